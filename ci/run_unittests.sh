@@ -73,6 +73,7 @@ if [ "x$CVMFS_CACHE_PLUGIN" != "x" ]; then
   echo "CVMFS_CACHE_PLUGIN_LOCATOR=$CVMFS_CACHE_LOCATOR" > $CVMFS_CACHE_CONFIG
   echo "CVMFS_CACHE_PLUGIN_SIZE=1000" >> $CVMFS_CACHE_CONFIG
   echo "CVMFS_CACHE_PLUGIN_TEST=yes" >> $CVMFS_CACHE_CONFIG
+  echo "CVMFS_CACHE_PLUGIN_THREADS=4" >> $CVMFS_CACHE_CONFIG
   for plugin in $(echo $CVMFS_CACHE_PLUGIN | tr : " "); do
     if [ -x $plugin ]; then
       echo "running unit tests for cache plugin $plugin"
@@ -89,6 +90,14 @@ if [ "x$CVMFS_CACHE_PLUGIN" != "x" ]; then
   rm -f $CVMFS_CACHE_CONFIG
 fi
 
+# run the allocation tests, they replace the global operator new
+CVMFS_ALLOC_UNITTESTS="$(dirname $CVMFS_UNITTESTS_BINARY)/cvmfs_test_alloc"
+if [ -x $CVMFS_ALLOC_UNITTESTS ]; then
+  echo "running allocation unit tests"
+  $CVMFS_ALLOC_UNITTESTS \
+    --gtest_output=xml:${CVMFS_UNITTESTS_RESULT_LOCATION}.alloc
+fi
+
 # run the unit tests
 echo "running unit tests (with XML output $CVMFS_UNITTESTS_RESULT_LOCATION)..."
 $CVMFS_UNITTESTS_BINARY --gtest_shuffle                                     \
@@ -0,0 +1,144 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "async_executor.h"
+
+#include <cassert>
+
+#include "clientctx.h"
+#include "logging.h"
+#include "statistics.h"
+#include "util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+namespace cvmfs {
+
+AsyncExecutor::AsyncExecutor(
+  unsigned num_threads,
+  perf::Counter *n_submitted,
+  perf::Counter *n_rejected)
+  : num_threads_((num_threads < kMaxThreads) ? num_threads : kMaxThreads)
+  , spawned_(false)
+  , terminated_(false)
+  , draining_(false)
+  , num_running_(0)
+  , n_submitted_(n_submitted)
+  , n_rejected_(n_rejected)
+{
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&cond_jobs_, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&cond_idle_, NULL);
+  assert(retval == 0);
+}
+
+
+AsyncExecutor::~AsyncExecutor() {
+  pthread_mutex_lock(&lock_);
+  terminated_ = true;
+  pthread_cond_broadcast(&cond_jobs_);
+  pthread_mutex_unlock(&lock_);
+  for (unsigned i = 0; i < threads_.size(); ++i)
+    pthread_join(threads_[i], NULL);
+  // Without workers, jobs are never queued
+  assert(jobs_.empty());
+  pthread_cond_destroy(&cond_idle_);
+  pthread_cond_destroy(&cond_jobs_);
+  pthread_mutex_destroy(&lock_);
+}
+
+
+/**
+ * Takes a job from the queue and returns only when terminated and the queue
+ * is drained.
+ */
+void *AsyncExecutor::MainWorker(void *data) {
+  AsyncExecutor *executor = reinterpret_cast<AsyncExecutor *>(data);
+  LogCvmfs(kLogCvmfs, kLogDebug, "starting asynchronous request worker");
+
+  while (true) {
+    pthread_mutex_lock(&executor->lock_);
+    while (executor->jobs_.empty() && !executor->terminated_)
+      pthread_cond_wait(&executor->cond_jobs_, &executor->lock_);
+    if (executor->jobs_.empty()) {
+      pthread_mutex_unlock(&executor->lock_);
+      break;
+    }
+    Job job = executor->jobs_.front();
+    executor->jobs_.pop_front();
+    executor->num_running_++;
+    pthread_mutex_unlock(&executor->lock_);
+
+    ProcessJob(job);
+
+    pthread_mutex_lock(&executor->lock_);
+    executor->num_running_--;
+    if (executor->jobs_.empty() && (executor->num_running_ == 0))
+      pthread_cond_broadcast(&executor->cond_idle_);
+    pthread_mutex_unlock(&executor->lock_);
+  }
+
+  LogCvmfs(kLogCvmfs, kLogDebug, "stopping asynchronous request worker");
+  return NULL;
+}
+
+
+void AsyncExecutor::ProcessJob(const Job &job) {
+  if (job.has_ctx)
+    ClientCtx::GetInstance()->Set(job.uid, job.gid, job.pid);
+  job.function(job.data);
+  if (job.has_ctx)
+    ClientCtx::GetInstance()->Unset();
+}
+
+
+bool AsyncExecutor::Submit(Function function, void *data) {
+  Job job;
+  job.function = function;
+  job.data = data;
+  ClientCtx *ctx = ClientCtx::GetInstance();
+  if (ctx->IsSet()) {
+    job.has_ctx = true;
+    ctx->Get(&job.uid, &job.gid, &job.pid);
+  }
+
+  MutexLockGuard lock_guard(&lock_);
+  if (!spawned_ || terminated_ || draining_)
+    return false;
+  if (jobs_.size() >= kMaxQueueLength) {
+    if (n_rejected_) perf::Inc(n_rejected_);
+    return false;
+  }
+  jobs_.push_back(job);
+  pthread_cond_signal(&cond_jobs_);
+  if (n_submitted_) perf::Inc(n_submitted_);
+  return true;
+}
+
+
+void AsyncExecutor::Drain() {
+  MutexLockGuard lock_guard(&lock_);
+  draining_ = true;
+  while (!jobs_.empty() || (num_running_ > 0))
+    pthread_cond_wait(&cond_idle_, &lock_);
+}
+
+
+void AsyncExecutor::Spawn() {
+  assert(!spawned_);
+  if (num_threads_ == 0)
+    return;
+  threads_.resize(num_threads_);
+  for (unsigned i = 0; i < num_threads_; ++i) {
+    int retval = pthread_create(&threads_[i], NULL, MainWorker, this);
+    assert(retval == 0);
+  }
+  MutexLockGuard lock_guard(&lock_);
+  spawned_ = true;
+}
+
+}  // namespace cvmfs
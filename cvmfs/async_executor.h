@@ -0,0 +1,119 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_ASYNC_EXECUTOR_H_
+#define CVMFS_ASYNC_EXECUTOR_H_
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <deque>
+#include <vector>
+
+#include "gtest/gtest_prod.h"
+#include "util/single_copy.h"
+
+namespace perf {
+class Counter;
+}
+
+namespace cvmfs {
+
+/**
+ * A small pool of worker threads that takes over fuse requests which need to
+ * download an object.  The fuse callback hands the request (including the
+ * fuse_req_t) over to the pool and returns, so that the libfuse worker thread
+ * is free for other requests.  The worker replies to the request once the
+ * download finished.  Thereby, a burst of downloads of large objects does not
+ * occupy all the libfuse threads and metadata requests are still served.
+ *
+ * Unlike the read-ahead, jobs cannot be dropped: every job owns a request
+ * that needs a reply.  If the queue is full or the pool is not running,
+ * Submit() returns false and the caller processes the request itself.  On
+ * destruction, the queued jobs are processed before the workers stop.
+ *
+ * Jobs change open file handles and the open files counter, so before the
+ * state of the file system is saved, the executor needs to be drained.
+ */
+class AsyncExecutor : SingleCopy {
+  FRIEND_TEST(T_AsyncExecutor, Submit);
+  FRIEND_TEST(T_AsyncExecutor, QueueFull);
+  FRIEND_TEST(T_AsyncExecutor, Drain);
+
+ public:
+  typedef void (*Function)(void *data);
+
+  static const unsigned kMaxThreads = 64;
+  /**
+   * Maximum number of queued (not yet processing) requests.
+   */
+  static const unsigned kMaxQueueLength = 256;
+
+  AsyncExecutor(unsigned num_threads,
+                perf::Counter *n_submitted,
+                perf::Counter *n_rejected);
+  ~AsyncExecutor();
+  void Spawn();
+
+  /**
+   * Queues function(data) and returns true.  The function runs in a worker
+   * thread with the client context of the calling thread.  Returns false
+   * without taking ownership of data if the job cannot be queued.
+   */
+  bool Submit(Function function, void *data);
+  /**
+   * Refuses new jobs from now on and waits until the queued and the running
+   * jobs are processed.
+   */
+  void Drain();
+
+  unsigned num_threads() const { return num_threads_; }
+
+ private:
+  struct Job {
+    Job()
+      : function(NULL)
+      , data(NULL)
+      , has_ctx(false)
+      , uid(-1)
+      , gid(-1)
+      , pid(-1)
+    { }
+    Function function;
+    void *data;
+    bool has_ctx;
+    uid_t uid;
+    gid_t gid;
+    pid_t pid;
+  };
+
+  static void *MainWorker(void *data);
+  static void ProcessJob(const Job &job);
+
+  unsigned num_threads_;
+  bool spawned_;
+  bool terminated_;
+  /**
+   * Set by Drain(), Submit() fails from then on
+   */
+  bool draining_;
+  /**
+   * Jobs taken from the queue that are not yet finished
+   */
+  unsigned num_running_;
+  std::vector<pthread_t> threads_;
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_jobs_;
+  /**
+   * Signaled when the last job finished and the queue is empty
+   */
+  pthread_cond_t cond_idle_;
+  std::deque<Job> jobs_;
+  perf::Counter *n_submitted_;
+  perf::Counter *n_rejected_;
+};
+
+}  // namespace cvmfs
+
+#endif  // CVMFS_ASYNC_EXECUTOR_H_
@@ -85,6 +85,32 @@ atomic_cas64(atomic_int64 *a, int64_t cmp, int64_t newval) {
   return __sync_bool_compare_and_swap(a, cmp, newval);
 }
 
+/**
+ * Publication of a pointer to immutable data: a reader that loads the pointer
+ * sees the pointee as initialized before the store.  Unlike atomic_read32(),
+ * the load is a plain move on x86.
+ */
+static void inline __attribute__((used)) *
+atomic_load_acquire(void * const *a) {
+#ifdef __ATOMIC_ACQUIRE
+  return __atomic_load_n(a, __ATOMIC_ACQUIRE);
+#else
+  void *value = *const_cast<void * const volatile *>(a);
+  __sync_synchronize();
+  return value;
+#endif
+}
+
+static void inline __attribute__((used))
+atomic_store_release(void **a, void *value) {
+#ifdef __ATOMIC_RELEASE
+  __atomic_store_n(a, value, __ATOMIC_RELEASE);
+#else
+  __sync_synchronize();
+  *const_cast<void * volatile *>(a) = value;
+#endif
+}
+
 static void inline __attribute__((used)) MemoryFence() {
   asm __volatile__("" : : : "memory");
 }
@@ -20,17 +20,18 @@
 using namespace std;  // NOLINT
 
 
-namespace {
-
-struct sslctx_info {
-  sslctx_info() : chain(NULL), pkey(NULL) {}
+struct AuthzAttachment::sslctx_info {
+  sslctx_info() : chain(NULL), pkey(NULL), refcount(0) {}
 
   STACK_OF(X509) *chain;
   EVP_PKEY *pkey;
+  /**
+   * Number of transfers using the credentials, protected by lock_credentials_
+   */
+  unsigned refcount;
+  shash::Any token_hash;
 };
 
-}  // anonymous namespace
-
 
 bool AuthzAttachment::ssl_strings_loaded_ = false;
 
@@ -41,6 +42,18 @@ AuthzAttachment::AuthzAttachment(AuthzSessionManager *sm)
   // Required for logging OpenSSL errors
   SSL_load_error_strings();
   ssl_strings_loaded_ = true;
+  int retval = pthread_mutex_init(&lock_credentials_, NULL);
+  assert(retval == 0);
+}
+
+
+AuthzAttachment::~AuthzAttachment() {
+  for (std::map<shash::Any, sslctx_info *>::iterator i = credentials_.begin(),
+       iEnd = credentials_.end(); i != iEnd; ++i)
+  {
+    FreeSslCtxInfo(i->second);
+  }
+  pthread_mutex_destroy(&lock_credentials_);
 }
 
 
@@ -137,6 +150,56 @@ bool AuthzAttachment::ConfigureCurlHandle(
     return false;
   }
 
+  shash::Any token_hash(shash::kSha1);
+  shash::HashMem(reinterpret_cast<unsigned char *>(token->data),
+                 token->size, &token_hash);
+
+  sslctx_info *result = NULL;
+  {
+    MutexLockGuard guard(&lock_credentials_);
+    std::map<shash::Any, sslctx_info *>::const_iterator iter =
+      credentials_.find(token_hash);
+    if (iter != credentials_.end()) {
+      result = iter->second;
+      result->refcount++;
+    }
+  }
+
+  if (result == NULL) {
+    sslctx_info *parsed = ParseToken(token->data, token->size);
+    if (parsed == NULL)
+      return false;
+    parsed->token_hash = token_hash;
+
+    MutexLockGuard guard(&lock_credentials_);
+    std::map<shash::Any, sslctx_info *>::const_iterator iter =
+      credentials_.find(token_hash);
+    if (iter != credentials_.end()) {
+      // Another thread was faster in parsing the same token
+      FreeSslCtxInfo(parsed);
+      result = iter->second;
+    } else {
+      result = parsed;
+      credentials_[token_hash] = result;
+    }
+    result->refcount++;
+  }
+
+  curl_easy_setopt(curl_handle, CURLOPT_SSL_CTX_DATA, result);
+  *info_data = result;
+  return true;
+}
+
+
+/**
+ * Extracts the certificate chain and the private key from a PEM token.
+ * Returns NULL if the token does not contain usable credentials.
+ */
+AuthzAttachment::sslctx_info *AuthzAttachment::ParseToken(
+  void *data,
+  unsigned size)
+{
+  int retval;
   UniquePtr<sslctx_info> parm(new sslctx_info);
 
   STACK_OF(X509_INFO) *sk = NULL;
@@ -144,10 +207,10 @@ bool AuthzAttachment::ConfigureCurlHandle(
   parm->chain = certstack;
   if (certstack == NULL) {
     LogCvmfs(kLogAuthz, kLogSyslogErr, "Failed to allocate new X509 chain.");
-    return false;
+    return NULL;
   }
 
-  BIO *bio_token = BIO_new_mem_buf(token->data, token->size);
+  BIO *bio_token = BIO_new_mem_buf(data, size);
   assert(bio_token != NULL);
   sk = PEM_X509_INFO_read_bio(bio_token, NULL, NULL, NULL);
   BIO_free(bio_token);
@@ -155,7 +218,7 @@ bool AuthzAttachment::ConfigureCurlHandle(
     LogOpenSSLErrors("Failed to load credential file.");
     sk_X509_INFO_free(sk);
     sk_X509_free(certstack);
-    return false;
+    return NULL;
   }
 
   while (sk_X509_INFO_num(sk)) {
@@ -186,7 +249,7 @@ bool AuthzAttachment::ConfigureCurlHandle(
   if (parm->pkey == NULL) {
     // Sigh - PEM_X509_INFO_read doesn't understand old key encodings.
     // Try a more general-purpose funciton.
-    BIO *bio_token = BIO_new_mem_buf(token->data, token->size);
+    BIO *bio_token = BIO_new_mem_buf(data, size);
     assert(bio_token != NULL);
     EVP_PKEY *old_pkey = PEM_read_bio_PrivateKey(bio_token, NULL, NULL, NULL);
     BIO_free(bio_token);
@@ -196,7 +259,7 @@ bool AuthzAttachment::ConfigureCurlHandle(
       sk_X509_free(certstack);
       LogCvmfs(kLogAuthz, kLogSyslogErr,
                "credential did not contain a decrypted private key.");
-      return false;
+      return NULL;
     }
   }
 
@@ -205,16 +268,45 @@ bool AuthzAttachment::ConfigureCurlHandle(
     sk_X509_free(certstack);
     LogCvmfs(kLogAuthz, kLogSyslogErr,
              "Credential file did not contain any actual credentials.");
-    return false;
+    return NULL;
   } else {
     LogCvmfs(kLogAuthz, kLogDebug, "Certificate stack contains %d entries.",
              sk_X509_num(certstack));
   }
 
-  sslctx_info *result = parm.Release();
-  curl_easy_setopt(curl_handle, CURLOPT_SSL_CTX_DATA, result);
-  *info_data = result;
-  return true;
+  return parm.Release();
+}
+
+
+void AuthzAttachment::FreeSslCtxInfo(sslctx_info *info) {
+  STACK_OF(X509) *chain = info->chain;
+  EVP_PKEY *pkey = info->pkey;
+  info->chain = NULL;
+  info->pkey = NULL;
+  delete info;
+
+  // Calls X509_free on each element, then frees the stack itself
+  sk_X509_pop_free(chain, X509_free);
+  EVP_PKEY_free(pkey);
+}
+
+
+/**
+ * Drops unused credentials until the cache is back to its maximum size.
+ * Called with lock_credentials_ held.
+ */
+void AuthzAttachment::EvictCredentials() {
+  std::map<shash::Any, sslctx_info *>::iterator i = credentials_.begin();
+  while ((credentials_.size() > kMaxCachedCredentials) &&
+         (i != credentials_.end()))
+  {
+    if (i->second->refcount > 0) {
+      ++i;
+      continue;
+    }
+    FreeSslCtxInfo(i->second);
+    credentials_.erase(i++);
+  }
 }
 
 
@@ -232,17 +324,15 @@ void AuthzAttachment::LogOpenSSLErrors(const char *top_message) {
 
 void AuthzAttachment::ReleaseCurlHandle(CURL *curl_handle, void *info_data) {
   sslctx_info *p = reinterpret_cast<sslctx_info *>(info_data);
-  STACK_OF(X509) *chain = p->chain;
-  EVP_PKEY *pkey = p->pkey;
-  p->chain = NULL;
-  p->pkey = NULL;
-  delete p;
-
-  // Calls X509_free on each element, then frees the stack itself
-  sk_X509_pop_free(chain, X509_free);
-  EVP_PKEY_free(pkey);
+  {
+    MutexLockGuard guard(&lock_credentials_);
+    assert(p->refcount > 0);
+    p->refcount--;
+    if (credentials_.size() > kMaxCachedCredentials)
+      EvictCredentials();
+  }
 
   // Make sure that if CVMFS reuses this curl handle, curl doesn't try
-  // to reuse cert chain we just freed.
+  // to reuse cert chain we might free.
   curl_easy_setopt(curl_handle, CURLOPT_SSL_CTX_DATA, 0);
 }
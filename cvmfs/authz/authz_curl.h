@@ -5,16 +5,26 @@
 #ifndef CVMFS_AUTHZ_AUTHZ_CURL_H_
 #define CVMFS_AUTHZ_AUTHZ_CURL_H_
 
+#include <pthread.h>
+
+#include <map>
 #include <string>
 
 #include "download.h"
+#include "hash.h"
 
 class AuthzSessionManager;
 
 class AuthzAttachment : public download::CredentialsAttachment {
  public:
+  /**
+   * Number of parsed credentials that are kept around after their last
+   * transfer finished.
+   */
+  static const unsigned kMaxCachedCredentials = 64;
+
   explicit AuthzAttachment(AuthzSessionManager *sm);
-  virtual ~AuthzAttachment() { }
+  virtual ~AuthzAttachment();
 
   virtual bool ConfigureCurlHandle(CURL *curl_handle,
                                    pid_t pid,
@@ -24,8 +34,14 @@ class AuthzAttachment : public download::CredentialsAttachment {
   void set_membership(const std::string &m) { membership_ = m; }
 
  private:
+  struct sslctx_info;
+
   static void LogOpenSSLErrors(const char *top_message);
   static CURLcode CallbackSslCtx(CURL *curl, void *sslctx, void *parm);
+  static sslctx_info *ParseToken(void *data, unsigned size);
+  static void FreeSslCtxInfo(sslctx_info *info);
+
+  void EvictCredentials();
 
   static bool ssl_strings_loaded_;
 
@@ -38,6 +54,14 @@ class AuthzAttachment : public download::CredentialsAttachment {
    * The required user group needs to be set on mount and remount by the client.
    */
   std::string membership_;
+
+  /**
+   * Parsing the PEM credentials is expensive.  The parsed certificate chain
+   * and private key are shared by all transfers with the same token, keyed by
+   * the token's content hash and reference counted by the transfers.
+   */
+  std::map<shash::Any, sslctx_info *> credentials_;
+  pthread_mutex_t lock_credentials_;
 };
 
 #endif  // CVMFS_AUTHZ_AUTHZ_CURL_H_
@@ -16,6 +16,7 @@
 #include <vector>
 
 #include "authz/authz_fetch.h"
+#include "authz/authz_shared.h"
 #include "logging.h"
 #include "platform.h"
 #include "statistics.h"
@@ -28,11 +29,13 @@ AuthzSessionManager::AuthzSessionManager()
   : deadline_sweep_pids_(0)
   , deadline_sweep_creds_(0)
   , authz_fetcher_(NULL)
+  , shared_cache_(NULL)
   , no_pid_(NULL)
   , no_session_(NULL)
   , n_fetch_(NULL)
   , n_grant_(NULL)
   , n_deny_(NULL)
+  , n_shared_(NULL)
 {
   int retval = pthread_mutex_init(&lock_pid2session_, NULL);
   assert(retval == 0);
@@ -45,6 +48,7 @@ AuthzSessionManager::AuthzSessionManager()
 
 
 AuthzSessionManager::~AuthzSessionManager() {
+  delete shared_cache_;
   int retval = pthread_mutex_destroy(&lock_pid2session_);
   assert(retval == 0);
   retval = pthread_mutex_destroy(&lock_session2cred_);
@@ -76,11 +80,19 @@ AuthzSessionManager *AuthzSessionManager::Create(
     "authz.n_grant", "overall number of granted membership queries");
   authz_mgr->n_deny_ = statistics->Register(
     "authz.n_deny", "overall number of denied membership queries");
+  authz_mgr->n_shared_ = statistics->Register(
+    "authz.n_shared", "overall number of decisions from the shared cache");
 
   return authz_mgr;
 }
 
 
+void AuthzSessionManager::SetSharedCache(AuthzSharedCache *shared_cache) {
+  delete shared_cache_;
+  shared_cache_ = shared_cache;
+}
+
+
 /**
  * Gathers SID, birthday, uid, and gid from given PID.
  */
@@ -192,19 +204,22 @@ bool AuthzSessionManager::IsMemberOf(
     return false;
 
   AuthzData authz_data;
-  return LookupAuthzData(pid_key, session_key, membership, &authz_data);
+  return LookupAuthzData(pid_key, session_key, membership, &authz_data, false);
 }
 
 
 /**
  * Calls out to the AuthzFetcher if the data is not cached.  Verifies the
- * membership.
+ * membership.  Negative decisions from the shared cache are copied into the
+ * local cache.  Positive decisions from the shared cache carry no token, so
+ * they are only used if no token is needed and they are not cached locally.
  */
 bool AuthzSessionManager::LookupAuthzData(
   const PidKey &pid_key,
   const SessionKey &session_key,
   const std::string &membership,
-  AuthzData *authz_data)
+  AuthzData *authz_data,
+  const bool need_token)
 {
   assert(authz_data != NULL);
 
@@ -225,13 +240,42 @@ bool AuthzSessionManager::LookupAuthzData(
     return granted;
   }
 
+  const AuthzSharedCache::Key shared_key(session_key.sid, session_key.sid_bday,
+                                         pid_key.uid, pid_key.gid, membership);
+  unsigned ttl;
+  if (shared_cache_ != NULL) {
+    AuthzStatus status;
+    if (shared_cache_->Lookup(shared_key, &status, &ttl) &&
+        (!need_token || (status != kAuthzOk)))
+    {
+      LogCvmfs(kLogAuthz, kLogDebug,
+               "shared authz data for sid %d, membership %s, status %d",
+               session_key.sid, membership.c_str(), status);
+      perf::Inc(n_shared_);
+      if (status == kAuthzOk) {
+        perf::Inc(n_grant_);
+        return true;
+      }
+      authz_data->status = status;
+      authz_data->deadline = platform_monotonic_time() + ttl;
+      LockMutex(&lock_session2cred_);
+      if (!session2cred_.Contains(session_key))
+        perf::Inc(no_session_);
+      session2cred_.Insert(session_key, *authz_data);
+      UnlockMutex(&lock_session2cred_);
+      perf::Inc(n_deny_);
+      return false;
+    }
+  }
+
   // Not found in cache, ask for help
   perf::Inc(n_fetch_);
-  unsigned ttl;
   authz_data->status = authz_fetcher_->Fetch(
     AuthzFetcher::QueryInfo(pid_key.pid, pid_key.uid, pid_key.gid, membership),
     &(authz_data->token), &ttl);
   authz_data->deadline = platform_monotonic_time() + ttl;
+  if (shared_cache_ != NULL)
+    shared_cache_->Store(shared_key, authz_data->status, ttl);
   if (authz_data->status == kAuthzOk)
     authz_data->membership = membership;
   LogCvmfs(kLogAuthz, kLogDebug,
@@ -19,6 +19,7 @@
 #include "util/single_copy.h"
 
 class AuthzFetcher;
+class AuthzSharedCache;
 
 // TODO(jblomer): add audit log
 
@@ -39,10 +40,16 @@ class AuthzSessionManager : SingleCopy {
   FRIEND_TEST(T_AuthzSession, GetPidInfo);
   FRIEND_TEST(T_AuthzSession, LookupAuthzData);
   FRIEND_TEST(T_AuthzSession, LookupSessionKey);
+  FRIEND_TEST(T_AuthzSession, SharedCache);
 
  public:
   static AuthzSessionManager *Create(AuthzFetcher *authz_fetcher,
                                      perf::Statistics *statistics);
+  /**
+   * Takes ownership of the shared cache.  Must be called before the first
+   * query.
+   */
+  void SetSharedCache(AuthzSharedCache *shared_cache);
   ~AuthzSessionManager();
 
   AuthzToken *GetTokenCopy(const pid_t pid, const std::string &membership);
@@ -126,10 +133,15 @@ class AuthzSessionManager : SingleCopy {
   void MaySweepPids();
   void SweepPids(uint64_t now);
 
+  /**
+   * If need_token is false, a positive decision of another mount point from
+   * the shared cache suffices.
+   */
   bool LookupAuthzData(const PidKey &pid_key,
                        const SessionKey &session_key,
                        const std::string &membership,
-                       AuthzData *authz_data);
+                       AuthzData *authz_data,
+                       const bool need_token = true);
   void MaySweepCreds();
   void SweepCreds(uint64_t now);
 
@@ -153,11 +165,17 @@ class AuthzSessionManager : SingleCopy {
    */
   AuthzFetcher *authz_fetcher_;
 
+  /**
+   * Optional, decisions shared with the other mount points on the node.
+   */
+  AuthzSharedCache *shared_cache_;
+
   perf::Counter *no_pid_;
   perf::Counter *no_session_;
   perf::Counter *n_fetch_;
   perf::Counter *n_grant_;
   perf::Counter *n_deny_;
+  perf::Counter *n_shared_;
 };
 
 #endif  // CVMFS_AUTHZ_AUTHZ_SESSION_H_
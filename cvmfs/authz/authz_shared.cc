@@ -0,0 +1,240 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "authz/authz_shared.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstring>
+
+#include "atomic.h"
+#include "logging.h"
+#include "murmur.h"
+#include "platform.h"
+#include "util/pointer.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+const uint32_t AuthzSharedCache::kMagic;
+const uint32_t AuthzSharedCache::kVersion;
+const unsigned AuthzSharedCache::kNumEntries;
+const unsigned AuthzSharedCache::kNumProbes;
+
+
+AuthzSharedCache::AuthzSharedCache()
+  : fd_(-1)
+  , size_(sizeof(Header) + kNumEntries * sizeof(Entry))
+  , mapping_(NULL)
+  , header_(NULL)
+  , entries_(NULL)
+{ }
+
+
+AuthzSharedCache::~AuthzSharedCache() {
+  if (mapping_ != NULL)
+    munmap(mapping_, size_);
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+
+AuthzSharedCache *AuthzSharedCache::Open(const string &path) {
+  UniquePtr<AuthzSharedCache> cache(new AuthzSharedCache());
+  cache->path_ = path;
+  if (!cache->Init())
+    return NULL;
+  return cache.Release();
+}
+
+
+/**
+ * Creates or resets the file under an exclusive lock if it does not match the
+ * expected layout or if it has been written before the last reboot.
+ */
+bool AuthzSharedCache::Init() {
+  fd_ = open(path_.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd_ < 0) {
+    LogCvmfs(kLogAuthz, kLogDebug | kLogSyslogErr,
+             "failed to open shared authz cache %s (%d)", path_.c_str(), errno);
+    return false;
+  }
+  int retval = flock(fd_, LOCK_EX);
+  if (retval != 0)
+    return false;
+
+  const string boot_id = GetBootId();
+  Header header;
+  bool valid = false;
+  platform_stat64 info;
+  if ((platform_fstat(fd_, &info) == 0) &&
+      (static_cast<uint64_t>(info.st_size) == size_) &&
+      (pread(fd_, &header, sizeof(header), 0) ==
+       static_cast<ssize_t>(sizeof(header))))
+  {
+    valid = (header.magic == kMagic) && (header.version == kVersion) &&
+            (header.num_entries == kNumEntries) &&
+            (strncmp(header.boot_id, boot_id.c_str(), sizeof(header.boot_id))
+             == 0);
+  }
+  if (!valid) {
+    LogCvmfs(kLogAuthz, kLogDebug, "resetting shared authz cache %s",
+             path_.c_str());
+    memset(&header, 0, sizeof(header));
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.num_entries = kNumEntries;
+    strncpy(header.boot_id, boot_id.c_str(), sizeof(header.boot_id) - 1);
+    if ((ftruncate(fd_, 0) != 0) ||
+        (ftruncate(fd_, size_) != 0) ||
+        (pwrite(fd_, &header, sizeof(header), 0) !=
+         static_cast<ssize_t>(sizeof(header))))
+    {
+      LogCvmfs(kLogAuthz, kLogDebug | kLogSyslogErr,
+               "failed to initialize shared authz cache %s (%d)",
+               path_.c_str(), errno);
+      flock(fd_, LOCK_UN);
+      return false;
+    }
+  }
+  flock(fd_, LOCK_UN);
+
+  mapping_ = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (mapping_ == MAP_FAILED) {
+    mapping_ = NULL;
+    LogCvmfs(kLogAuthz, kLogDebug | kLogSyslogErr,
+             "failed to map shared authz cache %s (%d)", path_.c_str(), errno);
+    return false;
+  }
+  header_ = reinterpret_cast<Header *>(mapping_);
+  entries_ = reinterpret_cast<Entry *>(
+    reinterpret_cast<char *>(mapping_) + sizeof(Header));
+  return true;
+}
+
+
+/**
+ * Empty if the platform does not provide a boot id.
+ */
+string AuthzSharedCache::GetBootId() {
+  string boot_id;
+  int fd = open("/proc/sys/kernel/random/boot_id", O_RDONLY);
+  if (fd < 0)
+    return "";
+  SafeReadToString(fd, &boot_id);
+  close(fd);
+  return Trim(boot_id);
+}
+
+
+uint64_t AuthzSharedCache::HashMembership(const string &membership) {
+  return MurmurHash64A(membership.data(), membership.length(), 0x6d656d62);
+}
+
+
+uint64_t AuthzSharedCache::HashKey(const Key &key) {
+  struct {
+    uint64_t bday;
+    uint64_t membership;
+    pid_t sid;
+    uid_t uid;
+    gid_t gid;
+  } __attribute__((packed)) key_info;
+  key_info.bday = key.sid_bday;
+  key_info.membership = HashMembership(key.membership);
+  key_info.sid = key.sid;
+  key_info.uid = key.uid;
+  key_info.gid = key.gid;
+  return MurmurHash64A(&key_info, sizeof(key_info), 0x07387a4f);
+}
+
+
+bool AuthzSharedCache::Matches(
+  const Entry &entry,
+  const Key &key,
+  const uint64_t membership_hash)
+{
+  return (entry.sid == key.sid) &&
+         (entry.sid_bday == key.sid_bday) &&
+         (entry.uid == static_cast<uint32_t>(key.uid)) &&
+         (entry.gid == static_cast<uint32_t>(key.gid)) &&
+         (entry.membership_hash == membership_hash);
+}
+
+
+bool AuthzSharedCache::Lookup(
+  const Key &key,
+  AuthzStatus *status,
+  unsigned *ttl)
+{
+  const uint64_t membership_hash = HashMembership(key.membership);
+  const uint64_t hash = HashKey(key);
+  const int64_t now = time(NULL);
+  for (unsigned i = 0; i < kNumProbes; ++i) {
+    Entry *slot = &entries_[(hash + i) & (kNumEntries - 1)];
+    const int32_t seq = atomic_read32(&slot->seq);
+    if (seq & 1)
+      continue;
+    Entry entry;
+    memcpy(&entry, slot, sizeof(entry));
+    __sync_synchronize();
+    if (atomic_read32(&slot->seq) != seq)
+      continue;
+    if (!Matches(entry, key, membership_hash))
+      continue;
+    if (entry.deadline < now)
+      return false;
+    *status = static_cast<AuthzStatus>(entry.status);
+    *ttl = entry.deadline - now;
+    return true;
+  }
+  return false;
+}
+
+
+/**
+ * Replaces the entry of the same key, an expired entry, or the entry with the
+ * closest deadline among the probed slots.
+ */
+void AuthzSharedCache::Store(
+  const Key &key,
+  const AuthzStatus status,
+  const unsigned ttl)
+{
+  const uint64_t membership_hash = HashMembership(key.membership);
+  const uint64_t hash = HashKey(key);
+  const int64_t now = time(NULL);
+  Entry *victim = NULL;
+  for (unsigned i = 0; i < kNumProbes; ++i) {
+    Entry *slot = &entries_[(hash + i) & (kNumEntries - 1)];
+    if (Matches(*slot, key, membership_hash)) {
+      victim = slot;
+      break;
+    }
+    if ((victim == NULL) || (slot->deadline < victim->deadline))
+      victim = slot;
+    if (slot->deadline < now)
+      break;
+  }
+
+  const int32_t seq = atomic_read32(&victim->seq);
+  if ((seq & 1) || !atomic_cas32(&victim->seq, seq, seq + 1))
+    return;
+  victim->status = status;
+  victim->sid = key.sid;
+  victim->uid = key.uid;
+  victim->gid = key.gid;
+  victim->sid_bday = key.sid_bday;
+  victim->membership_hash = membership_hash;
+  victim->deadline = now + ttl;
+  __sync_synchronize();
+  atomic_cas32(&victim->seq, seq + 1, seq + 2);
+}
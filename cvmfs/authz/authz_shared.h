@@ -0,0 +1,110 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_AUTHZ_AUTHZ_SHARED_H_
+#define CVMFS_AUTHZ_AUTHZ_SHARED_H_
+
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <ctime>
+#include <string>
+
+#include "authz/authz.h"
+#include "gtest/gtest_prod.h"
+#include "util/single_copy.h"
+
+/**
+ * A node-wide cache of authorization decisions.  It is a fixed-size table in a
+ * file that all the cvmfs2 processes sharing a cache directory map with
+ * MAP_SHARED.  Thus a session that is authorized by one mount point does not
+ * need to be authorized again by the other mount points.
+ *
+ * Only the decision (status and lifetime) is shared, not the credentials.
+ * Mount points that need the token for downloading still ask the helper.
+ *
+ * Entries are keyed by the session (sid and its birthday), the uid, the gid
+ * and the membership string.  Every slot is protected by a sequence number
+ * that is odd while the slot is being written.  A reader that races with a
+ * writer treats the slot as a miss; a writer that races with another writer
+ * drops its entry.  Deadlines are in wall clock time because monotonic clocks
+ * do not survive reboots, and the table is reset if the boot id changes.
+ */
+class AuthzSharedCache : SingleCopy {
+  FRIEND_TEST(T_AuthzShared, Collisions);
+
+ public:
+  static const uint32_t kMagic = 0x5a485441;  // "ATHZ" in little endian
+  static const uint32_t kVersion = 1;
+  /**
+   * Must be a power of 2.  Makes for a 512kB file.
+   */
+  static const unsigned kNumEntries = 8192;
+  /**
+   * Number of slots that are tried when looking up or storing an entry.
+   */
+  static const unsigned kNumProbes = 8;
+
+  struct Key {
+    Key() : sid(-1), uid(-1), gid(-1), sid_bday(0) { }
+    Key(pid_t s, uint64_t b, uid_t u, gid_t g, const std::string &m)
+      : sid(s), uid(u), gid(g), sid_bday(b), membership(m) { }
+    pid_t sid;
+    uid_t uid;
+    gid_t gid;
+    uint64_t sid_bday;
+    std::string membership;
+  };
+
+  static AuthzSharedCache *Open(const std::string &path);
+  ~AuthzSharedCache();
+
+  /**
+   * Returns false if there is no valid entry.  Otherwise, ttl is set to the
+   * remaining lifetime of the entry in seconds.
+   */
+  bool Lookup(const Key &key, AuthzStatus *status, unsigned *ttl);
+  void Store(const Key &key, const AuthzStatus status, const unsigned ttl);
+
+  std::string path() const { return path_; }
+
+ private:
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_entries;
+    uint32_t padding;
+    char boot_id[48];
+  };
+
+  struct Entry {
+    int32_t seq;
+    int32_t status;
+    int32_t sid;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t padding;
+    uint64_t sid_bday;
+    uint64_t membership_hash;
+    int64_t deadline;
+  };
+
+  static std::string GetBootId();
+  static uint64_t HashKey(const Key &key);
+  static uint64_t HashMembership(const std::string &membership);
+  static bool Matches(const Entry &entry, const Key &key,
+                      const uint64_t membership_hash);
+
+  AuthzSharedCache();
+  bool Init();
+
+  std::string path_;
+  int fd_;
+  size_t size_;
+  void *mapping_;
+  Header *header_;
+  Entry *entries_;
+};
+
+#endif  // CVMFS_AUTHZ_AUTHZ_SHARED_H_
@@ -1,17 +1,21 @@
 /**
  * This file is part of the CernVM File System.
  *
- * Exponential backoff (sleep) with cutoff.
+ * Exponential backoff (sleep) with cutoff and bandwidth limits.
  */
 
 #include "cvmfs_config.h"
 #include "backoff.h"
 
+#include <algorithm>
+#include <cassert>
 #include <ctime>
 
 #include "logging.h"
+#include "platform.h"
 #include "smalloc.h"
 #include "util/posix.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
@@ -70,3 +74,182 @@ void BackoffThrottle::Throttle() {
   last_throttle_ = now;
   pthread_mutex_unlock(lock_);
 }
+
+
+//------------------------------------------------------------------------------
+
+
+BandwidthThrottle::BandwidthThrottle(const uint64_t bytes_per_second)
+  : bytes_per_second_(bytes_per_second)
+  , start_ms_(platform_monotonic_time_ns() / (1000 * 1000))
+  , consumed_bytes_(0)
+{
+  assert(bytes_per_second_ > 0);
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+}
+
+
+BandwidthThrottle::~BandwidthThrottle() {
+  pthread_mutex_destroy(&lock_);
+}
+
+
+namespace {
+
+/**
+ * Time it takes to transfer nbytes at the limit, avoids overflows for large
+ * numbers of bytes
+ */
+uint64_t GetTransferMs(const uint64_t nbytes, const uint64_t bytes_per_second)
+{
+  return (nbytes / bytes_per_second) * 1000 +
+         (nbytes % bytes_per_second) * 1000 / bytes_per_second;
+}
+
+}  // anonymous namespace
+
+
+/**
+ * Time to wait until consumed_bytes are within the limit
+ */
+uint64_t BandwidthThrottle::GetDelayMs(const uint64_t consumed_bytes,
+                                       const uint64_t elapsed_ms,
+                                       const uint64_t bytes_per_second)
+{
+  const uint64_t expected_ms = GetTransferMs(consumed_bytes, bytes_per_second);
+  return (expected_ms > elapsed_ms) ? expected_ms - elapsed_ms : 0;
+}
+
+
+void BandwidthThrottle::Consume(const uint64_t nbytes) {
+  uint64_t delay_ms;
+  {
+    MutexLockGuard guard(&lock_);
+    const uint64_t now_ms = platform_monotonic_time_ns() / (1000 * 1000);
+    // Forget about the bandwidth that was not used for a longer time
+    const uint64_t expected_ms =
+      GetTransferMs(consumed_bytes_, bytes_per_second_);
+    if (now_ms - start_ms_ > expected_ms + kMaxBurstMs)
+      start_ms_ = now_ms - expected_ms - kMaxBurstMs;
+    consumed_bytes_ += nbytes;
+    delay_ms = GetDelayMs(consumed_bytes_, now_ms - start_ms_,
+                          bytes_per_second_);
+  }
+  if (delay_ms > 0)
+    SafeSleepMs(delay_ms);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+namespace {
+
+uint64_t GetNowMs() {
+  return platform_monotonic_time_ns() / (1000 * 1000);
+}
+
+}  // anonymous namespace
+
+
+void CircuitBreakers::Init(const unsigned failure_threshold,
+                           const unsigned open_ms,
+                           const unsigned max_open_ms)
+{
+  assert(failure_threshold > 0);
+  assert(open_ms <= max_open_ms);
+  failure_threshold_ = failure_threshold;
+  open_ms_ = open_ms;
+  max_open_ms_ = max_open_ms;
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+}
+
+
+CircuitBreakers::~CircuitBreakers() {
+  pthread_mutex_destroy(&lock_);
+}
+
+
+bool CircuitBreakers::Allow(const string &endpoint) {
+  MutexLockGuard guard(&lock_);
+  map<string, Endpoint>::iterator i = endpoints_.find(endpoint);
+  if ((i == endpoints_.end()) || (i->second.state == kStateClosed))
+    return true;
+
+  const uint64_t now_ms = GetNowMs();
+  if (now_ms < i->second.timestamp_retry_ms)
+    return false;
+  i->second.state = kStateHalfOpen;
+  i->second.timestamp_retry_ms = now_ms + i->second.open_ms;
+  LogCvmfs(kLogDownload, kLogDebug, "probing endpoint %s", endpoint.c_str());
+  return true;
+}
+
+
+bool CircuitBreakers::IsOpen(const string &endpoint) {
+  return GetWaitMs(endpoint) > 0;
+}
+
+
+uint64_t CircuitBreakers::GetWaitMs(const string &endpoint) {
+  MutexLockGuard guard(&lock_);
+  map<string, Endpoint>::const_iterator i = endpoints_.find(endpoint);
+  if ((i == endpoints_.end()) || (i->second.state == kStateClosed))
+    return 0;
+  const uint64_t now_ms = GetNowMs();
+  return (now_ms < i->second.timestamp_retry_ms) ?
+         i->second.timestamp_retry_ms - now_ms : 0;
+}
+
+
+CircuitBreakers::State CircuitBreakers::GetState(const string &endpoint) {
+  MutexLockGuard guard(&lock_);
+  map<string, Endpoint>::const_iterator i = endpoints_.find(endpoint);
+  return (i == endpoints_.end()) ? kStateClosed : i->second.state;
+}
+
+
+void CircuitBreakers::ReportSuccess(const string &endpoint) {
+  MutexLockGuard guard(&lock_);
+  map<string, Endpoint>::iterator i = endpoints_.find(endpoint);
+  if (i == endpoints_.end())
+    return;
+  if (i->second.state != kStateClosed) {
+    LogCvmfs(kLogDownload, kLogDebug | kLogSyslog,
+             "endpoint %s recovered", endpoint.c_str());
+  }
+  endpoints_.erase(i);
+}
+
+
+void CircuitBreakers::ReportFailure(const string &endpoint) {
+  MutexLockGuard guard(&lock_);
+  Endpoint *e = &endpoints_[endpoint];
+  e->num_failures++;
+  switch (e->state) {
+    case kStateClosed:
+      if (e->num_failures < failure_threshold_)
+        return;
+      e->open_ms = open_ms_;
+      break;
+    case kStateHalfOpen:
+      e->open_ms = min(2 * e->open_ms, max_open_ms_);
+      break;
+    case kStateOpen:
+      // Failures of transfers that started before the circuit opened
+      return;
+  }
+  e->state = kStateOpen;
+  e->timestamp_retry_ms = GetNowMs() + e->open_ms;
+  LogCvmfs(kLogDownload, kLogDebug | kLogSyslogWarn,
+           "skipping endpoint %s for %u ms after %u failures",
+           endpoint.c_str(), e->open_ms, e->num_failures);
+}
+
+
+void CircuitBreakers::Reset() {
+  MutexLockGuard guard(&lock_);
+  endpoints_.clear();
+}
@@ -6,6 +6,10 @@
 #define CVMFS_BACKOFF_H_
 
 #include <pthread.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
 
 #include "prng.h"
 #include "util/single_copy.h"
@@ -50,4 +54,108 @@ class BackoffThrottle : public SingleCopy {
   pthread_mutex_t *lock_;
 };
 
+
+/**
+ * Limits the rate at which several threads together read or transfer data.
+ * Short bursts of up to kMaxBurstMs worth of data are allowed after idle
+ * periods.
+ */
+class BandwidthThrottle : public SingleCopy {
+ public:
+  static const uint64_t kMaxBurstMs = 1000;
+
+  explicit BandwidthThrottle(const uint64_t bytes_per_second);
+  ~BandwidthThrottle();
+  /**
+   * Accounts for nbytes read and sleeps if the limit is exceeded
+   */
+  void Consume(const uint64_t nbytes);
+
+  static uint64_t GetDelayMs(const uint64_t consumed_bytes,
+                             const uint64_t elapsed_ms,
+                             const uint64_t bytes_per_second);
+
+ private:
+  uint64_t bytes_per_second_;
+  uint64_t start_ms_;
+  uint64_t consumed_bytes_;
+  pthread_mutex_t lock_;
+};
+
+
+/**
+ * Per-endpoint circuit breakers, shared by all the transfers of a download or
+ * upload manager.  An endpoint (a host or a proxy) that failed
+ * failure_threshold times in a row is "open": Allow() refuses it for open_ms
+ * so that the transfers skip it right away.  Thereafter, the endpoint is
+ * "half-open" and a single transfer is let through as a probe.  A successful
+ * probe closes the circuit, a failed one reopens it for twice as long (up to
+ * max_open_ms).  If the probe does not report back, another one is let
+ * through after open_ms.
+ */
+class CircuitBreakers : public SingleCopy {
+ public:
+  enum State {
+    kStateClosed = 0,
+    kStateOpen,
+    kStateHalfOpen
+  };
+
+  static const unsigned kDefaultFailureThreshold = 3;
+  static const unsigned kDefaultOpenMs = 2000;
+  static const unsigned kDefaultMaxOpenMs = 60000;
+
+  CircuitBreakers() {
+    Init(kDefaultFailureThreshold, kDefaultOpenMs, kDefaultMaxOpenMs);
+  }
+  CircuitBreakers(const unsigned failure_threshold,
+                  const unsigned open_ms,
+                  const unsigned max_open_ms)
+  {
+    Init(failure_threshold, open_ms, max_open_ms);
+  }
+  ~CircuitBreakers();
+
+  /**
+   * Returns false if the endpoint should be skipped.  Turns a due open circuit
+   * into half-open and grants the calling transfer the probe.
+   */
+  bool Allow(const std::string &endpoint);
+  /**
+   * Like Allow() but without claiming the probe.
+   */
+  bool IsOpen(const std::string &endpoint);
+  /**
+   * Milliseconds until the endpoint can be probed again, 0 if closed or due.
+   */
+  uint64_t GetWaitMs(const std::string &endpoint);
+  State GetState(const std::string &endpoint);
+  void ReportSuccess(const std::string &endpoint);
+  void ReportFailure(const std::string &endpoint);
+  void Reset();
+
+ private:
+  struct Endpoint {
+    Endpoint()
+      : state(kStateClosed), num_failures(0), open_ms(0), timestamp_retry_ms(0)
+    { }
+    State state;
+    unsigned num_failures;  ///< consecutive failures
+    unsigned open_ms;
+    uint64_t timestamp_retry_ms;
+  };
+
+  void Init(const unsigned failure_threshold,
+            const unsigned open_ms,
+            const unsigned max_open_ms);
+  unsigned failure_threshold_;
+  unsigned open_ms_;
+  unsigned max_open_ms_;
+  /**
+   * Only endpoints with failures are tracked
+   */
+  std::map<std::string, Endpoint> endpoints_;
+  pthread_mutex_t lock_;
+};
+
 #endif  // CVMFS_BACKOFF_H_
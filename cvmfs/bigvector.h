@@ -64,6 +64,34 @@ class BigVector {
     size_++;
   }
 
+  /**
+   * Appends a default constructed item and returns it, so that the caller can
+   * fill it in place instead of copying a temporary item.
+   */
+  Item *PushBackDefault() {
+    if (size_ == capacity_)
+      DoubleCapacity();
+    new (buffer_ + size_) Item();
+    return &buffer_[size_++];
+  }
+
+  /**
+   * Grows the buffer to at least num_items, so that the following PushBack()
+   * calls do not need to copy the items on reallocation.
+   */
+  void Reserve(const size_t num_items) {
+    if (num_items <= capacity_)
+      return;
+    Item *old_buffer = buffer_;
+    bool old_large_alloc = large_alloc_;
+
+    Alloc(num_items);
+    for (size_t i = 0; i < size_; ++i)
+      new (buffer_ + i) Item(old_buffer[i]);
+
+    FreeBuffer(old_buffer, size_, old_large_alloc);
+  }
+
   bool IsEmpty() const {
     return size_ == 0;
   }
@@ -0,0 +1,60 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "bloom_filter.h"
+
+using namespace std;  // NOLINT
+
+const unsigned BloomFilter::kBitsPerKey;
+const unsigned BloomFilter::kNumProbes;
+
+
+/**
+ * The number of bits is rounded up to a multiple of 64.
+ */
+BloomFilter::BloomFilter(const uint64_t expected_keys)
+  : num_bits_(0)
+  , num_keys_(0)
+{
+  const uint64_t num_words = (expected_keys * kBitsPerKey + 63) / 64;
+  bitmap_.resize((num_words > 0) ? num_words : 1, 0);
+  num_bits_ = bitmap_.size() * 64;
+}
+
+
+void BloomFilter::Add(const shash::Md5 &md5path) {
+  uint64_t h1, h2;
+  md5path.ToIntPair(&h1, &h2);
+  Add(h1, h2);
+}
+
+
+void BloomFilter::Add(const uint64_t h1, uint64_t h2) {
+  // The number of bits is even, so an odd step is never zero modulo num_bits
+  h2 |= 1;
+  for (unsigned i = 0; i < kNumProbes; ++i) {
+    const uint64_t bit = (h1 + i * h2) % num_bits_;
+    bitmap_[bit / 64] |= uint64_t(1) << (bit % 64);
+  }
+  num_keys_++;
+}
+
+
+bool BloomFilter::MayContain(const shash::Md5 &md5path) const {
+  uint64_t h1, h2;
+  md5path.ToIntPair(&h1, &h2);
+  return MayContain(h1, h2);
+}
+
+
+bool BloomFilter::MayContain(const uint64_t h1, uint64_t h2) const {
+  h2 |= 1;
+  for (unsigned i = 0; i < kNumProbes; ++i) {
+    const uint64_t bit = (h1 + i * h2) % num_bits_;
+    if ((bitmap_[bit / 64] & (uint64_t(1) << (bit % 64))) == 0)
+      return false;
+  }
+  return true;
+}
@@ -0,0 +1,50 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_BLOOM_FILTER_H_
+#define CVMFS_BLOOM_FILTER_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "hash.h"
+#include "util/single_copy.h"
+
+/**
+ * A bloom filter over md5 path hashes.  MayContain() has no false negatives,
+ * so a negative answer saves the catalog query for a path that does not
+ * exist.
+ *
+ * The digests are already uniformly distributed.  Instead of rehashing the
+ * key, the probe positions are derived from the two 64 bit halves of the
+ * digest by double hashing.  With kBitsPerKey bits per key and kNumProbes
+ * probes, about 1% of the absent paths pass the filter.
+ */
+class BloomFilter : SingleCopy {
+ public:
+  static const unsigned kBitsPerKey = 10;
+  static const unsigned kNumProbes = 7;
+
+  explicit BloomFilter(const uint64_t expected_keys);
+
+  void Add(const shash::Md5 &md5path);
+  bool MayContain(const shash::Md5 &md5path) const;
+  /**
+   * For keys other than path hashes, given as two uniformly distributed
+   * 64 bit integers
+   */
+  void Add(const uint64_t h1, uint64_t h2);
+  bool MayContain(const uint64_t h1, uint64_t h2) const;
+
+  uint64_t num_bits() const { return num_bits_; }
+  uint64_t num_keys() const { return num_keys_; }
+
+ private:
+  uint64_t num_bits_;
+  uint64_t num_keys_;
+  std::vector<uint64_t> bitmap_;
+};
+
+#endif  // CVMFS_BLOOM_FILTER_H_
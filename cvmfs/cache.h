@@ -167,6 +167,13 @@ class CacheManager : SingleCopy {
   virtual int64_t Pread(int fd, void *buf, uint64_t size, uint64_t offset) = 0;
   virtual int Dup(int fd) = 0;
   virtual int Readahead(int fd) = 0;
+  /**
+   * If the cache manager's file descriptors are kernel file descriptors, the
+   * caller can use them directly, e.g. for splicing data into the fuse
+   * channel.  Returns the kernel file descriptor that belongs to fd or -1 if
+   * the backend does not support it.
+   */
+  virtual int GetNativeFd(int fd) { return -1; }
 
   virtual uint32_t SizeOfTxn() = 0;
   virtual int StartTxn(const shash::Any &id, uint64_t size, void *txn) = 0;
@@ -8,14 +8,13 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 #include <algorithm>
 #include <cassert>
-#ifdef __APPLE__
 #include <cstdlib>
-#endif
 #include <cstring>
 #include <map>
 #include <new>
@@ -26,9 +25,7 @@
 #include "cache.pb.h"
 #include "hash.h"
 #include "logging.h"
-#ifdef __APPLE__
 #include "smalloc.h"
-#endif
 #include "util/pointer.h"
 #include "util/posix.h"
 #include "util/string.h"
@@ -67,6 +64,14 @@ int Ack2Errno(cvmfs::EnumStatus status_code) {
   }
 }
 
+bool IsUnixSocket(int fd) {
+  struct sockaddr_storage addr;
+  socklen_t addr_len = sizeof(addr);
+  int retval =
+    getsockname(fd, reinterpret_cast<struct sockaddr *>(&addr), &addr_len);
+  return (retval == 0) && (addr.ss_family == AF_UNIX);
+}
+
 }  // anonymous namespace
 
 const shash::Any ExternalCacheManager::kInvalidHandle;
@@ -89,14 +94,37 @@ bool ExternalCacheManager::AcquireQuotaManager(QuotaManager *quota_mgr) {
 }
 
 
+int64_t ExternalCacheManager::AcquireShmSlot() {
+  if (shm_buffer_ == NULL)
+    return -1;
+  MutexLockGuard guard(lock_shm_);
+  if (shm_free_slots_.empty())
+    return -1;
+  uint64_t offset = shm_free_slots_.back();
+  shm_free_slots_.pop_back();
+  return offset;
+}
+
+
 void ExternalCacheManager::CallRemotely(ExternalCacheManager::RpcJob *rpc_job) {
   if (!spawned_) {
+    if (io_failed_) {
+      FailRpc(rpc_job);
+      return;
+    }
     transport_.SendFrame(rpc_job->frame_send());
     uint32_t save_att_size = rpc_job->frame_recv()->att_size();
     bool again;
     do {
       again = false;
       bool retval = transport_.RecvFrame(rpc_job->frame_recv());
+      if (!retval && io_errors_nonfatal_) {
+        LogCvmfs(kLogCache, kLogDebug | kLogSyslogWarn,
+                 "connection to cache plugin broke");
+        io_failed_ = true;
+        FailRpc(rpc_job);
+        return;
+      }
       assert(retval);
       if (rpc_job->frame_recv()->IsMsgOutOfBand()) {
         google::protobuf::MessageLite *msg_typed =
@@ -108,20 +136,72 @@ void ExternalCacheManager::CallRemotely(ExternalCacheManager::RpcJob *rpc_job) {
       }
     } while (again);
   } else {
-    Signal signal;
-    {
-      MutexLockGuard guard(lock_inflight_rpcs_);
-      inflight_rpcs_.push_back(RpcInFlight(rpc_job, &signal));
-    }
-    {
-      MutexLockGuard guard(lock_send_fd_);
-      transport_.SendFrame(rpc_job->frame_send());
-    }
-    signal.Wait();
+    Completion completion;
+    SendRpc(rpc_job, &completion);
+    completion.Wait();
   }
 }
 
 
+/**
+ * Fills in an I/O error reply of the matching type for a request that could
+ * not be answered by the plugin.
+ */
+void ExternalCacheManager::FailRpc(RpcJob *rpc_job) {
+  cvmfs::MsgRpc msg_rpc;
+  const string type_name = rpc_job->msg_req()->GetTypeName();
+  const uint64_t req_id = rpc_job->req_id();
+  if (type_name == "cvmfs.MsgRefcountReq") {
+    cvmfs::MsgRefcountReply *msg = msg_rpc.mutable_msg_refcount_reply();
+    msg->set_req_id(req_id);
+    msg->set_status(cvmfs::STATUS_IOERR);
+  } else if (type_name == "cvmfs.MsgObjectInfoReq") {
+    cvmfs::MsgObjectInfoReply *msg = msg_rpc.mutable_msg_object_info_reply();
+    msg->set_req_id(req_id);
+    msg->set_status(cvmfs::STATUS_IOERR);
+  } else if (type_name == "cvmfs.MsgReadReq") {
+    cvmfs::MsgReadReply *msg = msg_rpc.mutable_msg_read_reply();
+    msg->set_req_id(req_id);
+    msg->set_status(cvmfs::STATUS_IOERR);
+  } else if ((type_name == "cvmfs.MsgStoreReq") ||
+             (type_name == "cvmfs.MsgStoreAbortReq"))
+  {
+    cvmfs::MsgStoreReply *msg = msg_rpc.mutable_msg_store_reply();
+    msg->set_req_id(req_id);
+    msg->set_status(cvmfs::STATUS_IOERR);
+    msg->set_part_nr(rpc_job->part_nr());
+  } else if (type_name == "cvmfs.MsgInfoReq") {
+    cvmfs::MsgInfoReply *msg = msg_rpc.mutable_msg_info_reply();
+    msg->set_req_id(req_id);
+    msg->set_status(cvmfs::STATUS_IOERR);
+    msg->set_size_bytes(0);
+    msg->set_used_bytes(0);
+    msg->set_pinned_bytes(0);
+    msg->set_no_shrink(-1);
+  } else if (type_name == "cvmfs.MsgShrinkReq") {
+    cvmfs::MsgShrinkReply *msg = msg_rpc.mutable_msg_shrink_reply();
+    msg->set_req_id(req_id);
+    msg->set_status(cvmfs::STATUS_IOERR);
+    msg->set_used_bytes(0);
+  } else if (type_name == "cvmfs.MsgListReq") {
+    cvmfs::MsgListReply *msg = msg_rpc.mutable_msg_list_reply();
+    msg->set_req_id(req_id);
+    msg->set_status(cvmfs::STATUS_IOERR);
+    msg->set_listing_id(0);
+    msg->set_is_last_part(true);
+  } else {
+    abort();
+  }
+
+  string buffer;
+  bool retval = msg_rpc.SerializeToString(&buffer);
+  assert(retval);
+  retval = rpc_job->frame_recv()->ParseMsgRpc(
+    const_cast<char *>(buffer.data()), buffer.length());
+  assert(retval);
+}
+
+
 int ExternalCacheManager::ChangeRefcount(const shash::Any &id, int change_by) {
   cvmfs::MsgHash object_id;
   transport_.FillMsgHash(id, &object_id);
@@ -196,7 +276,8 @@ int ExternalCacheManager::ConnectLocator(const std::string &locator) {
 ExternalCacheManager *ExternalCacheManager::Create(
   int fd_connection,
   unsigned max_open_fds,
-  const string &ident)
+  const string &ident,
+  bool use_shm)
 {
   UniquePtr<ExternalCacheManager> cache_mgr(
     new ExternalCacheManager(fd_connection, max_open_fds));
@@ -205,11 +286,22 @@ ExternalCacheManager *ExternalCacheManager::Create(
   cvmfs::MsgHandshake msg_handshake;
   msg_handshake.set_protocol_version(kPbProtocolVersion);
   msg_handshake.set_name(ident);
+  string shm_name;
+  if (use_shm && IsUnixSocket(fd_connection)) {
+    shm_name = cache_mgr->CreateShm();
+    if (!shm_name.empty()) {
+      msg_handshake.set_shm_name(shm_name);
+      msg_handshake.set_shm_size(cache_mgr->shm_size_);
+    }
+  }
   CacheTransport::Frame frame_send(&msg_handshake);
   cache_mgr->transport_.SendFrame(&frame_send);
 
   CacheTransport::Frame frame_recv;
   bool retval = cache_mgr->transport_.RecvFrame(&frame_recv);
+  // The plugin has either mapped the region by now or it never will
+  if (!shm_name.empty())
+    shm_unlink(shm_name.c_str());
   if (!retval)
     return NULL;
   google::protobuf::MessageLite *msg_typed = frame_recv.GetMsgTyped();
@@ -235,6 +327,8 @@ ExternalCacheManager *ExternalCacheManager::Create(
   }
   if (msg_ack->has_pid())
     cache_mgr->pid_plugin_ = msg_ack->pid();
+  if (cache_mgr->shm_buffer_ != NULL)
+    cache_mgr->SetupShmSlots(msg_ack->shm_attached());
   return cache_mgr.Release();
 }
 
@@ -274,6 +368,39 @@ ExternalCacheManager::PluginHandle *ExternalCacheManager::CreatePlugin(
 }
 
 
+/**
+ * Creates and maps a new POSIX shared memory object that is offered to the
+ * plugin in the handshake.  Returns the name of the object or the empty string
+ * on failure, in which case the data path stays with message attachments.
+ */
+string ExternalCacheManager::CreateShm() {
+  shash::Any rnd_id(shash::kMd5);
+  rnd_id.Randomize();
+  const string name = "/cvmfs.cache." + rnd_id.ToString();
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    LogCvmfs(kLogCache, kLogDebug, "failed to create shared memory %s (%d)",
+             name.c_str(), errno);
+    return "";
+  }
+  void *mapping = MAP_FAILED;
+  if (ftruncate(fd, kShmSize) == 0) {
+    mapping =
+      mmap(NULL, kShmSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    LogCvmfs(kLogCache, kLogDebug, "failed to map shared memory %s (%d)",
+             name.c_str(), errno);
+    shm_unlink(name.c_str());
+    return "";
+  }
+  shm_buffer_ = reinterpret_cast<unsigned char *>(mapping);
+  shm_size_ = kShmSize;
+  return name;
+}
+
+
 void ExternalCacheManager::CtrlTxn(
   const ObjectInfo &object_info,
   const int flags,
@@ -362,7 +489,11 @@ ExternalCacheManager::ExternalCacheManager(
   , max_object_size_(0)
   , spawned_(false)
   , terminated_(false)
+  , io_errors_nonfatal_(false)
+  , io_failed_(false)
   , capabilities_(cvmfs::CAP_NONE)
+  , shm_buffer_(NULL)
+  , shm_size_(0)
 {
   int retval = pthread_rwlock_init(&rwlock_fd_table_, NULL);
   assert(retval == 0);
@@ -370,6 +501,8 @@ ExternalCacheManager::ExternalCacheManager(
   assert(retval == 0);
   retval = pthread_mutex_init(&lock_inflight_rpcs_, NULL);
   assert(retval == 0);
+  retval = pthread_mutex_init(&lock_shm_, NULL);
+  assert(retval == 0);
   memset(&thread_read_, 0, sizeof(thread_read_));
   atomic_init64(&next_request_id_);
 }
@@ -391,44 +524,67 @@ ExternalCacheManager::~ExternalCacheManager() {
   pthread_rwlock_destroy(&rwlock_fd_table_);
   pthread_mutex_destroy(&lock_send_fd_);
   pthread_mutex_destroy(&lock_inflight_rpcs_);
+  if (shm_buffer_ != NULL)
+    munmap(shm_buffer_, shm_size_);
+  pthread_mutex_destroy(&lock_shm_);
 }
 
 
+/**
+ * Sends the transaction buffer as the next part of the object.  With the
+ * reader thread running, parts are pipelined: the acknowledgements are only
+ * collected when the object is committed or when too many parts are pending.
+ */
 int ExternalCacheManager::Flush(bool do_commit, Transaction *transaction) {
   if (transaction->committed)
     return 0;
   LogCvmfs(kLogCache, kLogDebug, "flushing %u bytes for %s",
            transaction->buf_pos, transaction->id.ToString().c_str());
-  cvmfs::MsgHash object_id;
-  transport_.FillMsgHash(transaction->id, &object_id);
-  cvmfs::MsgStoreReq msg_store;
-  msg_store.set_session_id(session_id_);
-  msg_store.set_req_id(transaction->transaction_id);
-  msg_store.set_allocated_object_id(&object_id);
-  msg_store.set_part_nr((transaction->size / max_object_size_) + 1);
-  msg_store.set_expected_size(transaction->expected_size);
-  msg_store.set_last_part(do_commit);
+  PendingStore *pending_store = new PendingStore();
+  cvmfs::MsgStoreReq *msg_store = &pending_store->msg_store;
+  transport_.FillMsgHash(transaction->id, msg_store->mutable_object_id());
+  msg_store->set_session_id(session_id_);
+  msg_store->set_req_id(transaction->transaction_id);
+  msg_store->set_part_nr((transaction->size / max_object_size_) + 1);
+  msg_store->set_expected_size(transaction->expected_size);
+  msg_store->set_last_part(do_commit);
 
   if (transaction->object_info_modified) {
     cvmfs::EnumObjectType object_type;
     transport_.FillObjectType(transaction->object_info.type, &object_type);
-    msg_store.set_object_type(object_type);
-    msg_store.set_description(transaction->object_info.description);
+    msg_store->set_object_type(object_type);
+    msg_store->set_description(transaction->object_info.description);
   }
 
-  RpcJob rpc_job(&msg_store);
-  rpc_job.set_attachment_send(transaction->buffer, transaction->buf_pos);
+  pending_store->rpc_job = new RpcJob(msg_store);
+  if (transaction->buf_pos > 0)
+    pending_store->shm_offset = AcquireShmSlot();
+  if (pending_store->shm_offset >= 0) {
+    memcpy(shm_buffer_ + pending_store->shm_offset, transaction->buffer,
+           transaction->buf_pos);
+    msg_store->set_shm_offset(pending_store->shm_offset);
+    msg_store->set_shm_size(transaction->buf_pos);
+  } else {
+    // The buffer is written to the socket before SendRpc() returns
+    pending_store->rpc_job->set_attachment_send(transaction->buffer,
+                                                transaction->buf_pos);
+  }
   // TODO(jblomer): allow for out of order chunk upload
-  CallRemotely(&rpc_job);
-  msg_store.release_object_id();
-
-  cvmfs::MsgStoreReply *msg_reply = rpc_job.msg_store_reply();
-  if (msg_reply->status() == cvmfs::STATUS_OK) {
-    transaction->flushed = true;
-    if (do_commit)
-      transaction->committed = true;
+  SendRpc(pending_store->rpc_job, &pending_store->completion);
+  if (transaction->pending_stores == NULL)
+    transaction->pending_stores = new vector<PendingStore *>();
+  transaction->pending_stores->push_back(pending_store);
+  transaction->flushed = true;
+
+  if (!do_commit &&
+      (transaction->pending_stores->size() < kMaxPendingRpcs))
+  {
+    return 0;
   }
-  return Ack2Errno(msg_reply->status());
+  int retval = WaitForPendingStores(transaction);
+  if ((retval == 0) && do_commit)
+    transaction->committed = true;
+  return retval;
 }
 
 
@@ -523,7 +679,7 @@ void *ExternalCacheManager::MainRead(void *data) {
       continue;
     }
     rpc_inflight.rpc_job->frame_recv()->MergeFrom(frame_recv);
-    rpc_inflight.signal->Wakeup();
+    rpc_inflight.completion->Fire();
   }
 
   if (!cache_mgr->terminated_) {
@@ -570,39 +726,80 @@ int64_t ExternalCacheManager::Pread(
   uint64_t size,
   uint64_t offset)
 {
-  shash::Any id = GetHandle(fd);
-  if (id == kInvalidHandle)
-    return -EBADF;
+  vector<ReadRange> ranges(1, ReadRange(fd, buf, size, offset));
+  PreadMany(&ranges);
+  return ranges[0].result;
+}
 
-  cvmfs::MsgHash object_id;
-  transport_.FillMsgHash(id, &object_id);
-  uint64_t nbytes = 0;
-  while (nbytes < size) {
-    uint64_t batch_size =
-      std::min(size - nbytes, static_cast<uint64_t>(max_object_size_));
-    cvmfs::MsgReadReq msg_read;
-    msg_read.set_session_id(session_id_);
-    msg_read.set_req_id(NextRequestId());
-    msg_read.set_allocated_object_id(&object_id);
-    msg_read.set_offset(offset + nbytes);
-    msg_read.set_size(batch_size);
-    RpcJob rpc_job(&msg_read);
-    rpc_job.set_attachment_recv(reinterpret_cast<char *>(buf) + nbytes,
-                                batch_size);
-    CallRemotely(&rpc_job);
-    msg_read.release_object_id();
-
-    cvmfs::MsgReadReply *msg_reply = rpc_job.msg_read_reply();
-    if (msg_reply->status() == cvmfs::STATUS_OK) {
-      nbytes += rpc_job.frame_recv()->att_size();
-      // Fuse sends in rounded up buffers, so short reads are expected
-      if (rpc_job.frame_recv()->att_size() < batch_size)
-        return nbytes;
-    } else {
-      return Ack2Errno(msg_reply->status());
+
+/**
+ * Reads multiple ranges, possibly of different objects, with as few round
+ * trips as possible.  Ranges are cut into pieces of at most max_object_size_.
+ * If the plugin supports vectored reads, consecutive pieces are combined into
+ * a single request.  Up to kMaxPendingRpcs requests are in flight at a time.
+ */
+void ExternalCacheManager::PreadMany(vector<ReadRange> *ranges) {
+  vector<bool> done(ranges->size(), false);
+  vector<ReadPiece> pieces;
+  for (unsigned i = 0; i < ranges->size(); ++i) {
+    ReadRange *range = &(*ranges)[i];
+    range->result = 0;
+    shash::Any id = GetHandle(range->fd);
+    if (id == kInvalidHandle) {
+      range->result = -EBADF;
+      done[i] = true;
+      continue;
+    }
+    for (uint64_t pos = 0; pos < range->size; pos += max_object_size_) {
+      uint32_t size =
+        std::min(range->size - pos, static_cast<uint64_t>(max_object_size_));
+      pieces.push_back(ReadPiece(i, id,
+                                 reinterpret_cast<char *>(range->buf) + pos,
+                                 size, range->offset + pos));
     }
   }
-  return size;
+
+  const bool has_readv = capabilities_ & cvmfs::CAP_READV;
+  vector<PendingRead *> pending_reads;
+  for (unsigned i = 0; i < pieces.size(); ) {
+    PendingRead *pending_read = new PendingRead();
+    uint64_t total_size = 0;
+    do {
+      pending_read->pieces.push_back(&pieces[i]);
+      total_size += pieces[i].size;
+      i++;
+    } while (has_readv && (i < pieces.size()) &&
+             (pending_read->pieces.size() < kMaxReadRanges) &&
+             (total_size + pieces[i].size <= max_object_size_));
+    pending_reads.push_back(pending_read);
+  }
+
+  unsigned next_receive = 0;
+  for (unsigned i = 0; i < pending_reads.size(); ++i) {
+    if (i - next_receive >= kMaxPendingRpcs)
+      ReceiveRead(pending_reads[next_receive++]);
+    SendRead(pending_reads[i]);
+  }
+  for (; next_receive < pending_reads.size(); ++next_receive)
+    ReceiveRead(pending_reads[next_receive]);
+  for (unsigned i = 0; i < pending_reads.size(); ++i)
+    delete pending_reads[i];
+
+  for (unsigned i = 0; i < pieces.size(); ++i) {
+    const ReadPiece &piece = pieces[i];
+    if (done[piece.range_idx])
+      continue;
+    ReadRange *range = &(*ranges)[piece.range_idx];
+    if (piece.status != cvmfs::STATUS_OK) {
+      range->result = Ack2Errno(piece.status);
+      done[piece.range_idx] = true;
+      continue;
+    }
+    range->result += piece.nbytes;
+    // Fuse sends in rounded up buffers, so short reads are expected
+    if (piece.nbytes < piece.size)
+      done[piece.range_idx] = true;
+  }
 }
 
 
@@ -615,8 +812,69 @@ int ExternalCacheManager::Readahead(int fd) {
 }
 
 
+void ExternalCacheManager::ReleaseShmSlot(uint64_t offset) {
+  MutexLockGuard guard(lock_shm_);
+  shm_free_slots_.push_back(offset);
+}
+
+
+/**
+ * Waits for the reply to a read request and distributes the data to the pieces
+ * of the request.
+ */
+void ExternalCacheManager::ReceiveRead(PendingRead *pending_read) {
+  pending_read->completion.Wait();
+  cvmfs::MsgReadReply *msg_reply = pending_read->rpc_job->msg_read_reply();
+  const char *data = pending_read->buffer;
+  uint64_t data_size = pending_read->rpc_job->frame_recv()->att_size();
+  if (pending_read->shm_offset >= 0) {
+    data = reinterpret_cast<char *>(shm_buffer_ + pending_read->shm_offset);
+    data_size = msg_reply->shm_size();
+  }
+
+  const unsigned npieces = pending_read->pieces.size();
+  if (npieces == 1) {
+    ReadPiece *piece = pending_read->pieces[0];
+    piece->status = msg_reply->status();
+    piece->nbytes = std::min(data_size, static_cast<uint64_t>(piece->size));
+    // Otherwise the data has been received directly into the piece's buffer
+    if ((piece->status == cvmfs::STATUS_OK) && (data != NULL))
+      memcpy(piece->buf, data, piece->nbytes);
+  } else {
+    cvmfs::EnumStatus status = msg_reply->status();
+    if ((status == cvmfs::STATUS_OK) &&
+        ((static_cast<unsigned>(msg_reply->range_status_size()) != npieces) ||
+         (static_cast<unsigned>(msg_reply->range_size_size()) != npieces)))
+    {
+      status = cvmfs::STATUS_IOERR;
+    }
+    uint64_t pos = 0;
+    for (unsigned i = 0; i < npieces; ++i) {
+      ReadPiece *piece = pending_read->pieces[i];
+      piece->status = status;
+      if (status == cvmfs::STATUS_OK) {
+        piece->status = msg_reply->range_status(i);
+        piece->nbytes = std::min(msg_reply->range_size(i), piece->size);
+        if ((piece->status == cvmfs::STATUS_OK) &&
+            (pos + piece->nbytes > data_size))
+        {
+          piece->status = cvmfs::STATUS_IOERR;
+        }
+      }
+      if (piece->status == cvmfs::STATUS_OK)
+        memcpy(piece->buf, data + pos, piece->nbytes);
+      pos += piece->size;
+    }
+  }
+
+  if (pending_read->shm_offset >= 0)
+    ReleaseShmSlot(pending_read->shm_offset);
+}
+
+
 int ExternalCacheManager::Reset(void *txn) {
   Transaction *transaction = reinterpret_cast<Transaction *>(txn);
+  WaitForPendingStores(transaction);
   transaction->buf_pos = 0;
   transaction->size = 0;
   transaction->open_fds = 0;
@@ -642,7 +900,93 @@ int ExternalCacheManager::Reset(void *txn) {
 }
 
 
+void ExternalCacheManager::SendRead(PendingRead *pending_read) {
+  cvmfs::MsgReadReq *msg_read = &pending_read->msg_read;
+  msg_read->set_session_id(session_id_);
+  msg_read->set_req_id(NextRequestId());
+  uint32_t total_size = 0;
+  for (unsigned i = 0; i < pending_read->pieces.size(); ++i) {
+    const ReadPiece *piece = pending_read->pieces[i];
+    if (i == 0) {
+      transport_.FillMsgHash(piece->id, msg_read->mutable_object_id());
+      msg_read->set_offset(piece->offset);
+      msg_read->set_size(piece->size);
+    } else {
+      cvmfs::MsgReadRange *range = msg_read->add_more_ranges();
+      transport_.FillMsgHash(piece->id, range->mutable_object_id());
+      range->set_offset(piece->offset);
+      range->set_size(piece->size);
+    }
+    total_size += piece->size;
+  }
+
+  pending_read->rpc_job = new RpcJob(msg_read);
+  pending_read->shm_offset = AcquireShmSlot();
+  if (pending_read->shm_offset >= 0) {
+    msg_read->set_shm_offset(pending_read->shm_offset);
+  } else if (pending_read->pieces.size() == 1) {
+    pending_read->rpc_job->set_attachment_recv(pending_read->pieces[0]->buf,
+                                               total_size);
+  } else {
+    pending_read->buffer = reinterpret_cast<char *>(smalloc(total_size));
+    pending_read->rpc_job->set_attachment_recv(pending_read->buffer,
+                                               total_size);
+  }
+  SendRpc(pending_read->rpc_job, &pending_read->completion);
+}
+
+
+/**
+ * Sends an RPC without waiting for the reply.  The completion fires once the
+ * reply has been received.  Before the reader thread is spawned, the call is
+ * synchronous.
+ */
+void ExternalCacheManager::SendRpc(RpcJob *rpc_job, Completion *completion) {
+  if (!spawned_) {
+    CallRemotely(rpc_job);
+    completion->Fire();
+    return;
+  }
+  {
+    MutexLockGuard guard(lock_inflight_rpcs_);
+    inflight_rpcs_.push_back(RpcInFlight(rpc_job, completion));
+  }
+  MutexLockGuard guard(lock_send_fd_);
+  transport_.SendFrame(rpc_job->frame_send());
+}
+
+
+/**
+ * Called after the handshake.  If the plugin did not map the shared memory
+ * region, it is released again.
+ */
+void ExternalCacheManager::SetupShmSlots(bool attached) {
+  if (!attached) {
+    LogCvmfs(kLogCache, kLogDebug, "cache plugin did not attach shared memory");
+    munmap(shm_buffer_, shm_size_);
+    shm_buffer_ = NULL;
+    shm_size_ = 0;
+    return;
+  }
+  // Reverse order, so that the first slots are handed out first
+  const unsigned nslots = shm_size_ / max_object_size_;
+  for (unsigned i = nslots; i > 0; --i)
+    shm_free_slots_.push_back(static_cast<uint64_t>(i - 1) * max_object_size_);
+  LogCvmfs(kLogCache, kLogDebug, "using shared memory data path (%u slots)",
+           nslots);
+}
+
+
+void ExternalCacheManager::MakeIoErrorsNonFatal() {
+  assert(!spawned_);
+  io_errors_nonfatal_ = true;
+  transport_.set_flags(
+    transport_.flags() | CacheTransport::kFlagSendIgnoreFailure);
+}
+
+
 void ExternalCacheManager::Spawn() {
+  assert(!io_errors_nonfatal_);
   int retval = pthread_create(&thread_read_, NULL, MainRead, this);
   assert(retval == 0);
   spawned_ = true;
@@ -731,6 +1075,34 @@ int ExternalCacheManager::StartTxn(
 }
 
 
+/**
+ * Collects the acknowledgements of the pipelined parts of a transaction.
+ * Returns the first error.  On failure, the plugin has dropped the transaction.
+ */
+int ExternalCacheManager::WaitForPendingStores(Transaction *transaction) {
+  if (transaction->pending_stores == NULL)
+    return 0;
+  int result = 0;
+  vector<PendingStore *> *pending_stores = transaction->pending_stores;
+  for (unsigned i = 0; i < pending_stores->size(); ++i) {
+    PendingStore *pending_store = (*pending_stores)[i];
+    pending_store->completion.Wait();
+    if (pending_store->shm_offset >= 0)
+      ReleaseShmSlot(pending_store->shm_offset);
+    cvmfs::MsgStoreReply *msg_reply =
+      pending_store->rpc_job->msg_store_reply();
+    if ((result == 0) && (msg_reply->status() != cvmfs::STATUS_OK))
+      result = Ack2Errno(msg_reply->status());
+    delete pending_store;
+  }
+  delete pending_stores;
+  transaction->pending_stores = NULL;
+  if (result != 0)
+    transaction->flushed = false;
+  return result;
+}
+
+
 int64_t ExternalCacheManager::Write(const void *buf, uint64_t size, void *txn) {
   Transaction *transaction = reinterpret_cast<Transaction *>(txn);
   assert(!transaction->committed);
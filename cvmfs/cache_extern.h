@@ -11,6 +11,7 @@
 #include <unistd.h>
 
 #include <cassert>
+#include <cstdlib>
 #include <string>
 #include <vector>
 
@@ -31,6 +32,22 @@ class ExternalCacheManager : public CacheManager {
 
  public:
   static const unsigned kPbProtocolVersion = 1;
+
+  /**
+   * A single read for PreadMany().  The number of bytes read or a negative
+   * errno is stored in result.
+   */
+  struct ReadRange {
+    ReadRange() : fd(-1), buf(NULL), size(0), offset(0), result(0) { }
+    ReadRange(int f, void *b, uint64_t s, uint64_t o)
+      : fd(f), buf(b), size(s), offset(o), result(0) { }
+    int fd;
+    void *buf;
+    uint64_t size;
+    uint64_t offset;
+    int64_t result;
+  };
+
   /**
    * Used for race-free startup of an external cache plugin.
    */
@@ -55,9 +72,15 @@ class ExternalCacheManager : public CacheManager {
     const std::string &locator,
     const std::vector<std::string> &cmd_line);
 
+  /**
+   * Returns a connected socket to a unix=... or tcp=... locator or a negative
+   * errno.
+   */
+  static int ConnectLocator(const std::string &locator);
   static ExternalCacheManager *Create(int fd_connection,
                                       unsigned max_open_fds,
-                                      const std::string &ident);
+                                      const std::string &ident,
+                                      bool use_shm = false);
   virtual ~ExternalCacheManager();
 
   virtual CacheManagerIds id() { return kExternalCacheManager; }
@@ -68,6 +91,7 @@ class ExternalCacheManager : public CacheManager {
   virtual int64_t GetSize(int fd);
   virtual int Close(int fd);
   virtual int64_t Pread(int fd, void *buf, uint64_t size, uint64_t offset);
+  void PreadMany(std::vector<ReadRange> *ranges);
   virtual int Dup(int fd);
   virtual int Readahead(int fd);
 
@@ -89,11 +113,19 @@ class ExternalCacheManager : public CacheManager {
   virtual int CommitTxn(void *txn);
 
   virtual void Spawn();
+  /**
+   * By default, a broken connection to the cache plugin is fatal.  Clients
+   * that can live without the plugin, such as the cache plugins of other
+   * nodes, can instead get -EIO from all subsequent calls.  Only supported as
+   * long as Spawn() has not been called.
+   */
+  void MakeIoErrorsNonFatal();
 
   int64_t session_id() const { return session_id_; }
   uint32_t max_object_size() const { return max_object_size_; }
   uint64_t capabilities() const { return capabilities_; }
   pid_t pid_plugin() const { return pid_plugin_; }
+  bool has_shm() const { return shm_buffer_ != NULL; }
 
  protected:
   virtual void *DoSaveState();
@@ -115,6 +147,22 @@ class ExternalCacheManager : public CacheManager {
    * Statistically, at least half of our objects should not be further chunked.
    */
   static const unsigned kMinSupportedObjectSize = 4 * 1024;
+  /**
+   * Size of the shared memory region offered to a local plugin.  It is cut
+   * into slots of max_object_size_.  Pages of unused slots are never touched.
+   */
+  static const unsigned kShmSize = 32 * kMaxSupportedObjectSize;
+  /**
+   * Upper bound of ranges in a single vectored read request
+   */
+  static const unsigned kMaxReadRanges = 64;
+  /**
+   * Number of RPCs of a single read or transaction that are sent before
+   * waiting for the replies
+   */
+  static const unsigned kMaxPendingRpcs = 16;
+
+  struct PendingStore;
 
   struct Transaction {
     explicit Transaction(const shash::Any &id)
@@ -129,6 +177,7 @@ class ExternalCacheManager : public CacheManager {
       , object_info_modified(false)
       , transaction_id(0)
       , id(id)
+      , pending_stores(NULL)
     { }
 
     /**
@@ -146,6 +195,10 @@ class ExternalCacheManager : public CacheManager {
     bool object_info_modified;
     uint64_t transaction_id;
     shash::Any id;
+    /**
+     * Parts of the object that have been sent but not yet acknowledged
+     */
+    std::vector<PendingStore *> *pending_stores;
   };  // class Transaction
 
   struct ReadOnlyHandle {
@@ -249,25 +302,78 @@ class ExternalCacheManager : public CacheManager {
     CacheTransport::Frame frame_recv_;
   };  // class RpcJob
 
+  /**
+   * A part of a transaction that is sent without waiting for the reply
+   */
+  struct PendingStore : ::SingleCopy {
+    PendingStore() : rpc_job(NULL), shm_offset(-1) { }
+    ~PendingStore() { delete rpc_job; }
+    cvmfs::MsgStoreReq msg_store;
+    RpcJob *rpc_job;
+    Completion completion;
+    int64_t shm_offset;
+  };
+
+  /**
+   * A piece of a read range; pieces are not larger than max_object_size_
+   */
+  struct ReadPiece {
+    ReadPiece(unsigned r, const shash::Any &i, char *b, uint32_t s, uint64_t o)
+      : range_idx(r), id(i), buf(b), size(s), offset(o)
+      , status(cvmfs::STATUS_UNKNOWN), nbytes(0) { }
+    unsigned range_idx;
+    shash::Any id;
+    char *buf;
+    uint32_t size;
+    uint64_t offset;
+    cvmfs::EnumStatus status;
+    uint32_t nbytes;
+  };
+
+  /**
+   * A read request for one or, with CAP_READV, multiple pieces
+   */
+  struct PendingRead : ::SingleCopy {
+    PendingRead() : rpc_job(NULL), buffer(NULL), shm_offset(-1) { }
+    ~PendingRead() { delete rpc_job; free(buffer); }
+    cvmfs::MsgReadReq msg_read;
+    RpcJob *rpc_job;
+    Completion completion;
+    std::vector<ReadPiece *> pieces;
+    /**
+     * Receiving buffer for multiple pieces
+     */
+    char *buffer;
+    int64_t shm_offset;
+  };
+
   struct RpcInFlight {
-    RpcInFlight() : rpc_job(NULL), signal(NULL) { }
-    RpcInFlight(RpcJob *r, Signal *s) : rpc_job(r), signal(s) { }
+    RpcInFlight() : rpc_job(NULL), completion(NULL) { }
+    RpcInFlight(RpcJob *r, Completion *c) : rpc_job(r), completion(c) { }
 
     RpcJob *rpc_job;
-    Signal *signal;
+    Completion *completion;
   };
 
   static void *MainRead(void *data);
-  static int ConnectLocator(const std::string &locator);
+  static void FailRpc(RpcJob *rpc_job);
   static bool SpawnPlugin(const std::vector<std::string> &cmd_line);
 
   explicit ExternalCacheManager(int fd_connection, unsigned max_open_fds);
   int64_t NextRequestId() { return atomic_xadd64(&next_request_id_, 1); }
   void CallRemotely(RpcJob *rpc_job);
+  void SendRpc(RpcJob *rpc_job, Completion *completion);
+  void SendRead(PendingRead *pending_read);
+  void ReceiveRead(PendingRead *pending_read);
+  int WaitForPendingStores(Transaction *transaction);
   int ChangeRefcount(const shash::Any &id, int change_by);
   int DoOpen(const shash::Any &id);
   shash::Any GetHandle(int fd);
   int Flush(bool do_commit, Transaction *transaction);
+  std::string CreateShm();
+  void SetupShmSlots(bool attached);
+  int64_t AcquireShmSlot();
+  void ReleaseShmSlot(uint64_t offset);
 
   pid_t pid_plugin_;
   FdTable<ReadOnlyHandle> fd_table_;
@@ -276,6 +382,11 @@ class ExternalCacheManager : public CacheManager {
   uint32_t max_object_size_;
   bool spawned_;
   bool terminated_;
+  bool io_errors_nonfatal_;
+  /**
+   * Set after a transport failure if io_errors_nonfatal_ is true
+   */
+  bool io_failed_;
   pthread_rwlock_t rwlock_fd_table_;
   atomic_int64 next_request_id_;
 
@@ -287,6 +398,18 @@ class ExternalCacheManager : public CacheManager {
   pthread_mutex_t lock_inflight_rpcs_;
   pthread_t thread_read_;
   uint64_t capabilities_;
+
+  /**
+   * Mapped shared memory region for the data path, NULL if not negotiated
+   */
+  unsigned char *shm_buffer_;
+  uint64_t shm_size_;
+  /**
+   * Offsets of the unused slots in the shared memory region.  If all slots are
+   * in use, requests fall back to attachments.
+   */
+  std::vector<uint64_t> shm_free_slots_;
+  pthread_mutex_t lock_shm_;
 };  // class ExternalCacheManager
 
 
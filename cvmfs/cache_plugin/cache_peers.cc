@@ -0,0 +1,264 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "cache_plugin/cache_peers.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "cache.h"
+#include "cache_extern.h"
+#include "hash.h"
+#include "logging.h"
+#include "murmur.h"
+#include "platform.h"
+#include "smalloc.h"
+#include "util/posix.h"
+#include "util/string.h"
+#include "util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+namespace {
+
+static shash::Any Chash2Cpphash(const struct cvmcache_hash &h) {
+  shash::Any hash;
+  memcpy(hash.digest, h.digest, sizeof(h.digest));
+  hash.algorithm = static_cast<shash::Algorithms>(h.algorithm);
+  return hash;
+}
+
+}  // anonymous namespace
+
+
+PeerRing::PeerRing(const vector<string> &peers) {
+  for (unsigned i = 0; i < peers.size(); ++i) {
+    for (unsigned j = 0; j < kNumVirtualNodes; ++j) {
+      const string point = peers[i] + "#" + StringifyInt(j);
+      points_.push_back(make_pair(
+        MurmurHash2(point.data(), point.length(), 0x52494e47), i));
+    }
+  }
+  sort(points_.begin(), points_.end());
+}
+
+
+unsigned PeerRing::GetOwner(const struct cvmcache_hash &id) const {
+  assert(!points_.empty());
+  const uint32_t position =
+    MurmurHash2(id.digest, sizeof(id.digest), 0x52494e47);
+  vector<pair<uint32_t, unsigned> >::const_iterator iter = lower_bound(
+    points_.begin(), points_.end(), make_pair(position, 0U));
+  if (iter == points_.end())
+    iter = points_.begin();
+  return iter->second;
+}
+
+
+//------------------------------------------------------------------------------
+
+
+PeerCache *PeerCache::Create(const string &self, const string &peers) {
+  vector<string> locators = SplitString(peers, ',');
+  vector<string> peer_list;
+  for (unsigned i = 0; i < locators.size(); ++i) {
+    const string locator = Trim(locators[i]);
+    if (!locator.empty())
+      peer_list.push_back(locator);
+  }
+  if (find(peer_list.begin(), peer_list.end(), self) == peer_list.end()) {
+    LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
+             "peer locator %s is not in the list of peers", self.c_str());
+    return NULL;
+  }
+  return new PeerCache(self, peer_list);
+}
+
+
+PeerCache::PeerCache(const string &self, const vector<string> &peers)
+  : self_(self)
+  , ring_(peers)
+  , idx_self_(0)
+  , spawned_(false)
+{
+  for (unsigned i = 0; i < peers.size(); ++i) {
+    Peer peer;
+    peer.locator = peers[i];
+    peer.lock =
+      reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+    int retval = pthread_mutex_init(peer.lock, NULL);
+    assert(retval == 0);
+    peers_.push_back(peer);
+    if (peers[i] == self)
+      idx_self_ = i;
+  }
+  atomic_init32(&num_pending_);
+  MakePipe(pipe_push_);
+  LogCvmfs(kLogCache, kLogDebug | kLogSyslog,
+           "sharing cached objects with %u peers",
+           static_cast<unsigned>(peers.size()) - 1);
+}
+
+
+PeerCache::~PeerCache() {
+  if (spawned_) {
+    PushJob *terminate = NULL;
+    WritePipe(pipe_push_[1], &terminate, sizeof(terminate));
+    pthread_join(thread_push_, NULL);
+  }
+  ClosePipe(pipe_push_);
+
+  for (unsigned i = 0; i < peers_.size(); ++i) {
+    delete peers_[i].cache_mgr;
+    pthread_mutex_destroy(peers_[i].lock);
+    free(peers_[i].lock);
+  }
+}
+
+
+void PeerCache::Spawn() {
+  assert(!spawned_);
+  int retval = pthread_create(&thread_push_, NULL, MainPush, this);
+  assert(retval == 0);
+  spawned_ = true;
+}
+
+
+/**
+ * Called with the lock of the peer held.
+ */
+ExternalCacheManager *PeerCache::Connect(Peer *peer) {
+  if (peer->cache_mgr != NULL)
+    return peer->cache_mgr;
+  if (platform_monotonic_time() < peer->timestamp_retry)
+    return NULL;
+
+  int fd_connection = ExternalCacheManager::ConnectLocator(peer->locator);
+  if (fd_connection >= 0) {
+    peer->cache_mgr =
+      ExternalCacheManager::Create(fd_connection, 64, "peer " + self_);
+    if (peer->cache_mgr != NULL)
+      peer->cache_mgr->MakeIoErrorsNonFatal();
+  }
+  if (peer->cache_mgr == NULL) {
+    LogCvmfs(kLogCache, kLogDebug | kLogSyslogWarn,
+             "failed to connect to peer %s", peer->locator.c_str());
+    peer->timestamp_retry = platform_monotonic_time() + kRetryPeriod;
+  }
+  return peer->cache_mgr;
+}
+
+
+/**
+ * Called with the lock of the peer held.
+ */
+void PeerCache::Disconnect(Peer *peer) {
+  LogCvmfs(kLogCache, kLogDebug | kLogSyslogWarn,
+           "lost connection to peer %s", peer->locator.c_str());
+  delete peer->cache_mgr;
+  peer->cache_mgr = NULL;
+  peer->timestamp_retry = platform_monotonic_time() + kRetryPeriod;
+}
+
+
+bool PeerCache::IsOwner(const struct cvmcache_hash &id) const {
+  return ring_.GetOwner(id) == idx_self_;
+}
+
+
+bool PeerCache::Fetch(
+  const struct cvmcache_hash &id,
+  unsigned char **buffer,
+  uint64_t *size)
+{
+  const unsigned idx_owner = ring_.GetOwner(id);
+  if (idx_owner == idx_self_)
+    return false;
+  Peer *peer = &peers_[idx_owner];
+
+  MutexLockGuard guard(peer->lock);
+  ExternalCacheManager *cache_mgr = Connect(peer);
+  if (cache_mgr == NULL)
+    return false;
+
+  int fd = cache_mgr->Open(CacheManager::Bless(Chash2Cpphash(id)));
+  if (fd < 0) {
+    if (fd != -ENOENT)
+      Disconnect(peer);
+    return false;
+  }
+  int64_t nbytes = cache_mgr->GetSize(fd);
+  if (nbytes < 0) {
+    Disconnect(peer);
+    return false;
+  }
+  *buffer = reinterpret_cast<unsigned char *>(smalloc(nbytes + 1));
+  int64_t retval = cache_mgr->Pread(fd, *buffer, nbytes, 0);
+  if (retval != nbytes) {
+    free(*buffer);
+    Disconnect(peer);
+    return false;
+  }
+  cache_mgr->Close(fd);
+  *size = nbytes;
+  LogCvmfs(kLogCache, kLogDebug, "fetched %s from peer %s",
+           Chash2Cpphash(id).ToString().c_str(), peer->locator.c_str());
+  return true;
+}
+
+
+void PeerCache::Push(
+  const struct cvmcache_hash &id,
+  unsigned char *buffer,
+  uint64_t size)
+{
+  if (IsOwner(id)) {
+    free(buffer);
+    return;
+  }
+  if (atomic_xadd32(&num_pending_, 1) >= kMaxPending) {
+    atomic_dec32(&num_pending_);
+    free(buffer);
+    return;
+  }
+  PushJob *job = new PushJob();
+  job->id = id;
+  job->buffer = buffer;
+  job->size = size;
+  WritePipe(pipe_push_[1], &job, sizeof(job));
+}
+
+
+void *PeerCache::MainPush(void *data) {
+  PeerCache *peer_cache = reinterpret_cast<PeerCache *>(data);
+
+  while (true) {
+    PushJob *job;
+    ReadPipe(peer_cache->pipe_push_[0], &job, sizeof(job));
+    if (job == NULL)
+      break;
+
+    Peer *peer = &peer_cache->peers_[peer_cache->ring_.GetOwner(job->id)];
+    {
+      MutexLockGuard guard(peer->lock);
+      ExternalCacheManager *cache_mgr = peer_cache->Connect(peer);
+      if ((cache_mgr != NULL) &&
+          !cache_mgr->CommitFromMem(Chash2Cpphash(job->id), job->buffer,
+                                    job->size, "peer"))
+      {
+        peer_cache->Disconnect(peer);
+      }
+    }
+    free(job->buffer);
+    delete job;
+    atomic_dec32(&peer_cache->num_pending_);
+  }
+  return NULL;
+}
@@ -0,0 +1,127 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Lets the cache plugins of a worker node cluster share their objects.  Every
+ * object has an owner among the peers, given by a consistent hash ring over
+ * the peer locators.  A plugin that misses an object asks the owner before
+ * the client falls back to the proxy.  Newly committed objects are pushed to
+ * their owner in the background.
+ *
+ * The peers talk to each other with the regular cache plugin protocol through
+ * ExternalCacheManager.  All peers need to use the same list of peers,
+ * otherwise requests might be forwarded in circles.  Since the data of
+ * uncompressed objects cannot be verified against the content hash, the peers
+ * must trust each other just like the nodes of a shared cache directory.
+ */
+
+#ifndef CVMFS_CACHE_PLUGIN_CACHE_PEERS_H_
+#define CVMFS_CACHE_PLUGIN_CACHE_PEERS_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "atomic.h"
+#include "cache_plugin/libcvmfs_cache.h"
+#include "util/single_copy.h"
+
+class ExternalCacheManager;
+
+/**
+ * Every peer is placed on the ring multiple times so that the objects are
+ * evenly distributed.  Adding or removing a peer only moves the objects owned
+ * by that peer.
+ */
+class PeerRing {
+ public:
+  static const unsigned kNumVirtualNodes = 64;
+
+  explicit PeerRing(const std::vector<std::string> &peers);
+  /**
+   * Returns the index of the owning peer in the list of peers.
+   */
+  unsigned GetOwner(const struct cvmcache_hash &id) const;
+
+ private:
+  /**
+   * Sorted pairs of ring position and peer index
+   */
+  std::vector<std::pair<uint32_t, unsigned> > points_;
+};
+
+
+class PeerCache : SingleCopy {
+ public:
+  /**
+   * Peers that failed are not contacted again for a minute.
+   */
+  static const unsigned kRetryPeriod = 60;
+  /**
+   * Objects to be pushed are dropped if too many of them are waiting.
+   */
+  static const int32_t kMaxPending = 128;
+
+  /**
+   * The peers are a comma separated list of locators.  Self is the locator of
+   * this plugin in that list.
+   */
+  static PeerCache *Create(const std::string &self, const std::string &peers);
+  ~PeerCache();
+  /**
+   * Starts the upload thread.  Needs to be called after the plugin forked
+   * into the background.
+   */
+  void Spawn();
+
+  bool IsOwner(const struct cvmcache_hash &id) const;
+  /**
+   * Copies the object from its owner into a malloc'd buffer.  Returns false if
+   * this plugin is the owner, if the owner does not have the object, or if the
+   * owner cannot be reached.
+   */
+  bool Fetch(const struct cvmcache_hash &id,
+             unsigned char **buffer,
+             uint64_t *size);
+  /**
+   * Queues the object for upload to its owner.  Takes ownership of the
+   * malloc'd buffer.
+   */
+  void Push(const struct cvmcache_hash &id,
+            unsigned char *buffer,
+            uint64_t size);
+
+ private:
+  struct Peer {
+    Peer() : lock(NULL), cache_mgr(NULL), timestamp_retry(0) { }
+    std::string locator;
+    pthread_mutex_t *lock;
+    ExternalCacheManager *cache_mgr;
+    uint64_t timestamp_retry;
+  };
+
+  struct PushJob {
+    struct cvmcache_hash id;
+    unsigned char *buffer;
+    uint64_t size;
+  };
+
+  static void *MainPush(void *data);
+
+  PeerCache(const std::string &self, const std::vector<std::string> &peers);
+  ExternalCacheManager *Connect(Peer *peer);
+  void Disconnect(Peer *peer);
+
+  std::string self_;
+  PeerRing ring_;
+  std::vector<Peer> peers_;
+  unsigned idx_self_;
+  int pipe_push_[2];
+  pthread_t thread_push_;
+  bool spawned_;
+  atomic_int32 num_pending_;
+};
+
+#endif  // CVMFS_CACHE_PLUGIN_CACHE_PEERS_H_
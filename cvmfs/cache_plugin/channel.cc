@@ -5,24 +5,27 @@
 #include "channel.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <signal.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/un.h>
 #include <unistd.h>
 
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
 #include <vector>
 
 #include "logging.h"
 #include "platform.h"
-#ifdef __APPLE__
 #include "smalloc.h"
-#endif
 #include "util/pointer.h"
 #include "util/posix.h"
 #include "util/string.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
@@ -35,6 +38,39 @@ void CachePlugin::AskToDetach() {
 }
 
 
+/**
+ * Maps the shared memory region of a local client.  The client unlinks the
+ * region once the handshake is acknowledged.
+ */
+bool CachePlugin::AttachShm(int fd_con, const string &name, uint64_t size) {
+  if ((size < max_object_size_) || name.empty() || (name[0] != '/'))
+    return false;
+  int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    LogCvmfs(kLogCache, kLogDebug, "failed to open shared memory %s (%d)",
+             name.c_str(), errno);
+    return false;
+  }
+  struct stat info;
+  void *mapping = MAP_FAILED;
+  if ((fstat(fd, &info) == 0) && (static_cast<uint64_t>(info.st_size) == size))
+    mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    LogCvmfs(kLogCache, kLogDebug, "failed to map shared memory %s (%d)",
+             name.c_str(), errno);
+    return false;
+  }
+  DetachShm(fd_con);
+  ShmRegion region;
+  region.buffer = reinterpret_cast<unsigned char *>(mapping);
+  region.size = size;
+  MutexLockGuard guard(lock_);
+  shm_regions_[fd_con] = region;
+  return true;
+}
+
+
 CachePlugin::CachePlugin(uint64_t capabilities)
   : is_local_(false)
   , capabilities_(capabilities)
@@ -51,14 +87,21 @@ CachePlugin::CachePlugin(uint64_t capabilities)
   // Don't use listing id zero
   atomic_inc64(&next_lst_id_);
   txn_ids_.Init(128, UniqueRequest(), HashUniqueRequest);
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
   memset(&thread_io_, 0, sizeof(thread_io_));
   MakePipe(pipe_ctrl_);
+  MakePipe(pipe_work_);
+  MakePipe(pipe_done_);
 }
 
 
 CachePlugin::~CachePlugin() {
   Terminate();
   ClosePipe(pipe_ctrl_);
+  ClosePipe(pipe_work_);
+  ClosePipe(pipe_done_);
+  pthread_mutex_destroy(&lock_);
   if (fd_socket_ >= 0)
     close(fd_socket_);
   if (fd_socket_lock_ >= 0)
@@ -66,16 +109,55 @@ CachePlugin::~CachePlugin() {
 }
 
 
+void CachePlugin::DetachShm(int fd_con) {
+  MutexLockGuard guard(lock_);
+  map<int, ShmRegion>::iterator iter = shm_regions_.find(fd_con);
+  if (iter == shm_regions_.end())
+    return;
+  munmap(iter->second.buffer, iter->second.size);
+  shm_regions_.erase(iter);
+}
+
+
+/**
+ * Returns NULL if the connection has no shared memory region or if the range
+ * is outside the region.
+ */
+unsigned char *CachePlugin::GetShmBuffer(
+  int fd_con,
+  uint64_t offset,
+  uint64_t size)
+{
+  MutexLockGuard guard(lock_);
+  map<int, ShmRegion>::const_iterator iter = shm_regions_.find(fd_con);
+  if (iter == shm_regions_.end())
+    return NULL;
+  const ShmRegion &region = iter->second;
+  if ((offset > region.size) || (size > region.size - offset))
+    return NULL;
+  return region.buffer + offset;
+}
+
+
+void CachePlugin::EraseTxnId(const UniqueRequest &req) {
+  MutexLockGuard guard(lock_);
+  txn_ids_.Erase(req);
+}
+
+
 void CachePlugin::HandleHandshake(
   cvmfs::MsgHandshake *msg_req,
   CacheTransport *transport)
 {
   uint64_t session_id = NextSessionId();
-  if (msg_req->has_name()) {
-    sessions_[session_id] = msg_req->name();
-  } else {
-    sessions_[session_id] =
-      "anonymous client (" + StringifyInt(session_id) + ")";
+  {
+    MutexLockGuard guard(lock_);
+    if (msg_req->has_name()) {
+      sessions_[session_id] = msg_req->name();
+    } else {
+      sessions_[session_id] =
+        "anonymous client (" + StringifyInt(session_id) + ")";
+    }
   }
   cvmfs::MsgHandshakeAck msg_ack;
   CacheTransport::Frame frame_send(&msg_ack);
@@ -85,9 +167,15 @@ void CachePlugin::HandleHandshake(
   msg_ack.set_protocol_version(kPbProtocolVersion);
   msg_ack.set_max_object_size(max_object_size_);
   msg_ack.set_session_id(session_id);
-  msg_ack.set_capabilities(capabilities_);
+  // Vectored reads are implemented by the channel on top of Pread()
+  msg_ack.set_capabilities(capabilities_ | cvmfs::CAP_READV);
   if (is_local_)
     msg_ack.set_pid(getpid());
+  if (msg_req->has_shm_name() && msg_req->has_shm_size()) {
+    msg_ack.set_shm_attached(AttachShm(transport->fd_connection(),
+                                       msg_req->shm_name(),
+                                       msg_req->shm_size()));
+  }
   transport->SendFrame(&frame_send);
 }
 
@@ -119,7 +207,15 @@ void CachePlugin::HandleIoctl(cvmfs::MsgIoctl *msg_req) {
   if (!msg_req->has_conncnt_change_by())
     return;
   int32_t conncnt_change_by = msg_req->conncnt_change_by();
-  if ((static_cast<int32_t>(num_inlimbo_clients_) + conncnt_change_by) < 0) {
+  bool valid;
+  {
+    MutexLockGuard guard(lock_);
+    valid =
+      (static_cast<int32_t>(num_inlimbo_clients_) + conncnt_change_by) >= 0;
+    if (valid)
+      num_inlimbo_clients_ += conncnt_change_by;
+  }
+  if (!valid) {
     LogSessionError(msg_req->session_id(), cvmfs::STATUS_MALFORMED,
                     "invalid request to drop connection counter below zero");
     return;
@@ -129,7 +225,6 @@ void CachePlugin::HandleIoctl(cvmfs::MsgIoctl *msg_req) {
   } else {
     LogSessionInfo(msg_req->session_id(), "release session lock");
   }
-  num_inlimbo_clients_ += conncnt_change_by;
 }
 
 
@@ -222,6 +317,11 @@ void CachePlugin::HandleRead(
   cvmfs::MsgReadReq *msg_req,
   CacheTransport *transport)
 {
+  if (msg_req->more_ranges_size() > 0) {
+    HandleReadV(msg_req, transport);
+    return;
+  }
+
   cvmfs::MsgReadReply msg_reply;
   CacheTransport::Frame frame_send(&msg_reply);
 
@@ -236,6 +336,30 @@ void CachePlugin::HandleRead(
     return;
   }
   unsigned size = msg_req->size();
+  if (msg_req->has_shm_offset()) {
+    // Zero-copy: the data is placed directly in the client's memory
+    unsigned char *shm_buffer = GetShmBuffer(transport->fd_connection(),
+                                             msg_req->shm_offset(), size);
+    if (shm_buffer == NULL) {
+      LogSessionError(msg_req->session_id(), cvmfs::STATUS_MALFORMED,
+                      "invalid shared memory range received from client");
+      msg_reply.set_status(cvmfs::STATUS_MALFORMED);
+      transport->SendFrame(&frame_send);
+      return;
+    }
+    cvmfs::EnumStatus status =
+      Pread(object_id, msg_req->offset(), &size, shm_buffer);
+    msg_reply.set_status(status);
+    if (status == cvmfs::STATUS_OK) {
+      msg_reply.set_shm_size(size);
+    } else {
+      LogSessionError(msg_req->session_id(), status,
+                      "failed to read from object");
+    }
+    transport->SendFrame(&frame_send);
+    return;
+  }
+
 #ifdef __APPLE__
   unsigned char *buffer = reinterpret_cast<unsigned char *>(smalloc(size));
 #else
@@ -256,6 +380,81 @@ void CachePlugin::HandleRead(
 }
 
 
+/**
+ * The data of all the ranges is placed one after another in a single payload,
+ * either attached to the reply or in the client's shared memory region.
+ */
+void CachePlugin::HandleReadV(
+  cvmfs::MsgReadReq *msg_req,
+  CacheTransport *transport)
+{
+  cvmfs::MsgReadReply msg_reply;
+  CacheTransport::Frame frame_send(&msg_reply);
+  msg_reply.set_req_id(msg_req->req_id());
+
+  const unsigned nranges = msg_req->more_ranges_size() + 1;
+  vector<shash::Any> object_ids(nranges);
+  vector<uint64_t> offsets(nranges);
+  vector<uint32_t> sizes(nranges);
+  bool retval = transport->ParseMsgHash(msg_req->object_id(), &object_ids[0]);
+  offsets[0] = msg_req->offset();
+  sizes[0] = msg_req->size();
+  uint64_t total_size = sizes[0];
+  for (unsigned i = 1; retval && (i < nranges); ++i) {
+    const cvmfs::MsgReadRange &range = msg_req->more_ranges(i - 1);
+    retval = transport->ParseMsgHash(range.object_id(), &object_ids[i]);
+    offsets[i] = range.offset();
+    sizes[i] = range.size();
+    total_size += sizes[i];
+  }
+
+  unsigned char *buffer = NULL;
+  unsigned char *local_buffer = NULL;
+  if (retval && (total_size <= max_object_size_)) {
+    if (msg_req->has_shm_offset()) {
+      buffer = GetShmBuffer(transport->fd_connection(), msg_req->shm_offset(),
+                            total_size);
+    } else {
+      local_buffer =
+        reinterpret_cast<unsigned char *>(smalloc(max_object_size_));
+      buffer = local_buffer;
+    }
+  }
+  if (buffer == NULL) {
+    LogSessionError(msg_req->session_id(), cvmfs::STATUS_MALFORMED,
+                    "malformed vectored read received from client");
+    msg_reply.set_status(cvmfs::STATUS_MALFORMED);
+    transport->SendFrame(&frame_send);
+    return;
+  }
+
+  uint64_t pos = 0;
+  uint64_t payload_size = 0;
+  for (unsigned i = 0; i < nranges; ++i) {
+    uint32_t size = sizes[i];
+    cvmfs::EnumStatus status =
+      Pread(object_ids[i], offsets[i], &size, buffer + pos);
+    msg_reply.add_range_status(status);
+    msg_reply.add_range_size((status == cvmfs::STATUS_OK) ? size : 0);
+    if (status == cvmfs::STATUS_OK) {
+      payload_size = pos + size;
+    } else if (status != cvmfs::STATUS_OUTOFBOUNDS) {
+      // Pipelined reads may well go beyond the end of the object
+      LogSessionError(msg_req->session_id(), status,
+                      "failed to read from object");
+    }
+    pos += sizes[i];
+  }
+  msg_reply.set_status(cvmfs::STATUS_OK);
+  if (msg_req->has_shm_offset())
+    msg_reply.set_shm_size(payload_size);
+  else if (payload_size > 0)
+    frame_send.set_attachment(buffer, payload_size);
+  transport->SendFrame(&frame_send);
+  free(local_buffer);
+}
+
+
 void CachePlugin::HandleRefcount(
   cvmfs::MsgRefcountReq *msg_req,
   CacheTransport *transport)
@@ -302,7 +501,11 @@ bool CachePlugin::HandleRequest(int fd_con) {
     HandleHandshake(msg_req, &transport);
   } else if (msg_typed->GetTypeName() == "cvmfs.MsgQuit") {
     cvmfs::MsgQuit *msg_req = reinterpret_cast<cvmfs::MsgQuit *>(msg_typed);
-    sessions_.erase(msg_req->session_id());
+    {
+      MutexLockGuard guard(lock_);
+      sessions_.erase(msg_req->session_id());
+    }
+    DetachShm(fd_con);
     return false;
   } else if (msg_typed->GetTypeName() == "cvmfs.MsgIoctl") {
     HandleIoctl(reinterpret_cast<cvmfs::MsgIoctl *>(msg_typed));
@@ -378,7 +581,7 @@ void CachePlugin::HandleStoreAbort(
   msg_reply.set_part_nr(0);
   uint64_t txn_id;
   UniqueRequest uniq_req(msg_req->session_id(), msg_req->req_id());
-  bool retval = txn_ids_.Lookup(uniq_req, &txn_id);
+  bool retval = LookupTxnId(uniq_req, &txn_id);
   if (!retval) {
     LogSessionError(msg_req->session_id(), cvmfs::STATUS_MALFORMED,
                     "malformed transaction id received from client");
@@ -390,7 +593,7 @@ void CachePlugin::HandleStoreAbort(
       LogSessionError(msg_req->session_id(), status,
                       "failed to abort transaction");
     }
-    txn_ids_.Erase(uniq_req);
+    EraseTxnId(uniq_req);
   }
   transport->SendFrame(&frame_send);
 }
@@ -405,11 +608,18 @@ void CachePlugin::HandleStore(
   CacheTransport::Frame frame_send(&msg_reply);
   msg_reply.set_req_id(msg_req->req_id());
   msg_reply.set_part_nr(msg_req->part_nr());
+  unsigned char *data = reinterpret_cast<unsigned char *>(frame->attachment());
+  uint32_t data_size = frame->att_size();
+  if (msg_req->has_shm_offset()) {
+    data_size = msg_req->shm_size();
+    data = GetShmBuffer(transport->fd_connection(), msg_req->shm_offset(),
+                        data_size);
+  }
   shash::Any object_id;
   bool retval = transport->ParseMsgHash(msg_req->object_id(), &object_id);
-  if ( !retval ||
-       (frame->att_size() > max_object_size_) ||
-       ((frame->att_size() < max_object_size_) && !msg_req->last_part()) )
+  if ( !retval || (data == NULL) ||
+       (data_size > max_object_size_) ||
+       ((data_size < max_object_size_) && !msg_req->last_part()) )
   {
     LogSessionError(msg_req->session_id(), cvmfs::STATUS_MALFORMED,
                     "malformed hash or bad object size received from client");
@@ -422,7 +632,7 @@ void CachePlugin::HandleStore(
   uint64_t txn_id;
   cvmfs::EnumStatus status = cvmfs::STATUS_OK;
   if (msg_req->part_nr() == 1) {
-    if (txn_ids_.Contains(uniq_req)) {
+    if (LookupTxnId(uniq_req, &txn_id)) {
       LogSessionError(msg_req->session_id(), cvmfs::STATUS_MALFORMED,
                       "invalid attempt to restart running transaction");
       msg_reply.set_status(cvmfs::STATUS_MALFORMED);
@@ -443,9 +653,9 @@ void CachePlugin::HandleStore(
       transport->SendFrame(&frame_send);
       return;
     }
-    txn_ids_.Insert(uniq_req, txn_id);
+    InsertTxnId(uniq_req, txn_id);
   } else {
-    retval = txn_ids_.Lookup(uniq_req, &txn_id);
+    retval = LookupTxnId(uniq_req, &txn_id);
     if (!retval) {
       LogSessionError(msg_req->session_id(), cvmfs::STATUS_MALFORMED,
                       "invalid transaction received from client");
@@ -456,12 +666,13 @@ void CachePlugin::HandleStore(
   }
 
   // TODO(jblomer): check part number and send objects up in order
-  if (frame->att_size() > 0) {
-    status = WriteTxn(txn_id,
-                      reinterpret_cast<unsigned char *>(frame->attachment()),
-                      frame->att_size());
+  if (data_size > 0) {
+    status = WriteTxn(txn_id, data, data_size);
     if (status != cvmfs::STATUS_OK) {
       LogSessionError(msg_req->session_id(), status, "failure writing object");
+      // Further, pipelined parts of the object have to be rejected
+      AbortTxn(txn_id);
+      EraseTxnId(uniq_req);
       msg_reply.set_status(status);
       transport->SendFrame(&frame_send);
       return;
@@ -474,18 +685,30 @@ void CachePlugin::HandleStore(
       LogSessionError(msg_req->session_id(), status,
                       "failure committing object");
     }
-    txn_ids_.Erase(uniq_req);
+    EraseTxnId(uniq_req);
   }
   msg_reply.set_status(status);
   transport->SendFrame(&frame_send);
 }
 
 
+void CachePlugin::InsertTxnId(const UniqueRequest &req, uint64_t txn_id) {
+  MutexLockGuard guard(lock_);
+  txn_ids_.Insert(req, txn_id);
+}
+
+
 bool CachePlugin::IsRunning() {
   return atomic_read32(&running_) != 0;
 }
 
 
+bool CachePlugin::LookupTxnId(const UniqueRequest &req, uint64_t *txn_id) {
+  MutexLockGuard guard(lock_);
+  return txn_ids_.Lookup(req, txn_id);
+}
+
+
 bool CachePlugin::Listen(const string &locator) {
   vector<string> tokens = SplitString(locator, '=');
   if (tokens[0] == "unix") {
@@ -543,12 +766,17 @@ bool CachePlugin::Listen(const string &locator) {
 }
 
 
-void CachePlugin::LogSessionInfo(uint64_t session_id, const string &msg) {
-  string session_str("unidentified client (" + StringifyInt(session_id) + ")");
+string CachePlugin::GetSessionName(uint64_t session_id) {
+  MutexLockGuard guard(lock_);
   map<uint64_t, string>::const_iterator iter = sessions_.find(session_id);
-  if (iter != sessions_.end()) {
-    session_str = iter->second;
-  }
+  if (iter != sessions_.end())
+    return iter->second;
+  return "unidentified client (" + StringifyInt(session_id) + ")";
+}
+
+
+void CachePlugin::LogSessionInfo(uint64_t session_id, const string &msg) {
+  string session_str = GetSessionName(session_id);
   LogCvmfs(kLogCache, kLogDebug | kLogSyslog,
            "session '%s': %s", session_str.c_str(), msg.c_str());
 }
@@ -559,11 +787,7 @@ void CachePlugin::LogSessionError(
   cvmfs::EnumStatus status,
   const std::string &msg)
 {
-  string session_str("unidentified client (" + StringifyInt(session_id) + ")");
-  map<uint64_t, string>::const_iterator iter = sessions_.find(session_id);
-  if (iter != sessions_.end()) {
-    session_str = iter->second;
-  }
+  string session_str = GetSessionName(session_id);
   LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
            "session '%s': %s (%d - %s)",
            session_str.c_str(), msg.c_str(), status,
@@ -576,8 +800,18 @@ void *CachePlugin::MainProcessRequests(void *data) {
 
   platform_sighandler_t save_sigpipe = signal(SIGPIPE, SIG_IGN);
 
+  // With a single worker, requests are handled in the I/O thread
+  if (cache_plugin->num_workers_ > 1) {
+    cache_plugin->threads_workers_.resize(cache_plugin->num_workers_);
+    for (unsigned i = 0; i < cache_plugin->num_workers_; ++i) {
+      int retval = pthread_create(&cache_plugin->threads_workers_[i], NULL,
+                                  MainWorker, cache_plugin);
+      assert(retval == 0);
+    }
+  }
+
   vector<struct pollfd> watch_fds;
-  // Elements 0, 1: control pipe, socket fd
+  // Elements 0, 1, 2: control pipe, socket fd, finished requests
   struct pollfd watch_ctrl;
   watch_ctrl.fd = cache_plugin->pipe_ctrl_[0];
   watch_ctrl.events = POLLIN | POLLPRI;
@@ -586,6 +820,10 @@ void *CachePlugin::MainProcessRequests(void *data) {
   watch_socket.fd = cache_plugin->fd_socket_;
   watch_socket.events = POLLIN | POLLPRI;
   watch_fds.push_back(watch_socket);
+  struct pollfd watch_done;
+  watch_done.fd = cache_plugin->pipe_done_[0];
+  watch_done.events = POLLIN | POLLPRI;
+  watch_fds.push_back(watch_done);
 
   bool terminated = false;
   while (!terminated) {
@@ -610,7 +848,7 @@ void *CachePlugin::MainProcessRequests(void *data) {
       }
 
       // termination
-      if (watch_fds.size() > 2) {
+      if (watch_fds.size() > kFirstConnection) {
         LogCvmfs(kLogCache, kLogSyslogWarn | kLogDebug,
                  "terminating external cache manager with pending connections");
       }
@@ -635,35 +873,79 @@ void *CachePlugin::MainProcessRequests(void *data) {
       cache_plugin->connections_.insert(fd_con);
     }
 
-    // New request
-    for (unsigned i = 2; i < watch_fds.size(); ) {
-      if (watch_fds[i].revents) {
-        bool proceed = cache_plugin->HandleRequest(watch_fds[i].fd);
-        if (!proceed) {
-          close(watch_fds[i].fd);
-          cache_plugin->connections_.erase(watch_fds[i].fd);
-          watch_fds.erase(watch_fds.begin() + i);
-          if ( (getenv(CacheTransport::kEnvReadyNotifyFd) != NULL) &&
-               (cache_plugin->connections_.empty()) &&
-               (cache_plugin->num_inlimbo_clients_ == 0) )
-          {
-            LogCvmfs(kLogCache, kLogSyslog,
-                     "stopping cache plugin, no more active clients");
-            terminated = true;
-            break;
-          }
+    // A worker thread is done with a request
+    bool has_done = false;
+    RequestDone done;
+    if (watch_fds[2].revents) {
+      ReadPipe(watch_fds[2].fd, &done, sizeof(done));
+      has_done = true;
+    }
+
+    // New request.  Connections that are served by a worker thread are
+    // stored as ~fd in the poll set, poll() ignores negative descriptors.
+    for (unsigned i = kFirstConnection; i < watch_fds.size(); ) {
+      bool proceed = true;
+      if (has_done && (watch_fds[i].fd == ~done.fd_con)) {
+        watch_fds[i].fd = done.fd_con;
+        cache_plugin->connections_busy_.erase(done.fd_con);
+        proceed = done.proceed;
+        if (proceed && cache_plugin->connections_detach_.erase(done.fd_con))
+          cache_plugin->SendDetachRequest(done.fd_con);
+      } else if ((watch_fds[i].fd >= 0) && watch_fds[i].revents) {
+        if (cache_plugin->num_workers_ > 1) {
+          int fd_con = watch_fds[i].fd;
+          watch_fds[i].fd = ~fd_con;
+          cache_plugin->connections_busy_.insert(fd_con);
+          WritePipe(cache_plugin->pipe_work_[1], &fd_con, sizeof(fd_con));
         } else {
-          i++;
+          proceed = cache_plugin->HandleRequest(watch_fds[i].fd);
         }
-      } else {
+      }
+
+      if (proceed) {
         i++;
+        continue;
+      }
+
+      cache_plugin->DetachShm(watch_fds[i].fd);
+      close(watch_fds[i].fd);
+      cache_plugin->connections_.erase(watch_fds[i].fd);
+      cache_plugin->connections_detach_.erase(watch_fds[i].fd);
+      watch_fds.erase(watch_fds.begin() + i);
+      uint64_t num_inlimbo_clients;
+      {
+        MutexLockGuard guard(cache_plugin->lock_);
+        num_inlimbo_clients = cache_plugin->num_inlimbo_clients_;
+      }
+      if ( (getenv(CacheTransport::kEnvReadyNotifyFd) != NULL) &&
+           (cache_plugin->connections_.empty()) &&
+           (num_inlimbo_clients == 0) )
+      {
+        LogCvmfs(kLogCache, kLogSyslog,
+                 "stopping cache plugin, no more active clients");
+        terminated = true;
+        break;
       }
     }
   }
 
-  // 0, 1 being closed by destructor
-  for (unsigned i = 2; i < watch_fds.size(); ++i)
-    close(watch_fds[i].fd);
+  // Queued requests are still processed before the workers see the stop mark
+  for (unsigned i = 0; i < cache_plugin->threads_workers_.size(); ++i) {
+    int fd_stop = -1;
+    WritePipe(cache_plugin->pipe_work_[1], &fd_stop, sizeof(fd_stop));
+  }
+  for (unsigned i = 0; i < cache_plugin->threads_workers_.size(); ++i)
+    pthread_join(cache_plugin->threads_workers_[i], NULL);
+  cache_plugin->threads_workers_.clear();
+  cache_plugin->connections_busy_.clear();
+  cache_plugin->connections_detach_.clear();
+
+  // 0, 1, 2 being closed by destructor
+  for (unsigned i = kFirstConnection; i < watch_fds.size(); ++i) {
+    int fd_con = (watch_fds[i].fd < 0) ? ~watch_fds[i].fd : watch_fds[i].fd;
+    cache_plugin->DetachShm(fd_con);
+    close(fd_con);
+  }
   cache_plugin->txn_ids_.Clear();
 
   signal(SIGPIPE, save_sigpipe);
@@ -671,6 +953,26 @@ void *CachePlugin::MainProcessRequests(void *data) {
 }
 
 
+/**
+ * Handles requests of the connections that the I/O thread passes on.
+ */
+void *CachePlugin::MainWorker(void *data) {
+  CachePlugin *cache_plugin = reinterpret_cast<CachePlugin *>(data);
+
+  while (true) {
+    int fd_con;
+    ReadPipe(cache_plugin->pipe_work_[0], &fd_con, sizeof(fd_con));
+    if (fd_con < 0)
+      break;
+    RequestDone done;
+    done.fd_con = fd_con;
+    done.proceed = cache_plugin->HandleRequest(fd_con);
+    WritePipe(cache_plugin->pipe_done_[1], &done, sizeof(done));
+  }
+  return NULL;
+}
+
+
 /**
  * Used during startup to synchronize with the cvmfs client.
  */
@@ -692,16 +994,26 @@ void CachePlugin::ProcessRequests(unsigned num_workers) {
 }
 
 
+void CachePlugin::SendDetachRequest(int fd_con) {
+  CacheTransport transport(fd_con,
+    CacheTransport::kFlagSendIgnoreFailure |
+    CacheTransport::kFlagSendNonBlocking);
+  cvmfs::MsgDetach msg_detach;
+  CacheTransport::Frame frame_send(&msg_detach);
+  transport.SendFrame(&frame_send);
+}
+
+
 void CachePlugin::SendDetachRequests() {
   set<int>::const_iterator iter = connections_.begin();
   set<int>::const_iterator iter_end = connections_.end();
   for (; iter != iter_end; ++iter) {
-    CacheTransport transport(*iter,
-      CacheTransport::kFlagSendIgnoreFailure |
-      CacheTransport::kFlagSendNonBlocking);
-    cvmfs::MsgDetach msg_detach;
-    CacheTransport::Frame frame_send(&msg_detach);
-    transport.SendFrame(&frame_send);
+    if (connections_busy_.count(*iter) > 0) {
+      // Sending now would interfere with the reply of the worker thread
+      connections_detach_.insert(*iter);
+      continue;
+    }
+    SendDetachRequest(*iter);
   }
 }
 
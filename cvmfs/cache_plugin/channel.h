@@ -10,6 +10,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "atomic.h"
 #include "cache.pb.h"
@@ -89,6 +90,11 @@ class CachePlugin {
   static const unsigned kListingSize = 4 * 1024 * 1024;  // 4MB
   static const char kSignalTerminate = 'q';
   static const char kSignalDetach = 'd';
+  /**
+   * Position of the first client connection in the poll set, after the
+   * control pipe, the socket, and the pipe of finished requests.
+   */
+  static const unsigned kFirstConnection = 3;
 
   struct UniqueRequest {
     UniqueRequest() : session_id(-1), req_id(-1) { }
@@ -105,7 +111,25 @@ class CachePlugin {
     int64_t req_id;
   };
 
+  /**
+   * Shared memory data path offered by a local client in the handshake
+   */
+  struct ShmRegion {
+    ShmRegion() : buffer(NULL), size(0) { }
+    unsigned char *buffer;
+    uint64_t size;
+  };
+
+  /**
+   * Sent by a worker thread when it finished a request of a connection.
+   */
+  struct RequestDone {
+    int fd_con;
+    bool proceed;
+  };
+
   static void *MainProcessRequests(void *data);
+  static void *MainWorker(void *data);
 
   inline uint64_t NextSessionId() {
     return atomic_xadd64(&next_session_id_, 1);
@@ -129,6 +153,7 @@ class CachePlugin {
                         CacheTransport *transport);
   void HandleRead(cvmfs::MsgReadReq *msg_req,
                      CacheTransport *transport);
+  void HandleReadV(cvmfs::MsgReadReq *msg_req, CacheTransport *transport);
   void HandleStore(cvmfs::MsgStoreReq *msg_req,
                    CacheTransport::Frame *frame,
                    CacheTransport *transport);
@@ -138,10 +163,20 @@ class CachePlugin {
   void HandleShrink(cvmfs::MsgShrinkReq *msg_req, CacheTransport *transport);
   void HandleList(cvmfs::MsgListReq *msg_req, CacheTransport *transport);
   void HandleIoctl(cvmfs::MsgIoctl *msg_req);
+  void SendDetachRequest(int fd_con);
   void SendDetachRequests();
 
+  bool AttachShm(int fd_con, const std::string &name, uint64_t size);
+  void DetachShm(int fd_con);
+  unsigned char *GetShmBuffer(int fd_con, uint64_t offset, uint64_t size);
+
   void NotifySupervisor(char signal);
 
+  bool LookupTxnId(const UniqueRequest &req, uint64_t *txn_id);
+  void InsertTxnId(const UniqueRequest &req, uint64_t txn_id);
+  void EraseTxnId(const UniqueRequest &req);
+
+  std::string GetSessionName(uint64_t session_id);
   void LogSessionError(uint64_t session_id,
                        cvmfs::EnumStatus status,
                        const std::string &msg);
@@ -164,10 +199,35 @@ class CachePlugin {
   atomic_int64 next_txn_id_;
   atomic_int64 next_lst_id_;
   SmallHashDynamic<UniqueRequest, uint64_t> txn_ids_;
+  /**
+   * Only used by the I/O thread.  Connections are busy while a worker thread
+   * handles one of their requests.  Busy connections receive the detach
+   * request once the worker is done.
+   */
   std::set<int> connections_;
+  std::set<int> connections_busy_;
+  std::set<int> connections_detach_;
   std::map<uint64_t, std::string> sessions_;
+  /**
+   * Maps connection file descriptors to their shared memory regions
+   */
+  std::map<int, ShmRegion> shm_regions_;
+  /**
+   * Protects txn_ids_, sessions_, shm_regions_, and num_inlimbo_clients_,
+   * which are shared by the worker threads.
+   */
+  pthread_mutex_t lock_;
   pthread_t thread_io_;
+  std::vector<pthread_t> threads_workers_;
   int pipe_ctrl_[2];
+  /**
+   * Connections with a pending request, read by the worker threads
+   */
+  int pipe_work_[2];
+  /**
+   * RequestDone messages, read by the I/O thread
+   */
+  int pipe_done_[2];
 };  // class CachePlugin
 
 #endif  // CVMFS_CACHE_PLUGIN_CHANNEL_H_
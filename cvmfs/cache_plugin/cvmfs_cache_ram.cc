@@ -9,6 +9,8 @@
 #include <alloca.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -22,6 +24,8 @@
 #include <string>
 #include <vector>
 
+#include "atomic.h"
+#include "cache_plugin/cache_peers.h"
 #include "cache_plugin/libcvmfs_cache.h"
 #include "logging.h"
 #include "lru.h"
@@ -152,38 +156,59 @@ struct cvmcache_context *ctx;
 
 
 /**
- * Implements all the cache plugin callbacks.  Singelton.
+ * A fixed-size part of the cache memory with its own heap, LRU lists, and
+ * statistics.  Objects are assigned to shards by their content hash.  Every
+ * shard is protected by its own lock so that the worker threads of the plugin
+ * library only contend if they operate on objects of the same shard.
  */
-class PluginRamCache : public Callbackable<MallocHeap::BlockPtr> {
+class RamShard : public Callbackable<MallocHeap::BlockPtr> {
  public:
-  static PluginRamCache *Create(const string &mem_size_str) {
-    assert(instance_ == NULL);
+  RamShard(const uint64_t heap_size, const uint64_t num_slots) {
+    in_danger_zone_ = false;
+    lock_ =
+      reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+    int retval = pthread_mutex_init(lock_, NULL);
+    assert(retval == 0);
 
-    uint64_t mem_size_bytes;
-    if (HasSuffix(mem_size_str, "%", false)) {
-      mem_size_bytes = platform_memsize() * String2Uint64(mem_size_str) / 100;
-    } else {
-      mem_size_bytes = String2Uint64(mem_size_str) * 1024 * 1024;
-    }
-    instance_ = new PluginRamCache(mem_size_bytes);
-    return instance_;
+    memset(&cache_info_, 0, sizeof(cache_info_));
+    cache_info_.size_bytes = heap_size;
+    storage_ = new MallocHeap(
+      heap_size, this->MakeCallback(&RamShard::OnBlockMove, this));
+
+    struct cvmcache_hash hash_empty;
+    memset(&hash_empty, 0, sizeof(hash_empty));
+
+    transactions_.Init(64, uint64_t(-1), hasher_uint64);
+
+    // Number of cache entries must be a multiple of 64
+    objects_all_ = new lru::LruCache<ComparableHash, ObjectHeader *>(
+      num_slots,
+      ComparableHash(hash_empty),
+      hasher_any,
+      perf::StatisticsTemplate("objects_all", &statistics_));
+    objects_volatile_ = new lru::LruCache<ComparableHash, ObjectHeader *>(
+      num_slots,
+      ComparableHash(hash_empty),
+      hasher_any,
+      perf::StatisticsTemplate("objects_volatile", &statistics_));
   }
 
-  ~PluginRamCache() {
+  ~RamShard() {
     delete storage_;
     delete objects_all_;
     delete objects_volatile_;
-    instance_ = NULL;
+    pthread_mutex_destroy(lock_);
+    free(lock_);
   }
 
-  static int ram_chrefcnt(struct cvmcache_hash *id, int32_t change_by) {
-    ComparableHash h(*id);
+  int ChangeRefcnt(const ComparableHash &h, int32_t change_by) {
+    MutexLockGuard guard(lock_);
     ObjectHeader *object;
-    if (!Me()->objects_all_->Lookup(h, &object))
+    if (!objects_all_->Lookup(h, &object))
       return CVMCACHE_STATUS_NOENTRY;
 
     if (object->type == CVMCACHE_OBJECT_VOLATILE)
-      Me()->objects_volatile_->Update(h);
+      objects_volatile_->Update(h);
 
     if (change_by == 0)
       return CVMCACHE_STATUS_OK;
@@ -191,25 +216,23 @@ class PluginRamCache : public Callbackable<MallocHeap::BlockPtr> {
       return CVMCACHE_STATUS_BADCOUNT;
 
     if (object->refcnt == 0) {
-      Me()->cache_info_.pinned_bytes += Me()->storage_->GetSize(object);
-      Me()->CheckHighPinWatermark();
+      cache_info_.pinned_bytes += storage_->GetSize(object);
+      CheckHighPinWatermark();
     }
     object->refcnt += change_by;
     if (object->refcnt == 0) {
-      Me()->cache_info_.pinned_bytes -= Me()->storage_->GetSize(object);
-      Me()->in_danger_zone_ = Me()->IsInDangerZone();
+      cache_info_.pinned_bytes -= storage_->GetSize(object);
+      in_danger_zone_ = IsInDangerZone();
     }
     return CVMCACHE_STATUS_OK;
   }
 
-
-  static int ram_obj_info(
-    struct cvmcache_hash *id,
-    struct cvmcache_object_info *info)
+  int GetObjectInfo(const ComparableHash &h,
+                    struct cvmcache_object_info *info)
   {
-    ComparableHash h(*id);
+    MutexLockGuard guard(lock_);
     ObjectHeader *object;
-    if (!Me()->objects_all_->Lookup(h, &object, false))
+    if (!objects_all_->Lookup(h, &object, false))
       return CVMCACHE_STATUS_NOENTRY;
 
     info->size = object->size_data;
@@ -221,15 +244,14 @@ class PluginRamCache : public Callbackable<MallocHeap::BlockPtr> {
     return CVMCACHE_STATUS_OK;
   }
 
-
-  static int ram_pread(struct cvmcache_hash *id,
-                      uint64_t offset,
-                      uint32_t *size,
-                      unsigned char *buffer)
+  int Pread(const ComparableHash &h,
+            uint64_t offset,
+            uint32_t *size,
+            unsigned char *buffer)
   {
-    ComparableHash h(*id);
+    MutexLockGuard guard(lock_);
     ObjectHeader *object;
-    bool retval = Me()->objects_all_->Lookup(h, &object, false);
+    bool retval = objects_all_->Lookup(h, &object, false);
     assert(retval);
     if (offset > object->size_data)
       return CVMCACHE_STATUS_OUTOFBOUNDS;
@@ -240,11 +262,9 @@ class PluginRamCache : public Callbackable<MallocHeap::BlockPtr> {
     return CVMCACHE_STATUS_OK;
   }
 
-
-  static int ram_start_txn(
-    struct cvmcache_hash *id,
-    uint64_t txn_id,
-    struct cvmcache_object_info *info)
+  int StartTxn(struct cvmcache_hash *id,
+               uint64_t txn_id,
+               struct cvmcache_object_info *info)
   {
     ObjectHeader object_header;
     object_header.txn_id = txn_id;
@@ -260,48 +280,44 @@ class PluginRamCache : public Callbackable<MallocHeap::BlockPtr> {
 
     uint32_t total_size = sizeof(object_header) +
                           object_header.size_desc + object_header.size_data;
-    Me()->TryFreeSpace(total_size);
+    MutexLockGuard guard(lock_);
+    TryFreeSpace(total_size);
     ObjectHeader *allocd_object = reinterpret_cast<ObjectHeader *>(
-      Me()->storage_->Allocate(total_size,
-                               &object_header, sizeof(object_header)));
+      storage_->Allocate(total_size, &object_header, sizeof(object_header)));
     if (allocd_object == NULL)
       return CVMCACHE_STATUS_NOSPACE;
 
     allocd_object->SetDescription(info->description);
-    Me()->transactions_.Insert(txn_id, allocd_object);
+    transactions_.Insert(txn_id, allocd_object);
     return CVMCACHE_STATUS_OK;
   }
 
-
-  static int ram_write_txn(
-    uint64_t txn_id,
-    unsigned char *buffer,
-    uint32_t size)
-  {
+  int WriteTxn(uint64_t txn_id, unsigned char *buffer, uint32_t size) {
+    MutexLockGuard guard(lock_);
     ObjectHeader *txn_object;
-    int retval = Me()->transactions_.Lookup(txn_id, &txn_object);
+    int retval = transactions_.Lookup(txn_id, &txn_object);
     assert(retval);
     assert(size > 0);
 
     if (txn_object->neg_nbytes_written > 0)
       txn_object->neg_nbytes_written = 0;
     if ((size - txn_object->neg_nbytes_written) > txn_object->size_data) {
-      uint32_t current_size = Me()->storage_->GetSize(txn_object);
+      uint32_t current_size = storage_->GetSize(txn_object);
       uint32_t header_size = current_size - txn_object->size_data;
       uint32_t new_size = std::max(
         header_size + size - txn_object->neg_nbytes_written,
         uint32_t(current_size * kObjectExpandFactor));
-      bool did_compact = Me()->TryFreeSpace(new_size);
+      bool did_compact = TryFreeSpace(new_size);
       if (did_compact) {
-        retval = Me()->transactions_.Lookup(txn_id, &txn_object);
+        retval = transactions_.Lookup(txn_id, &txn_object);
         assert(retval);
       }
       txn_object = reinterpret_cast<ObjectHeader *>(
-        Me()->storage_->Expand(txn_object, new_size));
+        storage_->Expand(txn_object, new_size));
       if (txn_object == NULL)
         return CVMCACHE_STATUS_NOSPACE;
       txn_object->size_data = new_size - header_size;
-      Me()->transactions_.Insert(txn_id, txn_object);
+      transactions_.Insert(txn_id, txn_object);
     }
 
     memcpy(txn_object->GetData() - txn_object->neg_nbytes_written,
@@ -310,26 +326,30 @@ class PluginRamCache : public Callbackable<MallocHeap::BlockPtr> {
     return CVMCACHE_STATUS_OK;
   }
 
-
-  static int ram_commit_txn(uint64_t txn_id) {
-    Me()->TryFreeSpace(0);
-    if (Me()->objects_all_->IsFull())
+  /**
+   * If id is not NULL, it is set to the object id of the transaction.
+   */
+  int CommitTxn(uint64_t txn_id, struct cvmcache_hash *id) {
+    MutexLockGuard guard(lock_);
+    TryFreeSpace(0);
+    if (objects_all_->IsFull())
       return CVMCACHE_STATUS_NOSPACE;
 
     ObjectHeader *txn_object;
-    int retval = Me()->transactions_.Lookup(txn_id, &txn_object);
+    int retval = transactions_.Lookup(txn_id, &txn_object);
     assert(retval);
 
-    Me()->transactions_.Erase(txn_id);
+    transactions_.Erase(txn_id);
     ComparableHash h(txn_object->id);
+    if (id != NULL)
+      *id = txn_object->id;
     ObjectHeader *existing_object;
-    if (Me()->objects_all_->Lookup(h, &existing_object)) {
+    if (objects_all_->Lookup(h, &existing_object)) {
       // Concurrent addition of same objects, drop the one at hand and
       // increase ref count of existing copy
-      Me()->storage_->MarkFree(txn_object);
+      storage_->MarkFree(txn_object);
       if (existing_object->refcnt == 0)
-        Me()->cache_info_.pinned_bytes +=
-          Me()->storage_->GetSize(existing_object);
+        cache_info_.pinned_bytes += storage_->GetSize(existing_object);
       existing_object->refcnt++;
     } else {
       txn_object->txn_id = uint64_t(-1);
@@ -337,56 +357,73 @@ class PluginRamCache : public Callbackable<MallocHeap::BlockPtr> {
         txn_object->neg_nbytes_written = 0;
       txn_object->size_data = -(txn_object->neg_nbytes_written);
       txn_object->refcnt = 1;
-      Me()->cache_info_.used_bytes += Me()->storage_->GetSize(txn_object);
-      Me()->cache_info_.pinned_bytes += Me()->storage_->GetSize(txn_object);
-      Me()->objects_all_->Insert(h, txn_object);
+      cache_info_.used_bytes += storage_->GetSize(txn_object);
+      cache_info_.pinned_bytes += storage_->GetSize(txn_object);
+      objects_all_->Insert(h, txn_object);
       if (txn_object->type == CVMCACHE_OBJECT_VOLATILE) {
-        assert(!Me()->objects_volatile_->IsFull());
-        Me()->objects_volatile_->Insert(h, txn_object);
+        assert(!objects_volatile_->IsFull());
+        objects_volatile_->Insert(h, txn_object);
       }
     }
-    Me()->CheckHighPinWatermark();
+    CheckHighPinWatermark();
     return CVMCACHE_STATUS_OK;
   }
 
-
-  static int ram_abort_txn(uint64_t txn_id) {
+  int AbortTxn(uint64_t txn_id) {
+    MutexLockGuard guard(lock_);
     ObjectHeader *txn_object;
-    int retval = Me()->transactions_.Lookup(txn_id, &txn_object);
+    int retval = transactions_.Lookup(txn_id, &txn_object);
     assert(retval);
-    Me()->transactions_.Erase(txn_id);
-    Me()->storage_->MarkFree(txn_object);
+    transactions_.Erase(txn_id);
+    storage_->MarkFree(txn_object);
     return CVMCACHE_STATUS_OK;
   }
 
-
-  static int ram_info(struct cvmcache_info *info) {
-    *info = Me()->cache_info_;
-    return CVMCACHE_STATUS_OK;
+  /**
+   * Copies the data of an object into a malloc'd buffer.
+   */
+  bool ReadObject(const ComparableHash &h,
+                  unsigned char **buffer,
+                  uint64_t *size)
+  {
+    MutexLockGuard guard(lock_);
+    ObjectHeader *object;
+    if (!objects_all_->Lookup(h, &object, false))
+      return false;
+    *size = object->size_data;
+    *buffer = reinterpret_cast<unsigned char *>(smalloc(*size + 1));
+    memcpy(*buffer, object->GetData(), *size);
+    return true;
   }
 
-
-  static int ram_shrink(uint64_t shrink_to, uint64_t *used) {
-    *used = Me()->cache_info_.used_bytes;
-    if (*used <= shrink_to)
-      return CVMCACHE_STATUS_OK;
-
-    Me()->DoShrink(shrink_to);
-    *used = Me()->cache_info_.used_bytes;
-    return (*used <= shrink_to) ? CVMCACHE_STATUS_OK : CVMCACHE_STATUS_PARTIAL;
+  /**
+   * Adds the shard's numbers to info.
+   */
+  void AddInfo(struct cvmcache_info *info) {
+    MutexLockGuard guard(lock_);
+    info->size_bytes += cache_info_.size_bytes;
+    info->used_bytes += cache_info_.used_bytes;
+    info->pinned_bytes += cache_info_.pinned_bytes;
+    info->no_shrink += cache_info_.no_shrink;
   }
 
+  /**
+   * Returns the number of used bytes after the shrink operation.
+   */
+  uint64_t Shrink(uint64_t shrink_to) {
+    MutexLockGuard guard(lock_);
+    if (cache_info_.used_bytes > shrink_to)
+      DoShrink(shrink_to);
+    return cache_info_.used_bytes;
+  }
 
-  static int ram_listing_begin(
-    uint64_t lst_id,
-    enum cvmcache_object_type type)
-  {
-    Listing *lst = new Listing();
-    Me()->objects_all_->FilterBegin();
-    while (Me()->objects_all_->FilterNext()) {
+  void List(enum cvmcache_object_type type, Listing *lst) {
+    MutexLockGuard guard(lock_);
+    objects_all_->FilterBegin();
+    while (objects_all_->FilterNext()) {
       ComparableHash h;
       ObjectHeader *object;
-      Me()->objects_all_->FilterGet(&h, &object);
+      objects_all_->FilterGet(&h, &object);
       if (object->type != type)
         continue;
 
@@ -400,89 +437,16 @@ class PluginRamCache : public Callbackable<MallocHeap::BlockPtr> {
                          : NULL;
       lst->elems.push_back(item);
     }
-    Me()->objects_all_->FilterEnd();
-
-    Me()->listings_.Insert(lst_id, lst);
-    return CVMCACHE_STATUS_OK;
-  }
-
-
-  static int ram_listing_next(
-    int64_t listing_id,
-    struct cvmcache_object_info *item)
-  {
-    Listing *lst;
-    bool retval = Me()->listings_.Lookup(listing_id, &lst);
-    assert(retval);
-    if (lst->pos >= lst->elems.size())
-      return CVMCACHE_STATUS_OUTOFBOUNDS;
-    *item = lst->elems[lst->pos];
-    lst->pos++;
-    return CVMCACHE_STATUS_OK;
+    objects_all_->FilterEnd();
   }
 
-
-  static int ram_listing_end(int64_t listing_id) {
-    Listing *lst;
-    bool retval = Me()->listings_.Lookup(listing_id, &lst);
-    assert(retval);
-
-    // Don't free description strings, done by the library
-    delete lst;
-    Me()->listings_.Erase(listing_id);
-    return CVMCACHE_STATUS_OK;
-  }
+  uint64_t size_bytes() const { return cache_info_.size_bytes; }
 
  private:
-  static const uint64_t kMinSize;  // 100 * 1024 * 1024;
   static const double kShrinkFactor;  //  = 0.75;
   static const double kObjectExpandFactor;  // = 1.5;
-  static const double kSlotFraction;  // = 0.04;
   static const double kDangerZoneThreshold;  // = 0.7
 
-  static PluginRamCache *instance_;
-  static PluginRamCache *Me() {
-    return instance_;
-  }
-  explicit PluginRamCache(uint64_t mem_size) {
-    in_danger_zone_ = false;
-
-    uint64_t heap_size = RoundUp8(
-      std::max(kMinSize, uint64_t(mem_size * (1.0 - kSlotFraction))));
-    memset(&cache_info_, 0, sizeof(cache_info_));
-    cache_info_.size_bytes = heap_size;
-    storage_ = new MallocHeap(
-      heap_size, this->MakeCallback(&PluginRamCache::OnBlockMove, this));
-
-    struct cvmcache_hash hash_empty;
-    memset(&hash_empty, 0, sizeof(hash_empty));
-
-    transactions_.Init(64, uint64_t(-1), hasher_uint64);
-    listings_.Init(8, uint64_t(-1), hasher_uint64);
-
-    double slot_size =
-      lru::LruCache<ComparableHash, ObjectHeader *>::GetEntrySize();
-    uint64_t num_slots = uint64_t((heap_size * kSlotFraction) /
-                         (2.0 * slot_size));
-    const unsigned mask_64 = ~((1 << 6) - 1);
-
-    LogCvmfs(kLogCache, kLogDebug | kLogSyslog, "Allocating %" PRIu64
-             "MB of memory for up to %" PRIu64 " objects",
-             heap_size / (1024 * 1024), num_slots & mask_64);
-
-    // Number of cache entries must be a multiple of 64
-    objects_all_ = new lru::LruCache<ComparableHash, ObjectHeader *>(
-      num_slots & mask_64,
-      ComparableHash(hash_empty),
-      hasher_any,
-      perf::StatisticsTemplate("objects_all", &statistics_));
-    objects_volatile_ = new lru::LruCache<ComparableHash, ObjectHeader *>(
-      num_slots & mask_64,
-      ComparableHash(hash_empty),
-      hasher_any,
-      perf::StatisticsTemplate("objects_volatile", &statistics_));
-  }
-
   /**
    * Returns true if memory compaction took place and pointers might have been
    * invalidated.
@@ -565,10 +529,10 @@ class PluginRamCache : public Callbackable<MallocHeap::BlockPtr> {
   }
 
   void CheckHighPinWatermark() {
-    if (!Me()->in_danger_zone_ && Me()->IsInDangerZone()) {
+    if (!in_danger_zone_ && IsInDangerZone()) {
       LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslog,
                "high watermark of pinned files");
-      Me()->in_danger_zone_ = true;
+      in_danger_zone_ = true;
       cvmcache_ask_detach(ctx);
     }
   }
@@ -580,22 +544,340 @@ class PluginRamCache : public Callbackable<MallocHeap::BlockPtr> {
   }
 
 
+  pthread_mutex_t *lock_;
   struct cvmcache_info cache_info_;
   perf::Statistics statistics_;
   SmallHashDynamic<uint64_t, ObjectHeader *> transactions_;
-  SmallHashDynamic<uint64_t, Listing *> listings_;
   lru::LruCache<ComparableHash, ObjectHeader *> *objects_all_;
   lru::LruCache<ComparableHash, ObjectHeader *> *objects_volatile_;
   MallocHeap *storage_;
   bool in_danger_zone_;
+};  // class RamShard
+
+const double RamShard::kShrinkFactor = 0.75;
+const double RamShard::kObjectExpandFactor = 1.5;
+const double RamShard::kDangerZoneThreshold = 0.7;
+
+
+/**
+ * Implements all the cache plugin callbacks.  Singelton.  The callbacks are
+ * forwarded to the shard of the object.  Transactions are mapped to their
+ * shard when they start.
+ */
+class PluginRamCache {
+ public:
+  static PluginRamCache *Create(const string &mem_size_str,
+                                const unsigned num_shards,
+                                PeerCache *peers)
+  {
+    assert(instance_ == NULL);
+
+    uint64_t mem_size_bytes;
+    if (HasSuffix(mem_size_str, "%", false)) {
+      mem_size_bytes = platform_memsize() * String2Uint64(mem_size_str) / 100;
+    } else {
+      mem_size_bytes = String2Uint64(mem_size_str) * 1024 * 1024;
+    }
+    instance_ = new PluginRamCache(mem_size_bytes, num_shards, peers);
+    return instance_;
+  }
+
+  ~PluginRamCache() {
+    delete peers_;
+    for (unsigned i = 0; i < shards_.size(); ++i)
+      delete shards_[i];
+    pthread_mutex_destroy(&lock_);
+    instance_ = NULL;
+  }
+
+  static int ram_chrefcnt(struct cvmcache_hash *id, int32_t change_by) {
+    int retval =
+      Me()->GetShard(id)->ChangeRefcnt(ComparableHash(*id), change_by);
+    if ((retval != CVMCACHE_STATUS_NOENTRY) || (change_by <= 0) ||
+        (Me()->peers_ == NULL))
+    {
+      return retval;
+    }
+    return Me()->FetchFromPeer(id, change_by);
+  }
+
+
+  static int ram_obj_info(
+    struct cvmcache_hash *id,
+    struct cvmcache_object_info *info)
+  {
+    return Me()->GetShard(id)->GetObjectInfo(ComparableHash(*id), info);
+  }
+
+
+  static int ram_pread(struct cvmcache_hash *id,
+                      uint64_t offset,
+                      uint32_t *size,
+                      unsigned char *buffer)
+  {
+    return Me()->GetShard(id)->Pread(ComparableHash(*id), offset, size,
+                                     buffer);
+  }
+
+
+  static int ram_start_txn(
+    struct cvmcache_hash *id,
+    uint64_t txn_id,
+    struct cvmcache_object_info *info)
+  {
+    RamShard *shard = Me()->GetShard(id);
+    int retval = shard->StartTxn(id, txn_id, info);
+    if (retval != CVMCACHE_STATUS_OK)
+      return retval;
+    MutexLockGuard guard(Me()->lock_);
+    Me()->transactions_.Insert(txn_id, shard);
+    return CVMCACHE_STATUS_OK;
+  }
+
+
+  static int ram_write_txn(
+    uint64_t txn_id,
+    unsigned char *buffer,
+    uint32_t size)
+  {
+    return Me()->GetTxnShard(txn_id)->WriteTxn(txn_id, buffer, size);
+  }
+
+
+  static int ram_commit_txn(uint64_t txn_id) {
+    struct cvmcache_hash id;
+    RamShard *shard = Me()->GetTxnShard(txn_id);
+    int retval = shard->CommitTxn(txn_id, &id);
+    if (retval != CVMCACHE_STATUS_OK)
+      return retval;
+    {
+      MutexLockGuard guard(Me()->lock_);
+      Me()->transactions_.Erase(txn_id);
+    }
+
+    if ((Me()->peers_ != NULL) && !Me()->peers_->IsOwner(id)) {
+      unsigned char *buffer;
+      uint64_t size;
+      if (shard->ReadObject(ComparableHash(id), &buffer, &size))
+        Me()->peers_->Push(id, buffer, size);
+    }
+    return CVMCACHE_STATUS_OK;
+  }
+
+
+  static int ram_abort_txn(uint64_t txn_id) {
+    int retval = Me()->GetTxnShard(txn_id)->AbortTxn(txn_id);
+    MutexLockGuard guard(Me()->lock_);
+    Me()->transactions_.Erase(txn_id);
+    return retval;
+  }
+
+
+  static int ram_info(struct cvmcache_info *info) {
+    memset(info, 0, sizeof(*info));
+    for (unsigned i = 0; i < Me()->shards_.size(); ++i)
+      Me()->shards_[i]->AddInfo(info);
+    return CVMCACHE_STATUS_OK;
+  }
+
+
+  /**
+   * Every shard gets shrunk to its share of the target size.
+   */
+  static int ram_shrink(uint64_t shrink_to, uint64_t *used) {
+    *used = 0;
+    for (unsigned i = 0; i < Me()->shards_.size(); ++i) {
+      RamShard *shard = Me()->shards_[i];
+      uint64_t shard_shrink_to = static_cast<uint64_t>(
+        static_cast<double>(shrink_to) *
+        (static_cast<double>(shard->size_bytes()) /
+         static_cast<double>(Me()->size_bytes_)));
+      *used += shard->Shrink(shard_shrink_to);
+    }
+    return (*used <= shrink_to) ? CVMCACHE_STATUS_OK : CVMCACHE_STATUS_PARTIAL;
+  }
+
+
+  static int ram_listing_begin(
+    uint64_t lst_id,
+    enum cvmcache_object_type type)
+  {
+    Listing *lst = new Listing();
+    for (unsigned i = 0; i < Me()->shards_.size(); ++i)
+      Me()->shards_[i]->List(type, lst);
+
+    MutexLockGuard guard(Me()->lock_);
+    Me()->listings_.Insert(lst_id, lst);
+    return CVMCACHE_STATUS_OK;
+  }
+
+
+  static int ram_listing_next(
+    int64_t listing_id,
+    struct cvmcache_object_info *item)
+  {
+    Listing *lst;
+    {
+      MutexLockGuard guard(Me()->lock_);
+      bool retval = Me()->listings_.Lookup(listing_id, &lst);
+      assert(retval);
+    }
+    if (lst->pos >= lst->elems.size())
+      return CVMCACHE_STATUS_OUTOFBOUNDS;
+    *item = lst->elems[lst->pos];
+    lst->pos++;
+    return CVMCACHE_STATUS_OK;
+  }
+
+
+  static int ram_listing_end(int64_t listing_id) {
+    Listing *lst;
+    {
+      MutexLockGuard guard(Me()->lock_);
+      bool retval = Me()->listings_.Lookup(listing_id, &lst);
+      assert(retval);
+      Me()->listings_.Erase(listing_id);
+    }
+
+    // Don't free description strings, done by the library
+    delete lst;
+    return CVMCACHE_STATUS_OK;
+  }
+
+ private:
+  static const uint64_t kMinSize;  // 100 * 1024 * 1024;
+  static const double kSlotFraction;  // = 0.04;
+  static const uint64_t kInternalTxnIdBase;  // = 1 << 63
+
+  static PluginRamCache *instance_;
+  static PluginRamCache *Me() {
+    return instance_;
+  }
+  PluginRamCache(uint64_t mem_size, unsigned num_shards, PeerCache *peers)
+    : peers_(peers)
+  {
+    int retval = pthread_mutex_init(&lock_, NULL);
+    assert(retval == 0);
+    atomic_init64(&next_internal_txn_id_);
+    transactions_.Init(64, uint64_t(-1), hasher_uint64);
+    listings_.Init(8, uint64_t(-1), hasher_uint64);
+
+    uint64_t heap_size = RoundUp8(
+      std::max(kMinSize, uint64_t(mem_size * (1.0 - kSlotFraction))));
+    double slot_size =
+      lru::LruCache<ComparableHash, ObjectHeader *>::GetEntrySize();
+    uint64_t num_slots = uint64_t((heap_size * kSlotFraction) /
+                         (2.0 * slot_size));
+    const unsigned mask_64 = ~((1 << 6) - 1);
+    // Every shard needs at least 64 cache entries
+    num_shards = std::max(1U, num_shards);
+    num_shards = std::min(num_shards, static_cast<unsigned>(num_slots / 64));
+
+    uint64_t shard_heap_size = RoundUp8(heap_size / num_shards);
+    uint64_t shard_num_slots = (num_slots / num_shards) & mask_64;
+    LogCvmfs(kLogCache, kLogDebug | kLogSyslog, "Allocating %" PRIu64
+             "MB of memory for up to %" PRIu64 " objects in %u shard(s)",
+             heap_size / (1024 * 1024), shard_num_slots * num_shards,
+             num_shards);
+
+    size_bytes_ = 0;
+    for (unsigned i = 0; i < num_shards; ++i) {
+      shards_.push_back(new RamShard(shard_heap_size, shard_num_slots));
+      size_bytes_ += shard_heap_size;
+    }
+  }
+
+  /**
+   * The LRU hash tables use the first bytes of the digest, the shard is
+   * selected by a hash over the entire digest in order to not correlate the
+   * two.
+   */
+  RamShard *GetShard(const struct cvmcache_hash *id) {
+    if (shards_.size() == 1)
+      return shards_[0];
+    uint32_t hash = MurmurHash2(id->digest, sizeof(id->digest), 0x5348524b);
+    return shards_[hash % shards_.size()];
+  }
+
+  /**
+   * Copies a missing object from its owner peer.  On success, the committed
+   * object is pinned once, like after a regular transaction.
+   */
+  int FetchFromPeer(struct cvmcache_hash *id, int32_t change_by) {
+    unsigned char *buffer;
+    uint64_t size;
+    if (!peers_->Fetch(*id, &buffer, &size))
+      return CVMCACHE_STATUS_NOENTRY;
+    int retval = InsertObject(id, buffer, size);
+    free(buffer);
+    if (retval != CVMCACHE_STATUS_OK)
+      return CVMCACHE_STATUS_NOENTRY;
+    if (change_by == 1)
+      return CVMCACHE_STATUS_OK;
+    return GetShard(id)->ChangeRefcnt(ComparableHash(*id), change_by - 1);
+  }
+
+  /**
+   * Stores an object with a transaction id that cannot clash with the ones
+   * handed out by the plugin library.
+   */
+  int InsertObject(struct cvmcache_hash *id,
+                   unsigned char *buffer,
+                   uint64_t size)
+  {
+    if (size > uint32_t(-1))
+      return CVMCACHE_STATUS_NOSPACE;
+    const uint64_t txn_id = kInternalTxnIdBase +
+      atomic_xadd64(&next_internal_txn_id_, 1);
+    struct cvmcache_object_info info;
+    memset(&info, 0, sizeof(info));
+    info.size = size;
+    info.type = CVMCACHE_OBJECT_REGULAR;
+
+    RamShard *shard = GetShard(id);
+    int retval = shard->StartTxn(id, txn_id, &info);
+    if (retval != CVMCACHE_STATUS_OK)
+      return retval;
+    if (size > 0) {
+      retval = shard->WriteTxn(txn_id, buffer, size);
+      if (retval != CVMCACHE_STATUS_OK) {
+        shard->AbortTxn(txn_id);
+        return retval;
+      }
+    }
+    retval = shard->CommitTxn(txn_id, NULL);
+    if (retval != CVMCACHE_STATUS_OK)
+      shard->AbortTxn(txn_id);
+    return retval;
+  }
+
+  RamShard *GetTxnShard(uint64_t txn_id) {
+    MutexLockGuard guard(lock_);
+    RamShard *shard;
+    bool retval = transactions_.Lookup(txn_id, &shard);
+    assert(retval);
+    return shard;
+  }
+
+  /**
+   * Protects the transaction and the listing maps
+   */
+  pthread_mutex_t lock_;
+  SmallHashDynamic<uint64_t, RamShard *> transactions_;
+  SmallHashDynamic<uint64_t, Listing *> listings_;
+  vector<RamShard *> shards_;
+  uint64_t size_bytes_;
+  /**
+   * NULL unless the plugin shares its objects with peers
+   */
+  PeerCache *peers_;
+  atomic_int64 next_internal_txn_id_;
 };  // class PluginRamCache
 
 PluginRamCache *PluginRamCache::instance_ = NULL;
 const uint64_t PluginRamCache::kMinSize = 100 * 1024 * 1024;
-const double PluginRamCache::kShrinkFactor = 0.75;
-const double PluginRamCache::kObjectExpandFactor = 1.5;
 const double PluginRamCache::kSlotFraction = 0.04;
-const double PluginRamCache::kDangerZoneThreshold = 0.7;
+const uint64_t PluginRamCache::kInternalTxnIdBase = uint64_t(1) << 63;
 
 
 static void Usage(const char *progname) {
@@ -637,11 +919,45 @@ int main(int argc, char **argv) {
     return 1;
   }
   char *test_mode = cvmcache_options_get(options, "CVMFS_CACHE_PLUGIN_TEST");
+  unsigned num_threads = 1;
+  char *threads = cvmcache_options_get(options, "CVMFS_CACHE_PLUGIN_THREADS");
+  if (threads != NULL) {
+    num_threads = std::max(uint64_t(1), String2Uint64(threads));
+    cvmcache_options_free(threads);
+  }
+  // Every shard gets an equal part of the memory, so the largest object must
+  // fit into CVMFS_CACHE_PLUGIN_SIZE / CVMFS_CACHE_PLUGIN_SHARDS
+  unsigned num_shards = num_threads;
+  char *shards = cvmcache_options_get(options, "CVMFS_CACHE_PLUGIN_SHARDS");
+  if (shards != NULL) {
+    num_shards = std::max(uint64_t(1), String2Uint64(shards));
+    cvmcache_options_free(shards);
+  }
 
   if (!test_mode)
     cvmcache_spawn_watchdog(NULL);
 
-  PluginRamCache *plugin = PluginRamCache::Create(mem_size);
+  PeerCache *peers = NULL;
+  char *peer_list = cvmcache_options_get(options, "CVMFS_CACHE_PLUGIN_PEERS");
+  if (peer_list != NULL) {
+    char *peer_locator =
+      cvmcache_options_get(options, "CVMFS_CACHE_PLUGIN_PEER_LOCATOR");
+    peers = PeerCache::Create(
+      (peer_locator != NULL) ? peer_locator : locator, peer_list);
+    if (peer_locator != NULL)
+      cvmcache_options_free(peer_locator);
+    cvmcache_options_free(peer_list);
+    if (peers == NULL) {
+      LogCvmfs(kLogCache, kLogStderr, "invalid CVMFS_CACHE_PLUGIN_PEERS");
+      cvmcache_options_fini(options);
+      return 1;
+    }
+    // Broken peer connections are handled by the peer cache
+    signal(SIGPIPE, SIG_IGN);
+  }
+
+  PluginRamCache *plugin =
+    PluginRamCache::Create(mem_size, num_shards, peers);
 
   struct cvmcache_callbacks callbacks;
   memset(&callbacks, 0, sizeof(callbacks));
@@ -701,7 +1017,9 @@ int main(int argc, char **argv) {
            "NOTE: this process needs to run as user cvmfs\n",
            locator);
 
-  cvmcache_process_requests(ctx, 0);
+  if (peers != NULL)
+    peers->Spawn();
+  cvmcache_process_requests(ctx, num_threads);
   if (test_mode)
     while (true) sleep(1);
   if (!cvmcache_is_supervised()) {
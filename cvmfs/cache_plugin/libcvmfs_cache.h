@@ -25,7 +25,8 @@ typedef struct OptionsManager cvmcache_option_map;
 enum cvmcache_hash_algorithm {
   CVMCACHE_HASH_SHA1 = 1,
   CVMCACHE_HASH_RIPEMD160,
-  CVMCACHE_HASH_SHAKE128
+  CVMCACHE_HASH_SHAKE128,
+  CVMCACHE_HASH_SHA256
 };
 
 // Mirrors cvmfs::EnumStatus protobuf definition
@@ -120,6 +121,7 @@ struct cvmcache_callbacks {
   /**
    * Returns CVMCACHE_STATUS_OUTOFBOUNDS if offset is larger than file size.
    * Otherwise must work if object's reference counter is larger than zero.
+   * For local clients, the buffer can be memory shared with the client.
    */
   int (*cvmcache_pread)(struct cvmcache_hash *id,
                         uint64_t offset,
@@ -181,7 +183,10 @@ struct cvmcache_context *cvmcache_init(struct cvmcache_callbacks *callbacks);
 int cvmcache_listen(struct cvmcache_context *ctx, char *locator);
 /**
  * Spawns a separate I/O thread that can be stopped with cvmcache_terminate.
- * The nworkers parameter is currently unused.
+ * With nworkers <= 1, the callbacks are called from the I/O thread.  With
+ * nworkers > 1, requests of different connections are dispatched to a pool of
+ * nworkers threads and the callbacks need to be thread-safe.  Requests of the
+ * same connection are still processed one after another.
  */
 void cvmcache_process_requests(struct cvmcache_context *ctx, unsigned nworkers);
 /**
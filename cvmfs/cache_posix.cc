@@ -18,7 +18,9 @@
  *
  * Files are created in txn directory first.  At the very latest
  * point they are renamed into their "real" content hash names atomically by
- * rename().  This concept is taken over from GROW-FS.
+ * rename().  This concept is taken over from GROW-FS.  On Linux, files are
+ * preferably created as unnamed O_TMPFILE files in the txn directory and
+ * linked into their final location by linkat().
  *
  * Identical URLs won't be concurrently downloaded.  The first thread performs
  * the download and informs the other, waiting threads on pipes.
@@ -43,13 +45,16 @@
 
 #include <algorithm>
 #include <cassert>
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <map>
 #include <vector>
 
 #include "atomic.h"
+#include "compression.h"
 #include "directory_entry.h"
 #include "download.h"
 #include "hash.h"
@@ -63,6 +68,8 @@
 #include "smalloc.h"
 #include "statistics.h"
 #include "util/posix.h"
+#include "util/string.h"
+#include "util_concurrency.h"
 
 #ifndef NFS_SUPER_MAGIC
 #define NFS_SUPER_MAGIC 0x6969
@@ -112,18 +119,104 @@ atomic_int32 CallGuard::global_drainout_ = 0;
 
 
 const uint64_t PosixCacheManager::kBigFile = 25 * 1024 * 1024;  // 25M
+const char *PosixCacheManager::kCompressedMarker = ".cvmfscompressed";
+
+
+PosixCacheManager::PosixCacheManager(
+  const string &cache_path,
+  const bool alien_cache)
+  : cache_path_(cache_path)
+  , txn_template_path_(cache_path_ + "/txn/fetchXXXXXX")
+  , txn_path_(cache_path_ + "/txn")
+  , alien_cache_(alien_cache)
+  , workaround_rename_(false)
+  , use_tmpfile_(false)
+  , cache_mode_(kCacheReadWrite)
+  , reports_correct_filesize_(true)
+  , fd_cache_size_(0)
+  , compressed_(false)
+  , fetch_locking_(false)
+{
+  atomic_init32(&no_inflight_txns_);
+  atomic_init32(&fd_cache_nentries_);
+  lock_fd_cache_ =
+    reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+  int retval = pthread_mutex_init(lock_fd_cache_, NULL);
+  assert(retval == 0);
+  lock_framed_readers_ =
+    reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+  retval = pthread_mutex_init(lock_framed_readers_, NULL);
+  assert(retval == 0);
+}
+
+
+/**
+ * Descriptors that are still referenced belong to open files.
+ */
+PosixCacheManager::~PosixCacheManager() {
+  while (!fd_cache_idle_.empty())
+    EraseFdCache(fd_cache_.find(fd_cache_idle_.front()));
+  pthread_mutex_destroy(lock_fd_cache_);
+  free(lock_fd_cache_);
+  for (map<int, zlib::FramedReader *>::iterator i = framed_readers_.begin(),
+       iEnd = framed_readers_.end(); i != iEnd; ++i)
+  {
+    delete i->second;
+  }
+  pthread_mutex_destroy(lock_framed_readers_);
+  free(lock_framed_readers_);
+}
 
 
 int PosixCacheManager::AbortTxn(void *txn) {
   Transaction *transaction = reinterpret_cast<Transaction *>(txn);
   LogCvmfs(kLogCache, kLogDebug, "abort %s", transaction->tmp_path.c_str());
-  close(transaction->fd);
-  int result = unlink(transaction->tmp_path.c_str());
+  if (!transaction->tmpfile)
+    close(transaction->fd);
+  int result = DropTxnFile(transaction);
+  ReleaseFetchLock(transaction);
   transaction->~Transaction();
   atomic_dec32(&no_inflight_txns_);
-  if (result == -1)
-    return -errno;
-  return 0;
+  return result;
+}
+
+
+/**
+ * Creates the fetch marker of id.  If another node holds the marker, waits
+ * until the object appears in the cache, the marker is released or the marker
+ * times out.  Returns 0 if the marker is acquired, -EEXIST if the object has
+ * been stored by another node, or another -errno.
+ */
+int PosixCacheManager::AcquireFetchLock(const shash::Any &id, string *lock_path)
+{
+  *lock_path = txn_path_ + "/fetch." + id.ToString();
+  unsigned backoff_ms = 10;
+  while (true) {
+    const int fd = open(lock_path->c_str(), O_WRONLY | O_CREAT | O_EXCL, 0660);
+    if (fd >= 0) {
+      close(fd);
+      return 0;
+    }
+    if (errno != EEXIST)
+      return -errno;
+
+    if (FileExists(GetPathInCache(id))) {
+      LogCvmfs(kLogCache, kLogDebug, "%s stored by another node",
+               id.ToString().c_str());
+      return -EEXIST;
+    }
+    platform_stat64 info;
+    if (platform_stat(lock_path->c_str(), &info) != 0)
+      continue;
+    if (info.st_mtime + static_cast<int>(kFetchLockTimeout) < time(NULL)) {
+      LogCvmfs(kLogCache, kLogDebug | kLogSyslogWarn,
+               "taking over stale fetch marker of %s", id.ToString().c_str());
+      unlink(lock_path->c_str());
+      continue;
+    }
+    SafeSleepMs(backoff_ms);
+    backoff_ms = std::min(2 * backoff_ms, 1000u);
+  }
 }
 
 
@@ -142,6 +235,26 @@ bool PosixCacheManager::AcquireQuotaManager(QuotaManager *quota_mgr) {
 
 
 int PosixCacheManager::Close(int fd) {
+  if (atomic_read32(&fd_cache_nentries_) > 0) {
+    MutexLockGuard guard(lock_fd_cache_);
+    map<int, FdCacheEntry>::iterator iter = fd_cache_.find(fd);
+    if (iter != fd_cache_.end()) {
+      if (iter->second.refcnt == 0)
+        return -EBADF;
+      if (--iter->second.refcnt == 0) {
+        if (iter->second.detached) {
+          EraseFdCache(iter);
+        } else {
+          iter->second.pos_idle =
+            fd_cache_idle_.insert(fd_cache_idle_.end(), fd);
+        }
+      }
+      return 0;
+    }
+  }
+
+  if (compressed_)
+    ForgetFramed(fd);
   int retval = close(fd);
   if (retval != 0)
     return -errno;
@@ -156,9 +269,12 @@ int PosixCacheManager::CommitTxn(void *txn) {
            transaction->final_path.c_str(), transaction->tmp_path.c_str());
 
   result = Flush(transaction);
-  close(transaction->fd);
+  // An unnamed file vanishes when it is closed, so it is linked first
+  if (!transaction->tmpfile)
+    close(transaction->fd);
   if (result < 0) {
-    unlink(transaction->tmp_path.c_str());
+    DropTxnFile(transaction);
+    ReleaseFetchLock(transaction);
     transaction->~Transaction();
     atomic_dec32(&no_inflight_txns_);
     return result;
@@ -177,8 +293,9 @@ int PosixCacheManager::CommitTxn(void *txn) {
                transaction->expected_size, transaction->size);
       CopyPath2Path(transaction->tmp_path,
                     cache_path_ + "/quarantaine/" + transaction->id.ToString());
-      unlink(transaction->tmp_path.c_str());
-      transaction->~Transaction();
+      DropTxnFile(transaction);
+      ReleaseFetchLock(transaction);
+    transaction->~Transaction();
       atomic_dec32(&no_inflight_txns_);
       return -EIO;
     }
@@ -193,38 +310,58 @@ int PosixCacheManager::CommitTxn(void *txn) {
     if (!retval) {
       LogCvmfs(kLogCache, kLogDebug, "commit failed: cannot pin %s",
                transaction->id.ToString().c_str());
-      unlink(transaction->tmp_path.c_str());
-      transaction->~Transaction();
+      DropTxnFile(transaction);
+      ReleaseFetchLock(transaction);
+    transaction->~Transaction();
       atomic_dec32(&no_inflight_txns_);
       return -ENOSPC;
     }
   }
 
+  uint64_t size_on_disk = transaction->size;
+  if (compressed_ && (transaction->size > 0) &&
+      ((transaction->object_info.type == kTypeRegular) ||
+       (transaction->object_info.type == kTypeVolatile)))
+  {
+    size_on_disk = CompressTxn(transaction);
+  }
+
   // Move the temporary file into its final location
   if (alien_cache_) {
     int retval = chmod(transaction->tmp_path.c_str(), 0660);
     assert(retval == 0);
   }
-  result =
-    Rename(transaction->tmp_path.c_str(), transaction->final_path.c_str());
+  if (transaction->tmpfile) {
+    result = LinkTmpfile(transaction);
+  } else {
+    result =
+      Rename(transaction->tmp_path.c_str(), transaction->final_path.c_str());
+  }
   if (result < 0) {
-    LogCvmfs(kLogCache, kLogDebug, "commit failed: %s", strerror(errno));
-    unlink(transaction->tmp_path.c_str());
+    LogCvmfs(kLogCache, kLogDebug, "commit failed: %s", strerror(-result));
+    DropTxnFile(transaction);
     if ((transaction->object_info.type == kTypePinned) ||
         (transaction->object_info.type == kTypeCatalog))
     {
       quota_mgr_->Remove(transaction->id);
     }
   } else {
+    if (transaction->tmpfile)
+      close(transaction->fd);
+    // Readers of the previous copy keep their descriptor
+    if (atomic_read32(&fd_cache_nentries_) > 0)
+      DetachFdCache(transaction->id);
     // Success, inform quota manager
     if (transaction->object_info.type == kTypeVolatile) {
-      quota_mgr_->InsertVolatile(transaction->id, transaction->size,
+      quota_mgr_->InsertVolatile(transaction->id, size_on_disk,
                                  transaction->object_info.description);
     } else if (transaction->object_info.type == kTypeRegular) {
-      quota_mgr_->Insert(transaction->id, transaction->size,
+      quota_mgr_->Insert(transaction->id, size_on_disk,
                          transaction->object_info.description);
     }
   }
+  // Waiting nodes find the object in place when the marker vanishes
+  ReleaseFetchLock(transaction);
   transaction->~Transaction();
   atomic_dec32(&no_inflight_txns_);
   return result;
@@ -267,10 +404,92 @@ PosixCacheManager *PosixCacheManager::Create(
     return NULL;
   }
 
+  // Alien caches are shared, possibly over network file systems
+  if (!cache_manager->alien_cache_ && !cache_manager->workaround_rename_)
+    cache_manager->use_tmpfile_ = cache_manager->ProbeTmpfile();
+
+  if (!cache_manager->alien_cache_ &&
+      FileExists(cache_path + "/" + kCompressedMarker))
+  {
+    cache_manager->compressed_ = true;
+  }
+
   return cache_manager.Release();
 }
 
 
+/**
+ * Replaces the file of a committing transaction by a framed, compressed copy
+ * unless the object does not compress.  Returns the size of the transaction
+ * file that ends up in the cache.
+ */
+uint64_t PosixCacheManager::CompressTxn(Transaction *transaction) {
+  const int fd_src = open(transaction->tmp_path.c_str(), O_RDONLY);
+  if (fd_src < 0)
+    return transaction->size;
+  bool tmpfile;
+  string tmp_path;
+  const int fd_dest = CreateTxnFile(&tmpfile, &tmp_path);
+  if (fd_dest < 0) {
+    close(fd_src);
+    return transaction->size;
+  }
+
+  uint64_t framed_size = 0;
+  const bool retval = zlib::CompressFd2Framed(fd_src, fd_dest, &framed_size);
+  close(fd_src);
+  if (!retval || (framed_size >= transaction->size)) {
+    LogCvmfs(kLogCache, kLogDebug, "storing %s uncompressed",
+             transaction->id.ToString().c_str());
+    close(fd_dest);
+    if (!tmpfile)
+      unlink(tmp_path.c_str());
+    return transaction->size;
+  }
+
+  DropTxnFile(transaction);
+  transaction->tmpfile = tmpfile;
+  transaction->tmp_path = tmp_path;
+  // Like the original file, a named file is closed before it is renamed
+  if (tmpfile) {
+    transaction->fd = fd_dest;
+  } else {
+    close(fd_dest);
+    transaction->fd = -1;
+  }
+  return framed_size;
+}
+
+
+/**
+ * Creates an unnamed O_TMPFILE file or, if not supported, a named file in the
+ * txn directory.  Returns the file descriptor or -errno.
+ */
+int PosixCacheManager::CreateTxnFile(bool *tmpfile, string *tmp_path) {
+#ifdef O_TMPFILE
+  if (use_tmpfile_) {
+    const int fd = open(txn_path_.c_str(), O_TMPFILE | O_RDWR, 0600);
+    if (fd == -1)
+      return -errno;
+    *tmpfile = true;
+    *tmp_path = "/proc/self/fd/" + StringifyInt(fd);
+    return fd;
+  }
+#endif
+
+  const unsigned temp_path_len = txn_template_path_.length();
+  char template_path[temp_path_len + 1];
+  memcpy(template_path, &txn_template_path_[0], temp_path_len);
+  template_path[temp_path_len] = '\0';
+  const int fd = mkstemp(template_path);
+  if (fd == -1)
+    return -errno;
+  *tmpfile = false;
+  *tmp_path = template_path;
+  return fd;
+}
+
+
 void PosixCacheManager::CtrlTxn(
   const ObjectInfo &object_info,
   const int flags,
@@ -282,37 +501,104 @@ void PosixCacheManager::CtrlTxn(
 
 
 string PosixCacheManager::Describe() {
-  return "Posix cache manager (cache directory: " + cache_path_ + ")\n";
+  return "Posix cache manager (cache directory: " + cache_path_ +
+         (compressed_ ? ", compressed" : "") + ")\n";
 }
 
 
 /**
- * Nothing to do, the kernel keeps the state of open file descriptors.  Return
- * a dummy memory location.
+ * The kernel keeps the state of open file descriptors.  Only the reference
+ * counters of shared descriptors in the fd cache need to be handed over.
+ * Without shared descriptors, return a dummy memory location like older
+ * versions did.
  */
 void *PosixCacheManager::DoSaveState() {
-  char *c = reinterpret_cast<char *>(smalloc(1));
-  *c = '\0';
-  return c;
+  MutexLockGuard guard(lock_fd_cache_);
+  while (!fd_cache_idle_.empty())
+    EraseFdCache(fd_cache_.find(fd_cache_idle_.front()));
+  if (fd_cache_.empty()) {
+    char *c = reinterpret_cast<char *>(smalloc(1));
+    *c = '\0';
+    return c;
+  }
+
+  SavedFdCache *saved_fd_cache = new SavedFdCache();
+  for (map<int, FdCacheEntry>::const_iterator i = fd_cache_.begin(),
+       iEnd = fd_cache_.end(); i != iEnd; ++i)
+  {
+    saved_fd_cache->fd2refcnt[i->first] = i->second.refcnt;
+  }
+  return saved_fd_cache;
 }
 
 
 bool PosixCacheManager::DoRestoreState(void *data) {
   assert(data);
   char *c = reinterpret_cast<char *>(data);
-  assert(*c == '\0');
+  if (*c == '\0')
+    return true;
+
+  SavedFdCache *saved_fd_cache = reinterpret_cast<SavedFdCache *>(data);
+  if (saved_fd_cache->version != SavedFdCache().version)
+    return false;
+  MutexLockGuard guard(lock_fd_cache_);
+  for (map<int, unsigned>::const_iterator
+       i = saved_fd_cache->fd2refcnt.begin(),
+       iEnd = saved_fd_cache->fd2refcnt.end(); i != iEnd; ++i)
+  {
+    if (fd_cache_.count(i->first) > 0)
+      continue;
+    FdCacheEntry entry;
+    entry.refcnt = i->second;
+    entry.detached = true;
+    fd_cache_[i->first] = entry;
+    atomic_inc32(&fd_cache_nentries_);
+  }
   return true;
 }
 
 
 bool PosixCacheManager::DoFreeState(void *data) {
-  free(data);
+  char *c = reinterpret_cast<char *>(data);
+  if (*c == '\0') {
+    free(data);
+  } else {
+    delete reinterpret_cast<SavedFdCache *>(data);
+  }
   return true;
 }
 
 
+/**
+ * Stops sharing the descriptor of an object.  Closes it if it is idle.
+ * Called with the fd cache unlocked.
+ */
+void PosixCacheManager::DetachFdCache(const shash::Any &id) {
+  MutexLockGuard guard(lock_fd_cache_);
+  map<shash::Any, int>::iterator iter_id = fd_cache_ids_.find(id);
+  if (iter_id == fd_cache_ids_.end())
+    return;
+  map<int, FdCacheEntry>::iterator iter = fd_cache_.find(iter_id->second);
+  assert(iter != fd_cache_.end());
+  if (iter->second.refcnt == 0) {
+    EraseFdCache(iter);
+  } else {
+    iter->second.detached = true;
+    fd_cache_ids_.erase(iter_id);
+  }
+}
+
 
 int PosixCacheManager::Dup(int fd) {
+  if (atomic_read32(&fd_cache_nentries_) > 0) {
+    MutexLockGuard guard(lock_fd_cache_);
+    map<int, FdCacheEntry>::iterator iter = fd_cache_.find(fd);
+    if ((iter != fd_cache_.end()) && (iter->second.refcnt > 0)) {
+      iter->second.refcnt++;
+      return fd;
+    }
+  }
+
   int new_fd = dup(fd);
   if (new_fd < 0)
     return -errno;
@@ -320,6 +606,39 @@ int PosixCacheManager::Dup(int fd) {
 }
 
 
+bool PosixCacheManager::EnableCompression() {
+  if (alien_cache_)
+    return false;
+  if (!compressed_) {
+    const int fd = open((cache_path_ + "/" + kCompressedMarker).c_str(),
+                        O_WRONLY | O_CREAT, 0600);
+    if (fd < 0)
+      return false;
+    close(fd);
+    compressed_ = true;
+  }
+  return true;
+}
+
+
+/**
+ * Removes an unreferenced entry and closes its descriptor.  Called with the fd
+ * cache locked.
+ */
+void PosixCacheManager::EraseFdCache(map<int, FdCacheEntry>::iterator iter) {
+  assert(iter->second.refcnt == 0);
+  if (!iter->second.detached) {
+    fd_cache_ids_.erase(iter->second.id);
+    fd_cache_idle_.erase(iter->second.pos_idle);
+  }
+  if (compressed_)
+    ForgetFramed(iter->first);
+  close(iter->first);
+  fd_cache_.erase(iter);
+  atomic_dec32(&fd_cache_nentries_);
+}
+
+
 int PosixCacheManager::Flush(Transaction *transaction) {
   if (transaction->buf_pos == 0)
     return 0;
@@ -336,12 +655,62 @@ int PosixCacheManager::Flush(Transaction *transaction) {
 }
 
 
+/**
+ * Removes the file of an aborted or failed transaction.  Named files are
+ * unlinked (their descriptor is already closed), unnamed files are freed by
+ * closing their descriptor.
+ */
+int PosixCacheManager::DropTxnFile(Transaction *transaction) {
+  int retval;
+  if (transaction->tmpfile)
+    retval = close(transaction->fd);
+  else
+    retval = unlink(transaction->tmp_path.c_str());
+  if (retval != 0)
+    return -errno;
+  return 0;
+}
+
+
+void PosixCacheManager::ReleaseFetchLock(Transaction *transaction) {
+  if (transaction->lock_path.empty())
+    return;
+  unlink(transaction->lock_path.c_str());
+  transaction->lock_path.clear();
+}
+
+
+void PosixCacheManager::ForgetFramed(int fd) {
+  MutexLockGuard guard(lock_framed_readers_);
+  map<int, zlib::FramedReader *>::iterator iter = framed_readers_.find(fd);
+  if (iter == framed_readers_.end())
+    return;
+  delete iter->second;
+  framed_readers_.erase(iter);
+}
+
+
+/**
+ * The content of compressed objects cannot be spliced
+ */
+int PosixCacheManager::GetNativeFd(int fd) {
+  if (compressed_ && (LookupFramed(fd) != NULL))
+    return -1;
+  return fd;
+}
+
+
 inline string PosixCacheManager::GetPathInCache(const shash::Any &id) {
   return cache_path_ + "/" + id.MakePathWithoutSuffix();
 }
 
 
 int64_t PosixCacheManager::GetSize(int fd) {
+  if (compressed_) {
+    zlib::FramedReader *reader = LookupFramed(fd);
+    if (reader != NULL)
+      return reader->size();
+  }
   platform_stat64 info;
   int retval = platform_fstat(fd, &info);
   if (retval != 0)
@@ -350,22 +719,131 @@ int64_t PosixCacheManager::GetSize(int fd) {
 }
 
 
+/**
+ * Remembers a freshly opened descriptor in the fd cache.  If another thread
+ * was faster, the descriptor is replaced by the shared one.
+ */
+void PosixCacheManager::InsertFdCache(const shash::Any &id, int *fd) {
+  platform_stat64 info;
+  int retval = platform_fstat(*fd, &info);
+  if ((retval != 0) ||
+      (static_cast<uint64_t>(info.st_size) > kFdCacheMaxObjectSize))
+  {
+    return;
+  }
+
+  MutexLockGuard guard(lock_fd_cache_);
+  map<shash::Any, int>::const_iterator iter_id = fd_cache_ids_.find(id);
+  if (iter_id != fd_cache_ids_.end()) {
+    FdCacheEntry *entry = &fd_cache_[iter_id->second];
+    if (entry->refcnt == 0)
+      fd_cache_idle_.erase(entry->pos_idle);
+    entry->refcnt++;
+    if (compressed_)
+      ForgetFramed(*fd);
+    close(*fd);
+    *fd = iter_id->second;
+    return;
+  }
+
+  if (fd_cache_.size() >= fd_cache_size_) {
+    if (fd_cache_idle_.empty())
+      return;
+    EraseFdCache(fd_cache_.find(fd_cache_idle_.front()));
+  }
+  FdCacheEntry entry;
+  entry.id = id;
+  entry.refcnt = 1;
+  entry.timestamp_touch = platform_monotonic_time();
+  fd_cache_[*fd] = entry;
+  fd_cache_ids_[id] = *fd;
+  atomic_inc32(&fd_cache_nentries_);
+}
+
+
+/**
+ * Returns the reader of a compressed object or NULL for a plain file.
+ */
+zlib::FramedReader *PosixCacheManager::LookupFramed(int fd) {
+  MutexLockGuard guard(lock_framed_readers_);
+  map<int, zlib::FramedReader *>::const_iterator iter =
+    framed_readers_.find(fd);
+  if (iter != framed_readers_.end())
+    return iter->second;
+  zlib::FramedReader *reader = zlib::FramedReader::Create(fd);
+  framed_readers_[fd] = reader;
+  return reader;
+}
+
+
 int PosixCacheManager::Open(const BlessedObject &object) {
-  const string path = GetPathInCache(object.id);
-  int result = open(path.c_str(), O_RDONLY);
+  if (fd_cache_size_ > 0) {
+    int fd = OpenCached(object.id);
+    if (fd >= 0)
+      return fd;
+  }
+
+  // Opening objects is frequent, the path is assembled on the stack
+  char path_buf[PATH_MAX];
+  string path_str;
+  const char *path = path_buf;
+  const unsigned prefix_length = cache_path_.length() + 1;
+  if ((prefix_length >= sizeof(path_buf)) ||
+      (object.id.WritePathWithoutSuffix(path_buf + prefix_length,
+                                        sizeof(path_buf) - prefix_length) == 0))
+  {
+    path_str = GetPathInCache(object.id);
+    path = path_str.c_str();
+  } else {
+    memcpy(path_buf, cache_path_.data(), cache_path_.length());
+    path_buf[cache_path_.length()] = '/';
+  }
+  int result = open(path, O_RDONLY);
 
   if (result >= 0) {
-    LogCvmfs(kLogCache, kLogDebug, "hit %s", path.c_str());
+    LogCvmfs(kLogCache, kLogDebug, "hit %s", path);
     // platform_disable_kcache(result);
     quota_mgr_->Touch(object.id);
+    if (fd_cache_size_ > 0)
+      InsertFdCache(object.id, &result);
   } else {
     result = -errno;
-    LogCvmfs(kLogCache, kLogDebug, "miss %s (%d)", path.c_str(), result);
+    LogCvmfs(kLogCache, kLogDebug, "miss %s (%d)", path, result);
   }
   return result;
 }
 
 
+/**
+ * Returns a shared descriptor from the fd cache or -1 if the object has no
+ * cached descriptor.
+ */
+int PosixCacheManager::OpenCached(const shash::Any &id) {
+  bool touch = false;
+  int fd;
+  {
+    MutexLockGuard guard(lock_fd_cache_);
+    map<shash::Any, int>::const_iterator iter_id = fd_cache_ids_.find(id);
+    if (iter_id == fd_cache_ids_.end())
+      return -1;
+    fd = iter_id->second;
+    FdCacheEntry *entry = &fd_cache_[fd];
+    if (entry->refcnt == 0)
+      fd_cache_idle_.erase(entry->pos_idle);
+    entry->refcnt++;
+    const uint64_t now = platform_monotonic_time();
+    if (now >= entry->timestamp_touch + kFdCacheTouchPeriod) {
+      entry->timestamp_touch = now;
+      touch = true;
+    }
+  }
+  LogCvmfs(kLogCache, kLogDebug, "hit %s (fd cache)", id.ToString().c_str());
+  if (touch)
+    quota_mgr_->Touch(id);
+  return fd;
+}
+
+
 int PosixCacheManager::OpenFromTxn(void *txn) {
   Transaction *transaction = reinterpret_cast<Transaction *>(txn);
   int retval = Flush(transaction);
@@ -384,6 +862,12 @@ int64_t PosixCacheManager::Pread(
   uint64_t size,
   uint64_t offset)
 {
+  if (compressed_) {
+    zlib::FramedReader *reader = LookupFramed(fd);
+    if (reader != NULL)
+      return reader->Pread(fd, buf, size, offset);
+  }
+
   int64_t result;
   do {
     errno = 0;
@@ -395,6 +879,69 @@ int64_t PosixCacheManager::Pread(
 }
 
 
+/**
+ * Gives an unnamed transaction file its final name.  Unlike rename(), linkat()
+ * does not replace an existing object.  In this case, the file is linked under
+ * a temporary name in the txn directory first and then renamed.
+ */
+int PosixCacheManager::LinkTmpfile(Transaction *transaction) {
+  int retval = linkat(AT_FDCWD, transaction->tmp_path.c_str(),
+                      AT_FDCWD, transaction->final_path.c_str(),
+                      AT_SYMLINK_FOLLOW);
+  if (retval == 0)
+    return 0;
+  if (errno != EEXIST)
+    return -errno;
+
+  const unsigned temp_path_len = txn_template_path_.length();
+  char template_path[temp_path_len + 1];
+  memcpy(template_path, &txn_template_path_[0], temp_path_len);
+  template_path[temp_path_len] = '\0';
+  int fd = mkstemp(template_path);
+  if (fd < 0)
+    return -errno;
+  close(fd);
+  unlink(template_path);
+  retval = linkat(AT_FDCWD, transaction->tmp_path.c_str(),
+                  AT_FDCWD, template_path, AT_SYMLINK_FOLLOW);
+  if (retval != 0)
+    return -errno;
+  retval = Rename(template_path, transaction->final_path.c_str());
+  if (retval < 0)
+    unlink(template_path);
+  return retval;
+}
+
+
+/**
+ * Checks if the cache file system supports O_TMPFILE and if unnamed files can
+ * be linked through /proc/self/fd.
+ */
+bool PosixCacheManager::ProbeTmpfile() {
+#ifdef O_TMPFILE
+  const int fd = open(txn_path_.c_str(), O_TMPFILE | O_RDWR, 0600);
+  if (fd < 0) {
+    LogCvmfs(kLogCache, kLogDebug, "O_TMPFILE not supported (%d)", errno);
+    return false;
+  }
+  const string fd_path = "/proc/self/fd/" + StringifyInt(fd);
+  const string probe_path = txn_path_ + "/probe." + StringifyInt(getpid());
+  unlink(probe_path.c_str());
+  const int retval = linkat(AT_FDCWD, fd_path.c_str(),
+                            AT_FDCWD, probe_path.c_str(), AT_SYMLINK_FOLLOW);
+  close(fd);
+  if (retval != 0) {
+    LogCvmfs(kLogCache, kLogDebug, "cannot link O_TMPFILE files (%d)", errno);
+    return false;
+  }
+  unlink(probe_path.c_str());
+  return true;
+#else
+  return false;
+#endif
+}
+
+
 int PosixCacheManager::Rename(const char *oldpath, const char *newpath) {
   int result;
   if (workaround_rename_ == false) {
@@ -479,21 +1026,27 @@ int PosixCacheManager::StartTxn(
   }
 
   Transaction *transaction = new (txn) Transaction(id, GetPathInCache(id));
-  const unsigned temp_path_len = txn_template_path_.length();
-
-  char template_path[temp_path_len + 1];
-  memcpy(template_path, &txn_template_path_[0], temp_path_len);
-  template_path[temp_path_len] = '\0';
-  transaction->fd = mkstemp(template_path);
-  if (transaction->fd == -1) {
+  if (fetch_locking_) {
+    const int retval = AcquireFetchLock(id, &transaction->lock_path);
+    if (retval < 0) {
+      transaction->lock_path.clear();
+      transaction->~Transaction();
+      atomic_dec32(&no_inflight_txns_);
+      return retval;
+    }
+  }
+  const int fd =
+    CreateTxnFile(&transaction->tmpfile, &transaction->tmp_path);
+  if (fd < 0) {
+    ReleaseFetchLock(transaction);
     transaction->~Transaction();
     atomic_dec32(&no_inflight_txns_);
-    return -errno;
+    return fd;
   }
 
   LogCvmfs(kLogCache, kLogDebug, "start transaction on %s has result %d",
-           template_path, transaction->fd);
-  transaction->tmp_path = template_path;
+           transaction->tmp_path.c_str(), fd);
+  transaction->fd = fd;
   transaction->expected_size = size;
   return transaction->fd;
 }
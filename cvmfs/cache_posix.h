@@ -5,9 +5,11 @@
 #ifndef CVMFS_CACHE_POSIX_H_
 #define CVMFS_CACHE_POSIX_H_
 
+#include <pthread.h>
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <list>
 #include <map>
 #include <string>
 #include <vector>
@@ -32,6 +34,10 @@ namespace download {
 class DownloadManager;
 }
 
+namespace zlib {
+class FramedReader;
+}
+
 /**
  * Cache manger implementation using a file system (cache directory) as a
  * backing storage.
@@ -39,6 +45,8 @@ class DownloadManager;
 class PosixCacheManager : public CacheManager {
   FRIEND_TEST(T_CacheManager, CommitTxnQuotaNotifications);
   FRIEND_TEST(T_CacheManager, CommitTxnRenameFail);
+  FRIEND_TEST(T_CacheManager, FdCache);
+  FRIEND_TEST(T_CacheManager, FdCacheSaveState);
   FRIEND_TEST(T_CacheManager, Open);
   FRIEND_TEST(T_CacheManager, OpenFromTxn);
   FRIEND_TEST(T_CacheManager, OpenPinned);
@@ -58,6 +66,26 @@ class PosixCacheManager : public CacheManager {
    * the cache is cleaned up opportunistically.
    */
   static const uint64_t kBigFile;
+  /**
+   * Only the file descriptors of objects up to this size are kept open in the
+   * fd cache.  Open descriptors pin the disk space of evicted objects.
+   */
+  static const uint64_t kFdCacheMaxObjectSize = 1024 * 1024;
+  /**
+   * Reusing a cached file descriptor touches the object in the quota manager
+   * at most once in this period (seconds).
+   */
+  static const unsigned kFdCacheTouchPeriod = 60;
+  /**
+   * Marks a cache directory whose regular objects are stored compressed
+   */
+  static const char *kCompressedMarker;
+  /**
+   * A node that fetches an object into a locking alien cache holds the fetch
+   * marker of the object.  Markers older than this (seconds) belong to a
+   * crashed node and are taken over.
+   */
+  static const unsigned kFetchLockTimeout = 120;
 
   virtual CacheManagerIds id() { return kPosixCacheManager; }
   virtual std::string Describe();
@@ -65,7 +93,7 @@ class PosixCacheManager : public CacheManager {
   static PosixCacheManager *Create(const std::string &cache_path,
                                    const bool alien_cache,
                                    const bool workaround_rename_ = false);
-  virtual ~PosixCacheManager() { }
+  virtual ~PosixCacheManager();
   virtual bool AcquireQuotaManager(QuotaManager *quota_mgr);
 
   virtual int Open(const BlessedObject &object);
@@ -74,6 +102,7 @@ class PosixCacheManager : public CacheManager {
   virtual int64_t Pread(int fd, void *buf, uint64_t size, uint64_t offset);
   virtual int Dup(int fd);
   virtual int Readahead(int fd);
+  virtual int GetNativeFd(int fd);
 
   virtual uint32_t SizeOfTxn() { return sizeof(Transaction); }
   virtual int StartTxn(const shash::Any &id, uint64_t size, void *txn);
@@ -89,6 +118,35 @@ class PosixCacheManager : public CacheManager {
   virtual void Spawn() { }
 
   void TearDown2ReadOnly();
+  /**
+   * Keeps up to size file descriptors of small objects open.  Repeated opens
+   * of the same object share the descriptor, Close() only closes it when it is
+   * evicted from the fd cache.  Zero (the default) disables the fd cache.
+   */
+  void SetFdCacheSize(const unsigned size) { fd_cache_size_ = size; }
+  /**
+   * Forces transactions into named temporary files that are renamed on commit
+   */
+  void DisableTmpfile() { use_tmpfile_ = false; }
+  bool use_tmpfile() { return use_tmpfile_; }
+  /**
+   * Stores new regular and volatile objects as seekable compressed files.  The
+   * setting sticks with the cache directory.  Not for alien caches, whose
+   * objects are read by other nodes, too.
+   */
+  bool EnableCompression();
+  bool compressed() { return compressed_; }
+  /**
+   * Nodes sharing an alien cache and mounts sharing a local cache directory
+   * fetch every object only once.  The process that starts a transaction
+   * first creates a marker in the txn directory with O_EXCL.  Other processes
+   * wait for the object instead of downloading it, and their StartTxn()
+   * returns -EEXIST once it is in the cache.  Concurrent requests within a
+   * process are already merged by the fetcher, so only one thread per process
+   * waits on the marker.
+   */
+  void EnableFetchLocking() { fetch_locking_ = true; }
+  bool fetch_locking() { return fetch_locking_; }
   CacheModes cache_mode() { return cache_mode_; }
   bool alien_cache() { return alien_cache_; }
   std::string cache_path() { return cache_path_; }
@@ -106,8 +164,10 @@ class PosixCacheManager : public CacheManager {
       , expected_size(kSizeUnknown)
       , fd(-1)
       , object_info(kTypeRegular, "")
+      , tmpfile(false)
       , tmp_path()
       , final_path(final_path)
+      , lock_path()
       , id(id)
     { }
 
@@ -117,30 +177,75 @@ class PosixCacheManager : public CacheManager {
     uint64_t expected_size;
     int fd;
     ObjectInfo object_info;
+    /**
+     * Anonymous O_TMPFILE file, tmp_path is its /proc/self/fd link
+     */
+    bool tmpfile;
     std::string tmp_path;
     std::string final_path;
+    /**
+     * Fetch marker held by the transaction, empty without fetch locking
+     */
+    std::string lock_path;
+    shash::Any id;
+  };
+
+  /**
+   * A shared, reference counted file descriptor.  Detached entries are not
+   * found by their id anymore, e.g. because the object was replaced in the
+   * cache or because the entry was inherited from before a reload.  They are
+   * closed once the last reference is gone.
+   */
+  struct FdCacheEntry {
+    FdCacheEntry() : refcnt(0), timestamp_touch(0), detached(false) { }
     shash::Any id;
+    unsigned refcnt;
+    uint64_t timestamp_touch;
+    bool detached;
+    std::list<int>::iterator pos_idle;
+  };
+
+  /**
+   * Hot patch state of the fd cache: the descriptors that are still in use by
+   * open files and their reference counters.  Idle descriptors are closed.
+   * Older versions save a single '\0' character instead.
+   */
+  struct SavedFdCache {
+    SavedFdCache() : version(1) { }
+    char version;
+    std::map<int, unsigned> fd2refcnt;
   };
 
-  PosixCacheManager(const std::string &cache_path, const bool alien_cache)
-    : cache_path_(cache_path)
-    , txn_template_path_(cache_path_ + "/txn/fetchXXXXXX")
-    , alien_cache_(alien_cache)
-    , workaround_rename_(false)
-    , cache_mode_(kCacheReadWrite)
-    , reports_correct_filesize_(true)
-  {
-    atomic_init32(&no_inflight_txns_);
-  }
+  PosixCacheManager(const std::string &cache_path, const bool alien_cache);
 
   std::string GetPathInCache(const shash::Any &id);
+  int CreateTxnFile(bool *tmpfile, std::string *tmp_path);
+  int AcquireFetchLock(const shash::Any &id, std::string *lock_path);
+  void ReleaseFetchLock(Transaction *transaction);
+  uint64_t CompressTxn(Transaction *transaction);
+  zlib::FramedReader *LookupFramed(int fd);
+  void ForgetFramed(int fd);
+  bool ProbeTmpfile();
   int Rename(const char *oldpath, const char *newpath);
+  int LinkTmpfile(Transaction *transaction);
+  int DropTxnFile(Transaction *transaction);
   int Flush(Transaction *transaction);
+  int OpenCached(const shash::Any &id);
+  void InsertFdCache(const shash::Any &id, int *fd);
+  void DetachFdCache(const shash::Any &id);
+  void EraseFdCache(std::map<int, FdCacheEntry>::iterator iter);
 
   std::string cache_path_;
   std::string txn_template_path_;
+  std::string txn_path_;
   bool alien_cache_;
   bool workaround_rename_;
+  /**
+   * Transactions write into unnamed O_TMPFILE files which are linked into
+   * their final location on commit (Linux).  Nothing is created or renamed in
+   * the txn directory, which takes the directory lock off the miss path.
+   */
+  bool use_tmpfile_;
   CacheModes cache_mode_;
 
   /**
@@ -154,6 +259,34 @@ class PosixCacheManager : public CacheManager {
    * Hack for HDFS which writes file sizes asynchronously.
    */
   bool reports_correct_filesize_;
+
+  /**
+   * Maximum number of descriptors in the fd cache, zero if disabled.
+   */
+  unsigned fd_cache_size_;
+  /**
+   * Number of entries in fd_cache_, allows Close() and Dup() to skip the lock
+   * if there is nothing cached.
+   */
+  atomic_int32 fd_cache_nentries_;
+  std::map<int, FdCacheEntry> fd_cache_;
+  std::map<shash::Any, int> fd_cache_ids_;
+  /**
+   * Unreferenced descriptors, least recently used first
+   */
+  std::list<int> fd_cache_idle_;
+  pthread_mutex_t *lock_fd_cache_;
+
+  /**
+   * Objects are stored compressed.  Every descriptor read from is probed once
+   * for the framed format, including descriptors inherited from before a
+   * reload.  Plain files, such as catalogs, have a NULL reader.
+   */
+  bool compressed_;
+  std::map<int, zlib::FramedReader *> framed_readers_;
+  pthread_mutex_t *lock_framed_readers_;
+
+  bool fetch_locking_;
 };  // class PosixCacheManager
 
 #endif  // CVMFS_CACHE_POSIX_H_
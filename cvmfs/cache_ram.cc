@@ -1,12 +1,20 @@
 /**
  * This file is part of the CernVM File System.
  */
+#define __STDC_FORMAT_MACROS
+
 #include "cvmfs_config.h"
 #include "cache_ram.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <unistd.h>
+
 #include <algorithm>
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
 #include <new>
 
@@ -19,6 +27,8 @@
 using namespace std;  // NOLINT
 
 const shash::Any RamCacheManager::kInvalidHandle;
+const double RamCacheManager::kPressureHigh = 10.0;
+const double RamCacheManager::kPressureLow = 1.0;
 
 string RamCacheManager::Describe() {
   return "Internal in-memory cache manager (size " +
@@ -32,6 +42,9 @@ RamCacheManager::RamCacheManager(
   MemoryKvStore::MemoryAllocator alloc,
   perf::StatisticsTemplate statistics)
   : max_size_(max_size)
+  , capacity_(max_size)
+  , min_size_(0)
+  , spawned_(false)
   , fd_table_(max_entries, ReadOnlyHandle())
   // TODO(jblomer): the number of slots in the kv-stores should _not_ be the
   // number of open files.
@@ -47,16 +60,132 @@ RamCacheManager::RamCacheManager(
 {
   int retval = pthread_rwlock_init(&rwlock_, NULL);
   assert(retval == 0);
+  pipe_terminate_[0] = pipe_terminate_[1] = -1;
+  counters_.sz_limit->Set(max_size_);
   LogCvmfs(kLogCache, kLogDebug, "max %u B, %u entries",
            max_size, max_entries);
 }
 
 
 RamCacheManager::~RamCacheManager() {
+  if (spawned_) {
+    char c = 'T';
+    WritePipe(pipe_terminate_[1], &c, 1);
+    pthread_join(thread_pressure_, NULL);
+    ClosePipe(pipe_terminate_);
+  }
   pthread_rwlock_destroy(&rwlock_);
 }
 
 
+void RamCacheManager::SetPressureAdaptation(
+  const uint64_t min_size,
+  const string &psi_path)
+{
+  assert(!spawned_);
+  min_size_ = std::min(min_size, capacity_);
+  psi_path_ = psi_path;
+}
+
+
+void RamCacheManager::Spawn() {
+  if ((min_size_ == 0) || (min_size_ == capacity_) || spawned_)
+    return;
+  MakePipe(pipe_terminate_);
+  int retval = pthread_create(&thread_pressure_, NULL, MainPressure, this);
+  assert(retval == 0);
+  spawned_ = true;
+}
+
+
+void RamCacheManager::SetSizeLimit(const uint64_t size) {
+  WriteLockGuard guard(rwlock_);
+  max_size_ = std::min(size, capacity_);
+  counters_.sz_limit->Set(max_size_);
+  int64_t overrun = regular_entries_.GetUsed() + volatile_entries_.GetUsed() -
+                    max_size_;
+  if (overrun <= 0)
+    return;
+  const int64_t volatile_size = volatile_entries_.GetUsed();
+  volatile_entries_.ShrinkTo(max((int64_t) 0, volatile_size - overrun));
+  overrun -= volatile_size - volatile_entries_.GetUsed();
+  if (overrun > 0) {
+    const int64_t regular_size = regular_entries_.GetUsed();
+    regular_entries_.ShrinkTo(max((int64_t) 0, regular_size - overrun));
+  }
+}
+
+
+bool RamCacheManager::ParsePsi(const string &psi, double *avg10) {
+  const string prefix = "some avg10=";
+  if (psi.compare(0, prefix.length(), prefix) != 0)
+    return false;
+  const char *begin = psi.c_str() + prefix.length();
+  char *end;
+  *avg10 = strtod(begin, &end);
+  return end != begin;
+}
+
+
+uint64_t RamCacheManager::NextSizeLimit(
+  const uint64_t current,
+  const uint64_t min_size,
+  const uint64_t max_size,
+  const double pressure)
+{
+  if (pressure >= kPressureHigh)
+    return std::max(min_size, current - current / 4);
+  if (pressure < kPressureLow)
+    return std::min(max_size, current + (max_size - min_size) / 8);
+  return current;
+}
+
+
+void *RamCacheManager::MainPressure(void *data) {
+  RamCacheManager *cache_mgr = reinterpret_cast<RamCacheManager *>(data);
+  LogCvmfs(kLogCache, kLogDebug, "memory pressure thread started (%s)",
+           cache_mgr->psi_path_.c_str());
+
+  struct pollfd watch_term;
+  watch_term.fd = cache_mgr->pipe_terminate_[0];
+  watch_term.events = POLLIN | POLLPRI;
+  while (true) {
+    watch_term.revents = 0;
+    int retval = poll(&watch_term, 1, kPressureIntervalMs);
+    if ((retval < 0) && (errno == EINTR))
+      continue;
+    if (retval != 0)
+      break;
+
+    const int fd = open(cache_mgr->psi_path_.c_str(), O_RDONLY);
+    if (fd < 0)
+      continue;
+    string psi;
+    const bool has_psi = SafeReadToString(fd, &psi);
+    close(fd);
+    double pressure;
+    if (!has_psi || !ParsePsi(psi, &pressure))
+      continue;
+
+    const uint64_t current = cache_mgr->max_size_;
+    const uint64_t next = NextSizeLimit(
+      current, cache_mgr->min_size_, cache_mgr->capacity_, pressure);
+    if (next == current)
+      continue;
+    LogCvmfs(kLogCache, kLogDebug, "memory pressure %.2f%%, "
+             "changing size limit to %" PRIu64 " B", pressure, next);
+    if (next < current)
+      perf::Inc(cache_mgr->counters_.n_pressure_shrink);
+    else
+      perf::Inc(cache_mgr->counters_.n_pressure_grow);
+    cache_mgr->SetSizeLimit(next);
+  }
+
+  LogCvmfs(kLogCache, kLogDebug, "memory pressure thread stopped");
+  return NULL;
+}
+
+
 int RamCacheManager::AddFd(const ReadOnlyHandle &handle) {
   int result = fd_table_.OpenFd(handle);
   if (result == -ENFILE) {
@@ -35,7 +35,9 @@
  * with a percent sign, the cache size will be set to that
  * percentage of the system memory. If no size is specified, the
  * RAM cache size defaults to ~3% of the system memory.
- * The minimum cache size is 200 MB.
+ * The minimum cache size is 200 MB.  If @p CVMFS_CACHE_RAM_MIN_SIZE is set
+ * as well, the cache shrinks towards that size under memory pressure and grows
+ * back to @p CVMFS_CACHE_RAM_SIZE when there is plenty of memory.
  *
  * RamCacheManager uses a custom heap allocator rather than
  * the system's libc @p malloc(). To switch to libc malloc, set
@@ -61,6 +63,9 @@ class RamCacheManager : public CacheManager {
     perf::Counter *n_overrun;
     perf::Counter *n_full;
     perf::Counter *n_realloc;
+    perf::Counter *n_pressure_shrink;
+    perf::Counter *n_pressure_grow;
+    perf::Counter *sz_limit;
 
     explicit Counters(perf::StatisticsTemplate statistics) {
       n_getsize = statistics.RegisterTemplated("n_getsize",
@@ -97,6 +102,12 @@ class RamCacheManager : public CacheManager {
         "Number of cache limit overruns");
       n_full = statistics.RegisterTemplated("n_full",
         "Number of overruns that could not be resolved");
+      n_pressure_shrink = statistics.RegisterTemplated("n_pressure_shrink",
+        "Number of times the size limit was lowered due to memory pressure");
+      n_pressure_grow = statistics.RegisterTemplated("n_pressure_grow",
+        "Number of times the size limit was raised without memory pressure");
+      sz_limit = statistics.RegisterTemplated("sz_limit",
+        "Current size limit in bytes");
     }
   };
 
@@ -237,9 +248,51 @@ class RamCacheManager : public CacheManager {
    */
   virtual int CommitTxn(void *txn);
 
-  virtual void Spawn() { }
+  /**
+   * Starts the memory pressure thread if SetPressureAdaptation() was called.
+   */
+  virtual void Spawn();
+
+  /**
+   * Lets the size limit float between min_size and the size given on
+   * construction.  Every few seconds, the memory pressure is read from a Linux
+   * PSI file such as /proc/pressure/memory.  Under pressure, the limit is
+   * lowered and entries are evicted; without pressure, the limit slowly grows
+   * back.  Needs to be called before Spawn().
+   */
+  void SetPressureAdaptation(const uint64_t min_size,
+                             const std::string &psi_path);
+
+  /**
+   * Evicts entries, and releases their memory, if the cache is larger than
+   * the new limit.  The limit is capped by the size given on construction.
+   */
+  void SetSizeLimit(const uint64_t size);
+  uint64_t size_limit() { return max_size_; }
+  uint64_t GetMemoryUsage() {
+    return regular_entries_.GetMemoryUsage() +
+           volatile_entries_.GetMemoryUsage();
+  }
+
+  /**
+   * Extracts the "some avg10" value, the share of the last ten seconds in %
+   * in which at least one task stalled on memory.
+   */
+  static bool ParsePsi(const std::string &psi, double *avg10);
+  /**
+   * Shrinks by a quarter above kPressureHigh, grows by an eighth of the
+   * range below kPressureLow.
+   */
+  static uint64_t NextSizeLimit(const uint64_t current,
+                                const uint64_t min_size,
+                                const uint64_t max_size,
+                                const double pressure);
 
  private:
+  static const unsigned kPressureIntervalMs = 10000;
+  static const double kPressureHigh;  // = 10.0
+  static const double kPressureLow;  // = 1.0
+
   // The null hash (hashed output is all null bytes) serves as a marker for
   // an invalid handle
   static const shash::Any kInvalidHandle;
@@ -291,11 +344,27 @@ class RamCacheManager : public CacheManager {
     }
   }
 
+  static void *MainPressure(void *data);
   int AddFd(const ReadOnlyHandle &handle);
   int64_t CommitToKvStore(Transaction *transaction);
   virtual int DoOpen(const shash::Any &id);
 
+  /**
+   * The current size limit, only changed under the write lock
+   */
   uint64_t max_size_;
+  /**
+   * The size the cache was created with, the upper bound of max_size_
+   */
+  uint64_t capacity_;
+  /**
+   * Zero unless the size limit follows the memory pressure
+   */
+  uint64_t min_size_;
+  std::string psi_path_;
+  int pipe_terminate_[2];
+  pthread_t thread_pressure_;
+  bool spawned_;
   FdTable<ReadOnlyHandle> fd_table_;
   pthread_rwlock_t rwlock_;
   MemoryKvStore regular_entries_;
@@ -4,13 +4,22 @@
 #include "cvmfs_config.h"
 #include "cache_tiered.h"
 
+#include <alloca.h>
 #include <errno.h>
 
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <new>
 #include <string>
 #include <vector>
 
+#include "logging.h"
 #include "platform.h"
 #include "quota.h"
+#include "util_concurrency.h"
+
+const int TieredCacheManager::kLowerFdFlag;
 
 
 std::string TieredCacheManager::Describe() {
@@ -45,26 +54,27 @@ void *TieredCacheManager::DoSaveState() {
 }
 
 
-int TieredCacheManager::Open(const BlessedObject &object) {
-  int fd = upper_->Open(object);
-  if ((fd >= 0) || (fd != -ENOENT)) {return fd;}
-
-  int fd2 = lower_->Open(object);
-  if (fd2 < 0) {return fd;}  // NOTE: use error code from upper.
-
-  // Lower cache hit; upper cache miss.  Copy object into the upper cache.
-  int64_t size = lower_->GetSize(fd2);
-  if (size < 0) {
-    lower_->Close(fd2);
-    return fd;
-  }
+/**
+ * Copies the object behind fd_src into a new transaction of dst.  If open_dst
+ * is true, returns a file descriptor to the new object in dst, otherwise 0 on
+ * success.
+ */
+int TieredCacheManager::CopyObject(
+  CacheManager *src,
+  int fd_src,
+  CacheManager *dst,
+  const BlessedObject &object,
+  bool open_dst)
+{
+  int64_t size = src->GetSize(fd_src);
+  if (size < 0)
+    return size;
 
-  void *txn = alloca(upper_->SizeOfTxn());
-  if (upper_->StartTxn(object.id, size, txn) < 0) {
-    lower_->Close(fd2);
-    return fd;
-  }
-  upper_->CtrlTxn(object.info, 0, txn);
+  void *txn = alloca(dst->SizeOfTxn());
+  int retval = dst->StartTxn(object.id, size, txn);
+  if (retval < 0)
+    return retval;
+  dst->CtrlTxn(object.info, 0, txn);
 
   std::vector<char> m_buffer;
   m_buffer.reserve(kCopyBufferSize);
@@ -72,83 +82,314 @@ int TieredCacheManager::Open(const BlessedObject &object) {
   uint64_t offset = 0;
   while (remaining > 0) {
     unsigned nbytes = remaining > kCopyBufferSize ? kCopyBufferSize : remaining;
-    int64_t result = lower_->Pread(fd2, &m_buffer[0], nbytes, offset);
+    int64_t result = src->Pread(fd_src, &m_buffer[0], nbytes, offset);
     // The file we are reading is supposed to be exactly `size` bytes.
     if ((result < 0) || (result != nbytes)) {
-      lower_->Close(fd2);
-      upper_->AbortTxn(txn);
-      return fd;
+      dst->AbortTxn(txn);
+      return (result < 0) ? result : -EIO;
     }
-    result = upper_->Write(&m_buffer[0], nbytes, txn);
+    result = dst->Write(&m_buffer[0], nbytes, txn);
     if (result < 0) {
-      lower_->Close(fd2);
-      upper_->AbortTxn(txn);
-      return fd;
+      dst->AbortTxn(txn);
+      return result;
     }
     offset += nbytes;
     remaining -= nbytes;
   }
-  lower_->Close(fd2);
-  int fd_return = upper_->OpenFromTxn(txn);
-  if (fd_return < 0) {
-    upper_->AbortTxn(txn);
-    return fd;
+
+  int fd_return = 0;
+  if (open_dst) {
+    fd_return = dst->OpenFromTxn(txn);
+    if (fd_return < 0) {
+      dst->AbortTxn(txn);
+      return fd_return;
+    }
   }
-  if (upper_->CommitTxn(txn) < 0) {
-    upper_->Close(fd_return);
-    return fd;
+  retval = dst->CommitTxn(txn);
+  if (retval < 0) {
+    if (open_dst)
+      dst->Close(fd_return);
+    return retval;
   }
   return fd_return;
 }
 
 
+/**
+ * Returns true if the object was opened often enough from the lower cache to
+ * be promoted.
+ */
+bool TieredCacheManager::CountAccess(const shash::Any &id) {
+  MutexLockGuard guard(&lock_);
+  if (access_counts_.size() >= kMaxAccessCounters)
+    access_counts_.clear();
+  unsigned *count = &access_counts_[id];
+  if (++(*count) < promotion_accesses_)
+    return false;
+  access_counts_.erase(id);
+  return true;
+}
+
+
+int TieredCacheManager::Open(const BlessedObject &object) {
+  int fd = upper_->Open(object);
+  if ((fd >= 0) || (fd != -ENOENT)) {return fd;}
+
+  int fd2 = lower_->Open(object);
+  if (fd2 < 0) {return fd;}  // NOTE: use error code from upper.
+
+  // Lower cache hit; upper cache miss.  Promote the object into the upper
+  // cache or keep reading it from the lower one.  Catalogs and other pinned
+  // objects are always promoted because they are pinned in the upper cache.
+  bool promote = true;
+  const bool is_pinned = (object.info.type == kTypeCatalog) ||
+                         (object.info.type == kTypePinned);
+  switch (is_pinned ? kPromoteOnOpen : promotion_policy_) {
+    case kPromoteOnOpen:
+      break;
+    case kPromoteOnAccess:
+      promote = CountAccess(object.id);
+      break;
+    case kPromoteAsync:
+      promote = false;
+      Enqueue(CopyJob(object, true));
+      break;
+    default:
+      abort();
+  }
+  if (!promote) {
+    perf::Inc(counters_->n_lower_reads);
+    return TagFd(fd2);
+  }
+
+  int fd_return = CopyObject(lower_, fd2, upper_, object, true);
+  if (fd_return < 0) {
+    // Keep serving the object from the lower cache
+    perf::Inc(counters_->n_promotions_failed);
+    return TagFd(fd2);
+  }
+  lower_->Close(fd2);
+  perf::Inc(counters_->n_promotions);
+  return fd_return;
+}
+
+
 int TieredCacheManager::StartTxn(const shash::Any &id, uint64_t size, void *txn)
 {
   int upper_result = upper_->StartTxn(id, size, txn);
-  if (lower_readonly_ || (upper_result < 0)) {
+  if (upper_result < 0)
     return upper_result;
-  }
 
-  void *txn2 = static_cast<char *>(txn) + upper_->SizeOfTxn();
-  int lower_result = lower_->StartTxn(id, size, txn2);
-  if (lower_result < 0) {
-    upper_->AbortTxn(txn);
+  int result = upper_result;
+  if (WritesLower()) {
+    result = lower_->StartTxn(id, size, GetLowerTxn(txn));
+    if (result < 0) {
+      upper_->AbortTxn(txn);
+      return result;
+    }
   }
-  return lower_result;
+  TxnInfo *txn_info = new (GetTxnInfo(txn)) TxnInfo();
+  txn_info->id = id;
+  return result;
 }
 
 
 CacheManager *TieredCacheManager::Create(
   CacheManager *upper_cache,
-  CacheManager *lower_cache)
+  CacheManager *lower_cache,
+  perf::StatisticsTemplate statistics)
 {
   TieredCacheManager *cache_mgr =
-    new TieredCacheManager(upper_cache, lower_cache);
+    new TieredCacheManager(upper_cache, lower_cache, statistics);
   delete cache_mgr->quota_mgr_;
   cache_mgr->quota_mgr_ = upper_cache->quota_mgr();
+  if (cache_mgr->GetNesting() > kMaxNesting) {
+    LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
+             "tiered cache nested more than %u levels deep", kMaxNesting);
+    delete cache_mgr;
+    return NULL;
+  }
+  cache_mgr->SetLowerFdFlag(kLowerFdFlag);
   return cache_mgr;
 }
 
 
+/**
+ * Number of tiered cache levels including this one.
+ */
+unsigned TieredCacheManager::GetNesting() {
+  unsigned nesting_upper = 0;
+  unsigned nesting_lower = 0;
+  if (upper_->id() == kTieredCacheManager)
+    nesting_upper = static_cast<TieredCacheManager *>(upper_)->GetNesting();
+  if (lower_->id() == kTieredCacheManager)
+    nesting_lower = static_cast<TieredCacheManager *>(lower_)->GetNesting();
+  return 1 + std::max(nesting_upper, nesting_lower);
+}
+
+
+/**
+ * Assigns the mark for lower tier file descriptors to this instance and the
+ * next lower bits to the tiered caches nested in it.  Has to be called before
+ * any file is opened.
+ */
+void TieredCacheManager::SetLowerFdFlag(int flag) {
+  lower_fd_flag_ = flag;
+  if (upper_->id() == kTieredCacheManager)
+    static_cast<TieredCacheManager *>(upper_)->SetLowerFdFlag(flag >> 1);
+  if (lower_->id() == kTieredCacheManager)
+    static_cast<TieredCacheManager *>(lower_)->SetLowerFdFlag(flag >> 1);
+}
+
+
+TieredCacheManager::TieredCacheManager(
+  CacheManager *upper_cache,
+  CacheManager *lower_cache,
+  perf::StatisticsTemplate statistics)
+  : upper_(upper_cache)
+  , lower_(lower_cache)
+  , lower_fd_flag_(kLowerFdFlag)
+  , lower_readonly_(false)
+  , promotion_policy_(kPromoteOnOpen)
+  , promotion_accesses_(kDefaultPromotionAccesses)
+  , async_writeback_(false)
+  , max_queue_length_(kDefaultMaxQueueLength)
+  , counters_(new Counters(statistics))
+  , spawned_(false)
+  , terminated_(false)
+{
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&cond_jobs_, NULL);
+  assert(retval == 0);
+}
+
+
+/**
+ * With kPromoteOnAccess, objects are promoted on the min_accesses-th open from
+ * the lower cache.  With kPromoteAsync, they are promoted in the background;
+ * until then, they are read from the lower cache.
+ */
+void TieredCacheManager::SetPromotionPolicy(
+  const PromotionPolicy policy,
+  const unsigned min_accesses)
+{
+  promotion_policy_ = policy;
+  promotion_accesses_ = (min_accesses > 0) ? min_accesses : 1;
+}
+
+
+/**
+ * New objects are only written to the upper cache during the transaction and
+ * copied to the lower cache in the background after commit.
+ */
+void TieredCacheManager::SetAsyncWriteBack(const unsigned max_queue_length) {
+  async_writeback_ = true;
+  max_queue_length_ = max_queue_length;
+}
+
+
+/**
+ * Returns false if the job was not queued, either because the object is
+ * already being copied or because the queue is full.  Before Spawn(), jobs are
+ * queued but not processed.
+ */
+bool TieredCacheManager::Enqueue(const CopyJob &job) {
+  MutexLockGuard guard(&lock_);
+  if (in_flight_.find(job.object.id) != in_flight_.end())
+    return false;
+  if (jobs_.size() >= max_queue_length_) {
+    perf::Inc(counters_->n_copies_dropped);
+    return false;
+  }
+  in_flight_.insert(job.object.id);
+  jobs_.push_back(job);
+  counters_->sz_copy_queue->Set(jobs_.size());
+  pthread_cond_signal(&cond_jobs_);
+  return true;
+}
+
+
+/**
+ * Background copy thread, returns when terminated.  Pending copies are
+ * discarded on termination.
+ */
+void *TieredCacheManager::MainCopy(void *data) {
+  TieredCacheManager *cache_mgr = reinterpret_cast<TieredCacheManager *>(data);
+  LogCvmfs(kLogCache, kLogDebug, "starting tiered cache copy thread");
+
+  while (true) {
+    pthread_mutex_lock(&cache_mgr->lock_);
+    while (cache_mgr->jobs_.empty() && !cache_mgr->terminated_)
+      pthread_cond_wait(&cache_mgr->cond_jobs_, &cache_mgr->lock_);
+    if (cache_mgr->terminated_) {
+      pthread_mutex_unlock(&cache_mgr->lock_);
+      break;
+    }
+    CopyJob job = cache_mgr->jobs_.front();
+    cache_mgr->jobs_.pop_front();
+    cache_mgr->counters_->sz_copy_queue->Set(cache_mgr->jobs_.size());
+    pthread_mutex_unlock(&cache_mgr->lock_);
+
+    cache_mgr->ProcessCopyJob(job);
+
+    pthread_mutex_lock(&cache_mgr->lock_);
+    cache_mgr->in_flight_.erase(job.object.id);
+    pthread_mutex_unlock(&cache_mgr->lock_);
+  }
+
+  LogCvmfs(kLogCache, kLogDebug, "stopping tiered cache copy thread");
+  return NULL;
+}
+
+
+void TieredCacheManager::ProcessCopyJob(const CopyJob &job) {
+  CacheManager *src = job.to_upper ? lower_ : upper_;
+  CacheManager *dst = job.to_upper ? upper_ : lower_;
+
+  int retval = dst->Open(job.object);
+  if (retval >= 0) {
+    // Already there, e.g. downloaded in the meantime
+    dst->Close(retval);
+    return;
+  }
+  int fd_src = src->Open(job.object);
+  if (fd_src >= 0) {
+    retval = CopyObject(src, fd_src, dst, job.object, false);
+    src->Close(fd_src);
+  } else {
+    retval = fd_src;
+  }
+
+  if (retval < 0) {
+    LogCvmfs(kLogCache, kLogDebug, "failed to copy %s to the %s cache (%d)",
+             job.object.id.ToString().c_str(),
+             job.to_upper ? "upper" : "lower", retval);
+    perf::Inc(job.to_upper ? counters_->n_promotions_failed
+                           : counters_->n_writebacks_failed);
+    return;
+  }
+  perf::Inc(job.to_upper ? counters_->n_promotions : counters_->n_writebacks);
+}
+
+
 void TieredCacheManager::CtrlTxn(
   const ObjectInfo &object_info,
   const int flags,
   void *txn)
 {
   upper_->CtrlTxn(object_info, flags, txn);
-  if (!lower_readonly_) {
-    void *txn2 = static_cast<char*>(txn) + upper_->SizeOfTxn();
-    lower_->CtrlTxn(object_info, flags, txn2);
-  }
+  if (WritesLower())
+    lower_->CtrlTxn(object_info, flags, GetLowerTxn(txn));
+  GetTxnInfo(txn)->info = object_info;
 }
 
 
 int64_t TieredCacheManager::Write(const void *buf, uint64_t size, void *txn) {
   int upper_result = upper_->Write(buf, size, txn);
-  if (lower_readonly_ || (upper_result < 0)) { return upper_result; }
+  if (!WritesLower() || (upper_result < 0)) { return upper_result; }
 
-  void *txn2 = static_cast<char*>(txn) + upper_->SizeOfTxn();
-  return lower_->Write(buf, size, txn2);
+  return lower_->Write(buf, size, GetLowerTxn(txn));
 }
 
 
@@ -156,10 +397,8 @@ int TieredCacheManager::Reset(void *txn) {
   int upper_result = upper_->Reset(txn);
 
   int lower_result = upper_result;
-  if (!lower_readonly_) {
-    void *txn2 = static_cast<char*>(txn) + upper_->SizeOfTxn();
-    lower_result = lower_->Reset(txn2);
-  }
+  if (WritesLower())
+    lower_result = lower_->Reset(GetLowerTxn(txn));
 
   return (upper_result < 0) ? upper_result : lower_result;
 }
@@ -169,10 +408,9 @@ int TieredCacheManager::AbortTxn(void *txn) {
   int upper_result = upper_->AbortTxn(txn);
 
   int lower_result = upper_result;
-  if (!lower_readonly_) {
-    void *txn2 = static_cast<char*>(txn) + upper_->SizeOfTxn();
-    lower_result = lower_->AbortTxn(txn2);
-  }
+  if (WritesLower())
+    lower_result = lower_->AbortTxn(GetLowerTxn(txn));
+  GetTxnInfo(txn)->~TxnInfo();
 
   return (upper_result < 0) ? upper_result : lower_result;
 }
@@ -182,10 +420,13 @@ int TieredCacheManager::CommitTxn(void *txn) {
   int upper_result = upper_->CommitTxn(txn);
 
   int lower_result = upper_result;
-  if (!lower_readonly_) {
-    void *txn2 = static_cast<char*>(txn) + upper_->SizeOfTxn();
-    lower_result = lower_->CommitTxn(txn2);
-  }
+  if (WritesLower())
+    lower_result = lower_->CommitTxn(GetLowerTxn(txn));
+
+  TxnInfo *txn_info = GetTxnInfo(txn);
+  if (async_writeback_ && !lower_readonly_ && (upper_result >= 0))
+    Enqueue(CopyJob(Bless(txn_info->id, txn_info->info), false));
+  txn_info->~TxnInfo();
 
   return (upper_result < 0) ? upper_result : lower_result;
 }
@@ -194,10 +435,27 @@ int TieredCacheManager::CommitTxn(void *txn) {
 void TieredCacheManager::Spawn() {
   upper_->Spawn();
   lower_->Spawn();
+  if (((promotion_policy_ == kPromoteAsync) || async_writeback_) &&
+      !spawned_)
+  {
+    int retval = pthread_create(&thread_copy_, NULL, MainCopy, this);
+    assert(retval == 0);
+    spawned_ = true;
+  }
 }
 
 
 TieredCacheManager::~TieredCacheManager() {
+  if (spawned_) {
+    pthread_mutex_lock(&lock_);
+    terminated_ = true;
+    pthread_cond_broadcast(&cond_jobs_);
+    pthread_mutex_unlock(&lock_);
+    pthread_join(thread_copy_, NULL);
+  }
+  pthread_cond_destroy(&cond_jobs_);
+  pthread_mutex_destroy(&lock_);
+
   quota_mgr_ = NULL;  // gets deleted by upper
   delete upper_;
   delete lower_;
@@ -7,33 +7,71 @@
 #ifndef CVMFS_CACHE_TIERED_H_
 #define CVMFS_CACHE_TIERED_H_
 
+#include <pthread.h>
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <set>
 #include <string>
 
 #include "cache.h"
 #include "gtest/gtest_prod.h"
+#include "hash.h"
+#include "statistics.h"
+#include "util/pointer.h"
 
 /**
  * Cache manager implementation that provides a hierarchical cache.
  * Given an "upper" and "lower" cache manager object:
  * - Reads are done first from the upper cache
  * - On upper cache miss, then this tries the lower cache.
- *   If there's a lower cache hit, then the file is written
- *   to the upper cache.
- * - Writes are done to both caches simultaneously.
+ *   If there's a lower cache hit, then, depending on the promotion policy, the
+ *   file is copied to the upper cache right away, after a number of accesses,
+ *   or asynchronously in the background.  Until the object is promoted, it is
+ *   read directly from the lower cache.
+ * - Writes are done to both caches simultaneously, unless write-back is
+ *   asynchronous.  In that case, committed objects are copied from the upper
+ *   to the lower cache in the background.
  *
  * The quota manager is only applied to the upper cache.
+ *
+ * File descriptors of the lower cache are handed out with lower_fd_flag_ set.
+ * Tiers can be tiered caches themselves up to kMaxNesting levels.
  */
 class TieredCacheManager : public CacheManager {
   FRIEND_TEST(T_MountPoint, TieredCacheMgr);
   FRIEND_TEST(T_MountPoint, TieredComplex);
+  FRIEND_TEST(T_TieredCacheManager, Nested);
+  FRIEND_TEST(T_TieredCacheManager, MaxNesting);
 
  public:
+  enum PromotionPolicy {
+    kPromoteOnOpen = 0,
+    kPromoteOnAccess,
+    kPromoteAsync
+  };
+
+  /**
+   * Default number of opens from the lower tier before an object is promoted
+   * with kPromoteOnAccess.
+   */
+  static const unsigned kDefaultPromotionAccesses = 2;
+  /**
+   * Maximum number of pending background copies, further ones are dropped.
+   */
+  static const unsigned kDefaultMaxQueueLength = 1024;
+
   virtual CacheManagerIds id() { return kTieredCacheManager; }
   virtual std::string Describe();
 
   static CacheManager *Create(CacheManager *upper_cache,
-                              CacheManager *lower_cache);
+                              CacheManager *lower_cache,
+                              perf::StatisticsTemplate statistics);
   void SetLowerReadOnly() { lower_readonly_ = true; }
+  void SetPromotionPolicy(const PromotionPolicy policy,
+                          const unsigned min_accesses);
+  void SetAsyncWriteBack(const unsigned max_queue_length);
 
   virtual ~TieredCacheManager();
   virtual bool AcquireQuotaManager(QuotaManager *quota_mgr) {
@@ -43,15 +81,31 @@ class TieredCacheManager : public CacheManager {
   }
 
   virtual int Open(const BlessedObject &object);
-  virtual int64_t GetSize(int fd) {return upper_->GetSize(fd);}
-  virtual int Close(int fd) {return upper_->Close(fd);}
-  virtual int64_t Pread(int fd, void *buf, uint64_t size, uint64_t offset)
-  { return upper_->Pread(fd, buf, size, offset); }
-  virtual int Dup(int fd) { return upper_->Dup(fd); }
-  virtual int Readahead(int fd) { return upper_->Readahead(fd); }
+  virtual int64_t GetSize(int fd) {
+    return IsLowerFd(fd) ? lower_->GetSize(UntagFd(fd)) : upper_->GetSize(fd);
+  }
+  virtual int Close(int fd) {
+    return IsLowerFd(fd) ? lower_->Close(UntagFd(fd)) : upper_->Close(fd);
+  }
+  virtual int64_t Pread(int fd, void *buf, uint64_t size, uint64_t offset) {
+    if (IsLowerFd(fd))
+      return lower_->Pread(UntagFd(fd), buf, size, offset);
+    return upper_->Pread(fd, buf, size, offset);
+  }
+  virtual int Dup(int fd) {
+    return IsLowerFd(fd) ? TagFd(lower_->Dup(UntagFd(fd))) : upper_->Dup(fd);
+  }
+  virtual int Readahead(int fd) {
+    return IsLowerFd(fd) ? lower_->Readahead(UntagFd(fd))
+                         : upper_->Readahead(fd);
+  }
+  virtual int GetNativeFd(int fd) {
+    return IsLowerFd(fd) ? lower_->GetNativeFd(UntagFd(fd))
+                         : upper_->GetNativeFd(fd);
+  }
 
   virtual uint32_t SizeOfTxn()
-  { return upper_->SizeOfTxn() + lower_->SizeOfTxn(); }
+  { return GetTxnInfoOffset() + sizeof(TxnInfo); }
   virtual int StartTxn(const shash::Any &id, uint64_t size, void *txn);
   virtual void CtrlTxn(const ObjectInfo &object_info,
                        const int flags,
@@ -70,6 +124,20 @@ class TieredCacheManager : public CacheManager {
 
  private:
   static const unsigned kCopyBufferSize = 64 * 1024;  // 64kB
+  /**
+   * Lower cache file descriptors of the outermost tiered cache are marked by
+   * this bit.  Cache managers hand out small non-negative integers, so the bit
+   * is never set in an upper cache file descriptor.  Tiered caches nested in
+   * one of the tiers use the next lower bits, so that the file descriptors of
+   * an inner instance pass through the outer instances unchanged.
+   */
+  static const int kLowerFdFlag = 1 << 30;
+  static const unsigned kMaxNesting = 4;
+  /**
+   * Bounds the memory used for counting accesses with kPromoteOnAccess.  If
+   * there are more entries, the counts start over.
+   */
+  static const unsigned kMaxAccessCounters = 64 * 1024;
 
   struct SavedState {
     SavedState() : state_upper(NULL), state_lower(NULL) { }
@@ -77,14 +145,112 @@ class TieredCacheManager : public CacheManager {
     void *state_lower;
   };
 
+  /**
+   * Appended to the transactions of both tiers.  Remembers the object for the
+   * asynchronous write-back to the lower tier.
+   */
+  struct TxnInfo {
+    shash::Any id;
+    ObjectInfo info;
+  };
+
+  /**
+   * A background copy between the tiers.
+   */
+  struct CopyJob {
+    CopyJob(const BlessedObject &o, bool u) : object(o), to_upper(u) { }
+    BlessedObject object;
+    /**
+     * Promotion from the lower to the upper cache or write-back of a new
+     * object from the upper to the lower cache.
+     */
+    bool to_upper;
+  };
+
+  struct Counters {
+    perf::Counter *n_promotions;
+    perf::Counter *n_promotions_failed;
+    perf::Counter *n_lower_reads;
+    perf::Counter *n_writebacks;
+    perf::Counter *n_writebacks_failed;
+    perf::Counter *n_copies_dropped;
+    perf::Counter *sz_copy_queue;
+
+    explicit Counters(perf::StatisticsTemplate statistics) {
+      n_promotions = statistics.RegisterTemplated("n_promotions",
+        "Number of objects copied from the lower to the upper cache");
+      n_promotions_failed = statistics.RegisterTemplated("n_promotions_failed",
+        "Number of failed copies from the lower to the upper cache");
+      n_lower_reads = statistics.RegisterTemplated("n_lower_reads",
+        "Number of objects opened from the lower cache without promotion");
+      n_writebacks = statistics.RegisterTemplated("n_writebacks",
+        "Number of objects asynchronously written to the lower cache");
+      n_writebacks_failed = statistics.RegisterTemplated("n_writebacks_failed",
+        "Number of failed asynchronous writes to the lower cache");
+      n_copies_dropped = statistics.RegisterTemplated("n_copies_dropped",
+        "Number of background copies dropped because the queue was full");
+      sz_copy_queue = statistics.RegisterTemplated("sz_copy_queue",
+        "Number of pending background copies");
+    }
+  };
+
   // NOTE: TieredCacheManager takes ownership of both caches passed.
   TieredCacheManager(CacheManager *upper_cache,
-                     CacheManager *lower_cache)
-    : upper_(upper_cache), lower_(lower_cache), lower_readonly_(false) { }
+                     CacheManager *lower_cache,
+                     perf::StatisticsTemplate statistics);
+
+  bool IsLowerFd(int fd) { return (fd >= 0) && (fd & lower_fd_flag_); }
+  int TagFd(int fd) { return (fd < 0) ? fd : (fd | lower_fd_flag_); }
+  int UntagFd(int fd) { return fd & ~lower_fd_flag_; }
+  unsigned GetNesting();
+  void SetLowerFdFlag(int flag);
+  void *GetLowerTxn(void *txn) {
+    return static_cast<char *>(txn) + upper_->SizeOfTxn();
+  }
+  uint32_t GetTxnInfoOffset() {
+    const uint32_t size = upper_->SizeOfTxn() + lower_->SizeOfTxn();
+    return (size + 7) & ~uint32_t(7);  // 8 byte aligned
+  }
+  TxnInfo *GetTxnInfo(void *txn) {
+    return reinterpret_cast<TxnInfo *>(
+      static_cast<char *>(txn) + GetTxnInfoOffset());
+  }
+  bool WritesLower() { return !lower_readonly_ && !async_writeback_; }
+
+  static int CopyObject(CacheManager *src, int fd_src,
+                        CacheManager *dst, const BlessedObject &object,
+                        bool open_dst);
+  bool CountAccess(const shash::Any &id);
+  bool Enqueue(const CopyJob &job);
+  static void *MainCopy(void *data);
+  void ProcessCopyJob(const CopyJob &job);
 
   CacheManager *upper_;
   CacheManager *lower_;
+  int lower_fd_flag_;
   bool lower_readonly_;
+  PromotionPolicy promotion_policy_;
+  unsigned promotion_accesses_;
+  bool async_writeback_;
+  unsigned max_queue_length_;
+  UniquePtr<Counters> counters_;
+
+  bool spawned_;
+  bool terminated_;
+  pthread_t thread_copy_;
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_jobs_;
+  std::deque<CopyJob> jobs_;
+  /**
+   * Objects that are queued or being copied, prevents duplicate copies.
+   * Protected by lock_.
+   */
+  std::set<shash::Any> in_flight_;
+  /**
+   * Opens from the lower tier per object for kPromoteOnAccess.  Protected by
+   * lock_.
+   */
+  std::map<shash::Any, unsigned> access_counts_;
 };  // class TieredCacheManager
 
 #endif  // CVMFS_CACHE_TIERED_H_
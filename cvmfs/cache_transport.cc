@@ -294,6 +294,9 @@ void CacheTransport::FillMsgHash(
     case shash::kShake128:
       msg_hash->set_algorithm(cvmfs::HASH_SHAKE128);
       break;
+    case shash::kSha256:
+      msg_hash->set_algorithm(cvmfs::HASH_SHA256);
+      break;
     default:
       abort();
   }
@@ -337,6 +340,9 @@ bool CacheTransport::ParseMsgHash(
     case cvmfs::HASH_SHAKE128:
       hash->algorithm = shash::kShake128;
       break;
+    case cvmfs::HASH_SHA256:
+      hash->algorithm = shash::kSha256;
+      break;
     default:
       return false;
   }
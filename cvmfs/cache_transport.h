@@ -147,6 +147,8 @@ class CacheTransport {
                        CacheManager::ObjectType *object_type);
 
   int fd_connection() const { return fd_connection_; }
+  uint32_t flags() const { return flags_; }
+  void set_flags(uint32_t flags) { flags_ = flags; }
 
  private:
   static const unsigned kMaxStackAlloc = 256 * 1024;  // 256 kB
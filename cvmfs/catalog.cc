@@ -6,11 +6,15 @@
 
 #include <alloca.h>
 #include <errno.h>
+#include <inttypes.h>
 
 #include <algorithm>
 #include <cassert>
 
+#include "bloom_filter.h"
+#include "catalog_index.h"
 #include "catalog_mgr.h"
+#include "catalog_nested_index.h"
 #include "logging.h"
 #include "platform.h"
 #include "smalloc.h"
@@ -54,6 +58,7 @@ Catalog::Catalog(const PathString &mountpoint,
   mountpoint_(mountpoint),
   is_regular_mountpoint_(mountpoint_ == root_prefix_),
   volatile_flag_(false),
+  has_prefetch_groups_(false),
   is_root_(parent == NULL && !is_nested),
   managed_database_(false),
   parent_(parent),
@@ -62,6 +67,9 @@ Catalog::Catalog(const PathString &mountpoint,
   initialized_(false)
 {
   max_row_id_ = 0;
+  atomic_init64(&last_access_);
+  atomic_init64(&num_lookups_);
+  atomic_init32(&num_open_streams_);
   inode_annotation_ = NULL;
   lock_ = reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
   int retval = pthread_mutex_init(lock_, NULL);
@@ -70,7 +78,10 @@ Catalog::Catalog(const PathString &mountpoint,
   database_ = NULL;
   uid_map_ = NULL;
   gid_map_ = NULL;
+  path_filter_ = NULL;
+  index_ = NULL;
   sql_listing_ = NULL;
+  sql_listing_page_ = NULL;
   sql_lookup_md5path_ = NULL;
   sql_lookup_nested_ = NULL;
   sql_list_nested_ = NULL;
@@ -78,6 +89,11 @@ Catalog::Catalog(const PathString &mountpoint,
   sql_all_chunks_ = NULL;
   sql_chunks_listing_ = NULL;
   sql_lookup_xattrs_ = NULL;
+  sql_lookup_inline_data_ = NULL;
+  sql_lookup_bundle_ = NULL;
+  sql_lookup_prefetch_group_ = NULL;
+  sql_list_prefetch_group_ = NULL;
+  sql_lookup_digest_tree_ = NULL;
 }
 
 
@@ -85,6 +101,8 @@ Catalog::~Catalog() {
   pthread_mutex_destroy(lock_);
   free(lock_);
   FinalizePreparedStatements();
+  delete path_filter_;
+  delete index_;
   delete database_;
 }
 
@@ -97,6 +115,7 @@ Catalog::~Catalog() {
  */
 void Catalog::InitPreparedStatements() {
   sql_listing_          = new SqlListing(database());
+  sql_listing_page_     = new SqlListingPage(database());
   sql_lookup_md5path_   = new SqlLookupPathHash(database());
   sql_lookup_nested_    = new SqlNestedCatalogLookup(database());
   sql_list_nested_      = new SqlNestedCatalogListing(database());
@@ -104,14 +123,25 @@ void Catalog::InitPreparedStatements() {
   sql_all_chunks_       = new SqlAllChunks(database());
   sql_chunks_listing_   = new SqlChunksListing(database());
   sql_lookup_xattrs_    = new SqlLookupXattrs(database());
+  sql_lookup_inline_data_ = new SqlInlineDataLookup(database());
+  sql_lookup_bundle_    = new SqlBundleLookup(database());
+  sql_lookup_prefetch_group_ = new SqlPrefetchGroupLookup(database());
+  sql_list_prefetch_group_   = new SqlPrefetchGroupListing(database());
+  sql_lookup_digest_tree_ = new SqlDigestTreeLookup(database());
 }
 
 
 void Catalog::FinalizePreparedStatements() {
+  delete sql_lookup_digest_tree_;
+  delete sql_list_prefetch_group_;
+  delete sql_lookup_prefetch_group_;
+  delete sql_lookup_bundle_;
+  delete sql_lookup_inline_data_;
   delete sql_lookup_xattrs_;
   delete sql_chunks_listing_;
   delete sql_all_chunks_;
   delete sql_listing_;
+  delete sql_listing_page_;
   delete sql_lookup_md5path_;
   delete sql_lookup_nested_;
   delete sql_list_nested_;
@@ -146,6 +176,9 @@ bool Catalog::ReadCatalogCounters() {
   } else if (database().schema_revision() < 3) {
     statistics_loaded =
       counters_.ReadFromDatabase(database(), LegacyMode::kNoExternals);
+  } else if (database().schema_revision() < 7) {
+    statistics_loaded =
+      counters_.ReadFromDatabase(database(), LegacyMode::kNoSummary);
   } else {
     statistics_loaded = counters_.ReadFromDatabase(database());
   }
@@ -200,6 +233,15 @@ bool Catalog::OpenDatabase(const string &db_path) {
   volatile_flag_ = database_->GetPropertyDefault<bool>("volatile",
                                                        volatile_flag_);
 
+  // Writable catalogs gain prefetch groups during the transaction
+  if (IsWritable()) {
+    has_prefetch_groups_ = true;
+  } else if (database().schema_revision() >= 8) {
+    SqlCatalog sql_prefetch_groups(database(),
+      "SELECT 1 FROM prefetch_groups LIMIT 1;");
+    has_prefetch_groups_ = sql_prefetch_groups.FetchRow();
+  }
+
   // Read Catalog Counter Statistics
   if (!ReadCatalogCounters()) {
     LogCvmfs(kLogCatalog, kLogStderr,
@@ -287,8 +329,21 @@ bool Catalog::LookupEntry(const shash::Md5 &md5path, const bool expand_symlink,
                           DirectoryEntry *dirent) const
 {
   assert(IsInitialized());
+  if ((path_filter_ != NULL) && !path_filter_->MayContain(md5path))
+    return false;
 
+  FlushStagedEntries();
   pthread_mutex_lock(lock_);
+  if (index_ != NULL) {
+    uint32_t row;
+    const bool found = index_->Find(md5path, &row);
+    if (found && (dirent != NULL)) {
+      *dirent = index_->GetDirent(row, this, expand_symlink);
+      FixTransitionPoint(md5path, dirent);
+    }
+    pthread_mutex_unlock(lock_);
+    return found;
+  }
   sql_lookup_md5path_->BindPathHash(md5path);
   bool found = sql_lookup_md5path_->FetchRow();
   if (found && (dirent != NULL)) {
@@ -332,6 +387,7 @@ bool Catalog::LookupXattrsMd5Path(
 {
   assert(IsInitialized());
 
+  FlushStagedEntries();
   pthread_mutex_lock(lock_);
   sql_lookup_xattrs_->BindPathHash(md5path);
   bool found = sql_lookup_xattrs_->FetchRow();
@@ -345,6 +401,147 @@ bool Catalog::LookupXattrsMd5Path(
 }
 
 
+/**
+ * Retrieves the content of a file that is stored inline in the catalog.
+ * Returns false if there is no inline content, in particular for catalogs
+ * with a schema revision that predates inline files.
+ */
+bool Catalog::LookupInlineDataMd5Path(
+  const shash::Md5 &md5path,
+  std::string *data) const
+{
+  assert(IsInitialized());
+  if (database().schema_revision() < 5)
+    return false;
+
+  FlushStagedEntries();
+  pthread_mutex_lock(lock_);
+  sql_lookup_inline_data_->BindPathHash(md5path);
+  bool found = sql_lookup_inline_data_->FetchRow();
+  if (found && (data != NULL)) {
+    *data = sql_lookup_inline_data_->GetData();
+  }
+  sql_lookup_inline_data_->Reset();
+  pthread_mutex_unlock(lock_);
+
+  return found;
+}
+
+
+/**
+ * Finds the bundle object that contains the file, if any, and the offset of
+ * the file in the serialized bundle.  Like for file chunks, the hash algorithm
+ * is given by the file itself.
+ */
+bool Catalog::LookupBundleMd5Path(
+  const shash::Md5 &md5path,
+  const shash::Algorithms interpret_hash_as,
+  shash::Any *bundle_hash,
+  uint64_t *offset) const
+{
+  assert(IsInitialized());
+  if (database().schema_revision() < 6)
+    return false;
+
+  FlushStagedEntries();
+  pthread_mutex_lock(lock_);
+  sql_lookup_bundle_->BindPathHash(md5path);
+  bool found = sql_lookup_bundle_->FetchRow();
+  if (found) {
+    *bundle_hash = sql_lookup_bundle_->GetBundleHash(interpret_hash_as);
+    *offset = sql_lookup_bundle_->GetOffset();
+  }
+  sql_lookup_bundle_->Reset();
+  pthread_mutex_unlock(lock_);
+
+  return found;
+}
+
+
+/**
+ * Finds the prefetch group of a file.  Returns false if the file is in no
+ * group, in particular for catalogs with a schema revision that predates
+ * prefetch groups.
+ */
+bool Catalog::LookupPrefetchGroupMd5Path(
+  const shash::Md5 &md5path,
+  uint64_t *group_id) const
+{
+  assert(IsInitialized());
+  if ((database().schema_revision() < 8) || !has_prefetch_groups_)
+    return false;
+
+  FlushStagedEntries();
+  pthread_mutex_lock(lock_);
+  sql_lookup_prefetch_group_->BindPathHash(md5path);
+  bool found = sql_lookup_prefetch_group_->FetchRow();
+  if (found)
+    *group_id = sql_lookup_prefetch_group_->GetGroupId();
+  sql_lookup_prefetch_group_->Reset();
+  pthread_mutex_unlock(lock_);
+
+  return found;
+}
+
+
+/**
+ * Lists up to max_members files of a prefetch group of this catalog.  The
+ * paths are relative to the mountpoint of the catalog.
+ */
+bool Catalog::ListPrefetchGroup(
+  const uint64_t group_id,
+  const unsigned max_members,
+  PrefetchGroup *members) const
+{
+  assert(IsInitialized());
+  if ((database().schema_revision() < 8) || !has_prefetch_groups_)
+    return false;
+
+  FlushStagedEntries();
+  pthread_mutex_lock(lock_);
+  sql_list_prefetch_group_->BindGroupId(group_id);
+  while ((members->size() < max_members) &&
+         sql_list_prefetch_group_->FetchRow())
+  {
+    PrefetchGroupMember member;
+    member.path = PlantPath(sql_list_prefetch_group_->GetPath());
+    member.dirent = sql_list_prefetch_group_->GetDirent(this);
+    members->push_back(member);
+  }
+  sql_list_prefetch_group_->Reset();
+  pthread_mutex_unlock(lock_);
+
+  return true;
+}
+
+
+/**
+ * Retrieves the serialized block digests of a large file.  Returns false if
+ * there are none, in particular for catalogs with a schema revision that
+ * predates digest trees.
+ */
+bool Catalog::LookupDigestTreeMd5Path(
+  const shash::Md5 &md5path,
+  std::string *tree) const
+{
+  assert(IsInitialized());
+  if (database().schema_revision() < 9)
+    return false;
+
+  FlushStagedEntries();
+  pthread_mutex_lock(lock_);
+  sql_lookup_digest_tree_->BindPathHash(md5path);
+  bool found = sql_lookup_digest_tree_->FetchRow();
+  if (found && (tree != NULL)) {
+    *tree = sql_lookup_digest_tree_->GetTree();
+  }
+  sql_lookup_digest_tree_->Reset();
+  pthread_mutex_unlock(lock_);
+
+  return found;
+}
+
+
 /**
  * Perform a listing of the directory with the given MD5 path hash.
  * @param path_hash the MD5 hash of the path of the directory to list
@@ -356,19 +553,37 @@ bool Catalog::ListingMd5PathStat(const shash::Md5 &md5path,
 {
   assert(IsInitialized());
 
+  // Rows are decoded into the same entry, the stat entries are filled in
+  // place in the listing
   DirectoryEntry dirent;
-  StatEntry entry;
 
+  FlushStagedEntries();
   pthread_mutex_lock(lock_);
+  if (index_ != NULL) {
+    uint32_t begin, end;
+    index_->FindListing(md5path, &begin, &end);
+    listing->Reserve(listing->size() + (end - begin));
+    for (uint32_t i = begin; i < end; ++i) {
+      index_->DecodeDirent(index_->GetListingRow(i), this, true, &dirent);
+      if (dirent.IsHidden())
+        continue;
+      FixTransitionPoint(md5path, &dirent);
+      StatEntry *entry = listing->PushBackDefault();
+      entry->name = dirent.name();
+      entry->info = dirent.GetStatStructure();
+    }
+    pthread_mutex_unlock(lock_);
+    return true;
+  }
   sql_listing_->BindPathHash(md5path);
   while (sql_listing_->FetchRow()) {
-    dirent = sql_listing_->GetDirent(this);
+    sql_listing_->DecodeDirent(this, true, &dirent);
     if (dirent.IsHidden())
       continue;
     FixTransitionPoint(md5path, &dirent);
-    entry.name = dirent.name();
-    entry.info = dirent.GetStatStructure();
-    listing->PushBack(entry);
+    StatEntry *entry = listing->PushBackDefault();
+    entry->name = dirent.name();
+    entry->info = dirent.GetStatStructure();
   }
   sql_listing_->Reset();
   pthread_mutex_unlock(lock_);
@@ -377,6 +592,47 @@ bool Catalog::ListingMd5PathStat(const shash::Md5 &md5path,
 }
 
 
+/**
+ * Lists at most max_rows rows of the directory with a rowid larger than
+ * cursor.  The cursor is advanced to the last row seen, hidden entries
+ * included.  An unchanged cursor marks the end of the listing.  The rowids
+ * vector receives the rowid of every listing entry.
+ */
+bool Catalog::ListingMd5PathPage(const shash::Md5 &md5path,
+                                 const unsigned max_rows,
+                                 uint64_t *cursor,
+                                 DirectoryEntryList *listing,
+                                 std::vector<uint64_t> *rowids) const
+{
+  assert(IsInitialized());
+
+  listing->reserve(listing->size() + max_rows);
+  rowids->reserve(rowids->size() + max_rows);
+
+  FlushStagedEntries();
+  pthread_mutex_lock(lock_);
+  sql_listing_page_->BindPathHash(md5path);
+  sql_listing_page_->BindCursor(*cursor, max_rows);
+  while (sql_listing_page_->FetchRow()) {
+    *cursor = sql_listing_page_->GetRowId();
+    // Decoded in place, hidden entries are dropped again
+    listing->push_back(DirectoryEntry());
+    DirectoryEntry *dirent = &listing->back();
+    sql_listing_page_->DecodeDirent(this, true, dirent);
+    if (dirent->IsHidden()) {
+      listing->pop_back();
+      continue;
+    }
+    FixTransitionPoint(md5path, dirent);
+    rowids->push_back(*cursor);
+  }
+  sql_listing_page_->Reset();
+  pthread_mutex_unlock(lock_);
+
+  return true;
+}
+
+
 /**
  * Perform a listing of the directory with the given MD5 path hash.
  * Returns only struct stat values
@@ -391,12 +647,29 @@ bool Catalog::ListingMd5Path(const shash::Md5 &md5path,
 {
   assert(IsInitialized());
 
+  FlushStagedEntries();
   pthread_mutex_lock(lock_);
+  if (index_ != NULL) {
+    uint32_t begin, end;
+    index_->FindListing(md5path, &begin, &end);
+    listing->reserve(listing->size() + (end - begin));
+    for (uint32_t i = begin; i < end; ++i) {
+      listing->push_back(DirectoryEntry());
+      DirectoryEntry *dirent = &listing->back();
+      index_->DecodeDirent(index_->GetListingRow(i), this, expand_symlink,
+                           dirent);
+      FixTransitionPoint(md5path, dirent);
+    }
+    pthread_mutex_unlock(lock_);
+    return true;
+  }
   sql_listing_->BindPathHash(md5path);
   while (sql_listing_->FetchRow()) {
-    DirectoryEntry dirent = sql_listing_->GetDirent(this, expand_symlink);
-    FixTransitionPoint(md5path, &dirent);
-    listing->push_back(dirent);
+    // Decode in place rather than copying a temporary entry into the listing
+    listing->push_back(DirectoryEntry());
+    DirectoryEntry *dirent = &listing->back();
+    sql_listing_->DecodeDirent(this, expand_symlink, dirent);
+    FixTransitionPoint(md5path, dirent);
   }
   sql_listing_->Reset();
   pthread_mutex_unlock(lock_);
@@ -405,7 +678,57 @@ bool Catalog::ListingMd5Path(const shash::Md5 &md5path,
 }
 
 
+/**
+ * Opens a listing of the directory that is ordered by the path hashes of the
+ * entries, see ListingStream.  The directory is listed from this catalog; if
+ * it does not exist, the stream is empty.
+ */
+ListingStream *Catalog::OpenListingStream(const PathString &path) const {
+  assert(IsInitialized());
+  return new ListingStream(this, NormalizePath(path));
+}
+
+
+/**
+ * Adds all the path hashes of the catalog to a bloom filter that answers most
+ * lookups of non-existing paths without a database query.  Takes one scan of
+ * the catalog table.  Must not be used on catalogs that are still modified.
+ */
+bool Catalog::BuildPathFilter() {
+  assert(IsInitialized());
+
+  BloomFilter *path_filter = new BloomFilter(max_row_id_);
+  SqlCatalog sql_md5paths(database(),
+                          "SELECT md5path_1, md5path_2 FROM catalog;");
+  while (sql_md5paths.FetchRow())
+    path_filter->Add(sql_md5paths.RetrieveMd5(0, 1));
+  if (sql_md5paths.GetLastError() != SQLITE_DONE) {
+    LogCvmfs(kLogCatalog, kLogDebug, "failed to build path filter for %s (%s)",
+             mountpoint().c_str(), sql_md5paths.GetLastErrorMsg().c_str());
+    delete path_filter;
+    return false;
+  }
+
+  delete path_filter_;
+  path_filter_ = path_filter;
+  LogCvmfs(kLogCatalog, kLogDebug, "path filter for %s: %" PRIu64 " entries, "
+           "%" PRIu64 " bits", mountpoint().c_str(), path_filter->num_keys(),
+           path_filter->num_bits());
+  return true;
+}
+
+
+void Catalog::AttachIndex(CatalogIndex *index) {
+  assert(IsInitialized());
+  pthread_mutex_lock(lock_);
+  delete index_;
+  index_ = index;
+  pthread_mutex_unlock(lock_);
+}
+
+
 bool Catalog::AllChunksBegin() {
+  FlushStagedEntries();
   return sql_all_chunks_->Open();
 }
 
@@ -432,6 +755,7 @@ bool Catalog::ListMd5PathChunks(const shash::Md5  &md5path,
 {
   assert(IsInitialized() && chunks->IsEmpty());
 
+  FlushStagedEntries();
   pthread_mutex_lock(lock_);
   sql_chunks_listing_->BindPathHash(md5path);
   while (sql_chunks_listing_->FetchRow()) {
@@ -453,10 +777,14 @@ const Catalog::HashVector& Catalog::GetReferencedObjects() const {
   }
 
   // retrieve all referenced content hashes of both files and file chunks
+  FlushStagedEntries();
   SqlListContentHashes list_content_hashes(database());
   while (list_content_hashes.FetchRow()) {
     referenced_hashes_.push_back(list_content_hashes.GetHash());
   }
+  const shash::Any index_hash = GetIndexHash();
+  if (!index_hash.IsNull())
+    referenced_hashes_.push_back(index_hash);
 
   return referenced_hashes_;
 }
@@ -534,6 +862,7 @@ uint64_t Catalog::GetNumChunks() const {
 uint64_t Catalog::GetNumEntries() const {
   const string sql = "SELECT count(*) FROM catalog;";
 
+  FlushStagedEntries();
   pthread_mutex_lock(lock_);
   SqlCatalog stmt(database(), sql);
   const uint64_t result = (stmt.FetchRow()) ? stmt.RetrieveInt64(0) : 0;
@@ -554,6 +883,37 @@ shash::Any Catalog::GetPreviousRevision() const {
 }
 
 
+/**
+ * The content hash of the read-optimized encoding of this catalog revision,
+ * see CatalogIndex.  Null if there is none.
+ */
+shash::Any Catalog::GetIndexHash() const {
+  pthread_mutex_lock(lock_);
+  const std::string hash_string =
+    database().GetPropertyDefault<std::string>(CatalogIndex::kPropertyKey, "");
+  pthread_mutex_unlock(lock_);
+  return (!hash_string.empty())
+    ? shash::MkFromHexPtr(shash::HexPtr(hash_string), shash::kSuffixNone)
+    : shash::Any();
+}
+
+
+/**
+ * The content hash of the index of all the nested catalogs of the repository,
+ * see NestedCatalogIndex.  Only root catalogs can have one.  Null if there is
+ * none.
+ */
+shash::Any Catalog::GetNestedIndexHash() const {
+  pthread_mutex_lock(lock_);
+  const std::string hash_string = database().GetPropertyDefault<std::string>(
+    NestedCatalogIndex::kPropertyKey, "");
+  pthread_mutex_unlock(lock_);
+  return (!hash_string.empty())
+    ? shash::MkFromHexPtr(shash::HexPtr(hash_string), shash::kSuffixNone)
+    : shash::Any();
+}
+
+
 string Catalog::PrintMemStatistics() const {
   sqlite::MemStatistics stats;
   pthread_mutex_lock(lock_);
@@ -573,6 +933,24 @@ string Catalog::PrintMemStatistics() const {
 }
 
 
+/**
+ * Memory of the SQLite connection and of the read-optimized index, if any.
+ */
+uint64_t Catalog::GetMemoryUsage() const {
+  sqlite::MemStatistics stats;
+  pthread_mutex_lock(lock_);
+  database().GetMemStatistics(&stats);
+  pthread_mutex_unlock(lock_);
+  uint64_t result = 0;
+  if (stats.page_cache_used > 0) result += stats.page_cache_used;
+  if (stats.schema_used > 0) result += stats.schema_used;
+  if (stats.stmt_used > 0) result += stats.stmt_used;
+  if (index_ != NULL)
+    result += index_->size();
+  return result;
+}
+
+
 /**
  * Determine the actual inode of a DirectoryEntry.
  * The first used entry from a hardlink group deterimines the inode of the
@@ -844,4 +1222,69 @@ void Catalog::FixTransitionPoint(const shash::Md5 &md5path,
   }
 }
 
+
+
+//------------------------------------------------------------------------------
+
+
+const unsigned ListingStream::kMaxSortedRows;
+
+
+ListingStream::ListingStream(const Catalog *catalog, const shash::Md5 &md5path)
+  : catalog_(catalog)
+  , md5path_(md5path)
+  , sql_listing_(NULL)
+  , at_end_(false)
+{
+  atomic_inc32(&catalog_->num_open_streams_);
+  catalog_->FlushStagedEntries();
+  pthread_mutex_lock(catalog_->lock_);
+  // Counting is a range scan on the parent index
+  SqlListingCount sql_count(catalog_->database());
+  uint64_t num_rows = 0;
+  if (sql_count.BindPathHash(md5path_) && sql_count.FetchRow())
+    num_rows = sql_count.GetCount();
+  sql_listing_ =
+    new SqlListingSorted(catalog_->database(), num_rows > kMaxSortedRows);
+  sql_listing_->BindPathHash(md5path_);
+  pthread_mutex_unlock(catalog_->lock_);
+}
+
+
+ListingStream::~ListingStream() {
+  pthread_mutex_lock(catalog_->lock_);
+  delete sql_listing_;
+  pthread_mutex_unlock(catalog_->lock_);
+  atomic_dec32(&catalog_->num_open_streams_);
+}
+
+
+bool ListingStream::Next(DirectoryEntry *dirent, shash::Md5 *md5path) {
+  if (at_end_)
+    return false;
+  pthread_mutex_lock(catalog_->lock_);
+  const bool has_row = sql_listing_->FetchRow();
+  if (has_row) {
+    *dirent = sql_listing_->GetDirent(catalog_);
+    *md5path = sql_listing_->GetPathHash();
+    catalog_->FixTransitionPoint(md5path_, dirent);
+  } else {
+    at_end_ = true;
+  }
+  pthread_mutex_unlock(catalog_->lock_);
+  return has_row;
+}
+
+
+int ListingStream::CompareMd5Paths(const shash::Md5 &a, const shash::Md5 &b) {
+  uint64_t a_1, a_2, b_1, b_2;
+  a.ToIntPair(&a_1, &a_2);
+  b.ToIntPair(&b_1, &b_2);
+  if (a_1 != b_1)
+    return (static_cast<int64_t>(a_1) < static_cast<int64_t>(b_1)) ? -1 : 1;
+  if (a_2 != b_2)
+    return (static_cast<int64_t>(a_2) < static_cast<int64_t>(b_2)) ? -1 : 1;
+  return 0;
+}
+
 }  // namespace catalog
@@ -13,6 +13,7 @@
 #include <string>
 #include <vector>
 
+#include "atomic.h"
 #include "catalog_counters.h"
 #include "catalog_sql.h"
 #include "directory_entry.h"
@@ -24,6 +25,8 @@
 #include "uid_map.h"
 #include "xattr.h"
 
+class BloomFilter;
+
 namespace swissknife {
 class CommandMigrate;
 }
@@ -34,9 +37,12 @@ template <class CatalogT>
 class AbstractCatalogManager;
 
 class Catalog;
+class CatalogIndex;
 
 class Counters;
 
+class ListingStream;
+
 typedef std::vector<Catalog *> CatalogList;
 typedef IntegerMap<uint64_t> OwnerMap;  // used to map uid/gid
 
@@ -63,6 +69,16 @@ struct InodeRange {
 };
 
 
+/**
+ * A file of a prefetch group together with its path in the file system
+ */
+struct PrefetchGroupMember {
+  PathString path;
+  DirectoryEntry dirent;
+};
+typedef std::vector<PrefetchGroupMember> PrefetchGroup;
+
+
 /**
  * Allows to define a class that transforms the inode in order to ensure
  * that inodes are not reused after reloads (catalog or fuse module).
@@ -92,6 +108,7 @@ class Catalog : SingleCopy {
   FRIEND_TEST(T_Catalog, NormalizePath);
   FRIEND_TEST(T_Catalog, PlantPath);
   friend class swissknife::CommandMigrate;  // for catalog version migration
+  friend class ListingStream;
 
  public:
   typedef std::vector<shash::Any> HashVector;
@@ -128,6 +145,28 @@ class Catalog : SingleCopy {
   bool LookupXattrsPath(const PathString &path, XattrList *xattrs) const {
     return LookupXattrsMd5Path(NormalizePath(path), xattrs);
   }
+  bool LookupInlineDataPath(const PathString &path, std::string *data) const {
+    return LookupInlineDataMd5Path(NormalizePath(path), data);
+  }
+  bool LookupBundlePath(const PathString &path,
+                        const shash::Algorithms interpret_hash_as,
+                        shash::Any *bundle_hash,
+                        uint64_t *offset) const
+  {
+    return LookupBundleMd5Path(NormalizePath(path), interpret_hash_as,
+                               bundle_hash, offset);
+  }
+  bool LookupPrefetchGroupPath(const PathString &path,
+                               uint64_t *group_id) const
+  {
+    return LookupPrefetchGroupMd5Path(NormalizePath(path), group_id);
+  }
+  bool ListPrefetchGroup(const uint64_t group_id,
+                         const unsigned max_members,
+                         PrefetchGroup *members) const;
+  bool LookupDigestTreePath(const PathString &path, std::string *tree) const {
+    return LookupDigestTreeMd5Path(NormalizePath(path), tree);
+  }
 
   inline bool ListingPath(const PathString &path,
                           DirectoryEntryList *listing,
@@ -140,6 +179,26 @@ class Catalog : SingleCopy {
   {
     return ListingMd5PathStat(NormalizePath(path), listing);
   }
+  bool ListingPathPage(const PathString &path,
+                       const unsigned max_rows,
+                       uint64_t *cursor,
+                       DirectoryEntryList *listing,
+                       std::vector<uint64_t> *rowids) const
+  {
+    return ListingMd5PathPage(NormalizePath(path), max_rows, cursor,
+                              listing, rowids);
+  }
+  ListingStream *OpenListingStream(const PathString &path) const;
+  bool BuildPathFilter();
+  bool HasPathFilter() const { return path_filter_ != NULL; }
+  /**
+   * Takes ownership of the read-optimized encoding of the catalog, which is
+   * then used for lookups and listings instead of the database.  Must not be
+   * used on catalogs that are still modified.
+   */
+  void AttachIndex(CatalogIndex *index);
+  bool HasIndex() const { return index_ != NULL; }
+
   bool AllChunksBegin();
   bool AllChunksNext(shash::Any *hash, zlib::Algorithms *compression_alg);
   bool AllChunksEnd();
@@ -171,8 +230,34 @@ class Catalog : SingleCopy {
   uint64_t GetNumEntries() const;
   uint64_t GetNumChunks() const;
   shash::Any GetPreviousRevision() const;
+  shash::Any GetIndexHash() const;
+  shash::Any GetNestedIndexHash() const;
   const Counters& GetCounters() const { return counters_; }
   std::string PrintMemStatistics() const;
+  uint64_t GetMemoryUsage() const;
+
+  /**
+   * Set by the catalog manager on every lookup and listing, possibly
+   * concurrently under its read lock.  Used to detach idle nested catalogs.
+   */
+  inline void Touch(const uint64_t now) const {
+    if (static_cast<uint64_t>(atomic_read64(&last_access_)) != now)
+      atomic_write64(&last_access_, now);
+  }
+  inline uint64_t last_access() const { return atomic_read64(&last_access_); }
+  /**
+   * Counts the lookups and listings served by this catalog if the catalog
+   * manager keeps a heat map, see CatalogHeatmap.
+   */
+  inline void CountLookup() const { atomic_inc64(&num_lookups_); }
+  inline uint64_t num_lookups() const { return atomic_read64(&num_lookups_); }
+  /**
+   * Listing streams keep using the catalog outside the catalog manager's lock,
+   * so the catalog must not be detached meanwhile.
+   */
+  inline bool HasOpenStreams() const {
+    return atomic_read32(&num_open_streams_) > 0;
+  }
 
   inline float schema() const { return database().schema_version(); }
   inline PathString mountpoint() const { return mountpoint_; }
@@ -243,6 +328,12 @@ class Catalog : SingleCopy {
   virtual void InitPreparedStatements();
   void FinalizePreparedStatements();
 
+  /**
+   * Called before the database is read.  Overwritten by the r/w catalog, which
+   * buffers new directory entries in memory.
+   */
+  virtual void FlushStagedEntries() const { }
+
   Counters& GetWritableCounters() { return counters_; }
 
   inline const CatalogDatabase &database() const { return *database_; }
@@ -275,6 +366,16 @@ class Catalog : SingleCopy {
 
   bool LookupMd5Path(const shash::Md5 &md5path, DirectoryEntry *dirent) const;
   bool LookupXattrsMd5Path(const shash::Md5 &md5path, XattrList *xattrs) const;
+  bool LookupInlineDataMd5Path(const shash::Md5 &md5path,
+                               std::string *data) const;
+  bool LookupBundleMd5Path(const shash::Md5 &md5path,
+                           const shash::Algorithms interpret_hash_as,
+                           shash::Any *bundle_hash,
+                           uint64_t *offset) const;
+  bool LookupPrefetchGroupMd5Path(const shash::Md5 &md5path,
+                                  uint64_t *group_id) const;
+  bool LookupDigestTreeMd5Path(const shash::Md5 &md5path,
+                               std::string *tree) const;
   bool ListMd5PathChunks(const shash::Md5 &md5path,
                          const shash::Algorithms interpret_hashes_as,
                          FileChunkList *chunks) const;
@@ -283,6 +384,11 @@ class Catalog : SingleCopy {
                       const bool expand_symlink = true) const;
   bool ListingMd5PathStat(const shash::Md5 &md5path,
                           StatEntryList *listing) const;
+  bool ListingMd5PathPage(const shash::Md5 &md5path,
+                          const unsigned max_rows,
+                          uint64_t *cursor,
+                          DirectoryEntryList *listing,
+                          std::vector<uint64_t> *rowids) const;
   bool LookupEntry(const shash::Md5 &md5path, const bool expand_symlink,
                    DirectoryEntry *dirent) const;
 
@@ -300,6 +406,11 @@ class Catalog : SingleCopy {
    */
   bool is_regular_mountpoint_;
   bool volatile_flag_;
+  /**
+   * False if the catalog is known to have no prefetch groups, which spares
+   * the lookup on every open() of a file.
+   */
+  bool has_prefetch_groups_;
   /**
    * For catalogs in a catalog manager: doesn't have a parent catalog
    */
@@ -315,6 +426,9 @@ class Catalog : SingleCopy {
   mutable std::string voms_authz_;
 
   bool initialized_;
+  mutable atomic_int64 last_access_;  ///< platform_monotonic_time()
+  mutable atomic_int64 num_lookups_;
+  mutable atomic_int32 num_open_streams_;
   InodeRange inode_range_;
   uint64_t max_row_id_;
   InodeAnnotation *inode_annotation_;
@@ -322,8 +436,17 @@ class Catalog : SingleCopy {
   // Point to the maps in the catalog manager
   const OwnerMap *uid_map_;
   const OwnerMap *gid_map_;
+  /**
+   * Built on demand for read-only catalogs, NULL otherwise.
+   */
+  BloomFilter *path_filter_;
+  /**
+   * Optional for read-only catalogs, NULL otherwise.
+   */
+  CatalogIndex *index_;
 
   SqlListing                  *sql_listing_;
+  SqlListingPage              *sql_listing_page_;
   SqlLookupPathHash           *sql_lookup_md5path_;
   SqlNestedCatalogLookup      *sql_lookup_nested_;
   SqlNestedCatalogListing     *sql_list_nested_;
@@ -331,10 +454,57 @@ class Catalog : SingleCopy {
   SqlAllChunks                *sql_all_chunks_;
   SqlChunksListing            *sql_chunks_listing_;
   SqlLookupXattrs             *sql_lookup_xattrs_;
+  SqlInlineDataLookup         *sql_lookup_inline_data_;
+  SqlBundleLookup             *sql_lookup_bundle_;
+  SqlPrefetchGroupLookup      *sql_lookup_prefetch_group_;
+  SqlPrefetchGroupListing     *sql_list_prefetch_group_;
+  SqlDigestTreeLookup         *sql_lookup_digest_tree_;
 
   mutable HashVector        referenced_hashes_;
 };  // class Catalog
 
+
+/**
+ * Steps through the listing of a directory in the order of the path hashes of
+ * the entries.  Only the current row is held in memory, so that the listings
+ * of two revisions of a directory can be merged entry by entry regardless of
+ * the size of the directory.  Directories of up to kMaxSortedRows entries are
+ * sorted by SQLite.  Larger directories are read in the order of the primary
+ * key, which takes a scan of the catalog but no memory for sorting.
+ *
+ * Every stream has its own statement, which is only stepped under the lock of
+ * the catalog.  A stream must be deleted before its catalog.
+ */
+class ListingStream : SingleCopy {
+  friend class Catalog;
+
+ public:
+  static const unsigned kMaxSortedRows = 4096;
+
+  ~ListingStream();
+  /**
+   * Returns false at the end of the listing
+   */
+  bool Next(DirectoryEntry *dirent, shash::Md5 *md5path);
+
+  /**
+   * The order of the listing: the path hashes are compared as pairs of signed
+   * integers, like SQLite compares the md5path columns.
+   */
+  static int CompareMd5Paths(const shash::Md5 &a, const shash::Md5 &b);
+
+ private:
+  ListingStream(const Catalog *catalog, const shash::Md5 &md5path);
+
+  const Catalog *catalog_;
+  shash::Md5 md5path_;
+  SqlListingSorted *sql_listing_;
+  /**
+   * SQLite restarts a finished statement on the next step
+   */
+  bool at_end_;
+};
+
 }  // namespace catalog
 
 #endif  // CVMFS_CATALOG_H_
@@ -0,0 +1,135 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "catalog_access_profile.h"
+
+#include <cerrno>
+#include <cstdio>
+
+#include "logging.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+/**
+ * Splits a line of the tracer's CSV output.  Fields are quoted, quotes within
+ * fields are doubled.
+ */
+bool AccessProfile::ParseCsvLine(const string &line, vector<string> *fields) {
+  fields->clear();
+  string field;
+  bool in_quotes = false;
+  bool was_quoted = false;
+  for (unsigned i = 0; i < line.length(); ++i) {
+    const char c = line[i];
+    if (in_quotes) {
+      if (c != '"') {
+        field.push_back(c);
+      } else if ((i + 1 < line.length()) && (line[i + 1] == '"')) {
+        field.push_back('"');
+        ++i;
+      } else {
+        in_quotes = false;
+      }
+      continue;
+    }
+    if (c == ',') {
+      fields->push_back(field);
+      field.clear();
+      was_quoted = false;
+    } else if ((c == '"') && field.empty() && !was_quoted) {
+      in_quotes = true;
+      was_quoted = true;
+    } else if (c != '\r') {
+      field.push_back(c);
+    }
+  }
+  if (in_quotes)
+    return false;
+  fields->push_back(field);
+  return true;
+}
+
+
+bool AccessProfile::LoadTracerLog(const string &path) {
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL) {
+    LogCvmfs(kLogCatalog, kLogStderr, "failed to open access profile %s (%d)",
+             path.c_str(), errno);
+    return false;
+  }
+
+  set<string> accessed_paths;
+  string line;
+  vector<string> fields;
+  unsigned num_lines = 0;
+  while (GetLineFile(f, &line)) {
+    ++num_lines;
+    if (!ParseCsvLine(line, &fields) || (fields.size() < 3)) {
+      LogCvmfs(kLogCatalog, kLogStderr, "invalid line %u in access profile %s",
+               num_lines, path.c_str());
+      fclose(f);
+      return false;
+    }
+    const int64_t event = String2Int64(fields[1]);
+    if (event == kTracerEventStart) {
+      FinishRun(&accessed_paths);
+      continue;
+    }
+    // Tracer internal events
+    if (event <= 0)
+      continue;
+
+    string accessed_path = fields[2];
+    if (!accessed_path.empty() && (accessed_path[0] != '/'))
+      continue;
+    while (!accessed_path.empty() && (*accessed_path.rbegin() == '/'))
+      accessed_path.erase(accessed_path.length() - 1);
+    accessed_paths.insert(accessed_path);
+  }
+  FinishRun(&accessed_paths);
+  fclose(f);
+
+  LogCvmfs(kLogCatalog, kLogDebug, "access profile %s: %u runs, %u paths",
+           path.c_str(), num_runs_,
+           static_cast<unsigned>(runs_per_path_.size()));
+  return true;
+}
+
+
+/**
+ * Counts the run for the accessed paths and all their parent directories.
+ */
+void AccessProfile::FinishRun(set<string> *accessed_paths) {
+  if (accessed_paths->empty())
+    return;
+
+  set<string> directories;
+  for (set<string>::const_iterator i = accessed_paths->begin(),
+       iEnd = accessed_paths->end(); i != iEnd; ++i)
+  {
+    string path = *i;
+    while (directories.insert(path).second && !path.empty())
+      path = GetParentPath(path);
+  }
+  for (set<string>::const_iterator i = directories.begin(),
+       iEnd = directories.end(); i != iEnd; ++i)
+  {
+    runs_per_path_[*i]++;
+  }
+  num_runs_++;
+  accessed_paths->clear();
+}
+
+
+unsigned AccessProfile::GetNumRuns(const string &path) const {
+  map<string, unsigned>::const_iterator i = runs_per_path_.find(path);
+  return (i == runs_per_path_.end()) ? 0 : i->second;
+}
+
+}  // namespace catalog
@@ -0,0 +1,54 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * The AccessProfile summarizes client trace logs (see tracer.h) for the
+ * CatalogBalancer.  Every tracer start event begins a new run, i.e. a job
+ * start.  For every directory, the profile counts the runs which accessed the
+ * directory or anything below it.  A nested catalog at that directory is
+ * downloaded by about that many runs.
+ */
+
+#ifndef CVMFS_CATALOG_ACCESS_PROFILE_H_
+#define CVMFS_CATALOG_ACCESS_PROFILE_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace catalog {
+
+class AccessProfile {
+ public:
+  AccessProfile() : num_runs_(0) { }
+
+  /**
+   * Adds the runs of a trace log in the tracer's CSV format.  Files written
+   * by several clients can be concatenated.
+   */
+  bool LoadTracerLog(const std::string &path);
+
+  /**
+   * Number of runs that accessed path or any path below it
+   */
+  unsigned GetNumRuns(const std::string &path) const;
+  unsigned num_runs() const { return num_runs_; }
+
+  static bool ParseCsvLine(const std::string &line,
+                           std::vector<std::string> *fields);
+
+ private:
+  /**
+   * Written by the Tracer when a new trace buffer is created
+   */
+  static const int kTracerEventStart = -1;
+
+  void FinishRun(std::set<std::string> *accessed_paths);
+
+  std::map<std::string, unsigned> runs_per_path_;
+  unsigned num_runs_;
+};
+
+}  // namespace catalog
+
+#endif  // CVMFS_CATALOG_ACCESS_PROFILE_H_
@@ -8,6 +8,7 @@
 #include <string>
 #include <vector>
 
+#include "catalog_access_profile.h"
 #include "catalog_mgr.h"
 #include "directory_entry.h"
 
@@ -41,13 +42,20 @@ namespace catalog {
  *
  * c) The number of entries of the catalog is lesser than min_weight_: the
  * catalog gets merged with its father (except the root catalog, obviously).
+ *
+ * By default, an overflowed directory is relieved by turning its heaviest sub
+ * directory into a nested catalog.  If the catalog manager has an access
+ * profile, the sub directory that the fewest runs access per entry is chosen
+ * instead.  Hot directories thus stay in their parent catalog and the
+ * expected number of catalog downloads per run remains small.
  */
 template <class CatalogMgrT>
 class CatalogBalancer {
  public:
   typedef typename CatalogMgrT::catalog_t catalog_t;
   explicit CatalogBalancer(CatalogMgrT *catalog_mgr)
-    : catalog_mgr_(catalog_mgr) { }
+    : catalog_mgr_(catalog_mgr)
+    , access_profile_(catalog_mgr->access_profile_) { }
 
   /**
    * This method balances a catalog. A catalog is considered overflowed if
@@ -133,9 +141,14 @@ class CatalogBalancer {
                                                  uid_t uid,
                                                  gid_t gid);
   static VirtualNode *MaxChild(VirtualNode *virtual_node);
+  VirtualNode *ColdestChild(VirtualNode *virtual_node);
   void AddCatalog(VirtualNode *child_node);
 
   CatalogMgrT *catalog_mgr_;
+  /**
+   * Optional, not owned
+   */
+  const AccessProfile *access_profile_;
 };
 
 }  // namespace catalog
@@ -103,19 +103,20 @@ void CatalogBalancer<CatalogMgrT>::PartitionOptimally(
       PartitionOptimally(virtual_child);
   }
   virtual_node->FixWeight();
+  const bool use_profile =
+    (access_profile_ != NULL) && (access_profile_->num_runs() > 0);
   while (virtual_node->weight > catalog_mgr_->balance_weight_) {
-    virtual_node_t *heaviest_node =
-        MaxChild(virtual_node);
+    virtual_node_t *selected_node = use_profile ?
+        ColdestChild(virtual_node) : MaxChild(virtual_node);
     // we directly add a catalog in this node
-    // TODO(molina) apply heuristics here
-    if (heaviest_node != NULL &&
-        heaviest_node->weight >= catalog_mgr_->min_weight_) {
+    if (selected_node != NULL &&
+        selected_node->weight >= catalog_mgr_->min_weight_) {
       // the catalog now generated _cannot_ be overflowed because the tree is
       // being traversed in postorder, handling the lightest nodes first
-      unsigned max_weight = heaviest_node->weight;
-      AddCatalogMarker(heaviest_node->path);
-      AddCatalog(heaviest_node);
-      virtual_node->weight -= (max_weight - 1);
+      unsigned selected_weight = selected_node->weight;
+      AddCatalogMarker(selected_node->path);
+      AddCatalog(selected_node);
+      virtual_node->weight -= (selected_weight - 1);
     } else {
       // there is no possibility for any this directory's children
       // to be a catalog
@@ -150,6 +151,53 @@ CatalogBalancer<CatalogMgrT>::MaxChild(
   return max_child;
 }
 
+/**
+ * Among the sub directories that are heavy enough for a nested catalog, finds
+ * the one with the smallest number of accessing runs per entry.  That removes
+ * the most entries from the parent catalog for the fewest additional catalog
+ * downloads.  Ties are broken by the weight.
+ */
+template <class CatalogMgrT>
+typename CatalogBalancer<CatalogMgrT>::VirtualNode*
+CatalogBalancer<CatalogMgrT>::ColdestChild(
+    virtual_node_t *virtual_node)
+{
+  virtual_node_t *coldest_child = NULL;
+  uint64_t coldest_runs = 0;
+  if (virtual_node->IsDirectory() &&
+      !virtual_node->IsCatalog() &&
+      !virtual_node->is_new_nested_catalog) {
+    for (unsigned i = 0; i < virtual_node->children.size(); ++i) {
+      virtual_node_t *child = &virtual_node->children[i];
+      if (!child->IsDirectory() || child->IsCatalog() ||
+          (child->weight < catalog_mgr_->min_weight_))
+        continue;
+      const uint64_t runs = access_profile_->GetNumRuns(child->path);
+      if (coldest_child == NULL) {
+        coldest_child = child;
+        coldest_runs = runs;
+        continue;
+      }
+      // runs / weight < coldest_runs / coldest_child->weight
+      const uint64_t lhs = runs * coldest_child->weight;
+      const uint64_t rhs = coldest_runs * child->weight;
+      if ((lhs < rhs) ||
+          ((lhs == rhs) && (child->weight > coldest_child->weight))) {
+        coldest_child = child;
+        coldest_runs = runs;
+      }
+    }
+  }
+  if (coldest_child != NULL) {
+    LogCvmfs(kLogPublish, kLogVerboseMsg, "coldest sub directory of '%s' is "
+             "'%s' (%u of %u runs, weight %u)",
+             virtual_node->path.c_str(), coldest_child->path.c_str(),
+             static_cast<unsigned>(coldest_runs), access_profile_->num_runs(),
+             coldest_child->weight);
+  }
+  return coldest_child;
+}
+
 template <class CatalogMgrT>
 void CatalogBalancer<CatalogMgrT>::AddCatalog(virtual_node_t *child_node) {
   assert(child_node != NULL);
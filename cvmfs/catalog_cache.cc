@@ -0,0 +1,209 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "catalog_cache.h"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <utime.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "compression.h"
+#include "logging.h"
+#include "platform.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+namespace {
+
+const char kCatalogSuffix[] = ".catalog";
+const char kDigestSuffix[] = ".digest";
+
+}  // anonymous namespace
+
+
+CatalogCache *CatalogCache::Create(
+  const string &cache_dir,
+  const uint64_t limit)
+{
+  if (!MkdirDeep(cache_dir, 0700)) {
+    LogCvmfs(kLogCatalog, kLogStderr, "cannot create catalog cache %s",
+             cache_dir.c_str());
+    return NULL;
+  }
+  return new CatalogCache(cache_dir, limit);
+}
+
+
+CatalogCache::CatalogCache(const string &cache_dir, const uint64_t limit)
+  : cache_dir_(cache_dir)
+  , limit_(limit)
+{
+  atomic_init32(&num_hits_);
+  atomic_init32(&num_misses_);
+}
+
+
+/**
+ * Tries to share the data blocks with the source (FICLONE), falls back to a
+ * regular copy.
+ */
+bool CatalogCache::CloneFile(const string &src, const string &dest) {
+#ifdef FICLONE
+  int fd_src = open(src.c_str(), O_RDONLY);
+  if (fd_src < 0)
+    return false;
+  int fd_dest = open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd_dest < 0) {
+    close(fd_src);
+    return false;
+  }
+  const int retval = ioctl(fd_dest, FICLONE, fd_src);
+  close(fd_dest);
+  close(fd_src);
+  if (retval == 0)
+    return true;
+#endif
+  return CopyPath2Path(src, dest);
+}
+
+
+string CatalogCache::GetCatalogPath(const shash::Any &hash) const {
+  return cache_dir_ + "/" + hash.ToString(true) + kCatalogSuffix;
+}
+
+
+string CatalogCache::GetDigestPath(const shash::Any &hash) const {
+  return cache_dir_ + "/" + hash.ToString(true) + kDigestSuffix;
+}
+
+
+void CatalogCache::Remove(const string &catalog_path) {
+  const string digest_path =
+    catalog_path.substr(0, catalog_path.length() - strlen(kCatalogSuffix)) +
+    kDigestSuffix;
+  unlink(digest_path.c_str());
+  unlink(catalog_path.c_str());
+}
+
+
+bool CatalogCache::Fetch(
+  const shash::Any &hash,
+  const string &path_prefix,
+  string *catalog_path)
+{
+  const string cached_path = GetCatalogPath(hash);
+  string digest;
+  int fd_digest = open(GetDigestPath(hash).c_str(), O_RDONLY);
+  if (fd_digest < 0) {
+    atomic_inc32(&num_misses_);
+    return false;
+  }
+  const bool retval = SafeReadToString(fd_digest, &digest);
+  close(fd_digest);
+  if (!retval) {
+    atomic_inc32(&num_misses_);
+    return false;
+  }
+
+  const string path = CreateTempPath(path_prefix, 0600);
+  if (path.empty() || !CloneFile(cached_path, path)) {
+    if (!path.empty())
+      unlink(path.c_str());
+    atomic_inc32(&num_misses_);
+    return false;
+  }
+  // The copy is verified, so that it cannot change after the check
+  shash::Any actual(hash.algorithm);
+  if (!shash::HashFile(path, &actual) || (actual.ToString() != digest)) {
+    LogCvmfs(kLogCatalog, kLogStderr | kLogSyslogWarn,
+             "removing corrupted catalog %s from catalog cache",
+             hash.ToString(true).c_str());
+    unlink(path.c_str());
+    Remove(cached_path);
+    atomic_inc32(&num_misses_);
+    return false;
+  }
+
+  // Marks the entry as recently used for Trim()
+  utime(cached_path.c_str(), NULL);
+  *catalog_path = path;
+  atomic_inc32(&num_hits_);
+  LogCvmfs(kLogCatalog, kLogVerboseMsg, "catalog %s taken from catalog cache",
+           hash.ToString(true).c_str());
+  return true;
+}
+
+
+void CatalogCache::Insert(const shash::Any &hash, const string &path) {
+  const string cached_path = GetCatalogPath(hash);
+  const string digest_path = GetDigestPath(hash);
+  if (FileExists(cached_path) && FileExists(digest_path)) {
+    utime(cached_path.c_str(), NULL);
+    return;
+  }
+
+  const string txn_catalog = CreateTempPath(cache_dir_ + "/txn", 0600);
+  const string txn_digest = CreateTempPath(cache_dir_ + "/txn", 0600);
+  shash::Any digest(hash.algorithm);
+  bool retval = !txn_catalog.empty() && !txn_digest.empty() &&
+                CloneFile(path, txn_catalog) &&
+                shash::HashFile(txn_catalog, &digest) &&
+                SafeWriteToFile(digest.ToString(), txn_digest, 0600);
+  // The digest is moved last, entries without digest are ignored
+  retval = retval &&
+           (rename(txn_catalog.c_str(), cached_path.c_str()) == 0) &&
+           (rename(txn_digest.c_str(), digest_path.c_str()) == 0);
+  if (!retval) {
+    LogCvmfs(kLogCatalog, kLogStderr,
+             "failed to insert catalog %s into catalog cache (errno: %d)",
+             hash.ToString(true).c_str(), errno);
+    if (!txn_catalog.empty())
+      unlink(txn_catalog.c_str());
+    if (!txn_digest.empty())
+      unlink(txn_digest.c_str());
+  }
+}
+
+
+void CatalogCache::Trim() {
+  if (limit_ == 0)
+    return;
+
+  // Modification time and size of all the catalogs
+  vector<pair<time_t, pair<uint64_t, string> > > catalogs;
+  uint64_t total_size = 0;
+  const vector<string> catalog_paths = FindFiles(cache_dir_, kCatalogSuffix);
+  for (unsigned i = 0; i < catalog_paths.size(); ++i) {
+    platform_stat64 info;
+    if (platform_stat(catalog_paths[i].c_str(), &info) != 0)
+      continue;
+    catalogs.push_back(make_pair(info.st_mtime,
+                                 make_pair(info.st_size, catalog_paths[i])));
+    total_size += info.st_size;
+  }
+  sort(catalogs.begin(), catalogs.end());
+
+  for (unsigned i = 0; (i < catalogs.size()) && (total_size > limit_); ++i) {
+    LogCvmfs(kLogCatalog, kLogVerboseMsg, "evicting %s from catalog cache",
+             catalogs[i].second.second.c_str());
+    Remove(catalogs[i].second.second);
+    total_size -= catalogs[i].second.first;
+  }
+}
+
+}  // namespace catalog
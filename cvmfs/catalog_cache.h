@@ -0,0 +1,80 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_CATALOG_CACHE_H_
+#define CVMFS_CATALOG_CACHE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "atomic.h"
+#include "hash.h"
+#include "util/single_copy.h"
+
+namespace catalog {
+
+/**
+ * Keeps the uncompressed catalog databases of a publisher or gateway across
+ * transactions, so that catalogs are downloaded and decompressed only once.
+ * Entries are keyed by the content hash of the compressed catalog.  Next to
+ * every catalog, the cache stores the hash of the uncompressed database;
+ * catalogs are verified against it whenever they are taken from the cache.
+ *
+ * Catalog managers modify their catalogs in place, so they receive private
+ * copies.  Where the file system supports it (btrfs, XFS), the copies are
+ * reflinks that share the data blocks with the cache entry until modified.
+ *
+ * All operations are safe to be called concurrently, also from different
+ * processes.  New entries are moved into place by rename().
+ */
+class CatalogCache : SingleCopy {
+ public:
+  /**
+   * Returns NULL if the cache directory cannot be created.  The limit is in
+   * bytes, Trim() evicts the least recently used catalogs beyond it.  A limit
+   * of zero lets the cache grow without bounds.
+   */
+  static CatalogCache *Create(const std::string &cache_dir,
+                              const uint64_t limit);
+
+  /**
+   * Creates a private copy of the catalog in a new temporary file starting
+   * with path_prefix.  Returns false if the catalog is not in the cache or if
+   * the cache entry is corrupted, in which case it is removed.
+   */
+  bool Fetch(const shash::Any &hash, const std::string &path_prefix,
+             std::string *catalog_path);
+  /**
+   * Stores a copy of the uncompressed catalog at path that is known to
+   * compress to hash.  Failures are only logged.
+   */
+  void Insert(const shash::Any &hash, const std::string &path);
+  /**
+   * Evicts catalogs that have not been used for the longest time until the
+   * cache is within its limit.
+   */
+  void Trim();
+
+  std::string cache_dir() const { return cache_dir_; }
+  int32_t num_hits() const { return atomic_read32(&num_hits_); }
+  int32_t num_misses() const { return atomic_read32(&num_misses_); }
+
+ private:
+  static bool CloneFile(const std::string &src, const std::string &dest);
+
+  CatalogCache(const std::string &cache_dir, const uint64_t limit);
+  std::string GetCatalogPath(const shash::Any &hash) const;
+  std::string GetDigestPath(const shash::Any &hash) const;
+  void Remove(const std::string &catalog_path);
+
+  std::string cache_dir_;
+  uint64_t limit_;
+  mutable atomic_int32 num_hits_;
+  mutable atomic_int32 num_misses_;
+};
+
+}  // namespace catalog
+
+#endif  // CVMFS_CATALOG_CACHE_H_
@@ -4,14 +4,53 @@
 
 #include "catalog_counters.h"
 
+#include <cassert>
+#include <string>
+
 #include "directory_entry.h"
+#include "util/string.h"
 
 namespace catalog {
 
+unsigned GetSizeBin(const uint64_t size) {
+  uint64_t limit = 4 * 1024;
+  for (unsigned i = 0; i < kNumSizeBins - 1; ++i) {
+    if (size < limit)
+      return i;
+    limit *= 16;
+  }
+  return kNumSizeBins - 1;
+}
+
+
+std::string GetSizeBinName(const unsigned bin) {
+  static const char *kNames[kNumSizeBins] = {
+    "size_4k", "size_64k", "size_1m", "size_16m", "size_256m", "size_4g",
+    "size_huge"
+  };
+  assert(bin < kNumSizeBins);
+  return kNames[bin];
+}
+
+
+bool IsSummaryCounter(const std::string &name) {
+  const std::string::size_type pos = name.find('_');
+  const std::string field = (pos == std::string::npos) ?
+                            name : name.substr(pos + 1);
+  return (field == "inline") || (field == "bundled") ||
+         (field == "unsummarized") || HasPrefix(field, "size_", false);
+}
+
+
 void DeltaCounters::ApplyDelta(const DirectoryEntry &dirent, const int delta) {
   if (dirent.IsRegular()) {
     self.regular_files += delta;
     self.file_size     += delta * dirent.size();
+    self.size_bins[GetSizeBin(dirent.size())] += delta;
+    if (dirent.IsInlineFile())
+      self.inline_files += delta;
+    if (dirent.IsBundledFile())
+      self.bundled_files += delta;
     if (dirent.IsChunkedFile()) {
       self.chunked_files     += delta;
       self.chunked_file_size += delta * dirent.size();
@@ -23,18 +23,37 @@ class CatalogDatabase;
 struct LegacyMode {
   enum Type {  // TODO(rmeusel): C++11 typed enum
     kNoLegacy,
+    kNoSummary,
     kNoExternals,
     kNoXattrs,
     kLegacy
   };
 };
 
+/**
+ * Regular files are counted in size bins.  Bin i holds the files smaller than
+ * 4 kB * 16^i, the last bin holds the remaining files of 4 GB and beyond.
+ */
+const unsigned kNumSizeBins = 7;
+unsigned GetSizeBin(const uint64_t size);
+/**
+ * The counter name of a size bin, such as "size_64k"
+ */
+std::string GetSizeBinName(const unsigned bin);
+/**
+ * The size bins, the inline and bundled files, and the unsummarized catalogs
+ * form the summary statistics.  They are missing in catalogs before schema
+ * revision 7.
+ */
+bool IsSummaryCounter(const std::string &name);
+
 // FieldT is either int64_t (DeltaCounters) or uint64_t (Counters)
 template<typename FieldT>
 class TreeCountersBase {
   friend class swissknife::CommandCheck;
   FRIEND_TEST(T_CatalogCounters, FieldsCombinations);
   FRIEND_TEST(T_CatalogCounters, FieldsMap);
+  FRIEND_TEST(T_CatalogCounters, SummaryCounters);
 
  protected:
   typedef std::map<std::string, const FieldT*> FieldsMap;
@@ -50,7 +69,14 @@ class TreeCountersBase {
       , chunked_file_size(0)
       , xattrs(0)
       , externals(0)
-      , external_file_size(0) { }
+      , external_file_size(0)
+      , inline_files(0)
+      , bundled_files(0)
+      , unsummarized(0)
+    {
+      for (unsigned i = 0; i < kNumSizeBins; ++i)
+        size_bins[i] = 0;
+    }
 
     // typname U is another TreeCountersBase (eg: add DeltaCounters to Counters)
     template<typename U>
@@ -76,6 +102,11 @@ class TreeCountersBase {
       xattrs             += factor * other.xattrs;
       externals          += factor * other.externals;
       external_file_size += factor * other.external_file_size;
+      inline_files       += factor * other.inline_files;
+      bundled_files      += factor * other.bundled_files;
+      unsummarized       += factor * other.unsummarized;
+      for (unsigned i = 0; i < kNumSizeBins; ++i)
+        size_bins[i] += factor * other.size_bins[i];
     }
 
     void FillFieldsMap(const std::string &prefix, FieldsMap *map) const {
@@ -90,6 +121,11 @@ class TreeCountersBase {
       (*map)[prefix + "xattr"]              = &xattrs;
       (*map)[prefix + "external"]           = &externals;
       (*map)[prefix + "external_file_size"] = &external_file_size;
+      (*map)[prefix + "inline"]             = &inline_files;
+      (*map)[prefix + "bundled"]            = &bundled_files;
+      (*map)[prefix + "unsummarized"]       = &unsummarized;
+      for (unsigned i = 0; i < kNumSizeBins; ++i)
+        (*map)[prefix + GetSizeBinName(i)] = &size_bins[i];
     }
 
     FieldT regular_files;
@@ -103,6 +139,15 @@ class TreeCountersBase {
     FieldT xattrs;
     FieldT externals;
     FieldT external_file_size;
+    FieldT inline_files;
+    FieldT bundled_files;
+    /**
+     * Catalogs whose summary statistics do not cover all their entries
+     * because they were created before schema revision 7.  The writable
+     * catalog recomputes its own summary on the next commit.
+     */
+    FieldT unsummarized;
+    FieldT size_bins[kNumSizeBins];
   };
 
  public:
@@ -148,6 +193,13 @@ class Counters : public TreeCountersBase<Counters_t> {
   Counters_t GetSelfEntries() const;
   Counters_t GetSubtreeEntries() const;
   Counters_t GetAllEntries() const;
+  /**
+   * False if the summary statistics of the catalog or its subtree miss some
+   * entries, see Fields::unsummarized
+   */
+  bool HasCompleteSummary() const {
+    return (self.unsummarized == 0) && (subtree.unsummarized == 0);
+  }
 };
 
 }  // namespace catalog
@@ -37,6 +37,7 @@ bool TreeCountersBase<FieldT>::ReadFromDatabase(
   const LegacyMode::Type   legacy)
 {
   bool retval = true;
+  bool summary_missing = false;
 
   FieldsMap map = GetFieldsMap();
   SqlGetCounter sql_counter(database);
@@ -51,6 +52,12 @@ bool TreeCountersBase<FieldT>::ReadFromDatabase(
     if (current_retval) {
       *(const_cast<FieldT*>(i->second)) =
         static_cast<FieldT>(sql_counter.GetCounter());
+    } else if ((legacy != LegacyMode::kNoLegacy) &&
+               IsSummaryCounter(i->first))
+    {
+      *(const_cast<FieldT*>(i->second)) = FieldT(0);
+      summary_missing = true;
+      current_retval = true;
     } else if ( (legacy == LegacyMode::kNoExternals) &&
                 ((i->first == "self_external")
                   || (i->first == "subtree_external") ||
@@ -77,6 +84,12 @@ bool TreeCountersBase<FieldT>::ReadFromDatabase(
     retval = (retval) ? current_retval : false;
   }
 
+  // Without summary, the catalog and all the catalogs below are unsummarized
+  if (summary_missing) {
+    self.unsummarized = 1;
+    subtree.unsummarized = self.nested_catalogs + subtree.nested_catalogs;
+  }
+
   return retval;
 }
 
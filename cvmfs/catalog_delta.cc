@@ -0,0 +1,144 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "catalog_delta.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+const unsigned CatalogDelta::kMaxChangedPercent;
+
+namespace {
+
+const char kMagic[] = "CVMFSDL1";
+const unsigned kMagicSize = 8;
+// Magic, page size, number of records, base size, target size
+const unsigned kHeaderSize = kMagicSize + 4 + 4 + 8 + 8;
+
+void PutUint(const uint64_t value, const unsigned nbytes, string *buf) {
+  for (unsigned i = 0; i < nbytes; ++i)
+    buf->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+uint64_t GetUint(const string &buf, const size_t pos, const unsigned nbytes) {
+  uint64_t result = 0;
+  for (unsigned i = 0; i < nbytes; ++i) {
+    result |= static_cast<uint64_t>(static_cast<unsigned char>(buf[pos + i]))
+              << (8 * i);
+  }
+  return result;
+}
+
+}  // anonymous namespace
+
+
+string CatalogDelta::MakeDeltaPath(
+  const shash::Any &base_hash,
+  const shash::Any &target_hash)
+{
+  return "data/" + target_hash.MakePath() + "-" + base_hash.ToString();
+}
+
+
+unsigned CatalogDelta::GetPageSize(const string &data) {
+  const char kSqliteMagic[] = "SQLite format 3";
+  if ((data.size() < 100) ||
+      (memcmp(data.data(), kSqliteMagic, sizeof(kSqliteMagic)) != 0))
+  {
+    return 0;
+  }
+  // Big endian at offset 16, the value 1 stands for 64kB
+  const unsigned page_size =
+    (static_cast<unsigned char>(data[16]) << 8) +
+    static_cast<unsigned char>(data[17]);
+  if (page_size == 1)
+    return 65536;
+  if ((page_size < 512) || ((page_size & (page_size - 1)) != 0))
+    return 0;
+  return page_size;
+}
+
+
+bool CatalogDelta::Create(
+  const string &base,
+  const string &target,
+  string *delta)
+{
+  const unsigned page_size = GetPageSize(target);
+  if ((page_size == 0) || (GetPageSize(base) != page_size))
+    return false;
+
+  const uint64_t num_pages = (target.size() + page_size - 1) / page_size;
+  string records;
+  uint32_t num_records = 0;
+  for (uint64_t i = 0; i < num_pages; ++i) {
+    const size_t offset = i * page_size;
+    const size_t length = min(static_cast<size_t>(page_size),
+                              target.size() - offset);
+    if ((offset + length <= base.size()) &&
+        (memcmp(base.data() + offset, target.data() + offset, length) == 0))
+    {
+      continue;
+    }
+    num_records++;
+    if (uint64_t(num_records) * 100 > num_pages * kMaxChangedPercent)
+      return false;
+    PutUint(i, 4, &records);
+    records.append(target, offset, length);
+    // The last page might be incomplete, records have a fixed size
+    records.append(page_size - length, '\0');
+  }
+
+  delta->assign(kMagic, kMagicSize);
+  PutUint(page_size, 4, delta);
+  PutUint(num_records, 4, delta);
+  PutUint(base.size(), 8, delta);
+  PutUint(target.size(), 8, delta);
+  delta->append(records);
+  return true;
+}
+
+
+bool CatalogDelta::Apply(
+  const string &base,
+  const string &delta,
+  string *target)
+{
+  if ((delta.size() < kHeaderSize) ||
+      (delta.compare(0, kMagicSize, kMagic, kMagicSize) != 0))
+  {
+    return false;
+  }
+  const unsigned page_size = GetUint(delta, kMagicSize, 4);
+  const uint64_t num_records = GetUint(delta, kMagicSize + 4, 4);
+  const uint64_t base_size = GetUint(delta, kMagicSize + 8, 8);
+  const uint64_t target_size = GetUint(delta, kMagicSize + 16, 8);
+  if ((page_size == 0) || (page_size != GetPageSize(base)) ||
+      (base_size != base.size()) ||
+      (delta.size() != kHeaderSize + num_records * (4 + page_size)))
+  {
+    return false;
+  }
+
+  *target = base;
+  target->resize(target_size, '\0');
+  size_t pos = kHeaderSize;
+  for (uint64_t i = 0; i < num_records; ++i) {
+    const uint64_t offset = GetUint(delta, pos, 4) * page_size;
+    pos += 4;
+    if (offset >= target_size)
+      return false;
+    const size_t length = min(static_cast<uint64_t>(page_size),
+                              target_size - offset);
+    target->replace(offset, length, delta, pos, length);
+    pos += page_size;
+  }
+  return true;
+}
+
+}  // namespace catalog
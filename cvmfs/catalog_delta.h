@@ -0,0 +1,62 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_CATALOG_DELTA_H_
+#define CVMFS_CATALOG_DELTA_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "hash.h"
+
+namespace catalog {
+
+/**
+ * Page-level binary deltas between two revisions of an uncompressed catalog
+ * database.  Typically, a new catalog revision changes only a few SQLite
+ * pages of the previous one, so clients that have the previous revision in
+ * their cache can reconstruct the new one from the changed pages.
+ *
+ * A delta consists of a header followed by (page index, page content) records
+ * for the pages of the target that differ from the base.  Deltas are zlib
+ * compressed on the server; the delta object of target is stored next to the
+ * target catalog, see MakeDeltaPath().  Deltas are not signed.  Clients verify
+ * the reconstructed catalog against the target content hash, which refers to
+ * the compressed catalog, by compressing it again.
+ */
+struct CatalogDelta {
+  /**
+   * The publisher does not store deltas that change more than a quarter of
+   * the pages; the full catalog is not much more expensive in that case.
+   */
+  static const unsigned kMaxChangedPercent = 25;
+
+  /**
+   * Relative to the repository root, e.g. data/ab/cdef...C-<base hash>
+   */
+  static std::string MakeDeltaPath(const shash::Any &base_hash,
+                                   const shash::Any &target_hash);
+
+  /**
+   * Returns the SQLite page size or 0 if data is not an SQLite database.
+   */
+  static unsigned GetPageSize(const std::string &data);
+
+  /**
+   * Fails if the page sizes differ or if too many pages changed.
+   */
+  static bool Create(const std::string &base, const std::string &target,
+                     std::string *delta);
+  /**
+   * Fails if the delta does not fit the base.  The result still needs to be
+   * verified against the expected content hash.
+   */
+  static bool Apply(const std::string &base, const std::string &delta,
+                    std::string *target);
+};
+
+}  // namespace catalog
+
+#endif  // CVMFS_CATALOG_DELTA_H_
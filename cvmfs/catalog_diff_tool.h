@@ -5,7 +5,10 @@
 #ifndef CVMFS_CATALOG_DIFF_TOOL_H_
 #define CVMFS_CATALOG_DIFF_TOOL_H_
 
+#include <pthread.h>
+
 #include <string>
+#include <vector>
 
 #include "directory_entry.h"
 #include "shortstring.h"
@@ -27,7 +30,10 @@ class CatalogDiffTool {
         download_manager_(NULL),
         old_catalog_mgr_(old_catalog_mgr),
         new_catalog_mgr_(new_catalog_mgr),
-        needs_setup_(false) {}
+        needs_setup_(false),
+        num_workers_(1),
+        num_active_(0),
+        terminate_(false) {}
 
   CatalogDiffTool(const std::string& repo_path, const shash::Any& old_root_hash,
                   const shash::Any& new_root_hash,
@@ -42,14 +48,31 @@ class CatalogDiffTool {
         new_raii_temp_dir_(),
         old_catalog_mgr_(),
         new_catalog_mgr_(),
-        needs_setup_(true) {}
+        needs_setup_(true),
+        num_workers_(1),
+        num_active_(0),
+        terminate_(false) {}
 
   virtual ~CatalogDiffTool() {}
 
   bool Init();
 
+  /**
+   * Reports the differences below path.  The entries of a directory are
+   * reported in the order of their path hashes, not of their names.
+   */
   bool Run(const PathString& path);
 
+  /**
+   * With more than one worker, the sub trees of nested catalogs that exist in
+   * both the old and the new revision are diffed concurrently.  The Report*()
+   * callbacks are then called from several threads.  A directory is still
+   * reported before and removed after its contents.
+   */
+  void SetNumWorkers(unsigned num_workers) {
+    num_workers_ = (num_workers > 0) ? num_workers : 1;
+  }
+
  protected:
   virtual void ReportAddition(const PathString& path,
                               const catalog::DirectoryEntry& entry,
@@ -76,6 +99,8 @@ class CatalogDiffTool {
                                    perf::Statistics* stats);
 
   void DiffRec(const PathString& path);
+  void ScheduleSubtree(const PathString& path);
+  static void* MainWorker(void* data);
 
   std::string repo_path_;
   shash::Any old_root_hash_;
@@ -94,6 +119,16 @@ class CatalogDiffTool {
   UniquePtr<RoCatalogMgr> new_catalog_mgr_;
 
   const bool needs_setup_;
+
+  unsigned num_workers_;
+  /**
+   * Protects the sub tree queue in parallel mode
+   */
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_changed_;
+  std::vector<PathString> pending_subtrees_;
+  unsigned num_active_;
+  bool terminate_;
 };
 
 #include "catalog_diff_tool_impl.h"
@@ -5,40 +5,33 @@
 #ifndef CVMFS_CATALOG_DIFF_TOOL_IMPL_H_
 #define CVMFS_CATALOG_DIFF_TOOL_IMPL_H_
 
-#include <algorithm>
+#include <cassert>
 #include <string>
+#include <vector>
 
 #include "catalog.h"
 #include "download.h"
 #include "hash.h"
 #include "logging.h"
 #include "util/posix.h"
+#include "util_concurrency.h"
 
-const uint64_t kLastInode = uint64_t(-1);
-
-inline void AppendFirstEntry(catalog::DirectoryEntryList* entry_list) {
-  catalog::DirectoryEntry empty_entry;
-  entry_list->push_back(empty_entry);
-}
-
-inline void AppendLastEntry(catalog::DirectoryEntryList* entry_list) {
-  assert(!entry_list->empty());
-  catalog::DirectoryEntry last_entry;
-  last_entry.set_inode(kLastInode);
-  entry_list->push_back(last_entry);
+/**
+ * Advances a listing stream, a NULL stream is empty
+ */
+inline bool NextListingEntry(catalog::ListingStream* listing,
+                             catalog::DirectoryEntry* entry,
+                             shash::Md5* md5path) {
+  if (listing == NULL) return false;
+  return listing->Next(entry, md5path);
 }
 
-inline bool IsSmaller(const catalog::DirectoryEntry& a,
-                      const catalog::DirectoryEntry& b) {
-  bool a_is_first = (a.inode() == catalog::DirectoryEntryBase::kInvalidInode);
-  bool a_is_last = (a.inode() == kLastInode);
-  bool b_is_first = (b.inode() == catalog::DirectoryEntryBase::kInvalidInode);
-  bool b_is_last = (b.inode() == kLastInode);
-
-  if (a_is_last || b_is_first) return false;
-  if (a_is_first) return !b_is_first;
-  if (b_is_last) return !a_is_last;
-  return a.name() < b.name();
+inline PathString MakeEntryPath(const PathString& path,
+                                const catalog::DirectoryEntry& entry) {
+  PathString result(path);
+  result.Append("/", 1);
+  result.Append(entry.name().GetChars(), entry.name().GetLength());
+  return result;
 }
 
 template <typename RoCatalogMgr>
@@ -74,11 +67,72 @@ bool CatalogDiffTool<RoCatalogMgr>::Init() {
 
 template <typename RoCatalogMgr>
 bool CatalogDiffTool<RoCatalogMgr>::Run(const PathString& path) {
-  DiffRec(path);
+  if (num_workers_ <= 1) {
+    DiffRec(path);
+    return true;
+  }
+
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&cond_changed_, NULL);
+  assert(retval == 0);
+  terminate_ = false;
+  num_active_ = 0;
+  std::vector<pthread_t> threads(num_workers_);
+  for (unsigned i = 0; i < num_workers_; ++i) {
+    retval = pthread_create(&threads[i], NULL, MainWorker, this);
+    assert(retval == 0);
+  }
+
+  ScheduleSubtree(path);
+  {
+    MutexLockGuard guard(lock_);
+    while (!pending_subtrees_.empty() || (num_active_ > 0))
+      pthread_cond_wait(&cond_changed_, &lock_);
+    terminate_ = true;
+    pthread_cond_broadcast(&cond_changed_);
+  }
+  for (unsigned i = 0; i < num_workers_; ++i)
+    pthread_join(threads[i], NULL);
+  pthread_cond_destroy(&cond_changed_);
+  pthread_mutex_destroy(&lock_);
 
   return true;
 }
 
+template <typename RoCatalogMgr>
+void CatalogDiffTool<RoCatalogMgr>::ScheduleSubtree(const PathString& path) {
+  MutexLockGuard guard(lock_);
+  pending_subtrees_.push_back(path);
+  pthread_cond_broadcast(&cond_changed_);
+}
+
+template <typename RoCatalogMgr>
+void* CatalogDiffTool<RoCatalogMgr>::MainWorker(void* data) {
+  CatalogDiffTool<RoCatalogMgr>* diff_tool =
+      reinterpret_cast<CatalogDiffTool<RoCatalogMgr>*>(data);
+
+  while (true) {
+    PathString path;
+    {
+      MutexLockGuard guard(diff_tool->lock_);
+      while (!diff_tool->terminate_ && diff_tool->pending_subtrees_.empty())
+        pthread_cond_wait(&diff_tool->cond_changed_, &diff_tool->lock_);
+      if (diff_tool->terminate_) break;
+      path = diff_tool->pending_subtrees_.back();
+      diff_tool->pending_subtrees_.pop_back();
+      diff_tool->num_active_++;
+    }
+
+    diff_tool->DiffRec(path);
+
+    MutexLockGuard guard(diff_tool->lock_);
+    diff_tool->num_active_--;
+    pthread_cond_broadcast(&diff_tool->cond_changed_);
+  }
+  return NULL;
+}
+
 template <typename RoCatalogMgr>
 RoCatalogMgr* CatalogDiffTool<RoCatalogMgr>::OpenCatalogManager(
     const std::string& repo_path, const std::string& temp_dir,
@@ -91,47 +145,53 @@ RoCatalogMgr* CatalogDiffTool<RoCatalogMgr>::OpenCatalogManager(
   return mgr;
 }
 
+/**
+ * Merges the listings of both revisions in the order of the path hashes.  The
+ * listings are streamed from the catalogs, so that only the current entry of
+ * every directory on the recursion path is held in memory.
+ */
 template <typename RoCatalogMgr>
 void CatalogDiffTool<RoCatalogMgr>::DiffRec(const PathString& path) {
-  catalog::DirectoryEntryList old_listing;
-  AppendFirstEntry(&old_listing);
-  old_catalog_mgr_->Listing(path, &old_listing);
-  sort(old_listing.begin(), old_listing.end(), IsSmaller);
-  AppendLastEntry(&old_listing);
-
-  catalog::DirectoryEntryList new_listing;
-  AppendFirstEntry(&new_listing);
-  new_catalog_mgr_->Listing(path, &new_listing);
-  sort(new_listing.begin(), new_listing.end(), IsSmaller);
-  AppendLastEntry(&new_listing);
-
-  unsigned i_from = 0, size_from = old_listing.size();
-  unsigned i_to = 0, size_to = new_listing.size();
-  while ((i_from < size_from) || (i_to < size_to)) {
-    const catalog::DirectoryEntry old_entry = old_listing[i_from];
-    const catalog::DirectoryEntry new_entry = new_listing[i_to];
-
-    PathString old_path(path);
-    old_path.Append("/", 1);
-    old_path.Append(old_entry.name().GetChars(), old_entry.name().GetLength());
-    PathString new_path(path);
-    new_path.Append("/", 1);
-    new_path.Append(new_entry.name().GetChars(), new_entry.name().GetLength());
-
-    XattrList xattrs;
-    if (new_entry.HasXattrs()) {
-      new_catalog_mgr_->LookupXattrs(new_path, &xattrs);
+  UniquePtr<catalog::ListingStream> old_listing(
+      old_catalog_mgr_->OpenListingStream(path));
+  UniquePtr<catalog::ListingStream> new_listing(
+      new_catalog_mgr_->OpenListingStream(path));
+
+  catalog::DirectoryEntry old_next, new_next;
+  shash::Md5 old_md5path, new_md5path;
+  bool has_old =
+      NextListingEntry(old_listing.weak_ref(), &old_next, &old_md5path);
+  bool has_new =
+      NextListingEntry(new_listing.weak_ref(), &new_next, &new_md5path);
+  while (has_old || has_new) {
+    int order;
+    if (!has_old) {
+      order = 1;
+    } else if (!has_new) {
+      order = -1;
+    } else {
+      order = catalog::ListingStream::CompareMd5Paths(old_md5path, new_md5path);
     }
 
-    if (IsSmaller(new_entry, old_entry)) {
-      i_to++;
+    if (order > 0) {
+      const catalog::DirectoryEntry new_entry = new_next;
+      has_new =
+          NextListingEntry(new_listing.weak_ref(), &new_next, &new_md5path);
+      const PathString new_path = MakeEntryPath(path, new_entry);
+      XattrList xattrs;
+      if (new_entry.HasXattrs()) {
+        new_catalog_mgr_->LookupXattrs(new_path, &xattrs);
+      }
       ReportAddition(new_path, new_entry, xattrs);
       if (new_entry.IsDirectory()) {
         DiffRec(new_path);
       }
       continue;
-    } else if (IsSmaller(old_entry, new_entry)) {
-      i_from++;
+    } else if (order < 0) {
+      const catalog::DirectoryEntry old_entry = old_next;
+      has_old =
+          NextListingEntry(old_listing.weak_ref(), &old_next, &old_md5path);
+      const PathString old_path = MakeEntryPath(path, old_entry);
       if (old_entry.IsDirectory()) {
         DiffRec(old_path);
       }
@@ -139,9 +199,18 @@ void CatalogDiffTool<RoCatalogMgr>::DiffRec(const PathString& path) {
       continue;
     }
 
+    const catalog::DirectoryEntry old_entry = old_next;
+    const catalog::DirectoryEntry new_entry = new_next;
+    has_old = NextListingEntry(old_listing.weak_ref(), &old_next, &old_md5path);
+    has_new = NextListingEntry(new_listing.weak_ref(), &new_next, &new_md5path);
+    const PathString old_path = MakeEntryPath(path, old_entry);
+    const PathString new_path = MakeEntryPath(path, new_entry);
     assert(old_path == new_path);
-    i_from++;
-    i_to++;
+
+    XattrList xattrs;
+    if (new_entry.HasXattrs()) {
+      new_catalog_mgr_->LookupXattrs(new_path, &xattrs);
+    }
     if (old_entry.CompareTo(new_entry) > 0) {
       ReportModification(old_path, old_entry, new_entry, xattrs);
     }
@@ -159,7 +228,8 @@ void CatalogDiffTool<RoCatalogMgr>::DiffRec(const PathString& path) {
         old_entry.CompareTo(new_entry);
     if ((diff == catalog::DirectoryEntryBase::Difference::kIdentical) &&
         old_entry.IsNestedCatalogMountpoint()) {
-      // Early recursion stop if nested catalogs are identical
+      // Early recursion stop if nested catalogs are identical.  The hashes
+      // come from the parent catalogs, the nested catalogs are not opened.
       shash::Any id_nested_from, id_nested_to;
       id_nested_from = old_catalog_mgr_->GetNestedCatalogHash(old_path);
       id_nested_to = new_catalog_mgr_->GetNestedCatalogHash(new_path);
@@ -167,6 +237,14 @@ void CatalogDiffTool<RoCatalogMgr>::DiffRec(const PathString& path) {
       if (id_nested_from == id_nested_to) continue;
     }
 
+    // The sub tree of a nested catalog that stays in place is independent of
+    // the remaining listing
+    if ((num_workers_ > 1) && old_entry.IsNestedCatalogMountpoint() &&
+        new_entry.IsNestedCatalogMountpoint()) {
+      ScheduleSubtree(old_path);
+      continue;
+    }
+
     DiffRec(old_path);
   }
 }
@@ -0,0 +1,271 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "catalog_heatmap.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+#include "logging.h"
+#include "util/posix.h"
+#include "util/string.h"
+#include "util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+namespace {
+
+const char *kHeaderPrefix = "# catalog heatmap ";
+
+bool CompareRank(const pair<uint64_t, string> &a,
+                 const pair<uint64_t, string> &b)
+{
+  if (a.first != b.first)
+    return a.first > b.first;
+  return a.second < b.second;
+}
+
+}  // anonymous namespace
+
+
+void CatalogHeatmap::Entry::Merge(const Entry &other) {
+  num_clients += other.num_clients;
+  num_attaches += other.num_attaches;
+  attach_us += other.attach_us;
+  max_attach_us = std::max(max_attach_us, other.max_attach_us);
+  num_lookups += other.num_lookups;
+  num_bytes += other.num_bytes;
+}
+
+
+CatalogHeatmap::CatalogHeatmap(const string &repo_name)
+  : repo_name_(repo_name)
+{
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+}
+
+
+CatalogHeatmap::~CatalogHeatmap() {
+  pthread_mutex_destroy(&lock_);
+}
+
+
+void CatalogHeatmap::RecordAttach(
+  const string &path,
+  const uint64_t attach_us,
+  const uint64_t num_bytes)
+{
+  MutexLockGuard lock_guard(&lock_);
+  Entry *entry = &entries_[path];
+  entry->num_attaches++;
+  entry->attach_us += attach_us;
+  entry->max_attach_us = std::max(entry->max_attach_us, attach_us);
+  entry->num_bytes += num_bytes;
+}
+
+
+void CatalogHeatmap::RecordLookups(
+  const string &path,
+  const uint64_t num_lookups)
+{
+  if (num_lookups == 0)
+    return;
+  MutexLockGuard lock_guard(&lock_);
+  entries_[path].num_lookups += num_lookups;
+}
+
+
+void CatalogHeatmap::Merge(const CatalogHeatmap &other) {
+  EntryMap other_entries;
+  {
+    MutexLockGuard lock_guard(&other.lock_);
+    other_entries = other.entries_;
+  }
+  MutexLockGuard lock_guard(&lock_);
+  for (EntryMap::const_iterator i = other_entries.begin(),
+       iEnd = other_entries.end(); i != iEnd; ++i)
+  {
+    EntryMap::iterator iter = entries_.find(i->first);
+    if (iter == entries_.end())
+      entries_[i->first] = i->second;
+    else
+      iter->second.Merge(i->second);
+  }
+}
+
+
+bool CatalogHeatmap::Lookup(const string &path, Entry *entry) const {
+  MutexLockGuard lock_guard(&lock_);
+  EntryMap::const_iterator iter = entries_.find(path);
+  if (iter == entries_.end())
+    return false;
+  *entry = iter->second;
+  return true;
+}
+
+
+unsigned CatalogHeatmap::size() const {
+  MutexLockGuard lock_guard(&lock_);
+  return entries_.size();
+}
+
+
+bool CatalogHeatmap::Load(
+  const string &path,
+  vector<CatalogHeatmap *> *heatmaps)
+{
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL)
+    return false;
+
+  const string header_prefix(kHeaderPrefix);
+  CatalogHeatmap *heatmap = NULL;
+  bool retval = true;
+  string line;
+  while (GetLineFile(f, &line)) {
+    if (HasPrefix(line, header_prefix, false)) {
+      heatmap = new CatalogHeatmap(line.substr(header_prefix.length()));
+      heatmaps->push_back(heatmap);
+      continue;
+    }
+    vector<string> tokens = SplitString(line, ' ');
+    if ((heatmap == NULL) || (tokens.size() < 7)) {
+      retval = false;
+      break;
+    }
+    Entry entry;
+    uint64_t *fields[] = { &entry.num_clients, &entry.num_attaches,
+                           &entry.attach_us, &entry.max_attach_us,
+                           &entry.num_lookups, &entry.num_bytes };
+    for (unsigned i = 0; retval && (i < 6); ++i)
+      retval = String2Uint64Parse(tokens[i], fields[i]);
+    if (!retval)
+      break;
+    // Paths can contain blanks
+    const string catalog_path = JoinStrings(
+      vector<string>(tokens.begin() + 6, tokens.end()), " ");
+    EntryMap::iterator iter = heatmap->entries_.find(catalog_path);
+    if (iter == heatmap->entries_.end())
+      heatmap->entries_[catalog_path] = entry;
+    else
+      iter->second.Merge(entry);
+  }
+  fclose(f);
+  if (!retval) {
+    LogCvmfs(kLogCatalog, kLogDebug, "invalid catalog heatmap %s",
+             path.c_str());
+  }
+  return retval;
+}
+
+
+string CatalogHeatmap::Serialize() const {
+  MutexLockGuard lock_guard(&lock_);
+  string result = kHeaderPrefix + repo_name_ + "\n";
+  for (EntryMap::const_iterator i = entries_.begin(), iEnd = entries_.end();
+       i != iEnd; ++i)
+  {
+    const Entry &e = i->second;
+    result += StringifyInt(e.num_clients) + " " +
+              StringifyInt(e.num_attaches) + " " +
+              StringifyInt(e.attach_us) + " " +
+              StringifyInt(e.max_attach_us) + " " +
+              StringifyInt(e.num_lookups) + " " +
+              StringifyInt(e.num_bytes) + " " + i->first + "\n";
+  }
+  return result;
+}
+
+
+/**
+ * Written to a temporary file first and atomically renamed to path.
+ */
+bool CatalogHeatmap::Save(const string &path) const {
+  const string content = Serialize();
+  string path_tmp;
+  FILE *f = CreateTempFile(path + ".tmp", 0644, "w", &path_tmp);
+  if (f == NULL) {
+    LogCvmfs(kLogCatalog, kLogDebug, "failed to create catalog heatmap (%d)",
+             errno);
+    return false;
+  }
+  bool retval = fwrite(content.data(), 1, content.length(), f) ==
+                content.length();
+  retval = (fclose(f) == 0) && retval;
+  if (retval)
+    retval = rename(path_tmp.c_str(), path.c_str()) == 0;
+  if (!retval) {
+    LogCvmfs(kLogCatalog, kLogDebug, "failed to write catalog heatmap %s",
+             path.c_str());
+    unlink(path_tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+uint64_t CatalogHeatmap::GetRankValue(const Entry &entry,
+                                      const RankBy rank_by)
+{
+  switch (rank_by) {
+    case kRankAttaches:
+      return entry.num_attaches;
+    case kRankAttachTime:
+      return entry.attach_us;
+    case kRankBytes:
+      return entry.num_bytes;
+    default:
+      return entry.num_lookups;
+  }
+}
+
+
+/**
+ * The hottest catalogs first.  Attach times are in milliseconds, downloaded
+ * bytes in kB.
+ */
+string CatalogHeatmap::PrintReport(
+  const RankBy rank_by,
+  const unsigned max_rows) const
+{
+  MutexLockGuard lock_guard(&lock_);
+  vector<pair<uint64_t, string> > ranking;
+  for (EntryMap::const_iterator i = entries_.begin(), iEnd = entries_.end();
+       i != iEnd; ++i)
+  {
+    ranking.push_back(make_pair(GetRankValue(i->second, rank_by), i->first));
+  }
+  sort(ranking.begin(), ranking.end(), CompareRank);
+
+  string result = "Repository " + repo_name_ + ": " +
+                  StringifyInt(entries_.size()) + " catalogs\n";
+  char line[512];
+  snprintf(line, sizeof(line), "%5s %8s %12s %9s %11s %11s %10s  %s\n",
+           "rank", "clients", "lookups", "attaches", "avg attach",
+           "max attach", "kB", "catalog");
+  result += line;
+  for (unsigned i = 0; (i < ranking.size()) && (i < max_rows); ++i) {
+    const Entry &e = entries_.find(ranking[i].second)->second;
+    const uint64_t avg_attach_us =
+      (e.num_attaches == 0) ? 0 : e.attach_us / e.num_attaches;
+    snprintf(line, sizeof(line),
+             "%5u %8" PRIu64 " %12" PRIu64 " %9" PRIu64 " %9" PRIu64 "ms "
+             "%9" PRIu64 "ms %10" PRIu64 "  ",
+             i + 1, e.num_clients, e.num_lookups, e.num_attaches,
+             avg_attach_us / 1000, e.max_attach_us / 1000, e.num_bytes / 1024);
+    result += line + ranking[i].second + "\n";
+  }
+  return result;
+}
+
+}  // namespace catalog
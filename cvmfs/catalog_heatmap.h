@@ -0,0 +1,95 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_CATALOG_HEATMAP_H_
+#define CVMFS_CATALOG_HEATMAP_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "util/single_copy.h"
+
+namespace catalog {
+
+/**
+ * Usage counters per nested catalog of a client: how often the catalog was
+ * attached, how long attaching took, how many lookups it served, and how many
+ * bytes were downloaded for it.  Catalogs are identified by their mountpoint
+ * so that the numbers of subsequent revisions add up.
+ *
+ * Clients dump their heat map periodically into a small text file.  The first
+ * line names the repository, every following line is a catalog:
+ *   <clients> <attaches> <attach us> <max attach us> <lookups> <bytes> <path>
+ * Dumps of many clients can be concatenated or merged into a ranked report,
+ * see the catalog_heatmap swissknife command.  The class is thread-safe.
+ */
+class CatalogHeatmap : SingleCopy {
+ public:
+  struct Entry {
+    Entry()
+      : num_clients(1), num_attaches(0), attach_us(0), max_attach_us(0)
+      , num_lookups(0), num_bytes(0)
+    { }
+    void Merge(const Entry &other);
+
+    uint64_t num_clients;
+    uint64_t num_attaches;
+    uint64_t attach_us;
+    uint64_t max_attach_us;
+    uint64_t num_lookups;
+    uint64_t num_bytes;
+  };
+
+  enum RankBy {
+    kRankLookups = 0,
+    kRankAttaches,
+    kRankAttachTime,
+    kRankBytes
+  };
+
+  explicit CatalogHeatmap(const std::string &repo_name);
+  ~CatalogHeatmap();
+
+  void RecordAttach(const std::string &path,
+                    const uint64_t attach_us,
+                    const uint64_t num_bytes);
+  void RecordLookups(const std::string &path, const uint64_t num_lookups);
+  /**
+   * Adds the counters of another heat map (or client) of the same repository
+   */
+  void Merge(const CatalogHeatmap &other);
+  bool Lookup(const std::string &path, Entry *entry) const;
+
+  /**
+   * Dump files can contain the heat maps of several repositories.
+   */
+  static bool Load(const std::string &path,
+                   std::vector<CatalogHeatmap *> *heatmaps);
+  bool Save(const std::string &path) const;
+  /**
+   * The dump file format; dumps can be concatenated.
+   */
+  std::string Serialize() const;
+  std::string PrintReport(const RankBy rank_by, const unsigned max_rows) const;
+
+  std::string repo_name() const { return repo_name_; }
+  unsigned size() const;
+
+ private:
+  typedef std::map<std::string, Entry> EntryMap;
+
+  static uint64_t GetRankValue(const Entry &entry, const RankBy rank_by);
+
+  std::string repo_name_;
+  EntryMap entries_;
+  mutable pthread_mutex_t lock_;
+};
+
+}  // namespace catalog
+
+#endif  // CVMFS_CATALOG_HEATMAP_H_
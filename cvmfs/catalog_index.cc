@@ -0,0 +1,394 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "catalog_index.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "catalog.h"
+#include "catalog_sql.h"
+#include "compression.h"
+#include "globals.h"
+#include "logging.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+const char *CatalogIndex::kPropertyKey = "read_index";
+
+namespace {
+
+const char kMagic[] = "CVMFSIX1";
+const unsigned kMagicSize = 8;
+// Magic, number of rows, heap size
+const unsigned kHeaderSize = kMagicSize + 4 + 4;
+const unsigned kKeySize = 16;
+
+// Layout of the row attributes
+const unsigned kOffParent = 0;
+const unsigned kOffRowId = 16;
+const unsigned kOffSize = 24;
+const unsigned kOffMtime = 32;
+const unsigned kOffUid = 40;
+const unsigned kOffGid = 44;
+const unsigned kOffMode = 48;
+const unsigned kOffHardlinkGroup = 52;
+const unsigned kOffLinkcount = 56;
+const unsigned kOffFlags = 60;
+const unsigned kOffName = 64;
+const unsigned kOffSymlink = 68;
+const unsigned kOffNameLength = 72;
+const unsigned kOffSymlinkLength = 74;
+const unsigned kOffHashAlgorithm = 76;
+const unsigned kOffCompression = 77;
+const unsigned kOffDigest = 80;
+const unsigned kRowSize = kOffDigest + shash::kMaxDigestSize;
+
+const uint32_t kRowNestedRoot = 0x01;
+const uint32_t kRowNestedMountpoint = 0x02;
+const uint32_t kRowBindMountpoint = 0x04;
+const uint32_t kRowChunked = 0x08;
+const uint32_t kRowHidden = 0x10;
+const uint32_t kRowExternal = 0x20;
+const uint32_t kRowInline = 0x40;
+const uint32_t kRowBundled = 0x80;
+const uint32_t kRowXattrs = 0x100;
+
+void PutUint(const uint64_t value, const unsigned nbytes, unsigned char *buf) {
+  for (unsigned i = 0; i < nbytes; ++i)
+    buf[i] = static_cast<unsigned char>((value >> (8 * i)) & 0xff);
+}
+
+void AppendUint(const uint64_t value, const unsigned nbytes, string *buf) {
+  unsigned char bytes[8];
+  PutUint(value, nbytes, bytes);
+  buf->append(reinterpret_cast<char *>(bytes), nbytes);
+}
+
+uint64_t GetUint(const unsigned char *buf, const unsigned nbytes) {
+  uint64_t result = 0;
+  for (unsigned i = 0; i < nbytes; ++i)
+    result |= static_cast<uint64_t>(buf[i]) << (8 * i);
+  return result;
+}
+
+struct PathKey {
+  bool operator <(const PathKey &other) const {
+    return memcmp(md5path.digest, other.md5path.digest, kKeySize) < 0;
+  }
+  shash::Md5 md5path;
+  uint32_t position;
+};
+
+struct ListingKey {
+  bool operator <(const ListingKey &other) const {
+    const int cmp = memcmp(parent.digest, other.parent.digest, kKeySize);
+    return (cmp < 0) || ((cmp == 0) && (rowid < other.rowid));
+  }
+  shash::Md5 parent;
+  uint64_t rowid;
+  uint32_t position;
+};
+
+}  // anonymous namespace
+
+
+bool CatalogIndex::Build(const CatalogDatabase &database, string *index) {
+  if (database.schema_version() < 2.1 - CatalogDatabase::kSchemaEpsilon)
+    return false;
+
+  // Rows in the order of the table scan, sorted below
+  string rows;
+  string heap;
+  vector<PathKey> path_keys;
+  vector<ListingKey> listing_keys;
+  SqlAllDirents sql_all(database);
+  while (sql_all.FetchRow()) {
+    const DirectoryEntry dirent = sql_all.GetRawDirent();
+    const shash::Md5 parent = sql_all.GetParentPathHash();
+    if ((dirent.name_.GetLength() > 0xffff) ||
+        (dirent.symlink_.GetLength() > 0xffff) ||
+        ((heap.size() + dirent.name_.GetLength() +
+          dirent.symlink_.GetLength()) > 0xffffffffU))
+    {
+      return false;
+    }
+
+    unsigned char row[kRowSize];
+    memset(row, 0, kRowSize);
+    memcpy(row + kOffParent, parent.digest, kKeySize);
+    PutUint(dirent.inode_, 8, row + kOffRowId);
+    PutUint(dirent.size_, 8, row + kOffSize);
+    PutUint(dirent.mtime_, 8, row + kOffMtime);
+    PutUint(dirent.uid_, 4, row + kOffUid);
+    PutUint(dirent.gid_, 4, row + kOffGid);
+    PutUint(dirent.mode_, 4, row + kOffMode);
+    PutUint(dirent.hardlink_group_, 4, row + kOffHardlinkGroup);
+    PutUint(dirent.linkcount_, 4, row + kOffLinkcount);
+    uint32_t flags = 0;
+    if (dirent.is_nested_catalog_root_) flags |= kRowNestedRoot;
+    if (dirent.is_nested_catalog_mountpoint_) flags |= kRowNestedMountpoint;
+    if (dirent.is_bind_mountpoint_) flags |= kRowBindMountpoint;
+    if (dirent.is_chunked_file_) flags |= kRowChunked;
+    if (dirent.is_hidden_) flags |= kRowHidden;
+    if (dirent.is_external_file_) flags |= kRowExternal;
+    if (dirent.is_inline_file_) flags |= kRowInline;
+    if (dirent.is_bundled_file_) flags |= kRowBundled;
+    if (dirent.has_xattrs_) flags |= kRowXattrs;
+    PutUint(flags, 4, row + kOffFlags);
+    PutUint(heap.size(), 4, row + kOffName);
+    PutUint(dirent.name_.GetLength(), 2, row + kOffNameLength);
+    heap.append(dirent.name_.GetChars(), dirent.name_.GetLength());
+    PutUint(heap.size(), 4, row + kOffSymlink);
+    PutUint(dirent.symlink_.GetLength(), 2, row + kOffSymlinkLength);
+    heap.append(dirent.symlink_.GetChars(), dirent.symlink_.GetLength());
+    row[kOffHashAlgorithm] = dirent.checksum_.algorithm;
+    row[kOffCompression] = dirent.compression_algorithm_;
+    memcpy(row + kOffDigest, dirent.checksum_.digest,
+           dirent.checksum_.GetDigestSize());
+    rows.append(reinterpret_cast<char *>(row), kRowSize);
+
+    PathKey path_key;
+    path_key.md5path = sql_all.GetPathHash();
+    path_key.position = path_keys.size();
+    path_keys.push_back(path_key);
+    ListingKey listing_key;
+    listing_key.parent = parent;
+    listing_key.rowid = dirent.inode_;
+    listing_key.position = listing_keys.size();
+    listing_keys.push_back(listing_key);
+  }
+  if (sql_all.GetLastError() != SQLITE_DONE) {
+    LogCvmfs(kLogCatalog, kLogDebug, "failed to scan catalog (%s)",
+             sql_all.GetLastErrorMsg().c_str());
+    return false;
+  }
+
+  sort(path_keys.begin(), path_keys.end());
+  sort(listing_keys.begin(), listing_keys.end());
+  const uint32_t num_rows = path_keys.size();
+  // Maps the scan order to the final order of the rows
+  vector<uint32_t> row_numbers(num_rows);
+  for (uint32_t i = 0; i < num_rows; ++i)
+    row_numbers[path_keys[i].position] = i;
+
+  index->clear();
+  index->reserve(kHeaderSize + num_rows * (kKeySize + kRowSize + 4) +
+                 heap.size());
+  index->append(kMagic, kMagicSize);
+  AppendUint(num_rows, 4, index);
+  AppendUint(heap.size(), 4, index);
+  for (uint32_t i = 0; i < num_rows; ++i) {
+    index->append(reinterpret_cast<const char *>(path_keys[i].md5path.digest),
+                  kKeySize);
+  }
+  for (uint32_t i = 0; i < num_rows; ++i)
+    index->append(rows, path_keys[i].position * kRowSize, kRowSize);
+  for (uint32_t i = 0; i < num_rows; ++i)
+    AppendUint(row_numbers[listing_keys[i].position], 4, index);
+  index->append(heap);
+  return true;
+}
+
+
+CatalogIndex *CatalogIndex::Create(unsigned char *buffer, const uint64_t size) {
+  CatalogIndex *index = new CatalogIndex(buffer, size);
+  if (!index->Validate()) {
+    delete index;
+    return NULL;
+  }
+  return index;
+}
+
+
+CatalogIndex::CatalogIndex(unsigned char *buffer, const uint64_t size)
+  : buffer_(buffer)
+  , size_(size)
+  , num_rows_(0)
+  , heap_size_(0)
+  , keys_(NULL)
+  , rows_(NULL)
+  , listing_(NULL)
+  , heap_(NULL)
+{
+  if (size_ < kHeaderSize)
+    return;
+  num_rows_ = GetUint(buffer_ + kMagicSize, 4);
+  heap_size_ = GetUint(buffer_ + kMagicSize + 4, 4);
+  keys_ = buffer_ + kHeaderSize;
+  rows_ = keys_ + uint64_t(num_rows_) * kKeySize;
+  listing_ = rows_ + uint64_t(num_rows_) * kRowSize;
+  heap_ = listing_ + uint64_t(num_rows_) * 4;
+}
+
+
+CatalogIndex::~CatalogIndex() {
+  free(buffer_);
+}
+
+
+/**
+ * Checks the bounds of all the references, so that lookups do not need to.
+ */
+bool CatalogIndex::Validate() const {
+  if ((size_ < kHeaderSize) || (memcmp(buffer_, kMagic, kMagicSize) != 0))
+    return false;
+  if (size_ != kHeaderSize +
+               uint64_t(num_rows_) * (kKeySize + kRowSize + 4) + heap_size_)
+  {
+    return false;
+  }
+  for (uint32_t i = 0; i < num_rows_; ++i) {
+    const unsigned char *row = GetRow(i);
+    const uint64_t name_end = GetUint(row + kOffName, 4) +
+                              GetUint(row + kOffNameLength, 2);
+    const uint64_t symlink_end = GetUint(row + kOffSymlink, 4) +
+                                 GetUint(row + kOffSymlinkLength, 2);
+    if ((name_end > heap_size_) || (symlink_end > heap_size_) ||
+        (row[kOffHashAlgorithm] >= shash::kAny) ||
+        (row[kOffCompression] > zlib::kLz4) ||
+        (GetListingRow(i) >= num_rows_))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+const unsigned char *CatalogIndex::GetKey(const uint32_t row) const {
+  return keys_ + uint64_t(row) * kKeySize;
+}
+
+
+const unsigned char *CatalogIndex::GetRow(const uint32_t row) const {
+  return rows_ + uint64_t(row) * kRowSize;
+}
+
+
+uint32_t CatalogIndex::GetListingRow(const uint32_t position) const {
+  return GetUint(listing_ + uint64_t(position) * 4, 4);
+}
+
+
+bool CatalogIndex::Find(const shash::Md5 &md5path, uint32_t *row) const {
+  uint32_t low = 0;
+  uint32_t high = num_rows_;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    const int cmp = memcmp(GetKey(mid), md5path.digest, kKeySize);
+    if (cmp == 0) {
+      *row = mid;
+      return true;
+    }
+    if (cmp < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return false;
+}
+
+
+void CatalogIndex::FindListing(
+  const shash::Md5 &parent_md5path,
+  uint32_t *begin,
+  uint32_t *end) const
+{
+  // Lower bound
+  uint32_t low = 0;
+  uint32_t high = num_rows_;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    if (memcmp(GetRow(GetListingRow(mid)) + kOffParent, parent_md5path.digest,
+               kKeySize) < 0)
+    {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  *begin = low;
+  // Upper bound
+  high = num_rows_;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    if (memcmp(GetRow(GetListingRow(mid)) + kOffParent, parent_md5path.digest,
+               kKeySize) <= 0)
+    {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  *end = low;
+}
+
+
+DirectoryEntry CatalogIndex::GetDirent(
+  const uint32_t row,
+  const Catalog *catalog,
+  const bool expand_symlink) const
+{
+  DirectoryEntry result;
+  DecodeDirent(row, catalog, expand_symlink, &result);
+  return result;
+}
+
+
+void CatalogIndex::DecodeDirent(
+  const uint32_t row,
+  const Catalog *catalog,
+  const bool expand_symlink,
+  DirectoryEntry *dirent) const
+{
+  *dirent = DirectoryEntry();
+  DirectoryEntry &result = *dirent;
+  const unsigned char *r = GetRow(row);
+
+  const uint32_t flags = GetUint(r + kOffFlags, 4);
+  result.is_nested_catalog_root_ = (flags & kRowNestedRoot);
+  result.is_nested_catalog_mountpoint_ = (flags & kRowNestedMountpoint);
+  result.is_bind_mountpoint_ = (flags & kRowBindMountpoint);
+  result.is_chunked_file_ = (flags & kRowChunked);
+  result.is_hidden_ = (flags & kRowHidden);
+  result.is_external_file_ = (flags & kRowExternal);
+  result.is_inline_file_ = (flags & kRowInline);
+  result.is_bundled_file_ = (flags & kRowBundled);
+  result.has_xattrs_ = (flags & kRowXattrs);
+
+  result.linkcount_ = GetUint(r + kOffLinkcount, 4);
+  result.hardlink_group_ = GetUint(r + kOffHardlinkGroup, 4);
+  result.inode_ = catalog->GetMangledInode(GetUint(r + kOffRowId, 8),
+                                           result.hardlink_group_);
+  result.checksum_ = shash::Any(
+    static_cast<shash::Algorithms>(r[kOffHashAlgorithm]), r + kOffDigest);
+  result.compression_algorithm_ =
+    static_cast<zlib::Algorithms>(r[kOffCompression]);
+  if (g_claim_ownership) {
+    result.uid_ = g_uid;
+    result.gid_ = g_gid;
+  } else {
+    result.uid_ = catalog->MapUid(GetUint(r + kOffUid, 4));
+    result.gid_ = catalog->MapGid(GetUint(r + kOffGid, 4));
+  }
+
+  result.mode_ = GetUint(r + kOffMode, 4);
+  result.size_ = GetUint(r + kOffSize, 8);
+  result.mtime_ = GetUint(r + kOffMtime, 8);
+  result.name_.Assign(
+    reinterpret_cast<const char *>(heap_ + GetUint(r + kOffName, 4)),
+    GetUint(r + kOffNameLength, 2));
+  result.symlink_.Assign(
+    reinterpret_cast<const char *>(heap_ + GetUint(r + kOffSymlink, 4)),
+    GetUint(r + kOffSymlinkLength, 2));
+  if (expand_symlink && !g_raw_symlinks)
+    SqlDirent::ExpandSymlink(&result.symlink_);
+}
+
+}  // namespace catalog
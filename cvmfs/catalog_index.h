@@ -0,0 +1,88 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_CATALOG_INDEX_H_
+#define CVMFS_CATALOG_INDEX_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "directory_entry.h"
+#include "hash.h"
+#include "util/single_copy.h"
+
+namespace catalog {
+
+class Catalog;
+class CatalogDatabase;
+
+/**
+ * Immutable, read-optimized encoding of the catalog table of a file catalog.
+ * It is produced by the publisher next to every catalog revision and stored
+ * as a regular content-addressed object; the catalog refers to it by the
+ * kPropertyKey property.  Clients use it to look up paths and to list
+ * directories without going through the SQLite statements.  Chunks, extended
+ * attributes, and everything else remain in the SQLite catalog.
+ *
+ * All the columns have a fixed width, multi-byte integers are little endian:
+ *   - Header: magic, number of rows, size of the name heap
+ *   - Path hashes of all the rows, sorted by memcmp() for binary search
+ *   - Row attributes, in the same order as the path hashes
+ *   - Row numbers sorted by parent path hash and rowid, for listings
+ *   - Name heap: the names and symlinks of all the rows
+ */
+class CatalogIndex : SingleCopy {
+ public:
+  static const char *kPropertyKey;
+
+  /**
+   * Encodes the catalog table.  Fails for catalogs older than schema 2.1.
+   */
+  static bool Build(const CatalogDatabase &database, std::string *index);
+  /**
+   * Takes ownership of the malloc'd buffer.  Returns NULL if the buffer is not
+   * a valid index.
+   */
+  static CatalogIndex *Create(unsigned char *buffer, const uint64_t size);
+  ~CatalogIndex();
+
+  bool Find(const shash::Md5 &md5path, uint32_t *row) const;
+  /**
+   * The children of a directory are listed by the positions [*begin, *end)
+   * of the listing column, see GetListingRow().
+   */
+  void FindListing(const shash::Md5 &parent_md5path,
+                   uint32_t *begin, uint32_t *end) const;
+  uint32_t GetListingRow(const uint32_t position) const;
+  /**
+   * Decodes a row the same way SqlLookup::GetDirent() decodes a database row.
+   */
+  DirectoryEntry GetDirent(const uint32_t row, const Catalog *catalog,
+                           const bool expand_symlink) const;
+  void DecodeDirent(const uint32_t row, const Catalog *catalog,
+                    const bool expand_symlink, DirectoryEntry *dirent) const;
+
+  uint32_t num_rows() const { return num_rows_; }
+  uint64_t size() const { return size_; }
+
+ private:
+  CatalogIndex(unsigned char *buffer, const uint64_t size);
+  bool Validate() const;
+  const unsigned char *GetKey(const uint32_t row) const;
+  const unsigned char *GetRow(const uint32_t row) const;
+
+  unsigned char *buffer_;
+  uint64_t size_;
+  uint32_t num_rows_;
+  uint32_t heap_size_;
+  const unsigned char *keys_;
+  const unsigned char *rows_;
+  const unsigned char *listing_;
+  const unsigned char *heap_;
+};
+
+}  // namespace catalog
+
+#endif  // CVMFS_CATALOG_INDEX_H_
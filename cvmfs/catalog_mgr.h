@@ -24,6 +24,7 @@
 #include "hash.h"
 #include "logging.h"
 #include "statistics.h"
+#include "util_concurrency.h"
 
 class XattrList;
 
@@ -69,8 +70,13 @@ struct Statistics {
   perf::Counter *n_lookup_path;
   perf::Counter *n_lookup_path_negative;
   perf::Counter *n_lookup_xattrs;
+  perf::Counter *n_lookup_inline_data;
+  perf::Counter *n_lookup_bundle;
+  perf::Counter *n_list_prefetch_group;
+  perf::Counter *n_lookup_digest_tree;
   perf::Counter *n_listing;
   perf::Counter *n_nested_listing;
+  perf::Counter *n_detach_idle;
 
   explicit Statistics(perf::Statistics *statistics) {
     n_lookup_inode = statistics->Register("catalog_mgr.n_lookup_inode",
@@ -82,10 +88,23 @@ struct Statistics {
         "Number of negative path lookups");
     n_lookup_xattrs = statistics->Register("catalog_mgr.n_lookup_xattrs",
         "Number of xattrs lookups");
+    n_lookup_inline_data = statistics->Register(
+        "catalog_mgr.n_lookup_inline_data",
+        "Number of lookups of file contents stored in the catalog");
+    n_lookup_bundle = statistics->Register("catalog_mgr.n_lookup_bundle",
+        "Number of lookups of bundle objects");
+    n_list_prefetch_group = statistics->Register(
+        "catalog_mgr.n_list_prefetch_group",
+        "Number of listings of prefetch groups");
+    n_lookup_digest_tree = statistics->Register(
+        "catalog_mgr.n_lookup_digest_tree",
+        "Number of lookups of block digests of large files");
     n_listing = statistics->Register("catalog_mgr.n_listing",
         "Number of listings");
     n_nested_listing = statistics->Register("catalog_mgr.n_nested_listing",
         "Number of listings of nested catalogs");
+    n_detach_idle = statistics->Register("catalog_mgr.n_detach_idle",
+        "Number of idle nested catalogs detached");
   }
 };
 
@@ -148,6 +167,7 @@ class AbstractCatalogManager : public SingleCopy {
   virtual bool Init();
   LoadError Remount(const bool dry_run);
   void DetachNested();
+  unsigned DetachIdle(const uint64_t max_idle_sec, const uint64_t mem_budget);
 
   bool LookupPath(const PathString &path, const LookupOptions options,
                   DirectoryEntry *entry);
@@ -159,6 +179,17 @@ class AbstractCatalogManager : public SingleCopy {
     return LookupPath(p, options, entry);
   }
   bool LookupXattrs(const PathString &path, XattrList *xattrs);
+  bool LookupInlineData(const PathString &path, std::string *data);
+  bool LookupBundle(const PathString &path,
+                    const shash::Algorithms interpret_hash_as,
+                    shash::Any *bundle_hash,
+                    uint64_t *offset);
+  bool LookupPrefetchGroup(const PathString &path, uint64_t *group_id);
+  bool ListPrefetchGroup(const PathString &path,
+                         const uint64_t group_id,
+                         const unsigned max_members,
+                         PrefetchGroup *members);
+  bool LookupDigestTree(const PathString &path, std::string *tree);
 
   bool Listing(const PathString &path, DirectoryEntryList *listing);
   bool Listing(const std::string &path, DirectoryEntryList *listing) {
@@ -167,6 +198,10 @@ class AbstractCatalogManager : public SingleCopy {
     return Listing(p, listing);
   }
   bool ListingStat(const PathString &path, StatEntryList *listing);
+  bool ListingPage(const PathString &path, const unsigned max_rows,
+                   uint64_t *cursor, DirectoryEntryList *listing,
+                   std::vector<uint64_t> *rowids);
+  ListingStream *OpenListingStream(const PathString &path);
 
   bool ListFileChunks(const PathString &path,
                       const shash::Algorithms interpret_hashes_as,
@@ -184,6 +219,7 @@ class AbstractCatalogManager : public SingleCopy {
   uint64_t GetTTL() const;
   bool GetVOMSAuthz(std::string *authz) const;
   int GetNumCatalogs() const;
+  uint64_t GetMemoryUsage() const;
   std::string PrintHierarchy() const;
   std::string PrintAllMemStatistics() const;
 
@@ -219,6 +255,13 @@ class AbstractCatalogManager : public SingleCopy {
                                 shash::Any   *catalog_hash) = 0;
   virtual void UnloadCatalog(const CatalogT *catalog) { }
   virtual void ActivateCatalog(CatalogT *catalog) { }
+  /**
+   * Called with the write lock held before the nested catalogs on the way
+   * from entry_point to path are mounted one by one.  Derived classes can
+   * start downloading the deeper levels in the meantime.
+   */
+  virtual void PrefetchSubtree(const PathString &path,
+                               const CatalogT *entry_point) { }
   const std::vector<CatalogT*>& GetCatalogs() const { return catalogs_; }
 
   /**
@@ -237,7 +280,7 @@ class AbstractCatalogManager : public SingleCopy {
   CatalogT *MountCatalog(const PathString &mountpoint, const shash::Any &hash,
                          CatalogT *parent_catalog);
   bool MountSubtree(const PathString &path, const CatalogT *entry_point,
-                    CatalogT **leaf_catalog);
+                    CatalogT **leaf_catalog, const bool can_prefetch = true);
 
   bool AttachCatalog(const std::string &db_path, CatalogT *new_catalog);
   void DetachCatalog(CatalogT *catalog);
@@ -248,20 +291,16 @@ class AbstractCatalogManager : public SingleCopy {
 
   CatalogT *FindCatalog(const PathString &path) const;
 
-  inline void ReadLock() const {
-    int retval = pthread_rwlock_rdlock(rwlock_);
-    assert(retval == 0);
-  }
-  inline void WriteLock() const {
-    int retval = pthread_rwlock_wrlock(rwlock_);
-    assert(retval == 0);
-  }
-  inline void Unlock() const {
-    int retval = pthread_rwlock_unlock(rwlock_);
-    assert(retval == 0);
-  }
+  inline void ReadLock() const { rwlock_->ReadLock(); }
+  inline void WriteLock() const { rwlock_->WriteLock(); }
+  inline void Unlock() const { rwlock_->Unlock(); }
   virtual void EnforceSqliteMemLimit();
 
+  /**
+   * If set, FindCatalog() counts the lookups served by every catalog
+   */
+  bool count_lookups_;
+
  private:
   void CheckInodeWatermark();
 
@@ -293,7 +332,12 @@ class AbstractCatalogManager : public SingleCopy {
   uint64_t incarnation_;
   // TODO(molina) we could just add an atomic global counter instead
   InodeAnnotation *inode_annotation_;  /**< applied to all catalogs */
-  pthread_rwlock_t *rwlock_;
+  /**
+   * Lookups take the lock in read mode, mounting and unmounting of catalogs
+   * take it in write mode.  Striped so that stat() storms from many threads
+   * do not bounce a single lock cache line between the cores.
+   */
+  StripedRwLock *rwlock_;
   Statistics statistics_;
   pthread_key_t pkey_sqlitemem_;
   OwnerMap uid_map_;
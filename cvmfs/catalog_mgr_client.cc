@@ -5,23 +5,64 @@
 #include "cvmfs_config.h"
 #include "catalog_mgr_client.h"
 
+#include <alloca.h>
+#include <errno.h>
+#include <poll.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <ctime>
 #include <string>
 #include <vector>
 
 #include "cache_posix.h"
+#include "catalog_delta.h"
+#include "catalog_heatmap.h"
+#include "catalog_index.h"
+#include "catalog_nested_index.h"
+#include "catalog_trace.h"
+#include "compression.h"
 #include "download.h"
 #include "fetch.h"
 #include "manifest.h"
+#include "platform.h"
 #include "quota.h"
 #include "signature.h"
+#include "sink.h"
+#include "smalloc.h"
 #include "statistics.h"
 #include "util/posix.h"
 #include "util/string.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
 namespace catalog {
 
+namespace {
+
+/**
+ * Collects a download in memory without a size limit
+ */
+class StringSink : public cvmfs::Sink {
+ public:
+  explicit StringSink(string *data) : data_(data) { }
+  virtual int64_t Write(const void *buf, uint64_t sz) {
+    data_->append(reinterpret_cast<const char *>(buf), sz);
+    return sz;
+  }
+  virtual int Reset() {
+    data_->clear();
+    return 0;
+  }
+
+ private:
+  string *data_;
+};
+
+}  // anonymous namespace
+
+
 /**
  * Triggered when the catalog is attached (db file opened)
  */
@@ -29,8 +70,23 @@ void ClientCatalogManager::ActivateCatalog(Catalog *catalog) {
   const Counters &counters = const_cast<const Catalog*>(catalog)->GetCounters();
   if (catalog->IsRoot()) {
     all_inodes_ = counters.GetAllEntries();
+    if (use_nested_index_)
+      LoadNestedCatalogIndex(catalog);
   }
   loaded_inodes_ += counters.GetSelfEntries();
+  if (use_path_filter_)
+    catalog->BuildPathFilter();
+  if (use_catalog_indexes_)
+    LoadCatalogIndex(catalog);
+  if (!trace_path_.empty())
+    TraceCatalog(catalog);
+  if (heatmap_ != NULL) {
+    const uint64_t attach_us = (attach_start_ns_ == 0) ? 0 :
+      (platform_monotonic_time_ns() - attach_start_ns_) / 1000;
+    heatmap_->RecordAttach(GetHeatmapPath(catalog), attach_us, attach_bytes_);
+    attach_start_ns_ = 0;
+    attach_bytes_ = 0;
+  }
 }
 
 
@@ -44,19 +100,78 @@ ClientCatalogManager::ClientCatalogManager(
   , fetcher_(fetcher)
   , signature_mgr_(signature_mgr)
   , offline_mode_(false)
+  , manifest_last_modified_(-1)
   , all_inodes_(0)
   , loaded_inodes_(0)
   , fixed_alt_root_catalog_(false)
+  , catalog_trace_(NULL)
+  , use_path_filter_(false)
+  , use_catalog_deltas_(false)
+  , use_catalog_indexes_(false)
+  , use_nested_index_(false)
+  , nested_index_(NULL)
+  , idle_max_sec_(0)
+  , idle_mem_budget_(0)
+  , heatmap_(NULL)
+  , heatmap_interval_sec_(0)
+  , attach_start_ns_(0)
+  , attach_bytes_(0)
 {
   LogCvmfs(kLogCatalog, kLogDebug, "constructing client catalog manager");
+  pipe_idle_detacher_[0] = pipe_idle_detacher_[1] = -1;
+  pipe_heatmap_dumper_[0] = pipe_heatmap_dumper_[1] = -1;
+  int retval = pthread_mutex_init(&lock_manifest_, NULL);
+  assert(retval == 0);
   n_certificate_hits_ = statistics->Register("cache.n_certificate_hits",
     "Number of certificate hits");
   n_certificate_misses_ = statistics->Register("cache.n_certificate_misses",
     "Number of certificate misses");
+  n_prefetch_ = statistics->Register("catalog_mgr.n_prefetch",
+    "Number of catalogs prefetched from learned groups");
+  n_manifest_not_modified_ = statistics->Register(
+    "catalog_mgr.n_manifest_not_modified",
+    "Number of revision checks answered by a not modified manifest");
+  n_preload_ = statistics->Register("catalog_mgr.n_preload",
+    "Number of catalogs of a new revision preloaded before the remount");
+  n_delta_hits_ = statistics->Register("catalog_mgr.n_delta_hits",
+    "Number of catalogs reconstructed from a delta");
+  n_delta_misses_ = statistics->Register("catalog_mgr.n_delta_misses",
+    "Number of catalogs downloaded in full because no usable delta was found");
+  n_index_ = statistics->Register("catalog_mgr.n_index",
+    "Number of catalogs accessed through their read-optimized index");
+  n_chain_prefetch_ = statistics->Register("catalog_mgr.n_chain_prefetch",
+    "Number of catalogs prefetched on the way to a path by the nested index");
 }
 
 
 ClientCatalogManager::~ClientCatalogManager() {
+  if (pipe_idle_detacher_[1] >= 0) {
+    char c = 'T';
+    WritePipe(pipe_idle_detacher_[1], &c, 1);
+    pthread_join(thread_idle_detacher_, NULL);
+    ClosePipe(pipe_idle_detacher_);
+  }
+  if (pipe_heatmap_dumper_[1] >= 0) {
+    char c = 'T';
+    WritePipe(pipe_heatmap_dumper_[1], &c, 1);
+    pthread_join(thread_heatmap_dumper_, NULL);
+    ClosePipe(pipe_heatmap_dumper_);
+  }
+  if (heatmap_ != NULL) {
+    CatalogHeatmap *snapshot = SnapshotHeatmap();
+    snapshot->Save(heatmap_path_);
+    delete snapshot;
+    delete heatmap_;
+  }
+  for (unsigned i = 0; i < prefetch_threads_.size(); ++i)
+    pthread_join(prefetch_threads_[i], NULL);
+  if (catalog_trace_ != NULL) {
+    catalog_trace_->Save(trace_path_);
+    delete catalog_trace_;
+  }
+  delete nested_index_;
+  pthread_mutex_destroy(&lock_manifest_);
+
   LogCvmfs(kLogCache, kLogDebug, "unpinning / unloading all catalogs");
 
   for (map<PathString, shash::Any>::iterator i = mounted_catalogs_.begin(),
@@ -86,6 +201,355 @@ shash::Any ClientCatalogManager::GetRootHash() {
 }
 
 
+LoadError ClientCatalogManager::RemountDryrun(shash::Any *root_hash) {
+  LogCvmfs(kLogCatalog, kLogDebug, "dry run remount, checking root hash");
+  return LoadCatalog(PathString("", 0), shash::Any(), NULL, root_hash);
+}
+
+
+/**
+ * Records the catalogs attached together in the trace file.  On the next mount
+ * of the same root catalog, the catalogs of a learned group are prefetched as
+ * soon as the first one of the group is attached.  Has to be called before
+ * Init().
+ */
+void ClientCatalogManager::EnableCatalogPrefetch(const string &trace_path) {
+  trace_path_ = trace_path;
+}
+
+
+/**
+ * Called with the write lock held.  A new root catalog invalidates the trace,
+ * the nested catalog hashes of the previous revision are of no use.
+ */
+void ClientCatalogManager::TraceCatalog(const Catalog *catalog) {
+  if (catalog->IsRoot() &&
+      ((catalog_trace_ == NULL) ||
+       (catalog_trace_->root_hash() != catalog->hash())))
+  {
+    delete catalog_trace_;
+    catalog_trace_ = CatalogTrace::Load(trace_path_, catalog->hash());
+    if (catalog_trace_ == NULL)
+      catalog_trace_ = new CatalogTrace(catalog->hash());
+  }
+  if (catalog_trace_ == NULL)
+    return;
+
+  PrefetchJob *job = new PrefetchJob();
+  job->catalog_mgr = this;
+  job->hashes = catalog_trace_->Record(catalog->hash(), time(NULL));
+  job->n_fetched = n_prefetch_;
+  job->speculative = true;
+  if (job->hashes.empty()) {
+    delete job;
+    return;
+  }
+  LogCvmfs(kLogCatalog, kLogDebug, "prefetching %lu catalogs after %s",
+           job->hashes.size(), catalog->mountpoint().c_str());
+  StartPrefetch(job);
+}
+
+
+/**
+ * Called with the write lock held.  The nested catalog index of the root
+ * catalog tells the entire chain of catalogs down to path.  The first one is
+ * mounted right away by the caller, the deeper ones are downloaded in the
+ * background meanwhile.  The fetcher merges concurrent downloads of the same
+ * catalog, so the mount of the deeper levels waits for the prefetch at worst.
+ */
+void ClientCatalogManager::PrefetchSubtree(
+  const PathString &path,
+  const Catalog *entry_point)
+{
+  if (nested_index_ == NULL)
+    return;
+  Catalog::NestedCatalogList chain;
+  nested_index_->FindChain(entry_point->mountpoint(), path, &chain);
+  if (chain.size() < 2)
+    return;
+
+  PrefetchJob *job = new PrefetchJob();
+  job->catalog_mgr = this;
+  job->n_fetched = n_chain_prefetch_;
+  job->speculative = false;
+  for (unsigned i = 1; i < chain.size(); ++i)
+    job->hashes.push_back(chain[i].hash);
+  LogCvmfs(kLogCatalog, kLogDebug, "prefetching %lu catalogs on the way to %s",
+           job->hashes.size(), path.c_str());
+  StartPrefetch(job);
+}
+
+
+void ClientCatalogManager::StartPrefetch(PrefetchJob *job) {
+  pthread_t thread_prefetch;
+  int retval = pthread_create(&thread_prefetch, NULL, MainPrefetch, job);
+  if (retval != 0) {
+    delete job;
+    return;
+  }
+  prefetch_threads_.push_back(thread_prefetch);
+}
+
+
+/**
+ * The catalogs are stored as regular objects.  They are pinned only when they
+ * are actually attached.
+ */
+void *ClientCatalogManager::MainPrefetch(void *data) {
+  PrefetchJob *job = reinterpret_cast<PrefetchJob *>(data);
+  ClientCatalogManager *catalog_mgr = job->catalog_mgr;
+
+  vector<cvmfs::Fetcher::FetchRequest> requests;
+  for (unsigned i = 0; i < job->hashes.size(); ++i) {
+    requests.push_back(cvmfs::Fetcher::FetchRequest(
+      job->hashes[i], CacheManager::kSizeUnknown,
+      "prefetched file catalog at " + catalog_mgr->repo_name_ + " (" +
+        job->hashes[i].ToString() + ")",
+      zlib::kZlibDefault, CacheManager::kTypeRegular));
+    requests.back().priority = job->speculative ? download::kPriorityPrefetch
+                                                : download::kPriorityMetadata;
+  }
+  catalog_mgr->fetcher_->FetchMany(&requests);
+
+  unsigned num_fetched = 0;
+  for (unsigned i = 0; i < requests.size(); ++i) {
+    if (requests[i].fd >= 0) {
+      catalog_mgr->fetcher_->cache_mgr()->Close(requests[i].fd);
+      num_fetched++;
+    }
+  }
+  perf::Xadd(job->n_fetched, num_fetched);
+  LogCvmfs(kLogCatalog, kLogDebug, "prefetched %u out of %lu catalogs",
+           num_fetched, requests.size());
+  delete job;
+  return NULL;
+}
+
+
+void ClientCatalogManager::SpawnIdleDetacher(
+  const unsigned max_idle_sec,
+  const uint64_t mem_budget)
+{
+  assert(pipe_idle_detacher_[0] < 0);
+  idle_max_sec_ = max_idle_sec;
+  idle_mem_budget_ = mem_budget;
+  MakePipe(pipe_idle_detacher_);
+  int retval = pthread_create(&thread_idle_detacher_, NULL, MainIdleDetacher,
+                              this);
+  assert(retval == 0);
+}
+
+
+/**
+ * Every detached catalog is unpinned in the cache and reattached by the next
+ * lookup underneath its mountpoint.  Inodes handed out to the kernel stay
+ * valid because the fuse module resolves them through the inode tracker.
+ */
+void *ClientCatalogManager::MainIdleDetacher(void *data) {
+  ClientCatalogManager *catalog_mgr =
+    reinterpret_cast<ClientCatalogManager *>(data);
+  LogCvmfs(kLogCatalog, kLogDebug, "starting idle catalog detacher");
+
+  unsigned interval_sec = catalog_mgr->idle_max_sec_ / 2;
+  if (interval_sec > kIdleCheckIntervalSec)
+    interval_sec = kIdleCheckIntervalSec;
+  if (interval_sec == 0)
+    interval_sec = 1;
+  struct pollfd watch_term;
+  watch_term.fd = catalog_mgr->pipe_idle_detacher_[0];
+  watch_term.events = POLLIN | POLLPRI;
+  while (true) {
+    watch_term.revents = 0;
+    int retval = poll(&watch_term, 1, interval_sec * 1000);
+    if (retval < 0) {
+      if (errno == EINTR)
+        continue;
+      abort();
+    }
+    if (retval > 0)
+      break;
+
+    const unsigned num_detached = catalog_mgr->DetachIdle(
+      catalog_mgr->idle_max_sec_, catalog_mgr->idle_mem_budget_);
+    if (num_detached > 0) {
+      LogCvmfs(kLogCatalog, kLogDebug, "detached %u idle nested catalogs",
+               num_detached);
+    }
+  }
+
+  LogCvmfs(kLogCatalog, kLogDebug, "stopping idle catalog detacher");
+  return NULL;
+}
+
+
+void ClientCatalogManager::EnableCatalogHeatmap(
+  const string &dump_path,
+  const unsigned interval_sec)
+{
+  assert(heatmap_ == NULL);
+  heatmap_ = new CatalogHeatmap(repo_name_);
+  heatmap_path_ = dump_path;
+  heatmap_interval_sec_ = (interval_sec == 0) ? 1 : interval_sec;
+  count_lookups_ = true;
+}
+
+
+void ClientCatalogManager::SpawnHeatmapDumper() {
+  if (heatmap_ == NULL)
+    return;
+  assert(pipe_heatmap_dumper_[0] < 0);
+  MakePipe(pipe_heatmap_dumper_);
+  int retval = pthread_create(&thread_heatmap_dumper_, NULL, MainHeatmapDumper,
+                              this);
+  assert(retval == 0);
+}
+
+
+CatalogHeatmap *ClientCatalogManager::SnapshotHeatmap() {
+  if (heatmap_ == NULL)
+    return NULL;
+  CatalogHeatmap *snapshot = new CatalogHeatmap(repo_name_);
+  ReadLock();
+  snapshot->Merge(*heatmap_);
+  const CatalogList &catalogs = GetCatalogs();
+  for (unsigned i = 0; i < catalogs.size(); ++i) {
+    snapshot->RecordLookups(GetHeatmapPath(catalogs[i]),
+                            catalogs[i]->num_lookups());
+  }
+  Unlock();
+  return snapshot;
+}
+
+
+string ClientCatalogManager::GetHeatmapPath(const Catalog *catalog) {
+  if (catalog->mountpoint().IsEmpty())
+    return "/";
+  return catalog->mountpoint().ToString();
+}
+
+
+void *ClientCatalogManager::MainHeatmapDumper(void *data) {
+  ClientCatalogManager *catalog_mgr =
+    reinterpret_cast<ClientCatalogManager *>(data);
+  LogCvmfs(kLogCatalog, kLogDebug, "starting catalog heatmap dumper");
+
+  struct pollfd watch_term;
+  watch_term.fd = catalog_mgr->pipe_heatmap_dumper_[0];
+  watch_term.events = POLLIN | POLLPRI;
+  while (true) {
+    watch_term.revents = 0;
+    int retval = poll(&watch_term, 1,
+                      catalog_mgr->heatmap_interval_sec_ * 1000);
+    if (retval < 0) {
+      if (errno == EINTR)
+        continue;
+      abort();
+    }
+    if (retval > 0)
+      break;
+
+    CatalogHeatmap *snapshot = catalog_mgr->SnapshotHeatmap();
+    snapshot->Save(catalog_mgr->heatmap_path_);
+    delete snapshot;
+  }
+
+  LogCvmfs(kLogCatalog, kLogDebug, "stopping catalog heatmap dumper");
+  return NULL;
+}
+
+
+/**
+ * True if mountpoint is one of the mounted catalogs or a parent directory of
+ * one of them.
+ */
+static bool IsOnMountedPath(
+  const PathString &mountpoint,
+  const map<PathString, shash::Any> &mounted_catalogs)
+{
+  const unsigned length = mountpoint.GetLength();
+  for (map<PathString, shash::Any>::const_iterator i = mounted_catalogs.begin(),
+       iend = mounted_catalogs.end(); i != iend; ++i)
+  {
+    if (!i->first.StartsWith(mountpoint))
+      continue;
+    if ((i->first.GetLength() == length) ||
+        (i->first.GetChars()[length] == '/'))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/**
+ * Downloads the catalogs of the revision given by root_hash that will be used
+ * right after the remount, so that the remount and the first accesses
+ * afterwards find them in the cache.  These are the catalogs that differ from
+ * the currently mounted ones at the same mount points plus the catalogs on the
+ * way to them.  Catalogs that did not change keep their hash and can be
+ * skipped including their entire subtree.  Like the prefetched catalogs of a
+ * learned group, the catalogs are stored as regular objects and pinned only
+ * when they are actually attached.  Returns the number of downloaded catalogs.
+ */
+unsigned ClientCatalogManager::PreloadCatalogs(const shash::Any &root_hash) {
+  ReadLock();
+  map<PathString, shash::Any> mounted_catalogs = mounted_catalogs_;
+  Unlock();
+
+  unsigned num_loaded = 0;
+  vector<Catalog::NestedCatalog> stack;
+  Catalog::NestedCatalog root;
+  root.mountpoint = PathString("", 0);
+  root.hash = root_hash;
+  root.size = 0;
+  stack.push_back(root);
+  while (!stack.empty()) {
+    Catalog::NestedCatalog next = stack.back();
+    stack.pop_back();
+    map<PathString, shash::Any>::const_iterator iter_mounted =
+      mounted_catalogs.find(next.mountpoint);
+    if ((iter_mounted != mounted_catalogs.end()) &&
+        (iter_mounted->second == next.hash))
+    {
+      continue;
+    }
+
+    int fd = fetcher_->Fetch(next.hash, CacheManager::kSizeUnknown,
+      "preloaded file catalog at " + repo_name_ + ":" +
+        (next.mountpoint.IsEmpty() ? "/" : next.mountpoint.ToString()) +
+        " (" + next.hash.ToString() + ")",
+      zlib::kZlibDefault, CacheManager::kTypeRegular, "");
+    if (fd < 0) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to preload catalog %s (%d)",
+               next.hash.ToString().c_str(), fd);
+      continue;
+    }
+    num_loaded++;
+
+    // The cvmfs sqlite vfs closes the file descriptor
+    Catalog catalog(next.mountpoint, next.hash, NULL);
+    if (!catalog.OpenDatabase("@" + StringifyInt(fd))) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to open preloaded catalog %s",
+               next.hash.ToString().c_str());
+      continue;
+    }
+    const Catalog::NestedCatalogList &nested = catalog.ListNestedCatalogs();
+    for (unsigned i = 0; i < nested.size(); ++i) {
+      // Follow only the nested catalogs that are or lead to mounted ones
+      if (!IsOnMountedPath(nested[i].mountpoint, mounted_catalogs))
+        continue;
+      stack.push_back(nested[i]);
+    }
+  }
+
+  perf::Xadd(n_preload_, num_loaded);
+  LogCvmfs(kLogCatalog, kLogDebug, "preloaded %u catalogs of revision %s",
+           num_loaded, root_hash.ToString().c_str());
+  return num_loaded;
+}
+
+
 /**
  * Specialized initialization that uses a fixed root hash.
  */
@@ -114,6 +578,10 @@ LoadError ClientCatalogManager::LoadCatalog(
   std::string *catalog_path,
   shash::Any *catalog_hash)
 {
+  if ((heatmap_ != NULL) && (catalog_path != NULL)) {
+    attach_start_ns_ = platform_monotonic_time_ns();
+    attach_bytes_ = 0;
+  }
   string cvmfs_path = "file catalog at " + repo_name_ + ":" +
     (mountpoint.IsEmpty() ?
       "/" : string(mountpoint.GetChars(), mountpoint.GetLength()));
@@ -131,6 +599,12 @@ LoadError ClientCatalogManager::LoadCatalog(
     string alt_catalog_path = "";
     if (mountpoint.IsEmpty() && fixed_alt_root_catalog_)
       alt_catalog_path = hash.MakeAlternativePath();
+    if (use_catalog_deltas_ && alt_catalog_path.empty()) {
+      map<PathString, shash::Any>::const_iterator iter_previous =
+        previous_catalogs_.find(mountpoint);
+      if (iter_previous != previous_catalogs_.end())
+        FetchCatalogDelta(iter_previous->second, hash, cvmfs_path);
+    }
     LoadError load_error =
       LoadCatalogCas(hash, cvmfs_path, alt_catalog_path, catalog_path);
     if (load_error == catalog::kLoadNew)
@@ -165,10 +639,46 @@ LoadError ClientCatalogManager::LoadCatalog(
   // Load and verify remote checksum
   manifest::Failures manifest_failure;
   CachedManifestEnsemble ensemble(fetcher_->cache_mgr(), this);
+  // A mere check for a new revision does not need the manifest again if the
+  // server (or the proxy) confirms that it did not change
+  const string host = GetCurrentHost();
+  shash::Any manifest_catalog_hash;
+  {
+    MutexLockGuard guard(&lock_manifest_);
+    if (!catalog_path && (manifest_last_modified_ > 0) &&
+        (host == manifest_host_))
+    {
+      ensemble.if_modified_since = manifest_last_modified_;
+      manifest_catalog_hash = manifest_catalog_hash_;
+    }
+  }
   manifest_failure = manifest::Fetch("", repo_name_, cache_last_modified,
                                      &cache_hash, signature_mgr_,
                                      fetcher_->download_mgr(),
                                      &ensemble);
+  if ((manifest_failure == manifest::kFailNotModified) &&
+      (GetCurrentHost() != host))
+  {
+    // The time stamp refers to the manifest of another stratum 1
+    ensemble.if_modified_since = 0;
+    manifest_failure = manifest::Fetch("", repo_name_, cache_last_modified,
+                                       &cache_hash, signature_mgr_,
+                                       fetcher_->download_mgr(),
+                                       &ensemble);
+  }
+  if (manifest_failure == manifest::kFailNotModified) {
+    LogCvmfs(kLogCache, kLogDebug, "manifest not modified, remote checksum "
+             "is %s", manifest_catalog_hash.ToString().c_str());
+    perf::Inc(n_manifest_not_modified_);
+    offline_mode_ = false;
+    if (manifest_catalog_hash == cache_hash) {
+      loaded_catalogs_[mountpoint] = cache_hash;
+      *catalog_hash = cache_hash;
+      return catalog::kLoadUp2Date;
+    }
+    *catalog_hash = manifest_catalog_hash;
+    return catalog::kLoadNew;
+  }
   if (manifest_failure != manifest::kFailOk) {
     LogCvmfs(kLogCache, kLogDebug, "failed to fetch manifest (%d - %s)",
              manifest_failure, manifest::Code2Ascii(manifest_failure));
@@ -186,6 +696,14 @@ LoadError ClientCatalogManager::LoadCatalog(
   }
 
   offline_mode_ = false;
+  {
+    // The modification time is meaningless if the fetch failed over
+    MutexLockGuard guard(&lock_manifest_);
+    manifest_last_modified_ =
+      (GetCurrentHost() == host) ? ensemble.last_modified : -1;
+    manifest_catalog_hash_ = ensemble.manifest->catalog_hash();
+    manifest_host_ = host;
+  }
   cvmfs_path += " (" + ensemble.manifest->catalog_hash().ToString() + ")";
   LogCvmfs(kLogCache, kLogDebug, "remote checksum is %s",
            ensemble.manifest->catalog_hash().ToString().c_str());
@@ -208,8 +726,18 @@ LoadError ClientCatalogManager::LoadCatalog(
       return catalog::kLoadUp2Date;
     }
   }
-  if (!catalog_path)
+  if (!catalog_path) {
+    *catalog_hash = ensemble.manifest->catalog_hash();
     return catalog::kLoadNew;
+  }
+
+  // The cached root catalog is typically the previous revision
+  if (use_catalog_deltas_ && !cache_hash.IsNull() &&
+      !ensemble.manifest->has_alt_catalog_path())
+  {
+    FetchCatalogDelta(cache_hash, ensemble.manifest->catalog_hash(),
+                      cvmfs_path);
+  }
 
   // Load new catalog
   catalog::LoadError load_retval =
@@ -232,6 +760,16 @@ LoadError ClientCatalogManager::LoadCatalog(
 }
 
 
+string ClientCatalogManager::GetCurrentHost() {
+  vector<string> host_chain;
+  unsigned current_host = 0;
+  fetcher_->download_mgr()->GetHostInfo(&host_chain, NULL, &current_host);
+  if (current_host >= host_chain.size())
+    return "";
+  return host_chain[current_host];
+}
+
+
 LoadError ClientCatalogManager::LoadCatalogCas(
   const shash::Any &hash,
   const string &name,
@@ -239,9 +777,23 @@ LoadError ClientCatalogManager::LoadCatalogCas(
   string *catalog_path)
 {
   assert(hash.suffix == shash::kSuffixCatalog);
+  // For the heat map, the catalog counts as downloaded if it was not cached
+  bool is_cached = false;
+  if (heatmap_ != NULL) {
+    int fd_cached = fetcher_->cache_mgr()->Open(CacheManager::Bless(hash));
+    if (fd_cached >= 0) {
+      fetcher_->cache_mgr()->Close(fd_cached);
+      is_cached = true;
+    }
+  }
   int fd = fetcher_->Fetch(hash, CacheManager::kSizeUnknown, name,
     zlib::kZlibDefault, CacheManager::kTypeCatalog, alt_catalog_path);
   if (fd >= 0) {
+    if ((heatmap_ != NULL) && !is_cached) {
+      const int64_t size = fetcher_->cache_mgr()->GetSize(fd);
+      if (size > 0)
+        attach_bytes_ += size;
+    }
     *catalog_path = "@" + StringifyInt(fd);
     return kLoadNew;
   }
@@ -253,6 +805,171 @@ LoadError ClientCatalogManager::LoadCatalogCas(
 }
 
 
+/**
+ * Loads the read-optimized encoding of the catalog into memory if the catalog
+ * has one.  The index is verified by its content hash and falls back to the
+ * database on any failure.
+ */
+void ClientCatalogManager::LoadCatalogIndex(Catalog *catalog) {
+  const shash::Any index_hash = catalog->GetIndexHash();
+  if (index_hash.IsNull())
+    return;
+
+  const string name = "index of " + catalog->mountpoint().ToString();
+  CacheManager *cache_mgr = fetcher_->cache_mgr();
+  const int fd = fetcher_->Fetch(index_hash, CacheManager::kSizeUnknown, name,
+                                 zlib::kZlibDefault,
+                                 CacheManager::kTypeRegular);
+  if (fd < 0) {
+    LogCvmfs(kLogCatalog, kLogDebug, "failed to load %s (%d)",
+             name.c_str(), fd);
+    return;
+  }
+  const int64_t size = cache_mgr->GetSize(fd);
+  unsigned char *buffer = NULL;
+  if (size > 0) {
+    buffer = reinterpret_cast<unsigned char *>(smalloc(size));
+    if (cache_mgr->Pread(fd, buffer, size, 0) != size) {
+      free(buffer);
+      buffer = NULL;
+    }
+  }
+  cache_mgr->Close(fd);
+  CatalogIndex *index =
+    (buffer != NULL) ? CatalogIndex::Create(buffer, size) : NULL;
+  if (index == NULL) {
+    LogCvmfs(kLogCatalog, kLogDebug | kLogSyslogWarn, "invalid %s",
+             name.c_str());
+    return;
+  }
+  catalog->AttachIndex(index);
+  perf::Inc(n_index_);
+  LogCvmfs(kLogCatalog, kLogDebug, "attached %s (%u rows)",
+           name.c_str(), index->num_rows());
+}
+
+
+/**
+ * Replaces the nested catalog index by the one of the new root catalog.  The
+ * index only serves as a hint for prefetching; without a valid index, nested
+ * catalogs are loaded one level at a time.
+ */
+void ClientCatalogManager::LoadNestedCatalogIndex(const Catalog *root_catalog) {
+  delete nested_index_;
+  nested_index_ = NULL;
+  const shash::Any index_hash = root_catalog->GetNestedIndexHash();
+  if (index_hash.IsNull())
+    return;
+
+  const string name = "nested catalog index of " + repo_name_;
+  CacheManager *cache_mgr = fetcher_->cache_mgr();
+  const int fd = fetcher_->Fetch(index_hash, CacheManager::kSizeUnknown, name,
+                                 zlib::kZlibDefault,
+                                 CacheManager::kTypeRegular);
+  if (fd < 0) {
+    LogCvmfs(kLogCatalog, kLogDebug, "failed to load %s (%d)",
+             name.c_str(), fd);
+    return;
+  }
+  const int64_t size = cache_mgr->GetSize(fd);
+  unsigned char *buffer = NULL;
+  if (size > 0) {
+    buffer = reinterpret_cast<unsigned char *>(smalloc(size));
+    if (cache_mgr->Pread(fd, buffer, size, 0) != size) {
+      free(buffer);
+      buffer = NULL;
+    }
+  }
+  cache_mgr->Close(fd);
+  if (buffer != NULL)
+    nested_index_ = NestedCatalogIndex::Create(buffer, size);
+  if (nested_index_ == NULL) {
+    LogCvmfs(kLogCatalog, kLogDebug | kLogSyslogWarn, "invalid %s",
+             name.c_str());
+    return;
+  }
+  LogCvmfs(kLogCatalog, kLogDebug, "loaded %s (%u catalogs)",
+           name.c_str(), nested_index_->num_catalogs());
+}
+
+
+/**
+ * Reconstructs the catalog hash from the cached catalog base_hash and the delta
+ * between the two and commits it to the cache.  Only the reconstructed catalog
+ * that matches the hash is used, so that the delta does not need to be
+ * trusted.  Returns false if the catalog needs to be downloaded in full.
+ */
+bool ClientCatalogManager::FetchCatalogDelta(
+  const shash::Any &base_hash,
+  const shash::Any &hash,
+  const string &name)
+{
+  if (base_hash == hash)
+    return false;
+  CacheManager *cache_mgr = fetcher_->cache_mgr();
+  int fd = cache_mgr->Open(CacheManager::Bless(hash));
+  if (fd >= 0) {
+    cache_mgr->Close(fd);
+    return false;
+  }
+  unsigned char *base_buf;
+  uint64_t base_size;
+  if (!cache_mgr->Open2Mem(base_hash, name, &base_buf, &base_size))
+    return false;
+  const string base(reinterpret_cast<char *>(base_buf), base_size);
+  free(base_buf);
+
+  const string url = "/" + CatalogDelta::MakeDeltaPath(base_hash, hash);
+  string delta;
+  StringSink sink(&delta);
+  download::JobInfo download_delta(&url, true, true, &sink, NULL);
+  download::Failures dl_retval =
+    fetcher_->download_mgr()->Fetch(&download_delta);
+  if (dl_retval != download::kFailOk) {
+    LogCvmfs(kLogCatalog, kLogDebug, "no delta for %s (%d - %s)",
+             name.c_str(), dl_retval, download::Code2Ascii(dl_retval));
+    perf::Inc(n_delta_misses_);
+    return false;
+  }
+
+  string target;
+  shash::Any target_hash(hash.algorithm, shash::kSuffixCatalog);
+  if (!CatalogDelta::Apply(base, delta, &target) ||
+      !zlib::CompressMem2Null(target.data(), target.size(), &target_hash))
+  {
+    LogCvmfs(kLogCatalog, kLogDebug, "failed to apply delta for %s",
+             name.c_str());
+    perf::Inc(n_delta_misses_);
+    return false;
+  }
+  if (target_hash != hash) {
+    LogCvmfs(kLogCatalog, kLogDebug | kLogSyslogWarn,
+             "catalog reconstructed from delta does not match %s",
+             name.c_str());
+    perf::Inc(n_delta_misses_);
+    return false;
+  }
+
+  void *txn = alloca(cache_mgr->SizeOfTxn());
+  if (cache_mgr->StartTxn(hash, target.size(), txn) < 0)
+    return false;
+  cache_mgr->CtrlTxn(CacheManager::ObjectInfo(CacheManager::kTypeCatalog,
+                                              name),
+                     0, txn);
+  const int64_t written = cache_mgr->Write(target.data(), target.size(), txn);
+  if ((written < 0) || (static_cast<uint64_t>(written) != target.size())) {
+    cache_mgr->AbortTxn(txn);
+    return false;
+  }
+  if (cache_mgr->CommitTxn(txn) != 0)
+    return false;
+  LogCvmfs(kLogCatalog, kLogDebug, "reconstructed %s from a delta of %lu "
+           "bytes", name.c_str(), delta.size());
+  perf::Inc(n_delta_hits_);
+  return true;
+}
+
+
 void ClientCatalogManager::UnloadCatalog(const Catalog *catalog) {
   LogCvmfs(kLogCache, kLogDebug, "unloading catalog %s",
            catalog->mountpoint().c_str());
@@ -261,9 +978,12 @@ void ClientCatalogManager::UnloadCatalog(const Catalog *catalog) {
     mounted_catalogs_.find(catalog->mountpoint());
   assert(iter != mounted_catalogs_.end());
   fetcher_->cache_mgr()->quota_mgr()->Unpin(iter->second);
+  previous_catalogs_[iter->first] = iter->second;
   mounted_catalogs_.erase(iter);
   const catalog::Counters &counters = catalog->GetCounters();
   loaded_inodes_ -= counters.GetSelfEntries();
+  if (heatmap_ != NULL)
+    heatmap_->RecordLookups(GetHeatmapPath(catalog), catalog->num_lookups());
 }
 
 
@@ -8,9 +8,11 @@
 #include "catalog_mgr.h"
 
 #include <inttypes.h>
+#include <pthread.h>
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "backoff.h"
 #include "hash.h"
@@ -31,6 +33,10 @@ class SignatureManager;
 
 namespace catalog {
 
+class CatalogHeatmap;
+class CatalogTrace;
+class NestedCatalogIndex;
+
 /**
  * A catalog manager that uses a Fetcher to get file catalgs in the form of
  * (virtual) file descriptors from a cache manager.  Sqlite has a path based
@@ -57,8 +63,51 @@ class ClientCatalogManager : public AbstractCatalogManager<Catalog> {
   virtual ~ClientCatalogManager();
 
   bool InitFixed(const shash::Any &root_hash, bool alternative_path);
+  void EnableCatalogPrefetch(const std::string &trace_path);
+  void EnablePathFilter() { use_path_filter_ = true; }
+  /**
+   * Reconstructs new catalog revisions from the previous ones in the cache
+   * and a delta if the server provides one, see CatalogDelta.
+   */
+  void EnableCatalogDeltas() { use_catalog_deltas_ = true; }
+  /**
+   * Uses the read-optimized encoding of catalogs for lookups and listings if
+   * the server provides one, see CatalogIndex.
+   */
+  void EnableCatalogIndexes() { use_catalog_indexes_ = true; }
+  /**
+   * Downloads the nested catalogs on the way to a path concurrently if the root
+   * catalog links the index of all the nested catalogs, see NestedCatalogIndex.
+   */
+  void EnableNestedCatalogIndex() { use_nested_index_ = true; }
+  /**
+   * Starts a thread that detaches nested catalogs that were not accessed for
+   * max_idle_sec when the attached catalogs use more than mem_budget bytes.
+   */
+  void SpawnIdleDetacher(const unsigned max_idle_sec,
+                         const uint64_t mem_budget);
+  /**
+   * Counts attaches, attach latency, lookups, and downloaded bytes per
+   * catalog.  The heat map is written to dump_path every interval_sec by a
+   * thread started with SpawnHeatmapDumper() and on unmount.  Has to be called
+   * before Init().
+   */
+  void EnableCatalogHeatmap(const std::string &dump_path,
+                            const unsigned interval_sec);
+  void SpawnHeatmapDumper();
+  /**
+   * A copy of the heat map including the lookups of the currently attached
+   * catalogs, NULL if the heat map is disabled.  Owned by the caller.
+   */
+  CatalogHeatmap *SnapshotHeatmap();
 
   shash::Any GetRootHash();
+  /**
+   * Like Remount(true) but additionally returns the hash of the new root
+   * catalog if a new revision is available.
+   */
+  LoadError RemountDryrun(shash::Any *root_hash);
+  unsigned PreloadCatalogs(const shash::Any &root_hash);
 
   bool IsRevisionBlacklisted();
 
@@ -77,29 +126,119 @@ class ClientCatalogManager : public AbstractCatalogManager<Catalog> {
                                   const shash::Any  &catalog_hash,
                                   catalog::Catalog *parent_catalog);
   void ActivateCatalog(catalog::Catalog *catalog);
+  void PrefetchSubtree(const PathString &path, const Catalog *entry_point);
 
  private:
   LoadError LoadCatalogCas(const shash::Any &hash,
                            const std::string &name,
                            const std::string &alt_catalog_path,
                            std::string *catalog_path);
+  void LoadCatalogIndex(Catalog *catalog);
+  void LoadNestedCatalogIndex(const Catalog *root_catalog);
+  bool FetchCatalogDelta(const shash::Any &base_hash,
+                         const shash::Any &hash,
+                         const std::string &name);
+
+  /**
+   * The catalogs of a learned group, downloaded by a background thread.
+   */
+  struct PrefetchJob {
+    ClientCatalogManager *catalog_mgr;
+    std::vector<shash::Any> hashes;
+    perf::Counter *n_fetched;
+    /**
+     * Prefetched catalogs that are not known to be needed yet yield to the
+     * other downloads
+     */
+    bool speculative;
+  };
+  void StartPrefetch(PrefetchJob *job);
+  static void *MainPrefetch(void *data);
+  void TraceCatalog(const Catalog *catalog);
+
+  /**
+   * Upper bound for the time between two checks of the idle detacher
+   */
+  static const unsigned kIdleCheckIntervalSec = 60;
+  static void *MainIdleDetacher(void *data);
+  static void *MainHeatmapDumper(void *data);
+  static std::string GetHeatmapPath(const Catalog *catalog);
+  std::string GetCurrentHost();
 
   /**
    * Required for unpinning
    */
   std::map<PathString, shash::Any> loaded_catalogs_;
   std::map<PathString, shash::Any> mounted_catalogs_;
+  /**
+   * The last unloaded revision of every mountpoint, the base for deltas
+   */
+  std::map<PathString, shash::Any> previous_catalogs_;
 
   std::string repo_name_;
   cvmfs::Fetcher *fetcher_;
   signature::SignatureManager *signature_mgr_;
   bool offline_mode_;  /**< cached copy used because there is no network */
+  /**
+   * The server's modification time of the last fetched manifest and the root
+   * catalog announced by it.  Revision checks send conditional requests as
+   * long as the same stratum 1 is used.
+   */
+  time_t manifest_last_modified_;
+  shash::Any manifest_catalog_hash_;
+  std::string manifest_host_;
+  pthread_mutex_t lock_manifest_;  /**< revision checks run concurrently */
+  perf::Counter *n_manifest_not_modified_;
   uint64_t all_inodes_;
   uint64_t loaded_inodes_;
   bool fixed_alt_root_catalog_;  /**< fixed root hash but alternative url */
   BackoffThrottle backoff_throttle_;
   perf::Counter *n_certificate_hits_;
   perf::Counter *n_certificate_misses_;
+  /**
+   * Empty unless catalog prefetching is enabled.
+   */
+  std::string trace_path_;
+  CatalogTrace *catalog_trace_;
+  std::vector<pthread_t> prefetch_threads_;
+  perf::Counter *n_prefetch_;
+  perf::Counter *n_preload_;
+  /**
+   * Attached catalogs get a bloom filter of their path hashes.
+   */
+  bool use_path_filter_;
+  bool use_catalog_deltas_;
+  bool use_catalog_indexes_;
+  bool use_nested_index_;
+  /**
+   * Belongs to the attached root catalog, protected by the catalog manager's
+   * lock.  NULL if there is none.
+   */
+  NestedCatalogIndex *nested_index_;
+  perf::Counter *n_chain_prefetch_;
+  perf::Counter *n_delta_hits_;
+  perf::Counter *n_delta_misses_;
+  perf::Counter *n_index_;
+  unsigned idle_max_sec_;
+  uint64_t idle_mem_budget_;
+  /**
+   * Terminates the idle detacher, -1 if it is not running
+   */
+  int pipe_idle_detacher_[2];
+  pthread_t thread_idle_detacher_;
+  /**
+   * NULL unless the heat map is enabled
+   */
+  CatalogHeatmap *heatmap_;
+  std::string heatmap_path_;
+  unsigned heatmap_interval_sec_;
+  /**
+   * Set by LoadCatalog() and consumed by ActivateCatalog() of the same attach
+   */
+  uint64_t attach_start_ns_;
+  uint64_t attach_bytes_;
+  int pipe_heatmap_dumper_[2];
+  pthread_t thread_heatmap_dumper_;
 };
 
 
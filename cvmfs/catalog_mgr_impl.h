@@ -11,12 +11,17 @@
 
 #include "cvmfs_config.h"
 
+#include <algorithm>
 #include <cassert>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "logging.h"
+#include "platform.h"
 #include "shortstring.h"
 #include "statistics.h"
+#include "util/probes.h"
 #include "xattr.h"
 
 using namespace std;  // NOLINT
@@ -27,6 +32,7 @@ template <class CatalogT>
 AbstractCatalogManager<CatalogT>::AbstractCatalogManager(
     perf::Statistics *statistics) :
   statistics_(statistics) {
+  count_lookups_ = false;
   inode_watermark_status_ = 0;
   inode_gauge_ = AbstractCatalogManager<CatalogT>::kInodeOffset;
   revision_cache_ = 0;
@@ -34,11 +40,8 @@ AbstractCatalogManager<CatalogT>::AbstractCatalogManager(
   has_authz_cache_ = false;
   inode_annotation_ = NULL;
   incarnation_ = 0;
-  rwlock_ =
-    reinterpret_cast<pthread_rwlock_t *>(smalloc(sizeof(pthread_rwlock_t)));
-  int retval = pthread_rwlock_init(rwlock_, NULL);
-  assert(retval == 0);
-  retval = pthread_key_create(&pkey_sqlitemem_, NULL);
+  rwlock_ = new StripedRwLock();
+  int retval = pthread_key_create(&pkey_sqlitemem_, NULL);
   assert(retval == 0);
 }
 
@@ -46,8 +49,7 @@ template <class CatalogT>
 AbstractCatalogManager<CatalogT>::~AbstractCatalogManager() {
   DetachAll();
   pthread_key_delete(pkey_sqlitemem_);
-  pthread_rwlock_destroy(rwlock_);
-  free(rwlock_);
+  delete rwlock_;
 }
 
 template <class CatalogT>
@@ -167,6 +169,64 @@ void AbstractCatalogManager<CatalogT>::DetachNested() {
 }
 
 
+/**
+ * Detaches the least recently used leaf nested catalogs that were not accessed
+ * for at least max_idle_sec until the attached catalogs use no more than
+ * mem_budget bytes.  The root catalog, catalogs with attached nested catalogs,
+ * and catalogs with open listing streams stay.  Parents of detached catalogs
+ * become candidates in the next round.  Detached catalogs are transparently
+ * reattached by the next lookup.
+ * @return the number of detached catalogs
+ */
+template <class CatalogT>
+unsigned AbstractCatalogManager<CatalogT>::DetachIdle(
+  const uint64_t max_idle_sec,
+  const uint64_t mem_budget)
+{
+  // Most of the time, the budget is not exceeded, which is checked without
+  // blocking lookups
+  uint64_t mem_usage = GetMemoryUsage();
+  if (mem_usage <= mem_budget)
+    return 0;
+
+  WriteLock();
+  const uint64_t now = platform_monotonic_time();
+  mem_usage = 0;
+  std::vector<std::pair<uint64_t, CatalogT *> > candidates;
+  for (unsigned i = 0; i < catalogs_.size(); ++i) {
+    CatalogT *catalog = catalogs_[i];
+    mem_usage += catalog->GetMemoryUsage();
+    if (!catalog->HasParent() || !catalog->GetChildren().empty() ||
+        catalog->HasOpenStreams())
+    {
+      continue;
+    }
+    const uint64_t last_access = catalog->last_access();
+    if ((last_access > now) || (now - last_access < max_idle_sec))
+      continue;
+    candidates.push_back(std::make_pair(last_access, catalog));
+  }
+  std::sort(candidates.begin(), candidates.end());
+
+  unsigned num_detached = 0;
+  for (unsigned i = 0; (i < candidates.size()) && (mem_usage > mem_budget);
+       ++i)
+  {
+    CatalogT *catalog = candidates[i].second;
+    const uint64_t catalog_mem = catalog->GetMemoryUsage();
+    LogCvmfs(kLogCatalog, kLogDebug, "detaching idle nested catalog %s",
+             catalog->mountpoint().c_str());
+    DetachCatalog(catalog);
+    mem_usage -= std::min(mem_usage, catalog_mem);
+    num_detached++;
+  }
+  Unlock();
+
+  perf::Xadd(statistics_.n_detach_idle, num_detached);
+  return num_detached;
+}
+
+
 /**
  * Returns the NULL hash if the nested catalog is not found.
  */
@@ -175,6 +235,7 @@ shash::Any AbstractCatalogManager<CatalogT>::GetNestedCatalogHash(
   const PathString &mountpoint)
 {
   assert(!mountpoint.IsEmpty());
+  ReadLock();
   CatalogT *catalog = FindCatalog(mountpoint);
   assert(catalog != NULL);
   if (catalog->mountpoint() == mountpoint) {
@@ -184,6 +245,7 @@ shash::Any AbstractCatalogManager<CatalogT>::GetNestedCatalogHash(
   shash::Any result;
   uint64_t size;
   catalog->FindNested(mountpoint, &result, &size);
+  Unlock();
   return result;
 }
 
@@ -326,6 +388,186 @@ bool AbstractCatalogManager<CatalogT>::LookupXattrs(
 }
 
 
+/**
+ * Retrieves the content of a small file that is stored in its catalog.
+ */
+template <class CatalogT>
+bool AbstractCatalogManager<CatalogT>::LookupInlineData(
+  const PathString &path,
+  std::string *data)
+{
+  EnforceSqliteMemLimit();
+  bool result;
+  ReadLock();
+
+  // Find catalog, possibly load nested
+  CatalogT *best_fit = FindCatalog(path);
+  CatalogT *catalog = best_fit;
+  if (MountSubtree(path, best_fit, NULL)) {
+    Unlock();
+    WriteLock();
+    // Check again to avoid race
+    best_fit = FindCatalog(path);
+    result = MountSubtree(path, best_fit, &catalog);
+    if (!result) {
+      Unlock();
+      return false;
+    }
+  }
+
+  perf::Inc(statistics_.n_lookup_inline_data);
+  result = catalog->LookupInlineDataPath(path, data);
+
+  Unlock();
+  return result;
+}
+
+
+/**
+ * Finds the bundle object that contains a copy of the file.
+ */
+template <class CatalogT>
+bool AbstractCatalogManager<CatalogT>::LookupBundle(
+  const PathString &path,
+  const shash::Algorithms interpret_hash_as,
+  shash::Any *bundle_hash,
+  uint64_t *offset)
+{
+  EnforceSqliteMemLimit();
+  bool result;
+  ReadLock();
+
+  // Find catalog, possibly load nested
+  CatalogT *best_fit = FindCatalog(path);
+  CatalogT *catalog = best_fit;
+  if (MountSubtree(path, best_fit, NULL)) {
+    Unlock();
+    WriteLock();
+    // Check again to avoid race
+    best_fit = FindCatalog(path);
+    result = MountSubtree(path, best_fit, &catalog);
+    if (!result) {
+      Unlock();
+      return false;
+    }
+  }
+
+  perf::Inc(statistics_.n_lookup_bundle);
+  result = catalog->LookupBundlePath(path, interpret_hash_as, bundle_hash,
+                                     offset);
+
+  Unlock();
+  return result;
+}
+
+
+/**
+ * Finds the prefetch group of a file, if any.
+ */
+template <class CatalogT>
+bool AbstractCatalogManager<CatalogT>::LookupPrefetchGroup(
+  const PathString &path,
+  uint64_t *group_id)
+{
+  EnforceSqliteMemLimit();
+  bool result;
+  ReadLock();
+
+  // Find catalog, possibly load nested
+  CatalogT *best_fit = FindCatalog(path);
+  CatalogT *catalog = best_fit;
+  if (MountSubtree(path, best_fit, NULL)) {
+    Unlock();
+    WriteLock();
+    // Check again to avoid race
+    best_fit = FindCatalog(path);
+    result = MountSubtree(path, best_fit, &catalog);
+    if (!result) {
+      Unlock();
+      return false;
+    }
+  }
+
+  result = catalog->LookupPrefetchGroupPath(path, group_id);
+
+  Unlock();
+  return result;
+}
+
+
+/**
+ * Lists the files of a prefetch group.  Prefetch groups are confined to the
+ * catalog that contains path.
+ */
+template <class CatalogT>
+bool AbstractCatalogManager<CatalogT>::ListPrefetchGroup(
+  const PathString &path,
+  const uint64_t group_id,
+  const unsigned max_members,
+  PrefetchGroup *members)
+{
+  EnforceSqliteMemLimit();
+  bool result;
+  ReadLock();
+
+  // Find catalog, possibly load nested
+  CatalogT *best_fit = FindCatalog(path);
+  CatalogT *catalog = best_fit;
+  if (MountSubtree(path, best_fit, NULL)) {
+    Unlock();
+    WriteLock();
+    // Check again to avoid race
+    best_fit = FindCatalog(path);
+    result = MountSubtree(path, best_fit, &catalog);
+    if (!result) {
+      Unlock();
+      return false;
+    }
+  }
+
+  perf::Inc(statistics_.n_list_prefetch_group);
+  result = catalog->ListPrefetchGroup(group_id, max_members, members);
+
+  Unlock();
+  return result;
+}
+
+
+/**
+ * Retrieves the serialized block digests of a large file, if any.
+ */
+template <class CatalogT>
+bool AbstractCatalogManager<CatalogT>::LookupDigestTree(
+  const PathString &path,
+  std::string *tree)
+{
+  EnforceSqliteMemLimit();
+  bool result;
+  ReadLock();
+
+  // Find catalog, possibly load nested
+  CatalogT *best_fit = FindCatalog(path);
+  CatalogT *catalog = best_fit;
+  if (MountSubtree(path, best_fit, NULL)) {
+    Unlock();
+    WriteLock();
+    // Check again to avoid race
+    best_fit = FindCatalog(path);
+    result = MountSubtree(path, best_fit, &catalog);
+    if (!result) {
+      Unlock();
+      return false;
+    }
+  }
+
+  perf::Inc(statistics_.n_lookup_digest_tree);
+  result = catalog->LookupDigestTreePath(path, tree);
+
+  Unlock();
+  return result;
+}
+
+
 /**
  * Do a listing of the specified directory.
  * @param path the path of the directory to list
@@ -400,6 +642,84 @@ bool AbstractCatalogManager<CatalogT>::ListingStat(const PathString &path,
 }
 
 
+/**
+ * Like Listing but only for a page of at most max_rows rows after cursor,
+ * see Catalog::ListingMd5PathPage().  Used to list very large directories
+ * without keeping the entire listing in memory.
+ */
+template <class CatalogT>
+bool AbstractCatalogManager<CatalogT>::ListingPage(
+  const PathString &path,
+  const unsigned max_rows,
+  uint64_t *cursor,
+  DirectoryEntryList *listing,
+  std::vector<uint64_t> *rowids)
+{
+  EnforceSqliteMemLimit();
+  bool result;
+  ReadLock();
+
+  // Find catalog, possibly load nested
+  CatalogT *best_fit = FindCatalog(path);
+  CatalogT *catalog = best_fit;
+  if (MountSubtree(path, best_fit, NULL)) {
+    Unlock();
+    WriteLock();
+    // Check again to avoid race
+    best_fit = FindCatalog(path);
+    result = MountSubtree(path, best_fit, &catalog);
+    if (!result) {
+      Unlock();
+      return false;
+    }
+  }
+
+  if (*cursor == 0)
+    perf::Inc(statistics_.n_listing);
+  result = catalog->ListingPathPage(path, max_rows, cursor, listing, rowids);
+
+  Unlock();
+  return result;
+}
+
+
+/**
+ * Opens a listing of the directory in the order of the path hashes of its
+ * entries, mounting nested catalogs as necessary.  The stream is used outside
+ * the lock of the catalog manager, so the catalog must not be detached while
+ * the stream is open.  That holds for catalog managers that are not remounted,
+ * such as the ones that diff two revisions.
+ * @return NULL if the catalog of the directory cannot be mounted
+ */
+template <class CatalogT>
+ListingStream *AbstractCatalogManager<CatalogT>::OpenListingStream(
+  const PathString &path)
+{
+  EnforceSqliteMemLimit();
+  ReadLock();
+
+  CatalogT *best_fit = FindCatalog(path);
+  CatalogT *catalog = best_fit;
+  if (MountSubtree(path, best_fit, NULL)) {
+    Unlock();
+    WriteLock();
+    // Check again to avoid race
+    best_fit = FindCatalog(path);
+    const bool retval = MountSubtree(path, best_fit, &catalog);
+    if (!retval) {
+      Unlock();
+      return NULL;
+    }
+  }
+
+  perf::Inc(statistics_.n_listing);
+  ListingStream *result = catalog->OpenListingStream(path);
+
+  Unlock();
+  return result;
+}
+
+
 /**
  * Collect file chunks (if exist)
  * @param path the path of the directory to list
@@ -477,6 +797,21 @@ int AbstractCatalogManager<CatalogT>::GetNumCatalogs() const {
 }
 
 
+/**
+ * Sum of the estimated heap usage of all attached catalogs, including their
+ * SQLite connections.
+ */
+template <class CatalogT>
+uint64_t AbstractCatalogManager<CatalogT>::GetMemoryUsage() const {
+  uint64_t result = 0;
+  ReadLock();
+  for (unsigned i = 0; i < catalogs_.size(); ++i)
+    result += catalogs_[i]->GetMemoryUsage();
+  Unlock();
+  return result;
+}
+
+
 /**
  * Gets a formatted tree of the currently attached catalogs
  */
@@ -538,6 +873,9 @@ CatalogT* AbstractCatalogManager<CatalogT>::FindCatalog(
     best_fit = next_fit;
   }
 
+  best_fit->Touch(platform_monotonic_time());
+  if (count_lookups_)
+    best_fit->CountLookup();
   return best_fit;
 }
 
@@ -569,11 +907,14 @@ bool AbstractCatalogManager<CatalogT>::IsAttached(const PathString &root_path,
  * If leaf_catalog is NULL, just indicate if it is necessary to load a
  * nested catalog for the given path.
  * The final leaf nested catalog is returned.
+ * The recursion passes can_prefetch = false, so that PrefetchSubtree() is
+ * called at most once per path.
  */
 template <class CatalogT>
 bool AbstractCatalogManager<CatalogT>::MountSubtree(const PathString &path,
                                           const CatalogT *entry_point,
-                                          CatalogT **leaf_catalog)
+                                          CatalogT **leaf_catalog,
+                                          const bool can_prefetch)
 {
   bool result = true;
   CatalogT *parent = (entry_point == NULL) ?
@@ -603,11 +944,14 @@ bool AbstractCatalogManager<CatalogT>::MountSubtree(const PathString &path,
       // (due to reloading root)
       if (i->hash.IsNull())
         return false;
+      // Only the outermost call, the deeper levels are part of the prefetch
+      if (can_prefetch)
+        PrefetchSubtree(path, parent);
       new_nested = MountCatalog(i->mountpoint, i->hash, parent);
       if (!new_nested)
         return false;
 
-      result = MountSubtree(path, new_nested, &parent);
+      result = MountSubtree(path, new_nested, &parent, false);
       break;
     }
   }
@@ -653,6 +997,7 @@ CatalogT *AbstractCatalogManager<CatalogT>::MountCatalog(
     return NULL;
   }
 
+  attached_catalog->Touch(platform_monotonic_time());
   return attached_catalog;
 }
 
@@ -702,6 +1047,8 @@ bool AbstractCatalogManager<CatalogT>::AttachCatalog(const string &db_path,
 
   catalogs_.push_back(new_catalog);
   ActivateCatalog(new_catalog);
+  CVMFS_PROBE2(catalog_attach, new_catalog->mountpoint().c_str(),
+               new_catalog->GetRevision());
   return true;
 }
 
@@ -716,6 +1063,8 @@ bool AbstractCatalogManager<CatalogT>::AttachCatalog(const string &db_path,
  */
 template <class CatalogT>
 void AbstractCatalogManager<CatalogT>::DetachCatalog(CatalogT *catalog) {
+  CVMFS_PROBE2(catalog_detach, catalog->mountpoint().c_str(),
+               catalog->GetRevision());
   if (catalog->HasParent())
     catalog->parent()->RemoveChild(catalog);
 
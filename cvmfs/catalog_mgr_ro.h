@@ -57,6 +57,10 @@ class SimpleCatalogManager : public AbstractCatalogManager<Catalog> {
   const shash::Any&  base_hash() const { return base_hash_; }
   void           set_base_hash(const shash::Any &hash) { base_hash_ = hash; }
   const std::string& dir_temp() const  { return dir_temp_;  }
+  const std::string& stratum0() const  { return stratum0_;  }
+  download::DownloadManager *download_manager() const {
+    return download_manager_;
+  }
 
   /**
    * Makes the given path relative to the catalog structure
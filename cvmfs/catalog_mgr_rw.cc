@@ -6,16 +6,25 @@
 
 #include "catalog_mgr_rw.h"
 
+#include <fcntl.h>
 #include <inttypes.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
 #include <string>
+#include <vector>
 
 #include "catalog_balancer.h"
+#include "catalog_cache.h"
+#include "catalog_delta.h"
+#include "catalog_index.h"
+#include "catalog_nested_index.h"
 #include "catalog_rw.h"
+#include "compression.h"
+#include "download.h"
 #include "logging.h"
 #include "manifest.h"
 #include "smalloc.h"
@@ -44,6 +53,12 @@ WritableCatalogManager::WritableCatalogManager(
   : SimpleCatalogManager(base_hash, stratum0, dir_temp, download_manager,
       statistics)
   , spooler_(spooler)
+  , generate_deltas_(false)
+  , generate_indexes_(false)
+  , generate_nested_index_(false)
+  , cluster_catalogs_(false)
+  , lazy_vacuum_(false)
+  , catalog_cache_(NULL)
   , enforce_limits_(enforce_limits)
   , nested_kcatalog_limit_(nested_kcatalog_limit)
   , root_kcatalog_limit_(root_kcatalog_limit)
@@ -52,6 +67,9 @@ WritableCatalogManager::WritableCatalogManager(
   , max_weight_(max_weight)
   , min_weight_(min_weight)
   , balance_weight_(max_weight / 2)
+  , max_staged_dirents_(0)
+  , staging_statistics_(statistics)
+  , access_profile_(NULL)
 {
   sync_lock_ =
     reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
@@ -72,6 +90,36 @@ WritableCatalogManager::~WritableCatalogManager() {
 }
 
 
+/**
+ * Takes the catalog from the catalog cache if possible.  Otherwise, the
+ * catalog is downloaded and stored in the cache before it gets modified.
+ */
+LoadError WritableCatalogManager::LoadCatalog(
+  const PathString  &mountpoint,
+  const shash::Any  &hash,
+  std::string       *catalog_path,
+  shash::Any        *catalog_hash)
+{
+  if (catalog_cache_ == NULL) {
+    return SimpleCatalogManager::LoadCatalog(mountpoint, hash, catalog_path,
+                                             catalog_hash);
+  }
+
+  const shash::Any effective_hash = hash.IsNull() ? base_hash() : hash;
+  if (catalog_cache_->Fetch(effective_hash, dir_temp() + "/catalog",
+                            catalog_path))
+  {
+    *catalog_hash = effective_hash;
+    return kLoadNew;
+  }
+  const LoadError retval = SimpleCatalogManager::LoadCatalog(
+    mountpoint, effective_hash, catalog_path, catalog_hash);
+  if (retval == kLoadNew)
+    catalog_cache_->Insert(*catalog_hash, *catalog_path);
+  return retval;
+}
+
+
 /**
  * This method is virtual in AbstractCatalogManager.  It returns a new catalog
  * structure in the form the different CatalogManagers need it.
@@ -86,9 +134,11 @@ Catalog* WritableCatalogManager::CreateCatalog(
   const shash::Any &catalog_hash,
   Catalog          *parent_catalog)
 {
-  return new WritableCatalog(mountpoint.ToString(),
-                             catalog_hash,
-                             parent_catalog);
+  WritableCatalog *catalog = new WritableCatalog(mountpoint.ToString(),
+                                                 catalog_hash,
+                                                 parent_catalog);
+  catalog->SetStaging(max_staged_dirents_, &staging_statistics_);
+  return catalog;
 }
 
 
@@ -409,6 +459,112 @@ void WritableCatalogManager::AddChunkedFile(
 }
 
 
+/**
+ * Adds a small regular file together with its content.  Clients serve the
+ * content from the catalog instead of downloading the object.  The object
+ * itself needs to be uploaded nevertheless for clients that do not know about
+ * inline files.
+ */
+void WritableCatalogManager::AddInlineFile(
+  const DirectoryEntryBase  &entry,
+  const XattrList           &xattrs,
+  const std::string         &parent_directory,
+  const std::string         &data)
+{
+  assert(entry.IsRegular() && !entry.IsExternalFile());
+  assert(data.length() == entry.size());
+
+  DirectoryEntry full_entry(entry);
+  full_entry.set_is_inline_file(true);
+
+  AddFile(full_entry, xattrs, parent_directory);
+
+  const string parent_path = MakeRelativePath(parent_directory);
+  const string file_path   = entry.GetFullPath(parent_path);
+
+  SyncLock();
+  WritableCatalog *catalog;
+  if (!FindCatalog(parent_path, &catalog)) {
+    LogCvmfs(kLogCatalog, kLogStderr, "catalog for file '%s' cannot be found",
+             file_path.c_str());
+    assert(false);
+  }
+  catalog->AddInlineData(file_path, data);
+  SyncUnlock();
+}
+
+
+/**
+ * Records the bundle object that contains a copy of an already added regular
+ * file.  Clients that miss the file download the entire bundle instead.
+ */
+void WritableCatalogManager::AddBundledFile(
+  const std::string &path,
+  const shash::Any  &bundle_hash,
+  const uint64_t     offset)
+{
+  const string file_path = MakeRelativePath(path);
+  const string parent_path = GetParentPath(file_path);
+
+  SyncLock();
+  WritableCatalog *catalog;
+  if (!FindCatalog(parent_path, &catalog)) {
+    LogCvmfs(kLogCatalog, kLogStderr, "catalog for file '%s' cannot be found",
+             file_path.c_str());
+    assert(false);
+  }
+  catalog->AddBundle(file_path, bundle_hash, offset);
+  SyncUnlock();
+}
+
+
+/**
+ * Puts an existing regular file into a prefetch group.  Returns false if there
+ * is no such file, e.g. for a stale path of an access trace.
+ */
+bool WritableCatalogManager::SetPrefetchGroup(
+  const std::string &path,
+  const uint64_t     group_id)
+{
+  const string file_path = MakeRelativePath(path);
+  const string parent_path = GetParentPath(file_path);
+
+  SyncLock();
+  WritableCatalog *catalog;
+  DirectoryEntry entry;
+  bool retval = FindCatalog(parent_path, &catalog) &&
+                catalog->LookupPath(PathString(file_path), &entry) &&
+                entry.IsRegular();
+  if (retval)
+    catalog->AddPrefetchGroup(file_path, group_id);
+  SyncUnlock();
+  return retval;
+}
+
+
+/**
+ * Stores the block digests of an already added regular file.  Clients use them
+ * to verify range requests of the file before it is entirely downloaded.
+ */
+void WritableCatalogManager::AddDigestTree(
+  const std::string &path,
+  const std::string &tree)
+{
+  const string file_path = MakeRelativePath(path);
+  const string parent_path = GetParentPath(file_path);
+
+  SyncLock();
+  WritableCatalog *catalog;
+  if (!FindCatalog(parent_path, &catalog)) {
+    LogCvmfs(kLogCatalog, kLogStderr, "catalog for file '%s' cannot be found",
+             file_path.c_str());
+    assert(false);
+  }
+  catalog->AddDigestTree(file_path, tree);
+  SyncUnlock();
+}
+
+
 /**
  * Add a hardlink group to the catalogs.
  * @param entries a list of DirectoryEntries describing the new files
@@ -773,6 +929,13 @@ bool WritableCatalogManager::Commit(const bool           stop_for_tweaks,
     LogCvmfs(kLogCatalog, kLogStderr, "failed to commit catalogs");
     return false;
   }
+  LogCvmfs(kLogCatalog, kLogVerboseMsg, "inserted %" PRId64 " staged entries "
+           "in %" PRId64 " flushes and %" PRId64 " unstaged entries, "
+           "%" PRId64 " us spent on inserts",
+           staging_statistics_.n_staged->Get(),
+           staging_statistics_.n_flushes->Get(),
+           staging_statistics_.n_unstaged->Get(),
+           staging_statistics_.insert_time_us->Get());
 
   // .cvmfspublished export
   LogCvmfs(kLogCatalog, kLogVerboseMsg, "Committing repository manifest");
@@ -784,14 +947,17 @@ bool WritableCatalogManager::Commit(const bool           stop_for_tweaks,
   manifest->set_ttl(root_catalog_info.ttl);
   manifest->set_revision(root_catalog_info.revision);
 
+  if (catalog_cache_ != NULL)
+    catalog_cache_->Trim();
   return true;
 }
 
 
 /**
  * Handles the snapshotting of dirty (i.e. modified) catalogs while trying to
- * parallize the compression and upload as much as possible. We use a parallel
- * depth first post order tree traversal based on 'continuations'.
+ * parallize the finalization, compression, and upload as much as possible. We
+ * use a parallel depth first post order tree traversal based on
+ * 'continuations'.
  *
  * The idea is as follows:
  *  1. find all leaf-catalogs (i.e. dirty catalogs with no dirty children)
@@ -800,7 +966,7 @@ bool WritableCatalogManager::Commit(const bool           stop_for_tweaks,
  *  2. annotate non-leaf catalogs with their number of dirty children
  *     --> a finished child will notify it's parent and decrement this number
  *         see WritableCatalogManager::CatalogUploadCallback()
- *  3. if a non-leaf catalog's dirty children number reaches 0, it is scheduled
+ *  3. if a non-leaf catalog's dirty children number reaches 0, it is queued
  *     for processing as well (continuation)
  *     --> the parallel processing walks bottom-up through the catalog tree
  *         see WritableCatalogManager::CatalogUploadCallback()
@@ -808,19 +974,25 @@ bool WritableCatalogManager::Commit(const bool           stop_for_tweaks,
  *     --> done through a Future<> in WritableCatalogManager::SnapshotCatalogs
  *
  * Note: The catalog finalisation (see WritableCatalogManager::FinalizeCatalog)
- *       happens in a worker thread (i.e. the callback method) for non-leaf
- *       catalogs.
- *
- * TODO(rmeusel): since all leaf catalogs are finalized in the main thread, we
- *                sacrafice some potential concurrency for simplicity.
+ *       happens in a pool of finalizer threads that take the queued catalogs,
+ *       so that independent subtrees are committed concurrently.  Only the
+ *       path from the last finished leaf to the root remains serial.
  */
 WritableCatalogManager::CatalogInfo WritableCatalogManager::SnapshotCatalogs(
                                                    const bool stop_for_tweaks) {
+  // Interactive tweaks require one catalog at a time
+  const unsigned num_finalizers =
+    stop_for_tweaks ? 1 : std::max(1U, GetNumberOfCpuCores());
+  // Every dirty catalog is queued at most once
+  FifoChannel<WritableCatalog *> finalize_queue(
+    GetNumCatalogs() + num_finalizers, 1);
+
   // prepare environment for parallel processing
   Future<CatalogInfo>  root_catalog_info_future;
   CatalogUploadContext upload_context;
   upload_context.root_catalog_info = &root_catalog_info_future;
   upload_context.stop_for_tweaks   = stop_for_tweaks;
+  upload_context.finalize_queue    = &finalize_queue;
 
   spooler_->RegisterListener(
     &WritableCatalogManager::CatalogUploadCallback, this, upload_context);
@@ -830,29 +1002,63 @@ WritableCatalogManager::CatalogInfo WritableCatalogManager::SnapshotCatalogs(
   WritableCatalogList leafs_to_snapshot;
   GetModifiedCatalogLeafs(&leafs_to_snapshot);
 
+  FinalizeWorkerContext worker_context;
+  worker_context.catalog_manager = this;
+  worker_context.finalize_queue  = &finalize_queue;
+  worker_context.stop_for_tweaks = stop_for_tweaks;
+  std::vector<pthread_t> finalizers(num_finalizers);
+  for (unsigned i = 0; i < num_finalizers; ++i) {
+    int retval = pthread_create(&finalizers[i], NULL, MainFinalizeWorker,
+                                &worker_context);
+    assert(retval == 0);
+  }
+
   // finalize and schedule the catalog processing
         WritableCatalogList::const_iterator i    = leafs_to_snapshot.begin();
   const WritableCatalogList::const_iterator iend = leafs_to_snapshot.end();
   for (; i != iend; ++i) {
-    FinalizeCatalog(*i, stop_for_tweaks);
-    ScheduleCatalogProcessing(*i);
+    finalize_queue.Enqueue(*i);
   }
 
   LogCvmfs(kLogCatalog, kLogVerboseMsg, "waiting for upload of catalogs");
   CatalogInfo& root_catalog_info = root_catalog_info_future.Get();
   spooler_->WaitForUpload();
 
+  // a NULL catalog stops a finalizer thread
+  for (unsigned j = 0; j < num_finalizers; ++j)
+    finalize_queue.Enqueue(NULL);
+  for (unsigned j = 0; j < num_finalizers; ++j)
+    pthread_join(finalizers[j], NULL);
+
   spooler_->UnregisterListeners();
+  UploadPendingObjects();
   return root_catalog_info;
 }
 
 
+void *WritableCatalogManager::MainFinalizeWorker(void *data) {
+  FinalizeWorkerContext *context =
+    reinterpret_cast<FinalizeWorkerContext *>(data);
+
+  while (true) {
+    WritableCatalog *catalog = context->finalize_queue->Dequeue();
+    if (catalog == NULL)
+      break;
+    context->catalog_manager->FinalizeCatalog(catalog,
+                                              context->stop_for_tweaks);
+    context->catalog_manager->ScheduleCatalogProcessing(catalog);
+  }
+  return NULL;
+}
+
+
 void WritableCatalogManager::FinalizeCatalog(WritableCatalog *catalog,
                                              const bool stop_for_tweaks) {
   // update meta information of this catalog
   LogCvmfs(kLogCatalog, kLogVerboseMsg, "creating snapshot of catalog '%s'",
            catalog->mountpoint().c_str());
 
+  catalog->SummarizeIfNecessary();
   catalog->UpdateCounters();
   catalog->UpdateLastModified();
   catalog->IncrementRevision();
@@ -910,7 +1116,16 @@ void WritableCatalogManager::FinalizeCatalog(WritableCatalog *catalog,
   }
 
   // compaction of bloated catalogs (usually after high database churn)
-  catalog->VacuumDatabaseIfNecessary();
+  if (cluster_catalogs_)
+    catalog->ClusterDatabase();
+  else
+    catalog->VacuumDatabaseIfNecessary(lazy_vacuum_);
+
+  // the index refers to rowids, which only become final after the vacuum
+  UpdateCatalogIndex(catalog);
+  // all the nested catalogs are committed before the root catalog
+  if (catalog->IsRoot())
+    UpdateNestedCatalogIndex(catalog);
 }
 
 
@@ -948,6 +1163,11 @@ void WritableCatalogManager::CatalogUploadCallback(
   uint64_t catalog_size = GetFileSize(result.local_path);
   assert(catalog_size > 0);
 
+  if (catalog_cache_ != NULL)
+    catalog_cache_->Insert(result.content_hash, result.local_path);
+  if (generate_deltas_)
+    CreateCatalogDelta(catalog, result.content_hash);
+
   SyncLock();
   if (catalog->HasParent()) {
     // finalized nested catalogs will update their parent's pointer and schedule
@@ -968,10 +1188,8 @@ void WritableCatalogManager::CatalogUploadCallback(
 
     // continuation of the dirty catalog tree traversal
     // see WritableCatalogManager::SnapshotCatalogs()
-    if (remaining_dirty_children == 0) {
-      FinalizeCatalog(parent, catalog_upload_context.stop_for_tweaks);
-      ScheduleCatalogProcessing(parent);
-    }
+    if (remaining_dirty_children == 0)
+      catalog_upload_context.finalize_queue->Enqueue(parent);
 
   } else if (catalog->IsRoot()) {
     // once the root catalog is reached, we are done with processing and report
@@ -989,6 +1207,332 @@ void WritableCatalogManager::CatalogUploadCallback(
 }
 
 
+/**
+ * Downloads and decompresses a previous catalog revision into memory.
+ */
+bool WritableCatalogManager::DownloadPreviousRevision(
+  const shash::Any &hash,
+  string *catalog)
+{
+  const string url = stratum0() + "/data/" + hash.MakePath();
+  string path;
+  FILE *fcatalog = CreateTempFile(dir_temp() + "/catalog", 0600, "w+", &path);
+  if (fcatalog == NULL)
+    return false;
+  download::JobInfo download_catalog(&url, true, false, fcatalog, &hash);
+  download::Failures dl_retval = download_manager()->Fetch(&download_catalog);
+  const bool retval = (dl_retval == download::kFailOk) &&
+                      (fflush(fcatalog) == 0) &&
+                      (lseek(fileno(fcatalog), 0, SEEK_SET) == 0) &&
+                      SafeReadToString(fileno(fcatalog), catalog);
+  fclose(fcatalog);
+  unlink(path.c_str());
+  if (!retval) {
+    LogCvmfs(kLogCatalog, kLogVerboseMsg,
+             "failed to load previous revision %s (%d - %s), no delta",
+             url.c_str(), dl_retval, download::Code2Ascii(dl_retval));
+  }
+  return retval;
+}
+
+
+/**
+ * Compares the uploaded catalog with its previous revision from the catalog
+ * cache or the stratum 0 and queues the delta for upload.  Deltas are
+ * optional, failures are only logged.
+ */
+void WritableCatalogManager::CreateCatalogDelta(
+  WritableCatalog *catalog,
+  const shash::Any &content_hash)
+{
+  const shash::Any base_hash = catalog->GetPreviousRevision();
+  if (base_hash.IsNull())
+    return;
+
+  string base;
+  string base_path;
+  if ((catalog_cache_ != NULL) &&
+      catalog_cache_->Fetch(base_hash, dir_temp() + "/catalog", &base_path))
+  {
+    int fd_base = open(base_path.c_str(), O_RDONLY);
+    const bool base_ok = (fd_base >= 0) && SafeReadToString(fd_base, &base);
+    if (fd_base >= 0)
+      close(fd_base);
+    unlink(base_path.c_str());
+    if (!base_ok)
+      return;
+  } else if (!DownloadPreviousRevision(base_hash, &base)) {
+    return;
+  }
+
+  string target;
+  int fd = open(catalog->database_path().c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  const bool target_ok = SafeReadToString(fd, &target);
+  close(fd);
+  string delta;
+  if (!target_ok || !CatalogDelta::Create(base, target, &delta)) {
+    LogCvmfs(kLogCatalog, kLogVerboseMsg, "no delta for catalog '%s'",
+             catalog->mountpoint().c_str());
+    return;
+  }
+
+  void *compressed;
+  uint64_t compressed_size;
+  if (!zlib::CompressMem2Mem(delta.data(), delta.size(),
+                             &compressed, &compressed_size))
+  {
+    return;
+  }
+  const string delta_path = CreateTempPath(dir_temp() + "/delta", 0600);
+  const bool write_ok = !delta_path.empty() &&
+    SafeWriteToFile(string(reinterpret_cast<char *>(compressed),
+                           compressed_size), delta_path, 0600);
+  free(compressed);
+  if (!write_ok) {
+    if (!delta_path.empty())
+      unlink(delta_path.c_str());
+    return;
+  }
+  LogCvmfs(kLogCatalog, kLogVerboseMsg,
+           "created delta of %" PRIu64 " bytes for catalog '%s' (%lu bytes)",
+           compressed_size, catalog->mountpoint().c_str(), target.size());
+
+  MutexLockGuard guard(catalog_processing_lock_);
+  pending_uploads_.push_back(make_pair(
+    delta_path, CatalogDelta::MakeDeltaPath(base_hash, content_hash)));
+}
+
+
+/**
+ * Stores the read-optimized encoding of the finalized catalog and links it
+ * from the catalog properties.  Indexes are optional; if none is created, the
+ * link to the index of the previous revision is removed.
+ */
+void WritableCatalogManager::UpdateCatalogIndex(WritableCatalog *catalog) {
+  CatalogDatabase &database = catalog->database();
+  string index;
+  if (!generate_indexes_ || !CatalogIndex::Build(database, &index)) {
+    if (database.HasProperty(CatalogIndex::kPropertyKey)) {
+      const bool retval =
+        database.SetProperty(CatalogIndex::kPropertyKey, string(""));
+      assert(retval);
+    }
+    return;
+  }
+
+  shash::Any index_hash(spooler_->GetHashAlgorithm());
+  string index_path;
+  if (!StoreCompressedObject(index, "index", &index_hash, &index_path)) {
+    PrintError("could not store index of catalog " +
+               catalog->mountpoint().ToString());
+    assert(false);
+  }
+  const bool retval = database.SetProperty(CatalogIndex::kPropertyKey,
+                                           index_hash.ToString());
+  assert(retval);
+  LogCvmfs(kLogCatalog, kLogVerboseMsg,
+           "created index of %" PRId64 " bytes for catalog '%s'",
+           GetFileSize(index_path), catalog->mountpoint().c_str());
+
+  MutexLockGuard guard(catalog_processing_lock_);
+  pending_uploads_.push_back(make_pair(index_path,
+                                       "data/" + index_hash.MakePath()));
+}
+
+
+/**
+ * Stores the index of all the nested catalogs of the new revision and links it
+ * from the root catalog properties.  Catalog subtrees that were not loaded
+ * during the publish process did not change; their entries are taken from the
+ * index of the previous revision.  If there is no such index, the unchanged
+ * catalogs are downloaded once.  The index is optional; if none is created,
+ * the link to the index of the previous revision is removed.
+ */
+void WritableCatalogManager::UpdateNestedCatalogIndex(
+  WritableCatalog *root_catalog)
+{
+  CatalogDatabase &database = root_catalog->database();
+  Catalog::NestedCatalogList nested_catalogs;
+  bool has_index = false;
+  if (generate_nested_index_) {
+    UniquePtr<NestedCatalogIndex> previous_index;
+    const shash::Any previous_hash = root_catalog->GetNestedIndexHash();
+    if (!previous_hash.IsNull())
+      previous_index = DownloadNestedCatalogIndex(previous_hash);
+    has_index = CollectNestedCatalogs(root_catalog, previous_index.weak_ref(),
+                                      &nested_catalogs);
+  }
+  if (!has_index) {
+    if (database.HasProperty(NestedCatalogIndex::kPropertyKey)) {
+      const bool retval =
+        database.SetProperty(NestedCatalogIndex::kPropertyKey, string(""));
+      assert(retval);
+    }
+    return;
+  }
+
+  string index;
+  NestedCatalogIndex::Build(nested_catalogs, &index);
+  shash::Any index_hash(spooler_->GetHashAlgorithm());
+  string index_path;
+  if (!StoreCompressedObject(index, "nested_index", &index_hash, &index_path))
+  {
+    PrintError("could not store the nested catalog index");
+    assert(false);
+  }
+  const bool retval = database.SetProperty(NestedCatalogIndex::kPropertyKey,
+                                           index_hash.ToString());
+  assert(retval);
+  LogCvmfs(kLogCatalog, kLogVerboseMsg,
+           "created index of %lu nested catalogs (%" PRId64 " bytes)",
+           nested_catalogs.size(), GetFileSize(index_path));
+
+  MutexLockGuard guard(catalog_processing_lock_);
+  pending_uploads_.push_back(make_pair(index_path,
+                                       "data/" + index_hash.MakePath()));
+}
+
+
+/**
+ * Appends the nested catalogs below catalog in the hierarchy of the new
+ * revision.  Returns false if a catalog of an unchanged subtree cannot be
+ * loaded.
+ */
+bool WritableCatalogManager::CollectNestedCatalogs(
+  const Catalog *catalog,
+  const NestedCatalogIndex *previous_index,
+  Catalog::NestedCatalogList *result)
+{
+  const Catalog::NestedCatalogList nested_catalogs =
+    catalog->ListOwnNestedCatalogs();
+  for (unsigned i = 0; i < nested_catalogs.size(); ++i) {
+    const Catalog::NestedCatalog &nested = nested_catalogs[i];
+    result->push_back(nested);
+
+    const Catalog *child = catalog->FindChild(nested.mountpoint);
+    if (child != NULL) {
+      if (!CollectNestedCatalogs(child, previous_index, result))
+        return false;
+      continue;
+    }
+    Catalog::NestedCatalog previous;
+    if ((previous_index != NULL) &&
+        previous_index->Find(nested.mountpoint, &previous) &&
+        (previous.hash == nested.hash))
+    {
+      previous_index->ListSubtree(nested.mountpoint, result);
+      continue;
+    }
+    if (!CollectRemoteNestedCatalogs(nested, previous_index, result))
+      return false;
+  }
+  return true;
+}
+
+
+bool WritableCatalogManager::CollectRemoteNestedCatalogs(
+  const Catalog::NestedCatalog &nested,
+  const NestedCatalogIndex *previous_index,
+  Catalog::NestedCatalogList *result)
+{
+  const string url = stratum0() + "/data/" + nested.hash.MakePath();
+  const string catalog_path = CreateTempPath(dir_temp() + "/catalog", 0600);
+  if (catalog_path.empty())
+    return false;
+  download::JobInfo download_catalog(&url, true, false, &catalog_path,
+                                     &nested.hash);
+  const download::Failures dl_retval =
+    download_manager()->Fetch(&download_catalog);
+  if (dl_retval != download::kFailOk) {
+    LogCvmfs(kLogCatalog, kLogStderr,
+             "failed to load catalog %s (%d - %s), no nested catalog index",
+             url.c_str(), dl_retval, download::Code2Ascii(dl_retval));
+    unlink(catalog_path.c_str());
+    return false;
+  }
+  Catalog *catalog = Catalog::AttachFreely(nested.mountpoint.ToString(),
+                                           catalog_path, nested.hash, NULL,
+                                           true);
+  bool retval = (catalog != NULL) &&
+                CollectNestedCatalogs(catalog, previous_index, result);
+  delete catalog;
+  unlink(catalog_path.c_str());
+  return retval;
+}
+
+
+/**
+ * Returns NULL if the index of the previous revision is not available.
+ */
+NestedCatalogIndex *WritableCatalogManager::DownloadNestedCatalogIndex(
+  const shash::Any &hash)
+{
+  const string url = stratum0() + "/data/" + hash.MakePath();
+  download::JobInfo download_index(&url, true, false, &hash);
+  const download::Failures dl_retval =
+    download_manager()->Fetch(&download_index);
+  if (dl_retval != download::kFailOk) {
+    LogCvmfs(kLogCatalog, kLogVerboseMsg,
+             "failed to load previous nested catalog index %s (%d - %s)",
+             url.c_str(), dl_retval, download::Code2Ascii(dl_retval));
+    return NULL;
+  }
+  NestedCatalogIndex *index = NestedCatalogIndex::Create(
+    reinterpret_cast<unsigned char *>(download_index.destination_mem.data),
+    download_index.destination_mem.pos);
+  if (index == NULL) {
+    LogCvmfs(kLogCatalog, kLogVerboseMsg,
+             "ignoring invalid nested catalog index %s", url.c_str());
+  }
+  return index;
+}
+
+
+/**
+ * The object is compressed and hashed in one pass, directly into a temporary
+ * file in dir_temp.
+ */
+bool WritableCatalogManager::StoreCompressedObject(
+  const string &content,
+  const string &name,
+  shash::Any *hash,
+  string *path)
+{
+  FILE *f = CreateTempFile(dir_temp() + "/" + name, 0600, "w", path);
+  if (f == NULL)
+    return false;
+  bool retval = zlib::CompressMem2File(
+    reinterpret_cast<const unsigned char *>(content.data()), content.size(),
+    f, hash);
+  if (fclose(f) != 0)
+    retval = false;
+  if (!retval)
+    unlink(path->c_str());
+  return retval;
+}
+
+
+/**
+ * The deltas and indexes are uploaded after the catalogs because the catalog
+ * upload listener must only see catalogs.
+ */
+void WritableCatalogManager::UploadPendingObjects() {
+  MutexLockGuard guard(catalog_processing_lock_);
+  if (pending_uploads_.empty())
+    return;
+  for (unsigned i = 0; i < pending_uploads_.size(); ++i)
+    spooler_->Upload(pending_uploads_[i].first, pending_uploads_[i].second);
+  spooler_->WaitForUpload();
+  for (unsigned i = 0; i < pending_uploads_.size(); ++i)
+    unlink(pending_uploads_[i].first.c_str());
+  LogCvmfs(kLogCatalog, kLogVerboseMsg,
+           "uploaded %lu catalog deltas and indexes", pending_uploads_.size());
+  pending_uploads_.clear();
+}
+
+
 /**
  * Finds dirty catalogs that can be snapshot right away and annotates all the
  * other catalogs with their number of dirty decendants.
@@ -1157,6 +1701,7 @@ WritableCatalogManager::SnapshotCatalogsSerialized(
   spooler_->WaitForUpload();
 
   spooler_->UnregisterListeners();
+  UploadPendingObjects();
   return root_catalog_info;
 }
 
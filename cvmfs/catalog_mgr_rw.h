@@ -35,6 +35,8 @@
 #include <map>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "catalog_mgr_ro.h"
 #include "catalog_rw.h"
@@ -61,6 +63,9 @@ class Statistics;
 }
 
 namespace catalog {
+class AccessProfile;
+class CatalogCache;
+class NestedCatalogIndex;
 template <class CatalogMgrT>
 class CatalogBalancer;
 }
@@ -104,6 +109,15 @@ class WritableCatalogManager : public SimpleCatalogManager {
                       const XattrList &xattrs,
                       const std::string &parent_directory,
                       const FileChunkList &file_chunks);
+  void AddInlineFile(const DirectoryEntryBase &entry,
+                     const XattrList &xattrs,
+                     const std::string &parent_directory,
+                     const std::string &data);
+  void AddBundledFile(const std::string &path,
+                      const shash::Any &bundle_hash,
+                      const uint64_t offset);
+  bool SetPrefetchGroup(const std::string &path, const uint64_t group_id);
+  void AddDigestTree(const std::string &path, const std::string &tree);
   void RemoveFile(const std::string &file_path);
 
   void AddDirectory(const DirectoryEntryBase &entry,
@@ -126,6 +140,55 @@ class WritableCatalogManager : public SimpleCatalogManager {
   WritableCatalog *GetHostingCatalog(const std::string &path);
 
   inline bool IsBalanceable() const { return is_balanceable_; }
+  /**
+   * Number of new directory entries per catalog that are buffered in memory,
+   * zero (the default) disables the buffering.  To be set before Init().
+   */
+  void SetMaxStagedDirents(const unsigned max_staged_dirents) {
+    max_staged_dirents_ = max_staged_dirents;
+  }
+  /**
+   * Lets the catalog balancer choose split points by access frequency.  The
+   * profile is not owned.
+   */
+  void SetAccessProfile(const AccessProfile *access_profile) {
+    access_profile_ = access_profile;
+  }
+  /**
+   * Uploads binary deltas from the previous revision of every changed
+   * catalog, see CatalogDelta.  To be set before Commit().
+   */
+  void EnableCatalogDeltas() { generate_deltas_ = true; }
+  /**
+   * Uploads the read-optimized encoding of every changed catalog, see
+   * CatalogIndex.  To be set before Commit().
+   */
+  void EnableCatalogIndexes() { generate_indexes_ = true; }
+  /**
+   * Uploads the index of all the nested catalogs with every root catalog, see
+   * NestedCatalogIndex.  To be set before Commit().
+   */
+  void EnableNestedCatalogIndex() { generate_nested_index_ = true; }
+  /**
+   * Rebuilds every changed catalog with its rows ordered by parent directory
+   * instead of defragmenting it only when necessary.  To be set before
+   * Commit().
+   */
+  void EnableCatalogClustering() { cluster_catalogs_ = true; }
+  /**
+   * Defragments changed catalogs only once they have accumulated a lot of
+   * free space, which saves rewriting large catalogs on every commit.  To be
+   * set before Commit().
+   */
+  void EnableLazyVacuum() { lazy_vacuum_ = true; }
+  /**
+   * Takes catalogs from the persistent cache instead of downloading them and
+   * stores all downloaded and committed catalogs in it.  The cache is not
+   * owned.  To be set before Init().
+   */
+  void SetCatalogCache(CatalogCache *catalog_cache) {
+    catalog_cache_ = catalog_cache;
+  }
   /**
    * TODO
    */
@@ -149,6 +212,10 @@ class WritableCatalogManager : public SimpleCatalogManager {
  protected:
   void EnforceSqliteMemLimit() { }
 
+  virtual LoadError LoadCatalog(const PathString  &mountpoint,
+                                const shash::Any  &hash,
+                                std::string       *catalog_path,
+                                shash::Any        *catalog_hash);
   Catalog *CreateCatalog(const PathString &mountpoint,
                          const shash::Any &catalog_hash,
                          Catalog *parent_catalog);
@@ -175,9 +242,20 @@ class WritableCatalogManager : public SimpleCatalogManager {
   struct CatalogUploadContext {
     Future<CatalogInfo>* root_catalog_info;
     bool                 stop_for_tweaks;
+    /**
+     * Receives the parent catalogs whose dirty children are all uploaded
+     */
+    FifoChannel<WritableCatalog *> *finalize_queue;
+  };
+
+  struct FinalizeWorkerContext {
+    WritableCatalogManager         *catalog_manager;
+    FifoChannel<WritableCatalog *> *finalize_queue;
+    bool                            stop_for_tweaks;
   };
 
   CatalogInfo SnapshotCatalogs(const bool stop_for_tweaks);
+  static void *MainFinalizeWorker(void *data);
   void FinalizeCatalog(WritableCatalog *catalog,
                        const bool stop_for_tweaks);
   void ScheduleCatalogProcessing(WritableCatalog *catalog);
@@ -192,6 +270,23 @@ class WritableCatalogManager : public SimpleCatalogManager {
 
   void CatalogUploadCallback(const upload::SpoolerResult &result,
                              const CatalogUploadContext   clg_upload_context);
+  bool DownloadPreviousRevision(const shash::Any &hash, std::string *catalog);
+  void CreateCatalogDelta(WritableCatalog *catalog,
+                          const shash::Any &content_hash);
+  void UpdateCatalogIndex(WritableCatalog *catalog);
+  void UpdateNestedCatalogIndex(WritableCatalog *root_catalog);
+  bool CollectNestedCatalogs(const Catalog *catalog,
+                             const NestedCatalogIndex *previous_index,
+                             Catalog::NestedCatalogList *result);
+  bool CollectRemoteNestedCatalogs(const Catalog::NestedCatalog &nested,
+                                   const NestedCatalogIndex *previous_index,
+                                   Catalog::NestedCatalogList *result);
+  NestedCatalogIndex *DownloadNestedCatalogIndex(const shash::Any &hash);
+  bool StoreCompressedObject(const std::string &content,
+                             const std::string &name,
+                             shash::Any *hash,
+                             std::string *path);
+  void UploadPendingObjects();
 
  private:
   inline void SyncLock() { pthread_mutex_lock(sync_lock_); }
@@ -222,6 +317,18 @@ class WritableCatalogManager : public SimpleCatalogManager {
   pthread_mutex_t                         *catalog_processing_lock_;
   std::map<std::string, WritableCatalog*>  catalog_processing_map_;
 
+  bool generate_deltas_;
+  bool generate_indexes_;
+  bool generate_nested_index_;
+  bool cluster_catalogs_;
+  bool lazy_vacuum_;
+  CatalogCache *catalog_cache_;
+  /**
+   * Local and remote paths of the deltas and indexes to be uploaded after the
+   * catalogs, protected by catalog_processing_lock_
+   */
+  std::vector<std::pair<std::string, std::string> > pending_uploads_;
+
   // TODO(jblomer): catalog limits should become its own struct
   bool enforce_limits_;
   unsigned nested_kcatalog_limit_;
@@ -261,6 +368,11 @@ class WritableCatalogManager : public SimpleCatalogManager {
    * min_weight. By default it is set to max_weight / 2.
    */
   const unsigned balance_weight_;
+
+  unsigned max_staged_dirents_;
+  DirentStagingStatistics staging_statistics_;
+
+  const AccessProfile *access_profile_;
 };  // class WritableCatalogManager
 
 }  // namespace catalog
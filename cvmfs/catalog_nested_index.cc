@@ -0,0 +1,288 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "catalog_nested_index.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+const char *NestedCatalogIndex::kPropertyKey = "nested_index";
+
+namespace {
+
+const char kMagic[] = "CVMFSNX1";
+const unsigned kMagicSize = 8;
+// Magic, number of catalogs, heap size
+const unsigned kHeaderSize = kMagicSize + 4 + 4;
+
+// Layout of the catalog records
+const unsigned kOffMountpoint = 0;
+const unsigned kOffMountpointLength = 4;
+const unsigned kOffSize = 8;
+const unsigned kOffHashAlgorithm = 16;
+const unsigned kOffHashSuffix = 17;
+const unsigned kOffDigest = 20;
+const unsigned kRecordSize = kOffDigest + shash::kMaxDigestSize;
+
+void PutUint(const uint64_t value, const unsigned nbytes, unsigned char *buf) {
+  for (unsigned i = 0; i < nbytes; ++i)
+    buf[i] = static_cast<unsigned char>((value >> (8 * i)) & 0xff);
+}
+
+void AppendUint(const uint64_t value, const unsigned nbytes, string *buf) {
+  unsigned char bytes[8];
+  PutUint(value, nbytes, bytes);
+  buf->append(reinterpret_cast<char *>(bytes), nbytes);
+}
+
+uint64_t GetUint(const unsigned char *buf, const unsigned nbytes) {
+  uint64_t result = 0;
+  for (unsigned i = 0; i < nbytes; ++i)
+    result |= static_cast<uint64_t>(buf[i]) << (8 * i);
+  return result;
+}
+
+int CompareStrings(const char *a, const unsigned length_a,
+                   const char *b, const unsigned length_b)
+{
+  const int cmp = memcmp(a, b, std::min(length_a, length_b));
+  if (cmp != 0)
+    return cmp;
+  return (length_a < length_b) ? -1 : ((length_a > length_b) ? 1 : 0);
+}
+
+bool CompareNested(const Catalog::NestedCatalog *a,
+                   const Catalog::NestedCatalog *b)
+{
+  return CompareStrings(a->mountpoint.GetChars(), a->mountpoint.GetLength(),
+                        b->mountpoint.GetChars(),
+                        b->mountpoint.GetLength()) < 0;
+}
+
+}  // anonymous namespace
+
+
+void NestedCatalogIndex::Build(
+  const Catalog::NestedCatalogList &catalogs,
+  string *index)
+{
+  vector<const Catalog::NestedCatalog *> sorted;
+  sorted.reserve(catalogs.size());
+  for (unsigned i = 0; i < catalogs.size(); ++i)
+    sorted.push_back(&catalogs[i]);
+  sort(sorted.begin(), sorted.end(), CompareNested);
+
+  string heap;
+  index->clear();
+  index->reserve(kHeaderSize + sorted.size() * (kRecordSize + 32));
+  index->append(kMagic, kMagicSize);
+  AppendUint(sorted.size(), 4, index);
+  AppendUint(0, 4, index);  // heap size, set below
+  for (unsigned i = 0; i < sorted.size(); ++i) {
+    const Catalog::NestedCatalog &nested = *sorted[i];
+    unsigned char record[kRecordSize];
+    memset(record, 0, kRecordSize);
+    PutUint(heap.size(), 4, record + kOffMountpoint);
+    PutUint(nested.mountpoint.GetLength(), 4, record + kOffMountpointLength);
+    heap.append(nested.mountpoint.GetChars(), nested.mountpoint.GetLength());
+    PutUint(nested.size, 8, record + kOffSize);
+    record[kOffHashAlgorithm] = nested.hash.algorithm;
+    record[kOffHashSuffix] = nested.hash.suffix;
+    memcpy(record + kOffDigest, nested.hash.digest,
+           nested.hash.GetDigestSize());
+    index->append(reinterpret_cast<char *>(record), kRecordSize);
+  }
+  unsigned char heap_size[4];
+  PutUint(heap.size(), 4, heap_size);
+  index->replace(kMagicSize + 4, 4, reinterpret_cast<char *>(heap_size), 4);
+  index->append(heap);
+}
+
+
+NestedCatalogIndex *NestedCatalogIndex::Create(
+  unsigned char *buffer,
+  const uint64_t size)
+{
+  NestedCatalogIndex *index = new NestedCatalogIndex(buffer, size);
+  if (!index->Validate()) {
+    delete index;
+    return NULL;
+  }
+  return index;
+}
+
+
+NestedCatalogIndex::NestedCatalogIndex(
+  unsigned char *buffer,
+  const uint64_t size)
+  : buffer_(buffer)
+  , size_(size)
+  , num_catalogs_(0)
+  , heap_size_(0)
+  , records_(NULL)
+  , heap_(NULL)
+{
+  if (size_ < kHeaderSize)
+    return;
+  num_catalogs_ = GetUint(buffer_ + kMagicSize, 4);
+  heap_size_ = GetUint(buffer_ + kMagicSize + 4, 4);
+  records_ = buffer_ + kHeaderSize;
+  heap_ = records_ + uint64_t(num_catalogs_) * kRecordSize;
+}
+
+
+NestedCatalogIndex::~NestedCatalogIndex() {
+  free(buffer_);
+}
+
+
+/**
+ * Checks the bounds of all the references and the sort order, so that lookups
+ * do not need to.
+ */
+bool NestedCatalogIndex::Validate() const {
+  if ((size_ < kHeaderSize) || (memcmp(buffer_, kMagic, kMagicSize) != 0))
+    return false;
+  if (size_ != kHeaderSize + uint64_t(num_catalogs_) * kRecordSize +
+               heap_size_)
+  {
+    return false;
+  }
+  for (uint32_t i = 0; i < num_catalogs_; ++i) {
+    const unsigned char *record = GetRecord(i);
+    const uint64_t mountpoint_end = GetUint(record + kOffMountpoint, 4) +
+                                    GetUint(record + kOffMountpointLength, 4);
+    if ((mountpoint_end > heap_size_) ||
+        (record[kOffHashAlgorithm] >= shash::kAny))
+    {
+      return false;
+    }
+    if (i > 0) {
+      const unsigned char *previous = GetRecord(i - 1);
+      const char *name = reinterpret_cast<const char *>(
+        heap_ + GetUint(previous + kOffMountpoint, 4));
+      if (CompareMountpoint(i, name,
+                            GetUint(previous + kOffMountpointLength, 4)) <= 0)
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+const unsigned char *NestedCatalogIndex::GetRecord(
+  const uint32_t position) const
+{
+  return records_ + uint64_t(position) * kRecordSize;
+}
+
+
+int NestedCatalogIndex::CompareMountpoint(
+  const uint32_t position,
+  const char *mountpoint,
+  const unsigned length) const
+{
+  const unsigned char *record = GetRecord(position);
+  return CompareStrings(
+    reinterpret_cast<const char *>(heap_ + GetUint(record + kOffMountpoint, 4)),
+    GetUint(record + kOffMountpointLength, 4), mountpoint, length);
+}
+
+
+/**
+ * Position of the first record that is not smaller than mountpoint
+ */
+uint32_t NestedCatalogIndex::LowerBound(
+  const char *mountpoint,
+  const unsigned length) const
+{
+  uint32_t low = 0;
+  uint32_t high = num_catalogs_;
+  while (low < high) {
+    const uint32_t mid = low + (high - low) / 2;
+    if (CompareMountpoint(mid, mountpoint, length) < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+
+void NestedCatalogIndex::GetNested(
+  const uint32_t position,
+  Catalog::NestedCatalog *nested) const
+{
+  const unsigned char *record = GetRecord(position);
+  nested->mountpoint.Assign(
+    reinterpret_cast<const char *>(heap_ + GetUint(record + kOffMountpoint, 4)),
+    GetUint(record + kOffMountpointLength, 4));
+  nested->size = GetUint(record + kOffSize, 8);
+  nested->hash = shash::Any(
+    static_cast<shash::Algorithms>(record[kOffHashAlgorithm]),
+    record + kOffDigest, record[kOffHashSuffix]);
+}
+
+
+bool NestedCatalogIndex::Find(
+  const PathString &mountpoint,
+  Catalog::NestedCatalog *nested) const
+{
+  const uint32_t position =
+    LowerBound(mountpoint.GetChars(), mountpoint.GetLength());
+  if ((position == num_catalogs_) ||
+      (CompareMountpoint(position, mountpoint.GetChars(),
+                         mountpoint.GetLength()) != 0))
+  {
+    return false;
+  }
+  GetNested(position, nested);
+  return true;
+}
+
+
+void NestedCatalogIndex::FindChain(
+  const PathString &base_mountpoint,
+  const PathString &path,
+  Catalog::NestedCatalogList *chain) const
+{
+  const char *chars = path.GetChars();
+  const unsigned length = path.GetLength();
+  Catalog::NestedCatalog nested;
+  // Every path prefix that ends at a path component is a candidate
+  for (unsigned i = base_mountpoint.GetLength() + 1; i <= length; ++i) {
+    if ((i < length) && (chars[i] != '/'))
+      continue;
+    if (Find(PathString(chars, i), &nested))
+      chain->push_back(nested);
+  }
+}
+
+
+void NestedCatalogIndex::ListSubtree(
+  const PathString &mountpoint,
+  Catalog::NestedCatalogList *result) const
+{
+  PathString prefix(mountpoint);
+  prefix.Append("/", 1);
+  Catalog::NestedCatalog nested;
+  for (uint32_t i = LowerBound(prefix.GetChars(), prefix.GetLength());
+       i < num_catalogs_; ++i)
+  {
+    GetNested(i, &nested);
+    if (!nested.mountpoint.StartsWith(prefix))
+      break;
+    result->push_back(nested);
+  }
+}
+
+}  // namespace catalog
@@ -0,0 +1,88 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_CATALOG_NESTED_INDEX_H_
+#define CVMFS_CATALOG_NESTED_INDEX_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "catalog.h"
+#include "shortstring.h"
+#include "util/single_copy.h"
+
+namespace catalog {
+
+/**
+ * Maps the mountpoints of all the nested catalogs of a repository revision to
+ * their content hashes and sizes.  It is produced by the publisher together
+ * with the root catalog and stored as a regular content-addressed object; the
+ * root catalog refers to it by the kPropertyKey property.  Without the index,
+ * the hash of a nested catalog is only known once its parent is opened.  With
+ * the index, clients know the entire chain of catalogs down to a path upfront
+ * and can download them concurrently.  The index only gives hints: catalogs
+ * are still mounted by the hashes in their parent catalogs.
+ *
+ * All the columns have a fixed width, multi-byte integers are little endian:
+ *   - Header: magic, number of catalogs, size of the name heap
+ *   - Catalog records, sorted by mountpoint for binary search
+ *   - Name heap: the mountpoints of all the catalogs
+ */
+class NestedCatalogIndex : SingleCopy {
+ public:
+  static const char *kPropertyKey;
+
+  /**
+   * Encodes the given nested catalogs.  The root catalog is not part of the
+   * index.
+   */
+  static void Build(const Catalog::NestedCatalogList &catalogs,
+                    std::string *index);
+  /**
+   * Takes ownership of the malloc'd buffer.  Returns NULL if the buffer is not
+   * a valid index.
+   */
+  static NestedCatalogIndex *Create(unsigned char *buffer,
+                                    const uint64_t size);
+  ~NestedCatalogIndex();
+
+  bool Find(const PathString &mountpoint,
+            Catalog::NestedCatalog *nested) const;
+  /**
+   * The catalogs of the chain from the root catalog down to path that are
+   * mounted below base_mountpoint, outermost first.
+   */
+  void FindChain(const PathString &base_mountpoint, const PathString &path,
+                 Catalog::NestedCatalogList *chain) const;
+  /**
+   * All the catalogs mounted (transitively) below mountpoint.
+   */
+  void ListSubtree(const PathString &mountpoint,
+                   Catalog::NestedCatalogList *result) const;
+
+  uint32_t num_catalogs() const { return num_catalogs_; }
+  uint64_t size() const { return size_; }
+
+ private:
+  NestedCatalogIndex(unsigned char *buffer, const uint64_t size);
+  bool Validate() const;
+  const unsigned char *GetRecord(const uint32_t position) const;
+  int CompareMountpoint(const uint32_t position,
+                        const char *mountpoint, const unsigned length) const;
+  uint32_t LowerBound(const char *mountpoint, const unsigned length) const;
+  void GetNested(const uint32_t position,
+                 Catalog::NestedCatalog *nested) const;
+
+  unsigned char *buffer_;
+  uint64_t size_;
+  uint32_t num_catalogs_;
+  uint32_t heap_size_;
+  const unsigned char *records_;
+  const unsigned char *heap_;
+};
+
+}  // namespace catalog
+
+#endif  // CVMFS_CATALOG_NESTED_INDEX_H_
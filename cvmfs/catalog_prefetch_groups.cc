@@ -0,0 +1,204 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "catalog_prefetch_groups.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+
+#include "catalog_access_profile.h"
+#include "hash.h"
+#include "logging.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+namespace {
+
+/**
+ * Event codes of the tracer, see tracer.h
+ */
+const int kTracerEventStart = -1;
+const int kTracerEventOpen = 1;
+
+}  // anonymous namespace
+
+
+/**
+ * Group ids are non-zero, positive 64 bit integers.
+ */
+uint64_t PrefetchGroups::MakeGroupId(const string &key) {
+  shash::Md5 md5((shash::AsciiPtr(key)));
+  uint64_t lo, hi;
+  md5.ToIntPair(&lo, &hi);
+  const uint64_t group_id = lo & 0x7FFFFFFFFFFFFFFFULL;
+  return (group_id == 0) ? 1 : group_id;
+}
+
+
+bool PrefetchGroups::LoadPatterns(const string &path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LogCvmfs(kLogCatalog, kLogStderr,
+             "cannot open prefetch group patterns %s (errno: %d)",
+             path.c_str(), errno);
+    return false;
+  }
+  string patterns;
+  const bool retval = SafeReadToString(fd, &patterns);
+  close(fd);
+  if (!retval) {
+    LogCvmfs(kLogCatalog, kLogStderr, "cannot read prefetch group patterns %s",
+             path.c_str());
+    return false;
+  }
+  return LoadPatternsFromString(patterns);
+}
+
+
+bool PrefetchGroups::LoadPatternsFromString(const string &patterns) {
+  off_t line_offset = 0;
+  while (line_offset < static_cast<off_t>(patterns.size())) {
+    const string line = GetLineMem(patterns.data() + line_offset,
+                                   patterns.size() - line_offset);
+    line_offset += line.size() + 1;  // +1 == skipped \n
+    const string spec = Trim(line.substr(0, line.find(kCommentMarker)));
+    if (spec.empty())
+      continue;
+    Pathspec pathspec(spec);
+    if (!pathspec.IsValid()) {
+      LogCvmfs(kLogCatalog, kLogStderr, "invalid prefetch group pattern: %s",
+               line.c_str());
+      return false;
+    }
+    patterns_.push_back(make_pair(pathspec, spec));
+  }
+  return true;
+}
+
+
+uint64_t PrefetchGroups::GetGroupId(const string &path) const {
+  for (unsigned i = 0; i < patterns_.size(); ++i) {
+    if (patterns_[i].first.IsMatchingRelaxed(path))
+      return MakeGroupId(patterns_[i].second + "\n" + GetParentPath(path));
+  }
+  return 0;
+}
+
+
+/**
+ * Adds the bursts of a single run to the votes.  Only the first open() of a
+ * file counts.
+ */
+void PrefetchGroups::CountRun(
+  const vector<pair<double, string> > &run,
+  Votes *votes)
+{
+  // Directory --> start time and leader of the current burst
+  map<string, pair<double, string> > bursts;
+  set<string> opened_paths;
+  for (unsigned i = 0; i < run.size(); ++i) {
+    const double timestamp = run[i].first;
+    const string &path = run[i].second;
+    if (!opened_paths.insert(path).second)
+      continue;
+
+    const string directory = GetParentPath(path);
+    map<string, pair<double, string> >::iterator burst =
+      bursts.find(directory);
+    if ((burst == bursts.end()) ||
+        (timestamp - burst->second.first > kBurstWindow))
+    {
+      bursts[directory] = make_pair(timestamp, path);
+      (*votes)[path][path]++;
+    } else {
+      (*votes)[path][burst->second.second]++;
+    }
+  }
+}
+
+
+bool PrefetchGroups::LoadTracerLog(const string &path) {
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL) {
+    LogCvmfs(kLogCatalog, kLogStderr, "failed to open trace log %s (%d)",
+             path.c_str(), errno);
+    return false;
+  }
+
+  Votes votes;
+  vector<pair<double, string> > run;
+  string line;
+  vector<string> fields;
+  unsigned num_lines = 0;
+  while (GetLineFile(f, &line)) {
+    ++num_lines;
+    if (!AccessProfile::ParseCsvLine(line, &fields) || (fields.size() < 3)) {
+      LogCvmfs(kLogCatalog, kLogStderr, "invalid line %u in trace log %s",
+               num_lines, path.c_str());
+      fclose(f);
+      return false;
+    }
+    const int64_t event = String2Int64(fields[1]);
+    if (event == kTracerEventStart) {
+      stable_sort(run.begin(), run.end());
+      CountRun(run, &votes);
+      run.clear();
+      continue;
+    }
+    if ((event != kTracerEventOpen) || fields[2].empty() ||
+        (fields[2][0] != '/'))
+    {
+      continue;
+    }
+    run.push_back(make_pair(strtod(fields[0].c_str(), NULL), fields[2]));
+  }
+  stable_sort(run.begin(), run.end());
+  CountRun(run, &votes);
+  fclose(f);
+
+  // Every file joins the leader with most votes, ties go to the smaller path
+  map<string, vector<string> > groups;
+  for (Votes::const_iterator i = votes.begin(), iEnd = votes.end();
+       i != iEnd; ++i)
+  {
+    map<string, unsigned>::const_iterator best = i->second.begin();
+    for (map<string, unsigned>::const_iterator j = i->second.begin(),
+         jEnd = i->second.end(); j != jEnd; ++j)
+    {
+      if (j->second > best->second)
+        best = j;
+    }
+    groups[best->first].push_back(i->first);
+  }
+
+  unsigned num_groups = 0;
+  for (map<string, vector<string> >::const_iterator i = groups.begin(),
+       iEnd = groups.end(); i != iEnd; ++i)
+  {
+    // A file on its own is fetched anyway
+    if (i->second.size() < 2)
+      continue;
+    const uint64_t group_id = MakeGroupId("trace\n" + i->first);
+    for (unsigned j = 0; j < i->second.size(); ++j)
+      traced_groups_[i->second[j]] = group_id;
+    num_groups++;
+  }
+
+  LogCvmfs(kLogCatalog, kLogDebug, "trace log %s: %u prefetch groups",
+           path.c_str(), num_groups);
+  return true;
+}
+
+}  // namespace catalog
@@ -0,0 +1,88 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * PrefetchGroups decides on the publisher which files clients fetch together.
+ * When a client opens any file of a group, it fetches the other files of the
+ * group in the background.  Groups are stored per catalog, in the
+ * prefetch_groups table, and are confined to a single directory.
+ *
+ * Groups are either declared by patterns or learned from client traces.
+ *
+ * The pattern file lists one pathspec per line, e.g.
+ *   # Shared libraries are loaded together
+ *   *.so*
+ *   *.py
+ * The regular files of a directory that match the same line form a group.
+ * Patterns are applied to the files that are published, so that existing
+ * files join their group when they are published again.
+ *
+ * Trace logs are in the tracer's CSV format, see tracer.h.  Within every run,
+ * the files of a directory that are opened within kBurstWindow seconds after
+ * the first file of the directory ("the leader") form a burst.  Every file
+ * joins the group of the leader that it followed most often.  Learned groups
+ * are applied to the existing files of the repository.
+ */
+
+#ifndef CVMFS_CATALOG_PREFETCH_GROUPS_H_
+#define CVMFS_CATALOG_PREFETCH_GROUPS_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "pathspec/pathspec.h"
+#include "util/single_copy.h"
+
+namespace catalog {
+
+class PrefetchGroups : SingleCopy {
+ public:
+  static const char kCommentMarker = '#';
+  /**
+   * Seconds after the first open() of a directory during which further opens
+   * in the same directory belong to the same burst
+   */
+  static const unsigned kBurstWindow = 2;
+
+  PrefetchGroups() { }
+
+  bool LoadPatterns(const std::string &path);
+  bool LoadPatternsFromString(const std::string &patterns);
+  bool LoadTracerLog(const std::string &path);
+
+  /**
+   * Returns the group of the first matching pattern for a path that starts
+   * with a slash, or 0 if no pattern matches.
+   */
+  uint64_t GetGroupId(const std::string &path) const;
+  /**
+   * Paths of the learned groups and their group ids
+   */
+  const std::map<std::string, uint64_t> &traced_groups() const {
+    return traced_groups_;
+  }
+  unsigned GetNumberOfPatterns() const { return patterns_.size(); }
+
+ private:
+  /**
+   * For every file, the number of bursts that were led by a given file
+   */
+  typedef std::map<std::string, std::map<std::string, unsigned> > Votes;
+
+  static uint64_t MakeGroupId(const std::string &key);
+  static void CountRun(const std::vector<std::pair<double, std::string> > &run,
+                       Votes *votes);
+
+  /**
+   * The pathspecs together with the text of their lines
+   */
+  std::vector<std::pair<Pathspec, std::string> > patterns_;
+  std::map<std::string, uint64_t> traced_groups_;
+};
+
+}  // namespace catalog
+
+#endif  // CVMFS_CATALOG_PREFETCH_GROUPS_H_
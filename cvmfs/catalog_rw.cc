@@ -7,10 +7,13 @@
 #include "catalog_rw.h"
 
 #include <inttypes.h>
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 
 #include "logging.h"
+#include "statistics.h"
+#include "util/algorithm.h"
 #include "util_concurrency.h"
 #include "xattr.h"
 
@@ -20,6 +23,22 @@ namespace catalog {
 
 const double WritableCatalog::kMaximalFreePageRatio = 0.20;
 const double WritableCatalog::kMaximalRowIdWasteRatio = 0.25;
+const double WritableCatalog::kLazyFreePageRatio = 0.5;
+const double WritableCatalog::kLazyRowIdWasteRatio = 0.5;
+
+
+DirentStagingStatistics::DirentStagingStatistics(
+  perf::Statistics *statistics)
+{
+  n_staged = statistics->Register("catalog_mgr_rw.n_dirents_staged",
+      "Number of directory entries inserted from the staging buffer");
+  n_unstaged = statistics->Register("catalog_mgr_rw.n_dirents_unstaged",
+      "Number of directory entries inserted without staging");
+  n_flushes = statistics->Register("catalog_mgr_rw.n_staging_flushes",
+      "Number of flushes of the directory entry staging buffer");
+  insert_time_us = statistics->Register("catalog_mgr_rw.dirent_insert_time_us",
+      "Time spent inserting new directory entries (us)");
+}
 
 
 WritableCatalog::WritableCatalog(const string      &path,
@@ -37,9 +56,19 @@ WritableCatalog::WritableCatalog(const string      &path,
   sql_chunk_insert_(NULL),
   sql_chunks_remove_(NULL),
   sql_chunks_count_(NULL),
+  sql_inline_data_insert_(NULL),
+  sql_inline_data_remove_(NULL),
+  sql_bundle_insert_(NULL),
+  sql_bundle_remove_(NULL),
+  sql_prefetch_group_insert_(NULL),
+  sql_prefetch_group_remove_(NULL),
+  sql_digest_tree_insert_(NULL),
+  sql_digest_tree_remove_(NULL),
   sql_max_link_id_(NULL),
   sql_inc_linkcount_(NULL),
-  dirty_(false)
+  dirty_(false),
+  max_staged_entries_(0),
+  staging_statistics_(NULL)
 {
   atomic_init32(&dirty_children_);
 }
@@ -77,6 +106,7 @@ void WritableCatalog::Transaction() {
 
 
 void WritableCatalog::Commit() {
+  FlushStagedEntries();
   LogCvmfs(kLogCatalog, kLogVerboseMsg, "closing SQLite transaction for '%s'",
                                         mountpoint().c_str());
   const bool retval = database().CommitTransaction();
@@ -97,6 +127,14 @@ void WritableCatalog::InitPreparedStatements() {
   sql_chunk_insert_  = new SqlChunkInsert      (database());
   sql_chunks_remove_ = new SqlChunksRemove     (database());
   sql_chunks_count_  = new SqlChunksCount      (database());
+  sql_inline_data_insert_ = new SqlInlineDataInsert(database());
+  sql_inline_data_remove_ = new SqlInlineDataRemove(database());
+  sql_bundle_insert_ = new SqlBundleInsert     (database());
+  sql_bundle_remove_ = new SqlBundleRemove     (database());
+  sql_prefetch_group_insert_ = new SqlPrefetchGroupInsert(database());
+  sql_prefetch_group_remove_ = new SqlPrefetchGroupRemove(database());
+  sql_digest_tree_insert_ = new SqlDigestTreeInsert(database());
+  sql_digest_tree_remove_ = new SqlDigestTreeRemove(database());
   sql_max_link_id_   = new SqlMaxHardlinkGroup (database());
   sql_inc_linkcount_ = new SqlIncLinkcount     (database());
 }
@@ -112,6 +150,14 @@ void WritableCatalog::FinalizePreparedStatements() {
   delete sql_chunk_insert_;
   delete sql_chunks_remove_;
   delete sql_chunks_count_;
+  delete sql_inline_data_insert_;
+  delete sql_inline_data_remove_;
+  delete sql_bundle_insert_;
+  delete sql_bundle_remove_;
+  delete sql_prefetch_group_insert_;
+  delete sql_prefetch_group_remove_;
+  delete sql_digest_tree_insert_;
+  delete sql_digest_tree_remove_;
   delete sql_max_link_id_;
   delete sql_inc_linkcount_;
 }
@@ -121,6 +167,7 @@ void WritableCatalog::FinalizePreparedStatements() {
  * Find out the maximal hardlink group id in this catalog.
  */
 uint32_t WritableCatalog::GetMaxLinkId() const {
+  FlushStagedEntries();
   int result = -1;
 
   if (sql_max_link_id_->FetchRow()) {
@@ -132,6 +179,115 @@ uint32_t WritableCatalog::GetMaxLinkId() const {
 }
 
 
+/**
+ * Sets the number of new entries that are buffered in memory before they are
+ * written to the database.  The statistics are optional.
+ */
+void WritableCatalog::SetStaging(
+  const unsigned max_staged_entries,
+  DirentStagingStatistics *statistics)
+{
+  FlushStagedEntries();
+  max_staged_entries_ = max_staged_entries;
+  staging_statistics_ = statistics;
+}
+
+
+/**
+ * Writes the staged entries, their file chunks, and their inline content sorted
+ * by path hash.  The
+ * inserts thus hit neighboring pages of the primary key index, which keeps the
+ * page cache of large catalogs effective.  Some statements, such as the
+ * removal or the update of an entry, need the staged entries in the database
+ * and flush, too.
+ */
+void WritableCatalog::FlushStagedEntries() const {
+  MutexLockGuard guard(lock_);
+  if (staged_entries_.empty())
+    return;
+
+  StopWatch stop_watch;
+  stop_watch.Start();
+
+  vector<const StagedEntry *> ordered_entries;
+  ordered_entries.reserve(staged_entries_.size());
+  for (unsigned i = 0; i < staged_entries_.size(); ++i)
+    ordered_entries.push_back(&staged_entries_[i]);
+  std::sort(ordered_entries.begin(), ordered_entries.end(),
+            StagedEntryOrder());
+
+  for (unsigned i = 0; i < ordered_entries.size(); ++i) {
+    const StagedEntry *staged = ordered_entries[i];
+    InsertDirent(staged->path_hash, staged->parent_hash, staged->entry,
+                 staged->xattrs);
+    for (unsigned j = 0; j < staged->chunks.size(); ++j)
+      InsertFileChunk(staged->path_hash, staged->chunks[j]);
+    if (staged->has_inline_data)
+      InsertInlineData(staged->path_hash, staged->inline_data);
+  }
+
+  stop_watch.Stop();
+  LogCvmfs(kLogCatalog, kLogVerboseMsg, "flushed %u staged entries of '%s'",
+           static_cast<unsigned>(staged_entries_.size()), mountpoint().c_str());
+  if (staging_statistics_ != NULL) {
+    perf::Inc(staging_statistics_->n_flushes);
+    perf::Xadd(staging_statistics_->n_staged, staged_entries_.size());
+    perf::Xadd(staging_statistics_->insert_time_us,
+               static_cast<int64_t>(stop_watch.GetTime() * 1000000.0));
+  }
+  staged_entries_.clear();
+}
+
+
+void WritableCatalog::InsertDirent(
+  const shash::Md5 &path_hash,
+  const shash::Md5 &parent_hash,
+  const DirectoryEntry &entry,
+  const XattrList &xattrs) const
+{
+  bool retval =
+    sql_insert_->BindPathHash(path_hash) &&
+    sql_insert_->BindParentPathHash(parent_hash) &&
+    sql_insert_->BindDirent(entry);
+  assert(retval);
+  if (xattrs.IsEmpty()) {
+    retval = sql_insert_->BindXattrEmpty();
+  } else {
+    retval = sql_insert_->BindXattr(xattrs);
+  }
+  assert(retval);
+  retval = sql_insert_->Execute();
+  assert(retval);
+  sql_insert_->Reset();
+}
+
+
+void WritableCatalog::InsertFileChunk(
+  const shash::Md5 &path_hash,
+  const FileChunk &chunk) const
+{
+  bool retval =
+    sql_chunk_insert_->BindPathHash(path_hash) &&
+    sql_chunk_insert_->BindFileChunk(chunk) &&
+    sql_chunk_insert_->Execute();
+  assert(retval);
+  sql_chunk_insert_->Reset();
+}
+
+
+void WritableCatalog::InsertInlineData(
+  const shash::Md5 &path_hash,
+  const std::string &data) const
+{
+  bool retval =
+    sql_inline_data_insert_->BindPathHash(path_hash) &&
+    sql_inline_data_insert_->BindData(data) &&
+    sql_inline_data_insert_->Execute();
+  assert(retval);
+  sql_inline_data_insert_->Reset();
+}
+
+
 /**
  * Adds a direcotry entry.
  * @param entry the DirectoryEntry to add to the catalog
@@ -154,23 +310,30 @@ void WritableCatalog::AddEntry(
   shash::Md5 parent_hash((shash::AsciiPtr(parent_path)));
   DirectoryEntry effective_entry(entry);
   effective_entry.set_has_xattrs(!xattrs.IsEmpty());
+  delta_counters_.Increment(effective_entry);
 
-  bool retval =
-    sql_insert_->BindPathHash(path_hash) &&
-    sql_insert_->BindParentPathHash(parent_hash) &&
-    sql_insert_->BindDirent(effective_entry);
-  assert(retval);
-  if (xattrs.IsEmpty()) {
-    retval = sql_insert_->BindXattrEmpty();
-  } else {
-    retval = sql_insert_->BindXattr(xattrs);
+  if (max_staged_entries_ == 0) {
+    StopWatch stop_watch;
+    stop_watch.Start();
+    InsertDirent(path_hash, parent_hash, effective_entry, xattrs);
+    stop_watch.Stop();
+    if (staging_statistics_ != NULL) {
+      perf::Inc(staging_statistics_->n_unstaged);
+      perf::Xadd(staging_statistics_->insert_time_us,
+                 static_cast<int64_t>(stop_watch.GetTime() * 1000000.0));
+    }
+    return;
   }
-  assert(retval);
-  retval = sql_insert_->Execute();
-  assert(retval);
-  sql_insert_->Reset();
 
-  delta_counters_.Increment(effective_entry);
+  bool is_full;
+  {
+    MutexLockGuard guard(lock_);
+    staged_entries_.push_back(
+      StagedEntry(path_hash, parent_hash, effective_entry, xattrs));
+    is_full = staged_entries_.size() >= max_staged_entries_;
+  }
+  if (is_full)
+    FlushStagedEntries();
 }
 
 
@@ -191,6 +354,16 @@ void WritableCatalog::RemoveEntry(const string &file_path) {
   if (entry.IsChunkedFile()) {
     RemoveFileChunks(file_path);
   }
+  if (entry.IsInlineFile()) {
+    RemoveInlineData(file_path);
+  }
+  if (entry.IsBundledFile()) {
+    RemoveBundle(file_path);
+  }
+  if (entry.IsRegular()) {
+    RemovePrefetchGroup(file_path);
+    RemoveDigestTree(file_path);
+  }
 
   // remove the entry itself
   shash::Md5 path_hash = shash::Md5(shash::AsciiPtr(file_path));
@@ -207,6 +380,7 @@ void WritableCatalog::RemoveEntry(const string &file_path) {
 void WritableCatalog::IncLinkcount(const string &path_within_group,
                                    const int delta)
 {
+  FlushStagedEntries();
   SetDirty();
 
   shash::Md5 path_hash = shash::Md5(shash::AsciiPtr(path_within_group));
@@ -222,6 +396,7 @@ void WritableCatalog::IncLinkcount(const string &path_within_group,
 
 void WritableCatalog::TouchEntry(const DirectoryEntryBase &entry,
                                  const shash::Md5 &path_hash) {
+  FlushStagedEntries();
   SetDirty();
 
   bool retval =
@@ -235,6 +410,7 @@ void WritableCatalog::TouchEntry(const DirectoryEntryBase &entry,
 
 void WritableCatalog::UpdateEntry(const DirectoryEntry &entry,
                                   const shash::Md5 &path_hash) {
+  FlushStagedEntries();
   SetDirty();
 
   bool retval =
@@ -259,12 +435,18 @@ void WritableCatalog::AddFileChunk(const std::string &entry_path,
 
   delta_counters_.self.file_chunks++;
 
-  bool retval =
-    sql_chunk_insert_->BindPathHash(path_hash) &&
-    sql_chunk_insert_->BindFileChunk(chunk) &&
-    sql_chunk_insert_->Execute();
-  assert(retval);
-  sql_chunk_insert_->Reset();
+  // Chunks are added right after their entry
+  {
+    MutexLockGuard guard(lock_);
+    if (!staged_entries_.empty() &&
+        (staged_entries_.back().path_hash == path_hash))
+    {
+      staged_entries_.back().chunks.push_back(chunk);
+      return;
+    }
+  }
+  FlushStagedEntries();
+  InsertFileChunk(path_hash, chunk);
 }
 
 
@@ -273,6 +455,7 @@ void WritableCatalog::AddFileChunk(const std::string &entry_path,
  * @param entry_path   the file path to clear from it's file chunks
  */
 void WritableCatalog::RemoveFileChunks(const std::string &entry_path) {
+  FlushStagedEntries();
   shash::Md5 path_hash((shash::AsciiPtr(entry_path)));
   bool retval;
 
@@ -294,6 +477,156 @@ void WritableCatalog::RemoveFileChunks(const std::string &entry_path) {
 }
 
 
+/**
+ * Stores the content of a small file in the catalog.  The entry needs to be
+ * marked as inline file and it needs to be added before its content.
+ */
+void WritableCatalog::AddInlineData(const std::string &entry_path,
+                                    const std::string &data)
+{
+  SetDirty();
+
+  shash::Md5 path_hash((shash::AsciiPtr(entry_path)));
+
+  LogCvmfs(kLogCatalog, kLogVerboseMsg, "adding %u bytes of inline data for %s",
+           static_cast<unsigned>(data.length()), entry_path.c_str());
+
+  // Like chunks, the data is added right after the entry
+  {
+    MutexLockGuard guard(lock_);
+    if (!staged_entries_.empty() &&
+        (staged_entries_.back().path_hash == path_hash))
+    {
+      staged_entries_.back().has_inline_data = true;
+      staged_entries_.back().inline_data = data;
+      return;
+    }
+  }
+  FlushStagedEntries();
+  InsertInlineData(path_hash, data);
+}
+
+
+void WritableCatalog::RemoveInlineData(const std::string &entry_path) {
+  FlushStagedEntries();
+  shash::Md5 path_hash((shash::AsciiPtr(entry_path)));
+  bool retval =
+    sql_inline_data_remove_->BindPathHash(path_hash) &&
+    sql_inline_data_remove_->Execute();
+  assert(retval);
+  sql_inline_data_remove_->Reset();
+}
+
+
+/**
+ * Records that the content of the file is also part of a bundle object, at the
+ * given offset of the serialized bundle.  Unlike inline data, bundles are
+ * created after all the files are processed, so the existing entry is marked
+ * as bundled file.
+ */
+void WritableCatalog::AddBundle(const std::string &entry_path,
+                                const shash::Any &bundle_hash,
+                                const uint64_t offset)
+{
+  SetDirty();
+
+  shash::Md5 path_hash((shash::AsciiPtr(entry_path)));
+  DirectoryEntry entry;
+  bool retval = LookupPath(PathString(entry_path), &entry);
+  assert(retval && entry.IsRegular() && !entry.IsChunkedFile());
+  if (!entry.IsBundledFile()) {
+    entry.set_is_bundled_file(true);
+    UpdateEntry(entry, path_hash);
+  }
+
+  retval =
+    sql_bundle_insert_->BindPathHash(path_hash) &&
+    sql_bundle_insert_->BindBundle(bundle_hash, offset) &&
+    sql_bundle_insert_->Execute();
+  assert(retval);
+  sql_bundle_insert_->Reset();
+}
+
+
+void WritableCatalog::RemoveBundle(const std::string &entry_path) {
+  FlushStagedEntries();
+  shash::Md5 path_hash((shash::AsciiPtr(entry_path)));
+  bool retval =
+    sql_bundle_remove_->BindPathHash(path_hash) &&
+    sql_bundle_remove_->Execute();
+  assert(retval);
+  sql_bundle_remove_->Reset();
+}
+
+
+/**
+ * Puts a regular file into a prefetch group.  Clients that open any file of
+ * the group fetch the other files of the group in the background.  Unchanged
+ * group memberships leave the catalog untouched.
+ */
+void WritableCatalog::AddPrefetchGroup(const std::string &entry_path,
+                                       const uint64_t group_id)
+{
+  uint64_t current_group_id;
+  if (LookupPrefetchGroupPath(PathString(entry_path), &current_group_id) &&
+      (current_group_id == group_id))
+  {
+    return;
+  }
+  SetDirty();
+
+  shash::Md5 path_hash((shash::AsciiPtr(entry_path)));
+  bool retval =
+    sql_prefetch_group_insert_->BindPathHash(path_hash) &&
+    sql_prefetch_group_insert_->BindGroup(group_id, entry_path) &&
+    sql_prefetch_group_insert_->Execute();
+  assert(retval);
+  sql_prefetch_group_insert_->Reset();
+}
+
+
+void WritableCatalog::RemovePrefetchGroup(const std::string &entry_path) {
+  FlushStagedEntries();
+  shash::Md5 path_hash((shash::AsciiPtr(entry_path)));
+  bool retval =
+    sql_prefetch_group_remove_->BindPathHash(path_hash) &&
+    sql_prefetch_group_remove_->Execute();
+  assert(retval);
+  sql_prefetch_group_remove_->Reset();
+}
+
+
+/**
+ * Stores the serialized block digests of a regular file, which lets clients
+ * verify range requests of the file.  The entry needs to be added first.
+ */
+void WritableCatalog::AddDigestTree(const std::string &entry_path,
+                                    const std::string &tree)
+{
+  SetDirty();
+
+  shash::Md5 path_hash((shash::AsciiPtr(entry_path)));
+  FlushStagedEntries();
+  bool retval =
+    sql_digest_tree_insert_->BindPathHash(path_hash) &&
+    sql_digest_tree_insert_->BindTree(tree) &&
+    sql_digest_tree_insert_->Execute();
+  assert(retval);
+  sql_digest_tree_insert_->Reset();
+}
+
+
+void WritableCatalog::RemoveDigestTree(const std::string &entry_path) {
+  FlushStagedEntries();
+  shash::Md5 path_hash((shash::AsciiPtr(entry_path)));
+  bool retval =
+    sql_digest_tree_remove_->BindPathHash(path_hash) &&
+    sql_digest_tree_remove_->Execute();
+  assert(retval);
+  sql_digest_tree_remove_->Reset();
+}
+
+
 /**
  * Sets the last modified time stamp of this catalog to current time.
  */
@@ -330,6 +663,20 @@ bool WritableCatalog::SetVOMSAuthz(const std::string &voms_authz) {
 }
 
 
+/**
+ * The serial number of the last tag change of the repository history that is
+ * reflected in the snapshots of the virtual catalog, 0 if unknown.
+ */
+uint64_t WritableCatalog::GetTagChangeSerial() const {
+  return database().GetPropertyDefault<uint64_t>("tag_change_serial", 0);
+}
+
+
+void WritableCatalog::SetTagChangeSerial(const uint64_t serial) {
+  database().SetProperty("tag_change_serial", serial);
+}
+
+
 /**
  * Sets the content hash of the previous catalog revision.
  */
@@ -429,6 +776,31 @@ void WritableCatalog::MoveToNestedRecursively(
     } else if (i->IsChunkedFile()) {
       MoveFileChunksToNested(full_path, i->hash_algorithm(),
                              new_nested_catalog);
+    } else if (i->IsInlineFile()) {
+      string data;
+      retval = LookupInlineDataPath(PathString(full_path), &data);
+      assert(retval);
+      new_nested_catalog->AddInlineData(full_path, data);
+    }
+    if (i->IsBundledFile()) {
+      shash::Any bundle_hash;
+      uint64_t offset;
+      retval = LookupBundlePath(PathString(full_path), i->hash_algorithm(),
+                                &bundle_hash, &offset);
+      assert(retval);
+      new_nested_catalog->AddBundle(full_path, bundle_hash, offset);
+    }
+    uint64_t group_id;
+    if (i->IsRegular() &&
+        LookupPrefetchGroupPath(PathString(full_path), &group_id))
+    {
+      new_nested_catalog->AddPrefetchGroup(full_path, group_id);
+    }
+    string digest_tree;
+    if (i->IsRegular() &&
+        LookupDigestTreePath(PathString(full_path), &digest_tree))
+    {
+      new_nested_catalog->AddDigestTree(full_path, digest_tree);
     }
 
     // Remove the entry from the current catalog
@@ -677,6 +1049,7 @@ void WritableCatalog::CopyToParent() {
   //         therefore we delete the mount point from the parent before merging
 
   WritableCatalog *parent = GetWritableParent();
+  FlushStagedEntries();
 
   // Update hardlink group IDs in this nested catalog.
   // To avoid collisions we add the maximal present hardlink group ID in parent
@@ -710,6 +1083,20 @@ void WritableCatalog::CopyToParent() {
   retval = SqlCatalog(database(), "INSERT INTO other.chunks "
                                   "SELECT * FROM main.chunks;").Execute();
   assert(retval);
+  retval = SqlCatalog(database(), "INSERT INTO other.inline_data "
+                                  "SELECT * FROM main.inline_data;").Execute();
+  assert(retval);
+  retval = SqlCatalog(database(), "INSERT INTO other.bundles "
+                                  "SELECT * FROM main.bundles;").Execute();
+  assert(retval);
+  retval = SqlCatalog(database(), "INSERT INTO other.prefetch_groups "
+                                  "SELECT * FROM main.prefetch_groups;")
+                                  .Execute();
+  assert(retval);
+  retval = SqlCatalog(database(), "INSERT INTO other.digest_trees "
+                                  "SELECT * FROM main.digest_trees;")
+                                  .Execute();
+  assert(retval);
   retval = SqlCatalog(database(), "DETACH other;").Execute();
   assert(retval);
   parent->SetDirty();
@@ -740,20 +1127,77 @@ void WritableCatalog::UpdateCounters() {
 }
 
 
+/**
+ * Catalogs from before schema revision 7, and catalogs that took over the
+ * entries of such a nested catalog, miss the summary statistics of their own
+ * entries.  These are recomputed from the catalog table.  The difference to
+ * the stored counters goes into delta_counters_, so that it is propagated to
+ * the subtree counters of the parent catalogs like any other change.
+ */
+void WritableCatalog::SummarizeIfNecessary() {
+  const Counters &counters = GetCounters();
+  const DeltaCounters_t unsummarized =
+    static_cast<DeltaCounters_t>(counters.self.unsummarized) +
+    delta_counters_.self.unsummarized;
+  if (unsummarized == 0)
+    return;
+
+  LogCvmfs(kLogCatalog, kLogVerboseMsg, "computing summary of catalog '%s'",
+           mountpoint().c_str());
+  FlushStagedEntries();
+  SqlCatalog sql_files(database(),
+    "SELECT size, flags FROM catalog "
+    "WHERE (flags & :flag_file) AND NOT (flags & :flag_link);");
+  bool retval = sql_files.BindInt64(1, SqlDirent::kFlagFile) &&
+                sql_files.BindInt64(2, SqlDirent::kFlagLink);
+  assert(retval);
+  DeltaCounters_t inline_files = 0;
+  DeltaCounters_t bundled_files = 0;
+  DeltaCounters_t size_bins[kNumSizeBins];
+  for (unsigned i = 0; i < kNumSizeBins; ++i)
+    size_bins[i] = 0;
+  while (sql_files.FetchRow()) {
+    const uint64_t size = sql_files.RetrieveInt64(0);
+    const int flags = sql_files.RetrieveInt(1);
+    size_bins[GetSizeBin(size)]++;
+    if (flags & SqlDirent::kFlagFileInline)
+      inline_files++;
+    if (flags & SqlDirent::kFlagFileBundle)
+      bundled_files++;
+  }
+  assert(sql_files.GetLastError() == SQLITE_DONE);
+
+  delta_counters_.self.inline_files = inline_files - counters.self.inline_files;
+  delta_counters_.self.bundled_files =
+    bundled_files - counters.self.bundled_files;
+  for (unsigned i = 0; i < kNumSizeBins; ++i) {
+    delta_counters_.self.size_bins[i] =
+      size_bins[i] - counters.self.size_bins[i];
+  }
+  delta_counters_.self.unsummarized =
+    -static_cast<DeltaCounters_t>(counters.self.unsummarized);
+}
+
+
 /**
  * Checks if the database of this catalogs needs cleanup and defragments it
- * if necessary
+ * if necessary.  In lazy mode, the database may accumulate more waste before
+ * it gets rewritten.
  */
-void WritableCatalog::VacuumDatabaseIfNecessary() {
+void WritableCatalog::VacuumDatabaseIfNecessary(const bool lazy) {
   const CatalogDatabase &db = database();
   bool        needs_defragmentation = false;
   double      ratio                 = 0.0;
   std::string reason;
+  const double max_free_page_ratio =
+    lazy ? kLazyFreePageRatio : kMaximalFreePageRatio;
+  const double max_row_id_waste_ratio =
+    lazy ? kLazyRowIdWasteRatio : kMaximalRowIdWasteRatio;
 
-  if ((ratio = db.GetFreePageRatio()) > kMaximalFreePageRatio) {
+  if ((ratio = db.GetFreePageRatio()) > max_free_page_ratio) {
     needs_defragmentation = true;
     reason                = "free pages";
-  } else if ((ratio = db.GetRowIdWasteRatio()) > kMaximalRowIdWasteRatio) {
+  } else if ((ratio = db.GetRowIdWasteRatio()) > max_row_id_waste_ratio) {
     needs_defragmentation = true;
     reason                = "wasted row IDs";
   }
@@ -773,4 +1217,21 @@ void WritableCatalog::VacuumDatabaseIfNecessary() {
   }
 }
 
+
+/**
+ * Unconditionally rebuilds the database with the rows ordered by parent
+ * directory.  This also defragments the database.
+ */
+void WritableCatalog::ClusterDatabase() {
+  const CatalogDatabase &db = database();
+  LogCvmfs(kLogCatalog, kLogVerboseMsg, "clustering catalog at %s",
+           (IsRoot()) ? "/" : mountpoint().c_str());
+  if (!db.ClusterByParent()) {
+    LogCvmfs(kLogCatalog, kLogStderr, "failed to cluster catalog at %s "
+             "(SQLite: %s)", (IsRoot()) ? "/" : mountpoint().c_str(),
+             db.GetLastErrorMsg().c_str());
+    assert(false);
+  }
+}
+
 }  // namespace catalog
@@ -9,6 +9,10 @@
  *  - UpdateEntry
  *  - RemoveEntry
  *
+ * New directory entries can be staged in memory.  They are written in path
+ * hash order, which is the order of the primary key, when the staging buffer
+ * fills up, before the catalog is read, and when the catalog is committed.
+ *
  * Catalogs not thread safe.
  */
 
@@ -25,6 +29,11 @@
 
 class XattrList;
 
+namespace perf {
+class Counter;
+class Statistics;
+}
+
 namespace swissknife {
 class CommandMigrate;
 }
@@ -33,6 +42,21 @@ namespace catalog {
 
 class WritableCatalogManager;
 
+/**
+ * Counters of the directory entry staging, shared by all the catalogs of a
+ * catalog manager.  The number of unstaged entries and the insert time allow
+ * for comparing publish runs with and without staging.
+ */
+struct DirentStagingStatistics {
+  perf::Counter *n_staged;
+  perf::Counter *n_unstaged;
+  perf::Counter *n_flushes;
+  perf::Counter *insert_time_us;
+
+  explicit DirentStagingStatistics(perf::Statistics *statistics);
+};
+
+
 class WritableCatalog : public Catalog {
   friend class WritableCatalogManager;
   friend class swissknife::CommandMigrate;  // needed for catalog migrations
@@ -58,6 +82,9 @@ class WritableCatalog : public Catalog {
   inline bool IsWritable() const { return true; }
   uint32_t GetMaxLinkId() const;
 
+  void SetStaging(const unsigned max_staged_entries,
+                  DirentStagingStatistics *statistics);
+
   void AddEntry(const DirectoryEntry &entry,
                 const XattrList &xattr,
                 const std::string &entry_path,
@@ -73,6 +100,17 @@ class WritableCatalog : public Catalog {
   void IncLinkcount(const std::string &path_within_group, const int delta);
   void AddFileChunk(const std::string &entry_path, const FileChunk &chunk);
   void RemoveFileChunks(const std::string &entry_path);
+  void AddInlineData(const std::string &entry_path, const std::string &data);
+  void RemoveInlineData(const std::string &entry_path);
+  void AddBundle(const std::string &entry_path,
+                 const shash::Any &bundle_hash,
+                 const uint64_t offset);
+  void RemoveBundle(const std::string &entry_path);
+  void AddPrefetchGroup(const std::string &entry_path,
+                        const uint64_t group_id);
+  void RemovePrefetchGroup(const std::string &entry_path);
+  void AddDigestTree(const std::string &entry_path, const std::string &tree);
+  void RemoveDigestTree(const std::string &entry_path);
 
   // Creation and removal of catalogs
   void Partition(WritableCatalog *new_nested_catalog);
@@ -101,10 +139,14 @@ class WritableCatalog : public Catalog {
   void SetPreviousRevision(const shash::Any &hash);
   void SetTTL(const uint64_t new_ttl);
   bool SetVOMSAuthz(const std::string &voms_authz);
+  uint64_t GetTagChangeSerial() const;
+  void SetTagChangeSerial(const uint64_t serial);
 
  protected:
   static const double kMaximalFreePageRatio;  // = 0.2
   static const double kMaximalRowIdWasteRatio;  // = 0.25;
+  static const double kLazyFreePageRatio;  // = 0.5
+  static const double kLazyRowIdWasteRatio;  // = 0.5
 
   CatalogDatabase::OpenMode DatabaseOpenMode() const {
     return CatalogDatabase::kOpenReadWrite;
@@ -129,6 +171,8 @@ class WritableCatalog : public Catalog {
   void InitPreparedStatements();
   void FinalizePreparedStatements();
 
+  void FlushStagedEntries() const;
+
   inline WritableCatalog* GetWritableParent() const {
     Catalog *parent = this->parent();
     assert(parent->IsWritable());
@@ -144,6 +188,36 @@ class WritableCatalog : public Catalog {
   }
 
  private:
+  /**
+   * A new directory entry together with its file chunks or inline content
+   */
+  struct StagedEntry {
+    StagedEntry(const shash::Md5 &path_hash,
+                const shash::Md5 &parent_hash,
+                const DirectoryEntry &entry,
+                const XattrList &xattrs)
+      : path_hash(path_hash)
+      , parent_hash(parent_hash)
+      , entry(entry)
+      , xattrs(xattrs)
+      , has_inline_data(false)
+    { }
+
+    shash::Md5 path_hash;
+    shash::Md5 parent_hash;
+    DirectoryEntry entry;
+    XattrList xattrs;
+    std::vector<FileChunk> chunks;
+    bool has_inline_data;
+    std::string inline_data;
+  };
+
+  struct StagedEntryOrder {
+    bool operator ()(const StagedEntry *a, const StagedEntry *b) const {
+      return a->path_hash < b->path_hash;
+    }
+  };
+
   SqlDirentInsert     *sql_insert_;
   SqlDirentUnlink     *sql_unlink_;
   SqlDirentTouch      *sql_touch_;
@@ -151,6 +225,14 @@ class WritableCatalog : public Catalog {
   SqlChunkInsert      *sql_chunk_insert_;
   SqlChunksRemove     *sql_chunks_remove_;
   SqlChunksCount      *sql_chunks_count_;
+  SqlInlineDataInsert *sql_inline_data_insert_;
+  SqlInlineDataRemove *sql_inline_data_remove_;
+  SqlBundleInsert     *sql_bundle_insert_;
+  SqlBundleRemove     *sql_bundle_remove_;
+  SqlPrefetchGroupInsert *sql_prefetch_group_insert_;
+  SqlPrefetchGroupRemove *sql_prefetch_group_remove_;
+  SqlDigestTreeInsert *sql_digest_tree_insert_;
+  SqlDigestTreeRemove *sql_digest_tree_remove_;
   SqlMaxHardlinkGroup *sql_max_link_id_;
   SqlIncLinkcount     *sql_inc_linkcount_;
 
@@ -158,6 +240,16 @@ class WritableCatalog : public Catalog {
 
   DeltaCounters delta_counters_;
 
+  /**
+   * Zero disables the staging of new entries
+   */
+  unsigned max_staged_entries_;
+  DirentStagingStatistics *staging_statistics_;
+  /**
+   * Protected by lock_ because readers flush the buffer
+   */
+  mutable std::vector<StagedEntry> staged_entries_;
+
   // parallel commit state
   mutable atomic_int32 dirty_children_;
 
@@ -167,6 +259,15 @@ class WritableCatalog : public Catalog {
     dirty_ = true;
   }
 
+  void InsertDirent(const shash::Md5 &path_hash,
+                    const shash::Md5 &parent_hash,
+                    const DirectoryEntry &entry,
+                    const XattrList &xattrs) const;
+  void InsertFileChunk(const shash::Md5 &path_hash,
+                       const FileChunk &chunk) const;
+  void InsertInlineData(const shash::Md5 &path_hash,
+                        const std::string &data) const;
+
   // Helpers for nested catalog creation and removal
   void MakeTransitionPoint(const std::string &mountpoint);
   void MakeNestedRoot();
@@ -193,7 +294,9 @@ class WritableCatalog : public Catalog {
   void CopyCatalogsToParent();
 
   void UpdateCounters();
-  void VacuumDatabaseIfNecessary();
+  void SummarizeIfNecessary();
+  void VacuumDatabaseIfNecessary(const bool lazy = false);
+  void ClusterDatabase();
 };  // class WritableCatalog
 
 typedef std::vector<WritableCatalog *> WritableCatalogList;
@@ -7,6 +7,8 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <utility>
+#include <vector>
 
 #include "catalog.h"
 #include "globals.h"
@@ -67,7 +69,20 @@ const float CatalogDatabase::kLatestSupportedSchema = 2.5;  // + 1.X (r/o)
 //            * add kFlagDirBindMountpoint
 //            * add kFlagHidden
 //            * add table bind_mountpoints
-const unsigned CatalogDatabase::kLatestSchemaRevision = 4;
+//   4 --> 5: (Oct 14 2026 - Git):
+//            * add kFlagFileInline
+//            * add table inline_data
+//   5 --> 6: (Oct 14 2026 - Git):
+//            * add kFlagFileBundle
+//            * add table bundles
+//   6 --> 7: (Oct 14 2026 - Git):
+//            * add summary statistics counters: size bins, inline and bundled
+//              files, unsummarized catalogs
+//   7 --> 8: (Oct 14 2026 - Git):
+//            * add table prefetch_groups
+//   8 --> 9: (Oct 14 2026 - Git):
+//            * add table digest_trees
+const unsigned CatalogDatabase::kLatestSchemaRevision = 9;
 
 bool CatalogDatabase::CheckSchemaCompatibility() {
   return !( (schema_version() >= 2.0-kSchemaEpsilon)                   &&
@@ -166,6 +181,133 @@ bool CatalogDatabase::LiveSchemaUpgradeIfNecessary() {
     }
   }
 
+  if (IsEqualSchema(schema_version(), 2.5) && (schema_revision() == 4)) {
+    LogCvmfs(kLogCatalog, kLogDebug, "upgrading schema revision (4 --> 5)");
+
+    SqlCatalog sql_upgrade9(*this,
+      "CREATE TABLE inline_data (md5path_1 INTEGER, md5path_2 INTEGER, "
+      "data BLOB, "
+      "CONSTRAINT pk_inline_data PRIMARY KEY (md5path_1, md5path_2));");
+    if (!sql_upgrade9.Execute()) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to upgrade catalogs (4 --> 5)");
+      return false;
+    }
+
+    set_schema_revision(5);
+    if (!StoreSchemaRevision()) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to upgrade schema revision");
+      return false;
+    }
+  }
+
+  if (IsEqualSchema(schema_version(), 2.5) && (schema_revision() == 5)) {
+    LogCvmfs(kLogCatalog, kLogDebug, "upgrading schema revision (5 --> 6)");
+
+    SqlCatalog sql_upgrade10(*this,
+      "CREATE TABLE bundles (md5path_1 INTEGER, md5path_2 INTEGER, "
+      "hash BLOB, offset INTEGER, "
+      "CONSTRAINT pk_bundles PRIMARY KEY (md5path_1, md5path_2));");
+    if (!sql_upgrade10.Execute()) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to upgrade catalogs (5 --> 6)");
+      return false;
+    }
+
+    set_schema_revision(6);
+    if (!StoreSchemaRevision()) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to upgrade schema revision");
+      return false;
+    }
+  }
+
+  if (IsEqualSchema(schema_version(), 2.5) && (schema_revision() == 6)) {
+    LogCvmfs(kLogCatalog, kLogDebug, "upgrading schema revision (6 --> 7)");
+
+    // The summary of the catalog is recomputed when it is committed next.  The
+    // catalogs below are summarized once they are committed themselves.
+    catalog::Counters counters;
+    if (!counters.ReadFromDatabase(*this, LegacyMode::kNoSummary)) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to upgrade catalogs (6 --> 7)");
+      return false;
+    }
+    vector<pair<string, uint64_t> > summary;
+    summary.push_back(make_pair("self_unsummarized",
+                                counters.self.unsummarized));
+    summary.push_back(make_pair("subtree_unsummarized",
+                                counters.subtree.unsummarized));
+    const char *prefixes[] = {"self_", "subtree_"};
+    for (unsigned i = 0; i < 2; ++i) {
+      const string prefix = prefixes[i];
+      summary.push_back(make_pair(prefix + "inline", 0));
+      summary.push_back(make_pair(prefix + "bundled", 0));
+      for (unsigned j = 0; j < kNumSizeBins; ++j)
+        summary.push_back(make_pair(prefix + GetSizeBinName(j), 0));
+    }
+    SqlCreateCounter sql_upgrade11(*this);
+    for (unsigned i = 0; i < summary.size(); ++i) {
+      const bool retval =
+        sql_upgrade11.BindCounter(summary[i].first) &&
+        sql_upgrade11.BindInitialValue(summary[i].second) &&
+        sql_upgrade11.Execute();
+      sql_upgrade11.Reset();
+      if (!retval) {
+        LogCvmfs(kLogCatalog, kLogDebug,
+                 "failed to upgrade catalogs (6 --> 7)");
+        return false;
+      }
+    }
+
+    set_schema_revision(7);
+    if (!StoreSchemaRevision()) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to upgrade schema revision");
+      return false;
+    }
+  }
+
+  if (IsEqualSchema(schema_version(), 2.5) && (schema_revision() == 7)) {
+    LogCvmfs(kLogCatalog, kLogDebug, "upgrading schema revision (7 --> 8)");
+
+    SqlCatalog sql_upgrade12(*this,
+      "CREATE TABLE prefetch_groups (md5path_1 INTEGER, md5path_2 INTEGER, "
+      "group_id INTEGER, path TEXT, "
+      "CONSTRAINT pk_prefetch_groups PRIMARY KEY (md5path_1, md5path_2));");
+    if (!sql_upgrade12.Execute()) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to upgrade catalogs (7 --> 8)");
+      return false;
+    }
+    // Can only be prepared once the table exists
+    SqlCatalog sql_upgrade13(*this,
+      "CREATE INDEX idx_prefetch_groups_group ON prefetch_groups (group_id);");
+    if (!sql_upgrade13.Execute()) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to upgrade catalogs (7 --> 8)");
+      return false;
+    }
+
+    set_schema_revision(8);
+    if (!StoreSchemaRevision()) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to upgrade schema revision");
+      return false;
+    }
+  }
+
+  if (IsEqualSchema(schema_version(), 2.5) && (schema_revision() == 8)) {
+    LogCvmfs(kLogCatalog, kLogDebug, "upgrading schema revision (8 --> 9)");
+
+    SqlCatalog sql_upgrade14(*this,
+      "CREATE TABLE digest_trees (md5path_1 INTEGER, md5path_2 INTEGER, "
+      "tree BLOB, "
+      "CONSTRAINT pk_digest_trees PRIMARY KEY (md5path_1, md5path_2));");
+    if (!sql_upgrade14.Execute()) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to upgrade catalogs (8 --> 9)");
+      return false;
+    }
+
+    set_schema_revision(9);
+    if (!StoreSchemaRevision()) {
+      LogCvmfs(kLogCatalog, kLogDebug, "failed to upgrade schema revision");
+      return false;
+    }
+  }
+
   return true;
 }
 
@@ -205,6 +347,32 @@ bool CatalogDatabase::CreateEmptyDatabase() {
   SqlCatalog(*this,
     "CREATE TABLE bind_mountpoints (path TEXT, sha1 TEXT, size INTEGER, "
     "CONSTRAINT pk_bind_mountpoints PRIMARY KEY (path));")        .Execute()  &&
+  // Content of small files, saves clients a separate download per file
+  SqlCatalog(*this,
+    "CREATE TABLE inline_data "
+    "(md5path_1 INTEGER, md5path_2 INTEGER, data BLOB, "
+    " CONSTRAINT pk_inline_data PRIMARY KEY "
+    "   (md5path_1, md5path_2));")                                .Execute()  &&
+  // Bundle objects and offsets of small files that are packed together
+  SqlCatalog(*this,
+    "CREATE TABLE bundles "
+    "(md5path_1 INTEGER, md5path_2 INTEGER, hash BLOB, offset INTEGER, "
+    " CONSTRAINT pk_bundles PRIMARY KEY (md5path_1, md5path_2));").Execute()  &&
+  // Files that clients fetch together, declared by the publisher
+  SqlCatalog(*this,
+    "CREATE TABLE prefetch_groups "
+    "(md5path_1 INTEGER, md5path_2 INTEGER, group_id INTEGER, path TEXT, "
+    " CONSTRAINT pk_prefetch_groups PRIMARY KEY "
+    "   (md5path_1, md5path_2));")                                .Execute()  &&
+  SqlCatalog(*this,
+    "CREATE INDEX idx_prefetch_groups_group "
+    "ON prefetch_groups (group_id);")                             .Execute()  &&
+  // Block digests of large files, allow clients to verify range requests
+  SqlCatalog(*this,
+    "CREATE TABLE digest_trees "
+    "(md5path_1 INTEGER, md5path_2 INTEGER, tree BLOB, "
+    " CONSTRAINT pk_digest_trees PRIMARY KEY "
+    "   (md5path_1, md5path_2));")                                .Execute()  &&
   SqlCatalog(*this,
     "CREATE TABLE statistics (counter TEXT, value INTEGER, "
     "CONSTRAINT pk_statistics PRIMARY KEY (counter));")           .Execute();
@@ -351,13 +519,30 @@ double CatalogDatabase::GetRowIdWasteRatio() const {
  * See: http://www.sqlite.org/lang_vacuum.html
  */
 bool CatalogDatabase::CompactDatabase() const {
+  return RewriteCatalogTable("rowid");
+}
+
+
+/**
+ * Like CompactDatabase() but the new rowids follow the parent path hash.  The
+ * entries of a directory end up next to each other in the catalog table, in
+ * the same order as they are found through idx_catalog_parent.  The final
+ * VACUUM also rebuilds the index b-trees in sorted order.
+ */
+bool CatalogDatabase::ClusterByParent() const {
+  return RewriteCatalogTable("parent_1, parent_2, rowid") &&
+         SqlCatalog(*this, "VACUUM;").Execute();
+}
+
+
+bool CatalogDatabase::RewriteCatalogTable(const string &order_by) const {
   assert(read_write());
 
   return SqlCatalog(*this, "PRAGMA foreign_keys = OFF;").Execute() &&
          BeginTransaction()                                        &&
          SqlCatalog(*this, "CREATE TEMPORARY TABLE duplicate AS "
                            "  SELECT * FROM catalog "
-                           "  ORDER BY rowid ASC;").Execute()      &&
+                           "  ORDER BY " + order_by + ";").Execute() &&
          SqlCatalog(*this, "DELETE FROM catalog;").Execute()       &&
          SqlCatalog(*this, "INSERT INTO catalog "
                            "  SELECT * FROM duplicate "
@@ -392,6 +577,10 @@ unsigned SqlDirent::CreateDatabaseFlags(const DirectoryEntry &entry) const {
       database_flags |= kFlagFileChunk;
     if (entry.IsExternalFile())
       database_flags |= kFlagFileExternal;
+    if (entry.IsInlineFile())
+      database_flags |= kFlagFileInline;
+    if (entry.IsBundledFile())
+      database_flags |= kFlagFileBundle;
   }
 
   if (!entry.checksum_ptr()->IsNull())
@@ -452,7 +641,7 @@ uint64_t SqlDirent::MakeHardlinks(const uint32_t hardlink_group,
  * Expands variant symlinks containing $(VARIABLE) string.  Uses the environment
  * variables of the current process (cvmfs2)
  */
-void SqlDirent::ExpandSymlink(LinkString *raw_symlink) const {
+void SqlDirent::ExpandSymlink(LinkString *raw_symlink) {
   const char *c = raw_symlink->GetChars();
   const char *cEnd = c+raw_symlink->GetLength();
   for (; c < cEnd; ++c) {
@@ -564,10 +753,29 @@ SqlListContentHashes::SqlListContentHashes(const CatalogDatabase &database) {
       "  ON catalog.md5path_1 = chunks.md5path_1 AND "
       "     catalog.md5path_2 = chunks.md5path_2;";
 
+  static const char *stmt_ge_r6 =
+      "SELECT hash, flags, 0 "
+      "  FROM catalog "
+      "  WHERE length(catalog.hash) > 0 "
+      "UNION "
+      "SELECT chunks.hash, catalog.flags, 1 "
+      "  FROM catalog "
+      "  LEFT JOIN chunks "
+      "  ON catalog.md5path_1 = chunks.md5path_1 AND "
+      "     catalog.md5path_2 = chunks.md5path_2 "
+      "UNION "
+      "SELECT bundles.hash, catalog.flags, 0 "
+      "  FROM catalog "
+      "  INNER JOIN bundles "
+      "  ON catalog.md5path_1 = bundles.md5path_1 AND "
+      "     catalog.md5path_2 = bundles.md5path_2;";
+
   if (database.schema_version() < 2.4-CatalogDatabase::kSchemaEpsilon) {
     DeferredInit(database.sqlite_db(), stmt_lt_2_4);
-  } else {
+  } else if (database.schema_revision() < 6) {
     DeferredInit(database.sqlite_db(), stmt_ge_2_4);
+  } else {
+    DeferredInit(database.sqlite_db(), stmt_ge_r6);
   }
 }
 
@@ -639,13 +847,25 @@ shash::Md5 SqlLookup::GetParentPathHash() const {
 }
 
 
-/**
- * This method is a friend of DirectoryEntry.
- */
 DirectoryEntry SqlLookup::GetDirent(const Catalog *catalog,
                                     const bool expand_symlink) const
 {
   DirectoryEntry result;
+  DecodeDirent(catalog, expand_symlink, &result);
+  return result;
+}
+
+
+/**
+ * This method is a friend of DirectoryEntry.
+ */
+void SqlLookup::DecodeDirent(const Catalog *catalog,
+                             const bool expand_symlink,
+                             DirectoryEntry *dirent) const
+{
+  // Not all the fields are set for every schema
+  *dirent = DirectoryEntry();
+  DirectoryEntry &result = *dirent;
 
   const unsigned database_flags = RetrieveInt(5);
   result.is_nested_catalog_root_ = (database_flags & kFlagDirNestedRoot);
@@ -674,6 +894,8 @@ DirectoryEntry SqlLookup::GetDirent(const Catalog *catalog,
     result.is_chunked_file_    = (database_flags & kFlagFileChunk);
     result.is_hidden_          = (database_flags & kFlagHidden);
     result.is_external_file_   = (database_flags & kFlagFileExternal);
+    result.is_inline_file_     = (database_flags & kFlagFileInline);
+    result.is_bundled_file_    = (database_flags & kFlagFileBundle);
     result.has_xattrs_         = RetrieveInt(15) != 0;
     result.checksum_           =
       RetrieveHashBlob(0, RetrieveHashAlgorithm(database_flags));
@@ -696,6 +918,40 @@ DirectoryEntry SqlLookup::GetDirent(const Catalog *catalog,
   result.symlink_.Assign(symlink, strlen(symlink));
   if (expand_symlink && !g_raw_symlinks)
     ExpandSymlink(&result.symlink_);
+}
+
+
+DirectoryEntry SqlLookup::GetRawDirent() const {
+  DirectoryEntry result;
+
+  const unsigned database_flags = RetrieveInt(5);
+  result.is_nested_catalog_root_ = (database_flags & kFlagDirNestedRoot);
+  result.is_nested_catalog_mountpoint_ =
+    (database_flags & kFlagDirNestedMountpoint);
+  result.is_bind_mountpoint_ = (database_flags & kFlagDirBindMountpoint);
+  result.is_chunked_file_    = (database_flags & kFlagFileChunk);
+  result.is_hidden_          = (database_flags & kFlagHidden);
+  result.is_external_file_   = (database_flags & kFlagFileExternal);
+  result.is_inline_file_     = (database_flags & kFlagFileInline);
+  result.is_bundled_file_    = (database_flags & kFlagFileBundle);
+  result.has_xattrs_         = RetrieveInt(15) != 0;
+  result.checksum_           =
+    RetrieveHashBlob(0, RetrieveHashAlgorithm(database_flags));
+  result.compression_algorithm_ = RetrieveCompressionAlgorithm(database_flags);
+
+  const uint64_t hardlinks = RetrieveInt64(1);
+  result.linkcount_      = Hardlinks2Linkcount(hardlinks);
+  result.hardlink_group_ = Hardlinks2HardlinkGroup(hardlinks);
+  result.inode_          = RetrieveInt64(12);
+  result.uid_            = RetrieveInt64(13);
+  result.gid_            = RetrieveInt64(14);
+  result.mode_           = RetrieveInt(3);
+  result.size_           = RetrieveInt64(2);
+  result.mtime_          = RetrieveInt64(4);
+  const char *name = reinterpret_cast<const char *>(RetrieveText(6));
+  const char *symlink = reinterpret_cast<const char *>(RetrieveText(7));
+  result.name_.Assign(name, strlen(name));
+  result.symlink_.Assign(symlink, strlen(symlink));
 
   return result;
 }
@@ -719,6 +975,78 @@ bool SqlListing::BindPathHash(const struct shash::Md5 &hash) {
 //------------------------------------------------------------------------------
 
 
+SqlListingPage::SqlListingPage(const CatalogDatabase &database) {
+  MAKE_STATEMENTS("SELECT @DB_FIELDS@ FROM catalog "
+                  "WHERE (parent_1 = :p_1) AND (parent_2 = :p_2) AND "
+                  "(rowid > :rowid) ORDER BY rowid LIMIT :limit;");
+  DEFERRED_INITS(database);
+}
+
+
+bool SqlListingPage::BindPathHash(const struct shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+bool SqlListingPage::BindCursor(const uint64_t rowid, const unsigned limit) {
+  return BindInt64(3, rowid) && BindInt64(4, limit);
+}
+
+
+uint64_t SqlListingPage::GetRowId() const {
+  return RetrieveInt64(12);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlListingSorted::SqlListingSorted(const CatalogDatabase &database,
+                                   const bool scan_path_index)
+{
+  if (scan_path_index) {
+    // The primary key on (md5path_1, md5path_2) is the automatic index
+    MAKE_STATEMENTS("SELECT @DB_FIELDS@ FROM catalog "
+                    "INDEXED BY sqlite_autoindex_catalog_1 "
+                    "WHERE (parent_1 = :p_1) AND (parent_2 = :p_2) "
+                    "ORDER BY md5path_1, md5path_2;");
+    DEFERRED_INITS(database);
+  } else {
+    MAKE_STATEMENTS("SELECT @DB_FIELDS@ FROM catalog "
+                    "WHERE (parent_1 = :p_1) AND (parent_2 = :p_2) "
+                    "ORDER BY md5path_1, md5path_2;");
+    DEFERRED_INITS(database);
+  }
+}
+
+
+bool SqlListingSorted::BindPathHash(const struct shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlListingCount::SqlListingCount(const CatalogDatabase &database) {
+  Init(database.sqlite_db(), "SELECT count(*) FROM catalog "
+                             "WHERE (parent_1 = :p_1) AND (parent_2 = :p_2);");
+}
+
+
+bool SqlListingCount::BindPathHash(const struct shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+uint64_t SqlListingCount::GetCount() const {
+  return RetrieveInt64(0);
+}
+
+
+//------------------------------------------------------------------------------
+
+
 SqlLookupPathHash::SqlLookupPathHash(const CatalogDatabase &database) {
   MAKE_STATEMENTS("SELECT @DB_FIELDS@ FROM catalog "
                   "WHERE (md5path_1 = :md5_1) AND (md5path_2 = :md5_2);");
@@ -733,6 +1061,15 @@ bool SqlLookupPathHash::BindPathHash(const struct shash::Md5 &hash) {
 //------------------------------------------------------------------------------
 
 
+SqlAllDirents::SqlAllDirents(const CatalogDatabase &database) {
+  MAKE_STATEMENTS("SELECT @DB_FIELDS@ FROM catalog;");
+  DEFERRED_INITS(database);
+}
+
+
+//------------------------------------------------------------------------------
+
+
 SqlLookupInode::SqlLookupInode(const CatalogDatabase &database) {
   MAKE_STATEMENTS("SELECT @DB_FIELDS@ FROM catalog WHERE rowid = :rowid;");
   DEFERRED_INITS(database);
@@ -1137,6 +1474,297 @@ int SqlChunksCount::GetChunkCount() const {
 //------------------------------------------------------------------------------
 
 
+SqlInlineDataInsert::SqlInlineDataInsert(const CatalogDatabase &database) {
+  DeferredInit(database.sqlite_db(),
+    "INSERT INTO inline_data (md5path_1, md5path_2, data) "
+    //                           1          2        3
+    "VALUES (:md5_1, :md5_2, :data);");
+}
+
+
+bool SqlInlineDataInsert::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+bool SqlInlineDataInsert::BindData(const std::string &data) {
+  return BindBlobTransient(3, data.data(), data.length());
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlInlineDataRemove::SqlInlineDataRemove(const CatalogDatabase &database) {
+  DeferredInit(database.sqlite_db(),
+    "DELETE FROM inline_data "
+    "WHERE (md5path_1 = :md5_1) AND (md5path_2 = :md5_2);");
+}
+
+
+bool SqlInlineDataRemove::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlInlineDataLookup::SqlInlineDataLookup(const CatalogDatabase &database) {
+  DeferredInit(database.sqlite_db(),
+    "SELECT data FROM inline_data "
+    //       0
+    "WHERE (md5path_1 = :md5_1) AND (md5path_2 = :md5_2);");
+    //                    1                          2
+}
+
+
+bool SqlInlineDataLookup::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+/**
+ * An empty file has a NULL blob.
+ */
+std::string SqlInlineDataLookup::GetData() const {
+  const char *data = reinterpret_cast<const char *>(RetrieveBlob(0));
+  if (data == NULL)
+    return "";
+  return std::string(data, RetrieveBytes(0));
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlBundleInsert::SqlBundleInsert(const CatalogDatabase &database) {
+  DeferredInit(database.sqlite_db(),
+    "INSERT OR REPLACE INTO bundles (md5path_1, md5path_2, hash, offset) "
+    //                                  1          2       3      4
+    "VALUES (:md5_1, :md5_2, :hash, :offset);");
+}
+
+
+bool SqlBundleInsert::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+bool SqlBundleInsert::BindBundle(
+  const shash::Any &bundle_hash,
+  const uint64_t offset)
+{
+  return BindHashBlob(3, bundle_hash) && BindInt64(4, offset);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlBundleRemove::SqlBundleRemove(const CatalogDatabase &database) {
+  DeferredInit(database.sqlite_db(),
+    "DELETE FROM bundles "
+    "WHERE (md5path_1 = :md5_1) AND (md5path_2 = :md5_2);");
+}
+
+
+bool SqlBundleRemove::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlBundleLookup::SqlBundleLookup(const CatalogDatabase &database) {
+  DeferredInit(database.sqlite_db(),
+    "SELECT hash, offset FROM bundles "
+    //       0      1
+    "WHERE (md5path_1 = :md5_1) AND (md5path_2 = :md5_2);");
+    //                    1                          2
+}
+
+
+bool SqlBundleLookup::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+shash::Any SqlBundleLookup::GetBundleHash(
+  const shash::Algorithms interpret_hash_as) const
+{
+  return RetrieveHashBlob(0, interpret_hash_as);
+}
+
+
+uint64_t SqlBundleLookup::GetOffset() const {
+  return RetrieveInt64(1);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlPrefetchGroupInsert::SqlPrefetchGroupInsert(
+  const CatalogDatabase &database)
+{
+  DeferredInit(database.sqlite_db(),
+    "INSERT OR REPLACE INTO prefetch_groups "
+    "(md5path_1, md5path_2, group_id, path) "
+    //   1          2          3        4
+    "VALUES (:md5_1, :md5_2, :group_id, :path);");
+}
+
+
+bool SqlPrefetchGroupInsert::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+bool SqlPrefetchGroupInsert::BindGroup(
+  const uint64_t group_id,
+  const std::string &path)
+{
+  return BindInt64(3, group_id) && BindText(4, path);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlPrefetchGroupRemove::SqlPrefetchGroupRemove(
+  const CatalogDatabase &database)
+{
+  DeferredInit(database.sqlite_db(),
+    "DELETE FROM prefetch_groups "
+    "WHERE (md5path_1 = :md5_1) AND (md5path_2 = :md5_2);");
+}
+
+
+bool SqlPrefetchGroupRemove::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlPrefetchGroupLookup::SqlPrefetchGroupLookup(
+  const CatalogDatabase &database)
+{
+  DeferredInit(database.sqlite_db(),
+    "SELECT group_id FROM prefetch_groups "
+    //       0
+    "WHERE (md5path_1 = :md5_1) AND (md5path_2 = :md5_2);");
+    //                    1                          2
+}
+
+
+bool SqlPrefetchGroupLookup::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+uint64_t SqlPrefetchGroupLookup::GetGroupId() const {
+  return RetrieveInt64(0);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+/**
+ * Only used for catalogs of schema revision 8 and later, so that the fields
+ * of the latest schema suffice.
+ */
+SqlPrefetchGroupListing::SqlPrefetchGroupListing(
+  const CatalogDatabase &database)
+{
+  DeferredInit(database.sqlite_db(),
+    "SELECT " DB_FIELDS_GE_V2_1_GE_R2 ", prefetch_groups.path "
+    "FROM prefetch_groups JOIN catalog "
+    "ON (catalog.md5path_1 = prefetch_groups.md5path_1) AND "
+    "   (catalog.md5path_2 = prefetch_groups.md5path_2) "
+    "WHERE prefetch_groups.group_id = :group_id;");
+}
+
+
+bool SqlPrefetchGroupListing::BindGroupId(const uint64_t group_id) {
+  return BindInt64(1, group_id);
+}
+
+
+PathString SqlPrefetchGroupListing::GetPath() const {
+  const char *path = reinterpret_cast<const char *>(RetrieveText(16));
+  return PathString(path, strlen(path));
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlDigestTreeInsert::SqlDigestTreeInsert(const CatalogDatabase &database) {
+  DeferredInit(database.sqlite_db(),
+    "INSERT OR REPLACE INTO digest_trees (md5path_1, md5path_2, tree) "
+    //                                       1          2        3
+    "VALUES (:md5_1, :md5_2, :tree);");
+}
+
+
+bool SqlDigestTreeInsert::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+bool SqlDigestTreeInsert::BindTree(const std::string &tree) {
+  return BindBlobTransient(3, tree.data(), tree.length());
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlDigestTreeRemove::SqlDigestTreeRemove(const CatalogDatabase &database) {
+  DeferredInit(database.sqlite_db(),
+    "DELETE FROM digest_trees "
+    "WHERE (md5path_1 = :md5_1) AND (md5path_2 = :md5_2);");
+}
+
+
+bool SqlDigestTreeRemove::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+SqlDigestTreeLookup::SqlDigestTreeLookup(const CatalogDatabase &database) {
+  DeferredInit(database.sqlite_db(),
+    "SELECT tree FROM digest_trees "
+    //       0
+    "WHERE (md5path_1 = :md5_1) AND (md5path_2 = :md5_2);");
+    //                    1                          2
+}
+
+
+bool SqlDigestTreeLookup::BindPathHash(const shash::Md5 &hash) {
+  return BindMd5(1, 2, hash);
+}
+
+
+std::string SqlDigestTreeLookup::GetTree() const {
+  const char *tree = reinterpret_cast<const char *>(RetrieveBlob(0));
+  if (tree == NULL)
+    return "";
+  return std::string(tree, RetrieveBytes(0));
+}
+
+
+//------------------------------------------------------------------------------
+
+
 SqlMaxHardlinkGroup::SqlMaxHardlinkGroup(const CatalogDatabase &database) {
   DeferredInit(database.sqlite_db(), "SELECT max(hardlinks) FROM catalog;");
 }
@@ -1255,6 +1883,15 @@ SqlAllChunks::SqlAllChunks(const CatalogDatabase &database) {
       "(catalog.flags & " + StringifyInt(SqlDirent::kFlagFileExternal) +
       " = 0)";
   }
+  if (database.schema_revision() >= 6) {
+    sql +=
+      " UNION "
+      "SELECT DISTINCT bundles.hash, " + StringifyInt(shash::kSuffixNone) +
+      ", " + flags2hash + "," + flags2compression +
+      "FROM bundles, catalog WHERE "
+      "bundles.md5path_1=catalog.md5path_1 AND "
+      "bundles.md5path_2=catalog.md5path_2";
+  }
   sql += ";";
   Init(database.sqlite_db(), sql);
 }
@@ -55,6 +55,11 @@ class CatalogDatabase : public sqlite::Database<CatalogDatabase> {
   bool CheckSchemaCompatibility();
   bool LiveSchemaUpgradeIfNecessary();
   bool CompactDatabase() const;
+  /**
+   * Renumbers the catalog rows by parent directory and rebuilds the database
+   * file, so that directory listings read adjacent pages.
+   */
+  bool ClusterByParent() const;
 
   double GetRowIdWasteRatio() const;
   bool SetVOMSAuthz(const std::string&);
@@ -65,6 +70,9 @@ class CatalogDatabase : public sqlite::Database<CatalogDatabase> {
   CatalogDatabase(const std::string  &filename,
                   const OpenMode      open_mode)
     : sqlite::Database<CatalogDatabase>(filename, open_mode) { }
+
+ private:
+  bool RewriteCatalogTable(const std::string &order_by) const;
 };
 
 
@@ -208,7 +216,23 @@ class SqlDirent : public SqlCatalog {
    * directory.
    */
   static const int kFlagHidden              = 0x8000;  // 2^15
+  /**
+   * A small regular file whose content is stored in the inline_data table.
+   * The object is uploaded just the same so that older clients are unaffected.
+   */
+  static const int kFlagFileInline          = 0x10000;  // 2^16
+  /**
+   * A small regular file that is also part of a bundle object, see the
+   * bundles table.
+   */
+  static const int kFlagFileBundle          = 0x20000;  // 2^17
 
+  /**
+   * Replaces place holder variables in a symbolic link by actual path elements.
+   * @param raw_symlink the raw symlink path (may) containing place holders
+   * @return the expanded symlink
+   */
+  static void ExpandSymlink(LinkString *raw_symlink);
 
  protected:
   /**
@@ -231,13 +255,6 @@ class SqlDirent : public SqlCatalog {
   uint32_t Hardlinks2HardlinkGroup(const uint64_t hardlinks) const;
   uint64_t MakeHardlinks(const uint32_t hardlink_group,
                          const uint32_t linkcount) const;
-
-  /**
-   * Replaces place holder variables in a symbolic link by actual path elements.
-   * @param raw_symlink the raw symlink path (may) containing place holders
-   * @return the expanded symlink
-   */
-  void ExpandSymlink(LinkString *raw_symlink) const;
 };
 
 
@@ -290,6 +307,19 @@ class SqlLookup : public SqlDirent {
    */
   DirectoryEntry GetDirent(const Catalog *catalog,
                            const bool expand_symlink = true) const;
+  /**
+   * Like GetDirent() but decodes into an existing DirectoryEntry, e.g. one
+   * that is already in place in a listing.
+   */
+  void DecodeDirent(const Catalog *catalog,
+                    const bool expand_symlink,
+                    DirectoryEntry *result) const;
+  /**
+   * Like GetDirent() but independent of a catalog object: the inode is the
+   * rowid, uid and gid are not mapped, and symlinks are not expanded.  Only
+   * for catalogs of schema 2.1 and later.
+   */
+  DirectoryEntry GetRawDirent() const;
 
   /**
    * DirectoryEntrys do not contain their path hash.
@@ -320,6 +350,52 @@ class SqlListing : public SqlLookup {
 //------------------------------------------------------------------------------
 
 
+/**
+ * Pages through a directory listing in rowid order.  The rowid of the last
+ * row of a page is the cursor for the next page.  The parent index contains
+ * the rowid, so that a page is a range scan on the index.
+ */
+class SqlListingPage : public SqlLookup {
+ public:
+  explicit SqlListingPage(const CatalogDatabase &database);
+  bool BindPathHash(const struct shash::Md5 &hash);
+  bool BindCursor(const uint64_t rowid, const unsigned limit);
+  uint64_t GetRowId() const;
+};
+
+
+//------------------------------------------------------------------------------
+
+
+/**
+ * Lists a directory ordered by the path hashes of its entries.  By default,
+ * SQLite uses the parent index and sorts the rows of the directory.  With
+ * scan_path_index, SQLite instead walks the primary key on the path hashes,
+ * which yields the rows already in order without a sort but visits every row
+ * of the catalog.  The latter is for very large directories, whose sort would
+ * need memory proportional to the size of the directory.
+ */
+class SqlListingSorted : public SqlLookup {
+ public:
+  SqlListingSorted(const CatalogDatabase &database, const bool scan_path_index);
+  bool BindPathHash(const struct shash::Md5 &hash);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+class SqlListingCount : public SqlCatalog {
+ public:
+  explicit SqlListingCount(const CatalogDatabase &database);
+  bool BindPathHash(const struct shash::Md5 &hash);
+  uint64_t GetCount() const;
+};
+
+
+//------------------------------------------------------------------------------
+
+
 class SqlLookupPathHash : public SqlLookup {
  public:
   explicit SqlLookupPathHash(const CatalogDatabase &database);
@@ -330,6 +406,18 @@ class SqlLookupPathHash : public SqlLookup {
 //------------------------------------------------------------------------------
 
 
+/**
+ * Scans all the entries of the catalog, see CatalogIndex
+ */
+class SqlAllDirents : public SqlLookup {
+ public:
+  explicit SqlAllDirents(const CatalogDatabase &database);
+};
+
+
+//------------------------------------------------------------------------------
+
+
 class SqlLookupInode : public SqlLookup {
  public:
   explicit SqlLookupInode(const CatalogDatabase &database);
@@ -521,6 +609,156 @@ class SqlChunksCount : public SqlCatalog {
 //------------------------------------------------------------------------------
 
 
+class SqlInlineDataInsert : public SqlCatalog {
+ public:
+  explicit SqlInlineDataInsert(const CatalogDatabase &database);
+  bool BindPathHash(const shash::Md5 &hash);
+  bool BindData(const std::string &data);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+class SqlInlineDataRemove : public SqlCatalog {
+ public:
+  explicit SqlInlineDataRemove(const CatalogDatabase &database);
+  bool BindPathHash(const shash::Md5 &hash);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+class SqlInlineDataLookup : public SqlCatalog {
+ public:
+  explicit SqlInlineDataLookup(const CatalogDatabase &database);
+  bool BindPathHash(const shash::Md5 &hash);
+  std::string GetData() const;
+};
+
+
+//------------------------------------------------------------------------------
+
+
+class SqlBundleInsert : public SqlCatalog {
+ public:
+  explicit SqlBundleInsert(const CatalogDatabase &database);
+  bool BindPathHash(const shash::Md5 &hash);
+  bool BindBundle(const shash::Any &bundle_hash, const uint64_t offset);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+class SqlBundleRemove : public SqlCatalog {
+ public:
+  explicit SqlBundleRemove(const CatalogDatabase &database);
+  bool BindPathHash(const shash::Md5 &hash);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+/**
+ * The hash algorithm of the bundle is the one of the bundled file.
+ */
+class SqlBundleLookup : public SqlCatalog {
+ public:
+  explicit SqlBundleLookup(const CatalogDatabase &database);
+  bool BindPathHash(const shash::Md5 &hash);
+  shash::Any GetBundleHash(const shash::Algorithms interpret_hash_as) const;
+  uint64_t GetOffset() const;
+};
+
+
+//------------------------------------------------------------------------------
+
+
+class SqlPrefetchGroupInsert : public SqlCatalog {
+ public:
+  explicit SqlPrefetchGroupInsert(const CatalogDatabase &database);
+  bool BindPathHash(const shash::Md5 &hash);
+  bool BindGroup(const uint64_t group_id, const std::string &path);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+class SqlPrefetchGroupRemove : public SqlCatalog {
+ public:
+  explicit SqlPrefetchGroupRemove(const CatalogDatabase &database);
+  bool BindPathHash(const shash::Md5 &hash);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+class SqlPrefetchGroupLookup : public SqlCatalog {
+ public:
+  explicit SqlPrefetchGroupLookup(const CatalogDatabase &database);
+  bool BindPathHash(const shash::Md5 &hash);
+  uint64_t GetGroupId() const;
+};
+
+
+//------------------------------------------------------------------------------
+
+
+/**
+ * Lists the directory entries of the members of a prefetch group together with
+ * their full paths.
+ */
+class SqlPrefetchGroupListing : public SqlLookup {
+ public:
+  explicit SqlPrefetchGroupListing(const CatalogDatabase &database);
+  bool BindGroupId(const uint64_t group_id);
+  PathString GetPath() const;
+};
+
+
+//------------------------------------------------------------------------------
+
+
+class SqlDigestTreeInsert : public SqlCatalog {
+ public:
+  explicit SqlDigestTreeInsert(const CatalogDatabase &database);
+  bool BindPathHash(const shash::Md5 &hash);
+  bool BindTree(const std::string &tree);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+class SqlDigestTreeRemove : public SqlCatalog {
+ public:
+  explicit SqlDigestTreeRemove(const CatalogDatabase &database);
+  bool BindPathHash(const shash::Md5 &hash);
+};
+
+
+//------------------------------------------------------------------------------
+
+
+/**
+ * The serialized DigestTree of a regular file, see digest_tree.h
+ */
+class SqlDigestTreeLookup : public SqlCatalog {
+ public:
+  explicit SqlDigestTreeLookup(const CatalogDatabase &database);
+  bool BindPathHash(const shash::Md5 &hash);
+  std::string GetTree() const;
+};
+
+
+//------------------------------------------------------------------------------
+
+
 class SqlMaxHardlinkGroup : public SqlCatalog {
  public:
   explicit SqlMaxHardlinkGroup(const CatalogDatabase &database);
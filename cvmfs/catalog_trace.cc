@@ -0,0 +1,161 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "catalog_trace.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#include "logging.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+const unsigned CatalogTrace::kGroupWindowSec;
+const unsigned CatalogTrace::kMaxGroupSize;
+const unsigned CatalogTrace::kMaxGroups;
+
+
+CatalogTrace::CatalogTrace(const shash::Any &root_hash)
+  : root_hash_(root_hash)
+  , current_start_(0)
+{ }
+
+
+CatalogTrace *CatalogTrace::Load(
+  const string &path,
+  const shash::Any &root_hash)
+{
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL)
+    return NULL;
+
+  string line;
+  if (!GetLineFile(f, &line) || (line != root_hash.ToStringWithSuffix())) {
+    LogCvmfs(kLogCatalog, kLogDebug, "catalog trace %s does not belong to "
+             "root catalog %s, ignoring", path.c_str(),
+             root_hash.ToString().c_str());
+    fclose(f);
+    return NULL;
+  }
+
+  CatalogTrace *trace = new CatalogTrace(root_hash);
+  while (GetLineFile(f, &line) && (trace->learned_.size() < kMaxGroups)) {
+    vector<string> tokens = SplitString(line, ' ');
+    if (tokens.size() < 2)
+      continue;
+    vector<shash::Any> group;
+    for (unsigned i = 0; (i < tokens.size()) && (i <= kMaxGroupSize); ++i) {
+      shash::Any hash = shash::MkFromSuffixedHexPtr(shash::HexPtr(tokens[i]));
+      if (hash.IsNull())
+        break;
+      group.push_back(hash);
+    }
+    if (group.size() != tokens.size()) {
+      LogCvmfs(kLogCatalog, kLogDebug, "invalid line in catalog trace %s",
+               path.c_str());
+      continue;
+    }
+    trace->learned_[group[0]] =
+      vector<shash::Any>(group.begin() + 1, group.end());
+  }
+  fclose(f);
+
+  LogCvmfs(kLogCatalog, kLogDebug, "using catalog trace %s (%u groups)",
+           path.c_str(), trace->num_learned());
+  return trace;
+}
+
+
+/**
+ * Groups of this mount take precedence over the learned ones.  The trace is
+ * written to a temporary file first and atomically renamed to path.
+ */
+bool CatalogTrace::Save(const string &path) const {
+  GroupMap groups;
+  for (GroupMap::const_iterator i = recorded_.begin(), iEnd = recorded_.end();
+       (i != iEnd) && (groups.size() < kMaxGroups); ++i)
+  {
+    if (!i->second.empty())
+      groups[i->first] = i->second;
+  }
+  for (GroupMap::const_iterator i = learned_.begin(), iEnd = learned_.end();
+       (i != iEnd) && (groups.size() < kMaxGroups); ++i)
+  {
+    if (groups.find(i->first) == groups.end())
+      groups[i->first] = i->second;
+  }
+
+  string path_tmp;
+  FILE *f = CreateTempFile(path + ".tmp", 0644, "w", &path_tmp);
+  if (f == NULL) {
+    LogCvmfs(kLogCatalog, kLogDebug, "failed to create catalog trace (%d)",
+             errno);
+    return false;
+  }
+  bool retval =
+    fprintf(f, "%s\n", root_hash_.ToStringWithSuffix().c_str()) > 0;
+  for (GroupMap::const_iterator i = groups.begin(), iEnd = groups.end();
+       retval && (i != iEnd); ++i)
+  {
+    string line = i->first.ToStringWithSuffix();
+    for (unsigned j = 0; j < i->second.size(); ++j)
+      line += " " + i->second[j].ToStringWithSuffix();
+    retval = fprintf(f, "%s\n", line.c_str()) > 0;
+  }
+  retval = (fclose(f) == 0) && retval;
+  if (retval)
+    retval = rename(path_tmp.c_str(), path.c_str()) == 0;
+  if (!retval) {
+    LogCvmfs(kLogCatalog, kLogDebug, "failed to write catalog trace %s",
+             path.c_str());
+    unlink(path_tmp.c_str());
+    return false;
+  }
+  LogCvmfs(kLogCatalog, kLogDebug, "wrote catalog trace %s (%lu groups)",
+           path.c_str(), groups.size());
+  return true;
+}
+
+
+/**
+ * Adds an attached catalog to the current group or starts a new group.  If
+ * the catalog leads a learned group, the other members of that group are
+ * returned, once per mount.
+ */
+vector<shash::Any> CatalogTrace::Record(
+  const shash::Any &hash,
+  const time_t now)
+{
+  if (current_leader_.IsNull() ||
+      (now < current_start_) ||
+      (now - current_start_ > static_cast<time_t>(kGroupWindowSec)))
+  {
+    current_leader_ = hash;
+    current_start_ = now;
+    recorded_[hash].clear();
+  } else if (hash != current_leader_) {
+    vector<shash::Any> *group = &recorded_[current_leader_];
+    if ((group->size() < kMaxGroupSize) &&
+        (find(group->begin(), group->end(), hash) == group->end()))
+    {
+      group->push_back(hash);
+    }
+  }
+
+  GroupMap::const_iterator i = learned_.find(hash);
+  if ((i == learned_.end()) || (triggered_.count(hash) > 0))
+    return vector<shash::Any>();
+  triggered_.insert(hash);
+  return i->second;
+}
+
+}  // namespace catalog
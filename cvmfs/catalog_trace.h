@@ -0,0 +1,73 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_CATALOG_TRACE_H_
+#define CVMFS_CATALOG_TRACE_H_
+
+#include <ctime>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "hash.h"
+
+namespace catalog {
+
+/**
+ * Learns which catalogs are attached together.  A group starts with the
+ * first catalog that is attached after a quiet period and collects all the
+ * catalogs that are attached within kGroupWindowSec thereafter.  Typically,
+ * the first group of a mount is led by the root catalog and contains the
+ * nested catalogs needed by the first jobs.
+ *
+ * The groups are tied to a root catalog hash because only then the nested
+ * catalog hashes are still valid.  They are stored in a small text file: the
+ * first line is the root hash, every following line is a group, leader
+ * first.  On the next mount of the same root catalog, attaching the leader of
+ * a learned group returns the other members so that they can be prefetched in
+ * parallel instead of being downloaded one by one while walking the tree.
+ */
+class CatalogTrace {
+ public:
+  static const unsigned kGroupWindowSec = 10;
+  static const unsigned kMaxGroupSize = 64;
+  static const unsigned kMaxGroups = 256;
+
+  explicit CatalogTrace(const shash::Any &root_hash);
+  /**
+   * Returns NULL if there is no trace for the given root catalog.
+   */
+  static CatalogTrace *Load(const std::string &path,
+                            const shash::Any &root_hash);
+  bool Save(const std::string &path) const;
+
+  std::vector<shash::Any> Record(const shash::Any &hash, const time_t now);
+
+  shash::Any root_hash() const { return root_hash_; }
+  unsigned num_learned() const { return learned_.size(); }
+
+ private:
+  typedef std::map<shash::Any, std::vector<shash::Any> > GroupMap;
+
+  shash::Any root_hash_;
+  /**
+   * Groups of previous mounts.
+   */
+  GroupMap learned_;
+  /**
+   * Leaders of learned groups that were already handed out for prefetching.
+   */
+  std::set<shash::Any> triggered_;
+  /**
+   * Groups of this mount.  Replace learned groups with the same leader.
+   */
+  GroupMap recorded_;
+  shash::Any current_leader_;
+  time_t current_start_;
+};
+
+}  // namespace catalog
+
+#endif  // CVMFS_CATALOG_TRACE_H_
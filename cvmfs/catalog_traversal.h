@@ -5,6 +5,9 @@
 #ifndef CVMFS_CATALOG_TRAVERSAL_H_
 #define CVMFS_CATALOG_TRAVERSAL_H_
 
+#include <pthread.h>
+
+#include <algorithm>
 #include <cassert>
 #include <limits>
 #include <set>
@@ -12,6 +15,7 @@
 #include <string>
 #include <vector>
 
+#include "atomic.h"
 #include "catalog.h"
 #include "compression.h"
 #include "history_sqlite.h"
@@ -19,6 +23,8 @@
 #include "manifest.h"
 #include "object_fetcher.h"
 #include "signature.h"
+#include "util/executor.h"
+#include "util/pointer.h"
 #include "util_concurrency.h"
 
 namespace catalog {
@@ -89,7 +95,7 @@ class CatalogTraversalInfoShim {
  *   -> Prune catalogs below a certain history level
  *   -> Prune catalogs older than a certain threshold timestamp
  *   -> Never traverse a certain catalog twice
- *   -> Breadth First Traversal or Depth First Traversal
+ *   -> Breadth First Traversal, Depth First Traversal or Unordered Traversal
  *   -> Optional catalog memory management (no_close)
  *   -> Use all Named Snapshots of a repository as traversal entry point
  *   -> Traverse starting from a provided catalog
@@ -114,6 +120,15 @@ class CatalogTraversalInfoShim {
  *   Note: This method needs more disk space to temporarily store downloaded but
  *         not yet processed catalogs.
  *
+ * Unordered Traversal Strategy
+ *   The catalog tree is traversed level by level.  The catalogs of a level are
+ *   downloaded and opened concurrently (see num_threads).  Parent catalogs and
+ *   newer revisions are handed out before their nested catalogs and older
+ *   revisions, but there is no particular order within a level.  This method
+ *   is the fastest one for users that only collect information, such as the
+ *   garbage collection.  Listeners are always called from the thread that
+ *   runs the traversal.
+ *
  * Note: Since all CVMFS catalog files together can grow to several gigabytes in
  *       file size, each catalog is loaded, processed and removed immediately
  *       afterwards. Except if no_close is specified, which allows the user to
@@ -161,6 +176,8 @@ class CatalogTraversal
    *                             could not be loaded (i.e. was sweeped before by
    *                             a garbage collection run)
    * @param quiet                silence messages that would go to stderr
+   * @param num_threads          number of concurrent catalog downloads in the
+   *                             unordered traversal (default: 1)
    * @param tmp_dir              path to the temporary directory to be used
    *                             (default: /tmp)
    */
@@ -172,7 +189,8 @@ class CatalogTraversal
       , no_repeat_history(false)
       , no_close(false)
       , ignore_load_failure(false)
-      , quiet(false) {}
+      , quiet(false)
+      , num_threads(1) {}
 
     static const unsigned int kFullHistory;
     static const unsigned int kNoHistory;
@@ -186,14 +204,22 @@ class CatalogTraversal
     bool            no_close;
     bool            ignore_load_failure;
     bool            quiet;
+    unsigned int    num_threads;
   };
 
  public:
   enum TraversalType {
     kBreadthFirstTraversal,
-    kDepthFirstTraversal
+    kDepthFirstTraversal,
+    kUnorderedTraversal
   };
 
+  /**
+   * In the unordered traversal, every thread downloads up to this many
+   * catalogs of a level before they are handed out and removed.
+   */
+  static const unsigned int kCatalogsPerThread = 8;
+
  protected:
   typedef std::set<shash::Any> HashSet;
 
@@ -282,6 +308,7 @@ class CatalogTraversal
     , no_repeat_history_(params.no_repeat_history)
     , default_history_depth_(params.history)
     , default_timestamp_threshold_(params.timestamp)
+    , num_threads_(std::max(params.num_threads, 1U))
     , error_sink_((params.quiet) ? kLogDebug : kLogStderr)
   {
     assert(object_fetcher_ != NULL);
@@ -293,6 +320,16 @@ class CatalogTraversal
   }
 
 
+  /**
+   * Registers a catalog that the user code processed without the traversal,
+   * so that it is skipped by following traversals with no_repeat_history.
+   */
+  void AddVisitedCatalog(const shash::Any &catalog_hash) {
+    if (no_repeat_history_)
+      visited_catalogs_.insert(catalog_hash);
+  }
+
+
   /**
    * Starts the traversal process.
    * After calling this methods CatalogTraversal will go through all catalogs
@@ -441,6 +478,8 @@ class CatalogTraversal
    */
   bool DoTraverse(TraversalContext *ctx) {
     assert(ctx->callback_stack.empty());
+    if (ctx->traversal_type == kUnorderedTraversal)
+      return DoTraverseUnordered(ctx);
 
     while (!ctx->catalog_stack.empty()) {
       // Get the top most catalog for the next processing step
@@ -478,6 +517,132 @@ class CatalogTraversal
   }
 
 
+  /**
+   * The unordered traversal.  The catalogs of the current level are split in
+   * batches; the catalogs of a batch are downloaded concurrently and then
+   * handed out one after another.  The jobs referenced by the catalogs of a
+   * batch form the next level.
+   */
+  bool DoTraverseUnordered(TraversalContext *ctx) {
+    std::vector<CatalogJob> level;
+    while (!ctx->catalog_stack.empty())
+      level.push_back(Pop(ctx));
+
+    const unsigned batch_size = num_threads_ * kCatalogsPerThread;
+    while (!level.empty()) {
+      for (unsigned i = 0; i < level.size(); i += batch_size) {
+        const unsigned batch_end =
+          std::min(i + batch_size, static_cast<unsigned>(level.size()));
+        std::vector<CatalogJob *> batch;
+        for (unsigned j = i; j < batch_end; ++j) {
+          // Also skips duplicates within the level
+          if (ShouldBeSkipped(level[j])) {
+            level[j].ignore = true;
+            continue;
+          }
+          MarkAsVisited(level[j]);
+          batch.push_back(&level[j]);
+        }
+
+        if (!LoadCatalogs(batch)) {
+          for (unsigned j = 0; j < batch.size(); ++j) {
+            if (batch[j]->catalog != NULL)
+              CloseCatalog(true, batch[j]);
+          }
+          return false;
+        }
+
+        for (unsigned j = 0; j < batch.size(); ++j) {
+          CatalogJob *job = batch[j];
+          if (job->ignore)
+            continue;
+          // The referenced catalogs are collected on the (empty) catalog stack
+          job->referenced_catalogs =
+            PushPreviousRevision(*job, ctx) + PushNestedCatalogs(*job, ctx);
+          if (!Yield(job)) {
+            for (unsigned k = j + 1; k < batch.size(); ++k) {
+              if (batch[k]->catalog != NULL)
+                CloseCatalog(true, batch[k]);
+            }
+            return false;
+          }
+        }
+      }
+
+      level.clear();
+      while (!ctx->catalog_stack.empty())
+        level.push_back(Pop(ctx));
+    }
+
+    return true;
+  }
+
+
+  /**
+   * State of a batch of catalog downloads shared by the download threads.
+   * Attaching a catalog to its parent (no_close) registers it with the parent,
+   * so these catalogs are loaded one at a time under lock_parents.
+   */
+  struct LoadBatch {
+    explicit LoadBatch(CatalogTraversal *t) : traversal(t) {
+      atomic_init32(&num_failures);
+      int retval = pthread_mutex_init(&lock_parents, NULL);
+      assert(retval == 0);
+    }
+    ~LoadBatch() {
+      pthread_mutex_destroy(&lock_parents);
+    }
+
+    CatalogTraversal *traversal;
+    atomic_int32 num_failures;
+    pthread_mutex_t lock_parents;
+  };
+
+  /**
+   * Loads one catalog of a batch, skipped after the first failure
+   */
+  class LoadCatalogTask : public Executor::Task {
+   public:
+    LoadCatalogTask(LoadBatch *batch, CatalogJob *job)
+      : batch_(batch), job_(job) { }
+    virtual void Run() {
+      if (atomic_read32(&batch_->num_failures) > 0)
+        return;
+      if (job_->parent != NULL)
+        pthread_mutex_lock(&batch_->lock_parents);
+      if (!batch_->traversal->LoadCatalog(job_))
+        atomic_inc32(&batch_->num_failures);
+      if (job_->parent != NULL)
+        pthread_mutex_unlock(&batch_->lock_parents);
+    }
+
+   private:
+    LoadBatch *batch_;
+    CatalogJob *job_;
+  };
+
+  /**
+   * Downloads and opens the given catalogs using up to num_threads_ threads.
+   * The worker threads are kept for the following batches.
+   */
+  bool LoadCatalogs(const std::vector<CatalogJob *> &jobs) {
+    LoadBatch batch(this);
+    if ((num_threads_ <= 1) || (jobs.size() <= 1)) {
+      for (unsigned i = 0; i < jobs.size(); ++i)
+        LoadCatalogTask(&batch, jobs[i]).Run();
+    } else {
+      if (!executor_.IsValid())
+        executor_ = new Executor(num_threads_);
+      std::vector<Executor::Task *> tasks;
+      for (unsigned i = 0; i < jobs.size(); ++i)
+        tasks.push_back(new LoadCatalogTask(&batch, jobs[i]));
+      executor_->SubmitBatch(tasks);
+      executor_->Wait();
+    }
+    return atomic_read32(&batch.num_failures) == 0;
+  }
+
+
   bool PrepareCatalog(const TraversalContext &ctx, CatalogJob *job) {
     // skipping duplicate catalogs might also yield postponed catalogs
     if (ShouldBeSkipped(*job)) {
@@ -485,6 +650,14 @@ class CatalogTraversal
       return true;
     }
 
+    return LoadCatalog(job);
+  }
+
+
+  /**
+   * Fetches and opens a catalog.  May run concurrently for different jobs.
+   */
+  bool LoadCatalog(CatalogJob *job) {
     const typename ObjectFetcherT::Failures retval =
       object_fetcher_->FetchCatalog(job->hash,
                                     job->path,
@@ -833,10 +1006,18 @@ class CatalogTraversal
   const bool              no_repeat_history_;
   const unsigned int      default_history_depth_;
   const time_t            default_timestamp_threshold_;
+  const unsigned int      num_threads_;
+  /**
+   * Created on the first batch that is loaded concurrently
+   */
+  UniquePtr<Executor>     executor_;
   HashSet                 visited_catalogs_;
   LogFacilities           error_sink_;
 };
 
+template <class ObjectFetcherT>
+const unsigned int CatalogTraversal<ObjectFetcherT>::kCatalogsPerThread;
+
 template <class ObjectFetcherT>
 const unsigned int
   CatalogTraversal<ObjectFetcherT>::Parameters::kFullHistory =
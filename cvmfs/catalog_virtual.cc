@@ -4,9 +4,12 @@
 #include "cvmfs_config.h"
 #include "catalog_virtual.h"
 
+#include <inttypes.h>
+
 #include <algorithm>
 #include <cassert>
 #include <cstdlib>
+#include <set>
 
 #include "catalog_mgr_rw.h"
 #include "compression.h"
@@ -72,14 +75,8 @@ void VirtualCatalog::CreateNestedCatalogMarker() {
   // file is in the repository!  It is currently done by the sync_mediator.
   shash::Algorithms algorithm = catalog_mgr_->spooler_->GetHashAlgorithm();
   shash::Any file_hash(algorithm);
-  void *empty_compressed;
-  uint64_t sz_empty_compressed;
-  bool retval = zlib::CompressMem2Mem(
-    NULL, 0, &empty_compressed, &sz_empty_compressed);
+  bool retval = zlib::CompressMem2Null(NULL, 0, &file_hash);
   assert(retval);
-  shash::HashMem(static_cast<unsigned char *>(empty_compressed),
-                 sz_empty_compressed, &file_hash);
-  free(empty_compressed);
   entry_marker.name_ = NameString(".cvmfscatalog");
   entry_marker.mode_ = S_IFREG | S_IRUSR | S_IRGRP | S_IROTH;
   entry_marker.checksum_ = file_hash;
@@ -132,13 +129,82 @@ void VirtualCatalog::Generate(int actions) {
 }
 
 
+/**
+ * If the history records its tag changes, only the snapshots of the tags that
+ * changed since the last run are compared.  Otherwise, or if the recorded
+ * changes do not continue the last known serial number, all the tags of the
+ * history are compared to the snapshot directories.
+ */
 void VirtualCatalog::GenerateSnapshots() {
   LogCvmfs(kLogCvmfs, kLogStdout, "Creating virtual snapshots");
   EnsurePresence();
 
+  UniquePtr<history::History> history(
+    assistant_.GetHistory(swissknife::Assistant::kOpenReadOnly));
+  assert(history.IsValid());
+  WritableCatalog *virtual_catalog =
+    catalog_mgr_->GetHostingCatalog(kVirtualPath);
+  assert(virtual_catalog != NULL);
+
+  const uint64_t known_serial = virtual_catalog->GetTagChangeSerial();
+  vector<string> changed_tags;
+  uint64_t last_serial = 0;
+  const bool has_changes =
+    history->ListTagChanges(known_serial, &changed_tags, &last_serial);
+  if (has_changes && (known_serial > 0)) {
+    LogCvmfs(kLogCatalog, kLogDebug, "comparing %u changed tags (serial %"
+             PRIu64 " --> %" PRIu64 ")",
+             static_cast<unsigned>(changed_tags.size()),
+             known_serial, last_serial);
+    CompareChangedSnapshots(history.weak_ref(), changed_tags);
+  } else {
+    CompareAllSnapshots(history.weak_ref());
+  }
+  if (has_changes || (known_serial > 0))
+    virtual_catalog->SetTagChangeSerial(has_changes ? last_serial : 0);
+}
+
+
+void VirtualCatalog::CompareChangedSnapshots(
+  history::History *history,
+  const vector<string> &tag_names)
+{
+  WritableCatalog *virtual_catalog =
+    catalog_mgr_->GetHostingCatalog(kVirtualPath);
+  // A tag can change several times
+  const set<string> unique_names(tag_names.begin(), tag_names.end());
+  for (set<string>::const_iterator i = unique_names.begin(),
+       iEnd = unique_names.end(); i != iEnd; ++i)
+  {
+    if ((*i == swissknife::CommandTag::kHeadTag) ||
+        (*i == swissknife::CommandTag::kPreviousHeadTag))
+    {
+      continue;
+    }
+
+    history::History::Tag tag;
+    const bool in_history = history->GetByName(*i, &tag);
+    shash::Any hash_catalog;
+    uint64_t size_catalog;
+    const bool in_catalog = virtual_catalog->FindNested(
+      PathString("/" + string(kVirtualPath) + "/" +
+                 string(kSnapshotDirectory) + "/" + *i),
+      &hash_catalog, &size_catalog);
+
+    if (in_history && in_catalog && (tag.root_hash == hash_catalog))
+      continue;
+    if (in_catalog)
+      RemoveSnapshot(TagId(*i, hash_catalog));
+    if (in_history)
+      InsertSnapshot(TagId(*i, tag.root_hash));
+  }
+}
+
+
+void VirtualCatalog::CompareAllSnapshots(history::History *history) {
   vector<TagId> tags_history;
   vector<TagId> tags_catalog;
-  GetSortedTagsFromHistory(&tags_history);
+  GetSortedTagsFromHistory(history, &tags_history);
   GetSortedTagsFromCatalog(&tags_catalog);
   // Add artifical end markers to both lists
   string tag_name_end = "";
@@ -211,9 +277,10 @@ bool VirtualCatalog::ParseActions(
 }
 
 
-void VirtualCatalog::GetSortedTagsFromHistory(vector<TagId> *tags) {
-  UniquePtr<history::History> history(
-    assistant_.GetHistory(swissknife::Assistant::kOpenReadOnly));
+void VirtualCatalog::GetSortedTagsFromHistory(
+  history::History *history,
+  vector<TagId> *tags)
+{
   vector<history::History::Tag> tags_history;
   bool retval = history->List(&tags_history);
   assert(retval);
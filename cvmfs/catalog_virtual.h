@@ -17,6 +17,9 @@ class WritableCatalogManager;
 namespace download {
 class DownloadManager;
 }
+namespace history {
+class History;
+}
 namespace manifest {
 class Manifest;
 }
@@ -60,12 +63,16 @@ class VirtualCatalog {
   };
 
   void GenerateSnapshots();
+  void CompareAllSnapshots(history::History *history);
+  void CompareChangedSnapshots(history::History *history,
+                               const std::vector<std::string> &tag_names);
   void EnsurePresence();
   void CreateCatalog();
   void CreateBaseDirectory();
   void CreateNestedCatalogMarker();
   void CreateSnapshotDirectory();
-  void GetSortedTagsFromHistory(std::vector<TagId> *tags);
+  void GetSortedTagsFromHistory(history::History *history,
+                                std::vector<TagId> *tags);
   void GetSortedTagsFromCatalog(std::vector<TagId> *tags);
   void RemoveSnapshot(TagId tag);
   void InsertSnapshot(TagId tag);
@@ -0,0 +1,227 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "chunk_prefetch.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "clientctx.h"
+#include "fetch.h"
+#include "file_chunk.h"
+#include "logging.h"
+#include "statistics.h"
+#include "util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+namespace cvmfs {
+
+const unsigned ChunkPrefetcher::kMaxWindow;
+const unsigned ChunkPrefetcher::kMaxThreads;
+const unsigned ChunkPrefetcher::kMaxQueueLength;
+const unsigned ChunkPrefetcher::kMaxGroupSize;
+const unsigned ChunkPrefetcher::kMaxClaimedGroups;
+
+
+ChunkPrefetcher::ChunkPrefetcher(
+  unsigned window,
+  unsigned num_threads,
+  perf::Counter *n_scheduled,
+  perf::Counter *n_dropped)
+  : window_(std::min(window, kMaxWindow))
+  , num_threads_(std::max(1U, std::min(num_threads, kMaxThreads)))
+  , spawned_(false)
+  , terminated_(false)
+  , n_scheduled_(n_scheduled)
+  , n_dropped_(n_dropped)
+{
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&cond_jobs_, NULL);
+  assert(retval == 0);
+}
+
+
+ChunkPrefetcher::~ChunkPrefetcher() {
+  pthread_mutex_lock(&lock_);
+  terminated_ = true;
+  pthread_cond_broadcast(&cond_jobs_);
+  pthread_mutex_unlock(&lock_);
+  for (unsigned i = 0; i < threads_.size(); ++i)
+    pthread_join(threads_[i], NULL);
+  pthread_cond_destroy(&cond_jobs_);
+  pthread_mutex_destroy(&lock_);
+}
+
+
+/**
+ * Takes a job from the queue and returns only when terminated.  Pending jobs
+ * are discarded on termination.
+ */
+void *ChunkPrefetcher::MainWorker(void *data) {
+  ChunkPrefetcher *prefetcher = reinterpret_cast<ChunkPrefetcher *>(data);
+  LogCvmfs(kLogCvmfs, kLogDebug, "starting chunk read-ahead worker");
+
+  while (true) {
+    pthread_mutex_lock(&prefetcher->lock_);
+    while (prefetcher->jobs_.empty() && !prefetcher->terminated_)
+      pthread_cond_wait(&prefetcher->cond_jobs_, &prefetcher->lock_);
+    if (prefetcher->terminated_) {
+      pthread_mutex_unlock(&prefetcher->lock_);
+      break;
+    }
+    Job job = prefetcher->jobs_.front();
+    prefetcher->jobs_.pop_front();
+    pthread_mutex_unlock(&prefetcher->lock_);
+
+    prefetcher->ProcessJob(job);
+
+    pthread_mutex_lock(&prefetcher->lock_);
+    prefetcher->in_flight_.erase(job.id);
+    pthread_mutex_unlock(&prefetcher->lock_);
+  }
+
+  LogCvmfs(kLogCvmfs, kLogDebug, "stopping chunk read-ahead worker");
+  return NULL;
+}
+
+
+void ChunkPrefetcher::ProcessJob(const Job &job) {
+  // Download with the credentials of the process that triggered the read-ahead
+  if (job.has_ctx)
+    ClientCtx::GetInstance()->Set(job.uid, job.gid, job.pid);
+  int fd = job.fetcher->Fetch(job.id, job.size, job.name, job.compression_alg,
+                              job.object_type, job.alt_url, job.range_offset);
+  if (job.has_ctx)
+    ClientCtx::GetInstance()->Unset();
+  if (fd < 0) {
+    LogCvmfs(kLogCvmfs, kLogDebug, "read-ahead of %s failed (%d)",
+             job.id.ToString().c_str(), fd);
+    return;
+  }
+  job.fetcher->cache_mgr()->Close(fd);
+}
+
+
+/**
+ * Returns false if the job was not queued, either because it is already in
+ * flight or because the queue is full.
+ */
+bool ChunkPrefetcher::Enqueue(const Job &job) {
+  MutexLockGuard lock_guard(&lock_);
+  if (in_flight_.find(job.id) != in_flight_.end())
+    return false;
+  if (jobs_.size() >= kMaxQueueLength) {
+    if (n_dropped_) perf::Inc(n_dropped_);
+    return false;
+  }
+  in_flight_.insert(job.id);
+  jobs_.push_back(job);
+  pthread_cond_signal(&cond_jobs_);
+  if (n_scheduled_) perf::Inc(n_scheduled_);
+  return true;
+}
+
+
+ChunkPrefetcher::Job ChunkPrefetcher::MakeJob(
+  const FileChunkReflist &chunks,
+  unsigned chunk_idx,
+  Fetcher *fetcher,
+  CacheManager::ObjectType object_type)
+{
+  Job job;
+  job.fetcher = fetcher;
+  job.name = "Read-ahead of " + chunks.path.ToString();
+  job.compression_alg = chunks.compression_alg;
+  job.object_type = object_type;
+  ClientCtx *ctx = ClientCtx::GetInstance();
+  if (ctx->IsSet()) {
+    job.has_ctx = true;
+    ctx->Get(&job.uid, &job.gid, &job.pid);
+  }
+  const FileChunk *chunk = chunks.list->AtPtr(chunk_idx);
+  job.id = chunk->content_hash();
+  job.size = chunk->size();
+  if (chunks.external_data) {
+    job.alt_url = chunks.path.ToString();
+    job.range_offset = chunk->offset();
+  }
+  return job;
+}
+
+
+/**
+ * Queues the window_ chunks following chunk_idx.  To be called when the reader
+ * opens chunk_idx.  Before Spawn(), jobs are queued but not processed.
+ */
+void ChunkPrefetcher::Schedule(
+  const FileChunkReflist &chunks,
+  unsigned chunk_idx,
+  Fetcher *fetcher,
+  CacheManager::ObjectType object_type)
+{
+  if (window_ == 0)
+    return;
+
+  const unsigned num_chunks = chunks.list->size();
+  for (unsigned i = chunk_idx + 1;
+       (i <= chunk_idx + window_) && (i < num_chunks); ++i)
+  {
+    Enqueue(MakeJob(chunks, i, fetcher, object_type));
+  }
+}
+
+
+/**
+ * Queues chunk_idx itself.  Returns true if the chunk is queued or already in
+ * flight, i.e. if it is going to be fetched in the background.
+ */
+bool ChunkPrefetcher::ScheduleChunk(
+  const FileChunkReflist &chunks,
+  unsigned chunk_idx,
+  Fetcher *fetcher,
+  CacheManager::ObjectType object_type)
+{
+  if (window_ == 0)
+    return false;
+
+  const Job job = MakeJob(chunks, chunk_idx, fetcher, object_type);
+  if (Enqueue(job))
+    return true;
+  MutexLockGuard lock_guard(&lock_);
+  return in_flight_.find(job.id) != in_flight_.end();
+}
+
+
+/**
+ * Returns true only for the first call with a given group, so that the files
+ * of a group are scheduled once.  Once too many groups are claimed, all the
+ * groups can be claimed again.
+ */
+bool ChunkPrefetcher::ClaimGroup(const uint64_t group_id) {
+  if (window_ == 0)
+    return false;
+
+  MutexLockGuard lock_guard(&lock_);
+  if (claimed_groups_.size() >= kMaxClaimedGroups)
+    claimed_groups_.clear();
+  return claimed_groups_.insert(group_id).second;
+}
+
+
+void ChunkPrefetcher::Spawn() {
+  assert(!spawned_);
+  if (window_ == 0)
+    return;
+  threads_.resize(num_threads_);
+  for (unsigned i = 0; i < num_threads_; ++i) {
+    int retval = pthread_create(&threads_[i], NULL, MainWorker, this);
+    assert(retval == 0);
+  }
+  spawned_ = true;
+}
+
+}  // namespace cvmfs
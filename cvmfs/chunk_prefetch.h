@@ -0,0 +1,144 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_CHUNK_PREFETCH_H_
+#define CVMFS_CHUNK_PREFETCH_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "cache.h"
+#include "compression.h"
+#include "gtest/gtest_prod.h"
+#include "hash.h"
+#include "util/single_copy.h"
+
+struct FileChunkReflist;
+namespace perf {
+class Counter;
+}
+
+namespace cvmfs {
+
+class Fetcher;
+
+/**
+ * Read-ahead for chunked files.  When cvmfs_read() moves to a new chunk, the
+ * following chunks of the file are handed over to a small pool of worker
+ * threads.  The workers run them through the Fetcher and close the resulting
+ * file descriptors right away, so that the chunks are in the cache by the
+ * time the reader arrives.  If the reader is faster, the Fetcher collapses the
+ * reader's request with the ongoing read-ahead download.
+ *
+ * Scheduling never blocks the caller: if the queue is full, read-ahead
+ * requests are dropped.
+ */
+class ChunkPrefetcher : SingleCopy {
+  FRIEND_TEST(T_ChunkPrefetcher, Schedule);
+  FRIEND_TEST(T_ChunkPrefetcher, QueueFull);
+  FRIEND_TEST(T_ChunkPrefetcher, ScheduleChunk);
+  FRIEND_TEST(T_ChunkPrefetcher, ClaimGroup);
+
+ public:
+  /**
+   * Upper bound for the read-ahead window and the number of worker threads.
+   */
+  static const unsigned kMaxWindow = 16;
+  static const unsigned kMaxThreads = 8;
+  /**
+   * Maximum number of queued (not yet processing) read-ahead requests.
+   */
+  static const unsigned kMaxQueueLength = 64;
+  /**
+   * Prefetch groups: at most kMaxGroupSize members are scheduled per group,
+   * at most kMaxClaimedGroups groups are remembered as already scheduled.
+   */
+  static const unsigned kMaxGroupSize = 32;
+  static const unsigned kMaxClaimedGroups = 4096;
+
+  ChunkPrefetcher(unsigned window,
+                  unsigned num_threads,
+                  perf::Counter *n_scheduled,
+                  perf::Counter *n_dropped);
+  ~ChunkPrefetcher();
+  void Spawn();
+
+  void Schedule(const FileChunkReflist &chunks,
+                unsigned chunk_idx,
+                Fetcher *fetcher,
+                CacheManager::ObjectType object_type);
+  bool ScheduleChunk(const FileChunkReflist &chunks,
+                     unsigned chunk_idx,
+                     Fetcher *fetcher,
+                     CacheManager::ObjectType object_type);
+  bool ClaimGroup(const uint64_t group_id);
+
+  unsigned window() const { return window_; }
+
+ private:
+  struct Job {
+    Job()
+      : fetcher(NULL)
+      , size(0)
+      , compression_alg(zlib::kZlibDefault)
+      , object_type(CacheManager::kTypeRegular)
+      , range_offset(-1)
+      , has_ctx(false)
+      , uid(-1)
+      , gid(-1)
+      , pid(-1)
+    { }
+    Fetcher *fetcher;
+    shash::Any id;
+    uint64_t size;
+    std::string name;
+    zlib::Algorithms compression_alg;
+    CacheManager::ObjectType object_type;
+    std::string alt_url;
+    off_t range_offset;
+    bool has_ctx;
+    uid_t uid;
+    gid_t gid;
+    pid_t pid;
+  };
+
+  static void *MainWorker(void *data);
+  static Job MakeJob(const FileChunkReflist &chunks,
+                     unsigned chunk_idx,
+                     Fetcher *fetcher,
+                     CacheManager::ObjectType object_type);
+  bool Enqueue(const Job &job);
+  void ProcessJob(const Job &job);
+
+  unsigned window_;
+  unsigned num_threads_;
+  bool spawned_;
+  bool terminated_;
+  std::vector<pthread_t> threads_;
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_jobs_;
+  std::deque<Job> jobs_;
+  /**
+   * Objects that are either queued or being fetched by a worker.  Prevents
+   * repeated scheduling of the same chunk by subsequent reads.
+   */
+  std::set<shash::Any> in_flight_;
+  /**
+   * Prefetch groups that have been scheduled already
+   */
+  std::set<uint64_t> claimed_groups_;
+  perf::Counter *n_scheduled_;
+  perf::Counter *n_dropped_;
+};
+
+}  // namespace cvmfs
+
+#endif  // CVMFS_CHUNK_PREFETCH_H_
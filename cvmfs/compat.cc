@@ -168,6 +168,86 @@ void Migrate(InodeTracker *old_tracker, glue::InodeTracker *new_tracker) {
 //------------------------------------------------------------------------------
 
 
+namespace inode_tracker_v4 {
+
+static uint32_t hasher_md5(const shash::Md5 &key) {
+  return (uint32_t) *((uint32_t *)key.digest + 1);  // NOLINT
+}
+
+static uint32_t hasher_inode(const uint64_t &inode) {
+  return MurmurHash2(&inode, sizeof(inode), 0x07387a4f);
+}
+
+void Migrate(InodeTracker *old_tracker, glue::InodeTracker *new_tracker) {
+  old_tracker->inode_map_.map_.SetHasher(hasher_inode);
+  old_tracker->path_map_.map_.SetHasher(hasher_md5);
+  old_tracker->path_map_.path_store_.map_.SetHasher(hasher_md5);
+
+  SmallHashDynamic<uint64_t, uint32_t> *old_inodes =
+    &old_tracker->inode_references_.map_;
+  for (unsigned i = 0; i < old_inodes->capacity(); ++i) {
+    const uint64_t inode = old_inodes->keys()[i];
+    if (inode == 0) continue;
+
+    const uint32_t references = old_inodes->values()[i];
+    PathString path;
+    bool retval = old_tracker->FindPath(inode, &path);
+    assert(retval);
+    new_tracker->VfsGetBy(inode, references, path);
+  }
+}
+
+}  // namespace inode_tracker_v4
+
+
+//------------------------------------------------------------------------------
+
+
+namespace {
+
+/**
+ * The chunk tables of version 5 are sharded.  Distribute the entries of the
+ * flat tables of older versions over the shards.
+ */
+void MigrateHandle2Fd(SmallHashDynamic<uint64_t, ::ChunkFd> *old_handle2fd,
+                      ::ChunkTables *new_tables)
+{
+  for (unsigned keyno = 0; keyno < old_handle2fd->capacity(); ++keyno) {
+    const uint64_t handle = old_handle2fd->keys()[keyno];
+    if (handle == 0) continue;
+    new_tables->Handle2Shard(handle)->handle2fd.Insert(
+      handle, old_handle2fd->values()[keyno]);
+  }
+}
+
+void MigrateInode2References(
+  SmallHashDynamic<uint64_t, uint32_t> *old_inode2references,
+  ::ChunkTables *new_tables)
+{
+  for (unsigned keyno = 0; keyno < old_inode2references->capacity(); ++keyno)
+  {
+    const uint64_t inode = old_inode2references->keys()[keyno];
+    if (inode == 0) continue;
+    new_tables->Inode2Shard(inode)->inode2references.Insert(
+      inode, old_inode2references->values()[keyno]);
+  }
+}
+
+void MigrateInode2Chunks(
+  SmallHashDynamic<uint64_t, ::FileChunkReflist> *old_inode2chunks,
+  ::ChunkTables *new_tables)
+{
+  for (unsigned keyno = 0; keyno < old_inode2chunks->capacity(); ++keyno) {
+    const uint64_t inode = old_inode2chunks->keys()[keyno];
+    if (inode == 0) continue;
+    new_tables->Inode2Shard(inode)->inode2chunks.Insert(
+      inode, old_inode2chunks->values()[keyno]);
+  }
+}
+
+}  // anonymous namespace
+
+
 namespace chunk_tables {
 
 ChunkTables::~ChunkTables() {
@@ -181,8 +261,8 @@ ChunkTables::~ChunkTables() {
 
 void Migrate(ChunkTables *old_tables, ::ChunkTables *new_tables) {
   new_tables->next_handle = old_tables->next_handle;
-  new_tables->handle2fd = old_tables->handle2fd;
-  new_tables->inode2references = old_tables->inode2references;
+  MigrateHandle2Fd(&old_tables->handle2fd, new_tables);
+  MigrateInode2References(&old_tables->inode2references, new_tables);
 
   SmallHashDynamic<uint64_t, FileChunkReflist> *old_inode2chunks =
     &old_tables->inode2chunks;
@@ -204,7 +284,7 @@ void Migrate(ChunkTables *old_tables, ::ChunkTables *new_tables) {
     delete old_list;
     ::FileChunkReflist new_reflist(new_list, old_reflist->path,
                                    zlib::kZlibDefault, false);
-    new_tables->inode2chunks.Insert(inode, new_reflist);
+    new_tables->Inode2Shard(inode)->inode2chunks.Insert(inode, new_reflist);
   }
 }
 
@@ -227,8 +307,8 @@ ChunkTables::~ChunkTables() {
 
 void Migrate(ChunkTables *old_tables, ::ChunkTables *new_tables) {
   new_tables->next_handle = old_tables->next_handle;
-  new_tables->handle2fd = old_tables->handle2fd;
-  new_tables->inode2references = old_tables->inode2references;
+  MigrateHandle2Fd(&old_tables->handle2fd, new_tables);
+  MigrateInode2References(&old_tables->inode2references, new_tables);
 
   SmallHashDynamic<uint64_t, FileChunkReflist> *old_inode2chunks =
     &old_tables->inode2chunks;
@@ -250,7 +330,7 @@ void Migrate(ChunkTables *old_tables, ::ChunkTables *new_tables) {
     delete old_list;
     ::FileChunkReflist new_reflist(new_list, old_reflist->path,
                                    zlib::kZlibDefault, false);
-    new_tables->inode2chunks.Insert(inode, new_reflist);
+    new_tables->Inode2Shard(inode)->inode2chunks.Insert(inode, new_reflist);
   }
 }
 
@@ -273,11 +353,44 @@ ChunkTables::~ChunkTables() {
 
 void Migrate(ChunkTables *old_tables, ::ChunkTables *new_tables) {
   new_tables->next_handle = old_tables->next_handle;
-  new_tables->handle2fd = old_tables->handle2fd;
-  new_tables->inode2chunks = old_tables->inode2chunks;
-  new_tables->inode2references = old_tables->inode2references;
+  MigrateHandle2Fd(&old_tables->handle2fd, new_tables);
+  MigrateInode2Chunks(&old_tables->inode2chunks, new_tables);
+  MigrateInode2References(&old_tables->inode2references, new_tables);
 }
 
 }  // namespace chunk_tables_v3
 
+
+//------------------------------------------------------------------------------
+
+
+namespace chunk_tables_v4 {
+
+ChunkTables::~ChunkTables() {
+  pthread_mutex_destroy(lock);
+  free(lock);
+  for (unsigned i = 0; i < kNumHandleLocks; ++i) {
+    pthread_mutex_destroy(handle_locks.At(i));
+    free(handle_locks.At(i));
+  }
+}
+
+void Migrate(ChunkTables *old_tables, ::ChunkTables *new_tables) {
+  new_tables->next_handle = old_tables->next_handle;
+  MigrateHandle2Fd(&old_tables->handle2fd, new_tables);
+  MigrateInode2Chunks(&old_tables->inode2chunks, new_tables);
+  MigrateInode2References(&old_tables->inode2references, new_tables);
+
+  SmallHashDynamic<uint64_t, uint64_t> *old_handle2uniqino =
+    &old_tables->handle2uniqino;
+  for (unsigned keyno = 0; keyno < old_handle2uniqino->capacity(); ++keyno) {
+    const uint64_t handle = old_handle2uniqino->keys()[keyno];
+    if (handle == 0) continue;
+    new_tables->Handle2Shard(handle)->handle2uniqino.Insert(
+      handle, old_handle2uniqino->values()[keyno]);
+  }
+}
+
+}  // namespace chunk_tables_v4
+
 }  // namespace compat
@@ -835,6 +835,237 @@ void Migrate(InodeTracker *old_tracker, glue::InodeTracker *new_tracker);
 //------------------------------------------------------------------------------
 
 
+namespace inode_tracker_v4 {
+
+class StringRef {
+ public:
+  StringRef() { length_ = NULL; }
+  uint16_t length() const { return *length_; }
+  uint16_t size() const { return sizeof(uint16_t) + *length_; }
+  static uint16_t size(const uint16_t length) {
+    return sizeof(uint16_t) + length;
+  }
+  char *data() const { return reinterpret_cast<char *>(length_ + 1); }
+  static StringRef Place(const uint16_t length, const char *str,
+                         void *addr)
+  {
+    assert(false);
+  }
+ private:
+  uint16_t *length_;
+};
+
+class StringHeap : public SingleCopy {
+ public:
+  StringHeap() { assert(false); }
+  explicit StringHeap(const uint32_t minimum_size) { assert(false); }
+  void Init(const uint32_t minimum_size) { assert(false); }
+
+  ~StringHeap() {
+    for (unsigned i = 0; i < bins_.size(); ++i) {
+      smunmap(bins_.At(i));
+    }
+  }
+
+  StringRef AddString(const uint16_t length, const char *str) {
+    assert(false);
+  }
+  void RemoveString(const StringRef str_ref) { assert(false); }
+  double GetUsage() const { assert(false); }
+  uint64_t used() const { assert(false); }
+
+ private:
+  void AddBin(const uint64_t size) { assert(false); }
+
+  uint64_t size_;
+  uint64_t used_;
+  uint64_t bin_size_;
+  uint64_t bin_used_;
+  BigVector<void *> bins_;
+};
+
+
+class PathStore {
+ public:
+  PathStore() { assert(false); }
+  ~PathStore() {
+    delete string_heap_;
+  }
+  explicit PathStore(const PathStore &other) { assert(false); }
+  PathStore &operator= (const PathStore &other) { assert(false); }
+
+  void Insert(const shash::Md5 &md5path, const PathString &path) {
+    assert(false);
+  }
+
+  bool Lookup(const shash::Md5 &md5path, PathString *path) {
+    PathInfo info;
+    bool retval = map_.Lookup(md5path, &info);
+    if (!retval)
+      return false;
+
+    if (info.parent.IsNull()) {
+      return true;
+    }
+
+    retval = Lookup(info.parent, path);
+    assert(retval);
+    path->Append("/", 1);
+    path->Append(info.name.data(), info.name.length());
+    return true;
+  }
+
+  void Erase(const shash::Md5 &md5path) { assert(false); }
+  void Clear() { assert(false); }
+
+// private:
+  struct PathInfo {
+    PathInfo() {
+      refcnt = 1;
+    }
+    shash::Md5 parent;
+    uint32_t refcnt;
+    StringRef name;
+  };
+  void CopyFrom(const PathStore &other) { assert(false); }
+  SmallHashDynamic<shash::Md5, PathInfo> map_;
+  StringHeap *string_heap_;
+};
+
+
+class PathMap {
+ public:
+  PathMap() {
+    assert(false);
+  }
+  bool LookupPath(const shash::Md5 &md5path, PathString *path) {
+    bool found = path_store_.Lookup(md5path, path);
+    return found;
+  }
+  uint64_t LookupInodeByPath(const PathString &path) { assert(false); }
+  uint64_t LookupInodeByMd5Path(const shash::Md5 &md5path) { assert(false); }
+  shash::Md5 Insert(const PathString &path, const uint64_t inode) {
+    assert(false);
+  }
+  void Erase(const shash::Md5 &md5path) {
+    assert(false);
+  }
+  void Clear() { assert(false); }
+ public:
+  SmallHashDynamic<shash::Md5, uint64_t> map_;
+  PathStore path_store_;
+};
+
+class InodeMap {
+ public:
+  InodeMap() {
+    assert(false);
+  }
+  bool LookupMd5Path(const uint64_t inode, shash::Md5 *md5path) {
+    bool found = map_.Lookup(inode, md5path);
+    return found;
+  }
+  void Insert(const uint64_t inode, const shash::Md5 &md5path) {
+    assert(false);
+  }
+  void Erase(const uint64_t inode) {
+    assert(false);
+  }
+  void Clear() { assert(false); }
+// private:
+  SmallHashDynamic<uint64_t, shash::Md5> map_;
+};
+
+
+class InodeReferences {
+ public:
+  InodeReferences() {
+    assert(false);
+  }
+  bool Get(const uint64_t inode, const uint32_t by) {
+    assert(false);
+  }
+  bool Put(const uint64_t inode, const uint32_t by) {
+    assert(false);
+  }
+  void Clear() { assert(false); }
+// private:
+  SmallHashDynamic<uint64_t, uint32_t> map_;
+};
+
+class InodeTracker {
+ public:
+  struct Statistics {
+    Statistics() { assert(false); }
+    std::string Print() { assert(false); }
+    atomic_int64 num_inserts;
+    atomic_int64 num_removes;
+    atomic_int64 num_references;
+    atomic_int64 num_hits_inode;
+    atomic_int64 num_hits_path;
+    atomic_int64 num_misses_path;
+  };
+  Statistics GetStatistics() { assert(false); }
+
+  InodeTracker() { assert(false); }
+  explicit InodeTracker(const InodeTracker &other) { assert(false); }
+  InodeTracker &operator= (const InodeTracker &other) { assert(false); }
+  ~InodeTracker() {
+    pthread_mutex_destroy(lock_);
+    free(lock_);
+  }
+  void VfsGetBy(const uint64_t inode, const uint32_t by, const PathString &path)
+  {
+    assert(false);
+  }
+  void VfsGet(const uint64_t inode, const PathString &path) {
+    assert(false);
+  }
+  void VfsPut(const uint64_t inode, const uint32_t by) {
+    assert(false);
+  }
+  bool FindPath(const uint64_t inode, PathString *path) {
+    // Lock();
+    shash::Md5 md5path;
+    bool found = inode_map_.LookupMd5Path(inode, &md5path);
+    if (found) {
+      found = path_map_.LookupPath(md5path, path);
+      assert(found);
+    }
+    // Unlock();
+    // if (found) atomic_inc64(&statistics_.num_hits_path);
+    // else atomic_inc64(&statistics_.num_misses_path);
+    return found;
+  }
+
+  uint64_t FindInode(const PathString &path) {
+    assert(false);
+  }
+
+// private:
+  static const unsigned kVersion = 4;
+
+  void InitLock() { assert(false); }
+  void CopyFrom(const InodeTracker &other) { assert(false); }
+  inline void Lock() const { assert(false); }
+  inline void Unlock() const { assert(false); }
+
+  unsigned version_;
+  pthread_mutex_t *lock_;
+  PathMap path_map_;
+  InodeMap inode_map_;
+  InodeReferences inode_references_;
+  Statistics statistics_;
+};
+
+void Migrate(InodeTracker *old_tracker, glue::InodeTracker *new_tracker);
+
+}  // namespace inode_tracker_v4
+
+
+//------------------------------------------------------------------------------
+
+
 namespace chunk_tables {
 
 class FileChunk {
@@ -984,6 +1215,41 @@ void Migrate(ChunkTables *old_tables, ::ChunkTables *new_tables);
 }  // namespace chunk_tables_v3
 
 
+//------------------------------------------------------------------------------
+
+
+namespace chunk_tables_v4 {
+
+struct ChunkTables {
+  ChunkTables() { assert(false); }
+  ~ChunkTables();
+  ChunkTables(const ChunkTables &other) { assert(false); }
+  ChunkTables &operator= (const ChunkTables &other) { assert(false); }
+  void CopyFrom(const ChunkTables &other) { assert(false); }
+  void InitLocks() { assert(false); }
+  void InitHashmaps() { assert(false); }
+  pthread_mutex_t *Handle2Lock(const uint64_t handle) const { assert(false); }
+  inline void Lock() { assert(false); }
+  inline void Unlock() { assert(false); }
+
+  int version;
+  static const unsigned kNumHandleLocks = 128;
+  SmallHashDynamic<uint64_t, uint64_t> handle2uniqino;
+  SmallHashDynamic<uint64_t, ::ChunkFd> handle2fd;
+  // The file descriptors attached to handles need to be locked.
+  // Using a hash map to survive with a small, fixed number of locks
+  BigVector<pthread_mutex_t *> handle_locks;
+  SmallHashDynamic<uint64_t, FileChunkReflist> inode2chunks;
+  SmallHashDynamic<uint64_t, uint32_t> inode2references;
+  uint64_t next_handle;
+  pthread_mutex_t *lock;
+};
+
+void Migrate(ChunkTables *old_tables, ::ChunkTables *new_tables);
+
+}  // namespace chunk_tables_v4
+
+
 }  // namespace compat
 
 #endif  // CVMFS_COMPAT_H_
@@ -18,12 +18,15 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <vector>
 
 #include "hash.h"
 #include "logging.h"
 #include "platform.h"
 #include "smalloc.h"
+#include "util/pointer.h"
 #include "util/posix.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
@@ -149,6 +152,10 @@ Algorithms ParseCompressionAlgorithm(const std::string &algorithm_option) {
     return kZlibDefault;
   if (algorithm_option == "none")
     return kNoCompression;
+  if ((algorithm_option == "zstd") && IsAlgorithmAvailable(kZstd))
+    return kZstd;
+  if ((algorithm_option == "lz4") && IsAlgorithmAvailable(kLz4))
+    return kLz4;
   LogCvmfs(kLogCompress, kLogStderr, "unknown compression algorithms: %s",
            algorithm_option.c_str());
   assert(false);
@@ -163,6 +170,12 @@ std::string AlgorithmName(const zlib::Algorithms alg) {
     case kNoCompression:
       return "none";
       break;
+    case kZstd:
+      return "zstd";
+      break;
+    case kLz4:
+      return "lz4";
+      break;
     // Purposely did not add a 'default' statement here: this will
     // cause the compiler to generate a warning if a new algorithm
     // is added but this function is not updated.
@@ -171,6 +184,31 @@ std::string AlgorithmName(const zlib::Algorithms alg) {
 }
 
 
+/**
+ * Zstd and lz4 are optional, depending on the libraries found at build time.
+ */
+bool IsAlgorithmAvailable(const zlib::Algorithms alg) {
+  switch (alg) {
+    case kZlibDefault:
+    case kNoCompression:
+      return true;
+    case kZstd:
+#ifdef HAS_ZSTD
+      return true;
+#else
+      return false;
+#endif
+    case kLz4:
+#ifdef HAS_LZ4
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+
 void CompressInit(z_stream *strm) {
   strm->zalloc = Z_NULL;
   strm->zfree = Z_NULL;
@@ -852,12 +890,229 @@ bool DecompressMem2Mem(const void *buf, const int64_t size,
 }
 
 
+namespace {
+
+/**
+ * Collects the output of a Decompressor in a growing memory buffer.
+ */
+class MemSink : public cvmfs::Sink {
+ public:
+  MemSink() : buffer_(NULL), size_(0), capacity_(0) { }
+  ~MemSink() { free(buffer_); }
+
+  int64_t Write(const void *buf, uint64_t sz) {
+    if (size_ + sz > capacity_) {
+      capacity_ = std::max(2 * capacity_, size_ + sz);
+      buffer_ = static_cast<unsigned char *>(srealloc(buffer_, capacity_));
+    }
+    memcpy(buffer_ + size_, buf, sz);
+    size_ += sz;
+    return sz;
+  }
+
+  int Reset() {
+    size_ = 0;
+    return 0;
+  }
+
+  /**
+   * The caller takes ownership of the buffer.
+   */
+  void Release(void **buffer, uint64_t *size) {
+    *buffer = (buffer_ == NULL) ? smalloc(1) : buffer_;
+    *size = size_;
+    buffer_ = NULL;
+    size_ = capacity_ = 0;
+  }
+
+ private:
+  unsigned char *buffer_;
+  uint64_t size_;
+  uint64_t capacity_;
+};
+
+}  // anonymous namespace
+
+
+/**
+ * Like DecompressMem2Mem but for any of the compression algorithms.  User of
+ * this function has to free out_buf.
+ */
+bool DecompressMem2Mem(const Algorithms alg,
+                       const void *buf, const int64_t size,
+                       void **out_buf, uint64_t *out_size)
+{
+  if (alg == kZlibDefault)
+    return DecompressMem2Mem(buf, size, out_buf, out_size);
+
+  UniquePtr<Decompressor> decompressor(Decompressor::Construct(alg));
+  if (!decompressor.IsValid())
+    return false;
+  MemSink sink;
+  if (decompressor->Inflate2Sink(buf, size, &sink) != kStreamEnd) {
+    *out_buf = NULL;
+    *out_size = 0;
+    return false;
+  }
+  sink.Release(out_buf, out_size);
+  return true;
+}
+
+
+/**
+ * Compresses buf and hashes the compressed data in a single pass.  Every piece
+ * of deflate output is hashed while it is still hot in the CPU cache and then,
+ * unless sink is NULL, written to the sink.
+ */
+bool CompressMem2Sink(const void *buf, const int64_t size,
+                      cvmfs::Sink *sink, shash::Any *compressed_hash)
+{
+  unsigned char out[kZChunk];
+  int z_ret = Z_OK;
+  int flush = Z_NO_FLUSH;
+  bool result = false;
+  z_stream strm;
+  int64_t pos = 0;
+  shash::ContextPtr hash_context(compressed_hash->algorithm);
+
+  CompressInit(&strm);
+  hash_context.buffer = alloca(hash_context.size);
+  shash::Init(hash_context);
+
+  do {
+    const int64_t used = min(static_cast<int64_t>(kZChunk), size - pos);
+    strm.avail_in = used;
+    strm.next_in = (used == 0) ? NULL :
+      const_cast<unsigned char *>(static_cast<const unsigned char *>(buf)) +
+      pos;
+    flush = (pos + used >= size) ? Z_FINISH : Z_NO_FLUSH;
+
+    // Run deflate() on input until output buffer not full
+    do {
+      strm.avail_out = kZChunk;
+      strm.next_out = out;
+      z_ret = deflate(&strm, flush);
+      if (z_ret == Z_STREAM_ERROR)
+        goto compress_mem2sink_final;
+      const size_t have = kZChunk - strm.avail_out;
+      shash::Update(out, have, hash_context);
+      if ((sink != NULL) && (have > 0) &&
+          (sink->Write(out, have) != static_cast<int64_t>(have)))
+      {
+        goto compress_mem2sink_final;
+      }
+    } while (strm.avail_out == 0);
+
+    pos += used;
+  } while (flush != Z_FINISH);
+
+  if (z_ret != Z_STREAM_END)
+    goto compress_mem2sink_final;
+
+  shash::Final(hash_context, compressed_hash);
+  result = true;
+
+ compress_mem2sink_final:
+  CompressFini(&strm);
+  return result;
+}
+
+
+/**
+ * Counterpart of CompressMem2Sink(): hashes the compressed input piece by
+ * piece right before it is inflated into the sink.  The caller compares the
+ * resulting hash with the expected one.
+ */
+bool DecompressMem2Sink(const void *buf, const int64_t size,
+                        cvmfs::Sink *sink, shash::Any *compressed_hash)
+{
+  StreamStates stream_state = kStreamIOError;
+  z_stream strm;
+  int64_t pos = 0;
+  shash::ContextPtr hash_context(compressed_hash->algorithm);
+
+  DecompressInit(&strm);
+  hash_context.buffer = alloca(hash_context.size);
+  shash::Init(hash_context);
+
+  while (pos < size) {
+    const unsigned char *piece = static_cast<const unsigned char *>(buf) + pos;
+    const int64_t used = min(static_cast<int64_t>(kZChunk), size - pos);
+    shash::Update(piece, used, hash_context);
+    stream_state = DecompressZStream2Sink(piece, used, &strm, sink);
+    if ((stream_state == kStreamDataError) || (stream_state == kStreamIOError))
+      break;
+    pos += used;
+  }
+  DecompressFini(&strm);
+
+  if (stream_state != kStreamEnd)
+    return false;
+  shash::Final(hash_context, compressed_hash);
+  return true;
+}
+
+
+/**
+ * Only computes the content hash of the compressed buffer.
+ */
+bool CompressMem2Null(const void *buf, const int64_t size,
+                      shash::Any *compressed_hash)
+{
+  return CompressMem2Sink(buf, size, NULL, compressed_hash);
+}
+
+
+/**
+ * Like CompressMem2Mem but also returns the content hash of the compressed
+ * buffer without a second pass.  User of this function has to free out_buf.
+ */
+bool CompressMem2Mem(const void *buf, const int64_t size,
+                     void **out_buf, uint64_t *out_size,
+                     shash::Any *compressed_hash)
+{
+  MemSink sink;
+  if (!CompressMem2Sink(buf, size, &sink, compressed_hash)) {
+    *out_buf = NULL;
+    *out_size = 0;
+    return false;
+  }
+  sink.Release(out_buf, out_size);
+  return true;
+}
+
+
+/**
+ * Like DecompressMem2Mem but also returns the content hash of the compressed
+ * input without a second pass.  User of this function has to free out_buf.
+ */
+bool DecompressMem2Mem(const void *buf, const int64_t size,
+                       void **out_buf, uint64_t *out_size,
+                       shash::Any *compressed_hash)
+{
+  MemSink sink;
+  if (!DecompressMem2Sink(buf, size, &sink, compressed_hash)) {
+    *out_buf = NULL;
+    *out_size = 0;
+    return false;
+  }
+  sink.Release(out_buf, out_size);
+  return true;
+}
+
+
 //------------------------------------------------------------------------------
 
 
 void Compressor::RegisterPlugins() {
   RegisterPlugin<ZlibCompressor>();
   RegisterPlugin<EchoCompressor>();
+#ifdef HAS_ZSTD
+  RegisterPlugin<ZstdCompressor>();
+#endif
+#ifdef HAS_LZ4
+  RegisterPlugin<Lz4Compressor>();
+#endif
 }
 
 
@@ -979,4 +1234,745 @@ size_t EchoCompressor::DeflateBound(const size_t bytes) {
   return (bytes == 0) ? 1 : bytes;
 }
 
+
+
+//------------------------------------------------------------------------------
+
+
+FrameCompressor::FrameCompressor(const Algorithms &alg)
+  : Compressor(alg)
+  , in_buf_(static_cast<unsigned char *>(smalloc(kFrameSize)))
+  , in_size_(0)
+  , out_buf_(NULL)
+  , out_capacity_(0)
+  , out_pos_(0)
+  , out_size_(0)
+  , has_frames_(false)
+{
+}
+
+
+FrameCompressor::~FrameCompressor() {
+  free(in_buf_);
+  free(out_buf_);
+}
+
+
+/**
+ * Used by Clone().  Copies the pending input and output.
+ */
+void FrameCompressor::CopyFrom(const FrameCompressor &other) {
+  memcpy(in_buf_, other.in_buf_, other.in_size_);
+  in_size_ = other.in_size_;
+  if (other.out_capacity_ > 0) {
+    out_capacity_ = other.out_capacity_;
+    out_buf_ = static_cast<unsigned char *>(
+      srealloc(out_buf_, out_capacity_));
+    memcpy(out_buf_, other.out_buf_, other.out_size_);
+  }
+  out_pos_ = other.out_pos_;
+  out_size_ = other.out_size_;
+  has_frames_ = other.has_frames_;
+}
+
+
+void FrameCompressor::CompressPendingInput() {
+  assert(out_pos_ == out_size_);
+  const size_t bound = FrameBound(in_size_);
+  if (bound > out_capacity_) {
+    out_capacity_ = bound;
+    out_buf_ = static_cast<unsigned char *>(srealloc(out_buf_, out_capacity_));
+  }
+  out_size_ = CompressFrame(in_buf_, in_size_, out_buf_, out_capacity_);
+  out_pos_ = 0;
+  in_size_ = 0;
+  has_frames_ = true;
+}
+
+
+bool FrameCompressor::Deflate(
+  const bool flush,
+  unsigned char **inbuf, size_t *inbufsize,
+  unsigned char **outbuf, size_t *outbufsize)
+{
+  size_t out_used = 0;
+  while (true) {
+    // Hand out what is left from the previous frame
+    if (out_pos_ < out_size_) {
+      const size_t nbytes = min(out_size_ - out_pos_, *outbufsize - out_used);
+      memcpy(*outbuf + out_used, out_buf_ + out_pos_, nbytes);
+      out_used += nbytes;
+      out_pos_ += nbytes;
+      if (out_pos_ < out_size_)
+        break;
+    }
+
+    const size_t nbytes = min(kFrameSize - in_size_, *inbufsize);
+    memcpy(in_buf_ + in_size_, *inbuf, nbytes);
+    in_size_ += nbytes;
+    *inbuf += nbytes;
+    *inbufsize -= nbytes;
+    if ((in_size_ == kFrameSize) ||
+        (flush && (*inbufsize == 0) && ((in_size_ > 0) || !has_frames_)))
+    {
+      CompressPendingInput();
+      continue;
+    }
+    break;
+  }
+  *outbufsize = out_used;
+
+  return (out_pos_ == out_size_) && (*inbufsize == 0) &&
+         (!flush || ((in_size_ == 0) && has_frames_));
+}
+
+
+size_t FrameCompressor::DeflateBound(const size_t bytes) {
+  const size_t total = in_size_ + bytes;
+  return (out_size_ - out_pos_) +
+         (total / kFrameSize) * FrameBound(kFrameSize) +
+         FrameBound(total % kFrameSize);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+#ifdef HAS_ZSTD
+
+ZstdCompressor::ZstdCompressor(const Algorithms &alg)
+  : FrameCompressor(alg)
+  , context_(ZSTD_createCCtx())
+{
+  assert(context_ != NULL);
+}
+
+
+ZstdCompressor::~ZstdCompressor() {
+  ZSTD_freeCCtx(context_);
+}
+
+
+bool ZstdCompressor::WillHandle(const zlib::Algorithms &alg) {
+  return alg == kZstd;
+}
+
+
+Compressor* ZstdCompressor::Clone() {
+  ZstdCompressor *other = new ZstdCompressor(zlib::kZstd);
+  other->CopyFrom(*this);
+  return other;
+}
+
+
+size_t ZstdCompressor::FrameBound(const size_t bytes) {
+  return ZSTD_compressBound(bytes);
+}
+
+
+size_t ZstdCompressor::CompressFrame(
+  const unsigned char *src,
+  const size_t src_size,
+  unsigned char *dst,
+  const size_t dst_size)
+{
+  const size_t retval = ZSTD_compressCCtx(context_, dst, dst_size,
+                                          src, src_size, ZSTD_CLEVEL_DEFAULT);
+  assert(!ZSTD_isError(retval));
+  return retval;
+}
+
+#endif  // HAS_ZSTD
+
+
+//------------------------------------------------------------------------------
+
+
+#ifdef HAS_LZ4
+
+Lz4Compressor::Lz4Compressor(const Algorithms &alg)
+  : FrameCompressor(alg)
+{
+}
+
+
+bool Lz4Compressor::WillHandle(const zlib::Algorithms &alg) {
+  return alg == kLz4;
+}
+
+
+Compressor* Lz4Compressor::Clone() {
+  Lz4Compressor *other = new Lz4Compressor(zlib::kLz4);
+  other->CopyFrom(*this);
+  return other;
+}
+
+
+size_t Lz4Compressor::FrameBound(const size_t bytes) {
+  return LZ4F_compressFrameBound(bytes, NULL);
+}
+
+
+size_t Lz4Compressor::CompressFrame(
+  const unsigned char *src,
+  const size_t src_size,
+  unsigned char *dst,
+  const size_t dst_size)
+{
+  const size_t retval = LZ4F_compressFrame(dst, dst_size, src, src_size, NULL);
+  assert(!LZ4F_isError(retval));
+  return retval;
+}
+
+#endif  // HAS_LZ4
+
+
+//------------------------------------------------------------------------------
+
+
+void Decompressor::RegisterPlugins() {
+  RegisterPlugin<ZlibDecompressor>();
+#ifdef HAS_ZSTD
+  RegisterPlugin<ZstdDecompressor>();
+#endif
+#ifdef HAS_LZ4
+  RegisterPlugin<Lz4Decompressor>();
+#endif
+}
+
+
+#if defined(HAS_ZSTD) || defined(HAS_LZ4)
+/**
+ * Output of the zstd and lz4 decompressors either goes to a sink or to a file.
+ */
+static bool WriteInflated(
+  const unsigned char *buf,
+  const size_t size,
+  cvmfs::Sink *sink,
+  FILE *f)
+{
+  if (size == 0)
+    return true;
+  if (sink != NULL) {
+    const int64_t written = sink->Write(buf, size);
+    return (written >= 0) && (static_cast<uint64_t>(written) == size);
+  }
+  if ((fwrite(buf, 1, size, f) != size) || ferror(f)) {
+    LogCvmfs(kLogCompress, kLogDebug, "Inflate to file failed with %s "
+             "(errno=%d)", strerror(errno), errno);
+    return false;
+  }
+  return true;
+}
+#endif
+
+
+ZlibDecompressor::ZlibDecompressor(const Algorithms &alg)
+  : Decompressor(alg)
+{
+  DecompressInit(&stream_);
+}
+
+
+ZlibDecompressor::~ZlibDecompressor() {
+  DecompressFini(&stream_);
+}
+
+
+bool ZlibDecompressor::WillHandle(const zlib::Algorithms &alg) {
+  return alg == kZlibDefault;
+}
+
+
+StreamStates ZlibDecompressor::Inflate2Sink(
+  const void *buf,
+  const int64_t size,
+  cvmfs::Sink *sink)
+{
+  return DecompressZStream2Sink(buf, size, &stream_, sink);
+}
+
+
+StreamStates ZlibDecompressor::Inflate2File(
+  const void *buf,
+  const int64_t size,
+  FILE *f)
+{
+  return DecompressZStream2File(buf, size, &stream_, f);
+}
+
+
+void ZlibDecompressor::Reset() {
+  DecompressFini(&stream_);
+  DecompressInit(&stream_);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+#ifdef HAS_ZSTD
+
+ZstdDecompressor::ZstdDecompressor(const Algorithms &alg)
+  : Decompressor(alg)
+  , stream_(ZSTD_createDStream())
+{
+  assert(stream_ != NULL);
+  const size_t retval = ZSTD_initDStream(stream_);
+  assert(!ZSTD_isError(retval));
+}
+
+
+ZstdDecompressor::~ZstdDecompressor() {
+  ZSTD_freeDStream(stream_);
+}
+
+
+bool ZstdDecompressor::WillHandle(const zlib::Algorithms &alg) {
+  return alg == kZstd;
+}
+
+
+StreamStates ZstdDecompressor::Inflate2Sink(
+  const void *buf,
+  const int64_t size,
+  cvmfs::Sink *sink)
+{
+  return Inflate(buf, size, sink, NULL);
+}
+
+
+StreamStates ZstdDecompressor::Inflate2File(
+  const void *buf,
+  const int64_t size,
+  FILE *f)
+{
+  return Inflate(buf, size, NULL, f);
+}
+
+
+/**
+ * The stream can consist of several frames, as written by ZstdCompressor.
+ * ZSTD_decompressStream returns zero whenever a frame is complete and flushed.
+ */
+StreamStates ZstdDecompressor::Inflate(
+  const void *buf,
+  const int64_t size,
+  cvmfs::Sink *sink,
+  FILE *f)
+{
+  unsigned char out[kZChunk];
+  ZSTD_inBuffer input = { buf, static_cast<size_t>(size), 0 };
+  ZSTD_outBuffer output;
+  size_t retval;
+  do {
+    output.dst = out;
+    output.size = kZChunk;
+    output.pos = 0;
+    retval = ZSTD_decompressStream(stream_, &output, &input);
+    if (ZSTD_isError(retval))
+      return kStreamDataError;
+    if (!WriteInflated(out, output.pos, sink, f))
+      return kStreamIOError;
+  } while ((input.pos < input.size) ||
+           ((output.pos == output.size) && (retval != 0)));
+
+  return (retval == 0) ? kStreamEnd : kStreamContinue;
+}
+
+
+void ZstdDecompressor::Reset() {
+  const size_t retval = ZSTD_initDStream(stream_);
+  assert(!ZSTD_isError(retval));
+}
+
+#endif  // HAS_ZSTD
+
+
+//------------------------------------------------------------------------------
+
+
+#ifdef HAS_LZ4
+
+Lz4Decompressor::Lz4Decompressor(const Algorithms &alg)
+  : Decompressor(alg)
+  , context_(NULL)
+  , frame_end_(false)
+{
+  const LZ4F_errorCode_t retval =
+    LZ4F_createDecompressionContext(&context_, LZ4F_VERSION);
+  assert(!LZ4F_isError(retval));
+}
+
+
+Lz4Decompressor::~Lz4Decompressor() {
+  LZ4F_freeDecompressionContext(context_);
+}
+
+
+bool Lz4Decompressor::WillHandle(const zlib::Algorithms &alg) {
+  return alg == kLz4;
+}
+
+
+StreamStates Lz4Decompressor::Inflate2Sink(
+  const void *buf,
+  const int64_t size,
+  cvmfs::Sink *sink)
+{
+  return Inflate(buf, size, sink, NULL);
+}
+
+
+StreamStates Lz4Decompressor::Inflate2File(
+  const void *buf,
+  const int64_t size,
+  FILE *f)
+{
+  return Inflate(buf, size, NULL, f);
+}
+
+
+/**
+ * The stream can consist of several frames, as written by Lz4Compressor.
+ * LZ4F_decompress returns zero whenever a frame is complete and starts over
+ * with the next frame on the next call.
+ */
+StreamStates Lz4Decompressor::Inflate(
+  const void *buf,
+  const int64_t size,
+  cvmfs::Sink *sink,
+  FILE *f)
+{
+  unsigned char out[kZChunk];
+  const unsigned char *in = static_cast<const unsigned char *>(buf);
+  size_t remaining = size;
+  size_t out_size;
+  do {
+    size_t in_size = remaining;
+    out_size = kZChunk;
+    const size_t retval =
+      LZ4F_decompress(context_, out, &out_size, in, &in_size, NULL);
+    if (LZ4F_isError(retval))
+      return kStreamDataError;
+    if (!WriteInflated(out, out_size, sink, f))
+      return kStreamIOError;
+    in += in_size;
+    remaining -= in_size;
+    frame_end_ = (retval == 0);
+  } while ((remaining > 0) || ((out_size == kZChunk) && !frame_end_));
+
+  return frame_end_ ? kStreamEnd : kStreamContinue;
+}
+
+
+void Lz4Decompressor::Reset() {
+  LZ4F_resetDecompressionContext(context_);
+  frame_end_ = false;
+}
+
+#endif  // HAS_LZ4
+
+
+//------------------------------------------------------------------------------
+
+
+namespace {
+
+const char kFramedMagic[8] = {'\x89', 'C', 'V', 'M', 'F', 'S', 'Z', '1'};
+
+struct FramedHeader {
+  char magic[8];
+  uint32_t algorithm;
+  uint32_t block_size;
+  uint64_t size;
+  uint64_t num_blocks;
+};
+
+size_t BlockBound(const Algorithms alg, const size_t size) {
+#ifdef HAS_ZSTD
+  if (alg == kZstd)
+    return ZSTD_compressBound(size);
+#endif
+  return compressBound(size);
+}
+
+
+/**
+ * Returns the compressed size or 0 on failure
+ */
+size_t CompressBlock(
+  const Algorithms alg,
+  const unsigned char *src, const size_t src_size,
+  unsigned char *dst, const size_t dst_size)
+{
+#ifdef HAS_ZSTD
+  if (alg == kZstd) {
+    const size_t retval = ZSTD_compress(dst, dst_size, src, src_size, 1);
+    return ZSTD_isError(retval) ? 0 : retval;
+  }
+#endif
+  uLongf out_size = dst_size;
+  if (compress2(dst, &out_size, src, src_size, Z_BEST_SPEED) != Z_OK)
+    return 0;
+  return out_size;
+}
+
+
+/**
+ * Returns false unless dst_size bytes are decompressed
+ */
+bool UncompressBlock(
+  const Algorithms alg,
+  const unsigned char *src, const size_t src_size,
+  unsigned char *dst, const size_t dst_size)
+{
+#ifdef HAS_ZSTD
+  if (alg == kZstd) {
+    const size_t retval = ZSTD_decompress(dst, dst_size, src, src_size);
+    return !ZSTD_isError(retval) && (retval == dst_size);
+  }
+#endif
+  if (alg != kZlibDefault)
+    return false;
+  uLongf out_size = dst_size;
+  return (uncompress(dst, &out_size, src, src_size) == Z_OK) &&
+         (out_size == dst_size);
+}
+
+}  // anonymous namespace
+
+
+bool CompressFd2Framed(int fd_src, int fd_dest, uint64_t *framed_size) {
+  platform_stat64 info;
+  if (platform_fstat(fd_src, &info) != 0)
+    return false;
+
+  FramedHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kFramedMagic, sizeof(kFramedMagic));
+#ifdef HAS_ZSTD
+  header.algorithm = kZstd;
+#else
+  header.algorithm = kZlibDefault;
+#endif
+  header.block_size = kFramedBlockSize;
+  header.size = info.st_size;
+  header.num_blocks = (header.size + kFramedBlockSize - 1) / kFramedBlockSize;
+  if (!SafeWrite(fd_dest, &header, sizeof(header)))
+    return false;
+
+  const Algorithms alg = static_cast<Algorithms>(header.algorithm);
+  const size_t bound = BlockBound(alg, kFramedBlockSize);
+  vector<unsigned char> in_buf(kFramedBlockSize);
+  vector<unsigned char> out_buf(bound);
+  vector<uint64_t> offsets;
+  offsets.reserve(header.num_blocks + 1);
+  uint64_t pos = sizeof(header);
+  for (uint64_t i = 0; i < header.num_blocks; ++i) {
+    const size_t nbytes = std::min(static_cast<uint64_t>(kFramedBlockSize),
+                                   header.size - i * kFramedBlockSize);
+    const ssize_t nread = SafeRead(fd_src, &in_buf[0], nbytes);
+    if ((nread < 0) || (static_cast<size_t>(nread) != nbytes))
+      return false;
+    const size_t compressed_size =
+      CompressBlock(alg, &in_buf[0], nbytes, &out_buf[0], bound);
+    offsets.push_back(pos);
+    bool retval;
+    if ((compressed_size == 0) || (compressed_size >= nbytes)) {
+      retval = SafeWrite(fd_dest, &in_buf[0], nbytes);
+      pos += nbytes;
+    } else {
+      retval = SafeWrite(fd_dest, &out_buf[0], compressed_size);
+      pos += compressed_size;
+    }
+    if (!retval)
+      return false;
+  }
+  offsets.push_back(pos);
+  if (!SafeWrite(fd_dest, &offsets[0], offsets.size() * sizeof(uint64_t)))
+    return false;
+
+  *framed_size = pos + offsets.size() * sizeof(uint64_t);
+  return true;
+}
+
+
+FramedReader::FramedReader()
+  : algorithm_(kZlibDefault)
+  , size_(0)
+  , block_buf_(NULL)
+  , compressed_buf_(NULL)
+  , compressed_buf_size_(0)
+  , cached_block_(-1)
+{
+  lock_ = reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+  int retval = pthread_mutex_init(lock_, NULL);
+  assert(retval == 0);
+}
+
+
+FramedReader::~FramedReader() {
+  free(block_buf_);
+  free(compressed_buf_);
+  pthread_mutex_destroy(lock_);
+  free(lock_);
+}
+
+
+FramedReader *FramedReader::Clone() const {
+  FramedReader *clone = new FramedReader();
+  clone->algorithm_ = algorithm_;
+  clone->size_ = size_;
+  clone->offsets_ = offsets_;
+  return clone;
+}
+
+
+/**
+ * Checks the header and the block index thoroughly, so that ordinary files
+ * are not mistaken for framed files.
+ */
+FramedReader *FramedReader::Create(int fd) {
+  platform_stat64 info;
+  if (platform_fstat(fd, &info) != 0)
+    return NULL;
+  const uint64_t file_size = info.st_size;
+  FramedHeader header;
+  if ((file_size < sizeof(header) + sizeof(uint64_t)) ||
+      (pread(fd, &header, sizeof(header), 0) !=
+       static_cast<ssize_t>(sizeof(header))) ||
+      (memcmp(header.magic, kFramedMagic, sizeof(kFramedMagic)) != 0))
+  {
+    return NULL;
+  }
+  if (((header.algorithm != kZlibDefault) && (header.algorithm != kZstd)) ||
+      !IsAlgorithmAvailable(static_cast<Algorithms>(header.algorithm)) ||
+      (header.block_size != kFramedBlockSize) ||
+      (header.num_blocks !=
+       (header.size + kFramedBlockSize - 1) / kFramedBlockSize) ||
+      ((header.num_blocks + 1) * sizeof(uint64_t) >
+       file_size - sizeof(header)))
+  {
+    return NULL;
+  }
+
+  UniquePtr<FramedReader> reader(new FramedReader());
+  reader->algorithm_ = static_cast<Algorithms>(header.algorithm);
+  reader->size_ = header.size;
+  reader->offsets_.resize(header.num_blocks + 1);
+  const size_t index_size = reader->offsets_.size() * sizeof(uint64_t);
+  const uint64_t index_offset = file_size - index_size;
+  if (pread(fd, &reader->offsets_[0], index_size, index_offset) !=
+      static_cast<ssize_t>(index_size))
+  {
+    return NULL;
+  }
+  if ((reader->offsets_[0] != sizeof(header)) ||
+      (reader->offsets_[header.num_blocks] != index_offset))
+  {
+    return NULL;
+  }
+  for (uint64_t i = 0; i < header.num_blocks; ++i) {
+    const uint64_t raw_size = std::min(static_cast<uint64_t>(kFramedBlockSize),
+                                       header.size - i * kFramedBlockSize);
+    if ((reader->offsets_[i + 1] <= reader->offsets_[i]) ||
+        (reader->offsets_[i + 1] - reader->offsets_[i] > raw_size))
+    {
+      return NULL;
+    }
+  }
+  return reader.Release();
+}
+
+
+/**
+ * Decompresses a complete block into dst.  Called with the lock held.
+ */
+int FramedReader::DecompressBlock(
+  int fd,
+  const uint64_t block,
+  unsigned char *dst)
+{
+  const size_t raw_size = std::min(static_cast<uint64_t>(kFramedBlockSize),
+                                   size_ - block * kFramedBlockSize);
+  const size_t stored_size = offsets_[block + 1] - offsets_[block];
+  // Blocks that did not compress are stored in full length
+  const bool is_compressed = (stored_size != raw_size);
+  unsigned char *read_buf = dst;
+  if (is_compressed) {
+    if (compressed_buf_size_ < stored_size) {
+      compressed_buf_ = static_cast<unsigned char *>(
+        srealloc(compressed_buf_, stored_size));
+      compressed_buf_size_ = stored_size;
+    }
+    read_buf = compressed_buf_;
+  }
+
+  ssize_t nbytes;
+  do {
+    errno = 0;
+    nbytes = pread(fd, read_buf, stored_size, offsets_[block]);
+  } while ((nbytes == -1) && (errno == EINTR));
+  if (nbytes < 0)
+    return -errno;
+  if (static_cast<size_t>(nbytes) != stored_size)
+    return -EIO;
+  if (is_compressed &&
+      !UncompressBlock(algorithm_, read_buf, stored_size, dst, raw_size))
+  {
+    return -EIO;
+  }
+  return 0;
+}
+
+
+int64_t FramedReader::Pread(
+  int fd,
+  void *buf,
+  uint64_t size,
+  uint64_t offset)
+{
+  if (offset >= size_)
+    return 0;
+  size = std::min(size, size_ - offset);
+
+  MutexLockGuard guard(lock_);
+  unsigned char *out = static_cast<unsigned char *>(buf);
+  uint64_t nbytes = 0;
+  while (nbytes < size) {
+    const uint64_t pos = offset + nbytes;
+    const uint64_t block = pos / kFramedBlockSize;
+    const uint64_t block_offset = pos % kFramedBlockSize;
+    const uint64_t block_size = std::min(static_cast<uint64_t>(kFramedBlockSize),
+                                         size_ - block * kFramedBlockSize);
+    const uint64_t nbytes_block =
+      std::min(block_size - block_offset, size - nbytes);
+    int retval;
+    if ((block_offset == 0) && (nbytes_block == block_size) &&
+        (static_cast<int64_t>(block) != cached_block_))
+    {
+      // Complete blocks are decompressed right into the output buffer
+      retval = DecompressBlock(fd, block, out + nbytes);
+      if (retval < 0)
+        return retval;
+    } else {
+      if (static_cast<int64_t>(block) != cached_block_) {
+        if (block_buf_ == NULL) {
+          block_buf_ =
+            static_cast<unsigned char *>(smalloc(kFramedBlockSize));
+        }
+        cached_block_ = -1;
+        retval = DecompressBlock(fd, block, block_buf_);
+        if (retval < 0)
+          return retval;
+        cached_block_ = block;
+      }
+      memcpy(out + nbytes, block_buf_ + block_offset, nbytes_block);
+    }
+    nbytes += nbytes_block;
+  }
+  return nbytes;
+}
+
 }  // namespace zlib
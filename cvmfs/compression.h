@@ -6,14 +6,23 @@
 #define CVMFS_COMPRESSION_H_
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#ifdef HAS_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAS_LZ4
+#include <lz4frame.h>
+#endif
 
 #include <string>
+#include <vector>
 
 #include "duplex_zlib.h"
 #include "sink.h"
 #include "util/plugin.h"
+#include "util/single_copy.h"
 
 namespace shash {
 struct Any;
@@ -44,6 +53,8 @@ enum StreamStates {
 enum Algorithms {
   kZlibDefault = 0,
   kNoCompression,
+  kZstd,
+  kLz4,
 };
 
 /**
@@ -125,8 +136,186 @@ class EchoCompressor: public Compressor {
 };
 
 
+/**
+ * Base class for engines that compress the input in independent frames of
+ * kFrameSize bytes.  The output is a concatenation of frames, which the
+ * streaming decompressors of the engines read as a single stream.  Since no
+ * compression state is carried from one frame to the next, such compressors
+ * can be cloned in the middle of a stream (as required for bulk chunks).
+ */
+class FrameCompressor: public Compressor {
+ public:
+  static const size_t kFrameSize = 256 * 1024;
+
+  explicit FrameCompressor(const Algorithms &alg);
+  virtual ~FrameCompressor();
+
+  bool Deflate(const bool flush,
+               unsigned char **inbuf, size_t *inbufsize,
+               unsigned char **outbuf, size_t *outbufsize);
+  size_t DeflateBound(const size_t bytes);
+
+ protected:
+  /**
+   * Upper bound of the size of a frame with the given number of input bytes.
+   */
+  virtual size_t FrameBound(const size_t bytes) = 0;
+  /**
+   * Compresses a complete frame into dst.  Returns the size of the frame.
+   */
+  virtual size_t CompressFrame(const unsigned char *src, const size_t src_size,
+                               unsigned char *dst, const size_t dst_size) = 0;
+  void CopyFrom(const FrameCompressor &other);
+
+ private:
+  void CompressPendingInput();
+
+  /**
+   * Input of the current frame, up to kFrameSize bytes.
+   */
+  unsigned char *in_buf_;
+  size_t in_size_;
+  /**
+   * Compressed data that did not yet fit into the output buffer.
+   */
+  unsigned char *out_buf_;
+  size_t out_capacity_;
+  size_t out_pos_;
+  size_t out_size_;
+  /**
+   * Even empty input is compressed to a (single) frame.
+   */
+  bool has_frames_;
+};
+
+
+#ifdef HAS_ZSTD
+class ZstdCompressor: public FrameCompressor {
+ public:
+  explicit ZstdCompressor(const Algorithms &alg);
+  ~ZstdCompressor();
+
+  Compressor* Clone();
+  static bool WillHandle(const zlib::Algorithms &alg);
+
+ protected:
+  size_t FrameBound(const size_t bytes);
+  size_t CompressFrame(const unsigned char *src, const size_t src_size,
+                       unsigned char *dst, const size_t dst_size);
+
+ private:
+  ZSTD_CCtx *context_;
+};
+#endif
+
+
+#ifdef HAS_LZ4
+class Lz4Compressor: public FrameCompressor {
+ public:
+  explicit Lz4Compressor(const Algorithms &alg);
+
+  Compressor* Clone();
+  static bool WillHandle(const zlib::Algorithms &alg);
+
+ protected:
+  size_t FrameBound(const size_t bytes);
+  size_t CompressFrame(const unsigned char *src, const size_t src_size,
+                       unsigned char *dst, const size_t dst_size);
+};
+#endif
+
+
+/**
+ * Streaming decompression for the download manager.  Decompressors are
+ * constructed from the compression algorithm stored with the directory entry.
+ * There is no decompressor for kNoCompression.
+ */
+class Decompressor: public PolymorphicConstruction<Decompressor, Algorithms> {
+ public:
+  explicit Decompressor(const Algorithms &alg) { }
+  virtual ~Decompressor() { }
+  /**
+   * Inflates the next piece of the compressed stream.  Returns kStreamEnd
+   * if the piece completes the stream.
+   */
+  virtual StreamStates Inflate2Sink(const void *buf, const int64_t size,
+                                    cvmfs::Sink *sink) = 0;
+  virtual StreamStates Inflate2File(const void *buf, const int64_t size,
+                                    FILE *f) = 0;
+  /**
+   * Prepares for a new stream, e.g. for a download retry.
+   */
+  virtual void Reset() = 0;
+
+  static void RegisterPlugins();
+};
+
+
+class ZlibDecompressor: public Decompressor {
+ public:
+  explicit ZlibDecompressor(const Algorithms &alg);
+  ~ZlibDecompressor();
+
+  StreamStates Inflate2Sink(const void *buf, const int64_t size,
+                            cvmfs::Sink *sink);
+  StreamStates Inflate2File(const void *buf, const int64_t size, FILE *f);
+  void Reset();
+  static bool WillHandle(const zlib::Algorithms &alg);
+
+ private:
+  z_stream stream_;
+};
+
+
+#ifdef HAS_ZSTD
+class ZstdDecompressor: public Decompressor {
+ public:
+  explicit ZstdDecompressor(const Algorithms &alg);
+  ~ZstdDecompressor();
+
+  StreamStates Inflate2Sink(const void *buf, const int64_t size,
+                            cvmfs::Sink *sink);
+  StreamStates Inflate2File(const void *buf, const int64_t size, FILE *f);
+  void Reset();
+  static bool WillHandle(const zlib::Algorithms &alg);
+
+ private:
+  StreamStates Inflate(const void *buf, const int64_t size,
+                       cvmfs::Sink *sink, FILE *f);
+
+  ZSTD_DStream *stream_;
+};
+#endif
+
+
+#ifdef HAS_LZ4
+class Lz4Decompressor: public Decompressor {
+ public:
+  explicit Lz4Decompressor(const Algorithms &alg);
+  ~Lz4Decompressor();
+
+  StreamStates Inflate2Sink(const void *buf, const int64_t size,
+                            cvmfs::Sink *sink);
+  StreamStates Inflate2File(const void *buf, const int64_t size, FILE *f);
+  void Reset();
+  static bool WillHandle(const zlib::Algorithms &alg);
+
+ private:
+  StreamStates Inflate(const void *buf, const int64_t size,
+                       cvmfs::Sink *sink, FILE *f);
+
+  LZ4F_dctx *context_;
+  /**
+   * Set when the last piece ended on a frame boundary.
+   */
+  bool frame_end_;
+};
+#endif
+
+
 Algorithms ParseCompressionAlgorithm(const std::string &algorithm_option);
 std::string AlgorithmName(const zlib::Algorithms alg);
+bool IsAlgorithmAvailable(const zlib::Algorithms alg);
 
 
 void CompressInit(z_stream *strm);
@@ -166,6 +355,75 @@ bool CompressMem2Mem(const void *buf, const int64_t size,
                      void **out_buf, uint64_t *out_size);
 bool DecompressMem2Mem(const void *buf, const int64_t size,
                        void **out_buf, uint64_t *out_size);
+bool DecompressMem2Mem(const Algorithms alg,
+                       const void *buf, const int64_t size,
+                       void **out_buf, uint64_t *out_size);
+
+// Single pass compression (decompression) and hashing of the compressed data.
+// If sink is NULL, only the hash is computed.
+bool CompressMem2Sink(const void *buf, const int64_t size,
+                      cvmfs::Sink *sink, shash::Any *compressed_hash);
+bool DecompressMem2Sink(const void *buf, const int64_t size,
+                        cvmfs::Sink *sink, shash::Any *compressed_hash);
+bool CompressMem2Null(const void *buf, const int64_t size,
+                      shash::Any *compressed_hash);
+bool CompressMem2Mem(const void *buf, const int64_t size,
+                     void **out_buf, uint64_t *out_size,
+                     shash::Any *compressed_hash);
+bool DecompressMem2Mem(const void *buf, const int64_t size,
+                       void **out_buf, uint64_t *out_size,
+                       shash::Any *compressed_hash);
+
+
+/**
+ * Seekable compressed files for the cache.  The data is compressed in
+ * independent blocks of kFramedBlockSize bytes, followed by the file offsets
+ * of the blocks.  Blocks that do not compress are stored as they are.  Numbers
+ * are stored in host byte order, framed files are not portable.
+ */
+const unsigned kFramedBlockSize = 128 * 1024;
+
+/**
+ * Writes the content of fd_src as framed file to fd_dest, using zstd if
+ * available and zlib otherwise.  Returns the size of the framed file.
+ */
+bool CompressFd2Framed(int fd_src, int fd_dest, uint64_t *framed_size);
+
+/**
+ * Random access to the content of a framed file.  The last decompressed block
+ * is kept for small, sequential reads.
+ */
+class FramedReader : SingleCopy {
+ public:
+  /**
+   * Returns NULL if fd does not refer to a valid framed file
+   */
+  static FramedReader *Create(int fd);
+  FramedReader *Clone() const;
+  ~FramedReader();
+
+  /**
+   * Returns the number of bytes read or -errno
+   */
+  int64_t Pread(int fd, void *buf, uint64_t size, uint64_t offset);
+  uint64_t size() const { return size_; }
+
+ private:
+  FramedReader();
+  int DecompressBlock(int fd, const uint64_t block, unsigned char *dst);
+
+  Algorithms algorithm_;
+  uint64_t size_;
+  /**
+   * Block i is stored between offsets_[i] and offsets_[i + 1]
+   */
+  std::vector<uint64_t> offsets_;
+  unsigned char *block_buf_;
+  unsigned char *compressed_buf_;
+  size_t compressed_buf_size_;
+  int64_t cached_block_;
+  pthread_mutex_t *lock_;
+};
 
 }  // namespace zlib
 
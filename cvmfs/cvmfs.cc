@@ -65,19 +65,23 @@
 #include <string>
 #include <vector>
 
+#include "async_executor.h"
 #include "atomic.h"
 #include "authz/authz_session.h"
 #include "auto_umount.h"
 #include "backoff.h"
 #include "cache.h"
 #include "catalog_mgr_client.h"
+#include "chunk_prefetch.h"
 #include "clientctx.h"
 #include "compat.h"
 #include "compression.h"
+#include "digest_tree.h"
 #include "directory_entry.h"
 #include "download.h"
 #include "fence.h"
 #include "fetch.h"
+#include "fetch_timing.h"
 #include "file_chunk.h"
 #include "fuse_inode_gen.h"
 #include "fuse_remount.h"
@@ -88,14 +92,18 @@
 #include "loader.h"
 #include "logging.h"
 #include "lru_md.h"
+#include "magic_xattr.h"
 #include "manifest_fetch.h"
+#include "md5path_snapshot.h"
 #include "monitor.h"
 #include "mountpoint.h"
+#include "murmur.h"
 #include "nfs_maps.h"
 #include "options.h"
 #include "platform.h"
 #include "quota_listener.h"
 #include "quota_posix.h"
+#include "runtime_config.h"
 #include "shortstring.h"
 #include "signature.h"
 #include "smalloc.h"
@@ -104,6 +112,7 @@
 #include "statistics.h"
 #include "talk.h"
 #include "tracer.h"
+#include "util/probes.h"
 #include "util_concurrency.h"
 #include "uuid.h"
 #include "wpad.h"
@@ -136,6 +145,45 @@ struct DirectoryListing {
   DirectoryListing() : buffer(NULL), size(0), capacity(0) { }
 };
 
+/**
+ * For cvmfs_opendir / cvmfs_readdir with CVMFS_STREAM_LISTING.  Only a window
+ * of up to kStreamPageRows catalog rows is kept per handle.  The directory
+ * offsets handed to the kernel are derived from the catalog rowids, so that
+ * any offset can be continued with a single range scan on the parent index.
+ * Offset 1 follows ".", offset 2 follows "..", row r is followed by offset
+ * r + kStreamOffsetRows.  Unlike the full listing, a stream is not a snapshot
+ * of the directory.
+ */
+struct DirectoryStream {
+  PathString path;
+  struct stat info_self;
+  struct stat info_parent;
+  bool has_parent;
+  /**
+   * The window consists of the entries after page_begin up to and including
+   * page_end.  page_begin == page_end marks the end of the listing.
+   */
+  off_t page_begin;
+  off_t page_end;
+  catalog::StatEntryList page;
+  std::vector<off_t> page_offsets;
+
+  DirectoryStream()
+    : has_parent(false), page_begin(-1), page_end(-1), page(kStreamPageRows)
+  {
+    memset(&info_self, 0, sizeof(info_self));
+    memset(&info_parent, 0, sizeof(info_parent));
+  }
+
+  bool Covers(const off_t offset) const {
+    return (page_begin >= 0) && (page_begin <= offset) &&
+           ((offset < page_end) || (page_begin == page_end));
+  }
+
+  static const unsigned kStreamPageRows = 256;
+  static const off_t kStreamOffsetRows = 2;
+};
+
 const loader::LoaderExports *loader_exports_ = NULL;
 OptionsManager *options_mgr_ = NULL;
 pid_t pid_ = 0;  /**< will be set after deamon() */
@@ -147,20 +195,74 @@ typedef google::dense_hash_map<uint64_t, DirectoryListing,
                                hash_murmur<uint64_t> >
         DirectoryHandles;
 DirectoryHandles *directory_handles_ = NULL;
+typedef google::dense_hash_map<uint64_t, DirectoryStream *,
+                               hash_murmur<uint64_t> >
+        DirectoryStreams;
+/**
+ * Shares lock_directory_handles_ and the handle numbers with
+ * directory_handles_.
+ */
+DirectoryStreams *directory_streams_ = NULL;
 pthread_mutex_t lock_directory_handles_ = PTHREAD_MUTEX_INITIALIZER;
 uint64_t next_directory_handle_ = 0;
 
+
+/**
+ * Used to save and restore open streams on reload.  Only the directory is
+ * copied, the window is refilled on the next readdir call.
+ */
+static DirectoryStreams *CopyDirectoryStreams(const DirectoryStreams &streams) {
+  DirectoryStreams *result = new DirectoryStreams();
+  result->set_empty_key((uint64_t)(-1));
+  result->set_deleted_key((uint64_t)(-2));
+  for (DirectoryStreams::const_iterator i = streams.begin(),
+       iEnd = streams.end(); i != iEnd; ++i)
+  {
+    DirectoryStream *stream = new DirectoryStream();
+    stream->path.Assign(i->second->path);
+    stream->info_self = i->second->info_self;
+    stream->info_parent = i->second->info_parent;
+    stream->has_parent = i->second->has_parent;
+    (*result)[i->first] = stream;
+  }
+  return result;
+}
+
+
+static void FreeDirectoryStreams(DirectoryStreams *streams) {
+  if (streams == NULL)
+    return;
+  for (DirectoryStreams::iterator i = streams->begin(), iEnd = streams->end();
+       i != iEnd; ++i)
+  {
+    delete i->second;
+  }
+  delete streams;
+}
+
 unsigned max_open_files_; /**< maximum allowed number of open files */
 /**
  * Number of reserved file descriptors for internal use
  */
 const int kNumReservedFd = 512;
+/**
+ * Partially fetched files with larger blocks in their digest tree are opened
+ * normally.  A range request fetches and verifies at least one block.
+ */
+const uint32_t kMaxPartialFetchBlockSize = 8 * 1024 * 1024;
 
 
+/**
+ * A single lock-free load of the current runtime configuration, which also
+ * tracks the caching state of the remounter.
+ */
 static inline double GetKcacheTimeout() {
-  if (!fuse_remounter_->IsCaching())
-    return 0.0;
-  return mount_point_->kcache_timeout_sec();
+  return mount_point_->runtime_config()->Get()->GetKcacheTimeout();
+}
+
+
+static inline double GetKcacheNegativeTimeout() {
+  return mount_point_->runtime_config()->Get()->GetKcacheNegativeTimeout();
 }
 
 
@@ -271,6 +373,42 @@ static bool GetDirentForInode(const fuse_ino_t ino,
 }
 
 
+/**
+ * With CVMFS_STABLE_INODES, an entry that the kernel does not know gets its
+ * inode from its path and its attributes instead of from its row in the
+ * catalog.  An entry that does not change in the next revision thus keeps its
+ * inode, a changed entry gets another one.  Hardlinks keep the shared inode of
+ * their group and the root entry keeps its fixed inode.
+ */
+static void SetStableInode(const shash::Md5 &md5path,
+                           catalog::DirectoryEntry *dirent)
+{
+  if (!mount_point_->stable_inodes() || (dirent->hardlink_group() != 0) ||
+      (dirent->inode() == mount_point_->catalog_mgr()->GetRootInode()))
+  {
+    return;
+  }
+
+  const shash::Any checksum = dirent->checksum();
+  const LinkString symlink = dirent->symlink();
+  uint64_t attributes[3];
+  attributes[0] = dirent->size();
+  attributes[1] = dirent->mtime();
+  attributes[2] = dirent->mode();
+  uint64_t fingerprint =
+    MurmurHash64A(attributes, sizeof(attributes), checksum.algorithm);
+  fingerprint = MurmurHash64A(checksum.digest, checksum.GetDigestSize(),
+                              fingerprint);
+  fingerprint = MurmurHash64A(symlink.GetChars(), symlink.GetLength(),
+                              fingerprint);
+
+  const uint64_t inode =
+    mount_point_->inode_tracker()->FindStableInode(md5path, fingerprint);
+  if (inode != 0)
+    dirent->set_inode(inode);
+}
+
+
 static bool GetDirentForPath(const PathString &path,
                              catalog::DirectoryEntry *dirent)
 {
@@ -287,6 +425,13 @@ static bool GetDirentForPath(const PathString &path,
     return true;
   }
 
+  Md5PathSnapshot *md5path_snapshot = mount_point_->md5path_snapshot();
+  if ((md5path_snapshot != NULL) && md5path_snapshot->IsNegative(md5path)) {
+    *dirent = catalog::DirectoryEntry(catalog::kDirentNegative);
+    mount_point_->md5path_cache()->InsertNegative(md5path);
+    return false;
+  }
+
   catalog::ClientCatalogManager *catalog_mgr = mount_point_->catalog_mgr();
 
   // Lookup inode in catalog TODO: not twice md5 calculation
@@ -299,6 +444,8 @@ static bool GetDirentForPath(const PathString &path,
     } else {
       if (live_inode != 0)
         dirent->set_inode(live_inode);
+      else
+        SetStableInode(md5path, dirent);
     }
     mount_point_->md5path_cache()->Insert(md5path, *dirent);
     return true;
@@ -313,6 +460,66 @@ static bool GetDirentForPath(const PathString &path,
 }
 
 
+/**
+ * Like GetDirentForPath() for an entry of a directory listing.  The listing
+ * already carries the complete directory entry, so instead of another
+ * catalog lookup per entry, the entry goes directly into the md5path cache.
+ * The lookup and getattr calls that the kernel issues for every entry of an
+ * "ls -l" or a "find" are then answered from the cache.  Nested catalog
+ * mountpoints take the regular path because their lookup returns the root
+ * entry of the nested catalog.
+ */
+static bool GetDirentForListingEntry(
+  const PathString &path,
+  const catalog::DirectoryEntry &listing_dirent,
+  catalog::DirectoryEntry *dirent)
+{
+  if (file_system_->IsNfsSource() ||
+      listing_dirent.IsNestedCatalogMountpoint() ||
+      listing_dirent.IsNestedCatalogRoot() ||
+      listing_dirent.IsBindMountpoint())
+  {
+    return GetDirentForPath(path, dirent);
+  }
+
+  *dirent = listing_dirent;
+  shash::Md5 md5path(path.GetChars(), path.GetLength());
+  const uint64_t live_inode = mount_point_->inode_tracker()->FindInode(path);
+  if (live_inode != 0)
+    dirent->set_inode(live_inode);
+  else
+    SetStableInode(md5path, dirent);
+  mount_point_->md5path_cache()->Insert(md5path, *dirent);
+  return true;
+}
+
+
+/**
+ * Retrieves the chunk list of a chunked file.  The lists are cached by the
+ * bulk content hash of the file, which changes whenever the chunks change.
+ * Files without a bulk hash always go to the catalog.  Needs to be called
+ * inside the remount fence.
+ */
+static bool ListFileChunks(const PathString &path,
+                           const catalog::DirectoryEntry &dirent,
+                           FileChunkList *chunks)
+{
+  const shash::Any &bulk_hash = dirent.checksum();
+  lru::ChunkListCache *chunk_list_cache = mount_point_->chunk_list_cache();
+  if (!bulk_hash.IsNull() && chunk_list_cache->Lookup(bulk_hash, chunks))
+    return true;
+
+  if (!mount_point_->catalog_mgr()->ListFileChunks(
+        path, dirent.hash_algorithm(), chunks))
+  {
+    return false;
+  }
+  if (!bulk_hash.IsNull() && !chunks->IsEmpty())
+    chunk_list_cache->Insert(bulk_hash, *chunks);
+  return true;
+}
+
+
 static bool GetPathForInode(const fuse_ino_t ino, PathString *path) {
   // Check the path cache first
   if (mount_point_->path_cache()->Lookup(ino, path))
@@ -339,12 +546,34 @@ static bool GetPathForInode(const fuse_ino_t ino, PathString *path) {
 }
 
 
+/**
+ * Fires the fuse_op_entry and fuse_op_exit tracepoints around a FUSE callback.
+ * The exit marks the return of the callback, which can be before the reply for
+ * asynchronous reads.
+ */
+class FuseOpProbe {
+ public:
+  FuseOpProbe(const char *op, const fuse_ino_t ino) : op_(op), ino_(ino) {
+    CVMFS_PROBE2(fuse_op_entry, op_, uint64_t(ino_));
+  }
+  ~FuseOpProbe() {
+    CVMFS_PROBE2(fuse_op_exit, op_, uint64_t(ino_));
+  }
+
+ private:
+  const char *op_;
+  const fuse_ino_t ino_;
+};
+
+
 /**
  * Find the inode number of a file name in a directory given by inode.
  * This or getattr is called as kind of prerequisit to every operation.
  * We do check catalog TTL here (and reload, if necessary).
  */
 static void cvmfs_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+  FuseOpProbe probe("lookup", parent);
+  perf::HistogramTimer latency_timer(file_system_->lat_fs_lookup());
   perf::Inc(file_system_->n_fs_lookup());
   const struct fuse_ctx *fuse_ctx = fuse_req_ctx(req);
   ClientCtxGuard ctx_guard(fuse_ctx->uid, fuse_ctx->gid, fuse_ctx->pid);
@@ -422,6 +651,7 @@ static void cvmfs_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
   fuse_remounter_->fence()->Leave();
   perf::Inc(file_system_->n_fs_lookup_negative());
   result.ino = 0;
+  result.entry_timeout = GetKcacheNegativeTimeout();
   fuse_reply_entry(req, &result);
   return;
 
@@ -439,6 +669,7 @@ static void cvmfs_forget(
   fuse_ino_t ino,
   unsigned long nlookup  // NOLINT
 ) {
+  FuseOpProbe probe("forget", ino);
   perf::Inc(file_system_->n_fs_forget());
 
   // The libfuse high-level library does the same
@@ -453,8 +684,12 @@ static void cvmfs_forget(
   // old kernel/fuse?
   LogCvmfs(kLogCvmfs, kLogDebug, "forget on inode %" PRIu64 " by %u",
            uint64_t(ino), nlookup);
-  if (!file_system_->IsNfsSource())
-    mount_point_->inode_tracker()->VfsPut(ino, nlookup);
+  if (!file_system_->IsNfsSource() &&
+      mount_point_->inode_tracker()->VfsPut(ino, nlookup) &&
+      (mount_point_->page_cache_tracker() != NULL))
+  {
+    mount_point_->page_cache_tracker()->Evict(ino);
+  }
   fuse_remounter_->fence()->Leave();
   fuse_reply_none(req);
 }
@@ -480,6 +715,8 @@ static void ReplyNegative(const catalog::DirectoryEntry &dirent,
 static void cvmfs_getattr(fuse_req_t req, fuse_ino_t ino,
                           struct fuse_file_info *fi)
 {
+  FuseOpProbe probe("getattr", ino);
+  perf::HistogramTimer latency_timer(file_system_->lat_fs_getattr());
   perf::Inc(file_system_->n_fs_stat());
   const struct fuse_ctx *fuse_ctx = fuse_req_ctx(req);
   ClientCtxGuard ctx_guard(fuse_ctx->uid, fuse_ctx->gid, fuse_ctx->pid);
@@ -515,6 +752,7 @@ static void cvmfs_getattr(fuse_req_t req, fuse_ino_t ino,
  * Reads a symlink from the catalog.  Environment variables are expanded.
  */
 static void cvmfs_readlink(fuse_req_t req, fuse_ino_t ino) {
+  FuseOpProbe probe("readlink", ino);
   perf::Inc(file_system_->n_fs_readlink());
   const struct fuse_ctx *fuse_ctx = fuse_req_ctx(req);
   ClientCtxGuard ctx_guard(fuse_ctx->uid, fuse_ctx->gid, fuse_ctx->pid);
@@ -566,12 +804,144 @@ static void AddToDirListing(const fuse_req_t req,
 }
 
 
+static DirectoryStream *OpenDirectoryStream(
+  const PathString &path,
+  const catalog::DirectoryEntry &dirent)
+{
+  DirectoryStream *stream = new DirectoryStream();
+  stream->path.Assign(path);
+  stream->info_self = dirent.GetStatStructure();
+  catalog::DirectoryEntry parent;
+  if (dirent.inode() != mount_point_->catalog_mgr()->GetRootInode() &&
+      GetDirentForPath(GetParentPath(path), &parent))
+  {
+    stream->has_parent = true;
+    stream->info_parent = parent.GetStatStructure();
+  }
+  return stream;
+}
+
+
+/**
+ * Replaces the window of the stream by the entries following offset.  Inodes
+ * are fixed as for the full listing.
+ */
+static bool FillDirectoryStream(const off_t offset, DirectoryStream *stream) {
+  assert(offset >= DirectoryStream::kStreamOffsetRows);
+  uint64_t cursor = offset - DirectoryStream::kStreamOffsetRows;
+  catalog::DirectoryEntryList listing_from_catalog;
+  vector<uint64_t> rowids;
+
+  fuse_remounter_->fence()->Enter();
+  bool retval = mount_point_->catalog_mgr()->ListingPage(
+    stream->path, DirectoryStream::kStreamPageRows, &cursor,
+    &listing_from_catalog, &rowids);
+  if (!retval) {
+    fuse_remounter_->fence()->Leave();
+    stream->page_begin = stream->page_end = -1;
+    return false;
+  }
+
+  stream->page.Clear();
+  stream->page_offsets.clear();
+  for (unsigned i = 0; i < listing_from_catalog.size(); ++i) {
+    const catalog::DirectoryEntry &dirent = listing_from_catalog[i];
+    PathString entry_path;
+    entry_path.Assign(stream->path);
+    entry_path.Append("/", 1);
+    entry_path.Append(dirent.name().GetChars(), dirent.name().GetLength());
+
+    catalog::DirectoryEntry entry_dirent;
+    if (!GetDirentForListingEntry(entry_path, dirent, &entry_dirent)) {
+      LogCvmfs(kLogCvmfs, kLogDebug, "listing entry %s vanished, skipping",
+               entry_path.c_str());
+      continue;
+    }
+    catalog::StatEntry *entry = stream->page.PushBackDefault();
+    entry->name = dirent.name();
+    entry->info = dirent.GetStatStructure();
+    entry->info.st_ino = entry_dirent.inode();
+    stream->page_offsets.push_back(
+      rowids[i] + DirectoryStream::kStreamOffsetRows);
+  }
+  fuse_remounter_->fence()->Leave();
+
+  stream->page_begin = offset;
+  stream->page_end = cursor + DirectoryStream::kStreamOffsetRows;
+  return true;
+}
+
+
+/**
+ * Sends as many entries after offset as fit into max_size bytes.  Refills the
+ * window of the stream as necessary.
+ */
+static void ReplyDirectoryStream(const fuse_req_t req,
+                                 DirectoryStream *stream,
+                                 off_t offset,
+                                 const size_t max_size)
+{
+  char *buffer = static_cast<char *>(smalloc(max_size));
+  size_t size = 0;
+  while (true) {
+    const char *name;
+    const struct stat *info;
+    off_t next_offset;
+    if (offset < 1) {
+      name = ".";
+      info = &stream->info_self;
+      next_offset = 1;
+    } else if (offset < DirectoryStream::kStreamOffsetRows) {
+      if (!stream->has_parent) {
+        offset = DirectoryStream::kStreamOffsetRows;
+        continue;
+      }
+      name = "..";
+      info = &stream->info_parent;
+      next_offset = DirectoryStream::kStreamOffsetRows;
+    } else {
+      if (!stream->Covers(offset) && !FillDirectoryStream(offset, stream)) {
+        if (size == 0) {
+          free(buffer);
+          fuse_reply_err(req, EIO);
+          return;
+        }
+        break;
+      }
+      if (stream->page_begin == stream->page_end)
+        break;
+      vector<off_t>::const_iterator iter_next = upper_bound(
+        stream->page_offsets.begin(), stream->page_offsets.end(), offset);
+      if (iter_next == stream->page_offsets.end()) {
+        // Only hidden or vanished entries left in the window
+        offset = stream->page_end;
+        continue;
+      }
+      const unsigned idx = iter_next - stream->page_offsets.begin();
+      name = stream->page.AtPtr(idx)->name.c_str();
+      info = &stream->page.AtPtr(idx)->info;
+      next_offset = *iter_next;
+    }
+
+    const size_t entry_size = fuse_add_direntry(
+      req, buffer + size, max_size - size, name, info, next_offset);
+    if (entry_size > max_size - size)
+      break;
+    size += entry_size;
+    offset = next_offset;
+  }
+  fuse_reply_buf(req, buffer, size);
+  free(buffer);
+}
+
+
 /**
  * Open a directory for listing.
  */
 static void cvmfs_opendir(fuse_req_t req, fuse_ino_t ino,
                           struct fuse_file_info *fi)
 {
+  FuseOpProbe probe("opendir", ino);
   const struct fuse_ctx *fuse_ctx = fuse_req_ctx(req);
   ClientCtxGuard ctx_guard(fuse_ctx->uid, fuse_ctx->gid, fuse_ctx->pid);
   fuse_remounter_->TryFinish();
@@ -596,6 +966,7 @@ static void cvmfs_opendir(fuse_req_t req, fuse_ino_t ino,
     fuse_reply_err(req, ENOENT);
     return;
   }
+  mount_point_->tracer()->Trace(Tracer::kEventLs, path, "opendir()");
   found = GetDirentForInode(ino, &d);
 
   if (!found) {
@@ -612,6 +983,25 @@ static void cvmfs_opendir(fuse_req_t req, fuse_ino_t ino,
   LogCvmfs(kLogCvmfs, kLogDebug, "cvmfs_opendir on inode: %" PRIu64 ", path %s",
            uint64_t(ino), path.c_str());
 
+  if (mount_point_->stream_listing()) {
+    DirectoryStream *stream = OpenDirectoryStream(path, d);
+    fuse_remounter_->fence()->Leave();
+
+    pthread_mutex_lock(&lock_directory_handles_);
+    LogCvmfs(kLogCvmfs, kLogDebug,
+             "linking directory stream %" PRIu64 " to dir inode: %" PRIu64,
+             next_directory_handle_, uint64_t(ino));
+    (*directory_streams_)[next_directory_handle_] = stream;
+    fi->fh = next_directory_handle_;
+    ++next_directory_handle_;
+    pthread_mutex_unlock(&lock_directory_handles_);
+    perf::Inc(file_system_->n_fs_dir_open());
+    perf::Inc(file_system_->no_open_dirs());
+
+    fuse_reply_open(req, fi);
+    return;
+  }
+
   // Build listing
   BigVector<char> fuse_listing(512);
 
@@ -630,8 +1020,8 @@ static void cvmfs_opendir(fuse_req_t req, fuse_ino_t ino,
   }
 
   // Add all names
-  catalog::StatEntryList listing_from_catalog;
-  bool retval = catalog_mgr->ListingStat(path, &listing_from_catalog);
+  catalog::DirectoryEntryList listing_from_catalog;
+  bool retval = catalog_mgr->Listing(path, &listing_from_catalog);
 
   if (!retval) {
     fuse_remounter_->fence()->Leave();
@@ -640,24 +1030,26 @@ static void cvmfs_opendir(fuse_req_t req, fuse_ino_t ino,
     return;
   }
   for (unsigned i = 0; i < listing_from_catalog.size(); ++i) {
+    const catalog::DirectoryEntry &dirent = listing_from_catalog[i];
+    if (dirent.IsHidden())
+      continue;
+
     // Fix inodes
     PathString entry_path;
     entry_path.Assign(path);
     entry_path.Append("/", 1);
-    entry_path.Append(listing_from_catalog.AtPtr(i)->name.GetChars(),
-                      listing_from_catalog.AtPtr(i)->name.GetLength());
+    entry_path.Append(dirent.name().GetChars(), dirent.name().GetLength());
 
     catalog::DirectoryEntry entry_dirent;
-    if (!GetDirentForPath(entry_path, &entry_dirent)) {
+    if (!GetDirentForListingEntry(entry_path, dirent, &entry_dirent)) {
       LogCvmfs(kLogCvmfs, kLogDebug, "listing entry %s vanished, skipping",
                entry_path.c_str());
       continue;
     }
 
-    struct stat fixed_info = listing_from_catalog.AtPtr(i)->info;
+    struct stat fixed_info = dirent.GetStatStructure();
     fixed_info.st_ino = entry_dirent.inode();
-    AddToDirListing(req, listing_from_catalog.AtPtr(i)->name.c_str(),
-                    &fixed_info, &fuse_listing);
+    AddToDirListing(req, dirent.name().c_str(), &fixed_info, &fuse_listing);
   }
   fuse_remounter_->fence()->Leave();
 
@@ -691,6 +1083,7 @@ static void cvmfs_opendir(fuse_req_t req, fuse_ino_t ino,
 static void cvmfs_releasedir(fuse_req_t req, fuse_ino_t ino,
                              struct fuse_file_info *fi)
 {
+  FuseOpProbe probe("releasedir", ino);
   ino = mount_point_->catalog_mgr()->MangleInode(ino);
   LogCvmfs(kLogCvmfs, kLogDebug, "cvmfs_releasedir on inode %" PRIu64
            ", handle %d", uint64_t(ino), fi->fh);
@@ -698,6 +1091,15 @@ static void cvmfs_releasedir(fuse_req_t req, fuse_ino_t ino,
   int reply = 0;
 
   pthread_mutex_lock(&lock_directory_handles_);
+  DirectoryStreams::iterator iter_stream = directory_streams_->find(fi->fh);
+  if (iter_stream != directory_streams_->end()) {
+    delete iter_stream->second;
+    directory_streams_->erase(iter_stream);
+    pthread_mutex_unlock(&lock_directory_handles_);
+    perf::Dec(file_system_->no_open_dirs());
+    fuse_reply_err(req, 0);
+    return;
+  }
   DirectoryHandles::iterator iter_handle =
     directory_handles_->find(fi->fh);
   if (iter_handle != directory_handles_->end()) {
@@ -739,6 +1141,7 @@ static void ReplyBufferSlice(const fuse_req_t req, const char *buffer,
 static void cvmfs_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
                           off_t off, struct fuse_file_info *fi)
 {
+  FuseOpProbe probe("readdir", ino);
   LogCvmfs(kLogCvmfs, kLogDebug,
            "cvmfs_readdir on inode %" PRIu64 " reading %d bytes from offset %d",
            uint64_t(mount_point_->catalog_mgr()->MangleInode(ino)), size, off);
@@ -746,6 +1149,19 @@ static void cvmfs_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
   DirectoryListing listing;
 
   pthread_mutex_lock(&lock_directory_handles_);
+  DirectoryStreams::const_iterator iter_stream =
+    directory_streams_->find(fi->fh);
+  if (iter_stream != directory_streams_->end()) {
+    // The kernel serializes readdir calls on the same handle and does not
+    // release the handle while a readdir call is pending
+    DirectoryStream *stream = iter_stream->second;
+    pthread_mutex_unlock(&lock_directory_handles_);
+
+    const struct fuse_ctx *fuse_ctx = fuse_req_ctx(req);
+    ClientCtxGuard ctx_guard(fuse_ctx->uid, fuse_ctx->gid, fuse_ctx->pid);
+    ReplyDirectoryStream(req, stream, off, size);
+    return;
+  }
   DirectoryHandles::const_iterator iter_handle =
     directory_handles_->find(fi->fh);
   if (iter_handle != directory_handles_->end()) {
@@ -761,6 +1177,198 @@ static void cvmfs_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
 }
 
 
+/**
+ * Sends the result of fetching a regular file to the kernel.  Needs to be
+ * called right after Fetch() because it inspects errno.
+ */
+static void ReplyOpen(fuse_req_t req, struct fuse_file_info *fi,
+                      fuse_ino_t ino, const PathString &path,
+                      const shash::Any &id, int fd)
+{
+  if (fd >= 0) {
+    if (perf::Xadd(file_system_->no_open_files(), 1) <
+        (static_cast<int>(max_open_files_))-kNumReservedFd) {
+      LogCvmfs(kLogCvmfs, kLogDebug, "file %s opened (fd %d)",
+               path.c_str(), fd);
+      // The same inode can refer to different revisions of a path.  Don't
+      // cache unless the page cache tracker knows that the content is the same.
+      glue::PageCacheTracker *page_cache_tracker =
+        mount_point_->page_cache_tracker();
+      fi->keep_cache = (page_cache_tracker != NULL) &&
+                       page_cache_tracker->Open(ino, id);
+      fi->fh = fd;
+      fuse_reply_open(req, fi);
+      return;
+    } else {
+      if (file_system_->cache_mgr()->Close(fd) == 0)
+        perf::Dec(file_system_->no_open_files());
+      LogCvmfs(kLogCvmfs, kLogSyslogErr, "open file descriptor limit exceeded");
+      fuse_reply_err(req, EMFILE);
+      return;
+    }
+    assert(false);
+  }
+
+  // fd < 0
+  LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslogErr,
+           "failed to open inode: %" PRIu64 ", CAS key %s, error code %d",
+           uint64_t(ino), id.ToString().c_str(), errno);
+  if (errno == EMFILE) {
+    fuse_reply_err(req, EMFILE);
+    return;
+  }
+
+  mount_point_->backoff_throttle()->Throttle();
+
+  perf::Inc(file_system_->n_io_error());
+  fuse_reply_err(req, -fd);
+}
+
+
+/**
+ * An open() call that waits for the download of the file in a worker thread.
+ */
+struct AsyncOpen {
+  AsyncOpen()
+    : req(NULL)
+    , ino(0)
+    , size(0)
+    , compression_alg(zlib::kZlibDefault)
+    , object_type(CacheManager::kTypeRegular)
+    , fetcher(NULL)
+  {
+    memset(&fi, 0, sizeof(fi));
+  }
+  fuse_req_t req;
+  struct fuse_file_info fi;
+  fuse_ino_t ino;
+  PathString path;
+  shash::Any id;
+  uint64_t size;
+  zlib::Algorithms compression_alg;
+  CacheManager::ObjectType object_type;
+  Fetcher *fetcher;
+};
+
+
+static void MainAsyncOpen(void *data) {
+  AsyncOpen *async_open = reinterpret_cast<AsyncOpen *>(data);
+  const int fd = async_open->fetcher->Fetch(
+    async_open->id,
+    async_open->size,
+    async_open->path.ToString(),
+    async_open->compression_alg,
+    async_open->object_type);
+  ReplyOpen(async_open->req, &async_open->fi, async_open->ino,
+            async_open->path, async_open->id, fd);
+  delete async_open;
+}
+
+
+/**
+ * Large uncompressed regular files can be opened before they are in the cache.
+ * Such files are registered like a chunked file with a single chunk.
+ */
+static bool IsPartialFetchCandidate(const catalog::DirectoryEntry &dirent) {
+  const uint64_t threshold = mount_point_->partial_fetch_size();
+  return (threshold > 0) && (dirent.size() > threshold) &&
+         dirent.IsRegular() && !dirent.IsChunkedFile() &&
+         !dirent.IsExternalFile() && !dirent.IsInlineFile() &&
+         !dirent.IsBundledFile() &&
+         (dirent.compression_algorithm() == zlib::kNoCompression);
+}
+
+
+/**
+ * Range requests of a partially fetched file are only served if the catalog
+ * has the block digests of the file.  Returns NULL if there is no usable
+ * digest tree, in which case the file is opened normally.
+ */
+static DigestTree *LookupPartialFetchTree(
+  const PathString &path,
+  const catalog::DirectoryEntry &dirent)
+{
+  string serialized;
+  if (!mount_point_->catalog_mgr()->LookupDigestTree(path, &serialized))
+    return NULL;
+  UniquePtr<DigestTree> tree(
+    new DigestTree(dirent.checksum().algorithm, DigestTree::kDefaultBlockSize));
+  if (!tree->Parse(serialized) || (tree->file_size() != dirent.size()) ||
+      (tree->block_size() > kMaxPartialFetchBlockSize))
+  {
+    LogCvmfs(kLogCvmfs, kLogDebug, "unusable digest tree of %s",
+             path.c_str());
+    return NULL;
+  }
+  return tree.Release();
+}
+
+
+/**
+ * Hands the download of a partially fetched file over to the read-ahead
+ * workers.  Returns false if the workers cannot take the download, in which
+ * case the file is opened normally.
+ */
+static bool SchedulePartialFetch(const PathString &path,
+                                 const catalog::DirectoryEntry &dirent,
+                                 const CacheManager::ObjectType object_type)
+{
+  FileChunkList chunk_list;
+  chunk_list.PushBack(FileChunk(dirent.checksum(), 0, dirent.size()));
+  FileChunkReflist chunks(&chunk_list, path, zlib::kNoCompression, false);
+  return mount_point_->chunk_prefetcher()->ScheduleChunk(
+    chunks, 0, mount_point_->fetcher(), object_type);
+}
+
+
+/**
+ * If path belongs to a prefetch group that has not been scheduled before, the
+ * other files of the group are handed over to the read-ahead workers.  Only
+ * whole, regular objects are prefetched; chunked and external files are
+ * skipped.
+ */
+static void SchedulePrefetchGroup(const PathString &path) {
+  cvmfs::ChunkPrefetcher *prefetcher = mount_point_->chunk_prefetcher();
+  if (!mount_point_->prefetch_groups() || (prefetcher == NULL) ||
+      (prefetcher->window() == 0))
+  {
+    return;
+  }
+  catalog::ClientCatalogManager *catalog_mgr = mount_point_->catalog_mgr();
+  uint64_t group_id;
+  if (!catalog_mgr->LookupPrefetchGroup(path, &group_id) ||
+      !prefetcher->ClaimGroup(group_id))
+  {
+    return;
+  }
+  catalog::PrefetchGroup group;
+  if (!catalog_mgr->ListPrefetchGroup(
+        path, group_id, cvmfs::ChunkPrefetcher::kMaxGroupSize, &group))
+  {
+    return;
+  }
+
+  LogCvmfs(kLogCvmfs, kLogDebug, "scheduling prefetch group of %s (%u files)",
+           path.c_str(), static_cast<unsigned>(group.size()));
+  for (unsigned i = 0; i < group.size(); ++i) {
+    const catalog::DirectoryEntry &dirent = group[i].dirent;
+    if ((group[i].path == path) || !dirent.IsRegular() ||
+        dirent.IsChunkedFile() || dirent.IsExternalFile() ||
+        dirent.IsInlineFile() || dirent.IsBundledFile())
+    {
+      continue;
+    }
+    FileChunkList chunk_list;
+    chunk_list.PushBack(FileChunk(dirent.checksum(), 0, dirent.size()));
+    FileChunkReflist chunks(&chunk_list, group[i].path,
+                            dirent.compression_algorithm(), false);
+    prefetcher->ScheduleChunk(
+      chunks, 0, mount_point_->fetcher(),
+      mount_point_->GetObjectType(group[i].path, dirent.size()));
+  }
+}
+
+
 /**
  * Open a file from cache.  If necessary, file is downloaded first.
  *
@@ -770,6 +1378,8 @@ static void cvmfs_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
 static void cvmfs_open(fuse_req_t req, fuse_ino_t ino,
                        struct fuse_file_info *fi)
 {
+  FuseOpProbe probe("open", ino);
+  perf::HistogramTimer latency_timer(file_system_->lat_fs_open());
   const struct fuse_ctx *fuse_ctx = fuse_req_ctx(req);
   ClientCtxGuard ctx_guard(fuse_ctx->uid, fuse_ctx->gid, fuse_ctx->pid);
   fuse_remounter_->fence()->Enter();
@@ -788,6 +1398,7 @@ static void cvmfs_open(fuse_req_t req, fuse_ino_t ino,
     fuse_reply_err(req, ENOENT);
     return;
   }
+  mount_point_->tracer()->Trace(Tracer::kEventOpen, path, "open()");
   found = GetDirentForInode(ino, &dirent);
   if (!found) {
     fuse_remounter_->fence()->Leave();
@@ -821,13 +1432,32 @@ static void cvmfs_open(fuse_req_t req, fuse_ino_t ino,
   }
 
   perf::Inc(file_system_->n_fs_open());  // Count actual open / fetch operations
-
-  if (!dirent.IsChunkedFile()) {
+  SchedulePrefetchGroup(path);
+
+  const CacheManager::ObjectType object_type =
+    mount_point_->GetObjectType(path, dirent.size());
+  bool partial_fetch = false;
+  UniquePtr<DigestTree> digest_tree;
+  if (IsPartialFetchCandidate(dirent)) {
+    fd = mount_point_->fetcher()->FetchCached(
+      dirent.checksum(), string(path.GetChars(), path.GetLength()),
+      object_type);
+    if (fd < 0)
+      digest_tree = LookupPartialFetchTree(path, dirent);
+    if (digest_tree.IsValid())
+      partial_fetch = SchedulePartialFetch(path, dirent, object_type);
+  }
+
+  if (!dirent.IsChunkedFile() && !partial_fetch) {
+    if (dirent.IsInlineFile())
+      mount_point_->CacheInlineFile(path, dirent);
+    else if (dirent.IsBundledFile())
+      mount_point_->CacheBundledFile(path, dirent);
     fuse_remounter_->fence()->Leave();
   } else {
     LogCvmfs(kLogCvmfs, kLogDebug,
-             "chunked file %s opened (download delayed to read() call)",
-             path.c_str());
+             "%s file %s opened (download delayed to read() call)",
+             partial_fetch ? "partially fetched" : "chunked", path.c_str());
 
     if (perf::Xadd(file_system_->no_open_files(), 1) >=
         (static_cast<int>(max_open_files_))-kNumReservedFd)
@@ -851,15 +1481,18 @@ static void cvmfs_open(fuse_req_t req, fuse_ino_t ino,
     const uint64_t unique_inode = dirent_origin.inode();
 
     ChunkTables *chunk_tables = mount_point_->chunk_tables();
-    chunk_tables->Lock();
-    if (!chunk_tables->inode2chunks.Contains(unique_inode)) {
-      chunk_tables->Unlock();
+    ChunkTables::InodeShard *inode_shard =
+      chunk_tables->Inode2Shard(unique_inode);
+    inode_shard->Lock();
+    if (!inode_shard->inode2chunks.Contains(unique_inode)) {
+      inode_shard->Unlock();
 
       // Retrieve File chunks from the catalog
       UniquePtr<FileChunkList> chunks(new FileChunkList());
-      if (!catalog_mgr->ListFileChunks(path, dirent.hash_algorithm(),
-                                       chunks.weak_ref()) ||
-          chunks->IsEmpty())
+      if (partial_fetch) {
+        chunks->PushBack(FileChunk(dirent.checksum(), 0, dirent.size()));
+      } else if (!ListFileChunks(path, dirent, chunks.weak_ref()) ||
+                 chunks->IsEmpty())
       {
         fuse_remounter_->fence()->Leave();
         LogCvmfs(kLogCvmfs, kLogDebug| kLogSyslogErr, "file %s is marked as "
@@ -869,42 +1502,48 @@ static void cvmfs_open(fuse_req_t req, fuse_ino_t ino,
       }
       fuse_remounter_->fence()->Leave();
 
-      chunk_tables->Lock();
+      inode_shard->Lock();
       // Check again to avoid race
-      if (!chunk_tables->inode2chunks.Contains(unique_inode)) {
-        chunk_tables->inode2chunks.Insert(
-          unique_inode, FileChunkReflist(chunks.Release(), path,
-                                         dirent.compression_algorithm(),
-                                         dirent.IsExternalFile()));
-        chunk_tables->inode2references.Insert(unique_inode, 1);
+      if (!inode_shard->inode2chunks.Contains(unique_inode)) {
+        FileChunkReflist reflist(chunks.Release(), path,
+                                 dirent.compression_algorithm(),
+                                 dirent.IsExternalFile());
+        reflist.partial = partial_fetch;
+        if (partial_fetch)
+          reflist.digest_tree = digest_tree.Release();
+        inode_shard->inode2chunks.Insert(unique_inode, reflist);
+        inode_shard->inode2references.Insert(unique_inode, 1);
       } else {
         uint32_t refctr;
         bool retval =
-          chunk_tables->inode2references.Lookup(unique_inode, &refctr);
+          inode_shard->inode2references.Lookup(unique_inode, &refctr);
         assert(retval);
-        chunk_tables->inode2references.Insert(unique_inode, refctr+1);
+        inode_shard->inode2references.Insert(unique_inode, refctr+1);
       }
     } else {
       fuse_remounter_->fence()->Leave();
       uint32_t refctr;
       bool retval =
-        chunk_tables->inode2references.Lookup(unique_inode, &refctr);
+        inode_shard->inode2references.Lookup(unique_inode, &refctr);
       assert(retval);
-      chunk_tables->inode2references.Insert(unique_inode, refctr+1);
+      inode_shard->inode2references.Insert(unique_inode, refctr+1);
     }
+    inode_shard->Unlock();
 
     // Update the chunk handle list
+    const uint64_t chunk_handle = chunk_tables->NextHandle();
     LogCvmfs(kLogCvmfs, kLogDebug,
-             "linking chunk handle %d to unique inode: %" PRIu64,
-             chunk_tables->next_handle, uint64_t(unique_inode));
-    chunk_tables->handle2fd.Insert(chunk_tables->next_handle, ChunkFd());
-    chunk_tables->handle2uniqino.Insert(chunk_tables->next_handle,
-                                        unique_inode);
+             "linking chunk handle %" PRIu64 " to unique inode: %" PRIu64,
+             chunk_handle, uint64_t(unique_inode));
+    ChunkTables::HandleShard *handle_shard =
+      chunk_tables->Handle2Shard(chunk_handle);
+    handle_shard->Lock();
+    handle_shard->handle2fd.Insert(chunk_handle, ChunkFd());
+    handle_shard->handle2uniqino.Insert(chunk_handle, unique_inode);
+    handle_shard->Unlock();
     // The same inode can refer to different revisions of a path.  Don't cache.
     fi->keep_cache = 0;
-    fi->fh = static_cast<uint64_t>(-chunk_tables->next_handle);
-    ++chunk_tables->next_handle;
-    chunk_tables->Unlock();
+    fi->fh = static_cast<uint64_t>(-static_cast<int64_t>(chunk_handle));
 
     fuse_reply_open(req, fi);
     return;
@@ -913,48 +1552,325 @@ static void cvmfs_open(fuse_req_t req, fuse_ino_t ino,
   Fetcher *this_fetcher = dirent.IsExternalFile()
     ? mount_point_->external_fetcher()
     : mount_point_->fetcher();
-  fd = this_fetcher->Fetch(
-    dirent.checksum(),
-    dirent.size(),
-    string(path.GetChars(), path.GetLength()),
-    dirent.compression_algorithm(),
-    mount_point_->catalog_mgr()->volatile_flag()
-      ? CacheManager::kTypeVolatile
-      : CacheManager::kTypeRegular);
+  AsyncExecutor *async_executor = mount_point_->async_executor();
+  if ((fd < 0) && (async_executor != NULL)) {
+    fd = this_fetcher->FetchCached(
+      dirent.checksum(), string(path.GetChars(), path.GetLength()),
+      object_type);
+    if (fd < 0) {
+      AsyncOpen *async_open = new AsyncOpen();
+      async_open->req = req;
+      async_open->fi = *fi;
+      async_open->ino = ino;
+      async_open->path.Assign(path);
+      async_open->id = dirent.checksum();
+      async_open->size = dirent.size();
+      async_open->compression_alg = dirent.compression_algorithm();
+      async_open->object_type = object_type;
+      async_open->fetcher = this_fetcher;
+      if (async_executor->Submit(MainAsyncOpen, async_open)) {
+        LogCvmfs(kLogCvmfs, kLogDebug, "deferred open of %s", path.c_str());
+        return;
+      }
+      delete async_open;
+    }
+  }
+  if (fd < 0) {
+    fd = this_fetcher->Fetch(
+      dirent.checksum(),
+      dirent.size(),
+      string(path.GetChars(), path.GetLength()),
+      dirent.compression_algorithm(),
+      object_type);
+  }
+  ReplyOpen(req, fi, ino, path, dirent.checksum(), fd);
+}
 
-  if (fd >= 0) {
-    if (perf::Xadd(file_system_->no_open_files(), 1) <
-        (static_cast<int>(max_open_files_))-kNumReservedFd) {
-      LogCvmfs(kLogCvmfs, kLogDebug, "file %s opened (fd %d)",
-               path.c_str(), fd);
-      // The same inode can refer to different revisions of a path. Don't cache.
-      fi->keep_cache = 0;
-      fi->fh = fd;
-      fuse_reply_open(req, fi);
-      return;
-    } else {
-      if (file_system_->cache_mgr()->Close(fd) == 0)
-        perf::Dec(file_system_->no_open_files());
-      LogCvmfs(kLogCvmfs, kLogSyslogErr, "open file descriptor limit exceeded");
-      fuse_reply_err(req, EMFILE);
-      return;
+
+/**
+ * Tries to reply to a read request by splicing from the cache manager's file
+ * descriptor (zero copy).  Only possible if the cache manager can hand out the
+ * kernel file descriptor, e.g. the POSIX cache.  Returns false if the caller
+ * needs to fall back to Pread() + fuse_reply_buf().
+ */
+static bool ReplySplice(fuse_req_t req, int fd, size_t size, off_t off) {
+#if FUSE_VERSION >= 29
+  if (!mount_point_->splice_read())
+    return false;
+  int native_fd = file_system_->cache_mgr()->GetNativeFd(fd);
+  if (native_fd < 0)
+    return false;
+
+  struct fuse_bufvec bufvec = FUSE_BUFVEC_INIT(size);
+  bufvec.buf[0].flags =
+    static_cast<fuse_buf_flags>(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+  bufvec.buf[0].fd = native_fd;
+  bufvec.buf[0].pos = off;
+  // fuse_reply_data() replies with an error itself if splicing fails
+  fuse_reply_data(req, &bufvec, FUSE_BUF_SPLICE_MOVE);
+  LogCvmfs(kLogCvmfs, kLogDebug, "spliced up to %zu bytes from fd %d to user",
+           size, native_fd);
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+/**
+ * Serves a read from a partially fetched file by a range request.  The range
+ * is extended to whole blocks of the digest tree and verified before any of it
+ * is returned.  The last verified blocks are kept with the handle, so that
+ * sequential reads need one range request per block.  Returns the number of
+ * bytes copied to data or -1 if the range cannot be fetched or verified.
+ */
+static int64_t ReadVerifiedRange(
+  const FileChunkReflist &chunks,
+  Fetcher *fetcher,
+  const string &verbose_path,
+  const uint64_t off,
+  const uint64_t size,
+  ChunkFd *chunk_fd,
+  char *data)
+{
+  const DigestTree *tree = chunks.digest_tree;
+  if (off >= tree->file_size())
+    return 0;
+  const uint64_t end = std::min(off + size, tree->file_size());
+  if ((chunk_fd->verified_data == NULL) || (off < chunk_fd->verified_offset) ||
+      (end > chunk_fd->verified_offset + chunk_fd->verified_size))
+  {
+    uint64_t aligned_offset;
+    uint64_t aligned_size;
+    tree->AlignRange(off, end - off, &aligned_offset, &aligned_size);
+    unsigned char *buffer =
+      static_cast<unsigned char *>(smalloc(aligned_size));
+    const int64_t bytes_fetched = fetcher->FetchRange(
+      chunks.list->AtPtr(0)->content_hash(), verbose_path,
+      aligned_offset, aligned_size, buffer);
+    if (bytes_fetched != static_cast<int64_t>(aligned_size)) {
+      free(buffer);
+      return -1;
+    }
+    if (!tree->VerifyRange(aligned_offset, buffer, aligned_size)) {
+      LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslogErr,
+               "range %" PRIu64 "-%" PRIu64 " of %s does not match the "
+               "block digests", aligned_offset,
+               aligned_offset + aligned_size - 1, chunks.path.c_str());
+      free(buffer);
+      return -1;
+    }
+    free(chunk_fd->verified_data);
+    chunk_fd->verified_data = buffer;
+    chunk_fd->verified_offset = aligned_offset;
+    chunk_fd->verified_size = aligned_size;
+  }
+  memcpy(data, chunk_fd->verified_data + (off - chunk_fd->verified_offset),
+         end - off);
+  return end - off;
+}
+
+
+/**
+ * Reads from a chunked file and replies to the request.  If may_defer is set
+ * and a chunk is not in the cache, returns false without replying and without
+ * changing the handle.  The read then needs to be repeated with may_defer
+ * unset, typically by an asynchronous worker.
+ */
+static bool ReadChunked(fuse_req_t req, fuse_ino_t ino, size_t size,
+                        off_t off, const uint64_t chunk_handle,
+                        const bool may_defer)
+{
+  // Get data chunk (<=128k guaranteed by Fuse)
+  char *data = static_cast<char *>(alloca(size));
+  unsigned int overall_bytes_fetched = 0;
+
+  uint64_t unique_inode;
+  ChunkFd chunk_fd;
+  FileChunkReflist chunks;
+  bool retval;
+
+  // Fetch unique inode, chunk list and file descriptor.  The file descriptor
+  // of the handle only changes under the handle lock.
+  ChunkTables *chunk_tables = mount_point_->chunk_tables();
+  pthread_mutex_t *handle_lock = chunk_tables->Handle2Lock(chunk_handle);
+  LockMutex(handle_lock);
+  ChunkTables::HandleShard *handle_shard =
+    chunk_tables->Handle2Shard(chunk_handle);
+  handle_shard->Lock();
+  retval = handle_shard->handle2uniqino.Lookup(chunk_handle, &unique_inode);
+  if (!retval) {
+    LogCvmfs(kLogCvmfs, kLogDebug, "no unique inode, fall back to fuse ino");
+    unique_inode = ino;
+  }
+  retval = handle_shard->handle2fd.Lookup(chunk_handle, &chunk_fd);
+  assert(retval);
+  handle_shard->Unlock();
+  ChunkTables::InodeShard *inode_shard =
+    chunk_tables->Inode2Shard(unique_inode);
+  inode_shard->Lock();
+  retval = inode_shard->inode2chunks.Lookup(unique_inode, &chunks);
+  assert(retval);
+  inode_shard->Unlock();
+
+  unsigned chunk_idx = chunks.FindChunkIdx(off);
+
+  // Fetch all needed chunks and read the requested data
+  off_t offset_in_chunk = off - chunks.list->AtPtr(chunk_idx)->offset();
+  do {
+    // Open file descriptor to chunk
+    if ((chunk_fd.fd == -1) || (chunk_fd.chunk_idx != chunk_idx)) {
+      const FileChunk *chunk = chunks.list->AtPtr(chunk_idx);
+      Fetcher *chunk_fetcher = chunks.external_data
+        ? mount_point_->external_fetcher()
+        : mount_point_->fetcher();
+      const CacheManager::ObjectType object_type =
+        mount_point_->GetObjectType(chunks.path, chunks.GetFileSize());
+      string verbose_path = "Part of " + chunks.path.ToString();
+      int fd_chunk = -1;
+      if (may_defer || chunks.partial) {
+        fd_chunk = chunk_fetcher->FetchCached(chunk->content_hash(),
+                                              verbose_path, object_type);
+        if ((fd_chunk < 0) && may_defer) {
+          // The file descriptor of the handle is unchanged
+          UnlockMutex(handle_lock);
+          return false;
+        }
+      }
+      // Not yet in the cache: serve the verified blocks of the requested range.
+      // If that fails, wait for the object from the background download.
+      if ((fd_chunk < 0) && chunks.partial) {
+        const int64_t bytes_fetched = ReadVerifiedRange(
+          chunks, chunk_fetcher, verbose_path, off, size, &chunk_fd, data);
+        if (bytes_fetched >= 0) {
+          handle_shard->Lock();
+          handle_shard->handle2fd.Insert(chunk_handle, chunk_fd);
+          handle_shard->Unlock();
+          UnlockMutex(handle_lock);
+          fuse_reply_buf(req, data, bytes_fetched);
+          LogCvmfs(kLogCvmfs, kLogDebug, "pushed %" PRId64 " bytes of %s "
+                   "from a range request to user", bytes_fetched,
+                   chunks.path.c_str());
+          return true;
+        }
+      }
+      // From now on, the handle reads from the cached object
+      free(chunk_fd.verified_data);
+      chunk_fd.verified_data = NULL;
+      if (chunk_fd.fd != -1) file_system_->cache_mgr()->Close(chunk_fd.fd);
+      if (fd_chunk < 0) {
+        if (chunks.external_data) {
+          fd_chunk = chunk_fetcher->Fetch(
+            chunk->content_hash(),
+            chunk->size(),
+            verbose_path,
+            chunks.compression_alg,
+            object_type,
+            chunks.path.ToString(),
+            chunk->offset());
+        } else {
+          fd_chunk = chunk_fetcher->Fetch(
+            chunk->content_hash(),
+            chunk->size(),
+            verbose_path,
+            chunks.compression_alg,
+            object_type);
+        }
+      }
+      chunk_fd.fd = fd_chunk;
+      if (chunk_fd.fd < 0) {
+        chunk_fd.fd = -1;
+        handle_shard->Lock();
+        handle_shard->handle2fd.Insert(chunk_handle, chunk_fd);
+        handle_shard->Unlock();
+        UnlockMutex(handle_lock);
+        fuse_reply_err(req, EIO);
+        return true;
+      }
+      chunk_fd.chunk_idx = chunk_idx;
+      // Moved to a new chunk: get the next ones in the background
+      mount_point_->chunk_prefetcher()->Schedule(
+        chunks, chunk_idx, chunk_fetcher, object_type);
     }
-    assert(false);
-  }
 
-  // fd < 0
-  LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslogErr,
-           "failed to open inode: %" PRIu64 ", CAS key %s, error code %d",
-           uint64_t(ino), dirent.checksum().ToString().c_str(), errno);
-  if (errno == EMFILE) {
-    fuse_reply_err(req, EMFILE);
-    return;
-  }
+    LogCvmfs(kLogCvmfs, kLogDebug, "reading from chunk fd %d",
+             chunk_fd.fd);
+    // Read data from chunk
+    const size_t bytes_to_read = size - overall_bytes_fetched;
+    const size_t remaining_bytes_in_chunk =
+      chunks.list->AtPtr(chunk_idx)->size() - offset_in_chunk;
+    size_t bytes_to_read_in_chunk =
+      std::min(bytes_to_read, remaining_bytes_in_chunk);
+
+    // If the entire request is served from this chunk, try to splice.  The
+    // handle lock protects the chunk fd until the reply is sent.
+    if ((bytes_to_read_in_chunk == size) &&
+        ReplySplice(req, chunk_fd.fd, size, offset_in_chunk))
+    {
+      handle_shard->Lock();
+      handle_shard->handle2fd.Insert(chunk_handle, chunk_fd);
+      handle_shard->Unlock();
+      UnlockMutex(handle_lock);
+      return true;
+    }
+    const int64_t bytes_fetched = file_system_->cache_mgr()->Pread(
+      chunk_fd.fd,
+      data + overall_bytes_fetched,
+      bytes_to_read_in_chunk,
+      offset_in_chunk);
+
+    if (bytes_fetched < 0) {
+      LogCvmfs(kLogCvmfs, kLogSyslogErr, "read err no %" PRId64 " (%s)",
+               bytes_fetched, chunks.path.c_str());
+      handle_shard->Lock();
+      handle_shard->handle2fd.Insert(chunk_handle, chunk_fd);
+      handle_shard->Unlock();
+      UnlockMutex(handle_lock);
+      fuse_reply_err(req, -bytes_fetched);
+      return true;
+    }
+    overall_bytes_fetched += bytes_fetched;
+
+    // Proceed to the next chunk to keep on reading data
+    ++chunk_idx;
+    offset_in_chunk = 0;
+  } while ((overall_bytes_fetched < size) &&
+           (chunk_idx < chunks.list->size()));
+
+  // Update chunk file descriptor
+  handle_shard->Lock();
+  handle_shard->handle2fd.Insert(chunk_handle, chunk_fd);
+  handle_shard->Unlock();
+  UnlockMutex(handle_lock);
+  LogCvmfs(kLogCvmfs, kLogDebug, "released chunk file descriptor %d",
+           chunk_fd.fd);
 
-  mount_point_->backoff_throttle()->Throttle();
+  fuse_reply_buf(req, data, overall_bytes_fetched);
+  LogCvmfs(kLogCvmfs, kLogDebug, "pushed %d bytes to user",
+           overall_bytes_fetched);
+  return true;
+}
 
-  perf::Inc(file_system_->n_io_error());
-  fuse_reply_err(req, -fd);
+
+/**
+ * A read() from a chunked file that waits for the download of a chunk in a
+ * worker thread.
+ */
+struct AsyncRead {
+  AsyncRead() : req(NULL), ino(0), size(0), off(0), chunk_handle(0) { }
+  fuse_req_t req;
+  fuse_ino_t ino;
+  size_t size;
+  off_t off;
+  uint64_t chunk_handle;
+};
+
+
+static void MainAsyncRead(void *data) {
+  AsyncRead *async_read = reinterpret_cast<AsyncRead *>(data);
+  ReadChunked(async_read->req, async_read->ino, async_read->size,
+              async_read->off, async_read->chunk_handle, false);
+  delete async_read;
 }
 
 
@@ -964,16 +1880,14 @@ static void cvmfs_open(fuse_req_t req, fuse_ino_t ino,
 static void cvmfs_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
                        struct fuse_file_info *fi)
 {
+  FuseOpProbe probe("read", ino);
+  perf::HistogramTimer latency_timer(file_system_->lat_fs_read());
   LogCvmfs(kLogCvmfs, kLogDebug,
            "cvmfs_read inode: %" PRIu64 " reading %d bytes from offset %d "
            "fd %d", uint64_t(mount_point_->catalog_mgr()->MangleInode(ino)),
            size, off, fi->fh);
   perf::Inc(file_system_->n_fs_read());
 
-  // Get data chunk (<=128k guaranteed by Fuse)
-  char *data = static_cast<char *>(alloca(size));
-  unsigned int overall_bytes_fetched = 0;
-
   // Do we have a a chunked file?
   if (static_cast<int64_t>(fi->fh) < 0) {
     const struct fuse_ctx *fuse_ctx = fuse_req_ctx(req);
@@ -981,126 +1895,40 @@ static void cvmfs_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
 
     const uint64_t chunk_handle =
       static_cast<uint64_t>(-static_cast<int64_t>(fi->fh));
-    uint64_t unique_inode;
-    ChunkFd chunk_fd;
-    FileChunkReflist chunks;
-    bool retval;
-
-    // Fetch unique inode, chunk list and file descriptor
-    ChunkTables *chunk_tables = mount_point_->chunk_tables();
-    chunk_tables->Lock();
-    retval = chunk_tables->handle2uniqino.Lookup(chunk_handle, &unique_inode);
-    if (!retval) {
-      LogCvmfs(kLogCvmfs, kLogDebug, "no unique inode, fall back to fuse ino");
-      unique_inode = ino;
-    }
-    retval = chunk_tables->inode2chunks.Lookup(unique_inode, &chunks);
-    assert(retval);
-    chunk_tables->Unlock();
-
-    unsigned chunk_idx = chunks.FindChunkIdx(off);
-
-    // Lock chunk handle
-    pthread_mutex_t *handle_lock = chunk_tables->Handle2Lock(chunk_handle);
-    LockMutex(handle_lock);
-    chunk_tables->Lock();
-    retval = chunk_tables->handle2fd.Lookup(chunk_handle, &chunk_fd);
-    assert(retval);
-    chunk_tables->Unlock();
-
-    // Fetch all needed chunks and read the requested data
-    off_t offset_in_chunk = off - chunks.list->AtPtr(chunk_idx)->offset();
-    do {
-      // Open file descriptor to chunk
-      if ((chunk_fd.fd == -1) || (chunk_fd.chunk_idx != chunk_idx)) {
-        if (chunk_fd.fd != -1) file_system_->cache_mgr()->Close(chunk_fd.fd);
-        string verbose_path = "Part of " + chunks.path.ToString();
-        if (chunks.external_data) {
-          chunk_fd.fd = mount_point_->external_fetcher()->Fetch(
-            chunks.list->AtPtr(chunk_idx)->content_hash(),
-            chunks.list->AtPtr(chunk_idx)->size(),
-            verbose_path,
-            chunks.compression_alg,
-            mount_point_->catalog_mgr()->volatile_flag()
-              ? CacheManager::kTypeVolatile
-              : CacheManager::kTypeRegular,
-            chunks.path.ToString(),
-            chunks.list->AtPtr(chunk_idx)->offset());
-        } else {
-          chunk_fd.fd = mount_point_->fetcher()->Fetch(
-            chunks.list->AtPtr(chunk_idx)->content_hash(),
-            chunks.list->AtPtr(chunk_idx)->size(),
-            verbose_path,
-            chunks.compression_alg,
-            mount_point_->catalog_mgr()->volatile_flag()
-              ? CacheManager::kTypeVolatile
-              : CacheManager::kTypeRegular);
-        }
-        if (chunk_fd.fd < 0) {
-          chunk_fd.fd = -1;
-          chunk_tables->Lock();
-          chunk_tables->handle2fd.Insert(chunk_handle, chunk_fd);
-          chunk_tables->Unlock();
-          UnlockMutex(handle_lock);
-          fuse_reply_err(req, EIO);
-          return;
-        }
-        chunk_fd.chunk_idx = chunk_idx;
-      }
+    AsyncExecutor *async_executor = mount_point_->async_executor();
+    if (ReadChunked(req, ino, size, off, chunk_handle, async_executor != NULL))
+      return;
 
-      LogCvmfs(kLogCvmfs, kLogDebug, "reading from chunk fd %d",
-               chunk_fd.fd);
-      // Read data from chunk
-      const size_t bytes_to_read = size - overall_bytes_fetched;
-      const size_t remaining_bytes_in_chunk =
-        chunks.list->AtPtr(chunk_idx)->size() - offset_in_chunk;
-      size_t bytes_to_read_in_chunk =
-        std::min(bytes_to_read, remaining_bytes_in_chunk);
-      const int64_t bytes_fetched = file_system_->cache_mgr()->Pread(
-        chunk_fd.fd,
-        data + overall_bytes_fetched,
-        bytes_to_read_in_chunk,
-        offset_in_chunk);
-
-      if (bytes_fetched < 0) {
-        LogCvmfs(kLogCvmfs, kLogSyslogErr, "read err no %" PRId64 " (%s)",
-                 bytes_fetched, chunks.path.ToString().c_str());
-        chunk_tables->Lock();
-        chunk_tables->handle2fd.Insert(chunk_handle, chunk_fd);
-        chunk_tables->Unlock();
-        UnlockMutex(handle_lock);
-        fuse_reply_err(req, -bytes_fetched);
-        return;
-      }
-      overall_bytes_fetched += bytes_fetched;
-
-      // Proceed to the next chunk to keep on reading data
-      ++chunk_idx;
-      offset_in_chunk = 0;
-    } while ((overall_bytes_fetched < size) &&
-             (chunk_idx < chunks.list->size()));
-
-    // Update chunk file descriptor
-    chunk_tables->Lock();
-    chunk_tables->handle2fd.Insert(chunk_handle, chunk_fd);
-    chunk_tables->Unlock();
-    UnlockMutex(handle_lock);
-    LogCvmfs(kLogCvmfs, kLogDebug, "released chunk file descriptor %d",
-             chunk_fd.fd);
-  } else {
-    const int64_t fd = fi->fh;
-    int64_t nbytes = file_system_->cache_mgr()->Pread(fd, data, size, off);
-    if (nbytes < 0) {
-      fuse_reply_err(req, -nbytes);
+    AsyncRead *async_read = new AsyncRead();
+    async_read->req = req;
+    async_read->ino = ino;
+    async_read->size = size;
+    async_read->off = off;
+    async_read->chunk_handle = chunk_handle;
+    if (async_executor->Submit(MainAsyncRead, async_read)) {
+      LogCvmfs(kLogCvmfs, kLogDebug, "deferred read from chunk handle %" PRIu64,
+               chunk_handle);
       return;
     }
-    overall_bytes_fetched = nbytes;
+    delete async_read;
+    ReadChunked(req, ino, size, off, chunk_handle, false);
+    return;
+  }
+
+  const int64_t fd = fi->fh;
+  if (ReplySplice(req, fd, size, off))
+    return;
+  // Get data chunk (<=128k guaranteed by Fuse)
+  char *data = static_cast<char *>(alloca(size));
+  int64_t nbytes = file_system_->cache_mgr()->Pread(fd, data, size, off);
+  if (nbytes < 0) {
+    fuse_reply_err(req, -nbytes);
+    return;
   }
 
   // Push it to user
-  fuse_reply_buf(req, data, overall_bytes_fetched);
-  LogCvmfs(kLogCvmfs, kLogDebug, "pushed %d bytes to user",
-           overall_bytes_fetched);
+  fuse_reply_buf(req, data, nbytes);
+  LogCvmfs(kLogCvmfs, kLogDebug, "pushed %" PRId64 " bytes to user", nbytes);
 }
 
 
@@ -1110,6 +1938,7 @@ static void cvmfs_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
 static void cvmfs_release(fuse_req_t req, fuse_ino_t ino,
                           struct fuse_file_info *fi)
 {
+  FuseOpProbe probe("release", ino);
   ino = mount_point_->catalog_mgr()->MangleInode(ino);
   LogCvmfs(kLogCvmfs, kLogDebug, "cvmfs_release on inode: %" PRIu64,
            uint64_t(ino));
@@ -1128,48 +1957,59 @@ static void cvmfs_release(fuse_req_t req, fuse_ino_t ino,
     bool retval;
 
     ChunkTables *chunk_tables = mount_point_->chunk_tables();
-    chunk_tables->Lock();
-    retval = chunk_tables->handle2uniqino.Lookup(chunk_handle, &unique_inode);
+    ChunkTables::HandleShard *handle_shard =
+      chunk_tables->Handle2Shard(chunk_handle);
+    handle_shard->Lock();
+    retval = handle_shard->handle2uniqino.Lookup(chunk_handle, &unique_inode);
     if (!retval) {
       LogCvmfs(kLogCvmfs, kLogDebug, "no unique inode, fall back to fuse ino");
       unique_inode = ino;
     } else {
-      chunk_tables->handle2uniqino.Erase(chunk_handle);
+      handle_shard->handle2uniqino.Erase(chunk_handle);
     }
-    retval = chunk_tables->handle2fd.Lookup(chunk_handle, &chunk_fd);
+    retval = handle_shard->handle2fd.Lookup(chunk_handle, &chunk_fd);
     assert(retval);
-    chunk_tables->handle2fd.Erase(chunk_handle);
+    handle_shard->handle2fd.Erase(chunk_handle);
+    handle_shard->Unlock();
 
-    retval = chunk_tables->inode2references.Lookup(unique_inode, &refctr);
+    ChunkTables::InodeShard *inode_shard =
+      chunk_tables->Inode2Shard(unique_inode);
+    inode_shard->Lock();
+    retval = inode_shard->inode2references.Lookup(unique_inode, &refctr);
     assert(retval);
     refctr--;
     if (refctr == 0) {
       LogCvmfs(kLogCvmfs, kLogDebug, "releasing chunk list for inode %" PRIu64,
                uint64_t(unique_inode));
       FileChunkReflist to_delete;
-      retval = chunk_tables->inode2chunks.Lookup(unique_inode, &to_delete);
+      retval = inode_shard->inode2chunks.Lookup(unique_inode, &to_delete);
       assert(retval);
-      chunk_tables->inode2references.Erase(unique_inode);
-      chunk_tables->inode2chunks.Erase(unique_inode);
+      inode_shard->inode2references.Erase(unique_inode);
+      inode_shard->inode2chunks.Erase(unique_inode);
       delete to_delete.list;
+      delete to_delete.digest_tree;
     } else {
-      chunk_tables->inode2references.Insert(unique_inode, refctr);
+      inode_shard->inode2references.Insert(unique_inode, refctr);
     }
-    chunk_tables->Unlock();
+    inode_shard->Unlock();
 
     if (chunk_fd.fd != -1)
       file_system_->cache_mgr()->Close(chunk_fd.fd);
+    free(chunk_fd.verified_data);
     perf::Dec(file_system_->no_open_files());
   } else {
     if (file_system_->cache_mgr()->Close(fd) == 0) {
       perf::Dec(file_system_->no_open_files());
     }
+    if (mount_point_->page_cache_tracker() != NULL)
+      mount_point_->page_cache_tracker()->Close(ino);
   }
   fuse_reply_err(req, 0);
 }
 
 
 static void cvmfs_statfs(fuse_req_t req, fuse_ino_t ino) {
+  FuseOpProbe probe("statfs", ino);
   ino = mount_point_->catalog_mgr()->MangleInode(ino);
   LogCvmfs(kLogCvmfs, kLogDebug, "cvmfs_statfs on inode: %" PRIu64,
            uint64_t(ino));
@@ -1218,6 +2058,268 @@ static void cvmfs_statfs(fuse_req_t req, fuse_ino_t ino) {
 }
 
 
+/**
+ * Computes the value of a magic extended attribute.  Returns 0 or the error
+ * code that is passed to fuse.  For symlinks, d needs to contain the raw
+ * symlink.
+ */
+static int GetMagicXattr(
+  const MagicXattr id,
+  const catalog::DirectoryEntry &d,
+  const PathString &path,
+  string *attribute_value)
+{
+  catalog::ClientCatalogManager *catalog_mgr = mount_point_->catalog_mgr();
+
+  switch (id) {
+    case kMagicXattrPid:
+      *attribute_value = StringifyInt(pid_);
+      break;
+    case kMagicXattrVersion:
+      *attribute_value = string(VERSION) + "." + string(CVMFS_PATCH_LEVEL);
+      break;
+    case kMagicXattrPubkeys:
+      *attribute_value = mount_point_->signature_mgr()->GetActivePubkeys();
+      break;
+    case kMagicXattrHash:
+      if (d.checksum().IsNull())
+        return ENOATTR;
+      *attribute_value = d.checksum().ToString();
+      break;
+    case kMagicXattrLhash: {
+      if (d.checksum().IsNull())
+        return ENOATTR;
+      CacheManager::ObjectInfo object_info;
+      object_info.description = path.ToString();
+      if (catalog_mgr->volatile_flag())
+        object_info.type = CacheManager::kTypeVolatile;
+      int fd = file_system_->cache_mgr()->Open(
+        CacheManager::Bless(d.checksum(), object_info));
+      if (fd < 0) {
+        *attribute_value = "Not in cache";
+      } else {
+        shash::Any hash(d.checksum().algorithm);
+        int retval_i = file_system_->cache_mgr()->ChecksumFd(fd, &hash);
+        if (retval_i != 0)
+          *attribute_value = "I/O error (" + StringifyInt(retval_i) + ")";
+        else
+          *attribute_value = hash.ToString();
+        file_system_->cache_mgr()->Close(fd);
+      }
+      break;
+    }
+    case kMagicXattrXfsrootRawlink:
+    case kMagicXattrRawlink:
+      if (!d.IsLink())
+        return ENOATTR;
+      *attribute_value = d.symlink().ToString();
+      break;
+    case kMagicXattrRevision:
+      *attribute_value = StringifyInt(catalog_mgr->GetRevision());
+      break;
+    case kMagicXattrRootHash:
+      *attribute_value = catalog_mgr->GetRootHash().ToString();
+      break;
+    case kMagicXattrTag:
+      *attribute_value = mount_point_->repository_tag();
+      break;
+    case kMagicXattrExpires:
+      if (fuse_remounter_->catalogs_valid_until() ==
+          MountPoint::kIndefiniteDeadline)
+      {
+        *attribute_value = "never (fixed root catalog)";
+      } else {
+        time_t now = time(NULL);
+        *attribute_value = StringifyInt(
+          (fuse_remounter_->catalogs_valid_until() - now) / 60);
+      }
+      break;
+    case kMagicXattrMaxfd:
+      *attribute_value = StringifyInt(max_open_files_ - kNumReservedFd);
+      break;
+    case kMagicXattrUsedfd:
+      *attribute_value = file_system_->no_open_files()->ToString();
+      break;
+    case kMagicXattrUseddirp:
+      *attribute_value = file_system_->no_open_dirs()->ToString();
+      break;
+    case kMagicXattrNioerr:
+      *attribute_value = file_system_->n_io_error()->ToString();
+      break;
+    case kMagicXattrProxy: {
+      vector< vector<download::DownloadManager::ProxyInfo> > proxy_chain;
+      unsigned current_group;
+      mount_point_->download_mgr()->GetProxyInfo(
+        &proxy_chain, &current_group, NULL);
+      if (proxy_chain.size()) {
+        *attribute_value = proxy_chain[current_group][0].url;
+      } else {
+        *attribute_value = "DIRECT";
+      }
+      break;
+    }
+    case kMagicXattrAuthz:
+      if (!mount_point_->has_membership_req())
+        return ENOATTR;
+      *attribute_value = mount_point_->membership_req();
+      break;
+    case kMagicXattrChunks:
+      if (!d.IsRegular())
+        return ENOATTR;
+      if (d.IsChunkedFile()) {
+        FileChunkList chunks;
+        if (!ListFileChunks(path, d, &chunks) || chunks.IsEmpty())
+        {
+          LogCvmfs(kLogCvmfs, kLogDebug| kLogSyslogErr, "file %s is marked as "
+                   "'chunked', but no chunks found.", path.c_str());
+          return EIO;
+        }
+        *attribute_value = StringifyInt(chunks.size());
+      } else {
+        *attribute_value = "1";
+      }
+      break;
+    case kMagicXattrExternalFile:
+      if (!d.IsRegular())
+        return ENOATTR;
+      *attribute_value = d.IsExternalFile() ? "1" : "0";
+      break;
+    case kMagicXattrFetchTiming: {
+      // Only files that were downloaded recently have timing information
+      if (!d.IsRegular() || (mount_point_->fetch_timing_log() == NULL))
+        return ENOATTR;
+      vector<shash::Any> ids;
+      if (d.IsChunkedFile()) {
+        FileChunkList chunks;
+        if (!ListFileChunks(path, d, &chunks))
+          return ENOATTR;
+        for (unsigned i = 0; i < chunks.size(); ++i)
+          ids.push_back(chunks.AtPtr(i)->content_hash());
+      } else {
+        ids.push_back(d.checksum());
+      }
+      cvmfs::FetchTiming timing;
+      if (!mount_point_->fetch_timing_log()->Lookup(ids, &timing))
+        return ENOATTR;
+      *attribute_value = timing.ToString();
+      break;
+    }
+    case kMagicXattrExternalHost:
+    case kMagicXattrHost:
+    case kMagicXattrHostList: {
+      vector<string> host_chain;
+      vector<int> rtt;
+      unsigned current_host;
+      download::DownloadManager *download_mgr =
+        (id == kMagicXattrExternalHost) ?
+        mount_point_->external_download_mgr() : mount_point_->download_mgr();
+      download_mgr->GetHostInfo(&host_chain, &rtt, &current_host);
+      if (host_chain.empty()) {
+        *attribute_value = "internal error: no hosts defined";
+        break;
+      }
+      *attribute_value = host_chain[current_host];
+      if (id == kMagicXattrHostList) {
+        for (unsigned i = 1; i < host_chain.size(); ++i) {
+          *attribute_value +=
+            ";" + host_chain[(i+current_host) % host_chain.size()];
+        }
+      }
+      break;
+    }
+    case kMagicXattrCompression:
+      if (!d.IsRegular())
+        return ENOATTR;
+      *attribute_value = zlib::AlgorithmName(d.compression_algorithm());
+      break;
+    case kMagicXattrUptime: {
+      time_t now = time(NULL);
+      uint64_t uptime = now - loader_exports_->boot_time;
+      *attribute_value = StringifyInt(uptime / 60);
+      break;
+    }
+    case kMagicXattrNclg:
+      *attribute_value = StringifyInt(catalog_mgr->GetNumCatalogs());
+      break;
+    case kMagicXattrNopen:
+      *attribute_value = file_system_->n_fs_open()->ToString();
+      break;
+    case kMagicXattrNdiropen:
+      *attribute_value = file_system_->n_fs_dir_open()->ToString();
+      break;
+    case kMagicXattrNdownload:
+      *attribute_value =
+        mount_point_->statistics()->Lookup("fetch.n_downloads")->Print();
+      break;
+    case kMagicXattrTimeout:
+    case kMagicXattrTimeoutDirect:
+    case kMagicXattrExternalTimeout: {
+      unsigned seconds, seconds_direct;
+      mount_point_->download_mgr()->GetTimeout(&seconds, &seconds_direct);
+      *attribute_value =
+        StringifyInt((id == kMagicXattrTimeout) ? seconds : seconds_direct);
+      break;
+    }
+    case kMagicXattrRx: {
+      perf::Statistics *statistics = mount_point_->statistics();
+      int64_t rx = statistics->Lookup("download.sz_transferred_bytes")->Get();
+      *attribute_value = StringifyInt(rx/1024);
+      break;
+    }
+    case kMagicXattrSpeed: {
+      perf::Statistics *statistics = mount_point_->statistics();
+      int64_t rx = statistics->Lookup("download.sz_transferred_bytes")->Get();
+      int64_t time = statistics->Lookup("download.sz_transfer_time")->Get();
+      if (time == 0)
+        *attribute_value = "n/a";
+      else
+        *attribute_value = StringifyInt((rx/1024)/time);
+      break;
+    }
+    case kMagicXattrFqrn:
+      *attribute_value = loader_exports_->repository_name;
+      break;
+    case kMagicXattrInodeMax:
+      *attribute_value = StringifyInt(
+        inode_generation_info_.inode_generation +
+        catalog_mgr->inode_gauge());
+      break;
+    case kMagicXattrNcleanup24: {
+      QuotaManager *quota_mgr = file_system_->cache_mgr()->quota_mgr();
+      if (!quota_mgr->HasCapability(QuotaManager::kCapIntrospectCleanupRate)) {
+        *attribute_value = StringifyInt(-1);
+      } else {
+        const uint64_t period_s = 24 * 60 * 60;
+        const uint64_t rate = quota_mgr->GetCleanupRate(period_s);
+        *attribute_value = StringifyInt(rate);
+      }
+      break;
+    }
+    default:
+      return ENOATTR;
+  }
+  return 0;
+}
+
+
+/**
+ * Looks up the custom extended attributes of an inode in the catalog, unless
+ * they are already in the xattr cache.
+ */
+static bool GetXattrsForInode(
+  const fuse_ino_t ino,
+  const PathString &path,
+  XattrList *xattrs)
+{
+  if (mount_point_->xattr_cache()->Lookup(ino, xattrs))
+    return true;
+  if (!mount_point_->catalog_mgr()->LookupXattrs(path, xattrs))
+    return false;
+  mount_point_->xattr_cache()->Insert(ino, *xattrs);
+  return true;
+}
+
+
 #ifdef __APPLE__
 static void cvmfs_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
                            size_t size, uint32_t position)
@@ -1226,6 +2328,7 @@ static void cvmfs_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
                            size_t size)
 #endif
 {
+  FuseOpProbe probe("getxattr", ino);
   const struct fuse_ctx *fuse_ctx = fuse_req_ctx(req);
   ClientCtxGuard ctx_guard(fuse_ctx->uid, fuse_ctx->gid, fuse_ctx->pid);
 
@@ -1243,6 +2346,14 @@ static void cvmfs_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
   }
 
   const string attr = name;
+  // Batched queries (user.stat) return name=value lines of multiple magic
+  // attributes, in which case ids has more than one element
+  vector<MagicXattr> ids;
+  const MagicXattr magic_xattr = LookupMagicXattr(attr);
+  if ((magic_xattr != kMagicXattrNone) && (magic_xattr != kMagicXattrStat))
+    ids.push_back(magic_xattr);
+  const bool is_stat = ids.empty() && ParseMagicXattrStat(attr, &ids);
+
   catalog::DirectoryEntry d;
   const bool found = GetDirentForInode(ino, &d);
   bool retval;
@@ -1251,17 +2362,30 @@ static void cvmfs_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
   PathString path;
   retval = GetPathForInode(ino, &path);
   assert(retval);
-  if (d.IsLink()) {
-    catalog::LookupOptions lookup_options = static_cast<catalog::LookupOptions>(
-      catalog::kLookupSole | catalog::kLookupRawSymlink);
-    catalog::DirectoryEntry raw_symlink;
-    retval = catalog_mgr->LookupPath(path, lookup_options, &raw_symlink);
-    assert(retval);
-    d.set_symlink(raw_symlink.symlink());
-  }
-  if (d.HasXattrs()) {
-    retval = catalog_mgr->LookupXattrs(path, &xattrs);
-    assert(retval);
+  if (ids.empty() && !is_stat) {
+    // Custom extended attribute from the catalog
+    if (d.HasXattrs()) {
+      retval = GetXattrsForInode(ino, path, &xattrs);
+      assert(retval);
+    }
+  } else if (d.IsLink()) {
+    bool needs_raw_symlink = false;
+    for (unsigned i = 0; i < ids.size(); ++i) {
+      if ((ids[i] == kMagicXattrRawlink) ||
+          (ids[i] == kMagicXattrXfsrootRawlink))
+      {
+        needs_raw_symlink = true;
+      }
+    }
+    if (needs_raw_symlink) {
+      catalog::LookupOptions lookup_options =
+        static_cast<catalog::LookupOptions>(
+          catalog::kLookupSole | catalog::kLookupRawSymlink);
+      catalog::DirectoryEntry raw_symlink;
+      retval = catalog_mgr->LookupPath(path, lookup_options, &raw_symlink);
+      assert(retval);
+      d.set_symlink(raw_symlink.symlink());
+    }
   }
   fuse_remounter_->fence()->Leave();
 
@@ -1271,215 +2395,26 @@ static void cvmfs_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
   }
 
   string attribute_value;
-
-  if (attr == "user.pid") {
-    attribute_value = StringifyInt(pid_);
-  } else if (attr == "user.version") {
-    attribute_value = string(VERSION) + "." + string(CVMFS_PATCH_LEVEL);
-  } else if (attr == "user.pubkeys") {
-    attribute_value = mount_point_->signature_mgr()->GetActivePubkeys();
-  } else if (attr == "user.hash") {
-    if (!d.checksum().IsNull()) {
-      attribute_value = d.checksum().ToString();
-    } else {
-      fuse_reply_err(req, ENOATTR);
-      return;
-    }
-  } else if (attr == "user.lhash") {
-    if (!d.checksum().IsNull()) {
-      string result;
-      CacheManager::ObjectInfo object_info;
-      object_info.description = path.ToString();
-      if (mount_point_->catalog_mgr()->volatile_flag())
-        object_info.type = CacheManager::kTypeVolatile;
-      int fd = file_system_->cache_mgr()->Open(
-        CacheManager::Bless(d.checksum(), object_info));
-      if (fd < 0) {
-        attribute_value = "Not in cache";
-      } else {
-        shash::Any hash(d.checksum().algorithm);
-        int retval_i = file_system_->cache_mgr()->ChecksumFd(fd, &hash);
-        if (retval_i != 0)
-          attribute_value = "I/O error (" + StringifyInt(retval_i) + ")";
-        else
-          attribute_value = hash.ToString();
-        file_system_->cache_mgr()->Close(fd);
-      }
-    } else {
-      fuse_reply_err(req, ENOATTR);
-      return;
-    }
-  } else if ((attr == "xfsroot.rawlink") || (attr == "user.rawlink")) {
-    if (d.IsLink()) {
-      attribute_value = d.symlink().ToString();
-    } else {
-      fuse_reply_err(req, ENOATTR);
-      return;
-    }
-  } else if (attr == "user.revision") {
-    const uint64_t revision = catalog_mgr->GetRevision();
-    attribute_value = StringifyInt(revision);
-  } else if (attr == "user.root_hash") {
-    attribute_value = catalog_mgr->GetRootHash().ToString();
-  } else if (attr == "user.tag") {
-    attribute_value = mount_point_->repository_tag();
-  } else if (attr == "user.expires") {
-    if (fuse_remounter_->catalogs_valid_until() ==
-        MountPoint::kIndefiniteDeadline)
-    {
-      attribute_value = "never (fixed root catalog)";
-    } else {
-      time_t now = time(NULL);
-      attribute_value = StringifyInt(
-        (fuse_remounter_->catalogs_valid_until() - now) / 60);
-    }
-  } else if (attr == "user.maxfd") {
-    attribute_value = StringifyInt(max_open_files_ - kNumReservedFd);
-  } else if (attr == "user.usedfd") {
-    attribute_value = file_system_->no_open_files()->ToString();
-  } else if (attr == "user.useddirp") {
-    attribute_value = file_system_->no_open_dirs()->ToString();
-  } else if (attr == "user.nioerr") {
-    attribute_value = file_system_->n_io_error()->ToString();
-  } else if (attr == "user.proxy") {
-    vector< vector<download::DownloadManager::ProxyInfo> > proxy_chain;
-    unsigned current_group;
-    mount_point_->download_mgr()->GetProxyInfo(
-      &proxy_chain, &current_group, NULL);
-    if (proxy_chain.size()) {
-      attribute_value = proxy_chain[current_group][0].url;
-    } else {
-      attribute_value = "DIRECT";
-    }
-  } else if (attr == "user.authz") {
-    if (!mount_point_->has_membership_req()) {
-      fuse_reply_err(req, ENOATTR);
-      return;
-    }
-    attribute_value = mount_point_->membership_req();
-  } else if (attr == "user.chunks") {
-    if (d.IsRegular()) {
-      if (d.IsChunkedFile()) {
-        FileChunkList chunks;
-        if (!catalog_mgr->ListFileChunks(path, d.hash_algorithm(), &chunks) ||
-            chunks.IsEmpty())
-        {
-          LogCvmfs(kLogCvmfs, kLogDebug| kLogSyslogErr, "file %s is marked as "
-                   "'chunked', but no chunks found.", path.c_str());
-          fuse_reply_err(req, EIO);
-          return;
-        } else {
-          attribute_value = StringifyInt(chunks.size());
-        }
-      } else {
-        attribute_value = "1";
+  if (is_stat) {
+    // Attributes that do not apply to the inode are left out
+    for (unsigned i = 0; i < ids.size(); ++i) {
+      string value;
+      int retval_i = GetMagicXattr(ids[i], d, path, &value);
+      if (retval_i == ENOATTR)
+        continue;
+      if (retval_i != 0) {
+        fuse_reply_err(req, retval_i);
+        return;
       }
-    } else {
-      fuse_reply_err(req, ENOATTR);
-      return;
-    }
-  } else if (attr == "user.external_file") {
-    if (d.IsRegular()) {
-      attribute_value = d.IsExternalFile() ? "1" : "0";
-    } else {
-      fuse_reply_err(req, ENOATTR);
-      return;
-    }
-  } else if (attr == "user.external_host") {
-    vector<string> host_chain;
-    vector<int> rtt;
-    unsigned current_host;
-    mount_point_->external_download_mgr()->GetHostInfo(
-      &host_chain, &rtt, &current_host);
-    if (host_chain.size()) {
-      attribute_value = string(host_chain[current_host]);
-    } else {
-      attribute_value = "internal error: no hosts defined";
+      attribute_value +=
+        string(GetMagicXattrName(ids[i])) + "=" + value + "\n";
     }
-  } else if (attr == "user.compression") {
-    if (d.IsRegular()) {
-      attribute_value = zlib::AlgorithmName(d.compression_algorithm());
-    } else {
-      fuse_reply_err(req, ENOATTR);
+  } else if (!ids.empty()) {
+    int retval_i = GetMagicXattr(ids[0], d, path, &attribute_value);
+    if (retval_i != 0) {
+      fuse_reply_err(req, retval_i);
       return;
     }
-  } else if (attr == "user.host") {
-    vector<string> host_chain;
-    vector<int> rtt;
-    unsigned current_host;
-    mount_point_->download_mgr()->GetHostInfo(&host_chain, &rtt, &current_host);
-    if (host_chain.size()) {
-      attribute_value = string(host_chain[current_host]);
-    } else {
-      attribute_value = "internal error: no hosts defined";
-    }
-  } else if (attr == "user.host_list") {
-    vector<string> host_chain;
-    vector<int> rtt;
-    unsigned current_host;
-    mount_point_->download_mgr()->GetHostInfo(&host_chain, &rtt, &current_host);
-    if (host_chain.size()) {
-      attribute_value = host_chain[current_host];
-      for (unsigned i = 1; i < host_chain.size(); ++i) {
-        attribute_value +=
-          ";" + host_chain[(i+current_host) % host_chain.size()];
-      }
-    } else {
-      attribute_value = "internal error: no hosts defined";
-    }
-  } else if (attr == "user.uptime") {
-    time_t now = time(NULL);
-    uint64_t uptime = now - loader_exports_->boot_time;
-    attribute_value = StringifyInt(uptime / 60);
-  } else if (attr == "user.nclg") {
-    const int num_catalogs = catalog_mgr->GetNumCatalogs();
-    attribute_value = StringifyInt(num_catalogs);
-  } else if (attr == "user.nopen") {
-    attribute_value = file_system_->n_fs_open()->ToString();
-  } else if (attr == "user.ndiropen") {
-    attribute_value = file_system_->n_fs_dir_open()->ToString();
-  } else if (attr == "user.ndownload") {
-    attribute_value =
-      mount_point_->statistics()->Lookup("fetch.n_downloads")->Print();
-  } else if (attr == "user.timeout") {
-    unsigned seconds, seconds_direct;
-    mount_point_->download_mgr()->GetTimeout(&seconds, &seconds_direct);
-    attribute_value = StringifyInt(seconds);
-  } else if (attr == "user.timeout_direct") {
-    unsigned seconds, seconds_direct;
-    mount_point_->download_mgr()->GetTimeout(&seconds, &seconds_direct);
-    attribute_value = StringifyInt(seconds_direct);
-  } else if (attr == "user.external_timeout") {
-    unsigned seconds, seconds_direct;
-    mount_point_->download_mgr()->GetTimeout(&seconds, &seconds_direct);
-    attribute_value = StringifyInt(seconds_direct);
-  } else if (attr == "user.rx") {
-    perf::Statistics *statistics = mount_point_->statistics();
-    int64_t rx = statistics->Lookup("download.sz_transferred_bytes")->Get();
-    attribute_value = StringifyInt(rx/1024);
-  } else if (attr == "user.speed") {
-    perf::Statistics *statistics = mount_point_->statistics();
-    int64_t rx = statistics->Lookup("download.sz_transferred_bytes")->Get();
-    int64_t time = statistics->Lookup("download.sz_transfer_time")->Get();
-    if (time == 0)
-      attribute_value = "n/a";
-    else
-      attribute_value = StringifyInt((rx/1024)/time);
-  } else if (attr == "user.fqrn") {
-    attribute_value = loader_exports_->repository_name;
-  } else if (attr == "user.inode_max") {
-    attribute_value = StringifyInt(
-      inode_generation_info_.inode_generation +
-      catalog_mgr->inode_gauge());
-  } else if (attr == "user.ncleanup24") {
-    QuotaManager *quota_mgr = file_system_->cache_mgr()->quota_mgr();
-    if (!quota_mgr->HasCapability(QuotaManager::kCapIntrospectCleanupRate)) {
-      attribute_value = StringifyInt(-1);
-    } else {
-      const uint64_t period_s = 24 * 60 * 60;
-      const uint64_t rate = quota_mgr->GetCleanupRate(period_s);
-      attribute_value = StringifyInt(rate);
-    }
   } else {
     if (!xattrs.Get(attr, &attribute_value)) {
       fuse_reply_err(req, ENOATTR);
@@ -1498,6 +2433,7 @@ static void cvmfs_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
 
 
 static void cvmfs_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
+  FuseOpProbe probe("listxattr", ino);
   const struct fuse_ctx *fuse_ctx = fuse_req_ctx(req);
   ClientCtxGuard ctx_guard(fuse_ctx->uid, fuse_ctx->gid, fuse_ctx->pid);
 
@@ -1515,7 +2451,7 @@ static void cvmfs_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
     PathString path;
     bool retval = GetPathForInode(ino, &path);
     assert(retval);
-    retval = catalog_mgr->LookupXattrs(path, &xattrs);
+    retval = GetXattrsForInode(ino, path, &xattrs);
     assert(retval);
   }
   fuse_remounter_->fence()->Leave();
@@ -1531,7 +2467,7 @@ static void cvmfs_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
     "user.ndownload\0user.timeout\0user.timeout_direct\0user.rx\0user.speed\0"
     "user.fqrn\0user.ndiropen\0user.inode_max\0user.tag\0user.host_list\0"
     "user.external_host\0user.external_timeout\0user.pubkeys\0"
-    "user.ncleanup24\0";
+    "user.ncleanup24\0user.stat\0";
   string attribute_list;
   if (mount_point_->hide_magic_xattrs()) {
     LogCvmfs(kLogCvmfs, kLogDebug, "Hiding extended attributes");
@@ -1548,7 +2484,7 @@ static void cvmfs_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
       attribute_list += string(symlink_list, sizeof(symlink_list)-1);
     } else if (d.IsRegular()) {
       const char regular_file_list[] = "user.external_file\0user.compression\0"
-                                       "user.chunks\0";
+                                       "user.chunks\0user.fetch_timing\0";
       attribute_list += string(regular_file_list, sizeof(regular_file_list)-1);
     }
 
@@ -1597,8 +2533,7 @@ bool Pin(const string &path) {
     fuse_remounter_->fence()->Leave();
   } else {
     FileChunkList chunks;
-    mount_point_->catalog_mgr()->ListFileChunks(
-      PathString(path), dirent.hash_algorithm(), &chunks);
+    ListFileChunks(PathString(path), dirent, &chunks);
     fuse_remounter_->fence()->Leave();
     for (unsigned i = 0; i < chunks.size(); ++i) {
       bool retval =
@@ -1663,6 +2598,16 @@ static void cvmfs_init(void *userdata, struct fuse_conn_info *conn) {
 #ifdef CVMFS_NFS_SUPPORT
   conn->want |= FUSE_CAP_EXPORT_SUPPORT;
 #endif
+
+#if FUSE_VERSION >= 29
+  // Without splice support in the kernel, fuse_reply_data() copies the data
+  if (mount_point_->splice_read()) {
+    if (conn->capable & FUSE_CAP_SPLICE_WRITE)
+      conn->want |= FUSE_CAP_SPLICE_WRITE;
+    if (conn->capable & FUSE_CAP_SPLICE_MOVE)
+      conn->want |= FUSE_CAP_SPLICE_MOVE;
+  }
+#endif
 }
 
 static void cvmfs_destroy(void *unused __attribute__((unused))) {
@@ -1803,6 +2748,9 @@ static int Init(const loader::LoaderExports *loader_exports) {
   cvmfs::directory_handles_ = new cvmfs::DirectoryHandles();
   cvmfs::directory_handles_->set_empty_key((uint64_t)(-1));
   cvmfs::directory_handles_->set_deleted_key((uint64_t)(-2));
+  cvmfs::directory_streams_ = new cvmfs::DirectoryStreams();
+  cvmfs::directory_streams_->set_empty_key((uint64_t)(-1));
+  cvmfs::directory_streams_->set_deleted_key((uint64_t)(-2));
 
   LogCvmfs(kLogCvmfs, kLogDebug, "fuse inode size is %d bits",
            sizeof(fuse_ino_t) * 8);
@@ -1861,6 +2809,12 @@ static void Spawn() {
   }
 
   cvmfs::fuse_remounter_->Spawn();
+  if (cvmfs::mount_point_->catalog_idle_timeout_sec() > 0) {
+    cvmfs::mount_point_->catalog_mgr()->SpawnIdleDetacher(
+      cvmfs::mount_point_->catalog_idle_timeout_sec(),
+      cvmfs::mount_point_->catalog_mem_limit());
+  }
+  cvmfs::mount_point_->catalog_mgr()->SpawnHeatmapDumper();
 
   cvmfs::mount_point_->download_mgr()->Spawn();
   cvmfs::mount_point_->external_download_mgr()->Spawn();
@@ -1876,6 +2830,11 @@ static void Spawn() {
       cvmfs::mount_point_->uuid()->uuid() + "-unpin");
   }
   cvmfs::mount_point_->tracer()->Spawn();
+  if (cvmfs::mount_point_->histogram_exporter())
+    cvmfs::mount_point_->histogram_exporter()->Spawn();
+  cvmfs::mount_point_->chunk_prefetcher()->Spawn();
+  if (cvmfs::mount_point_->async_executor())
+    cvmfs::mount_point_->async_executor()->Spawn();
   cvmfs::talk_mgr_->Spawn();
   if (cvmfs::file_system_->IsNfsSource())
     nfs_maps::Spawn();
@@ -1911,10 +2870,15 @@ static void Fini() {
   }
 
   delete cvmfs::directory_handles_;
+  cvmfs::FreeDirectoryStreams(cvmfs::directory_streams_);
+  // Also runs before a reload, the new instance picks up the snapshot
+  if (cvmfs::mount_point_ != NULL)
+    cvmfs::mount_point_->SaveMd5PathSnapshot();
   delete cvmfs::mount_point_;
   delete cvmfs::file_system_;
   delete cvmfs::options_mgr_;
   cvmfs::directory_handles_ = NULL;
+  cvmfs::directory_streams_ = NULL;
   cvmfs::mount_point_ = NULL;
   cvmfs::file_system_ = NULL;
   cvmfs::options_mgr_ = NULL;
@@ -1956,6 +2920,15 @@ static bool MaintenanceMode(const int fd_progress) {
 static bool SaveState(const int fd_progress, loader::StateList *saved_states) {
   string msg_progress;
 
+  // Deferred requests already left their fuse callback, so the reload fence
+  // does not wait for them.  They change the open file handles and counters.
+  cvmfs::AsyncExecutor *async_executor =
+    cvmfs::mount_point_->async_executor();
+  if (async_executor != NULL) {
+    SendMsg2Socket(fd_progress, "Waiting for deferred file system calls\n");
+    async_executor->Drain();
+  }
+
   unsigned num_open_dirs = cvmfs::directory_handles_->size();
   if (num_open_dirs != 0) {
 #ifdef DEBUGMSG
@@ -1980,13 +2953,28 @@ static bool SaveState(const int fd_progress, loader::StateList *saved_states) {
     saved_states->push_back(save_open_dirs);
   }
 
+  unsigned num_open_streams = cvmfs::directory_streams_->size();
+  if (num_open_streams != 0) {
+    msg_progress = "Saving open directory streams (" +
+      StringifyInt(num_open_streams) + " handles)\n";
+    SendMsg2Socket(fd_progress, msg_progress);
+
+    loader::SavedState *save_open_streams = new loader::SavedState();
+    save_open_streams->state_id = loader::kStateOpenDirStreams;
+    save_open_streams->state =
+      cvmfs::CopyDirectoryStreams(*cvmfs::directory_streams_);
+    saved_states->push_back(save_open_streams);
+  }
+
   if (!cvmfs::file_system_->IsNfsSource()) {
     msg_progress = "Saving inode tracker\n";
     SendMsg2Socket(fd_progress, msg_progress);
-    glue::InodeTracker *saved_inode_tracker =
-      new glue::InodeTracker(*cvmfs::mount_point_->inode_tracker());
+    // The live inode tracker is destroyed with the library anyway, so its
+    // content is handed over instead of copied
+    glue::InodeTracker *saved_inode_tracker = new glue::InodeTracker();
+    saved_inode_tracker->Swap(cvmfs::mount_point_->inode_tracker());
     loader::SavedState *state_glue_buffer = new loader::SavedState();
-    state_glue_buffer->state_id = loader::kStateGlueBufferV4;
+    state_glue_buffer->state_id = loader::kStateGlueBufferV5;
     state_glue_buffer->state = saved_inode_tracker;
     saved_states->push_back(state_glue_buffer);
   }
@@ -1996,7 +2984,7 @@ static bool SaveState(const int fd_progress, loader::StateList *saved_states) {
   ChunkTables *saved_chunk_tables = new ChunkTables(
     *cvmfs::mount_point_->chunk_tables());
   loader::SavedState *state_chunk_tables = new loader::SavedState();
-  state_chunk_tables->state_id = loader::kStateOpenChunksV4;
+  state_chunk_tables->state_id = loader::kStateOpenChunksV5;
   state_chunk_tables->state = saved_chunk_tables;
   saved_states->push_back(state_chunk_tables);
 
@@ -2054,8 +3042,26 @@ static bool RestoreState(const int fd_progress,
         StringifyInt(cvmfs::directory_handles_->size()) + " handles\n");
     }
 
+    if (saved_states[i]->state_id == loader::kStateOpenDirStreams) {
+      SendMsg2Socket(fd_progress, "Restoring open directory streams... ");
+      cvmfs::FreeDirectoryStreams(cvmfs::directory_streams_);
+      cvmfs::directory_streams_ = cvmfs::CopyDirectoryStreams(
+        *static_cast<cvmfs::DirectoryStreams *>(saved_states[i]->state));
+      cvmfs::file_system_->no_open_dirs()->Xadd(
+        cvmfs::directory_streams_->size());
+      cvmfs::DirectoryStreams::const_iterator i =
+        cvmfs::directory_streams_->begin();
+      for (; i != cvmfs::directory_streams_->end(); ++i) {
+        if (i->first >= cvmfs::next_directory_handle_)
+          cvmfs::next_directory_handle_ = i->first + 1;
+      }
+
+      SendMsg2Socket(fd_progress,
+        StringifyInt(cvmfs::directory_streams_->size()) + " handles\n");
+    }
+
     if (saved_states[i]->state_id == loader::kStateGlueBuffer) {
-      SendMsg2Socket(fd_progress, "Migrating inode tracker (v1 to v4)... ");
+      SendMsg2Socket(fd_progress, "Migrating inode tracker (v1 to v5)... ");
       compat::inode_tracker::InodeTracker *saved_inode_tracker =
         (compat::inode_tracker::InodeTracker *)saved_states[i]->state;
       compat::inode_tracker::Migrate(
@@ -2064,7 +3070,7 @@ static bool RestoreState(const int fd_progress,
     }
 
     if (saved_states[i]->state_id == loader::kStateGlueBufferV2) {
-      SendMsg2Socket(fd_progress, "Migrating inode tracker (v2 to v4)... ");
+      SendMsg2Socket(fd_progress, "Migrating inode tracker (v2 to v5)... ");
       compat::inode_tracker_v2::InodeTracker *saved_inode_tracker =
         (compat::inode_tracker_v2::InodeTracker *)saved_states[i]->state;
       compat::inode_tracker_v2::Migrate(saved_inode_tracker,
@@ -2073,7 +3079,7 @@ static bool RestoreState(const int fd_progress,
     }
 
     if (saved_states[i]->state_id == loader::kStateGlueBufferV3) {
-      SendMsg2Socket(fd_progress, "Migrating inode tracker (v3 to v4)... ");
+      SendMsg2Socket(fd_progress, "Migrating inode tracker (v3 to v5)... ");
       compat::inode_tracker_v3::InodeTracker *saved_inode_tracker =
         (compat::inode_tracker_v3::InodeTracker *)saved_states[i]->state;
       compat::inode_tracker_v3::Migrate(saved_inode_tracker,
@@ -2082,45 +3088,61 @@ static bool RestoreState(const int fd_progress,
     }
 
     if (saved_states[i]->state_id == loader::kStateGlueBufferV4) {
+      SendMsg2Socket(fd_progress, "Migrating inode tracker (v4 to v5)... ");
+      compat::inode_tracker_v4::InodeTracker *saved_inode_tracker =
+        (compat::inode_tracker_v4::InodeTracker *)saved_states[i]->state;
+      compat::inode_tracker_v4::Migrate(saved_inode_tracker,
+                                        cvmfs::mount_point_->inode_tracker());
+      SendMsg2Socket(fd_progress, " done\n");
+    }
+
+    if (saved_states[i]->state_id == loader::kStateGlueBufferV5) {
       SendMsg2Socket(fd_progress, "Restoring inode tracker... ");
-      cvmfs::mount_point_->inode_tracker()->~InodeTracker();
       glue::InodeTracker *saved_inode_tracker =
         (glue::InodeTracker *)saved_states[i]->state;
-      new (cvmfs::mount_point_->inode_tracker())
-        glue::InodeTracker(*saved_inode_tracker);
+      cvmfs::mount_point_->inode_tracker()->Swap(saved_inode_tracker);
       SendMsg2Socket(fd_progress, " done\n");
     }
 
     ChunkTables *chunk_tables = cvmfs::mount_point_->chunk_tables();
 
     if (saved_states[i]->state_id == loader::kStateOpenChunks) {
-      SendMsg2Socket(fd_progress, "Migrating chunk tables (v1 to v4)... ");
+      SendMsg2Socket(fd_progress, "Migrating chunk tables (v1 to v5)... ");
       compat::chunk_tables::ChunkTables *saved_chunk_tables =
         (compat::chunk_tables::ChunkTables *)saved_states[i]->state;
       compat::chunk_tables::Migrate(saved_chunk_tables, chunk_tables);
       SendMsg2Socket(fd_progress,
-        StringifyInt(chunk_tables->handle2fd.size()) + " handles\n");
+        StringifyInt(chunk_tables->GetNumHandles()) + " handles\n");
     }
 
     if (saved_states[i]->state_id == loader::kStateOpenChunksV2) {
-      SendMsg2Socket(fd_progress, "Migrating chunk tables (v2 to v4)... ");
+      SendMsg2Socket(fd_progress, "Migrating chunk tables (v2 to v5)... ");
       compat::chunk_tables_v2::ChunkTables *saved_chunk_tables =
         (compat::chunk_tables_v2::ChunkTables *)saved_states[i]->state;
       compat::chunk_tables_v2::Migrate(saved_chunk_tables, chunk_tables);
       SendMsg2Socket(fd_progress,
-        StringifyInt(chunk_tables->handle2fd.size()) + " handles\n");
+        StringifyInt(chunk_tables->GetNumHandles()) + " handles\n");
     }
 
     if (saved_states[i]->state_id == loader::kStateOpenChunksV3) {
-      SendMsg2Socket(fd_progress, "Migrating chunk tables (v3 to v4)... ");
+      SendMsg2Socket(fd_progress, "Migrating chunk tables (v3 to v5)... ");
       compat::chunk_tables_v3::ChunkTables *saved_chunk_tables =
         (compat::chunk_tables_v3::ChunkTables *)saved_states[i]->state;
       compat::chunk_tables_v3::Migrate(saved_chunk_tables, chunk_tables);
       SendMsg2Socket(fd_progress,
-        StringifyInt(chunk_tables->handle2fd.size()) + " handles\n");
+        StringifyInt(chunk_tables->GetNumHandles()) + " handles\n");
     }
 
     if (saved_states[i]->state_id == loader::kStateOpenChunksV4) {
+      SendMsg2Socket(fd_progress, "Migrating chunk tables (v4 to v5)... ");
+      compat::chunk_tables_v4::ChunkTables *saved_chunk_tables =
+        (compat::chunk_tables_v4::ChunkTables *)saved_states[i]->state;
+      compat::chunk_tables_v4::Migrate(saved_chunk_tables, chunk_tables);
+      SendMsg2Socket(fd_progress,
+        StringifyInt(chunk_tables->GetNumHandles()) + " handles\n");
+    }
+
+    if (saved_states[i]->state_id == loader::kStateOpenChunksV5) {
       SendMsg2Socket(fd_progress, "Restoring chunk tables... ");
       chunk_tables->~ChunkTables();
       ChunkTables *saved_chunk_tables = reinterpret_cast<ChunkTables *>(
@@ -2177,6 +3199,11 @@ static void FreeSavedState(const int fd_progress,
         SendMsg2Socket(fd_progress, "Releasing saved open directory handles\n");
         delete static_cast<cvmfs::DirectoryHandles *>(saved_states[i]->state);
         break;
+      case loader::kStateOpenDirStreams:
+        SendMsg2Socket(fd_progress, "Releasing saved open directory streams\n");
+        cvmfs::FreeDirectoryStreams(
+          static_cast<cvmfs::DirectoryStreams *>(saved_states[i]->state));
+        break;
       case loader::kStateGlueBuffer:
         SendMsg2Socket(
           fd_progress, "Releasing saved glue buffer (version 1)\n");
@@ -2196,6 +3223,12 @@ static void FreeSavedState(const int fd_progress,
           saved_states[i]->state);
         break;
       case loader::kStateGlueBufferV4:
+        SendMsg2Socket(
+          fd_progress, "Releasing saved glue buffer (version 4)\n");
+        delete static_cast<compat::inode_tracker_v4::InodeTracker *>(
+          saved_states[i]->state);
+        break;
+      case loader::kStateGlueBufferV5:
         SendMsg2Socket(fd_progress, "Releasing saved glue buffer\n");
         delete static_cast<glue::InodeTracker *>(saved_states[i]->state);
         break;
@@ -2215,6 +3248,11 @@ static void FreeSavedState(const int fd_progress,
           saved_states[i]->state);
         break;
       case loader::kStateOpenChunksV4:
+        SendMsg2Socket(fd_progress, "Releasing chunk tables (version 4)\n");
+        delete static_cast<compat::chunk_tables_v4::ChunkTables *>(
+          saved_states[i]->state);
+        break;
+      case loader::kStateOpenChunksV5:
         SendMsg2Socket(fd_progress, "Releasing chunk tables\n");
         delete static_cast<ChunkTables *>(saved_states[i]->state);
         break;
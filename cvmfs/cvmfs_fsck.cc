@@ -13,7 +13,9 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <pthread.h>
+#include <sqlite3.h>
 #include <stdint.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -21,15 +23,19 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <string>
+#include <vector>
 
 #include "atomic.h"
+#include "backoff.h"
 #include "compression.h"
 #include "hash.h"
 #include "logging.h"
 #include "platform.h"
 #include "smalloc.h"
 #include "util/posix.h"
+#include "util/string.h"
 
 using namespace std;  // NOLINT
 
@@ -42,25 +48,53 @@ enum Errors {
   kErrorUsage = 16,
 };
 
+/**
+ * Name of the file in the cache directory that stores the start time of the
+ * last check.  Objects are immutable, so objects whose inode did not change
+ * since then do not need to be verified again in incremental mode.
+ */
+const char *kTimestampFile = "fsck.timestamp";
+const unsigned kNumCacheDirs = 256;
+
+/**
+ * An object that is present in the cache directory after the check, used to
+ * reconcile the managed cache db.
+ */
+struct CacheObject {
+  CacheObject(const string &h, uint64_t s) : hash_name(h), size(s) { }
+  string hash_name;
+  uint64_t size;
+};
+
 string *g_cache_dir;
 atomic_int32 g_num_files;
+atomic_int32 g_num_skipped;
 atomic_int32 g_num_err_fixed;
 atomic_int32 g_num_err_unfixed;
 atomic_int32 g_num_err_operational;
 atomic_int32 g_num_tmp_catalog;
 /**
- * Traversal of the file system tree is serialized.
+ * Worker threads claim whole cache sub directories from this counter, so that
+ * the traversal needs no lock.
+ */
+atomic_int32 g_next_dir;
+/**
+ * Filled by the worker that claimed the directory if the cache db gets
+ * reconciled, indexed by directory.
  */
-pthread_mutex_t g_lock_traverse = PTHREAD_MUTEX_INITIALIZER;
-DIR *g_DIRP_current = NULL;
-int g_num_dirs = -1;  /**< Number of cache directories already examined. */
-string *g_current_dir;  /**< Current cache sub directory */
+vector<CacheObject> *g_objects = NULL;
 
 int g_num_threads = 1;
 bool g_fix_errors = false;
 bool g_verbose = false;
+bool g_incremental = false;
+bool g_reconcile = false;
+time_t g_verified_before = 0;  /**< Skip objects unchanged since then */
+uint64_t g_max_bandwidth = 0;  /**< In bytes per second, 0 for unlimited */
+BandwidthThrottle *g_throttle = NULL;
 atomic_int32 g_force_rebuild;
 atomic_int32 g_modified_cache;
+atomic_int32 g_removed_objects;
 
 
 static void Usage() {
@@ -69,30 +103,205 @@ static void Usage() {
            "This tool checks a cvmfs cache directory for consistency.\n"
            "If necessary, the managed cache db is removed so that\n"
            "it will be rebuilt on next mount.\n\n"
-           "Usage: cvmfs_fsck [-v] [-p] [-f] [-j #threads] <cache directory>\n"
+           "Usage: cvmfs_fsck [-v] [-p] [-f] [-i] [-q] [-b MB/s] [-j #threads] "
+           "<cache directory>\n"
            "Options:\n"
            "  -v verbose output\n"
            "  -p try to fix automatically\n"
            "  -f force rebuild of managed cache db on next mount\n"
+           "  -i only verify objects that changed since the last check\n"
+           "  -q reconcile the managed cache db with the cache directory\n"
+           "  -b limit the verification I/O to the given MB/s\n"
            "  -j number of concurrent integrity check worker threads\n",
            VERSION);
 }
 
 
-static bool GetNextFile(string *relative_path, string *hash_name) {
-  platform_dirent64 *d = NULL;
+/**
+ * Objects of a compressed cache directory are verified by their content.
+ * Returns a descriptor to an unlinked temporary file with the decoded object
+ * or -1 on failure.
+ */
+static int DecodeFramed(int fd_src, zlib::FramedReader *reader) {
+  const string tmp_path = CreateTempPath("./txn/fsck", 0600);
+  if (tmp_path.empty())
+    return -1;
+  const int fd_decoded = open(tmp_path.c_str(), O_RDWR);
+  unlink(tmp_path.c_str());
+  if (fd_decoded < 0)
+    return -1;
+
+  unsigned char buf[zlib::kFramedBlockSize];
+  for (uint64_t pos = 0; pos < reader->size(); ) {
+    const int64_t nbytes = reader->Pread(fd_src, buf, sizeof(buf), pos);
+    if ((nbytes <= 0) || !SafeWrite(fd_decoded, buf, nbytes)) {
+      close(fd_decoded);
+      return -1;
+    }
+    pos += nbytes;
+  }
+  if (lseek(fd_decoded, 0, SEEK_SET) != 0) {
+    close(fd_decoded);
+    return -1;
+  }
+  return fd_decoded;
+}
+
+
+/**
+ * Verifies a single object.  Returns false if the object was removed from the
+ * cache directory.
+ */
+static bool CheckFile(const string &relative_path, const string &hash_name,
+                      const platform_stat64 &info)
+{
+  const string path = *g_cache_dir + "/" + relative_path;
+
+  if (relative_path[relative_path.length()-1] == 'T') {
+    LogCvmfs(kLogCvmfs, kLogStdout,
+             "Warning: temporary file catalog %s found", path.c_str());
+    atomic_inc32(&g_num_tmp_catalog);
+    if (g_fix_errors) {
+      if (unlink(relative_path.c_str()) == 0) {
+        LogCvmfs(kLogCvmfs, kLogStdout, "Fix: %s unlinked", path.c_str());
+        atomic_inc32(&g_num_err_fixed);
+      } else {
+        LogCvmfs(kLogCvmfs, kLogStdout, "Error: failed to unlink %s",
+                 path.c_str());
+        atomic_inc32(&g_num_err_unfixed);
+      }
+    }
+    // Temporary catalogs are not managed by the cache db
+    return false;
+  }
+
+  if (info.st_ctime < g_verified_before) {
+    atomic_inc32(&g_num_skipped);
+    return true;
+  }
+
+  int n = atomic_xadd32(&g_num_files, 1);
+  if (g_verbose)
+    LogCvmfs(kLogCvmfs, kLogStdout, "Checking file %s", path.c_str());
+  if (!g_verbose && ((n % 1000) == 0))
+    LogCvmfs(kLogCvmfs, kLogStdout | kLogNoLinebreak, ".");
+
+  bool present = true;
+  int fd_src = open(relative_path.c_str() , O_RDONLY);
+  if (fd_src < 0) {
+    LogCvmfs(kLogCvmfs, kLogStdout, "Error: cannot open %s", path.c_str());
+    atomic_inc32(&g_num_err_operational);
+    return true;
+  }
+  // Don't thrash kernel buffers
+  platform_disable_kcache(fd_src);
+  zlib::FramedReader *framed = zlib::FramedReader::Create(fd_src);
+  if (framed != NULL) {
+    const int fd_decoded = DecodeFramed(fd_src, framed);
+    delete framed;
+    close(fd_src);
+    if (fd_decoded < 0) {
+      LogCvmfs(kLogCvmfs, kLogStdout, "Error: could not decompress %s",
+               path.c_str());
+      atomic_inc32(&g_num_err_operational);
+      return true;
+    }
+    fd_src = fd_decoded;
+  }
 
-  pthread_mutex_lock(&g_lock_traverse);
- get_next_file_again:
-  while (g_DIRP_current && ((d = platform_readdir(g_DIRP_current)) != NULL)) {
+  // Compress every file and calculate SHA-1 of stream
+  shash::Any expected_hash = shash::MkFromHexPtr(shash::HexPtr(hash_name));
+  shash::Any hash(expected_hash.algorithm);
+  if (!zlib::CompressFd2Null(fd_src, &hash)) {
+    LogCvmfs(kLogCvmfs, kLogStdout, "Error: could not compress %s",
+             path.c_str());
+    atomic_inc32(&g_num_err_operational);
+  } else {
+    if (hash != expected_hash) {
+      // If the hashes don't match, try hashing the uncompressed file
+      if ((lseek(fd_src, 0, SEEK_SET) != 0) || !shash::HashFd(fd_src, &hash)) {
+        LogCvmfs(kLogCvmfs, kLogStdout, "Error: could not hash %s",
+                 path.c_str());
+        atomic_inc32(&g_num_err_operational);
+      }
+      if (hash != expected_hash) {
+        if (g_fix_errors) {
+          const string quarantaine_path = "./quarantaine/" + hash_name;
+          bool fixed = false;
+          if (rename(relative_path.c_str(), quarantaine_path.c_str()) == 0) {
+            LogCvmfs(kLogCvmfs, kLogStdout,
+                     "Fix: %s is corrupted, moved to quarantaine folder",
+                     path.c_str());
+            fixed = true;
+          } else {
+            LogCvmfs(kLogCvmfs, kLogStdout,
+                     "Warning: failed to move %s into quarantaine folder",
+                     path.c_str());
+            if (unlink(relative_path.c_str()) == 0) {
+              LogCvmfs(kLogCvmfs, kLogStdout,
+                       "Fix: %s is corrupted, file unlinked", path.c_str());
+              fixed = true;
+            } else {
+              LogCvmfs(kLogCvmfs, kLogStdout,
+                       "Error: %s is corrupted, could not unlink",
+                       path.c_str());
+            }
+          }
+
+          if (fixed) {
+            atomic_inc32(&g_num_err_fixed);
+
+            // Changes made, the managed cache db needs to be reconciled
+            // or rebuilt
+            atomic_cas32(&g_removed_objects, 0, 1);
+            atomic_cas32(&g_modified_cache, 0, 1);
+            present = false;
+          } else {
+            atomic_inc32(&g_num_err_unfixed);
+          }
+        } else {
+          LogCvmfs(kLogCvmfs, kLogStdout,
+                   "Error: %s has compressed checksum %s, "
+                   "delete this file from cache directory!",
+                   path.c_str(), hash.ToString().c_str());
+          atomic_inc32(&g_num_err_unfixed);
+        }
+      }
+    }
+  }
+  close(fd_src);
+  // The limit applies to the sum of all workers
+  if (g_throttle)
+    g_throttle->Consume(info.st_size);
+  return present;
+}
+
+
+static void CheckDirectory(const unsigned dir_idx) {
+  char hex[3];
+  snprintf(hex, sizeof(hex), "%02x", dir_idx);
+  const string current_dir(hex, 2);
+
+  if (g_verbose)
+    LogCvmfs(kLogCvmfs, kLogStdout, "Entering %s", current_dir.c_str());
+  DIR *dirp = opendir(hex);
+  if (dirp == NULL) {
+    LogCvmfs(kLogCvmfs, kLogStderr,
+             "Invalid cache directory, %s/%s does not exist",
+             g_cache_dir->c_str(), current_dir.c_str());
+    exit(kErrorUnfixed);
+  }
+
+  platform_dirent64 *d;
+  while ((d = platform_readdir(dirp)) != NULL) {
     const string name = d->d_name;
     if ((name == ".") || (name == "..")) continue;
 
     platform_stat64 info;
-    *relative_path = *g_current_dir + "/" + name;
-    *hash_name = *g_current_dir + name;
-    const string path = *g_cache_dir + "/" + *relative_path;
-    if (platform_lstat(relative_path->c_str(), &info) != 0) {
+    const string relative_path = current_dir + "/" + name;
+    const string hash_name = current_dir + name;
+    const string path = *g_cache_dir + "/" + relative_path;
+    if (platform_lstat(relative_path.c_str(), &info) != 0) {
       LogCvmfs(kLogCvmfs, kLogStdout, "Warning: failed to stat() %s (%d)",
                path.c_str(), errno);
       continue;
@@ -104,152 +313,236 @@ static bool GetNextFile(string *relative_path, string *hash_name) {
       continue;
     }
 
-    break;
+    const bool present = CheckFile(relative_path, hash_name, info);
+    if (present && g_reconcile)
+      g_objects[dir_idx].push_back(CacheObject(hash_name, info.st_size));
   }
+  closedir(dirp);
+}
 
-  if (!d) {
-    if (g_DIRP_current) {
-      closedir(g_DIRP_current);
-      g_DIRP_current = NULL;
-    }
-    g_num_dirs++;
-    if (g_num_dirs < 256) {
-      char hex[3];
-      snprintf(hex, sizeof(hex), "%02x", g_num_dirs);
-      *g_current_dir = string(hex, 2);
 
-      if (g_verbose)
-        LogCvmfs(kLogCvmfs, kLogStdout, "Entering %s", g_current_dir->c_str());
-      if ((g_DIRP_current = opendir(hex)) == NULL) {
-        LogCvmfs(kLogCvmfs, kLogStderr,
-                 "Invalid cache directory, %s/%s does not exist",
-                 g_cache_dir->c_str(), g_current_dir->c_str());
-        pthread_mutex_unlock(&g_lock_traverse);
-        exit(kErrorUnfixed);
-      }
-      goto get_next_file_again;
-    }
-  }
-  pthread_mutex_unlock(&g_lock_traverse);
+static void *MainCheck(void *data __attribute__((unused))) {
+  unsigned dir_idx;
+  while ((dir_idx = atomic_xadd32(&g_next_dir, 1)) < kNumCacheDirs)
+    CheckDirectory(dir_idx);
+  return NULL;
+}
 
-  if (d)
-    return true;
 
-  return false;
+/**
+ * Returns 0 if there is no timestamp of a previous check
+ */
+static time_t ReadTimestamp() {
+  const int fd = open(kTimestampFile, O_RDONLY);
+  if (fd < 0)
+    return 0;
+  string content;
+  const bool retval = SafeReadToString(fd, &content);
+  close(fd);
+  if (!retval)
+    return 0;
+  return String2Int64(Trim(content));
 }
 
 
-static void *MainCheck(void *data __attribute__((unused))) {
-  string relative_path;
-  string hash_name;
+static void WriteTimestamp(const time_t timestamp) {
+  if (!SafeWriteToFile(StringifyInt(timestamp) + "\n", kTimestampFile,
+                       0644))
+  {
+    LogCvmfs(kLogCvmfs, kLogStdout, "Warning: failed to write %s/%s (%d)",
+             g_cache_dir->c_str(), kTimestampFile, errno);
+  }
+}
 
-  while (GetNextFile(&relative_path, &hash_name)) {
-    const string path = *g_cache_dir + "/" + relative_path;
 
-    int n = atomic_xadd32(&g_num_files, 1);
-    if (g_verbose)
-      LogCvmfs(kLogCvmfs, kLogStdout, "Checking file %s", path.c_str());
-    if (!g_verbose && ((n % 1000) == 0))
-      LogCvmfs(kLogCvmfs, kLogStdout | kLogNoLinebreak, ".");
+static bool ExecSql(sqlite3 *db, const string &sql) {
+  const int retval = sqlite3_exec(db, sql.c_str(), NULL, NULL, NULL);
+  if (retval != SQLITE_OK) {
+    LogCvmfs(kLogCvmfs, kLogStdout, "Error: managed cache db failure (%s)",
+             sqlite3_errmsg(db));
+    return false;
+  }
+  return true;
+}
 
-    if (relative_path[relative_path.length()-1] == 'T') {
-      LogCvmfs(kLogCvmfs, kLogStdout,
-               "Warning: temporary file catalog %s found", path.c_str());
-      atomic_inc32(&g_num_tmp_catalog);
-      if (g_fix_errors) {
-        if (unlink(relative_path.c_str()) == 0) {
-          LogCvmfs(kLogCvmfs, kLogStdout, "Fix: %s unlinked", path.c_str());
-          atomic_inc32(&g_num_err_fixed);
-        } else {
-          LogCvmfs(kLogCvmfs, kLogStdout, "Error: failed to unlink %s",
-                   path.c_str());
-          atomic_inc32(&g_num_err_unfixed);
-        }
-      }
-      continue;
-    }
 
-    int fd_src = open(relative_path.c_str() , O_RDONLY);
-    if (fd_src < 0) {
-      LogCvmfs(kLogCvmfs, kLogStdout, "Error: cannot open %s", path.c_str());
-      atomic_inc32(&g_num_err_operational);
-      continue;
+/**
+ * Compares the managed cache db with the objects found in the cache
+ * directory.  Entries without an object are orphaned, objects without entry
+ * are missing.  With -p, orphaned entries are removed and missing entries are
+ * added at the end of the LRU list.  Returns false if the cache db could not
+ * be reconciled, e.g. because it is locked by a mounted repository.
+ */
+static bool Reconcile() {
+  sqlite3 *db = NULL;
+  int retval = sqlite3_open_v2("cachedb", &db,
+    SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, NULL);
+  if (retval != SQLITE_OK) {
+    sqlite3_close(db);
+    if (!FileExists("cachedb")) {
+      if (g_verbose)
+        LogCvmfs(kLogCvmfs, kLogStdout, "No managed cache db to reconcile");
+      return true;
     }
-    // Don't thrash kernel buffers
-    platform_disable_kcache(fd_src);
-
-    // Compress every file and calculate SHA-1 of stream
-    shash::Any expected_hash = shash::MkFromHexPtr(shash::HexPtr(hash_name));
-    shash::Any hash(expected_hash.algorithm);
-    if (!zlib::CompressFd2Null(fd_src, &hash)) {
-      LogCvmfs(kLogCvmfs, kLogStdout, "Error: could not compress %s",
-               path.c_str());
-      atomic_inc32(&g_num_err_operational);
-    } else {
-      if (hash != expected_hash) {
-        // If the hashes don't match, try hashing the uncompressed file
-        if (!shash::HashFile(relative_path, &hash)) {
-          LogCvmfs(kLogCvmfs, kLogStdout, "Error: could not hash %s",
-                   path.c_str());
-          atomic_inc32(&g_num_err_operational);
-        }
-        if (hash != expected_hash) {
-          if (g_fix_errors) {
-            const string quarantaine_path = "./quarantaine/" + hash_name;
-            bool fixed = false;
-            if (rename(relative_path.c_str(), quarantaine_path.c_str()) == 0) {
-              LogCvmfs(kLogCvmfs, kLogStdout,
-                       "Fix: %s is corrupted, moved to quarantaine folder",
-                       path.c_str());
-              fixed = true;
-            } else {
-              LogCvmfs(kLogCvmfs, kLogStdout,
-                       "Warning: failed to move %s into quarantaine folder",
-                       path.c_str());
-              if (unlink(relative_path.c_str()) == 0) {
-                LogCvmfs(kLogCvmfs, kLogStdout,
-                         "Fix: %s is corrupted, file unlinked", path.c_str());
-                fixed = true;
-              } else {
-                LogCvmfs(kLogCvmfs, kLogStdout,
-                         "Error: %s is corrupted, could not unlink",
-                         path.c_str());
-              }
-            }
-
-            if (fixed) {
-              atomic_inc32(&g_num_err_fixed);
+    LogCvmfs(kLogCvmfs, kLogStdout, "Error: cannot open managed cache db");
+    atomic_inc32(&g_num_err_operational);
+    return false;
+  }
 
-              // Changes made, we have to rebuild the managed cache db
-              atomic_cas32(&g_force_rebuild, 0, 1);
-              atomic_cas32(&g_modified_cache, 0, 1);
-            } else {
-              atomic_inc32(&g_num_err_unfixed);
-            }
-          } else {
-            LogCvmfs(kLogCvmfs, kLogStdout,
-                     "Error: %s has compressed checksum %s, "
-                     "delete this file from cache directory!",
-                     path.c_str(), hash.ToString().c_str());
-            atomic_inc32(&g_num_err_unfixed);
-          }
-        }
+  sqlite3_stmt *stmt_insert = NULL;
+  sqlite3_stmt *stmt_select = NULL;
+  sqlite3_stmt *stmt_fix = NULL;
+  int64_t max_acseq = 0;
+  unsigned num_orphaned = 0;
+  unsigned num_missing = 0;
+  unsigned num_size = 0;
+  bool result = false;
+
+  // Fails if the cache db is locked by a mounted repository
+  if (!ExecSql(db, "BEGIN IMMEDIATE;")) {
+    LogCvmfs(kLogCvmfs, kLogStdout,
+             "Warning: managed cache db is in use, is the repository mounted?");
+    goto reconcile_fail;
+  }
+  if (!ExecSql(db, "CREATE TEMP TABLE fsck_objects (sha1 TEXT, size INTEGER, "
+                   "CONSTRAINT pk_fsck_objects PRIMARY KEY (sha1));"))
+  {
+    goto reconcile_fail;
+  }
+  sqlite3_prepare_v2(db, "INSERT INTO fsck_objects (sha1, size) "
+                     "VALUES (:sha1, :s);", -1, &stmt_insert, NULL);
+  for (unsigned i = 0; i < kNumCacheDirs; ++i) {
+    for (unsigned j = 0; j < g_objects[i].size(); ++j) {
+      const CacheObject &object = g_objects[i][j];
+      sqlite3_bind_text(stmt_insert, 1, object.hash_name.data(),
+                        object.hash_name.length(), SQLITE_STATIC);
+      sqlite3_bind_int64(stmt_insert, 2, object.size);
+      if (sqlite3_step(stmt_insert) != SQLITE_DONE) {
+        LogCvmfs(kLogCvmfs, kLogStdout, "Error: managed cache db failure (%s)",
+                 sqlite3_errmsg(db));
+        goto reconcile_fail;
       }
+      sqlite3_reset(stmt_insert);
+    }
+    // Not needed anymore
+    vector<CacheObject>().swap(g_objects[i]);
+  }
+  sqlite3_finalize(stmt_insert);
+  stmt_insert = NULL;
+
+  // Orphaned entries
+  sqlite3_prepare_v2(db, "SELECT sha1 FROM cache_catalog WHERE sha1 NOT IN "
+                     "(SELECT sha1 FROM fsck_objects);", -1, &stmt_select,
+                     NULL);
+  while (sqlite3_step(stmt_select) == SQLITE_ROW) {
+    num_orphaned++;
+    if (g_verbose) {
+      LogCvmfs(kLogCvmfs, kLogStdout,
+               "Managed cache db entry %s has no object in the cache",
+               sqlite3_column_text(stmt_select, 0));
+    }
+  }
+  sqlite3_finalize(stmt_select);
+  stmt_select = NULL;
+
+  // Entries whose size does not match the object
+  sqlite3_prepare_v2(db, "SELECT count(*) FROM cache_catalog, fsck_objects "
+                     "WHERE cache_catalog.sha1 = fsck_objects.sha1 AND "
+                     "cache_catalog.size != fsck_objects.size;",
+                     -1, &stmt_select, NULL);
+  if (sqlite3_step(stmt_select) == SQLITE_ROW)
+    num_size = sqlite3_column_int64(stmt_select, 0);
+  sqlite3_finalize(stmt_select);
+  stmt_select = NULL;
+
+  sqlite3_prepare_v2(db, "SELECT coalesce(max(acseq), 0) FROM cache_catalog;",
+                     -1, &stmt_select, NULL);
+  if (sqlite3_step(stmt_select) == SQLITE_ROW)
+    max_acseq = sqlite3_column_int64(stmt_select, 0);
+  sqlite3_finalize(stmt_select);
+  stmt_select = NULL;
+
+  // Missing entries, appended to the LRU list as regular files (the
+  // information that an object is a catalog is lost)
+  if (g_fix_errors) {
+    sqlite3_prepare_v2(db,
+      "INSERT INTO cache_catalog (sha1, size, acseq, path, type, pinned) "
+      "VALUES (:sha1, :s, :seq, 'unknown (fsck)', 0, 0);", -1, &stmt_fix,
+      NULL);
+  }
+  sqlite3_prepare_v2(db, "SELECT sha1, size FROM fsck_objects WHERE sha1 NOT "
+                     "IN (SELECT sha1 FROM cache_catalog);", -1, &stmt_select,
+                     NULL);
+  while (sqlite3_step(stmt_select) == SQLITE_ROW) {
+    num_missing++;
+    if (g_verbose) {
+      LogCvmfs(kLogCvmfs, kLogStdout,
+               "Object %s has no entry in the managed cache db",
+               sqlite3_column_text(stmt_select, 0));
+    }
+    if (!g_fix_errors)
+      continue;
+    // The SELECT reads a temporary table, its values remain valid while the
+    // cache catalog table is modified
+    sqlite3_bind_text(stmt_fix, 1,
+      reinterpret_cast<const char *>(sqlite3_column_text(stmt_select, 0)),
+      -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt_fix, 2, sqlite3_column_int64(stmt_select, 1));
+    sqlite3_bind_int64(stmt_fix, 3, ++max_acseq);
+    if (sqlite3_step(stmt_fix) != SQLITE_DONE) {
+      LogCvmfs(kLogCvmfs, kLogStdout, "Error: managed cache db failure (%s)",
+               sqlite3_errmsg(db));
+      goto reconcile_fail;
+    }
+    sqlite3_reset(stmt_fix);
+  }
+  sqlite3_finalize(stmt_select);
+  stmt_select = NULL;
+
+  if (g_fix_errors) {
+    if (!ExecSql(db, "DELETE FROM cache_catalog WHERE sha1 NOT IN "
+                     "(SELECT sha1 FROM fsck_objects);") ||
+        !ExecSql(db, "UPDATE cache_catalog SET size = (SELECT size FROM "
+                     "fsck_objects WHERE fsck_objects.sha1 = "
+                     "cache_catalog.sha1) WHERE size != (SELECT size FROM "
+                     "fsck_objects WHERE fsck_objects.sha1 = "
+                     "cache_catalog.sha1);"))
+    {
+      goto reconcile_fail;
     }
-    close(fd_src);
   }
+  if (!ExecSql(db, "COMMIT;"))
+    goto reconcile_fail;
 
-  return NULL;
+  if (num_orphaned + num_missing + num_size > 0) {
+    LogCvmfs(kLogCvmfs, kLogStdout,
+             "%s managed cache db: %u orphaned entries, %u missing entries, "
+             "%u entries with wrong size",
+             g_fix_errors ? "Fix:" : "Error:",
+             num_orphaned, num_missing, num_size);
+    if (g_fix_errors)
+      atomic_inc32(&g_num_err_fixed);
+    else
+      atomic_inc32(&g_num_err_unfixed);
+  }
+  result = g_fix_errors || (num_orphaned + num_missing + num_size == 0);
+
+ reconcile_fail:
+  if (stmt_insert) sqlite3_finalize(stmt_insert);
+  if (stmt_select) sqlite3_finalize(stmt_select);
+  if (stmt_fix) sqlite3_finalize(stmt_fix);
+  sqlite3_close(db);
+  return result;
 }
 
 
 int main(int argc, char **argv) {
   atomic_init32(&g_force_rebuild);
   atomic_init32(&g_modified_cache);
-  g_current_dir = new string();
+  atomic_init32(&g_removed_objects);
 
   int c;
-  while ((c = getopt(argc, argv, "hvpfj:")) != -1) {
+  while ((c = getopt(argc, argv, "hvpfiqb:j:")) != -1) {
     switch (c) {
       case 'h':
         Usage();
@@ -263,6 +556,20 @@ int main(int argc, char **argv) {
       case 'f':
         atomic_cas32(&g_force_rebuild, 0, 1);
         break;
+      case 'i':
+        g_incremental = true;
+        break;
+      case 'q':
+        g_reconcile = true;
+        break;
+      case 'b':
+        g_max_bandwidth = String2Uint64(optarg) * 1024 * 1024;
+        if (g_max_bandwidth == 0) {
+          LogCvmfs(kLogCvmfs, kLogStdout,
+                   "The bandwidth limit needs to be at least 1 MB/s");
+          return kErrorUsage;
+        }
+        break;
       case 'j':
         g_num_threads = atoi(optarg);
         if (g_num_threads < 1) {
@@ -311,8 +618,24 @@ int main(int argc, char **argv) {
   }
   closedir(dirp_txn);
 
+  // Objects changed after this time are verified by the next incremental run
+  const time_t start_time = time(NULL);
+  if (g_incremental) {
+    g_verified_before = ReadTimestamp();
+    if (g_verified_before == 0) {
+      LogCvmfs(kLogCvmfs, kLogStdout,
+               "No previous check recorded, verifying all files");
+    }
+  }
+  if (g_reconcile)
+    g_objects = new vector<CacheObject>[kNumCacheDirs];
+
   // Run workers to recalculate checksums
+  atomic_init32(&g_next_dir);
+  if (g_max_bandwidth > 0)
+    g_throttle = new BandwidthThrottle(g_max_bandwidth);
   atomic_init32(&g_num_files);
+  atomic_init32(&g_num_skipped);
   atomic_init32(&g_num_err_fixed);
   atomic_init32(&g_num_err_unfixed);
   atomic_init32(&g_num_err_operational);
@@ -335,10 +658,33 @@ int main(int argc, char **argv) {
       LogCvmfs(kLogCvmfs, kLogStdout, "Stopping worker %d", i+1);
   }
   free(workers);
+  delete g_throttle;
   if (!g_verbose)
     LogCvmfs(kLogCvmfs, kLogStdout, "");
   LogCvmfs(kLogCvmfs, kLogStdout, "Verified %d files",
            atomic_read32(&g_num_files));
+  if (g_verified_before > 0) {
+    LogCvmfs(kLogCvmfs, kLogStdout, "Skipped %d files unchanged since %s",
+             atomic_read32(&g_num_skipped),
+             StringifyTime(g_verified_before, false).c_str());
+  }
+
+  // Removed objects are either removed from the managed cache db right away or
+  // the cache db is rebuilt on the next mount
+  if (g_reconcile) {
+    if (!Reconcile() && atomic_read32(&g_removed_objects))
+      atomic_cas32(&g_force_rebuild, 0, 1);
+    delete[] g_objects;
+  } else if (atomic_read32(&g_removed_objects)) {
+    atomic_cas32(&g_force_rebuild, 0, 1);
+  }
+
+  // Failed verifications are repeated by the next incremental run
+  if ((atomic_read32(&g_num_err_unfixed) == 0) &&
+      (atomic_read32(&g_num_err_operational) == 0))
+  {
+    WriteTimestamp(start_time);
+  }
 
   if (atomic_read32(&g_num_tmp_catalog) > 0)
     LogCvmfs(kLogCvmfs, kLogStdout, "Temporary file catalogs were found.");
@@ -0,0 +1,260 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "digest_tree.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "smalloc.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+DigestTree::DigestTree(
+  const shash::Algorithms algorithm,
+  const uint32_t block_size)
+  : algorithm_(algorithm)
+  , block_size_(block_size)
+  , file_size_(0)
+  , context_(algorithm)
+  , block_pos_(0)
+  , finalized_(false)
+{
+  assert(block_size_ > 0);
+}
+
+
+/**
+ * Also copies the state of a tree that is being built.
+ */
+DigestTree::DigestTree(const DigestTree &other)
+  : algorithm_(other.algorithm_)
+  , block_size_(other.block_size_)
+  , file_size_(other.file_size_)
+  , blocks_(other.blocks_)
+  , context_(other.context_)
+  , block_pos_(other.block_pos_)
+  , finalized_(other.finalized_)
+{
+  if (other.context_.buffer != NULL) {
+    context_.buffer = smalloc(context_.size);
+    memcpy(context_.buffer, other.context_.buffer, context_.size);
+  }
+}
+
+
+DigestTree &DigestTree::operator=(const DigestTree &other) {
+  if (&other == this)
+    return *this;
+  free(context_.buffer);
+  algorithm_ = other.algorithm_;
+  block_size_ = other.block_size_;
+  file_size_ = other.file_size_;
+  blocks_ = other.blocks_;
+  context_ = other.context_;
+  block_pos_ = other.block_pos_;
+  finalized_ = other.finalized_;
+  if (other.context_.buffer != NULL) {
+    context_.buffer = smalloc(context_.size);
+    memcpy(context_.buffer, other.context_.buffer, context_.size);
+  }
+  return *this;
+}
+
+
+DigestTree::~DigestTree() {
+  free(context_.buffer);
+}
+
+
+void DigestTree::InitContext() {
+  if (context_.buffer == NULL)
+    context_.buffer = smalloc(context_.size);
+  shash::Init(context_);
+  block_pos_ = 0;
+}
+
+
+void DigestTree::FinalizeBlock() {
+  shash::Any digest(algorithm_);
+  shash::Final(context_, &digest);
+  blocks_.push_back(digest);
+  block_pos_ = 0;
+}
+
+
+/**
+ * Appends the next piece of the file content.
+ */
+void DigestTree::Update(const unsigned char *data, const uint64_t size) {
+  assert(!finalized_);
+  uint64_t pos = 0;
+  while (pos < size) {
+    if (block_pos_ == 0)
+      InitContext();
+    const uint32_t nbytes = static_cast<uint32_t>(
+      std::min(static_cast<uint64_t>(block_size_ - block_pos_), size - pos));
+    shash::Update(data + pos, nbytes, context_);
+    block_pos_ += nbytes;
+    pos += nbytes;
+    if (block_pos_ == block_size_)
+      FinalizeBlock();
+  }
+  file_size_ += size;
+}
+
+
+void DigestTree::Finalize() {
+  assert(!finalized_);
+  if (block_pos_ > 0)
+    FinalizeBlock();
+  free(context_.buffer);
+  context_.buffer = NULL;
+  finalized_ = true;
+}
+
+
+/**
+ * The serialized tree is a header with the block size and the file size
+ * followed by the block digests, one per line.
+ */
+string DigestTree::Serialize() const {
+  assert(finalized_);
+  string result = "B" + StringifyInt(block_size_) + "\n" +
+                  "S" + StringifyInt(file_size_) + "\n" + "--\n";
+  for (unsigned i = 0; i < blocks_.size(); ++i)
+    result += blocks_[i].ToString() + "\n";
+  return result;
+}
+
+
+shash::Any DigestTree::GetRoot() const {
+  shash::Any root(algorithm_);
+  shash::HashString(Serialize(), &root);
+  return root;
+}
+
+
+/**
+ * Restores a tree from its serialized form.  The caller needs to compare
+ * GetRoot() with the trusted root.  Returns false on malformed input.
+ */
+bool DigestTree::Parse(const string &serialized) {
+  vector<string> lines = SplitString(serialized, '\n');
+  // The final newline results in an empty last element
+  if (lines.empty() || !lines.back().empty())
+    return false;
+  lines.pop_back();
+
+  uint64_t block_size = 0;
+  uint64_t file_size = 0;
+  bool has_file_size = false;
+  unsigned i = 0;
+  for (; (i < lines.size()) && (lines[i] != "--"); ++i) {
+    if (lines[i].length() < 2)
+      return false;
+    const string value = lines[i].substr(1);
+    switch (lines[i][0]) {
+      case 'B':
+        if (!String2Uint64Parse(value, &block_size))
+          return false;
+        break;
+      case 'S':
+        if (!String2Uint64Parse(value, &file_size))
+          return false;
+        has_file_size = true;
+        break;
+      default:
+        // Unknown keys are ignored for future extensions
+        break;
+    }
+  }
+  if ((i == lines.size()) || (block_size == 0) ||
+      (block_size != static_cast<uint32_t>(block_size)) || !has_file_size)
+  {
+    return false;
+  }
+  ++i;
+
+  const uint64_t num_blocks = (file_size + block_size - 1) / block_size;
+  if (lines.size() - i != num_blocks)
+    return false;
+  vector<shash::Any> blocks;
+  for (; i < lines.size(); ++i) {
+    shash::Any digest = shash::MkFromHexPtr(shash::HexPtr(lines[i]));
+    if (digest.algorithm != algorithm_)
+      return false;
+    blocks.push_back(digest);
+  }
+
+  free(context_.buffer);
+  context_.buffer = NULL;
+  block_size_ = static_cast<uint32_t>(block_size);
+  file_size_ = file_size;
+  blocks_.swap(blocks);
+  block_pos_ = 0;
+  finalized_ = true;
+  return true;
+}
+
+
+/**
+ * Extends a range to the smallest range of whole blocks that can be verified.
+ * The aligned range never reaches beyond the end of the file.
+ */
+void DigestTree::AlignRange(
+  const uint64_t offset,
+  const uint64_t size,
+  uint64_t *aligned_offset,
+  uint64_t *aligned_size) const
+{
+  if (offset >= file_size_) {
+    *aligned_offset = file_size_;
+    *aligned_size = 0;
+    return;
+  }
+  *aligned_offset = offset - (offset % block_size_);
+  uint64_t end = std::min(offset + size, file_size_);
+  if (end % block_size_ != 0)
+    end = std::min(end + block_size_ - (end % block_size_), file_size_);
+  *aligned_size = end - *aligned_offset;
+}
+
+
+/**
+ * Checks the data of a range of whole blocks.  The range must start at a block
+ * boundary and end at a block boundary or at the end of the file, see
+ * AlignRange().
+ */
+bool DigestTree::VerifyRange(
+  const uint64_t offset,
+  const unsigned char *data,
+  const uint64_t size) const
+{
+  assert(finalized_);
+  if (size == 0)
+    return offset <= file_size_;
+  if ((offset % block_size_ != 0) || (offset + size > file_size_))
+    return false;
+  if (((offset + size) % block_size_ != 0) && (offset + size != file_size_))
+    return false;
+
+  uint64_t pos = 0;
+  unsigned block_idx = offset / block_size_;
+  while (pos < size) {
+    const uint64_t nbytes =
+      std::min(static_cast<uint64_t>(block_size_), size - pos);
+    shash::Any digest(algorithm_);
+    shash::HashMem(data + pos, nbytes, &digest);
+    if (digest != blocks_[block_idx])
+      return false;
+    pos += nbytes;
+    block_idx++;
+  }
+  return true;
+}
@@ -0,0 +1,73 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_DIGEST_TREE_H_
+#define CVMFS_DIGEST_TREE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "hash.h"
+
+/**
+ * Digests of the fixed-size blocks of a file's uncompressed content.  The
+ * object hash of a file can only be checked once the entire file is
+ * downloaded.  With the block digests, any block-aligned range of the file can
+ * be verified on its own, e.g. the result of a range request.
+ *
+ * The publisher stores the serialized tree in the catalog next to the entry
+ * (table digest_trees), so the block digests are as trustworthy as the content
+ * hash of the file.  The root digest is the hash of the serialized block
+ * digests; it identifies a tree independent of where it is stored.
+ *
+ * The tree is either built incrementally from the file content by Update() and
+ * Finalize() or restored from its serialized form by Parse().
+ */
+class DigestTree {
+ public:
+  static const uint32_t kDefaultBlockSize = 1024 * 1024;
+
+  DigestTree(const shash::Algorithms algorithm, const uint32_t block_size);
+  DigestTree(const DigestTree &other);
+  DigestTree &operator=(const DigestTree &other);
+  ~DigestTree();
+
+  void Update(const unsigned char *data, const uint64_t size);
+  void Finalize();
+  bool Parse(const std::string &serialized);
+
+  std::string Serialize() const;
+  shash::Any GetRoot() const;
+
+  void AlignRange(const uint64_t offset, const uint64_t size,
+                  uint64_t *aligned_offset, uint64_t *aligned_size) const;
+  bool VerifyRange(const uint64_t offset,
+                   const unsigned char *data,
+                   const uint64_t size) const;
+
+  shash::Algorithms algorithm() const { return algorithm_; }
+  uint32_t block_size() const { return block_size_; }
+  uint64_t file_size() const { return file_size_; }
+  unsigned num_blocks() const { return blocks_.size(); }
+  bool finalized() const { return finalized_; }
+
+ private:
+  void InitContext();
+  void FinalizeBlock();
+
+  shash::Algorithms algorithm_;
+  uint32_t block_size_;
+  uint64_t file_size_;
+  std::vector<shash::Any> blocks_;
+  /**
+   * Hash context of the currently built block, NULL if not building
+   */
+  shash::ContextPtr context_;
+  uint32_t block_pos_;
+  bool finalized_;
+};
+
+#endif  // CVMFS_DIGEST_TREE_H_
@@ -4,6 +4,8 @@
 
 #include "directory_entry.h"
 
+#include "smalloc.h"
+
 namespace catalog {
 
 DirectoryEntryBase::Differences DirectoryEntryBase::CompareTo(
@@ -63,8 +65,114 @@ DirectoryEntryBase::Differences DirectoryEntry::CompareTo(
   if (IsHidden() != other.IsHidden()) {
     result |= Difference::kHiddenFlag;
   }
+  if (IsInlineFile() != other.IsInlineFile()) {
+    result |= Difference::kInlineFileFlag;
+  }
+  if (IsBundledFile() != other.IsBundledFile()) {
+    result |= Difference::kBundledFileFlag;
+  }
 
   return result;
 }
 
+
+DirectoryEntryCompact::Blob DirectoryEntryCompact::negative_blob_ =
+  { 1, 0, 0, 0, 0, 0, 0, 0, 0, kFlagNegative, 0, 0, 0, 0, 0 };
+
+
+DirectoryEntryCompact::DirectoryEntryCompact(const DirectoryEntry &dirent) {
+  if (dirent.IsNegative()) {
+    blob_ = &negative_blob_;
+    Ref();
+    return;
+  }
+
+  const bool null_checksum = dirent.checksum_.IsNull();
+  const unsigned len_digest =
+    null_checksum ? 0 : dirent.checksum_.GetDigestSize();
+  const unsigned len_name = dirent.name_.GetLength();
+  const unsigned len_symlink = dirent.symlink_.GetLength();
+  assert((len_name <= 0xffff) && (len_symlink <= 0xffff));
+  blob_ = reinterpret_cast<Blob *>(
+    smalloc(sizeof(Blob) + len_digest + len_name + len_symlink));
+
+  blob_->refcount = 1;
+  blob_->mode = dirent.mode_;
+  blob_->inode = dirent.inode_;
+  blob_->size = dirent.size_;
+  blob_->mtime = dirent.mtime_;
+  blob_->uid = dirent.uid_;
+  blob_->gid = dirent.gid_;
+  blob_->linkcount = dirent.linkcount_;
+  blob_->hardlink_group = dirent.hardlink_group_;
+  blob_->flags = 0;
+  if (dirent.has_xattrs_) blob_->flags |= kFlagHasXattrs;
+  if (dirent.is_external_file_) blob_->flags |= kFlagExternalFile;
+  if (dirent.is_nested_catalog_root_) blob_->flags |= kFlagNestedCatalogRoot;
+  if (dirent.is_nested_catalog_mountpoint_)
+    blob_->flags |= kFlagNestedCatalogMountpoint;
+  if (dirent.is_bind_mountpoint_) blob_->flags |= kFlagBindMountpoint;
+  if (dirent.is_chunked_file_) blob_->flags |= kFlagChunkedFile;
+  if (dirent.is_hidden_) blob_->flags |= kFlagHidden;
+  if (dirent.is_inline_file_) blob_->flags |= kFlagInlineFile;
+  if (dirent.is_bundled_file_) blob_->flags |= kFlagBundledFile;
+  if (null_checksum) blob_->flags |= kFlagNullChecksum;
+  blob_->len_name = len_name;
+  blob_->len_symlink = len_symlink;
+  blob_->hash_algorithm = dirent.checksum_.algorithm;
+  blob_->hash_suffix = dirent.checksum_.suffix;
+  blob_->compression_algorithm = dirent.compression_algorithm_;
+
+  char *data = reinterpret_cast<char *>(blob_ + 1);
+  memcpy(data, dirent.checksum_.digest, len_digest);
+  data += len_digest;
+  memcpy(data, dirent.name_.GetChars(), len_name);
+  data += len_name;
+  memcpy(data, dirent.symlink_.GetChars(), len_symlink);
+}
+
+
+void DirectoryEntryCompact::Expand(DirectoryEntry *dirent) const {
+  assert(blob_ != NULL);
+  if (blob_->flags & kFlagNegative) {
+    *dirent = DirectoryEntry(kDirentNegative);
+    return;
+  }
+
+  dirent->mode_ = blob_->mode;
+  dirent->inode_ = blob_->inode;
+  dirent->size_ = blob_->size;
+  dirent->mtime_ = blob_->mtime;
+  dirent->uid_ = blob_->uid;
+  dirent->gid_ = blob_->gid;
+  dirent->linkcount_ = blob_->linkcount;
+  dirent->hardlink_group_ = blob_->hardlink_group;
+  dirent->has_xattrs_ = blob_->flags & kFlagHasXattrs;
+  dirent->is_external_file_ = blob_->flags & kFlagExternalFile;
+  dirent->is_nested_catalog_root_ = blob_->flags & kFlagNestedCatalogRoot;
+  dirent->is_nested_catalog_mountpoint_ =
+    blob_->flags & kFlagNestedCatalogMountpoint;
+  dirent->is_bind_mountpoint_ = blob_->flags & kFlagBindMountpoint;
+  dirent->is_chunked_file_ = blob_->flags & kFlagChunkedFile;
+  dirent->is_hidden_ = blob_->flags & kFlagHidden;
+  dirent->is_inline_file_ = blob_->flags & kFlagInlineFile;
+  dirent->is_bundled_file_ = blob_->flags & kFlagBundledFile;
+  dirent->is_negative_ = false;
+  dirent->compression_algorithm_ =
+    static_cast<zlib::Algorithms>(blob_->compression_algorithm);
+
+  const char *data = reinterpret_cast<const char *>(blob_ + 1);
+  dirent->checksum_ = shash::Any(
+    static_cast<shash::Algorithms>(blob_->hash_algorithm),
+    blob_->hash_suffix);
+  if (!(blob_->flags & kFlagNullChecksum)) {
+    const unsigned len_digest = dirent->checksum_.GetDigestSize();
+    memcpy(dirent->checksum_.digest, data, len_digest);
+    data += len_digest;
+  }
+  dirent->name_.Assign(data, blob_->len_name);
+  data += blob_->len_name;
+  dirent->symlink_.Assign(data, blob_->len_symlink);
+}
+
 }  // namespace catalog
@@ -11,10 +11,12 @@
 #include <sys/types.h>
 
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
 #include <string>
 #include <vector>
 
+#include "atomic.h"
 #include "bigvector.h"
 #include "compression.h"
 #include "hash.h"
@@ -32,6 +34,8 @@ namespace catalog {
 
 // Create DirectoryEntries for unit test purposes.
 class DirectoryEntryTestFactory;
+class DirectoryEntryCompact;
+class CatalogIndex;
 
 class MockCatalogManager;
 class Catalog;
@@ -63,6 +67,10 @@ class DirectoryEntryBase {
   friend class SqlDirentTouch;
   // Allow creation of virtual directories and files
   friend class VirtualCatalog;
+  // Encoding for the meta-data caches
+  friend class DirectoryEntryCompact;
+  // Decoding of the read-optimized catalog encoding
+  friend class CatalogIndex;
 
  public:
   static const inode_t kInvalidInode = 0;
@@ -87,6 +95,8 @@ class DirectoryEntryBase {
     static const unsigned int kExternalFileFlag             = 0x800;
     static const unsigned int kBindMountpointFlag           = 0x1000;
     static const unsigned int kHiddenFlag                   = 0x2000;
+    static const unsigned int kInlineFileFlag               = 0x4000;
+    static const unsigned int kBundledFileFlag              = 0x8000;
   };
   typedef unsigned int Differences;
 
@@ -232,6 +242,10 @@ class DirectoryEntry : public DirectoryEntryBase {
   friend class WritableCatalogManager;
   // Create DirectoryEntries for unit test purposes.
   friend class DirectoryEntryTestFactory;
+  // Encoding for the meta-data caches
+  friend class DirectoryEntryCompact;
+  // Decoding of the read-optimized catalog encoding
+  friend class CatalogIndex;
 
  public:
   /**
@@ -248,6 +262,8 @@ class DirectoryEntry : public DirectoryEntryBase {
     , is_nested_catalog_mountpoint_(false)
     , is_bind_mountpoint_(false)
     , is_chunked_file_(false)
+    , is_inline_file_(false)
+    , is_bundled_file_(false)
     , is_hidden_(false)
     , is_negative_(false) { }
 
@@ -257,6 +273,8 @@ class DirectoryEntry : public DirectoryEntryBase {
     , is_nested_catalog_mountpoint_(false)
     , is_bind_mountpoint_(false)
     , is_chunked_file_(false)
+    , is_inline_file_(false)
+    , is_bundled_file_(false)
     , is_hidden_(false)
     , is_negative_(false) { }
 
@@ -266,6 +284,8 @@ class DirectoryEntry : public DirectoryEntryBase {
     , is_nested_catalog_mountpoint_(false)
     , is_bind_mountpoint_(false)
     , is_chunked_file_(false)
+    , is_inline_file_(false)
+    , is_bundled_file_(false)
     , is_hidden_(false)
     , is_negative_(true) { assert(special_type == kDirentNegative); }
 
@@ -288,6 +308,8 @@ class DirectoryEntry : public DirectoryEntryBase {
   }
   inline bool IsBindMountpoint() const { return is_bind_mountpoint_; }
   inline bool IsChunkedFile() const { return is_chunked_file_; }
+  inline bool IsInlineFile() const { return is_inline_file_; }
+  inline bool IsBundledFile() const { return is_bundled_file_; }
   inline bool IsHidden() const { return is_hidden_; }
   inline uint32_t hardlink_group() const { return hardlink_group_; }
 
@@ -306,6 +328,12 @@ class DirectoryEntry : public DirectoryEntryBase {
   inline void set_is_chunked_file(const bool val) {
     is_chunked_file_ = val;
   }
+  inline void set_is_inline_file(const bool val) {
+    is_inline_file_ = val;
+  }
+  inline void set_is_bundled_file(const bool val) {
+    is_bundled_file_ = val;
+  }
   inline void set_is_hidden(const bool val) {
     is_hidden_ = val;
   }
@@ -322,11 +350,106 @@ class DirectoryEntry : public DirectoryEntryBase {
   bool is_nested_catalog_mountpoint_;
   bool is_bind_mountpoint_;
   bool is_chunked_file_;
+  // The content is stored in the catalog (see SqlDirent::kFlagFileInline)
+  bool is_inline_file_;
+  // A copy is in a bundle object (see SqlDirent::kFlagFileBundle)
+  bool is_bundled_file_;
   bool is_hidden_;
   bool is_negative_;
 };
 
 
+/**
+ * Storage format of directory entries in the client's meta-data caches.  The
+ * cache slots only hold a pointer to a reference counted, flat buffer that
+ * contains the fixed-size fields followed by the content hash (omitted if
+ * null), the name, and the symlink with their actual lengths.  Copying an
+ * encoded entry in and out of the caches only touches the reference counter.
+ * The entry is expanded into a DirectoryEntry when it is looked up.
+ *
+ * Negative entries carry no data and share a single, static buffer.
+ */
+class DirectoryEntryCompact {
+ public:
+  /**
+   * Estimated size of the buffer of an average entry including the malloc
+   * overhead, used for sizing the caches.
+   */
+  static const unsigned kAverageSize = 128;
+
+  DirectoryEntryCompact() : blob_(NULL) { }
+  explicit DirectoryEntryCompact(const DirectoryEntry &dirent);
+  DirectoryEntryCompact(const DirectoryEntryCompact &other)
+    : blob_(other.blob_)
+  {
+    Ref();
+  }
+  DirectoryEntryCompact &operator =(const DirectoryEntryCompact &other) {
+    if (blob_ != other.blob_) {
+      Unref();
+      blob_ = other.blob_;
+      Ref();
+    }
+    return *this;
+  }
+  ~DirectoryEntryCompact() { Unref(); }
+
+  bool IsEmpty() const { return blob_ == NULL; }
+  void Expand(DirectoryEntry *dirent) const;
+
+ private:
+  static const uint16_t kFlagHasXattrs               = 0x001;
+  static const uint16_t kFlagExternalFile            = 0x002;
+  static const uint16_t kFlagNestedCatalogRoot       = 0x004;
+  static const uint16_t kFlagNestedCatalogMountpoint = 0x008;
+  static const uint16_t kFlagBindMountpoint          = 0x010;
+  static const uint16_t kFlagChunkedFile             = 0x020;
+  static const uint16_t kFlagHidden                  = 0x040;
+  static const uint16_t kFlagNegative                = 0x080;
+  static const uint16_t kFlagNullChecksum            = 0x100;
+  static const uint16_t kFlagInlineFile              = 0x200;
+  static const uint16_t kFlagBundledFile             = 0x400;
+
+  /**
+   * Followed by the variable-length data
+   */
+  struct Blob {
+    atomic_int32 refcount;
+    uint32_t mode;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t linkcount;
+    uint32_t hardlink_group;
+    uint16_t flags;
+    uint16_t len_name;
+    uint16_t len_symlink;
+    uint8_t hash_algorithm;
+    char hash_suffix;
+    uint8_t compression_algorithm;
+  };
+
+  static Blob negative_blob_;
+
+  void Ref() {
+    if (blob_ != NULL)
+      atomic_inc32(&blob_->refcount);
+  }
+  /**
+   * The static negative buffer starts with a reference count of 1 and is never
+   * freed.
+   */
+  void Unref() {
+    if ((blob_ != NULL) && (atomic_xadd32(&blob_->refcount, -1) == 1))
+      free(blob_);
+  }
+
+  Blob *blob_;
+};
+
+
 /**
  * Saves memory for large directory listings.
  */
@@ -36,6 +36,7 @@
 #include "logging.h"
 #include "sanitizer.h"
 #include "smalloc.h"
+#include "util/posix.h"
 #include "util/string.h"
 
 using namespace std;  // NOLINT
@@ -194,8 +195,11 @@ const set<string> &Host::ViewBestAddresses(IpPreference preference) const {
   {
     return ipv4_addresses_;
   }
-  if ((preference == kIpPreferV6) && !HasIpv6())
+  if (((preference == kIpPreferV6) || (preference == kIpPreferRace)) &&
+      !HasIpv6())
+  {
     return ipv4_addresses_;
+  }
   return ipv6_addresses_;
 }
 
@@ -1272,9 +1276,128 @@ void NormalResolver::SetSystemSearchDomains() {
 }
 
 
+/**
+ * Creates the directory if necessary.  An empty directory disables the shared
+ * cache.
+ */
+bool NormalResolver::SetSharedCacheDir(const string &cache_dir) {
+  if (!cache_dir.empty() && !MkdirDeep(cache_dir, 0700, true)) {
+    LogCvmfs(kLogDns, kLogDebug | kLogSyslogWarn,
+             "failed to create DNS cache directory %s", cache_dir.c_str());
+    return false;
+  }
+  shared_cache_dir_ = cache_dir;
+  return true;
+}
+
+
+/**
+ * Names are used as file names.  Short names depend on the search domains of
+ * the process and are not shared.
+ */
+bool NormalResolver::IsCacheableName(const string &name) {
+  if ((name.length() > 255) || (name.find('.') == string::npos) ||
+      (name[0] == '.'))
+  {
+    return false;
+  }
+  for (unsigned i = 0; i < name.length(); ++i) {
+    const char c = name[i];
+    if (!(((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+          ((c >= '0') && (c <= '9')) || (c == '-') || (c == '.')))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+/**
+ * The cache file consists of the deadline in seconds since UNIX epoch, the
+ * IPv4-only flag of the resolver that stored the entry, the fully qualified
+ * name, and one line "4 <address>" or "6 <address>" per address.
+ */
+bool NormalResolver::LoadSharedCache(
+  const string &name,
+  vector<string> *ipv4_addresses,
+  vector<string> *ipv6_addresses,
+  unsigned *ttl,
+  string *fqdn)
+{
+  FILE *f = fopen((shared_cache_dir_ + "/" + name).c_str(), "r");
+  if (f == NULL)
+    return false;
+
+  string line;
+  bool retval = GetLineFile(f, &line);
+  const time_t deadline = String2Int64(line);
+  const time_t now = time(NULL);
+  const bool ipv4_only = cares_resolver_->ipv4_only();
+  retval = retval && (deadline > now) && GetLineFile(f, &line) &&
+           (ipv4_only || (line == "0")) && GetLineFile(f, fqdn);
+  vector<string> addresses4;
+  vector<string> addresses6;
+  while (retval && GetLineFile(f, &line)) {
+    if (HasPrefix(line, "4 ", false))
+      addresses4.push_back(line.substr(2));
+    else if (HasPrefix(line, "6 ", false) && !ipv4_only)
+      addresses6.push_back(line.substr(2));
+  }
+  fclose(f);
+  if (!retval || (addresses4.empty() && addresses6.empty()))
+    return false;
+
+  (*ipv4_addresses) = addresses4;
+  (*ipv6_addresses) = addresses6;
+  *ttl = deadline - now;
+  LogCvmfs(kLogDns, kLogDebug, "found %s in shared DNS cache, ttl %u",
+           name.c_str(), *ttl);
+  return true;
+}
+
+
+/**
+ * Written to a temporary file and renamed, so that concurrent readers see
+ * either the old or the new entry.  Failures are ignored.
+ */
+void NormalResolver::StoreSharedCache(
+  const string &name,
+  const vector<string> &ipv4_addresses,
+  const vector<string> &ipv6_addresses,
+  const unsigned ttl,
+  const string &fqdn)
+{
+  const string path = shared_cache_dir_ + "/" + name;
+  const unsigned effective_ttl = (ttl > kMaxTtl) ? kMaxTtl : ttl;
+  string content = StringifyInt(time(NULL) + effective_ttl) + "\n" +
+                   (cares_resolver_->ipv4_only() ? "1" : "0") + "\n" +
+                   fqdn + "\n";
+  for (unsigned i = 0; i < ipv4_addresses.size(); ++i)
+    content += "4 " + ipv4_addresses[i] + "\n";
+  for (unsigned i = 0; i < ipv6_addresses.size(); ++i)
+    content += "6 " + ipv6_addresses[i] + "\n";
+
+  string path_tmp;
+  FILE *f = CreateTempFile(path + ".tmp", 0600, "w", &path_tmp);
+  if (f == NULL)
+    return;
+  bool retval = fwrite(content.data(), 1, content.length(), f) ==
+                content.length();
+  retval = (fclose(f) == 0) && retval;
+  if (!retval || (rename(path_tmp.c_str(), path.c_str()) != 0)) {
+    LogCvmfs(kLogDns, kLogDebug, "failed to store %s in shared DNS cache",
+             name.c_str());
+    unlink(path_tmp.c_str());
+  }
+}
+
+
 /**
  * First pass done by the hostfile resolver, all successfully resolved names
- * are skipped by the c-ares resolver.
+ * are skipped by the c-ares resolver.  If the shared cache is enabled, the
+ * remaining names are looked up there before c-ares, and the names resolved
+ * by c-ares are stored there.
  */
 void NormalResolver::DoResolve(
   const vector<string> &names,
@@ -1293,8 +1416,29 @@ void NormalResolver::DoResolve(
     if ((*failures)[i] == kFailOk)
       skip_cares[i] = true;
   }
+  vector<bool> is_cacheable(num, false);
+  if (!shared_cache_dir_.empty()) {
+    for (unsigned i = 0; i < num; ++i) {
+      if (skip_cares[i] || !IsCacheableName(names[i]))
+        continue;
+      is_cacheable[i] = true;
+      if (LoadSharedCache(names[i], &(*ipv4_addresses)[i],
+                          &(*ipv6_addresses)[i], &(*ttls)[i], &(*fqdns)[i]))
+      {
+        (*failures)[i] = kFailOk;
+        skip_cares[i] = true;
+        is_cacheable[i] = false;
+      }
+    }
+  }
   cares_resolver_->DoResolve(names, skip_cares, ipv4_addresses, ipv6_addresses,
                              failures, ttls, fqdns);
+  for (unsigned i = 0; i < num; ++i) {
+    if (is_cacheable[i] && ((*failures)[i] == kFailOk)) {
+      StoreSharedCache(names[i], (*ipv4_addresses)[i], (*ipv6_addresses)[i],
+                       (*ttls)[i], (*fqdns)[i]);
+    }
+  }
 }
 
 
@@ -48,6 +48,8 @@ enum IpPreference {
   kIpPreferSystem = 0,
   kIpPreferV4,
   kIpPreferV6,
+  // dual-stack hosts are connected by racing IPv6 and IPv4 (RFC 8305)
+  kIpPreferRace,
 };
 
 inline const char *Code2Ascii(const Failures error) {
@@ -361,9 +363,15 @@ class HostfileResolver : public Resolver {
 /**
  * The normal resolver combines Hostfile and C-ares resolver.  First looks up
  * host names in the host file.  All non-matches are looked up by c-ares.
+ *
+ * Optionally, the answers of c-ares are shared with other processes through
+ * files in a cache directory.  Names found there with a remaining TTL are not
+ * queried again.  With the directory in the shared cache workspace, a proxy
+ * name is resolved once per node instead of once per mounted repository.
  */
 class NormalResolver : public Resolver {
   FRIEND_TEST(T_Dns, NormalResolverConstruct);
+  FRIEND_TEST(T_Dns, NormalResolverSharedCache);
 
  public:
   static NormalResolver *Create(const bool ipv4_only,
@@ -374,6 +382,8 @@ class NormalResolver : public Resolver {
   virtual void SetSystemResolvers();
   virtual void SetSystemSearchDomains();
   virtual ~NormalResolver();
+  bool SetSharedCacheDir(const std::string &cache_dir);
+  const std::string &shared_cache_dir() const { return shared_cache_dir_; }
 
  protected:
   virtual void DoResolve(const std::vector<std::string> &names,
@@ -386,8 +396,24 @@ class NormalResolver : public Resolver {
   NormalResolver();
 
  private:
+  static bool IsCacheableName(const std::string &name);
+  bool LoadSharedCache(const std::string &name,
+                       std::vector<std::string> *ipv4_addresses,
+                       std::vector<std::string> *ipv6_addresses,
+                       unsigned *ttl,
+                       std::string *fqdn);
+  void StoreSharedCache(const std::string &name,
+                        const std::vector<std::string> &ipv4_addresses,
+                        const std::vector<std::string> &ipv6_addresses,
+                        const unsigned ttl,
+                        const std::string &fqdn);
+
   CaresResolver *cares_resolver_;
   HostfileResolver *hostfile_resolver_;
+  /**
+   * Empty if the answers are not shared with other processes
+   */
+  std::string shared_cache_dir_;
 };
 
 }  // namespace dns
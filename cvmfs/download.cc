@@ -9,9 +9,10 @@
  * The module starts in single-threaded mode and can be switched to multi-
  * threaded mode by Spawn().  In multi-threaded mode, the Fetch() function still
  * blocks but there is a separate I/O thread using asynchronous I/O, which
- * maintains all concurrent connections simultaneously.  As there might be more
- * than 1024 file descriptors for the CernVM-FS process, the I/O thread uses
- * poll and the libcurl multi socket interface.
+ * maintains all concurrent connections simultaneously.  FetchMany() submits
+ * a set of jobs at once and blocks until all of them are finished.  As there
+ * might be more than 1024 file descriptors for the CernVM-FS process, the I/O
+ * thread uses poll and the libcurl multi socket interface.
  *
  * While downloading, files can be decompressed and the secure hash can be
  * calculated on the fly.
@@ -45,6 +46,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <ctime>
 #include <set>
 
 #include "atomic.h"
@@ -52,17 +54,21 @@
 #include "duplex_curl.h"
 #include "hash.h"
 #include "logging.h"
+#include "platform.h"
 #include "prng.h"
 #include "sanitizer.h"
 #include "smalloc.h"
 #include "util/algorithm.h"
 #include "util/posix.h"
+#include "util/probes.h"
 #include "util/string.h"
 
 using namespace std;  // NOLINT
 
 namespace download {
 
+static const char *kInfoHeaderName = "cvmfs-info: ";
+
 static inline bool EscapeUrlChar(char input, char output[3]) {
   if (((input >= '0') && (input <= '9')) ||
       ((input >= 'A') && (input <= 'Z')) ||
@@ -165,6 +171,91 @@ static Failures PrepareDownloadDestination(JobInfo *info) {
 }
 
 
+static uint64_t GetTimestampMs() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_usec / 1000;
+}
+
+
+/**
+ * Called when a job is submitted.  The JobInfo of a thread is reused for many
+ * downloads.
+ */
+static void ResetTiming(JobInfo *info) {
+  memset(&info->timing, 0, sizeof(info->timing));
+  info->submit_ns = platform_monotonic_time_ns();
+}
+
+
+static uint64_t CurlTimeNs(const double seconds) {
+  return (seconds > 0.0) ? static_cast<uint64_t>(seconds * 1e9) : 0;
+}
+
+
+/**
+ * Adds the phases of the last attempt to the timing of the job.  The curl
+ * times are measured from the start of the attempt and phases that were not
+ * reached are zero.  A reused connection has no DNS, connect, or TLS time.
+ */
+static void UpdateTiming(JobInfo *info) {
+  double namelookup = 0.0;
+  double connect = 0.0;
+  double appconnect = 0.0;
+  double pretransfer = 0.0;
+  double starttransfer = 0.0;
+  double total = 0.0;
+  CURL *handle = info->curl_handle;
+  curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME, &namelookup);
+  curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME, &connect);
+  curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME, &appconnect);
+  curl_easy_getinfo(handle, CURLINFO_PRETRANSFER_TIME, &pretransfer);
+  curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME, &starttransfer);
+  curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &total);
+
+  info->timing.dns += CurlTimeNs(namelookup);
+  if (pretransfer <= 0.0) {
+    // The attempt failed before the request was sent
+    info->timing.connect += CurlTimeNs(total - namelookup);
+    return;
+  }
+  connect = std::max(connect, namelookup);
+  const double handshake = std::max(appconnect, connect);
+  info->timing.connect += CurlTimeNs(connect - namelookup);
+  info->timing.tls += CurlTimeNs(handshake - connect);
+  if (starttransfer <= 0.0) {
+    info->timing.wait += CurlTimeNs(total - std::max(pretransfer, handshake));
+    return;
+  }
+  info->timing.wait +=
+    CurlTimeNs(starttransfer - std::max(pretransfer, handshake));
+  info->timing.transfer += CurlTimeNs(total - starttransfer);
+}
+
+
+/**
+ * Called by the first data chunk of a job or its hedge.  The other transfer is
+ * marked as lost and gets removed by the I/O thread.  If the hedge wins, the
+ * received headers are moved to the original job, which owns the destination.
+ */
+static void DecideHedge(JobInfo *winner) {
+  JobInfo *loser = winner->hedge_partner;
+  winner->hedge_partner = loser->hedge_partner = NULL;
+  loser->hedge_lost = true;
+  JobInfo *info = winner->hedge_of;
+  if (info == NULL)
+    return;
+
+  info->http_code = winner->http_code;
+  if (info->destination == kDestinationMem) {
+    free(info->destination_mem.data);
+    info->destination_mem = winner->destination_mem;
+    winner->destination_mem.size = winner->destination_mem.pos = 0;
+    winner->destination_mem.data = NULL;
+  }
+}
+
+
 /**
  * Called by curl for every HTTP header. Not called for file:// transfers.
  */
@@ -175,6 +266,11 @@ static size_t CallbackCurlHeader(void *ptr, size_t size, size_t nmemb,
   const string header_line(static_cast<const char *>(ptr), num_bytes);
   JobInfo *info = static_cast<JobInfo *>(info_link);
 
+  if (info->hedge_lost)
+    return 0;
+  // The server responds, no need to hedge
+  info->hedge_deadline_ms = 0;
+
   // LogCvmfs(kLogDownload, kLogDebug, "REMOVE-ME: Header callback with %s",
   //          header_line.c_str());
 
@@ -193,6 +289,9 @@ static size_t CallbackCurlHeader(void *ptr, size_t size, size_t nmemb,
 
     if ((info->http_code / 100) == 2) {
       return num_bytes;
+    } else if ((info->http_code == 304) && (info->if_modified_since > 0)) {
+      // Classified by libcurl as an unmet time condition
+      return num_bytes;
     } else if ((info->http_code == 301) ||
                (info->http_code == 302) ||
                (info->http_code == 303) ||
@@ -257,37 +356,42 @@ static size_t CallbackCurlHeader(void *ptr, size_t size, size_t nmemb,
 
 
 /**
- * Called by curl for every received data chunk.
+ * Hashes, decompresses, and writes received data to a file or a sink.
  */
-static size_t CallbackCurlData(void *ptr, size_t size, size_t nmemb,
-                               void *info_link)
-{
-  const size_t num_bytes = size*nmemb;
-  JobInfo *info = static_cast<JobInfo *>(info_link);
-
-  // LogCvmfs(kLogDownload, kLogDebug, "Data callback,  %d bytes", num_bytes);
-
-  if (num_bytes == 0)
-    return 0;
+static bool ProcessData(JobInfo *info, const void *ptr, size_t num_bytes) {
+  if (info->expected_hash) {
+    shash::Update(static_cast<const unsigned char *>(ptr), num_bytes,
+                  info->hash_context);
+  }
 
-  if (info->expected_hash)
-    shash::Update((unsigned char *)ptr, num_bytes, info->hash_context);
+  if (info->decryptor != NULL) {
+    const unsigned char *plaintext;
+    if (!info->decryptor->Update(ptr, num_bytes, &plaintext, &num_bytes)) {
+      LogCvmfs(kLogDownload, kLogDebug, "failed to decrypt %s",
+               info->url->c_str());
+      info->error_code = kFailBadData;
+      return false;
+    }
+    if (num_bytes == 0)
+      return true;
+    ptr = plaintext;
+  }
 
   if (info->destination == kDestinationSink) {
     if (info->compressed) {
       zlib::StreamStates retval =
-        zlib::DecompressZStream2Sink(ptr, num_bytes,
-                                     &info->zstream, info->destination_sink);
+        info->decompressor->Inflate2Sink(ptr, num_bytes,
+                                         info->destination_sink);
       if (retval == zlib::kStreamDataError) {
         LogCvmfs(kLogDownload, kLogDebug, "failed to decompress %s",
                  info->url->c_str());
         info->error_code = kFailBadData;
-        return 0;
+        return false;
       } else if (retval == zlib::kStreamIOError) {
         LogCvmfs(kLogDownload, kLogSyslogErr,
                  "decompressing %s, local IO error", info->url->c_str());
         info->error_code = kFailLocalIO;
-        return 0;
+        return false;
       }
     } else {
       int64_t written = info->destination_sink->Write(ptr, num_bytes);
@@ -295,60 +399,259 @@ static size_t CallbackCurlData(void *ptr, size_t size, size_t nmemb,
         LogCvmfs(kLogDownload, kLogDebug, "Failed to perform write on %s (%"
                  PRId64 ")", info->url->c_str(), written);
         info->error_code = kFailLocalIO;
-        return 0;
-      }
-    }
-  } else if (info->destination == kDestinationMem) {
-    // Write to memory
-    if (info->destination_mem.pos + num_bytes > info->destination_mem.size) {
-      if (info->destination_mem.size == 0) {
-        LogCvmfs(kLogDownload, kLogDebug,
-                 "Content-Length was missing or zero, but %zu bytes received",
-                 info->destination_mem.pos + num_bytes);
-      } else {
-        LogCvmfs(kLogDownload, kLogDebug, "Callback had too much data: "
-                 "start %zu, bytes %zu, expected %zu",
-                 info->destination_mem.pos,
-                 num_bytes,
-                 info->destination_mem.size);
+        return false;
       }
-      info->error_code = kFailBadData;
-      return 0;
     }
-    memcpy(info->destination_mem.data + info->destination_mem.pos,
-           ptr, num_bytes);
-    info->destination_mem.pos += num_bytes;
   } else {
     // Write to file
     if (info->compressed) {
-      // LogCvmfs(kLogDownload, kLogDebug, "REMOVE-ME: writing %d bytes for %s",
-      //          num_bytes, info->url->c_str());
       zlib::StreamStates retval =
-        zlib::DecompressZStream2File(ptr, num_bytes,
-                                     &info->zstream, info->destination_file);
+        info->decompressor->Inflate2File(ptr, num_bytes,
+                                         info->destination_file);
       if (retval == zlib::kStreamDataError) {
         LogCvmfs(kLogDownload, kLogDebug, "failed to decompress %s",
                  info->url->c_str());
         info->error_code = kFailBadData;
-        return 0;
+        return false;
       } else if (retval == zlib::kStreamIOError) {
         LogCvmfs(kLogDownload, kLogSyslogErr,
                  "decompressing %s, local IO error", info->url->c_str());
         info->error_code = kFailLocalIO;
-        return 0;
+        return false;
       }
     } else {
       if (fwrite(ptr, 1, num_bytes, info->destination_file) != num_bytes) {
-       LogCvmfs(kLogDownload, kLogDebug,
+        LogCvmfs(kLogDownload, kLogDebug,
                  "downloading %s, IO failure: %s (errno=%d)",
                  info->url->c_str(), strerror(errno), errno);
         info->error_code = kFailLocalIO;
-        return 0;
+        return false;
       }
     }
   }
 
-  return num_bytes;
+  return true;
+}
+
+
+/**
+ * Runs in the I/O thread or, with data workers, in the worker of the job.  The
+ * blocks of a job are never processed concurrently, so the data time can be
+ * summed up without locking.
+ */
+static bool WriteData(JobInfo *info, const void *ptr, size_t num_bytes) {
+  const uint64_t start_ns = platform_monotonic_time_ns();
+  const bool retval = ProcessData(info, ptr, num_bytes);
+  info->timing.data += platform_monotonic_time_ns() - start_ns;
+  return retval;
+}
+
+
+/**
+ * Called by curl for every received data chunk.
+ */
+static size_t CallbackCurlData(void *ptr, size_t size, size_t nmemb,
+                               void *info_link)
+{
+  const size_t num_bytes = size*nmemb;
+  JobInfo *info = static_cast<JobInfo *>(info_link);
+
+  // LogCvmfs(kLogDownload, kLogDebug, "Data callback,  %d bytes", num_bytes);
+
+  if (num_bytes == 0)
+    return 0;
+
+  if (info->hedge_partner != NULL)
+    DecideHedge(info);
+  if (info->hedge_lost)
+    return 0;
+  // A hedge that won writes to the destination of the original job
+  if (info->hedge_of != NULL)
+    info = info->hedge_of;
+
+  if (info->destination == kDestinationMem) {
+    if (info->expected_hash)
+      shash::Update((unsigned char *)ptr, num_bytes, info->hash_context);
+    // Write to memory
+    if (info->destination_mem.pos + num_bytes > info->destination_mem.size) {
+      if (info->destination_mem.size == 0) {
+        LogCvmfs(kLogDownload, kLogDebug,
+                 "Content-Length was missing or zero, but %zu bytes received",
+                 info->destination_mem.pos + num_bytes);
+      } else {
+        LogCvmfs(kLogDownload, kLogDebug, "Callback had too much data: "
+                 "start %zu, bytes %zu, expected %zu",
+                 info->destination_mem.pos,
+                 num_bytes,
+                 info->destination_mem.size);
+      }
+      info->error_code = kFailBadData;
+      return 0;
+    }
+    memcpy(info->destination_mem.data + info->destination_mem.pos,
+           ptr, num_bytes);
+    info->destination_mem.pos += num_bytes;
+    return num_bytes;
+  }
+
+  if (info->data_workers != NULL) {
+    // The error code is set by the worker
+    if (atomic_read32(&info->data_failed))
+      return 0;
+    info->data_workers->Push(info, ptr, num_bytes);
+    return num_bytes;
+  }
+
+  return WriteData(info, ptr, num_bytes) ? num_bytes : 0;
+}
+
+
+//------------------------------------------------------------------------------
+
+
+DataWorkers::Worker::Worker()
+  : queued_bytes(0)
+  , terminate(false)
+  , pipe_done(-1)
+{
+  int retval = pthread_mutex_init(&lock, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&cond_data, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&cond_space, NULL);
+  assert(retval == 0);
+}
+
+
+DataWorkers::Worker::~Worker() {
+  pthread_mutex_destroy(&lock);
+  pthread_cond_destroy(&cond_data);
+  pthread_cond_destroy(&cond_space);
+}
+
+
+DataWorkers::DataWorkers(const unsigned num_workers, const int pipe_done)
+  : next_worker_(0)
+{
+  assert(num_workers > 0);
+  for (unsigned i = 0; i < num_workers; ++i) {
+    Worker *worker = new Worker();
+    worker->pipe_done = pipe_done;
+    int retval = pthread_create(&worker->thread, NULL, MainWorker, worker);
+    assert(retval == 0);
+    workers_.push_back(worker);
+  }
+  LogCvmfs(kLogDownload, kLogDebug, "started %u download data workers",
+           num_workers);
+}
+
+
+/**
+ * The workers process the blocks that are still queued before they stop.
+ */
+DataWorkers::~DataWorkers() {
+  for (unsigned i = 0; i < workers_.size(); ++i) {
+    pthread_mutex_lock(&workers_[i]->lock);
+    workers_[i]->terminate = true;
+    pthread_cond_signal(&workers_[i]->cond_data);
+    pthread_mutex_unlock(&workers_[i]->lock);
+  }
+  for (unsigned i = 0; i < workers_.size(); ++i) {
+    pthread_join(workers_[i]->thread, NULL);
+    delete workers_[i];
+  }
+}
+
+
+void DataWorkers::Push(JobInfo *info, const void *buf, const size_t size) {
+  // Without pending blocks, the order is preserved by any worker
+  if (atomic_read32(&info->data_pending) == 0) {
+    info->data_worker = next_worker_;
+    next_worker_ = (next_worker_ + 1) % workers_.size();
+  }
+  Worker *worker = workers_[info->data_worker];
+
+  Block block;
+  block.info = info;
+  block.data = smalloc(size);
+  block.size = size;
+  memcpy(block.data, buf, size);
+
+  pthread_mutex_lock(&worker->lock);
+  while (worker->queued_bytes >= kMaxQueuedBytes)
+    pthread_cond_wait(&worker->cond_space, &worker->lock);
+  worker->queue.push_back(block);
+  worker->queued_bytes += size;
+  atomic_inc32(&info->data_pending);
+  pthread_cond_signal(&worker->cond_data);
+  pthread_mutex_unlock(&worker->lock);
+}
+
+
+/**
+ * The received data that is not yet processed by the workers
+ */
+uint64_t DataWorkers::GetQueuedBytes() {
+  uint64_t result = 0;
+  for (unsigned i = 0; i < workers_.size(); ++i) {
+    pthread_mutex_lock(&workers_[i]->lock);
+    result += workers_[i]->queued_bytes;
+    pthread_mutex_unlock(&workers_[i]->lock);
+  }
+  return result;
+}
+
+
+bool DataWorkers::Finish(JobInfo *info) {
+  Worker *worker = workers_[info->data_worker];
+  pthread_mutex_lock(&worker->lock);
+  const bool result = (atomic_read32(&info->data_pending) == 0);
+  if (!result)
+    info->data_draining = true;
+  pthread_mutex_unlock(&worker->lock);
+  return result;
+}
+
+
+void *DataWorkers::MainWorker(void *data) {
+  Worker *worker = static_cast<Worker *>(data);
+
+  pthread_mutex_lock(&worker->lock);
+  while (true) {
+    while (worker->queue.empty() && !worker->terminate)
+      pthread_cond_wait(&worker->cond_data, &worker->lock);
+    if (worker->queue.empty())
+      break;
+    Block block = worker->queue.front();
+    worker->queue.pop_front();
+    pthread_mutex_unlock(&worker->lock);
+
+    JobInfo *info = block.info;
+    // After a failure, the remaining blocks of the transfer are dropped
+    if (!atomic_read32(&info->data_failed) &&
+        !WriteData(info, block.data, block.size))
+    {
+      atomic_inc32(&info->data_failed);
+    }
+    free(block.data);
+
+    pthread_mutex_lock(&worker->lock);
+    worker->queued_bytes -= block.size;
+    pthread_cond_signal(&worker->cond_space);
+    bool drained = false;
+    if ((atomic_xadd32(&info->data_pending, -1) == 1) && info->data_draining) {
+      info->data_draining = false;
+      drained = true;
+    }
+    if (drained) {
+      // The job can be gone as soon as the I/O thread picks it up
+      pthread_mutex_unlock(&worker->lock);
+      WritePipe(worker->pipe_done, &info, sizeof(info));
+      pthread_mutex_lock(&worker->lock);
+    }
+  }
+  pthread_mutex_unlock(&worker->lock);
+  return NULL;
 }
 
 
@@ -359,6 +662,23 @@ const int DownloadManager::kProbeUnprobed = -1;
 const int DownloadManager::kProbeDown     = -2;
 const int DownloadManager::kProbeGeo      = -3;
 const unsigned DownloadManager::kMaxMemSize = 1024*1024;
+const unsigned DownloadManager::kMinScoreSamples;
+const unsigned DownloadManager::kSteerThresholdPercent;
+const unsigned DownloadManager::kExploreInterval;
+const unsigned DownloadManager::kHedgeSamples;
+const unsigned DownloadManager::kHedgePercentile;
+const unsigned DownloadManager::kHedgeUpdateInterval;
+const unsigned DownloadManager::kGeoCacheDefaultTtl;
+const unsigned DownloadManager::kStripeSize;
+const unsigned DownloadManager::kRaceDelayMs;
+const unsigned DownloadManager::kIpv4PinTtl;
+const unsigned DownloadManager::EndpointScore::kReferenceBytes;
+const unsigned DownloadManager::EndpointScore::kMinThroughputBytes;
+
+/**
+ * Weight of a new sample in the moving averages of an EndpointScore
+ */
+static const double kScoreWeight = 0.125;
 
 
 /**
@@ -452,6 +772,361 @@ int DownloadManager::CallbackCurlSocket(CURL *easy,
 }
 
 
+/**
+ * Hands a new job to curl.
+ */
+void DownloadManager::StartJob(JobInfo *info) {
+  info->timing.queue = platform_monotonic_time_ns() - info->submit_ns;
+  CURL *handle = AcquireCurlHandle();
+  InitializeRequest(info, handle);
+  SetUrlOptions(info);
+  ScheduleHedge(info);
+  curl_multi_add_handle(curl_multi_, handle);
+}
+
+
+/**
+ * Sets the time after which a job without response gets a hedge.
+ */
+void DownloadManager::ScheduleHedge(JobInfo *info) {
+  info->hedge_deadline_ms = 0;
+  if ((opt_hedge_max_per_second_ == 0) || info->head_request)
+    return;
+  const int32_t delay_ms = atomic_read32(&hedge_delay_ms_);
+  if (delay_ms > 0)
+    info->hedge_deadline_ms = GetTimestampMs() + delay_ms;
+}
+
+
+/**
+ * Sends hedges for the jobs that passed their deadline, as long as the rate
+ * limit allows for it.  Returns the number of new hedges.
+ */
+unsigned DownloadManager::StartHedges() {
+  const uint64_t now = GetTimestampMs();
+  if (now / 1000 != hedge_second_) {
+    hedge_second_ = now / 1000;
+    hedge_num_second_ = 0;
+  }
+  if (hedge_num_second_ >= opt_hedge_max_per_second_)
+    return 0;
+
+  // StartHedge() changes the set of handles in use
+  vector<JobInfo *> overdue;
+  for (set<CURL *>::const_iterator i = pool_handles_inuse_->begin(),
+       iEnd = pool_handles_inuse_->end(); i != iEnd; ++i)
+  {
+    JobInfo *info;
+    curl_easy_getinfo(*i, CURLINFO_PRIVATE, &info);
+    if ((info->hedge_deadline_ms > 0) && (info->hedge_deadline_ms <= now))
+      overdue.push_back(info);
+  }
+
+  unsigned result = 0;
+  for (unsigned i = 0; i < overdue.size(); ++i) {
+    if (hedge_num_second_ >= opt_hedge_max_per_second_)
+      break;
+    overdue[i]->hedge_deadline_ms = 0;
+    if (StartHedge(overdue[i])) {
+      hedge_num_second_++;
+      result++;
+    }
+  }
+  return result;
+}
+
+
+/**
+ * Duplicates a job to another proxy or host.  Fails if there is no other
+ * endpoint to use.
+ */
+bool DownloadManager::StartHedge(JobInfo *info) {
+  if (info->url->find("@proxy@") != string::npos)
+    return false;
+
+  JobInfo *hedge = new JobInfo();
+  hedge->url = info->url;
+  hedge->compressed = info->compressed;
+  hedge->compression_alg = info->compression_alg;
+  hedge->probe_hosts = info->probe_hosts;
+  hedge->force_nocache = info->force_nocache;
+  hedge->pid = info->pid;
+  hedge->uid = info->uid;
+  hedge->gid = info->gid;
+  // Required by the header callback to reserve memory
+  hedge->destination = info->destination;
+  hedge->extra_info = info->extra_info;
+  hedge->range_offset = info->range_offset;
+  hedge->range_size = info->range_size;
+  hedge->info_header = info->info_header;
+
+  InitializeRequest(hedge, AcquireCurlHandle());
+  if (info->nocache)
+    SetNocache(hedge);
+  if (!SetHedgeUrlOptions(hedge, info)) {
+    DropHedge(hedge);
+    return false;
+  }
+  LogCvmfs(kLogDownload, kLogDebug, "hedge %s via proxy %s (job used %s)",
+           info->url->c_str(), hedge->proxy.c_str(), info->proxy.c_str());
+
+  hedge->hedge_of = info;
+  hedge->hedge_partner = info;
+  info->hedge_partner = hedge;
+  hedges_.push_back(hedge);
+  curl_multi_add_handle(curl_multi_, hedge->curl_handle);
+  perf::Inc(counters_->n_hedged);
+  return true;
+}
+
+
+/**
+ * Uses the regular URL options unless they point to the same endpoint as the
+ * original job.  In that case, the hedge uses the next proxy of the current
+ * load-balancing group or, without proxies, the next host.
+ */
+bool DownloadManager::SetHedgeUrlOptions(JobInfo *hedge, const JobInfo *info) {
+  SetUrlOptions(hedge);
+  if (hedge->proxy != info->proxy)
+    return true;
+
+  bool result = false;
+  pthread_mutex_lock(lock_options_);
+  if (info->proxy != "DIRECT") {
+    if (opt_proxy_groups_) {
+      const vector<ProxyInfo> &group =
+        (*opt_proxy_groups_)[opt_proxy_groups_current_];
+      const unsigned num_candidates =
+        group.size() + 1 - std::max(opt_proxy_groups_current_burned_, 1U);
+      for (unsigned i = 0; i < num_candidates; ++i) {
+        if ((group[i].url == info->proxy) || (group[i].url == "DIRECT") ||
+            (group[i].host.status() != dns::kFailOk))
+        {
+          continue;
+        }
+        hedge->proxy = group[i].url;
+        curl_easy_setopt(hedge->curl_handle, CURLOPT_PROXY,
+                         hedge->proxy.c_str());
+        result = true;
+        break;
+      }
+    }
+  } else if (info->probe_hosts && opt_host_chain_ &&
+             (opt_host_chain_->size() > 1))
+  {
+    const unsigned next_host =
+      (opt_host_chain_current_ + 1) % opt_host_chain_->size();
+    const string url = (*opt_host_chain_)[next_host] + *(info->url);
+    curl_easy_setopt(hedge->curl_handle, CURLOPT_URL, EscapeUrl(url).c_str());
+    result = true;
+  }
+  pthread_mutex_unlock(lock_options_);
+  return result;
+}
+
+
+/**
+ * Removes the transfers that lost against their partner.  If the hedge won,
+ * it takes over from the curl handle of the original job; the hedge itself
+ * stays until the transfer finishes because it is the callbacks' argument.
+ */
+void DownloadManager::ReapHedges() {
+  for (unsigned i = 0; i < hedges_.size(); ) {
+    JobInfo *hedge = hedges_[i];
+    JobInfo *info = hedge->hedge_of;
+    if (hedge->hedge_lost) {
+      DropHedge(hedge);
+      hedges_.erase(hedges_.begin() + i);
+      continue;
+    }
+    if (info->hedge_lost) {
+      curl_multi_remove_handle(curl_multi_, info->curl_handle);
+      if (info->cred_data) {
+        credentials_attachment_->ReleaseCurlHandle(info->curl_handle,
+                                                   info->cred_data);
+      }
+      ReleaseCurlHandle(info->curl_handle);
+      info->curl_handle = hedge->curl_handle;
+      info->cred_data = hedge->cred_data;
+      hedge->cred_data = NULL;
+      info->proxy = hedge->proxy;
+      info->hedge_lost = false;
+      curl_easy_setopt(info->curl_handle, CURLOPT_PRIVATE,
+                       static_cast<void *>(info));
+      perf::Inc(counters_->n_hedge_won);
+    }
+    i++;
+  }
+}
+
+
+/**
+ * Called for a finished transfer.  Hedges that finish without having received
+ * data are dropped, in which case false is returned.  Otherwise, the hedge of
+ * the job is dropped, too, and the curl handle is restored to refer to the
+ * job only.
+ */
+bool DownloadManager::CompleteHedge(JobInfo *info) {
+  for (unsigned i = 0; i < hedges_.size(); ++i) {
+    JobInfo *hedge = hedges_[i];
+    if ((hedge != info) && (hedge->hedge_of != info))
+      continue;
+
+    if ((hedge != info) && (hedge->curl_handle == info->curl_handle)) {
+      curl_easy_setopt(info->curl_handle, CURLOPT_WRITEHEADER,
+                       static_cast<void *>(info));
+      curl_easy_setopt(info->curl_handle, CURLOPT_WRITEDATA,
+                       static_cast<void *>(info));
+      curl_easy_setopt(info->curl_handle, CURLOPT_HTTPHEADER, info->headers);
+    }
+    DropHedge(hedge);
+    hedges_.erase(hedges_.begin() + i);
+    return hedge != info;
+  }
+  return true;
+}
+
+
+/**
+ * Frees a hedge and, unless it was handed over to the original job, its curl
+ * handle.
+ */
+void DownloadManager::DropHedge(JobInfo *hedge) {
+  if (hedge->hedge_partner)
+    hedge->hedge_partner->hedge_partner = NULL;
+  if ((hedge->hedge_of == NULL) ||
+      (hedge->curl_handle != hedge->hedge_of->curl_handle))
+  {
+    curl_multi_remove_handle(curl_multi_, hedge->curl_handle);
+    if (hedge->cred_data) {
+      credentials_attachment_->ReleaseCurlHandle(hedge->curl_handle,
+                                                 hedge->cred_data);
+    }
+    ReleaseCurlHandle(hedge->curl_handle);
+  }
+  header_lists_->PutList(hedge->headers);
+  free(hedge->destination_mem.data);
+  delete hedge;
+}
+
+
+/**
+ * Appends a job to the queue of its priority and its requester's uid, see
+ * StartQueuedJobs().
+ */
+void DownloadManager::QueueJob(JobInfo *info) {
+  const uid_t uid = opt_fair_share_ ? info->uid : 0;
+  const unsigned priority = opt_priorities_ ? info->priority : 0;
+  assert(priority < kNumPriorities);
+  queued_jobs_[priority][uid].push_back(info);
+  num_queued_jobs_++;
+}
+
+
+/**
+ * The number of pool handles that jobs of the given priority leave to the more
+ * urgent classes.  Every class can use at least one handle.
+ */
+unsigned DownloadManager::GetReservedHandles(
+  const unsigned priority,
+  const unsigned max_inflight) const
+{
+  // In eighths of the pool
+  static const unsigned kReservedShare[kNumPriorities] = {0, 1, 2, 4};
+  if (kReservedShare[priority] == 0)
+    return 0;
+  const unsigned reserved =
+    std::max(1U, (max_inflight * kReservedShare[priority]) / 8);
+  return std::min(reserved, max_inflight - 1);
+}
+
+
+/**
+ * Starts queued jobs as long as there are idle handles in the pool, so that
+ * large batches do not open an unbounded number of transfers.  Without fair
+ * share and priorities, single jobs from Fetch() are not queued and thus not
+ * throttled.  With fair share, the next job is taken from the queue of the uid
+ * that follows the last served one, so every uid gets its turn.  With
+ * priorities, the queued jobs of the most urgent class start first and the
+ * less urgent classes cannot take the last handles.  Thus catalogs and small
+ * files find a free transfer slot while bulk downloads and prefetching occupy
+ * the others.
+ */
+void DownloadManager::StartQueuedJobs() {
+  const unsigned max_inflight = (pool_max_handles_ > 0) ? pool_max_handles_ : 1;
+  while (num_queued_jobs_ > 0) {
+    // Less urgent classes have fewer handles at their disposal, so if the first
+    // class with queued jobs cannot start, none can
+    unsigned priority = 0;
+    while (queued_jobs_[priority].empty())
+      priority++;
+    if (pool_handles_inuse_->size() + GetReservedHandles(priority, max_inflight)
+        >= max_inflight)
+    {
+      break;
+    }
+
+    map<uid_t, deque<JobInfo *> > &queue = queued_jobs_[priority];
+    map<uid_t, deque<JobInfo *> >::iterator iter =
+      queue.upper_bound(queued_jobs_cursor_[priority]);
+    if (iter == queue.end())
+      iter = queue.begin();
+    queued_jobs_cursor_[priority] = iter->first;
+    JobInfo *info = iter->second.front();
+    iter->second.pop_front();
+    if (iter->second.empty())
+      queue.erase(iter);
+    num_queued_jobs_--;
+    StartJob(info);
+  }
+}
+
+
+/**
+ * Returns the result of a finished job to the waiting thread.  Jobs of a
+ * FetchMany() batch are collected in the batch and the submitting thread is
+ * only signaled through the condition variable, which is cheap if it is not
+ * waiting because it is still busy with previously finished jobs.
+ */
+void DownloadManager::NotifyJobDone(JobInfo *info) {
+  JobBatch *batch = info->batch;
+  if (batch == NULL) {
+    info->completion.Fire();
+    return;
+  }
+  pthread_mutex_lock(&batch->lock);
+  batch->done.push_back(info);
+  pthread_cond_signal(&batch->cond_done);
+  pthread_mutex_unlock(&batch->lock);
+}
+
+
+/**
+ * Verifies a finished transfer and either restarts it or returns the easy
+ * handle into the pool and the result to the waiting thread.  Returns true if
+ * curl needs to be kicked because handles were added.
+ */
+bool DownloadManager::FinalizeTransfer(const int curl_error, JobInfo *info) {
+  CURL *easy_handle = info->curl_handle;
+  // Failures of the data workers look like failures of the data callback
+  const int result =
+    atomic_read32(&info->data_failed) ? CURLE_WRITE_ERROR : curl_error;
+  if (VerifyAndFinalize(result, info)) {
+    ScheduleHedge(info);
+    curl_multi_add_handle(curl_multi_, easy_handle);
+    return true;
+  }
+
+  ReleaseCurlHandle(easy_handle);
+  NotifyJobDone(info);
+  if (num_queued_jobs_ > 0) {
+    StartQueuedJobs();
+    return true;
+  }
+  return false;
+}
+
+
 /**
  * Worker thread event loop.  Waits on new JobInfo structs on a pipe.
  */
@@ -460,15 +1135,18 @@ void *DownloadManager::MainDownload(void *data) {
   DownloadManager *download_mgr = static_cast<DownloadManager *>(data);
 
   download_mgr->watch_fds_ =
-    static_cast<struct pollfd *>(smalloc(2 * sizeof(struct pollfd)));
-  download_mgr->watch_fds_size_ = 2;
+    static_cast<struct pollfd *>(smalloc(3 * sizeof(struct pollfd)));
+  download_mgr->watch_fds_size_ = 3;
   download_mgr->watch_fds_[0].fd = download_mgr->pipe_terminate_[0];
   download_mgr->watch_fds_[0].events = POLLIN | POLLPRI;
   download_mgr->watch_fds_[0].revents = 0;
   download_mgr->watch_fds_[1].fd = download_mgr->pipe_jobs_[0];
   download_mgr->watch_fds_[1].events = POLLIN | POLLPRI;
   download_mgr->watch_fds_[1].revents = 0;
-  download_mgr->watch_fds_inuse_ = 2;
+  download_mgr->watch_fds_[2].fd = download_mgr->pipe_data_done_[0];
+  download_mgr->watch_fds_[2].events = POLLIN | POLLPRI;
+  download_mgr->watch_fds_[2].revents = 0;
+  download_mgr->watch_fds_inuse_ = 3;
 
   int still_running = 0;
   struct timeval timeval_start, timeval_stop;
@@ -518,18 +1196,39 @@ void *DownloadManager::MainDownload(void *data) {
       ReadPipe(download_mgr->pipe_jobs_[0], &info, sizeof(info));
       if (!still_running)
         gettimeofday(&timeval_start, NULL);
-      CURL *handle = download_mgr->AcquireCurlHandle();
-      download_mgr->InitializeRequest(info, handle);
-      download_mgr->SetUrlOptions(info);
-      curl_multi_add_handle(download_mgr->curl_multi_, handle);
+      if (info->batch != NULL) {
+        for (unsigned i = 0; i < info->batch->jobs.size(); ++i)
+          download_mgr->QueueJob(info->batch->jobs[i]);
+        download_mgr->StartQueuedJobs();
+      } else if (download_mgr->opt_fair_share_ ||
+                 download_mgr->opt_priorities_)
+      {
+        download_mgr->QueueJob(info);
+        download_mgr->StartQueuedJobs();
+      } else {
+        download_mgr->StartJob(info);
+      }
       retval = curl_multi_socket_action(download_mgr->curl_multi_,
                                         CURL_SOCKET_TIMEOUT,
                                         0,
                                         &still_running);
     }
 
+    // Data workers processed the remaining data of a finished transfer
+    if (download_mgr->watch_fds_[2].revents) {
+      download_mgr->watch_fds_[2].revents = 0;
+      JobInfo *info;
+      ReadPipe(download_mgr->pipe_data_done_[0], &info, sizeof(info));
+      if (download_mgr->FinalizeTransfer(info->curl_result, info)) {
+        retval = curl_multi_socket_action(download_mgr->curl_multi_,
+                                          CURL_SOCKET_TIMEOUT,
+                                          0,
+                                          &still_running);
+      }
+    }
+
     // Activity on curl sockets
-    for (unsigned i = 2; i < download_mgr->watch_fds_inuse_; ++i) {
+    for (unsigned i = 3; i < download_mgr->watch_fds_inuse_; ++i) {
       if (download_mgr->watch_fds_[i].revents) {
         int ev_bitmask = 0;
         if (download_mgr->watch_fds_[i].revents & (POLLIN | POLLPRI))
@@ -550,6 +1249,9 @@ void *DownloadManager::MainDownload(void *data) {
       }
     }
 
+    if (!download_mgr->hedges_.empty())
+      download_mgr->ReapHedges();
+
     // Check if transfers are completed
     CURLMsg *curl_msg;
     int msgs_in_queue;
@@ -564,23 +1266,43 @@ void *DownloadManager::MainDownload(void *data) {
         curl_easy_getinfo(easy_handle, CURLINFO_PRIVATE, &info);
 
         curl_multi_remove_handle(download_mgr->curl_multi_, easy_handle);
-        if (download_mgr->VerifyAndFinalize(curl_error, info)) {
-          curl_multi_add_handle(download_mgr->curl_multi_, easy_handle);
+        if (!download_mgr->hedges_.empty() &&
+            !download_mgr->CompleteHedge(info))
+        {
+          continue;
+        }
+        if (info->data_workers != NULL) {
+          info->curl_result = curl_error;
+          if (!info->data_workers->Finish(info))
+            continue;
+        }
+        if (download_mgr->FinalizeTransfer(curl_error, info)) {
           retval = curl_multi_socket_action(download_mgr->curl_multi_,
                                             CURL_SOCKET_TIMEOUT,
                                             0,
                                             &still_running);
-        } else {
-          // Return easy handle into pool and write result back
-          download_mgr->ReleaseCurlHandle(easy_handle);
-
-          WritePipe(info->wait_at[1], &info->error_code,
-                    sizeof(info->error_code));
         }
       }
     }
+
+    // Duplicate transfers that wait too long for a response
+    if (still_running && (download_mgr->opt_hedge_max_per_second_ > 0) &&
+        (download_mgr->StartHedges() > 0))
+    {
+      retval = curl_multi_socket_action(download_mgr->curl_multi_,
+                                        CURL_SOCKET_TIMEOUT,
+                                        0,
+                                        &still_running);
+    }
   }
 
+  for (unsigned i = 0; i < download_mgr->hedges_.size(); ++i) {
+    JobInfo *hedge = download_mgr->hedges_[i];
+    download_mgr->header_lists_->PutList(hedge->headers);
+    free(hedge->destination_mem.data);
+    delete hedge;
+  }
+  download_mgr->hedges_.clear();
   for (set<CURL *>::iterator i = download_mgr->pool_handles_inuse_->begin(),
        iEnd = download_mgr->pool_handles_inuse_->end(); i != iEnd; ++i)
   {
@@ -598,6 +1320,11 @@ void *DownloadManager::MainDownload(void *data) {
 //------------------------------------------------------------------------------
 
 
+HeaderLists::HeaderLists() {
+  atomic_init64(&bytes_allocated_);
+}
+
+
 HeaderLists::~HeaderLists() {
   for (unsigned i = 0; i < blocks_.size(); ++i) {
     delete[] blocks_[i];
@@ -711,12 +1438,53 @@ void HeaderLists::AddBlock() {
     Put(&new_block[i]);
   }
   blocks_.push_back(new_block);
+  atomic_xadd64(&bytes_allocated_, kBlockSize * sizeof(curl_slist));
 }
 
 
 //------------------------------------------------------------------------------
 
 
+void DownloadManager::EndpointScore::Add(
+  const double sample_latency_ms,
+  const double sample_throughput)
+{
+  if (num_samples == 0)
+    latency_ms = sample_latency_ms;
+  else
+    latency_ms += kScoreWeight * (sample_latency_ms - latency_ms);
+  if (sample_throughput > 0.0) {
+    if (throughput == 0.0)
+      throughput = sample_throughput;
+    else
+      throughput += kScoreWeight * (sample_throughput - throughput);
+  }
+  num_samples++;
+}
+
+
+/**
+ * In milliseconds.  Without a known throughput, only the latency counts.
+ */
+double DownloadManager::EndpointScore::Cost() const {
+  double cost = latency_ms;
+  if (throughput > 0.0)
+    cost += 1000.0 * kReferenceBytes / throughput;
+  return cost;
+}
+
+
+string DownloadManager::EndpointScore::Print() const {
+  if (num_samples == 0)
+    return "unscored";
+  string result = StringifyInt(static_cast<int64_t>(latency_ms)) + " ms";
+  if (throughput > 0.0)
+    result += ", " + StringifyInt(static_cast<int64_t>(throughput / 1024)) +
+              " kB/s";
+  return result;
+}
+
+
 string DownloadManager::ProxyInfo::Print() {
   if (url == "DIRECT")
     return url;
@@ -737,10 +1505,33 @@ string DownloadManager::ProxyInfo::Print() {
   } else {
     result += " (:unresolved:, " + expinfo + ")";
   }
+  if (score.num_samples > 0)
+    result += " [" + score.Print() + "]";
   return result;
 }
 
 
+void DownloadManager::CallbackCurlShareLock(
+  CURL * /* handle */,
+  curl_lock_data /* data */,
+  curl_lock_access /* access */,
+  void *userptr)
+{
+  DownloadManager *download_mgr = static_cast<DownloadManager *>(userptr);
+  pthread_mutex_lock(download_mgr->lock_curl_share_);
+}
+
+
+void DownloadManager::CallbackCurlShareUnlock(
+  CURL * /* handle */,
+  curl_lock_data /* data */,
+  void *userptr)
+{
+  DownloadManager *download_mgr = static_cast<DownloadManager *>(userptr);
+  pthread_mutex_unlock(download_mgr->lock_curl_share_);
+}
+
+
 /**
  * Gets an idle CURL handle from the pool. Creates a new one and adds it to
  * the pool if necessary.
@@ -757,6 +1548,7 @@ CURL *DownloadManager::AcquireCurlHandle() {
     // curl_easy_setopt(curl_default, CURLOPT_FAILONERROR, 1);
     curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, CallbackCurlHeader);
     curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, CallbackCurlData);
+    curl_easy_setopt(handle, CURLOPT_SHARE, curl_share_);
   } else {
     handle = *(pool_handles_idle_->begin());
     pool_handles_idle_->erase(pool_handles_idle_->begin());
@@ -786,6 +1578,7 @@ void DownloadManager::ReleaseCurlHandle(CURL *handle) {
  * proxy.
  */
 void DownloadManager::InitializeRequest(JobInfo *info, CURL *handle) {
+  CVMFS_PROBE1(download_start, info->url->c_str());
   // Initialize internal download state
   info->curl_handle = handle;
   info->error_code = kFailOk;
@@ -804,13 +1597,21 @@ void DownloadManager::InitializeRequest(JobInfo *info, CURL *handle) {
   } else {
     info->nocache = false;
   }
-  if (info->compressed) {
-    zlib::DecompressInit(&(info->zstream));
-  }
   if (info->expected_hash) {
     assert(info->hash_context.buffer != NULL);
     shash::Init(info->hash_context);
   }
+  info->data_workers = NULL;
+  if ((data_workers_ != NULL) &&
+      ((info->destination == kDestinationFile) ||
+       (info->destination == kDestinationPath) ||
+       (info->destination == kDestinationSink)) &&
+      (info->compressed || info->expected_hash))
+  {
+    info->data_workers = data_workers_;
+  }
+  atomic_init32(&info->data_pending);
+  atomic_init32(&info->data_failed);
 
   if ((info->range_offset != -1) && (info->range_size)) {
     char byte_range_array[100];
@@ -828,6 +1629,16 @@ void DownloadManager::InitializeRequest(JobInfo *info, CURL *handle) {
     curl_easy_setopt(handle, CURLOPT_RANGE, NULL);
   }
 
+  info->last_modified = -1;
+  curl_easy_setopt(handle, CURLOPT_FILETIME, 1);
+  if (info->if_modified_since > 0) {
+    curl_easy_setopt(handle, CURLOPT_TIMECONDITION, CURL_TIMECOND_IFMODSINCE);
+    curl_easy_setopt(handle, CURLOPT_TIMEVALUE,
+                     static_cast<long>(info->if_modified_since));  // NOLINT
+  } else {
+    curl_easy_setopt(handle, CURLOPT_TIMECONDITION, CURL_TIMECOND_NONE);
+  }
+
   // Set curl parameters
   curl_easy_setopt(handle, CURLOPT_PRIVATE, static_cast<void *>(info));
   curl_easy_setopt(handle, CURLOPT_WRITEHEADER,
@@ -844,6 +1655,15 @@ void DownloadManager::InitializeRequest(JobInfo *info, CURL *handle) {
     curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1);
     curl_easy_setopt(handle, CURLOPT_MAXREDIRS, 4);
   }
+#ifdef CURLPIPE_MULTIPLEX
+  if (opt_http2_) {
+    // Falls back to HTTP/1.1 if the server or the proxy can't do HTTP/2.
+    // New requests rather wait for an existing connection to turn out to be
+    // multiplexing than opening another connection.
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_0);
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+  }
+#endif
 }
 
 
@@ -859,9 +1679,10 @@ void DownloadManager::SetUrlOptions(JobInfo *info) {
   // Check if proxy group needs to be reset from backup to primary
   if (opt_timestamp_backup_proxies_ > 0) {
     const time_t now = time(NULL);
-    if (static_cast<int64_t>(now) >
-        static_cast<int64_t>(opt_timestamp_backup_proxies_ +
-                             opt_proxy_groups_reset_after_))
+    if ((static_cast<int64_t>(now) >
+         static_cast<int64_t>(opt_timestamp_backup_proxies_ +
+                              opt_proxy_groups_reset_after_)) &&
+        (!opt_proxy_groups_ || breakers_.Allow((*opt_proxy_groups_)[0][0].url)))
     {
       string old_proxy;
       if (opt_proxy_groups_)
@@ -899,9 +1720,10 @@ void DownloadManager::SetUrlOptions(JobInfo *info) {
   // Check if host needs to be reset
   if (opt_timestamp_backup_host_ > 0) {
     const time_t now = time(NULL);
-    if (static_cast<int64_t>(now) >
-        static_cast<int64_t>(opt_timestamp_backup_host_ +
-                             opt_host_reset_after_))
+    if ((static_cast<int64_t>(now) >
+         static_cast<int64_t>(opt_timestamp_backup_host_ +
+                              opt_host_reset_after_)) &&
+        breakers_.Allow(dns::ExtractHost((*opt_host_chain_)[0])))
     {
       LogCvmfs(kLogDownload, kLogDebug | kLogSyslogWarn,
                "switching host from %s to %s (reset host)",
@@ -922,6 +1744,25 @@ void DownloadManager::SetUrlOptions(JobInfo *info) {
     ValidateProxyIpsUnlocked(proxy.url, proxy.host);
     ProxyInfo *proxy_ptr =
       &((*opt_proxy_groups_)[opt_proxy_groups_current_][0]);
+    if (opt_adaptive_proxies_ &&
+        ((++opt_num_steered_requests_ % kExploreInterval) == 0))
+    {
+      // Sample another proxy of the group so that its score stays current
+      vector<ProxyInfo> *group =
+        &((*opt_proxy_groups_)[opt_proxy_groups_current_]);
+      const unsigned num_candidates =
+        group->size() + 1 - std::max(opt_proxy_groups_current_burned_, 1U);
+      if (num_candidates > 1) {
+        ProxyInfo *other = &((*group)[1 + prng_.Next(num_candidates - 1)]);
+        if ((other->url != "DIRECT") &&
+            (other->host.status() == dns::kFailOk) &&
+            !other->host.IsExpired() &&
+            !breakers_.IsOpen(other->url))
+        {
+          proxy_ptr = other;
+        }
+      }
+    }
     info->proxy = proxy_ptr->url;
     if (proxy_ptr->host.status() == dns::kFailOk) {
       curl_easy_setopt(info->curl_handle, CURLOPT_PROXY, info->proxy.c_str());
@@ -946,11 +1787,28 @@ void DownloadManager::SetUrlOptions(JobInfo *info) {
 
   string url = url_prefix + *(info->url);
 
+  if ((opt_ip_preference_ == dns::kIpPreferRace) && !opt_ipv4_only_) {
+    const string endpoint =
+      (info->proxy == "DIRECT") ? dns::ExtractHost(url) : info->proxy;
+    curl_easy_setopt(curl_handle, CURLOPT_IPRESOLVE,
+                     IsIpv4PinnedUnlocked(endpoint) ? CURL_IPRESOLVE_V4 :
+                                                      CURL_IPRESOLVE_WHATEVER);
+#if LIBCURL_VERSION_NUM >= 0x073b00
+    curl_easy_setopt(curl_handle, CURLOPT_HAPPY_EYEBALLS_TIMEOUT_MS,
+                     static_cast<long>(kRaceDelayMs));  // NOLINT(runtime/int)
+#endif
+  }
+
   curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 1L);
   if (url.substr(0, 5) == "https") {
     const char *cadir = getenv("X509_CERT_DIR");
     if (!cadir || !*cadir) {cadir = "/etc/grid-security/certificates";}
     curl_easy_setopt(curl_handle, CURLOPT_CAPATH, cadir);
+    // Undo the settings of a previous transfer with client credentials
+    curl_easy_setopt(curl_handle, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+    curl_easy_setopt(curl_handle, CURLOPT_FRESH_CONNECT, 0L);
+    curl_easy_setopt(curl_handle, CURLOPT_FORBID_REUSE, 0L);
+    curl_easy_setopt(curl_handle, CURLOPT_SSL_CTX_DATA, NULL);
     if (info->pid != -1) {
       if (credentials_attachment_ == NULL) {
         LogCvmfs(kLogDownload, kLogDebug,
@@ -1013,6 +1871,33 @@ void DownloadManager::SetUrlOptions(JobInfo *info) {
 }
 
 
+/**
+ * Adds one proxy per IP address of the preferred family.  With connection
+ * racing, a dual-stack proxy keeps its name, so that curl connects to IPv6 and
+ * IPv4 addresses in parallel.
+ */
+void DownloadManager::AppendProxyInfos(
+  const dns::Host &host,
+  const string &url,
+  vector<ProxyInfo> *infos)
+{
+  if ((opt_ip_preference_ == dns::kIpPreferRace) && !opt_ipv4_only_ &&
+      host.HasIpv4() && host.HasIpv6())
+  {
+    infos->push_back(ProxyInfo(host, url));
+    return;
+  }
+  // IPv4 addresses have precedence
+  const set<string> &best_addresses =
+    host.ViewBestAddresses(opt_ip_preference_);
+  set<string>::const_iterator iter_ips = best_addresses.begin();
+  for (; iter_ips != best_addresses.end(); ++iter_ips) {
+    string url_ip = dns::RewriteUrl(url, *iter_ips);
+    infos->push_back(ProxyInfo(host, url_ip));
+  }
+}
+
+
 /**
  * Checks if the name resolving information is still up to date.  The host
  * object should be one from the current load-balance group.  If the information
@@ -1067,12 +1952,7 @@ void DownloadManager::ValidateProxyIpsUnlocked(
     }
   }
   vector<ProxyInfo> new_infos;
-  set<string> best_addresses = new_host.ViewBestAddresses(opt_ip_preference_);
-  set<string>::const_iterator iter_ips = best_addresses.begin();
-  for (; iter_ips != best_addresses.end(); ++iter_ips) {
-    string url_ip = dns::RewriteUrl(url, *iter_ips);
-    new_infos.push_back(ProxyInfo(new_host, url_ip));
-  }
+  AppendProxyInfos(new_host, url, &new_infos);
   group->insert(group->end(), new_infos.begin(), new_infos.end());
   opt_num_proxies_ += new_infos.size();
 
@@ -1081,10 +1961,11 @@ void DownloadManager::ValidateProxyIpsUnlocked(
 
 
 /**
- * Adds transfer time and downloaded bytes to the global counters.
+ * Adds transfer time and downloaded bytes to the global counters and to the
+ * counters of the used HTTP protocol version.
  */
 void DownloadManager::UpdateStatistics(CURL *handle) {
-  double val;
+  double val = 0.0;
   int retval;
   int64_t sum = 0;
 
@@ -1095,6 +1976,229 @@ void DownloadManager::UpdateStatistics(CURL *handle) {
   assert(retval == CURLE_OK);
   sum += static_cast<int64_t>(val);*/
   perf::Xadd(counters_->sz_transferred_bytes, sum);
+
+  if (curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &val) != CURLE_OK)
+    val = 0.0;
+  counters_->lat_transfer->Add(static_cast<uint64_t>(val * 1000 * 1000));
+  const int64_t request_time_ms = static_cast<int64_t>(val * 1000);
+
+  long http_version = 0;  // NOLINT(runtime/int) curl API
+#if LIBCURL_VERSION_NUM >= 0x073200
+  if (curl_easy_getinfo(handle, CURLINFO_HTTP_VERSION, &http_version) !=
+      CURLE_OK)
+  {
+    http_version = 0;
+  }
+#endif
+  // No HTTP transfer, e.g. file:// or a failed connection
+  if (http_version == 0)
+    return;
+  if (http_version == CURL_HTTP_VERSION_2_0) {
+    perf::Inc(counters_->n_requests_http2);
+    perf::Xadd(counters_->sz_transferred_bytes_http2, sum);
+    perf::Xadd(counters_->sz_request_time_http2, request_time_ms);
+  } else {
+    perf::Inc(counters_->n_requests_http1);
+    perf::Xadd(counters_->sz_transferred_bytes_http1, sum);
+    perf::Xadd(counters_->sz_request_time_http1, request_time_ms);
+  }
+}
+
+
+/**
+ * Counts new connections and the time to establish them.  With connection
+ * racing, remembers the endpoints that were reached by IPv4.
+ */
+void DownloadManager::UpdateConnectionStatistics(JobInfo *info) {
+  long num_connects = 0;  // NOLINT(runtime/int) curl API
+  char *primary_ip = NULL;
+  if ((curl_easy_getinfo(info->curl_handle, CURLINFO_NUM_CONNECTS,
+                         &num_connects) != CURLE_OK) ||
+      (num_connects == 0) ||
+      (curl_easy_getinfo(info->curl_handle, CURLINFO_PRIMARY_IP,
+                         &primary_ip) != CURLE_OK) ||
+      (primary_ip == NULL) || (primary_ip[0] == '\0'))
+  {
+    return;
+  }
+  perf::Inc(counters_->n_connects);
+  double val = 0.0;
+  if (curl_easy_getinfo(info->curl_handle, CURLINFO_CONNECT_TIME, &val) ==
+      CURLE_OK)
+  {
+    perf::Xadd(counters_->sz_connect_time, static_cast<int64_t>(val * 1000));
+  }
+  double appconnect_time;
+  if ((curl_easy_getinfo(info->curl_handle, CURLINFO_APPCONNECT_TIME,
+                         &appconnect_time) == CURLE_OK) &&
+      (appconnect_time > 0.0))
+  {
+    perf::Inc(counters_->n_tls_handshakes);
+    perf::Xadd(counters_->sz_tls_handshake_time,
+               static_cast<int64_t>((appconnect_time - val) * 1000));
+  }
+  const bool is_ipv6 = (strchr(primary_ip, ':') != NULL);
+  if (is_ipv6)
+    perf::Inc(counters_->n_connects_ipv6);
+
+  if (opt_ip_preference_ != dns::kIpPreferRace)
+    return;
+  string endpoint = info->proxy;
+  if (endpoint == "DIRECT") {
+    char *effective_url = NULL;
+    curl_easy_getinfo(info->curl_handle, CURLINFO_EFFECTIVE_URL,
+                      &effective_url);
+    if (effective_url == NULL)
+      return;
+    endpoint = dns::ExtractHost(effective_url);
+  }
+  pthread_mutex_lock(lock_options_);
+  if (is_ipv6) {
+    ipv4_pinned_.erase(endpoint);
+  } else if (ipv4_pinned_.find(endpoint) == ipv4_pinned_.end()) {
+    LogCvmfs(kLogDownload, kLogDebug, "%s reached by IPv4, skipping IPv6 for "
+             "%u seconds", endpoint.c_str(), kIpv4PinTtl);
+    ipv4_pinned_[endpoint] = time(NULL) + kIpv4PinTtl;
+    perf::Inc(counters_->n_ipv4_pinned);
+  }
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+/**
+ * Returns true if the endpoint recently won a connection race over IPv4.
+ * Expired entries are removed, so that the endpoint is raced again.
+ */
+bool DownloadManager::IsIpv4PinnedUnlocked(const string &endpoint) {
+  map<string, time_t>::iterator iter = ipv4_pinned_.find(endpoint);
+  if (iter == ipv4_pinned_.end())
+    return false;
+  if (iter->second < time(NULL)) {
+    ipv4_pinned_.erase(iter);
+    return false;
+  }
+  return true;
+}
+
+
+/**
+ * Adds a successful transfer to the scores of its proxy and its host.
+ */
+void DownloadManager::UpdateScores(JobInfo *info) {
+  double val = 0.0;
+  if (curl_easy_getinfo(info->curl_handle, CURLINFO_STARTTRANSFER_TIME, &val)
+      != CURLE_OK)
+  {
+    return;
+  }
+  const double latency_ms = val * 1000.0;
+  double throughput = 0.0;
+  if ((curl_easy_getinfo(info->curl_handle, CURLINFO_SIZE_DOWNLOAD, &val) ==
+       CURLE_OK) && (val >= EndpointScore::kMinThroughputBytes) &&
+      (curl_easy_getinfo(info->curl_handle, CURLINFO_SPEED_DOWNLOAD, &val) ==
+       CURLE_OK))
+  {
+    throughput = val;
+  }
+  char *effective_url = NULL;
+  curl_easy_getinfo(info->curl_handle, CURLINFO_EFFECTIVE_URL, &effective_url);
+
+  pthread_mutex_lock(lock_options_);
+  if (info->proxy != "DIRECT")
+    opt_proxy_scores_[info->proxy].Add(latency_ms, throughput);
+  if (info->probe_hosts && opt_host_chain_ && effective_url) {
+    for (unsigned i = 0; i < opt_host_chain_->size(); ++i) {
+      if (HasPrefix(string(effective_url) + "/",
+                    (*opt_host_chain_)[i] + "/", true))
+      {
+        opt_host_scores_[(*opt_host_chain_)[i]].Add(latency_ms, throughput);
+        break;
+      }
+    }
+  }
+  if (opt_adaptive_proxies_ && (info->proxy != "DIRECT"))
+    SteerProxyUnlocked();
+  if (opt_hedge_max_per_second_ > 0)
+    UpdateHedgeDelayUnlocked(latency_ms);
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+/**
+ * Records the response time of a transfer and determines the time after which
+ * jobs get hedged.
+ */
+void DownloadManager::UpdateHedgeDelayUnlocked(const double latency_ms) {
+  hedge_latencies_ms_[hedge_num_latencies_ % kHedgeSamples] = latency_ms;
+  hedge_num_latencies_++;
+  if ((hedge_num_latencies_ < kHedgeSamples) ||
+      (hedge_num_latencies_ % kHedgeUpdateInterval != 0))
+  {
+    return;
+  }
+
+  vector<double> latencies(hedge_latencies_ms_);
+  vector<double>::iterator percentile =
+    latencies.begin() + (kHedgeSamples * kHedgePercentile) / 100;
+  std::nth_element(latencies.begin(), percentile, latencies.end());
+  atomic_write32(&hedge_delay_ms_, static_cast<int32_t>(*percentile) + 1);
+}
+
+
+/**
+ * Moves the fastest proxy of the current load-balancing group to the front if
+ * the active proxy is considerably slower.  Only proxies that did not fail
+ * and that have enough samples are considered.  If not all of them have a
+ * known throughput, they are compared by latency.
+ */
+void DownloadManager::SteerProxyUnlocked() {
+  if (!opt_proxy_groups_)
+    return;
+  vector<ProxyInfo> *group = &((*opt_proxy_groups_)[opt_proxy_groups_current_]);
+  const unsigned num_candidates =
+    group->size() + 1 - std::max(opt_proxy_groups_current_burned_, 1U);
+  if (num_candidates < 2)
+    return;
+
+  vector<EndpointScore> scores(num_candidates);
+  bool with_throughput = true;
+  for (unsigned i = 0; i < num_candidates; ++i) {
+    map<string, EndpointScore>::const_iterator iter =
+      opt_proxy_scores_.find((*group)[i].url);
+    if ((iter == opt_proxy_scores_.end()) ||
+        (iter->second.num_samples < kMinScoreSamples))
+    {
+      continue;
+    }
+    scores[i] = iter->second;
+    with_throughput = with_throughput && (scores[i].throughput > 0.0);
+  }
+  if (scores[0].num_samples == 0)
+    return;
+  if (!with_throughput) {
+    for (unsigned i = 0; i < num_candidates; ++i)
+      scores[i].throughput = 0.0;
+  }
+
+  unsigned best = 0;
+  for (unsigned i = 1; i < num_candidates; ++i) {
+    if ((scores[i].num_samples > 0) &&
+        (scores[i].Cost() < scores[best].Cost()))
+    {
+      best = i;
+    }
+  }
+  if (best == 0)
+    return;
+  if (scores[0].Cost() * 100.0 <= scores[best].Cost() * kSteerThresholdPercent)
+    return;
+
+  LogCvmfs(kLogDownload, kLogDebug | kLogSyslog,
+           "switching proxy from %s (%s) to %s (%s) for lower latency",
+           (*group)[0].url.c_str(), scores[0].Print().c_str(),
+           (*group)[best].url.c_str(), scores[best].Print().c_str());
+  swap((*group)[0], (*group)[best]);
+  perf::Inc(counters_->n_proxy_steered);
 }
 
 
@@ -1175,6 +2279,10 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
            "Verify downloaded url %s, proxy %s (curl error %d)",
            info->url->c_str(), info->proxy.c_str(), curl_error);
   UpdateStatistics(info->curl_handle);
+  UpdateConnectionStatistics(info);
+  UpdateTiming(info);
+  if (curl_error == CURLE_OK)
+    UpdateScores(info);
 
   if (info->cred_data) {
     assert(credentials_attachment_ != NULL);  // Someone must have set it
@@ -1184,8 +2292,26 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
   }
 
   // Verification and error classification
+  long condition_unmet = 0;  // NOLINT
+  long filetime = -1;  // NOLINT
   switch (curl_error) {
     case CURLE_OK:
+      if (info->if_modified_since > 0) {
+        curl_easy_getinfo(info->curl_handle, CURLINFO_CONDITION_UNMET,
+                          &condition_unmet);
+        if (condition_unmet) {
+          LogCvmfs(kLogDownload, kLogDebug, "%s not modified",
+                   info->url->c_str());
+          info->error_code = kFailNotModified;
+          break;
+        }
+      }
+      if ((curl_easy_getinfo(info->curl_handle, CURLINFO_FILETIME,
+                             &filetime) == CURLE_OK) && (filetime >= 0))
+      {
+        info->last_modified = filetime;
+      }
+
       // Verify content hash
       if (info->expected_hash) {
         shash::Any match_hash;
@@ -1200,11 +2326,32 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
         }
       }
 
-      // Decompress memory in a single run
+      // Decrypt and decompress memory in a single run
+      if ((info->destination == kDestinationMem) &&
+          (info->decryptor != NULL))
+      {
+        const unsigned char *plaintext;
+        size_t plaintext_size;
+        if (info->decryptor->Update(info->destination_mem.data,
+                                    info->destination_mem.pos,
+                                    &plaintext, &plaintext_size))
+        {
+          memcpy(info->destination_mem.data, plaintext, plaintext_size);
+          info->destination_mem.pos = info->destination_mem.size =
+            plaintext_size;
+        } else {
+          LogCvmfs(kLogDownload, kLogDebug,
+                   "decryption (memory) of url %s failed",
+                   info->url->c_str());
+          info->error_code = kFailBadData;
+          break;
+        }
+      }
       if ((info->destination == kDestinationMem) && info->compressed) {
         void *buf;
         uint64_t size;
-        bool retval = zlib::DecompressMem2Mem(info->destination_mem.data,
+        bool retval = zlib::DecompressMem2Mem(info->compression_alg,
+                                              info->destination_mem.data,
                                               info->destination_mem.pos,
                                               &buf, &size);
         if (retval) {
@@ -1271,6 +2418,7 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
       info->error_code = kFailOther;
       break;
   }
+  ReportEndpointHealth(info);
 
   std::vector<std::string> *host_chain = opt_host_chain_;
 
@@ -1376,8 +2524,11 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
     }
     if (info->expected_hash)
       shash::Init(info->hash_context);
-    if (info->compressed)
-      zlib::DecompressInit(&info->zstream);
+    if (info->decompressor != NULL)
+      info->decompressor->Reset();
+    if (info->decryptor != NULL)
+      info->decryptor->Reset();
+    atomic_init32(&info->data_failed);
     SetRegularCache(info);
 
     // Failure handling
@@ -1423,6 +2574,7 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
       SetUrlOptions(info);
     }
 
+    CVMFS_PROBE2(download_retry, info->url->c_str(), int(info->error_code));
     return true;  // try again
   }
 
@@ -1438,14 +2590,17 @@ bool DownloadManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
     info->destination_file = NULL;
   }
 
-  if (info->compressed)
-    zlib::DecompressFini(&info->zstream);
+  delete info->decompressor;
+  info->decompressor = NULL;
+  delete info->decryptor;
+  info->decryptor = NULL;
 
   if (info->headers) {
     header_lists_->PutList(info->headers);
     info->headers = NULL;
   }
 
+  CVMFS_PROBE2(download_finish, info->url->c_str(), int(info->error_code));
   return false;  // stop transfer and return to Fetch()
 }
 
@@ -1461,7 +2616,13 @@ DownloadManager::DownloadManager() {
   pipe_terminate_[0] = pipe_terminate_[1] = -1;
 
   pipe_jobs_[0] = pipe_jobs_[1] = -1;
+  pipe_data_done_[0] = pipe_data_done_[1] = -1;
+  data_workers_ = NULL;
+  opt_data_workers_ = 0;
   watch_fds_ = NULL;
+  num_queued_jobs_ = 0;
+  for (unsigned i = 0; i < kNumPriorities; ++i)
+    queued_jobs_cursor_[i] = 0;
   watch_fds_size_ = 0;
   watch_fds_inuse_ = 0;
   watch_fds_max_ = 0;
@@ -1474,6 +2635,11 @@ DownloadManager::DownloadManager() {
   reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
   retval = pthread_mutex_init(lock_synchronous_mode_, NULL);
   assert(retval == 0);
+  curl_share_ = NULL;
+  lock_curl_share_ =
+  reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+  retval = pthread_mutex_init(lock_curl_share_, NULL);
+  assert(retval == 0);
 
   opt_dns_server_ = NULL;
   opt_ip_preference_ = dns::kIpPreferSystem;
@@ -1494,6 +2660,20 @@ DownloadManager::DownloadManager() {
   opt_ipv4_only_ = false;
   follow_redirects_ = false;
   use_system_proxy_ = false;
+  opt_http2_ = false;
+  opt_http2_max_host_connections_ = 0;
+  opt_adaptive_proxies_ = false;
+  opt_num_steered_requests_ = 0;
+  opt_fair_share_ = false;
+  opt_priorities_ = false;
+  opt_geo_cache_ttl_ = 0;
+  opt_stripe_streams_ = 0;
+  opt_stripe_min_size_ = 0;
+  opt_hedge_max_per_second_ = 0;
+  hedge_num_latencies_ = 0;
+  atomic_init32(&hedge_delay_ms_);
+  hedge_second_ = 0;
+  hedge_num_second_ = 0;
 
   resolver_ = NULL;
 
@@ -1512,8 +2692,10 @@ DownloadManager::DownloadManager() {
 DownloadManager::~DownloadManager() {
   pthread_mutex_destroy(lock_options_);
   pthread_mutex_destroy(lock_synchronous_mode_);
+  pthread_mutex_destroy(lock_curl_share_);
   free(lock_options_);
   free(lock_synchronous_mode_);
+  free(lock_curl_share_);
 }
 
 void DownloadManager::InitHeaders() {
@@ -1581,6 +2763,14 @@ void DownloadManager::Init(const unsigned max_pool_handles,
   curl_multi_setopt(curl_multi_, CURLMOPT_MAX_TOTAL_CONNECTIONS,
                     pool_max_handles_);
   // curl_multi_setopt(curl_multi_, CURLMOPT_PIPELINING, 1);
+  curl_share_ = curl_share_init();
+  assert(curl_share_ != NULL);
+  curl_share_setopt(curl_share_, CURLSHOPT_LOCKFUNC, CallbackCurlShareLock);
+  curl_share_setopt(curl_share_, CURLSHOPT_UNLOCKFUNC,
+                    CallbackCurlShareUnlock);
+  curl_share_setopt(curl_share_, CURLSHOPT_USERDATA,
+                    static_cast<void *>(this));
+  curl_share_setopt(curl_share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
 
   prng_.InitLocaltime();
 
@@ -1617,6 +2807,10 @@ void DownloadManager::Fini() {
     close(pipe_terminate_[0]);
     close(pipe_jobs_[1]);
     close(pipe_jobs_[0]);
+    delete data_workers_;
+    data_workers_ = NULL;
+    close(pipe_data_done_[1]);
+    close(pipe_data_done_[0]);
   }
 
   for (set<CURL *>::iterator i = pool_handles_idle_->begin(),
@@ -1627,45 +2821,306 @@ void DownloadManager::Fini() {
   delete pool_handles_idle_;
   delete pool_handles_inuse_;
   curl_multi_cleanup(curl_multi_);
+  curl_share_cleanup(curl_share_);
   pool_handles_idle_ = NULL;
   pool_handles_inuse_ = NULL;
   curl_multi_ = NULL;
+  curl_share_ = NULL;
 
   FiniHeaders();
   if (user_agent_)
     free(user_agent_);
   user_agent_ = NULL;
 
-  delete counters_;
-  counters_ = NULL;
+  delete counters_;
+  counters_ = NULL;
+
+  delete opt_host_chain_;
+  delete opt_host_chain_rtt_;
+  delete opt_proxy_groups_;
+  opt_host_chain_ = NULL;
+  opt_host_chain_rtt_ = NULL;
+  opt_proxy_groups_ = NULL;
+
+  curl_global_cleanup();
+
+  delete resolver_;
+  resolver_ = NULL;
+}
+
+
+/**
+ * Spawns the I/O worker thread and switches the module in multi-threaded mode.
+ * No way back except Fini(); Init();
+ */
+void DownloadManager::Spawn() {
+  MakePipe(pipe_terminate_);
+  MakePipe(pipe_jobs_);
+  MakePipe(pipe_data_done_);
+  if (opt_data_workers_ > 0)
+    data_workers_ = new DataWorkers(opt_data_workers_, pipe_data_done_[1]);
+
+  int retval = pthread_create(&thread_download_, NULL, MainDownload,
+                              static_cast<void *>(this));
+  assert(retval == 0);
+
+  atomic_inc32(&multi_threaded_);
+}
+
+
+/**
+ * Sets up the decompressor, the decryptor, and the destination of a job.  The hash context
+ * and the info header are allocated by the caller, Fetch() keeps them on its
+ * stack.
+ */
+Failures DownloadManager::PrepareJob(JobInfo *info) {
+  assert(info != NULL);
+  assert(info->url != NULL);
+
+  // Memory destinations are decompressed in one go after the download
+  info->decompressor = NULL;
+  if (info->compressed && (info->destination != kDestinationMem)) {
+    info->decompressor = zlib::Decompressor::Construct(info->compression_alg);
+    if (info->decompressor == NULL) {
+      LogCvmfs(kLogDownload, kLogDebug | kLogSyslogErr,
+               "%s: compression algorithm %s not supported",
+               info->url->c_str(),
+               zlib::AlgorithmName(info->compression_alg).c_str());
+      return kFailBadData;
+    }
+  }
+
+  info->decryptor = NULL;
+  if (info->decryption_key != NULL)
+    info->decryptor = new cipher::StreamDecryptor(info->decryption_key);
+
+  Failures result = PrepareDownloadDestination(info);
+  if (result != kFailOk) {
+    delete info->decompressor;
+    info->decompressor = NULL;
+    delete info->decryptor;
+    info->decryptor = NULL;
+    return result;
+  }
+
+  if (info->expected_hash) {
+    const shash::Algorithms algorithm = info->expected_hash->algorithm;
+    info->hash_context.algorithm = algorithm;
+    info->hash_context.size = shash::GetContextSize(algorithm);
+  }
+  info->info_header = NULL;
+  return kFailOk;
+}
+
+
+/**
+ * Size of the zero-terminated cvmfs-info: header of a job, 0 if the job does
+ * not send such a header.
+ */
+unsigned DownloadManager::GetInfoHeaderSize(const JobInfo *info) {
+  if (!enable_info_header_ || !info->extra_info)
+    return 0;
+  return 1 + strlen(kInfoHeaderName) +
+         EscapeHeader(*(info->extra_info), NULL, 0);
+}
+
+
+void DownloadManager::FormatInfoHeader(
+  JobInfo *info,
+  char *buffer,
+  const unsigned size)
+{
+  const size_t header_name_len = strlen(kInfoHeaderName);
+  memcpy(buffer, kInfoHeaderName, header_name_len);
+  EscapeHeader(*(info->extra_info), buffer + header_name_len,
+               size - header_name_len);
+  buffer[size - 1] = '\0';
+  info->info_header = buffer;
+}
+
+
+void DownloadManager::CleanupFailedJob(JobInfo *info) {
+  LogCvmfs(kLogDownload, kLogDebug, "download failed (error %d - %s)",
+           info->error_code, Code2Ascii(info->error_code));
+
+  if (info->destination == kDestinationPath)
+    unlink(info->destination_path->c_str());
+
+  if (info->destination_mem.data) {
+    free(info->destination_mem.data);
+    info->destination_mem.data = NULL;
+    info->destination_mem.size = 0;
+  }
+}
+
+
+/**
+ * Striping needs the size of the resource upfront.  Uncompressed jobs without
+ * a range carry the expected size in range_size.
+ */
+bool DownloadManager::IsStripable(const JobInfo *info) {
+  if ((opt_stripe_streams_ < 2) || (atomic_xadd32(&multi_threaded_, 0) != 1))
+    return false;
+  return !info->compressed && !info->head_request &&
+         (info->decryption_key == NULL) &&
+         (info->if_modified_since == 0) &&
+         (info->range_offset == -1) &&
+         (static_cast<uint64_t>(info->range_size) >= opt_stripe_min_size_) &&
+         ((info->destination == kDestinationFile) ||
+          (info->destination == kDestinationSink));
+}
+
 
-  delete opt_host_chain_;
-  delete opt_host_chain_rtt_;
-  delete opt_proxy_groups_;
-  opt_host_chain_ = NULL;
-  opt_host_chain_rtt_ = NULL;
-  opt_proxy_groups_ = NULL;
+namespace {
 
-  curl_global_cleanup();
+/**
+ * Receives one range of a striped download.  Fails if the server sends more
+ * than the requested range, e.g. because it ignores the Range header.
+ */
+class StripeSink : public cvmfs::Sink, SingleCopy {
+ public:
+  explicit StripeSink(const uint64_t size)
+    : data_(static_cast<unsigned char *>(smalloc(size))), size_(size), pos_(0)
+  { }
+  virtual ~StripeSink() { free(data_); }
+  virtual int64_t Write(const void *buf, uint64_t sz) {
+    if (pos_ + sz > size_)
+      return -ERANGE;
+    memcpy(data_ + pos_, buf, sz);
+    pos_ += sz;
+    return sz;
+  }
+  virtual int Reset() {
+    pos_ = 0;
+    return 0;
+  }
+  bool IsComplete() const { return pos_ == size_; }
+  const unsigned char *data() const { return data_; }
+  uint64_t size() const { return size_; }
 
-  delete resolver_;
-  resolver_ = NULL;
-}
+ private:
+  unsigned char *data_;
+  uint64_t size_;
+  uint64_t pos_;
+};
+
+}  // anonymous namespace
 
 
 /**
- * Spawns the I/O worker thread and switches the module in multi-threaded mode.
- * No way back except Fini(); Init();
+ * Fetches the ranges of info in windows of opt_stripe_streams_ parallel
+ * transfers and appends them to the destination of info.  The content hash is
+ * verified at the end.  Returns false if the download should be repeated as a
+ * single transfer, in which case the destination is reset.
  */
-void DownloadManager::Spawn() {
-  MakePipe(pipe_terminate_);
-  MakePipe(pipe_jobs_);
+bool DownloadManager::FetchStriped(JobInfo *info) {
+  const uint64_t size = info->range_size;
+  const uint64_t num_stripes = (size + kStripeSize - 1) / kStripeSize;
+  LogCvmfs(kLogDownload, kLogDebug, "striped download of %s (%" PRIu64 " "
+           "bytes in %" PRIu64 " ranges)", info->url->c_str(), size,
+           num_stripes);
+  perf::Inc(counters_->n_striped);
+
+  shash::ContextPtr hash_context;
+  if (info->expected_hash) {
+    hash_context = shash::ContextPtr(info->expected_hash->algorithm);
+    hash_context.buffer = alloca(hash_context.size);
+    shash::Init(hash_context);
+  }
 
-  int retval = pthread_create(&thread_download_, NULL, MainDownload,
-                              static_cast<void *>(this));
-  assert(retval == 0);
+  Failures result = kFailOk;
+  for (uint64_t i = 0; (i < num_stripes) && (result == kFailOk); ) {
+    const uint64_t num_window =
+      std::min(num_stripes - i, static_cast<uint64_t>(opt_stripe_streams_));
+    std::vector<StripeSink *> sinks;
+    std::vector<JobInfo *> jobs;
+    for (uint64_t j = i; j < i + num_window; ++j) {
+      const uint64_t offset = j * kStripeSize;
+      const uint64_t length =
+        std::min(static_cast<uint64_t>(kStripeSize), size - offset);
+      StripeSink *sink = new StripeSink(length);
+      JobInfo *job = new JobInfo(info->url, false, info->probe_hosts, sink,
+                                 NULL);
+      job->force_nocache = info->force_nocache;
+      job->follow_redirects = info->follow_redirects;
+      job->pid = info->pid;
+      job->uid = info->uid;
+      job->gid = info->gid;
+      job->cred_data = NULL;
+      job->extra_info = info->extra_info;
+      job->range_offset = offset;
+      job->range_size = length;
+      sinks.push_back(sink);
+      jobs.push_back(job);
+    }
 
-  atomic_inc32(&multi_threaded_);
+    FetchMany(jobs, NULL);
+    for (unsigned j = 0; j < jobs.size(); ++j) {
+      if (result != kFailOk)
+        break;
+      if (jobs[j]->error_code != kFailOk) {
+        result = jobs[j]->error_code;
+        break;
+      }
+      if (!sinks[j]->IsComplete()) {
+        result = kFailBadData;
+        break;
+      }
+      if (info->expected_hash)
+        shash::Update(sinks[j]->data(), sinks[j]->size(), hash_context);
+      if (info->destination == kDestinationSink) {
+        const int64_t written =
+          info->destination_sink->Write(sinks[j]->data(), sinks[j]->size());
+        if ((written < 0) || (static_cast<uint64_t>(written) !=
+                              sinks[j]->size()))
+        {
+          result = kFailLocalIO;
+        }
+      } else if (fwrite(sinks[j]->data(), 1, sinks[j]->size(),
+                        info->destination_file) != sinks[j]->size())
+      {
+        result = kFailLocalIO;
+      }
+    }
+    for (unsigned j = 0; j < jobs.size(); ++j) {
+      delete jobs[j];
+      delete sinks[j];
+    }
+    i += num_window;
+  }
+
+  if ((result == kFailOk) && info->expected_hash) {
+    shash::Any hash(info->expected_hash->algorithm);
+    shash::Final(hash_context, &hash);
+    if (hash != *info->expected_hash) {
+      LogCvmfs(kLogDownload, kLogDebug, "striped download of %s: hash "
+               "mismatch (%s instead of %s)", info->url->c_str(),
+               hash.ToString().c_str(), info->expected_hash->ToString().c_str());
+      result = kFailBadData;
+    }
+  }
+  if (result == kFailOk) {
+    info->error_code = kFailOk;
+    return true;
+  }
+
+  LogCvmfs(kLogDownload, kLogDebug, "striped download of %s failed (%s), "
+           "repeating as single transfer", info->url->c_str(),
+           Code2Ascii(result));
+  perf::Inc(counters_->n_striped_fallback);
+  bool reset;
+  if (info->destination == kDestinationSink) {
+    reset = (info->destination_sink->Reset() == 0);
+  } else {
+    reset = (fflush(info->destination_file) == 0) &&
+            (ftruncate(fileno(info->destination_file), 0) == 0);
+    rewind(info->destination_file);
+  }
+  if (!reset) {
+    info->error_code = kFailLocalIO;
+    return true;
+  }
+  return false;
 }
 
 
@@ -1673,47 +3128,32 @@ void DownloadManager::Spawn() {
  * Downloads data from an unsecure outside channel (currently HTTP or file).
  */
 Failures DownloadManager::Fetch(JobInfo *info) {
-  assert(info != NULL);
-  assert(info->url != NULL);
+  ResetTiming(info);
+  if (IsStripable(info)) {
+    if (FetchStriped(info))
+      return info->error_code;
+  }
 
-  Failures result;
-  result = PrepareDownloadDestination(info);
+  Failures result = PrepareJob(info);
   if (result != kFailOk)
     return result;
 
-  if (info->expected_hash) {
-    const shash::Algorithms algorithm = info->expected_hash->algorithm;
-    info->hash_context.algorithm = algorithm;
-    info->hash_context.size = shash::GetContextSize(algorithm);
+  // Hash context and cvmfs-info: header live on the stack
+  if (info->expected_hash)
     info->hash_context.buffer = alloca(info->hash_context.size);
-  }
-
-  // Prepare cvmfs-info: header, allocate string on the stack
-  info->info_header = NULL;
-  if (enable_info_header_ && info->extra_info) {
-    const char *header_name = "cvmfs-info: ";
-    const size_t header_name_len = strlen(header_name);
-    const unsigned header_size = 1 + header_name_len +
-      EscapeHeader(*(info->extra_info), NULL, 0);
-    info->info_header = static_cast<char *>(alloca(header_size));
-    memcpy(info->info_header, header_name, header_name_len);
-    EscapeHeader(*(info->extra_info), info->info_header + header_name_len,
-                 header_size - header_name_len);
-    info->info_header[header_size-1] = '\0';
+  const unsigned header_size = GetInfoHeaderSize(info);
+  if (header_size > 0) {
+    FormatInfoHeader(info, static_cast<char *>(alloca(header_size)),
+                     header_size);
   }
 
   if (atomic_xadd32(&multi_threaded_, 0) == 1) {
-    if (info->wait_at[0] == -1) {
-      MakePipe(info->wait_at);
-    }
-
-    // LogCvmfs(kLogDownload, kLogDebug, "send job to thread, pipe %d %d",
-    //          info->wait_at[0], info->wait_at[1]);
     WritePipe(pipe_jobs_[1], &info, sizeof(info));
-    ReadPipe(info->wait_at[0], &result, sizeof(result));
-    // LogCvmfs(kLogDownload, kLogDebug, "got result %d", result);
+    info->completion.Wait();
+    result = info->error_code;
   } else {
     pthread_mutex_lock(lock_synchronous_mode_);
+    info->timing.queue = platform_monotonic_time_ns() - info->submit_ns;
     CURL *handle = AcquireCurlHandle();
     InitializeRequest(info, handle);
     SetUrlOptions(info);
@@ -1731,21 +3171,102 @@ Failures DownloadManager::Fetch(JobInfo *info) {
     pthread_mutex_unlock(lock_synchronous_mode_);
   }
 
-  if (result != kFailOk) {
-    LogCvmfs(kLogDownload, kLogDebug, "download failed (error %d - %s)", result,
-             Code2Ascii(result));
+  if (result != kFailOk)
+    CleanupFailedJob(info);
+
+  return result;
+}
 
-    if (info->destination == kDestinationPath)
-      unlink(info->destination_path->c_str());
 
-    if (info->destination_mem.data) {
-      free(info->destination_mem.data);
-      info->destination_mem.data = NULL;
-      info->destination_mem.size = 0;
+/**
+ * Downloads a set of jobs concurrently.  In multi-threaded mode, the jobs are
+ * passed to the I/O thread with a single pipe write.  The I/O thread keeps at
+ * most as many of them in flight as there are pooled curl handles.  Instead of
+ * a pipe round trip per job, the calling thread waits on the batch and gets
+ * woken up for all the jobs that finished in the meantime.
+ *
+ * For every job, on_done (if not NULL) is called from the calling thread once
+ * the job is finished, successfully or not.  The result of the individual jobs
+ * is in their error_code.  Returns true if all the jobs succeeded.
+ */
+bool DownloadManager::FetchMany(
+  const std::vector<JobInfo *> &infos,
+  const CallbackBase<JobInfo *> *on_done)
+{
+  bool all_ok = true;
+  if (atomic_xadd32(&multi_threaded_, 0) != 1) {
+    for (unsigned i = 0; i < infos.size(); ++i) {
+      all_ok = (Fetch(infos[i]) == kFailOk) && all_ok;
+      if (on_done)
+        (*on_done)(infos[i]);
     }
+    return all_ok;
   }
 
-  return result;
+  JobBatch batch;
+  // Hash contexts and info headers; there might be too many for the stack
+  std::vector<void *> buffers;
+  for (unsigned i = 0; i < infos.size(); ++i) {
+    JobInfo *info = infos[i];
+    info->batch = NULL;
+    ResetTiming(info);
+    info->error_code = PrepareJob(info);
+    if (info->error_code != kFailOk) {
+      all_ok = false;
+      if (on_done)
+        (*on_done)(info);
+      continue;
+    }
+    if (info->expected_hash) {
+      info->hash_context.buffer = smalloc(info->hash_context.size);
+      buffers.push_back(info->hash_context.buffer);
+    }
+    const unsigned header_size = GetInfoHeaderSize(info);
+    if (header_size > 0) {
+      char *header = static_cast<char *>(smalloc(header_size));
+      buffers.push_back(header);
+      FormatInfoHeader(info, header, header_size);
+    }
+    info->batch = &batch;
+    batch.jobs.push_back(info);
+  }
+
+  if (!batch.jobs.empty()) {
+    // The I/O thread picks up the entire batch through its first job
+    JobInfo *head = batch.jobs[0];
+    WritePipe(pipe_jobs_[1], &head, sizeof(head));
+
+    std::vector<JobInfo *> done;
+    unsigned num_done = 0;
+    while (num_done < batch.jobs.size()) {
+      pthread_mutex_lock(&batch.lock);
+      while (batch.done.empty())
+        pthread_cond_wait(&batch.cond_done, &batch.lock);
+      done.swap(batch.done);
+      pthread_mutex_unlock(&batch.lock);
+
+      for (unsigned i = 0; i < done.size(); ++i) {
+        JobInfo *info = done[i];
+        info->batch = NULL;
+        if (info->error_code != kFailOk) {
+          all_ok = false;
+          CleanupFailedJob(info);
+        }
+        if (on_done)
+          (*on_done)(info);
+      }
+      num_done += done.size();
+      done.clear();
+    }
+  }
+
+  for (unsigned i = 0; i < buffers.size(); ++i)
+    free(buffers[i]);
+  for (unsigned i = 0; i < infos.size(); ++i) {
+    infos[i]->hash_context.buffer = NULL;
+    infos[i]->info_header = NULL;
+  }
+  return all_ok;
 }
 
 
@@ -1796,11 +3317,39 @@ void DownloadManager::SetDnsParameters(
     pthread_mutex_unlock(lock_options_);
     return;
   }
+  const string shared_cache_dir = resolver_->shared_cache_dir();
   delete resolver_;
   resolver_ = NULL;
   resolver_ =
     dns::NormalResolver::Create(opt_ipv4_only_, retries, timeout_ms);
   assert(resolver_);
+  resolver_->SetSharedCacheDir(shared_cache_dir);
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+/**
+ * Shares the resolved proxy and host names with the other processes that use
+ * cache_dir, e.g. the other mounted repositories on the node.
+ */
+void DownloadManager::EnableSharedDnsCache(const string &cache_dir) {
+  pthread_mutex_lock(lock_options_);
+  resolver_->SetSharedCacheDir(cache_dir);
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+/**
+ * Stores the geographic order of the stratum 1s in cache_dir, so that
+ * remounts and other repositories with the same stratum 1s and proxies skip
+ * the Geo-API request for ttl_s seconds.
+ */
+void DownloadManager::EnableGeoCache(const string &cache_dir,
+                                     const unsigned ttl_s)
+{
+  pthread_mutex_lock(lock_options_);
+  opt_geo_cache_dir_ = cache_dir;
+  opt_geo_cache_ttl_ = ttl_s;
   pthread_mutex_unlock(lock_options_);
 }
 
@@ -1971,7 +3520,19 @@ void DownloadManager::SwitchProxy(JobInfo *info) {
 
   // Select new one
   if ((group_size - opt_proxy_groups_current_burned_) > 0) {
-    int select = prng_.Next(group_size - opt_proxy_groups_current_burned_ + 1);
+    const unsigned num_candidates =
+      group_size - opt_proxy_groups_current_burned_ + 1;
+    int select = prng_.Next(num_candidates);
+    // Prefer a proxy that is not known to be unavailable
+    for (unsigned i = 0; i < num_candidates; ++i) {
+      const unsigned candidate = (select + i) % num_candidates;
+      if (!breakers_.IsOpen((*group)[candidate].url)) {
+        if (i > 0)
+          perf::Inc(counters_->n_endpoint_skipped);
+        select = candidate;
+        break;
+      }
+    }
 
     // Move selected proxy to front
     const ProxyInfo swap = (*group)[select];
@@ -2020,8 +3581,19 @@ void DownloadManager::SwitchHost(JobInfo *info) {
 
   if (do_switch) {
     string old_host = (*opt_host_chain_)[opt_host_chain_current_];
-    opt_host_chain_current_ = (opt_host_chain_current_+1) %
-    opt_host_chain_->size();
+    // Skip hosts that are known to be unavailable, unless all of them are
+    const unsigned num_hosts = opt_host_chain_->size();
+    unsigned next_host = (opt_host_chain_current_ + 1) % num_hosts;
+    for (unsigned i = 1; i < num_hosts; ++i) {
+      const unsigned candidate = (opt_host_chain_current_ + i) % num_hosts;
+      if (!breakers_.IsOpen(dns::ExtractHost((*opt_host_chain_)[candidate]))) {
+        if (i > 1)
+          perf::Inc(counters_->n_endpoint_skipped);
+        next_host = candidate;
+        break;
+      }
+    }
+    opt_host_chain_current_ = next_host;
     perf::Inc(counters_->n_host_failover);
     LogCvmfs(kLogDownload, kLogDebug | kLogSyslogWarn,
              "switching host from %s to %s", old_host.c_str(),
@@ -2046,6 +3618,92 @@ void DownloadManager::SwitchHost() {
 }
 
 
+/**
+ * True if no transfer can currently get through because the circuits of all
+ * the hosts or of all the proxies are open.  Turns false as soon as one of
+ * them is due for a probe, so that the next transfer finds out whether the
+ * network is back.
+ */
+bool DownloadManager::IsDegraded() {
+  pthread_mutex_lock(lock_options_);
+  const bool result = IsDegradedUnlocked();
+  pthread_mutex_unlock(lock_options_);
+  return result;
+}
+
+
+bool DownloadManager::IsDegradedUnlocked() {
+  if ((opt_host_chain_ == NULL) || opt_host_chain_->empty())
+    return false;
+
+  bool all_hosts_open = true;
+  for (unsigned i = 0; i < opt_host_chain_->size(); ++i) {
+    if (!breakers_.IsOpen(dns::ExtractHost((*opt_host_chain_)[i]))) {
+      all_hosts_open = false;
+      break;
+    }
+  }
+  if (all_hosts_open)
+    return true;
+
+  if (opt_proxy_groups_ == NULL)
+    return false;
+  for (unsigned i = 0; i < opt_proxy_groups_->size(); ++i) {
+    for (unsigned j = 0; j < (*opt_proxy_groups_)[i].size(); ++j) {
+      const string &url = (*opt_proxy_groups_)[i][j].url;
+      if ((url == "DIRECT") || !breakers_.IsOpen(url))
+        return false;
+    }
+  }
+  return true;
+}
+
+
+/**
+ * Feeds the circuit breakers with the outcome of a transfer.  Only failures to
+ * resolve or to connect count against an endpoint; any reply, even an error
+ * reply, shows that the endpoint is alive.
+ */
+void DownloadManager::ReportEndpointHealth(JobInfo *info) {
+  const bool via_proxy = !info->proxy.empty() && (info->proxy != "DIRECT");
+  string host;
+  if (info->probe_hosts) {
+    char *effective_url = NULL;
+    curl_easy_getinfo(info->curl_handle, CURLINFO_EFFECTIVE_URL,
+                      &effective_url);
+    if (effective_url != NULL)
+      host = dns::ExtractHost(effective_url);
+  }
+
+  switch (info->error_code) {
+    case kFailProxyResolve:
+    case kFailProxyConnection:
+      if (via_proxy)
+        breakers_.ReportFailure(info->proxy);
+      break;
+    case kFailHostResolve:
+    case kFailHostConnection:
+      if (!host.empty())
+        breakers_.ReportFailure(host);
+      break;
+    case kFailOk:
+    case kFailBadData:
+    case kFailHostHttp:
+      if (!host.empty())
+        breakers_.ReportSuccess(host);
+      if (via_proxy)
+        breakers_.ReportSuccess(info->proxy);
+      break;
+    case kFailProxyHttp:
+      if (via_proxy)
+        breakers_.ReportSuccess(info->proxy);
+      break;
+    default:
+      break;
+  }
+}
+
+
 /**
  * Orders the hostlist according to RTT of downloading .cvmfschecksum.
  * Sets the current host to the best-responsive host.
@@ -2101,6 +3759,66 @@ void DownloadManager::ProbeHosts() {
 }
 
 
+/**
+ * Reads a geographic order stored by StoreGeoOrder().  Fails if the order is
+ * older than ttl_s seconds or does not match the number of servers.
+ */
+bool DownloadManager::LoadGeoOrder(
+  const string &path,
+  const unsigned ttl_s,
+  const unsigned expected_size,
+  vector<uint64_t> *geo_order)
+{
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL)
+    return false;
+  string timestamp;
+  string order;
+  const bool retval = GetLineFile(f, &timestamp) && GetLineFile(f, &order);
+  fclose(f);
+  if (!retval)
+    return false;
+
+  uint64_t stored;
+  const uint64_t now = time(NULL);
+  if (!String2Uint64Parse(timestamp, &stored) || (stored > now) ||
+      (now - stored >= ttl_s))
+  {
+    return false;
+  }
+  geo_order->resize(expected_size);
+  if (!ValidateGeoReply(order, expected_size, geo_order))
+    return false;
+  LogCvmfs(kLogDownload, kLogDebug | kLogSyslog,
+           "geographic order of servers loaded from %s", path.c_str());
+  LogCvmfs(kLogDownload, kLogDebug, "order is %s", order.c_str());
+  return true;
+}
+
+
+/**
+ * Replaces the stored order atomically, failures are only logged.
+ */
+void DownloadManager::StoreGeoOrder(
+  const string &path,
+  const string &reply_order)
+{
+  string order = reply_order;
+  while (!order.empty() && (order[order.length() - 1] == '\n'))
+    order.erase(order.length() - 1);
+  const string content = StringifyInt(time(NULL)) + "\n" + order + "\n";
+  const string path_tmp = path + ".tmp" + StringifyInt(getpid());
+  if (!MkdirDeep(GetParentPath(path), 0700, true) ||
+      !SafeWriteToFile(content, path_tmp, 0600) ||
+      (rename(path_tmp.c_str(), path.c_str()) != 0))
+  {
+    LogCvmfs(kLogDownload, kLogDebug, "failed to store geographic order in %s",
+             path.c_str());
+    unlink(path_tmp.c_str());
+  }
+}
+
+
 bool DownloadManager::GeoSortServers(std::vector<std::string> *servers,
                     std::vector<uint64_t> *output_order) {
   if (!servers) {return false;}
@@ -2127,12 +3845,25 @@ bool DownloadManager::GeoSortServers(std::vector<std::string> *servers,
   pthread_mutex_lock(lock_options_);
   // Determine random hosts for the Geo-API query
   vector<string> host_chain_shuffled = Shuffle(host_chain, &prng_);
+  const string geo_cache_dir = opt_geo_cache_dir_;
+  const unsigned geo_cache_ttl = opt_geo_cache_ttl_;
+  const string geo_cache_key = host_list + "|" + opt_proxy_list_;
   pthread_mutex_unlock(lock_options_);
 
-  // Request ordered list via Geo-API
-  bool success = false;
-  unsigned max_attempts = std::min(host_chain_shuffled.size(), size_t(3));
+  // The order depends on the proxies, which replace @proxy@
   vector<uint64_t> geo_order(servers->size());
+  string geo_cache_path;
+  bool success = false;
+  if (!geo_cache_dir.empty()) {
+    geo_cache_path = geo_cache_dir + "/geo." +
+      shash::Md5(geo_cache_key.data(), geo_cache_key.length()).ToString();
+    success = LoadGeoOrder(geo_cache_path, geo_cache_ttl, servers->size(),
+                           &geo_order);
+  }
+
+  // Request ordered list via Geo-API
+  unsigned max_attempts =
+    success ? 0 : std::min(host_chain_shuffled.size(), size_t(3));
   for (unsigned i = 0; i < max_attempts; ++i) {
     string url = host_chain_shuffled[i] + "/api/v1.0/geo/@proxy@/" + host_list;
     LogCvmfs(kLogDownload, kLogDebug,
@@ -2152,6 +3883,8 @@ bool DownloadManager::GeoSortServers(std::vector<std::string> *servers,
                  "geographic order of servers retrieved from %s",
                  dns::ExtractHost(host_chain_shuffled[i]).c_str());
         LogCvmfs(kLogDownload, kLogDebug, "order is %s", order.c_str());
+        if (!geo_cache_path.empty())
+          StoreGeoOrder(geo_cache_path, order);
         success = true;
         break;
       }
@@ -2501,14 +4234,7 @@ void DownloadManager::SetProxyChain(
         continue;
       }
 
-      // IPv4 addresses have precedence
-      set<string> best_addresses =
-        hosts[num_proxy].ViewBestAddresses(opt_ip_preference_);
-      set<string>::const_iterator iter_ips = best_addresses.begin();
-      for (; iter_ips != best_addresses.end(); ++iter_ips) {
-        string url_ip = dns::RewriteUrl(this_group[j], *iter_ips);
-        infos.push_back(ProxyInfo(hosts[num_proxy], url_ip));
-      }
+      AppendProxyInfos(hosts[num_proxy], this_group[j], &infos);
     }
     opt_proxy_groups_->push_back(infos);
     opt_num_proxies_ += infos.size();
@@ -2560,6 +4286,14 @@ void DownloadManager::GetProxyInfo(vector< vector<ProxyInfo> > *proxy_chain,
   }
 
   *proxy_chain = *opt_proxy_groups_;
+  for (unsigned i = 0; i < proxy_chain->size(); ++i) {
+    for (unsigned j = 0; j < (*proxy_chain)[i].size(); ++j) {
+      map<string, EndpointScore>::const_iterator iter =
+        opt_proxy_scores_.find((*proxy_chain)[i][j].url);
+      if (iter != opt_proxy_scores_.end())
+        (*proxy_chain)[i][j].score = iter->second;
+    }
+  }
   if (current_group != NULL)
     *current_group = opt_proxy_groups_current_;
   if (fallback_group != NULL)
@@ -2589,6 +4323,8 @@ void DownloadManager::RebalanceProxiesUnlocked() {
   vector<ProxyInfo> *group = &((*opt_proxy_groups_)[opt_proxy_groups_current_]);
   int select = prng_.Next(group->size());
   swap((*group)[select], (*group)[0]);
+  if (opt_adaptive_proxies_)
+    SteerProxyUnlocked();
   // LogCvmfs(kLogDownload, kLogDebug | kLogSyslog,
   //          "switching proxy from %s to %s (rebalance)",
   //          (*group)[select].c_str(), swap.c_str());
@@ -2689,11 +4425,154 @@ void DownloadManager::EnablePipelining() {
 }
 
 
+/**
+ * Returns true if libcurl was built with HTTP/2 support (nghttp2).
+ */
+bool DownloadManager::IsHttp2Supported() {
+#ifdef CURLPIPE_MULTIPLEX
+  curl_version_info_data *info = curl_version_info(CURLVERSION_NOW);
+  return (info != NULL) && (info->features & CURL_VERSION_HTTP2);
+#else
+  return false;
+#endif
+}
+
+
+/**
+ * Multiplexes concurrent requests as HTTP/2 streams over at most
+ * max_host_connections connections per host address.  A proxy that resolves
+ * to several addresses (see SetMaxIpaddrPerProxy) gets at most
+ * max_host_connections per address.  All the streams of a broken connection
+ * fail at once; the proxy and host failover takes place only for the first of
+ * them because the others find the proxy or host already switched.
+ * Servers and proxies that don't speak HTTP/2 are used with HTTP/1.1 as
+ * before.  Needs to be called before Spawn().
+ */
+void DownloadManager::EnableHttp2(const unsigned max_host_connections) {
+  if (!IsHttp2Supported()) {
+    LogCvmfs(kLogDownload, kLogDebug | kLogSyslogWarn,
+             "HTTP/2 requested but not supported by libcurl, using HTTP/1.1");
+    return;
+  }
+#ifdef CURLPIPE_MULTIPLEX
+  opt_http2_ = true;
+  opt_http2_max_host_connections_ = max_host_connections;
+  curl_multi_setopt(curl_multi_, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  curl_multi_setopt(curl_multi_, CURLMOPT_MAX_HOST_CONNECTIONS,
+                    static_cast<long>(max_host_connections));  // NOLINT
+  LogCvmfs(kLogDownload, kLogDebug, "enabled HTTP/2 with up to %u "
+           "connections per host", max_host_connections);
+#endif
+}
+
+
 void DownloadManager::EnableRedirects() {
   follow_redirects_ = true;
 }
 
 
+/**
+ * Steers new requests to the fastest proxy of the active load-balancing group,
+ * see SteerProxyUnlocked().
+ */
+void DownloadManager::EnableAdaptiveProxies() {
+  pthread_mutex_lock(lock_options_);
+  opt_adaptive_proxies_ = true;
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+/**
+ * Jobs that wait longer than usual for a response are duplicated to another
+ * proxy or host, at most max_per_second times per second.  The first transfer
+ * that receives data wins.
+ */
+void DownloadManager::EnableHedgedRequests(const unsigned max_per_second) {
+  pthread_mutex_lock(lock_options_);
+  opt_hedge_max_per_second_ = max_per_second;
+  hedge_latencies_ms_.assign(kHedgeSamples, 0.0);
+  hedge_num_latencies_ = 0;
+  atomic_write32(&hedge_delay_ms_, 0);
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+/**
+ * Queues all the jobs in the I/O thread and starts them round-robin by uid of
+ * the requester instead of in the order of arrival.  Like for FetchMany()
+ * batches, at most max_pool_handles transfers are in flight.  Must be called
+ * before Spawn().
+ */
+void DownloadManager::EnableFairShare() {
+  pthread_mutex_lock(lock_options_);
+  opt_fair_share_ = true;
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+/**
+ * Queues all the jobs in the I/O thread and starts them by their priority
+ * class, see StartQueuedJobs().  Like for FetchMany() batches, at most
+ * max_pool_handles transfers are in flight.  Transfers that already run are
+ * not interrupted.  Must be called before Spawn().
+ */
+void DownloadManager::EnablePriorities() {
+  pthread_mutex_lock(lock_options_);
+  opt_priorities_ = true;
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+/**
+ * Hashing and decompression of file and sink downloads moves from the I/O
+ * thread to num_workers data worker threads.  Must be called before Spawn().
+ */
+void DownloadManager::EnableDataWorkers(const unsigned num_workers) {
+  opt_data_workers_ = num_workers;
+}
+
+
+/**
+ * Large uncompressed downloads of known size are split into ranges, which are
+ * fetched over num_streams connections in parallel.  With HTTP/2, the ranges
+ * share the multiplexed connections instead.
+ */
+void DownloadManager::EnableStriping(
+  const unsigned num_streams,
+  const uint64_t min_size)
+{
+  pthread_mutex_lock(lock_options_);
+  opt_stripe_streams_ = num_streams;
+  opt_stripe_min_size_ = std::max(min_size, uint64_t(2) * kStripeSize);
+  pthread_mutex_unlock(lock_options_);
+}
+
+
+DownloadManager::EndpointScore DownloadManager::GetHostScore(
+  const string &host)
+{
+  EndpointScore result;
+  pthread_mutex_lock(lock_options_);
+  map<string, EndpointScore>::const_iterator iter = opt_host_scores_.find(host);
+  if (iter != opt_host_scores_.end())
+    result = iter->second;
+  pthread_mutex_unlock(lock_options_);
+  return result;
+}
+
+
+/**
+ * The header lists of the transfers and the received data that is queued for
+ * the data workers.  The curl handles and their buffers are not included.
+ */
+uint64_t DownloadManager::GetMemoryUsage() {
+  uint64_t result = header_lists_->bytes_allocated();
+  if (data_workers_ != NULL)
+    result += data_workers_->GetQueuedBytes();
+  return result;
+}
+
+
 /**
  * Creates a copy of the existing download manager.  Must only be called in
  * single-threaded stage because it calls curl_global_init().
@@ -2704,6 +4583,8 @@ DownloadManager *DownloadManager::Clone(perf::StatisticsTemplate statistics) {
   if (resolver_) {
     clone->SetDnsParameters(resolver_->retries(), resolver_->timeout_ms());
     clone->SetMaxIpaddrPerProxy(resolver_->throttle());
+    if (!resolver_->shared_cache_dir().empty())
+      clone->EnableSharedDnsCache(resolver_->shared_cache_dir());
   }
   if (opt_dns_server_)
     clone->SetDnsServer(opt_dns_server_);
@@ -2715,6 +4596,18 @@ DownloadManager *DownloadManager::Clone(perf::StatisticsTemplate statistics) {
   clone->opt_backoff_max_ms_ = opt_backoff_max_ms_;
   clone->enable_info_header_ = enable_info_header_;
   clone->follow_redirects_ = follow_redirects_;
+  clone->opt_adaptive_proxies_ = opt_adaptive_proxies_;
+  clone->opt_fair_share_ = opt_fair_share_;
+  clone->opt_priorities_ = opt_priorities_;
+  clone->opt_data_workers_ = opt_data_workers_;
+  clone->opt_stripe_streams_ = opt_stripe_streams_;
+  clone->opt_stripe_min_size_ = opt_stripe_min_size_;
+  clone->opt_geo_cache_dir_ = opt_geo_cache_dir_;
+  clone->opt_geo_cache_ttl_ = opt_geo_cache_ttl_;
+  if (opt_hedge_max_per_second_ > 0)
+    clone->EnableHedgedRequests(opt_hedge_max_per_second_);
+  if (opt_http2_)
+    clone->EnableHttp2(opt_http2_max_host_connections_);
   if (opt_host_chain_) {
     clone->opt_host_chain_ = new vector<string>(*opt_host_chain_);
     clone->opt_host_chain_rtt_ = new vector<int>(*opt_host_chain_rtt_);
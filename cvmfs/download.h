@@ -10,7 +10,11 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include <cassert>
 #include <cstdio>
+#include <ctime>
+#include <deque>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
@@ -18,13 +22,17 @@
 #include "gtest/gtest_prod.h"
 
 #include "atomic.h"
+#include "backoff.h"
 #include "compression.h"
 #include "dns.h"
 #include "duplex_curl.h"
+#include "encrypt.h"
 #include "hash.h"
 #include "prng.h"
 #include "sink.h"
 #include "statistics.h"
+#include "util/async.h"
+#include "util_concurrency.h"
 
 
 namespace download {
@@ -50,6 +58,7 @@ enum Failures {
   kFailTooBig,
   kFailOther,
   kFailUnsupportedProtocol,
+  kFailNotModified,
 
   kFailNumEntries
 };  // Failures
@@ -71,7 +80,8 @@ inline const char *Code2Ascii(const Failures error) {
   texts[11] = "resource too big to download";
   texts[12] = "unknown network error";
   texts[13] = "Unsupported URL in protocol";
-  texts[14] = "no text";
+  texts[14] = "resource not modified";
+  texts[15] = "no text";
   return texts[error];
 }
 
@@ -88,6 +98,19 @@ enum Destination {
 };  // Destination
 
 
+/**
+ * Scheduling classes of queued jobs, most urgent first, see
+ * DownloadManager::EnablePriorities().
+ */
+enum Priority {
+  kPriorityMetadata = 0,  ///< catalogs, manifests, certificates
+  kPriorityInteractive,   ///< small files
+  kPriorityBulk,          ///< large files and chunks
+  kPriorityPrefetch,      ///< speculative downloads
+  kNumPriorities,
+};  // Priority
+
+
 struct Counters {
   perf::Counter *sz_transferred_bytes;
   perf::Counter *sz_transfer_time;  // measured in miliseconds
@@ -95,6 +118,26 @@ struct Counters {
   perf::Counter *n_retries;
   perf::Counter *n_proxy_failover;
   perf::Counter *n_host_failover;
+  perf::Counter *n_proxy_steered;
+  perf::Counter *n_hedged;
+  perf::Counter *n_hedge_won;
+  perf::Counter *n_striped;
+  perf::Counter *n_striped_fallback;
+  // Broken out by the HTTP protocol version that was used for the transfer
+  perf::Counter *n_requests_http1;
+  perf::Counter *n_requests_http2;
+  perf::Counter *sz_transferred_bytes_http1;
+  perf::Counter *sz_transferred_bytes_http2;
+  perf::Counter *sz_request_time_http1;  // measured in miliseconds
+  perf::Counter *sz_request_time_http2;  // measured in miliseconds
+  perf::Histogram *lat_transfer;  // measured in microseconds
+  perf::Counter *n_connects;
+  perf::Counter *n_connects_ipv6;
+  perf::Counter *sz_connect_time;  // measured in miliseconds
+  perf::Counter *n_ipv4_pinned;
+  perf::Counter *n_tls_handshakes;
+  perf::Counter *sz_tls_handshake_time;  // measured in miliseconds
+  perf::Counter *n_endpoint_skipped;
 
   explicit Counters(perf::StatisticsTemplate statistics) {
     sz_transferred_bytes = statistics.RegisterTemplated("sz_transferred_bytes",
@@ -108,16 +151,66 @@ struct Counters {
         "Number of proxy failovers");
     n_host_failover = statistics.RegisterTemplated("n_host_failover",
         "Number of host failovers");
+    n_proxy_steered = statistics.RegisterTemplated("n_proxy_steered",
+        "Number of switches to a faster proxy");
+    n_hedged = statistics.RegisterTemplated("n_hedged",
+        "Number of hedged requests");
+    n_hedge_won = statistics.RegisterTemplated("n_hedge_won",
+        "Number of hedged requests that answered first");
+    n_striped = statistics.RegisterTemplated("n_striped",
+        "Number of downloads split into parallel ranges");
+    n_striped_fallback = statistics.RegisterTemplated("n_striped_fallback",
+        "Number of striped downloads repeated as a single transfer");
+    n_requests_http1 = statistics.RegisterTemplated("n_requests_http1",
+        "Number of HTTP/1.x requests");
+    n_requests_http2 = statistics.RegisterTemplated("n_requests_http2",
+        "Number of HTTP/2 requests");
+    sz_transferred_bytes_http1 = statistics.RegisterTemplated(
+        "sz_transferred_bytes_http1",
+        "Number of bytes transferred by HTTP/1.x");
+    sz_transferred_bytes_http2 = statistics.RegisterTemplated(
+        "sz_transferred_bytes_http2",
+        "Number of bytes transferred by HTTP/2");
+    sz_request_time_http1 = statistics.RegisterTemplated(
+        "sz_request_time_http1",
+        "Summed up latency of HTTP/1.x requests (miliseconds)");
+    sz_request_time_http2 = statistics.RegisterTemplated(
+        "sz_request_time_http2",
+        "Summed up latency of HTTP/2 requests (miliseconds)");
+    lat_transfer = statistics.RegisterTemplatedHistogram("lat_transfer",
+        "Latency of transfers (microseconds)");
+    n_connects = statistics.RegisterTemplated("n_connects",
+        "Number of new connections");
+    n_connects_ipv6 = statistics.RegisterTemplated("n_connects_ipv6",
+        "Number of new connections over IPv6");
+    sz_connect_time = statistics.RegisterTemplated("sz_connect_time",
+        "Summed up time to establish new connections (miliseconds)");
+    n_ipv4_pinned = statistics.RegisterTemplated("n_ipv4_pinned",
+        "Number of endpoints connected by IPv4 after a connection race");
+    n_tls_handshakes = statistics.RegisterTemplated("n_tls_handshakes",
+        "Number of TLS handshakes of new connections");
+    sz_tls_handshake_time = statistics.RegisterTemplated(
+        "sz_tls_handshake_time",
+        "Summed up time of TLS handshakes (miliseconds)");
+    n_endpoint_skipped = statistics.RegisterTemplated("n_endpoint_skipped",
+        "Number of fail-overs that skipped an unavailable host or proxy");
   }
 };  // Counters
 
 
+struct JobBatch;
+class DataWorkers;
+
 /**
  * Contains all the information to specify a download job.
  */
 struct JobInfo {
   const std::string *url;
   bool compressed;
+  /**
+   * Only relevant for compressed downloads
+   */
+  zlib::Algorithms compression_alg;
   bool probe_hosts;
   bool head_request;
   bool follow_redirects;
@@ -125,6 +218,7 @@ struct JobInfo {
   pid_t pid;
   uid_t uid;
   gid_t gid;
+  Priority priority;
   void *cred_data;  // Per-transfer credential data
   Destination destination;
   struct {
@@ -137,15 +231,45 @@ struct JobInfo {
   cvmfs::Sink *destination_sink;
   const shash::Any *expected_hash;
   const std::string *extra_info;
+  /**
+   * If set, the object is decrypted while it streams in, before it gets
+   * decompressed.  The expected hash refers to the cipher text.
+   */
+  const cipher::Key *decryption_key;
 
   // Allow byte ranges to be specified.
   off_t range_offset;
   off_t range_size;
 
+  /**
+   * If set, the resource is only transferred if it changed since then.
+   * Otherwise the download fails with kFailNotModified.  After the download,
+   * last_modified is the modification time reported by the server or -1.
+   */
+  time_t if_modified_since;
+  time_t last_modified;
+
+  /**
+   * Where the time of the download went, in nanoseconds and summed up over
+   * all the attempts.  Filled in by the download manager.  The data time
+   * overlaps with the transfer time unless the data is processed by the data
+   * workers.
+   */
+  struct {
+    uint64_t queue;  ///< submitted until handed to curl
+    uint64_t dns;
+    uint64_t connect;  ///< TCP connections to the host or proxy
+    uint64_t tls;
+    uint64_t wait;  ///< request sent until the first byte arrived
+    uint64_t transfer;  ///< first until last byte
+    uint64_t data;  ///< hashing, decrypting, decompressing, writing
+  } timing;
+
   // Default initialization of fields
   void Init() {
     url = NULL;
     compressed = false;
+    compression_alg = zlib::kZlibDefault;
     probe_hosts = false;
     head_request = false;
     follow_redirects = false;
@@ -153,6 +277,7 @@ struct JobInfo {
     pid = -1;
     uid = -1;
     gid = -1;
+    priority = kPriorityInteractive;
     cred_data = NULL;
     destination = kDestinationNone;
     destination_mem.size = destination_mem.pos = 0;
@@ -162,12 +287,14 @@ struct JobInfo {
     destination_sink = NULL;
     expected_hash = NULL;
     extra_info = NULL;
+    decryption_key = NULL;
 
     curl_handle = NULL;
     headers = NULL;
-    memset(&zstream, 0, sizeof(zstream));
+    decompressor = NULL;
+    decryptor = NULL;
     info_header = NULL;
-    wait_at[0] = wait_at[1] = -1;
+    batch = NULL;
     nocache = false;
     error_code = kFailOther;
     num_used_proxies = num_used_hosts = num_retries = 0;
@@ -175,7 +302,24 @@ struct JobInfo {
 
     range_offset = -1;
     range_size = -1;
+    if_modified_since = 0;
+    last_modified = -1;
     http_code = -1;
+    timing.queue = timing.dns = timing.connect = timing.tls = 0;
+    timing.wait = timing.transfer = timing.data = 0;
+    submit_ns = 0;
+
+    hedge_of = NULL;
+    hedge_partner = NULL;
+    hedge_deadline_ms = 0;
+    hedge_lost = false;
+
+    data_workers = NULL;
+    data_worker = 0;
+    atomic_init32(&data_pending);
+    atomic_init32(&data_failed);
+    data_draining = false;
+    curl_result = 0;
   }
 
   // One constructor per destination + head request
@@ -230,20 +374,15 @@ struct JobInfo {
     head_request = true;
   }
 
-  ~JobInfo() {
-    if (wait_at[0] >= 0) {
-      close(wait_at[0]);
-      close(wait_at[1]);
-    }
-  }
-
   // Internal state, don't touch
   CURL *curl_handle;
   curl_slist *headers;
   char *info_header;
-  z_stream zstream;
+  zlib::Decompressor *decompressor;
+  cipher::StreamDecryptor *decryptor;
   shash::ContextPtr hash_context;
-  int wait_at[2];  /**< Pipe used for the return value */
+  Completion completion;  /**< Signals the waiting Fetch() */
+  JobBatch *batch;  /**< Set for jobs submitted by FetchMany() */
   std::string proxy;
   bool nocache;
   Failures error_code;
@@ -252,9 +391,121 @@ struct JobInfo {
   unsigned char num_used_hosts;
   unsigned char num_retries;
   unsigned backoff_ms;
+  uint64_t submit_ns;  ///< Start of the queue time
+  /**
+   * Hedged requests, only used by the I/O thread.  A hedge is a duplicate of a
+   * slow job sent through another proxy or host.  It points to the original
+   * job by hedge_of.  Both jobs are linked by hedge_partner until one of them
+   * receives the first data byte; the other one is then marked as lost.
+   */
+  JobInfo *hedge_of;
+  JobInfo *hedge_partner;
+  uint64_t hedge_deadline_ms;  ///< Time to send a hedge, 0 for none
+  bool hedge_lost;
+  /**
+   * Set if the received data is processed by the data workers instead of the
+   * I/O thread.  data_worker is the worker that got the last data block; it
+   * only changes if there are no pending blocks.  data_draining is protected
+   * by the lock of that worker.  curl_result keeps the result of a transfer
+   * that finished while data was still pending.
+   */
+  DataWorkers *data_workers;
+  unsigned data_worker;
+  atomic_int32 data_pending;
+  atomic_int32 data_failed;
+  bool data_draining;
+  int curl_result;
 };  // JobInfo
 
 
+/**
+ * Jobs that are submitted together by FetchMany().  The batch is handed to the
+ * I/O thread as a whole.  The I/O thread collects finished jobs in done and
+ * signals the submitting thread, which processes all the jobs that finished in
+ * the meantime in one go.
+ */
+struct JobBatch {
+  JobBatch() {
+    int retval = pthread_mutex_init(&lock, NULL);
+    assert(retval == 0);
+    retval = pthread_cond_init(&cond_done, NULL);
+    assert(retval == 0);
+  }
+  ~JobBatch() {
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&cond_done);
+  }
+
+  std::vector<JobInfo *> jobs;
+  /**
+   * Protected by lock
+   */
+  std::vector<JobInfo *> done;
+  pthread_mutex_t lock;
+  pthread_cond_t cond_done;
+};
+
+
+/**
+ * Decompresses, hashes, and writes the received data of file and sink
+ * destinations in a pool of worker threads, so that the I/O thread only moves
+ * bytes from curl to the workers.  All the blocks of a job are processed by
+ * one worker in the order of arrival.  If curl finishes a transfer while
+ * blocks are still pending, the worker hands the job back to the I/O thread
+ * through pipe_done once it processed the last block.
+ */
+class DataWorkers : SingleCopy {
+ public:
+  /**
+   * Back pressure: the I/O thread waits if more data is queued for a worker
+   */
+  static const unsigned kMaxQueuedBytes = 4 * 1024 * 1024;
+
+  DataWorkers(const unsigned num_workers, const int pipe_done);
+  ~DataWorkers();
+  /**
+   * Called by the I/O thread for every block received by curl
+   */
+  void Push(JobInfo *info, const void *buf, const size_t size);
+  /**
+   * Called by the I/O thread for a finished transfer.  Returns false if there
+   * are pending blocks, in which case the job is written to pipe_done later.
+   */
+  bool Finish(JobInfo *info);
+
+  uint64_t GetQueuedBytes();
+  unsigned num_workers() const { return workers_.size(); }
+
+ private:
+  struct Block {
+    JobInfo *info;
+    void *data;
+    size_t size;
+  };
+
+  struct Worker {
+    Worker();
+    ~Worker();
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond_data;
+    pthread_cond_t cond_space;
+    std::deque<Block> queue;
+    uint64_t queued_bytes;
+    bool terminate;
+    int pipe_done;
+  };
+
+  static void *MainWorker(void *data);
+
+  std::vector<Worker *> workers_;
+  /**
+   * Only used by the I/O thread
+   */
+  unsigned next_worker_;
+};
+
+
 /**
  * Manages blocks of arrays of curl_slist storing header strings.  In contrast
  * to curl's slists, these ones don't take ownership of the header strings.
@@ -267,6 +518,7 @@ struct JobInfo {
 class HeaderLists {
   FRIEND_TEST(T_HeaderLists, Intrinsics);
  public:
+  HeaderLists();
   ~HeaderLists();
   curl_slist *GetList(const char *header);
   curl_slist *DuplicateList(curl_slist *slist);
@@ -274,6 +526,7 @@ class HeaderLists {
   void CutHeader(const char *header, curl_slist **slist);
   void PutList(curl_slist *slist);
   std::string Print(curl_slist *slist);
+  uint64_t bytes_allocated() { return atomic_read64(&bytes_allocated_); }
 
  private:
   static const unsigned kBlockSize = 4096/sizeof(curl_slist);
@@ -284,6 +537,10 @@ class HeaderLists {
   void AddBlock();
 
   std::vector<curl_slist *> blocks_;  // List of curl_slist blocks
+  /**
+   * Can be read from outside the I/O thread
+   */
+  atomic_int64 bytes_allocated_;
 };
 
 
@@ -307,9 +564,36 @@ class CredentialsAttachment {
  */
 class DownloadManager {
   FRIEND_TEST(T_Download, ValidateGeoReply);
+  FRIEND_TEST(T_Download, GeoCache);
   FRIEND_TEST(T_Download, StripDirect);
+  FRIEND_TEST(T_Download, EndpointScore);
+  FRIEND_TEST(T_Download, SteerProxy);
+  FRIEND_TEST(T_Download, HedgeDelay);
+  FRIEND_TEST(T_Download, IpFamilyRace);
+  FRIEND_TEST(T_Download, Priorities);
+  FRIEND_TEST(T_Download, Degraded);
 
  public:
+  /**
+   * Exponentially weighted moving averages over the successful transfers
+   * through a proxy or from a host.  The cost estimates the duration of a
+   * request of kReferenceBytes.
+   */
+  struct EndpointScore {
+    static const unsigned kReferenceBytes = 128 * 1024;
+    /**
+     * Smaller transfers do not tell the throughput
+     */
+    static const unsigned kMinThroughputBytes = 64 * 1024;
+    EndpointScore() : num_samples(0), latency_ms(0.0), throughput(0.0) { }
+    void Add(const double sample_latency_ms, const double sample_throughput);
+    double Cost() const;
+    std::string Print() const;
+    uint64_t num_samples;
+    double latency_ms;  ///< Time to the first byte
+    double throughput;  ///< Bytes per second, 0 if unknown
+  };
+
   struct ProxyInfo {
     ProxyInfo() { }
     explicit ProxyInfo(const std::string &url) : url(url) { }
@@ -320,6 +604,10 @@ class DownloadManager {
     std::string Print();
     dns::Host host;
     std::string url;
+    /**
+     * Filled by GetProxyInfo()
+     */
+    EndpointScore score;
   };
 
   enum ProxySetModes {
@@ -349,11 +637,52 @@ class DownloadManager {
 
   static const unsigned kDnsDefaultRetries = 1;
   static const unsigned kDnsDefaultTimeoutMs = 3000;
+  /**
+   * With HTTP/2, concurrent requests are multiplexed over a few connections
+   * per proxy or host address.
+   */
+  static const unsigned kHttp2DefaultMaxHostConnections = 2;
+  /**
+   * With adaptive proxies, a score is used after kMinScoreSamples transfers.
+   * The active proxy is replaced if its cost exceeds the cost of the fastest
+   * proxy of the group by kSteerThresholdPercent.
+   */
+  static const unsigned kMinScoreSamples = 8;
+  static const unsigned kSteerThresholdPercent = 150;
+  static const unsigned kExploreInterval = 64;
+  /**
+   * With hedged requests, a job that did not receive a response after the
+   * kHedgePercentile percentile of the last kHedgeSamples response times is
+   * duplicated to another proxy or host.  The percentile is recalculated
+   * every kHedgeUpdateInterval samples.
+   */
+  static const unsigned kHedgeSamples = 128;
+  static const unsigned kHedgePercentile = 95;
+  static const unsigned kHedgeUpdateInterval = 16;
+  /**
+   * A geographic order of the stratum 1s stored in the cache directory is
+   * reused for a day by default.
+   */
+  static const unsigned kGeoCacheDefaultTtl = 24 * 3600;
+  /**
+   * Striped downloads fetch kStripeSize ranges, as many at a time as there are
+   * streams.  The ranges are buffered in memory and written to the
+   * destination in order.
+   */
+  static const unsigned kStripeSize = 8 * 1024 * 1024;
+  /**
+   * With dns::kIpPreferRace, the IPv4 connection attempt starts kRaceDelayMs
+   * after the IPv6 attempt.  If IPv4 wins, the endpoint is connected by IPv4
+   * only for kIpv4PinTtl seconds.
+   */
+  static const unsigned kRaceDelayMs = 250;
+  static const unsigned kIpv4PinTtl = 600;
 
   DownloadManager();
   ~DownloadManager();
 
   static int ParseHttpCode(const char digits[3]);
+  static bool IsHttp2Supported();
 
   void Init(const unsigned max_pool_handles,
             const bool use_system_proxy,
@@ -362,10 +691,14 @@ class DownloadManager {
   void Spawn();
   DownloadManager *Clone(perf::StatisticsTemplate statistics);
   Failures Fetch(JobInfo *info);
+  bool FetchMany(const std::vector<JobInfo *> &infos,
+                 const CallbackBase<JobInfo *> *on_done);
 
   void SetCredentialsAttachment(CredentialsAttachment *ca);
   void SetDnsServer(const std::string &address);
   void SetDnsParameters(const unsigned retries, const unsigned timeout_ms);
+  void EnableSharedDnsCache(const std::string &cache_dir);
+  void EnableGeoCache(const std::string &cache_dir, const unsigned ttl_s);
   void SetIpPreference(const dns::IpPreference preference);
   void SetTimeout(const unsigned seconds_proxy, const unsigned seconds_direct);
   void GetTimeout(unsigned *seconds_proxy, unsigned *seconds_direct);
@@ -402,7 +735,17 @@ class DownloadManager {
   void SetProxyTemplates(const std::string &direct, const std::string &forced);
   void EnableInfoHeader();
   void EnablePipelining();
+  void EnableHttp2(const unsigned max_host_connections);
   void EnableRedirects();
+  void EnableAdaptiveProxies();
+  void EnableHedgedRequests(const unsigned max_per_second);
+  void EnableFairShare();
+  void EnablePriorities();
+  bool IsDegraded();
+  void EnableDataWorkers(const unsigned num_workers);
+  void EnableStriping(const unsigned num_streams, const uint64_t min_size);
+  EndpointScore GetHostScore(const std::string &host);
+  uint64_t GetMemoryUsage();
 
   unsigned num_hosts() {
     if (opt_host_chain_) return opt_host_chain_->size();
@@ -410,28 +753,65 @@ class DownloadManager {
   }
 
  private:
+  static void CallbackCurlShareLock(CURL *handle, curl_lock_data data,
+                                    curl_lock_access access, void *userptr);
+  static void CallbackCurlShareUnlock(CURL *handle, curl_lock_data data,
+                                      void *userptr);
   static int CallbackCurlSocket(CURL *easy, curl_socket_t s, int action,
                                 void *userp, void *socketp);
   static void *MainDownload(void *data);
+  static void NotifyJobDone(JobInfo *info);
 
   bool StripDirect(const std::string &proxy_list, std::string *cleaned_list);
   bool ValidateGeoReply(const std::string &reply_order,
                         const unsigned expected_size,
                         std::vector<uint64_t> *reply_vals);
+  bool LoadGeoOrder(const std::string &path, const unsigned ttl_s,
+                    const unsigned expected_size,
+                    std::vector<uint64_t> *geo_order);
+  void StoreGeoOrder(const std::string &path, const std::string &reply_order);
   void SwitchHost(JobInfo *info);
   void SwitchProxy(JobInfo *info);
   void RebalanceProxiesUnlocked();
   CURL *AcquireCurlHandle();
   void ReleaseCurlHandle(CURL *handle);
+  Failures PrepareJob(JobInfo *info);
+  unsigned GetInfoHeaderSize(const JobInfo *info);
+  void FormatInfoHeader(JobInfo *info, char *buffer, const unsigned size);
+  void CleanupFailedJob(JobInfo *info);
+  bool IsStripable(const JobInfo *info);
+  bool FetchStriped(JobInfo *info);
+  void StartJob(JobInfo *info);
+  void QueueJob(JobInfo *info);
+  void StartQueuedJobs();
+  unsigned GetReservedHandles(const unsigned priority,
+                              const unsigned max_inflight) const;
   void InitializeRequest(JobInfo *info, CURL *handle);
   void SetUrlOptions(JobInfo *info);
+  bool IsDegradedUnlocked();
   void ValidateProxyIpsUnlocked(const std::string &url, const dns::Host &host);
   void UpdateStatistics(CURL *handle);
+  void UpdateConnectionStatistics(JobInfo *info);
+  bool IsIpv4PinnedUnlocked(const std::string &endpoint);
+  void ReportEndpointHealth(JobInfo *info);
+  void AppendProxyInfos(const dns::Host &host, const std::string &url,
+                        std::vector<ProxyInfo> *infos);
+  void UpdateScores(JobInfo *info);
+  void SteerProxyUnlocked();
+  void UpdateHedgeDelayUnlocked(const double latency_ms);
+  void ScheduleHedge(JobInfo *info);
+  unsigned StartHedges();
+  bool StartHedge(JobInfo *info);
+  bool SetHedgeUrlOptions(JobInfo *hedge, const JobInfo *info);
+  void ReapHedges();
+  bool CompleteHedge(JobInfo *info);
+  void DropHedge(JobInfo *hedge);
   bool CanRetry(const JobInfo *info);
   void Backoff(JobInfo *info);
   void SetNocache(JobInfo *info);
   void SetRegularCache(JobInfo *info);
   bool VerifyAndFinalize(const int curl_error, JobInfo *info);
+  bool FinalizeTransfer(const int curl_error, JobInfo *info);
   void InitHeaders();
   void FiniHeaders();
   void CloneProxyConfig(DownloadManager *clone);
@@ -441,6 +821,12 @@ class DownloadManager {
   std::set<CURL *> *pool_handles_inuse_;
   uint32_t pool_max_handles_;
   CURLM *curl_multi_;
+  /**
+   * TLS sessions are shared by all the pooled handles, so that new HTTPS
+   * connections resume a session instead of a full handshake.
+   */
+  CURLSH *curl_share_;
+  pthread_mutex_t *lock_curl_share_;
   HeaderLists *header_lists_;
   curl_slist *default_headers_;
   char *user_agent_;
@@ -450,6 +836,29 @@ class DownloadManager {
   int pipe_terminate_[2];
 
   int pipe_jobs_[2];
+  /**
+   * Jobs whose remaining data was processed by the data workers after the
+   * transfer finished.
+   */
+  int pipe_data_done_[2];
+  /**
+   * NULL unless EnableDataWorkers() was called before Spawn()
+   */
+  DataWorkers *data_workers_;
+  unsigned opt_data_workers_;
+  /**
+   * Jobs that have not yet been handed to curl, by priority and by uid of the
+   * requester.  Without fair share, all jobs are in the queue of uid 0.
+   * Without priorities, all jobs are in the queue of the first class.  Unless
+   * one of the two is enabled, only jobs of FetchMany() batches are queued.
+   * Only accessed by the I/O thread.
+   */
+  std::map<uid_t, std::deque<JobInfo *> > queued_jobs_[kNumPriorities];
+  unsigned num_queued_jobs_;
+  /**
+   * The uid whose queue was served last, per priority
+   */
+  uid_t queued_jobs_cursor_[kNumPriorities];
   struct pollfd *watch_fds_;
   uint32_t watch_fds_size_;
   uint32_t watch_fds_inuse_;
@@ -468,6 +877,8 @@ class DownloadManager {
   bool opt_ipv4_only_;
   bool follow_redirects_;
   bool use_system_proxy_;
+  bool opt_http2_;
+  unsigned opt_http2_max_host_connections_;
 
   // Host list
   std::vector<std::string> *opt_host_chain_;
@@ -506,6 +917,61 @@ class DownloadManager {
    * The original proxy fallback list provided to SetProxyChain.
    */
   std::string opt_proxy_fallback_list_;
+  /**
+   * Transfer scores of the proxies by proxy url and of the hosts by host url.
+   * They are kept when the proxy chain or the host chain changes.
+   */
+  std::map<std::string, EndpointScore> opt_proxy_scores_;
+  std::map<std::string, EndpointScore> opt_host_scores_;
+  /**
+   * If set, new requests are steered to the fastest proxy of the current
+   * load-balancing group.  Every kExploreInterval-th request goes through
+   * another proxy of the group so that its score stays current.
+   */
+  bool opt_adaptive_proxies_;
+  unsigned opt_num_steered_requests_;
+
+  /**
+   * If set, the transfers are shared round-robin between the uids of the
+   * requesters, so that a single user cannot starve the others.
+   */
+  bool opt_fair_share_;
+
+  /**
+   * Queue all the jobs and reserve transfer slots for the more urgent ones
+   */
+  bool opt_priorities_;
+
+  /**
+   * If larger than zero, slow jobs are hedged, at most
+   * opt_hedge_max_per_second_ times per second.  The response times in
+   * hedge_latencies_ms_ are protected by lock_options_; hedge_delay_ms_ is 0
+   * as long as there are too few samples.  The other fields are only used by
+   * the I/O thread.
+   */
+  /**
+   * If not empty, geographic orders of the stratum 1s are stored in this
+   * directory and reused for opt_geo_cache_ttl_ seconds, also across mounts.
+   * The file name depends on the list of stratum 1s and on the proxies.
+   */
+  std::string opt_geo_cache_dir_;
+  unsigned opt_geo_cache_ttl_;
+
+  /**
+   * Uncompressed downloads of at least opt_stripe_min_size_ bytes into a file
+   * or a sink are split into ranges, opt_stripe_streams_ of which are fetched
+   * in parallel.  Disabled if smaller than two.
+   */
+  unsigned opt_stripe_streams_;
+  uint64_t opt_stripe_min_size_;
+
+  unsigned opt_hedge_max_per_second_;
+  std::vector<double> hedge_latencies_ms_;
+  uint64_t hedge_num_latencies_;
+  atomic_int32 hedge_delay_ms_;
+  std::vector<JobInfo *> hedges_;
+  uint64_t hedge_second_;
+  unsigned hedge_num_second_;
 
   /**
    * Used to resolve proxy addresses (host addresses are resolved by the proxy).
@@ -516,6 +982,18 @@ class DownloadManager {
    * If a proxy has IPv4 and IPv6 addresses, which one to prefer
    */
   dns::IpPreference opt_ip_preference_;
+  /**
+   * Endpoints (proxy URLs or host names) that won a connection race over IPv4
+   * and until when they are connected by IPv4 only.  Protected by
+   * lock_options_.
+   */
+  std::map<std::string, time_t> ipv4_pinned_;
+  /**
+   * Connection and name resolution failures of hosts (by host name) and of
+   * proxies (by URL).  Fail-overs skip open endpoints, the reset to the
+   * primary host or proxy group waits for a successful probe.
+   */
+  CircuitBreakers breakers_;
 
   /**
    * Used to replace @proxy@ in the Geo-API calls to order Stratum 1 servers,
@@ -7,6 +7,8 @@
 
 #ifdef CVMFS_LIBCVMFS
 // Unit tests
+#include <sys/types.h>
+
 #define FUSE_VERSION 29
 #define FUSE_ROOT_ID 1
 extern "C" {
@@ -20,6 +22,13 @@ static int __attribute__((used)) fuse_lowlevel_notify_inval_entry(
   fuse_lowlevel_notify_inval_entry_cnt++;
   return -1;
 }
+extern unsigned fuse_lowlevel_notify_inval_inode_cnt;
+static int __attribute__((used)) fuse_lowlevel_notify_inval_inode(
+  void *, unsigned long, off_t, off_t)  // NOLINT (ulong from fuse)
+{
+  fuse_lowlevel_notify_inval_inode_cnt++;
+  return -1;
+}
 }
 #else
 #define FUSE_USE_VERSION 26
@@ -32,6 +41,11 @@ static int __attribute__((used)) fuse_lowlevel_notify_inval_entry(
 {
   abort();
 }
+static int __attribute__((used)) fuse_lowlevel_notify_inval_inode(
+  void *, unsigned long, off_t, off_t)  // NOLINT
+{
+  abort();
+}
 }
 #endif
 #endif
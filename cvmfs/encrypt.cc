@@ -10,6 +10,7 @@
 #include <openssl/rand.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
@@ -158,6 +159,8 @@ Cipher *Cipher::Create(const Algorithms a) {
   switch (a) {
     case kAes256Cbc:
       return new CipherAes256Cbc();
+    case kAes256Ctr:
+      return new CipherAes256Ctr();
     case kNone:
       return new CipherNone();
     default:
@@ -344,6 +347,171 @@ shash::Md5 CipherAes256Cbc::GenerateIv(const Key &key) {
 //------------------------------------------------------------------------------
 
 
+const unsigned CipherAes256Ctr::kHeaderSize;
+
+
+string CipherAes256Ctr::DoEncrypt(const string &plaintext, const Key &key) {
+  UniquePtr<StreamEncryptor> encryptor(StreamEncryptor::Create(key));
+  assert(encryptor.IsValid());
+  // The envelope byte is added by Cipher::Encrypt()
+  string result = encryptor->header().substr(1);
+  const unsigned offset = result.size();
+  result.resize(offset + plaintext.size());
+  if (!plaintext.empty()) {
+    encryptor->Update(
+      reinterpret_cast<const unsigned char *>(plaintext.data()),
+      plaintext.size(),
+      reinterpret_cast<unsigned char *>(&result[offset]));
+  }
+  return result;
+}
+
+
+string CipherAes256Ctr::DoDecrypt(const string &ciphertext, const Key &key) {
+  if (ciphertext.size() < kIvSize)
+    return "";
+  StreamDecryptor decryptor(&key);
+  const unsigned char envelope = (kAes256Ctr << 4) & 0xF0;
+  const unsigned char *plaintext;
+  size_t plaintext_size;
+  bool retval = decryptor.Update(&envelope, 1, &plaintext, &plaintext_size);
+  assert(retval);
+  retval = decryptor.Update(ciphertext.data(), ciphertext.size(),
+                            &plaintext, &plaintext_size);
+  if (!retval || (plaintext_size == 0))
+    return "";
+  return string(reinterpret_cast<const char *>(plaintext), plaintext_size);
+}
+
+
+//------------------------------------------------------------------------------
+
+
+StreamEncryptor *StreamEncryptor::Create(const Key &key) {
+  if (key.size() != CipherAes256Ctr::kKeySize)
+    return NULL;
+
+  unsigned char iv[CipherAes256Ctr::kIvSize];
+  int retval = RAND_bytes(iv, CipherAes256Ctr::kIvSize);
+  if (retval != 1)
+    return NULL;
+
+  UniquePtr<StreamEncryptor> result(new StreamEncryptor());
+  result->header_.push_back((kAes256Ctr << 4) & 0xF0);
+  result->header_.append(reinterpret_cast<char *>(iv),
+                         CipherAes256Ctr::kIvSize);
+  result->ctx_ = EVP_CIPHER_CTX_new();
+  assert(result->ctx_ != NULL);
+  retval = EVP_EncryptInit_ex(result->ctx_, EVP_aes_256_ctr(), NULL,
+                              key.data(), iv);
+  assert(retval == 1);
+  return result.Release();
+}
+
+
+StreamEncryptor::~StreamEncryptor() {
+  if (ctx_ != NULL)
+    EVP_CIPHER_CTX_free(ctx_);
+}
+
+
+void StreamEncryptor::Update(
+  const unsigned char *in,
+  const size_t size,
+  unsigned char *out)
+{
+  if (size == 0)
+    return;
+  int out_len = 0;
+  int retval = EVP_EncryptUpdate(ctx_, out, &out_len, in, size);
+  assert(retval == 1);
+  // No padding in counter mode
+  assert(static_cast<size_t>(out_len) == size);
+}
+
+
+StreamDecryptor::StreamDecryptor(const Key *key)
+  : key_(key)
+  , ctx_(EVP_CIPHER_CTX_new())
+  , ctx_initialized_(false)
+  , buffer_(NULL)
+  , buffer_size_(0)
+{
+  assert(ctx_ != NULL);
+}
+
+
+StreamDecryptor::~StreamDecryptor() {
+  EVP_CIPHER_CTX_free(ctx_);
+  free(buffer_);
+}
+
+
+void StreamDecryptor::Reset() {
+  ctx_initialized_ = false;
+  header_.clear();
+}
+
+
+bool StreamDecryptor::InitContext() {
+  assert(header_.size() == CipherAes256Ctr::kHeaderSize);
+  const unsigned char envelope = header_[0];
+  const unsigned char version = envelope & 0x0F;
+  const unsigned char algorithm = (envelope & 0xF0) >> 4;
+  if ((version != 0) || (algorithm != kAes256Ctr))
+    return false;
+  if (key_->size() != CipherAes256Ctr::kKeySize)
+    return false;
+
+  int retval = EVP_DecryptInit_ex(ctx_, EVP_aes_256_ctr(), NULL, key_->data(),
+    reinterpret_cast<const unsigned char *>(header_.data() + 1));
+  assert(retval == 1);
+  ctx_initialized_ = true;
+  return true;
+}
+
+
+bool StreamDecryptor::Update(
+  const void *in,
+  size_t size,
+  const unsigned char **plaintext,
+  size_t *plaintext_size)
+{
+  const unsigned char *data = static_cast<const unsigned char *>(in);
+  *plaintext = buffer_;
+  *plaintext_size = 0;
+
+  if (!ctx_initialized_) {
+    const size_t nbytes_header =
+      std::min(size, CipherAes256Ctr::kHeaderSize - header_.size());
+    header_.append(reinterpret_cast<const char *>(data), nbytes_header);
+    data += nbytes_header;
+    size -= nbytes_header;
+    if (header_.size() < CipherAes256Ctr::kHeaderSize)
+      return true;
+    if (!InitContext())
+      return false;
+  }
+  if (size == 0)
+    return true;
+
+  if (size > buffer_size_) {
+    buffer_ = reinterpret_cast<unsigned char *>(srealloc(buffer_, size));
+    buffer_size_ = size;
+  }
+  int out_len = 0;
+  int retval = EVP_DecryptUpdate(ctx_, buffer_, &out_len, data, size);
+  assert(retval == 1);
+  assert(static_cast<size_t>(out_len) == size);
+  *plaintext = buffer_;
+  *plaintext_size = size;
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+
+
 string CipherNone::DoDecrypt(const string &ciphertext, const Key &key) {
   return ciphertext;
 }
@@ -8,6 +8,9 @@
  *
  * The initialization vector is transferred together with the cipher text.  It
  * is constructed from the HMAC of the key and nonce.
+ *
+ * Large objects are encrypted with AES-256-CTR by the StreamEncryptor and the
+ * StreamDecryptor, which process the data piecewise as it passes through.
  */
 
 #ifndef CVMFS_ENCRYPT_H_
@@ -18,14 +21,20 @@
 #include <map>
 #include <string>
 
+#include <cstddef>
+
 #include "gtest/gtest_prod.h"
 #include "hash.h"
 #include "util/single_copy.h"
 
+// OpenSSL's EVP_CIPHER_CTX
+struct evp_cipher_ctx_st;
+
 namespace cipher {
 
 enum Algorithms {
   kAes256Cbc = 0,
+  kAes256Ctr,
   kNone,  // needs to be last
 };
 
@@ -138,6 +147,97 @@ class CipherAes256Cbc : public Cipher {
 };
 
 
+/**
+ * Counter mode: the cipher text has the same length as the plain text and it
+ * can be produced and consumed in pieces of any size, see StreamEncryptor and
+ * StreamDecryptor.  The IV is random.
+ */
+class CipherAes256Ctr : public Cipher {
+ public:
+  static const unsigned kKeySize = 256/8;
+  static const unsigned kIvSize = 128/8;
+  static const unsigned kBlockSize = 128/8;
+  /**
+   * Envelope byte plus IV
+   */
+  static const unsigned kHeaderSize = 1 + kIvSize;
+
+  virtual ~CipherAes256Ctr() { }
+
+  virtual std::string name() const { return "AES-256-CTR"; }
+  virtual Algorithms algorithm() const { return kAes256Ctr; }
+  virtual unsigned key_size() const { return kKeySize; }
+  virtual unsigned iv_size() const { return kIvSize; }
+  virtual unsigned block_size() const { return kBlockSize; }
+
+ protected:
+  virtual std::string DoEncrypt(const std::string &plaintext, const Key &key);
+  virtual std::string DoDecrypt(const std::string &ciphertext, const Key &key);
+};
+
+
+/**
+ * Encrypts a stream with AES-256-CTR.  The header followed by the output of
+ * all the Update() calls is a cipher text that Cipher::Decrypt() understands.
+ * The OpenSSL EVP interface uses AES-NI instructions where available.
+ */
+class StreamEncryptor : SingleCopy {
+ public:
+  static StreamEncryptor *Create(const Key &key);
+  ~StreamEncryptor();
+
+  /**
+   * Needs to precede the cipher text.
+   */
+  const std::string &header() const { return header_; }
+  /**
+   * Encrypts the next size bytes of the stream.  Input and output may be the
+   * same buffer.
+   */
+  void Update(const unsigned char *in, const size_t size, unsigned char *out);
+
+ private:
+  StreamEncryptor() : ctx_(NULL) { }
+  evp_cipher_ctx_st *ctx_;
+  std::string header_;
+};
+
+
+/**
+ * Decrypts a stream produced by the StreamEncryptor or by CipherAes256Ctr.  The
+ * header can arrive in pieces, too.  The key is not owned and needs to outlive
+ * the decryptor.
+ */
+class StreamDecryptor : SingleCopy {
+ public:
+  explicit StreamDecryptor(const Key *key);
+  ~StreamDecryptor();
+
+  /**
+   * Consumes the next size bytes of cipher text.  The resulting plain text is
+   * stored in an internal buffer that remains valid until the next call.  As
+   * long as the header is incomplete, the plain text is empty.  Returns false
+   * if the envelope does not match the key or the algorithm.
+   */
+  bool Update(const void *in, size_t size,
+              const unsigned char **plaintext, size_t *plaintext_size);
+  /**
+   * Start over with a new stream, e.g. for a download retry.
+   */
+  void Reset();
+
+ private:
+  bool InitContext();
+
+  const Key *key_;
+  evp_cipher_ctx_st *ctx_;
+  bool ctx_initialized_;
+  std::string header_;
+  unsigned char *buffer_;
+  size_t buffer_size_;
+};
+
+
 /**
  * No encryption, plaintext and ciphertext are identical.  For testing.
  */
@@ -5,21 +5,72 @@
 #include "cvmfs_config.h"
 #include "fetch.h"
 
+#include <errno.h>
+#include <inttypes.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <map>
+
 #include "backoff.h"
 #include "cache.h"
 #include "clientctx.h"
 #include "download.h"
+#include "fetch_timing.h"
 #include "logging.h"
+#include "pack.h"
+#include "platform.h"
 #include "quota.h"
 #include "statistics.h"
+#include "uid_accounting.h"
+#include "util/pointer.h"
 #include "util/posix.h"
+#include "util/probes.h"
+#include "util/string.h"
 
 using namespace std;  // NOLINT
 
 namespace cvmfs {
 
+namespace {
+
+/**
+ * Writes into a caller provided buffer of fixed capacity.  Writing beyond the
+ * capacity fails, which aborts the download, e.g. if a server ignores the
+ * range header and sends the entire object.
+ */
+class BufferSink : public Sink {
+ public:
+  BufferSink(void *buffer, uint64_t capacity)
+    : buffer_(static_cast<unsigned char *>(buffer))
+    , capacity_(capacity)
+    , pos_(0)
+  { }
+  virtual ~BufferSink() { }
+  virtual int64_t Write(const void *buf, uint64_t sz) {
+    if (pos_ + sz > capacity_)
+      return -ENOSPC;
+    memcpy(buffer_ + pos_, buf, sz);
+    pos_ += sz;
+    return sz;
+  }
+  virtual int Reset() {
+    pos_ = 0;
+    return 0;
+  }
+  uint64_t pos() const { return pos_; }
+
+ private:
+  unsigned char *buffer_;
+  uint64_t capacity_;
+  uint64_t pos_;
+};
+
+}  // anonymous namespace
+
+
 void TLSDestructor(void *data) {
   Fetcher::ThreadLocalStorage *tls =
     static_cast<Fetcher::ThreadLocalStorage *>(data);
@@ -83,12 +134,15 @@ int Fetcher::Fetch(
   const std::string &alt_url,
   off_t range_offset)
 {
+  perf::HistogramTimer latency_timer(lat_fetch);
+  const uint64_t fetch_start_ns = platform_monotonic_time_ns();
   int fd_return;  // Read-only file descriptor that is returned
   int retval;
 
   // Try to open from local cache
   if ((fd_return = OpenSelect(id, name, object_type)) >= 0) {
     LogCvmfs(kLogCache, kLogDebug, "hit: %s", name.c_str());
+    AccountHit();
     return fd_return;
   }
 
@@ -100,6 +154,7 @@ int Fetcher::Fetch(
   ThreadQueues::iterator iDownloadQueue = queues_download_.find(id);
   if (iDownloadQueue != queues_download_.end()) {
     LogCvmfs(kLogCache, kLogDebug, "waiting for download of %s", name.c_str());
+    CVMFS_PROBE1(fetch_collapse, name.c_str());
 
     iDownloadQueue->second->push_back(tls->pipe_wait[1]);
     pthread_mutex_unlock(lock_queues_download_);
@@ -107,12 +162,19 @@ int Fetcher::Fetch(
 
     LogCvmfs(kLogCache, kLogDebug, "received from another thread fd %d for %s",
              fd_return, name.c_str());
+    FetchTiming timing;
+    timing.id = id;
+    timing.name = name;
+    timing.size = size;
+    timing.collapsed = true;
+    RecordTiming(fd_return, fetch_start_ns, &timing);
     return fd_return;
   } else {
     // Seems we are the first one, check again in the cache (race condition)
     fd_return = OpenSelect(id, name, object_type);
     if (fd_return >= 0) {
       pthread_mutex_unlock(lock_queues_download_);
+      AccountHit();
       return fd_return;
     }
 
@@ -121,6 +183,10 @@ int Fetcher::Fetch(
     pthread_mutex_unlock(lock_queues_download_);
   }
 
+  if (IsFailFast(id, name)) {
+    SignalWaitingThreads(-EIO, id, tls);
+    return -EIO;
+  }
   perf::Inc(n_downloads);
 
   // Involve the download manager
@@ -132,7 +198,18 @@ int Fetcher::Fetch(
     url = "/" + (alt_url.size() ? alt_url : "data/" + id.MakePath());
   }
   void *txn = alloca(cache_mgr_->SizeOfTxn());
+  const uint64_t txn_start_ns = platform_monotonic_time_ns();
   retval = cache_mgr_->StartTxn(id, size, txn);
+  // Another process sharing the cache directory has stored the object
+  // meanwhile.  If it got evicted again before we could open it, download it.
+  if (retval == -EEXIST) {
+    retval = OpenSelect(id, name, object_type);
+    if (retval >= 0) {
+      SignalWaitingThreads(retval, id, tls);
+      return retval;
+    }
+    retval = cache_mgr_->StartTxn(id, size, txn);
+  }
   if (retval < 0) {
     LogCvmfs(kLogCache, kLogDebug, "could not start transaction on %s",
              name.c_str());
@@ -140,8 +217,11 @@ int Fetcher::Fetch(
     return retval;
   }
   cache_mgr_->CtrlTxn(CacheManager::ObjectInfo(object_type, name), 0, txn);
+  FetchTiming timing;
+  timing.txn_us = (platform_monotonic_time_ns() - txn_start_ns) / 1000;
 
   LogCvmfs(kLogCache, kLogDebug, "miss: %s %s", name.c_str(), url.c_str());
+  CVMFS_PROBE2(fetch_miss, name.c_str(), size);
   TransactionSink sink(cache_mgr_, txn);
   tls->download_job.url = &url;
   tls->download_job.destination_sink = &sink;
@@ -153,43 +233,572 @@ int Fetcher::Fetch(
              &tls->download_job.gid,
              &tls->download_job.pid);
   }
-  tls->download_job.compressed = (compression_algorithm == zlib::kZlibDefault);
+  tls->download_job.compressed =
+    (compression_algorithm != zlib::kNoCompression);
+  tls->download_job.compression_alg = compression_algorithm;
   tls->download_job.range_offset = range_offset;
   tls->download_job.range_size = size;
+  tls->download_job.priority = GetPriority(object_type, size);
+  const uint64_t start_ns = platform_monotonic_time_ns();
   download_mgr_->Fetch(&tls->download_job);
+  AccountDownload(tls->download_job, size, start_ns);
+
+  uint64_t commit_ns;
+  fd_return = FinalizeDownload(tls->download_job, id, name, txn,
+                               &tls->other_pipes_waiting, &commit_ns);
+  timing.id = id;
+  timing.name = name;
+  timing.size = size;
+  timing.SetDownload(tls->download_job);
+  timing.commit_us = commit_ns / 1000;
+  RecordTiming(fd_return, fetch_start_ns, &timing);
+  return fd_return;
+}
+
+
+/**
+ * Commits or aborts the transaction of a finished download and passes the
+ * result on to the threads that are waiting for the same object.  The time
+ * spent on the cache transaction is returned in commit_ns.
+ */
+int Fetcher::FinalizeDownload(
+  const download::JobInfo &download_job,
+  const shash::Any &id,
+  const std::string &name,
+  void *txn,
+  std::vector<int> *other_pipes_waiting,
+  uint64_t *commit_ns)
+{
+  int fd_return;
+  int retval;
+  const uint64_t start_ns = platform_monotonic_time_ns();
 
-  if (tls->download_job.error_code == download::kFailOk) {
-    LogCvmfs(kLogCache, kLogDebug, "finished downloading of %s", url.c_str());
+  if (download_job.error_code == download::kFailOk) {
+    LogCvmfs(kLogCache, kLogDebug, "finished downloading of %s",
+             download_job.url->c_str());
 
     fd_return = cache_mgr_->OpenFromTxn(txn);
     if (fd_return < 0) {
       cache_mgr_->AbortTxn(txn);
-      SignalWaitingThreads(fd_return, id, tls);
+      *commit_ns = platform_monotonic_time_ns() - start_ns;
+      SignalWaitingThreads(fd_return, id, other_pipes_waiting);
       return fd_return;
     }
 
     retval = cache_mgr_->CommitTxn(txn);
+    *commit_ns = platform_monotonic_time_ns() - start_ns;
     if (retval < 0) {
       cache_mgr_->Close(fd_return);
-      SignalWaitingThreads(retval, id, tls);
+      SignalWaitingThreads(retval, id, other_pipes_waiting);
       return retval;
     }
-    SignalWaitingThreads(fd_return, id, tls);
+    SignalWaitingThreads(fd_return, id, other_pipes_waiting);
     return fd_return;
   }
 
   // Download failed
   LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
            "failed to fetch %s (hash: %s, error %d [%s])", name.c_str(),
-           id.ToString().c_str(), tls->download_job.error_code,
-           download::Code2Ascii(tls->download_job.error_code));
+           id.ToString().c_str(), download_job.error_code,
+           download::Code2Ascii(download_job.error_code));
   cache_mgr_->AbortTxn(txn);
+  *commit_ns = platform_monotonic_time_ns() - start_ns;
+  RememberFailure(id);
   backoff_throttle_->Throttle();
-  SignalWaitingThreads(-EIO, id, tls);
+  SignalWaitingThreads(-EIO, id, other_pipes_waiting);
   return -EIO;
 }
 
 
+void Fetcher::EnableFastFail(const unsigned ttl_s) {
+  fast_fail_ttl_s_ = ttl_s;
+}
+
+
+/**
+ * Called by the downloading thread before it starts the download.  True if
+ * the object failed recently or if no host or proxy is currently reachable.
+ * The circuit breakers of the download manager let a probe through from time
+ * to time, so the mount recovers by itself once the network is back.
+ */
+bool Fetcher::IsFailFast(const shash::Any &id, const std::string &name) {
+  if (fast_fail_ttl_s_ == 0)
+    return false;
+
+  bool is_failed = false;
+  pthread_mutex_lock(lock_failed_objects_);
+  std::map<shash::Any, uint64_t>::iterator iter = failed_objects_.find(id);
+  if (iter != failed_objects_.end()) {
+    if (iter->second > platform_monotonic_time_ns() / (1000 * 1000))
+      is_failed = true;
+    else
+      failed_objects_.erase(iter);
+  }
+  pthread_mutex_unlock(lock_failed_objects_);
+  if (is_failed) {
+    LogCvmfs(kLogCache, kLogDebug, "%s failed recently, not retrying",
+             name.c_str());
+    perf::Inc(n_fast_fail);
+    return true;
+  }
+
+  if (download_mgr_->IsDegraded()) {
+    LogCvmfs(kLogCache, kLogDebug, "no endpoint reachable, not fetching %s",
+             name.c_str());
+    perf::Inc(n_fast_fail);
+    return true;
+  }
+  return false;
+}
+
+
+void Fetcher::RememberFailure(const shash::Any &id) {
+  if (fast_fail_ttl_s_ == 0)
+    return;
+  const uint64_t deadline_ms = platform_monotonic_time_ns() / (1000 * 1000) +
+                               uint64_t(fast_fail_ttl_s_) * 1000;
+  pthread_mutex_lock(lock_failed_objects_);
+  if (failed_objects_.size() >= kMaxFailedObjects)
+    failed_objects_.clear();
+  failed_objects_[id] = deadline_ms;
+  pthread_mutex_unlock(lock_failed_objects_);
+}
+
+
+namespace {
+
+/**
+ * Stores the objects of a deserialized bundle in the cache.  The bundle is
+ * consumed in one piece, so that every object arrives in a single event.
+ */
+class BundleCommitter {
+ public:
+  explicit BundleCommitter(CacheManager *cache_mgr)
+    : cache_mgr(cache_mgr)
+    , num_committed(0)
+    , num_failed(0)
+  { }
+
+  void OnObject(const ObjectPackBuild::Event &event) {
+    if ((event.buf_size != event.size) ||
+        !cache_mgr->CommitFromMem(event.id,
+                                  static_cast<const unsigned char *>(event.buf),
+                                  event.size, "bundle"))
+    {
+      num_failed++;
+      return;
+    }
+    num_committed++;
+  }
+
+  CacheManager *cache_mgr;
+  unsigned num_committed;
+  unsigned num_failed;
+};
+
+}  // anonymous namespace
+
+
+/**
+ * Downloads a bundle of small objects in one go and stores all of its objects
+ * in the cache.  Returns the number of stored objects or -EIO.  Concurrent
+ * requests for the same bundle are collapsed; the waiting threads get the
+ * result of the downloading thread.  Unlike Fetch(), no file descriptor is
+ * returned.  The caller opens the object it is interested in afterwards.
+ */
+int Fetcher::FetchBundle(
+  const shash::Any &bundle_id,
+  const std::string &name,
+  const zlib::Algorithms compression_algorithm)
+{
+  assert(!external_);
+  ThreadLocalStorage *tls = GetTls();
+  int result;
+
+  pthread_mutex_lock(lock_queues_download_);
+  ThreadQueues::iterator iDownloadQueue = queues_download_.find(bundle_id);
+  if (iDownloadQueue != queues_download_.end()) {
+    LogCvmfs(kLogCache, kLogDebug, "waiting for download of bundle %s",
+             bundle_id.ToString().c_str());
+    iDownloadQueue->second->push_back(tls->pipe_wait[1]);
+    pthread_mutex_unlock(lock_queues_download_);
+    ReadPipe(tls->pipe_wait[0], &result, sizeof(int));
+    return result;
+  }
+  queues_download_[bundle_id] = &tls->other_pipes_waiting;
+  pthread_mutex_unlock(lock_queues_download_);
+
+  perf::Inc(n_downloads);
+  const std::string url = "/data/" + bundle_id.MakePath();
+  download::JobInfo download_job(&url,
+                                 compression_algorithm != zlib::kNoCompression,
+                                 true, &bundle_id);
+  download_job.compression_alg = compression_algorithm;
+  download_job.extra_info = &name;
+  download_job.priority = download::kPriorityBulk;
+  ClientCtx *ctx = ClientCtx::GetInstance();
+  if (ctx->IsSet())
+    ctx->Get(&download_job.uid, &download_job.gid, &download_job.pid);
+  const uint64_t start_ns = platform_monotonic_time_ns();
+  download_mgr_->Fetch(&download_job);
+  AccountDownload(download_job, download_job.destination_mem.pos, start_ns);
+
+  if (download_job.error_code == download::kFailOk) {
+    const unsigned char *buffer = reinterpret_cast<const unsigned char *>(
+      download_job.destination_mem.data);
+    result = CommitBundle(bundle_id, buffer, download_job.destination_mem.pos);
+  } else {
+    LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
+             "failed to fetch bundle of %s (hash: %s, error %d [%s])",
+             name.c_str(), bundle_id.ToString().c_str(),
+             download_job.error_code,
+             download::Code2Ascii(download_job.error_code));
+    backoff_throttle_->Throttle();
+    result = -EIO;
+  }
+  free(download_job.destination_mem.data);
+
+  // Like SignalWaitingThreads() but there are no file descriptors to pass on
+  pthread_mutex_lock(lock_queues_download_);
+  for (unsigned i = 0; i < tls->other_pipes_waiting.size(); ++i)
+    WritePipe(tls->other_pipes_waiting[i], &result, sizeof(int));
+  tls->other_pipes_waiting.clear();
+  queues_download_.erase(bundle_id);
+  pthread_mutex_unlock(lock_queues_download_);
+  return result;
+}
+
+
+/**
+ * Downloads size bytes at offset of an uncompressed object into buffer by an
+ * HTTP range request.  The data bypass the cache and cannot be verified
+ * against the content hash, so the caller has to check them against the block
+ * digests of the file (DigestTree).  Returns
+ * the number of bytes received or -EIO.  Servers that do not honor the range
+ * result in an error, too.
+ */
+int64_t Fetcher::FetchRange(
+  const shash::Any &id,
+  const std::string &name,
+  const uint64_t offset,
+  const uint64_t size,
+  void *buffer)
+{
+  if (size == 0)
+    return 0;
+
+  perf::Inc(n_range_requests);
+  const std::string url = "/data/" + id.MakePath();
+  BufferSink sink(buffer, size);
+  download::JobInfo download_job(&url, false, true, &sink, NULL);
+  download_job.extra_info = &name;
+  download_job.range_offset = offset;
+  download_job.range_size = size;
+  ClientCtx *ctx = ClientCtx::GetInstance();
+  if (ctx->IsSet())
+    ctx->Get(&download_job.uid, &download_job.gid, &download_job.pid);
+  download_mgr_->Fetch(&download_job);
+
+  if ((download_job.error_code != download::kFailOk) ||
+      (download_job.http_code != 206))
+  {
+    LogCvmfs(kLogCache, kLogDebug,
+             "failed to fetch range %" PRIu64 "-%" PRIu64 " of %s "
+             "(hash: %s, http code %d, error %d [%s])",
+             offset, offset + size - 1, name.c_str(), id.ToString().c_str(),
+             download_job.http_code, download_job.error_code,
+             download::Code2Ascii(download_job.error_code));
+    return -EIO;
+  }
+  return sink.pos();
+}
+
+
+/**
+ * A bundle is a serialized ObjectPack.  Its integrity is already verified by
+ * the content hash of the bundle, so the header digest that the consumer
+ * expects is calculated from the buffer itself.  The size of the header
+ * follows from the payload size that is recorded in the header.
+ */
+int Fetcher::CommitBundle(
+  const shash::Any &bundle_id,
+  const unsigned char *buffer,
+  const uint64_t size)
+{
+  std::map<char, std::string> header;
+  ParseKeyvalMem(buffer, static_cast<unsigned>(size), &header);
+  const uint64_t payload_size = (header.find('S') != header.end()) ?
+                                String2Uint64(header['S']) : size + 1;
+  const uint64_t num_objects = (header.find('N') != header.end()) ?
+                               String2Uint64(header['N']) : 0;
+  // The header ends with the separator and one index line per object
+  bool header_valid = (payload_size < size) &&
+                      (buffer[size - payload_size - 1] == '\n');
+  if (header_valid) {
+    const std::string raw_header(reinterpret_cast<const char *>(buffer),
+                                 size - payload_size);
+    const size_t separator_idx = raw_header.find("\n--\n");
+    header_valid = (separator_idx != std::string::npos) &&
+      (static_cast<uint64_t>(std::count(raw_header.begin() + separator_idx + 4,
+                                        raw_header.end(), '\n')) ==
+       num_objects);
+  }
+  if (!header_valid) {
+    LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr, "malformed bundle %s",
+             bundle_id.ToString().c_str());
+    return -EIO;
+  }
+  const uint64_t header_size = size - payload_size;
+  shash::Any header_digest(bundle_id.algorithm);
+  shash::HashMem(buffer, header_size, &header_digest);
+
+  BundleCommitter committer(cache_mgr_);
+  // The consumer has a large accumulator, keep it off the stack
+  UniquePtr<ObjectPackConsumer> consumer(
+    new ObjectPackConsumer(header_digest, header_size));
+  consumer->RegisterListener(&BundleCommitter::OnObject, &committer);
+  const ObjectPackBuild::State state =
+    consumer->ConsumeNext(static_cast<unsigned>(size), buffer);
+  perf::Xadd(n_bundle_objects, committer.num_committed);
+  if ((state != ObjectPackBuild::kStateDone) || (committer.num_failed > 0)) {
+    LogCvmfs(kLogCache, kLogDebug | kLogSyslogErr,
+             "failed to store bundle %s (state %d, %u objects failed)",
+             bundle_id.ToString().c_str(), state, committer.num_failed);
+    return -EIO;
+  }
+  LogCvmfs(kLogCache, kLogDebug, "stored %u objects of bundle %s",
+           committer.num_committed, bundle_id.ToString().c_str());
+  return committer.num_committed;
+}
+
+
+/**
+ * Fetches a set of objects at once.  Objects that are not in the cache are
+ * downloaded concurrently by a single FetchMany() call to the download manager
+ * and committed to the cache as soon as they arrive.  Like for Fetch(),
+ * downloads are collapsed: duplicates within the request are downloaded only
+ * once and objects that are currently downloaded by another thread are waited
+ * for after the own downloads finished.  The caller owns the returned file
+ * descriptors.
+ */
+void Fetcher::FetchMany(std::vector<FetchRequest> *requests) {
+  const uint64_t fetch_start_ns = platform_monotonic_time_ns();
+  int retval;
+  BatchDownloads downloads;
+  std::vector<download::JobInfo *> download_jobs;
+  // Index of the first request for each object
+  std::map<shash::Any, unsigned> first_requests;
+  std::vector<unsigned> duplicates;
+  std::vector<unsigned> collapsed;
+
+  ClientCtx *ctx = ClientCtx::GetInstance();
+  for (unsigned i = 0; i < requests->size(); ++i) {
+    FetchRequest *request = &(*requests)[i];
+    if (first_requests.find(request->id) != first_requests.end()) {
+      duplicates.push_back(i);
+      continue;
+    }
+    first_requests[request->id] = i;
+
+    if ((request->fd = OpenSelect(request->id, request->name,
+                                  request->object_type)) >= 0)
+    {
+      LogCvmfs(kLogCache, kLogDebug, "hit: %s", request->name.c_str());
+      AccountHit();
+      continue;
+    }
+
+    pthread_mutex_lock(lock_queues_download_);
+    if (queues_download_.find(request->id) != queues_download_.end()) {
+      pthread_mutex_unlock(lock_queues_download_);
+      collapsed.push_back(i);
+      continue;
+    }
+    // Check again in the cache (race condition)
+    request->fd = OpenSelect(request->id, request->name, request->object_type);
+    if (request->fd >= 0) {
+      pthread_mutex_unlock(lock_queues_download_);
+      AccountHit();
+      continue;
+    }
+    BatchDownload *download = new BatchDownload();
+    download->request = request;
+    queues_download_[request->id] = &download->other_pipes_waiting;
+    pthread_mutex_unlock(lock_queues_download_);
+
+    if (IsFailFast(request->id, request->name)) {
+      SignalWaitingThreads(-EIO, request->id, &download->other_pipes_waiting);
+      request->fd = -EIO;
+      delete download;
+      continue;
+    }
+    perf::Inc(n_downloads);
+    if (external_)
+      download->url = request->name;
+    else
+      download->url = "/data/" + request->id.MakePath();
+    download->txn = smalloc(cache_mgr_->SizeOfTxn());
+    const uint64_t txn_start_ns = platform_monotonic_time_ns();
+    retval = cache_mgr_->StartTxn(request->id, request->size, download->txn);
+    if (retval == -EEXIST) {
+      retval = OpenSelect(request->id, request->name, request->object_type);
+      if (retval >= 0) {
+        SignalWaitingThreads(retval, request->id,
+                             &download->other_pipes_waiting);
+        request->fd = retval;
+        delete download;
+        continue;
+      }
+      retval = cache_mgr_->StartTxn(request->id, request->size, download->txn);
+    }
+    if (retval < 0) {
+      LogCvmfs(kLogCache, kLogDebug, "could not start transaction on %s",
+               request->name.c_str());
+      SignalWaitingThreads(retval, request->id,
+                           &download->other_pipes_waiting);
+      request->fd = retval;
+      delete download;
+      continue;
+    }
+    cache_mgr_->CtrlTxn(
+      CacheManager::ObjectInfo(request->object_type, request->name), 0,
+      download->txn);
+    download->txn_ns = platform_monotonic_time_ns() - txn_start_ns;
+
+    LogCvmfs(kLogCache, kLogDebug, "miss: %s %s", request->name.c_str(),
+             download->url.c_str());
+    download->sink = new TransactionSink(cache_mgr_, download->txn);
+    download::JobInfo *job = &download->download_job;
+    job->url = &download->url;
+    job->destination = download::kDestinationSink;
+    job->destination_sink = download->sink;
+    job->expected_hash = &request->id;
+    job->extra_info = &request->name;
+    job->probe_hosts = true;
+    if (ctx->IsSet())
+      ctx->Get(&job->uid, &job->gid, &job->pid);
+    job->compressed = (request->compression_algorithm != zlib::kNoCompression);
+    job->compression_alg = request->compression_algorithm;
+    job->range_size = request->size;
+    job->priority = request->priority;
+    download->fetch_start_ns = fetch_start_ns;
+    download->start_ns = platform_monotonic_time_ns();
+    downloads[job] = download;
+    download_jobs.push_back(job);
+  }
+
+  BoundClosure<download::JobInfo *, Fetcher, BatchDownloads *>
+    on_done(&Fetcher::OnBatchJobDone, this, &downloads);
+  download_mgr_->FetchMany(download_jobs, &on_done);
+  for (BatchDownloads::iterator i = downloads.begin(), iEnd = downloads.end();
+       i != iEnd; ++i)
+  {
+    delete i->second;
+  }
+
+  // Objects downloaded by other threads; Fetch() finds them in the cache or
+  // enqueues to the waiting threads
+  for (unsigned i = 0; i < collapsed.size(); ++i) {
+    FetchRequest *request = &(*requests)[collapsed[i]];
+    request->fd = Fetch(request->id, request->size, request->name,
+                        request->compression_algorithm, request->object_type);
+  }
+
+  for (unsigned i = 0; i < duplicates.size(); ++i) {
+    FetchRequest *request = &(*requests)[duplicates[i]];
+    const int fd = (*requests)[first_requests[request->id]].fd;
+    request->fd = (fd >= 0) ? cache_mgr_->Dup(fd) : fd;
+  }
+}
+
+
+/**
+ * Catalogs come first because every path lookup below them waits for them.
+ * Large objects are mostly read sequentially by a single process that can
+ * make progress with the data that arrive; they should not hold up the many
+ * small files that a process opens one after another.
+ */
+download::Priority Fetcher::GetPriority(
+  const CacheManager::ObjectType object_type,
+  const uint64_t size)
+{
+  if (object_type == CacheManager::kTypeCatalog)
+    return download::kPriorityMetadata;
+  if ((size != CacheManager::kSizeUnknown) && (size >= kBulkMinSize))
+    return download::kPriorityBulk;
+  return download::kPriorityInteractive;
+}
+
+
+void Fetcher::AccountHit() {
+  perf::Inc(n_hits);
+  if (uid_accounting_ != NULL)
+    uid_accounting_->RecordHit();
+}
+
+
+/**
+ * Books a finished download on the uid of the requesting process, if uid
+ * accounting is enabled.
+ */
+void Fetcher::AccountDownload(
+  const download::JobInfo &download_job,
+  const uint64_t size,
+  const uint64_t start_ns)
+{
+  if (uid_accounting_ == NULL)
+    return;
+  const uint64_t duration_us = (platform_monotonic_time_ns() - start_ns) / 1000;
+  uid_accounting_->RecordDownload(
+    size, duration_us, download_job.error_code == download::kFailOk);
+}
+
+
+/**
+ * Completes the timing of a download or of a wait for another thread's
+ * download with the requesting process and the overall time.
+ */
+void Fetcher::RecordTiming(
+  const int result,
+  const uint64_t start_ns,
+  FetchTiming *timing)
+{
+  if (fetch_timing_log_ == NULL)
+    return;
+  timing->result = result;
+  timing->timestamp = time(NULL);
+  timing->total_us = (platform_monotonic_time_ns() - start_ns) / 1000;
+  ClientCtx *ctx = ClientCtx::GetInstance();
+  if (ctx->IsSet()) {
+    gid_t gid;
+    ctx->Get(&timing->uid, &gid, &timing->pid);
+  }
+  fetch_timing_log_->Record(*timing);
+}
+
+
+void Fetcher::OnBatchJobDone(
+  download::JobInfo * const &download_job,
+  BatchDownloads *downloads)
+{
+  BatchDownload *download = (*downloads)[download_job];
+  FetchRequest *request = download->request;
+  AccountDownload(*download_job, request->size, download->start_ns);
+  uint64_t commit_ns;
+  request->fd = FinalizeDownload(*download_job, request->id, request->name,
+                                 download->txn, &download->other_pipes_waiting,
+                                 &commit_ns);
+  FetchTiming timing;
+  timing.id = request->id;
+  timing.name = request->name;
+  timing.size = request->size;
+  timing.txn_us = download->txn_ns / 1000;
+  timing.SetDownload(*download_job);
+  timing.commit_us = commit_ns / 1000;
+  RecordTiming(request->fd, download->fetch_start_ns, &timing);
+}
+
+
 Fetcher::Fetcher(
   CacheManager *cache_mgr,
   download::DownloadManager *download_mgr,
@@ -202,6 +811,10 @@ Fetcher::Fetcher(
   , cache_mgr_(cache_mgr)
   , download_mgr_(download_mgr)
   , backoff_throttle_(backoff_throttle)
+  , uid_accounting_(NULL)
+  , fetch_timing_log_(NULL)
+  , fast_fail_ttl_s_(0)
+  , lock_failed_objects_(NULL)
 {
   int retval;
   retval = pthread_key_create(&thread_local_storage_, TLSDestructor);
@@ -214,8 +827,23 @@ Fetcher::Fetcher(
     smalloc(sizeof(pthread_mutex_t)));
   retval = pthread_mutex_init(lock_tls_blocks_, NULL);
   assert(retval == 0);
+  lock_failed_objects_ = reinterpret_cast<pthread_mutex_t *>(
+    smalloc(sizeof(pthread_mutex_t)));
+  retval = pthread_mutex_init(lock_failed_objects_, NULL);
+  assert(retval == 0);
   n_downloads = statistics.RegisterTemplated("n_downloads",
     "overall number of downloaded files (incl. catalogs, chunks)");
+  n_hits = statistics.RegisterTemplated("n_hits",
+    "number of objects served from the local cache (incl. catalogs, chunks)");
+  n_bundle_objects = statistics.RegisterTemplated("n_bundle_objects",
+    "number of objects stored in the cache from downloaded bundles");
+  n_range_requests = statistics.RegisterTemplated("n_range_requests",
+    "number of partial reads of not yet cached objects by range requests");
+  n_fast_fail = statistics.RegisterTemplated("n_fast_fail",
+    "number of fetches failed without download attempt (recent failure or "
+    "no reachable host)");
+  lat_fetch = statistics.RegisterTemplatedHistogram("lat_fetch",
+    "latency of object fetches incl. cache hits (microseconds)");
 }
 
 
@@ -235,6 +863,10 @@ Fetcher::~Fetcher() {
   assert(retval == 0);
   free(lock_queues_download_);
 
+  retval = pthread_mutex_destroy(lock_failed_objects_);
+  assert(retval == 0);
+  free(lock_failed_objects_);
+
   retval = pthread_key_delete(thread_local_storage_);
   assert(retval == 0);
 }
@@ -262,13 +894,22 @@ void Fetcher::SignalWaitingThreads(
   const int fd,
   const shash::Any &id,
   ThreadLocalStorage *tls)
+{
+  SignalWaitingThreads(fd, id, &tls->other_pipes_waiting);
+}
+
+
+void Fetcher::SignalWaitingThreads(
+  const int fd,
+  const shash::Any &id,
+  std::vector<int> *other_pipes_waiting)
 {
   pthread_mutex_lock(lock_queues_download_);
-  for (unsigned i = 0, s = tls->other_pipes_waiting.size(); i < s; ++i) {
+  for (unsigned i = 0, s = other_pipes_waiting->size(); i < s; ++i) {
     int fd_dup = (fd >= 0) ? cache_mgr_->Dup(fd) : fd;
-    WritePipe(tls->other_pipes_waiting[i], &fd_dup, sizeof(int));
+    WritePipe((*other_pipes_waiting)[i], &fd_dup, sizeof(int));
   }
-  tls->other_pipes_waiting.clear();
+  other_pipes_waiting->clear();
   queues_download_.erase(id);
   pthread_mutex_unlock(lock_queues_download_);
 }
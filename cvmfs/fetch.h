@@ -6,7 +6,9 @@
 #define CVMFS_FETCH_H_
 
 #include <pthread.h>
+#include <stdint.h>
 
+#include <cstdlib>
 #include <map>
 #include <string>
 #include <vector>
@@ -16,6 +18,7 @@
 #include "gtest/gtest_prod.h"
 #include "hash.h"
 #include "sink.h"
+#include "util/async.h"
 
 class BackoffThrottle;
 
@@ -25,6 +28,10 @@ class Statistics;
 
 namespace cvmfs {
 
+class FetchTimingLog;
+struct FetchTiming;
+class UidAccounting;
+
 /**
  * TransacionSink uses an open transaction in a cache manager as a sink.  It
  * allows the download manager to write data without knowing about the cache
@@ -61,6 +68,9 @@ class TransactionSink : public Sink {
 class Fetcher : SingleCopy {
   FRIEND_TEST(T_Fetcher, GetTls);
   FRIEND_TEST(T_Fetcher, SignalWaitingThreads);
+  FRIEND_TEST(T_Fetcher, FetchMany);
+  FRIEND_TEST(T_Fetcher, CommitBundle);
+  FRIEND_TEST(T_Fetcher, FastFail);
   friend void *TestGetTls(void *data);
   friend void *TestFetchCollapse(void *data);
   friend void *TestFetchCollapse2(void *data);
@@ -81,11 +91,101 @@ class Fetcher : SingleCopy {
             const CacheManager::ObjectType object_type,
             const std::string &alt_url = "",
             off_t range_offset = -1);
+  /**
+   * Like Fetch() but returns a negative error code instead of downloading the
+   * object if it is not in the cache.  Never blocks on the network.
+   */
+  int FetchCached(const shash::Any &id,
+                  const std::string &name,
+                  const CacheManager::ObjectType object_type)
+  {
+    return OpenSelect(id, name, object_type);
+  }
+
+  /**
+   * Objects of at least this size are downloaded as bulk data
+   */
+  static const uint64_t kBulkMinSize = 1024 * 1024;
+  static download::Priority GetPriority(
+    const CacheManager::ObjectType object_type,
+    const uint64_t size);
+
+  /**
+   * One object requested through FetchMany().  On return, fd is set to the
+   * result that Fetch() would have returned for the object.  The priority is
+   * derived from the object type and size; callers may lower it for
+   * speculative requests.
+   */
+  struct FetchRequest {
+    FetchRequest()
+      : size(0)
+      , compression_algorithm(zlib::kZlibDefault)
+      , object_type(CacheManager::kTypeRegular)
+      , priority(download::kPriorityInteractive)
+      , fd(-1)
+    { }
+    FetchRequest(const shash::Any &id,
+                 const uint64_t size,
+                 const std::string &name,
+                 const zlib::Algorithms compression_algorithm,
+                 const CacheManager::ObjectType object_type)
+      : id(id)
+      , size(size)
+      , name(name)
+      , compression_algorithm(compression_algorithm)
+      , object_type(object_type)
+      , priority(GetPriority(object_type, size))
+      , fd(-1)
+    { }
+
+    shash::Any id;
+    uint64_t size;
+    std::string name;
+    zlib::Algorithms compression_algorithm;
+    CacheManager::ObjectType object_type;
+    download::Priority priority;
+    int fd;
+  };
+  void FetchMany(std::vector<FetchRequest> *requests);
+  int FetchBundle(const shash::Any &bundle_id,
+                  const std::string &name,
+                  const zlib::Algorithms compression_algorithm);
+  int64_t FetchRange(const shash::Any &id,
+                     const std::string &name,
+                     const uint64_t offset,
+                     const uint64_t size,
+                     void *buffer);
 
   CacheManager *cache_mgr() { return cache_mgr_; }
   download::DownloadManager *download_mgr() { return download_mgr_; }
+  /**
+   * Not owned by the Fetcher.  NULL disables uid accounting.
+   */
+  void set_uid_accounting(UidAccounting *uid_accounting) {
+    uid_accounting_ = uid_accounting;
+  }
+  /**
+   * Not owned by the Fetcher.  NULL disables recording the timing of
+   * downloads.
+   */
+  void set_fetch_timing_log(FetchTimingLog *fetch_timing_log) {
+    fetch_timing_log_ = fetch_timing_log;
+  }
+  /**
+   * Objects whose download failed are not downloaded again for ttl_s seconds,
+   * and no downloads are attempted while the download manager is degraded.
+   * Opening an uncached object then fails right away instead of after the
+   * timeouts and retries of all the hosts and proxies.  Cached objects are
+   * still served.
+   */
+  void EnableFastFail(const unsigned ttl_s);
 
  private:
+  /**
+   * Beyond that, the remembered failures are dropped wholesale
+   */
+  static const unsigned kMaxFailedObjects = 8192;
+
   /**
    * Multiple threads might want to download the same object at the same time.
    * If that happens, only the first thread performs the download.  The other
@@ -127,13 +227,61 @@ class Fetcher : SingleCopy {
    */
   typedef std::map< shash::Any, std::vector<int> * > ThreadQueues;
 
+  /**
+   * State of an object that is downloaded as part of FetchMany().  Takes the
+   * role of the thread local storage for the downloading thread.
+   */
+  struct BatchDownload {
+    BatchDownload()
+      : request(NULL), txn(NULL), sink(NULL), start_ns(0), fetch_start_ns(0)
+      , txn_ns(0)
+    { }
+    ~BatchDownload() {
+      delete sink;
+      free(txn);
+    }
+
+    FetchRequest *request;
+    void *txn;
+    TransactionSink *sink;
+    uint64_t start_ns;
+    uint64_t fetch_start_ns;  ///< Start of the FetchMany() call
+    uint64_t txn_ns;
+    std::string url;
+    std::vector<int> other_pipes_waiting;
+    download::JobInfo download_job;
+  };
+  typedef std::map<download::JobInfo *, BatchDownload *> BatchDownloads;
+
+  void AccountHit();
+  void AccountDownload(const download::JobInfo &download_job,
+                       const uint64_t size,
+                       const uint64_t start_ns);
+  void RecordTiming(const int result, const uint64_t start_ns,
+                    FetchTiming *timing);
+
   ThreadLocalStorage *GetTls();
   void CleanupTls(ThreadLocalStorage *tls);
   void SignalWaitingThreads(const int fd, const shash::Any &id,
                             ThreadLocalStorage *tls);
+  void SignalWaitingThreads(const int fd, const shash::Any &id,
+                            std::vector<int> *other_pipes_waiting);
+  int FinalizeDownload(const download::JobInfo &download_job,
+                       const shash::Any &id,
+                       const std::string &name,
+                       void *txn,
+                       std::vector<int> *other_pipes_waiting,
+                       uint64_t *commit_ns);
+  void OnBatchJobDone(download::JobInfo * const &download_job,
+                      BatchDownloads *downloads);
+  int CommitBundle(const shash::Any &bundle_id,
+                   const unsigned char *buffer,
+                   const uint64_t size);
   int OpenSelect(const shash::Any &id,
                  const std::string &name,
                  const CacheManager::ObjectType object_type);
+  bool IsFailFast(const shash::Any &id, const std::string &name);
+  void RememberFailure(const shash::Any &id);
 
   /**
    * If set to true, this fetcher is in 'external data' mode:
@@ -160,7 +308,24 @@ class Fetcher : SingleCopy {
   CacheManager *cache_mgr_;
   download::DownloadManager *download_mgr_;
   BackoffThrottle *backoff_throttle_;
+  UidAccounting *uid_accounting_;
+  FetchTimingLog *fetch_timing_log_;
+  /**
+   * Zero if fast fail is disabled
+   */
+  unsigned fast_fail_ttl_s_;
+  /**
+   * Failed objects and until when (monotonic time in ms) they are not
+   * downloaded again
+   */
+  std::map<shash::Any, uint64_t> failed_objects_;
+  pthread_mutex_t *lock_failed_objects_;
   perf::Counter *n_downloads;
+  perf::Counter *n_hits;
+  perf::Counter *n_bundle_objects;
+  perf::Counter *n_range_requests;
+  perf::Counter *n_fast_fail;
+  perf::Histogram *lat_fetch;
 };
 
 }  // namespace cvmfs
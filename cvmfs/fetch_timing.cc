@@ -0,0 +1,166 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "fetch_timing.h"
+
+#include <cassert>
+
+#include "cache.h"
+#include "download.h"
+#include "logging.h"
+#include "util/string.h"
+#include "util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+namespace cvmfs {
+
+namespace {
+
+string Ms(const uint64_t us) {
+  return StringifyDouble(static_cast<double>(us) / 1000.0);
+}
+
+string Describe(const FetchTiming &timing) {
+  return timing.name + " (uid " + StringifyInt(static_cast<int>(timing.uid)) +
+         ", pid " + StringifyInt(timing.pid) + ", " +
+         ((timing.size == CacheManager::kSizeUnknown) ?
+           "unknown size" : StringifyUint(timing.size) + " bytes") + ")";
+}
+
+}  // anonymous namespace
+
+
+FetchTiming::FetchTiming()
+  : size(0)
+  , timestamp(0)
+  , uid(-1)
+  , pid(-1)
+  , result(0)
+  , collapsed(false)
+  , num_retries(0)
+  , total_us(0)
+  , txn_us(0)
+  , queue_us(0)
+  , dns_us(0)
+  , connect_us(0)
+  , tls_us(0)
+  , wait_us(0)
+  , transfer_us(0)
+  , data_us(0)
+  , commit_us(0)
+{ }
+
+
+void FetchTiming::SetDownload(const download::JobInfo &download_job) {
+  num_retries = download_job.num_retries;
+  proxy = download_job.proxy;
+  queue_us = download_job.timing.queue / 1000;
+  dns_us = download_job.timing.dns / 1000;
+  connect_us = download_job.timing.connect / 1000;
+  tls_us = download_job.timing.tls / 1000;
+  wait_us = download_job.timing.wait / 1000;
+  transfer_us = download_job.timing.transfer / 1000;
+  data_us = download_job.timing.data / 1000;
+}
+
+
+/**
+ * Single line, times in milliseconds.  Used for the log, the cvmfs_talk
+ * listing, and the user.fetch_timing extended attribute.
+ */
+string FetchTiming::ToString() const {
+  string result_str = (result >= 0) ? "ok" : "error " + StringifyInt(-result);
+  if (collapsed) {
+    return "total " + Ms(total_us) + " waited for another download [" +
+           result_str + "]";
+  }
+  return "total " + Ms(total_us) +
+         " txn " + Ms(txn_us) +
+         " queue " + Ms(queue_us) +
+         " dns " + Ms(dns_us) +
+         " connect " + Ms(connect_us) +
+         " tls " + Ms(tls_us) +
+         " wait " + Ms(wait_us) +
+         " transfer " + Ms(transfer_us) +
+         " data " + Ms(data_us) +
+         " commit " + Ms(commit_us) +
+         " retries " + StringifyInt(num_retries) +
+         " proxy " + (proxy.empty() ? "n/a" : proxy) +
+         " [" + result_str + "]";
+}
+
+
+//------------------------------------------------------------------------------
+
+
+FetchTimingLog::FetchTimingLog(const unsigned threshold_ms)
+  : threshold_ms_(threshold_ms)
+  , next_(0)
+{
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+}
+
+
+FetchTimingLog::~FetchTimingLog() {
+  pthread_mutex_destroy(&lock_);
+}
+
+
+void FetchTimingLog::Record(const FetchTiming &timing) {
+  if ((threshold_ms_ > 0) &&
+      (timing.total_us >= static_cast<uint64_t>(threshold_ms_) * 1000))
+  {
+    LogCvmfs(kLogCache, kLogDebug | kLogSyslogWarn, "slow fetch of %s: %s",
+             Describe(timing).c_str(), timing.ToString().c_str());
+  }
+
+  MutexLockGuard guard(&lock_);
+  if (ring_.size() < kCapacity) {
+    ring_.push_back(timing);
+  } else {
+    ring_[next_] = timing;
+  }
+  next_ = (next_ + 1) % kCapacity;
+}
+
+
+bool FetchTimingLog::Lookup(
+  const vector<shash::Any> &ids,
+  FetchTiming *timing) const
+{
+  MutexLockGuard guard(&lock_);
+  for (unsigned i = 0; i < ring_.size(); ++i) {
+    const FetchTiming &entry =
+      ring_[(next_ + kCapacity - 1 - i) % kCapacity];
+    for (unsigned j = 0; j < ids.size(); ++j) {
+      if (entry.id == ids[j]) {
+        *timing = entry;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+
+string FetchTimingLog::Print() const {
+  string result = "Recent downloads (times in ms";
+  if (threshold_ms_ > 0)
+    result += ", logging above " + StringifyInt(threshold_ms_) + " ms";
+  result += "):\n";
+
+  MutexLockGuard guard(&lock_);
+  for (unsigned i = 0; i < ring_.size(); ++i) {
+    const FetchTiming &entry =
+      ring_[(next_ + kCapacity - 1 - i) % kCapacity];
+    result += StringifyTime(entry.timestamp, false) + " " + Describe(entry) +
+              ": " + entry.ToString() + "\n";
+  }
+  return result;
+}
+
+}  // namespace cvmfs
@@ -0,0 +1,103 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_FETCH_TIMING_H_
+#define CVMFS_FETCH_TIMING_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "hash.h"
+#include "util/single_copy.h"
+
+namespace download {
+struct JobInfo;
+}
+
+namespace cvmfs {
+
+/**
+ * Where the time of a single Fetcher operation went.  All times are in
+ * microseconds.  The download phases come from the JobInfo, the others are
+ * measured by the Fetcher.
+ */
+struct FetchTiming {
+  FetchTiming();
+  void SetDownload(const download::JobInfo &download_job);
+  std::string ToString() const;
+
+  shash::Any id;
+  std::string name;
+  uint64_t size;
+  time_t timestamp;
+  uid_t uid;
+  pid_t pid;
+  /**
+   * The file descriptor or the error code returned by the Fetcher
+   */
+  int result;
+  /**
+   * Another thread downloaded the object, the time is spent waiting for it
+   */
+  bool collapsed;
+  unsigned num_retries;
+  std::string proxy;
+
+  uint64_t total_us;
+  uint64_t txn_us;  ///< opening the cache transaction, incl. quota reservation
+  uint64_t queue_us;  ///< waiting for the download manager
+  uint64_t dns_us;
+  uint64_t connect_us;
+  uint64_t tls_us;
+  uint64_t wait_us;  ///< request sent until the first byte arrived
+  uint64_t transfer_us;
+  uint64_t data_us;  ///< hashing, decompressing, writing to the cache
+  uint64_t commit_us;  ///< committing the transaction to the cache
+};
+
+
+/**
+ * Keeps the timing of the last kCapacity downloads and collapsed waits of the
+ * Fetcher in a ring.  Cache hits are not recorded.  Operations that take at
+ * least threshold_ms are also logged to syslog; a threshold of zero disables
+ * the logging.
+ */
+class FetchTimingLog : SingleCopy {
+ public:
+  static const unsigned kCapacity = 128;
+
+  explicit FetchTimingLog(const unsigned threshold_ms);
+  ~FetchTimingLog();
+
+  void Record(const FetchTiming &timing);
+  /**
+   * Finds the most recent operation on any of the given objects, e.g. the
+   * chunks of a file.
+   */
+  bool Lookup(const std::vector<shash::Any> &ids, FetchTiming *timing) const;
+  /**
+   * Newest first, used by cvmfs_talk
+   */
+  std::string Print() const;
+
+  unsigned threshold_ms() const { return threshold_ms_; }
+
+ private:
+  unsigned threshold_ms_;
+  /**
+   * Protected by lock_, next_ points to the oldest entry once the ring is full
+   */
+  std::vector<FetchTiming> ring_;
+  unsigned next_;
+  mutable pthread_mutex_t lock_;
+};
+
+}  // namespace cvmfs
+
+#endif  // CVMFS_FETCH_TIMING_H_
@@ -42,14 +42,97 @@ unsigned FileChunkReflist::FindChunkIdx(const uint64_t off) {
 }
 
 
+/**
+ * The chunks are ordered by their offset and cover the complete file.
+ */
+uint64_t FileChunkReflist::GetFileSize() const {
+  if ((list == NULL) || (list->size() == 0))
+    return 0;
+  const FileChunk *last_chunk = list->AtPtr(list->size() - 1);
+  return last_chunk->offset() + last_chunk->size();
+}
+
+
+//------------------------------------------------------------------------------
+
+
+bool CompactChunkList::Encode(
+  const FileChunkList &chunks,
+  CompactChunkList *compact)
+{
+  if (chunks.IsEmpty())
+    return false;
+  compact->algorithm_ = chunks.AtPtr(0)->content_hash().algorithm;
+  compact->suffix_ = chunks.AtPtr(0)->content_hash().suffix;
+  compact->num_chunks_ = chunks.size();
+  compact->digests_.clear();
+  compact->sizes_.clear();
+  const unsigned digest_size = shash::kDigestSizes[compact->algorithm_];
+  compact->digests_.reserve(chunks.size() * digest_size);
+  off_t offset = 0;
+  for (unsigned i = 0; i < chunks.size(); ++i) {
+    const FileChunk *chunk = chunks.AtPtr(i);
+    if ((chunk->offset() != offset) ||
+        (chunk->content_hash().algorithm != compact->algorithm_) ||
+        (chunk->content_hash().suffix != compact->suffix_))
+    {
+      return false;
+    }
+    compact->digests_.append(
+      reinterpret_cast<const char *>(chunk->content_hash().digest),
+      digest_size);
+    // 7 bits per byte, the high bit marks a continuation
+    uint64_t size = chunk->size();
+    do {
+      unsigned char byte = size & 0x7f;
+      size >>= 7;
+      if (size > 0)
+        byte |= 0x80;
+      compact->sizes_.push_back(static_cast<char>(byte));
+    } while (size > 0);
+    offset += chunk->size();
+  }
+  return true;
+}
+
+
+void CompactChunkList::Expand(FileChunkList *chunks) const {
+  const unsigned digest_size = shash::kDigestSizes[algorithm_];
+  off_t offset = 0;
+  unsigned pos = 0;
+  for (unsigned i = 0; i < num_chunks_; ++i) {
+    uint64_t size = 0;
+    unsigned shift = 0;
+    unsigned char byte;
+    do {
+      byte = static_cast<unsigned char>(sizes_[pos++]);
+      size |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    shash::Any hash(algorithm_,
+      reinterpret_cast<const unsigned char *>(digests_.data()) +
+        i * digest_size,
+      suffix_);
+    chunks->PushBack(FileChunk(hash, offset, size));
+    offset += size;
+  }
+}
+
+
 //------------------------------------------------------------------------------
 
 
 void ChunkTables::InitLocks() {
-  lock =
-    reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
-  int retval = pthread_mutex_init(lock, NULL);
-  assert(retval == 0);
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    handle_shards[i].lock =
+      reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+    int retval = pthread_mutex_init(handle_shards[i].lock, NULL);
+    assert(retval == 0);
+    inode_shards[i].lock =
+      reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+    retval = pthread_mutex_init(inode_shards[i].lock, NULL);
+    assert(retval == 0);
+  }
 
   for (unsigned i = 0; i < kNumHandleLocks; ++i) {
     pthread_mutex_t *m =
@@ -62,10 +145,12 @@ void ChunkTables::InitLocks() {
 
 
 void ChunkTables::InitHashmaps() {
-  handle2uniqino.Init(16, 0, hasher_uint64t);
-  handle2fd.Init(16, 0, hasher_uint64t);
-  inode2chunks.Init(16, 0, hasher_uint64t);
-  inode2references.Init(16, 0, hasher_uint64t);
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    handle_shards[i].handle2uniqino.Init(16, 0, hasher_uint64t);
+    handle_shards[i].handle2fd.Init(16, 0, hasher_uint64t);
+    inode_shards[i].inode2chunks.Init(16, 0, hasher_uint64t);
+    inode_shards[i].inode2references.Init(16, 0, hasher_uint64t);
+  }
 }
 
 
@@ -78,8 +163,12 @@ ChunkTables::ChunkTables() {
 
 
 ChunkTables::~ChunkTables() {
-  pthread_mutex_destroy(lock);
-  free(lock);
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    pthread_mutex_destroy(handle_shards[i].lock);
+    free(handle_shards[i].lock);
+    pthread_mutex_destroy(inode_shards[i].lock);
+    free(inode_shards[i].lock);
+  }
   for (unsigned i = 0; i < kNumHandleLocks; ++i) {
     pthread_mutex_destroy(handle_locks.At(i));
     free(handle_locks.At(i));
@@ -99,10 +188,12 @@ ChunkTables &ChunkTables::operator= (const ChunkTables &other) {
   if (&other == this)
     return *this;
 
-  handle2uniqino.Clear();
-  handle2fd.Clear();
-  inode2chunks.Clear();
-  inode2references.Clear();
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    handle_shards[i].handle2uniqino.Clear();
+    handle_shards[i].handle2fd.Clear();
+    inode_shards[i].inode2chunks.Clear();
+    inode_shards[i].inode2references.Clear();
+  }
   CopyFrom(other);
   return *this;
 }
@@ -111,10 +202,12 @@ ChunkTables &ChunkTables::operator= (const ChunkTables &other) {
 void ChunkTables::CopyFrom(const ChunkTables &other) {
   assert(version == other.version);
   next_handle = other.next_handle;
-  inode2references = other.inode2references;
-  inode2chunks = other.inode2chunks;
-  handle2fd = other.handle2fd;
-  handle2uniqino = other.handle2uniqino;
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    inode_shards[i].inode2references = other.inode_shards[i].inode2references;
+    inode_shards[i].inode2chunks = other.inode_shards[i].inode2chunks;
+    handle_shards[i].handle2fd = other.handle_shards[i].handle2fd;
+    handle_shards[i].handle2uniqino = other.handle_shards[i].handle2uniqino;
+  }
 }
 
 
@@ -127,6 +220,59 @@ pthread_mutex_t *ChunkTables::Handle2Lock(const uint64_t handle) const {
 }
 
 
+/**
+ * Uses the low bits of the hash; the handle locks use the high bits.
+ */
+ChunkTables::HandleShard *ChunkTables::Handle2Shard(const uint64_t handle) {
+  return &handle_shards[hasher_uint64t(handle) % kNumShards];
+}
+
+
+ChunkTables::InodeShard *ChunkTables::Inode2Shard(const uint64_t inode) {
+  return &inode_shards[hasher_uint64t(inode) % kNumShards];
+}
+
+
+uint64_t ChunkTables::GetNumHandles() {
+  uint64_t result = 0;
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    handle_shards[i].Lock();
+    result += handle_shards[i].handle2fd.size();
+    handle_shards[i].Unlock();
+  }
+  return result;
+}
+
+
+/**
+ * Heap usage of the hash tables and of the chunk lists of open files.
+ */
+uint64_t ChunkTables::GetMemoryUsage() {
+  uint64_t result = 0;
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    HandleShard *handle_shard = &handle_shards[i];
+    handle_shard->Lock();
+    result += handle_shard->handle2uniqino.bytes_allocated() +
+              handle_shard->handle2fd.bytes_allocated();
+    handle_shard->Unlock();
+
+    InodeShard *inode_shard = &inode_shards[i];
+    inode_shard->Lock();
+    result += inode_shard->inode2chunks.bytes_allocated() +
+              inode_shard->inode2references.bytes_allocated();
+    const uint64_t empty_key = inode_shard->inode2chunks.empty_key();
+    const uint64_t *keys = inode_shard->inode2chunks.keys();
+    const FileChunkReflist *values = inode_shard->inode2chunks.values();
+    for (unsigned j = 0; j < inode_shard->inode2chunks.capacity(); ++j) {
+      if ((keys[j] != empty_key) && (values[j].list != NULL))
+        result += values[j].list->capacity() * sizeof(FileChunk);
+    }
+    inode_shard->Unlock();
+  }
+  return result;
+}
+
+
 //------------------------------------------------------------------------------
 
 
@@ -141,17 +287,31 @@ SimpleChunkTables::SimpleChunkTables() {
 SimpleChunkTables::~SimpleChunkTables() {
   for (unsigned i = 0; i < fd_table_.size(); ++i) {
     delete fd_table_[i].chunk_reflist.list;
+    delete fd_table_[i].chunk_fd;
+    FreeChunkLock(fd_table_[i].chunk_lock);
   }
   pthread_mutex_destroy(lock_);
   free(lock_);
 }
 
 
+void SimpleChunkTables::FreeChunkLock(pthread_mutex_t *chunk_lock) {
+  if (chunk_lock == NULL)
+    return;
+  pthread_mutex_destroy(chunk_lock);
+  free(chunk_lock);
+}
+
+
 int SimpleChunkTables::Add(FileChunkReflist chunks) {
   assert(chunks.list != NULL);
   OpenChunks new_entry;
   new_entry.chunk_reflist = chunks;
   new_entry.chunk_fd = new ChunkFd();
+  new_entry.chunk_lock =
+    reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
+  int retval = pthread_mutex_init(new_entry.chunk_lock, NULL);
+  assert(retval == 0);
   unsigned i = 0;
   Lock();
   for (; i < fd_table_.size(); ++i) {
@@ -197,6 +357,8 @@ void SimpleChunkTables::Release(int fd) {
   fd_table_[idx].chunk_reflist.path.Assign("", 0);
   delete fd_table_[idx].chunk_fd;
   fd_table_[idx].chunk_fd = NULL;
+  FreeChunkLock(fd_table_[idx].chunk_lock);
+  fd_table_[idx].chunk_lock = NULL;
   while (!fd_table_.empty() && (fd_table_.back().chunk_reflist.list == NULL)) {
     fd_table_.pop_back();
   }
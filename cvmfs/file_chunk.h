@@ -24,6 +24,8 @@
 #include "smallhash.h"
 #include "util/single_copy.h"
 
+class DigestTree;
+
 /**
  * Describes a FileChunk as generated from the FileProcessor in collaboration
  * with the ChunkGenerator.
@@ -50,10 +52,40 @@ class FileChunk {
 
 typedef BigVector<FileChunk> FileChunkList;
 
+
+/**
+ * Memory-efficient encoding of a FileChunkList, used by the chunk list cache.
+ * The digests are stored back to back.  The offsets are implied by the
+ * sequence of chunk sizes, which are stored as variable-length integers.
+ * Chunk lists with gaps or with mixed hash algorithms cannot be encoded.
+ */
+class CompactChunkList {
+ public:
+  CompactChunkList()
+    : algorithm_(shash::kAny)
+    , suffix_(shash::kSuffixNone)
+    , num_chunks_(0) { }
+
+  static bool Encode(const FileChunkList &chunks, CompactChunkList *compact);
+  void Expand(FileChunkList *chunks) const;
+
+  uint32_t num_chunks() const { return num_chunks_; }
+  uint64_t GetMemorySize() const { return digests_.size() + sizes_.size(); }
+
+ private:
+  shash::Algorithms algorithm_;
+  shash::Suffix suffix_;
+  uint32_t num_chunks_;
+  std::string digests_;
+  std::string sizes_;
+};
+
 struct FileChunkReflist {
   FileChunkReflist() : list(NULL)
                      , compression_alg(zlib::kZlibDefault)
-                     , external_data(false) { }
+                     , external_data(false)
+                     , partial(false)
+                     , digest_tree(NULL) { }
   FileChunkReflist(FileChunkList     *l,
                    const PathString  &p,
                    zlib::Algorithms   alg,
@@ -61,14 +93,27 @@ struct FileChunkReflist {
     : list(l)
     , path(p)
     , compression_alg(alg)
-    , external_data(external) { }
+    , external_data(external)
+    , partial(false)
+    , digest_tree(NULL) { }
 
   unsigned FindChunkIdx(const uint64_t offset);
+  uint64_t GetFileSize() const;
 
   FileChunkList     *list;
   PathString         path;
   zlib::Algorithms   compression_alg;
   bool               external_data;
+  /**
+   * Set for a non-chunked file that is represented as a single chunk so that
+   * reads can be served by range requests until the object is cached.
+   */
+  bool               partial;
+  /**
+   * Block digests of a partial list, owned like the list.  Range requests are
+   * verified against them before they are served.
+   */
+  DigestTree        *digest_tree;
 };
 
 
@@ -77,16 +122,66 @@ struct FileChunkReflist {
  * and for libcvmfs.
  */
 struct ChunkFd {
-  ChunkFd() : fd(-1), chunk_idx(0) { }
+  ChunkFd() : fd(-1), chunk_idx(0), verified_data(NULL), verified_offset(0),
+              verified_size(0) { }
   int fd;  // -1 or pointing to chunk_idx
   unsigned chunk_idx;
+  /**
+   * Of a partial list: the last verified blocks from a range request or NULL
+   */
+  unsigned char *verified_data;
+  uint64_t verified_offset;
+  uint64_t verified_size;
 };
 
 
 /**
- * All chunk related data structures in the Fuse module.
+ * All chunk related data structures in the Fuse module.  The tables are split
+ * into shards, one set keyed by chunk handle and one set keyed by unique inode,
+ * so that concurrent readers of different chunked files do not serialize on a
+ * single mutex.  A shard lock is only held for the hash table operations,
+ * never while a chunk is fetched.
  */
 struct ChunkTables {
+  /**
+   * The file descriptor and the unique inode of open chunk handles.  Versions
+   * < 4 of ChunkTables didn't have the handle2uniqino map.  Therefore, after a
+   * hot patch a handle can be missing from this map.  In this case, the fuse
+   * module falls back to the inode passed by the kernel.
+   */
+  struct HandleShard {
+    inline void Lock() {
+      int retval = pthread_mutex_lock(lock);
+      assert(retval == 0);
+    }
+    inline void Unlock() {
+      int retval = pthread_mutex_unlock(lock);
+      assert(retval == 0);
+    }
+
+    SmallHashDynamic<uint64_t, uint64_t> handle2uniqino;
+    SmallHashDynamic<uint64_t, ChunkFd> handle2fd;
+    pthread_mutex_t *lock;
+  };
+
+  /**
+   * The chunk lists of open files, shared by all handles of the same inode.
+   */
+  struct InodeShard {
+    inline void Lock() {
+      int retval = pthread_mutex_lock(lock);
+      assert(retval == 0);
+    }
+    inline void Unlock() {
+      int retval = pthread_mutex_unlock(lock);
+      assert(retval == 0);
+    }
+
+    SmallHashDynamic<uint64_t, FileChunkReflist> inode2chunks;
+    SmallHashDynamic<uint64_t, uint32_t> inode2references;
+    pthread_mutex_t *lock;
+  };
+
   ChunkTables();
   ~ChunkTables();
   ChunkTables(const ChunkTables &other);
@@ -96,34 +191,25 @@ struct ChunkTables {
   void InitHashmaps();
 
   pthread_mutex_t *Handle2Lock(const uint64_t handle) const;
-
-  inline void Lock() {
-    int retval = pthread_mutex_lock(lock);
-    assert(retval == 0);
-  }
-
-  inline void Unlock() {
-    int retval = pthread_mutex_unlock(lock);
-    assert(retval == 0);
-  }
+  HandleShard *Handle2Shard(const uint64_t handle);
+  InodeShard *Inode2Shard(const uint64_t inode);
+  inline uint64_t NextHandle() { return atomic_xadd64(&next_handle, 1); }
+  uint64_t GetNumHandles();
+  uint64_t GetMemoryUsage();
 
   // Version 2 --> 4: add handle2uniqino
-  static const unsigned kVersion = 4;
+  // Version 4 --> 5: shard the tables, remove the global lock
+  static const unsigned kVersion = 5;
 
   int version;
   static const unsigned kNumHandleLocks = 128;
-  // Versions < 4 of ChunkTables didn't have this map.  Therefore, after a
-  // hot patch a handle can be missing from this map.  In this case, the fuse
-  // module falls back to the inode passed by the kernel.
-  SmallHashDynamic<uint64_t, uint64_t> handle2uniqino;
-  SmallHashDynamic<uint64_t, ChunkFd> handle2fd;
-  // The file descriptors attached to handles need to be locked.
-  // Using a hash map to survive with a small, fixed number of locks
+  static const unsigned kNumShards = 16;
+  HandleShard handle_shards[kNumShards];
+  InodeShard inode_shards[kNumShards];
+  // The file descriptors attached to handles need to be locked while a chunk
+  // is read.  Using a hash map to survive with a small, fixed number of locks
   BigVector<pthread_mutex_t *> handle_locks;
-  SmallHashDynamic<uint64_t, FileChunkReflist> inode2chunks;
-  SmallHashDynamic<uint64_t, uint32_t> inode2references;
-  uint64_t next_handle;
-  pthread_mutex_t *lock;
+  atomic_int64 next_handle;
 };
 
 
@@ -137,11 +223,13 @@ class SimpleChunkTables : SingleCopy {
  public:
   /**
    * While a chunked file is open, a single file descriptor is moved around the
-   * individual chunks.
+   * individual chunks.  Readers of the same handle need to hold chunk_lock
+   * while they use chunk_fd.
    */
   struct OpenChunks {
-    OpenChunks() : chunk_fd(NULL) { }
+    OpenChunks() : chunk_fd(NULL), chunk_lock(NULL) { }
     ChunkFd *chunk_fd;
+    pthread_mutex_t *chunk_lock;
     FileChunkReflist chunk_reflist;
   };
 
@@ -152,6 +240,8 @@ class SimpleChunkTables : SingleCopy {
   void Release(int fd);
 
  private:
+  static void FreeChunkLock(pthread_mutex_t *chunk_lock);
+
   inline void Lock() {
     int retval = pthread_mutex_lock(lock_);
     assert(retval == 0);
@@ -9,13 +9,17 @@ namespace upload {
 
 CharBuffer* AbstractReader::CreateBuffer(const size_t size) {
   ++buffers_in_flight_counter_;
-  CharBuffer *buffer = new CharBuffer(size);
+  CharBuffer *buffer = (buffer_pool_ != NULL) ?
+                       buffer_pool_->Acquire(size) : new CharBuffer(size);
   return buffer;
 }
 
 
 void AbstractReader::ReleaseBuffer(CharBuffer *buffer) {
-  delete buffer;
+  if (buffer_pool_ != NULL)
+    buffer_pool_->Release(buffer);
+  else
+    delete buffer;
   --buffers_in_flight_counter_;
 }
 
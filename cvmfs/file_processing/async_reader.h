@@ -5,14 +5,19 @@
 #ifndef CVMFS_FILE_PROCESSING_ASYNC_READER_H_
 #define CVMFS_FILE_PROCESSING_ASYNC_READER_H_
 
-#include <tbb/concurrent_queue.h>
 #include <tbb/task.h>
+#include <tbb/task_scheduler_init.h>
 #include <tbb/tbb_thread.h>
 
 #include <list>
 #include <string>
+#include <vector>
 
 #include "file_processing/char_buffer.h"
+#include "file_processing/char_buffer_pool.h"
+#include "util/io_ring.h"
+#include "util/pointer.h"
+#include "util/ring_queue.h"
 #include "util_concurrency.h"
 
 // TODO(rmeusel): remove this... wrong namespace (for testing)
@@ -22,8 +27,13 @@ class AbstractFile;
 
 class AbstractReader {
  public:
-  explicit AbstractReader(const unsigned int max_buffers_in_flight) :
-    buffers_in_flight_counter_(max_buffers_in_flight)
+  /**
+   * Without a buffer pool, buffers are allocated and freed one by one
+   */
+  explicit AbstractReader(const unsigned int  max_buffers_in_flight,
+                          CharBufferPool     *buffer_pool = NULL) :
+    buffers_in_flight_counter_(max_buffers_in_flight),
+    buffer_pool_(buffer_pool)
   {}
 
   virtual ~AbstractReader() {}
@@ -49,6 +59,7 @@ class AbstractReader {
 
  private:
   SynchronizingCounter<uint32_t> buffers_in_flight_counter_;
+  CharBufferPool *buffer_pool_;  ///< (weak) reference, can be NULL
 };
 
 
@@ -61,6 +72,8 @@ class AbstractReader {
  * This allows for better parallelism in the processing pipeline since each
  * individual File needs to be processed sequentially. Though data Blocks of
  * different Files are independent of each other and allow for higher throughput.
+ * If the kernel supports io_uring, the next Blocks of all open Files are read
+ * by a single batch of concurrent reads.
  *
  * Note: The Reader produces CharBuffers that are passed into the processing
  *       pipeline. The Reader claims ownership of these specific CharBuffers,
@@ -100,15 +113,21 @@ class Reader : public AbstractReader,
     FileT *file;
     bool   terminate;
   };
-  typedef tbb::concurrent_bounded_queue<FileJob> JobQueue;
+  typedef RingQueue<FileJob> JobQueue;
 
  public:
   Reader(const size_t       max_buffer_size,
-         const unsigned int max_files_in_flight) :
-    AbstractReader(max_files_in_flight * 5),
+         const unsigned int max_files_in_flight,
+         const int          number_of_threads =
+                              tbb::task_scheduler_init::automatic,
+         CharBufferPool     *buffer_pool = NULL) :
+    AbstractReader(max_files_in_flight * 5, buffer_pool),
+    queue_(max_files_in_flight + 1),
     max_buffer_size_(max_buffer_size),
+    number_of_threads_(number_of_threads),
     draining_(false),
     files_in_flight_counter_(max_files_in_flight),
+    io_ring_(IoRing::Create(max_files_in_flight)),
     running_(false) {}
 
   virtual ~Reader() {
@@ -121,7 +140,7 @@ class Reader : public AbstractReader,
   void ScheduleRead(FileT *file) {
     assert(running_);
     ++files_in_flight_counter_;
-    queue_.push(FileJob(file));
+    queue_.Push(FileJob(file));
   }
 
   void Wait() {
@@ -134,7 +153,7 @@ class Reader : public AbstractReader,
     if (running_ && read_thread_.joinable()) {
       // send a termination signal through the queue and wait for the read
       // thread to terminate
-      queue_.push(FileJob());
+      queue_.Push(FileJob());
       read_thread_.join();
       running_ = false;
     }
@@ -156,18 +175,36 @@ class Reader : public AbstractReader,
   void OpenNewFile(FileT          *file);
   void CloseFile(OpenFile         *file);
 
+  CharBuffer *CreateNextBuffer(OpenFile *open_file, size_t *bytes_to_read);
   bool ReadAndScheduleNextBuffer(OpenFile *open_file);
+  /**
+   * Reads the next Block of every open File in a single io_uring batch
+   */
+  void ReadAndScheduleNextBuffers();
+  bool ScheduleBuffer(OpenFile *open_file, CharBuffer *buffer);
 
   void FinalizedFile(AbstractFile *file);
 
  private:
-  JobQueue queue_;  ///< reference to the JobQueue (see IoDispatcher)
+  /**
+   * At most max_files_in_flight jobs plus the termination signal
+   */
+  JobQueue queue_;
   const size_t max_buffer_size_;  ///< size of data Blocks to read-in
+  /**
+   * Number of TBB threads processing the data Blocks scheduled by the read
+   * thread
+   */
+  const int number_of_threads_;
 
   bool                            draining_;
   OpenFileList                    open_files_;
 
   SynchronizingCounter<uint32_t>  files_in_flight_counter_;
+  /**
+   * NULL if io_uring is not available, then Files are read one by one
+   */
+  UniquePtr<IoRing>               io_ring_;
 
   tbb::tbb_thread                 read_thread_;
   Future<bool>                    thread_started_executing_;
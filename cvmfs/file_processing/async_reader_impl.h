@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <cerrno>
+#include <vector>
 
 #include "logging.h"
 #include "platform.h"
@@ -44,6 +45,9 @@ bool Reader<FileScrubbingTaskT, FileT>::Initialize() {
 
 template <class FileScrubbingTaskT, class FileT>
 void Reader<FileScrubbingTaskT, FileT>::ReadThread() {
+  // The FileScrubbingTasks are enqueued by this thread, so its scheduler
+  // determines the number of worker threads
+  tbb::task_scheduler_init scheduler(number_of_threads_);
   thread_started_executing_.Set(true);
 
   while (HasData()) {
@@ -60,6 +64,12 @@ void Reader<FileScrubbingTaskT, FileT>::ReadThread() {
       }
     }
 
+    // With io_uring, the next Blocks of all open Files are read at once
+    if (io_ring_.IsValid()) {
+      ReadAndScheduleNextBuffers();
+      continue;
+    }
+
     // read File Blocks in a round robin fashion and schedule these blocks for
     // processing
     typename OpenFileList::iterator       i    = open_files_.begin();
@@ -88,10 +98,10 @@ bool Reader<FileScrubbingTaskT, FileT>::TryToAcquireNewJob(FileJob *next_job) {
   // If we have no more work, we allow the thread to block otherwise we just
   // acquire what we can get and continue working
   if (open_files_.empty()) {
-    queue_.pop(*next_job);
+    queue_.Pop(next_job);
     popped = true;
   } else {
-    popped = queue_.try_pop(*next_job);
+    popped = queue_.TryPop(next_job);
   }
 
   return popped;
@@ -143,12 +153,84 @@ void Reader<FileScrubbingTaskT, FileT>::FinalizedFile(AbstractFile *file) {
 }
 
 
+template <class FileScrubbingTaskT, class FileT>
+CharBuffer *Reader<FileScrubbingTaskT, FileT>::
+  CreateNextBuffer(OpenFile *open_file, size_t *bytes_to_read)
+{
+  assert(open_file->file != NULL);
+  assert(open_file->file_descriptor > 0);
+
+  // figure out how many bytes need to be read in this step and create a
+  // CharBuffer to accomodate these bytes
+  const size_t file_size = open_file->file->size();
+  *bytes_to_read =
+    std::min(file_size - static_cast<size_t>(open_file->file_marker),
+             max_buffer_size_);
+  CharBuffer *buffer = CreateBuffer(*bytes_to_read);
+  buffer->SetBaseOffset(open_file->file_marker);
+  return buffer;
+}
+
+
 template <class FileScrubbingTaskT, class FileT>
 bool Reader<FileScrubbingTaskT, FileT>::
   ReadAndScheduleNextBuffer(OpenFile *open_file)
+{
+  size_t bytes_to_read;
+  CharBuffer *buffer = CreateNextBuffer(open_file, &bytes_to_read);
+
+  // read the next data Block into the just created CharBuffer and check if
+  // everything worked as expected
+  const size_t bytes_read = read(open_file->file_descriptor,
+                                 buffer->ptr(),
+                                 bytes_to_read);
+  assert(bytes_to_read == bytes_read);
+  buffer->SetUsedBytes(bytes_read);
+  return ScheduleBuffer(open_file, buffer);
+}
+
+
+template <class FileScrubbingTaskT, class FileT>
+void Reader<FileScrubbingTaskT, FileT>::ReadAndScheduleNextBuffers() {
+  std::vector<CharBuffer *> buffers;
+  std::vector<IoRing::Request> requests;
+  typename OpenFileList::iterator       i    = open_files_.begin();
+  typename OpenFileList::const_iterator iend = open_files_.end();
+  for (; i != iend; ++i) {
+    size_t bytes_to_read;
+    CharBuffer *buffer = CreateNextBuffer(&(*i), &bytes_to_read);
+    buffers.push_back(buffer);
+    requests.push_back(IoRing::Request(i->file_descriptor, buffer->ptr(),
+                                       bytes_to_read, i->file_marker));
+  }
+
+  io_ring_->Read(&requests);
+
+  // schedule the Blocks in the same order as they were submitted, the
+  // OpenFileList is unchanged in the meantime
+  i = open_files_.begin();
+  for (unsigned j = 0; j < requests.size(); ++j) {
+    assert(requests[j].result >= 0);
+    assert(static_cast<size_t>(requests[j].result) == requests[j].size);
+    buffers[j]->SetUsedBytes(requests[j].result);
+    const bool finished_reading = ScheduleBuffer(&(*i), buffers[j]);
+    if (finished_reading) {
+      OpenFile file = *i;
+      i = open_files_.erase(i);
+      CloseFile(&file);
+    } else {
+      ++i;
+    }
+  }
+}
+
+
+template <class FileScrubbingTaskT, class FileT>
+bool Reader<FileScrubbingTaskT, FileT>::
+  ScheduleBuffer(OpenFile *open_file, CharBuffer *buffer)
 {
   assert(open_file->file != NULL);
-  assert(open_file->file_descriptor > 0);
+  assert(buffer->base_offset() == open_file->file_marker);
 
 
   // All asynchronous tasks for a single File need to be processed sequentially,
@@ -193,29 +275,14 @@ bool Reader<FileScrubbingTaskT, FileT>::
 
 
 
-  // figure out how many bytes need to be read in this step and create a
-  // CharBuffer to accomodate these bytes
-  const size_t file_size     = open_file->file->size();
-  const off_t  file_offset   = lseek(open_file->file_descriptor, 0, SEEK_CUR);
-  const size_t bytes_to_read =
-    std::min(file_size - static_cast<size_t>(open_file->file_marker),
-             max_buffer_size_);
-  CharBuffer *buffer = CreateBuffer(bytes_to_read);
-  buffer->SetBaseOffset(open_file->file_marker);
-
-  // read the next data Block into the just created CharBuffer and check if
-  // everything worked as expected
-  const size_t bytes_read = read(open_file->file_descriptor,
-                                 buffer->ptr(),
-                                 bytes_to_read);
-  assert(bytes_to_read == bytes_read);
-  buffer->SetUsedBytes(bytes_read);
+  const size_t file_size  = open_file->file->size();
+  const size_t bytes_read = buffer->used_bytes();
   open_file->file_marker += bytes_read;
 
   // Tell kernel to evict read pages from the page cache.  We don't care much if
   // it succeeds or not.
   (void) platform_invalidate_kcache(open_file->file_descriptor,
-                                    file_offset, bytes_read);
+                                    buffer->base_offset(), bytes_read);
 
   // check if the file has been fully read
   const bool finished_reading =
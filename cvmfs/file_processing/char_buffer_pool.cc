@@ -0,0 +1,156 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "char_buffer_pool.h"
+
+#include <inttypes.h>
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include "file_processing/char_buffer.h"
+
+using namespace std;  // NOLINT
+
+namespace upload {
+
+const size_t CharBufferPool::kMinClassSize;
+const size_t CharBufferPool::kMaxClassSize;
+const size_t CharBufferPool::kDefaultMaxPooledBytes;
+const unsigned CharBufferPool::kNumClasses;
+
+
+CharBufferPool::CharBufferPool(const size_t max_pooled_bytes)
+  : max_pooled_bytes_(max_pooled_bytes)
+{
+  for (unsigned i = 0; i < kNumClasses; ++i) {
+    int retval = pthread_mutex_init(&classes_[i].lock, NULL);
+    assert(retval == 0);
+  }
+  atomic_init64(&num_acquired_);
+  atomic_init64(&num_allocated_);
+  atomic_init64(&num_released_);
+  atomic_init64(&num_freed_);
+  atomic_init64(&sz_pooled_);
+}
+
+
+CharBufferPool::~CharBufferPool() {
+  for (unsigned i = 0; i < kNumClasses; ++i) {
+    for (unsigned j = 0; j < classes_[i].buffers.size(); ++j)
+      delete classes_[i].buffers[j];
+    pthread_mutex_destroy(&classes_[i].lock);
+  }
+}
+
+
+/**
+ * Returns the smallest size class that fits the size or -1 if the size is
+ * larger than kMaxClassSize
+ */
+int CharBufferPool::GetClass(const size_t size) {
+  for (unsigned i = 0; i < kNumClasses; ++i) {
+    if (size <= GetClassSize(i))
+      return i;
+  }
+  return -1;
+}
+
+
+CharBuffer *CharBufferPool::Acquire(const size_t size) {
+  atomic_inc64(&num_acquired_);
+  const int size_class = GetClass(size);
+  if (size_class < 0) {
+    atomic_inc64(&num_allocated_);
+    return new CharBuffer(size);
+  }
+
+  CharBuffer *buffer = NULL;
+  SizeClass *pool = &classes_[size_class];
+  pthread_mutex_lock(&pool->lock);
+  if (!pool->buffers.empty()) {
+    buffer = pool->buffers.back();
+    pool->buffers.pop_back();
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  if (buffer == NULL) {
+    atomic_inc64(&num_allocated_);
+    return new CharBuffer(GetClassSize(size_class));
+  }
+  atomic_xadd64(&sz_pooled_, -static_cast<int64_t>(buffer->size_bytes()));
+  buffer->SetUsedBytes(0);
+  buffer->SetBaseOffset(0);
+  return buffer;
+}
+
+
+void CharBufferPool::Release(CharBuffer *buffer) {
+  assert(buffer != NULL);
+  atomic_inc64(&num_released_);
+
+  // Buffers that were not allocated by the pool are only kept if they happen
+  // to have the size of a class
+  const int size_class = GetClass(buffer->size());
+  const int64_t size_bytes = buffer->size_bytes();
+  bool keep = (size_class >= 0) &&
+              (GetClassSize(size_class) == static_cast<size_t>(size_bytes));
+  if (keep) {
+    const int64_t sz_pooled = atomic_xadd64(&sz_pooled_, size_bytes);
+    if (static_cast<size_t>(sz_pooled + size_bytes) > max_pooled_bytes_) {
+      atomic_xadd64(&sz_pooled_, -size_bytes);
+      keep = false;
+    }
+  }
+  if (!keep) {
+    atomic_inc64(&num_freed_);
+    delete buffer;
+    return;
+  }
+
+  SizeClass *pool = &classes_[size_class];
+  pthread_mutex_lock(&pool->lock);
+  pool->buffers.push_back(buffer);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+
+CharBuffer *CharBufferPool::Clone(const CharBuffer &buffer) {
+  assert(buffer.IsInitialized());
+  CharBuffer *new_buffer = Acquire(buffer.size());
+  assert(new_buffer->size() >= buffer.size());
+  new_buffer->SetUsedBytes(buffer.used_bytes());
+  new_buffer->SetBaseOffset(buffer.base_offset());
+  memcpy(new_buffer->ptr(), buffer.ptr(), buffer.used_bytes());
+  return new_buffer;
+}
+
+
+CharBufferPool::Statistics CharBufferPool::GetStatistics() {
+  Statistics result;
+  result.num_acquired = atomic_read64(&num_acquired_);
+  result.num_allocated = atomic_read64(&num_allocated_);
+  result.num_recycled = result.num_acquired - result.num_allocated;
+  result.num_released = atomic_read64(&num_released_);
+  result.num_freed = atomic_read64(&num_freed_);
+  result.sz_pooled = atomic_read64(&sz_pooled_);
+  return result;
+}
+
+
+string CharBufferPool::PrintStatistics() {
+  const Statistics stats = GetStatistics();
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "buffer pool: %" PRIu64 " acquired (%" PRIu64 " allocated, "
+           "%" PRIu64 " recycled), %" PRIu64 " released (%" PRIu64 " freed), "
+           "%" PRIu64 " kB pooled",
+           stats.num_acquired, stats.num_allocated, stats.num_recycled,
+           stats.num_released, stats.num_freed, stats.sz_pooled / 1024);
+  return buf;
+}
+
+}  // namespace upload
@@ -0,0 +1,95 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_FILE_PROCESSING_CHAR_BUFFER_POOL_H_
+#define CVMFS_FILE_PROCESSING_CHAR_BUFFER_POOL_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "atomic.h"
+#include "util/single_copy.h"
+
+namespace upload {
+
+class CharBuffer;
+
+/**
+ * Recycles the CharBuffers of the file processing pipeline: the read blocks of
+ * the Reader and the compressed blocks of the Chunks, which are released
+ * after their upload.  Buffers are rounded up to power-of-two size classes
+ * between kMinClassSize and kMaxClassSize, so that a buffer can be reused for
+ * any request of its class.  Hence, once the pipeline reached its steady state,
+ * publishing does not allocate memory for data blocks anymore.
+ *
+ * The pool keeps at most max_pooled_bytes in released buffers; beyond, and for
+ * requests larger than kMaxClassSize, buffers are freed.  Every size class has
+ * its own lock.  The memory itself comes from the TBB scalable allocator,
+ * which uses huge pages if TBB_MALLOC_USE_HUGE_PAGES=1 is set.
+ */
+class CharBufferPool : SingleCopy {
+ public:
+  struct Statistics {
+    Statistics()
+      : num_acquired(0), num_allocated(0), num_recycled(0), num_released(0)
+      , num_freed(0), sz_pooled(0) { }
+    uint64_t num_acquired;
+    uint64_t num_allocated;  ///< acquired buffers that were newly allocated
+    uint64_t num_recycled;  ///< acquired buffers that were taken from the pool
+    uint64_t num_released;
+    uint64_t num_freed;  ///< released buffers that were not kept in the pool
+    uint64_t sz_pooled;  ///< bytes currently kept in the pool
+  };
+
+  static const size_t kMinClassSize = 4 * 1024;
+  static const size_t kMaxClassSize = 16 * 1024 * 1024;
+  static const size_t kDefaultMaxPooledBytes = 256 * 1024 * 1024;
+
+  explicit CharBufferPool(
+    const size_t max_pooled_bytes = kDefaultMaxPooledBytes);
+  ~CharBufferPool();
+
+  /**
+   * Returns an empty buffer of at least the given size
+   */
+  CharBuffer *Acquire(const size_t size);
+  void Release(CharBuffer *buffer);
+  /**
+   * Copies the used bytes and the base offset into a buffer of the same size
+   */
+  CharBuffer *Clone(const CharBuffer &buffer);
+
+  Statistics GetStatistics();
+  std::string PrintStatistics();
+
+ private:
+  static const unsigned kNumClasses = 13;
+
+  struct SizeClass {
+    pthread_mutex_t lock;
+    std::vector<CharBuffer *> buffers;
+  };
+
+  static int GetClass(const size_t size);
+  static size_t GetClassSize(const unsigned size_class) {
+    return kMinClassSize << size_class;
+  }
+
+  const size_t max_pooled_bytes_;
+  SizeClass classes_[kNumClasses];
+
+  atomic_int64 num_acquired_;
+  atomic_int64 num_allocated_;
+  atomic_int64 num_released_;
+  atomic_int64 num_freed_;
+  atomic_int64 sz_pooled_;
+};
+
+}  // namespace upload
+
+#endif  // CVMFS_FILE_PROCESSING_CHAR_BUFFER_POOL_H_
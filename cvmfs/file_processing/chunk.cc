@@ -18,13 +18,43 @@ CharBuffer* Chunk::GetDeflateBuffer(const size_t bytes) {
     if (current_deflate_buffer_ != NULL) {
       ScheduleWrite(current_deflate_buffer_);
     }
-    current_deflate_buffer_ = new CharBuffer(bytes);
+    current_deflate_buffer_ =
+      file_->io_dispatcher()->buffer_pool()->Acquire(bytes);
   }
 
   return current_deflate_buffer_;
 }
 
 
+bool Chunk::EnqueueBlock(const ChunkBlock &block) {
+  tbb::spin_mutex::scoped_lock lock(pending_blocks_lock_);
+  assert(!done_);
+  pending_blocks_.push_back(block);
+  if (processing_blocks_)
+    return false;
+  processing_blocks_ = true;
+  return true;
+}
+
+
+bool Chunk::DequeueBlock(ChunkBlock *block) {
+  tbb::spin_mutex::scoped_lock lock(pending_blocks_lock_);
+  assert(processing_blocks_);
+  if (pending_blocks_.empty()) {
+    processing_blocks_ = false;
+    return false;
+  }
+
+  *block = pending_blocks_.front();
+  pending_blocks_.pop_front();
+  if (block->finalize) {
+    assert(pending_blocks_.empty());
+    processing_blocks_ = false;
+  }
+  return true;
+}
+
+
 void Chunk::ScheduleWrite(CharBuffer *buffer) {
   buffer->SetBaseOffset(compressed_size_);
   compressed_size_ += buffer->used_bytes();
@@ -51,10 +81,17 @@ void Chunk::FlushDeferredWrites(const bool delete_buffers) {
 }
 
 
-void Chunk::Initialize() {
+void Chunk::Initialize(const shash::Algorithms hash_algorithm) {
   done_            = false;
   compressed_size_ = 0;
 
+  const size_t digest_block_size = file_->digest_tree_block_size();
+  if ((digest_block_size > 0) && (file_offset_ == 0) &&
+      (file_->size() > digest_block_size))
+  {
+    digest_tree_ = new DigestTree(hash_algorithm, digest_block_size);
+  }
+
   content_hash_context_.buffer = smalloc(content_hash_context_.size);
   shash::Init(content_hash_context_);
 
@@ -63,6 +100,12 @@ void Chunk::Initialize() {
   // from a parameter, a zlib::Algorithms in this case
   compressor_ = zlib::Compressor::Construct(compression_algorithm_);
 
+  if (file_->encryption_key() != NULL) {
+    encryptor_ = cipher::StreamEncryptor::Create(*file_->encryption_key());
+    assert(encryptor_.IsValid());
+    encryption_header_pending_ = true;
+  }
+
   zlib_initialized_         = true;
   content_hash_initialized_ = true;
 }
@@ -75,6 +118,9 @@ void Chunk::Finalize() {
   free(content_hash_context_.buffer);
   content_hash_context_.buffer = NULL;
 
+  if (digest_tree_.IsValid())
+    digest_tree_->Finalize();
+
   if (current_deflate_buffer_ != NULL) {
     ScheduleWrite(current_deflate_buffer_);
     current_deflate_buffer_ = NULL;
@@ -109,13 +155,21 @@ Chunk::Chunk(const Chunk &other) :
   content_hash_initialized_(other.content_hash_initialized_),
   upload_stream_handle_(NULL),
   bytes_written_(other.bytes_written_),
-  compressed_size_(other.compressed_size_)
+  compressed_size_(other.compressed_size_),
+  processing_blocks_(false),
+  encryption_header_pending_(false)
 {
   assert(!other.done_);
+  assert(!other.processing_blocks_);
+  assert(other.pending_blocks_.empty());
   assert(!other.HasUploadStreamHandle());
   assert(other.bytes_written_ == 0);
+  // Copying the key stream would encrypt two objects with the same IV
+  assert(!other.encryptor_.IsValid());
 
-  current_deflate_buffer_ = other.current_deflate_buffer_->Clone();
+  current_deflate_buffer_ =
+    file_->io_dispatcher()->buffer_pool()->Clone(
+      *other.current_deflate_buffer_);
 
   content_hash_context_.buffer = smalloc(content_hash_context_.size);
   memcpy(content_hash_context_.buffer,
@@ -124,6 +178,9 @@ Chunk::Chunk(const Chunk &other) :
 
   compressor_ = other.compressor_->Clone();
   zlib_initialized_ = true;
+
+  if (other.digest_tree_.IsValid())
+    digest_tree_ = new DigestTree(*other.digest_tree_);
 }
 
 
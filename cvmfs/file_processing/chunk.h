@@ -7,13 +7,17 @@
 
 #include <sys/types.h>
 #include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
 
 #include <cassert>
+#include <deque>
 #include <string>
 #include <vector>
 
 #include "compression.h"
+#include "digest_tree.h"
 #include "duplex_zlib.h"
+#include "encrypt.h"
 #include "file_processing/char_buffer.h"
 #include "hash.h"
 #include "util/pointer.h"
@@ -23,6 +27,25 @@ namespace upload {
 struct UploadStreamHandle;
 class IoDispatcher;
 class File;
+class SharedReadBuffer;
+
+/**
+ * A piece of File data that still needs to be crunched into a specific Chunk.
+ * ChunkBlocks are queued by the FileScrubbingTask in file order.
+ */
+struct ChunkBlock {
+  ChunkBlock() : buffer(NULL), data(NULL), bytes(0), finalize(false) {}
+  ChunkBlock(SharedReadBuffer    *buffer,
+             const unsigned char *data,
+             const size_t         bytes,
+             const bool           finalize) :
+    buffer(buffer), data(data), bytes(bytes), finalize(finalize) {}
+
+  SharedReadBuffer    *buffer;    ///< released once the Block is crunched
+  const unsigned char *data;      ///< start of the Chunk's data in buffer
+  size_t               bytes;     ///< number of bytes belonging to the Chunk
+  bool                 finalize;  ///< last Block of the Chunk
+};
 
 /**
  * The Chunk class describes a file chunk in processing. It holds state infor-
@@ -53,8 +76,10 @@ class Chunk {
         , upload_stream_handle_(NULL)
         , current_deflate_buffer_(NULL)
         , bytes_written_(0)
+        , processing_blocks_(false)
+        , encryption_header_pending_(false)
   {
-    Initialize();
+    Initialize(hash_algorithm);
   }
 
   bool IsInitialized()         const { return zlib_initialized_ &&
@@ -83,6 +108,27 @@ class Chunk {
    */
   CharBuffer* GetDeflateBuffer(const size_t bytes);
 
+  /**
+   * Appends a data Block to the processing queue of the Chunk.  The queue is
+   * worked off in order by a single ChunkProcessingTask at a time, so that
+   * different Chunks of the same File are crunched concurrently.
+   *
+   * @param block  the data Block to be processed after all previous ones
+   * @return       true if no ChunkProcessingTask is working on the queue, in
+   *               which case the caller needs to spawn one
+   */
+  bool EnqueueBlock(const ChunkBlock &block);
+
+  /**
+   * Used by the ChunkProcessingTask to fetch the next data Block.  If there is
+   * none, the queue is released and the next EnqueueBlock() call asks for a new
+   * ChunkProcessingTask.  The final Block of a Chunk releases the queue, too.
+   *
+   * @param block  the next data Block to be processed
+   * @return       false if the queue is empty
+   */
+  bool DequeueBlock(ChunkBlock *block);
+
   /**
    * An enabled deferred write mode instructs the Chunk object to store Buffers
    * instead of directly sending them to the IoDispatcher for write out.
@@ -107,6 +153,23 @@ class Chunk {
   shash::ContextPtr& content_hash_context() { return content_hash_context_; }
   const shash::Any&  content_hash() const { return content_hash_; }
   zlib::Compressor*   compressor() { return compressor_.weak_ref(); }
+  /**
+   * Encrypts the compressed data of the Chunk if the File has an encryption
+   * key, NULL otherwise.  The cipher text header needs to be written once
+   * before the first encrypted byte, see TakeEncryptionHeader().
+   */
+  cipher::StreamEncryptor* encryptor() { return encryptor_.weak_ref(); }
+  bool TakeEncryptionHeader() {
+    const bool result = encryption_header_pending_;
+    encryption_header_pending_ = false;
+    return result;
+  }
+  /**
+   * Only the Chunk at offset 0 of a large enough File has a DigestTree, so
+   * that it is available for the bulk Chunk.  NULL otherwise.
+   */
+  DigestTree*         digest_tree() { return digest_tree_.weak_ref(); }
+  const DigestTree*   digest_tree() const { return digest_tree_.weak_ref(); }
 
   UploadStreamHandle* upload_stream_handle() const {
     return upload_stream_handle_;
@@ -123,7 +186,7 @@ class Chunk {
   }
 
  protected:
-  void Initialize();
+  void Initialize(const shash::Algorithms hash_algorithm);
   void FlushDeferredWrites(const bool delete_buffers = true);
   void ScheduleWrite(CharBuffer *buffer);
 
@@ -175,6 +238,24 @@ class Chunk {
    * Compressor
    */
   UniquePtr<zlib::Compressor>  compressor_;
+
+  /**
+   * Block digests of the uncompressed data (see digest_tree())
+   */
+  UniquePtr<DigestTree>        digest_tree_;
+
+  /**
+   * Data Blocks waiting to be crunched (see EnqueueBlock())
+   */
+  std::deque<ChunkBlock>   pending_blocks_;
+  bool                     processing_blocks_;
+  tbb::spin_mutex          pending_blocks_lock_;
+
+  /**
+   * Encrypts the compressed data (see encryptor())
+   */
+  UniquePtr<cipher::StreamEncryptor> encryptor_;
+  bool                     encryption_header_pending_;
 };
 
 typedef std::vector<Chunk*> ChunkVector;
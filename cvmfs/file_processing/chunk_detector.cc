@@ -8,6 +8,16 @@
 #include <algorithm>
 #include <limits>
 
+// The vectorized cut mark search relies on the target function attribute to
+// compile SSE4.1 and AVX2 code paths next to the generic code
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    ((defined(__clang__) && (__clang_major__ >= 4)) || \
+     (!defined(__clang__) && defined(__GNUC__) && \
+      ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))))
+#define CVMFS_XOR32_SIMD
+#include <immintrin.h>
+#endif
+
 namespace upload {
 
 off_t StaticOffsetDetector::FindNextCutMark(CharBuffer *buffer) {
@@ -38,6 +48,214 @@ const int32_t Xor32Detector::kMagicNumber   =
   std::numeric_limits<uint32_t>::max() / 2;
 
 
+#ifdef CVMFS_XOR32_SIMD
+namespace {
+
+// The rolling checksum after byte i is
+//   xor32_i = XOR_{k=0..31} (b_{i-k} << k)
+// which can be split into blocks of 8 bytes
+//   A_i     = XOR_{k=0..7} (b_{i-k} << k)                              (15 bit)
+//   xor32_i = A_i ^ (A_{i-8} << 8) ^ (A_{i-16} << 16) ^ (A_{i-24} << 24)
+// A_i is computed for 8 or 16 positions in parallel by doubling the window:
+//   a1_i = b_i ^ (b_{i-1} << 1), a2_i = a1_i ^ (a1_{i-2} << 2),
+//   A_i = a2_i ^ (a2_{i-4} << 4)
+// The upper 16 bits of the checksum are
+//   (A_{i-8} >> 8) ^ A_{i-16} ^ (A_{i-24} << 8)
+// Every cut mark has upper bits of 0x7fff or 0x8000 (or 0xffff, see
+// CheckThreshold() for the case of abs(INT_MIN)) as long as the threshold is
+// not larger than kMaxScanThreshold.  Positions with matching upper bits are
+// verified byte-wise.
+
+inline uint16_t Xor32A1(const unsigned char *data, const off_t i) {
+  return data[i] ^ (data[i - 1] << 1);
+}
+
+inline uint16_t Xor32A2(const unsigned char *data, const off_t i) {
+  return Xor32A1(data, i) ^ (Xor32A1(data, i - 2) << 2);
+}
+
+inline uint16_t Xor32A(const unsigned char *data, const off_t i) {
+  return Xor32A2(data, i) ^ (Xor32A2(data, i - 4) << 4);
+}
+
+
+/**
+ * Start values of the vector pipeline for the 24 positions before begin
+ */
+struct Xor32Prologue {
+  Xor32Prologue(const unsigned char *data, const off_t begin) {
+    for (unsigned i = 0; i < kSize; ++i) {
+      const off_t pos = begin - kSize + i;
+      b[i]  = data[pos];
+      a1[i] = Xor32A1(data, pos);
+      a2[i] = Xor32A2(data, pos);
+      a[i]  = Xor32A(data, pos);
+    }
+  }
+
+  static const unsigned kSize = 24;
+  uint16_t b[kSize];
+  uint16_t a1[kSize];
+  uint16_t a2[kSize];
+  uint16_t a[kSize];
+};
+
+
+__attribute__((target("sse4.1")))
+off_t Xor32ScanSse41(const unsigned char *data,
+                     const off_t begin,
+                     const off_t end)
+{
+  const Xor32Prologue pro(data, begin);
+  const __m128i *b_pro  = reinterpret_cast<const __m128i *>(pro.b  + 16);
+  const __m128i *a1_pro = reinterpret_cast<const __m128i *>(pro.a1 + 16);
+  const __m128i *a2_pro = reinterpret_cast<const __m128i *>(pro.a2 + 16);
+  __m128i b_prev  = _mm_loadu_si128(b_pro);
+  __m128i a1_prev = _mm_loadu_si128(a1_pro);
+  __m128i a2_prev = _mm_loadu_si128(a2_pro);
+  __m128i a_m24 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pro.a));
+  __m128i a_m16 =
+    _mm_loadu_si128(reinterpret_cast<const __m128i *>(pro.a + 8));
+  __m128i a_m8 =
+    _mm_loadu_si128(reinterpret_cast<const __m128i *>(pro.a + 16));
+
+  const __m128i lower = _mm_set1_epi16(0x7fff);
+  const __m128i upper = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+  const __m128i ones  = _mm_set1_epi16(static_cast<int16_t>(0xffff));
+
+  off_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    const __m128i hi = _mm_xor_si128(
+      _mm_xor_si128(_mm_srli_epi16(a_m8, 8), a_m16), _mm_slli_epi16(a_m24, 8));
+    const __m128i candidates = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi16(hi, lower), _mm_cmpeq_epi16(hi, upper)),
+      _mm_cmpeq_epi16(hi, ones));
+    if (!_mm_testz_si128(candidates, candidates))
+      return i;
+
+    const __m128i b = _mm_cvtepu8_epi16(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i *>(data + i)));
+    const __m128i a1 = _mm_xor_si128(
+      b, _mm_slli_epi16(_mm_alignr_epi8(b, b_prev, 14), 1));
+    const __m128i a2 = _mm_xor_si128(
+      a1, _mm_slli_epi16(_mm_alignr_epi8(a1, a1_prev, 12), 2));
+    const __m128i a = _mm_xor_si128(
+      a2, _mm_slli_epi16(_mm_alignr_epi8(a2, a2_prev, 8), 4));
+
+    b_prev  = b;
+    a1_prev = a1;
+    a2_prev = a2;
+    a_m24 = a_m16;
+    a_m16 = a_m8;
+    a_m8  = a;
+  }
+  return i;
+}
+
+
+__attribute__((target("avx2")))
+off_t Xor32ScanAvx2(const unsigned char *data,
+                    const off_t begin,
+                    const off_t end)
+{
+  // The two 128 bit lanes hold 8 consecutive positions each.  The in-lane
+  // alignr instruction gets the preceding positions through a lane permute.
+  const Xor32Prologue pro(data, begin);
+  __m256i b_prev =
+    _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pro.b + 8));
+  __m256i a1_prev =
+    _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pro.a1 + 8));
+  __m256i a2_prev =
+    _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pro.a2 + 8));
+  __m256i a_m24 =
+    _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pro.a));
+  __m256i a_m16 =
+    _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pro.a + 8));
+
+  const __m256i lower = _mm256_set1_epi16(0x7fff);
+  const __m256i upper = _mm256_set1_epi16(static_cast<int16_t>(0x8000));
+  const __m256i ones  = _mm256_set1_epi16(static_cast<int16_t>(0xffff));
+
+  off_t i = begin;
+  for (; i + 16 <= end; i += 16) {
+    const __m256i b = _mm256_cvtepu8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+    const __m256i b_m8 = _mm256_permute2x128_si256(b_prev, b, 0x21);
+    const __m256i a1 = _mm256_xor_si256(
+      b, _mm256_slli_epi16(_mm256_alignr_epi8(b, b_m8, 14), 1));
+    const __m256i a1_m8 = _mm256_permute2x128_si256(a1_prev, a1, 0x21);
+    const __m256i a2 = _mm256_xor_si256(
+      a1, _mm256_slli_epi16(_mm256_alignr_epi8(a1, a1_m8, 12), 2));
+    const __m256i a2_m8 = _mm256_permute2x128_si256(a2_prev, a2, 0x21);
+    const __m256i a = _mm256_xor_si256(
+      a2, _mm256_slli_epi16(_mm256_alignr_epi8(a2, a2_m8, 8), 4));
+    const __m256i a_m8 = _mm256_permute2x128_si256(a_m16, a, 0x21);
+
+    const __m256i hi = _mm256_xor_si256(
+      _mm256_xor_si256(_mm256_srli_epi16(a_m8, 8), a_m16),
+      _mm256_slli_epi16(a_m24, 8));
+    const __m256i candidates = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi16(hi, lower),
+                      _mm256_cmpeq_epi16(hi, upper)),
+      _mm256_cmpeq_epi16(hi, ones));
+    if (!_mm256_testz_si256(candidates, candidates))
+      return i;
+
+    b_prev  = b;
+    a1_prev = a1;
+    a2_prev = a2;
+    a_m24 = a_m8;
+    a_m16 = a;
+  }
+  return i;
+}
+
+}  // anonymous namespace
+#endif  // CVMFS_XOR32_SIMD
+
+
+bool Xor32Detector::IsImplementationAvailable(
+  const Implementation implementation)
+{
+  switch (implementation) {
+    case kImplScalar:
+      return true;
+#ifdef CVMFS_XOR32_SIMD
+    case kImplSse41:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse4.1");
+    case kImplAvx2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+
+void Xor32Detector::SetImplementation(const Implementation implementation) {
+  assert(IsImplementationAvailable(implementation));
+  implementation_ = implementation;
+  scan_ = NULL;
+  // Otherwise the byte-wise computation is used after all
+  if (threshold_ > kMaxScanThreshold)
+    return;
+#ifdef CVMFS_XOR32_SIMD
+  switch (implementation) {
+    case kImplSse41:
+      scan_ = Xor32ScanSse41;
+      break;
+    case kImplAvx2:
+      scan_ = Xor32ScanAvx2;
+      break;
+    default:
+      break;
+  }
+#endif
+}
+
+
 Xor32Detector::Xor32Detector(const size_t minimal_chunk_size,
                              const size_t average_chunk_size,
                              const size_t maximal_chunk_size) :
@@ -45,11 +263,18 @@ Xor32Detector::Xor32Detector(const size_t minimal_chunk_size,
   average_chunk_size_(average_chunk_size),
   maximal_chunk_size_(maximal_chunk_size),
   xor32_ptr_(0), xor32_(0),
-  threshold_(std::numeric_limits<uint32_t>::max() / average_chunk_size)
+  threshold_(std::numeric_limits<uint32_t>::max() / average_chunk_size),
+  implementation_(kImplScalar),
+  scan_(NULL)
 {
   assert(minimal_chunk_size_ > 0);
   assert(minimal_chunk_size_ < average_chunk_size_);
   assert(average_chunk_size_ < maximal_chunk_size_);
+
+  if (IsImplementationAvailable(kImplAvx2))
+    SetImplementation(kImplAvx2);
+  else if (IsImplementationAvailable(kImplSse41))
+    SetImplementation(kImplSse41);
 }
 
 
@@ -100,12 +325,33 @@ off_t Xor32Detector::FindNextCutMark(CharBuffer *buffer) {
   const off_t internal_compute_end =
     std::min(internal_max_chunk_size_end,
              static_cast<off_t>(buffer->used_bytes()));
-  for (; internal_offset < internal_compute_end; ++internal_offset) {
-    xor32(data[internal_offset]);
+  while (internal_offset < internal_compute_end) {
+    // skip over data that cannot contain a cut mark (if vectorized) and
+    // restore the rolling checksum from the last 32 bytes
+    if ((scan_ != NULL) &&
+        (internal_offset >= static_cast<off_t>(kXor32Window)))
+    {
+      const off_t candidate =
+        scan_(data, internal_offset, internal_compute_end);
+      if (candidate > internal_offset) {
+        internal_offset = candidate;
+        xor32_ = 0;
+        for (off_t i = candidate - kXor32Window; i < candidate; ++i)
+          xor32(data[i]);
+      }
+    }
+
+    const off_t internal_verify_end = (scan_ == NULL)
+      ? internal_compute_end
+      : std::min(internal_offset + static_cast<off_t>(kXor32Window),
+                 internal_compute_end);
+    for (; internal_offset < internal_verify_end; ++internal_offset) {
+      xor32(data[internal_offset]);
 
-    // check if we found a cut mark
-    if (CheckThreshold()) {
-      return DoCut(internal_offset + buffer->base_offset());
+      // check if we found a cut mark
+      if (CheckThreshold()) {
+        return DoCut(internal_offset + buffer->base_offset());
+      }
     }
   }
 
@@ -120,4 +366,113 @@ off_t Xor32Detector::FindNextCutMark(CharBuffer *buffer) {
   }
 }
 
+
+//------------------------------------------------------------------------------
+
+
+namespace {
+
+/**
+ * Maps every byte to a random 64 bit number.  The table is produced by the
+ * splitmix64 generator from a fixed seed.  You should never change the seed or
+ * the generator, since they affect the definition of cut marks.
+ */
+struct GearTable {
+  GearTable() {
+    uint64_t state = 0x6376666d73636463ULL;  // "cvmfscdc"
+    for (unsigned i = 0; i < 256; ++i) {
+      state += 0x9e3779b97f4a7c15ULL;
+      uint64_t z = state;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      values[i] = z ^ (z >> 31);
+    }
+  }
+
+  uint64_t values[256];
+};
+
+const GearTable kGearTable;
+
+/**
+ * Floor of the binary logarithm
+ */
+unsigned Log2(size_t value) {
+  unsigned result = 0;
+  while (value >>= 1)
+    result++;
+  return result;
+}
+
+}  // anonymous namespace
+
+
+/**
+ * Selects the upper nbits of the hash, which depend on the most bytes of the
+ * gear hash window
+ */
+uint64_t FastCdcDetector::MkMask(const unsigned nbits) {
+  assert((nbits > 0) && (nbits < 64));
+  return ~((uint64_t(1) << (64 - nbits)) - 1);
+}
+
+
+FastCdcDetector::FastCdcDetector(const size_t minimal_chunk_size,
+                                 const size_t average_chunk_size,
+                                 const size_t maximal_chunk_size) :
+  minimal_chunk_size_(minimal_chunk_size),
+  average_chunk_size_(average_chunk_size),
+  maximal_chunk_size_(maximal_chunk_size),
+  mask_small_(MkMask(Log2(average_chunk_size) + kNormalization)),
+  mask_large_(MkMask(std::max(Log2(average_chunk_size), kNormalization + 1) -
+                     kNormalization)),
+  gear_ptr_(0), gear_(0)
+{
+  assert(minimal_chunk_size_ > 0);
+  assert(minimal_chunk_size_ < average_chunk_size_);
+  assert(average_chunk_size_ < maximal_chunk_size_);
+}
+
+
+off_t FastCdcDetector::FindNextCutMark(CharBuffer *buffer) {
+  const unsigned char *data = buffer->ptr();
+  const off_t base = buffer->base_offset();
+  const off_t end = base + static_cast<off_t>(buffer->used_bytes());
+
+  // the gear hash computation either continues where the last buffer ended or
+  // starts after the minimal chunk size of the current chunk
+  const off_t global_offset =
+    std::max(last_cut() + static_cast<off_t>(minimal_chunk_size_), gear_ptr_);
+  if (global_offset >= end)
+    return NoCut(global_offset);
+
+  const off_t max_chunk_size_end =
+    last_cut() + static_cast<off_t>(maximal_chunk_size_);
+  const off_t internal_compute_end = std::min(max_chunk_size_end, end) - base;
+  const off_t internal_normal_end = std::min(
+    last_cut() + static_cast<off_t>(average_chunk_size_) - base,
+    internal_compute_end);
+  const uint64_t *gear_values = kGearTable.values;
+  uint64_t gear = gear_;
+
+  off_t i = global_offset - base;
+  for (; i < internal_normal_end; ++i) {
+    gear = (gear << 1) + gear_values[data[i]];
+    if ((gear & mask_small_) == 0)
+      return DoCut(base + i + 1);
+  }
+  for (; i < internal_compute_end; ++i) {
+    gear = (gear << 1) + gear_values[data[i]];
+    if ((gear & mask_large_) == 0)
+      return DoCut(base + i + 1);
+  }
+
+  // hard cut at the maximal chunk size, otherwise continue with the next
+  // buffer
+  if (base + i == max_chunk_size_end)
+    return DoCut(max_chunk_size_end);
+  gear_ = gear;
+  return NoCut(base + i);
+}
+
 }  // namespace upload
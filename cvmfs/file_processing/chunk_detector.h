@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <limits>
 #include <utility>
 #include <vector>
 
@@ -91,10 +92,26 @@ class Xor32Detector : public ChunkDetector {
   FRIEND_TEST(T_ChunkDetectors, Xor32);
 
  public:
+  /**
+   * Implementations of the cut mark search.  The vectorized ones skip over data
+   * that cannot contain a cut mark and find exactly the same cut marks as the
+   * byte-wise computation.  By default, the fastest implementation supported
+   * by the CPU is used.
+   */
+  enum Implementation {
+    kImplScalar = 0,
+    kImplSse41,
+    kImplAvx2
+  };
+
   Xor32Detector(const size_t minimal_chunk_size,
                 const size_t average_chunk_size,
                 const size_t maximal_chunk_size);
 
+  static bool IsImplementationAvailable(const Implementation implementation);
+  void SetImplementation(const Implementation implementation);
+  Implementation implementation() const { return implementation_; }
+
   bool MightFindChunks(const size_t size) const {
     return size > minimal_chunk_size_;
   }
@@ -117,17 +134,38 @@ class Xor32Detector : public ChunkDetector {
     xor32_ = (xor32_ << 1) ^ byte;
   }
 
+  /**
+   * Equivalent to abs(int32_t(xor32_) - kMagicNumber) < threshold_ with two's
+   * complement wrap-around, which defines the cut marks.  Spelled out to avoid
+   * the signed overflow: optimizing compilers would produce different cuts.
+   */
   inline bool CheckThreshold() {
-    return abs(static_cast<int32_t>(xor32_) - kMagicNumber) < threshold_;
+    const int32_t distance = static_cast<int32_t>(
+      xor32_ - static_cast<uint32_t>(kMagicNumber));
+    return (distance == std::numeric_limits<int32_t>::min()) ||
+           ((distance > -threshold_) && (distance < threshold_));
   }
 
  private:
   typedef std::pair<size_t, uint32_t> Threshold;
   typedef std::vector<Threshold> Thresholds;
 
+  /**
+   * Returns the first position in [begin, end) that might be a cut mark,
+   * rounded down to the vector width, or end.  Requires begin >= kXor32Window.
+   */
+  typedef off_t (*ScanFunction)(const unsigned char *data,
+                                const off_t begin,
+                                const off_t end);
+
   // xor32 only depends on a window of the last 32 bytes in the data stream
   static const size_t kXor32Window = 32;
   static const int32_t kMagicNumber;
+  /**
+   * The vectorized scans only look at the upper 16 bits of the checksum,
+   * which requires the threshold to be small enough.
+   */
+  static const int32_t kMaxScanThreshold = 0x10000;
 
   const size_t minimal_chunk_size_;
   const size_t average_chunk_size_;
@@ -137,6 +175,71 @@ class Xor32Detector : public ChunkDetector {
   uint32_t xor32_;
 
   const int32_t threshold_;
+
+  Implementation implementation_;
+  ScanFunction   scan_;  ///< NULL for the byte-wise computation
+};
+
+
+/**
+ * FastCDC [1] finds cut marks with a gear hash, which only depends on the last
+ * 64 bytes of the data stream and takes just a shift, an addition and a table
+ * lookup per byte.  A position is a cut mark if the bits of the hash selected
+ * by a mask are zero.  The search starts at the minimal chunk size.
+ *
+ * With normalized chunking, the mask selects more bits before the average
+ * chunk size and less bits after the average chunk size.  That makes cut marks
+ * less likely for small chunks and more likely for large chunks, so that the
+ * chunk sizes concentrate around the average chunk size.
+ *
+ * [1]     "FastCDC: a Fast and Efficient Content-Defined Chunking Approach for
+ *          Data Deduplication", W. Xia et al., USENIX ATC 2016
+ */
+class FastCdcDetector : public ChunkDetector {
+  FRIEND_TEST(T_ChunkDetectors, FastCdcMasks);
+
+ public:
+  FastCdcDetector(const size_t minimal_chunk_size,
+                  const size_t average_chunk_size,
+                  const size_t maximal_chunk_size);
+
+  bool MightFindChunks(const size_t size) const {
+    return size > minimal_chunk_size_;
+  }
+
+  off_t FindNextCutMark(CharBuffer *buffer);
+
+ protected:
+  virtual off_t DoCut(const off_t offset) {
+    gear_     = 0;
+    gear_ptr_ = offset;
+    return ChunkDetector::DoCut(offset);
+  }
+
+  virtual off_t NoCut(const off_t offset) {
+    gear_ptr_ = offset;
+    return ChunkDetector::NoCut(offset);
+  }
+
+ private:
+  /**
+   * Number of bits that the masks before and after the average chunk size
+   * differ from the number of bits of the average chunk size.  You should
+   * never change this number, since it affects the definition of cut marks.
+   */
+  static const unsigned kNormalization = 2;
+
+  static uint64_t MkMask(const unsigned nbits);
+
+  const size_t minimal_chunk_size_;
+  const size_t average_chunk_size_;
+  const size_t maximal_chunk_size_;
+
+  const uint64_t mask_small_;  ///< used up to the average chunk size
+  const uint64_t mask_large_;  ///< used beyond the average chunk size
+
+  off_t    gear_ptr_;
+  uint64_t gear_;
 };
 
 }  // namespace upload
@@ -17,7 +17,9 @@ File::File(const std::string    &path,
            bool                  generate_legacy_bulk_chunk,
            shash::Algorithms     hash_algorithm,
            zlib::Algorithms      compression_alg,
-           const shash::Suffix   hash_suffix) :
+           const shash::Suffix   hash_suffix,
+           const size_t          digest_tree_block_size,
+           const cipher::Key    *encryption_key) :
   AbstractFile(path, GetFileSize(path)),
   might_become_chunked_(chunk_detector != NULL &&
                         chunk_detector->MightFindChunks(size())),
@@ -25,6 +27,8 @@ File::File(const std::string    &path,
   hash_algorithm_(hash_algorithm),
   hash_suffix_(hash_suffix),
   compression_alg_(compression_alg),
+  digest_tree_block_size_(digest_tree_block_size),
+  encryption_key_(encryption_key),
   bulk_chunk_(NULL),
   io_dispatcher_(io_dispatcher),
   chunk_detector_(chunk_detector)
@@ -17,6 +17,10 @@
 #include "hash.h"
 #include "platform.h"
 
+namespace cipher {
+class Key;
+}
+
 namespace upload {
 
 class IoDispatcher;
@@ -37,7 +41,9 @@ class File : public AbstractFile {
        bool                  generate_legacy_bulk_chunk,
        shash::Algorithms     hash_algorithm,
        zlib::Algorithms      compression_alg,
-       const shash::Suffix   hash_suffix = shash::kSuffixNone);
+       const shash::Suffix   hash_suffix = shash::kSuffixNone,
+       const size_t          digest_tree_block_size = 0,
+       const cipher::Key    *encryption_key = NULL);
   ~File();
 
   bool MightBecomeChunked() const { return might_become_chunked_; }
@@ -77,6 +83,9 @@ class File : public AbstractFile {
   const Chunk*        bulk_chunk()  const { return bulk_chunk_;  }
   const ChunkVector&  chunks()      const { return chunks_;      }
         shash::Suffix hash_suffix() const { return hash_suffix_; }
+  zlib::Algorithms compression_alg() const { return compression_alg_; }
+  size_t digest_tree_block_size() const { return digest_tree_block_size_; }
+  const cipher::Key* encryption_key() const { return encryption_key_; }
 
   Chunk* current_chunk() {
     return (chunks_.size() > 0) ? chunks_.back() : NULL;
@@ -113,6 +122,14 @@ class File : public AbstractFile {
    * Compression algorithm for the chunks
    */
   const zlib::Algorithms compression_alg_;
+  /**
+   * Block size of the DigestTree of the bulk Chunk, 0 for none
+   */
+  const size_t digest_tree_block_size_;
+  /**
+   * Chunks are encrypted after compression if set
+   */
+  const cipher::Key *encryption_key_;
 
   ChunkVector chunks_;  ///< List of generated Chunks
   Chunk *bulk_chunk_;  ///< Associated bulk Chunk
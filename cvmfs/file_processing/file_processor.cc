@@ -5,7 +5,11 @@
 #include "cvmfs_config.h"
 #include "file_processor.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <cassert>
+#include <cstdlib>
 #include <string>
 
 #include "file_processing/chunk.h"
@@ -13,6 +17,10 @@
 #include "file_processing/file.h"
 #include "file_processing/io_dispatcher.h"
 #include "logging.h"
+#include "smalloc.h"
+#include "util/pointer.h"
+#include "util/posix.h"
+#include "util/probes.h"
 
 namespace upload {
 
@@ -21,20 +29,30 @@ FileProcessor::FileProcessor(AbstractUploader         *uploader,
   io_dispatcher_(new IoDispatcher(uploader,
                                   this,
                                   spooler_definition.number_of_threads)),
-  compression_alg_(spooler_definition.compression_alg),
+  policy_(spooler_definition.processing_policy),
   hash_algorithm_(spooler_definition.hash_algorithm),
   generate_legacy_bulk_chunks_(spooler_definition.generate_legacy_bulk_chunks),
-  chunking_enabled_(spooler_definition.use_file_chunking),
-  minimal_chunk_size_(spooler_definition.min_file_chunk_size),
-  average_chunk_size_(spooler_definition.avg_file_chunk_size),
-  maximal_chunk_size_(spooler_definition.max_file_chunk_size)
+  digest_tree_block_size_(spooler_definition.digest_tree_block_size),
+  encryption_key_(spooler_definition.encryption_key)
 {
+  defaults_.compression_alg = spooler_definition.compression_alg;
+  defaults_.use_chunking = spooler_definition.use_file_chunking;
+  defaults_.chunking_algorithm = spooler_definition.chunking_algorithm;
+  defaults_.min_chunk_size = spooler_definition.min_file_chunk_size;
+  defaults_.avg_chunk_size = spooler_definition.avg_file_chunk_size;
+  defaults_.max_chunk_size = spooler_definition.max_file_chunk_size;
+  atomic_init64(&num_chunked_files_);
+  atomic_init64(&num_incompressible_files_);
   assert(io_dispatcher_ != NULL);
-  assert(!chunking_enabled_ || minimal_chunk_size_ > 0);
-  assert(!chunking_enabled_ || average_chunk_size_ > 0);
-  assert(!chunking_enabled_ || maximal_chunk_size_ > 0);
-  assert(!chunking_enabled_ || minimal_chunk_size_ <= average_chunk_size_);
-  assert(!chunking_enabled_ || average_chunk_size_ <= maximal_chunk_size_);
+  assert(!defaults_.use_chunking || defaults_.min_chunk_size > 0);
+  assert(!defaults_.use_chunking || defaults_.avg_chunk_size > 0);
+  assert(!defaults_.use_chunking || defaults_.max_chunk_size > 0);
+  assert(!defaults_.use_chunking ||
+         defaults_.min_chunk_size <= defaults_.avg_chunk_size);
+  assert(!defaults_.use_chunking ||
+         defaults_.avg_chunk_size <= defaults_.max_chunk_size);
+  // The bulk chunk would be encrypted with the key stream of the first chunk
+  assert(!encryption_key_ || !generate_legacy_bulk_chunks_);
 }
 
 
@@ -46,29 +64,110 @@ FileProcessor::~FileProcessor() {
 
 void FileProcessor::Process(const std::string   &local_path,
                             const bool           allow_chunking,
-                            const shash::Suffix  hash_suffix) {
-  ChunkDetector *chunk_detector = (chunking_enabled_ && allow_chunking)
-                                        ? new Xor32Detector(minimal_chunk_size_,
-                                                            average_chunk_size_,
-                                                            maximal_chunk_size_)
+                            const shash::Suffix  hash_suffix,
+                            const std::string   &repository_path) {
+  ProcessingPolicy::Settings settings(defaults_);
+  if ((policy_ != NULL) && !repository_path.empty())
+    policy_->Apply(repository_path, &settings);
+  // A policy can turn on chunking for a repository without chunk sizes
+  const bool use_chunking = allow_chunking && settings.use_chunking &&
+                            (settings.avg_chunk_size > 0);
+  if ((settings.sample_threshold > 0) &&
+      (settings.compression_alg != zlib::kNoCompression) &&
+      !IsCompressible(local_path, settings.compression_alg,
+                      settings.sample_threshold))
+  {
+    settings.compression_alg = zlib::kNoCompression;
+    atomic_inc64(&num_incompressible_files_);
+  }
+
+  ChunkDetector *chunk_detector = use_chunking
+                                        ? CreateChunkDetector(settings)
                                         : NULL;
   File *file = new File(local_path,
                         io_dispatcher_,
                         chunk_detector,
                         generate_legacy_bulk_chunks_,
                         hash_algorithm_,
-                        compression_alg_,
-                        hash_suffix);
+                        settings.compression_alg,
+                        hash_suffix,
+                        digest_tree_block_size_,
+                        encryption_key_);
 
   LogCvmfs(kLogSpooler, kLogVerboseMsg, "Scheduling '%s' for processing ("
-                                        "chunking: %s, hash_suffix: %c)",
+                                        "chunking: %s, compression: %s, "
+                                        "hash_suffix: %c)",
            local_path.c_str(),
-           ((allow_chunking) ? "true" : "false"),
+           ((use_chunking) ? "true" : "false"),
+           zlib::AlgorithmName(settings.compression_alg).c_str(),
            hash_suffix);
+  CVMFS_PROBE1(spool_file_start, local_path.c_str());
   io_dispatcher_->ScheduleRead(file);
 }
 
 
+ChunkDetector *FileProcessor::CreateChunkDetector(
+  const ProcessingPolicy::Settings &settings)
+{
+  switch (settings.chunking_algorithm) {
+    case SpoolerDefinition::kChunkingFastCdc:
+      return new FastCdcDetector(settings.min_chunk_size,
+                                 settings.avg_chunk_size,
+                                 settings.max_chunk_size);
+    default:
+      return new Xor32Detector(settings.min_chunk_size,
+                               settings.avg_chunk_size,
+                               settings.max_chunk_size);
+  }
+}
+
+
+/**
+ * Compresses the first block of the file and checks whether it shrinks to at
+ * most threshold percent of its size.  Files that cannot be read are left to
+ * the IoDispatcher, which reports the error.
+ */
+bool FileProcessor::IsCompressible(
+  const std::string &local_path,
+  const zlib::Algorithms compression_alg,
+  const unsigned threshold)
+{
+  int fd = open(local_path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return true;
+  unsigned char *sample = reinterpret_cast<unsigned char *>(
+    smalloc(ProcessingPolicy::kSampleSize));
+  const ssize_t sample_size =
+    SafeRead(fd, sample, ProcessingPolicy::kSampleSize);
+  close(fd);
+  if (sample_size <= 0) {
+    free(sample);
+    return true;
+  }
+
+  UniquePtr<zlib::Compressor> compressor(
+    zlib::Compressor::Construct(compression_alg));
+  const size_t deflate_bound = compressor->DeflateBound(sample_size);
+  unsigned char *deflated =
+    reinterpret_cast<unsigned char *>(smalloc(deflate_bound));
+  unsigned char *running_data = sample;
+  size_t running_inputsize = sample_size;
+  uint64_t deflated_size = 0;
+  bool done = false;
+  while (!done) {
+    unsigned char *output_start = deflated;
+    size_t outbufsize = deflate_bound;
+    done = compressor->Deflate(true, &running_data, &running_inputsize,
+                               &output_start, &outbufsize);
+    deflated_size += outbufsize;
+  }
+  free(deflated);
+  free(sample);
+
+  return deflated_size * 100 <= uint64_t(sample_size) * threshold;
+}
+
+
 void FileProcessor::FileDone(File *file) {
   assert(file != NULL);
   assert(!file->path().empty());
@@ -90,7 +189,10 @@ void FileProcessor::FileDone(File *file) {
     resulting_chunks.PushBack(FileChunk(chunk_hash,
                                         current_chunk->offset(),
                                         current_chunk->size()));
+    chunk_sizes_.Add(current_chunk->size());
   }
+  if (!generated_chunks.empty())
+    atomic_inc64(&num_chunked_files_);
 
   LogCvmfs(kLogSpooler, kLogVerboseMsg, "File '%s' processed completely "
                                         "(bulk hash: %s suffix: %c)",
@@ -98,11 +200,14 @@ void FileProcessor::FileDone(File *file) {
            file->GetBulkHash().ToString().c_str(),
            file->hash_suffix());
   assert(file->hash_suffix() == file->GetBulkHash().suffix);
-  NotifyListeners(SpoolerResult(0,
-                                file->path(),
-                                file->GetBulkHash(),
-                                resulting_chunks,
-                                compression_alg_));
+  SpoolerResult result(0,
+                       file->path(),
+                       file->GetBulkHash(),
+                       resulting_chunks,
+                       file->compression_alg());
+  if (file->HasBulkChunk() && (file->bulk_chunk()->digest_tree() != NULL))
+    result.digest_tree = file->bulk_chunk()->digest_tree()->Serialize();
+  NotifyListeners(result);
 }
 
 
@@ -7,10 +7,18 @@
 
 #include <string>
 
+#include "atomic.h"
+#include "file_processing/processing_policy.h"
 #include "hash.h"
+#include "statistics.h"
+#include "upload_spooler_definition.h"
 #include "upload_spooler_result.h"
 #include "util_concurrency.h"
 
+namespace cipher {
+class Key;
+}
+
 namespace upload {
 
 /**
@@ -21,6 +29,7 @@ namespace upload {
  * The processing involves the following:
  *      -> create smaller file chunks for big input files
  *      -> compress the file content (optionally chunked)
+ *      -> optionally encrypt the compressed content
  *      -> generate a content hash of the compression result
  *
  * The main components of the processing facility are:
@@ -60,9 +69,9 @@ namespace upload {
 
 
 class AbstractUploader;
+class ChunkDetector;
 class IoDispatcher;
 class File;
-struct SpoolerDefinition;
 
 /**
  * This is the outer most wrapper class that should be used by the Spooler.
@@ -77,26 +86,59 @@ class FileProcessor : public Observable<SpoolerResult> {
                 const SpoolerDefinition  &spooler_definition);
   virtual ~FileProcessor();
 
+  /**
+   * If the spooler definition has a processing policy, the policy rules
+   * matching repository_path select the compression and chunking parameters.
+   * Without repository path, the file is processed with the defaults.
+   */
   void Process(const std::string   &local_path,
                const bool           allow_chunking,
-               const shash::Suffix  hash_suffix = shash::kSuffixNone);
+               const shash::Suffix  hash_suffix = shash::kSuffixNone,
+               const std::string   &repository_path = "");
 
   void WaitForProcessing();
 
+  /**
+   * Sizes of the chunks of all the chunked files processed so far
+   */
+  const perf::Histogram &chunk_sizes() const { return chunk_sizes_; }
+  int64_t num_chunked_files() const {
+    return atomic_read64(&num_chunked_files_);
+  }
+  /**
+   * Number of files stored uncompressed because their sample did not compress
+   */
+  int64_t num_incompressible_files() const {
+    return atomic_read64(&num_incompressible_files_);
+  }
+
  protected:
   friend class IoDispatcher;
   void FileDone(File *file);
 
  private:
+  static ChunkDetector *CreateChunkDetector(
+    const ProcessingPolicy::Settings &settings);
+  static bool IsCompressible(const std::string &local_path,
+                             const zlib::Algorithms compression_alg,
+                             const unsigned threshold);
+
   IoDispatcher  *io_dispatcher_;
 
-  zlib::Algorithms   compression_alg_;
+  /**
+   * Compression and chunking parameters of files without matching policy
+   * rules
+   */
+  ProcessingPolicy::Settings defaults_;
+  const ProcessingPolicy *policy_;
   shash::Algorithms  hash_algorithm_;
   const bool         generate_legacy_bulk_chunks_;
-  const bool         chunking_enabled_;
-  const size_t       minimal_chunk_size_;
-  const size_t       average_chunk_size_;
-  const size_t       maximal_chunk_size_;
+  const size_t       digest_tree_block_size_;
+  const cipher::Key *encryption_key_;
+
+  perf::Histogram    chunk_sizes_;
+  mutable atomic_int64 num_chunked_files_;
+  mutable atomic_int64 num_incompressible_files_;
 };
 
 }  // namespace upload
@@ -45,6 +45,7 @@ class AbstractFileScrubbingTask : public tbb::task {
         CharBuffer* buffer()       { return buffer_;  }
   const FileT*      file()   const { return file_;    }
   const CharBuffer* buffer() const { return buffer_;  }
+  AbstractReader*   reader()       { return reader_;  }
   bool              IsLast() const { return is_last_; }
 
   /** Associate the FileScrubbingTask with its successor */
@@ -54,8 +55,14 @@ class AbstractFileScrubbingTask : public tbb::task {
   }
 
  protected:
-  tbb::task* Finalize() {
-    reader_->ReleaseBuffer(buffer_);
+  /**
+   * @param release_buffer  hand buffer_ back to the Reader; if false, the
+   *                        subclass is in charge of releasing it
+   */
+  tbb::task* Finalize(const bool release_buffer = true) {
+    if (release_buffer) {
+      reader_->ReleaseBuffer(buffer_);
+    }
     if (is_last_) {
       reader_->FinalizedFile(file_);
     }
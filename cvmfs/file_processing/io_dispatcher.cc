@@ -12,6 +12,7 @@
 #include "file_processing/file.h"
 #include "file_processing/file_processor.h"
 #include "file_processing/processor.h"
+#include "util/probes.h"
 #include "util_concurrency.h"
 
 namespace upload {
@@ -77,7 +78,7 @@ void IoDispatcher::BufferUploadCompleteCallback(
 
   chunk->add_bytes_written(buffer->used_bytes());
   if (delete_buffer) {
-    delete buffer;
+    buffer_pool_.Release(buffer);
   }
 }
 
@@ -94,6 +95,8 @@ void IoDispatcher::ChunkUploadCompleteCallback(const UploaderResults &results,
     abort();
   }
 
+  CVMFS_PROBE2(spool_chunk_uploaded, uint64_t(chunk->offset()),
+               chunk->compressed_size());
   chunk->file()->ChunkCommitted(chunk);
 
   pthread_mutex_lock(&processing_done_mutex_);
@@ -105,6 +108,7 @@ void IoDispatcher::ChunkUploadCompleteCallback(const UploaderResults &results,
 
 
 void IoDispatcher::CommitFile(File *file) {
+  CVMFS_PROBE1(spool_file_done, file->path().c_str());
   file_processor_->FileDone(file);
   delete file;
 }
@@ -17,8 +17,10 @@
 
 #include "file_processing/async_reader.h"
 #include "file_processing/char_buffer.h"
+#include "file_processing/char_buffer_pool.h"
 #include "file_processing/file.h"
 #include "file_processing/processor.h"
+#include "logging.h"
 #include "upload_facility.h"
 
 namespace upload {
@@ -124,7 +126,8 @@ class IoDispatcher {
                const unsigned int   number_of_threads,
                const size_t         max_read_buffer_size = 512 * 1024) :
     max_read_buffer_size_(max_read_buffer_size),
-    reader_(max_read_buffer_size_, number_of_threads * 10),
+    reader_(max_read_buffer_size_, number_of_threads * 10, number_of_threads,
+            &buffer_pool_),
     uploader_(uploader),
     file_processor_(file_processor)
   {
@@ -141,6 +144,8 @@ class IoDispatcher {
     Wait();
 
     reader_.TearDown();
+    LogCvmfs(kLogSpooler, kLogDebug, "%s",
+             buffer_pool_.PrintStatistics().c_str());
 
     pthread_mutex_destroy(&processing_done_mutex_);
     pthread_cond_destroy(&processing_done_condition_);
@@ -173,6 +178,11 @@ class IoDispatcher {
 
   void CommitFile(File *file);
 
+  /**
+   * Read blocks and compressed blocks are recycled through the buffer pool
+   */
+  CharBufferPool *buffer_pool() { return &buffer_pool_; }
+
  protected:
   friend class Chunk;
   friend class File;
@@ -221,6 +231,7 @@ class IoDispatcher {
   pthread_mutex_t processing_done_mutex_;
   pthread_cond_t processing_done_condition_;
 
+  CharBufferPool buffer_pool_;  ///< needs to outlive the reader_
   Reader<FileScrubbingTask, File> reader_;  ///< dedicated File Reader object
 
   /**
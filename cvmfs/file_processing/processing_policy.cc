@@ -0,0 +1,199 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "file_processing/processing_policy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "hash.h"
+#include "logging.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace upload {
+
+ProcessingPolicy *ProcessingPolicy::Create(const string &policy_path) {
+  int fd = open(policy_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LogCvmfs(kLogSpooler, kLogStderr,
+             "cannot open processing policy %s (errno: %d)",
+             policy_path.c_str(), errno);
+    return NULL;
+  }
+  string policy;
+  const bool retval = SafeReadToString(fd, &policy);
+  close(fd);
+  if (!retval) {
+    LogCvmfs(kLogSpooler, kLogStderr, "cannot read processing policy %s",
+             policy_path.c_str());
+    return NULL;
+  }
+  return CreateFromString(policy);
+}
+
+
+ProcessingPolicy *ProcessingPolicy::CreateFromString(const string &policy) {
+  ProcessingPolicy *result = new ProcessingPolicy();
+  if (!result->Parse(policy)) {
+    delete result;
+    return NULL;
+  }
+  return result;
+}
+
+
+bool ProcessingPolicy::Parse(const string &policy) {
+  bool valid = true;
+  off_t line_offset = 0;
+  while (line_offset < static_cast<off_t>(policy.size())) {
+    const string line = GetLineMem(policy.data() + line_offset,
+                                   policy.size() - line_offset);
+    line_offset += line.size() + 1;  // +1 == skipped \n
+    if (!ParseLine(line)) {
+      LogCvmfs(kLogSpooler, kLogStderr, "invalid processing policy line: %s",
+               line.c_str());
+      valid = false;
+    }
+  }
+
+  shash::Any hash(shash::kMd5);
+  shash::HashString(policy, &hash);
+  fingerprint_ = hash.ToString();
+  return valid;
+}
+
+
+bool ProcessingPolicy::ParseLine(const string &line) {
+  string content = line.substr(0, line.find(kCommentMarker));
+  for (unsigned i = 0; i < content.size(); ++i) {
+    if (content[i] == '\t')
+      content[i] = ' ';
+  }
+
+  vector<string> tokens;
+  vector<string> fields = SplitString(content, ' ');
+  for (unsigned i = 0; i < fields.size(); ++i) {
+    if (!fields[i].empty())
+      tokens.push_back(fields[i]);
+  }
+  if (tokens.empty())
+    return true;
+  // A pathspec without settings is most likely a typo
+  if (tokens.size() < 2)
+    return false;
+
+  Rule rule((Pathspec(tokens[0])));
+  if (!rule.pathspec.IsValid())
+    return false;
+  for (unsigned i = 1; i < tokens.size(); ++i) {
+    const size_t pos_equal = tokens[i].find('=');
+    if ((pos_equal == string::npos) || (pos_equal == 0))
+      return false;
+    if (!ParseSetting(tokens[i].substr(0, pos_equal),
+                      tokens[i].substr(pos_equal + 1), &rule))
+    {
+      return false;
+    }
+  }
+  rules_.push_back(rule);
+  return true;
+}
+
+
+bool ProcessingPolicy::ParseSetting(
+  const string &key,
+  const string &value,
+  Rule *rule)
+{
+  if (key == "compression") {
+    // Not ParseCompressionAlgorithm(), which asserts on unknown names
+    if ((value == "zlib") || (value == "default")) {
+      rule->settings.compression_alg = zlib::kZlibDefault;
+    } else if (value == "none") {
+      rule->settings.compression_alg = zlib::kNoCompression;
+    } else if (value == "zstd") {
+      rule->settings.compression_alg = zlib::kZstd;
+    } else if (value == "lz4") {
+      rule->settings.compression_alg = zlib::kLz4;
+    } else {
+      return false;
+    }
+    if (!zlib::IsAlgorithmAvailable(rule->settings.compression_alg)) {
+      LogCvmfs(kLogSpooler, kLogStderr, "compression algorithm %s is not "
+               "available", value.c_str());
+      return false;
+    }
+    rule->has_compression = true;
+    return true;
+  }
+
+  if (key == "chunking") {
+    if (value == "off") {
+      rule->settings.use_chunking = false;
+    } else if (value == "xor32") {
+      rule->settings.use_chunking = true;
+      rule->settings.chunking_algorithm = SpoolerDefinition::kChunkingXor32;
+    } else if (value == "fastcdc") {
+      rule->settings.use_chunking = true;
+      rule->settings.chunking_algorithm = SpoolerDefinition::kChunkingFastCdc;
+    } else {
+      return false;
+    }
+    rule->has_chunking = true;
+    return true;
+  }
+
+  uint64_t number;
+  if (!String2Uint64Parse(value, &number))
+    return false;
+
+  if (key == "chunk_size") {
+    if (number < 2 * kMinChunkSize)
+      return false;
+    rule->settings.min_chunk_size = number / 2;
+    rule->settings.avg_chunk_size = number;
+    rule->settings.max_chunk_size = number * 2;
+    rule->has_chunk_size = true;
+    return true;
+  }
+
+  if (key == "sample") {
+    if (number > 100)
+      return false;
+    rule->settings.sample_threshold = number;
+    rule->has_sample_threshold = true;
+    return true;
+  }
+
+  return false;
+}
+
+
+void ProcessingPolicy::Apply(const string &path, Settings *settings) const {
+  for (unsigned i = 0; i < rules_.size(); ++i) {
+    const Rule &rule = rules_[i];
+    if (!rule.pathspec.IsMatchingRelaxed(path))
+      continue;
+    if (rule.has_compression)
+      settings->compression_alg = rule.settings.compression_alg;
+    if (rule.has_chunking) {
+      settings->use_chunking = rule.settings.use_chunking;
+      if (rule.settings.use_chunking)
+        settings->chunking_algorithm = rule.settings.chunking_algorithm;
+    }
+    if (rule.has_chunk_size) {
+      settings->min_chunk_size = rule.settings.min_chunk_size;
+      settings->avg_chunk_size = rule.settings.avg_chunk_size;
+      settings->max_chunk_size = rule.settings.max_chunk_size;
+    }
+    if (rule.has_sample_threshold)
+      settings->sample_threshold = rule.settings.sample_threshold;
+  }
+}
+
+}  // namespace upload
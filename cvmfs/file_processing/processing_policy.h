@@ -0,0 +1,127 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_FILE_PROCESSING_PROCESSING_POLICY_H_
+#define CVMFS_FILE_PROCESSING_PROCESSING_POLICY_H_
+
+#include <string>
+#include <vector>
+
+#include "compression.h"
+#include "pathspec/pathspec.h"
+#include "upload_spooler_definition.h"
+#include "util/single_copy.h"
+
+namespace upload {
+
+/**
+ * Selects the compression and chunking parameters per file.  The policy is
+ * read from a file similar to the .cvmfsdirtab, for instance
+ *
+ *   # Test the first block of all files
+ *   *         sample=90
+ *   # Payloads that are compressed already
+ *   *.gz      compression=none sample=0
+ *   *.jpg     compression=none sample=0
+ *   *.root    chunking=fastcdc chunk_size=16777216
+ *   /logs?*   compression=zstd chunking=off
+ *
+ * Every line consists of a pathspec (matched relaxed, as a shell pattern,
+ * against the path of a file in the repository) and a list of settings.
+ * Similar to .gitattributes, the settings of all matching lines apply in
+ * order, so that later lines override earlier ones.  Settings that no line
+ * sets keep the repository wide parameters.
+ *
+ *   compression=<zlib|zstd|lz4|none>
+ *   chunking=<off|xor32|fastcdc>  Chunking is only ever applied to regular
+ *                                 files, never to catalogs and bundles
+ *   chunk_size=<bytes>            Average chunk size; the minimal and maximal
+ *                                 chunk sizes are half and twice of it
+ *   sample=<percent>              Compress the first kSampleSize bytes of the
+ *                                 file upfront and store the file uncompressed
+ *                                 if the compressed sample is not smaller than
+ *                                 the given percentage of the sample.  Zero
+ *                                 turns off sampling.
+ */
+class ProcessingPolicy : SingleCopy {
+ public:
+  static const char kCommentMarker = '#';
+  static const unsigned kSampleSize = 64 * 1024;
+  static const size_t kMinChunkSize = 4 * 1024;
+
+  /**
+   * The processing parameters of a single file
+   */
+  struct Settings {
+    Settings()
+      : compression_alg(zlib::kZlibDefault)
+      , use_chunking(false)
+      , chunking_algorithm(SpoolerDefinition::kChunkingXor32)
+      , min_chunk_size(0)
+      , avg_chunk_size(0)
+      , max_chunk_size(0)
+      , sample_threshold(0)
+    { }
+
+    zlib::Algorithms compression_alg;
+    bool use_chunking;
+    SpoolerDefinition::ChunkingAlgorithm chunking_algorithm;
+    size_t min_chunk_size;
+    size_t avg_chunk_size;
+    size_t max_chunk_size;
+    /**
+     * Percentage of compressed to uncompressed sample size above which the
+     * file is not compressed, 0 for no sampling
+     */
+    unsigned sample_threshold;
+  };
+
+  /**
+   * Returns NULL if the policy file cannot be read or contains errors
+   */
+  static ProcessingPolicy *Create(const std::string &policy_path);
+  static ProcessingPolicy *CreateFromString(const std::string &policy);
+
+  /**
+   * Applies the rules matching the given repository path on top of settings.
+   */
+  void Apply(const std::string &path, Settings *settings) const;
+
+  /**
+   * Identifies the policy for the content cache of the publisher
+   */
+  std::string GetFingerprint() const { return fingerprint_; }
+  unsigned GetNumberOfRules() const { return rules_.size(); }
+
+ private:
+  struct Rule {
+    explicit Rule(const Pathspec &spec)
+      : pathspec(spec)
+      , has_compression(false)
+      , has_chunking(false)
+      , has_chunk_size(false)
+      , has_sample_threshold(false)
+    { }
+
+    Pathspec pathspec;
+    bool has_compression;
+    bool has_chunking;
+    bool has_chunk_size;
+    bool has_sample_threshold;
+    Settings settings;
+  };
+
+  ProcessingPolicy() { }
+  bool Parse(const std::string &policy);
+  bool ParseLine(const std::string &line);
+  bool ParseSetting(const std::string &key, const std::string &value,
+                    Rule *rule);
+
+  std::vector<Rule> rules_;
+  std::string fingerprint_;
+};
+
+}  // namespace upload
+
+#endif  // CVMFS_FILE_PROCESSING_PROCESSING_POLICY_H_
@@ -8,63 +8,46 @@
 #include <tbb/parallel_invoke.h>
 
 #include <algorithm>
+#include <cstring>
+#include <string>
 #include <vector>
 
 #include "file_processing/chunk.h"
 #include "file_processing/file.h"
 #include "file_processing/io_dispatcher.h"
 #include "hash.h"
+#include "util/probes.h"
 
 namespace upload {
 
 tbb::task* ChunkProcessingTask::execute() {
   // Thread Safety:
   //   * Only one ChunkProcessingTask for any given Chunk at any given time
+  //     (see Chunk::EnqueueBlock())
   //   * Parallel execution of more than one ChunkProcessingTask for chunks of
   //     the same File is possible
   //   * Multiple ChunkProcessingTasks might share the same CharBuffer
 
   assert(chunk_->IsInitialized());
-  assert(buffer_->IsInitialized());
 
-  // Get the position from where the current input buffer needs to be processed
-  // Two different cases:
-  //   -> The beginning of the CharBuffer, if the contained data lies in the
-  //      middle of the currently processed Chunk
-  //   -> At the position where the applicable data for the processed Chunk
-  //      starts (i.e. Chunk's starting offset is in the middle of the buffer)
-  const off_t internal_offset =
-    std::max(off_t(0), chunk_->offset() - buffer_->base_offset());
-  assert(internal_offset >= 0);
-  assert(static_cast<size_t>(internal_offset) <= buffer_->used_bytes());
-  const unsigned char *data = buffer_->ptr() + internal_offset;
-
-  // Determine how many bytes need to be processed
-  // Two different cases:
-  //   -> The full CharBuffer, if the FileScrubbingTask did not find any Chunk
-  //      cut marks in the current buffer (thus not defining the size of the
-  //      associated Chunk)
-  //   -> The end of the applicable data for the associated Chunk inside the
-  //      CharBuffer (defined by the size of the Chunk)
-  const size_t byte_count = (chunk_->size() == 0)
-    ? buffer_->used_bytes() - internal_offset
-    :   std::min(buffer_->base_offset()  + buffer_->used_bytes(),
-                 chunk_->offset()        + chunk_->size())
-      - std::max(buffer_->base_offset(), chunk_->offset());
-  assert(byte_count <= buffer_->used_bytes() - internal_offset);
-
-  // find out, if we are going to process the final block of the chunk
-  const bool finalize = (
-    (chunk_->IsFullyDefined()) &&
-    (buffer_->base_offset() + internal_offset + byte_count
-      == chunk_->offset() + chunk_->size()));
-
-  // crunch the data
-  Crunch(data, byte_count, finalize);
-
-  // finalize the chunk if necessary
-  if (finalize) {
-    chunk_->Finalize();
+  // work off the queued data Blocks in file order
+  ChunkBlock block;
+  while (chunk_->DequeueBlock(&block)) {
+    Crunch(block.data, block.bytes, block.finalize);
+
+    // the input buffer needs to be handed back before the Chunk gets committed,
+    // as the processing pipeline might be torn down right after that
+    block.buffer->Release();
+
+    // finalize and commit the chunk if necessary
+    // Note: the Chunk might be gone as soon as its commit is scheduled
+    if (block.finalize) {
+      chunk_->Finalize();
+      CVMFS_PROBE3(spool_chunk_processed, uint64_t(chunk_->offset()),
+                   chunk_->size(), chunk_->compressed_size());
+      chunk_->ScheduleCommit();
+      break;
+    }
   }
 
   // the TBB scheduler should figure out what to do next
@@ -76,6 +59,18 @@ void ChunkProcessingTask::Crunch(const unsigned char  *data,
                                  const size_t          bytes,
                                  const bool            finalize) {
   shash::ContextPtr &ch_ctx = chunk_->content_hash_context();
+  if (chunk_->digest_tree() != NULL)
+    chunk_->digest_tree()->Update(data, bytes);
+  if (chunk_->TakeEncryptionHeader()) {
+    const std::string &header = chunk_->encryptor()->header();
+    CharBuffer *header_buffer = chunk_->GetDeflateBuffer(
+      chunk_->compressor()->DeflateBound(bytes) + header.size());
+    assert(header_buffer->free_bytes() >= header.size());
+    unsigned char *header_start = header_buffer->free_space_ptr();
+    memcpy(header_start, header.data(), header.size());
+    header_buffer->SetUsedBytes(header_buffer->used_bytes() + header.size());
+    shash::Update(header_start, header.size(), ch_ctx);
+  }
   // We need to make a copy
   unsigned char* running_data = const_cast<unsigned char*>(data);
   size_t running_inputsize = bytes;
@@ -103,6 +98,10 @@ void ChunkProcessingTask::Crunch(const unsigned char  *data,
     //
     compress_buffer->SetUsedBytes(compress_buffer->used_bytes() + outbufsize);
 
+    // Encrypt in place, the hash is over the cipher text
+    if (chunk_->encryptor() != NULL)
+      chunk_->encryptor()->Update(output_start, outbufsize, output_start);
+
     // Update the hash
     shash::Update(output_start, outbufsize, ch_ctx);
   }
@@ -117,6 +116,12 @@ tbb::task* FileScrubbingTask::execute() {
 
   File *file = FileScrubbingTask::file();
 
+  // As long as a potentially chunked File has not been cut, its first Chunk
+  // might still become (or be copied into) the bulk Chunk. This requires the
+  // Chunk to be fully processed up to the current buffer.
+  const bool wait_for_processing =
+    file->MightBecomeChunked() && (file->chunks().size() <= 1);
+
   if (file->MightBecomeChunked()) {
     // find chunk cut marks in the current buffer and process all chunks that
     // are fully specified (i.e. not reaching beyond the current buffer)
@@ -149,40 +154,100 @@ tbb::task* FileScrubbingTask::execute() {
     QueueForDeferredProcessing(file->bulk_chunk());
   }
 
-  // wait for all scheduled chunk processing tasks on the current buffer
-  SpawnTasksAndWaitForProcessing();
-
-  // commit the chunks that have been finished during this processing step
-  CommitFinishedChunks();
+  // queue the current buffer for processing in all collected chunks
+  ScheduleChunkProcessing(wait_for_processing);
 
   // go on with the next file buffer
-  return Finalize();
+  // Note: the buffer is released by the ChunkProcessingTasks
+  const bool release_buffer = false;
+  return Finalize(release_buffer);
 }
 
 
-void FileScrubbingTask::SpawnTasksAndWaitForProcessing() {
-  tbb::task_list tasks;
-  std::vector<Chunk*>::const_iterator i    = chunks_to_process_.begin();
-  std::vector<Chunk*>::const_iterator iend = chunks_to_process_.end();
-  for (; i != iend; ++i) {
-    tbb::task *chunk_processing_task =
-      new(allocate_child()) ChunkProcessingTask(*i, buffer());
-    tasks.push_back(*chunk_processing_task);
-  }
+ChunkBlock FileScrubbingTask::CreateChunkBlock(
+  const Chunk       *chunk,
+  SharedReadBuffer  *shared_buffer) const
+{
+  const CharBuffer *buffer = FileScrubbingTask::buffer();
+  assert(buffer->IsInitialized());
+
+  // Get the position from where the current input buffer needs to be processed
+  // Two different cases:
+  //   -> The beginning of the CharBuffer, if the contained data lies in the
+  //      middle of the currently processed Chunk
+  //   -> At the position where the applicable data for the processed Chunk
+  //      starts (i.e. Chunk's starting offset is in the middle of the buffer)
+  const off_t internal_offset =
+    std::max(off_t(0), chunk->offset() - buffer->base_offset());
+  assert(internal_offset >= 0);
+  assert(static_cast<size_t>(internal_offset) <= buffer->used_bytes());
+  const unsigned char *data = buffer->ptr() + internal_offset;
+
+  // Determine how many bytes need to be processed
+  // Two different cases:
+  //   -> The full CharBuffer, if the FileScrubbingTask did not find any Chunk
+  //      cut marks in the current buffer (thus not defining the size of the
+  //      associated Chunk)
+  //   -> The end of the applicable data for the associated Chunk inside the
+  //      CharBuffer (defined by the size of the Chunk)
+  const size_t byte_count = (chunk->size() == 0)
+    ? buffer->used_bytes() - internal_offset
+    :   std::min(buffer->base_offset()  + buffer->used_bytes(),
+                 chunk->offset()        + chunk->size())
+      - std::max(buffer->base_offset(), chunk->offset());
+  assert(byte_count <= buffer->used_bytes() - internal_offset);
 
-  set_ref_count(chunks_to_process_.size() + 1);  // +1 for the wait
-  spawn_and_wait_for_all(tasks);
+  // find out, if we are going to process the final block of the chunk
+  // Note: this needs to be decided here, since the Chunk's size might be
+  //       defined by a later FileScrubbingTask while the ChunkProcessingTask
+  //       is still working on previous data Blocks
+  const bool finalize = (
+    (chunk->IsFullyDefined()) &&
+    (buffer->base_offset() + internal_offset + byte_count
+      == chunk->offset() + chunk->size()));
+
+  return ChunkBlock(shared_buffer, data, byte_count, finalize);
 }
 
 
-void FileScrubbingTask::CommitFinishedChunks() const {
+void FileScrubbingTask::ScheduleChunkProcessing(
+  const bool wait_for_processing)
+{
+  if (chunks_to_process_.empty()) {
+    reader()->ReleaseBuffer(buffer());
+    return;
+  }
+
+  SharedReadBuffer *shared_buffer =
+    new SharedReadBuffer(buffer(), reader(), chunks_to_process_.size());
+
+  // ChunkProcessingTasks are only spawned for Chunks that are not already
+  // being processed, the others will pick up the new data Block on their own
+  tbb::task_list tasks;
+  unsigned int   task_count = 0;
   std::vector<Chunk*>::const_iterator i    = chunks_to_process_.begin();
   std::vector<Chunk*>::const_iterator iend = chunks_to_process_.end();
   for (; i != iend; ++i) {
-    Chunk *current_chunk = *i;
-    if (current_chunk->IsFullyProcessed()) {
-      current_chunk->ScheduleCommit();
+    Chunk *chunk = *i;
+    const bool needs_task =
+      chunk->EnqueueBlock(CreateChunkBlock(chunk, shared_buffer));
+    if (!needs_task) {
+      assert(!wait_for_processing);
+      continue;
     }
+
+    tbb::task *chunk_processing_task = (wait_for_processing)
+      ? new(allocate_child())            ChunkProcessingTask(chunk)
+      : new(tbb::task::allocate_root())  ChunkProcessingTask(chunk);
+    tasks.push_back(*chunk_processing_task);
+    ++task_count;
+  }
+
+  if (wait_for_processing) {
+    set_ref_count(task_count + 1);  // +1 for the wait
+    spawn_and_wait_for_all(tasks);
+  } else if (task_count > 0) {
+    spawn(tasks);
   }
 }
 
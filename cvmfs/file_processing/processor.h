@@ -5,35 +5,69 @@
 #ifndef CVMFS_FILE_PROCESSING_PROCESSOR_H_
 #define CVMFS_FILE_PROCESSING_PROCESSOR_H_
 
+#include <tbb/atomic.h>
 #include <tbb/task.h>
 
+#include <cassert>
 #include <vector>
 
+#include "file_processing/async_reader.h"
 #include "file_processing/char_buffer.h"
+#include "file_processing/chunk.h"
 #include "file_processing/file_scrubbing_task.h"
 
 namespace upload {
 
-class Chunk;
 class IoDispatcher;
 class File;
 
 /**
- * This processes a data Block provided by the IoDispatcher in the context of a
+ * A CharBuffer of the Reader that is shared by all Chunks owning data inside
+ * its bounds. The last ChunkProcessingTask that is done with the data hands
+ * the CharBuffer back to the Reader.
+ */
+class SharedReadBuffer {
+ public:
+  SharedReadBuffer(CharBuffer      *buffer,
+                   AbstractReader  *reader,
+                   const unsigned   users) :
+    buffer_(buffer), reader_(reader)
+  {
+    assert(users > 0);
+    users_ = users;  // tbb::atomic has no init constructor
+  }
+
+  void Release() {
+    if (--users_ == 0) {
+      reader_->ReleaseBuffer(buffer_);
+      delete this;
+    }
+  }
+
+ private:
+  CharBuffer              *buffer_;
+  AbstractReader          *reader_;
+  tbb::atomic<unsigned>    users_;
+};
+
+
+/**
+ * This processes the queued data Blocks (see Chunk::EnqueueBlock()) of a
  * specific Chunk. For a specific CharBuffer there might be more than one Chunk-
  * ProcessingTask in flight concurrently, for example to process a bulk Chunk
  * and two Chunks partially owning data inside the bounds of the CharBuffer.
+ * Once a File is cut into several Chunks, the FileScrubbingTasks do not wait
+ * for the ChunkProcessingTasks, thus the Chunks of a File are crunched
+ * concurrently while the File is still being scrubbed.
  *
  * The ChunkProcessingTask is compressing the File data read by the IoDispatcher
  * in a streamed fashion. Additionally it computes the content hash of the com-
  * pressed File data. Furthermore it schedules the writing of processed data
- * Blocks.
+ * Blocks and the commit of the finished Chunk.
  */
 class ChunkProcessingTask : public tbb::task {
  public:
-  ChunkProcessingTask(Chunk        *chunk,
-                      CharBuffer   *buffer) :
-    chunk_(chunk), buffer_(buffer) {}
+  explicit ChunkProcessingTask(Chunk *chunk) : chunk_(chunk) {}
 
   tbb::task* execute();
 
@@ -55,10 +89,6 @@ class ChunkProcessingTask : public tbb::task {
 
  private:
   Chunk        *chunk_;   ///< the associated Chunk object (will be updated)
-  CharBuffer   *buffer_;  ///< the CharBuffer containing data to be processed
-                          ///< Note: not necessarily all data in this buffer is
-                          ///<       applicable for the associated Chunk
-                          ///<       (see: ChunkProcessingTask::execute)
 };
 
 
@@ -70,8 +100,8 @@ class ChunkProcessingTask : public tbb::task {
  *
  * The FileScrubbingTask runs over the complete file and handles the creation
  * of Chunks on the way. For each incoming data Block and each associated Chunk
- * it will spawn ChunkProcessingTasks that take care of the actual crunching of
- * Chunk contents.
+ * it will queue the applicable data and spawn ChunkProcessingTasks (if needed)
+ * that take care of the actual crunching of Chunk contents.
  */
 class FileScrubbingTask : public AbstractFileScrubbingTask<File> {
  protected:
@@ -99,8 +129,9 @@ class FileScrubbingTask : public AbstractFileScrubbingTask<File> {
     assert(chunk != NULL);
     chunks_to_process_.push_back(chunk);
   }
-  void SpawnTasksAndWaitForProcessing();
-  void CommitFinishedChunks() const;
+  ChunkBlock CreateChunkBlock(const Chunk       *chunk,
+                              SharedReadBuffer  *shared_buffer) const;
+  void ScheduleChunkProcessing(const bool wait_for_processing);
 
  private:
   /**
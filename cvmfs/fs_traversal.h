@@ -15,6 +15,7 @@
 
 #include <set>
 #include <string>
+#include <vector>
 
 #include "logging.h"
 #include "platform.h"
@@ -24,6 +25,36 @@
 namespace CVMFS_NAMESPACE_GUARD {
 #endif
 
+/**
+ * Source of directory listings that have been read ahead of the traversal,
+ * e.g. by the ParallelDirectoryScanner.  Listings are handed out at most once.
+ */
+class DirectoryPrefetcher {
+ public:
+  struct Entry {
+    Entry() : mode(0) { }
+    Entry(const std::string &n, const mode_t m) : name(n), mode(m) { }
+    bool operator <(const Entry &other) const { return name < other.name; }
+
+    std::string name;
+    mode_t mode;
+  };
+  typedef std::vector<Entry> Listing;
+
+  virtual ~DirectoryPrefetcher() { }
+  /**
+   * Returns false if the directory has not been scheduled for reading, the
+   * caller needs to read it itself.  Blocks until the listing is available.
+   */
+  virtual bool GetListing(const std::string &path, Listing *listing) = 0;
+  /**
+   * The traversal is not going to descend into path, drop its listing and the
+   * listings of its sub directories.
+   */
+  virtual void Discard(const std::string &path) = 0;
+};
+
+
 /**
  * @brief A simple recursion engine to abstract the recursion of directories.
  * It provides several callback hooks to instrument and control the recursion.
@@ -99,7 +130,8 @@ class FileSystemTraversal {
     fn_new_dir_postfix(NULL),
     delegate_(delegate),
     relative_to_directory_(relative_to_directory),
-    recurse_(recurse)
+    recurse_(recurse),
+    prefetcher_(NULL)
   {
     Init();
   }
@@ -126,6 +158,15 @@ class FileSystemTraversal {
     DoRecursion(dir_path, "");
   }
 
+  /**
+   * Optionally take directory listings from a prefetcher instead of reading
+   * the directories during the recursion.  The callbacks are still called
+   * from the thread running Recurse().
+   */
+  void SetPrefetcher(DirectoryPrefetcher *prefetcher) {
+    prefetcher_ = prefetcher;
+  }
+
  private:
   // The delegate all hooks are called on
   T *delegate_;
@@ -133,6 +174,7 @@ class FileSystemTraversal {
   /** dir_path in callbacks will be relative to this directory */
   std::string relative_to_directory_;
   bool recurse_;
+  DirectoryPrefetcher *prefetcher_;
 
 
   void Init() {
@@ -146,6 +188,28 @@ class FileSystemTraversal {
     const std::string path = parent_path + ((!dir_name.empty()) ?
                                            ("/" + dir_name) : "");
 
+    DirectoryPrefetcher::Listing listing;
+    if ((prefetcher_ != NULL) && prefetcher_->GetListing(path, &listing)) {
+      LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "entering prefetched %s "
+               "(%s -- %s)", path.c_str(), parent_path.c_str(),
+               dir_name.c_str());
+      Notify(fn_enter_dir, parent_path, dir_name);
+      for (unsigned i = 0; i < listing.size(); ++i) {
+        const std::string &name = listing[i].name;
+        if ((fn_ignore_file != NULL) && Notify(fn_ignore_file, path, name)) {
+          LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "ignoring %s/%s",
+                   path.c_str(), name.c_str());
+          if (S_ISDIR(listing[i].mode))
+            prefetcher_->Discard(path + "/" + name);
+          continue;
+        }
+        NotifyEntry(path, name, listing[i].mode);
+      }
+      LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "leaving %s", path.c_str());
+      Notify(fn_leave_dir, parent_path, dir_name);
+      return;
+    }
+
     // Change into directory and notify the user
     LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "entering %s (%s -- %s)",
              path.c_str(), parent_path.c_str(), dir_name.c_str());
@@ -183,42 +247,7 @@ class FileSystemTraversal {
                  (path + "/" + dit->d_name).c_str(), errno);
         abort();
       }
-      if (S_ISDIR(info.st_mode)) {
-        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing directory %s/%s",
-                 path.c_str(), dit->d_name);
-        if (Notify(fn_new_dir_prefix, path, dit->d_name) && recurse_) {
-          DoRecursion(path, dit->d_name);
-        }
-        Notify(fn_new_dir_postfix, path, dit->d_name);
-      } else if (S_ISREG(info.st_mode)) {
-        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing regular file %s/%s",
-                 path.c_str(), dit->d_name);
-        Notify(fn_new_file, path, dit->d_name);
-      } else if (S_ISLNK(info.st_mode)) {
-        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing symlink %s/%s",
-                 path.c_str(), dit->d_name);
-        Notify(fn_new_symlink, path, dit->d_name);
-      } else if (S_ISSOCK(info.st_mode)) {
-        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing socket %s/%s",
-                 path.c_str(), dit->d_name);
-        Notify(fn_new_socket, path, dit->d_name);
-      } else if (S_ISBLK(info.st_mode)) {
-        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing block-device %s/%s",
-                 path.c_str(), dit->d_name);
-        Notify(fn_new_block_dev, path, dit->d_name);
-      } else if (S_ISCHR(info.st_mode)) {
-        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing character-device "
-                                                  "%s/%s",
-                 path.c_str(), dit->d_name);
-        Notify(fn_new_character_dev, path, dit->d_name);
-      } else if (S_ISFIFO(info.st_mode)) {
-        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing FIFO %s/%s",
-                 path.c_str(), dit->d_name);
-        Notify(fn_new_fifo, path, dit->d_name);
-      } else {
-        LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "unknown file type %s/%s",
-                 path.c_str(), dit->d_name);
-      }
+      NotifyEntry(path, dit->d_name, info.st_mode);
     }
 
     // Close directory and notify user
@@ -227,6 +256,51 @@ class FileSystemTraversal {
     Notify(fn_leave_dir, parent_path, dir_name);
   }
 
+  void NotifyEntry(const std::string &path,
+                   const std::string &name,
+                   const mode_t mode) const
+  {
+    const char *entry_name = name.c_str();
+    if (S_ISDIR(mode)) {
+      LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing directory %s/%s",
+               path.c_str(), entry_name);
+      if (Notify(fn_new_dir_prefix, path, name) && recurse_) {
+        DoRecursion(path, name);
+      } else if (prefetcher_ != NULL) {
+        prefetcher_->Discard(path + "/" + name);
+      }
+      Notify(fn_new_dir_postfix, path, name);
+    } else if (S_ISREG(mode)) {
+      LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing regular file %s/%s",
+               path.c_str(), entry_name);
+      Notify(fn_new_file, path, name);
+    } else if (S_ISLNK(mode)) {
+      LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing symlink %s/%s",
+               path.c_str(), entry_name);
+      Notify(fn_new_symlink, path, name);
+    } else if (S_ISSOCK(mode)) {
+      LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing socket %s/%s",
+               path.c_str(), entry_name);
+      Notify(fn_new_socket, path, name);
+    } else if (S_ISBLK(mode)) {
+      LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing block-device %s/%s",
+               path.c_str(), entry_name);
+      Notify(fn_new_block_dev, path, name);
+    } else if (S_ISCHR(mode)) {
+      LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing character-device "
+                                                "%s/%s",
+               path.c_str(), entry_name);
+      Notify(fn_new_character_dev, path, name);
+    } else if (S_ISFIFO(mode)) {
+      LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "passing FIFO %s/%s",
+               path.c_str(), entry_name);
+      Notify(fn_new_fifo, path, name);
+    } else {
+      LogCvmfs(kLogFsTraversal, kLogVerboseMsg, "unknown file type %s/%s",
+               path.c_str(), entry_name);
+    }
+  }
+
   inline bool Notify(const BoolCallback callback,
                      const std::string &parent_path,
                      const std::string &entry_name) const
@@ -0,0 +1,254 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "fs_traversal_parallel.h"
+
+#include <dirent.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "logging.h"
+#include "platform.h"
+#include "util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+#ifdef CVMFS_NAMESPACE_GUARD
+namespace CVMFS_NAMESPACE_GUARD {
+#endif
+
+const unsigned ParallelDirectoryScanner::kDefaultMaxListings;
+
+
+/**
+ * Like a byte-wise comparison but with '/' sorting before any other
+ * character.  Since directory listings are sorted by name, this is the order
+ * in which a depth-first traversal visits the directories.
+ */
+bool ParallelDirectoryScanner::PathOrder::operator ()(
+  const string &a,
+  const string &b) const
+{
+  const unsigned length = std::min(a.length(), b.length());
+  for (unsigned i = 0; i < length; ++i) {
+    unsigned char ca = a[i];
+    unsigned char cb = b[i];
+    if (ca == cb)
+      continue;
+    if (ca == '/')
+      return true;
+    if (cb == '/')
+      return false;
+    return ca < cb;
+  }
+  return a.length() < b.length();
+}
+
+
+bool ParallelDirectoryScanner::IsDescendant(
+  const string &path,
+  const string &ancestor)
+{
+  return (path.length() > ancestor.length()) &&
+         (path[ancestor.length()] == '/') &&
+         (path.compare(0, ancestor.length(), ancestor) == 0);
+}
+
+
+ParallelDirectoryScanner::ParallelDirectoryScanner(
+  const unsigned num_threads,
+  const unsigned max_listings,
+  Filter *filter)
+  : num_threads_(num_threads)
+  , max_listings_(max_listings)
+  , filter_(filter)
+  , terminate_(false)
+{
+  assert(num_threads_ > 0);
+  assert(max_listings_ > 0);
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&cond_changed_, NULL);
+  assert(retval == 0);
+}
+
+
+ParallelDirectoryScanner::~ParallelDirectoryScanner() {
+  {
+    MutexLockGuard guard(lock_);
+    terminate_ = true;
+    pthread_cond_broadcast(&cond_changed_);
+  }
+  for (unsigned i = 0; i < threads_.size(); ++i)
+    pthread_join(threads_[i], NULL);
+
+  for (ListingMap::iterator i = completed_.begin(), iEnd = completed_.end();
+       i != iEnd; ++i)
+  {
+    delete i->second;
+  }
+  pthread_cond_destroy(&cond_changed_);
+  pthread_mutex_destroy(&lock_);
+}
+
+
+void ParallelDirectoryScanner::Start(const string &root_path) {
+  assert(threads_.empty());
+  pending_.insert(root_path);
+
+  threads_.resize(num_threads_);
+  for (unsigned i = 0; i < num_threads_; ++i) {
+    int retval = pthread_create(&threads_[i], NULL, MainWorker, this);
+    assert(retval == 0);
+  }
+  LogCvmfs(kLogFsTraversal, kLogDebug, "started %u directory scanner threads "
+           "for %s", num_threads_, root_path.c_str());
+}
+
+
+/**
+ * Workers pick the pending directory that comes first in traversal order.
+ * Once the read-ahead listings fill the buffer, only the directory that the
+ * traversal needs before any of the buffered ones may be read.  Otherwise the
+ * traversal might wait for a listing that is never going to be read.
+ */
+bool ParallelDirectoryScanner::CanStart() const {
+  if (pending_.empty())
+    return false;
+  if (completed_.size() + in_progress_.size() < max_listings_)
+    return true;
+  return completed_.empty() ||
+         PathOrder()(*pending_.begin(), completed_.begin()->first);
+}
+
+
+void *ParallelDirectoryScanner::MainWorker(void *data) {
+  ParallelDirectoryScanner *scanner =
+    reinterpret_cast<ParallelDirectoryScanner *>(data);
+
+  while (true) {
+    string path;
+    {
+      MutexLockGuard guard(scanner->lock_);
+      while (!scanner->terminate_ && !scanner->CanStart())
+        pthread_cond_wait(&scanner->cond_changed_, &scanner->lock_);
+      if (scanner->terminate_)
+        break;
+      path = *scanner->pending_.begin();
+      scanner->pending_.erase(scanner->pending_.begin());
+      scanner->in_progress_.insert(path);
+    }
+
+    Listing *listing = new Listing();
+    ReadDirectory(path, listing);
+    vector<string> sub_dirs;
+    for (unsigned i = 0; i < listing->size(); ++i) {
+      if (!S_ISDIR((*listing)[i].mode))
+        continue;
+      const string sub_dir = path + "/" + (*listing)[i].name;
+      if ((scanner->filter_ == NULL) || scanner->filter_->Descend(sub_dir))
+        sub_dirs.push_back(sub_dir);
+    }
+
+    MutexLockGuard guard(scanner->lock_);
+    scanner->in_progress_.erase(path);
+    if (scanner->discarded_.erase(path) > 0) {
+      delete listing;
+    } else {
+      scanner->completed_[path] = listing;
+      scanner->pending_.insert(sub_dirs.begin(), sub_dirs.end());
+    }
+    pthread_cond_broadcast(&scanner->cond_changed_);
+  }
+  return NULL;
+}
+
+
+void ParallelDirectoryScanner::ReadDirectory(
+  const string &path,
+  Listing *listing)
+{
+  DIR *dip = opendir(path.c_str());
+  if (!dip) {
+    LogCvmfs(kLogFsTraversal, kLogStderr, "Failed to open %s (%d).\n"
+             "Please check directory permissions.",
+             path.c_str(), errno);
+    abort();
+  }
+  platform_dirent64 *dit;
+  while ((dit = platform_readdir(dip)) != NULL) {
+    if ((strcmp(dit->d_name, ".") == 0) || (strcmp(dit->d_name, "..") == 0))
+      continue;
+    const string entry_path = path + "/" + dit->d_name;
+    platform_stat64 info;
+    int retval = platform_lstat(entry_path.c_str(), &info);
+    if (retval != 0) {
+      LogCvmfs(kLogFsTraversal, kLogStderr, "failed to lstat '%s' errno: %d",
+               entry_path.c_str(), errno);
+      abort();
+    }
+    listing->push_back(Entry(dit->d_name, info.st_mode));
+  }
+  closedir(dip);
+  std::sort(listing->begin(), listing->end());
+}
+
+
+bool ParallelDirectoryScanner::GetListing(
+  const string &path,
+  Listing *listing)
+{
+  MutexLockGuard guard(lock_);
+  while (true) {
+    ListingMap::iterator i = completed_.find(path);
+    if (i != completed_.end()) {
+      listing->swap(*i->second);
+      delete i->second;
+      completed_.erase(i);
+      pthread_cond_broadcast(&cond_changed_);
+      return true;
+    }
+    if ((pending_.find(path) == pending_.end()) &&
+        (in_progress_.find(path) == in_progress_.end()))
+    {
+      return false;
+    }
+    pthread_cond_wait(&cond_changed_, &lock_);
+  }
+}
+
+
+void ParallelDirectoryScanner::Discard(const string &path) {
+  MutexLockGuard guard(lock_);
+  // In depth-first order, the sub directories of path form a contiguous range
+  // that starts with path itself
+  PathSet::iterator i = pending_.lower_bound(path);
+  while ((i != pending_.end()) && ((*i == path) || IsDescendant(*i, path)))
+    pending_.erase(i++);
+
+  ListingMap::iterator j = completed_.lower_bound(path);
+  while ((j != completed_.end()) &&
+         ((j->first == path) || IsDescendant(j->first, path)))
+  {
+    delete j->second;
+    completed_.erase(j++);
+  }
+
+  for (PathSet::const_iterator k = in_progress_.lower_bound(path),
+       kEnd = in_progress_.end();
+       (k != kEnd) && ((*k == path) || IsDescendant(*k, path)); ++k)
+  {
+    discarded_.insert(*k);
+  }
+  pthread_cond_broadcast(&cond_changed_);
+}
+
+#ifdef CVMFS_NAMESPACE_GUARD
+}  // namespace CVMFS_NAMESPACE_GUARD
+#endif
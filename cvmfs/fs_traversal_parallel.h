@@ -0,0 +1,103 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * The ParallelDirectoryScanner reads directories ahead of a (single-threaded)
+ * depth-first traversal, such as the FileSystemTraversal.  Worker threads
+ * open and lstat() the directory entries and store sorted listings, the
+ * traversal picks them up in the order it visits the directories.  Hence the
+ * traversal's callbacks keep their order guarantees (a directory is notified
+ * before its children) while the file system latency is hidden.
+ */
+
+#ifndef CVMFS_FS_TRAVERSAL_PARALLEL_H_
+#define CVMFS_FS_TRAVERSAL_PARALLEL_H_
+
+#include <pthread.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "fs_traversal.h"
+#include "util/single_copy.h"
+
+#ifdef CVMFS_NAMESPACE_GUARD
+namespace CVMFS_NAMESPACE_GUARD {
+#endif
+
+class ParallelDirectoryScanner : public DirectoryPrefetcher, SingleCopy {
+ public:
+  /**
+   * Decides if a sub directory should be read ahead of time.  Called
+   * concurrently from the worker threads.
+   */
+  class Filter {
+   public:
+    virtual ~Filter() { }
+    virtual bool Descend(const std::string &path) = 0;
+  };
+
+  /**
+   * Sorts paths in depth-first order, i.e. a directory is immediately followed
+   * by its descendants.
+   */
+  struct PathOrder {
+    bool operator ()(const std::string &a, const std::string &b) const;
+  };
+
+  static const unsigned kDefaultMaxListings = 1024;
+
+  /**
+   * @param num_threads   number of concurrent directory readers
+   * @param max_listings  bounds the number of listings that are read ahead
+   * @param filter        optional, if NULL all sub directories are read
+   */
+  ParallelDirectoryScanner(const unsigned num_threads,
+                           const unsigned max_listings,
+                           Filter *filter);
+  ~ParallelDirectoryScanner();
+
+  void Start(const std::string &root_path);
+  virtual bool GetListing(const std::string &path, Listing *listing);
+  virtual void Discard(const std::string &path);
+
+  static bool IsDescendant(const std::string &path,
+                           const std::string &ancestor);
+
+ private:
+  typedef std::set<std::string, PathOrder> PathSet;
+  typedef std::map<std::string, Listing *, PathOrder> ListingMap;
+
+  static void *MainWorker(void *data);
+  bool CanStart() const;
+  static void ReadDirectory(const std::string &path, Listing *listing);
+
+  unsigned num_threads_;
+  unsigned max_listings_;
+  Filter *filter_;
+  std::vector<pthread_t> threads_;
+
+  pthread_mutex_t lock_;
+  /**
+   * Signals new listings, new pending directories, and free space
+   */
+  pthread_cond_t cond_changed_;
+  bool terminate_;
+  /**
+   * Directories not yet picked up by a worker thread
+   */
+  PathSet pending_;
+  PathSet in_progress_;
+  /**
+   * Directories removed by Discard() while being read
+   */
+  PathSet discarded_;
+  ListingMap completed_;
+};
+
+#ifdef CVMFS_NAMESPACE_GUARD
+}  // namespace CVMFS_NAMESPACE_GUARD
+#endif
+
+#endif  // CVMFS_FS_TRAVERSAL_PARALLEL_H_
@@ -7,12 +7,15 @@
 #include "cvmfs_config.h"
 #include "fuse_evict.h"
 
+#include <errno.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <stdint.h>
 
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
 
 #include "glue_buffer.h"
 #include "logging.h"
@@ -47,6 +50,7 @@ void FuseInvalidator::Handle::WaitFor() {
 const unsigned FuseInvalidator::kTimeoutSafetyMarginSec = 1;
 const unsigned FuseInvalidator::kCheckTimeoutFreqMs = 100;
 const unsigned FuseInvalidator::kCheckTimeoutFreqOps = 256;
+const unsigned FuseInvalidator::kCompactFreqMs = 10000;
 
 
 bool FuseInvalidator::HasFuseNotifyInval() {
@@ -96,19 +100,74 @@ void FuseInvalidator::InvalidateDentries(Handle *handle) {
 }
 
 
+void FuseInvalidator::InvalidatePaths(
+  Handle *handle,
+  std::vector<PathString> *paths)
+{
+  assert(handle != NULL);
+  assert(paths != NULL);
+  char c = 'P';
+  WritePipe(pipe_ctrl_[1], &c, 1);
+  WritePipe(pipe_ctrl_[1], &handle, sizeof(handle));
+  WritePipe(pipe_ctrl_[1], &paths, sizeof(paths));
+}
+
+
+/**
+ * Called after every eviction.  Every kCheckTimeoutFreqOps operations, checks
+ * whether the caches are anyway drained out by timeout or whether the thread
+ * should be shut down.
+ */
+bool FuseInvalidator::IsCanceled(unsigned num_ops, uint64_t deadline) {
+  if ((num_ops % kCheckTimeoutFreqOps) != 0)
+    return false;
+  if (platform_monotonic_time() >= deadline) {
+    LogCvmfs(kLogCvmfs, kLogDebug,
+             "cancel cache eviction after %u entries due to timeout", num_ops);
+    return true;
+  }
+  if (atomic_read32(&terminated_) == 1) {
+    LogCvmfs(kLogCvmfs, kLogDebug, "cancel cache eviction due to termination");
+    return true;
+  }
+  return false;
+}
+
+
 void *FuseInvalidator::MainInvalidator(void *data) {
   FuseInvalidator *invalidator = reinterpret_cast<FuseInvalidator *>(data);
   LogCvmfs(kLogCvmfs, kLogDebug, "starting dentry invalidator thread");
 
   char c;
   Handle *handle;
+  struct pollfd watch_ctrl;
+  watch_ctrl.fd = invalidator->pipe_ctrl_[0];
+  watch_ctrl.events = POLLIN | POLLPRI;
   while (true) {
+    watch_ctrl.revents = 0;
+    int retval = poll(&watch_ctrl, 1, kCompactFreqMs);
+    if (retval < 0) {
+      if (errno == EINTR)
+        continue;
+      LogCvmfs(kLogCvmfs, kLogSyslogErr | kLogDebug,
+               "dentry invalidator connection failure (%d)", errno);
+      abort();
+    }
+    if (retval == 0) {
+      if (invalidator->inode_tracker_->Compact())
+        LogCvmfs(kLogCvmfs, kLogDebug, "compacted inode tracker");
+      continue;
+    }
+
     ReadPipe(invalidator->pipe_ctrl_[0], &c, 1);
     if (c == 'Q')
       break;
 
-    assert(c == 'I');
+    assert((c == 'I') || (c == 'P'));
     ReadPipe(invalidator->pipe_ctrl_[0], &handle, sizeof(handle));
+    vector<PathString> *paths = NULL;
+    if (c == 'P')
+      ReadPipe(invalidator->pipe_ctrl_[0], &paths, sizeof(paths));
     LogCvmfs(kLogCvmfs, kLogDebug, "invalidating kernel caches, timeout %u",
              handle->timeout_s_);
 
@@ -125,6 +184,40 @@ void *FuseInvalidator::MainInvalidator(void *data) {
         }
       }
       handle->SetDone();
+      delete paths;
+      continue;
+    }
+
+    if (paths != NULL) {
+      unsigned i = 0;
+      unsigned N = paths->size();
+      while (i < N) {
+        const PathString &path = (*paths)[i];
+        // Paths that the kernel never looked up have no inode in the tracker
+        if (!path.IsEmpty()) {
+          PathString parent_path = GetParentPath(path);
+          uint64_t parent_inode = parent_path.IsEmpty() ?
+            FUSE_ROOT_ID : invalidator->inode_tracker_->FindInode(parent_path);
+          if (parent_inode != 0) {
+            NameString name = GetFileName(path);
+            fuse_lowlevel_notify_inval_entry(*invalidator->fuse_channel_,
+              parent_inode, name.GetChars(), name.GetLength());
+          }
+        }
+        uint64_t inode = path.IsEmpty() ?
+          FUSE_ROOT_ID : invalidator->inode_tracker_->FindInode(path);
+        if (inode != 0) {
+          fuse_lowlevel_notify_inval_inode(*invalidator->fuse_channel_,
+                                           inode, 0, 0);
+        }
+        LogCvmfs(kLogCvmfs, kLogDebug, "evicting %s (inode %" PRIu64 ")",
+                 path.c_str(), inode);
+
+        if (invalidator->IsCanceled(++i, deadline))
+          break;
+      }
+      handle->SetDone();
+      delete paths;
       continue;
     }
 
@@ -155,18 +248,8 @@ void *FuseInvalidator::MainInvalidator(void *data) {
       LogCvmfs(kLogCvmfs, kLogDebug, "evicting <%" PRIu64 ">/%s",
                evictable_object.inode, evictable_object.name.c_str());
 
-      if ((++i % kCheckTimeoutFreqOps) == 0) {
-        if (platform_monotonic_time() >= deadline) {
-          LogCvmfs(kLogCvmfs, kLogDebug,
-                   "cancel cache eviction after %u entries due to timeout", i);
-          break;
-        }
-        if (atomic_read32(&invalidator->terminated_) == 1) {
-          LogCvmfs(kLogCvmfs, kLogDebug,
-                   "cancel cache eviction due to termination");
-          break;
-        }
-      }
+      if (invalidator->IsCanceled(++i, deadline))
+        break;
     }
     handle->SetDone();
     invalidator->evict_list_.Clear();
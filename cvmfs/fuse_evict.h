@@ -8,6 +8,8 @@
 #include <pthread.h>
 #include <stdint.h>
 
+#include <vector>
+
 #include "atomic.h"
 #include "bigvector.h"
 #include "duplex_fuse.h"
@@ -27,11 +29,18 @@ class InodeTracker;
  *
  * Evicting entries from the cache must be done from a separate thread to
  * avoid a deadlock in the fuse callbacks (see Fuse documenatation).
+ *
+ * Instead of all the known dentries, the invalidator can also evict a given
+ * list of paths, e.g. the paths that changed between two catalog revisions.
+ *
+ * While idle, the thread periodically compacts the inode tracker so that
+ * memory is returned after many inodes have been forgotten.
  */
 class FuseInvalidator : SingleCopy {
   FRIEND_TEST(T_FuseInvalidator, StartStop);
   FRIEND_TEST(T_FuseInvalidator, InvalidateTimeout);
   FRIEND_TEST(T_FuseInvalidator, InvalidateOps);
+  FRIEND_TEST(T_FuseInvalidator, InvalidatePaths);
 
  public:
   static bool HasFuseNotifyInval();
@@ -65,6 +74,13 @@ class FuseInvalidator : SingleCopy {
   ~FuseInvalidator();
   void Spawn();
   void InvalidateDentries(Handle *handle);
+  /**
+   * Evicts the dentries and the inode attributes and pages of the given paths,
+   * as far as they are known to the kernel.  Takes ownership of paths.  If the
+   * fuse library does not support active eviction, it waits for the timeout
+   * like InvalidateDentries.
+   */
+  void InvalidatePaths(Handle *handle, std::vector<PathString> *paths);
 
  private:
   /**
@@ -80,6 +96,10 @@ class FuseInvalidator : SingleCopy {
    * caches are anyway drained out by timeout.
    */
   static const unsigned kCheckTimeoutFreqOps;  // = 256
+  /**
+   * Interval of the inode tracker compaction when the thread is idle.
+   */
+  static const unsigned kCompactFreqMs;  // = 10000
 
   /**
    * The information given to fuse_lowlevel_notify_inval_entry
@@ -90,6 +110,7 @@ class FuseInvalidator : SingleCopy {
   };
 
   static void *MainInvalidator(void *data);
+  bool IsCanceled(unsigned num_ops, uint64_t deadline);
 
   glue::InodeTracker *inode_tracker_;
   struct fuse_chan **fuse_channel_;
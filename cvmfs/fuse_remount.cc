@@ -12,18 +12,99 @@
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
+#include <string>
+#include <vector>
 
 #include "backoff.h"
+#include "catalog_diff_tool.h"
 #include "catalog_mgr_client.h"
 #include "fuse_inode_gen.h"
 #include "logging.h"
 #include "lru_md.h"
 #include "mountpoint.h"
 #include "platform.h"
+#include "prng.h"
+#include "runtime_config.h"
+#include "statistics.h"
+#include "util/pointer.h"
 #include "util/posix.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
+namespace {
+
+/**
+ * Gives the diff tool access to a catalog manager that it doesn't own.  The
+ * diff tool deletes its catalog managers, which must not happen to the live
+ * catalog manager of the mount point.  Remembers failed listings (catalog
+ * load errors) so that the diff can be disregarded.
+ */
+class DiffCatalogMgr {
+ public:
+  explicit DiffCatalogMgr(catalog::ClientCatalogManager *catalog_mgr)
+    : catalog_mgr_(catalog_mgr)
+    , failed_(false)
+  { }
+  catalog::ListingStream *OpenListingStream(const PathString &path) {
+    catalog::ListingStream *result = catalog_mgr_->OpenListingStream(path);
+    if (result == NULL)
+      failed_ = true;
+    return result;
+  }
+  bool LookupXattrs(const PathString &path, XattrList *xattrs) {
+    return catalog_mgr_->LookupXattrs(path, xattrs);
+  }
+  shash::Any GetNestedCatalogHash(const PathString &mountpoint) {
+    return catalog_mgr_->GetNestedCatalogHash(mountpoint);
+  }
+  bool failed() const { return failed_; }
+
+ private:
+  catalog::ClientCatalogManager *catalog_mgr_;
+  bool failed_;
+};
+
+
+/**
+ * Collects all the added, removed, and modified paths.  That includes the
+ * parent directories of added and removed entries because their mtime changes.
+ */
+class ChangedPathCollector : public CatalogDiffTool<DiffCatalogMgr> {
+ public:
+  ChangedPathCollector(DiffCatalogMgr *old_catalog_mgr,
+                       DiffCatalogMgr *new_catalog_mgr,
+                       vector<PathString> *paths)
+    : CatalogDiffTool<DiffCatalogMgr>(old_catalog_mgr, new_catalog_mgr)
+    , paths_(paths)
+  { }
+
+ protected:
+  virtual void ReportAddition(const PathString &path,
+                              const catalog::DirectoryEntry & /* entry */,
+                              const XattrList & /* xattrs */)
+  {
+    paths_->push_back(path);
+  }
+  virtual void ReportRemoval(const PathString &path,
+                             const catalog::DirectoryEntry & /* entry */)
+  {
+    paths_->push_back(path);
+  }
+  virtual void ReportModification(const PathString &path,
+                                  const catalog::DirectoryEntry & /* old */,
+                                  const catalog::DirectoryEntry & /* new */,
+                                  const XattrList & /* xattrs */)
+  {
+    paths_->push_back(path);
+  }
+
+ private:
+  vector<PathString> *paths_;
+};
+
+}  // anonymous namespace
+
 
 /**
  * Executed by the trigger thread, or triggered from cvmfs_talk.  Moves into
@@ -45,7 +126,9 @@ FuseRemounter::Status FuseRemounter::Check() {
   }
 
   LogCvmfs(kLogCvmfs, kLogDebug, "remounting root catalog");
-  catalog::LoadError retval = mountpoint_->catalog_mgr()->Remount(true);
+  shash::Any new_root_hash;
+  catalog::LoadError retval =
+    mountpoint_->catalog_mgr()->RemountDryrun(&new_root_hash);
   switch (retval) {
     case catalog::kLoadNew:
       if (atomic_cas32(&drainout_mode_, 0, 1)) {
@@ -53,10 +136,11 @@ FuseRemounter::Status FuseRemounter::Check() {
         LogCvmfs(kLogCvmfs, kLogDebug,
                  "new catalog revision available, "
                  "draining out meta-data caches");
-        invalidator_handle_.Reset();
-        invalidator_->InvalidateDentries(&invalidator_handle_);
+        PublishModes();
+        InvalidateKernelCaches(new_root_hash);
         atomic_inc32(&drainout_mode_);
         // drainout_mode_ == 2, IsInDrainoutMode is now 'true'
+        PublishModes();
       } else {
         LogCvmfs(kLogCvmfs, kLogDebug, "already in drainout mode, leaving");
       }
@@ -82,6 +166,99 @@ FuseRemounter::Status FuseRemounter::Check() {
 }
 
 
+/**
+ * Executed by the trigger thread shortly before the catalog TTL expires.  If a
+ * new revision is available, downloads its catalogs that replace the mounted
+ * ones.  Leaves the mounted revision and the kernel caches untouched; the
+ * actual remount follows with Check() on TTL expiry.
+ */
+void FuseRemounter::PreloadCatalogs() {
+  FenceGuard fence_guard(&fence_maintenance_);
+  if (IsInMaintenanceMode() || !IsCaching())
+    return;
+
+  shash::Any new_root_hash;
+  catalog::LoadError retval =
+    mountpoint_->catalog_mgr()->RemountDryrun(&new_root_hash);
+  if ((retval != catalog::kLoadNew) || new_root_hash.IsNull())
+    return;
+  LogCvmfs(kLogCvmfs, kLogDebug, "preloading catalogs of new revision %s",
+           new_root_hash.ToString().c_str());
+  mountpoint_->catalog_mgr()->PreloadCatalogs(new_root_hash);
+}
+
+
+/**
+ * Figures out which paths differ between the active root catalog and the new
+ * one.  The new catalogs are loaded by a temporary catalog manager; they end
+ * up in the cache, so that the actual remount later on does not need to
+ * download them again.  Returns false if a catalog cannot be loaded or if there
+ * are too many changes.
+ */
+bool FuseRemounter::GetChangedPaths(
+  const shash::Any &new_root_hash,
+  vector<PathString> *paths)
+{
+  catalog::ClientCatalogManager *catalog_mgr = mountpoint_->catalog_mgr();
+  // The temporary catalog manager unpins its catalogs when it is deleted.
+  // Pins are not reference counted, so catalogs shared with the active catalog
+  // manager may become unpinned, too.  The diff does not descend into
+  // identical nested catalogs, which keeps that set small.
+  perf::Statistics statistics;
+  UniquePtr<catalog::ClientCatalogManager> new_catalog_mgr(
+    new catalog::ClientCatalogManager(catalog_mgr->repo_name(),
+                                      mountpoint_->fetcher(),
+                                      mountpoint_->signature_mgr(),
+                                      &statistics));
+  if (!new_catalog_mgr->InitFixed(new_root_hash, false)) {
+    LogCvmfs(kLogCvmfs, kLogDebug, "failed to load new root catalog %s",
+             new_root_hash.ToString().c_str());
+    return false;
+  }
+
+  // Owned by the diff tool
+  DiffCatalogMgr *old_diff_mgr = new DiffCatalogMgr(catalog_mgr);
+  DiffCatalogMgr *new_diff_mgr = new DiffCatalogMgr(new_catalog_mgr.weak_ref());
+  ChangedPathCollector collector(old_diff_mgr, new_diff_mgr, paths);
+  collector.Run(PathString("", 0));
+  if (old_diff_mgr->failed() || new_diff_mgr->failed()) {
+    LogCvmfs(kLogCvmfs, kLogDebug, "failed to load catalogs for the diff");
+    return false;
+  }
+  // The root directory is not reported by the diff tool
+  paths->push_back(PathString("", 0));
+  return paths->size() <= kMaxChangedPaths;
+}
+
+
+/**
+ * Called when moving into drainout mode.  Evicts either only the changed paths
+ * or all the known dentries from the kernel caches.
+ */
+void FuseRemounter::InvalidateKernelCaches(const shash::Any &new_root_hash) {
+  invalidator_handle_.Reset();
+  expected_root_hash_ = shash::Any();
+  if (mountpoint_->selective_kcache_invalidation() &&
+      FuseInvalidator::HasFuseNotifyInval() && !new_root_hash.IsNull())
+  {
+    vector<PathString> *paths = new vector<PathString>();
+    if (GetChangedPaths(new_root_hash, paths)) {
+      LogCvmfs(kLogCvmfs, kLogDebug,
+               "evicting %u changed paths from the kernel caches",
+               static_cast<unsigned>(paths->size()));
+      expected_root_hash_ = new_root_hash;
+      invalidator_->InvalidatePaths(&invalidator_handle_, paths);
+      return;
+    }
+    LogCvmfs(kLogCvmfs, kLogDebug,
+             "selective invalidation not possible (%u paths), "
+             "evicting all dentries", static_cast<unsigned>(paths->size()));
+    delete paths;
+  }
+  invalidator_->InvalidateDentries(&invalidator_handle_);
+}
+
+
 /**
  * Used from the TalkManager.  Continously calls 'check' until it returns with
  * "up to date" or a failure.
@@ -105,6 +282,7 @@ FuseRemounter::Status FuseRemounter::CheckSynchronously() {
 void FuseRemounter::EnterMaintenanceMode() {
   fence_maintenance_.Drain();
   atomic_cas32(&maintenance_mode_, 0, 1);
+  PublishModes();
   fence_maintenance_.Open();
 
   // All running Check() and TryFinish() methods returned.  Both methods now
@@ -125,6 +303,7 @@ FuseRemounter::FuseRemounter(
   , inode_generation_info_(inode_generation_info)
   , invalidator_(new FuseInvalidator(mountpoint->inode_tracker(), fuse_channel))
   , invalidator_handle_(mountpoint->kcache_timeout_sec())
+  , invalidator_handle_all_(mountpoint->kcache_timeout_sec())
   , fence_(new Fence())
   , catalogs_valid_until_(MountPoint::kIndefiniteDeadline)
 {
@@ -133,6 +312,8 @@ FuseRemounter::FuseRemounter(
   atomic_init32(&drainout_mode_);
   atomic_init32(&maintenance_mode_);
   atomic_init32(&critical_section_);
+  int retval = pthread_mutex_init(&lock_publish_, NULL);
+  assert(retval == 0);
 }
 
 
@@ -145,12 +326,15 @@ FuseRemounter::~FuseRemounter() {
   }
   delete invalidator_;
   delete fence_;
+  pthread_mutex_destroy(&lock_publish_);
 }
 
 
 /**
  * Triggers the Check() method when the catalog TTL expires.  Works essentially
- * as an alarm() timer.
+ * as an alarm() timer.  If catalog preloading is enabled, the alarm first
+ * goes off a little earlier for PreloadCatalogs().  With a remount jitter,
+ * every alarm is delayed by a random number of seconds up to the jitter.
  */
 void *FuseRemounter::MainRemountTrigger(void *data) {
   FuseRemounter *remounter = reinterpret_cast<FuseRemounter *>(data);
@@ -158,6 +342,10 @@ void *FuseRemounter::MainRemountTrigger(void *data) {
   char c;
   int timeout_ms = -1;
   uint64_t deadline = 0;
+  // Deadline of the Check() if the next wake-up is for preloading, else 0
+  uint64_t check_deadline = 0;
+  Prng prng;
+  prng.InitLocaltime();
   struct pollfd watch_ctrl;
   watch_ctrl.fd = remounter->pipe_remount_trigger_[0];
   watch_ctrl.events = POLLIN | POLLPRI;
@@ -178,6 +366,14 @@ void *FuseRemounter::MainRemountTrigger(void *data) {
     }
 
     if (retval == 0) {
+      if (check_deadline > 0) {
+        remounter->PreloadCatalogs();
+        deadline = check_deadline;
+        check_deadline = 0;
+        uint64_t now = platform_monotonic_time();
+        timeout_ms = (now > deadline) ? 0 : (deadline - now) * 1000;
+        continue;
+      }
       remounter->Check();
       timeout_ms = -1;
       continue;
@@ -190,13 +386,39 @@ void *FuseRemounter::MainRemountTrigger(void *data) {
       break;
     assert(c == 'T');
     ReadPipe(remounter->pipe_remount_trigger_[0], &timeout_ms, sizeof(int));
+    // Clients that mounted at the same time should not look for a new revision
+    // and download its catalogs all at once
+    const unsigned jitter_s = remounter->mountpoint_->remount_jitter_sec();
+    if (jitter_s > 0)
+      timeout_ms += prng.Next(jitter_s + 1) * 1000;
     deadline = platform_monotonic_time() + timeout_ms / 1000;
+    check_deadline = 0;
+    // Preload at the latest half-way through the TTL
+    const unsigned lead_s = remounter->mountpoint_->catalog_preload_lead_sec();
+    if ((lead_s > 0) && (timeout_ms >= 2000)) {
+      const unsigned half_s = timeout_ms / 2000;
+      check_deadline = deadline;
+      deadline -= (lead_s < half_s) ? lead_s : half_s;
+      uint64_t now = platform_monotonic_time();
+      timeout_ms = (now > deadline) ? 0 : (deadline - now) * 1000;
+    }
   }
   LogCvmfs(kLogCvmfs, kLogDebug, "stopping remount trigger");
   return NULL;
 }
 
 
+/**
+ * Called after every change of drainout_mode_ or maintenance_mode_.  The fuse
+ * callbacks read the modes from the runtime configuration of the mount point.
+ */
+void FuseRemounter::PublishModes() {
+  MutexLockGuard guard(&lock_publish_);
+  mountpoint_->runtime_config()->SetReloadModes(
+    atomic_read32(&drainout_mode_), atomic_read32(&maintenance_mode_) == 1);
+}
+
+
 void FuseRemounter::SetAlarm(int timeout) {
   assert(HasRemountTrigger());
   timeout *= 1000;  // timeout given in ms
@@ -231,6 +453,13 @@ void FuseRemounter::Spawn() {
  * flushed.
  */
 void FuseRemounter::TryFinish() {
+  // Common case: called from a fuse callback while there is nothing to do.
+  // The snapshot is published after the flags change, so at worst the remount
+  // is applied by one of the next calls.
+  const cvmfs::RuntimeConfig *config = mountpoint_->runtime_config()->Get();
+  if (!config->IsInDrainoutMode() || config->maintenance_mode)
+    return;
+
   FenceGuard fence_guard(&fence_maintenance_);
   if (IsInMaintenanceMode())
     return;
@@ -253,13 +482,18 @@ void FuseRemounter::TryFinish() {
   mountpoint_->inode_cache()->Pause();
   mountpoint_->path_cache()->Pause();
   mountpoint_->md5path_cache()->Pause();
+  mountpoint_->xattr_cache()->Pause();
   mountpoint_->inode_cache()->Drop();
   mountpoint_->path_cache()->Drop();
   mountpoint_->md5path_cache()->Drop();
+  mountpoint_->xattr_cache()->Drop();
 
   // Ensure that all Fuse callbacks left the catalog query code
   fence_->Drain();
   catalog::LoadError retval = mountpoint_->catalog_mgr()->Remount(false);
+  // The snapshot belongs to the previous root catalog
+  if (retval == catalog::kLoadNew)
+    mountpoint_->DropMd5PathSnapshot();
   if (mountpoint_->inode_annotation()) {
     inode_generation_info_->inode_generation =
       mountpoint_->inode_annotation()->GetGeneration();
@@ -270,8 +504,22 @@ void FuseRemounter::TryFinish() {
   mountpoint_->inode_cache()->Resume();
   mountpoint_->path_cache()->Resume();
   mountpoint_->md5path_cache()->Resume();
+  mountpoint_->xattr_cache()->Resume();
 
   atomic_xadd32(&drainout_mode_, -2);  // 2 --> 0, end of drainout mode
+  PublishModes();
+
+  // A revision newer than the diffed one got applied: the kernel caches may
+  // contain entries that changed in between
+  if (!expected_root_hash_.IsNull() && (retval == catalog::kLoadNew) &&
+      (mountpoint_->catalog_mgr()->GetRootHash() != expected_root_hash_))
+  {
+    LogCvmfs(kLogCvmfs, kLogDebug,
+             "revision changed during drainout, evicting all dentries");
+    invalidator_handle_all_.Reset();
+    invalidator_->InvalidateDentries(&invalidator_handle_all_);
+  }
+  expected_root_hash_ = shash::Any();
 
   if ((retval == catalog::kLoadFail) || (retval == catalog::kLoadNoSpace) ||
       mountpoint_->catalog_mgr()->offline_mode())
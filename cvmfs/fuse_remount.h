@@ -8,11 +8,14 @@
 #include <pthread.h>
 
 #include <ctime>
+#include <vector>
 
 #include "atomic.h"
 #include "duplex_fuse.h"
 #include "fence.h"
 #include "fuse_evict.h"
+#include "hash.h"
+#include "shortstring.h"
 #include "util/single_copy.h"
 
 namespace cvmfs {
@@ -33,6 +36,10 @@ class MountPoint;
  * flushed.  We do this through the FuseInvalidator.  Once the FuseInvalidor
  * is ready (either by waiting or by active eviction), we flush all user-level
  * caches and reload a new root catalog.
+ *
+ * With selective invalidation, the FuseInvalidator evicts only the paths that
+ * changed between the current and the new root catalog.  The remaining kernel
+ * caches stay warm across the remount.
  */
 class FuseRemounter : SingleCopy {
  public:
@@ -65,10 +72,21 @@ class FuseRemounter : SingleCopy {
   time_t catalogs_valid_until() { return catalogs_valid_until_; }
 
  private:
+  /**
+   * Beyond this number of changed paths, all the known dentries are evicted
+   * instead.
+   */
+  static const unsigned kMaxChangedPaths = 50000;
+
   static void *MainRemountTrigger(void *data);
+  void PreloadCatalogs();
+  bool GetChangedPaths(const shash::Any &new_root_hash,
+                       std::vector<PathString> *paths);
+  void InvalidateKernelCaches(const shash::Any &new_root_hash);
 
   bool HasRemountTrigger() { return pipe_remount_trigger_[0] >= 0; }
   void SetAlarm(int timeout);
+  void PublishModes();
 
   bool EnterCriticalSection() {
     return atomic_cas32(&critical_section_, 0, 1);
@@ -82,6 +100,16 @@ class FuseRemounter : SingleCopy {
    * Used to query whether the kernel cache invalidation is done.
    */
   FuseInvalidator::Handle invalidator_handle_;
+  /**
+   * Used for the full eviction if a newer revision than the one that was
+   * selectively invalidated appeared in the meantime.  Nobody waits for it.
+   */
+  FuseInvalidator::Handle invalidator_handle_all_;
+  /**
+   * With selective invalidation, the root hash the kernel caches were prepared
+   * for.  Null otherwise.
+   */
+  shash::Any expected_root_hash_;
   /**
    * Ensures that within a fuse callback all operations take place on the same
    * catalog revision.
@@ -127,6 +155,12 @@ class FuseRemounter : SingleCopy {
    * from concurrent execution.
    */
   atomic_int32 critical_section_;
+  /**
+   * Orders the publication of the drainout and maintenance mode in the runtime
+   * configuration of the mount point, so that the last published snapshot
+   * always reflects the current modes.
+   */
+  pthread_mutex_t lock_publish_;
 };  // class FuseRemounter
 
 #endif  // CVMFS_FUSE_REMOUNT_H_
@@ -27,6 +27,12 @@
  * The GarbageCollector is templated with CatalogTraversalT mainly for
  * testability and with HashFilterT as an instance of the Strategy Pattern to
  * abstract from the actual hash filtering method to be used.
+ *
+ * With a mark state directory (see GcMarkState), the 1st stage is incremental:
+ * the preserved catalogs are walked through their stored summaries and only
+ * catalogs that were published since the last run are downloaded.  Every
+ * full_gc_interval runs, a full run traverses all the preserved catalogs again
+ * and rebuilds the mark state.
  */
 
 #ifndef CVMFS_GARBAGE_COLLECTION_GARBAGE_COLLECTOR_H_
@@ -34,11 +40,15 @@
 
 #include <inttypes.h>
 
+#include <set>
+#include <string>
 #include <vector>
 
 #include "catalog_traversal.h"
+#include "garbage_collection/gc_mark_state.h"
 #include "garbage_collection/hash_filter.h"
 #include "upload_facility.h"
+#include "util/pointer.h"
 
 template<class CatalogTraversalT, class HashFilterT>
 class GarbageCollector {
@@ -56,6 +66,8 @@ class GarbageCollector {
     static const unsigned int kFullHistory;
     static const unsigned int kNoHistory;
     static const time_t       kNoTimestamp;
+    static const unsigned int kDefaultDeletionBatchSize;
+    static const unsigned int kDefaultFullGcInterval;
     static const shash::Any   kLatestHistoryDatabase;
 
     Configuration()
@@ -66,7 +78,13 @@ class GarbageCollector {
       , keep_history_timestamp(kNoTimestamp)
       , dry_run(false)
       , verbose(false)
-      , deleted_objects_logfile(NULL) {}
+      , deleted_objects_logfile(NULL)
+      , num_threads(1)
+      , hash_filter_memory(0)
+      , tmp_dir("/tmp")
+      , deletion_batch_size(kDefaultDeletionBatchSize)
+      , deletion_concurrency(1)
+      , full_gc_interval(kDefaultFullGcInterval) {}
 
     bool has_deletion_log() const { return deleted_objects_logfile != NULL; }
 
@@ -78,6 +96,28 @@ class GarbageCollector {
     bool                       dry_run;
     bool                       verbose;
     FILE                      *deleted_objects_logfile;
+    /**
+     * With more than one thread, the preserved catalogs are collected by an
+     * unordered, concurrent traversal
+     */
+    unsigned int               num_threads;
+    /**
+     * Memory limit of the preserved objects filter, 0 keeps the default
+     */
+    uint64_t                   hash_filter_memory;
+    std::string                tmp_dir;
+    /**
+     * Condemned objects are removed in batches of deletion_batch_size objects
+     * with up to deletion_concurrency removals in flight
+     */
+    unsigned int               deletion_batch_size;
+    unsigned int               deletion_concurrency;
+    /**
+     * Enables incremental runs if set.  Every full_gc_interval runs, all the
+     * preserved catalogs are read again.
+     */
+    std::string                mark_state_dir;
+    unsigned int               full_gc_interval;
   };
 
  public:
@@ -90,6 +130,13 @@ class GarbageCollector {
   unsigned int condemned_catalog_count() const { return condemned_catalogs_; }
   unsigned int condemned_objects_count() const { return condemned_objects_;  }
   uint64_t oldest_trunk_catalog() const { return oldest_trunk_catalog_; }
+  bool is_incremental() const { return incremental_; }
+  /**
+   * Preserved catalogs that were taken from the mark state
+   */
+  unsigned int summarized_catalog_count() const {
+    return summarized_catalogs_;
+  }
 
  protected:
   TraversalParameters GetTraversalParams(const Configuration &configuration);
@@ -98,18 +145,51 @@ class GarbageCollector {
   void SweepDataObjects(const TraversalCallbackDataTN &data);
 
   bool AnalyzePreservedCatalogTree();
+  bool AnalyzePreservedSummaries();
   bool CheckPreservedRevisions();
   bool SweepReflog();
 
   void CheckAndSweep(const shash::Any &hash);
   void Sweep(const shash::Any &hash);
+  void FlushSweeps();
   bool RemoveCatalogFromReflog(const shash::Any &catalog);
 
   void PrintCatalogTreeEntry(const unsigned int  tree_level,
-                             const CatalogTN    *catalog) const;
+                             const shash::Any   &catalog_hash,
+                             const std::string  &mountpoint) const;
   void LogDeletion(const shash::Any &hash) const;
 
  private:
+  /**
+   * A catalog to be marked in an incremental run
+   */
+  struct MarkJob {
+    MarkJob(const shash::Any   &hash,
+            const std::string  &path,
+            const unsigned int  tree_level,
+            const unsigned int  history_depth)
+      : hash(hash), path(path), tree_level(tree_level)
+      , history_depth(history_depth) {}
+
+    shash::Any   hash;
+    std::string  path;
+    unsigned int tree_level;
+    unsigned int history_depth;
+  };
+
+  bool MarkRevision(const shash::Any   &root_catalog_hash,
+                    const unsigned int  history_depth,
+                    const time_t        timestamp);
+  bool LoadSummary(const MarkJob &job,
+                   GcMarkState::CatalogSummary *summary,
+                   bool *exists);
+  void PreserveSummary(const MarkJob &job,
+                       const GcMarkState::CatalogSummary &summary);
+  static void MakeSummary(const CatalogTN *catalog,
+                          GcMarkState::CatalogSummary *summary);
+  uint64_t GetRootTimestamp(const shash::Any &catalog_hash,
+                            const GcMarkState::CatalogSummary &summary) const;
+
   class ReflogBasedInfoShim :
     public swissknife::CatalogTraversalInfoShim<CatalogTN>
   {
@@ -130,6 +210,10 @@ class GarbageCollector {
   ReflogBasedInfoShim  catalog_info_shim_;
   CatalogTraversalT    traversal_;
   HashFilterT          hash_filter_;
+  /**
+   * Condemned objects whose removal is pending
+   */
+  std::vector<shash::Any> sweep_batch_;
 
   bool use_reflog_timestamps_;
   /**
@@ -144,6 +228,14 @@ class GarbageCollector {
   unsigned int          condemned_catalogs_;
 
   unsigned int          condemned_objects_;
+
+  /**
+   * NULL without a mark state directory
+   */
+  UniquePtr<GcMarkState> mark_state_;
+  bool                  incremental_;
+  std::set<shash::Any>  marked_catalogs_;
+  unsigned int          summarized_catalogs_;
 };
 
 #include "garbage_collector_impl.h"
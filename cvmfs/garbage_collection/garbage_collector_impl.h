@@ -5,6 +5,8 @@
 #ifndef CVMFS_GARBAGE_COLLECTION_GARBAGE_COLLECTOR_IMPL_H_
 #define CVMFS_GARBAGE_COLLECTION_GARBAGE_COLLECTOR_IMPL_H_
 
+#include <inttypes.h>
+
 #include <algorithm>
 #include <limits>
 #include <string>
@@ -25,6 +27,14 @@ template<class CatalogTraversalT, class HashFilterT>
 const time_t GarbageCollector<CatalogTraversalT,
                               HashFilterT>::Configuration::kNoTimestamp = 0;
 
+template<class CatalogTraversalT, class HashFilterT>
+const unsigned int GarbageCollector<CatalogTraversalT,
+  HashFilterT>::Configuration::kDefaultDeletionBatchSize = 1000;
+
+template<class CatalogTraversalT, class HashFilterT>
+const unsigned int GarbageCollector<CatalogTraversalT,
+  HashFilterT>::Configuration::kDefaultFullGcInterval = 10;
+
 
 template <class CatalogTraversalT, class HashFilterT>
 GarbageCollector<CatalogTraversalT, HashFilterT>::GarbageCollector(
@@ -41,8 +51,24 @@ GarbageCollector<CatalogTraversalT, HashFilterT>::GarbageCollector(
   , preserved_catalogs_(0)
   , condemned_catalogs_(0)
   , condemned_objects_(0)
+  , incremental_(false)
+  , summarized_catalogs_(0)
 {
   assert(configuration_.uploader != NULL);
+  if (configuration_.hash_filter_memory > 0) {
+    hash_filter_.SetMemoryLimit(configuration_.hash_filter_memory,
+                                configuration_.tmp_dir);
+  }
+  if (!configuration_.mark_state_dir.empty()) {
+    mark_state_ = GcMarkState::Open(configuration_.mark_state_dir);
+    if (!mark_state_.IsValid()) {
+      LogCvmfs(kLogGc, kLogStderr, "running a full garbage collection without "
+                                   "mark state");
+    } else {
+      incremental_ =
+        mark_state_->runs_since_full() < configuration_.full_gc_interval;
+    }
+  }
 }
 
 
@@ -65,6 +91,7 @@ typename GarbageCollector<CatalogTraversalT, HashFilterT>::TraversalParameters
   params.no_repeat_history   = true;
   params.ignore_load_failure = true;
   params.quiet               = !config.verbose;
+  params.num_threads         = config.num_threads;
   return params;
 }
 
@@ -89,10 +116,17 @@ void GarbageCollector<CatalogTraversalT, HashFilterT>::PreserveDataObjects(
                StringifyTime(data.catalog->GetLastModified(), true).c_str(),
                StringifyTime(catalog_info_shim_.GetLastModified(data.catalog),
                              true).c_str());
-      PrintCatalogTreeEntry(data.tree_level, data.catalog);
+      PrintCatalogTreeEntry(data.tree_level, data.catalog->hash(),
+                            data.catalog->mountpoint().ToString());
     }
   }
 
+  if (mark_state_.IsValid()) {
+    GcMarkState::CatalogSummary summary;
+    MakeSummary(data.catalog, &summary);
+    mark_state_->Store(data.catalog->hash(), summary);
+  }
+
   // the hash of the actual catalog needs to preserved
   hash_filter_.Fill(data.catalog->hash());
 
@@ -120,7 +154,8 @@ void GarbageCollector<CatalogTraversalT, HashFilterT>::SweepDataObjects(
       LogCvmfs(kLogGc, kLogStdout, "Sweeping Revision %d (%s)",
                                    rev, StringifyTime(mtime, true).c_str());
     }
-    PrintCatalogTreeEntry(data.tree_level, data.catalog);
+    PrintCatalogTreeEntry(data.tree_level, data.catalog->hash(),
+                          data.catalog->mountpoint().ToString());
   }
 
   // all the objects referenced from this catalog need to be checked against the
@@ -134,6 +169,11 @@ void GarbageCollector<CatalogTraversalT, HashFilterT>::SweepDataObjects(
 
   // the catalog itself is also condemned and needs to be removed
   CheckAndSweep(data.catalog->hash());
+  if (mark_state_.IsValid() && !configuration_.dry_run &&
+      !hash_filter_.Contains(data.catalog->hash()))
+  {
+    mark_state_->Remove(data.catalog->hash());
+  }
 }
 
 
@@ -156,7 +196,19 @@ void GarbageCollector<CatalogTraversalT, HashFilterT>::Sweep(
     return;
   }
 
-  configuration_.uploader->Remove(hash);
+  sweep_batch_.push_back(hash);
+  if (sweep_batch_.size() >= configuration_.deletion_batch_size)
+    FlushSweeps();
+}
+
+
+template <class CatalogTraversalT, class HashFilterT>
+void GarbageCollector<CatalogTraversalT, HashFilterT>::FlushSweeps() {
+  if (sweep_batch_.empty())
+    return;
+  configuration_.uploader->RemoveBatch(sweep_batch_,
+                                       configuration_.deletion_concurrency);
+  sweep_batch_.clear();
 }
 
 
@@ -173,9 +225,23 @@ bool GarbageCollector<CatalogTraversalT, HashFilterT>::
 
 template <class CatalogTraversalT, class HashFilterT>
 bool GarbageCollector<CatalogTraversalT, HashFilterT>::Collect() {
-  return AnalyzePreservedCatalogTree() &&
-         CheckPreservedRevisions()     &&
-         SweepReflog();
+  // A full run rebuilds the mark state from scratch
+  if (mark_state_.IsValid() && !incremental_ && !configuration_.dry_run &&
+      !mark_state_->Reset())
+  {
+    LogCvmfs(kLogGc, kLogStderr, "failed to reset gc mark state in %s",
+             mark_state_->directory().c_str());
+    return false;
+  }
+
+  const bool preserved = incremental_ ? AnalyzePreservedSummaries()
+                                      : AnalyzePreservedCatalogTree();
+  const bool success = preserved                 &&
+                       CheckPreservedRevisions() &&
+                       SweepReflog();
+  if (success && mark_state_.IsValid() && !configuration_.dry_run)
+    return mark_state_->CommitRun(incremental_);
+  return success;
 }
 
 
@@ -191,15 +257,235 @@ bool GarbageCollector<CatalogTraversalT, HashFilterT>::
        &GarbageCollector<CatalogTraversalT, HashFilterT>::PreserveDataObjects,
         this);
 
-  bool success = traversal_.Traverse();
+  // The preserved hashes and the oldest trunk catalog do not depend on the
+  // order in which catalogs are handed out
+  const typename CatalogTraversalT::TraversalType traversal_type =
+    (configuration_.num_threads > 1)
+      ? CatalogTraversalT::kUnorderedTraversal
+      : CatalogTraversalT::kBreadthFirstTraversal;
+  bool success = traversal_.Traverse(traversal_type);
   oldest_trunk_catalog_found_ = true;
-  success = success && traversal_.TraverseNamedSnapshots();
+  success = success && traversal_.TraverseNamedSnapshots(traversal_type);
   traversal_.UnregisterListener(callback);
+  hash_filter_.Freeze();
 
   return success;
 }
 
 
+/**
+ * Same result as AnalyzePreservedCatalogTree() but the catalog graph is walked
+ * through the summaries of the mark state.  Catalogs without summary are
+ * downloaded and summarized.  The marked catalogs are skipped when the
+ * condemned revisions are traversed later on.
+ */
+template <class CatalogTraversalT, class HashFilterT>
+bool GarbageCollector<CatalogTraversalT, HashFilterT>::
+  AnalyzePreservedSummaries()
+{
+  if (configuration_.verbose) {
+    LogCvmfs(kLogGc, kLogStdout, "Preserving data objects in latest revision "
+                                 "(incremental)");
+  }
+
+  UniquePtr<manifest::Manifest> manifest;
+  typename ObjectFetcherTN::Failures retval =
+    configuration_.object_fetcher->FetchManifest(&manifest);
+  if (retval != ObjectFetcherTN::kFailOk) {
+    LogCvmfs(kLogGc, kLogStderr, "failed to load manifest (%d - %s)",
+             retval, Code2Ascii(retval));
+    return false;
+  }
+
+  bool success = MarkRevision(manifest->catalog_hash(),
+                              configuration_.keep_history_depth,
+                              configuration_.keep_history_timestamp);
+  oldest_trunk_catalog_found_ = true;
+
+  UniquePtr<HistoryTN> tag_db;
+  retval = configuration_.object_fetcher->FetchHistory(&tag_db);
+  if (success && (retval == ObjectFetcherTN::kFailOk)) {
+    HashVector root_hashes;
+    success = tag_db->GetHashes(&root_hashes);
+    typename HashVector::const_reverse_iterator i    = root_hashes.rbegin();
+    const typename HashVector::const_reverse_iterator iend =
+      root_hashes.rend();
+    for (; success && (i != iend); ++i) {
+      success = MarkRevision(*i, Configuration::kNoHistory,
+                             Configuration::kNoTimestamp);
+    }
+  } else if (success && (retval != ObjectFetcherTN::kFailNotFound)) {
+    LogCvmfs(kLogGc, kLogStderr, "failed to download history database "
+                                 "(%d - %s)", retval, Code2Ascii(retval));
+    success = false;
+  }
+  hash_filter_.Freeze();
+
+  return success;
+}
+
+
+/**
+ * Marks a root catalog, its nested catalogs, and its predecessor revisions up
+ * to the history depth and timestamp thresholds.  Follows the breadth first
+ * catalog traversal with no_repeat_history and ignore_load_failure.
+ */
+template <class CatalogTraversalT, class HashFilterT>
+bool GarbageCollector<CatalogTraversalT, HashFilterT>::MarkRevision(
+  const shash::Any   &root_catalog_hash,
+  const unsigned int  history_depth,
+  const time_t        timestamp)
+{
+  std::vector<MarkJob> stack;
+  stack.push_back(MarkJob(root_catalog_hash, "", 0, 0));
+  while (!stack.empty()) {
+    const MarkJob job = stack.back();
+    stack.pop_back();
+    if (marked_catalogs_.count(job.hash) > 0)
+      continue;
+
+    GcMarkState::CatalogSummary summary;
+    bool exists;
+    if (!LoadSummary(job, &summary, &exists))
+      return false;
+    if (!exists)
+      continue;
+    marked_catalogs_.insert(job.hash);
+    traversal_.AddVisitedCatalog(job.hash);
+    PreserveSummary(job, summary);
+
+    if (summary.is_root && !summary.previous_revision.IsNull()) {
+      const bool below_history = job.history_depth >= history_depth;
+      const bool below_timestamp = GetRootTimestamp(job.hash, summary) <
+                                   static_cast<uint64_t>(timestamp);
+      if (!below_history && !below_timestamp) {
+        stack.push_back(MarkJob(summary.previous_revision, "", 0,
+                                job.history_depth + 1));
+      }
+    }
+    for (unsigned i = 0; i < summary.nested_catalogs.size(); ++i) {
+      stack.push_back(MarkJob(summary.nested_catalogs[i].first,
+                              summary.nested_catalogs[i].second,
+                              job.tree_level + 1,
+                              job.history_depth));
+    }
+  }
+  return true;
+}
+
+
+/**
+ * Takes the summary from the mark state or downloads the catalog.  Catalogs
+ * that are not found were swept before (exists = false).
+ */
+template <class CatalogTraversalT, class HashFilterT>
+bool GarbageCollector<CatalogTraversalT, HashFilterT>::LoadSummary(
+  const MarkJob &job,
+  GcMarkState::CatalogSummary *summary,
+  bool *exists)
+{
+  *exists = true;
+  if (mark_state_->Lookup(job.hash, summary)) {
+    ++summarized_catalogs_;
+    return true;
+  }
+
+  UniquePtr<CatalogTN> catalog;
+  const typename ObjectFetcherTN::Failures retval =
+    configuration_.object_fetcher->FetchCatalog(job.hash, job.path, &catalog,
+                                                job.tree_level > 0);
+  switch (retval) {
+    case ObjectFetcherTN::kFailOk:
+      break;
+    case ObjectFetcherTN::kFailNotFound:
+      LogCvmfs(kLogGc, kLogDebug, "ignoring missing catalog %s "
+                                  "(swept before?)",
+               job.hash.ToString().c_str());
+      *exists = false;
+      return true;
+    default:
+      LogCvmfs(kLogGc, kLogStderr, "failed to load catalog %s (%d - %s)",
+               job.hash.ToStringWithSuffix().c_str(),
+               retval, Code2Ascii(retval));
+      return false;
+  }
+
+  MakeSummary(catalog.weak_ref(), summary);
+  // A failure costs a download in the next run
+  mark_state_->Store(job.hash, *summary);
+  return true;
+}
+
+
+template <class CatalogTraversalT, class HashFilterT>
+void GarbageCollector<CatalogTraversalT, HashFilterT>::PreserveSummary(
+  const MarkJob &job,
+  const GcMarkState::CatalogSummary &summary)
+{
+  ++preserved_catalogs_;
+
+  if (summary.is_root) {
+    const uint64_t mtime = GetRootTimestamp(job.hash, summary);
+    if (!oldest_trunk_catalog_found_)
+      oldest_trunk_catalog_ = std::min(oldest_trunk_catalog_, mtime);
+    if (configuration_.verbose) {
+      LogCvmfs(kLogGc, kLogStdout, "Preserving Revision %" PRIu64
+               " (%s / added @ %s)",
+               summary.revision,
+               StringifyTime(summary.last_modified, true).c_str(),
+               StringifyTime(mtime, true).c_str());
+      PrintCatalogTreeEntry(job.tree_level, job.hash, job.path);
+    }
+  }
+
+  hash_filter_.Fill(job.hash);
+  for (unsigned i = 0; i < summary.referenced_objects.size(); ++i)
+    hash_filter_.Fill(summary.referenced_objects[i]);
+}
+
+
+template <class CatalogTraversalT, class HashFilterT>
+void GarbageCollector<CatalogTraversalT, HashFilterT>::MakeSummary(
+  const CatalogTN *catalog,
+  GcMarkState::CatalogSummary *summary)
+{
+  typedef typename CatalogTN::NestedCatalogList NestedCatalogList;
+
+  summary->is_root = catalog->IsRoot();
+  summary->revision = catalog->revision();
+  summary->last_modified = catalog->GetLastModified();
+  if (summary->is_root)
+    summary->previous_revision = catalog->GetPreviousRevision();
+  const NestedCatalogList nested = catalog->ListOwnNestedCatalogs();
+  for (typename NestedCatalogList::const_iterator i = nested.begin(),
+       iEnd = nested.end(); i != iEnd; ++i)
+  {
+    summary->nested_catalogs.push_back(
+      GcMarkState::CatalogSummary::NestedCatalog(i->hash,
+                                                 i->mountpoint.ToString()));
+  }
+  summary->referenced_objects = catalog->GetReferencedObjects();
+}
+
+
+/**
+ * Like ReflogBasedInfoShim::GetLastModified() for catalogs that are not loaded
+ */
+template <class CatalogTraversalT, class HashFilterT>
+uint64_t GarbageCollector<CatalogTraversalT, HashFilterT>::GetRootTimestamp(
+  const shash::Any &catalog_hash,
+  const GcMarkState::CatalogSummary &summary) const
+{
+  uint64_t timestamp;
+  if (use_reflog_timestamps_ &&
+      configuration_.reflog->GetCatalogTimestamp(catalog_hash, &timestamp))
+  {
+    return timestamp;
+  }
+  return summary.last_modified;
+}
+
+
 template <class CatalogTraversalT, class HashFilterT>
 bool GarbageCollector<CatalogTraversalT, HashFilterT>::CheckPreservedRevisions()
 {
@@ -237,10 +523,11 @@ bool GarbageCollector<CatalogTraversalT, HashFilterT>::SweepReflog() {
   const std::vector<shash::Any>::const_iterator iend = catalogs.end();
   for (; i != iend && success; ++i) {
     if (!hash_filter_.Contains(*i)) {
-      success =
-        success                                         &&
-        traversal_.TraverseRevision(*i, traversal_type) &&
-        RemoveCatalogFromReflog(*i);
+      success = traversal_.TraverseRevision(*i, traversal_type);
+      // The objects have to be gone before the catalog leaves the reflog,
+      // otherwise they would be lost for later garbage collection runs
+      FlushSweeps();
+      success = success && RemoveCatalogFromReflog(*i);
     }
   }
 
@@ -252,8 +539,9 @@ bool GarbageCollector<CatalogTraversalT, HashFilterT>::SweepReflog() {
 
 template <class CatalogTraversalT, class HashFilterT>
 void GarbageCollector<CatalogTraversalT, HashFilterT>::PrintCatalogTreeEntry(
-                                              const unsigned int  tree_level,
-                                              const CatalogTN    *catalog) const
+                                          const unsigned int  tree_level,
+                                          const shash::Any   &catalog_hash,
+                                          const std::string  &mountpoint) const
 {
   std::string tree_indent;
   for (unsigned int i = 0; i < tree_level; ++i) {
@@ -261,9 +549,8 @@ void GarbageCollector<CatalogTraversalT, HashFilterT>::PrintCatalogTreeEntry(
   }
   tree_indent += "\u251C\u2500 ";
 
-  const std::string hash_string = catalog->hash().ToString();
-  const std::string path =
-    (catalog->mountpoint().IsEmpty()) ? "/" : catalog->mountpoint().ToString();
+  const std::string hash_string = catalog_hash.ToString();
+  const std::string path = mountpoint.empty() ? "/" : mountpoint;
 
   LogCvmfs(kLogGc, kLogStdout, "%s%s %s",
     tree_indent.c_str(),
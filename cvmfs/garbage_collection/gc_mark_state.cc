@@ -0,0 +1,207 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "garbage_collection/gc_mark_state.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdio>
+#include <limits>
+
+#include "logging.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+const unsigned GcMarkState::kNoFullRun = numeric_limits<unsigned>::max();
+
+namespace {
+
+string HashToString(const shash::Any &hash) {
+  return hash.IsNull() ? string("-") : hash.ToStringWithSuffix();
+}
+
+/**
+ * Null hashes are written as "-"
+ */
+bool StringToHash(const string &str, shash::Any *hash) {
+  if (str == "-") {
+    *hash = shash::Any();
+    return true;
+  }
+  *hash = shash::MkFromSuffixedHexPtr(shash::HexPtr(str));
+  // Parse errors leave the algorithm unset
+  return hash->algorithm != shash::kAny;
+}
+
+/**
+ * Atomically replaces path by content
+ */
+bool WriteFileAtomically(const string &path, const string &content) {
+  string path_tmp;
+  FILE *f = CreateTempFile(path + ".tmp", 0644, "w", &path_tmp);
+  if (f == NULL)
+    return false;
+  bool retval = fwrite(content.data(), 1, content.length(), f) ==
+                content.length();
+  retval = (fclose(f) == 0) && retval;
+  if (retval)
+    retval = rename(path_tmp.c_str(), path.c_str()) == 0;
+  if (!retval)
+    unlink(path_tmp.c_str());
+  return retval;
+}
+
+}  // anonymous namespace
+
+
+GcMarkState::GcMarkState(const string &directory)
+  : directory_(directory)
+  , runs_since_full_(kNoFullRun)
+{ }
+
+
+/**
+ * Creates the directory if necessary.  Returns NULL if the directory is not
+ * usable.
+ */
+GcMarkState *GcMarkState::Open(const string &directory) {
+  if (!MkdirDeep(directory + "/catalogs", 0755)) {
+    LogCvmfs(kLogGc, kLogStderr, "failed to create gc mark state in %s (%d)",
+             directory.c_str(), errno);
+    return NULL;
+  }
+  GcMarkState *state = new GcMarkState(directory);
+
+  FILE *f = fopen((directory + "/runs").c_str(), "r");
+  if (f != NULL) {
+    string line;
+    uint64_t runs;
+    if (GetLineFile(f, &line) && String2Uint64Parse(line, &runs) &&
+        (runs < kNoFullRun))
+    {
+      state->runs_since_full_ = runs;
+    }
+    fclose(f);
+  }
+  return state;
+}
+
+
+string GcMarkState::GetSummaryPath(const shash::Any &catalog_hash) const {
+  return directory_ + "/catalogs/" + catalog_hash.MakePath();
+}
+
+
+/**
+ * A summary file starts with a line
+ *   S <revision> <last modified> <is root> <previous revision or ->
+ * followed by a "C <hash> <mountpoint>" line per nested catalog and an
+ * "O <hash>" line per referenced object.
+ */
+bool GcMarkState::Lookup(
+  const shash::Any &catalog_hash,
+  CatalogSummary *summary) const
+{
+  const string path = GetSummaryPath(catalog_hash);
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL)
+    return false;
+
+  *summary = CatalogSummary();
+  string line;
+  bool retval = GetLineFile(f, &line);
+  if (retval) {
+    vector<string> tokens = SplitString(line, ' ');
+    retval = (tokens.size() == 5) && (tokens[0] == "S") &&
+             String2Uint64Parse(tokens[1], &summary->revision) &&
+             String2Uint64Parse(tokens[2], &summary->last_modified) &&
+             StringToHash(tokens[4], &summary->previous_revision);
+    summary->is_root = retval && (tokens[3] == "1");
+  }
+  shash::Any hash;
+  while (retval && GetLineFile(f, &line)) {
+    if (HasPrefix(line, "O ", false)) {
+      retval = StringToHash(line.substr(2), &hash);
+      summary->referenced_objects.push_back(hash);
+    } else if (HasPrefix(line, "C ", false)) {
+      // Mountpoints can contain blanks
+      const size_t pos_path = line.find(' ', 2);
+      retval = (pos_path != string::npos) &&
+               StringToHash(line.substr(2, pos_path - 2), &hash);
+      summary->nested_catalogs.push_back(
+        CatalogSummary::NestedCatalog(hash, line.substr(pos_path + 1)));
+    } else {
+      retval = false;
+    }
+  }
+  fclose(f);
+
+  if (!retval) {
+    LogCvmfs(kLogGc, kLogDebug, "ignoring corrupted gc summary %s",
+             path.c_str());
+    unlink(path.c_str());
+  }
+  return retval;
+}
+
+
+bool GcMarkState::Store(
+  const shash::Any &catalog_hash,
+  const CatalogSummary &summary)
+{
+  string content = "S " + StringifyInt(summary.revision) + " " +
+    StringifyInt(summary.last_modified) + " " +
+    (summary.is_root ? "1 " : "0 ") +
+    HashToString(summary.previous_revision) + "\n";
+  for (unsigned i = 0; i < summary.nested_catalogs.size(); ++i) {
+    content += "C " + HashToString(summary.nested_catalogs[i].first) + " " +
+               summary.nested_catalogs[i].second + "\n";
+  }
+  for (unsigned i = 0; i < summary.referenced_objects.size(); ++i)
+    content += "O " + HashToString(summary.referenced_objects[i]) + "\n";
+
+  const string path = GetSummaryPath(catalog_hash);
+  if (!MkdirDeep(GetParentPath(path), 0755) ||
+      !WriteFileAtomically(path, content))
+  {
+    LogCvmfs(kLogGc, kLogStderr, "failed to store gc summary %s (%d)",
+             path.c_str(), errno);
+    return false;
+  }
+  return true;
+}
+
+
+void GcMarkState::Remove(const shash::Any &catalog_hash) {
+  unlink(GetSummaryPath(catalog_hash).c_str());
+}
+
+
+bool GcMarkState::Reset() {
+  runs_since_full_ = kNoFullRun;
+  const string runs_path = directory_ + "/runs";
+  if ((unlink(runs_path.c_str()) != 0) && (errno != ENOENT))
+    return false;
+  return RemoveTree(directory_ + "/catalogs") &&
+         MkdirDeep(directory_ + "/catalogs", 0755);
+}
+
+
+bool GcMarkState::CommitRun(const bool incremental) {
+  if (incremental)
+    assert(runs_since_full_ != kNoFullRun);
+  const unsigned runs = incremental ? runs_since_full_ + 1 : 0;
+  if (!WriteFileAtomically(directory_ + "/runs", StringifyInt(runs) + "\n")) {
+    LogCvmfs(kLogGc, kLogStderr, "failed to update gc mark state in %s",
+             directory_.c_str());
+    return false;
+  }
+  runs_since_full_ = runs;
+  return true;
+}
@@ -0,0 +1,83 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * The mark state lets the garbage collector skip the download of catalogs that
+ * it has seen in a previous run.  Catalogs are content-addressed and never
+ * change, so the outcome of reading a catalog, i.e. the objects it references,
+ * its nested catalogs, and its predecessor revision, can be stored once and
+ * reused by all later garbage collection runs.  With the summaries of all the
+ * preserved catalogs at hand, only newly published catalogs and the condemned
+ * catalogs need to be fetched.
+ */
+
+#ifndef CVMFS_GARBAGE_COLLECTION_GC_MARK_STATE_H_
+#define CVMFS_GARBAGE_COLLECTION_GC_MARK_STATE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hash.h"
+#include "util/single_copy.h"
+
+/**
+ * A directory with one summary file per catalog and a small state file that
+ * counts the incremental runs since the last full garbage collection.  The
+ * summaries are written to a temporary file first and renamed, so a summary is
+ * either complete or missing.  Missing summaries only cost a catalog download,
+ * therefore summaries can be removed at any time.
+ */
+class GcMarkState : SingleCopy {
+ public:
+  /**
+   * Returned by runs_since_full() if no full run has been recorded
+   */
+  static const unsigned kNoFullRun;
+
+  struct CatalogSummary {
+    typedef std::pair<shash::Any, std::string> NestedCatalog;
+
+    CatalogSummary() : is_root(false), revision(0), last_modified(0) { }
+
+    bool is_root;
+    uint64_t revision;
+    uint64_t last_modified;
+    /**
+     * Only set for root catalogs
+     */
+    shash::Any previous_revision;
+    /**
+     * Hashes and mountpoints of the direct nested catalogs
+     */
+    std::vector<NestedCatalog> nested_catalogs;
+    std::vector<shash::Any> referenced_objects;
+  };
+
+  static GcMarkState *Open(const std::string &directory);
+
+  bool Lookup(const shash::Any &catalog_hash, CatalogSummary *summary) const;
+  bool Store(const shash::Any &catalog_hash, const CatalogSummary &summary);
+  void Remove(const shash::Any &catalog_hash);
+  /**
+   * Drops all the summaries, used before a full run rebuilds the state
+   */
+  bool Reset();
+  /**
+   * Records a successful run
+   */
+  bool CommitRun(const bool incremental);
+
+  unsigned runs_since_full() const { return runs_since_full_; }
+  std::string directory() const { return directory_; }
+
+ private:
+  explicit GcMarkState(const std::string &directory);
+  std::string GetSummaryPath(const shash::Any &catalog_hash) const;
+
+  std::string directory_;
+  unsigned runs_since_full_;
+};
+
+#endif  // CVMFS_GARBAGE_COLLECTION_GC_MARK_STATE_H_
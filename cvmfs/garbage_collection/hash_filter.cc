@@ -0,0 +1,287 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "garbage_collection/hash_filter.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <utility>
+
+#include "logging.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+const uint64_t CompactHashFilter::kDefaultMemoryLimit;
+const unsigned CompactHashFilter::kKeysPerBlock;
+
+
+CompactHashFilter::CompactHashFilter()
+  : memory_limit_(kDefaultMemoryLimit)
+  , tmp_dir_("/tmp")
+  , frozen_(false)
+  , num_compacted_(0)
+  , num_spilled_(0)
+  , num_keys_(0)
+  , bloom_filter_(NULL)
+  , fd_(-1)
+{ }
+
+
+CompactHashFilter::~CompactHashFilter() {
+  delete bloom_filter_;
+  if (fd_ >= 0) {
+    close(fd_);
+    unlink(path_.c_str());
+  }
+  for (unsigned i = 0; i < runs_.size(); ++i)
+    unlink(runs_[i].c_str());
+}
+
+
+void CompactHashFilter::SetMemoryLimit(
+  const uint64_t bytes,
+  const string &tmp_dir)
+{
+  assert(buffer_.empty() && runs_.empty());
+  memory_limit_ = bytes;
+  tmp_dir_ = tmp_dir;
+}
+
+
+CompactHashFilter::Key CompactHashFilter::MkKey(const shash::Any &hash) {
+  Key key;
+  // Digests shorter than kMaxDigestSize leave undefined trailing bytes
+  memset(key.digest, 0, sizeof(key.digest));
+  memcpy(key.digest, hash.digest, hash.GetDigestSize());
+  key.algorithm = hash.algorithm;
+  return key;
+}
+
+
+/**
+ * The digests are uniformly distributed, so their first 16 bytes serve as the
+ * bloom filter probes.  Same digests of different algorithms are told apart by
+ * the algorithm.
+ */
+void CompactHashFilter::GetIntPair(
+  const Key &key,
+  uint64_t *h1,
+  uint64_t *h2)
+{
+  memcpy(h1, key.digest, sizeof(*h1));
+  memcpy(h2, key.digest + sizeof(*h1), sizeof(*h2));
+  *h1 += key.algorithm;
+}
+
+
+/**
+ * Sorts the buffer and removes duplicates, unless nothing was added since the
+ * last call.
+ */
+void CompactHashFilter::Compact() const {
+  if (num_compacted_ == buffer_.size())
+    return;
+  sort(buffer_.begin(), buffer_.end());
+  buffer_.erase(unique(buffer_.begin(), buffer_.end()), buffer_.end());
+  num_compacted_ = buffer_.size();
+}
+
+
+void CompactHashFilter::Fill(const shash::Any &hash) {
+  assert(!frozen_);
+  const size_t capacity =
+    max(static_cast<uint64_t>(kKeysPerBlock), memory_limit_ / sizeof(Key));
+  if (buffer_.size() == buffer_.capacity())
+    buffer_.reserve(min(capacity, max(buffer_.size() * 2, size_t(1024))));
+
+  buffer_.push_back(MkKey(hash));
+  if (buffer_.size() < capacity)
+    return;
+
+  // Duplicates are common; spill only if they do not make enough room
+  Compact();
+  if (buffer_.size() > capacity / 2)
+    Spill();
+}
+
+
+size_t CompactHashFilter::Count() const {
+  if (frozen_)
+    return num_keys_;
+  Compact();
+  return num_spilled_ + buffer_.size();
+}
+
+
+/**
+ * Writes the sorted buffer as a new run into the temporary directory
+ */
+void CompactHashFilter::Spill() {
+  Compact();
+  string path;
+  FILE *f = CreateTempFile(tmp_dir_ + "/hashfilter", 0600, "w", &path);
+  if (f == NULL) {
+    LogCvmfs(kLogGc, kLogStderr, "failed to create hash filter run in %s "
+             "(errno: %d)", tmp_dir_.c_str(), errno);
+    abort();
+  }
+  runs_.push_back(path);
+  if ((fwrite(&buffer_[0], sizeof(Key), buffer_.size(), f) != buffer_.size())
+      || (fclose(f) != 0))
+  {
+    LogCvmfs(kLogGc, kLogStderr, "failed to write hash filter run %s "
+             "(errno: %d)", path.c_str(), errno);
+    abort();
+  }
+  num_spilled_ += buffer_.size();
+  buffer_.clear();
+  num_compacted_ = 0;
+}
+
+
+void CompactHashFilter::AddToIndex(const Key &key) {
+  if ((num_keys_ % kKeysPerBlock) == 0)
+    fences_.push_back(key);
+  uint64_t h1, h2;
+  GetIntPair(key, &h1, &h2);
+  bloom_filter_->Add(h1, h2);
+  num_keys_++;
+}
+
+
+/**
+ * K-way merge of the sorted runs into the hash file.  Duplicates across runs
+ * are dropped.
+ */
+void CompactHashFilter::Merge() {
+  FILE *f = CreateTempFile(tmp_dir_ + "/hashfilter", 0600, "w", &path_);
+  if (f == NULL) {
+    LogCvmfs(kLogGc, kLogStderr, "failed to create hash file in %s "
+             "(errno: %d)", tmp_dir_.c_str(), errno);
+    abort();
+  }
+
+  vector<FILE *> inputs;
+  typedef pair<Key, unsigned> Head;
+  priority_queue<Head, vector<Head>, greater<Head> > heads;
+  for (unsigned i = 0; i < runs_.size(); ++i) {
+    FILE *input = fopen(runs_[i].c_str(), "r");
+    if (input == NULL) {
+      LogCvmfs(kLogGc, kLogStderr, "failed to open hash filter run %s "
+               "(errno: %d)", runs_[i].c_str(), errno);
+      abort();
+    }
+    // Runs do not need to persist beyond the merge
+    unlink(runs_[i].c_str());
+    inputs.push_back(input);
+    Key key;
+    if (fread(&key, sizeof(key), 1, input) == 1)
+      heads.push(Head(key, i));
+  }
+  runs_.clear();
+
+  Key last = Key();
+  while (!heads.empty()) {
+    const Head head = heads.top();
+    heads.pop();
+    if ((num_keys_ == 0) || !(head.first == last)) {
+      if (fwrite(&head.first, sizeof(Key), 1, f) != 1) {
+        LogCvmfs(kLogGc, kLogStderr, "failed to write hash file %s "
+                 "(errno: %d)", path_.c_str(), errno);
+        abort();
+      }
+      AddToIndex(head.first);
+      last = head.first;
+    }
+    Key key;
+    if (fread(&key, sizeof(key), 1, inputs[head.second]) == 1)
+      heads.push(Head(key, head.second));
+  }
+
+  for (unsigned i = 0; i < inputs.size(); ++i)
+    fclose(inputs[i]);
+  if (fclose(f) != 0) {
+    LogCvmfs(kLogGc, kLogStderr, "failed to write hash file %s (errno: %d)",
+             path_.c_str(), errno);
+    abort();
+  }
+  fd_ = open(path_.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    LogCvmfs(kLogGc, kLogStderr, "failed to open hash file %s (errno: %d)",
+             path_.c_str(), errno);
+    abort();
+  }
+}
+
+
+void CompactHashFilter::Freeze() {
+  if (frozen_)
+    return;
+  frozen_ = true;
+  Compact();
+
+  // The bloom filter gets at most three quarters of the memory budget.  On a
+  // smaller budget, it has fewer bits per key and more false positives.
+  const uint64_t max_bloom_keys =
+    (memory_limit_ / 4 * 3 * 8) / BloomFilter::kBitsPerKey;
+
+  if (runs_.empty()) {
+    // All the hashes fit into memory, the sorted buffer is the hash file
+    bloom_filter_ = new BloomFilter(min(static_cast<uint64_t>(buffer_.size()),
+                                        max_bloom_keys));
+    vector<Key>(buffer_).swap(buffer_);
+    for (unsigned i = 0; i < buffer_.size(); ++i) {
+      uint64_t h1, h2;
+      GetIntPair(buffer_[i], &h1, &h2);
+      bloom_filter_->Add(h1, h2);
+    }
+    num_keys_ = buffer_.size();
+    return;
+  }
+
+  if (!buffer_.empty())
+    Spill();
+  vector<Key>().swap(buffer_);
+  bloom_filter_ = new BloomFilter(min(static_cast<uint64_t>(num_spilled_),
+                                      max_bloom_keys));
+  Merge();
+}
+
+
+bool CompactHashFilter::Contains(const shash::Any &hash) const {
+  assert(frozen_);
+  const Key key = MkKey(hash);
+  uint64_t h1, h2;
+  GetIntPair(key, &h1, &h2);
+  if (!bloom_filter_->MayContain(h1, h2))
+    return false;
+
+  if (fd_ < 0)
+    return binary_search(buffer_.begin(), buffer_.end(), key);
+
+  vector<Key>::const_iterator fence =
+    upper_bound(fences_.begin(), fences_.end(), key);
+  if (fence == fences_.begin())
+    return false;
+  const uint64_t block = (fence - fences_.begin()) - 1;
+  Key keys[kKeysPerBlock];
+  const ssize_t nbytes = pread(fd_, keys, sizeof(keys),
+                               block * kKeysPerBlock * sizeof(Key));
+  if ((nbytes < 0) || (static_cast<size_t>(nbytes) % sizeof(Key) != 0)) {
+    LogCvmfs(kLogGc, kLogStderr, "failed to read hash file %s (errno: %d)",
+             path_.c_str(), errno);
+    abort();
+  }
+  return binary_search(keys, keys + nbytes / sizeof(Key), key);
+}
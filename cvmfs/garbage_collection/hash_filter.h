@@ -9,10 +9,17 @@
 #ifndef CVMFS_GARBAGE_COLLECTION_HASH_FILTER_H_
 #define CVMFS_GARBAGE_COLLECTION_HASH_FILTER_H_
 
+#include <stdint.h>
+
+#include <cstring>
 #include <set>
+#include <string>
+#include <vector>
 
+#include "bloom_filter.h"
 #include "hash.h"
 #include "smallhash.h"
+#include "util/single_copy.h"
 
 /**
  * Abstract base class of a HashFilter to define the common interface.
@@ -48,6 +55,16 @@ class AbstractHashFilter {
    */
   virtual void Freeze() {}
 
+  /**
+   * Bounds the memory used by the filter.  Implementations that keep all the
+   * hashes in memory ignore the limit.  Must be called before the first Fill().
+   *
+   * @param bytes    the memory budget of the filter
+   * @param tmp_dir  directory for hashes that do not fit into memory
+   */
+  virtual void SetMemoryLimit(const uint64_t bytes,
+                              const std::string &tmp_dir) {}
+
   /**
    * Returns the number of objects already inserted into the filter.
    * @return number of objects in the filter
@@ -124,4 +141,81 @@ class SmallhashFilter : public AbstractHashFilter {
   bool                                frozen_;
 };
 
+
+
+//------------------------------------------------------------------------------
+
+
+/**
+ * A memory bounded implementation of AbstractHashFilter for the preserved
+ * objects of large repositories.  Hashes are stored in a compact, fixed size
+ * encoding.  Once the memory limit is reached, the buffered hashes are sorted
+ * and spilled as a run into the temporary directory.  Freeze() merges the runs
+ * into a single sorted hash file that is split into blocks of kKeysPerBlock
+ * hashes.  Only the first hash of every block and a bloom filter stay in
+ * memory.  Most absent hashes are rejected by the bloom filter; the others
+ * cost one block read.  If all hashes fit into memory, nothing is written.
+ *
+ * Contains() requires a frozen filter.  Before Freeze(), Count() includes
+ * hashes that were spilled more than once.
+ */
+class CompactHashFilter : public AbstractHashFilter, SingleCopy {
+ public:
+  static const uint64_t kDefaultMemoryLimit = 256 * 1024 * 1024;
+  static const unsigned kKeysPerBlock = 192;
+
+  CompactHashFilter();
+  ~CompactHashFilter();
+
+  void Fill(const shash::Any &hash);
+  bool Contains(const shash::Any &hash) const;
+  void Freeze();
+  size_t Count() const;
+  void SetMemoryLimit(const uint64_t bytes, const std::string &tmp_dir);
+
+  unsigned num_runs() const { return runs_.size(); }
+
+ private:
+  /**
+   * The digest and the algorithm, but not the suffix
+   */
+  struct Key {
+    bool operator <(const Key &other) const {
+      return memcmp(this, &other, sizeof(Key)) < 0;
+    }
+    bool operator ==(const Key &other) const {
+      return memcmp(this, &other, sizeof(Key)) == 0;
+    }
+    unsigned char digest[shash::kMaxDigestSize];
+    unsigned char algorithm;
+  };
+
+  static Key MkKey(const shash::Any &hash);
+  static void GetIntPair(const Key &key, uint64_t *h1, uint64_t *h2);
+  void Compact() const;
+  void Spill();
+  void Merge();
+  void AddToIndex(const Key &key);
+
+  uint64_t memory_limit_;
+  std::string tmp_dir_;
+  bool frozen_;
+  /**
+   * Mutable so that Count() can remove duplicates
+   */
+  mutable std::vector<Key> buffer_;
+  mutable size_t num_compacted_;
+  std::vector<std::string> runs_;
+  size_t num_spilled_;
+
+  size_t num_keys_;
+  BloomFilter *bloom_filter_;
+  /**
+   * First key of every block of the hash file
+   */
+  std::vector<Key> fences_;
+  std::string path_;
+  int fd_;
+};
+
 #endif  // CVMFS_GARBAGE_COLLECTION_HASH_FILTER_H_
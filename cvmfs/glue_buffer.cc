@@ -11,17 +11,25 @@
 #include <cstdlib>
 #include <cstring>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
 #include "logging.h"
+#include "murmur.h"
 #include "platform.h"
 #include "smalloc.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
 namespace glue {
 
+const double PathStore::kCompactThreshold = 0.75;
+const double PathStore::kCompactThresholdErase = 0.5;
+const uint64_t InodeTracker::kStableInodeBase;
+
+
 PathStore &PathStore::operator= (const PathStore &other) {
   if (&other == this)
     return *this;
@@ -66,9 +74,8 @@ void InodeTracker::InitLock() {
 void InodeTracker::CopyFrom(const InodeTracker &other) {
   assert(other.version_ == kVersion);
   version_ = kVersion;
-  path_map_ = other.path_map_;
+  path_store_ = other.path_store_;
   inode_map_ = other.inode_map_;
-  inode_references_ = other.inode_references_;
   statistics_ = other.statistics_;
 }
 
@@ -94,9 +101,126 @@ InodeTracker &InodeTracker::operator= (const InodeTracker &other) {
 }
 
 
+void InodeTracker::Swap(InodeTracker *other) {
+  assert(other->version_ == kVersion);
+  Lock();
+  other->Lock();
+  path_store_.Swap(&other->path_store_);
+  inode_map_.Swap(&other->inode_map_);
+  std::swap(statistics_, other->statistics_);
+  other->Unlock();
+  Unlock();
+}
+
+
 InodeTracker::~InodeTracker() {
   pthread_mutex_destroy(lock_);
   free(lock_);
 }
 
+
+/**
+ * Returns an inode that only depends on the path and on the fingerprint of the
+ * directory entry, so that an unchanged entry gets the same inode in the next
+ * catalog revision.  Collisions with inodes tracked for other paths are
+ * resolved by linear probing.  Returns 0 if no inode is available.
+ */
+uint64_t InodeTracker::FindStableInode(
+  const shash::Md5 &md5path,
+  const uint64_t fingerprint)
+{
+  uint64_t key[3];
+  memcpy(key, md5path.digest, sizeof(md5path.digest));
+  key[2] = fingerprint;
+  const uint64_t hash = MurmurHash64A(key, sizeof(key), 0x9ce603115bba659bLLU);
+
+  Lock();
+  uint64_t result = 0;
+  for (unsigned i = 0; i < kMaxStableInodeProbes; ++i) {
+    const uint64_t inode =
+      kStableInodeBase | ((hash + i) & (kStableInodeBase - 1));
+    shash::Md5 tracked_md5path;
+    if (!inode_map_.LookupMd5Path(inode, &tracked_md5path) ||
+        (tracked_md5path == md5path))
+    {
+      result = inode;
+      break;
+    }
+  }
+  Unlock();
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+
+
+PageCacheTracker::PageCacheTracker() {
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+  map_.Init(16, 0, hasher_inode);
+}
+
+
+PageCacheTracker::~PageCacheTracker() {
+  pthread_mutex_destroy(&lock_);
+}
+
+
+bool PageCacheTracker::Open(const uint64_t inode, const shash::Any &hash) {
+  MutexLockGuard guard(&lock_);
+  Entry entry;
+  const bool found = map_.Lookup(inode, &entry);
+  bool keep_cache = false;
+  if (!found) {
+    entry.hash = hash;
+  } else if (entry.nopen == 0) {
+    // Stale entries are removed when the last handle is closed
+    keep_cache = (entry.hash == hash);
+    entry.hash = hash;
+  } else if (!entry.is_stale && (entry.hash == hash)) {
+    keep_cache = true;
+  } else {
+    if (!entry.is_stale)
+      statistics_.n_stale++;
+    entry.hash = hash;
+    entry.is_stale = true;
+  }
+  entry.nopen++;
+  map_.Insert(inode, entry);
+
+  if (keep_cache)
+    statistics_.n_keep++;
+  else
+    statistics_.n_drop++;
+  return keep_cache;
+}
+
+
+void PageCacheTracker::Close(const uint64_t inode) {
+  MutexLockGuard guard(&lock_);
+  Entry entry;
+  if (!map_.Lookup(inode, &entry) || (entry.nopen == 0))
+    return;
+  entry.nopen--;
+  if ((entry.nopen == 0) && entry.is_stale)
+    map_.Erase(inode);
+  else
+    map_.Insert(inode, entry);
+}
+
+
+void PageCacheTracker::Evict(const uint64_t inode) {
+  MutexLockGuard guard(&lock_);
+  Entry entry;
+  if (map_.Lookup(inode, &entry) && (entry.nopen == 0))
+    map_.Erase(inode);
+}
+
+
+PageCacheTracker::Statistics PageCacheTracker::GetStatistics() {
+  MutexLockGuard guard(&lock_);
+  return statistics_;
+}
+
 }  // namespace glue
@@ -12,6 +12,7 @@
 #include <sched.h>
 #include <stdint.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <map>
@@ -25,6 +26,7 @@
 #include "smallhash.h"
 #include "smalloc.h"
 #include "util/posix.h"
+#include "util/single_copy.h"
 #include "util/string.h"
 
 #ifndef CVMFS_GLUE_BUFFER_H_
@@ -97,6 +99,7 @@ class StringHeap : public SingleCopy {
   void Init(const uint32_t minimum_size) {
     size_ = 0;
     used_ = 0;
+    bytes_allocated_ = 0;
 
     // Initial bin: 128kB or smallest power of 2 >= minimum size
     uint32_t pow2_size = minimum_size < 128*1024 ? 128*1024 : minimum_size;
@@ -143,11 +146,13 @@ class StringHeap : public SingleCopy {
   }
 
   uint64_t used() const { return used_; }
+  uint64_t bytes_allocated() const { return bytes_allocated_; }
 
  private:
   void AddBin(const uint64_t size) {
     void *bin = smmap(size);
     bins_.PushBack(bin);
+    bytes_allocated_ += size;
     bin_size_ = size;
     bin_used_ = 0;
   }
@@ -156,6 +161,7 @@ class StringHeap : public SingleCopy {
   uint64_t used_;
   uint64_t bin_size_;
   uint64_t bin_used_;
+  uint64_t bytes_allocated_;
   BigVector<void *> bins_;
 };
 
@@ -163,6 +169,18 @@ class StringHeap : public SingleCopy {
 //------------------------------------------------------------------------------
 
 
+/**
+ * Stores the tracked paths as a tree of path segments.  Every entry is keyed
+ * by the md5 sum of its full path and references its parent.  The root entry
+ * has an empty name and a null parent.  Entries are reference counted by their
+ * children; entries that are tracked for an inode hold an extra reference and
+ * carry the inode inline.
+ *
+ * Removed segments leave garbage in the string heap.  Compact() copies the
+ * remaining segments to a new, smaller heap.  Erase() compacts on its own only
+ * if the heap is mostly garbage, so that compaction usually takes place in a
+ * background pass.
+ */
 class PathStore {
  public:
   /**
@@ -186,31 +204,19 @@ class PathStore {
   explicit PathStore(const PathStore &other);
   PathStore &operator= (const PathStore &other);
 
-  void Insert(const shash::Md5 &md5path, const PathString &path) {
-    PathInfo info;
-    bool found = map_.Lookup(md5path, &info);
-    if (found) {
-      info.refcnt++;
-      map_.Insert(md5path, info);
-      return;
-    }
-
-    PathInfo new_entry;
-    if (path.IsEmpty()) {
-      new_entry.name = string_heap_->AddString(0, "");
-      map_.Insert(md5path, new_entry);
-      return;
-    }
-
-    PathString parent_path = GetParentPath(path);
-    new_entry.parent = shash::Md5(parent_path.GetChars(),
-                                  parent_path.GetLength());
-    Insert(new_entry.parent, parent_path);
+  void Swap(PathStore *other) {
+    map_.Swap(&other->map_);
+    std::swap(string_heap_, other->string_heap_);
+  }
 
-    const uint16_t name_length = path.GetLength() - parent_path.GetLength() - 1;
-    const char *name_str = path.GetChars() + parent_path.GetLength() + 1;
-    new_entry.name = string_heap_->AddString(name_length, name_str);
-    map_.Insert(md5path, new_entry);
+  /**
+   * Tracks path for the given inode.  A path that is already tracked keeps its
+   * inode.
+   */
+  shash::Md5 Insert(const PathString &path, const uint64_t inode) {
+    shash::Md5 md5path(path.GetChars(), path.GetLength());
+    DoInsert(md5path, path, inode);
+    return md5path;
   }
 
   bool Lookup(const shash::Md5 &md5path, PathString *path) {
@@ -229,33 +235,40 @@ class PathStore {
     return true;
   }
 
+  /**
+   * Returns 0 if the path is not tracked for an inode.
+   */
+  uint64_t LookupInode(const shash::Md5 &md5path) {
+    PathInfo info;
+    bool found = map_.Lookup(md5path, &info);
+    if (found) return info.inode;
+    return 0;
+  }
+
+  /**
+   * Stops tracking the path for its inode.  The path segments are removed once
+   * they are not referenced by children anymore.
+   */
   void Erase(const shash::Md5 &md5path) {
     PathInfo info;
     bool found = map_.Lookup(md5path, &info);
-    if (!found)
+    if (!found || (info.inode == 0))
       return;
 
-    info.refcnt--;
-    if (info.refcnt == 0) {
-      map_.Erase(md5path);
-      string_heap_->RemoveString(info.name);
-      if (string_heap_->GetUsage() < 0.75) {
-        StringHeap *new_string_heap = new StringHeap(string_heap_->used());
-        shash::Md5 empty_path = map_.empty_key();
-        for (unsigned i = 0; i < map_.capacity(); ++i) {
-          if (map_.keys()[i] != empty_path) {
-            (map_.values() + i)->name =
-              new_string_heap->AddString(map_.values()[i].name.length(),
-                                         map_.values()[i].name.data());
-          }
-        }
-        delete string_heap_;
-        string_heap_ = new_string_heap;
-      }
-      Erase(info.parent);
-    } else {
-      map_.Insert(md5path, info);
-    }
+    info.inode = 0;
+    Release(md5path, &info);
+    if (string_heap_->GetUsage() < kCompactThresholdErase)
+      DoCompact();
+  }
+
+  /**
+   * Returns true if the string heap was replaced by a smaller one.
+   */
+  bool Compact() {
+    if (string_heap_->GetUsage() >= kCompactThreshold)
+      return false;
+    DoCompact();
+    return true;
   }
 
   void Clear() {
@@ -264,6 +277,10 @@ class PathStore {
     string_heap_ = new StringHeap();
   }
 
+  uint64_t bytes_allocated() const {
+    return map_.bytes_allocated() + string_heap_->bytes_allocated();
+  }
+
   Cursor BeginEnumerate() {
     return Cursor();
   }
@@ -284,149 +301,161 @@ class PathStore {
   }
 
  private:
+  /**
+   * Background compaction takes place once a quarter of the string heap is
+   * garbage.  Erase() compacts once half of the string heap is garbage.
+   */
+  static const double kCompactThreshold;  // = 0.75
+  static const double kCompactThresholdErase;  // = 0.5
+
   struct PathInfo {
-    PathInfo() {
-      refcnt = 1;
-    }
+    PathInfo() : refcnt(1), inode(0) { }
     shash::Md5 parent;
     uint32_t refcnt;
     StringRef name;
+    uint64_t inode;
   };
 
-  void CopyFrom(const PathStore &other);
-
-  SmallHashDynamic<shash::Md5, PathInfo> map_;
-  StringHeap *string_heap_;
-};
-
-
-//------------------------------------------------------------------------------
-
-
-class PathMap {
- public:
-  PathMap() {
-    map_.Init(16, shash::Md5(shash::AsciiPtr("!")), hasher_md5);
-  }
+  /**
+   * Inserts a tracked path if inode > 0 or a parent reference otherwise.
+   */
+  void DoInsert(const shash::Md5 &md5path, const PathString &path,
+                const uint64_t inode)
+  {
+    PathInfo info;
+    bool found = map_.Lookup(md5path, &info);
+    if (found) {
+      if (inode != 0) {
+        if (info.inode != 0)
+          return;
+        info.inode = inode;
+      }
+      info.refcnt++;
+      map_.Insert(md5path, info);
+      return;
+    }
 
-  bool LookupPath(const shash::Md5 &md5path, PathString *path) {
-    bool found = path_store_.Lookup(md5path, path);
-    return found;
-  }
+    PathInfo new_entry;
+    new_entry.inode = inode;
+    if (path.IsEmpty()) {
+      new_entry.name = string_heap_->AddString(0, "");
+      map_.Insert(md5path, new_entry);
+      return;
+    }
 
-  uint64_t LookupInodeByPath(const PathString &path) {
-    uint64_t inode;
-    bool found = map_.Lookup(shash::Md5(path.GetChars(), path.GetLength()),
-                             &inode);
-    if (found) return inode;
-    return 0;
-  }
+    PathString parent_path = GetParentPath(path);
+    new_entry.parent = shash::Md5(parent_path.GetChars(),
+                                  parent_path.GetLength());
+    DoInsert(new_entry.parent, parent_path, 0);
 
-  uint64_t LookupInodeByMd5Path(const shash::Md5 &md5path) {
-    uint64_t inode;
-    bool found = map_.Lookup(md5path, &inode);
-    if (found) return inode;
-    return 0;
+    const uint16_t name_length = path.GetLength() - parent_path.GetLength() - 1;
+    const char *name_str = path.GetChars() + parent_path.GetLength() + 1;
+    new_entry.name = string_heap_->AddString(name_length, name_str);
+    map_.Insert(md5path, new_entry);
   }
 
-  shash::Md5 Insert(const PathString &path, const uint64_t inode) {
-    shash::Md5 md5path(path.GetChars(), path.GetLength());
-    if (!map_.Contains(md5path)) {
-      path_store_.Insert(md5path, path);
-      map_.Insert(md5path, inode);
+  void Release(const shash::Md5 &md5path, PathInfo *info) {
+    info->refcnt--;
+    if (info->refcnt > 0) {
+      map_.Insert(md5path, *info);
+      return;
     }
-    return md5path;
-  }
 
-  void Erase(const shash::Md5 &md5path) {
-    bool found = map_.Contains(md5path);
-    if (found) {
-      path_store_.Erase(md5path);
-      map_.Erase(md5path);
+    map_.Erase(md5path);
+    string_heap_->RemoveString(info->name);
+    PathInfo parent_info;
+    if (map_.Lookup(info->parent, &parent_info))
+      Release(info->parent, &parent_info);
+  }
+
+  void DoCompact() {
+    StringHeap *new_string_heap = new StringHeap(string_heap_->used());
+    shash::Md5 empty_path = map_.empty_key();
+    for (unsigned i = 0; i < map_.capacity(); ++i) {
+      if (map_.keys()[i] != empty_path) {
+        (map_.values() + i)->name =
+          new_string_heap->AddString(map_.values()[i].name.length(),
+                                     map_.values()[i].name.data());
+      }
     }
+    delete string_heap_;
+    string_heap_ = new_string_heap;
   }
 
-  void Clear() {
-    map_.Clear();
-    path_store_.Clear();
-  }
-
-  // For enumerating
-  PathStore *path_store() { return &path_store_; }
+  void CopyFrom(const PathStore &other);
 
- private:
-  SmallHashDynamic<shash::Md5, uint64_t> map_;
-  PathStore path_store_;
+  SmallHashDynamic<shash::Md5, PathInfo> map_;
+  StringHeap *string_heap_;
 };
 
 
 //------------------------------------------------------------------------------
 
 
+/**
+ * Maps inodes to the md5 sum of their path and keeps the reference counter
+ * given by Fuse inline.
+ */
 class InodeMap {
  public:
   InodeMap() {
     map_.Init(16, 0, hasher_inode);
   }
 
-  bool LookupMd5Path(const uint64_t inode, shash::Md5 *md5path) {
-    bool found = map_.Lookup(inode, md5path);
-    return found;
-  }
-
-  void Insert(const uint64_t inode, const shash::Md5 &md5path) {
-    map_.Insert(inode, md5path);
-  }
-
-  void Erase(const uint64_t inode) {
-    map_.Erase(inode);
-  }
-
-  void Clear() { map_.Clear(); }
-
- private:
-  SmallHashDynamic<uint64_t, shash::Md5> map_;
-};
-
-
-//------------------------------------------------------------------------------
-
-
-class InodeReferences {
- public:
-  InodeReferences() {
-    map_.Init(16, 0, hasher_inode);
-  }
-
-  bool Get(const uint64_t inode, const uint32_t by) {
-    uint32_t refcounter = 0;
-    const bool found = map_.Lookup(inode, &refcounter);
-    const bool new_inode = !found;
-    refcounter += by;  // This is 0 if the inode is not found
-    map_.Insert(inode, refcounter);
-    return new_inode;
+  /**
+   * Returns true if the inode is new.  The inode is associated with md5path
+   * in any case.
+   */
+  bool Get(const uint64_t inode, const uint32_t by,
+           const shash::Md5 &md5path)
+  {
+    InodeInfo info;
+    const bool found = map_.Lookup(inode, &info);
+    info.references += by;  // This is 0 if the inode is not found
+    info.md5path = md5path;
+    map_.Insert(inode, info);
+    return !found;
   }
 
-  bool Put(const uint64_t inode, const uint32_t by) {
-    uint32_t refcounter;
-    bool found = map_.Lookup(inode, &refcounter);
+  /**
+   * Returns true and the path of the inode if the last reference was dropped.
+   */
+  bool Put(const uint64_t inode, const uint32_t by, shash::Md5 *md5path) {
+    InodeInfo info;
+    bool found = map_.Lookup(inode, &info);
     assert(found);
-    assert(refcounter >= by);
-    if (refcounter == by) {
+    assert(info.references >= by);
+    if (info.references == by) {
+      *md5path = info.md5path;
       map_.Erase(inode);
       return true;
     }
-    refcounter -= by;
-    map_.Insert(inode, refcounter);
+    info.references -= by;
+    map_.Insert(inode, info);
     return false;
   }
 
-  void Clear() {
-    map_.Clear();
+  bool LookupMd5Path(const uint64_t inode, shash::Md5 *md5path) {
+    InodeInfo info;
+    bool found = map_.Lookup(inode, &info);
+    if (found)
+      *md5path = info.md5path;
+    return found;
   }
 
+  void Clear() { map_.Clear(); }
+  void Swap(InodeMap *other) { map_.Swap(&other->map_); }
+
+  uint64_t bytes_allocated() const { return map_.bytes_allocated(); }
+
  private:
-  SmallHashDynamic<uint64_t, uint32_t> map_;
+  struct InodeInfo {
+    InodeInfo() : references(0) { }
+    shash::Md5 md5path;
+    uint32_t references;
+  };
+
+  SmallHashDynamic<uint64_t, InodeInfo> map_;
 };
 
 
@@ -475,17 +504,31 @@ class InodeTracker {
   };
   Statistics GetStatistics() { return statistics_; }
 
+  /**
+   * Inodes derived from the path and the directory entry are in the upper half
+   * of the inode space, so they do not overlap with the inodes of the catalogs.
+   */
+  static const uint64_t kStableInodeBase = uint64_t(1) << 62;
+  /**
+   * After so many inodes taken by other paths, FindStableInode() gives up.
+   */
+  static const unsigned kMaxStableInodeProbes = 8;
+
   InodeTracker();
   explicit InodeTracker(const InodeTracker &other);
   InodeTracker &operator= (const InodeTracker &other);
   ~InodeTracker();
+  /**
+   * Hands over the tracked inodes in constant time instead of copying them.
+   * Used by the hot reload on both ends (save and restore).
+   */
+  void Swap(InodeTracker *other);
 
   void VfsGetBy(const uint64_t inode, const uint32_t by, const PathString &path)
   {
     Lock();
-    bool new_inode = inode_references_.Get(inode, by);
-    shash::Md5 md5path = path_map_.Insert(path, inode);
-    inode_map_.Insert(inode, md5path);
+    shash::Md5 md5path = path_store_.Insert(path, inode);
+    bool new_inode = inode_map_.Get(inode, by, md5path);
     Unlock();
 
     atomic_xadd64(&statistics_.num_references, by);
@@ -496,20 +539,21 @@ class InodeTracker {
     VfsGetBy(inode, 1, path);
   }
 
-  void VfsPut(const uint64_t inode, const uint32_t by) {
+  /**
+   * Returns true if the last reference was dropped, i.e. the kernel forgot
+   * the inode.
+   */
+  bool VfsPut(const uint64_t inode, const uint32_t by) {
     Lock();
-    bool removed = inode_references_.Put(inode, by);
+    shash::Md5 md5path;
+    bool removed = inode_map_.Put(inode, by, &md5path);
     if (removed) {
-      // TODO(jblomer): pop operation (Lookup+Erase)
-      shash::Md5 md5path;
-      bool found = inode_map_.LookupMd5Path(inode, &md5path);
-      assert(found);
-      inode_map_.Erase(inode);
-      path_map_.Erase(md5path);
+      path_store_.Erase(md5path);
       atomic_inc64(&statistics_.num_removes);
     }
     Unlock();
     atomic_xadd64(&statistics_.num_references, -int32_t(by));
+    return removed;
   }
 
   bool FindPath(const uint64_t inode, PathString *path) {
@@ -517,7 +561,7 @@ class InodeTracker {
     shash::Md5 md5path;
     bool found = inode_map_.LookupMd5Path(inode, &md5path);
     if (found) {
-      found = path_map_.LookupPath(md5path, path);
+      found = path_store_.Lookup(md5path, path);
       assert(found);
     }
     Unlock();
@@ -532,7 +576,8 @@ class InodeTracker {
 
   uint64_t FindInode(const PathString &path) {
     Lock();
-    uint64_t inode = path_map_.LookupInodeByPath(path);
+    uint64_t inode = path_store_.LookupInode(
+      shash::Md5(path.GetChars(), path.GetLength()));
     Unlock();
     atomic_inc64(&statistics_.num_hits_inode);
     return inode;
@@ -540,20 +585,20 @@ class InodeTracker {
 
   Cursor BeginEnumerate() {
     Lock();
-    return Cursor(path_map_.path_store()->BeginEnumerate());
+    return Cursor(path_store_.BeginEnumerate());
   }
 
   bool Next(Cursor *cursor, uint64_t *inode_parent, NameString *name) {
     shash::Md5 parent_md5;
     StringRef name_ref;
-    bool result = path_map_.path_store()->Next(
-      &(cursor->csr_paths), &parent_md5, &name_ref);
+    bool result = path_store_.Next(&(cursor->csr_paths), &parent_md5,
+                                   &name_ref);
     if (!result)
       return false;
     if (parent_md5.IsNull())
       *inode_parent = 0;
     else
-      *inode_parent = path_map_.LookupInodeByMd5Path(parent_md5);
+      *inode_parent = path_store_.LookupInode(parent_md5);
     name->Assign(name_ref.data(), name_ref.length());
     return true;
   }
@@ -562,8 +607,30 @@ class InodeTracker {
     Unlock();
   }
 
+  uint64_t FindStableInode(const shash::Md5 &md5path,
+                           const uint64_t fingerprint);
+
+  /**
+   * Shrinks the memory of the path segments after many inodes have been
+   * released.  Called periodically from a background thread.
+   */
+  bool Compact() {
+    Lock();
+    bool retval = path_store_.Compact();
+    Unlock();
+    return retval;
+  }
+
+  uint64_t bytes_allocated() {
+    Lock();
+    uint64_t result =
+      path_store_.bytes_allocated() + inode_map_.bytes_allocated();
+    Unlock();
+    return result;
+  }
+
  private:
-  static const unsigned kVersion = 4;
+  static const unsigned kVersion = 5;
 
   void InitLock();
   void CopyFrom(const InodeTracker &other);
@@ -578,13 +645,69 @@ class InodeTracker {
 
   unsigned version_;
   pthread_mutex_t *lock_;
-  PathMap path_map_;
+  PathStore path_store_;
   InodeMap inode_map_;
-  InodeReferences inode_references_;
   Statistics statistics_;
 };  // class InodeTracker
 
 
+//------------------------------------------------------------------------------
+
+
+/**
+ * Decides if the kernel can keep the page cache of a regular file on open.
+ * The same inode can refer to different revisions of a file, so the page
+ * cache is only kept if the content hash did not change since the previous
+ * open.  If an inode is opened with a new content hash while handles to the
+ * old content are still open, reads from the old handles might fill the page
+ * cache with old data.  In this case, the page cache is dropped on every open
+ * until all handles are closed.
+ *
+ * Unlike the inode tracker, the page cache tracker does not survive reloads.
+ * It starts empty and thus drops the page cache on the first open.
+ */
+class PageCacheTracker : SingleCopy {
+ public:
+  struct Statistics {
+    Statistics() : n_keep(0), n_drop(0), n_stale(0) { }
+    uint64_t n_keep;
+    uint64_t n_drop;
+    uint64_t n_stale;
+  };
+
+  PageCacheTracker();
+  ~PageCacheTracker();
+
+  /**
+   * Registers a new handle for the inode.  Returns true if the page cache can
+   * be kept.
+   */
+  bool Open(const uint64_t inode, const shash::Any &hash);
+  /**
+   * Unknown inodes are ignored, they have been opened before a reload.
+   */
+  void Close(const uint64_t inode);
+  /**
+   * Called when the kernel forgot the inode, which drops its page cache too.
+   */
+  void Evict(const uint64_t inode);
+
+  Statistics GetStatistics();
+
+ private:
+  struct Entry {
+    Entry() : nopen(0), is_stale(false) { }
+    shash::Any hash;
+    uint32_t nopen;
+    bool is_stale;
+  };
+
+  pthread_mutex_t lock_;
+  SmallHashDynamic<uint64_t, Entry> map_;
+  Statistics statistics_;
+};  // class PageCacheTracker
+
+
 }  // namespace glue
 
 #endif  // CVMFS_GLUE_BUFFER_H_
@@ -26,7 +26,7 @@ namespace CVMFS_NAMESPACE_GUARD {
 namespace shash {
 
 const char *kAlgorithmIds[] =
-  {"", "", "-rmd160", "-shake128", ""};
+  {"", "", "-rmd160", "-shake128", "-sha256", ""};
 
 
 bool HexPtr::IsValid() const {
@@ -71,6 +71,39 @@ Algorithms ParseHashAlgorithm(const string &algorithm_option) {
     return kRmd160;
   if (algorithm_option == "shake128")
     return kShake128;
+  if (algorithm_option == "sha256")
+    return kSha256;
+  return kAny;
+}
+
+
+/**
+ * Returns true if the hex string, apart from an optional trailing hash suffix,
+ * ends with the algorithm identifier of the given algorithm.
+ */
+static bool HasAlgorithmId(
+  const string &hex,
+  const Algorithms algorithm,
+  const bool with_suffix)
+{
+  const unsigned hex_length = 2*kDigestSizes[algorithm];
+  const unsigned id_length = kAlgorithmIdSizes[algorithm];
+  if (hex.length() != hex_length + id_length + (with_suffix ? 1 : 0))
+    return false;
+  return hex.compare(hex_length, id_length, kAlgorithmIds[algorithm]) == 0;
+}
+
+
+/**
+ * Deducts the algorithm from the length of the hex string and from the
+ * algorithm identifier.  Returns kAny if no algorithm matches.
+ */
+static Algorithms GuessAlgorithm(const string &hex, const bool with_suffix) {
+  for (unsigned i = 0; i < kAny; ++i) {
+    const Algorithms algorithm = static_cast<Algorithms>(i);
+    if (HasAlgorithmId(hex, algorithm, with_suffix))
+      return algorithm;
+  }
   return kAny;
 }
 
@@ -78,16 +111,9 @@ Algorithms ParseHashAlgorithm(const string &algorithm_option) {
 Any MkFromHexPtr(const HexPtr hex, const char suffix) {
   Any result;
 
-  const unsigned length = hex.str->length();
-  if (length == 2*kDigestSizes[kMd5])
-    result = Any(kMd5, hex);
-  if (length == 2*kDigestSizes[kSha1])
-    result = Any(kSha1, hex);
-  // TODO(jblomer) compare -rmd160, -shake128
-  if ((length == 2*kDigestSizes[kRmd160] + kAlgorithmIdSizes[kRmd160]))
-    result = Any(kRmd160, hex);
-  if ((length == 2*kDigestSizes[kShake128] + kAlgorithmIdSizes[kShake128]))
-    result = Any(kShake128, hex);
+  const Algorithms algorithm = GuessAlgorithm(*hex.str, false);
+  if (algorithm != kAny)
+    result = Any(algorithm, hex);
 
   result.suffix = suffix;
   return result;
@@ -100,37 +126,13 @@ Any MkFromHexPtr(const HexPtr hex, const char suffix) {
 Any MkFromSuffixedHexPtr(const HexPtr hex) {
   Any result;
 
-  const unsigned length = hex.str->length();
-  if ((length == 2*kDigestSizes[kMd5]) || (length == 2*kDigestSizes[kMd5] + 1))
-  {
-    Suffix suffix = (length == 2*kDigestSizes[kMd5] + 1) ?
-      *(hex.str->rbegin()) : kSuffixNone;
-    result = Any(kMd5, hex, suffix);
-  }
-  if ((length == 2*kDigestSizes[kSha1]) ||
-      (length == 2*kDigestSizes[kSha1] + 1))
-  {
-    Suffix suffix = (length == 2*kDigestSizes[kSha1] + 1) ?
-      *(hex.str->rbegin()) : kSuffixNone;
-    result = Any(kSha1, hex, suffix);
-  }
-  if ((length == 2*kDigestSizes[kRmd160] + kAlgorithmIdSizes[kRmd160]) ||
-      (length == 2*kDigestSizes[kRmd160] + kAlgorithmIdSizes[kRmd160] + 1))
-  {
-    Suffix suffix =
-      (length == 2*kDigestSizes[kRmd160] + kAlgorithmIdSizes[kRmd160] + 1)
-        ? *(hex.str->rbegin())
-        : kSuffixNone;
-    result = Any(kRmd160, hex, suffix);
-  }
-  if ((length == 2*kDigestSizes[kShake128] + kAlgorithmIdSizes[kShake128]) ||
-      (length == 2*kDigestSizes[kShake128] + kAlgorithmIdSizes[kShake128] + 1))
-  {
-    Suffix suffix =
-      (length == 2*kDigestSizes[kShake128] + kAlgorithmIdSizes[kShake128] + 1)
-        ? *(hex.str->rbegin())
-        : kSuffixNone;
-    result = Any(kShake128, hex, suffix);
+  Algorithms algorithm = GuessAlgorithm(*hex.str, false);
+  if (algorithm != kAny) {
+    result = Any(algorithm, hex);
+  } else {
+    algorithm = GuessAlgorithm(*hex.str, true);
+    if (algorithm != kAny)
+      result = Any(algorithm, hex, *(hex.str->rbegin()));
   }
 
   return result;
@@ -150,6 +152,8 @@ unsigned GetContextSize(const Algorithms algorithm) {
       return sizeof(RIPEMD160_CTX);
     case kShake128:
       return sizeof(Keccak_HashInstance);
+    case kSha256:
+      return sizeof(SHA256_CTX);
     default:
       LogCvmfs(kLogHash, kLogDebug | kLogSyslogErr, "tried to generate hash "
                "context for unspecified hash. Aborting...");
@@ -178,6 +182,10 @@ void Init(ContextPtr context) {
         reinterpret_cast<Keccak_HashInstance *>(context.buffer));
       assert(keccak_result == SUCCESS);
       break;
+    case kSha256:
+      assert(context.size == sizeof(SHA256_CTX));
+      SHA256_Init(reinterpret_cast<SHA256_CTX *>(context.buffer));
+      break;
     default:
       abort();  // Undefined hash
   }
@@ -209,6 +217,11 @@ void Update(const unsigned char *buffer, const unsigned buffer_length,
                         context.buffer), buffer, buffer_length * 8);
       assert(keccak_result == SUCCESS);
       break;
+    case kSha256:
+      assert(context.size == sizeof(SHA256_CTX));
+      SHA256_Update(reinterpret_cast<SHA256_CTX *>(context.buffer),
+                    buffer, buffer_length);
+      break;
     default:
       abort();  // Undefined hash
   }
@@ -216,6 +229,7 @@ void Update(const unsigned char *buffer, const unsigned buffer_length,
 
 void Final(ContextPtr context, Any *any_digest) {
   HashReturn keccak_result;
+  unsigned char sha256_digest[SHA256_DIGEST_LENGTH];
   switch (context.algorithm) {
     case kMd5:
       assert(context.size == sizeof(MD5_CTX));
@@ -241,6 +255,12 @@ void Final(ContextPtr context, Any *any_digest) {
         Keccak_HashSqueeze(reinterpret_cast<Keccak_HashInstance *>(
           context.buffer), any_digest->digest, kDigestSizes[kShake128] * 8);
       break;
+    case kSha256:
+      assert(context.size == sizeof(SHA256_CTX));
+      SHA256_Final(sha256_digest,
+                   reinterpret_cast<SHA256_CTX *>(context.buffer));
+      memcpy(any_digest->digest, sha256_digest, kDigestSizes[kSha256]);
+      break;
     default:
       abort();  // Undefined hash
   }
@@ -35,12 +35,16 @@ namespace shash {
  * as file catalog flags and as flags in communication with the cache manager.
  * If algorithms are added, the protocol definition for external cache managers
  * needs to be updated, too.
+ *
+ * SHA-256 is truncated to 160 bits, like SHAKE128, so that the digests fit
+ * into kMaxDigestSize and the memory layout of hashes remains unchanged.
  */
 enum Algorithms {
   kMd5 = 0,
   kSha1,
   kRmd160,
   kShake128,  // with 160 output bits
+  kSha256,    // truncated to 160 output bits
   kAny,
 };
 
@@ -56,6 +60,7 @@ const char kSuffixPartial      = 'P';
 const char kSuffixTemporary    = 'T';
 const char kSuffixCertificate  = 'X';
 const char kSuffixMetainfo     = 'M';
+const char kSuffixTagIndex     = 'I';
 
 
 /**
@@ -65,8 +70,8 @@ const char kSuffixMetainfo     = 'M';
  * PosixQuotaManager::LruCommand changes, too!
  */
 const unsigned kDigestSizes[] =
-  {16,  20,   20,     20,       20};
-// Md5  Sha1  Rmd160  Shake128  Any
+  {16,  20,   20,     20,       20,     20};
+// Md5  Sha1  Rmd160  Shake128  Sha256  Any
 const unsigned kMaxDigestSize = 20;
 
 /**
@@ -77,8 +82,8 @@ const unsigned kMaxDigestSize = 20;
  */
 extern const char *kAlgorithmIds[];
 const unsigned kAlgorithmIdSizes[] =
-  {0,   0,    7,       9,         0};
-// Md5  Sha1  -rmd160  -shake128  Any
+  {0,   0,    7,       9,         7,       0};
+// Md5  Sha1  -rmd160  -shake128  -sha256  Any
 const unsigned kMaxAlgorithmIdentifierSize = 9;
 
 /**
@@ -86,8 +91,8 @@ const unsigned kMaxAlgorithmIdentifierSize = 9;
  * Is an HMAC for SHAKE well-defined?
  */
 const unsigned kBlockSizes[] =
-  {64,  64,   64,     168};
-// Md5  Sha1  Rmd160  Shake128
+  {64,  64,   64,     168,      64};
+// Md5  Sha1  Rmd160  Shake128  Sha256
 
 /**
  * Distinguishes between interpreting a string as hex hash and hashing over
@@ -342,13 +347,46 @@ struct Digest {
   std::string MakePathExplicit(const unsigned dir_levels,
                                const unsigned digits_per_level,
                                const Suffix   hash_suffix = kSuffixNone) const {
-    Hex hex(this);
-
-    // figure out how big the output string needs to be
-    const bool use_suffix = (hash_suffix != kSuffixNone);
-    const unsigned string_length = hex.length() + dir_levels + use_suffix;
     std::string result;
-    result.resize(string_length);
+    result.resize(GetPathLength(dir_levels, hash_suffix));
+    WritePath(dir_levels, digits_per_level, hash_suffix, &result[0]);
+    return result;
+  }
+
+  /**
+   * Like MakePathWithoutSuffix() but writes the null-terminated path into a
+   * caller-provided buffer instead of allocating a string.  Used on hot paths,
+   * such as opening objects from the cache.
+   *
+   * @return  the length of the path or 0 if buffer_size is not sufficient
+   */
+  unsigned WritePathWithoutSuffix(char *buffer,
+                                  const unsigned buffer_size) const
+  {
+    const unsigned length = GetPathLength(1, kSuffixNone);
+    if (length >= buffer_size)
+      return 0;
+    WritePath(1, 2, kSuffixNone, buffer);
+    buffer[length] = '\0';
+    return length;
+  }
+
+  unsigned GetPathLength(const unsigned dir_levels,
+                         const Suffix hash_suffix) const
+  {
+    return Hex(this).length() + dir_levels + (hash_suffix != kSuffixNone);
+  }
+
+  /**
+   * Writes the path representation without terminating null byte, the buffer
+   * needs to have space for GetPathLength() characters
+   */
+  void WritePath(const unsigned dir_levels,
+                 const unsigned digits_per_level,
+                 const Suffix hash_suffix,
+                 char *buffer) const
+  {
+    Hex hex(this);
 
     // build hexified hash and path delimiters
     unsigned i   = 0;
@@ -356,19 +394,18 @@ struct Digest {
     for (; i < hex.length(); ++i) {
       if (i > 0 && (i % digits_per_level == 0)
                 && (i / digits_per_level <= dir_levels)) {
-        result[pos++] = '/';
+        buffer[pos++] = '/';
       }
-      result[pos++] = hex[i];
+      buffer[pos++] = hex[i];
     }
 
     // (optionally) add hash hint suffix
-    if (use_suffix) {
-      result[pos++] = hash_suffix;
+    if (hash_suffix != kSuffixNone) {
+      buffer[pos++] = hash_suffix;
     }
 
     assert(i   == hex.length());
-    assert(pos == string_length);
-    return result;
+    assert(pos == GetPathLength(dir_levels, hash_suffix));
   }
 
   bool IsNull() const {
@@ -439,6 +476,7 @@ struct Md5 : public Digest<16, kMd5> {
 struct Sha1 : public Digest<20, kSha1> { };
 struct Rmd160 : public Digest<20, kRmd160> { };
 struct Shake128 : public Digest<20, kShake128> { };
+struct Sha256 : public Digest<20, kSha256> { };
 
 /**
  * Any as such must not be used except for digest storage.
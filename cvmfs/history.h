@@ -210,6 +210,22 @@ class History {
    */
   virtual bool GetHashes(std::vector<shash::Any> *hashes) const = 0;
 
+  /**
+   * Every insertion, update, and removal of a tag is recorded with an
+   * increasing serial number.  Lists the names of the tags that changed after
+   * the given serial number, possibly with duplicates, and the serial number
+   * of the last change.
+   *
+   * @param since_serial  the last change known to the caller, 0 for all
+   * @param names         names of the changed tags in order of the changes
+   * @param last_serial   serial number of the last recorded change
+   * @return              false if the history does not record changes or if
+   *                      it does not continue since_serial
+   */
+  virtual bool ListTagChanges(const uint64_t since_serial,
+                              std::vector<std::string> *names,
+                              uint64_t *last_serial) const = 0;
+
   // database file management controls
   virtual void TakeDatabaseFileOwnership() = 0;
   virtual void DropDatabaseFileOwnership() = 0;
@@ -0,0 +1,408 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "history_index.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <map>
+
+#include "logging.h"
+
+using namespace std;  // NOLINT
+
+namespace history {
+
+namespace {
+
+struct IndexEntry {
+  IndexEntry(const History::Tag &t, const bool r) : tag(t), removed(r) { }
+  History::Tag tag;
+  bool removed;
+};
+
+bool CompareByName(const IndexEntry &a, const IndexEntry &b) {
+  return a.tag.name < b.tag.name;
+}
+
+bool IsSameTag(const History::Tag &a, const History::Tag &b) {
+  return (a.root_hash == b.root_hash) && (a.size == b.size) &&
+         (a.revision == b.revision) && (a.timestamp == b.timestamp) &&
+         (a.channel == b.channel) && (a.branch == b.branch);
+}
+
+/**
+ * Orders record indexes of the default branch by (timestamp, revision)
+ */
+class DateOrder {
+ public:
+  explicit DateOrder(const vector<IndexEntry> *entries) : entries_(entries) { }
+  bool operator() (const uint32_t a, const uint32_t b) const {
+    return (*entries_)[a].tag < (*entries_)[b].tag;
+  }
+ private:
+  const vector<IndexEntry> *entries_;
+};
+
+}  // anonymous namespace
+
+
+TagIndex::TagIndex()
+  : buffer_(NULL)
+  , header_(NULL)
+  , records_(NULL)
+  , by_date_(NULL)
+  , head_at_(NULL)
+  , strings_(NULL)
+{ }
+
+
+TagIndex::~TagIndex() {
+  if (!mapped_file_.IsValid())
+    free(buffer_);
+}
+
+
+bool TagIndex::Write(const vector<History::Tag> &tags, const string &path) {
+  return WriteRecords(tags, vector<string>(), kTypeFull, path);
+}
+
+
+bool TagIndex::WriteDelta(
+  const vector<History::Tag> &base_tags,
+  const vector<History::Tag> &tags,
+  const string &path)
+{
+  map<string, const History::Tag *> base;
+  for (unsigned i = 0; i < base_tags.size(); ++i)
+    base[base_tags[i].name] = &base_tags[i];
+
+  vector<History::Tag> changed;
+  for (unsigned i = 0; i < tags.size(); ++i) {
+    map<string, const History::Tag *>::iterator iter = base.find(tags[i].name);
+    if (iter == base.end()) {
+      changed.push_back(tags[i]);
+      continue;
+    }
+    if (!IsSameTag(*iter->second, tags[i]))
+      changed.push_back(tags[i]);
+    base.erase(iter);
+  }
+
+  vector<string> removed;
+  for (map<string, const History::Tag *>::const_iterator i = base.begin(),
+       iEnd = base.end(); i != iEnd; ++i)
+  {
+    removed.push_back(i->first);
+  }
+  return WriteRecords(changed, removed, kTypeDelta, path);
+}
+
+
+bool TagIndex::ApplyDelta(
+  const TagIndex &base,
+  const string &delta_path,
+  const string &path)
+{
+  UniquePtr<TagIndex> delta(Open(delta_path));
+  if (!delta.IsValid() || (delta->type() != kTypeDelta)) {
+    LogCvmfs(kLogHistory, kLogDebug, "invalid tag index delta %s",
+             delta_path.c_str());
+    return false;
+  }
+
+  vector<History::Tag> tags;
+  base.List(&tags);
+  map<string, History::Tag> merged;
+  for (unsigned i = 0; i < tags.size(); ++i)
+    merged[tags[i].name] = tags[i];
+
+  vector<string> removed;
+  delta->ListRemoved(&removed);
+  for (unsigned i = 0; i < removed.size(); ++i)
+    merged.erase(removed[i]);
+  delta->List(&tags);
+  for (unsigned i = 0; i < tags.size(); ++i)
+    merged[tags[i].name] = tags[i];
+
+  tags.clear();
+  for (map<string, History::Tag>::const_iterator i = merged.begin(),
+       iEnd = merged.end(); i != iEnd; ++i)
+  {
+    tags.push_back(i->second);
+  }
+  return Write(tags, path);
+}
+
+
+bool TagIndex::WriteRecords(
+  const vector<History::Tag> &tags,
+  const vector<string> &removed,
+  const Type type,
+  const string &path)
+{
+  vector<IndexEntry> entries;
+  for (unsigned i = 0; i < tags.size(); ++i)
+    entries.push_back(IndexEntry(tags[i], false));
+  for (unsigned i = 0; i < removed.size(); ++i) {
+    History::Tag tag;
+    tag.name = removed[i];
+    entries.push_back(IndexEntry(tag, true));
+  }
+  sort(entries.begin(), entries.end(), CompareByName);
+
+  string strings;
+  vector<TagRecord> records(entries.size());
+  vector<uint32_t> by_date;
+  for (unsigned i = 0; i < entries.size(); ++i) {
+    const History::Tag &tag = entries[i].tag;
+    TagRecord *record = &records[i];
+    memset(record, 0, sizeof(TagRecord));
+    record->timestamp = tag.timestamp;
+    record->size = tag.size;
+    record->revision = tag.revision;
+    record->name_offset = strings.length();
+    record->name_length = tag.name.length();
+    strings += tag.name;
+    record->branch_offset = strings.length();
+    record->branch_length = tag.branch.length();
+    strings += tag.branch;
+    record->algorithm = tag.root_hash.algorithm;
+    record->suffix = tag.root_hash.suffix;
+    record->channel = tag.channel;
+    memcpy(record->digest, tag.root_hash.digest, shash::kMaxDigestSize);
+    if (entries[i].removed)
+      record->flags |= kFlagRemoved;
+    else if ((type == kTypeFull) && tag.branch.empty())
+      by_date.push_back(i);
+  }
+  sort(by_date.begin(), by_date.end(), DateOrder(&entries));
+  vector<uint32_t> head_at(by_date.size());
+  for (unsigned i = 0; i < by_date.size(); ++i) {
+    head_at[i] = by_date[i];
+    if ((i > 0) && (entries[head_at[i - 1]].tag.revision >
+                    entries[by_date[i]].tag.revision))
+    {
+      head_at[i] = head_at[i - 1];
+    }
+  }
+
+  IndexHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kMagic;
+  header.version = kVersion;
+  header.type = type;
+  header.num_tags = records.size();
+  header.num_dated = by_date.size();
+  header.strings_size = strings.length();
+
+  FILE *f = fopen(path.c_str(), "w");
+  if (f == NULL) {
+    LogCvmfs(kLogHistory, kLogStderr, "failed to create tag index %s (%d)",
+             path.c_str(), errno);
+    return false;
+  }
+  bool retval = fwrite(&header, sizeof(header), 1, f) == 1;
+  if (!records.empty()) {
+    retval = retval &&
+      (fwrite(&records[0], sizeof(TagRecord), records.size(), f) ==
+       records.size());
+  }
+  if (!by_date.empty()) {
+    retval = retval &&
+      (fwrite(&by_date[0], sizeof(uint32_t), by_date.size(), f) ==
+       by_date.size()) &&
+      (fwrite(&head_at[0], sizeof(uint32_t), head_at.size(), f) ==
+       head_at.size());
+  }
+  retval = retval &&
+    (fwrite(strings.data(), 1, strings.length(), f) == strings.length());
+  retval = (fclose(f) == 0) && retval;
+  if (!retval) {
+    LogCvmfs(kLogHistory, kLogStderr, "failed to write tag index %s (%d)",
+             path.c_str(), errno);
+    unlink(path.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+TagIndex *TagIndex::Open(const string &path) {
+  UniquePtr<TagIndex> index(new TagIndex());
+  index->mapped_file_ = new MemoryMappedFile(path);
+  if (!index->mapped_file_->Map())
+    return NULL;
+  index->buffer_ = index->mapped_file_->buffer();
+  if (!index->Verify(index->mapped_file_->size())) {
+    LogCvmfs(kLogHistory, kLogDebug, "invalid tag index %s", path.c_str());
+    return NULL;
+  }
+  return index.Release();
+}
+
+
+TagIndex *TagIndex::Parse(unsigned char *buffer, const size_t size) {
+  UniquePtr<TagIndex> index(new TagIndex());
+  index->buffer_ = buffer;
+  if (!index->Verify(size))
+    return NULL;
+  return index.Release();
+}
+
+
+/**
+ * Checks the header and that all offsets of the records are within the buffer
+ * before any lookup trusts them.
+ */
+bool TagIndex::Verify(const size_t size) {
+  if ((buffer_ == NULL) || (size < sizeof(IndexHeader)))
+    return false;
+  header_ = reinterpret_cast<const IndexHeader *>(buffer_);
+  if ((header_->magic != kMagic) || (header_->version != kVersion) ||
+      (header_->type > kTypeDelta))
+  {
+    return false;
+  }
+  if ((header_->type == kTypeDelta) && (header_->num_dated > 0))
+    return false;
+  if (header_->num_dated > header_->num_tags)
+    return false;
+
+  const uint64_t expected_size = sizeof(IndexHeader) +
+    static_cast<uint64_t>(header_->num_tags) * sizeof(TagRecord) +
+    static_cast<uint64_t>(header_->num_dated) * 2 * sizeof(uint32_t) +
+    header_->strings_size;
+  if (expected_size != size)
+    return false;
+
+  records_ = reinterpret_cast<const TagRecord *>(buffer_ + sizeof(IndexHeader));
+  by_date_ = reinterpret_cast<const uint32_t *>(records_ + header_->num_tags);
+  head_at_ = by_date_ + header_->num_dated;
+  strings_ = reinterpret_cast<const char *>(head_at_ + header_->num_dated);
+
+  for (unsigned i = 0; i < header_->num_tags; ++i) {
+    const TagRecord &record = records_[i];
+    if ((static_cast<uint64_t>(record.name_offset) + record.name_length >
+         header_->strings_size) ||
+        (static_cast<uint64_t>(record.branch_offset) + record.branch_length >
+         header_->strings_size) ||
+        (record.algorithm > shash::kAny))
+    {
+      return false;
+    }
+  }
+  for (unsigned i = 0; i < header_->num_dated; ++i) {
+    if ((by_date_[i] >= header_->num_tags) ||
+        (head_at_[i] >= header_->num_tags))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+string TagIndex::GetString(const uint32_t offset, const uint32_t length) const
+{
+  return string(strings_ + offset, length);
+}
+
+
+int TagIndex::CompareName(const TagRecord &record, const string &name) const {
+  const size_t length = std::min(static_cast<size_t>(record.name_length),
+                                 name.length());
+  const int retval = memcmp(strings_ + record.name_offset, name.data(), length);
+  if (retval != 0)
+    return retval;
+  if (record.name_length == name.length())
+    return 0;
+  return (record.name_length < name.length()) ? -1 : 1;
+}
+
+
+void TagIndex::ToTag(const TagRecord &record, History::Tag *tag) const {
+  tag->name = GetString(record.name_offset, record.name_length);
+  tag->branch = GetString(record.branch_offset, record.branch_length);
+  tag->root_hash = shash::Any(static_cast<shash::Algorithms>(record.algorithm),
+                              record.digest, record.suffix);
+  tag->size = record.size;
+  tag->revision = record.revision;
+  tag->timestamp = record.timestamp;
+  tag->channel = static_cast<History::UpdateChannel>(record.channel);
+  tag->description.clear();
+}
+
+
+bool TagIndex::GetByName(const string &name, History::Tag *tag) const {
+  unsigned low = 0;
+  unsigned high = header_->num_tags;
+  while (low < high) {
+    const unsigned mid = low + (high - low) / 2;
+    const int cmp = CompareName(records_[mid], name);
+    if (cmp == 0) {
+      if (records_[mid].flags & kFlagRemoved)
+        return false;
+      ToTag(records_[mid], tag);
+      return true;
+    }
+    if (cmp < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return false;
+}
+
+
+bool TagIndex::GetByDate(const time_t timestamp, History::Tag *tag) const {
+  // Number of default branch tags that are not younger than timestamp
+  unsigned low = 0;
+  unsigned high = header_->num_dated;
+  while (low < high) {
+    const unsigned mid = low + (high - low) / 2;
+    if (records_[by_date_[mid]].timestamp <= timestamp)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  if (low == 0)
+    return false;
+  ToTag(records_[head_at_[low - 1]], tag);
+  return true;
+}
+
+
+bool TagIndex::List(vector<History::Tag> *tags) const {
+  tags->clear();
+  for (unsigned i = 0; i < header_->num_tags; ++i) {
+    if (records_[i].flags & kFlagRemoved)
+      continue;
+    History::Tag tag;
+    ToTag(records_[i], &tag);
+    tags->push_back(tag);
+  }
+  return true;
+}
+
+
+bool TagIndex::ListRemoved(vector<string> *names) const {
+  names->clear();
+  for (unsigned i = 0; i < header_->num_tags; ++i) {
+    if (records_[i].flags & kFlagRemoved) {
+      names->push_back(
+        GetString(records_[i].name_offset, records_[i].name_length));
+    }
+  }
+  return true;
+}
+
+}  // namespace history
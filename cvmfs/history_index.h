@@ -0,0 +1,144 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * A compact, sorted binary index of the tags of a history database.  It is
+ * published next to the history database and allows for resolving a tag name
+ * or a timestamp to a root catalog without downloading and opening the SQLite
+ * file.  The index is meant to be memory mapped, lookups are binary searches
+ * on the mapped buffer.
+ *
+ * Layout (host byte order, checked by the magic number):
+ *   IndexHeader
+ *   TagRecord[num_tags]          sorted by name
+ *   uint32_t by_date[num_dated]  default branch records sorted by timestamp
+ *   uint32_t head_at[num_dated]  record with the highest revision in
+ *                                by_date[0..i]
+ *   char strings[strings_size]   tag and branch names, not NUL terminated
+ *
+ * A delta uses the same layout with kTypeDelta in the header and no date
+ * arrays.  It lists the tags that are new or changed with respect to a base
+ * index and the removed tags (flag kFlagRemoved).
+ */
+
+#ifndef CVMFS_HISTORY_INDEX_H_
+#define CVMFS_HISTORY_INDEX_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "hash.h"
+#include "history.h"
+#include "util/mmap_file.h"
+#include "util/pointer.h"
+#include "util/single_copy.h"
+
+namespace history {
+
+class TagIndex : SingleCopy {
+ public:
+  static const uint32_t kMagic = 0x49544643;  // "CFTI" in little endian
+  static const uint32_t kVersion = 1;
+
+  enum Type {
+    kTypeFull = 0,
+    kTypeDelta,
+  };
+
+  enum RecordFlags {
+    kFlagRemoved = 0x01,
+  };
+
+  struct IndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t type;
+    uint32_t num_tags;
+    uint32_t num_dated;
+    uint32_t strings_size;
+  };
+
+  struct TagRecord {
+    int64_t timestamp;
+    uint64_t size;
+    uint32_t revision;
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t branch_offset;
+    uint32_t branch_length;
+    uint8_t algorithm;
+    uint8_t suffix;
+    uint8_t channel;
+    uint8_t flags;
+    unsigned char digest[shash::kMaxDigestSize];
+  };
+
+  /**
+   * Writes the index of the given tags.  The tag descriptions are not part of
+   * the index.
+   */
+  static bool Write(const std::vector<History::Tag> &tags,
+                    const std::string &path);
+  /**
+   * Writes the difference between the tags of a base index and the new tags.
+   */
+  static bool WriteDelta(const std::vector<History::Tag> &base_tags,
+                         const std::vector<History::Tag> &tags,
+                         const std::string &path);
+  /**
+   * Applies the delta file to the base index and writes the resulting full
+   * index to path.
+   */
+  static bool ApplyDelta(const TagIndex &base, const std::string &delta_path,
+                         const std::string &path);
+
+  /**
+   * Memory maps an index or a delta file.
+   */
+  static TagIndex *Open(const std::string &path);
+  /**
+   * Takes ownership of a malloc'd buffer, e.g. read from the cache manager.
+   */
+  static TagIndex *Parse(unsigned char *buffer, const size_t size);
+  ~TagIndex();
+
+  Type type() const { return static_cast<Type>(header_->type); }
+  unsigned GetNumberOfTags() const { return header_->num_tags; }
+
+  bool GetByName(const std::string &name, History::Tag *tag) const;
+  /**
+   * Same semantics as History::GetByDate(): the tag of the default branch with
+   * the highest revision that is not younger than timestamp.
+   */
+  bool GetByDate(const time_t timestamp, History::Tag *tag) const;
+  /**
+   * In a delta, the removed tags are skipped.
+   */
+  bool List(std::vector<History::Tag> *tags) const;
+  bool ListRemoved(std::vector<std::string> *names) const;
+
+ private:
+  TagIndex();
+  bool Verify(const size_t size);
+  static bool WriteRecords(const std::vector<History::Tag> &tags,
+                           const std::vector<std::string> &removed,
+                           const Type type,
+                           const std::string &path);
+  std::string GetString(const uint32_t offset, const uint32_t length) const;
+  int CompareName(const TagRecord &record, const std::string &name) const;
+  void ToTag(const TagRecord &record, History::Tag *tag) const;
+
+  UniquePtr<MemoryMappedFile> mapped_file_;
+  unsigned char *buffer_;
+  const IndexHeader *header_;
+  const TagRecord *records_;
+  const uint32_t *by_date_;
+  const uint32_t *head_at_;
+  const char *strings_;
+};
+
+}  // namespace history
+
+#endif  // CVMFS_HISTORY_INDEX_H_
@@ -12,12 +12,13 @@ namespace history {
 
 const float    HistoryDatabase::kLatestSchema          = 1.0;
 const float    HistoryDatabase::kLatestSupportedSchema = 1.0;
-const unsigned HistoryDatabase::kLatestSchemaRevision  = 3;
+const unsigned HistoryDatabase::kLatestSchemaRevision  = 4;
 
 /**
  * Database Schema ChangeLog:
  *
  * Schema Version 1.0
+ *   -> Revision 4: add table 'tag_changes', filled by triggers on table tags
  *   -> Revision 3: deprecate (flush) table 'recycle_bin'
  *                  add table 'branches'
  *                  add column 'branch' to table tags
@@ -41,7 +42,8 @@ bool HistoryDatabase::CreateEmptyDatabase() {
 
   return CreateBranchesTable() &&
          CreateTagsTable() &&
-         CreateRecycleBinTable();
+         CreateRecycleBinTable() &&
+         CreateTagChangesTable();
 }
 
 
@@ -84,6 +86,30 @@ bool HistoryDatabase::CreateBranchesTable() {
 }
 
 
+/**
+ * The triggers record every modification of the tags table, independent of
+ * the code path and of the client version that modifies the database.
+ */
+bool HistoryDatabase::CreateTagChangesTable() {
+  assert(read_write());
+  const char *statements[] = {
+    "CREATE TABLE tag_changes (serial INTEGER PRIMARY KEY, name TEXT);",
+    "CREATE TRIGGER tag_changes_insert AFTER INSERT ON tags BEGIN "
+    "  INSERT INTO tag_changes (name) VALUES (NEW.name); END;",
+    "CREATE TRIGGER tag_changes_update AFTER UPDATE ON tags BEGIN "
+    "  INSERT INTO tag_changes (name) VALUES (OLD.name); "
+    "  INSERT INTO tag_changes (name) VALUES (NEW.name); END;",
+    "CREATE TRIGGER tag_changes_delete AFTER DELETE ON tags BEGIN "
+    "  INSERT INTO tag_changes (name) VALUES (OLD.name); END;",
+  };
+  for (unsigned i = 0; i < sizeof(statements) / sizeof(statements[0]); ++i) {
+    if (!sqlite::Sql(sqlite_db(), statements[i]).Execute())
+      return false;
+  }
+  return true;
+}
+
+
 bool HistoryDatabase::InsertInitialValues(const std::string &repository_name) {
   assert(read_write());
   return this->SetProperty(kFqrnKey, repository_name);
@@ -95,6 +121,11 @@ bool HistoryDatabase::ContainsRecycleBin() const {
 }
 
 
+bool HistoryDatabase::ContainsTagChanges() const {
+  return schema_version() >= 1.0 - kSchemaEpsilon && schema_revision() >= 4;
+}
+
+
 bool HistoryDatabase::CheckSchemaCompatibility() {
   return !((schema_version() < kLatestSupportedSchema - kSchemaEpsilon) ||
            (schema_version() > kLatestSchema          + kSchemaEpsilon));
@@ -119,7 +150,8 @@ bool HistoryDatabase::LiveSchemaUpgradeIfNecessary() {
 
   const bool success = UpgradeSchemaRevision_10_1() &&
                        UpgradeSchemaRevision_10_2() &&
-                       UpgradeSchemaRevision_10_3();
+                       UpgradeSchemaRevision_10_3() &&
+                       UpgradeSchemaRevision_10_4();
 
   return success && StoreSchemaRevision();
 }
@@ -191,6 +223,22 @@ bool HistoryDatabase::UpgradeSchemaRevision_10_3() {
 }
 
 
+bool HistoryDatabase::UpgradeSchemaRevision_10_4() {
+  if (schema_revision() > 3) {
+    return true;
+  }
+
+  // Changes before the upgrade are unknown, their consumers start over
+  if (!CreateTagChangesTable()) {
+    LogCvmfs(kLogHistory, kLogStderr, "failed to create tag changes table");
+    return false;
+  }
+
+  set_schema_revision(4);
+  return true;
+}
+
+
 //------------------------------------------------------------------------------
 
 #define DB_FIELDS_V1R0  "name, hash, revision, timestamp, channel, " \
@@ -383,6 +431,40 @@ SqlListRollbackTags::SqlListRollbackTags(const HistoryDatabase *database) {
 //------------------------------------------------------------------------------
 
 
+SqlListTagChanges::SqlListTagChanges(const HistoryDatabase *database) {
+  assert(database->ContainsTagChanges());
+  DeferredInit(database->sqlite_db(),
+    "SELECT serial, name FROM tag_changes WHERE serial > :serial "
+    "ORDER BY serial;");
+}
+
+bool SqlListTagChanges::BindSerial(const uint64_t since_serial) {
+  return BindInt64(1, since_serial);
+}
+
+uint64_t SqlListTagChanges::RetrieveSerial() const {
+  return RetrieveInt64(0);
+}
+
+std::string SqlListTagChanges::RetrieveName() const {
+  return RetrieveString(1);
+}
+
+
+SqlGetLastTagChange::SqlGetLastTagChange(const HistoryDatabase *database) {
+  assert(database->ContainsTagChanges());
+  DeferredInit(database->sqlite_db(),
+               "SELECT COALESCE(MAX(serial), 0) FROM tag_changes;");
+}
+
+uint64_t SqlGetLastTagChange::RetrieveSerial() const {
+  return RetrieveInt64(0);
+}
+
+
+//------------------------------------------------------------------------------
+
+
 SqlListBranches::SqlListBranches(const HistoryDatabase *database) {
   if (database->schema_revision() < 3)
     DeferredInit(database->sqlite_db(), "SELECT '', NULL, 0;");
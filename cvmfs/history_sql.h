@@ -30,6 +30,7 @@ class HistoryDatabase : public sqlite::Database<HistoryDatabase> {
   bool InsertInitialValues(const std::string &repository_name);
 
   bool ContainsRecycleBin() const;
+  bool ContainsTagChanges() const;
 
   bool CheckSchemaCompatibility();
   bool LiveSchemaUpgradeIfNecessary();
@@ -46,10 +47,12 @@ class HistoryDatabase : public sqlite::Database<HistoryDatabase> {
   bool CreateTagsTable();
   bool CreateRecycleBinTable();
   bool CreateBranchesTable();
+  bool CreateTagChangesTable();
 
   bool UpgradeSchemaRevision_10_1();
   bool UpgradeSchemaRevision_10_2();
   bool UpgradeSchemaRevision_10_3();
+  bool UpgradeSchemaRevision_10_4();
 };
 
 
@@ -183,6 +186,22 @@ class SqlGetHashes : public SqlHistory {
 };
 
 
+class SqlListTagChanges : public SqlHistory {
+ public:
+  explicit SqlListTagChanges(const HistoryDatabase *database);
+  bool BindSerial(const uint64_t since_serial);
+  uint64_t RetrieveSerial() const;
+  std::string RetrieveName() const;
+};
+
+
+class SqlGetLastTagChange : public SqlHistory {
+ public:
+  explicit SqlGetLastTagChange(const HistoryDatabase *database);
+  uint64_t RetrieveSerial() const;
+};
+
+
 class SqlListBranches : public SqlHistory {
  public:
   explicit SqlListBranches(const HistoryDatabase *database);
@@ -115,6 +115,11 @@ void SqliteHistory::PrepareQueries() {
     recycle_list_ = new SqlRecycleBinList(database_.weak_ref());
   }
 
+  if (database_->ContainsTagChanges()) {
+    list_tag_changes_ = new SqlListTagChanges(database_.weak_ref());
+    last_tag_change_  = new SqlGetLastTagChange(database_.weak_ref());
+  }
+
   if (IsWritable()) {
     insert_tag_         = new SqlInsertTag          (database_.weak_ref());
     remove_tag_         = new SqlRemoveTag          (database_.weak_ref());
@@ -467,6 +472,30 @@ bool SqliteHistory::GetHashes(std::vector<shash::Any> *hashes) const {
 }
 
 
+bool SqliteHistory::ListTagChanges(
+  const uint64_t since_serial,
+  std::vector<std::string> *names,
+  uint64_t *last_serial) const
+{
+  assert(database_);
+  if (!list_tag_changes_.IsValid())
+    return false;
+
+  if (!last_tag_change_->FetchRow())
+    return false;
+  *last_serial = last_tag_change_->RetrieveSerial();
+  if (!last_tag_change_->Reset() || (*last_serial < since_serial))
+    return false;
+
+  if (!list_tag_changes_->BindSerial(since_serial))
+    return false;
+  while (list_tag_changes_->FetchRow()) {
+    names->push_back(list_tag_changes_->RetrieveName());
+  }
+  return list_tag_changes_->Reset();
+}
+
+
 void SqliteHistory::TakeDatabaseFileOwnership() {
   assert(database_);
   database_->TakeFileOwnership();
@@ -140,6 +140,10 @@ class SqliteHistory : public History {
    */
   bool GetHashes(std::vector<shash::Any> *hashes) const;
 
+  bool ListTagChanges(const uint64_t since_serial,
+                      std::vector<std::string> *names,
+                      uint64_t *last_serial) const;
+
   // database file management controls
   void TakeDatabaseFileOwnership();
   void DropDatabaseFileOwnership();
@@ -176,6 +180,8 @@ class SqliteHistory : public History {
   UniquePtr<SqlFindBranchHead>      find_branch_head_;
   UniquePtr<SqlRecycleBinList>      recycle_list_;
   UniquePtr<SqlRecycleBinFlush>     recycle_empty_;
+  UniquePtr<SqlListTagChanges>      list_tag_changes_;
+  UniquePtr<SqlGetLastTagChange>    last_tag_change_;
 };
 
 }  // namespace history
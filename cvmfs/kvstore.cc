@@ -2,8 +2,11 @@
  * This file is part of the CernVM File System.
  */
 
+#define __STDC_FORMAT_MACROS
+
 #include "kvstore.h"
 
+#include <inttypes.h>
 #include <unistd.h>
 
 #include <assert.h>
@@ -14,6 +17,7 @@
 #include <algorithm>
 
 #include "logging.h"
+#include "util/algorithm.h"
 #include "util/async.h"
 #include "util_concurrency.h"
 
@@ -44,23 +48,41 @@ MemoryKvStore::MemoryKvStore(
   , entries_(cache_entries, shash::Any(), hasher_any,
              perf::StatisticsTemplate("lru", statistics))
   , heap_(NULL)
+  , slab_(NULL)
   , counters_(statistics)
 {
   int retval = pthread_rwlock_init(&rwlock_, NULL);
   assert(retval == 0);
+  // The slab arena comes on top of the heap, so that large objects can still
+  // use the full allocation size.  Memory is only faulted in when used and
+  // the cache manager limits the sum of the stored objects.
+  if ((alloc != kMallocLibc) && (alloc_size >= kMinSlabHeapSize)) {
+    slab_ = new MallocSlab(alloc_size / kSlabFraction);
+    LogCvmfs(kLogKvStore, kLogDebug, "using %" PRIu64 " B for small object "
+             "slabs", slab_->capacity());
+  }
   switch (alloc) {
     case kMallocHeap:
       heap_ = new MallocHeap(alloc_size,
           this->MakeCallback(&MemoryKvStore::OnBlockMove, this));
       break;
+    case kMallocHeapHugePages:
+      heap_ = new MallocHeap(alloc_size,
+          this->MakeCallback(&MemoryKvStore::OnBlockMove, this), true);
+      break;
     default:
       break;
   }
+  if ((heap_ != NULL) && (alloc == kMallocHeapHugePages)) {
+    LogCvmfs(kLogKvStore, kLogDebug, "memory heap backed by %s huge pages",
+             heap_->has_hugetlb() ? "explicit" : "transparent");
+  }
 }
 
 
 MemoryKvStore::~MemoryKvStore() {
   delete heap_;
+  delete slab_;
   pthread_rwlock_destroy(&rwlock_);
 }
 
@@ -108,7 +130,17 @@ int MemoryKvStore::DoMalloc(MemoryBuffer *buf) {
         if (!tmp.address) return -errno;
         break;
       case kMallocHeap:
+      case kMallocHeapHugePages:
         assert(heap_);
+        if ((slab_ != NULL) && (tmp.size <= MallocSlab::kMaxChunkSize)) {
+          tmp.address = slab_->Allocate(tmp.size);
+          if (tmp.address) {
+            perf::Inc(counters_.n_slab_chunks[
+              MallocSlab::GetClass(tmp.size)]);
+            break;
+          }
+          // Slabs exhausted, fall back to the heap
+        }
         a.id = tmp.id;
         tmp.address =
           heap_->Allocate(tmp.size + sizeof(a), &a, sizeof(a));
@@ -135,6 +167,12 @@ void MemoryKvStore::DoFree(MemoryBuffer *buf) {
       free(buf->address);
       return;
     case kMallocHeap:
+    case kMallocHeapHugePages:
+      if ((slab_ != NULL) && slab_->Contains(buf->address)) {
+        perf::Dec(counters_.n_slab_chunks[slab_->GetClassOf(buf->address)]);
+        slab_->MarkFree(buf->address);
+        return;
+      }
       heap_->MarkFree(static_cast<char *>(buf->address) - sizeof(a));
       return;
     default:
@@ -147,11 +185,20 @@ bool MemoryKvStore::CompactMemory() {
   double utilization;
   switch (allocator_) {
     case kMallocHeap:
+    case kMallocHeapHugePages:
       utilization = heap_->utilization();
       LogCvmfs(kLogKvStore, kLogDebug, "compact requested (%f)", utilization);
       if (utilization < kCompactThreshold) {
         LogCvmfs(kLogKvStore, kLogDebug, "compacting heap");
+        StopWatch stopwatch;
+        stopwatch.Start();
         heap_->Compact();
+        stopwatch.Stop();
+        const int64_t pause_us = stopwatch.GetTime() * 1000000;
+        perf::Inc(counters_.n_compact);
+        perf::Xadd(counters_.sz_compact_time, pause_us);
+        if (pause_us > counters_.sz_compact_time_max->Get())
+          counters_.sz_compact_time_max->Set(pause_us);
         if (heap_->utilization() > utilization) return true;
       }
       return false;
@@ -381,5 +428,7 @@ bool MemoryKvStore::ShrinkTo(size_t size) {
   }
   entries_.FilterEnd();
   LogCvmfs(kLogKvStore, kLogDebug, "shrunk to %u B", used_bytes_);
+  // Returns the memory of the deleted entries to the system
+  CompactMemory();
   return used_bytes_ <= size;
 }
@@ -14,9 +14,11 @@
 #include "cache.h"
 #include "lru.h"
 #include "malloc_heap.h"
+#include "malloc_slab.h"
 #include "statistics.h"
 #include "util/async.h"
 #include "util/single_copy.h"
+#include "util/string.h"
 
 using namespace std;  // NOLINT
 
@@ -62,12 +64,18 @@ struct MemoryBuffer {
  * mid-operation, and decrement the reference count when done. The store
  * can attempt to reduce its size by removing the least recently used
  * entries without any outstanding references.
+ *
+ * With the heap allocators, objects of up to MallocSlab::kMaxChunkSize bytes
+ * are preferably placed in size class slabs next to the heap.  They never
+ * move, which keeps the many small catalogs and symlink targets out of the
+ * heap compaction.
  */
 class MemoryKvStore : SingleCopy, public Callbackable<MallocHeap::BlockPtr> {
  public:
   enum MemoryAllocator {
     kMallocLibc,
     kMallocHeap,
+    kMallocHeapHugePages,
   };
 
   struct Counters {
@@ -84,6 +92,10 @@ class MemoryKvStore : SingleCopy, public Callbackable<MallocHeap::BlockPtr> {
     perf::Counter *sz_committed;
     perf::Counter *sz_deleted;
     perf::Counter *sz_shrunk;
+    perf::Counter *n_compact;
+    perf::Counter *sz_compact_time;  // measured in microseconds
+    perf::Counter *sz_compact_time_max;  // measured in microseconds
+    std::vector<perf::Counter *> n_slab_chunks;  // one per size class
 
     explicit Counters(perf::StatisticsTemplate statistics) {
       sz_size = statistics.RegisterTemplated("sz_size", "Total size");
@@ -107,6 +119,18 @@ class MemoryKvStore : SingleCopy, public Callbackable<MallocHeap::BlockPtr> {
         "Bytes committed");
       sz_deleted = statistics.RegisterTemplated("sz_deleted", "Bytes deleted");
       sz_shrunk = statistics.RegisterTemplated("sz_shrunk", "Bytes shrunk");
+      n_compact = statistics.RegisterTemplated("n_compact",
+        "Number of heap compactions");
+      sz_compact_time = statistics.RegisterTemplated("sz_compact_time",
+        "Time spent in heap compaction (us)");
+      sz_compact_time_max = statistics.RegisterTemplated(
+        "sz_compact_time_max", "Longest heap compaction (us)");
+      for (unsigned i = 0; i < MallocSlab::kNumClasses; ++i) {
+        const string chunk_size = StringifyInt(MallocSlab::GetChunkSize(i));
+        n_slab_chunks.push_back(statistics.RegisterTemplated(
+          "n_slab_chunks_" + chunk_size,
+          "Number of objects in " + chunk_size + "B slab chunks"));
+      }
     }
   };
 
@@ -199,9 +223,25 @@ class MemoryKvStore : SingleCopy, public Callbackable<MallocHeap::BlockPtr> {
    */
   size_t GetUsed() { return used_bytes_; }
 
+  /**
+   * The memory taken by the store: the mapped heap and slab arenas, or the
+   * space used for data with the malloc allocator
+   */
+  uint64_t GetMemoryUsage() {
+    if (heap_ == NULL)
+      return used_bytes_;
+    return heap_->capacity() + ((slab_ == NULL) ? 0 : slab_->capacity());
+  }
+
  private:
   // Compact memory once utilization falls below the threshold
   static const double kCompactThreshold;  // = 0.8
+  /**
+   * Heaps of at least this size get an additional arena, a fraction of the
+   * heap size, for the small object slabs.
+   */
+  static const unsigned kMinSlabHeapSize = 32 * MallocSlab::kSlabSize;
+  static const unsigned kSlabFraction = 8;
 
   bool DoDelete(const shash::Any &id);
   int DoMalloc(MemoryBuffer *buf);
@@ -216,6 +256,7 @@ class MemoryKvStore : SingleCopy, public Callbackable<MallocHeap::BlockPtr> {
   unsigned int max_entries_;
   lru::LruCache<shash::Any, MemoryBuffer> entries_;
   MallocHeap *heap_;
+  MallocSlab *slab_;
   pthread_rwlock_t rwlock_;
   Counters counters_;
 };
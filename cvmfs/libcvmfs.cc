@@ -18,6 +18,7 @@
 
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
 #include <string>
 
 #include "libcvmfs_int.h"
@@ -206,6 +207,22 @@ ssize_t cvmfs_pread(
 }
 
 
+ssize_t cvmfs_preadv(
+  LibContext *ctx,
+  int fd,
+  const struct iovec *iov,
+  int iovcnt,
+  off_t off)
+{
+  ssize_t nbytes = ctx->Preadv(fd, iov, iovcnt, off);
+  if (nbytes < 0) {
+    errno = -nbytes;
+    return -1;
+  }
+  return nbytes;
+}
+
+
 int cvmfs_close(LibContext *ctx, int fd)
 {
   int rc = ctx->Close(fd);
@@ -299,6 +316,60 @@ int cvmfs_listdir(
 }
 
 
+int cvmfs_listdir_stat(
+  LibContext *ctx,
+  const char *path,
+  struct cvmfs_listing_entry **buf,
+  size_t *listlen
+) {
+  string lpath;
+  int rc;
+  rc = expand_path(0, ctx, path, &lpath);
+  if (rc < 0) {
+    return -1;
+  }
+  path = lpath.c_str();
+
+  catalog::DirectoryEntryList listing;
+  rc = ctx->ListDirectoryStat(path, &listing);
+  if (rc < 0) {
+    errno = -rc;
+    return -1;
+  }
+
+  *listlen = listing.size();
+  *buf = reinterpret_cast<struct cvmfs_listing_entry *>(
+    smalloc(sizeof(struct cvmfs_listing_entry) * (listing.size() + 1)));
+  for (unsigned i = 0; i < listing.size(); ++i) {
+    const catalog::DirectoryEntry &dirent = listing[i];
+    struct cvmfs_listing_entry *entry = &((*buf)[i]);
+    entry->name = strdup(dirent.name().c_str());
+    assert(entry->name);
+    entry->info = dirent.GetStatStructure();
+    entry->content_hash = NULL;
+    if (dirent.IsRegular() && !dirent.checksum().IsNull()) {
+      entry->content_hash =
+        strdup(dirent.checksum().ToStringWithSuffix().c_str());
+      assert(entry->content_hash);
+    }
+    entry->is_chunked = dirent.IsChunkedFile();
+    entry->is_external = dirent.IsExternalFile();
+  }
+  return 0;
+}
+
+
+void cvmfs_listdir_stat_free(struct cvmfs_listing_entry *buf, size_t listlen) {
+  if (buf == NULL)
+    return;
+  for (size_t i = 0; i < listlen; ++i) {
+    free(buf[i].name);
+    free(buf[i].content_hash);
+  }
+  free(buf);
+}
+
+
 cvmfs_errors cvmfs_attach_repo_v2(
   const char *fqrn,
   SimpleOptionsParser *opts,
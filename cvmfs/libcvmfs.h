@@ -32,9 +32,12 @@
 // 23: update initialization code
 // 24: add LIBCVMFS_ERR_REVISION_BLACKLISTED
 // 25: CernVM-FS 2.4.0
-#define LIBCVMFS_REVISION 25
+// 26: add cvmfs_preadv, thread-safe reads of chunked files
+// 27: add cvmfs_listdir_stat
+#define LIBCVMFS_REVISION 27
 
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 // Legacy error codes
@@ -249,6 +252,15 @@ int cvmfs_open(cvmfs_context *ctx, const char *path);
 ssize_t cvmfs_pread(cvmfs_context *ctx,
                     int fd, void *buf, size_t size, off_t off);
 
+/**
+ * Like cvmfs_pread() but scatters the data into iovcnt buffers.  File
+ * descriptors can be read concurrently by several threads.
+ *
+ * \return number of bytes read, -1 on failure (sets errno)
+ */
+ssize_t cvmfs_preadv(cvmfs_context *ctx,
+                     int fd, const struct iovec *iov, int iovcnt, off_t off);
+
 /**
  * Close a file previously opened with cvmfs_open().
  *
@@ -313,6 +325,46 @@ int cvmfs_listdir(
   char ***buf,
   size_t *buflen);
 
+/**
+ * Entry of a directory listing returned by cvmfs_listdir_stat()
+ */
+struct cvmfs_listing_entry {
+  char *name;
+  struct stat info;
+  /**
+   * Content hash with algorithm suffix of regular files, NULL otherwise
+   */
+  char *content_hash;
+  int is_chunked;
+  int is_external;
+};
+
+/**
+ * Get the directory contents together with the stat information of every
+ * entry.  Unlike cvmfs_listdir() followed by cvmfs_stat() for every name, the
+ * attributes are taken from a single catalog query.  The listing does not
+ * include "." and "..".  Symlinks are not resolved, i.e. the info field
+ * corresponds to cvmfs_lstat().
+ *
+ * On return, *buf points to an array of *listlen entries that must be freed
+ * with cvmfs_listdir_stat_free().
+ *
+ * @param[in] path, path of directory (e.g. /dir, not /cvmfs/repo/dir)
+ * @param[out] buf, pointer to a dynamically allocated array of entries
+ * @param[out] listlen, number of entries in the array
+ * \return 0 on success, -1 on failure (sets errno)
+ */
+int cvmfs_listdir_stat(
+  cvmfs_context *ctx,
+  const char *path,
+  struct cvmfs_listing_entry **buf,
+  size_t *listlen);
+
+/**
+ * Frees a listing returned by cvmfs_listdir_stat().
+ */
+void cvmfs_listdir_stat_free(struct cvmfs_listing_entry *buf, size_t listlen);
+
 #ifdef __cplusplus
 }
 #endif
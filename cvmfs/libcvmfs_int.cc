@@ -16,6 +16,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <google/dense_hash_map>
+#include <inttypes.h>
 #include <openssl/crypto.h>
 #include <pthread.h>
 #include <stddef.h>
@@ -70,6 +71,7 @@
 #include "sqlitevfs.h"
 #include "util/posix.h"
 #include "util/string.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
@@ -210,10 +212,14 @@ LibContext *LibContext::Create(
 LibContext::LibContext()
   : options_mgr_(NULL)
   , mount_point_(NULL)
-{ }
+{
+  atomic_init32(&num_readahead_);
+}
 
 
 LibContext::~LibContext() {
+  while (atomic_read32(&num_readahead_) > 0)
+    SafeSleepMs(10);
   delete mount_point_;
   delete options_mgr_;
 }
@@ -375,6 +381,46 @@ int LibContext::ListDirectory(
 }
 
 
+/**
+ * Retrieves the full directory entries in a single catalog query, so that
+ * callers do not need to look up every entry separately.
+ */
+int LibContext::ListDirectoryStat(
+  const char *c_path,
+  catalog::DirectoryEntryList *listing
+) {
+  perf::Inc(file_system()->n_fs_dir_open());
+  LogCvmfs(kLogCvmfs, kLogDebug, "cvmfs_listdir_stat on path: %s", c_path);
+  ClientCtxGuard ctxg(geteuid(), getegid(), getpid());
+
+  if (c_path[0] == '/' && c_path[1] == '\0') {
+    // root path is expected to be "", not "/"
+    c_path = "";
+  }
+
+  PathString path;
+  path.Assign(c_path, strlen(c_path));
+
+  catalog::DirectoryEntry d;
+  const bool found = GetDirentForPath(path, &d);
+
+  if (!found) {
+    return -ENOENT;
+  }
+
+  if (!d.IsDirectory()) {
+    return -ENOTDIR;
+  }
+
+  listing->clear();
+  if (!mount_point_->catalog_mgr()->Listing(path, listing)) {
+    return -EIO;
+  }
+
+  return 0;
+}
+
+
 int LibContext::Open(const char *c_path) {
   LogCvmfs(kLogCvmfs, kLogDebug, "cvmfs_open on path: %s", c_path);
   ClientCtxGuard ctxg(geteuid(), getegid(), getpid());
@@ -413,6 +459,11 @@ int LibContext::Open(const char *c_path) {
     return fd | kFdChunked;
   }
 
+  if (dirent.IsInlineFile())
+    mount_point_->CacheInlineFile(path, dirent);
+  else if (dirent.IsBundledFile())
+    mount_point_->CacheBundledFile(path, dirent);
+
   cvmfs::Fetcher *this_fetcher = dirent.IsExternalFile()
     ? mount_point_->external_fetcher()
     : mount_point_->fetcher();
@@ -448,81 +499,210 @@ int64_t LibContext::Pread(
   uint64_t size,
   uint64_t off)
 {
+  struct iovec iov;
+  iov.iov_base = buf;
+  iov.iov_len = size;
+  return Preadv(fd, &iov, 1, off);
+}
+
+
+int64_t LibContext::Preadv(
+  int fd,
+  const struct iovec *iov,
+  int iovcnt,
+  uint64_t off)
+{
+  if (iovcnt < 0)
+    return -EINVAL;
+
   if (fd & kFdChunked) {
     ClientCtxGuard ctxg(geteuid(), getegid(), getpid());
     const int chunk_handle = fd & ~kFdChunked;
     SimpleChunkTables::OpenChunks open_chunks =
       mount_point_->simple_chunk_tables()->Get(chunk_handle);
-    FileChunkList *chunk_list = open_chunks.chunk_reflist.list;
-    zlib::Algorithms compression_alg =
-      open_chunks.chunk_reflist.compression_alg;
-    if (chunk_list == NULL)
+    if (open_chunks.chunk_reflist.list == NULL)
       return -EBADF;
 
-    // Fetch all needed chunks and read the requested data
-    unsigned chunk_idx = open_chunks.chunk_reflist.FindChunkIdx(off);
+    MutexLockGuard guard(open_chunks.chunk_lock);
     uint64_t overall_bytes_fetched = 0;
-    off_t offset_in_chunk = off - chunk_list->AtPtr(chunk_idx)->offset();
-    do {
-      // Open file descriptor to chunk
-      ChunkFd *chunk_fd = open_chunks.chunk_fd;
-      if ((chunk_fd->fd == -1) || (chunk_fd->chunk_idx != chunk_idx)) {
-        if (chunk_fd->fd != -1) file_system()->cache_mgr()->Close(chunk_fd->fd);
-        if (open_chunks.chunk_reflist.external_data) {
-          chunk_fd->fd = mount_point_->external_fetcher()->Fetch(
-            chunk_list->AtPtr(chunk_idx)->content_hash(),
-            chunk_list->AtPtr(chunk_idx)->size(),
-            "no path info",
-            compression_alg,
-            CacheManager::kTypeRegular,
-            open_chunks.chunk_reflist.path.ToString(),
-            chunk_list->AtPtr(chunk_idx)->offset());
-        } else {
-          chunk_fd->fd = mount_point_->fetcher()->Fetch(
-            chunk_list->AtPtr(chunk_idx)->content_hash(),
-            chunk_list->AtPtr(chunk_idx)->size(),
-            "no path info",
-            compression_alg,
-            CacheManager::kTypeRegular);
-        }
-        if (chunk_fd->fd < 0) {
-          chunk_fd->fd = -1;
-          return -EIO;
-        }
-        chunk_fd->chunk_idx = chunk_idx;
-      }
+    for (int i = 0; i < iovcnt; ++i) {
+      const int64_t bytes_fetched = PreadChunked(
+        &open_chunks, iov[i].iov_base, iov[i].iov_len,
+        off + overall_bytes_fetched);
+      if (bytes_fetched < 0)
+        return (overall_bytes_fetched > 0) ? overall_bytes_fetched
+                                           : bytes_fetched;
+      overall_bytes_fetched += bytes_fetched;
+      if (static_cast<uint64_t>(bytes_fetched) < iov[i].iov_len)
+        break;
+    }
+    return overall_bytes_fetched;
+  }
+
+  uint64_t overall_bytes_fetched = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    const int64_t bytes_fetched = file_system()->cache_mgr()->Pread(
+      fd, iov[i].iov_base, iov[i].iov_len, off + overall_bytes_fetched);
+    if (bytes_fetched < 0)
+      return (overall_bytes_fetched > 0) ? overall_bytes_fetched
+                                         : bytes_fetched;
+    overall_bytes_fetched += bytes_fetched;
+    if (static_cast<uint64_t>(bytes_fetched) < iov[i].iov_len)
+      break;
+  }
+  return overall_bytes_fetched;
+}
 
-      LogCvmfs(kLogCvmfs, kLogDebug, "reading from chunk fd %d",
-               chunk_fd->fd);
-      // Read data from chunk
-      const size_t bytes_to_read = size - overall_bytes_fetched;
-      const size_t remaining_bytes_in_chunk =
-        chunk_list->AtPtr(chunk_idx)->size() - offset_in_chunk;
-      size_t bytes_to_read_in_chunk =
-        std::min(bytes_to_read, remaining_bytes_in_chunk);
-      const int64_t bytes_fetched = file_system()->cache_mgr()->Pread(
-        chunk_fd->fd,
-        reinterpret_cast<char *>(buf) + overall_bytes_fetched,
-        bytes_to_read_in_chunk,
-        offset_in_chunk);
-
-      if (bytes_fetched < 0) {
-        LogCvmfs(kLogCvmfs, kLogSyslogErr, "read err no %d (%s)",
-                 bytes_fetched,
-                 open_chunks.chunk_reflist.path.ToString().c_str());
-        return -bytes_fetched;
+
+int LibContext::FetchChunk(
+  const shash::Any &content_hash,
+  const uint64_t size,
+  const uint64_t offset,
+  const zlib::Algorithms compression_alg,
+  const bool external_data,
+  const string &path)
+{
+  if (external_data) {
+    return mount_point_->external_fetcher()->Fetch(
+      content_hash,
+      size,
+      "no path info",
+      compression_alg,
+      CacheManager::kTypeRegular,
+      path,
+      offset);
+  }
+  return mount_point_->fetcher()->Fetch(
+    content_hash,
+    size,
+    "no path info",
+    compression_alg,
+    CacheManager::kTypeRegular);
+}
+
+
+/**
+ * The caller holds the chunk lock of the handle.
+ */
+int64_t LibContext::PreadChunked(
+  SimpleChunkTables::OpenChunks *open_chunks,
+  void *buf,
+  uint64_t size,
+  uint64_t off)
+{
+  FileChunkList *chunk_list = open_chunks->chunk_reflist.list;
+  if (size == 0)
+    return 0;
+
+  // Fetch all needed chunks and read the requested data
+  unsigned chunk_idx = open_chunks->chunk_reflist.FindChunkIdx(off);
+  uint64_t overall_bytes_fetched = 0;
+  off_t offset_in_chunk = off - chunk_list->AtPtr(chunk_idx)->offset();
+  bool chunk_switched = false;
+  do {
+    // Open file descriptor to chunk
+    ChunkFd *chunk_fd = open_chunks->chunk_fd;
+    if ((chunk_fd->fd == -1) || (chunk_fd->chunk_idx != chunk_idx)) {
+      if (chunk_fd->fd != -1) file_system()->cache_mgr()->Close(chunk_fd->fd);
+      chunk_fd->fd = FetchChunk(
+        chunk_list->AtPtr(chunk_idx)->content_hash(),
+        chunk_list->AtPtr(chunk_idx)->size(),
+        chunk_list->AtPtr(chunk_idx)->offset(),
+        open_chunks->chunk_reflist.compression_alg,
+        open_chunks->chunk_reflist.external_data,
+        open_chunks->chunk_reflist.path.ToString());
+      if (chunk_fd->fd < 0) {
+        chunk_fd->fd = -1;
+        return -EIO;
       }
-      overall_bytes_fetched += bytes_fetched;
+      chunk_fd->chunk_idx = chunk_idx;
+      chunk_switched = true;
+    }
 
-      // Proceed to the next chunk to keep on reading data
-      ++chunk_idx;
-      offset_in_chunk = 0;
-    } while ((overall_bytes_fetched < size) &&
-             (chunk_idx < chunk_list->size()));
-    return overall_bytes_fetched;
-  } else {
-    return file_system()->cache_mgr()->Pread(fd, buf, size, off);
+    LogCvmfs(kLogCvmfs, kLogDebug, "reading from chunk fd %d",
+             chunk_fd->fd);
+    // Read data from chunk
+    const size_t bytes_to_read = size - overall_bytes_fetched;
+    const size_t remaining_bytes_in_chunk =
+      chunk_list->AtPtr(chunk_idx)->size() - offset_in_chunk;
+    size_t bytes_to_read_in_chunk =
+      std::min(bytes_to_read, remaining_bytes_in_chunk);
+    const int64_t bytes_fetched = file_system()->cache_mgr()->Pread(
+      chunk_fd->fd,
+      reinterpret_cast<char *>(buf) + overall_bytes_fetched,
+      bytes_to_read_in_chunk,
+      offset_in_chunk);
+
+    if (bytes_fetched < 0) {
+      LogCvmfs(kLogCvmfs, kLogSyslogErr, "read err no %" PRId64 " (%s)",
+               bytes_fetched,
+               open_chunks->chunk_reflist.path.ToString().c_str());
+      return bytes_fetched;
+    }
+    overall_bytes_fetched += bytes_fetched;
+
+    // Proceed to the next chunk to keep on reading data
+    ++chunk_idx;
+    offset_in_chunk = 0;
+  } while ((overall_bytes_fetched < size) &&
+           (chunk_idx < chunk_list->size()));
+
+  if (chunk_switched)
+    Readahead(open_chunks->chunk_reflist, chunk_idx);
+  return overall_bytes_fetched;
+}
+
+
+void LibContext::Readahead(
+  const FileChunkReflist &chunk_reflist,
+  const unsigned chunk_idx)
+{
+  if (chunk_idx >= chunk_reflist.list->size())
+    return;
+  if (atomic_xadd32(&num_readahead_, 1) >= kMaxReadahead) {
+    atomic_dec32(&num_readahead_);
+    return;
+  }
+
+  ReadaheadJob *job = new ReadaheadJob();
+  job->ctx = this;
+  job->content_hash = chunk_reflist.list->AtPtr(chunk_idx)->content_hash();
+  job->size = chunk_reflist.list->AtPtr(chunk_idx)->size();
+  job->offset = chunk_reflist.list->AtPtr(chunk_idx)->offset();
+  job->compression_alg = chunk_reflist.compression_alg;
+  job->external_data = chunk_reflist.external_data;
+  job->path = chunk_reflist.path.ToString();
+  ClientCtx::GetInstance()->Get(&job->uid, &job->gid, &job->pid);
+
+  pthread_t thread_readahead;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int retval = pthread_create(&thread_readahead, &attr, MainReadahead, job);
+  pthread_attr_destroy(&attr);
+  if (retval != 0) {
+    delete job;
+    atomic_dec32(&num_readahead_);
+  }
+}
+
+
+void *LibContext::MainReadahead(void *data) {
+  ReadaheadJob *job = reinterpret_cast<ReadaheadJob *>(data);
+  LibContext *ctx = job->ctx;
+  {
+    ClientCtxGuard ctxg(job->uid, job->gid, job->pid);
+    int fd = ctx->FetchChunk(job->content_hash, job->size, job->offset,
+                             job->compression_alg, job->external_data,
+                             job->path);
+    LogCvmfs(kLogCvmfs, kLogDebug, "readahead of chunk %s: %d",
+             job->content_hash.ToString().c_str(), fd);
+    if (fd >= 0)
+      ctx->file_system()->cache_mgr()->Close(fd);
   }
+  delete job;
+  atomic_dec32(&ctx->num_readahead_);
+  return NULL;
 }
 
 
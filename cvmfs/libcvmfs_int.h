@@ -13,6 +13,7 @@
 #ifndef CVMFS_LIBCVMFS_INT_H_
 #define CVMFS_LIBCVMFS_INT_H_
 
+#include <sys/uio.h>
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
@@ -20,6 +21,7 @@
 #include <string>
 #include <vector>
 
+#include "atomic.h"
 #include "backoff.h"
 #include "catalog_mgr.h"
 #include "file_chunk.h"
@@ -99,9 +101,17 @@ class LibContext : SingleCopy {
   int GetAttr(const char *c_path, struct stat *info);
   int Readlink(const char *path, char *buf, size_t size);
   int ListDirectory(const char *path, char ***buf, size_t *buflen);
+  int ListDirectoryStat(const char *c_path,
+                        catalog::DirectoryEntryList *listing);
 
+  /**
+   * Open, Pread, Preadv, and Close can be used concurrently by many threads.
+   * Reads of the same chunked file are serialized because they share the
+   * file descriptor of the current chunk.
+   */
   int Open(const char *c_path);
   int64_t Pread(int fd, void *buf, uint64_t size, uint64_t off);
+  int64_t Preadv(int fd, const struct iovec *iov, int iovcnt, uint64_t off);
   int Close(int fd);
 
   MountPoint *mount_point() { return mount_point_; }
@@ -112,6 +122,30 @@ class LibContext : SingleCopy {
    * File descriptors of chunked files have bit 30 set.
    */
   static const int kFdChunked = 1 << 30;
+  /**
+   * Upper bound on the number of chunks that are fetched in the background
+   * at the same time.
+   */
+  static const int kMaxReadahead = 4;
+
+  /**
+   * Entering a chunk of a chunked file triggers fetching the next chunk in a
+   * detached thread, so that sequential readers find it in the cache.
+   */
+  struct ReadaheadJob {
+    LibContext *ctx;
+    shash::Any content_hash;
+    uint64_t size;
+    uint64_t offset;
+    zlib::Algorithms compression_alg;
+    bool external_data;
+    std::string path;
+    uid_t uid;
+    gid_t gid;
+    pid_t pid;
+  };
+  static void *MainReadahead(void *data);
+
   /**
    * use static method Create() for construction
    */
@@ -124,6 +158,16 @@ class LibContext : SingleCopy {
                           size_t       *buflen);
   bool GetDirentForPath(const PathString         &path,
                         catalog::DirectoryEntry  *dirent);
+  int FetchChunk(const shash::Any &content_hash,
+                 const uint64_t size,
+                 const uint64_t offset,
+                 const zlib::Algorithms compression_alg,
+                 const bool external_data,
+                 const std::string &path);
+  int64_t PreadChunked(SimpleChunkTables::OpenChunks *open_chunks,
+                       void *buf, uint64_t size, uint64_t off);
+  void Readahead(const FileChunkReflist &chunk_reflist,
+                 const unsigned chunk_idx);
 
   /**
    * Only non-NULL if cvmfs_attache_repo is used for initialization.  In this
@@ -131,6 +175,10 @@ class LibContext : SingleCopy {
    */
   OptionsManager *options_mgr_;
   MountPoint *mount_point_;
+  /**
+   * Number of running readahead threads.  The destructor waits for them.
+   */
+  atomic_int32 num_readahead_;
 };
 
 #endif  // CVMFS_LIBCVMFS_INT_H_
@@ -22,6 +22,7 @@
 #include <fuse/fuse_lowlevel.h>
 #include <fuse/fuse_opt.h>
 #include <openssl/crypto.h>
+#include <pthread.h>
 #include <sched.h>
 #include <signal.h>
 #include <stddef.h>
@@ -48,6 +49,7 @@
 #include "options.h"
 #include "platform.h"
 #include "sanitizer.h"
+#include "smalloc.h"
 #include "util/posix.h"
 #include "util/string.h"
 
@@ -124,6 +126,12 @@ string *usyslog_path_ = NULL;
 uid_t uid_ = 0;
 gid_t gid_ = 0;
 bool single_threaded_ = false;
+unsigned num_fuse_workers_ = 0;
+/**
+ * Upper limit for CVMFS_FUSE_THREADS.  Every worker has its own channel buffer
+ * of the size of the largest fuse request.
+ */
+const unsigned kMaxFuseWorkers = 256;
 bool foreground_ = false;
 bool debug_mode_ = false;
 bool grab_mountpoint_ = false;
@@ -570,6 +578,121 @@ static unsigned long CallbackLibcryptoThreadId() {  // NOLINT(runtime/int)
 
 #endif
 
+/**
+ * A fixed set of threads that process fuse requests.  Unlike the libfuse
+ * multi-threaded loop, the workers are started once and are never torn
+ * down and recreated under load, and their request counters are exported to
+ * the fuse module.  All workers read from the same fuse channel.
+ */
+struct FuseWorker {
+  FuseWorker() : session(NULL), channel(NULL), buffer(NULL), n_requests(NULL),
+                 pipe_exit(-1) { }
+  pthread_t thread;
+  struct fuse_session *session;
+  struct fuse_chan *channel;
+  char *buffer;
+  atomic_int64 *n_requests;
+  int pipe_exit;
+};
+
+
+#if FUSE_VERSION >= 29
+static void *MainFuseWorker(void *data) {
+  FuseWorker *worker = reinterpret_cast<FuseWorker *>(data);
+  const size_t buffer_size = fuse_chan_bufsize(worker->channel);
+  while (!fuse_session_exited(worker->session)) {
+    struct fuse_chan *channel = worker->channel;
+    struct fuse_buf buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.mem = worker->buffer;
+    buf.size = buffer_size;
+    // The worker is only canceled while it waits for a request
+    int retval = fuse_session_receive_buf(worker->session, &buf, &channel);
+    if (retval == -EINTR)
+      continue;
+    if (retval <= 0)
+      break;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    fuse_session_process_buf(worker->session, &buf, channel);
+    atomic_inc64(worker->n_requests);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+  }
+
+  // Unmounted or failed, wake up the main thread
+  fuse_session_exit(worker->session);
+  char c = 'Q';
+  WritePipe(worker->pipe_exit, &c, 1);
+  return NULL;
+}
+#endif
+
+
+/**
+ * Runs the fuse session with num_fuse_workers_ threads.  Signals are handled
+ * by the calling thread, which terminates the workers once the session exits.
+ */
+static int RunFuseWorkers(struct fuse_session *session,
+                          struct fuse_chan *channel)
+{
+#if FUSE_VERSION >= 29
+  int pipe_exit[2];
+  MakePipe(pipe_exit);
+  std::vector<FuseWorker> workers(num_fuse_workers_);
+  const size_t buffer_size = fuse_chan_bufsize(channel);
+
+  sigset_t sigset_all;
+  sigset_t sigset_saved;
+  sigfillset(&sigset_all);
+  pthread_sigmask(SIG_BLOCK, &sigset_all, &sigset_saved);
+  unsigned num_started = 0;
+  for (; num_started < num_fuse_workers_; ++num_started) {
+    FuseWorker *worker = &workers[num_started];
+    worker->session = session;
+    worker->channel = channel;
+    worker->buffer = static_cast<char *>(smalloc(buffer_size));
+    worker->n_requests =
+      &loader_exports_->fuse_worker_requests[num_started];
+    worker->pipe_exit = pipe_exit[1];
+    int retval =
+      pthread_create(&worker->thread, NULL, MainFuseWorker, worker);
+    if (retval != 0) {
+      free(worker->buffer);
+      LogCvmfs(kLogCvmfs, kLogSyslogErr,
+               "failed to start fuse worker %u (%d)", num_started, retval);
+      break;
+    }
+  }
+  pthread_sigmask(SIG_SETMASK, &sigset_saved, NULL);
+
+  if (num_started == 0) {
+    ClosePipe(pipe_exit);
+    return fuse_session_loop_mt(session);
+  }
+
+  LogCvmfs(kLogCvmfs, kLogDebug, "started %u fuse workers", num_started);
+  // Interrupted by the signal handlers installed by libfuse
+  while (!fuse_session_exited(session)) {
+    char c;
+    if (read(pipe_exit[0], &c, 1) == 1)
+      break;
+  }
+  fuse_session_exit(session);
+
+  for (unsigned i = 0; i < num_started; ++i)
+    pthread_cancel(workers[i].thread);
+  for (unsigned i = 0; i < num_started; ++i) {
+    pthread_join(workers[i].thread, NULL);
+    free(workers[i].buffer);
+  }
+  ClosePipe(pipe_exit);
+  fuse_session_reset(session);
+  return 0;
+#else
+  return fuse_session_loop_mt(session);
+#endif
+}
+
+
 static void SetupLibcryptoMt() {
 #ifndef OPENSSL_API_INTERFACE_V11
   gLibcryptoLocks = static_cast<pthread_mutex_t *>(OPENSSL_malloc(
@@ -767,6 +890,27 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if (options_manager->GetValue("CVMFS_FUSE_THREADS", &parameter)) {
+    const uint64_t num_fuse_workers = String2Uint64(parameter);
+    if (num_fuse_workers > kMaxFuseWorkers) {
+      LogCvmfs(kLogCvmfs, kLogStdout | kLogSyslogWarn,
+               "CVMFS_FUSE_THREADS limited to %u", kMaxFuseWorkers);
+      num_fuse_workers_ = kMaxFuseWorkers;
+    } else {
+      num_fuse_workers_ = num_fuse_workers;
+    }
+#if FUSE_VERSION < 29
+    num_fuse_workers_ = 0;
+#endif
+    if (num_fuse_workers_ > 0) {
+      loader_exports_->num_fuse_workers = num_fuse_workers_;
+      loader_exports_->fuse_worker_requests =
+        new atomic_int64[num_fuse_workers_];
+      for (unsigned i = 0; i < num_fuse_workers_; ++i)
+        atomic_init64(&loader_exports_->fuse_worker_requests[i]);
+    }
+  }
+
   // Apply OOM score adjustment
   if (options_manager->GetValue("CVMFS_OOM_SCORE_ADJ", &parameter)) {
     string proc_path = "/proc/" + StringifyInt(getpid()) + "/oom_score_adj";
@@ -934,6 +1078,8 @@ int main(int argc, char *argv[]) {
   fuse_session_add_chan(session, channel);
   if (single_threaded_)
     retval = fuse_session_loop(session);
+  else if (num_fuse_workers_ > 0)
+    retval = RunFuseWorkers(session, channel);
   else
     retval = fuse_session_loop_mt(session);
   SetLogMicroSyslog(*usyslog_path_);
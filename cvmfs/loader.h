@@ -16,6 +16,8 @@
 #include <string>
 #include <vector>
 
+#include "atomic.h"
+
 namespace loader {
 
 extern std::string *usyslog_path_;
@@ -101,7 +103,10 @@ enum StateId {
   kStateOpenChunksV2,       // >= 2.1.20
   kStateOpenChunksV3,       // >= 2.2.0
   kStateOpenChunksV4,       // >= 2.2.3
-  kStateOpenFiles           // >= 2.4
+  kStateOpenFiles,          // >= 2.4
+  kStateGlueBufferV5,       // >= 2.5
+  kStateOpenDirStreams,     // >= 2.5
+  kStateOpenChunksV5        // >= 2.5
 
   // Note: kStateOpenFilesXXX was renamed to kStateOpenChunksXXX as of 2.4
 };
@@ -151,18 +156,21 @@ typedef std::vector<LoadEvent *> EventList;
  */
 struct LoaderExports {
   LoaderExports() :
-    version(4),
+    version(5),
     size(sizeof(LoaderExports)),
     boot_time(0),
     foreground(false),
     disable_watchdog(false),
     simple_options_parsing(false),
-    fuse_channel(NULL)
+    fuse_channel(NULL),
+    num_fuse_workers(0),
+    fuse_worker_requests(NULL)
   { }
 
   ~LoaderExports() {
     for (unsigned i = 0; i < history.size(); ++i)
       delete history[i];
+    delete[] fuse_worker_requests;
   }
 
   uint32_t version;
@@ -185,6 +193,14 @@ struct LoaderExports {
 
   // added with CernVM-FS 2.4.0 (LoaderExports Version: 4)
   struct fuse_chan **fuse_channel;
+
+  // added with CernVM-FS 2.5.0 (LoaderExports Version: 5)
+  /**
+   * Number of requests processed by each of the loader's fuse worker threads.
+   * Zero workers if the libfuse multi-threaded loop is used.
+   */
+  unsigned num_fuse_workers;
+  atomic_int64 *fuse_worker_requests;
 };
 
 
@@ -26,6 +26,7 @@
 #include <cstring>
 #include <ctime>
 
+#include "atomic.h"
 #include "platform.h"
 #include "smalloc.h"
 #include "util/posix.h"
@@ -63,6 +64,15 @@ int syslog_facility = LOG_USER;
 int syslog_level = LOG_NOTICE;
 char *syslog_prefix = NULL;
 
+/**
+ * Syslog messages per interval (in seconds), 0 for no limit
+ */
+unsigned syslog_rate_limit = 0;
+unsigned syslog_rate_interval = 60;
+atomic_int64 syslog_window_start = 0;
+atomic_int32 syslog_window_count = 0;
+atomic_int32 syslog_suppressed = 0;
+
 string *usyslog_dest = NULL;
 int usyslog_fd = -1;
 int usyslog_fd1 = -1;
@@ -189,6 +199,23 @@ void SetLogSyslogPrefix(const std::string &prefix) {
   }
 }
 
+/**
+ * Limits the number of syslog messages to max_messages per interval seconds.
+ * Further messages in the same interval are dropped and counted.  The next
+ * message that passes is preceded by the number of dropped messages.  If
+ * max_messages is 0, all messages are logged.
+ */
+void SetLogSyslogRateLimit(const unsigned max_messages,
+                           const unsigned interval)
+{
+  assert(interval > 0);
+  syslog_rate_limit = max_messages;
+  syslog_rate_interval = interval;
+  atomic_write64(&syslog_window_start, 0);
+  atomic_write32(&syslog_window_count, 0);
+  atomic_write32(&syslog_suppressed, 0);
+}
+
 void SetLogSyslogShowPID(bool flag) {
   openlog(NULL, flag ? LOG_PID : 0, GetLogSyslogFacility());
 }
@@ -345,6 +372,64 @@ void SetAltLogFunc(void (*fn)(const LogSource source, const int mask,
 }
 
 
+/**
+ * Lock-free accounting of the syslog rate limit.  The interval starts with the
+ * first message after the previous interval ended.  Concurrent messages at the
+ * interval boundary might be counted in either interval.
+ *
+ * @param[out] num_suppressed  messages dropped since the last logged message
+ * @return true if the message should be dropped
+ */
+static bool IsSyslogThrottled(int32_t *num_suppressed) {
+  *num_suppressed = 0;
+  if (syslog_rate_limit == 0)
+    return false;
+
+  const int64_t now = time(NULL);
+  const int64_t window_start = atomic_read64(&syslog_window_start);
+  if ((now - window_start >= static_cast<int64_t>(syslog_rate_interval)) &&
+      atomic_cas64(&syslog_window_start, window_start, now))
+  {
+    atomic_write32(&syslog_window_count, 0);
+  }
+
+  const int32_t count = atomic_xadd32(&syslog_window_count, 1);
+  if (count >= static_cast<int32_t>(syslog_rate_limit)) {
+    atomic_inc32(&syslog_suppressed);
+    return true;
+  }
+
+  *num_suppressed = atomic_read32(&syslog_suppressed);
+  if (*num_suppressed > 0)
+    atomic_xadd32(&syslog_suppressed, -(*num_suppressed));
+  return false;
+}
+
+
+static void LogSyslog(const int mask, const char *msg) {
+  if (usyslog_dest) {
+    string fmt_msg(msg);
+    if (syslog_prefix) fmt_msg = "(" + string(syslog_prefix) + ") " + fmt_msg;
+    time_t rawtime;
+    time(&rawtime);
+    char fmt_time[26];
+    ctime_r(&rawtime, fmt_time);
+    fmt_msg = string(fmt_time, 24) + " " + fmt_msg;
+    fmt_msg.push_back('\n');
+    LogMicroSyslog(fmt_msg);
+  } else {
+    int level = syslog_level;
+    if (mask & kLogSyslogWarn) level = LOG_WARNING;
+    if (mask & kLogSyslogErr) level = LOG_ERR;
+    if (syslog_prefix) {
+      syslog(syslog_facility | level, "(%s) %s", syslog_prefix, msg);
+    } else {
+      syslog(syslog_facility | level, "%s", msg);
+    }
+  }
+}
+
+
 /**
  * Logs a message to one or multiple facilities specified by mask.
  * Mask can be extended by a log level in the future, using the higher bits.
@@ -419,25 +504,16 @@ void LogCvmfs(const LogSource source, const int mask, const char *format, ...) {
   }
 
   if (mask & (kLogSyslog | kLogSyslogWarn | kLogSyslogErr)) {
-    if (usyslog_dest) {
-      string fmt_msg(msg);
-      if (syslog_prefix) fmt_msg = "(" + string(syslog_prefix) + ") " + fmt_msg;
-      time_t rawtime;
-      time(&rawtime);
-      char fmt_time[26];
-      ctime_r(&rawtime, fmt_time);
-      fmt_msg = string(fmt_time, 24) + " " + fmt_msg;
-      fmt_msg.push_back('\n');
-      LogMicroSyslog(fmt_msg);
-    } else {
-      int level = syslog_level;
-      if (mask & kLogSyslogWarn) level = LOG_WARNING;
-      if (mask & kLogSyslogErr) level = LOG_ERR;
-      if (syslog_prefix) {
-        syslog(syslog_facility | level, "(%s) %s", syslog_prefix, msg);
-      } else {
-        syslog(syslog_facility | level, "%s", msg);
+    int32_t num_suppressed = 0;
+    // Errors are never dropped, they often precede an abort()
+    if ((mask & kLogSyslogErr) || !IsSyslogThrottled(&num_suppressed)) {
+      if (num_suppressed > 0) {
+        char msg_suppressed[64];
+        snprintf(msg_suppressed, sizeof(msg_suppressed),
+                 "%d messages suppressed by the rate limit", num_suppressed);
+        LogSyslog(mask, msg_suppressed);
       }
+      LogSyslog(mask, msg);
     }
   }
 
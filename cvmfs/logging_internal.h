@@ -91,6 +91,8 @@ void SetLogMicroSyslog(const std::string &filename);
 std::string GetLogMicroSyslog();
 void SetLogSyslogPrefix(const std::string &prefix);
 void SetLogSyslogShowPID(bool flag);
+void SetLogSyslogRateLimit(const unsigned max_messages,
+                           const unsigned interval);
 void SetLogVerbosity(const LogLevels min_level);
 void LogShutdown();
 
@@ -47,6 +47,7 @@
 #include <functional>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "atomic.h"
 #include "platform.h"
@@ -517,19 +518,8 @@ class LruCache : SingleCopy {
     allocator_(cache_size),
     lru_list_(&allocator_)
   {
-    assert(cache_size > 0);
-
     counters_.sz_size->Set(cache_size_);
-    filter_entry_ = NULL;
-    // cache_ = Cache(cache_size_);
-    cache_.Init(cache_size_, empty_key, hasher);
-    perf::Xadd(counters_.sz_allocated, allocator_.bytes_allocated() +
-                  cache_.bytes_allocated());
-
-#ifdef LRU_CACHE_THREAD_SAFE
-    int retval = pthread_mutex_init(&lock_, NULL);
-    assert(retval == 0);
-#endif
+    Init(empty_key, hasher);
   }
 
   static double GetEntrySize() {
@@ -701,9 +691,8 @@ class LruCache : SingleCopy {
     lru_list_.clear();
     cache_.Clear();
     perf::Inc(counters_.n_drop);
-    counters_.sz_allocated->Set(0);
-    perf::Xadd(counters_.sz_allocated, allocator_.bytes_allocated() +
-                  cache_.bytes_allocated());
+    // The hash table and the list entries are preallocated, so sz_allocated
+    // does not change
 
     this->Unlock();
   }
@@ -793,9 +782,42 @@ class LruCache : SingleCopy {
   }
 
  protected:
+  /**
+   * Used for the shards of a ShardedLruCache.  The shards share the counters
+   * of the sharded cache.
+   */
+  LruCache(const unsigned   cache_size,
+           const Key       &empty_key,
+           uint32_t (*hasher)(const Key &key),
+           const Counters  &counters) :
+    counters_(counters),
+    pause_(false),
+    cache_gauge_(0),
+    cache_size_(cache_size),
+    allocator_(cache_size),
+    lru_list_(&allocator_)
+  {
+    Init(empty_key, hasher);
+  }
+
   Counters counters_;
 
  private:
+  void Init(const Key &empty_key, uint32_t (*hasher)(const Key &key)) {
+    assert(cache_size_ > 0);
+
+    filter_entry_ = NULL;
+    // cache_ = Cache(cache_size_);
+    cache_.Init(cache_size_, empty_key, hasher);
+    perf::Xadd(counters_.sz_allocated, allocator_.bytes_allocated() +
+                  cache_.bytes_allocated());
+
+#ifdef LRU_CACHE_THREAD_SAFE
+    int retval = pthread_mutex_init(&lock_, NULL);
+    assert(retval == 0);
+#endif
+  }
+
   /**
    *  this just performs a lookup in the cache
    *  WITHOUT changing the LRU order
@@ -871,6 +893,180 @@ class LruCache : SingleCopy {
 #endif
 };  // class LruCache
 
+
+/**
+ * An LRU cache for the meta-data caches that are hit by many threads in
+ * parallel.  The keys are distributed over independent LruCache shards, each
+ * with its own lock, so that concurrent lookups of different keys rarely
+ * contend.  The replacement order is least recently used per shard.
+ *
+ * The shards are selected by the lower bits of the hash value.  The hash
+ * tables of the shards scale the full hash value to their buckets, so that
+ * the keys of a shard still spread over all the buckets.
+ *
+ * The shards share the counters of the sharded cache.  Filter operations lock
+ * all the shards and iterate them one after another.
+ */
+template<class Key, class Value>
+class ShardedLruCache : SingleCopy {
+ public:
+  static const unsigned kMaxShards = 16;
+  /**
+   * Small caches use fewer shards.
+   */
+  static const unsigned kMinShardSize = 1024;
+
+  ShardedLruCache(const unsigned   cache_size,
+                  const Key       &empty_key,
+                  uint32_t (*hasher)(const Key &key),
+                  perf::StatisticsTemplate statistics) :
+    counters_(statistics),
+    hasher_(hasher),
+    filter_shard_(0)
+  {
+    assert(cache_size > 0);
+    unsigned num_shards = kMaxShards;
+    while ((num_shards > 1) && (cache_size / num_shards < kMinShardSize))
+      num_shards /= 2;
+    // The memory allocator of the shards requires a multiple of 64 entries
+    const unsigned shard_size = (cache_size / num_shards) & ~63U;
+
+    counters_.n_hit->MakeSharded();
+    counters_.n_miss->MakeSharded();
+    counters_.sz_size->Set(num_shards * shard_size);
+    // The shards must not change the counters that describe the entire cache
+    Counters shard_counters(counters_);
+    shard_counters.sz_size = &shard_dummy_size_;
+    shard_counters.n_drop = &shard_dummy_drop_;
+    for (unsigned i = 0; i < num_shards; ++i) {
+      shards_.push_back(
+        new Shard(shard_size, empty_key, hasher, shard_counters));
+    }
+  }
+
+  static double GetEntrySize() {
+    return LruCache<Key, Value>::GetEntrySize();
+  }
+
+  virtual ~ShardedLruCache() {
+    for (unsigned i = 0; i < shards_.size(); ++i)
+      delete shards_[i];
+  }
+
+  virtual bool Insert(const Key &key, const Value &value) {
+    return GetShard(key)->Insert(key, value);
+  }
+
+  virtual void Update(const Key &key) {
+    GetShard(key)->Update(key);
+  }
+
+  virtual bool UpdateValue(const Key &key, const Value &value) {
+    return GetShard(key)->UpdateValue(key, value);
+  }
+
+  virtual bool Lookup(const Key &key, Value *value, bool update_lru = true) {
+    return GetShard(key)->Lookup(key, value, update_lru);
+  }
+
+  virtual bool Forget(const Key &key) {
+    return GetShard(key)->Forget(key);
+  }
+
+  virtual void Drop() {
+    for (unsigned i = 0; i < shards_.size(); ++i)
+      shards_[i]->Drop();
+    perf::Inc(counters_.n_drop);
+  }
+
+  void Pause() {
+    for (unsigned i = 0; i < shards_.size(); ++i)
+      shards_[i]->Pause();
+  }
+
+  void Resume() {
+    for (unsigned i = 0; i < shards_.size(); ++i)
+      shards_[i]->Resume();
+  }
+
+  bool IsEmpty() const {
+    for (unsigned i = 0; i < shards_.size(); ++i) {
+      if (!shards_[i]->IsEmpty())
+        return false;
+    }
+    return true;
+  }
+
+  unsigned num_shards() const { return shards_.size(); }
+
+  Counters counters() {
+    counters_.num_collisions = 0;
+    counters_.max_collisions = 0;
+    for (unsigned i = 0; i < shards_.size(); ++i) {
+      Counters shard_counters = shards_[i]->counters();
+      counters_.num_collisions += shard_counters.num_collisions;
+      counters_.max_collisions =
+        std::max(counters_.max_collisions, shard_counters.max_collisions);
+    }
+    return counters_;
+  }
+
+  /**
+   * Locks all the shards for the duration of the filter operation.
+   */
+  virtual void FilterBegin() {
+    for (unsigned i = 0; i < shards_.size(); ++i)
+      shards_[i]->FilterBegin();
+    filter_shard_ = 0;
+  }
+
+  virtual void FilterGet(Key *key, Value *value) {
+    shards_[filter_shard_]->FilterGet(key, value);
+  }
+
+  virtual bool FilterNext() {
+    while (filter_shard_ < shards_.size()) {
+      if (shards_[filter_shard_]->FilterNext())
+        return true;
+      filter_shard_++;
+    }
+    return false;
+  }
+
+  virtual void FilterDelete() {
+    shards_[filter_shard_]->FilterDelete();
+  }
+
+  virtual void FilterEnd() {
+    for (unsigned i = 0; i < shards_.size(); ++i)
+      shards_[i]->FilterEnd();
+  }
+
+ protected:
+  Counters counters_;
+
+ private:
+  class Shard : public LruCache<Key, Value> {
+   public:
+    Shard(const unsigned   cache_size,
+          const Key       &empty_key,
+          uint32_t (*hasher)(const Key &key),
+          const Counters  &counters)
+      : LruCache<Key, Value>(cache_size, empty_key, hasher, counters)
+    { }
+  };
+
+  inline Shard *GetShard(const Key &key) {
+    return shards_[hasher_(key) % shards_.size()];
+  }
+
+  uint32_t (*hasher_)(const Key &key);
+  std::vector<Shard *> shards_;
+  unsigned filter_shard_;
+  perf::Counter shard_dummy_size_;
+  perf::Counter shard_dummy_drop_;
+};  // class ShardedLruCache
+
 }  // namespace lru
 
 #endif  // CVMFS_LRU_H_
@@ -17,11 +17,13 @@
 
 #include "atomic.h"
 #include "directory_entry.h"
+#include "file_chunk.h"
 #include "hash.h"
 #include "logging.h"
 #include "lru.h"
 #include "murmur.h"
 #include "shortstring.h"
+#include "xattr.h"
 
 
 namespace lru {
@@ -35,33 +37,50 @@ static inline uint32_t hasher_md5(const shash::Md5 &key) {
 static inline uint32_t hasher_inode(const fuse_ino_t &inode) {
   return MurmurHash2(&inode, sizeof(inode), 0x07387a4f);
 }
+
+static inline uint32_t hasher_any(const shash::Any &key) {
+  // Don't start with the first bytes, because == is using them as well
+  return (uint32_t) *(reinterpret_cast<const uint32_t *>(key.digest) + 1);
+}
 // uint32_t hasher_md5(const shash::Md5 &key);
 // uint32_t hasher_inode(const fuse_ino_t &inode);
 
 
-class InodeCache : public LruCache<fuse_ino_t, catalog::DirectoryEntry>
+class InodeCache :
+  public ShardedLruCache<fuse_ino_t, catalog::DirectoryEntryCompact>
 {
  public:
   explicit InodeCache(unsigned int cache_size, perf::Statistics *statistics) :
-    LruCache<fuse_ino_t, catalog::DirectoryEntry>(
+    ShardedLruCache<fuse_ino_t, catalog::DirectoryEntryCompact>(
       cache_size, fuse_ino_t(-1), hasher_inode,
       perf::StatisticsTemplate("inode_cache", statistics))
   {
   }
 
+  static double GetEntrySize() {
+    return ShardedLruCache<fuse_ino_t,
+                           catalog::DirectoryEntryCompact>::GetEntrySize() +
+           catalog::DirectoryEntryCompact::kAverageSize;
+  }
+
   bool Insert(const fuse_ino_t &inode, const catalog::DirectoryEntry &dirent) {
     LogCvmfs(kLogLru, kLogDebug, "insert inode --> dirent: %u -> '%s'",
              inode, dirent.name().c_str());
     const bool result =
-      LruCache<fuse_ino_t, catalog::DirectoryEntry>::Insert(inode, dirent);
+      ShardedLruCache<fuse_ino_t, catalog::DirectoryEntryCompact>::Insert(
+        inode, catalog::DirectoryEntryCompact(dirent));
     return result;
   }
 
   bool Lookup(const fuse_ino_t &inode, catalog::DirectoryEntry *dirent,
               bool update_lru = true)
   {
+    catalog::DirectoryEntryCompact compact;
     const bool result =
-      LruCache<fuse_ino_t, catalog::DirectoryEntry>::Lookup(inode, dirent);
+      ShardedLruCache<fuse_ino_t, catalog::DirectoryEntryCompact>::Lookup(
+        inode, &compact);
+    if (result)
+      compact.Expand(dirent);
     LogCvmfs(kLogLru, kLogDebug, "lookup inode --> dirent: %u (%s)",
              inode, result ? "hit" : "miss");
     return result;
@@ -69,15 +88,16 @@ class InodeCache : public LruCache<fuse_ino_t, catalog::DirectoryEntry>
 
   void Drop() {
     LogCvmfs(kLogLru, kLogDebug, "dropping inode cache");
-    LruCache<fuse_ino_t, catalog::DirectoryEntry>::Drop();
+    ShardedLruCache<fuse_ino_t, catalog::DirectoryEntryCompact>::Drop();
   }
 };  // InodeCache
 
 
-class PathCache : public LruCache<fuse_ino_t, PathString> {
+class PathCache : public ShardedLruCache<fuse_ino_t, PathString> {
  public:
   explicit PathCache(unsigned int cache_size, perf::Statistics *statistics) :
-    LruCache<fuse_ino_t, PathString>(cache_size, fuse_ino_t(-1), hasher_inode,
+    ShardedLruCache<fuse_ino_t, PathString>(
+      cache_size, fuse_ino_t(-1), hasher_inode,
       perf::StatisticsTemplate("path_cache", statistics))
   {
   }
@@ -86,7 +106,7 @@ class PathCache : public LruCache<fuse_ino_t, PathString> {
     LogCvmfs(kLogLru, kLogDebug, "insert inode --> path %u -> '%s'",
              inode, path.c_str());
     const bool result =
-      LruCache<fuse_ino_t, PathString>::Insert(inode, path);
+      ShardedLruCache<fuse_ino_t, PathString>::Insert(inode, path);
     return result;
   }
 
@@ -94,7 +114,7 @@ class PathCache : public LruCache<fuse_ino_t, PathString> {
               bool update_lru = true)
   {
     const bool found =
-      LruCache<fuse_ino_t, PathString>::Lookup(inode, path);
+      ShardedLruCache<fuse_ino_t, PathString>::Lookup(inode, path);
     LogCvmfs(kLogLru, kLogDebug, "lookup inode --> path: %u (%s)",
              inode, found ? "hit" : "miss");
     return found;
@@ -102,33 +122,133 @@ class PathCache : public LruCache<fuse_ino_t, PathString> {
 
   void Drop() {
     LogCvmfs(kLogLru, kLogDebug, "dropping path cache");
-    LruCache<fuse_ino_t, PathString>::Drop();
+    ShardedLruCache<fuse_ino_t, PathString>::Drop();
   }
 };  // PathCache
 
 
+/**
+ * Keeps the parsed extended attributes of the inodes that have custom extended
+ * attributes in their catalog, so that getxattr() and listxattr() on such an
+ * inode do not need to query and deserialize them again.
+ */
+class XattrCache : public ShardedLruCache<fuse_ino_t, XattrList> {
+ public:
+  explicit XattrCache(unsigned int cache_size, perf::Statistics *statistics) :
+    ShardedLruCache<fuse_ino_t, XattrList>(
+      cache_size, fuse_ino_t(-1), hasher_inode,
+      perf::StatisticsTemplate("xattr_cache", statistics))
+  {
+  }
+
+  bool Insert(const fuse_ino_t &inode, const XattrList &xattrs) {
+    LogCvmfs(kLogLru, kLogDebug, "insert inode --> xattrs: %lu", inode);
+    return ShardedLruCache<fuse_ino_t, XattrList>::Insert(inode, xattrs);
+  }
+
+  bool Lookup(const fuse_ino_t &inode, XattrList *xattrs,
+              bool update_lru = true)
+  {
+    const bool result =
+      ShardedLruCache<fuse_ino_t, XattrList>::Lookup(inode, xattrs);
+    LogCvmfs(kLogLru, kLogDebug, "lookup inode --> xattrs: %lu (%s)",
+             inode, result ? "hit" : "miss");
+    return result;
+  }
+
+  void Drop() {
+    LogCvmfs(kLogLru, kLogDebug, "dropping xattr cache");
+    ShardedLruCache<fuse_ino_t, XattrList>::Drop();
+  }
+};  // XattrCache
+
+
+/**
+ * Keeps the chunk lists of chunked files, keyed by the content hash of the
+ * entire file, so that repeated opens of the same file do not query the
+ * catalog again.  The entries are content-addressed and thus remain valid
+ * across catalog updates.
+ */
+class ChunkListCache : public ShardedLruCache<shash::Any, CompactChunkList> {
+ public:
+  /**
+   * Larger lists are not cached to bound the memory consumption
+   */
+  static const unsigned kMaxChunks = 65536;
+
+  explicit ChunkListCache(unsigned int cache_size,
+                          perf::Statistics *statistics) :
+    ShardedLruCache<shash::Any, CompactChunkList>(
+      cache_size, shash::Any(), hasher_any,
+      perf::StatisticsTemplate("chunk_list_cache", statistics))
+  {
+  }
+
+  bool Insert(const shash::Any &hash, const FileChunkList &chunks) {
+    CompactChunkList compact;
+    if ((chunks.size() > kMaxChunks) ||
+        !CompactChunkList::Encode(chunks, &compact))
+    {
+      return false;
+    }
+    LogCvmfs(kLogLru, kLogDebug, "insert hash --> chunks: %s (%u chunks)",
+             hash.ToString().c_str(), compact.num_chunks());
+    return ShardedLruCache<shash::Any, CompactChunkList>::Insert(hash,
+                                                                 compact);
+  }
+
+  bool Lookup(const shash::Any &hash, FileChunkList *chunks,
+              bool update_lru = true)
+  {
+    CompactChunkList compact;
+    const bool result =
+      ShardedLruCache<shash::Any, CompactChunkList>::Lookup(hash, &compact);
+    if (result)
+      compact.Expand(chunks);
+    LogCvmfs(kLogLru, kLogDebug, "lookup hash --> chunks: %s (%s)",
+             hash.ToString().c_str(), result ? "hit" : "miss");
+    return result;
+  }
+
+  void Drop() {
+    LogCvmfs(kLogLru, kLogDebug, "dropping chunk list cache");
+    ShardedLruCache<shash::Any, CompactChunkList>::Drop();
+  }
+};  // ChunkListCache
+
+
 class Md5PathCache :
-  public LruCache<shash::Md5, catalog::DirectoryEntry>
+  public ShardedLruCache<shash::Md5, catalog::DirectoryEntryCompact>
 {
  public:
   explicit Md5PathCache(unsigned int cache_size, perf::Statistics *statistics) :
-    LruCache<shash::Md5, catalog::DirectoryEntry>(
+    ShardedLruCache<shash::Md5, catalog::DirectoryEntryCompact>(
       cache_size, shash::Md5(shash::AsciiPtr("!")), hasher_md5,
       perf::StatisticsTemplate("md5_path_cache", statistics))
   {
-    dirent_negative_ = catalog::DirectoryEntry(catalog::kDirentNegative);
+    dirent_negative_ = catalog::DirectoryEntryCompact(
+      catalog::DirectoryEntry(catalog::kDirentNegative));
+  }
+
+  static double GetEntrySize() {
+    return ShardedLruCache<shash::Md5,
+                           catalog::DirectoryEntryCompact>::GetEntrySize() +
+           catalog::DirectoryEntryCompact::kAverageSize;
   }
 
   bool Insert(const shash::Md5 &hash, const catalog::DirectoryEntry &dirent) {
     LogCvmfs(kLogLru, kLogDebug, "insert md5 --> dirent: %s -> '%s'",
              hash.ToString().c_str(), dirent.name().c_str());
     const bool result =
-      LruCache<shash::Md5, catalog::DirectoryEntry>::Insert(hash, dirent);
+      ShardedLruCache<shash::Md5, catalog::DirectoryEntryCompact>::Insert(
+        hash, catalog::DirectoryEntryCompact(dirent));
     return result;
   }
 
   bool InsertNegative(const shash::Md5 &hash) {
-    const bool result = Insert(hash, dirent_negative_);
+    const bool result =
+      ShardedLruCache<shash::Md5, catalog::DirectoryEntryCompact>::Insert(
+        hash, dirent_negative_);
     if (result)
       perf::Inc(counters_.n_insert_negative);
     return result;
@@ -137,8 +257,12 @@ class Md5PathCache :
   bool Lookup(const shash::Md5 &hash, catalog::DirectoryEntry *dirent,
               bool update_lru = true)
   {
+    catalog::DirectoryEntryCompact compact;
     const bool result =
-      LruCache<shash::Md5, catalog::DirectoryEntry>::Lookup(hash, dirent);
+      ShardedLruCache<shash::Md5, catalog::DirectoryEntryCompact>::Lookup(
+        hash, &compact);
+    if (result)
+      compact.Expand(dirent);
     LogCvmfs(kLogLru, kLogDebug, "lookup md5 --> dirent: %s (%s)",
              hash.ToString().c_str(), result ? "hit" : "miss");
     return result;
@@ -147,16 +271,24 @@ class Md5PathCache :
   bool Forget(const shash::Md5 &hash) {
     LogCvmfs(kLogLru, kLogDebug, "forget md5: %s",
              hash.ToString().c_str());
-    return LruCache<shash::Md5, catalog::DirectoryEntry>::Forget(hash);
+    return ShardedLruCache<shash::Md5, catalog::DirectoryEntryCompact>::Forget(
+      hash);
+  }
+
+  void FilterGet(shash::Md5 *hash, catalog::DirectoryEntry *dirent) {
+    catalog::DirectoryEntryCompact compact;
+    ShardedLruCache<shash::Md5, catalog::DirectoryEntryCompact>::FilterGet(
+      hash, &compact);
+    compact.Expand(dirent);
   }
 
   void Drop() {
     LogCvmfs(kLogLru, kLogDebug, "dropping md5path cache");
-    LruCache<shash::Md5, catalog::DirectoryEntry>::Drop();
+    ShardedLruCache<shash::Md5, catalog::DirectoryEntryCompact>::Drop();
   }
 
  private:
-  catalog::DirectoryEntry dirent_negative_;
+  catalog::DirectoryEntryCompact dirent_negative_;
 };  // Md5PathCache
 
 }  // namespace lru
@@ -0,0 +1,134 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "magic_xattr.h"
+
+#include <cassert>
+
+#include "murmur.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+const char *kMagicXattrStatPrefix = "user.stat.";
+
+namespace {
+
+const char *kMagicXattrNames[] = {
+  "",
+  "user.authz",
+  "user.chunks",
+  "user.compression",
+  "user.expires",
+  "user.external_file",
+  "user.external_host",
+  "user.external_timeout",
+  "user.fetch_timing",
+  "user.fqrn",
+  "user.hash",
+  "user.host",
+  "user.host_list",
+  "user.inode_max",
+  "user.lhash",
+  "user.maxfd",
+  "user.nclg",
+  "user.ncleanup24",
+  "user.ndiropen",
+  "user.ndownload",
+  "user.nioerr",
+  "user.nopen",
+  "user.pid",
+  "user.proxy",
+  "user.pubkeys",
+  "user.rawlink",
+  "user.revision",
+  "user.root_hash",
+  "user.rx",
+  "user.speed",
+  "user.stat",
+  "user.tag",
+  "user.timeout",
+  "user.timeout_direct",
+  "user.uptime",
+  "user.usedfd",
+  "user.useddirp",
+  "user.version",
+  "xfsroot.rawlink",
+};
+
+/**
+ * Perfect hash of the attribute names: MurmurHash2(name, kSeed) % kNumSlots
+ * is unique for every name.  The slots contain the index into
+ * kMagicXattrNames or 0 for an unused slot.  When adding an attribute, the
+ * seed and the slots need to be regenerated such that the names do not collide
+ * (checked by the unit test).
+ */
+const uint32_t kSeed = 0x1a3;
+const unsigned kNumSlots = 128;
+const unsigned char kSlots[kNumSlots] = {
+  0, 0, 22, 0, 0, 0, 0, 0, 0, 0, 24, 0, 0, 34, 0, 0,
+  0, 29, 0, 0, 0, 30, 0, 0, 0, 0, 0, 0, 0, 0, 12, 0,
+  0, 0, 0, 0, 0, 0, 0, 5, 0, 37, 7, 0, 0, 0, 25, 0,
+  33, 3, 9, 0, 0, 0, 19, 8, 0, 0, 28, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 6, 4, 0, 21, 0, 17, 0, 0, 15, 14, 0, 26,
+  18, 0, 0, 27, 0, 0, 0, 38, 0, 0, 0, 0, 0, 0, 2, 0,
+  0, 10, 16, 11, 36, 20, 0, 0, 0, 1, 13, 0, 0, 32, 0, 35,
+  0, 0, 0, 0, 0, 0, 0, 31, 0, 23, 0, 0, 0, 0, 0, 0,
+};
+
+}  // anonymous namespace
+
+
+MagicXattr LookupMagicXattr(const string &name) {
+  const unsigned slot =
+    MurmurHash2(name.data(), name.length(), kSeed) % kNumSlots;
+  const unsigned id = kSlots[slot];
+  if ((id == kMagicXattrNone) || (name != kMagicXattrNames[id]))
+    return kMagicXattrNone;
+  return static_cast<MagicXattr>(id);
+}
+
+
+const char *GetMagicXattrName(const MagicXattr id) {
+  assert(id < kMagicXattrNumEntries);
+  return kMagicXattrNames[id];
+}
+
+
+bool ParseMagicXattrStat(const string &name, vector<MagicXattr> *ids) {
+  ids->clear();
+  if (name == kMagicXattrNames[kMagicXattrStat]) {
+    for (unsigned i = kMagicXattrNone + 1; i < kMagicXattrNumEntries; ++i) {
+      switch (i) {
+        case kMagicXattrLhash:
+        case kMagicXattrPubkeys:
+        case kMagicXattrStat:
+        case kMagicXattrXfsrootRawlink:
+          break;
+        default:
+          ids->push_back(static_cast<MagicXattr>(i));
+      }
+    }
+    return true;
+  }
+
+  if (!HasPrefix(name, kMagicXattrStatPrefix, false))
+    return false;
+  vector<string> elements =
+    SplitString(name.substr(string(kMagicXattrStatPrefix).length()), ',');
+  for (unsigned i = 0; i < elements.size(); ++i) {
+    MagicXattr id = LookupMagicXattr(elements[i]);
+    if (id == kMagicXattrNone)
+      id = LookupMagicXattr("user." + elements[i]);
+    if ((id == kMagicXattrNone) || (id == kMagicXattrStat) ||
+        (id == kMagicXattrPubkeys))
+    {
+      ids->clear();
+      return false;
+    }
+    ids->push_back(id);
+  }
+  return true;
+}
@@ -0,0 +1,81 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Maps the names of the magic extended attributes (user.pid, user.hash, ...)
+ * to identifiers so that the fuse module can dispatch a getxattr() call with a
+ * single table lookup instead of a chain of string comparisons.
+ */
+
+#ifndef CVMFS_MAGIC_XATTR_H_
+#define CVMFS_MAGIC_XATTR_H_
+
+#include <string>
+#include <vector>
+
+/**
+ * The order must match kMagicXattrNames in magic_xattr.cc.
+ */
+enum MagicXattr {
+  kMagicXattrNone = 0,
+  kMagicXattrAuthz,
+  kMagicXattrChunks,
+  kMagicXattrCompression,
+  kMagicXattrExpires,
+  kMagicXattrExternalFile,
+  kMagicXattrExternalHost,
+  kMagicXattrExternalTimeout,
+  kMagicXattrFetchTiming,
+  kMagicXattrFqrn,
+  kMagicXattrHash,
+  kMagicXattrHost,
+  kMagicXattrHostList,
+  kMagicXattrInodeMax,
+  kMagicXattrLhash,
+  kMagicXattrMaxfd,
+  kMagicXattrNclg,
+  kMagicXattrNcleanup24,
+  kMagicXattrNdiropen,
+  kMagicXattrNdownload,
+  kMagicXattrNioerr,
+  kMagicXattrNopen,
+  kMagicXattrPid,
+  kMagicXattrProxy,
+  kMagicXattrPubkeys,
+  kMagicXattrRawlink,
+  kMagicXattrRevision,
+  kMagicXattrRootHash,
+  kMagicXattrRx,
+  kMagicXattrSpeed,
+  kMagicXattrStat,
+  kMagicXattrTag,
+  kMagicXattrTimeout,
+  kMagicXattrTimeoutDirect,
+  kMagicXattrUptime,
+  kMagicXattrUsedfd,
+  kMagicXattrUseddirp,
+  kMagicXattrVersion,
+  kMagicXattrXfsrootRawlink,
+  kMagicXattrNumEntries
+};
+
+/**
+ * Prefix of the batched query, e.g. user.stat.nopen,hash,chunks
+ */
+extern const char *kMagicXattrStatPrefix;
+
+MagicXattr LookupMagicXattr(const std::string &name);
+const char *GetMagicXattrName(const MagicXattr id);
+
+/**
+ * Returns the attributes of a batched query.  For user.stat, these are all the
+ * magic attributes except for the ones that are expensive (user.lhash), that
+ * have multi-line values (user.pubkeys), or that are duplicates
+ * (xfsroot.rawlink).  For user.stat.<list>, these are the elements of the comma
+ * separated list, given with or without the "user." prefix.  Returns false if
+ * the name is not a batched query or if the list contains an unknown attribute,
+ * in which case ids is empty.
+ */
+bool ParseMagicXattrStat(const std::string &name,
+                         std::vector<MagicXattr> *ids);
+
+#endif  // CVMFS_MAGIC_XATTR_H_
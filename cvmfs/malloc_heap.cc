@@ -5,6 +5,9 @@
 #include "cvmfs_config.h"
 #include "malloc_heap.h"
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include <cassert>
 #include <cstring>
 #include <new>
@@ -70,9 +73,23 @@ void MallocHeap::Compact() {
     }
   }
 
+  const uint64_t old_gauge = gauge_;
   gauge_ = (reinterpret_cast<unsigned char *>(current_tag) - heap_);
   if (!current_tag->IsFree())
     gauge_ += sizeof(Tag) + current_tag->GetSize();
+
+  // Pages above the gauge are unused until the heap grows again
+  if (!has_hugetlb_) {
+    const uint64_t page_size = sysconf(_SC_PAGESIZE);
+    const uint64_t release_begin =
+      (gauge_ + page_size - 1) / page_size * page_size;
+    const uint64_t release_end =
+      (old_gauge + page_size - 1) / page_size * page_size;
+    if (release_end > release_begin) {
+      madvise(heap_ + release_begin, release_end - release_begin,
+              MADV_DONTNEED);
+    }
+  }
 }
 
 
@@ -110,21 +127,65 @@ uint64_t MallocHeap::GetSize(void *block) {
 }
 
 
-MallocHeap::MallocHeap(uint64_t capacity, CallbackPtr callback_ptr)
+MallocHeap::MallocHeap(
+  uint64_t capacity,
+  CallbackPtr callback_ptr,
+  bool huge_pages)
   : callback_ptr_(callback_ptr)
   , capacity_(capacity)
   , gauge_(0)
   , stored_(0)
   , num_blocks_(0)
+  , heap_(NULL)
+  , mapped_size_(capacity)
+  , has_hugetlb_(false)
 {
   assert(capacity_ > kMinCapacity);
   // Ensure 8-byte alignment
   assert((capacity_ % 8) == 0);
-  heap_ = reinterpret_cast<unsigned char *>(sxmmap(capacity));
+  if (huge_pages)
+    MapHugePages();
+  else
+    heap_ = reinterpret_cast<unsigned char *>(sxmmap(capacity));
   assert(uintptr_t(heap_) % 8 == 0);
 }
 
 
 MallocHeap::~MallocHeap() {
-  sxunmap(heap_, capacity_);
+  sxunmap(heap_, mapped_size_);
+}
+
+
+/**
+ * Tries explicit huge pages first.  If there are not enough reserved huge
+ * pages, maps a huge page aligned arena and asks for transparent huge pages.
+ */
+void MallocHeap::MapHugePages() {
+  mapped_size_ = ((capacity_ + kHugePageSize - 1) / kHugePageSize) *
+                 kHugePageSize;
+#ifdef MAP_HUGETLB
+  void *mem = mmap(NULL, mapped_size_, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (mem != MAP_FAILED) {
+    heap_ = reinterpret_cast<unsigned char *>(mem);
+    has_hugetlb_ = true;
+    return;
+  }
+#endif
+
+  // Over-allocate by one huge page and trim to an aligned start address
+  unsigned char *area = reinterpret_cast<unsigned char *>(
+    sxmmap(mapped_size_ + kHugePageSize));
+  uint64_t head = (kHugePageSize - (uintptr_t(area) % kHugePageSize)) %
+                  kHugePageSize;
+  if (head > 0)
+    sxunmap(area, head);
+  heap_ = area + head;
+  uint64_t tail = kHugePageSize - head;
+  if (tail > 0)
+    sxunmap(heap_ + mapped_size_, tail);
+#ifdef MADV_HUGEPAGE
+  // Best effort, transparent huge pages might be disabled
+  (void)madvise(heap_, mapped_size_, MADV_HUGEPAGE);
+#endif
 }
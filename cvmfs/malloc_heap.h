@@ -32,6 +32,10 @@
  *
  * All memory blocks are 8-byte aligned and they have an 8-byte header
  * containing their size.  The size is negative for free blocks.
+ *
+ * For large heaps, the arena can be backed by huge pages in order to reduce
+ * TLB misses.  Explicit huge pages (hugetlbfs) are used if they are reserved
+ * on the system, otherwise transparent huge pages are requested.
  */
 class MallocHeap {
  public:
@@ -45,7 +49,8 @@ class MallocHeap {
   // compacted.
   typedef Callbackable<BlockPtr>::CallbackTN* CallbackPtr;
 
-  MallocHeap(uint64_t capacity, CallbackPtr callback_ptr);
+  MallocHeap(uint64_t capacity, CallbackPtr callback_ptr,
+             bool huge_pages = false);
   ~MallocHeap();
 
   void *Allocate(uint64_t size, void *header, unsigned header_size);
@@ -61,6 +66,7 @@ class MallocHeap {
     return stored_ + num_blocks_ * sizeof(Tag);
   }
   inline uint64_t capacity() { return capacity_; }
+  inline bool has_hugetlb() { return has_hugetlb_; }
   inline double utilization() {
     return static_cast<double>(stored_) / static_cast<double>(gauge_);
   }
@@ -71,6 +77,10 @@ class MallocHeap {
    * Minimum number of bytes of the heap.
    */
   static const unsigned kMinCapacity = 1024;
+  /**
+   * Huge pages are assumed to be 2MB, the default on x86_64 and aarch64.
+   */
+  static const uint64_t kHugePageSize = 2 * 1024 * 1024;
 
   /**
    * Prepends every block.  The size does not include the size of the tag.  The
@@ -97,6 +107,8 @@ class MallocHeap {
     int64_t size;
   };
 
+  void MapHugePages();
+
   /**
    * Invoked when a block is moved during compact.
    */
@@ -121,6 +133,14 @@ class MallocHeap {
    * The big mmap'd memory block used to serve allocation requests.
    */
   unsigned char *heap_;
+  /**
+   * Capacity rounded up to the page size of the mapping.
+   */
+  uint64_t mapped_size_;
+  /**
+   * True if the heap is backed by explicit huge pages.
+   */
+  bool has_hugetlb_;
 };  // class MallocHeap
 
 #endif  // CVMFS_MALLOC_HEAP_H_
@@ -0,0 +1,144 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "malloc_slab.h"
+
+#include <cassert>
+#include <cstring>
+
+#include "smalloc.h"
+
+using namespace std;  // NOLINT
+
+const unsigned MallocSlab::kMinChunkSize;
+const unsigned MallocSlab::kMaxChunkSize;
+const unsigned MallocSlab::kNumClasses;
+const unsigned MallocSlab::kSlabSize;
+
+
+/**
+ * The capacity is rounded down to a multiple of the slab size.
+ */
+MallocSlab::MallocSlab(uint64_t capacity)
+  : arena_(NULL)
+  , capacity_((capacity / kSlabSize) * kSlabSize)
+  , free_slabs_(kNoSlab)
+  , num_free_slabs_(0)
+{
+  assert(capacity_ >= kSlabSize);
+  arena_ = reinterpret_cast<unsigned char *>(sxmmap(capacity_));
+  slabs_.resize(capacity_ / kSlabSize);
+  for (uint32_t i = slabs_.size(); i > 0; --i) {
+    slabs_[i - 1].next = free_slabs_;
+    free_slabs_ = i - 1;
+  }
+  num_free_slabs_ = slabs_.size();
+  for (unsigned i = 0; i < kNumClasses; ++i) {
+    partial_slabs_[i] = kNoSlab;
+    num_chunks_[i] = 0;
+  }
+}
+
+
+MallocSlab::~MallocSlab() {
+  sxunmap(arena_, capacity_);
+}
+
+
+/**
+ * Returns NULL if the object is too large for a slab or if there is neither
+ * a free chunk of the size class nor a free slab left.
+ */
+void *MallocSlab::Allocate(uint64_t size) {
+  const unsigned size_class = GetClass(size);
+  if (size_class >= kNumClasses)
+    return NULL;
+
+  uint32_t idx = partial_slabs_[size_class];
+  if (idx == kNoSlab) {
+    if (free_slabs_ == kNoSlab)
+      return NULL;
+    idx = free_slabs_;
+    free_slabs_ = slabs_[idx].next;
+    num_free_slabs_--;
+    slabs_[idx] = Slab();
+    slabs_[idx].size_class = size_class;
+    LinkPartial(idx);
+  }
+
+  Slab *slab = &slabs_[idx];
+  void *chunk;
+  if (slab->free_chunks != NULL) {
+    chunk = slab->free_chunks;
+    memcpy(&slab->free_chunks, chunk, sizeof(void *));
+  } else {
+    assert(slab->num_carved < ChunksPerSlab(size_class));
+    chunk = GetSlabBase(idx) +
+            uint64_t(slab->num_carved) * GetChunkSize(size_class);
+    slab->num_carved++;
+  }
+  slab->num_used++;
+  if (slab->num_used == ChunksPerSlab(size_class))
+    UnlinkPartial(idx);
+  num_chunks_[size_class]++;
+  return chunk;
+}
+
+
+unsigned MallocSlab::GetClassOf(void *chunk) const {
+  assert(Contains(chunk));
+  const uint32_t idx =
+    (reinterpret_cast<unsigned char *>(chunk) - arena_) / kSlabSize;
+  return slabs_[idx].size_class;
+}
+
+
+void MallocSlab::MarkFree(void *chunk) {
+  assert(Contains(chunk));
+  const uint32_t idx =
+    (reinterpret_cast<unsigned char *>(chunk) - arena_) / kSlabSize;
+  Slab *slab = &slabs_[idx];
+  assert(slab->num_used > 0);
+  const unsigned size_class = slab->size_class;
+  const bool was_full = (slab->num_used == ChunksPerSlab(size_class));
+
+  memcpy(chunk, &slab->free_chunks, sizeof(void *));
+  slab->free_chunks = chunk;
+  slab->num_used--;
+  num_chunks_[size_class]--;
+
+  if (slab->num_used == 0) {
+    // A slab holds at least 16 chunks, so an empty slab is never full
+    UnlinkPartial(idx);
+    slab->next = free_slabs_;
+    free_slabs_ = idx;
+    num_free_slabs_++;
+  } else if (was_full) {
+    LinkPartial(idx);
+  }
+}
+
+
+void MallocSlab::LinkPartial(uint32_t idx) {
+  Slab *slab = &slabs_[idx];
+  const uint32_t head = partial_slabs_[slab->size_class];
+  slab->prev = kNoSlab;
+  slab->next = head;
+  if (head != kNoSlab)
+    slabs_[head].prev = idx;
+  partial_slabs_[slab->size_class] = idx;
+}
+
+
+void MallocSlab::UnlinkPartial(uint32_t idx) {
+  Slab *slab = &slabs_[idx];
+  if (slab->prev != kNoSlab)
+    slabs_[slab->prev].next = slab->next;
+  else
+    partial_slabs_[slab->size_class] = slab->next;
+  if (slab->next != kNoSlab)
+    slabs_[slab->next].prev = slab->prev;
+  slab->prev = slab->next = kNoSlab;
+}
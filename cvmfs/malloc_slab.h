@@ -0,0 +1,110 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_MALLOC_SLAB_H_
+#define CVMFS_MALLOC_SLAB_H_
+
+#include <inttypes.h>
+#include <stdint.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "util/single_copy.h"
+
+/**
+ * Size class allocator for small objects.  The arena is a single mmap'd
+ * region that is split into slabs of kSlabSize bytes.  A slab serves chunks
+ * of exactly one size class, the size classes are powers of two from
+ * kMinChunkSize to kMaxChunkSize.  Chunks never move, so unlike the
+ * MallocHeap, the small objects do not need to be compacted.  Slabs that
+ * become empty return to the pool of free slabs and can be taken by another
+ * size class.
+ *
+ * Free chunks are linked through their first bytes.  Fresh slabs are carved
+ * lazily, so that untouched slabs do not consume resident memory.
+ * Not thread-safe.
+ */
+class MallocSlab : SingleCopy {
+ public:
+  static const unsigned kMinChunkSize = 64;
+  static const unsigned kMaxChunkSize = 4096;
+  static const unsigned kNumClasses = 7;
+  static const unsigned kSlabSize = 64 * 1024;
+
+  /**
+   * Index of the smallest size class that fits size or kNumClasses if the
+   * object is too large for the slabs.
+   */
+  static inline unsigned GetClass(uint64_t size) {
+    unsigned size_class = 0;
+    uint64_t chunk_size = kMinChunkSize;
+    while ((chunk_size < size) && (size_class < kNumClasses)) {
+      chunk_size <<= 1;
+      size_class++;
+    }
+    return size_class;
+  }
+  static inline unsigned GetChunkSize(unsigned size_class) {
+    return kMinChunkSize << size_class;
+  }
+
+  explicit MallocSlab(uint64_t capacity);
+  ~MallocSlab();
+
+  void *Allocate(uint64_t size);
+  void MarkFree(void *chunk);
+  unsigned GetClassOf(void *chunk) const;
+
+  inline bool Contains(const void *ptr) const {
+    return (ptr >= arena_) && (ptr < arena_ + capacity_);
+  }
+  inline uint64_t capacity() const { return capacity_; }
+  /**
+   * Number of allocated chunks of a size class.
+   */
+  inline uint64_t num_chunks(unsigned size_class) const {
+    return num_chunks_[size_class];
+  }
+  inline unsigned num_free_slabs() const { return num_free_slabs_; }
+
+ private:
+  static const uint32_t kNoSlab = uint32_t(-1);
+
+  /**
+   * Slabs with free chunks are kept in a doubly linked list per size class.
+   * Free slabs are singly linked through next.
+   */
+  struct Slab {
+    Slab()
+      : size_class(0), num_used(0), num_carved(0)
+      , prev(kNoSlab), next(kNoSlab), free_chunks(NULL)
+    { }
+    unsigned size_class;
+    uint32_t num_used;
+    uint32_t num_carved;
+    uint32_t prev;
+    uint32_t next;
+    void *free_chunks;
+  };
+
+  inline unsigned char *GetSlabBase(uint32_t idx) const {
+    return arena_ + uint64_t(idx) * kSlabSize;
+  }
+  inline uint32_t ChunksPerSlab(unsigned size_class) const {
+    return kSlabSize / GetChunkSize(size_class);
+  }
+  void LinkPartial(uint32_t idx);
+  void UnlinkPartial(uint32_t idx);
+
+  unsigned char *arena_;
+  uint64_t capacity_;
+  std::vector<Slab> slabs_;
+  uint32_t free_slabs_;
+  unsigned num_free_slabs_;
+  uint32_t partial_slabs_[kNumClasses];
+  uint64_t num_chunks_[kNumClasses];
+};  // class MallocSlab
+
+#endif  // CVMFS_MALLOC_SLAB_H_
@@ -68,6 +68,7 @@ Manifest *Manifest::Load(const map<char, string> &content) {
   bool garbage_collectable = false;
   bool has_alt_catalog_path = false;
   shash::Any meta_info;
+  shash::Any tag_index;
 
   if ((iter = content.find('B')) != content.end())
     catalog_size = String2Uint64(iter->second);
@@ -91,11 +92,17 @@ Manifest *Manifest::Load(const map<char, string> &content) {
   if ((iter = content.find('M')) != content.end())
     meta_info = MkFromHexPtr(shash::HexPtr(iter->second),
                              shash::kSuffixMetainfo);
-
-  return new Manifest(catalog_hash, catalog_size, root_path, ttl, revision,
-                      micro_catalog_hash, repository_name, certificate,
-                      history, publish_timestamp, garbage_collectable,
-                      has_alt_catalog_path, meta_info);
+  if ((iter = content.find('I')) != content.end())
+    tag_index = MkFromHexPtr(shash::HexPtr(iter->second),
+                             shash::kSuffixTagIndex);
+
+  Manifest *manifest =
+    new Manifest(catalog_hash, catalog_size, root_path, ttl, revision,
+                 micro_catalog_hash, repository_name, certificate,
+                 history, publish_timestamp, garbage_collectable,
+                 has_alt_catalog_path, meta_info);
+  manifest->set_tag_index(tag_index);
+  return manifest;
 }
 
 
@@ -138,6 +145,8 @@ string Manifest::ExportString() const {
     manifest += "T" + StringifyInt(publish_timestamp_) + "\n";
   if (!meta_info_.IsNull())
     manifest += "M" + meta_info_.ToString() + "\n";
+  if (!tag_index_.IsNull())
+    manifest += "I" + tag_index_.ToString() + "\n";
   // Reserved: Z -> for identification of channel tips
 
   return manifest;
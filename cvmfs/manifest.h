@@ -92,6 +92,9 @@ class Manifest {
   void set_meta_info(const shash::Any &meta_info) {
     meta_info_ = meta_info;
   }
+  void set_tag_index(const shash::Any &tag_index) {
+    tag_index_ = tag_index;
+  }
   void set_root_path(const std::string &root_path) {
     root_path_ = shash::Md5(shash::AsciiPtr(root_path));
   }
@@ -107,6 +110,7 @@ class Manifest {
   bool garbage_collectable() const { return garbage_collectable_; }
   bool has_alt_catalog_path() const { return has_alt_catalog_path_; }
   shash::Any meta_info() const { return meta_info_; }
+  shash::Any tag_index() const { return tag_index_; }
 
   std::string MakeCatalogPath() const {
     return has_alt_catalog_path_ ? catalog_hash_.MakeAlternativePath() :
@@ -144,6 +148,12 @@ class Manifest {
    * of recommended stratum 1s, ...)
    */
   shash::Any meta_info_;
+
+  /**
+   * Hash of the binary index of the tags in the history database, see
+   * history::TagIndex
+   */
+  shash::Any tag_index_;
 };  // class Manifest
 
 }  // namespace manifest
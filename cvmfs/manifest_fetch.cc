@@ -44,12 +44,17 @@ static Failures DoFetch(
 
   const string manifest_url = base_url + string("/.cvmfspublished");
   download::JobInfo download_manifest(&manifest_url, false, probe_hosts, NULL);
+  download_manifest.if_modified_since = ensemble->if_modified_since;
+  download_manifest.priority = download::kPriorityMetadata;
   shash::Any certificate_hash;
   string certificate_url = base_url + "/";  // rest is in manifest
   download::JobInfo download_certificate(&certificate_url, true, probe_hosts,
                                          &certificate_hash);
+  download_certificate.priority = download::kPriorityMetadata;
 
   retval_dl = download_manager->Fetch(&download_manifest);
+  if (retval_dl == download::kFailNotModified)
+    return kFailNotModified;
   if (retval_dl != download::kFailOk) {
     LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslogWarn,
              "failed to download repository manifest (%d - %s)",
@@ -61,6 +66,7 @@ static Failures DoFetch(
   ensemble->raw_manifest_buf =
     reinterpret_cast<unsigned char *>(download_manifest.destination_mem.data);
   ensemble->raw_manifest_size = download_manifest.destination_mem.pos;
+  ensemble->last_modified = download_manifest.last_modified;
   ensemble->manifest =
     manifest::Manifest::LoadMem(ensemble->raw_manifest_buf,
                                 ensemble->raw_manifest_size);
@@ -179,7 +185,7 @@ Failures Fetch(const std::string &base_url, const std::string &repository_name,
     DoFetch(base_url, repository_name, minimum_timestamp, base_catalog,
             signature_manager, download_manager, ensemble);
   if ((result != kFailOk) && (result != kFailLoad) &&
-      (download_manager->num_hosts() > 1))
+      (result != kFailNotModified) && (download_manager->num_hosts() > 1))
   {
     LogCvmfs(kLogCache, kLogDebug | kLogSyslogWarn,
              "failed to fetch manifest (%d - %s), trying another stratum 1",
@@ -6,6 +6,7 @@
 #define CVMFS_MANIFEST_FETCH_H_
 
 #include <cstdlib>
+#include <ctime>
 #include <string>
 
 #include "manifest.h"
@@ -36,6 +37,7 @@ enum Failures {
   kFailBadWhitelist,
   kFailInvalidCertificate,
   kFailUnknown,
+  kFailNotModified,
 
   kFailNumEntries
 };
@@ -53,7 +55,8 @@ inline const char *Code2Ascii(const Failures error) {
   texts[8] = "bad whitelist";
   texts[9] = "invalid certificate";
   texts[10] = "unknown error";
-  texts[11] = "no text";
+  texts[11] = "manifest not modified";
+  texts[12] = "no text";
   return texts[error];
 }
 
@@ -67,6 +70,8 @@ struct ManifestEnsemble {
     manifest = NULL;
     raw_manifest_buf = cert_buf = whitelist_buf = whitelist_pkcs7_buf = NULL;
     raw_manifest_size = cert_size = whitelist_size = whitelist_pkcs7_size = 0;
+    if_modified_since = 0;
+    last_modified = -1;
   }
   virtual ~ManifestEnsemble() {
     delete manifest;
@@ -87,6 +92,13 @@ struct ManifestEnsemble {
   unsigned cert_size;
   unsigned whitelist_size;
   unsigned whitelist_pkcs7_size;
+  /**
+   * If set, the fetch fails with kFailNotModified unless the manifest changed
+   * on the server since then.  On success, last_modified is the modification
+   * time of the manifest as reported by the server or -1.
+   */
+  time_t if_modified_since;
+  time_t last_modified;
 };
 
 // TODO(jblomer): analogous to the Fetcher class, make a ManifestFetcher class
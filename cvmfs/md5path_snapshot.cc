@@ -0,0 +1,182 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#define __STDC_FORMAT_MACROS
+
+#include "cvmfs_config.h"
+#include "md5path_snapshot.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "directory_entry.h"
+#include "logging.h"
+#include "lru_md.h"
+#include "util/mmap_file.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+
+/**
+ * Returns NULL if there is no snapshot for the given root catalog.
+ */
+Md5PathSnapshot *Md5PathSnapshot::Open(
+  const string &path,
+  const shash::Any &root_hash)
+{
+  if (!FileExists(path))
+    return NULL;
+  MemoryMappedFile *mmap_file = new MemoryMappedFile(path);
+  if (!mmap_file->Map()) {
+    delete mmap_file;
+    return NULL;
+  }
+
+  Header header;
+  if (mmap_file->size() < sizeof(header)) {
+    LogCvmfs(kLogCvmfs, kLogDebug, "truncated md5 path snapshot %s",
+             path.c_str());
+    delete mmap_file;
+    return NULL;
+  }
+  memcpy(&header, mmap_file->buffer(), sizeof(header));
+  header.root_hash[sizeof(header.root_hash) - 1] = '\0';
+  if ((header.magic != kMagic) || (header.version != kVersion) ||
+      (header.num_entries > kMaxEntries) ||
+      (mmap_file->size() !=
+       sizeof(header) + header.num_entries * kDigestSize))
+  {
+    LogCvmfs(kLogCvmfs, kLogDebug, "invalid md5 path snapshot %s",
+             path.c_str());
+    delete mmap_file;
+    return NULL;
+  }
+  if (string(header.root_hash) != root_hash.ToString()) {
+    LogCvmfs(kLogCvmfs, kLogDebug, "md5 path snapshot %s is for root catalog "
+             "%s, ignoring", path.c_str(), header.root_hash);
+    delete mmap_file;
+    return NULL;
+  }
+
+  LogCvmfs(kLogCvmfs, kLogDebug, "using md5 path snapshot %s (%" PRIu64
+           " negative entries)", path.c_str(), header.num_entries);
+  return new Md5PathSnapshot(mmap_file, mmap_file->buffer() + sizeof(header),
+                             header.num_entries);
+}
+
+
+/**
+ * Collects the negative entries of the md5 path cache and, if given, of the
+ * previous snapshot of the same root catalog.  The snapshot is written to a
+ * temporary file first and atomically renamed to path.  The md5 path cache
+ * must not be modified concurrently.
+ */
+bool Md5PathSnapshot::Write(
+  const string &path,
+  const shash::Any &root_hash,
+  lru::Md5PathCache *md5path_cache,
+  const Md5PathSnapshot *previous)
+{
+  Header header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kMagic;
+  header.version = kVersion;
+  const string root_hash_str = root_hash.ToString();
+  if (root_hash_str.length() >= sizeof(header.root_hash))
+    return false;
+  memcpy(header.root_hash, root_hash_str.data(), root_hash_str.length());
+
+  vector<shash::Md5> entries;
+  shash::Md5 md5path;
+  catalog::DirectoryEntry dirent;
+  md5path_cache->FilterBegin();
+  while (md5path_cache->FilterNext()) {
+    md5path_cache->FilterGet(&md5path, &dirent);
+    if (dirent.GetSpecial() == catalog::kDirentNegative)
+      entries.push_back(md5path);
+  }
+  md5path_cache->FilterEnd();
+  // Every shard of the cache is iterated from its least recently used entry
+  // onwards
+  if (entries.size() > kMaxEntries)
+    entries.erase(entries.begin(), entries.end() - kMaxEntries);
+  if (previous != NULL) {
+    for (uint64_t i = 0;
+         (i < previous->num_entries_) && (entries.size() < kMaxEntries); ++i)
+    {
+      memcpy(md5path.digest, previous->entries_ + i * kDigestSize,
+             kDigestSize);
+      entries.push_back(md5path);
+    }
+  }
+  sort(entries.begin(), entries.end());
+  entries.erase(unique(entries.begin(), entries.end()), entries.end());
+  header.num_entries = entries.size();
+
+  string path_tmp;
+  FILE *f = CreateTempFile(path + ".tmp", 0644, "w", &path_tmp);
+  if (f == NULL) {
+    LogCvmfs(kLogCvmfs, kLogDebug, "failed to create md5 path snapshot (%d)",
+             errno);
+    return false;
+  }
+  bool retval = fwrite(&header, sizeof(header), 1, f) == 1;
+  for (unsigned i = 0; retval && (i < entries.size()); ++i)
+    retval = fwrite(entries[i].digest, kDigestSize, 1, f) == 1;
+  retval = (fclose(f) == 0) && retval;
+  if (retval)
+    retval = rename(path_tmp.c_str(), path.c_str()) == 0;
+  if (!retval) {
+    LogCvmfs(kLogCvmfs, kLogDebug, "failed to write md5 path snapshot %s",
+             path.c_str());
+    unlink(path_tmp.c_str());
+    return false;
+  }
+  LogCvmfs(kLogCvmfs, kLogDebug, "wrote md5 path snapshot %s (%" PRIu64
+           " negative entries)", path.c_str(), header.num_entries);
+  return true;
+}
+
+
+Md5PathSnapshot::Md5PathSnapshot(
+  MemoryMappedFile *mmap_file,
+  const unsigned char *entries,
+  uint64_t num_entries)
+  : mmap_file_(mmap_file)
+  , entries_(entries)
+  , num_entries_(num_entries)
+{ }
+
+
+Md5PathSnapshot::~Md5PathSnapshot() {
+  delete mmap_file_;
+}
+
+
+/**
+ * Binary search in the sorted digests of the mapped file.
+ */
+bool Md5PathSnapshot::IsNegative(const shash::Md5 &md5path) const {
+  uint64_t low = 0;
+  uint64_t high = num_entries_;
+  while (low < high) {
+    const uint64_t mid = low + (high - low) / 2;
+    const int cmp =
+      memcmp(entries_ + mid * kDigestSize, md5path.digest, kDigestSize);
+    if (cmp == 0)
+      return true;
+    if (cmp < 0)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return false;
+}
@@ -0,0 +1,72 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_MD5PATH_SNAPSHOT_H_
+#define CVMFS_MD5PATH_SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "hash.h"
+#include "util/single_copy.h"
+
+class MemoryMappedFile;
+namespace lru {
+class Md5PathCache;
+}
+
+/**
+ * An on-disk, memory-mapped snapshot of the negative entries of the md5 path
+ * cache.  It keeps ENOENT lookups cheap across remounts and reboots, which
+ * matters for search path scans (PYTHONPATH, LD_LIBRARY_PATH, ...) in large
+ * software stacks.
+ *
+ * The snapshot is tied to a root catalog hash.  It is only used if the
+ * repository is mounted with the very same root catalog, because then the
+ * entire file system tree is the same.  Positive entries are not stored
+ * because the cached inodes depend on the order in which catalogs get
+ * attached.
+ *
+ * The file consists of a header, followed by the sorted md5 digests.
+ */
+class Md5PathSnapshot : SingleCopy {
+ public:
+  static const uint32_t kMagic = 0x4d355053;  // "M5PS"
+  static const uint32_t kVersion = 1;
+  /**
+   * Bounds the size of the snapshot to 16MB worth of digests.
+   */
+  static const uint64_t kMaxEntries = 1024 * 1024;
+
+  static Md5PathSnapshot *Open(const std::string &path,
+                               const shash::Any &root_hash);
+  static bool Write(const std::string &path,
+                    const shash::Any &root_hash,
+                    lru::Md5PathCache *md5path_cache,
+                    const Md5PathSnapshot *previous);
+  ~Md5PathSnapshot();
+
+  bool IsNegative(const shash::Md5 &md5path) const;
+  uint64_t size() const { return num_entries_; }
+
+ private:
+  static const unsigned kDigestSize = 16;
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    char root_hash[128];
+    uint64_t num_entries;
+  };
+
+  Md5PathSnapshot(MemoryMappedFile *mmap_file,
+                  const unsigned char *entries,
+                  uint64_t num_entries);
+
+  MemoryMappedFile *mmap_file_;
+  const unsigned char *entries_;
+  uint64_t num_entries_;
+};
+
+#endif  // CVMFS_MD5PATH_SNAPSHOT_H_
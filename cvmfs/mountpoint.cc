@@ -6,6 +6,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #ifndef CVMFS_LIBCVMFS
 #include <fuse/fuse_lowlevel.h>
 #endif
@@ -26,9 +27,11 @@
 #endif
 #endif
 
+#include "async_executor.h"
 #include "authz/authz_curl.h"
 #include "authz/authz_fetch.h"
 #include "authz/authz_session.h"
+#include "authz/authz_shared.h"
 #include "backoff.h"
 #include "cache.h"
 #include "cache_extern.h"
@@ -37,31 +40,38 @@
 #include "cache_tiered.h"
 #include "catalog.h"
 #include "catalog_mgr_client.h"
+#include "chunk_prefetch.h"
 #include "clientctx.h"
 #include "download.h"
 #include "duplex_sqlite3.h"
 #include "fetch.h"
+#include "fetch_timing.h"
 #include "file_chunk.h"
 #include "globals.h"
 #include "glue_buffer.h"
 #include "google/protobuf/stubs/common.h"
 #include "history.h"
+#include "history_index.h"
 #include "history_sqlite.h"
 #include "logging.h"
 #include "lru_md.h"
 #include "manifest.h"
 #include "manifest_fetch.h"
+#include "md5path_snapshot.h"
 #ifdef CVMFS_NFS_SUPPORT
 #include "nfs_maps.h"
 #endif
 #include "options.h"
 #include "platform.h"
 #include "quota_posix.h"
+#include "runtime_config.h"
 #include "signature.h"
+#include "smalloc.h"
 #include "sqlitemem.h"
 #include "sqlitevfs.h"
 #include "statistics.h"
 #include "tracer.h"
+#include "uid_accounting.h"
 #include "util/pointer.h"
 #include "util/posix.h"
 #include "util/string.h"
@@ -72,6 +82,26 @@
 using namespace std;  // NOLINT
 
 
+string BootFactory::PrintBootTimings() {
+  string result;
+  for (unsigned i = 0; i < boot_timings_.size(); ++i) {
+    result += "  " + boot_timings_[i].first + ": " +
+              StringifyInt(boot_timings_[i].second / (1000 * 1000)) + " ms\n";
+  }
+  return result;
+}
+
+
+void BootFactory::RecordBootStage(const string &stage, uint64_t *start_ns) {
+  const uint64_t now_ns = platform_monotonic_time_ns();
+  boot_timings_.push_back(make_pair(stage, now_ns - *start_ns));
+  *start_ns = now_ns;
+}
+
+
+//------------------------------------------------------------------------------
+
+
 bool FileSystem::g_alive = false;
 const char *FileSystem::kDefaultCacheBase = "/var/lib/cvmfs";
 const char *FileSystem::kDefaultCacheMgrInstance = "default";
@@ -107,6 +137,12 @@ bool FileSystem::CheckPosixCacheSettings(
     boot_status_ = loader::kFailOptions;
     return false;
   }
+  if (settings.is_alien && settings.compress) {
+    boot_error_ = "Failure: cache compression and alien cache mutually "
+                  "exclusive. Please turn off cache compression.";
+    boot_status_ = loader::kFailOptions;
+    return false;
+  }
   if (settings.is_alien && settings.is_managed) {
     boot_error_ = "Failure: quota management and alien cache mutually "
                   "exclusive. Please turn off quota limit.";
@@ -139,6 +175,7 @@ bool FileSystem::CheckPosixCacheSettings(
  * method.
  */
 FileSystem *FileSystem::Create(const FileSystem::FileSystemInfo &fs_info) {
+  uint64_t start_ns = platform_monotonic_time_ns();
   UniquePtr<FileSystem>
     file_system(new FileSystem(fs_info));
 
@@ -148,10 +185,12 @@ FileSystem *FileSystem::Create(const FileSystem::FileSystemInfo &fs_info) {
 
   file_system->CreateStatistics();
   file_system->SetupSqlite();
+  file_system->RecordBootStage("logging, statistics, sqlite", &start_ns);
   if (!file_system->DetermineNfsMode())
     return file_system.Release();
   if (!file_system->SetupWorkspace())
     return file_system.Release();
+  file_system->RecordBootStage("workspace", &start_ns);
 
   // Redirect SQlite temp directory to workspace (global variable)
   unsigned length_tempdir = file_system->workspace_.length() + 1;
@@ -163,13 +202,19 @@ FileSystem *FileSystem::Create(const FileSystem::FileSystemInfo &fs_info) {
 
   if (!file_system->TriageCacheMgr())
     return file_system.Release();
+  file_system->RecordBootStage("cache manager", &start_ns);
   file_system->SetupUuid();
   if (!file_system->SetupNfsMaps())
     return file_system.Release();
+  file_system->RecordBootStage("uuid, nfs maps", &start_ns);
+  int vfs_options = sqlite::kVfsOptDefault;
+  if (file_system->has_sqlite_mmap_)
+    vfs_options |= sqlite::kVfsOptMmap;
   bool retval = sqlite::RegisterVfsRdOnly(
     file_system->cache_mgr_,
     file_system->statistics_,
-    sqlite::kVfsOptDefault);
+    vfs_options,
+    file_system->sqlite_mem_threshold_);
   assert(retval);
   file_system->has_custom_sqlitevfs_ = true;
 
@@ -191,27 +236,47 @@ void FileSystem::CreateStatistics() {
   statistics_->Register("linkstring.n_instances", "Number of instances");
   statistics_->Register("linkstring.n_overflows", "Number of overflows");
 
-  // Callback counters
-  n_fs_open_ = statistics_->Register("cvmfs.n_fs_open",
-                                     "Overall number of file open operations");
-  n_fs_dir_open_ = statistics_->Register("cvmfs.n_fs_dir_open",
+  // Callback counters, sharded because they are changed by every fuse call
+  n_fs_open_ = statistics_->RegisterSharded("cvmfs.n_fs_open",
+               "Overall number of file open operations");
+  n_fs_dir_open_ = statistics_->RegisterSharded("cvmfs.n_fs_dir_open",
                    "Overall number of directory open operations");
-  n_fs_lookup_ = statistics_->Register("cvmfs.n_fs_lookup",
-                                       "Number of lookups");
-  n_fs_lookup_negative_ = statistics_->Register("cvmfs.n_fs_lookup_negative",
-                                                "Number of negative lookups");
-  n_fs_stat_ = statistics_->Register("cvmfs.n_fs_stat", "Number of stats");
-  n_fs_read_ = statistics_->Register("cvmfs.n_fs_read", "Number of files read");
-  n_fs_readlink_ = statistics_->Register("cvmfs.n_fs_readlink",
-                                         "Number of links read");
-  n_fs_forget_ = statistics_->Register("cvmfs.n_fs_forget",
-                                       "Number of inode forgets");
+  n_fs_lookup_ = statistics_->RegisterSharded("cvmfs.n_fs_lookup",
+                                              "Number of lookups");
+  n_fs_lookup_negative_ = statistics_->RegisterSharded(
+    "cvmfs.n_fs_lookup_negative", "Number of negative lookups");
+  n_fs_stat_ = statistics_->RegisterSharded("cvmfs.n_fs_stat",
+                                            "Number of stats");
+  n_fs_read_ = statistics_->RegisterSharded("cvmfs.n_fs_read",
+                                            "Number of files read");
+  n_fs_readahead_ = statistics_->Register("cvmfs.n_fs_readahead",
+                    "Number of chunks scheduled for read-ahead");
+  n_fs_readahead_dropped_ = statistics_->Register(
+    "cvmfs.n_fs_readahead_dropped",
+    "Number of chunk read-ahead requests dropped due to a full queue");
+  n_fs_async_ = statistics_->Register("cvmfs.n_fs_async",
+    "Number of open and read requests answered by the asynchronous workers");
+  n_fs_async_rejected_ = statistics_->Register("cvmfs.n_fs_async_rejected",
+    "Number of requests processed in the fuse thread due to a full queue");
+  n_fs_readlink_ = statistics_->RegisterSharded("cvmfs.n_fs_readlink",
+                                                "Number of links read");
+  n_fs_forget_ = statistics_->RegisterSharded("cvmfs.n_fs_forget",
+                                              "Number of inode forgets");
   n_io_error_ = statistics_->Register("cvmfs.n_io_error",
                                       "Number of I/O errors");
   no_open_files_ = statistics_->Register("cvmfs.no_open_files",
                                          "Number of currently opened files");
   no_open_dirs_ = statistics_->Register("cvmfs.no_open_dirs",
                   "Number of currently opened directories");
+
+  lat_fs_lookup_ = statistics_->RegisterHistogram("cvmfs.lat_fs_lookup",
+                   "Latency of lookups (microseconds)");
+  lat_fs_getattr_ = statistics_->RegisterHistogram("cvmfs.lat_fs_getattr",
+                    "Latency of stats (microseconds)");
+  lat_fs_open_ = statistics_->RegisterHistogram("cvmfs.lat_fs_open",
+                 "Latency of file open operations (microseconds)");
+  lat_fs_read_ = statistics_->RegisterHistogram("cvmfs.lat_fs_read",
+                 "Latency of reads (microseconds)");
 }
 
 
@@ -237,6 +302,24 @@ FileSystem::PosixCacheSettings FileSystem::DeterminePosixCacheSettings(
   {
     settings.avoid_rename = true;
   }
+  if (options_mgr_->GetValue(MkCacheParm("CVMFS_CACHE_COMPRESSION", instance),
+                             &optarg)
+      && options_mgr_->IsOn(optarg))
+  {
+    settings.compress = true;
+  }
+  if (options_mgr_->GetValue(
+        MkCacheParm("CVMFS_CACHE_ALIEN_LOCKING", instance), &optarg)
+      && options_mgr_->IsOn(optarg))
+  {
+    settings.alien_locking = true;
+  }
+  if (options_mgr_->GetValue(
+        MkCacheParm("CVMFS_CACHE_SHARED_LOCKING", instance), &optarg)
+      && options_mgr_->IsOn(optarg))
+  {
+    settings.shared_locking = true;
+  }
 
   if (type_ == kFsFuse)
     settings.quota_limit = kDefaultQuotaLimit;
@@ -248,6 +331,17 @@ FileSystem::PosixCacheSettings FileSystem::DeterminePosixCacheSettings(
   if (settings.quota_limit > 0)
     settings.is_managed = true;
 
+  if (options_mgr_->GetValue(MkCacheParm("CVMFS_CACHE_FD_CACHE_SIZE", instance),
+                             &optarg))
+  {
+    settings.fd_cache_size = String2Uint64(optarg);
+  }
+  if (options_mgr_->GetValue(
+        MkCacheParm("CVMFS_CACHE_EVICTION_POLICY", instance), &optarg))
+  {
+    settings.eviction_policy = optarg;
+  }
+
   settings.cache_path = kDefaultCacheBase;
   if (options_mgr_->GetValue(MkCacheParm("CVMFS_CACHE_BASE", instance),
                              &optarg))
@@ -304,6 +398,10 @@ bool FileSystem::DetermineNfsMode() {
     if (options_mgr_->GetValue("CVMFS_NFS_SHARED", &optarg)) {
       nfs_mode_ |= kNfsMapsHa;
       nfs_maps_dir_ = optarg;
+    } else if (options_mgr_->GetValue("CVMFS_NFS_MMAP_MAPS", &optarg) &&
+               options_mgr_->IsOn(optarg))
+    {
+      nfs_mode_ |= kNfsMapsMmap;
     }
   }
 
@@ -329,11 +427,19 @@ FileSystem::FileSystem(const FileSystem::FileSystemInfo &fs_info)
   , n_fs_lookup_negative_(NULL)
   , n_fs_stat_(NULL)
   , n_fs_read_(NULL)
+  , n_fs_readahead_(NULL)
+  , n_fs_readahead_dropped_(NULL)
+  , n_fs_async_(NULL)
+  , n_fs_async_rejected_(NULL)
   , n_fs_readlink_(NULL)
   , n_fs_forget_(NULL)
   , n_io_error_(NULL)
   , no_open_files_(NULL)
   , no_open_dirs_(NULL)
+  , lat_fs_lookup_(NULL)
+  , lat_fs_getattr_(NULL)
+  , lat_fs_open_(NULL)
+  , lat_fs_read_(NULL)
   , statistics_(NULL)
   , fd_workspace_lock_(-1)
   , found_previous_crash_(false)
@@ -342,6 +448,8 @@ FileSystem::FileSystem(const FileSystem::FileSystemInfo &fs_info)
   , uuid_cache_(NULL)
   , has_nfs_maps_(false)
   , has_custom_sqlitevfs_(false)
+  , has_sqlite_mmap_(false)
+  , sqlite_mem_threshold_(0)
 {
   assert(!g_alive);
   g_alive = true;
@@ -567,8 +675,14 @@ CacheManager *FileSystem::SetupExternalCacheMgr(const string &instance) {
     boot_status_ = loader::kFailCacheDir;
     return NULL;
   }
+  bool use_shm = false;
+  if (options_mgr_->GetValue(MkCacheParm("CVMFS_CACHE_SHARED_MEMORY", instance),
+      &optarg))
+  {
+    use_shm = options_mgr_->IsOn(optarg);
+  }
   ExternalCacheManager *cache_mgr = ExternalCacheManager::Create(
-    plugin_handle->fd_connection(), nfiles, name_ + ":" + instance);
+    plugin_handle->fd_connection(), nfiles, name_ + ":" + instance, use_shm);
   if (cache_mgr == NULL) {
     boot_error_ = "failed to create external cache manager for " + instance;
     boot_status_ = loader::kFailCacheDir;
@@ -594,6 +708,18 @@ CacheManager *FileSystem::SetupPosixCacheMgr(const string &instance) {
     boot_status_ = loader::kFailCacheDir;
     return NULL;
   }
+  cache_mgr->SetFdCacheSize(settings.fd_cache_size);
+  if ((settings.is_alien && settings.alien_locking) ||
+      (settings.is_shared && settings.shared_locking))
+  {
+    cache_mgr->EnableFetchLocking();
+  }
+  if (settings.compress && !cache_mgr->EnableCompression()) {
+    boot_error_ = "Failed to enable compression of posix cache '" + instance +
+                  "' in " + settings.cache_path;
+    boot_status_ = loader::kFailCacheDir;
+    return NULL;
+  }
 
   // Sentinel file for future use
   // Might be a read-only cache
@@ -634,6 +760,8 @@ CacheManager *FileSystem::SetupRamCacheMgr(const string &instance) {
       alloc = MemoryKvStore::kMallocLibc;
     } else if (optarg == "heap") {
       alloc = MemoryKvStore::kMallocHeap;
+    } else if (optarg == "hugepages") {
+      alloc = MemoryKvStore::kMallocHeapHugePages;
     } else {
       boot_error_ = "Failure: unknown malloc " +
                     MkCacheParm("CVMFS_CACHE_MALLOC", instance) + "=" + optarg;
@@ -654,6 +782,26 @@ CacheManager *FileSystem::SetupRamCacheMgr(const string &instance) {
     return NULL;
   }
   cache_mgr->AcquireQuotaManager(new NoopQuotaManager());
+
+  // The configured size becomes the upper bound
+  if (options_mgr_->GetValue(MkCacheParm("CVMFS_CACHE_MIN_SIZE", instance),
+                             &optarg))
+  {
+    uint64_t sz_min_bytes;
+    if (HasSuffix(optarg, "%", false))
+      sz_min_bytes = platform_memsize() * String2Uint64(optarg)/100;
+    else
+      sz_min_bytes = String2Uint64(optarg) * 1024 * 1024;
+    const string psi_path = "/proc/pressure/memory";
+    if (!FileExists(psi_path)) {
+      LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslogWarn,
+               "memory pressure information not available, "
+               "ignoring %s", MkCacheParm("CVMFS_CACHE_MIN_SIZE",
+                                          instance).c_str());
+    } else if (sz_min_bytes < sz_cache_bytes) {
+      cache_mgr->SetPressureAdaptation(sz_min_bytes, psi_path);
+    }
+  }
   return cache_mgr;
 }
 
@@ -683,17 +831,57 @@ CacheManager *FileSystem::SetupTieredCacheMgr(const string &instance) {
     return NULL;
 
   CacheManager *tiered =
-    TieredCacheManager::Create(upper.Release(), lower.Release());
+    TieredCacheManager::Create(upper.Release(), lower.Release(),
+      perf::StatisticsTemplate("cache." + instance, statistics_));
   if (tiered == NULL) {
     boot_error_ = "Failed to setup tiered cache manager " + instance;
     boot_status_ = loader::kFailCacheDir;
     return NULL;
   }
+  TieredCacheManager *tiered_mgr = static_cast<TieredCacheManager*>(tiered);
   if (options_mgr_->GetValue(
         MkCacheParm("CVMFS_CACHE_LOWER_READONLY", instance), &optarg) &&
       options_mgr_->IsOn(optarg))
   {
-    static_cast<TieredCacheManager*>(tiered)->SetLowerReadOnly();
+    tiered_mgr->SetLowerReadOnly();
+  }
+  if (options_mgr_->GetValue(
+        MkCacheParm("CVMFS_CACHE_PROMOTION", instance), &optarg))
+  {
+    unsigned min_accesses = TieredCacheManager::kDefaultPromotionAccesses;
+    string optarg_accesses;
+    if (options_mgr_->GetValue(
+          MkCacheParm("CVMFS_CACHE_PROMOTION_ACCESSES", instance),
+          &optarg_accesses))
+    {
+      min_accesses = String2Uint64(optarg_accesses);
+    }
+    if (optarg == "open") {
+      tiered_mgr->SetPromotionPolicy(TieredCacheManager::kPromoteOnOpen, 0);
+    } else if (optarg == "access") {
+      tiered_mgr->SetPromotionPolicy(TieredCacheManager::kPromoteOnAccess,
+                                     min_accesses);
+    } else if (optarg == "async") {
+      tiered_mgr->SetPromotionPolicy(TieredCacheManager::kPromoteAsync, 0);
+    } else {
+      boot_error_ = "invalid promotion policy for tiered cache " + instance +
+                    ": " + optarg;
+      boot_status_ = loader::kFailOptions;
+      delete tiered;
+      return NULL;
+    }
+  }
+  if (options_mgr_->GetValue(
+        MkCacheParm("CVMFS_CACHE_ASYNC_WRITEBACK", instance), &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    unsigned max_queue_length = TieredCacheManager::kDefaultMaxQueueLength;
+    if (options_mgr_->GetValue(
+          MkCacheParm("CVMFS_CACHE_COPY_QUEUE", instance), &optarg))
+    {
+      max_queue_length = String2Uint64(optarg);
+    }
+    tiered_mgr->SetAsyncWriteBack(max_queue_length);
   }
   return tiered;
 }
@@ -753,6 +941,8 @@ void FileSystem::SetupLogging() {
     SetLogSyslogLevel(String2Uint64(optarg));
   if (options_mgr_->GetValue("CVMFS_SYSLOG_FACILITY", &optarg))
     SetLogSyslogFacility(String2Int64(optarg));
+  if (options_mgr_->GetValue("CVMFS_SYSLOG_RATE_LIMIT", &optarg))
+    SetLogSyslogRateLimit(String2Uint64(optarg), 60);
   if (options_mgr_->GetValue("CVMFS_USYSLOG", &optarg))
     SetLogMicroSyslog(optarg);
   if (options_mgr_->GetValue("CVMFS_DEBUGLOG", &optarg))
@@ -821,7 +1011,8 @@ bool FileSystem::SetupNfsMaps() {
     nfs_maps::Init(inode_cache_dir,
                    catalog::ClientCatalogManager::kInodeOffset + 1,
                    found_previous_crash_,
-                   IsHaNfsSource());
+                   IsHaNfsSource(),
+                   IsMmapNfsSource());
   if (!retval) {
     boot_error_ = "Failed to initialize NFS maps";
     boot_status_ = loader::kFailNfsMaps;
@@ -848,6 +1039,14 @@ bool FileSystem::SetupPosixQuotaMgr(
              settings.workspace.c_str(), settings.cache_path.c_str());
     cache_workspace += ":" + settings.workspace;
   }
+  PosixQuotaManager::EvictionPolicy eviction_policy;
+  if (!PosixQuotaManager::ParseEvictionPolicy(settings.eviction_policy,
+                                              &eviction_policy))
+  {
+    boot_error_ = "invalid cache eviction policy: " + settings.eviction_policy;
+    boot_status_ = loader::kFailOptions;
+    return false;
+  }
   PosixQuotaManager *quota_mgr;
 
   if (settings.is_shared) {
@@ -856,7 +1055,8 @@ bool FileSystem::SetupPosixQuotaMgr(
                   cache_workspace,
                   settings.quota_limit,
                   quota_threshold,
-                  foreground_);
+                  foreground_,
+                  eviction_policy);
     if (quota_mgr == NULL) {
       boot_error_ = "Failed to initialize shared lru cache";
       boot_status_ = loader::kFailQuota;
@@ -873,6 +1073,7 @@ bool FileSystem::SetupPosixQuotaMgr(
       boot_status_ = loader::kFailQuota;
       return false;
     }
+    quota_mgr->SetEvictionPolicy(eviction_policy);
   }
 
   if (quota_mgr->GetSize() > quota_mgr->GetCapacity()) {
@@ -908,6 +1109,24 @@ void FileSystem::SetupSqlite() {
   assert(retval == SQLITE_OK);
   SqliteMemoryManager::GetInstance()->AssignGlobalArenas();
 
+  string optarg;
+  if (options_mgr_->GetValue("CVMFS_CATALOG_PAGECACHE_SIZE", &optarg)) {
+    SqliteMemoryManager::GetInstance()->SetPageCacheBudget(
+      String2Uint64(optarg) * 1024 * 1024);
+  }
+  if (options_mgr_->GetValue("CVMFS_CATALOG_MMAP", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    retval = sqlite3_config(SQLITE_CONFIG_MMAP_SIZE,
+                            static_cast<sqlite3_int64>(kCatalogMmapSize),
+                            static_cast<sqlite3_int64>(kCatalogMmapSize));
+    assert(retval == SQLITE_OK);
+    has_sqlite_mmap_ = true;
+  }
+  if (options_mgr_->GetValue("CVMFS_CATALOG_MEM_THRESHOLD", &optarg)) {
+    sqlite_mem_threshold_ = String2Uint64(optarg) * 1024;
+  }
+
   // Disable SQlite3 file locking
   retval = sqlite3_vfs_register(sqlite3_vfs_find("unix-none"), 1);
   assert(retval == SQLITE_OK);
@@ -1013,6 +1232,23 @@ bool FileSystem::TriageCacheMgr() {
 const char *MountPoint::kDefaultAuthzSearchPath = "/usr/libexec/cvmfs/authz";
 const char *MountPoint::kDefaultBlacklist = "/etc/cvmfs/blacklist";
 
+
+/**
+ * Boot errors can be raised concurrently by the key loader and the download
+ * manager setup.  The first error wins.
+ */
+void MountPoint::SetBootError(
+  loader::Failures status,
+  const string &error)
+{
+  MutexLockGuard lock_guard(&lock_boot_error_);
+  if (boot_error_.empty()) {
+    boot_error_ = error;
+    boot_status_ = status;
+  }
+}
+
+
 bool MountPoint::CheckBlacklists() {
   blacklist_paths_.clear();
   string blacklist;
@@ -1023,8 +1259,8 @@ bool MountPoint::CheckBlacklists() {
   bool append = false;
   if (FileExists(blacklist)) {
     if (!signature_mgr_->LoadBlacklist(blacklist, append)) {
-      boot_error_ = "failed to load blacklist " + blacklist;
-      boot_status_ = loader::kFailSignature;
+      SetBootError(loader::kFailSignature,
+                   "failed to load blacklist " + blacklist);
       return false;
     }
     append = true;
@@ -1036,8 +1272,8 @@ bool MountPoint::CheckBlacklists() {
     blacklist_paths_.push_back(blacklist);
     if (FileExists(blacklist)) {
       if (!signature_mgr_->LoadBlacklist(blacklist, append)) {
-        boot_error_ = "failed to load blacklist from config repository";
-        boot_status_ = loader::kFailSignature;
+        SetBootError(loader::kFailSignature,
+                     "failed to load blacklist from config repository");
         return false;
       }
     }
@@ -1085,23 +1321,49 @@ MountPoint *MountPoint::Create(
   // At this point, we have a repository name, the type (fuse or library) and
   // an options manager (which can be the same than the FileSystem's one).
 
+  uint64_t start_ns = platform_monotonic_time_ns();
   mountpoint->CreateStatistics();
   mountpoint->CreateAuthz();
   mountpoint->backoff_throttle_ = new BackoffThrottle();
-
-  if (!mountpoint->CreateSignatureManager() || !mountpoint->CheckBlacklists())
-    return mountpoint.Release();
-  if (!mountpoint->CreateDownloadManagers())
+  mountpoint->RecordBootStage("statistics, authz", &start_ns);
+
+  // The global initialization of OpenSSL and libcurl is not thread-safe and
+  // thus takes place before the key loader is started
+  mountpoint->CreateSignatureManager();
+  mountpoint->CreateDownloadManager();
+  KeyLoader key_loader;
+  key_loader.mountpoint = mountpoint.weak_ref();
+  pthread_t thread_key_loader;
+  bool has_key_loader = (pthread_create(
+    &thread_key_loader, NULL, MainKeyLoader, &key_loader) == 0);
+  if (!has_key_loader)
+    MainKeyLoader(&key_loader);
+  const bool retval_download = mountpoint->SetupDownloadManagers();
+  mountpoint->RecordBootStage("download managers", &start_ns);
+  if (has_key_loader)
+    pthread_join(thread_key_loader, NULL);
+  mountpoint->boot_timings_.push_back(
+    std::make_pair(std::string("public keys, blacklists (parallel)"),
+                   key_loader.duration_ns));
+  start_ns = platform_monotonic_time_ns();
+  if (!key_loader.result || !retval_download)
     return mountpoint.Release();
+
   mountpoint->CreateFetchers();
   if (!mountpoint->CreateCatalogManager())
     return mountpoint.Release();
+  mountpoint->RecordBootStage("manifest, root catalog", &start_ns);
   if (!mountpoint->CreateTracer())
     return mountpoint.Release();
+  mountpoint->CreateHistogramExporter();
 
   mountpoint->ReEvaluateAuthz();
   mountpoint->CreateTables();
+  mountpoint->CreateMd5PathSnapshot();
+  mountpoint->CreateChunkPrefetcher();
+  mountpoint->CreateAsyncExecutor();
   mountpoint->SetupBehavior();
+  mountpoint->RecordBootStage("tracer, tables, behavior", &start_ns);
 
   mountpoint->boot_status_ = loader::kFailOk;
   return mountpoint.Release();
@@ -1129,6 +1391,16 @@ void MountPoint::CreateAuthz() {
     statistics_);
   assert(authz_session_mgr_ != NULL);
 
+  // Share the decisions with the other mount points of the workspace
+  if (options_mgr_->GetValue("CVMFS_AUTHZ_SHARED_CACHE", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    AuthzSharedCache *shared_cache = AuthzSharedCache::Open(
+      file_system_->workspace() + "/authz.shared");
+    if (shared_cache != NULL)
+      authz_session_mgr_->SetSharedCache(shared_cache);
+  }
+
   authz_attachment_ = new AuthzAttachment(authz_session_mgr_);
   assert(authz_attachment_ != NULL);
 }
@@ -1139,6 +1411,41 @@ bool MountPoint::CreateCatalogManager() {
 
   catalog_mgr_ = new catalog::ClientCatalogManager(
     fqrn_, fetcher_, signature_mgr_, statistics_);
+  if (options_mgr_->GetValue("CVMFS_CATALOG_PREFETCH", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    catalog_mgr_->EnableCatalogPrefetch(
+      file_system_->workspace() + "/catalogtrace." + fqrn_);
+  }
+  if (options_mgr_->GetValue("CVMFS_CATALOG_PATH_FILTER", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    catalog_mgr_->EnablePathFilter();
+  }
+  if (options_mgr_->GetValue("CVMFS_CATALOG_DELTAS", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    catalog_mgr_->EnableCatalogDeltas();
+  }
+  if (options_mgr_->GetValue("CVMFS_CATALOG_INDEX", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    catalog_mgr_->EnableCatalogIndexes();
+  }
+  if (options_mgr_->GetValue("CVMFS_NESTED_CATALOG_INDEX", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    catalog_mgr_->EnableNestedCatalogIndex();
+  }
+  if (options_mgr_->GetValue("CVMFS_CATALOG_HEATMAP", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    unsigned interval_sec = kDefaultHeatmapIntervalSec;
+    if (options_mgr_->GetValue("CVMFS_CATALOG_HEATMAP_INTERVAL", &optarg))
+      interval_sec = String2Uint64(optarg);
+    catalog_mgr_->EnableCatalogHeatmap(
+      file_system_->workspace() + "/catalogheatmap." + fqrn_, interval_sec);
+  }
 
   SetupInodeAnnotation();
   if (!SetupOwnerMaps())
@@ -1183,14 +1490,20 @@ bool MountPoint::CreateCatalogManager() {
 }
 
 
-bool MountPoint::CreateDownloadManagers() {
-  string optarg;
+void MountPoint::CreateDownloadManager() {
   download_mgr_ = new download::DownloadManager();
   const bool use_system_proxy = false;
   download_mgr_->Init(kDefaultNumConnections, use_system_proxy,
                       perf::StatisticsTemplate("download", statistics_));
   download_mgr_->SetCredentialsAttachment(authz_attachment_);
+}
 
+
+/**
+ * Runs in parallel with the key loader.
+ */
+bool MountPoint::SetupDownloadManagers() {
+  string optarg;
   if (options_mgr_->GetValue("CVMFS_SERVER_URL", &optarg)) {
     download_mgr_->SetHostChain(ReplaceHosts(optarg));
   }
@@ -1207,13 +1520,16 @@ bool MountPoint::CreateDownloadManagers() {
   string proxies;
   if (options_mgr_->GetValue("CVMFS_HTTP_PROXY", &optarg))
     proxies = optarg;
+  unsigned proxy_discovery_ttl = 0;
+  if (options_mgr_->GetValue("CVMFS_PROXY_DISCOVERY_TTL", &optarg))
+    proxy_discovery_ttl = String2Uint64(optarg);
   proxies = download::ResolveProxyDescription(
     proxies,
     file_system_->workspace() + "/proxies" + GetUniqFileSuffix(),
-    download_mgr_);
+    download_mgr_,
+    proxy_discovery_ttl);
   if (proxies == "") {
-    boot_error_ = "failed to discover HTTP proxy servers";
-    boot_status_ = loader::kFailWpad;
+    SetBootError(loader::kFailWpad, "failed to discover HTTP proxy servers");
     return false;
   }
   string fallback_proxies;
@@ -1247,14 +1563,93 @@ void MountPoint::CreateFetchers() {
     backoff_throttle_,
     perf::StatisticsTemplate("fetch-external", statistics_),
     is_external_data);
+
+  string optarg;
+  unsigned slow_fetch_threshold_ms = 0;
+  if (options_mgr_->GetValue("CVMFS_SLOW_FETCH_THRESHOLD", &optarg))
+    slow_fetch_threshold_ms = String2Uint64(optarg);
+  fetch_timing_log_ = new cvmfs::FetchTimingLog(slow_fetch_threshold_ms);
+  fetcher_->set_fetch_timing_log(fetch_timing_log_);
+  external_fetcher_->set_fetch_timing_log(fetch_timing_log_);
+  if (options_mgr_->GetValue("CVMFS_UID_ACCOUNTING", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    uid_accounting_ = new cvmfs::UidAccounting();
+    fetcher_->set_uid_accounting(uid_accounting_);
+    external_fetcher_->set_uid_accounting(uid_accounting_);
+  }
+  if (options_mgr_->GetValue("CVMFS_DOWNLOAD_FAST_FAIL", &optarg) &&
+      (String2Uint64(optarg) > 0))
+  {
+    fetcher_->EnableFastFail(String2Uint64(optarg));
+    external_fetcher_->EnableFastFail(String2Uint64(optarg));
+  }
 }
 
 
-bool MountPoint::CreateSignatureManager() {
+/**
+ * Only the fuse module reads chunked files through the read-ahead engine.
+ */
+void MountPoint::CreateChunkPrefetcher() {
+  if (file_system_->type() != FileSystem::kFsFuse)
+    return;
+
+  string optarg;
+  unsigned window = kDefaultReadAheadChunks;
+  unsigned num_threads = kDefaultReadAheadThreads;
+  if (options_mgr_->GetValue("CVMFS_READAHEAD_CHUNKS", &optarg))
+    window = String2Uint64(optarg);
+  if (options_mgr_->GetValue("CVMFS_READAHEAD_THREADS", &optarg))
+    num_threads = String2Uint64(optarg);
+  chunk_prefetcher_ = new cvmfs::ChunkPrefetcher(
+    window, num_threads,
+    file_system_->n_fs_readahead(), file_system_->n_fs_readahead_dropped());
+  if (chunk_prefetcher_->window() > 0) {
+    LogCvmfs(kLogCvmfs, kLogDebug, "read-ahead of %u chunks enabled",
+             chunk_prefetcher_->window());
+  }
+}
+
+
+/**
+ * Only the fuse module can reply to requests from a different thread.
+ */
+void MountPoint::CreateAsyncExecutor() {
+  if (file_system_->type() != FileSystem::kFsFuse)
+    return;
+
   string optarg;
+  unsigned num_threads = kDefaultAsyncFuseThreads;
+  if (options_mgr_->GetValue("CVMFS_ASYNC_FUSE_THREADS", &optarg))
+    num_threads = String2Uint64(optarg);
+  if (num_threads == 0)
+    return;
+  async_executor_ = new cvmfs::AsyncExecutor(
+    num_threads,
+    file_system_->n_fs_async(), file_system_->n_fs_async_rejected());
+  LogCvmfs(kLogCvmfs, kLogDebug, "%u asynchronous fuse request workers",
+           async_executor_->num_threads());
+}
+
+
+void MountPoint::CreateSignatureManager() {
   signature_mgr_ = new signature::SignatureManager();
   signature_mgr_->Init();
+}
+
+
+void *MountPoint::MainKeyLoader(void *data) {
+  KeyLoader *key_loader = reinterpret_cast<KeyLoader *>(data);
+  uint64_t start_ns = platform_monotonic_time_ns();
+  key_loader->result = key_loader->mountpoint->LoadPublicKeys() &&
+                       key_loader->mountpoint->CheckBlacklists();
+  key_loader->duration_ns = platform_monotonic_time_ns() - start_ns;
+  return NULL;
+}
 
+
+bool MountPoint::LoadPublicKeys() {
+  string optarg;
   string public_keys;
   if (options_mgr_->GetValue("CVMFS_PUBLIC_KEY", &optarg)) {
     public_keys = optarg;
@@ -1266,8 +1661,7 @@ bool MountPoint::CreateSignatureManager() {
   }
 
   if (!signature_mgr_->LoadPublicRsaKeys(public_keys)) {
-    boot_error_ = "failed to load public key(s)";
-    boot_status_ = loader::kFailSignature;
+    SetBootError(loader::kFailSignature, "failed to load public key(s)");
     return false;
   }
   LogCvmfs(kLogCvmfs, kLogDebug, "CernVM-FS: using public key(s) %s",
@@ -1275,8 +1669,8 @@ bool MountPoint::CreateSignatureManager() {
 
   if (options_mgr_->GetValue("CVMFS_TRUSTED_CERTS", &optarg)) {
     if (!signature_mgr_->LoadTrustedCaCrl(optarg)) {
-      boot_error_ = "failed to load trusted certificates";
-      boot_status_ = loader::kFailSignature;
+      SetBootError(loader::kFailSignature,
+                   "failed to load trusted certificates");
       return false;
     }
   }
@@ -1303,6 +1697,22 @@ void MountPoint::CreateStatistics() {
                         "overall number of successful path lookups");
   statistics_->Register("inode_tracker.n_miss_path",
                         "overall number of unsuccessful path lookups");
+
+  // Set by the TalkManager, estimates in bytes
+  statistics_->Register("memory.sz_inode_tracker",
+                        "memory used by the inode tracker");
+  statistics_->Register("memory.sz_metadata_caches",
+                        "memory used by the inode, path, and md5path caches");
+  statistics_->Register("memory.sz_catalogs",
+                        "memory used by the attached catalogs");
+  statistics_->Register("memory.sz_sqlite",
+                        "memory mapped by the sqlite allocator");
+  statistics_->Register("memory.sz_chunk_tables",
+                        "memory used by the chunk tables of open files");
+  statistics_->Register("memory.sz_download",
+                        "memory used by the download managers' buffers");
+  statistics_->Register("memory.sz_ram_cache",
+                        "memory used by the in-memory cache manager");
 }
 
 
@@ -1321,6 +1731,14 @@ void MountPoint::CreateTables() {
   if (options_mgr_->GetValue("CVMFS_MEMCACHE_SIZE", &optarg))
     mem_cache_size = String2Uint64(optarg) * 1024 * 1024;
 
+  // The tables are filled on creation, so the first touch would put all of
+  // them on the node of the loader thread
+  const bool numa_interleave =
+    options_mgr_->GetValue("CVMFS_NUMA_INTERLEAVE", &optarg) &&
+    options_mgr_->IsOn(optarg) && platform_numa_interleave(true);
+  if (numa_interleave)
+    LogCvmfs(kLogCvmfs, kLogDebug, "interleaving memory caches");
+
   const double memcache_unit_size =
     (static_cast<double>(kInodeCacheFactor) * lru::Md5PathCache::GetEntrySize())
     + lru::InodeCache::GetEntrySize() + lru::PathCache::GetEntrySize();
@@ -1332,8 +1750,42 @@ void MountPoint::CreateTables() {
   path_cache_ = new lru::PathCache(memcache_num_units & mask_64, statistics_);
   md5path_cache_ = new lru::Md5PathCache((memcache_num_units * 7) & mask_64,
                                          statistics_);
+  xattr_cache_ = new lru::XattrCache(kXattrCacheSize, statistics_);
+  chunk_list_cache_ =
+    new lru::ChunkListCache(kChunkListCacheSize, statistics_);
 
   inode_tracker_ = new glue::InodeTracker();
+  if (numa_interleave)
+    platform_numa_interleave(false);
+
+  // In NFS mode, inodes are never forgotten
+  if (options_mgr_->GetValue("CVMFS_KEEP_PAGE_CACHE", &optarg) &&
+      options_mgr_->IsOn(optarg) && !file_system_->IsNfsSource())
+  {
+    page_cache_tracker_ = new glue::PageCacheTracker();
+    LogCvmfs(kLogCvmfs, kLogDebug, "keeping page cache of unchanged files");
+  }
+}
+
+
+/**
+ * The snapshot is only used by the fuse module.  It is stored in the
+ * workspace, which survives reboots.
+ */
+void MountPoint::CreateMd5PathSnapshot() {
+  if (file_system_->type() != FileSystem::kFsFuse)
+    return;
+
+  string optarg;
+  if (!options_mgr_->GetValue("CVMFS_NEGATIVE_CACHE_SNAPSHOT", &optarg) ||
+      !options_mgr_->IsOn(optarg))
+  {
+    return;
+  }
+  md5path_snapshot_path_ =
+    file_system_->workspace() + "/md5path_snapshot." + fqrn_;
+  md5path_snapshot_ =
+    Md5PathSnapshot::Open(md5path_snapshot_path_, catalog_mgr_->GetRootHash());
 }
 
 
@@ -1346,12 +1798,44 @@ bool MountPoint::CreateTracer() {
       boot_status_ = loader::kFailOptions;
       return false;
     }
-    tracer_->Activate(kTracerBufferSize, kTracerFlushThreshold, optarg);
+    Tracer::Format format = Tracer::kFormatCsv;
+    string format_str;
+    if (options_mgr_->GetValue("CVMFS_TRACEFILE_FORMAT", &format_str)) {
+      if (format_str == "binary") {
+        format = Tracer::kFormatBinary;
+      } else if (format_str != "csv") {
+        boot_error_ = "invalid trace file format: " + format_str;
+        boot_status_ = loader::kFailOptions;
+        return false;
+      }
+    }
+    tracer_->Activate(kTracerBufferSize, kTracerFlushThreshold, optarg,
+                      format);
   }
   return true;
 }
 
 
+/**
+ * Periodically writes the latency percentiles to the given file, for
+ * monitoring.  The same numbers are available through cvmfs_talk latency.
+ */
+void MountPoint::CreateHistogramExporter() {
+  string optarg;
+  if (!options_mgr_->GetValue("CVMFS_LATENCY_EXPORT", &optarg))
+    return;
+  const string export_path = optarg;
+  unsigned interval_s = kDefaultLatencyExportIntervalSec;
+  if (options_mgr_->GetValue("CVMFS_LATENCY_EXPORT_INTERVAL", &optarg) &&
+      (String2Uint64(optarg) > 0))
+  {
+    interval_s = String2Uint64(optarg);
+  }
+  histogram_exporter_ =
+    new perf::HistogramExporter(statistics_, export_path, interval_s);
+}
+
+
 bool MountPoint::DetermineRootHash(shash::Any *root_hash) {
   string optarg;
   if (options_mgr_->GetValue("CVMFS_ROOT_HASH", &optarg)) {
@@ -1366,20 +1850,38 @@ bool MountPoint::DetermineRootHash(shash::Any *root_hash) {
     return true;
   }
 
-  string history_path;
-  if (!FetchHistory(&history_path))
-    return false;
-  UnlinkGuard history_file(history_path);
-  UniquePtr<history::History> tag_db(
-    history::SqliteHistory::Open(history_path));
-  if (!tag_db) {
-    LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslog,
-             "failed to open history database (%s)", history_path.c_str());
-    boot_error_ = "failed to open history database";
+  manifest::Failures retval_mf;
+  manifest::ManifestEnsemble ensemble;
+  retval_mf = manifest::Fetch("", fqrn_, 0, NULL, signature_mgr_, download_mgr_,
+                              &ensemble);
+  if (retval_mf != manifest::kFailOk) {
+    boot_error_ = "Failed to fetch manifest";
     boot_status_ = loader::kFailHistory;
     return false;
   }
 
+  // The tag index is a small download and needs no SQLite; the history
+  // database is only used if the repository publishes no (valid) index
+  UniquePtr<history::TagIndex> tag_index;
+  if (!ensemble.manifest->tag_index().IsNull())
+    tag_index = FetchTagIndex(ensemble.manifest->tag_index());
+  UnlinkGuard history_file;
+  UniquePtr<history::History> tag_db;
+  if (!tag_index.IsValid()) {
+    string history_path;
+    if (!FetchHistory(ensemble.manifest->history(), &history_path))
+      return false;
+    history_file.Set(history_path);
+    tag_db = history::SqliteHistory::Open(history_path);
+    if (!tag_db) {
+      LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslog,
+               "failed to open history database (%s)", history_path.c_str());
+      boot_error_ = "failed to open history database";
+      boot_status_ = loader::kFailHistory;
+      return false;
+    }
+  }
+
   history::History::Tag tag;
   bool retval;
   if (!options_mgr_->GetValue("CVMFS_REPOSITORY_TAG", &repository_tag_)) {
@@ -1393,7 +1895,9 @@ bool MountPoint::DetermineRootHash(shash::Any *root_hash) {
       boot_status_ = loader::kFailHistory;
       return false;
     }
-    retval = tag_db->GetByDate(repository_utctime, &tag);
+    retval = tag_index.IsValid()
+             ? tag_index->GetByDate(repository_utctime, &tag)
+             : tag_db->GetByDate(repository_utctime, &tag);
     if (!retval) {
       boot_error_ = "no repository state as early as utc timestamp " +
                      StringifyTime(repository_utctime, true);
@@ -1406,7 +1910,8 @@ bool MountPoint::DetermineRootHash(shash::Any *root_hash) {
              tag.name.c_str());
     repository_tag_ = tag.name;
   } else {
-    retval = tag_db->GetByName(repository_tag_, &tag);
+    retval = tag_index.IsValid() ? tag_index->GetByName(repository_tag_, &tag)
+                                 : tag_db->GetByName(repository_tag_, &tag);
     if (!retval) {
       boot_error_ = "no such tag: " + repository_tag_;
       boot_status_ = loader::kFailHistory;
@@ -1420,17 +1925,10 @@ bool MountPoint::DetermineRootHash(shash::Any *root_hash) {
 }
 
 
-bool MountPoint::FetchHistory(std::string *history_path) {
-  manifest::Failures retval_mf;
-  manifest::ManifestEnsemble ensemble;
-  retval_mf = manifest::Fetch("", fqrn_, 0, NULL, signature_mgr_, download_mgr_,
-                              &ensemble);
-  if (retval_mf != manifest::kFailOk) {
-    boot_error_ = "Failed to fetch manifest";
-    boot_status_ = loader::kFailHistory;
-    return false;
-  }
-  shash::Any history_hash = ensemble.manifest->history();
+bool MountPoint::FetchHistory(
+  const shash::Any &history_hash,
+  std::string *history_path)
+{
   if (history_hash.IsNull()) {
     boot_error_ = "No history";
     boot_status_ = loader::kFailHistory;
@@ -1454,6 +1952,44 @@ bool MountPoint::FetchHistory(std::string *history_path) {
 }
 
 
+/**
+ * Returns NULL if the tag index cannot be fetched or parsed.  The caller falls
+ * back to the history database in this case.
+ */
+history::TagIndex *MountPoint::FetchTagIndex(const shash::Any &tag_index_hash)
+{
+  int fd = fetcher_->Fetch(
+    tag_index_hash,
+    CacheManager::kSizeUnknown,
+    "tag index for " + fqrn_,
+    zlib::kZlibDefault,
+    CacheManager::kTypeRegular);
+  if (fd < 0) {
+    LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslog,
+             "failed to download tag index (%d)", fd);
+    return NULL;
+  }
+  const int64_t size = file_system_->cache_mgr()->GetSize(fd);
+  unsigned char *buffer = NULL;
+  if (size > 0) {
+    buffer = static_cast<unsigned char *>(smalloc(size));
+    if (file_system_->cache_mgr()->Pread(fd, buffer, size, 0) != size) {
+      free(buffer);
+      buffer = NULL;
+    }
+  }
+  file_system_->cache_mgr()->Close(fd);
+  if (buffer == NULL)
+    return NULL;
+  history::TagIndex *tag_index = history::TagIndex::Parse(buffer, size);
+  if (tag_index == NULL) {
+    LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslog, "invalid tag index %s",
+             tag_index_hash.ToString().c_str());
+  }
+  return tag_index;
+}
+
+
 unsigned MountPoint::GetEffectiveTtlSec() {
   unsigned max_ttl;
   {
@@ -1499,6 +2035,10 @@ MountPoint::MountPoint(
   , external_download_mgr_(NULL)
   , fetcher_(NULL)
   , external_fetcher_(NULL)
+  , fetch_timing_log_(NULL)
+  , uid_accounting_(NULL)
+  , chunk_prefetcher_(NULL)
+  , async_executor_(NULL)
   , inode_annotation_(NULL)
   , catalog_mgr_(NULL)
   , chunk_tables_(NULL)
@@ -1506,24 +2046,53 @@ MountPoint::MountPoint(
   , inode_cache_(NULL)
   , path_cache_(NULL)
   , md5path_cache_(NULL)
+  , xattr_cache_(NULL)
+  , chunk_list_cache_(NULL)
+  , md5path_snapshot_(NULL)
+  , runtime_config_(NULL)
+  , page_cache_tracker_(NULL)
   , tracer_(NULL)
+  , histogram_exporter_(NULL)
   , inode_tracker_(NULL)
   , max_ttl_sec_(kDefaultMaxTtlSec)
   , kcache_timeout_sec_(static_cast<double>(kDefaultKCacheTtlSec))
+  , kcache_negative_timeout_sec_(static_cast<double>(kDefaultKCacheTtlSec))
   , fixed_catalog_(false)
   , hide_magic_xattrs_(false)
+  , splice_read_(false)
+  , stream_listing_(false)
+  , selective_kcache_invalidation_(false)
+  , stable_inodes_(false)
+  , catalog_preload_lead_sec_(0)
+  , remount_jitter_sec_(0)
+  , catalog_idle_timeout_sec_(0)
+  , catalog_mem_limit_(0)
+  , volatile_file_size_(0)
+  , partial_fetch_size_(0)
+  , prefetch_groups_(true)
   , has_membership_req_(false)
 {
   int retval = pthread_mutex_init(&lock_max_ttl_, NULL);
   assert(retval == 0);
+  retval = pthread_mutex_init(&lock_boot_error_, NULL);
+  assert(retval == 0);
 }
 
 
 MountPoint::~MountPoint() {
   pthread_mutex_destroy(&lock_max_ttl_);
+  pthread_mutex_destroy(&lock_boot_error_);
 
+  // Answers the pending requests, which use most of the other objects
+  delete async_executor_;
+  delete histogram_exporter_;
+  delete page_cache_tracker_;
   delete inode_tracker_;
   delete tracer_;
+  delete md5path_snapshot_;
+  delete runtime_config_;
+  delete xattr_cache_;
+  delete chunk_list_cache_;
   delete md5path_cache_;
   delete path_cache_;
   delete inode_cache_;
@@ -1532,8 +2101,12 @@ MountPoint::~MountPoint() {
 
   delete catalog_mgr_;
   delete inode_annotation_;
+  // Joins the read-ahead threads, which use the fetchers
+  delete chunk_prefetcher_;
   delete external_fetcher_;
   delete fetcher_;
+  delete fetch_timing_log_;
+  delete uid_accounting_;
   if (external_download_mgr_ != NULL) {
     external_download_mgr_->Fini();
     delete external_download_mgr_;
@@ -1556,12 +2129,129 @@ MountPoint::~MountPoint() {
 }
 
 
+/**
+ * To be called when the root catalog changes.  Must not run concurrently to
+ * lookups.
+ */
+void MountPoint::DropMd5PathSnapshot() {
+  delete md5path_snapshot_;
+  md5path_snapshot_ = NULL;
+}
+
+
 void MountPoint::ReEvaluateAuthz() {
   has_membership_req_ = catalog_mgr_->GetVOMSAuthz(&membership_req_);
   authz_attachment_->set_membership(membership_req_);
 }
 
 
+/**
+ * The content of small files can be stored in the catalog.  If such a file
+ * is not yet in the cache, its content is copied from the catalog into the
+ * cache so that the subsequent fetch does not need to download the object.
+ * On failure, the fetcher downloads the object as usual.  Needs to be called
+ * while the catalogs cannot be reloaded.
+ */
+void MountPoint::CacheInlineFile(
+  const PathString &path,
+  const catalog::DirectoryEntry &dirent)
+{
+  CacheManager *cache_mgr = file_system_->cache_mgr();
+  int fd = cache_mgr->Open(CacheManager::Bless(dirent.checksum()));
+  if (fd >= 0) {
+    cache_mgr->Close(fd);
+    return;
+  }
+
+  string data;
+  if (!catalog_mgr_->LookupInlineData(path, &data) ||
+      (data.length() != dirent.size()))
+  {
+    LogCvmfs(kLogCvmfs, kLogDebug, "no inline data for %s", path.c_str());
+    return;
+  }
+  bool retval = cache_mgr->CommitFromMem(
+    dirent.checksum(), reinterpret_cast<const unsigned char *>(data.data()),
+    data.length(), path.ToString());
+  LogCvmfs(kLogCvmfs, kLogDebug, "%s inline data of %s",
+           retval ? "cached" : "failed to cache", path.c_str());
+}
+
+
+/**
+ * Small files can be part of a bundle object.  If such a file is not yet in
+ * the cache, the entire bundle is downloaded and all of its files are stored in
+ * the cache, so that opening the sibling files does not need further
+ * downloads.  The offset of the file in the bundle is not needed for that.  On
+ * failure, the fetcher downloads the file's object as usual.  Needs to be
+ * called while the catalogs cannot be reloaded.
+ */
+void MountPoint::CacheBundledFile(
+  const PathString &path,
+  const catalog::DirectoryEntry &dirent)
+{
+  CacheManager *cache_mgr = file_system_->cache_mgr();
+  int fd = cache_mgr->Open(CacheManager::Bless(dirent.checksum()));
+  if (fd >= 0) {
+    cache_mgr->Close(fd);
+    return;
+  }
+
+  shash::Any bundle_hash;
+  uint64_t offset;
+  if (!catalog_mgr_->LookupBundle(path, dirent.hash_algorithm(), &bundle_hash,
+                                  &offset))
+  {
+    LogCvmfs(kLogCvmfs, kLogDebug, "no bundle for %s", path.c_str());
+    return;
+  }
+  int retval = fetcher_->FetchBundle(bundle_hash, path.ToString(),
+                                     dirent.compression_algorithm());
+  LogCvmfs(kLogCvmfs, kLogDebug, "bundle %s of %s: %d",
+           bundle_hash.ToString().c_str(), path.c_str(), retval);
+}
+
+
+/**
+ * Writes the negative entries of the md5 path cache for the current root
+ * catalog.  The entries of the previous snapshot are merged, if it is still
+ * valid.  Called on unmount and on reload, when there are no more file system
+ * callbacks.
+ */
+/**
+ * Objects of repositories with the volatile flag and large files that match
+ * the volatile file policy are inserted as volatile objects into the cache.
+ */
+CacheManager::ObjectType MountPoint::GetObjectType(
+  const PathString &path,
+  const uint64_t size)
+{
+  if (catalog_mgr_->volatile_flag())
+    return CacheManager::kTypeVolatile;
+  if ((volatile_file_size_ == 0) || (size <= volatile_file_size_))
+    return CacheManager::kTypeRegular;
+  if (volatile_file_patterns_.empty())
+    return CacheManager::kTypeVolatile;
+  const string path_str = path.ToString();
+  for (unsigned i = 0; i < volatile_file_patterns_.size(); ++i) {
+    if (fnmatch(volatile_file_patterns_[i].c_str(), path_str.c_str(), 0) == 0)
+      return CacheManager::kTypeVolatile;
+  }
+  return CacheManager::kTypeRegular;
+}
+
+
+void MountPoint::SaveMd5PathSnapshot() {
+  if (md5path_snapshot_path_.empty() || (md5path_cache_ == NULL) ||
+      (catalog_mgr_ == NULL))
+  {
+    return;
+  }
+  Md5PathSnapshot::Write(md5path_snapshot_path_, catalog_mgr_->GetRootHash(),
+                         md5path_cache_, md5path_snapshot_);
+}
+
+
 string MountPoint::ReplaceHosts(string hosts) {
   vector<string> tokens = SplitString(fqrn_, '.');
   const string org = tokens[0];
@@ -1590,12 +2280,72 @@ void MountPoint::SetupBehavior() {
   }
   LogCvmfs(kLogCvmfs, kLogDebug, "kernel caches expire after %d seconds",
            static_cast<int>(kcache_timeout_sec_));
+  kcache_negative_timeout_sec_ = kcache_timeout_sec_;
+  if (options_mgr_->GetValue("CVMFS_KCACHE_NEGATIVE_TIMEOUT", &optarg)) {
+    kcache_negative_timeout_sec_ =
+      std::max(0.0, static_cast<double>(String2Int64(optarg)));
+    LogCvmfs(kLogCvmfs, kLogDebug,
+             "negative kernel cache entries expire after %d seconds",
+             static_cast<int>(kcache_negative_timeout_sec_));
+  }
+  cvmfs::RuntimeConfig runtime_config;
+  runtime_config.kcache_timeout_sec = kcache_timeout_sec_;
+  runtime_config.kcache_negative_timeout_sec = kcache_negative_timeout_sec_;
+  runtime_config_ = new cvmfs::RuntimeConfigStore(runtime_config);
 
   if (options_mgr_->GetValue("CVMFS_HIDE_MAGIC_XATTRS", &optarg)
       && options_mgr_->IsOn(optarg))
   {
     hide_magic_xattrs_ = true;
   }
+
+  if (options_mgr_->GetValue("CVMFS_SPLICE_READ", &optarg)
+      && options_mgr_->IsOn(optarg))
+  {
+    splice_read_ = true;
+  }
+
+  if (options_mgr_->GetValue("CVMFS_STREAM_LISTING", &optarg)
+      && options_mgr_->IsOn(optarg))
+  {
+    stream_listing_ = true;
+  }
+
+  if (options_mgr_->GetValue("CVMFS_KCACHE_SELECTIVE_INVALIDATION", &optarg)
+      && options_mgr_->IsOn(optarg))
+  {
+    selective_kcache_invalidation_ = true;
+  }
+
+  if (options_mgr_->GetValue("CVMFS_STABLE_INODES", &optarg)
+      && options_mgr_->IsOn(optarg) && !file_system_->IsNfsSource())
+  {
+    stable_inodes_ = true;
+  }
+
+  if (options_mgr_->GetValue("CVMFS_CATALOG_PRELOAD_LEAD", &optarg))
+    catalog_preload_lead_sec_ = String2Uint64(optarg);
+  if (options_mgr_->GetValue("CVMFS_REMOUNT_JITTER", &optarg))
+    remount_jitter_sec_ = String2Uint64(optarg);
+  if (options_mgr_->GetValue("CVMFS_CATALOG_IDLE_TIMEOUT", &optarg))
+    catalog_idle_timeout_sec_ = String2Uint64(optarg);
+  if (options_mgr_->GetValue("CVMFS_CATALOG_MEMORY_LIMIT", &optarg))
+    catalog_mem_limit_ = String2Uint64(optarg) * 1024 * 1024;
+
+  if (options_mgr_->GetValue("CVMFS_VOLATILE_FILE_SIZE", &optarg))
+    volatile_file_size_ = String2Uint64(optarg) * 1024 * 1024;
+  if (options_mgr_->GetValue("CVMFS_VOLATILE_FILE_PATHS", &optarg)) {
+    vector<string> patterns = SplitString(optarg, ':');
+    for (unsigned i = 0; i < patterns.size(); ++i) {
+      if (!patterns[i].empty())
+        volatile_file_patterns_.push_back(patterns[i]);
+    }
+  }
+
+  if (options_mgr_->GetValue("CVMFS_PARTIAL_FETCH_SIZE", &optarg))
+    partial_fetch_size_ = String2Uint64(optarg) * 1024 * 1024;
+  if (options_mgr_->GetValue("CVMFS_PREFETCH_GROUPS", &optarg))
+    prefetch_groups_ = options_mgr_->IsOn(optarg);
 }
 
 
@@ -1619,6 +2369,19 @@ void MountPoint::SetupDnsTuning(download::DownloadManager *manager) {
     download_mgr_->SetDnsServer(optarg);
   }
 
+  if (options_mgr_->GetValue("CVMFS_DNS_SHARED_CACHE", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    manager->EnableSharedDnsCache(file_system_->workspace() + "/dnscache");
+  }
+
+  unsigned geo_cache_ttl = download::DownloadManager::kGeoCacheDefaultTtl;
+  if (options_mgr_->GetValue("CVMFS_GEO_CACHE_TTL", &optarg))
+    geo_cache_ttl = String2Uint64(optarg);
+  if (geo_cache_ttl > 0)
+    manager->EnableGeoCache(file_system_->workspace() + "/geocache",
+                            geo_cache_ttl);
+
   if (options_mgr_->GetValue("CVMFS_IPFAMILY_PREFER", &optarg)) {
     switch (String2Int64(optarg)) {
       case 4:
@@ -1629,6 +2392,11 @@ void MountPoint::SetupDnsTuning(download::DownloadManager *manager) {
         break;
     }
   }
+  if (options_mgr_->GetValue("CVMFS_IPFAMILY_RACING", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    manager->SetIpPreference(dns::kIpPreferRace);
+  }
   if (options_mgr_->GetValue("CVMFS_MAX_IPADDR_PER_PROXY", &optarg))
     manager->SetMaxIpaddrPerProxy(String2Uint64(optarg));
 }
@@ -1663,15 +2431,19 @@ bool MountPoint::SetupExternalDownloadMgr(bool dogeosort) {
     external_download_mgr_->SetHostChain("");
   }
 
+  unsigned proxy_discovery_ttl = 0;
+  if (options_mgr_->GetValue("CVMFS_PROXY_DISCOVERY_TTL", &optarg))
+    proxy_discovery_ttl = String2Uint64(optarg);
   string proxies = "DIRECT";
   if (options_mgr_->GetValue("CVMFS_EXTERNAL_HTTP_PROXY", &optarg)) {
     proxies = download::ResolveProxyDescription(
       optarg,
       file_system_->workspace() + "/proxies-external" + GetUniqFileSuffix(),
-      external_download_mgr_);
+      external_download_mgr_,
+      proxy_discovery_ttl);
     if (proxies == "") {
-      boot_error_ = "failed to discover external HTTP proxy servers";
-      boot_status_ = loader::kFailWpad;
+      SetBootError(loader::kFailWpad,
+                   "failed to discover external HTTP proxy servers");
       return false;
     }
   }
@@ -1726,6 +2498,49 @@ void MountPoint::SetupHttpTuning() {
   {
     download_mgr_->EnableInfoHeader();
   }
+  if (options_mgr_->GetValue("CVMFS_PROXY_ADAPTIVE", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    download_mgr_->EnableAdaptiveProxies();
+  }
+  if (options_mgr_->GetValue("CVMFS_HTTP2", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    unsigned max_host_connections =
+      download::DownloadManager::kHttp2DefaultMaxHostConnections;
+    if (options_mgr_->GetValue("CVMFS_HTTP2_MAX_CONNECTIONS", &optarg))
+      max_host_connections = String2Uint64(optarg);
+    download_mgr_->EnableHttp2(max_host_connections);
+  }
+  if (options_mgr_->GetValue("CVMFS_HEDGED_REQUESTS", &optarg) &&
+      (String2Uint64(optarg) > 0))
+  {
+    download_mgr_->EnableHedgedRequests(String2Uint64(optarg));
+  }
+  if (options_mgr_->GetValue("CVMFS_DOWNLOAD_FAIR_SHARE", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    download_mgr_->EnableFairShare();
+  }
+  if (options_mgr_->GetValue("CVMFS_DOWNLOAD_PRIORITIES", &optarg) &&
+      options_mgr_->IsOn(optarg))
+  {
+    download_mgr_->EnablePriorities();
+  }
+  if (options_mgr_->GetValue("CVMFS_DOWNLOAD_WORKERS", &optarg) &&
+      (String2Uint64(optarg) > 0))
+  {
+    download_mgr_->EnableDataWorkers(String2Uint64(optarg));
+  }
+  if (options_mgr_->GetValue("CVMFS_STRIPED_DOWNLOADS", &optarg) &&
+      (String2Uint64(optarg) > 1))
+  {
+    const unsigned num_streams = String2Uint64(optarg);
+    uint64_t min_size = 0;
+    if (options_mgr_->GetValue("CVMFS_STRIPED_DOWNLOAD_MIN_SIZE", &optarg))
+      min_size = String2Uint64(optarg) * 1024 * 1024;
+    download_mgr_->EnableStriping(num_streams, min_size);
+  }
 }
 
 
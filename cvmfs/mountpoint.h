@@ -8,17 +8,20 @@
 #define CVMFS_MOUNTPOINT_H_
 
 #include <pthread.h>
+#include <stdint.h>
 #include <unistd.h>
 
 #include <ctime>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "cache.h"
 #include "gtest/gtest_prod.h"
 #include "hash.h"
 #include "loader.h"
+#include "shortstring.h"
 #include "util/pointer.h"
 
 class AuthzAttachment;
@@ -28,11 +31,17 @@ class BackoffThrottle;
 class CacheManager;
 namespace catalog {
 class ClientCatalogManager;
+class DirectoryEntry;
 class InodeGenerationAnnotation;
 }
 struct ChunkTables;
 namespace cvmfs {
+class AsyncExecutor;
+class ChunkPrefetcher;
 class Fetcher;
+class FetchTimingLog;
+class RuntimeConfigStore;
+class UidAccounting;
 class Uuid;
 }
 namespace download {
@@ -40,15 +49,24 @@ class DownloadManager;
 }
 namespace glue {
 class InodeTracker;
+class PageCacheTracker;
+}
+namespace history {
+class TagIndex;
 }
 namespace lru {
+class ChunkListCache;
 class InodeCache;
 class Md5PathCache;
 class PathCache;
+class XattrCache;
 }
+class Md5PathSnapshot;
 class OptionsManager;
 namespace perf {
 class Counter;
+class Histogram;
+class HistogramExporter;
 class Statistics;
 }
 namespace signature {
@@ -75,9 +93,24 @@ class BootFactory {
    */
   void set_boot_status(loader::Failures code) { boot_status_ = code; }
 
+  /**
+   * One line per boot stage with its wall clock duration, for cvmfs_talk.
+   */
+  std::string PrintBootTimings();
+
  protected:
+  /**
+   * Records the time since *start_ns for the given stage and sets *start_ns
+   * to the current time, so that consecutive stages can be chained.
+   */
+  void RecordBootStage(const std::string &stage, uint64_t *start_ns);
+
   loader::Failures boot_status_;
   std::string boot_error_;
+  /**
+   * Boot stages and their durations in nanoseconds
+   */
+  std::vector<std::pair<std::string, uint64_t> > boot_timings_;
 };
 
 
@@ -156,12 +189,17 @@ class FileSystem : SingleCopy, public BootFactory {
    * NFS maps maintained by sqlite so that they can reside on an NFS mount
    */
   static const unsigned kNfsMapsHa = 0x02;
+  /**
+   * NFS maps in an append-only log with memory mapped indexes, no leveldb
+   */
+  static const unsigned kNfsMapsMmap = 0x04;
 
   static FileSystem *Create(const FileSystemInfo &fs_info);
   ~FileSystem();
 
   bool IsNfsSource() { return nfs_mode_ & kNfsMaps; }
   bool IsHaNfsSource() { return nfs_mode_ & kNfsMapsHa; }
+  bool IsMmapNfsSource() { return nfs_mode_ & kNfsMapsMmap; }
   void ResetErrorCounters();
   void TearDown2ReadOnly();
 
@@ -169,12 +207,20 @@ class FileSystem : SingleCopy, public BootFactory {
   std::string cache_mgr_instance() { return cache_mgr_instance_; }
   std::string exe_path() { return exe_path_; }
   bool found_previous_crash() { return found_previous_crash_; }
+  perf::Histogram *lat_fs_getattr() { return lat_fs_getattr_; }
+  perf::Histogram *lat_fs_lookup() { return lat_fs_lookup_; }
+  perf::Histogram *lat_fs_open() { return lat_fs_open_; }
+  perf::Histogram *lat_fs_read() { return lat_fs_read_; }
+  perf::Counter *n_fs_async() { return n_fs_async_; }
+  perf::Counter *n_fs_async_rejected() { return n_fs_async_rejected_; }
   perf::Counter *n_fs_dir_open() { return n_fs_dir_open_; }
   perf::Counter *n_fs_forget() { return n_fs_forget_; }
   perf::Counter *n_fs_lookup() { return n_fs_lookup_; }
   perf::Counter *n_fs_lookup_negative() { return n_fs_lookup_negative_; }
   perf::Counter *n_fs_open() { return n_fs_open_; }
   perf::Counter *n_fs_read() { return n_fs_read_; }
+  perf::Counter *n_fs_readahead() { return n_fs_readahead_; }
+  perf::Counter *n_fs_readahead_dropped() { return n_fs_readahead_dropped_; }
   perf::Counter *n_fs_readlink() { return n_fs_readlink_; }
   perf::Counter *n_fs_stat() { return n_fs_stat_; }
   perf::Counter *n_io_error() { return n_io_error_; }
@@ -196,17 +242,35 @@ class FileSystem : SingleCopy, public BootFactory {
   static const unsigned kDefaultQuotaLimit = 1024 * 1024 * 1024;  // 1GB
   static const unsigned kDefaultNfiles = 8192;  // if CVMFS_NFILES is unset
   static const char *kDefaultCacheMgrInstance;  // "default"
+  /**
+   * Mapped size of catalogs if CVMFS_CATALOG_MMAP is set.  Larger catalogs
+   * are read through the page cache beyond that offset.
+   */
+  static const int64_t kCatalogMmapSize = 0x7fff0000;  // SQLITE_MAX_MMAP_SIZE
 
   struct PosixCacheSettings {
     PosixCacheSettings() :
       is_shared(false), is_alien(false), is_managed(false),
-      avoid_rename(false), cache_base_defined(false), cache_dir_defined(false),
-      quota_limit(0)
+      avoid_rename(false), compress(false), alien_locking(false),
+      shared_locking(false), cache_base_defined(false), cache_dir_defined(false), quota_limit(0),
+      fd_cache_size(0)
       { }
     bool is_shared;
     bool is_alien;
     bool is_managed;
     bool avoid_rename;
+    /**
+     * Keep regular objects compressed in the cache directory
+     */
+    bool compress;
+    /**
+     * Nodes sharing the alien cache fetch every object only once
+     */
+    bool alien_locking;
+    /**
+     * Mounts sharing the local cache fetch every object only once
+     */
+    bool shared_locking;
     bool cache_base_defined;
     bool cache_dir_defined;
     /**
@@ -214,6 +278,14 @@ class FileSystem : SingleCopy, public BootFactory {
      * cache when the limit is exceeded.
      */
     int64_t quota_limit;
+    /**
+     * Number of shared file descriptors of small objects, 0 if disabled.
+     */
+    unsigned fd_cache_size;
+    /**
+     * Name of the quota manager's eviction policy, "lru" or "slru".
+     */
+    std::string eviction_policy;
     std::string cache_path;
     /**
      * Different from cache_path only if CVMFS_WORKSPACE or
@@ -270,11 +342,19 @@ class FileSystem : SingleCopy, public BootFactory {
   perf::Counter *n_fs_lookup_negative_;
   perf::Counter *n_fs_stat_;
   perf::Counter *n_fs_read_;
+  perf::Counter *n_fs_readahead_;
+  perf::Counter *n_fs_readahead_dropped_;
+  perf::Counter *n_fs_async_;
+  perf::Counter *n_fs_async_rejected_;
   perf::Counter *n_fs_readlink_;
   perf::Counter *n_fs_forget_;
   perf::Counter *n_io_error_;
   perf::Counter *no_open_files_;
   perf::Counter *no_open_dirs_;
+  perf::Histogram *lat_fs_lookup_;
+  perf::Histogram *lat_fs_getattr_;
+  perf::Histogram *lat_fs_open_;
+  perf::Histogram *lat_fs_read_;
   perf::Statistics *statistics_;
 
   /**
@@ -340,6 +420,15 @@ class FileSystem : SingleCopy, public BootFactory {
    * down.
    */
   bool has_custom_sqlitevfs_;
+  /**
+   * Memory map catalogs that are read through the custom sqlite VFS.
+   */
+  bool has_sqlite_mmap_;
+  /**
+   * Catalogs up to this size in bytes are read into memory when opened by the
+   * custom sqlite VFS.  Zero keeps all catalogs file-backed.
+   */
+  uint64_t sqlite_mem_threshold_;
 };
 
 
@@ -371,10 +460,20 @@ class MountPoint : SingleCopy, public BootFactory {
   unsigned GetEffectiveTtlSec();
   void SetMaxTtlMn(unsigned value_minutes);
   void ReEvaluateAuthz();
-
+  void CacheInlineFile(const PathString &path,
+                       const catalog::DirectoryEntry &dirent);
+  void CacheBundledFile(const PathString &path,
+                        const catalog::DirectoryEntry &dirent);
+  void SaveMd5PathSnapshot();
+  void DropMd5PathSnapshot();
+  CacheManager::ObjectType GetObjectType(const PathString &path,
+                                         const uint64_t size);
+
+  cvmfs::AsyncExecutor *async_executor() { return async_executor_; }
   AuthzSessionManager *authz_session_mgr() { return authz_session_mgr_; }
   BackoffThrottle *backoff_throttle() { return backoff_throttle_; }
   catalog::ClientCatalogManager *catalog_mgr() { return catalog_mgr_; }
+  cvmfs::ChunkPrefetcher *chunk_prefetcher() { return chunk_prefetcher_; }
   ChunkTables *chunk_tables() { return chunk_tables_; }
   download::DownloadManager *download_mgr() { return download_mgr_; }
   download::DownloadManager *external_download_mgr() {
@@ -391,17 +490,40 @@ class MountPoint : SingleCopy, public BootFactory {
     return inode_annotation_;
   }
   glue::InodeTracker *inode_tracker() { return inode_tracker_; }
+  perf::HistogramExporter *histogram_exporter() {
+    return histogram_exporter_;
+  }
   lru::InodeCache *inode_cache() { return inode_cache_; }
+  unsigned catalog_preload_lead_sec() { return catalog_preload_lead_sec_; }
+  unsigned remount_jitter_sec() { return remount_jitter_sec_; }
+  unsigned catalog_idle_timeout_sec() { return catalog_idle_timeout_sec_; }
+  uint64_t catalog_mem_limit() { return catalog_mem_limit_; }
   double kcache_timeout_sec() { return kcache_timeout_sec_; }
+  double kcache_negative_timeout_sec() { return kcache_negative_timeout_sec_; }
   lru::Md5PathCache *md5path_cache() { return md5path_cache_; }
+  Md5PathSnapshot *md5path_snapshot() { return md5path_snapshot_; }
   std::string membership_req() { return membership_req_; }
   lru::PathCache *path_cache() { return path_cache_; }
   std::string repository_tag() { return repository_tag_; }
+  cvmfs::RuntimeConfigStore *runtime_config() { return runtime_config_; }
+  bool selective_kcache_invalidation() {
+    return selective_kcache_invalidation_;
+  }
+  bool splice_read() { return splice_read_; }
+  bool stable_inodes() { return stable_inodes_; }
+  glue::PageCacheTracker *page_cache_tracker() { return page_cache_tracker_; }
+  uint64_t partial_fetch_size() { return partial_fetch_size_; }
+  bool prefetch_groups() { return prefetch_groups_; }
+  bool stream_listing() { return stream_listing_; }
   SimpleChunkTables *simple_chunk_tables() { return simple_chunk_tables_; }
   perf::Statistics *statistics() { return statistics_; }
   signature::SignatureManager *signature_mgr() { return signature_mgr_; }
   Tracer *tracer() { return tracer_; }
+  cvmfs::FetchTimingLog *fetch_timing_log() { return fetch_timing_log_; }
+  cvmfs::UidAccounting *uid_accounting() { return uid_accounting_; }
   cvmfs::Uuid *uuid() { return uuid_; }
+  lru::XattrCache *xattr_cache() { return xattr_cache_; }
+  lru::ChunkListCache *chunk_list_cache() { return chunk_list_cache_; }
 
   bool ReloadBlacklists();
 
@@ -423,6 +545,14 @@ class MountPoint : SingleCopy, public BootFactory {
    * Cache seven times more md5 paths than inodes in the fuse module.
    */
   static const unsigned kInodeCacheFactor = 7;
+  /**
+   * Only few inodes have custom extended attributes.
+   */
+  static const unsigned kXattrCacheSize = 4096;
+  /**
+   * Chunk lists of the recently opened chunked files
+   */
+  static const unsigned kChunkListCacheSize = 1024;
   /**
    * Default to 16M RAM for meta-data caches; does not include the inode tracker
    */
@@ -447,21 +577,58 @@ class MountPoint : SingleCopy, public BootFactory {
    */
   static const unsigned kTracerBufferSize = 8192;
   static const unsigned kTracerFlushThreshold = 7000;
+  /**
+   * Interval of the latency histogram export (CVMFS_LATENCY_EXPORT)
+   */
+  static const unsigned kDefaultLatencyExportIntervalSec = 60;
+  /**
+   * Interval of the catalog heat map dumps (CVMFS_CATALOG_HEATMAP)
+   */
+  static const unsigned kDefaultHeatmapIntervalSec = 300;
+  /**
+   * Read-ahead of chunked files is disabled by default.  If enabled, the
+   * default number of read-ahead worker threads is used unless specified.
+   */
+  static const unsigned kDefaultReadAheadChunks = 0;
+  static const unsigned kDefaultReadAheadThreads = 2;
+  /**
+   * By default, the fuse callbacks download objects in the libfuse threads.
+   */
+  static const unsigned kDefaultAsyncFuseThreads = 0;
   static const char *kDefaultBlacklist;  // "/etc/cvmfs/blacklist"
 
   MountPoint(const std::string &fqrn,
              FileSystem *file_system,
              OptionsManager *options_mgr);
 
+  /**
+   * The public keys are loaded in parallel with the download manager setup,
+   * which can take a while due to proxy auto-discovery, DNS, and the Geo-API.
+   */
+  struct KeyLoader {
+    KeyLoader() : mountpoint(NULL), result(false), duration_ns(0) { }
+    MountPoint *mountpoint;
+    bool result;
+    uint64_t duration_ns;
+  };
+  static void *MainKeyLoader(void *data);
+
   void CreateStatistics();
   void CreateAuthz();
-  bool CreateSignatureManager();
+  void CreateSignatureManager();
+  bool LoadPublicKeys();
   bool CheckBlacklists();
-  bool CreateDownloadManagers();
+  void CreateDownloadManager();
+  bool SetupDownloadManagers();
+  void SetBootError(loader::Failures status, const std::string &error);
   void CreateFetchers();
+  void CreateChunkPrefetcher();
+  void CreateAsyncExecutor();
   bool CreateCatalogManager();
   void CreateTables();
+  void CreateMd5PathSnapshot();
   bool CreateTracer();
+  void CreateHistogramExporter();
   void SetupBehavior();
   void SetupDnsTuning(download::DownloadManager *manager);
   void SetupHttpTuning();
@@ -469,7 +636,8 @@ class MountPoint : SingleCopy, public BootFactory {
   void SetupInodeAnnotation();
   bool SetupOwnerMaps();
   bool DetermineRootHash(shash::Any *root_hash);
-  bool FetchHistory(std::string *history_path);
+  bool FetchHistory(const shash::Any &history_hash, std::string *history_path);
+  history::TagIndex *FetchTagIndex(const shash::Any &tag_index_hash);
   std::string ReplaceHosts(std::string hosts);
   std::string GetUniqFileSuffix();
 
@@ -494,6 +662,19 @@ class MountPoint : SingleCopy, public BootFactory {
   download::DownloadManager *external_download_mgr_;
   cvmfs::Fetcher *fetcher_;
   cvmfs::Fetcher *external_fetcher_;
+  /**
+   * Shared by both fetchers.  Logs to syslog above CVMFS_SLOW_FETCH_THRESHOLD.
+   */
+  cvmfs::FetchTimingLog *fetch_timing_log_;
+  /**
+   * NULL unless CVMFS_UID_ACCOUNTING is set.  Shared by both fetchers.
+   */
+  cvmfs::UidAccounting *uid_accounting_;
+  cvmfs::ChunkPrefetcher *chunk_prefetcher_;
+  /**
+   * NULL unless fuse requests that need downloads are answered asynchronously
+   */
+  cvmfs::AsyncExecutor *async_executor_;
   catalog::InodeGenerationAnnotation *inode_annotation_;
   catalog::ClientCatalogManager *catalog_mgr_;
   ChunkTables *chunk_tables_;
@@ -501,14 +682,100 @@ class MountPoint : SingleCopy, public BootFactory {
   lru::InodeCache *inode_cache_;
   lru::PathCache *path_cache_;
   lru::Md5PathCache *md5path_cache_;
+  lru::XattrCache *xattr_cache_;
+  lru::ChunkListCache *chunk_list_cache_;
+  /**
+   * Negative md5 path cache entries of a previous mount of the same root
+   * catalog.  NULL unless CVMFS_NEGATIVE_CACHE_SNAPSHOT is set.
+   */
+  Md5PathSnapshot *md5path_snapshot_;
+  /**
+   * The kernel cache timeouts and the reload modes, read on every request
+   */
+  cvmfs::RuntimeConfigStore *runtime_config_;
+  /**
+   * NULL unless the kernel page cache of unchanged files is kept on open
+   */
+  glue::PageCacheTracker *page_cache_tracker_;
+  std::string md5path_snapshot_path_;
   Tracer *tracer_;
+  /**
+   * NULL unless CVMFS_LATENCY_EXPORT is set
+   */
+  perf::HistogramExporter *histogram_exporter_;
   glue::InodeTracker *inode_tracker_;
 
   unsigned max_ttl_sec_;
   pthread_mutex_t lock_max_ttl_;
+  /**
+   * Protects the boot error while boot stages run in parallel
+   */
+  pthread_mutex_t lock_boot_error_;
   double kcache_timeout_sec_;
+  /**
+   * For ENOENT lookup replies, defaults to kcache_timeout_sec_.
+   */
+  double kcache_negative_timeout_sec_;
   bool fixed_catalog_;
   bool hide_magic_xattrs_;
+  /**
+   * Reply to reads from the POSIX cache with fuse_reply_data() on the cache
+   * file descriptor instead of copying through a user space buffer.
+   */
+  bool splice_read_;
+  /**
+   * Directory handles page through the catalog listing instead of holding
+   * the complete listing.
+   */
+  bool stream_listing_;
+  /**
+   * On a new revision, evict only the entries that changed from the kernel
+   * caches instead of all the known entries.
+   */
+  bool selective_kcache_invalidation_;
+  /**
+   * New entries get inodes derived from their path and their attributes, so
+   * that unchanged entries keep their inode across catalog revisions.
+   */
+  bool stable_inodes_;
+  /**
+   * If non-zero, the catalogs of a new revision are downloaded that many
+   * seconds before the catalog TTL expires.
+   */
+  unsigned catalog_preload_lead_sec_;
+  /**
+   * The remount trigger looks for a new revision up to that many seconds
+   * after the catalog TTL expired.  Spreads the requests of clients that
+   * otherwise would switch to a new revision at the same time.
+   */
+  unsigned remount_jitter_sec_;
+  /**
+   * If non-zero, nested catalogs that were not accessed for that many seconds
+   * are detached as long as the attached catalogs use more than
+   * catalog_mem_limit_ bytes.
+   */
+  unsigned catalog_idle_timeout_sec_;
+  uint64_t catalog_mem_limit_;
+  /**
+   * Files larger than volatile_file_size_ bytes (0 = disabled) are stored as
+   * volatile objects if their path matches one of the shell wildcard patterns
+   * (or if there are no patterns).  Volatile objects are the first to be
+   * evicted, so that large files read once do not push out the rest.
+   */
+  uint64_t volatile_file_size_;
+  std::vector<std::string> volatile_file_patterns_;
+  /**
+   * Uncompressed, non-chunked files larger than partial_fetch_size_ bytes
+   * (0 = disabled) are opened without waiting for the download.  Reads are
+   * served by range requests while the object is fetched in the background.
+   * Only applies to files with block digests in the catalog.
+   */
+  uint64_t partial_fetch_size_;
+  /**
+   * Opening a file that belongs to a prefetch group of the catalog schedules
+   * the other files of the group for read-ahead.  On by default.
+   */
+  bool prefetch_groups_;
   std::string repository_tag_;
   std::vector<std::string> blacklist_paths_;
 
@@ -32,6 +32,7 @@
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "logging.h"
+#include "nfs_mmap_maps.h"
 #include "nfs_shared_maps.h"
 #include "util/posix.h"
 #include "util/string.h"
@@ -55,6 +56,8 @@ bool spawned_ = false;  // Set to true after fork()
 // If true, use sqlite db that can be put on a shared NFS volume.
 // See nfs_shared_maps
 bool use_shared_db_ = false;
+// If true, use the append-only log and mmap'd indexes of nfs_mmap_maps
+bool use_mmap_db_ = false;
 
 
 // Leveldb's background threads must not be started before cvmfs has forked.
@@ -199,6 +202,8 @@ static uint64_t FindInode(const shash::Md5 &path) {
 uint64_t GetInode(const PathString &path) {
   if (use_shared_db_)
     return nfs_shared_maps::GetInode(path);
+  if (use_mmap_db_)
+    return nfs_mmap_maps::GetInode(path);
 
   const shash::Md5 md5_path(path.GetChars(), path.GetLength());
   uint64_t inode = FindInode(md5_path);
@@ -232,6 +237,8 @@ uint64_t GetInode(const PathString &path) {
 bool GetPath(const uint64_t inode, PathString *path) {
   if (use_shared_db_)
     return nfs_shared_maps::GetPath(inode, path);
+  if (use_mmap_db_)
+    return nfs_mmap_maps::GetPath(inode, path);
 
   leveldb::Status status;
   leveldb::Slice key(reinterpret_cast<const char *>(&inode), sizeof(inode));
@@ -261,6 +268,8 @@ bool GetPath(const uint64_t inode, PathString *path) {
 string GetStatistics() {
   if (use_shared_db_)
     return nfs_shared_maps::GetStatistics();
+  if (use_mmap_db_)
+    return nfs_mmap_maps::GetStatistics();
 
   string result = "Total number of issued inodes: " +
                   StringifyInt(seq_-root_inode_) + "\n";
@@ -277,11 +286,14 @@ string GetStatistics() {
 
 
 bool Init(const string &leveldb_dir, const uint64_t root_inode,
-          const bool rebuild, const bool shared_db)
+          const bool rebuild, const bool shared_db, const bool mmap_db)
 {
   use_shared_db_ = shared_db;
-  if (shared_db)
+  use_mmap_db_ = mmap_db && !shared_db;
+  if (use_shared_db_)
     return nfs_shared_maps::Init(leveldb_dir, root_inode, rebuild);
+  if (use_mmap_db_)
+    return nfs_mmap_maps::Init(leveldb_dir, root_inode, rebuild);
 
   assert(root_inode > 0);
   root_inode_ = root_inode;
@@ -358,6 +370,10 @@ void Spawn() {
     nfs_shared_maps::Spawn();
     return;
   }
+  if (use_mmap_db_) {
+    nfs_mmap_maps::Spawn();
+    return;
+  }
   spawned_ = true;
 }
 
@@ -365,6 +381,8 @@ void Spawn() {
 void Fini() {
   if (use_shared_db_)
     return nfs_shared_maps::Fini();
+  if (use_mmap_db_)
+    return nfs_mmap_maps::Fini();
 
   // Write highest issued sequence number
   PutPath2Inode(shash::Md5(shash::AsciiPtr("?seq")), seq_);
@@ -0,0 +1,678 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * NFS maps without a key-value store.  The paths are appended to a log in the
+ * order in which their inodes are issued, so that the log alone determines
+ * the maps.  Two indexes point into the log: an array of log offsets indexed
+ * by inode and an open addressing hash table from the path hash to the inode.
+ * All three files are mapped MAP_SHARED, new entries are memcpy()'d into the
+ * page cache and survive a crash of the cvmfs process.
+ *
+ * Only the log needs to be durable.  The indexes are rebuilt from the log if
+ * they were not closed cleanly.  A background thread syncs the log every
+ * kCommitIntervalMs if new inodes have been issued, so that many new inodes
+ * share one fsync() (group commit).
+ *
+ * New inodes are issued under a lock.  Lookups do not take a lock: an entry
+ * is fully written before the slot or the inode counter that makes it
+ * visible.  Files that grow are mapped again; previous mappings stay valid
+ * until Fini() because concurrent readers might still use them.
+ *
+ * The maps are not accounted for by the cache quota.
+ */
+
+#define __STDC_FORMAT_MACROS
+
+#include "cvmfs_config.h"
+#include "nfs_mmap_maps.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "atomic.h"
+#include "hash.h"
+#include "logging.h"
+#include "platform.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace nfs_mmap_maps {
+
+static const uint32_t kMagicLog = 0x4c534643;    // "CFSL"
+static const uint32_t kMagicIndex = 0x49534643;  // "CFSI"
+static const uint32_t kMagicTable = 0x54534643;  // "CFST"
+static const uint32_t kVersion = 1;
+static const uint64_t kHeaderSize = 64;
+static const uint64_t kPageSize = 4096;
+static const uint64_t kInitialLogSize = 1024 * 1024;
+static const uint64_t kInitialIndexSize = 64 * 1024;
+static const uint64_t kInitialCapacity = 4096;
+static const int kCommitIntervalMs = 500;
+
+/**
+ * Occupies the first kHeaderSize bytes of every file.  Not all fields are
+ * used in every file.
+ */
+struct FileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t root_inode;
+  uint64_t num_inodes;
+  uint64_t log_size;
+  uint64_t capacity;
+  uint64_t num_entries;
+  uint32_t clean;
+  uint32_t padding;
+};
+
+/**
+ * Followed by the path, padded to a multiple of 8 bytes.  The inode is
+ * written last.  The checksum detects torn records after a crash.
+ */
+struct LogRecord {
+  uint64_t inode;
+  uint32_t length;
+  uint32_t checksum;
+};
+
+struct Slot {
+  uint64_t md5_lo;
+  uint64_t md5_hi;
+  uint64_t inode;  // 0 for an empty slot
+};
+
+
+/**
+ * A file that is mapped MAP_SHARED as a whole.  Grow() enlarges the file and
+ * maps it again at a new address.  The previous mapping remains valid until
+ * Close().
+ */
+class SharedFile {
+ public:
+  SharedFile() : fd_(-1), base_(NULL), size_(0) { }
+  ~SharedFile() { Close(); }
+  bool Open(const string &path, const uint64_t min_size);
+  bool Grow(const uint64_t min_size);
+  bool Sync();
+  void Close();
+
+  unsigned char *base() const {
+    unsigned char *result = base_;
+    MemoryFence();
+    return result;
+  }
+  FileHeader *header() const { return reinterpret_cast<FileHeader *>(base()); }
+  uint64_t size() const { return size_; }
+  int fd() const { return fd_; }
+
+ private:
+  int fd_;
+  unsigned char * volatile base_;
+  uint64_t size_;
+  vector<pair<unsigned char *, uint64_t> > retired_;
+};
+
+
+bool SharedFile::Open(const string &path, const uint64_t min_size) {
+  assert(min_size >= kHeaderSize);
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd_ < 0) {
+    LogCvmfs(kLogNfsMaps, kLogDebug, "failed to open %s (%d)",
+             path.c_str(), errno);
+    return false;
+  }
+  platform_stat64 info;
+  if (platform_fstat(fd_, &info) != 0) {
+    Close();
+    return false;
+  }
+  size_ = info.st_size;
+  if (size_ < min_size) {
+    size_ = ((min_size + kPageSize - 1) / kPageSize) * kPageSize;
+    if (ftruncate(fd_, size_) != 0) {
+      LogCvmfs(kLogNfsMaps, kLogDebug, "failed to resize %s (%d)",
+               path.c_str(), errno);
+      Close();
+      return false;
+    }
+  }
+  void *mapping = mmap(NULL, size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd_, 0);
+  if (mapping == MAP_FAILED) {
+    LogCvmfs(kLogNfsMaps, kLogDebug, "failed to map %s (%d)",
+             path.c_str(), errno);
+    Close();
+    return false;
+  }
+  base_ = static_cast<unsigned char *>(mapping);
+  return true;
+}
+
+
+bool SharedFile::Grow(const uint64_t min_size) {
+  uint64_t new_size = size_;
+  while (new_size < min_size)
+    new_size *= 2;
+  if (ftruncate(fd_, new_size) != 0)
+    return false;
+  void *mapping = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd_, 0);
+  if (mapping == MAP_FAILED)
+    return false;
+  retired_.push_back(make_pair(base_, size_));
+  MemoryFence();
+  base_ = static_cast<unsigned char *>(mapping);
+  size_ = new_size;
+  return true;
+}
+
+
+/**
+ * Writes the dirty pages of the mapping to disk.  Used by the clean shutdown
+ * only, the committer thread uses fsync() on the file descriptor.
+ */
+bool SharedFile::Sync() {
+  return msync(base_, size_, MS_SYNC) == 0;
+}
+
+
+void SharedFile::Close() {
+  for (unsigned i = 0; i < retired_.size(); ++i)
+    munmap(retired_[i].first, retired_[i].second);
+  retired_.clear();
+  if (base_ != NULL)
+    munmap(base_, size_);
+  base_ = NULL;
+  size_ = 0;
+  if (fd_ >= 0)
+    close(fd_);
+  fd_ = -1;
+}
+
+
+/**
+ * The capacity is a power of 2 and at least twice the number of entries, so
+ * that the linear probing always finds an empty slot.  A table never grows in
+ * place, it is replaced by a table with twice the capacity.
+ */
+struct PathTable {
+  PathTable() : capacity(0), num_entries(0) { }
+  Slot *slots() const {
+    return reinterpret_cast<Slot *>(file.base() + kHeaderSize);
+  }
+
+  SharedFile file;
+  uint64_t capacity;
+  uint64_t num_entries;
+};
+
+
+string *db_dir_ = NULL;
+uint64_t root_inode_;
+SharedFile *log_ = NULL;
+SharedFile *index_ = NULL;
+PathTable * volatile table_ = NULL;
+vector<PathTable *> *retired_tables_ = NULL;
+/**
+ * Used bytes of the log, protected by lock_
+ */
+uint64_t log_size_;
+/**
+ * Published after the log record and the log offset of an inode are written
+ */
+atomic_int64 num_inodes_;
+atomic_int64 num_commits_;
+pthread_mutex_t lock_ = PTHREAD_MUTEX_INITIALIZER;
+bool spawned_ = false;
+pthread_t thread_commit_;
+int pipe_terminate_[2];
+
+
+static string LogPath() { return *db_dir_ + "/paths.log"; }
+static string IndexPath() { return *db_dir_ + "/inodes.idx"; }
+static string TablePath() { return *db_dir_ + "/paths.idx"; }
+
+
+static uint32_t Checksum(const uint64_t md5_lo) {
+  return static_cast<uint32_t>(md5_lo);
+}
+
+
+static PathTable *CreateTable(const string &path, const uint64_t capacity) {
+  unlink(path.c_str());
+  PathTable *table = new PathTable();
+  if (!table->file.Open(path, kHeaderSize + capacity * sizeof(Slot))) {
+    delete table;
+    return NULL;
+  }
+  table->capacity = capacity;
+  FileHeader *header = table->file.header();
+  header->magic = kMagicTable;
+  header->version = kVersion;
+  header->capacity = capacity;
+  return table;
+}
+
+
+/**
+ * Returns NULL if the table does not exist or is not usable.
+ */
+static PathTable *OpenTable(const string &path) {
+  PathTable *table = new PathTable();
+  if (!table->file.Open(path, kHeaderSize)) {
+    delete table;
+    return NULL;
+  }
+  const FileHeader *header = table->file.header();
+  const uint64_t capacity = header->capacity;
+  if ((header->magic != kMagicTable) || (header->version != kVersion) ||
+      (capacity == 0) || ((capacity & (capacity - 1)) != 0) ||
+      (2 * header->num_entries > capacity) ||
+      (kHeaderSize + capacity * sizeof(Slot) > table->file.size()))
+  {
+    delete table;
+    return NULL;
+  }
+  table->capacity = capacity;
+  table->num_entries = header->num_entries;
+  return table;
+}
+
+
+/**
+ * Lock-free.  A slot is visible once its inode is set.
+ */
+static uint64_t FindInode(const shash::Md5 &md5path) {
+  uint64_t md5_lo, md5_hi;
+  md5path.ToIntPair(&md5_lo, &md5_hi);
+  const PathTable *table = table_;
+  MemoryFence();
+  const Slot *slots = table->slots();
+  const uint64_t mask = table->capacity - 1;
+  for (uint64_t i = md5_lo & mask; ; i = (i + 1) & mask) {
+    const uint64_t inode =
+      *reinterpret_cast<const volatile uint64_t *>(&slots[i].inode);
+    if (inode == 0)
+      return 0;
+    MemoryFence();
+    if ((slots[i].md5_lo == md5_lo) && (slots[i].md5_hi == md5_hi))
+      return inode;
+  }
+}
+
+
+/**
+ * Called with lock_ held or before the maps are in use.
+ */
+static void InsertSlot(
+  PathTable *table,
+  const uint64_t md5_lo,
+  const uint64_t md5_hi,
+  const uint64_t inode)
+{
+  Slot *slots = table->slots();
+  const uint64_t mask = table->capacity - 1;
+  uint64_t i = md5_lo & mask;
+  while (slots[i].inode != 0)
+    i = (i + 1) & mask;
+  slots[i].md5_lo = md5_lo;
+  slots[i].md5_hi = md5_hi;
+  atomic_write64(reinterpret_cast<atomic_int64 *>(&slots[i].inode), inode);
+  table->num_entries++;
+}
+
+
+/**
+ * Rehashes into a table of twice the size that replaces the current one.
+ * Readers on the old table that miss an entry retry under the lock.
+ */
+static bool GrowTable() {
+  PathTable *table = table_;
+  PathTable *new_table =
+    CreateTable(TablePath() + ".tmp", 2 * table->capacity);
+  if (new_table == NULL)
+    return false;
+  const Slot *slots = table->slots();
+  for (uint64_t i = 0; i < table->capacity; ++i) {
+    if (slots[i].inode != 0)
+      InsertSlot(new_table, slots[i].md5_lo, slots[i].md5_hi, slots[i].inode);
+  }
+  if (rename((TablePath() + ".tmp").c_str(), TablePath().c_str()) != 0) {
+    delete new_table;
+    return false;
+  }
+  MemoryFence();
+  table_ = new_table;
+  retired_tables_->push_back(table);
+  LogCvmfs(kLogNfsMaps, kLogDebug, "grew path table to %" PRIu64 " slots",
+           new_table->capacity);
+  return true;
+}
+
+
+/**
+ * Makes the log record at offset the record of the next inode.  Called with
+ * lock_ held or before the maps are in use.
+ */
+static uint64_t IndexRecord(
+  const uint64_t offset,
+  const uint64_t md5_lo,
+  const uint64_t md5_hi)
+{
+  const uint64_t idx = atomic_read64(&num_inodes_);
+  const uint64_t index_size = kHeaderSize + (idx + 1) * sizeof(uint64_t);
+  if ((index_size > index_->size()) && !index_->Grow(index_size)) {
+    LogCvmfs(kLogNfsMaps, kLogSyslogErr, "failed to grow inode index (%d)",
+             errno);
+    abort();
+  }
+  reinterpret_cast<uint64_t *>(index_->base() + kHeaderSize)[idx] = offset;
+  atomic_inc64(&num_inodes_);
+
+  if ((2 * (table_->num_entries + 1) > table_->capacity) && !GrowTable()) {
+    LogCvmfs(kLogNfsMaps, kLogSyslogErr, "failed to grow path table (%d)",
+             errno);
+    abort();
+  }
+  InsertSlot(table_, md5_lo, md5_hi, root_inode_ + idx);
+  return root_inode_ + idx;
+}
+
+
+/**
+ * Appends the path to the log and indexes it.  Called with lock_ held.
+ */
+static uint64_t IssueInode(const PathString &path, const shash::Md5 &md5path) {
+  uint64_t md5_lo, md5_hi;
+  md5path.ToIntPair(&md5_lo, &md5_hi);
+  const uint64_t record_size =
+    (sizeof(LogRecord) + path.GetLength() + 7) & ~uint64_t(7);
+  if ((log_size_ + record_size > log_->size()) &&
+      !log_->Grow(log_size_ + record_size))
+  {
+    LogCvmfs(kLogNfsMaps, kLogSyslogErr, "failed to grow paths log (%d)",
+             errno);
+    abort();
+  }
+
+  LogRecord *record = reinterpret_cast<LogRecord *>(log_->base() + log_size_);
+  memcpy(record + 1, path.GetChars(), path.GetLength());
+  record->length = path.GetLength();
+  record->checksum = Checksum(md5_lo);
+  atomic_write64(reinterpret_cast<atomic_int64 *>(&record->inode),
+                 root_inode_ + atomic_read64(&num_inodes_));
+  const uint64_t offset = log_size_;
+  log_size_ += record_size;
+  return IndexRecord(offset, md5_lo, md5_hi);
+}
+
+
+/**
+ * Replays the log.  Stops at the first record that was not written
+ * completely.
+ */
+static bool RebuildIndexes() {
+  LogCvmfs(kLogNfsMaps, kLogDebug | kLogSyslogWarn,
+           "rebuilding NFS maps index from %s", LogPath().c_str());
+  if (table_ != NULL)
+    delete table_;
+  table_ = CreateTable(TablePath(), kInitialCapacity);
+  if (table_ == NULL)
+    return false;
+
+  atomic_write64(&num_inodes_, 0);
+  log_size_ = kHeaderSize;
+  while (log_size_ + sizeof(LogRecord) <= log_->size()) {
+    const LogRecord *record =
+      reinterpret_cast<const LogRecord *>(log_->base() + log_size_);
+    if (record->inode != root_inode_ + atomic_read64(&num_inodes_))
+      break;
+    const uint64_t record_size =
+      (sizeof(LogRecord) + record->length + 7) & ~uint64_t(7);
+    if (log_size_ + record_size > log_->size())
+      break;
+    const shash::Md5 md5path(reinterpret_cast<const char *>(record + 1),
+                             record->length);
+    uint64_t md5_lo, md5_hi;
+    md5path.ToIntPair(&md5_lo, &md5_hi);
+    if (record->checksum != Checksum(md5_lo))
+      break;
+    IndexRecord(log_size_, md5_lo, md5_hi);
+    log_size_ += record_size;
+  }
+  LogCvmfs(kLogNfsMaps, kLogDebug, "recovered %" PRId64 " inodes",
+           atomic_read64(&num_inodes_));
+  return true;
+}
+
+
+static void *MainCommit(void *data __attribute__((unused))) {
+  LogCvmfs(kLogNfsMaps, kLogDebug, "starting NFS maps committer");
+  struct pollfd watch_term;
+  watch_term.fd = pipe_terminate_[0];
+  watch_term.events = POLLIN | POLLPRI;
+  int64_t num_committed = 0;
+  while (true) {
+    watch_term.revents = 0;
+    const int retval = poll(&watch_term, 1, kCommitIntervalMs);
+    if (retval < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (retval > 0)
+      break;
+
+    const int64_t num_inodes = atomic_read64(&num_inodes_);
+    if (num_inodes == num_committed)
+      continue;
+    // Also writes back the pages that were dirtied through the mapping
+    if (fsync(log_->fd()) != 0) {
+      LogCvmfs(kLogNfsMaps, kLogSyslogErr, "failed to sync paths log (%d)",
+               errno);
+      continue;
+    }
+    num_committed = num_inodes;
+    atomic_inc64(&num_commits_);
+  }
+  LogCvmfs(kLogNfsMaps, kLogDebug, "stopping NFS maps committer");
+  return NULL;
+}
+
+
+/**
+ * Finds the inode for path or issues a new inode.
+ */
+uint64_t GetInode(const PathString &path) {
+  const shash::Md5 md5path(path.GetChars(), path.GetLength());
+  uint64_t inode = FindInode(md5path);
+  if (inode != 0)
+    return inode;
+
+  pthread_mutex_lock(&lock_);
+  // Search again to avoid race
+  inode = FindInode(md5path);
+  if (inode == 0)
+    inode = IssueInode(path, md5path);
+  pthread_mutex_unlock(&lock_);
+  return inode;
+}
+
+
+/**
+ * Finds the path that belongs to an inode.  The inode input comes from the
+ * file system, i.e. it must have been issued before.  Lock-free.
+ * \return false if not found
+ */
+bool GetPath(const uint64_t inode, PathString *path) {
+  const uint64_t num_inodes = atomic_read64(&num_inodes_);
+  if ((inode < root_inode_) || (inode - root_inode_ >= num_inodes)) {
+    LogCvmfs(kLogNfsMaps, kLogDebug,
+             "failed to find inode %" PRIu64 " in NFS maps, returning ESTALE",
+             inode);
+    return false;
+  }
+  const uint64_t offset = reinterpret_cast<const uint64_t *>(
+    index_->base() + kHeaderSize)[inode - root_inode_];
+  const LogRecord *record =
+    reinterpret_cast<const LogRecord *>(log_->base() + offset);
+  path->Assign(reinterpret_cast<const char *>(record + 1), record->length);
+  LogCvmfs(kLogNfsMaps, kLogDebug, "inode %" PRIu64 " maps to path %s",
+           inode, path->c_str());
+  return true;
+}
+
+
+string GetStatistics() {
+  pthread_mutex_lock(&lock_);
+  string result = "Total number of issued inodes: " +
+                  StringifyInt(atomic_read64(&num_inodes_)) + "\n";
+  result += "Size of the paths log: " + StringifyInt(log_size_) + "\n";
+  result += "Path table: " + StringifyInt(table_->num_entries) + " entries, " +
+            StringifyInt(table_->capacity) + " slots\n";
+  result += "Group commits: " + StringifyInt(atomic_read64(&num_commits_)) +
+            "\n";
+  pthread_mutex_unlock(&lock_);
+  return result;
+}
+
+
+/**
+ * If rebuild is set, the indexes are recovered from the log.  Unlike the
+ * leveldb maps, the inodes issued before a crash remain valid.
+ */
+bool Init(const string &db_dir, const uint64_t root_inode,
+          const bool rebuild)
+{
+  assert(root_inode > 0);
+  db_dir_ = new string(db_dir);
+  root_inode_ = root_inode;
+  atomic_init64(&num_inodes_);
+  atomic_init64(&num_commits_);
+  log_size_ = kHeaderSize;
+  log_ = new SharedFile();
+  index_ = new SharedFile();
+  retired_tables_ = new vector<PathTable *>();
+
+  if (!log_->Open(LogPath(), kInitialLogSize) ||
+      !index_->Open(IndexPath(), kInitialIndexSize))
+  {
+    return false;
+  }
+  FileHeader *log_header = log_->header();
+  if (log_header->magic == 0) {
+    log_header->magic = kMagicLog;
+    log_header->version = kVersion;
+  } else if ((log_header->magic != kMagicLog) ||
+             (log_header->version != kVersion))
+  {
+    LogCvmfs(kLogNfsMaps, kLogDebug | kLogSyslogErr,
+             "unknown format of NFS maps log %s", LogPath().c_str());
+    return false;
+  }
+
+  FileHeader *index_header = index_->header();
+  bool valid = !rebuild && (index_header->magic == kMagicIndex) &&
+               (index_header->version == kVersion) &&
+               (index_header->root_inode == root_inode_) &&
+               (index_header->clean == 1) &&
+               (index_header->log_size >= kHeaderSize) &&
+               (index_header->log_size <= log_->size()) &&
+               (kHeaderSize + index_header->num_inodes * sizeof(uint64_t) <=
+                index_->size());
+  if (valid) {
+    table_ = OpenTable(TablePath());
+    valid = (table_ != NULL) &&
+            (table_->num_entries == index_header->num_inodes);
+  }
+  if (valid) {
+    atomic_write64(&num_inodes_, index_header->num_inodes);
+    log_size_ = index_header->log_size;
+  } else if (!RebuildIndexes()) {
+    return false;
+  }
+
+  // Marked clean again by Fini()
+  index_header = index_->header();
+  index_header->magic = kMagicIndex;
+  index_header->version = kVersion;
+  index_header->root_inode = root_inode_;
+  index_header->clean = 0;
+  if (msync(index_header, kHeaderSize, MS_SYNC) != 0)
+    return false;
+
+  LogCvmfs(kLogNfsMaps, kLogDebug, "NFS maps opened, %" PRId64 " inodes",
+           atomic_read64(&num_inodes_));
+  if (atomic_read64(&num_inodes_) == 0) {
+    // Insert root inode
+    PathString root_path;
+    GetInode(root_path);
+  }
+  return true;
+}
+
+
+/**
+ * The committer thread must not be started before cvmfs has forked.
+ */
+void Spawn() {
+  MakePipe(pipe_terminate_);
+  int retval = pthread_create(&thread_commit_, NULL, MainCommit, NULL);
+  assert(retval == 0);
+  spawned_ = true;
+}
+
+
+void Fini() {
+  if (spawned_) {
+    char c = 'T';
+    WritePipe(pipe_terminate_[1], &c, 1);
+    pthread_join(thread_commit_, NULL);
+    ClosePipe(pipe_terminate_);
+    spawned_ = false;
+  }
+
+  if ((log_ != NULL) && (index_ != NULL) && (table_ != NULL)) {
+    FileHeader *table_header = table_->file.header();
+    table_header->num_entries = table_->num_entries;
+    FileHeader *index_header = index_->header();
+    index_header->num_inodes = atomic_read64(&num_inodes_);
+    index_header->log_size = log_size_;
+    // The indexes are only usable if everything before reached the disk
+    if (log_->Sync() && table_->file.Sync() && index_->Sync()) {
+      index_header->clean = 1;
+      index_->Sync();
+    }
+    LogCvmfs(kLogNfsMaps, kLogDebug, "NFS maps closed");
+  }
+
+  if (retired_tables_ != NULL) {
+    for (unsigned i = 0; i < retired_tables_->size(); ++i)
+      delete (*retired_tables_)[i];
+  }
+  delete retired_tables_;
+  delete table_;
+  delete index_;
+  delete log_;
+  delete db_dir_;
+  retired_tables_ = NULL;
+  table_ = NULL;
+  index_ = NULL;
+  log_ = NULL;
+  db_dir_ = NULL;
+}
+
+}  // namespace nfs_mmap_maps
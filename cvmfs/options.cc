@@ -119,6 +119,126 @@ bool SimpleOptionsParser::TryParsePath(const string &config_file) {
 }
 
 
+/**
+ * Recognizes a line that assigns a literal value to a parameter, such as
+ *   KEY=value, export KEY="value", KEY='value'  # comment
+ * The value must evaluate to itself in a shell, also after the word splitting
+ * and pathname expansion of the "echo $KEY" that reads it back from the shell.
+ * Everything else, including readonly parameters, is left to the shell.
+ *
+ * @return false if the line is not a literal assignment
+ */
+bool BashOptionsManager::ParseLiteralAssignment(
+  const string &line,
+  string *parameter,
+  string *value)
+{
+  size_t pos = 0;
+  if (line.compare(0, 7, "export ") == 0) {
+    pos = line.find_first_not_of(' ', 7);
+    if (pos == string::npos)
+      return false;
+  }
+
+  const size_t pos_begin = pos;
+  while ((pos < line.length()) &&
+         (((line[pos] >= 'A') && (line[pos] <= 'Z')) ||
+          ((line[pos] >= 'a') && (line[pos] <= 'z')) ||
+          ((line[pos] >= '0') && (line[pos] <= '9') && (pos > pos_begin)) ||
+          (line[pos] == '_')))
+  {
+    pos++;
+  }
+  if ((pos == pos_begin) || (pos == line.length()) || (line[pos] != '='))
+    return false;
+  *parameter = line.substr(pos_begin, pos - pos_begin);
+  pos++;
+
+  size_t pos_end;
+  if ((pos < line.length()) && ((line[pos] == '"') || (line[pos] == '\''))) {
+    pos_end = line.find(line[pos], pos + 1);
+    if (pos_end == string::npos)
+      return false;
+    *value = line.substr(pos + 1, pos_end - pos - 1);
+    // In double quotes, these are still expanded
+    if ((line[pos] == '"') && (value->find_first_of("$`\\") != string::npos))
+      return false;
+    pos_end++;
+  } else {
+    pos_end = line.find(' ', pos);
+    if (pos_end == string::npos)
+      pos_end = line.length();
+    *value = line.substr(pos, pos_end - pos);
+    if (value->find_first_of("$`\\\"';&|()<>~") != string::npos)
+      return false;
+  }
+  // Only a comment may follow the value
+  if (pos_end < line.length()) {
+    if (line[pos_end] != ' ')
+      return false;
+    pos_end = line.find_first_not_of(' ', pos_end);
+    if ((pos_end != string::npos) && (line[pos_end] != '#'))
+      return false;
+  }
+
+  // Whitespace, globs, and escapes would be changed by echo $KEY
+  for (unsigned i = 0; i < value->length(); ++i) {
+    const unsigned char c = (*value)[i];
+    if ((c < ' ') || (c == '*') || (c == '?') || (c == '[') || (c == '\\') ||
+        ((c == ' ') && ((i == 0) || (i + 1 == value->length()) ||
+                        ((*value)[i + 1] == ' '))))
+    {
+      return false;
+    }
+  }
+  // The value would be taken as an option of echo
+  if (!value->empty() && ((*value)[0] == '-') &&
+      (value->find_first_not_of("neE", 1) == string::npos))
+  {
+    return false;
+  }
+  return true;
+}
+
+
+/**
+ * Parses the config file without a shell if it consists only of comments and
+ * literal assignments.  Otherwise nothing is changed.
+ *
+ * @return false if the config file needs to be evaluated by a shell
+ */
+bool BashOptionsManager::TryParseLiteral(
+  FILE *fconfig,
+  const string &config_file)
+{
+  vector<pair<string, string> > assignments;
+  string line;
+  bool is_literal = true;
+  while (is_literal && GetLineFile(fconfig, &line)) {
+    line = Trim(line);
+    if (line.empty() || (line[0] == '#'))
+      continue;
+    string parameter;
+    string value;
+    is_literal = ParseLiteralAssignment(line, &parameter, &value);
+    assignments.push_back(make_pair(parameter, value));
+  }
+  rewind(fconfig);
+  if (!is_literal)
+    return false;
+
+  LogCvmfs(kLogCvmfs, kLogDebug, "Config file %s has only literal values",
+           config_file.c_str());
+  for (unsigned i = 0; i < assignments.size(); ++i) {
+    ConfigValue config_value;
+    config_value.source = config_file;
+    config_value.value = assignments[i].second;
+    PopulateParameter(assignments[i].first, config_value);
+  }
+  return true;
+}
+
+
 void BashOptionsManager::ParsePath(const string &config_file,
                                    const bool external) {
   LogCvmfs(kLogCvmfs, kLogDebug, "Parsing config file %s", config_file.c_str());
@@ -187,6 +307,11 @@ void BashOptionsManager::ParsePath(const string &config_file,
     return;
   }
 
+  if (TryParseLiteral(fconfig, config_file)) {
+    fclose(fconfig);
+    return;
+  }
+
   int fd_stdin;
   int fd_stdout;
   int fd_stderr;
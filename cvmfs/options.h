@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 
+#include <cstdio>
 #include <map>
 #include <string>
 #include <vector>
@@ -185,11 +186,20 @@ class SimpleOptionsParser : public OptionsManager {
  * Derived class from OptionsManager. This class provides the
  * complete parsing of the configuration files. In order to parse the
  * configuration files it retrieves the "KEY=VALUE" pairs and uses bash for
- * the rest, so that you can execute sightly complex scripts
+ * the rest, so that you can execute sightly complex scripts.
+ *
+ * Most configuration files only assign literal values.  Such files are parsed
+ * without spawning a shell; the result is the same as the one of the shell.
  */
 class BashOptionsManager : public OptionsManager {
  public:
   void ParsePath(const std::string &config_file, const bool external);
+
+ protected:
+  static bool ParseLiteralAssignment(const std::string &line,
+                                     std::string *parameter,
+                                     std::string *value);
+  bool TryParseLiteral(FILE *fconfig, const std::string &config_file);
 };  // class BashOptionsManager
 
 
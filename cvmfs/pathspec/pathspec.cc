@@ -6,16 +6,7 @@
 
 #include <cassert>
 
-#include "logging.h"
-#include "smalloc.h"
-
 Pathspec::Pathspec(const std::string &spec) :
-  regex_compiled_(false),
-  regex_(NULL),
-  relaxed_regex_compiled_(false),
-  relaxed_regex_(NULL),
-  prefix_regex_compiled_(false),
-  prefix_regex_(NULL),
   glob_string_compiled_(false),
   glob_string_sequence_compiled_(false),
   valid_(true),
@@ -33,43 +24,8 @@ Pathspec::Pathspec(const std::string &spec) :
       valid_ = false;
     }
   }
-}
 
-Pathspec::Pathspec(const Pathspec &other) :
-  patterns_(other.patterns_),
-  regex_compiled_(false),          // compiled regex structure cannot be
-  regex_(NULL),                    // duplicated and needs to be re-compiled
-  relaxed_regex_compiled_(false),  // Note: the copy-constructed object will
-  relaxed_regex_(NULL),            //       perform a lazy evaluation again
-  prefix_regex_compiled_(false),
-  prefix_regex_(NULL),
-  glob_string_compiled_(other.glob_string_compiled_),
-  glob_string_(other.glob_string_),
-  glob_string_sequence_compiled_(other.glob_string_sequence_compiled_),
-  glob_string_sequence_(other.glob_string_sequence_),
-  valid_(other.valid_),
-  absolute_(other.absolute_) {}
-
-Pathspec::~Pathspec() {
-  DestroyRegularExpressions();
-}
-
-Pathspec& Pathspec::operator=(const Pathspec &other) {
-  if (this != &other) {
-    DestroyRegularExpressions();  // see: copy c'tor for details
-    patterns_ = other.patterns_;
-
-    glob_string_compiled_ = other.glob_string_compiled_;
-    glob_string_          = other.glob_string_;
-
-    glob_string_sequence_compiled_ = other.glob_string_sequence_compiled_;
-    glob_string_sequence_          = other.glob_string_sequence_;
-
-    valid_    = other.valid_;
-    absolute_ = other.absolute_;
-  }
-
-  return *this;
+  Compile();
 }
 
 
@@ -139,134 +95,79 @@ bool Pathspec::IsMatchingRelaxed(const std::string &query_path) const {
   return IsPathspecMatchingRelaxed(query_path);
 }
 
-bool Pathspec::IsPathspecMatching(const std::string &query_path) const {
-  return ApplyRegularExpression(query_path, GetRegularExpression());
-}
-
-bool Pathspec::IsPathspecPrefixMatching(const std::string &query_path) const {
-  return ApplyRegularExpression(query_path, GetPrefixRegularExpression());
-}
-
-bool Pathspec::IsPathspecMatchingRelaxed(const std::string &query_path) const {
-  return ApplyRegularExpression(query_path, GetRelaxedRegularExpression());
-}
-
-bool Pathspec::ApplyRegularExpression(const std::string  &query_path,
-                                            regex_t      *regex) const {
-  const char *path = query_path.c_str();
-  const int retval = regexec(regex, path, 0, NULL, 0);
-
-  if (retval != 0 && retval != REG_NOMATCH) {
-    PrintRegularExpressionError(retval);
-  }
-
-  return (retval == 0);
-}
-
-regex_t* Pathspec::GetRegularExpression() const {
-  if (!regex_compiled_) {
-    const bool is_relaxed = false;
-    const std::string regex = GenerateRegularExpression(is_relaxed);
-    LogCvmfs(kLogPathspec, kLogDebug, "compiled regex: %s", regex.c_str());
-
-    regex_ = CompileRegularExpression(regex);
-    regex_compiled_ = true;
-  }
-
-  return regex_;
-}
-
-regex_t* Pathspec::GetPrefixRegularExpression() const {
-  if (!prefix_regex_compiled_) {
-    const bool is_relaxed = false;
-    const bool is_prefix = true;
-    const std::string regex = GenerateRegularExpression(is_relaxed, is_prefix);
-    LogCvmfs(kLogPathspec, kLogDebug, "compiled regex: %s", regex.c_str());
-
-    prefix_regex_ = CompileRegularExpression(regex);
-    prefix_regex_compiled_ = true;
+void Pathspec::Compile() {
+  element_globs_.resize(patterns_.size());
+  if (IsAbsolute()) {
+    relaxed_glob_.AddLiteral(kSeparator);
   }
 
-  return prefix_regex_;
-}
-
-regex_t* Pathspec::GetRelaxedRegularExpression() const {
-  if (!relaxed_regex_compiled_) {
-    const bool is_relaxed = true;
-    const std::string regex = GenerateRegularExpression(is_relaxed);
-    LogCvmfs(kLogPathspec, kLogDebug, "compiled relaxed regex: %s",
-             regex.c_str());
-
-    relaxed_regex_ = CompileRegularExpression(regex);
-    relaxed_regex_compiled_ = true;
+  for (unsigned i = 0; i < patterns_.size(); ++i) {
+    patterns_[i].Compile(&element_globs_[i]);
+    if (i > 0) {
+      relaxed_glob_.AddLiteral(kSeparator);
+    }
+    patterns_[i].Compile(&relaxed_glob_);
   }
-
-  return relaxed_regex_;
 }
 
-std::string Pathspec::GenerateRegularExpression(
-  const bool is_relaxed,
-  const bool is_prefix) const
-{
-  // start matching at the first character
-  std::string regex = "^";
+/**
+ * Matches the path segments one by one against the compiled element patterns.
+ * In prefix mode, any number of additional segments may follow.  Otherwise a
+ * path might end with a trailing slash (pathspec does not distinguish files
+ * and directories).
+ */
+bool Pathspec::IsMatchingSegments(const std::string &query_path,
+                                  const bool is_prefix) const {
+  const char *pos = query_path.data();
+  const char *end = pos + query_path.length();
 
   // absolute paths require a / in the beginning
   if (IsAbsolute()) {
-    regex += kSeparator;
+    if (*pos != kSeparator) {
+      return false;
+    }
+    ++pos;
   }
 
-  // concatenate the regular expressions of the compiled path elements
-        ElementPatterns::const_iterator i    = patterns_.begin();
-  const ElementPatterns::const_iterator iend = patterns_.end();
-  for (; i != iend; ++i) {
-    regex += i->GenerateRegularExpression(is_relaxed);
-    if (i + 1 != iend) {
-      regex += kSeparator;
+  const unsigned num_elements = element_globs_.size();
+  for (unsigned i = 0; i < num_elements; ++i) {
+    const char *end_segment = pos;
+    while ((end_segment != end) && (*end_segment != kSeparator)) {
+      ++end_segment;
     }
+    if ((i + 1 < num_elements) && (end_segment == end)) {
+      return false;
+    }
+    if (!element_globs_[i].IsMatching(pos, end_segment)) {
+      return false;
+    }
+    pos = (i + 1 < num_elements) ? end_segment + 1 : end_segment;
   }
 
-  if (is_prefix) {
-    regex += "($|";
-    regex += kSeparator;
-    regex += ".*$)";
-  } else {
-    // a path might end with a trailing slash
-    // (pathspec does not distinguish files and directories)
-    regex += kSeparator;
-    regex += "?$";
+  if (pos == end) {
+    return true;
   }
-
-  return regex;
+  assert(*pos == kSeparator);
+  return is_prefix || (pos + 1 == end);
 }
 
-regex_t* Pathspec::CompileRegularExpression(const std::string &regex) const {
-  regex_t *result = reinterpret_cast<regex_t *>(smalloc(sizeof(regex_t)));
-  const int flags = REG_NOSUB | REG_NEWLINE | REG_EXTENDED;
-  const int retval = regcomp(result, regex.c_str(), flags);
-
-  if (retval != 0) {
-    PrintRegularExpressionError(retval);
-    assert(false && "failed to compile regex");
-  }
-
-  return result;
+bool Pathspec::IsPathspecMatching(const std::string &query_path) const {
+  return IsMatchingSegments(query_path, false);
 }
 
-void Pathspec::DestroyRegularExpressions() {
-  if (regex_compiled_) {
-    assert(regex_ != NULL);
-    regfree(regex_);
-    regex_          = NULL;
-    regex_compiled_ = false;
-  }
+bool Pathspec::IsPathspecPrefixMatching(const std::string &query_path) const {
+  return IsMatchingSegments(query_path, true);
+}
 
-  if (relaxed_regex_compiled_) {
-    assert(relaxed_regex_ != NULL);
-    regfree(relaxed_regex_);
-    relaxed_regex_          = NULL;
-    relaxed_regex_compiled_ = false;
+bool Pathspec::IsPathspecMatchingRelaxed(const std::string &query_path) const {
+  const char *begin = query_path.data();
+  const char *end = begin + query_path.length();
+  if (relaxed_glob_.IsMatching(begin, end)) {
+    return true;
   }
+  // a path might end with a trailing slash
+  return (*(end - 1) == kSeparator) &&
+         relaxed_glob_.IsMatching(begin, end - 1);
 }
 
 bool Pathspec::operator==(const Pathspec &other) const {
@@ -290,14 +191,6 @@ bool Pathspec::operator==(const Pathspec &other) const {
   return true;
 }
 
-void Pathspec::PrintRegularExpressionError(const int error_code) const {
-  assert(regex_compiled_);
-  const size_t errbuf_size = 1024;
-  char error[errbuf_size];
-  regerror(error_code, regex_, error, errbuf_size);
-  LogCvmfs(kLogPathspec, kLogStderr, "RegEx Error: %d - %s", error_code, error);
-}
-
 const Pathspec::GlobStringSequence& Pathspec::GetGlobStringSequence() const {
   if (!glob_string_sequence_compiled_) {
     GenerateGlobStringSequence();
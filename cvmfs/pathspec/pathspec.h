@@ -5,8 +5,6 @@
 #ifndef CVMFS_PATHSPEC_PATHSPEC_H_
 #define CVMFS_PATHSPEC_PATHSPEC_H_
 
-#include <regex.h>
-
 #include <string>
 #include <vector>
 
@@ -29,8 +27,8 @@
  * Note: sophisticated Pathspec based catalog lookup was not needed, yet. But it
  *       is implemented and not merged (see: reneme/feature-lookup_pathspec).
  *
- * Also inverse matches are possible by transforming a Pathspec into a regular
- * expression and matching path strings with it. There are two matching modes:
+ * Also inverse matches are possible by compiling a Pathspec into PathspecGlobs
+ * and matching path strings with them. There are two matching modes:
  *   IsMatching()        - Matches the exact path
  *                         (wildcards don't span directory boundaries)
  *   IsMatchingRelaxed() - Matches the path more relaxed
@@ -40,9 +38,12 @@
  * Internally a Pathspec is broken up into PathspecElementPatterns at the
  * directory boundaries. Have a look there for further details.
  *
- * For matching, Pathspecs need to be transformed either into a regular expres-
- * sion or GlobString(Sequence). These transformations are done lazily on first
- * request.
+ * For matching, every PathspecElementPattern is compiled into a PathspecGlob
+ * that is applied to the corresponding segment of the query path.  Matching
+ * stops at the first segment that does not match.
+ * For relaxed matching, all elements are compiled into a single PathspecGlob.
+ * The compilation is done on construction, the transformation into a
+ * GlobString(Sequence) is done lazily on first request.
  */
 class Pathspec {
  public:
@@ -66,9 +67,6 @@ class Pathspec {
    * @param spec  the pathspec pattern to be parsed
    */
   explicit Pathspec(const std::string &spec);
-  Pathspec(const Pathspec &other);
-  // TODO(rmeusel): C++11 move constructor
-  ~Pathspec();
 
   /**
    * Matches an exact path string. Directory boundaries are taken into account
@@ -128,7 +126,6 @@ class Pathspec {
    */
   const std::string& GetGlobString() const;
 
-  Pathspec& operator=(const Pathspec &other);
   bool operator== (const Pathspec &other) const;
   bool operator!= (const Pathspec &other) const { return !(*this == other); }
 
@@ -141,39 +138,22 @@ class Pathspec {
   void ParsePathElement(const std::string::const_iterator &end,
                         std::string::const_iterator *itr);
 
+  void Compile();
+
   bool IsPathspecMatching(const std::string &query_path) const;
   bool IsPathspecPrefixMatching(const std::string &query_path) const;
   bool IsPathspecMatchingRelaxed(const std::string &query_path) const;
-
-  bool ApplyRegularExpression(const std::string  &query_path,
-                                    regex_t      *regex) const;
-
-  regex_t* GetRegularExpression() const;
-  regex_t* GetPrefixRegularExpression() const;
-  regex_t* GetRelaxedRegularExpression() const;
-
-  std::string GenerateRegularExpression(const bool is_relaxed = false,
-                                        const bool is_prefix = false) const;
-  regex_t* CompileRegularExpression(const std::string &regex) const;
-
-  void PrintRegularExpressionError(const int error_code) const;
+  bool IsMatchingSegments(const std::string &query_path,
+                          const bool is_prefix) const;
 
   void GenerateGlobStringSequence() const;
   void GenerateGlobString() const;
 
-  void DestroyRegularExpressions();
-
  private:
   ElementPatterns             patterns_;
 
-  mutable bool                regex_compiled_;
-  mutable regex_t            *regex_;
-
-  mutable bool                relaxed_regex_compiled_;
-  mutable regex_t            *relaxed_regex_;
-
-  mutable bool                prefix_regex_compiled_;
-  mutable regex_t            *prefix_regex_;
+  std::vector<PathspecGlob>   element_globs_;
+  PathspecGlob                relaxed_glob_;
 
   mutable bool                glob_string_compiled_;
   mutable std::string         glob_string_;
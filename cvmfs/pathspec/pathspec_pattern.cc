@@ -6,9 +6,92 @@
 #include "pathspec_pattern.h"
 
 #include <cassert>
+#include <cstring>
 
 #include "pathspec/pathspec.h"
 
+void PathspecGlob::AddLiteral(const char chr) {
+  if (IsLiteral())
+    literal_prefix_.push_back(chr);
+  symbols_.push_back(Symbol(kSymbolLiteral, chr));
+}
+
+void PathspecGlob::AddWildcard() {
+  // Consecutive wildcards are equivalent to a single one
+  if (!symbols_.empty() && (symbols_.back().type == kSymbolWildcard))
+    return;
+  symbols_.push_back(Symbol(kSymbolWildcard, '\0'));
+}
+
+void PathspecGlob::AddPlaceholder() {
+  symbols_.push_back(Symbol(kSymbolPlaceholder, '\0'));
+}
+
+bool PathspecGlob::IsMatchingSymbol(const Symbol &symbol,
+                                    const char chr) const
+{
+  return (symbol.type == kSymbolPlaceholder)
+         ? (chr != Pathspec::kSeparator)
+         : (symbol.chr == chr);
+}
+
+/**
+ * Wildcards initially match the empty string.  On a mismatch, the most recent
+ * wildcard consumes one more character and matching resumes behind it.  Going
+ * back further is not necessary because the remaining symbols have a fixed
+ * length, so this runs in O(length of string * number of symbols) in the worst
+ * case and typically in linear time.
+ */
+bool PathspecGlob::IsMatching(const char *begin, const char *end) const {
+  const size_t length = end - begin;
+  const size_t prefix_length = literal_prefix_.length();
+  if (length < prefix_length)
+    return false;
+  if (memcmp(begin, literal_prefix_.data(), prefix_length) != 0)
+    return false;
+  if (IsLiteral())
+    return length == prefix_length;
+
+  const size_t num_symbols = symbols_.size();
+  size_t pos_string = prefix_length;
+  size_t pos_symbol = prefix_length;
+  bool has_wildcard = false;
+  size_t wildcard_symbol = 0;
+  size_t wildcard_string = 0;
+  while (pos_string < length) {
+    if (pos_symbol < num_symbols) {
+      const Symbol &symbol = symbols_[pos_symbol];
+      if (symbol.type == kSymbolWildcard) {
+        has_wildcard = true;
+        wildcard_symbol = pos_symbol++;
+        wildcard_string = pos_string;
+        continue;
+      }
+      if (IsMatchingSymbol(symbol, begin[pos_string])) {
+        pos_symbol++;
+        pos_string++;
+        continue;
+      }
+    }
+    if (!has_wildcard)
+      return false;
+    pos_symbol = wildcard_symbol + 1;
+    pos_string = ++wildcard_string;
+  }
+
+  // Trailing wildcard matches the empty string
+  while ((pos_symbol < num_symbols) &&
+         (symbols_[pos_symbol].type == kSymbolWildcard))
+  {
+    pos_symbol++;
+  }
+  return pos_symbol == num_symbols;
+}
+
+
+//------------------------------------------------------------------------------
+
+
 PathspecElementPattern::PathspecElementPattern(
   const std::string::const_iterator begin,
   const std::string::const_iterator &end)
@@ -124,15 +207,12 @@ PathspecElementPattern::SubPattern* PathspecElementPattern::ParseSpecialChar(
   }
 }
 
-std::string PathspecElementPattern::GenerateRegularExpression(
-                                                  const bool is_relaxed) const {
-  std::string result;
+void PathspecElementPattern::Compile(PathspecGlob *glob) const {
         SubPatterns::const_iterator i    = subpatterns_.begin();
   const SubPatterns::const_iterator iend = subpatterns_.end();
   for (; i != iend; ++i) {
-    result += (*i)->GenerateRegularExpression(is_relaxed);
+    (*i)->Compile(glob);
   }
-  return result;
 }
 
 std::string PathspecElementPattern::GenerateGlobString() const {
@@ -175,21 +255,14 @@ void PathspecElementPattern::PlaintextSubPattern::AddChar(const char chr) {
   chars_.push_back(chr);
 }
 
-std::string
-  PathspecElementPattern::PlaintextSubPattern::GenerateRegularExpression(
-  const bool is_relaxed) const
+void PathspecElementPattern::PlaintextSubPattern::Compile(
+  PathspecGlob *glob) const
 {
-  // Note: strict and relaxed regex are the same!
         std::string::const_iterator i    = chars_.begin();
   const std::string::const_iterator iend = chars_.end();
-  std::string regex;
   for (; i != iend; ++i) {
-    if (IsSpecialRegexCharacter(*i)) {
-      regex += "\\";
-    }
-    regex += *i;
+    glob->AddLiteral(*i);
   }
-  return regex;
 }
 
 
@@ -208,24 +281,6 @@ std::string
   return glob_string;
 }
 
-bool PathspecElementPattern::PlaintextSubPattern::IsSpecialRegexCharacter(
-  const char chr) const
-{
-  return (chr == '.'  ||
-          chr == '\\' ||
-          chr == '*'  ||
-          chr == '?'  ||
-          chr == '['  ||
-          chr == ']'  ||
-          chr == '('  ||
-          chr == ')'  ||
-          chr == '{'  ||
-          chr == '}'  ||
-          chr == '^'  ||
-          chr == '$'  ||
-          chr == '+');
-}
-
 bool PathspecElementPattern::PlaintextSubPattern::Compare(
   const SubPattern *other) const
 {
@@ -240,13 +295,10 @@ bool PathspecElementPattern::PlaintextSubPattern::Compare(
 }
 
 
-std::string
-  PathspecElementPattern::WildcardSubPattern::GenerateRegularExpression(
-  const bool is_relaxed) const
+void PathspecElementPattern::WildcardSubPattern::Compile(
+  PathspecGlob *glob) const
 {
-  return (is_relaxed)
-         ? std::string(".*")
-         : std::string("[^") + Pathspec::kSeparator + "]*";
+  glob->AddWildcard();
 }
 
 
@@ -264,12 +316,10 @@ bool PathspecElementPattern::WildcardSubPattern::Compare(
 }
 
 
-std::string
-  PathspecElementPattern::PlaceholderSubPattern::GenerateRegularExpression(
-  const bool is_relaxed) const
+void PathspecElementPattern::PlaceholderSubPattern::Compile(
+  PathspecGlob *glob) const
 {
-  // Note: strict and relaxed regex are the same!
-  return std::string("[^") + Pathspec::kSeparator + "]";
+  glob->AddPlaceholder();
 }
 
 std::string
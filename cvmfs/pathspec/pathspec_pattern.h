@@ -8,6 +8,54 @@
 #include <string>
 #include <vector>
 
+/**
+ * A PathspecGlob is the compiled form of one or more PathspecElementPatterns.
+ * It matches strings directly, without a regular expression engine: literal
+ * characters match themselves, wildcards (*) match any sequence of characters
+ * and placeholders (?) match any single character but the directory separator.
+ *
+ * Wildcards within a single directory level never see a separator because the
+ * Pathspec matches path segment by segment.  For relaxed matching, the Pathspec
+ * compiles all its elements into one PathspecGlob and wildcards match across
+ * directory boundaries.
+ *
+ * A literal prefix is compared upfront and fully literal globs are matched by
+ * a simple string comparison.
+ */
+class PathspecGlob {
+ public:
+  void AddLiteral(const char chr);
+  void AddWildcard();
+  void AddPlaceholder();
+
+  bool IsMatching(const char *begin, const char *end) const;
+  bool IsLiteral() const {
+    return literal_prefix_.length() == symbols_.size();
+  }
+
+ private:
+  enum SymbolType {
+    kSymbolLiteral = 0,
+    kSymbolWildcard,
+    kSymbolPlaceholder
+  };
+
+  struct Symbol {
+    Symbol(const SymbolType t, const char c) : type(t), chr(c) {}
+    SymbolType type;
+    char chr;
+  };
+
+  bool IsMatchingSymbol(const Symbol &symbol, const char chr) const;
+
+  std::vector<Symbol> symbols_;
+  /**
+   * The leading literal characters, for the fast paths
+   */
+  std::string literal_prefix_;
+};
+
+
 /**
  * The PathspecElementPattern is used internally by the Pathspec class!
  *
@@ -48,8 +96,7 @@ class PathspecElementPattern {
     virtual bool IsWildcard()    const { return false; }
     virtual bool IsPlaceholder() const { return false; }
 
-    virtual std::string
-      GenerateRegularExpression(const bool is_relaxed) const = 0;
+    virtual void Compile(PathspecGlob *glob) const = 0;
     virtual std::string GenerateGlobString() const = 0;
   };
 
@@ -63,14 +110,13 @@ class PathspecElementPattern {
     bool IsEmpty() const { return chars_.empty(); }
     bool IsPlaintext() const { return true; }
 
-    std::string GenerateRegularExpression(const bool is_relaxed) const;
-    std::string GenerateGlobString()                             const;
+    void Compile(PathspecGlob *glob) const;
+    std::string GenerateGlobString() const;
 
    protected:
     PlaintextSubPattern(const PlaintextSubPattern &other) :
       chars_(other.chars_) {}
     PlaintextSubPattern& operator=(const PlaintextSubPattern &other);
-    bool IsSpecialRegexCharacter(const char chr) const;
 
    private:
     std::string chars_;
@@ -80,8 +126,8 @@ class PathspecElementPattern {
    public:
     SubPattern* Clone() const { return new WildcardSubPattern(); }
     bool Compare(const SubPattern *other) const;
-    std::string GenerateRegularExpression(const bool is_relaxed) const;
-    std::string GenerateGlobString()                             const;
+    void Compile(PathspecGlob *glob) const;
+    std::string GenerateGlobString() const;
     bool IsWildcard() const { return true; }
   };
 
@@ -89,8 +135,8 @@ class PathspecElementPattern {
    public:
     SubPattern* Clone() const { return new PlaceholderSubPattern(); }
     bool Compare(const SubPattern *other) const;
-    std::string GenerateRegularExpression(const bool is_relaxed) const;
-    std::string GenerateGlobString()                             const;
+    void Compile(PathspecGlob *glob) const;
+    std::string GenerateGlobString() const;
     bool IsPlaceholder() const { return true; }
   };
 
@@ -105,8 +151,8 @@ class PathspecElementPattern {
   // TODO(rmeusel): C++11 - move constructor!
   ~PathspecElementPattern();
 
-  std::string GenerateRegularExpression(const bool is_relaxed = false) const;
-  std::string GenerateGlobString()                                     const;
+  void Compile(PathspecGlob *glob) const;
+  std::string GenerateGlobString() const;
 
   bool IsValid() const { return valid_; }
 
@@ -14,14 +14,17 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <linux/mempolicy.h>
 #include <mntent.h>
 #include <pthread.h>
 #include <signal.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/mount.h>
 #include <sys/prctl.h>
 #include <sys/select.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/utsname.h>
 #include <unistd.h>
 
@@ -261,6 +264,19 @@ inline int platform_readahead(int filedes) {
   return readahead(filedes, 0, static_cast<size_t>(-1));
 }
 
+/**
+ * Flushes the file system that contains filedes.  The glibc wrapper for
+ * syncfs() is not available on all supported platforms.
+ */
+inline int platform_syncfs(int filedes) {
+#ifdef SYS_syncfs
+  return syscall(SYS_syncfs, filedes);
+#else
+  sync();
+  return 0;
+#endif
+}
+
 /**
  * Advises the kernel to evict the given file region from the page cache.
  *
@@ -289,6 +305,32 @@ inline int platform_invalidate_kcache(const int fd, const off_t offset,
   return posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
 }
 
+/**
+ * Returns true if any page of the file range is in the page cache.  The offset
+ * needs to be page aligned.
+ */
+inline bool platform_in_kcache(const int fd, const off_t offset,
+                               const size_t length) {
+  if (length == 0)
+    return false;
+  void *addr = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, offset);
+  if (addr == MAP_FAILED)
+    return false;
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  std::vector<unsigned char> pages((length + page_size - 1) / page_size);
+  bool result = false;
+  if (mincore(addr, length, &pages[0]) == 0) {
+    for (unsigned i = 0; i < pages.size(); ++i) {
+      if (pages[i] & 1) {
+        result = true;
+        break;
+      }
+    }
+  }
+  munmap(addr, length);
+  return result;
+}
+
 inline std::string platform_libname(const std::string &base_name) {
   return "lib" + base_name + ".so";
 }
@@ -315,11 +357,74 @@ inline uint64_t platform_monotonic_time() {
   return tp.tv_sec + (tp.tv_nsec >= 500000000);
 }
 
+/**
+ * Nanoseconds from an arbitrary starting point, for measuring intervals
+ */
+inline uint64_t platform_monotonic_time_ns() {
+  struct timespec tp;
+  int retval = clock_gettime(CLOCK_MONOTONIC, &tp);
+  assert(retval == 0);
+  return static_cast<uint64_t>(tp.tv_sec) * 1000000000 + tp.tv_nsec;
+}
+
+/**
+ * Nanoseconds since the epoch
+ */
+inline uint64_t platform_realtime_ns() {
+  struct timespec tp;
+  int retval = clock_gettime(CLOCK_REALTIME, &tp);
+  assert(retval == 0);
+  return static_cast<uint64_t>(tp.tv_sec) * 1000000000 + tp.tv_nsec;
+}
+
 inline uint64_t platform_memsize() {
   return static_cast<uint64_t>(sysconf(_SC_PHYS_PAGES)) *
          static_cast<uint64_t>(sysconf(_SC_PAGE_SIZE));
 }
 
+/**
+ * Until the policy is reset, the memory pages first touched by the calling
+ * thread are spread round-robin over all NUMA nodes.  Used for the shared
+ * caches that are filled at creation time, so that lookups from all nodes
+ * have the same average distance.  Returns false if there is only one node.
+ */
+inline bool platform_numa_interleave(const bool enable) {
+  if (!enable)
+    return syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0) == 0;
+
+  // Node list has the format "0-1,4"
+  FILE *fnodes = fopen("/sys/devices/system/node/online", "r");
+  if (fnodes == NULL)
+    return false;
+  const unsigned kMaxNodes = 1024;
+  const unsigned kBitsPerWord = 8 * sizeof(unsigned long);  // NOLINT
+  unsigned long mask[kMaxNodes / kBitsPerWord];  // NOLINT
+  memset(mask, 0, sizeof(mask));
+  unsigned num_nodes = 0;
+  unsigned first;
+  unsigned last;
+  int separator;
+  while (fscanf(fnodes, "%u", &first) == 1) {
+    last = first;
+    separator = fgetc(fnodes);
+    if (separator == '-') {
+      if (fscanf(fnodes, "%u", &last) != 1)
+        break;
+      separator = fgetc(fnodes);
+    }
+    for (unsigned i = first; (i <= last) && (i < kMaxNodes); ++i) {
+      mask[i / kBitsPerWord] |= 1UL << (i % kBitsPerWord);
+      num_nodes++;
+    }
+    if (separator != ',')
+      break;
+  }
+  fclose(fnodes);
+  if (num_nodes < 2)
+    return false;
+  return syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, mask, kMaxNodes) == 0;
+}
+
 #ifdef CVMFS_NAMESPACE_GUARD
 }  // namespace CVMFS_NAMESPACE_GUARD
 #endif
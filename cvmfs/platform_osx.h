@@ -25,9 +25,11 @@
 #include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/sysctl.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/ucred.h>
 #include <sys/xattr.h>
+#include <unistd.h>
 
 #include <cassert>
 #include <cstdio>
@@ -213,11 +215,23 @@ inline void platform_invalidate_kcache(const int fd, const off_t offset,
   // TODO(rmeusel): implement
 }
 
+inline bool platform_in_kcache(const int fd, const off_t offset,
+                               const size_t length) {
+  // Nothing is invalidated anyway
+  return true;
+}
+
 inline int platform_readahead(int filedes) {
   // TODO(jblomer): is there a readahead equivalent?
   return 0;
 }
 
+inline int platform_syncfs(int filedes) {
+  // No per file system flush available
+  sync();
+  return 0;
+}
+
 inline bool read_line(FILE *f, std::string *line) {
   char *buffer_line = NULL;
   size_t buffer_size = 0;
@@ -242,6 +256,26 @@ inline uint64_t platform_monotonic_time() {
   return val_ns * 1e-9;
 }
 
+/**
+ * Nanoseconds from an arbitrary starting point, for measuring intervals
+ */
+inline uint64_t platform_monotonic_time_ns() {
+  uint64_t val_abs = mach_absolute_time();
+  mach_timebase_info_data_t info;
+  mach_timebase_info(&info);
+  return val_abs * info.numer / info.denom;
+}
+
+/**
+ * Nanoseconds since the epoch, with microsecond precision
+ */
+inline uint64_t platform_realtime_ns() {
+  struct timeval tv;
+  int retval = gettimeofday(&tv, NULL);
+  assert(retval == 0);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000000 + tv.tv_usec * 1000;
+}
+
 /**
  * strdupa does not exist on OSX
  */
@@ -273,6 +307,10 @@ inline uint64_t platform_memsize() {
   return ramsize;
 }
 
+inline bool platform_numa_interleave(const bool enable) {
+  return false;
+}
+
 #ifdef CVMFS_NAMESPACE_GUARD
 }  // namespace CVMFS_NAMESPACE_GUARD
 #endif
@@ -17,6 +17,7 @@
 #include "statistics.h"
 #include "swissknife.h"
 #include "swissknife_pull.h"
+#include "swissknife_warm.h"
 #include "util/posix.h"
 #include "uuid.h"
 
@@ -38,7 +39,12 @@ void Usage() {
     "              [-k <public key>]\n"
     "              [-m <fully qualified repository name>]\n"
     "              [-n <num of parallel download threads>]\n"
-    "              [-x <directory for temporary files>]\n\n", kVersion);
+    "              [-x <directory for temporary files>]\n"
+    "              [-l <file with a list of paths to warm>]\n"
+    "              [-T <tracer log (csv) of a previous job>]\n"
+    "              [-D dry run: only estimate the size of -l / -T]\n\n"
+    "With -l or -T, only the files of the listed paths are fetched instead of "
+    "the directories of the dirtab.\n\n", kVersion);
 }
 }  // namespace swissknife
 
@@ -121,14 +127,14 @@ int main(int argc, char *argv[]) {
   string default_num_threads = "4";
   args['n'] = &default_num_threads;
 
-  string option_string = "u:r:k:m:x:d:n:vh";
+  string option_string = "u:r:k:m:x:d:n:l:T:Dvh";
   int c;
   while ((c = getopt(argc, argv, option_string.c_str())) != -1) {
     if ((c == 'v') || (c == 'h')) {
       swissknife::Usage();
       return 0;
     }
-    args[c] = new string(optarg);
+    args[c] = (optarg == NULL) ? NULL : new string(optarg);
   }
 
   // check all mandatory parameters are included
@@ -208,16 +214,20 @@ int main(int argc, char *argv[]) {
   swissknife::g_statistics = new perf::Statistics();
 
   // load the command
-  if (HasDirtabChanged(dirtab, dirtab_in_cache)) {
-    LogCvmfs(kLogCvmfs, kLogStdout, "CernVM-FS: new dirtab, forced run");
-    args['z'] = NULL;  // look into existing catalogs, too
-  }
-  args['c'] = NULL;
-  retval = swissknife::CommandPull().Main(args);
+  if ((args.find('l') != args.end()) || (args.find('T') != args.end())) {
+    retval = swissknife::CommandWarm().Main(args);
+  } else {
+    if (HasDirtabChanged(dirtab, dirtab_in_cache)) {
+      LogCvmfs(kLogCvmfs, kLogStdout, "CernVM-FS: new dirtab, forced run");
+      args['z'] = NULL;  // look into existing catalogs, too
+    }
+    args['c'] = NULL;
+    retval = swissknife::CommandPull().Main(args);
 
-  // Copy dirtab file
-  if (retval == 0) {
-    CopyPath2Path(dirtab, dirtab_in_cache);
+    // Copy dirtab file
+    if (retval == 0) {
+      CopyPath2Path(dirtab, dirtab_in_cache);
+    }
   }
 
   // Create cache uuid if not present
@@ -41,6 +41,8 @@ class QuotaManager : SingleCopy {
    *  - backchannel command 'R': release pinned files if possible
    * Revision 2:
    *  - add kCleanupRate command
+   * Revision 3:
+   *  - add kTouchBatch command
    */
   static const uint32_t kProtocolRevision;
 
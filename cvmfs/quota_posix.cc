@@ -22,6 +22,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdint.h>
@@ -35,11 +36,13 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
+#include <limits>
 #include <map>
 #include <set>
 #include <string>
@@ -54,11 +57,22 @@
 #include "statistics.h"
 #include "util/pointer.h"
 #include "util/posix.h"
+#include "util/probes.h"
 #include "util/string.h"
 #include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
+namespace {
+
+static inline uint32_t hasher_any(const shash::Any &key) {
+  // Every supported hash is at least 8 bytes long, skip the first 4 bytes
+  // which are also used by operator==
+  return (uint32_t) *(reinterpret_cast<const uint32_t *>(key.digest) + 1);
+}
+
+}  // anonymous namespace
+
 
 int PosixQuotaManager::BindReturnPipe(int pipe_wronly) {
   if (!shared_)
@@ -134,7 +148,7 @@ bool PosixQuotaManager::Cleanup(const uint64_t leave_size) {
   cmd.size = leave_size;
   cmd.return_pipe = pipe_cleanup[1];
 
-  WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+  WriteCommand(&cmd, sizeof(cmd));
   ReadHalfPipe(pipe_cleanup[0], &result, sizeof(result));
   CloseReturnPipe(pipe_cleanup);
 
@@ -143,11 +157,15 @@ bool PosixQuotaManager::Cleanup(const uint64_t leave_size) {
 
 
 void PosixQuotaManager::CloseDatabase() {
+  if (database_)
+    WriteTouchedSeq();
   if (stmt_list_catalogs_) sqlite3_finalize(stmt_list_catalogs_);
   if (stmt_list_pinned_) sqlite3_finalize(stmt_list_pinned_);
   if (stmt_list_volatile_) sqlite3_finalize(stmt_list_volatile_);
   if (stmt_list_) sqlite3_finalize(stmt_list_);
   if (stmt_lru_) sqlite3_finalize(stmt_lru_);
+  if (stmt_lru_protected_) sqlite3_finalize(stmt_lru_protected_);
+  if (stmt_size_protected_) sqlite3_finalize(stmt_size_protected_);
   if (stmt_rm_) sqlite3_finalize(stmt_rm_);
   if (stmt_size_) sqlite3_finalize(stmt_size_);
   if (stmt_touch_) sqlite3_finalize(stmt_touch_);
@@ -163,6 +181,9 @@ void PosixQuotaManager::CloseDatabase() {
   stmt_list_volatile_ = NULL;
   stmt_list_ = NULL;
   stmt_rm_ = NULL;
+  stmt_lru_ = NULL;
+  stmt_lru_protected_ = NULL;
+  stmt_size_protected_ = NULL;
   stmt_size_ = NULL;
   stmt_touch_ = NULL;
   stmt_unpin_ = NULL;
@@ -263,7 +284,8 @@ PosixQuotaManager *PosixQuotaManager::CreateShared(
   const std::string &cache_workspace,
   const uint64_t limit,
   const uint64_t cleanup_threshold,
-  bool foreground)
+  bool foreground,
+  const EvictionPolicy eviction_policy)
 {
   string cache_dir;
   string workspace_dir;
@@ -350,6 +372,7 @@ PosixQuotaManager *PosixQuotaManager::CreateShared(
   command_line.push_back(StringifyInt(GetLogSyslogLevel()));
   command_line.push_back(StringifyInt(GetLogSyslogFacility()));
   command_line.push_back(GetLogDebugFile() + ":" + GetLogMicroSyslog());
+  command_line.push_back(StringifyInt(eviction_policy));
 
   set<int> preserve_filedes;
   preserve_filedes.insert(0);
@@ -429,20 +452,105 @@ bool PosixQuotaManager::DoCleanup(const uint64_t leave_size) {
            "clean up cache until at most %lu KB is used", leave_size/1024);
   LogCvmfs(kLogQuota, kLogDebug, "gauge %" PRIu64, gauge_);
   cleanup_recorder_.Tick();
+  const uint64_t start_ns = platform_monotonic_time_ns();
+  CVMFS_PROBE2(quota_cleanup_start, gauge_, leave_size);
+
+  vector<string> trash;
+  if (!EvictLru(leave_size, 0, &trash))
+    return false;
+
+  // Double fork avoids zombie, forked removal process must not flush file
+  // buffers
+  if (!trash.empty()) {
+    if (async_delete_) {
+      pid_t pid;
+      int statloc;
+      if ((pid = fork()) == 0) {
+        // TODO(jblomer): eviciting files in the cache should perhaps become a
+        // thread.  This would also allow to block the chunks and prevent the
+        // race with re-insertion.  Then again, a thread can block umount.
+#ifndef DEBUGMSG
+        int max_fd = sysconf(_SC_OPEN_MAX);
+        for (int i = 0; i < max_fd; ++i)
+          close(i);
+#endif
+        if (fork() == 0) {
+          UnlinkFiles(&trash);
+          _exit(0);
+        }
+        _exit(0);
+      } else {
+        if (pid > 0)
+          waitpid(pid, &statloc, 0);
+        else
+          return false;
+      }
+    } else {  // !async_delete_
+      UnlinkFiles(&trash);
+    }
+  }
+  LogCvmfs(kLogQuota, kLogDebug, "cleanup of %lu files took %" PRIu64 " ms",
+           static_cast<unsigned long>(trash.size()),  // NOLINT
+           (platform_monotonic_time_ns() - start_ns) / 1000000);
+  CVMFS_PROBE2(quota_cleanup_done, gauge_, trash.size());
+
+  if (gauge_ > leave_size) {
+    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogWarn,
+             "request to clean until %" PRIu64 ", "
+             "but effective gauge is %" PRIu64, leave_size, gauge_);
+    return false;
+  }
+  return true;
+}
+
+
+/**
+ * Removes the least recently used entries from the cache database until the
+ * gauge is at most leave_size or, if max_files > 0, until max_files entries
+ * have been visited.  The paths of the removed files are appended to trash.
+ * Returns false if the cache database is out of sync.
+ */
+bool PosixQuotaManager::EvictLru(
+  const uint64_t leave_size,
+  const unsigned max_files,
+  vector<string> *trash)
+{
+  // The LRU order in the database must be up to date
+  WriteTouchedSeq();
 
   bool result;
   string hash_str;
-  vector<string> trash;
+  unsigned num_visited = 0;
+
+  // With the segmented LRU, the protected entries are evicted first only if
+  // they take too large a share of the cache
+  uint64_t size_protected = 0;
+  if (eviction_policy_ == kEvictSlru) {
+    if (sqlite3_step(stmt_size_protected_) == SQLITE_ROW)
+      size_protected = sqlite3_column_int64(stmt_size_protected_, 0);
+    sqlite3_reset(stmt_size_protected_);
+  }
 
   do {
-    sqlite3_reset(stmt_lru_);
-    if (sqlite3_step(stmt_lru_) != SQLITE_ROW) {
+    sqlite3_stmt *stmt_lru = stmt_lru_;
+    if ((size_protected > 0) &&
+        (size_protected > gauge_ / 100 * kSlruProtectedShare))
+    {
+      stmt_lru = stmt_lru_protected_;
+    }
+    sqlite3_reset(stmt_lru);
+    if (sqlite3_step(stmt_lru) != SQLITE_ROW) {
+      if (stmt_lru == stmt_lru_protected_) {
+        // Only blocked protected entries left
+        size_protected = 0;
+        continue;
+      }
       LogCvmfs(kLogQuota, kLogDebug, "could not get lru-entry");
       break;
     }
 
     hash_str = string(reinterpret_cast<const char *>(
-                      sqlite3_column_text(stmt_lru_, 0)));
+                      sqlite3_column_text(stmt_lru, 0)));
     LogCvmfs(kLogQuota, kLogDebug, "removing %s", hash_str.c_str());
     shash::Any hash = shash::MkFromHexPtr(shash::HexPtr(hash_str));
 
@@ -450,8 +558,14 @@ bool PosixQuotaManager::DoCleanup(const uint64_t leave_size) {
     // pinned file as it is already reserved (but will be inserted later).
     // Instead, set the pin bit in the db to not run into an endless loop
     if (pinned_chunks_.find(hash) == pinned_chunks_.end()) {
-      trash.push_back(cache_dir_ + "/" + hash.MakePathWithoutSuffix());
-      gauge_ -= sqlite3_column_int64(stmt_lru_, 1);
+      trash->push_back(cache_dir_ + "/" + hash.MakePathWithoutSuffix());
+      const uint64_t size = sqlite3_column_int64(stmt_lru, 1);
+      gauge_ -= size;
+      if (static_cast<uint64_t>(sqlite3_column_int64(stmt_lru, 2)) &
+          kProtectedFlag)
+      {
+        size_protected = (size_protected > size) ? size_protected - size : 0;
+      }
       LogCvmfs(kLogQuota, kLogDebug, "lru cleanup %s, new gauge %" PRIu64,
                hash_str.c_str(), gauge_);
 
@@ -474,59 +588,95 @@ bool PosixQuotaManager::DoCleanup(const uint64_t leave_size) {
       sqlite3_reset(stmt_block_);
       assert(result);
     }
-  } while (gauge_ > leave_size);
+    num_visited++;
+  } while ((gauge_ > leave_size) &&
+           ((max_files == 0) || (num_visited < max_files)));
+  sqlite3_reset(stmt_lru_);
+  sqlite3_reset(stmt_lru_protected_);
 
   result = (sqlite3_step(stmt_unblock_) == SQLITE_DONE);
   sqlite3_reset(stmt_unblock_);
   assert(result);
+  return true;
+}
 
-  // Double fork avoids zombie, forked removal process must not flush file
-  // buffers
-  if (!trash.empty()) {
-    if (async_delete_) {
-      pid_t pid;
-      int statloc;
-      if ((pid = fork()) == 0) {
-        // TODO(jblomer): eviciting files in the cache should perhaps become a
-        // thread.  This would also allow to block the chunks and prevent the
-        // race with re-insertion.  Then again, a thread can block umount.
-#ifndef DEBUGMSG
-        int max_fd = sysconf(_SC_OPEN_MAX);
-        for (int i = 0; i < max_fd; ++i)
-          close(i);
-#endif
-        if (fork() == 0) {
-          for (unsigned i = 0, iEnd = trash.size(); i < iEnd; ++i) {
-            LogCvmfs(kLogQuota, kLogDebug, "unlink %s", trash[i].c_str());
-            unlink(trash[i].c_str());
-          }
-          _exit(0);
-        }
-        _exit(0);
-      } else {
-        if (pid > 0)
-          waitpid(pid, &statloc, 0);
-        else
-          return false;
-      }
-    } else {  // !async_delete_
-      for (unsigned i = 0, iEnd = trash.size(); i < iEnd; ++i) {
-        LogCvmfs(kLogQuota, kLogDebug, "unlink %s", trash[i].c_str());
-        unlink(trash[i].c_str());
-      }
-    }
+
+/**
+ * Sorting the paths makes the unlinks proceed directory by directory.
+ */
+void PosixQuotaManager::UnlinkFiles(vector<string> *paths) {
+  sort(paths->begin(), paths->end());
+  for (unsigned i = 0, iEnd = paths->size(); i < iEnd; ++i) {
+    LogCvmfs(kLogQuota, kLogDebug, "unlink %s", (*paths)[i].c_str());
+    unlink((*paths)[i].c_str());
   }
+}
 
-  if (gauge_ > leave_size) {
-    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogWarn,
-             "request to clean until %" PRIu64 ", "
-             "but effective gauge is %" PRIu64, leave_size, gauge_);
+
+/**
+ * Starts a background cleanup once the gauge crosses the watermark.  Returns
+ * true as long as the background cleanup is not finished.
+ */
+bool PosixQuotaManager::IsBackgroundCleanupDue() {
+  if (background_cleanup_)
+    return true;
+  if (limit_ == 0)
     return false;
-  }
+  const uint64_t watermark = limit_ / 100 * kBackgroundCleanupWatermark;
+  if ((watermark <= cleanup_threshold_) || (gauge_ <= watermark))
+    return false;
+
+  LogCvmfs(kLogQuota, kLogSyslog,
+           "start background cleanup of cache until at most %lu KB is used",
+           cleanup_threshold_/1024);
+  background_cleanup_ = true;
+  background_cleanup_since_ = platform_monotonic_time_ns();
+  background_cleanup_gauge_ = gauge_;
   return true;
 }
 
 
+/**
+ * Evicts a small portion of the cache in a single transaction.  Unlike
+ * DoCleanup(), the files are unlinked right away by the cache manager thread.
+ * That is cheaper than forking for every step and the cache manager is idle
+ * anyway.
+ */
+void PosixQuotaManager::DoBackgroundCleanupStep() {
+  assert(background_cleanup_);
+  uint64_t step = limit_ / 100 * kBackgroundCleanupStep;
+  if (step == 0) step = 1;
+  const uint64_t leave_size = (gauge_ > cleanup_threshold_ + step) ?
+                              gauge_ - step : cleanup_threshold_;
+  const uint64_t gauge_before = gauge_;
+
+  vector<string> trash;
+  int retval = sqlite3_exec(database_, "BEGIN", NULL, NULL, NULL);
+  assert(retval == SQLITE_OK);
+  bool result = EvictLru(leave_size, kMaxBackgroundCleanupFiles, &trash);
+  retval = sqlite3_exec(database_, "COMMIT", NULL, NULL, NULL);
+  if (retval != SQLITE_OK) {
+    LogCvmfs(kLogQuota, kLogSyslogErr,
+             "failed to commit background cleanup to cachedb, error %d",
+             retval);
+    abort();
+  }
+  UnlinkFiles(&trash);
+
+  // Stop if done or if no progress is possible (e.g. only pinned files left)
+  if (!result || (gauge_ <= cleanup_threshold_) || (gauge_ == gauge_before)) {
+    LogCvmfs(kLogQuota, kLogSyslog,
+             "finished background cleanup of cache, freed %" PRIu64 " KB in "
+             "%" PRIu64 " ms",
+             (background_cleanup_gauge_ > gauge_) ?
+               (background_cleanup_gauge_ - gauge_) / 1024 : 0,
+             (platform_monotonic_time_ns() - background_cleanup_since_) /
+               1000000);
+    background_cleanup_ = false;
+  }
+}
+
+
 void PosixQuotaManager::DoInsert(
   const shash::Any &hash,
   const uint64_t size,
@@ -536,6 +686,7 @@ void PosixQuotaManager::DoInsert(
   const string hash_str = hash.ToString();
   LogCvmfs(kLogQuota, kLogDebug, "insert into lru %s, path %s, method %d",
            hash_str.c_str(), description.c_str(), command_type);
+  CVMFS_PROBE3(quota_insert, hash_str.c_str(), size, description.c_str());
   const unsigned desc_length = (description.length() > kMaxDescription) ?
     kMaxDescription : description.length();
 
@@ -548,7 +699,7 @@ void PosixQuotaManager::DoInsert(
   cmd->desc_length = desc_length;
   memcpy(reinterpret_cast<char *>(cmd)+sizeof(LruCommand),
          &description[0], desc_length);
-  WritePipe(pipe_lru_[1], cmd, sizeof(LruCommand) + desc_length);
+  WriteCommand(cmd, sizeof(LruCommand) + desc_length);
 }
 
 
@@ -562,7 +713,7 @@ vector<string> PosixQuotaManager::DoList(const CommandType list_command) {
   LruCommand cmd;
   cmd.command_type = list_command;
   cmd.return_pipe = pipe_list[1];
-  WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+  WriteCommand(&cmd, sizeof(cmd));
 
   int length;
   do {
@@ -602,7 +753,7 @@ void PosixQuotaManager::GetLimits(uint64_t *limit, uint64_t *cleanup_threshold)
   LruCommand cmd;
   cmd.command_type = kLimits;
   cmd.return_pipe = pipe_limits[1];
-  WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+  WriteCommand(&cmd, sizeof(cmd));
   ReadHalfPipe(pipe_limits[0], limit, sizeof(*limit));
   ReadPipe(pipe_limits[0], cleanup_threshold, sizeof(*cleanup_threshold));
   CloseReturnPipe(pipe_limits);
@@ -630,7 +781,7 @@ pid_t PosixQuotaManager::GetPid() {
   LruCommand cmd;
   cmd.command_type = kPid;
   cmd.return_pipe = pipe_pid[1];
-  WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+  WriteCommand(&cmd, sizeof(cmd));
   ReadHalfPipe(pipe_pid[0], &result, sizeof(result));
   CloseReturnPipe(pipe_pid);
   return result;
@@ -644,7 +795,7 @@ uint32_t PosixQuotaManager::GetProtocolRevision() {
   LruCommand cmd;
   cmd.command_type = kGetProtocolRevision;
   cmd.return_pipe = pipe_revision[1];
-  WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+  WriteCommand(&cmd, sizeof(cmd));
 
   uint32_t revision;
   ReadHalfPipe(pipe_revision[0], &revision, sizeof(revision));
@@ -663,7 +814,7 @@ void PosixQuotaManager::GetSharedStatus(uint64_t *gauge, uint64_t *pinned) {
   LruCommand cmd;
   cmd.command_type = kStatus;
   cmd.return_pipe = pipe_status[1];
-  WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+  WriteCommand(&cmd, sizeof(cmd));
   ReadHalfPipe(pipe_status[0], gauge, sizeof(*gauge));
   ReadPipe(pipe_status[0], pinned, sizeof(*pinned));
   CloseReturnPipe(pipe_status);
@@ -696,7 +847,7 @@ uint64_t PosixQuotaManager::GetCleanupRate(uint64_t period_s) {
   cmd.command_type = kCleanupRate;
   cmd.size = period_s;
   cmd.return_pipe = pipe_cleanup_rate[1];
-  WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+  WriteCommand(&cmd, sizeof(cmd));
   ReadHalfPipe(pipe_cleanup_rate[0], &cleanup_rate, sizeof(cleanup_rate));
   CloseReturnPipe(pipe_cleanup_rate);
 
@@ -704,6 +855,45 @@ uint64_t PosixQuotaManager::GetCleanupRate(uint64_t period_s) {
 }
 
 
+/**
+ * The sequence numbers of volatile, regular, and protected entries form three
+ * disjoint ranges of acseq.  Looking up the largest value in every range uses
+ * the acseq index, whereas masking the flags in a single query would need to
+ * scan the entire table, which takes long on caches with many files.
+ */
+bool PosixQuotaManager::GetMaxSeq(uint64_t *max_seq) {
+  const int64_t ranges[][2] = {
+    {static_cast<int64_t>(kVolatileFlag), 0},
+    {0, static_cast<int64_t>(kProtectedFlag)},
+    {static_cast<int64_t>(kProtectedFlag), numeric_limits<int64_t>::max()}
+  };
+  sqlite3_stmt *stmt;
+  int retval = sqlite3_prepare_v2(database_,
+    "SELECT acseq FROM cache_catalog WHERE acseq >= :lower AND acseq < :upper "
+    "ORDER BY acseq DESC LIMIT 1;", -1, &stmt, NULL);
+  if (retval != SQLITE_OK)
+    return false;
+
+  *max_seq = 0;
+  for (unsigned i = 0; i < sizeof(ranges) / sizeof(ranges[0]); ++i) {
+    sqlite3_bind_int64(stmt, 1, ranges[i][0]);
+    sqlite3_bind_int64(stmt, 2, ranges[i][1]);
+    retval = sqlite3_step(stmt);
+    if (retval == SQLITE_ROW) {
+      const uint64_t seq = static_cast<uint64_t>(sqlite3_column_int64(stmt, 0))
+                           & ~(kVolatileFlag | kProtectedFlag);
+      *max_seq = std::max(*max_seq, seq);
+    } else if (retval != SQLITE_DONE) {
+      sqlite3_finalize(stmt);
+      return false;
+    }
+    sqlite3_reset(stmt);
+  }
+  sqlite3_finalize(stmt);
+  return true;
+}
+
+
 bool PosixQuotaManager::InitDatabase(const bool rebuild_database) {
   string sql;
   sqlite3_stmt *stmt;
@@ -773,8 +963,8 @@ bool PosixQuotaManager::InitDatabase(const bool rebuild_database) {
     }
   }
 
-  // Set pinned back
-  sql = "UPDATE cache_catalog SET pinned=0;";
+  // Set pinned back, only touching the rows that need to change
+  sql = "UPDATE cache_catalog SET pinned=0 WHERE pinned<>0;";
   err = sqlite3_exec(database_, sql.c_str(), NULL, NULL, NULL);
   if (err != SQLITE_OK) {
     LogCvmfs(kLogQuota, kLogDebug, "could not init cache database (failed: %s)",
@@ -826,20 +1016,16 @@ bool PosixQuotaManager::InitDatabase(const bool rebuild_database) {
   sqlite3_finalize(stmt);
 
   // Highest seq-no?
-  sql = "SELECT coalesce(max(acseq & (~(1<<63))), 0) FROM cache_catalog;";
-  sqlite3_prepare_v2(database_, sql.c_str(), -1, &stmt, NULL);
-  if (sqlite3_step(stmt) == SQLITE_ROW) {
-    seq_ = sqlite3_column_int64(stmt, 0)+1;
-  } else {
+  if (!GetMaxSeq(&seq_)) {
     LogCvmfs(kLogQuota, kLogDebug, "could not determine highest seq-no");
-    sqlite3_finalize(stmt);
     goto init_database_fail;
   }
-  sqlite3_finalize(stmt);
+  seq_++;
 
   // Prepare touch, new, remove statements
   sqlite3_prepare_v2(database_,
-                     "UPDATE cache_catalog SET acseq=:seq | (acseq&(1<<63)) "
+                     "UPDATE cache_catalog SET acseq=:seq | (acseq&(1<<63)) | "
+                     "  (CASE WHEN acseq >= 0 THEN :protect ELSE 0 END) "
                      "WHERE sha1=:sha1;", -1, &stmt_touch_, NULL);
   sqlite3_prepare_v2(database_, "UPDATE cache_catalog SET pinned=0 "
                      "WHERE sha1=:sha1;", -1, &stmt_unpin_, NULL);
@@ -858,10 +1044,20 @@ bool PosixQuotaManager::InitDatabase(const bool rebuild_database) {
   sqlite3_prepare_v2(database_, "DELETE FROM cache_catalog WHERE sha1=:sha1;",
                      -1, &stmt_rm_, NULL);
   sqlite3_prepare_v2(database_,
-                     "SELECT sha1, size FROM cache_catalog WHERE "
+                     "SELECT sha1, size, acseq FROM cache_catalog WHERE "
                      "acseq=(SELECT min(acseq) "
                      "FROM cache_catalog WHERE pinned<>2);",
                      -1, &stmt_lru_, NULL);
+  sqlite3_prepare_v2(database_,
+                     "SELECT sha1, size, acseq FROM cache_catalog WHERE "
+                     "acseq=(SELECT min(acseq) "
+                     "FROM cache_catalog WHERE acseq >= (1<<62) "
+                     "AND pinned<>2);",
+                     -1, &stmt_lru_protected_, NULL);
+  sqlite3_prepare_v2(database_,
+                     "SELECT coalesce(sum(size), 0) FROM cache_catalog "
+                     "WHERE acseq >= (1<<62);",
+                     -1, &stmt_size_protected_, NULL);
   sqlite3_prepare_v2(database_,
                      ("SELECT path FROM cache_catalog WHERE type=" +
                       StringifyInt(kFileRegular) +
@@ -1019,6 +1215,10 @@ int PosixQuotaManager::MainCacheManager(int argc, char **argv) {
     return 1;
   }
   shared_manager.CheckFreeSpace();
+  if (argc > 11) {
+    shared_manager.SetEvictionPolicy(
+      static_cast<EvictionPolicy>(String2Int64(argv[11])));
+  }
 
   // Save protocol revision to file.  If the file is not found, it indicates
   // to the client that the cache manager is from times before the protocol
@@ -1092,9 +1292,29 @@ void *PosixQuotaManager::MainCommandServer(void *data) {
   char description_buffer[kCommandBufferSize*kMaxDescription];
   unsigned num_commands = 0;
 
-  while (read(quota_mgr->pipe_lru_[0], &command_buffer[num_commands],
-              sizeof(command_buffer[0])) == sizeof(command_buffer[0]))
-  {
+  while (true) {
+    // Evict ahead of demand while no command is waiting
+    while (quota_mgr->IsBackgroundCleanupDue()) {
+      struct pollfd poll_lru;
+      poll_lru.fd = quota_mgr->pipe_lru_[0];
+      poll_lru.events = POLLIN;
+      poll_lru.revents = 0;
+      if (poll(&poll_lru, 1, 0) != 0)
+        break;
+      // Apply buffered touches and inserts first to get the LRU order right
+      if (num_commands > 0) {
+        quota_mgr->ProcessCommandBunch(num_commands, command_buffer,
+                                       description_buffer);
+        num_commands = 0;
+      }
+      quota_mgr->DoBackgroundCleanupStep();
+    }
+
+    if (read(quota_mgr->pipe_lru_[0], &command_buffer[num_commands],
+             sizeof(command_buffer[0])) != sizeof(command_buffer[0]))
+    {
+      break;
+    }
     const CommandType command_type = command_buffer[num_commands].command_type;
     LogCvmfs(kLogQuota, kLogDebug, "received command %d", command_type);
     const uint64_t size = command_buffer[num_commands].GetSize();
@@ -1108,6 +1328,38 @@ void *PosixQuotaManager::MainCommandServer(void *data) {
                &description_buffer[kMaxDescription*num_commands], desc_length);
     }
 
+    // Batches of touches are unpacked into the command buffer.  A batch always
+    // fits into the buffer, so that it is applied in a single transaction.
+    if (command_type == kTouchBatch) {
+      unsigned char batch[kMaxDescription];
+      const unsigned batch_size = command_buffer[num_commands].desc_length;
+      assert(batch_size <= kMaxDescription);
+      ReadPipe(quota_mgr->pipe_lru_[0], batch, batch_size);
+      const unsigned num_touches = batch_size / kTouchBatchEntrySize;
+      if (num_commands + num_touches > kCommandBufferSize) {
+        quota_mgr->ProcessCommandBunch(num_commands, command_buffer,
+                                       description_buffer);
+        num_commands = 0;
+      }
+      for (unsigned i = 0; i < num_touches; ++i) {
+        const unsigned char *entry = &batch[i * kTouchBatchEntrySize];
+        if (entry[0] >= shash::kAny)
+          continue;
+        shash::Any hash(static_cast<shash::Algorithms>(entry[0]));
+        memcpy(hash.digest, entry + 1, hash.GetDigestSize());
+        command_buffer[num_commands] = LruCommand();
+        command_buffer[num_commands].command_type = kTouch;
+        command_buffer[num_commands].StoreHash(hash);
+        num_commands++;
+      }
+      if (num_commands == kCommandBufferSize) {
+        quota_mgr->ProcessCommandBunch(num_commands, command_buffer,
+                                       description_buffer);
+        num_commands = 0;
+      }
+      continue;
+    }
+
     // The protocol revision is returned immediately
     if (command_type == kGetProtocolRevision) {
       int return_pipe =
@@ -1422,6 +1674,22 @@ void PosixQuotaManager::MakeReturnPipe(int pipe[2]) {
 }
 
 
+bool PosixQuotaManager::ParseEvictionPolicy(
+  const string &name,
+  EvictionPolicy *eviction_policy)
+{
+  if ((name == "") || (name == "lru")) {
+    *eviction_policy = kEvictLru;
+    return true;
+  }
+  if (name == "slru") {
+    *eviction_policy = kEvictSlru;
+    return true;
+  }
+  return false;
+}
+
+
 void PosixQuotaManager::ParseDirectories(
   const std::string cache_workspace,
   std::string *cache_dir,
@@ -1503,7 +1771,7 @@ bool PosixQuotaManager::Pin(
   cmd.SetSize(size);
   cmd.StoreHash(hash);
   cmd.return_pipe = pipe_reserve[1];
-  WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+  WriteCommand(&cmd, sizeof(cmd));
   bool result;
   ReadHalfPipe(pipe_reserve[0], &result, sizeof(result));
   CloseReturnPipe(pipe_reserve);
@@ -1530,6 +1798,10 @@ PosixQuotaManager::PosixQuotaManager(
   , workspace_dir_()  // initialized in body
   , fd_lock_cachedb_(-1)
   , async_delete_(true)
+  , background_cleanup_(false)
+  , background_cleanup_since_(0)
+  , background_cleanup_gauge_(0)
+  , eviction_policy_(kEvictLru)
   , database_(NULL)
   , stmt_touch_(NULL)
   , stmt_unpin_(NULL)
@@ -1537,6 +1809,8 @@ PosixQuotaManager::PosixQuotaManager(
   , stmt_unblock_(NULL)
   , stmt_new_(NULL)
   , stmt_lru_(NULL)
+  , stmt_lru_protected_(NULL)
+  , stmt_size_protected_(NULL)
   , stmt_size_(NULL)
   , stmt_rm_(NULL)
   , stmt_list_(NULL)
@@ -1547,6 +1821,13 @@ PosixQuotaManager::PosixQuotaManager(
 {
   ParseDirectories(cache_workspace, &cache_dir_, &workspace_dir_);
   pipe_lru_[0] = pipe_lru_[1] = -1;
+  pending_touches_since_ = 0;
+  pipe_terminate_touches_[0] = pipe_terminate_touches_[1] = -1;
+  flush_touches_spawned_ = false;
+  int retval = pthread_mutex_init(&lock_touches_, NULL);
+  assert(retval == 0);
+  touched_seq_.Init(1024, shash::Any(), hasher_any);
+  last_checkpoint_ = platform_monotonic_time();
   cleanup_recorder_.AddRecorder(1, 90);  // last 1.5 min with second resolution
   // last 1.5 h with minute resolution
   cleanup_recorder_.AddRecorder(60, 90*60);
@@ -1558,6 +1839,15 @@ PosixQuotaManager::PosixQuotaManager(
 
 
 PosixQuotaManager::~PosixQuotaManager() {
+  if (flush_touches_spawned_) {
+    char fin = 0;
+    WritePipe(pipe_terminate_touches_[1], &fin, 1);
+    pthread_join(thread_flush_touches_, NULL);
+    ClosePipe(pipe_terminate_touches_);
+  }
+  if (initialized_)
+    FlushTouches();
+  pthread_mutex_destroy(&lock_touches_);
   if (!initialized_) return;
 
   if (shared_) {
@@ -1597,19 +1887,7 @@ void PosixQuotaManager::ProcessCommandBunch(
     bool exists;
     switch (commands[i].command_type) {
       case kTouch:
-        sqlite3_bind_int64(stmt_touch_, 1, seq_++);
-        sqlite3_bind_text(stmt_touch_, 2, &hash_str[0], hash_str.length(),
-                          SQLITE_STATIC);
-        retval = sqlite3_step(stmt_touch_);
-        LogCvmfs(kLogQuota, kLogDebug, "touching %s (%ld): %d",
-                 hash_str.c_str(), seq_-1, retval);
-        if ((retval != SQLITE_DONE) && (retval != SQLITE_OK)) {
-          LogCvmfs(kLogQuota, kLogSyslogErr,
-                   "failed to update %s in cachedb, error %d",
-                   hash_str.c_str(), retval);
-          abort();
-        }
-        sqlite3_reset(stmt_touch_);
+        touched_seq_.Insert(hash, seq_++);
         break;
       case kUnpin:
         sqlite3_bind_text(stmt_unpin_, 1, &hash_str[0], hash_str.length(),
@@ -1640,7 +1918,8 @@ void PosixQuotaManager::ProcessCommandBunch(
           assert(retval != 0);
         }
 
-        // Insert or replace
+        // Insert or replace, the new sequence number supersedes touches
+        touched_seq_.Erase(hash);
         sqlite3_bind_text(stmt_new_, 1, &hash_str[0], hash_str.length(),
                           SQLITE_STATIC);
         sqlite3_bind_int64(stmt_new_, 2, size);
@@ -1674,6 +1953,12 @@ void PosixQuotaManager::ProcessCommandBunch(
     }
   }
 
+  if ((touched_seq_.size() >= kMaxTouchedSeq) ||
+      (platform_monotonic_time() >= last_checkpoint_ + kCheckpointIntervalS))
+  {
+    WriteTouchedSeq();
+  }
+
   retval = sqlite3_exec(database_, "COMMIT", NULL, NULL, NULL);
   if (retval != SQLITE_OK) {
     LogCvmfs(kLogQuota, kLogSyslogErr,
@@ -1683,18 +1968,61 @@ void PosixQuotaManager::ProcessCommandBunch(
 }
 
 
+/**
+ * Scans a single cache sub-directory.  Runs in a separate thread, the results
+ * are inserted into the database by RebuildDatabase().
+ */
+void *PosixQuotaManager::MainRebuildShard(void *data) {
+  RebuildShard *shard = reinterpret_cast<RebuildShard *>(data);
+  platform_dirent64 *d;
+  struct stat info;
+
+  DIR *dirp = opendir(shard->path.c_str());
+  if (dirp == NULL) {
+    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
+             "failed to open directory %s (tmpwatch interfering?)",
+             shard->path.c_str());
+    return NULL;
+  }
+  while ((d = platform_readdir(dirp)) != NULL) {
+    string file_path = shard->path + "/" + string(d->d_name);
+    if (stat(file_path.c_str(), &info) == 0) {
+      if (!S_ISREG(info.st_mode))
+        continue;
+      if (info.st_size == 0) {
+        LogCvmfs(kLogQuota, kLogSyslog | kLogDebug,
+                 "removing empty file %s during automatic cache db rebuild",
+                 file_path.c_str());
+        unlink(file_path.c_str());
+        continue;
+      }
+
+      RebuildShard::Entry entry;
+      entry.hash = shard->hex_prefix + string(d->d_name);
+      entry.size = info.st_size;
+      entry.atime = info.st_atime;
+      shard->entries.push_back(entry);
+    } else {
+      LogCvmfs(kLogQuota, kLogDebug, "could not stat %s", file_path.c_str());
+    }
+  }
+  closedir(dirp);
+  shard->result = true;
+  return NULL;
+}
+
+
 bool PosixQuotaManager::RebuildDatabase() {
   bool result = false;
+  bool in_transaction = false;
   string sql;
   sqlite3_stmt *stmt_select = NULL;
   sqlite3_stmt *stmt_insert = NULL;
   int sqlerr;
   int seq = 0;
   char hex[4];
-  struct stat info;
-  platform_dirent64 *d;
-  DIR *dirp = NULL;
-  string path;
+  vector<RebuildShard> shards;
+  vector<pthread_t> threads;
 
   LogCvmfs(kLogQuota, kLogSyslog | kLogDebug, "re-building cache database");
 
@@ -1708,51 +2036,55 @@ bool PosixQuotaManager::RebuildDatabase() {
 
   gauge_ = 0;
 
-  // Insert files from cache sub-directories 00 - ff
+  // A single transaction saves a journal update per inserted file
+  sqlerr = sqlite3_exec(database_, "BEGIN", NULL, NULL, NULL);
+  if (sqlerr != SQLITE_OK) {
+    LogCvmfs(kLogQuota, kLogDebug, "could not start rebuild transaction");
+    goto build_return;
+  }
+  in_transaction = true;
+
+  // Insert files from cache sub-directories 00 - ff.  The directories are
+  // scanned in batches of kRebuildThreads in parallel, which hides the
+  // latency of stat() on large caches.
   // TODO(jblomer): fs_traversal
   sqlite3_prepare_v2(database_, "INSERT INTO fscache (sha1, size, actime) "
                      "VALUES (:sha1, :s, :t);", -1, &stmt_insert, NULL);
 
-  for (int i = 0; i <= 0xff; i++) {
-    snprintf(hex, sizeof(hex), "%02x", i);
-    path = cache_dir_ + "/" + string(hex);
-    if ((dirp = opendir(path.c_str())) == NULL) {
-      LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
-               "failed to open directory %s (tmpwatch interfering?)",
-               path.c_str());
-      goto build_return;
+  for (int i = 0; i <= 0xff; i += kRebuildThreads) {
+    const int batch_size =
+      std::min(0x100 - i, static_cast<int>(kRebuildThreads));
+    shards.assign(batch_size, RebuildShard());
+    threads.assign(batch_size, pthread_t());
+    for (int j = 0; j < batch_size; ++j) {
+      snprintf(hex, sizeof(hex), "%02x", i + j);
+      shards[j].hex_prefix = string(hex);
+      shards[j].path = cache_dir_ + "/" + shards[j].hex_prefix;
+      int retval = pthread_create(&threads[j], NULL, MainRebuildShard,
+                                  &shards[j]);
+      assert(retval == 0);
     }
-    while ((d = platform_readdir(dirp)) != NULL) {
-      string file_path = path + "/" + string(d->d_name);
-      if (stat(file_path.c_str(), &info) == 0) {
-        if (!S_ISREG(info.st_mode))
-          continue;
-        if (info.st_size == 0) {
-          LogCvmfs(kLogQuota, kLogSyslog | kLogDebug,
-                   "removing empty file %s during automatic cache db rebuild",
-                   file_path.c_str());
-          unlink(file_path.c_str());
-          continue;
-        }
-
-        string hash = string(hex) + string(d->d_name);
-        sqlite3_bind_text(stmt_insert, 1, hash.data(), hash.length(),
-                          SQLITE_STATIC);
-        sqlite3_bind_int64(stmt_insert, 2, info.st_size);
-        sqlite3_bind_int64(stmt_insert, 3, info.st_atime);
+    for (int j = 0; j < batch_size; ++j)
+      pthread_join(threads[j], NULL);
+
+    for (int j = 0; j < batch_size; ++j) {
+      if (!shards[j].result)
+        goto build_return;
+      const vector<RebuildShard::Entry> &entries = shards[j].entries;
+      for (unsigned k = 0; k < entries.size(); ++k) {
+        sqlite3_bind_text(stmt_insert, 1, entries[k].hash.data(),
+                          entries[k].hash.length(), SQLITE_STATIC);
+        sqlite3_bind_int64(stmt_insert, 2, entries[k].size);
+        sqlite3_bind_int64(stmt_insert, 3, entries[k].atime);
         if (sqlite3_step(stmt_insert) != SQLITE_DONE) {
           LogCvmfs(kLogQuota, kLogDebug, "could not insert into temp table");
           goto build_return;
         }
         sqlite3_reset(stmt_insert);
 
-        gauge_ += info.st_size;
-      } else {
-        LogCvmfs(kLogQuota, kLogDebug, "could not stat %s", file_path.c_str());
+        gauge_ += entries[k].size;
       }
     }
-    closedir(dirp);
-    dirp = NULL;
   }
   sqlite3_finalize(stmt_insert);
   stmt_insert = NULL;
@@ -1784,6 +2116,10 @@ bool PosixQuotaManager::RebuildDatabase() {
     }
     sqlite3_reset(stmt_insert);
   }
+  sqlite3_finalize(stmt_insert);
+  sqlite3_finalize(stmt_select);
+  stmt_insert = NULL;
+  stmt_select = NULL;
 
   // Delete temporary table
   sql = "DELETE FROM fscache;";
@@ -1794,6 +2130,14 @@ bool PosixQuotaManager::RebuildDatabase() {
     goto build_return;
   }
 
+  sqlerr = sqlite3_exec(database_, "COMMIT", NULL, NULL, NULL);
+  if (sqlerr != SQLITE_OK) {
+    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
+             "could not commit cache database rebuild (%d)", sqlerr);
+    goto build_return;
+  }
+  in_transaction = false;
+
   seq_ = seq;
   result = true;
   LogCvmfs(kLogQuota, kLogDebug,
@@ -1803,7 +2147,7 @@ bool PosixQuotaManager::RebuildDatabase() {
  build_return:
   if (stmt_insert) sqlite3_finalize(stmt_insert);
   if (stmt_select) sqlite3_finalize(stmt_select);
-  if (dirp) closedir(dirp);
+  if (in_transaction) sqlite3_exec(database_, "ROLLBACK", NULL, NULL, NULL);
   return result;
 }
 
@@ -1825,7 +2169,7 @@ void PosixQuotaManager::RegisterBackChannel(
     cmd.return_pipe = back_channel[1];
     // Not StoreHash().  This is an MD5 hash.
     memcpy(cmd.digest, hash.digest, hash.GetDigestSize());
-    WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+    WriteCommand(&cmd, sizeof(cmd));
 
     char success;
     ReadHalfPipe(back_channel[0], &success, sizeof(success));
@@ -1855,7 +2199,7 @@ void PosixQuotaManager::Remove(const shash::Any &hash) {
   cmd.command_type = kRemove;
   cmd.return_pipe = pipe_remove[1];
   cmd.StoreHash(hash);
-  WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+  WriteCommand(&cmd, sizeof(cmd));
 
   bool success;
   ReadHalfPipe(pipe_remove[0], &success, sizeof(success));
@@ -1865,7 +2209,39 @@ void PosixQuotaManager::Remove(const shash::Any &hash) {
 }
 
 
+/**
+ * Switching back to plain LRU drops the protection of all entries, otherwise
+ * they would be evicted only after all the other entries.
+ */
+void PosixQuotaManager::SetEvictionPolicy(
+  const EvictionPolicy eviction_policy)
+{
+  assert(!spawned_ || shared_);
+  eviction_policy_ = eviction_policy;
+  LogCvmfs(kLogQuota, kLogDebug, "using eviction policy %d", eviction_policy);
+  if ((eviction_policy_ != kEvictLru) || (database_ == NULL))
+    return;
+
+  WriteTouchedSeq();
+  int retval = sqlite3_exec(database_,
+    "UPDATE cache_catalog SET acseq = acseq & (~(1<<62)) "
+    "WHERE acseq >= (1<<62);", NULL, NULL, NULL);
+  if (retval != SQLITE_OK) {
+    LogCvmfs(kLogQuota, kLogDebug | kLogSyslogErr,
+             "failed to reset protected entries in cachedb (%d)", retval);
+  }
+}
+
+
 void PosixQuotaManager::Spawn() {
+  if ((protocol_revision_ >= 3) && !flush_touches_spawned_) {
+    MakePipe(pipe_terminate_touches_);
+    int retval = pthread_create(&thread_flush_touches_, NULL, MainFlushTouches,
+                                static_cast<void *>(this));
+    assert(retval == 0);
+    flush_touches_spawned_ = true;
+  }
+
   if (spawned_)
     return;
 
@@ -1881,13 +2257,157 @@ void PosixQuotaManager::Spawn() {
 
 
 /**
- * Updates the sequence number of the file specified by the hash.
+ * Updates the sequence number of the file specified by the hash.  If the
+ * cache manager supports it, touches are collected and sent in batches.
  */
 void PosixQuotaManager::Touch(const shash::Any &hash) {
-  LruCommand cmd;
-  cmd.command_type = kTouch;
-  cmd.StoreHash(hash);
-  WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+  if (protocol_revision_ < 3) {
+    LruCommand cmd;
+    cmd.command_type = kTouch;
+    cmd.StoreHash(hash);
+    WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+    return;
+  }
+
+  MutexLockGuard lock_guard(&lock_touches_);
+  const uint64_t now = platform_monotonic_time();
+  if (pending_touches_.empty())
+    pending_touches_since_ = now;
+  if (find(pending_touches_.begin(), pending_touches_.end(), hash) ==
+      pending_touches_.end())
+  {
+    pending_touches_.push_back(hash);
+  }
+  if ((pending_touches_.size() >= kMaxTouchBatch) ||
+      (now >= pending_touches_since_ + kTouchWindowS))
+  {
+    DoFlushTouches();
+  }
+}
+
+
+/**
+ * All commands except for touches go through here.  Pending touches are sent
+ * first, so that the cache manager sees the commands in order.
+ */
+void PosixQuotaManager::WriteCommand(const void *buf, const unsigned size) {
+  FlushTouches();
+  WritePipe(pipe_lru_[1], buf, size);
+}
+
+
+void PosixQuotaManager::FlushTouches() {
+  if (protocol_revision_ < 3)
+    return;
+  MutexLockGuard lock_guard(&lock_touches_);
+  DoFlushTouches();
+}
+
+
+/**
+ * Sends the pending touches as a single kTouchBatch command.  The caller holds
+ * lock_touches_.
+ */
+void PosixQuotaManager::DoFlushTouches() {
+  if (pending_touches_.empty())
+    return;
+
+  struct {
+    LruCommand command;
+    unsigned char batch[kMaxDescription];
+  } frame;
+  assert(pending_touches_.size() <= kMaxTouchBatch);
+  memset(frame.batch, 0, sizeof(frame.batch));
+  for (unsigned i = 0; i < pending_touches_.size(); ++i) {
+    unsigned char *entry = &frame.batch[i * kTouchBatchEntrySize];
+    entry[0] = pending_touches_[i].algorithm;
+    memcpy(entry + 1, pending_touches_[i].digest,
+           pending_touches_[i].GetDigestSize());
+  }
+  frame.command.command_type = kTouchBatch;
+  frame.command.desc_length = pending_touches_.size() * kTouchBatchEntrySize;
+  WritePipe(pipe_lru_[1], &frame,
+            sizeof(LruCommand) + frame.command.desc_length);
+  pending_touches_.clear();
+}
+
+
+/**
+ * Sends the pending touches once the batch is older than kTouchWindowS, even
+ * if no further touch or command arrives.
+ */
+void *PosixQuotaManager::MainFlushTouches(void *data) {
+  PosixQuotaManager *quota_mgr = reinterpret_cast<PosixQuotaManager *>(data);
+  LogCvmfs(kLogQuota, kLogDebug, "starting touch flusher");
+
+  struct pollfd watch_term;
+  watch_term.fd = quota_mgr->pipe_terminate_touches_[0];
+  watch_term.events = POLLIN | POLLPRI;
+  while (true) {
+    watch_term.revents = 0;
+    int retval = poll(&watch_term, 1, kTouchCheckIntervalMs);
+    if ((retval < 0) && (errno == EINTR))
+      continue;
+    if (retval != 0)
+      break;
+
+    MutexLockGuard lock_guard(&quota_mgr->lock_touches_);
+    if (!quota_mgr->pending_touches_.empty() &&
+        (platform_monotonic_time() >=
+         quota_mgr->pending_touches_since_ + kTouchWindowS))
+    {
+      quota_mgr->DoFlushTouches();
+    }
+  }
+
+  LogCvmfs(kLogQuota, kLogDebug, "stopping touch flusher");
+  return NULL;
+}
+
+
+/**
+ * Writes the access sequence numbers of the touched files to the cache
+ * database.  Opens its own transaction unless called from within one.  Entries
+ * of files that were removed in the meantime are silently dropped by the
+ * UPDATE statement.
+ */
+void PosixQuotaManager::WriteTouchedSeq() {
+  last_checkpoint_ = platform_monotonic_time();
+  if (touched_seq_.size() == 0)
+    return;
+  LogCvmfs(kLogQuota, kLogDebug, "writing %u touched entries to cachedb",
+           touched_seq_.size());
+  const bool own_transaction = sqlite3_get_autocommit(database_) != 0;
+  if (own_transaction)
+    sqlite3_exec(database_, "BEGIN", NULL, NULL, NULL);
+
+  const shash::Any empty;
+  shash::Any *keys = touched_seq_.keys();
+  uint64_t *values = touched_seq_.values();
+  for (unsigned i = 0; i < touched_seq_.capacity(); ++i) {
+    if (keys[i] == empty)
+      continue;
+    const string hash_str = keys[i].ToString();
+    sqlite3_bind_int64(stmt_touch_, 1, values[i]);
+    sqlite3_bind_int64(stmt_touch_, 2,
+                       (eviction_policy_ == kEvictSlru) ? kProtectedFlag : 0);
+    sqlite3_bind_text(stmt_touch_, 3, &hash_str[0], hash_str.length(),
+                      SQLITE_STATIC);
+    int retval = sqlite3_step(stmt_touch_);
+    LogCvmfs(kLogQuota, kLogDebug, "touching %s (%ld): %d",
+             hash_str.c_str(), values[i], retval);
+    if ((retval != SQLITE_DONE) && (retval != SQLITE_OK)) {
+      LogCvmfs(kLogQuota, kLogSyslogErr,
+               "failed to update %s in cachedb, error %d",
+               hash_str.c_str(), retval);
+      abort();
+    }
+    sqlite3_reset(stmt_touch_);
+  }
+  touched_seq_.Clear();
+
+  if (own_transaction)
+    sqlite3_exec(database_, "COMMIT", NULL, NULL, NULL);
 }
 
 
@@ -1909,7 +2429,7 @@ void PosixQuotaManager::Unpin(const shash::Any &hash) {
   LruCommand cmd;
   cmd.command_type = kUnpin;
   cmd.StoreHash(hash);
-  WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+  WriteCommand(&cmd, sizeof(cmd));
 }
 
 
@@ -1924,7 +2444,7 @@ void PosixQuotaManager::UnregisterBackChannel(
     cmd.command_type = kUnregisterBackChannel;
     // Not StoreHash().  This is an MD5 hash.
     memcpy(cmd.digest, hash.digest, hash.GetDigestSize());
-    WritePipe(pipe_lru_[1], &cmd, sizeof(cmd));
+    WriteCommand(&cmd, sizeof(cmd));
 
     // Writer's end will be closed by cache manager, FIFO is already unlinked
     close(back_channel[0]);
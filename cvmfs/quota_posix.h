@@ -18,6 +18,7 @@
 #include "gtest/gtest_prod.h"
 #include "hash.h"
 #include "quota.h"
+#include "smallhash.h"
 #include "statistics.h"
 #include "util/single_copy.h"
 #include "util/string.h"
@@ -33,13 +34,32 @@ class Recorder;
  * TODO(jblomer): split into client, server, and protocol classes.
  */
 class PosixQuotaManager : public QuotaManager {
+  FRIEND_TEST(T_QuotaManager, BackgroundCleanup);
   FRIEND_TEST(T_QuotaManager, BindReturnPipe);
   FRIEND_TEST(T_QuotaManager, Cleanup);
+  FRIEND_TEST(T_QuotaManager, CleanupSlru);
   FRIEND_TEST(T_QuotaManager, Contains);
+  FRIEND_TEST(T_QuotaManager, GetMaxSeq);
   FRIEND_TEST(T_QuotaManager, InitDatabase);
   FRIEND_TEST(T_QuotaManager, MakeReturnPipe);
+  FRIEND_TEST(T_QuotaManager, TouchBatch);
+  FRIEND_TEST(T_QuotaManager, TouchWindow);
+  FRIEND_TEST(T_QuotaManager, TouchCheckpoint);
 
  public:
+  /**
+   * Order in which files are evicted from the cache.  With kEvictLru, the
+   * least recently used files are removed first.  kEvictSlru is a segmented
+   * LRU: files that are opened from the cache again after their insertion are
+   * protected and only evicted after all the files that were used once, unless
+   * the protected files exceed kSlruProtectedShare of the cache size.  That
+   * makes the cache resistant against a single scan of a large data set.
+   */
+  enum EvictionPolicy {
+    kEvictLru = 0,
+    kEvictSlru,
+  };
+
   static PosixQuotaManager *Create(const std::string &cache_workspace,
     const uint64_t limit, const uint64_t cleanup_threshold,
     const bool rebuild_database);
@@ -48,8 +68,11 @@ class PosixQuotaManager : public QuotaManager {
     const std::string &cache_workspace,
     const uint64_t limit,
     const uint64_t cleanup_threshold,
-    bool foreground);
+    bool foreground,
+    const EvictionPolicy eviction_policy);
   static int MainCacheManager(int argc, char **argv);
+  static bool ParseEvictionPolicy(const std::string &name,
+                                  EvictionPolicy *eviction_policy);
 
   virtual ~PosixQuotaManager();
   virtual bool HasCapability(Capabilities capability) { return true; }
@@ -84,6 +107,13 @@ class PosixQuotaManager : public QuotaManager {
   virtual pid_t GetPid();
   virtual uint32_t GetProtocolRevision();
 
+  /**
+   * Only for the exclusive cache manager, before Spawn().  The shared cache
+   * manager receives the policy on its command line.
+   */
+  void SetEvictionPolicy(const EvictionPolicy eviction_policy);
+  EvictionPolicy eviction_policy() const { return eviction_policy_; }
+
  private:
   /**
    * Loaded catalogs are pinned in the LRU and have to be treated differently.
@@ -118,6 +148,8 @@ class PosixQuotaManager : public QuotaManager {
     // as of protocol revision 2
     kListVolatile,
     kCleanupRate,
+    // as of protocol revision 3
+    kTouchBatch,
   };
 
   /**
@@ -190,12 +222,37 @@ class PosixQuotaManager : public QuotaManager {
    */
   static const unsigned kMaxDescription = 512-sizeof(LruCommand);
 
+  /**
+   * Touches are collected and sent as a single kTouchBatch command.  The batch
+   * is transferred in the description part of the command, each entry is the
+   * hash algorithm followed by the digest.  Repeated touches of the same hash
+   * within a batch are coalesced.  A batch is sent when it is full, when the
+   * first touch is older than kTouchWindowS seconds, or before any other
+   * command.  The age of the batch is checked every kTouchCheckIntervalMs by
+   * a separate thread, so that the window holds on an idle client, too.
+   */
+  static const unsigned kTouchBatchEntrySize = 1 + shash::kMaxDigestSize;
+  static const unsigned kMaxTouchBatch = kMaxDescription / kTouchBatchEntrySize;
+  static const unsigned kTouchWindowS = 1;
+  static const unsigned kTouchCheckIntervalMs = 250;
+
   /**
    * Alarm when more than 75% of the cache fraction allowed for pinned files
    * (50%) is filled with pinned files
    */
   static const unsigned kHighPinWatermark = 75;
 
+  /**
+   * Once the cache is filled beyond 90% of the limit, the cache manager starts
+   * to evict files in the background, whenever there are no pending commands.
+   * It cleans up until cleanup_threshold_ in steps of at most 1% of the limit
+   * resp. kMaxBackgroundCleanupFiles files, so that a cleanup is usually done
+   * before an insert hits the limit and has to wait for a full cleanup.
+   */
+  static const unsigned kBackgroundCleanupWatermark = 90;
+  static const unsigned kBackgroundCleanupStep = 1;
+  static const unsigned kMaxBackgroundCleanupFiles = 1000;
+
   /**
    * The last bit in the sequence number indicates if an entry is volatile.
    * Such sequence numbers are negative and they are preferred during cleanup.
@@ -203,11 +260,63 @@ class PosixQuotaManager : public QuotaManager {
    */
   static const uint64_t kVolatileFlag = 1ULL << 63;
 
+  /**
+   * With the kEvictSlru policy, the second to last bit in the sequence number
+   * marks protected entries, which sort after all the unprotected entries.
+   * Volatile entries are never protected.  Protected entries are evicted first
+   * if they take more than 80% of the cache.
+   */
+  static const uint64_t kProtectedFlag = 1ULL << 62;
+  static const unsigned kSlruProtectedShare = 80;
+
+  /**
+   * Touched sequence numbers are kept in memory and written to the cache
+   * database after kCheckpointIntervalS seconds or once there are
+   * kMaxTouchedSeq of them.
+   */
+  static const unsigned kCheckpointIntervalS = 60;
+  static const unsigned kMaxTouchedSeq = 32768;
+
+  /**
+   * The cache database rebuild scans kRebuildThreads of the 256 cache
+   * sub-directories in parallel.
+   */
+  static const unsigned kRebuildThreads = 16;
+
+  /**
+   * Result of scanning a single cache sub-directory during RebuildDatabase()
+   */
+  struct RebuildShard {
+    RebuildShard() : path(), hex_prefix(), result(false) { }
+    struct Entry {
+      std::string hash;
+      uint64_t size;
+      uint64_t atime;
+    };
+    std::string path;
+    std::string hex_prefix;
+    std::vector<Entry> entries;
+    bool result;
+  };
+  static void *MainRebuildShard(void *data);
+
   bool InitDatabase(const bool rebuild_database);
   bool RebuildDatabase();
+  bool GetMaxSeq(uint64_t *max_seq);
   void CloseDatabase();
   bool Contains(const std::string &hash_str);
   bool DoCleanup(const uint64_t leave_size);
+  bool EvictLru(const uint64_t leave_size, const unsigned max_files,
+                std::vector<std::string> *trash);
+  static void UnlinkFiles(std::vector<std::string> *paths);
+  bool IsBackgroundCleanupDue();
+  void DoBackgroundCleanupStep();
+  void WriteTouchedSeq();
+
+  void WriteCommand(const void *buf, const unsigned size);
+  void FlushTouches();
+  void DoFlushTouches();
+  static void *MainFlushTouches(void *data);
 
   void MakeReturnPipe(int pipe[2]);
   int BindReturnPipe(int pipe_wronly);
@@ -273,6 +382,14 @@ class PosixQuotaManager : public QuotaManager {
    */
   uint64_t seq_;
 
+  /**
+   * Access sequence numbers of touched files that are not yet written to the
+   * cache database.  The in-memory value takes precedence.  Only the cache
+   * manager thread or process uses it.
+   */
+  SmallHashDynamic<shash::Any, uint64_t> touched_seq_;
+  uint64_t last_checkpoint_;
+
   /**
    * Should match the directory given to the cache manager.
    */
@@ -295,6 +412,21 @@ class PosixQuotaManager : public QuotaManager {
    */
   int pipe_lru_[2];
 
+  /**
+   * Touches not yet sent to the cache manager, protected by lock_touches_.
+   * Only used if the cache manager understands kTouchBatch.
+   */
+  std::vector<shash::Any> pending_touches_;
+  uint64_t pending_touches_since_;
+  pthread_mutex_t lock_touches_;
+
+  /**
+   * Sends batches of touches that are older than kTouchWindowS.
+   */
+  pthread_t thread_flush_touches_;
+  int pipe_terminate_touches_[2];
+  bool flush_touches_spawned_;
+
   /**
    * In exclusive mode, controls the quota manager thread.
    */
@@ -313,10 +445,21 @@ class PosixQuotaManager : public QuotaManager {
 
   /**
    * Keeps track of the number of cleanups over time.  Use by
-   * `cvmfs_talk cleanup rate`
+   * `cvmfs_talk cleanup rate`.  Background eviction steps are not
+   * counted.
    */
   perf::MultiRecorder cleanup_recorder_;
 
+  /**
+   * True while the cache manager thread evicts files ahead of demand.  Records
+   * the start time and the cache size at the start for the syslog summary.
+   */
+  bool background_cleanup_;
+  uint64_t background_cleanup_since_;
+  uint64_t background_cleanup_gauge_;
+
+  EvictionPolicy eviction_policy_;
+
   sqlite3 *database_;
   sqlite3_stmt *stmt_touch_;
   sqlite3_stmt *stmt_unpin_;
@@ -324,6 +467,8 @@ class PosixQuotaManager : public QuotaManager {
   sqlite3_stmt *stmt_unblock_;
   sqlite3_stmt *stmt_new_;
   sqlite3_stmt *stmt_lru_;
+  sqlite3_stmt *stmt_lru_protected_;
+  sqlite3_stmt *stmt_size_protected_;
   sqlite3_stmt *stmt_size_;
   sqlite3_stmt *stmt_rm_;
   sqlite3_stmt *stmt_list_;
@@ -7,6 +7,7 @@
 
 #include <string>
 
+#include "atomic.h"
 #include "catalog_diff_tool.h"
 #include "params.h"
 #include "util/pointer.h"
@@ -41,7 +42,7 @@ class CatalogMergeTool : public CatalogDiffTool<RoCatalogMgr> {
         repo_path_(""),
         lease_path_(lease_path),
         temp_dir_prefix_(temp_dir_prefix),
-        invalid_path_encountered_(false),
+        invalid_path_encountered_(0),
         download_manager_(NULL),
         manifest_(manifest),
         output_catalog_mgr_(output_catalog_mgr),
@@ -59,7 +60,7 @@ class CatalogMergeTool : public CatalogDiffTool<RoCatalogMgr> {
         repo_path_(repo_path),
         lease_path_(lease_path),
         temp_dir_prefix_(temp_dir_prefix),
-        invalid_path_encountered_(false),
+        invalid_path_encountered_(0),
         download_manager_(download_manager),
         manifest_(manifest),
         needs_setup_(true) {}
@@ -68,6 +69,13 @@ class CatalogMergeTool : public CatalogDiffTool<RoCatalogMgr> {
 
   bool Run(const Params& params, std::string* new_manifest_path);
 
+  /**
+   * Applies the changes onto a catalog manager that is owned and committed by
+   * the caller.  Used to group the commits of several leases on disjoint paths
+   * into a single catalog update.
+   */
+  bool Merge(const Params& params, RwCatalogMgr* output_catalog_mgr);
+
  protected:
   virtual void ReportAddition(const PathString& path,
                               const catalog::DirectoryEntry& entry,
@@ -80,14 +88,19 @@ class CatalogMergeTool : public CatalogDiffTool<RoCatalogMgr> {
                                   const XattrList& xattrs);
 
  private:
+  bool ApplyChanges(const Params& params);
   bool CreateNewManifest(std::string* new_manifest_path);
+  bool CheckLeasePath(const PathString& rel_path, const char* operation);
 
   std::string repo_path_;
 
   PathString lease_path_;
   std::string temp_dir_prefix_;
 
-  bool invalid_path_encountered_;
+  /**
+   * Set from the diff worker threads
+   */
+  atomic_int32 invalid_path_encountered_;
 
   download::DownloadManager* download_manager_;
 
@@ -51,36 +51,68 @@ bool CatalogMergeTool<RwCatalogMgr, RoCatalogMgr>::Run(
     output_catalog_mgr_->Init();
   }
 
+  bool ret = ApplyChanges(params);
+  ret &= CreateNewManifest(new_manifest_path);
+
+  output_catalog_mgr_.Destroy();
+
+  return ret;
+}
+
+template <typename RwCatalogMgr, typename RoCatalogMgr>
+bool CatalogMergeTool<RwCatalogMgr, RoCatalogMgr>::Merge(
+    const Params& params, RwCatalogMgr* output_catalog_mgr) {
+  output_catalog_mgr_ = output_catalog_mgr;
+  const bool ret = ApplyChanges(params);
+  // Remains with the caller
+  output_catalog_mgr_.Release();
+  return ret;
+}
+
+template <typename RwCatalogMgr, typename RoCatalogMgr>
+bool CatalogMergeTool<RwCatalogMgr, RoCatalogMgr>::ApplyChanges(
+    const Params& params) {
+  // Nested catalog sub trees are merged concurrently, the changes to the
+  // output catalogs are serialized by the writable catalog manager
+  CatalogDiffTool<RoCatalogMgr>::SetNumWorkers(params.num_merge_workers);
   bool ret = CatalogDiffTool<RoCatalogMgr>::Run(PathString(""));
 
-  ret &= !invalid_path_encountered_;
+  const bool invalid_path = atomic_read32(&invalid_path_encountered_) != 0;
+  ret &= !invalid_path;
 
-  if (invalid_path_encountered_) {
+  if (invalid_path) {
     LogCvmfs(
         kLogReceiver, kLogSyslogErr,
         "CatalogMergeTool - Invalid path encountered for current lease path");
   }
 
-  ret &= CreateNewManifest(new_manifest_path);
-
-  output_catalog_mgr_.Destroy();
-
   return ret;
 }
 
+/**
+ * Changes outside of the lease path are still applied but make the merge
+ * fail.
+ */
+template <typename RwCatalogMgr, typename RoCatalogMgr>
+bool CatalogMergeTool<RwCatalogMgr, RoCatalogMgr>::CheckLeasePath(
+    const PathString& rel_path, const char* operation) {
+  if (rel_path.StartsWith(lease_path_)) {
+    return true;
+  }
+  atomic_write32(&invalid_path_encountered_, 1);
+  LogCvmfs(kLogReceiver, kLogSyslogErr,
+           "CatalogMergeTool::%s - Invalid path %s, for lease path: %s",
+           operation, rel_path.c_str(), lease_path_.c_str());
+  return false;
+}
+
 template <typename RwCatalogMgr, typename RoCatalogMgr>
 void CatalogMergeTool<RwCatalogMgr, RoCatalogMgr>::ReportAddition(
     const PathString& path, const catalog::DirectoryEntry& entry,
     const XattrList& xattrs) {
   const PathString rel_path = MakeRelative(path);
 
-  invalid_path_encountered_ = !rel_path.StartsWith(lease_path_);
-  if (invalid_path_encountered_) {
-    LogCvmfs(kLogReceiver, kLogSyslogErr,
-             "CatalogMergeTool::ReportAddition - Invalid path %s, for lease "
-             "path: %s",
-             path.c_str(), lease_path_.c_str());
-  }
+  CheckLeasePath(rel_path, "ReportAddition");
 
   const std::string parent_path =
       std::strchr(rel_path.c_str(), '/') ? GetParentPath(rel_path).c_str() : "";
@@ -102,13 +134,7 @@ void CatalogMergeTool<RwCatalogMgr, RoCatalogMgr>::ReportRemoval(
     const PathString& path, const catalog::DirectoryEntry& entry) {
   const PathString rel_path = MakeRelative(path);
 
-  invalid_path_encountered_ = !rel_path.StartsWith(lease_path_);
-  if (invalid_path_encountered_) {
-    LogCvmfs(
-        kLogReceiver, kLogSyslogErr,
-        "CatalogMergeTool::ReportRemoval - Invalid path %s, for lease path: %s",
-        path.c_str(), lease_path_.c_str());
-  }
+  CheckLeasePath(rel_path, "ReportRemoval");
 
   if (entry.IsDirectory()) {
     output_catalog_mgr_->RemoveDirectory(rel_path.c_str());
@@ -123,13 +149,7 @@ void CatalogMergeTool<RwCatalogMgr, RoCatalogMgr>::ReportModification(
     const catalog::DirectoryEntry& entry2, const XattrList& xattrs) {
   const PathString rel_path = MakeRelative(path);
 
-  invalid_path_encountered_ = !rel_path.StartsWith(lease_path_);
-  if (invalid_path_encountered_) {
-    LogCvmfs(kLogReceiver, kLogSyslogErr,
-             "CatalogMergeTool::ReportModification - Invalid path %s, for "
-             "lease path: %s",
-             path.c_str(), lease_path_.c_str());
-  }
+  CheckLeasePath(rel_path, "ReportModification");
 
   const std::string parent_path =
       std::strchr(rel_path.c_str(), '/') ? GetParentPath(rel_path).c_str() : "";
@@ -4,8 +4,16 @@
 
 #include "commit_processor.h"
 
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
 #include <vector>
 
+#include "catalog_cache.h"
 #include "catalog_diff_tool.h"
 #include "catalog_merge_tool.h"
 #include "catalog_mgr_ro.h"
@@ -16,8 +24,10 @@
 #include "manifest.h"
 #include "manifest_fetch.h"
 #include "params.h"
+#include "platform.h"
 #include "signing_tool.h"
 #include "statistics.h"
+#include "upload.h"
 #include "util/algorithm.h"
 #include "util/pointer.h"
 #include "util/posix.h"
@@ -42,25 +52,17 @@ PathString RemoveRepoName(const PathString& lease_path) {
 
 namespace receiver {
 
+const unsigned CommitProcessor::kMaxGroupSize;
+
 CommitProcessor::CommitProcessor() : num_errors_(0) {}
 
 CommitProcessor::~CommitProcessor() {}
 
 /**
- * Applies the changes from the new catalog onto the repository.
- *
- * Let:
- *   + C_O = the root catalog of the repository (given by old_root_hash) at
- *           the beginning of the lease, on the release manager machine
- *   + C_N = the root catalog of the repository (given by new_root_hash), on
- *           the release manager machine, with the changes introduced during the
- *           lease
- *   + C_G = the current root catalog of the repository on the gateway machine.
- *
- * This method applies all the changes from C_N, with respect to C_O, onto C_G.
- * The resulting catalog on the gateway machine (C_GN) is then set as root
- * catalog in the repository manifest. The method also signes the updated
- * repository manifest.
+ * Registers the commit in the spool directory of the repository and waits for
+ * the commit lock.  Unless another receiver has already processed the commit
+ * as part of its group, the commit is processed together with the pending
+ * commits on disjoint lease paths.
  */
 CommitProcessor::Result CommitProcessor::Process(
     const std::string& lease_path, const shash::Any& old_root_hash,
@@ -70,18 +72,244 @@ CommitProcessor::Result CommitProcessor::Process(
            lease_path.c_str(), old_root_hash.ToString(true).c_str(),
            new_root_hash.ToString(true).c_str());
 
-  const std::vector<std::string> lease_path_tokens =
-      SplitString(lease_path, '/');
+  const std::string repo_name = SplitString(lease_path, '/').front();
+  const std::string spool_dir = GetSpoolDir(repo_name);
+  if (!MkdirDeep(spool_dir, 0700, true)) {
+    LogCvmfs(kLogReceiver, kLogSyslogErr,
+             "Error: Could not create commit spool directory %s",
+             spool_dir.c_str());
+    return kIoError;
+  }
+
+  // Request ids sort in the order of arrival
+  char id[64];
+  snprintf(id, sizeof(id), "%020" PRIu64 "-%d", platform_realtime_ns(),
+           getpid());
+  Request own;
+  own.id = id;
+  own.lease_path = lease_path;
+  own.old_root_hash = old_root_hash;
+  own.new_root_hash = new_root_hash;
+  if (!WriteCommitRequest(spool_dir, own)) {
+    LogCvmfs(kLogReceiver, kLogSyslogErr,
+             "Error: Could not register commit in %s", spool_dir.c_str());
+    return kIoError;
+  }
+  const std::string request_path = spool_dir + "/" + own.id + ".req";
+
+  Result result = kRetry;
+  while (result == kRetry) {
+    const int fd_lock = LockFile(spool_dir + "/lock");
+    if (fd_lock < 0) {
+      LogCvmfs(kLogReceiver, kLogSyslogErr,
+               "Error: Could not acquire commit lock in %s", spool_dir.c_str());
+      unlink(request_path.c_str());
+      return kIoError;
+    }
+
+    if (ReadResult(spool_dir, own.id, &result)) {
+      LogCvmfs(kLogReceiver, kLogSyslog,
+               "CommitProcessor - %s committed in a group", lease_path.c_str());
+    } else if (!FileExists(request_path)) {
+      // Taken by another receiver that failed to store the result
+      result = kIoError;
+    } else {
+      std::vector<Request> pending;
+      ReadPending(spool_dir, &pending);
+      const std::vector<Request> group = SelectGroup(own, pending);
+      std::vector<Result> results(group.size(), kRetry);
+      ProcessGroup(repo_name, group, &results);
+
+      // The own commit is the first one of the group.  The result of the other
+      // commits is stored before their request is removed.
+      for (unsigned i = 0; i < group.size(); ++i) {
+        if (results[i] == kRetry)
+          continue;
+        if (i == 0) {
+          result = results[i];
+        } else if (!WriteResult(spool_dir, group[i].id, results[i])) {
+          LogCvmfs(kLogReceiver, kLogSyslogErr,
+                   "Error: Could not store commit result of %s",
+                   group[i].lease_path.c_str());
+        }
+        unlink((spool_dir + "/" + group[i].id + ".req").c_str());
+      }
+    }
 
-  const std::string repo_name = lease_path_tokens.front();
+    UnlockFile(fd_lock);
+  }
+
+  if (result != kSuccess)
+    num_errors_++;
+  return result;
+}
+
+/**
+ * Lease paths overlap if one is a prefix of the other, compared by path
+ * components.
+ */
+bool CommitProcessor::PathsOverlap(const std::string& lease_path1,
+                                   const std::string& lease_path2) {
+  std::string path1 = lease_path1;
+  std::string path2 = lease_path2;
+  while (!path1.empty() && (path1[path1.length() - 1] == '/'))
+    path1.erase(path1.length() - 1);
+  while (!path2.empty() && (path2[path2.length() - 1] == '/'))
+    path2.erase(path2.length() - 1);
+  if (path1.length() > path2.length())
+    std::swap(path1, path2);
+  return (path2 == path1) || HasPrefix(path2, path1 + "/", false);
+}
+
+std::string CommitProcessor::GetSpoolDir(const std::string& repo_name) {
+  return "/var/spool/cvmfs/" + repo_name + "/commits";
+}
+
+/**
+ * The own commit comes first, followed by the oldest pending commits that do
+ * not overlap with any commit already in the group.
+ */
+std::vector<CommitProcessor::Request> CommitProcessor::SelectGroup(
+    const Request& own, const std::vector<Request>& pending) {
+  std::vector<Request> group;
+  group.push_back(own);
+  for (unsigned i = 0; i < pending.size(); ++i) {
+    if (group.size() >= kMaxGroupSize)
+      break;
+    if (pending[i].id == own.id)
+      continue;
+    bool overlaps = false;
+    for (unsigned j = 0; j < group.size(); ++j) {
+      if (PathsOverlap(pending[i].lease_path, group[j].lease_path)) {
+        overlaps = true;
+        break;
+      }
+    }
+    if (!overlaps)
+      group.push_back(pending[i]);
+  }
+  return group;
+}
+
+/**
+ * Requests of receivers that do not exist anymore are removed
+ */
+bool CommitProcessor::ReadPending(const std::string& spool_dir,
+                                  std::vector<Request>* pending) {
+  const std::vector<std::string> paths = FindFiles(spool_dir, ".req");
+  for (unsigned i = 0; i < paths.size(); ++i) {
+    Request request;
+    if (!ReadCommitRequest(paths[i], &request))
+      continue;
+    const std::string::size_type pos = request.id.find('-');
+    const pid_t pid = (pos == std::string::npos) ?
+                      0 : String2Int64(request.id.substr(pos + 1));
+    if ((pid > 0) && (kill(pid, 0) != 0) && (errno == ESRCH)) {
+      LogCvmfs(kLogReceiver, kLogSyslog,
+               "CommitProcessor - removing stale commit of %s",
+               request.lease_path.c_str());
+      unlink(paths[i].c_str());
+      continue;
+    }
+    pending->push_back(request);
+  }
+  return true;
+}
+
+bool CommitProcessor::WriteCommitRequest(const std::string& spool_dir,
+                                         const Request& request) {
+  const std::string content = request.lease_path + "\n" +
+                              request.old_root_hash.ToString(true) + "\n" +
+                              request.new_root_hash.ToString(true) + "\n";
+  const std::string tmp_path = spool_dir + "/" + request.id + ".tmp";
+  if (!SafeWriteToFile(content, tmp_path, 0600))
+    return false;
+  // Other receivers only see complete requests
+  const std::string path = spool_dir + "/" + request.id + ".req";
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool CommitProcessor::ReadCommitRequest(const std::string& path,
+                                        Request* request) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  std::string content;
+  const bool retval = SafeReadToString(fd, &content);
+  close(fd);
+  if (!retval)
+    return false;
+  const std::vector<std::string> lines = SplitString(content, '\n');
+  if (lines.size() < 3)
+    return false;
+  request->id = GetFileName(path);
+  request->id = request->id.substr(0, request->id.length() - 4);
+  request->lease_path = lines[0];
+  request->old_root_hash = shash::MkFromSuffixedHexPtr(shash::HexPtr(lines[1]));
+  request->new_root_hash = shash::MkFromSuffixedHexPtr(shash::HexPtr(lines[2]));
+  return true;
+}
+
+bool CommitProcessor::WriteResult(const std::string& spool_dir,
+                                  const std::string& id, Result result) {
+  return SafeWriteToFile(StringifyInt(result) + "\n",
+                         spool_dir + "/" + id + ".res", 0600);
+}
+
+/**
+ * Returns false if there is no result (yet).  The result is removed.
+ */
+bool CommitProcessor::ReadResult(const std::string& spool_dir,
+                                 const std::string& id, Result* result) {
+  const std::string path = spool_dir + "/" + id + ".res";
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  std::string content;
+  const bool retval = SafeReadToString(fd, &content);
+  close(fd);
+  unlink(path.c_str());
+  *result = retval ? static_cast<Result>(String2Int64(Trim(content))) :
+                     kIoError;
+  return true;
+}
+
+/**
+ * Applies the changes from the new catalogs onto the repository.
+ *
+ * Let, for every commit of the group:
+ *   + C_O = the root catalog of the repository (given by old_root_hash) at
+ *           the beginning of the lease, on the release manager machine
+ *   + C_N = the root catalog of the repository (given by new_root_hash), on
+ *           the release manager machine, with the changes introduced during the
+ *           lease
+ *   + C_G = the current root catalog of the repository on the gateway machine.
+ *
+ * This method applies all the changes from C_N, with respect to C_O, onto C_G.
+ * The changes of all the commits in the group are applied before the catalogs
+ * are committed.  The resulting catalog on the gateway machine (C_GN) is then
+ * set as root catalog in the repository manifest. The method also signes the
+ * updated repository manifest.
+ *
+ * If one of the merges fails, no commit of the group is applied.  The failed
+ * commit gets its error, the others are retried.
+ */
+void CommitProcessor::ProcessGroup(const std::string& repo_name,
+                                   const std::vector<Request>& group,
+                                   std::vector<Result>* results) {
   const std::string stratum0 = "file:///srv/cvmfs/" + repo_name;
+  results->assign(group.size(), kIoError);
 
   UniquePtr<ServerTool> server_tool(new ServerTool());
 
   if (!server_tool->InitDownloadManager(true)) {
     LogCvmfs(kLogReceiver, kLogSyslogErr,
              "Error: Could not initialize the download manager");
-    return kIoError;
+    return;
   }
 
   const std::string public_key = "/etc/cvmfs/keys/" + repo_name + ".pub";
@@ -90,7 +318,7 @@ CommitProcessor::Result CommitProcessor::Process(
   if (!server_tool->InitVerifyingSignatureManager(public_key, trusted_certs)) {
     LogCvmfs(kLogReceiver, kLogSyslogErr,
              "Error: Could not initialize the signature manager");
-    return kIoError;
+    return;
   }
 
   shash::Any manifest_base_hash;
@@ -101,36 +329,96 @@ CommitProcessor::Result CommitProcessor::Process(
   if (!manifest.IsValid()) {
     LogCvmfs(kLogReceiver, kLogSyslogErr,
              "Error: Could not open repository manifest");
-    return kIoError;
+    return;
   }
 
   const std::string temp_dir_root =
       "/srv/cvmfs/" + repo_name + "/data/txn/commit_processor";
 
-  const PathString relative_lease_path = RemoveRepoName(PathString(lease_path));
-
-  CatalogMergeTool<catalog::WritableCatalogManager,
-                   catalog::SimpleCatalogManager>
-      merge_tool(stratum0, old_root_hash, new_root_hash, relative_lease_path,
-                 temp_dir_root, server_tool->download_manager(),
-                 manifest.weak_ref());
-  if (!merge_tool.Init()) {
-    LogCvmfs(kLogReceiver, kLogSyslogErr,
-             "Error: Could not initialize the catalog merge tool");
-    return kIoError;
-  }
-
   Params params;
   if (!GetParamsFromFile(repo_name, &params)) {
     LogCvmfs(kLogReceiver, kLogSyslogErr,
              "Error: Could not get configuration parameters.");
-    return kIoError;
+    return;
   }
 
-  std::string new_manifest_path;
-  if (!merge_tool.Run(params, &new_manifest_path)) {
-    LogCvmfs(kLogReceiver, kLogSyslogErr, "Error: Catalog merge failed");
-    return kMergeError;
+  // The output catalogs are shared by all the commits of the group
+  upload::SpoolerDefinition definition(
+      params.spooler_configuration, params.hash_alg, params.compression_alg,
+      params.generate_legacy_bulk_chunks, params.use_file_chunking,
+      params.min_chunk_size, params.avg_chunk_size, params.max_chunk_size,
+      "dummy_token", "dummy_key");
+  UniquePtr<upload::Spooler> spooler(upload::Spooler::Construct(definition));
+  if (!spooler.IsValid()) {
+    LogCvmfs(kLogReceiver, kLogSyslogErr, "Error: Could not create spooler");
+    return;
+  }
+  perf::Statistics stats;
+  UniquePtr<catalog::CatalogCache> catalog_cache;
+  if (!params.catalog_cache_dir.empty()) {
+    catalog_cache = catalog::CatalogCache::Create(
+        params.catalog_cache_dir,
+        uint64_t(params.catalog_cache_mbyte_limit) * 1024 * 1024);
+    if (!catalog_cache.IsValid()) {
+      LogCvmfs(kLogReceiver, kLogSyslogWarn,
+               "Warning: Could not create catalog cache %s, continuing "
+               "without", params.catalog_cache_dir.c_str());
+    }
+  }
+  UniquePtr<RaiiTempDir> catalog_temp_dir(
+      RaiiTempDir::Create(temp_dir_root));
+  UniquePtr<catalog::WritableCatalogManager> output_catalog_mgr(
+      new catalog::WritableCatalogManager(
+          manifest->catalog_hash(), stratum0, catalog_temp_dir->dir(),
+          spooler.weak_ref(), server_tool->download_manager(),
+          params.enforce_limits, params.nested_kcatalog_limit,
+          params.root_kcatalog_limit, params.file_mbyte_limit, &stats,
+          params.use_autocatalogs, params.max_weight, params.min_weight));
+  if (params.lazy_vacuum)
+    output_catalog_mgr->EnableLazyVacuum();
+  if (catalog_cache.IsValid())
+    output_catalog_mgr->SetCatalogCache(catalog_cache.weak_ref());
+  output_catalog_mgr->Init();
+
+  for (unsigned i = 0; i < group.size(); ++i) {
+    const PathString relative_lease_path =
+        RemoveRepoName(PathString(group[i].lease_path));
+    CatalogMergeTool<catalog::WritableCatalogManager,
+                     catalog::SimpleCatalogManager>
+        merge_tool(stratum0, group[i].old_root_hash, group[i].new_root_hash,
+                   relative_lease_path, temp_dir_root,
+                   server_tool->download_manager(), manifest.weak_ref());
+    Result error = kSuccess;
+    if (!merge_tool.Init()) {
+      LogCvmfs(kLogReceiver, kLogSyslogErr,
+               "Error: Could not initialize the catalog merge tool");
+      error = kIoError;
+    } else if (!merge_tool.Merge(params, output_catalog_mgr.weak_ref())) {
+      LogCvmfs(kLogReceiver, kLogSyslogErr, "Error: Catalog merge failed");
+      error = kMergeError;
+    }
+    if (error != kSuccess) {
+      results->assign(group.size(), kRetry);
+      (*results)[i] = error;
+      return;
+    }
+  }
+
+  LogCvmfs(kLogReceiver, kLogSyslog,
+           "CommitProcessor - committing a group of %u lease(s)",
+           static_cast<unsigned>(group.size()));
+  if (!output_catalog_mgr->Commit(false, 0, manifest.weak_ref())) {
+    LogCvmfs(kLogReceiver, kLogSyslogErr,
+             "Error: Could not commit output catalog");
+    results->assign(group.size(), kMergeError);
+    return;
+  }
+  output_catalog_mgr.Destroy();
+
+  const std::string new_manifest_path = CreateTempPath(temp_dir_root, 0600);
+  if (!manifest->Export(new_manifest_path)) {
+    LogCvmfs(kLogReceiver, kLogSyslogErr, "Error: Could not export manifest");
+    return;
   }
 
   UniquePtr<RaiiTempDir> raii_temp_dir(RaiiTempDir::Create(temp_dir_root));
@@ -148,10 +436,10 @@ CommitProcessor::Result CommitProcessor::Process(
                        private_key, repo_name, "", "",
                        "/var/spool/cvmfs/" + repo_name + "/reflog.chksum")) {
     LogCvmfs(kLogReceiver, kLogSyslogErr, "Error signing manifest");
-    return kIoError;
+    return;
   }
 
-  return kSuccess;
+  results->assign(group.size(), kSuccess);
 }
 
 }  // namespace receiver
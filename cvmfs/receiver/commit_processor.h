@@ -5,7 +5,10 @@
 #ifndef CVMFS_RECEIVER_COMMIT_PROCESSOR_H_
 #define CVMFS_RECEIVER_COMMIT_PROCESSOR_H_
 
+#include <gtest/gtest_prod.h>
+
 #include <string>
+#include <vector>
 
 #include "server_tool.h"
 #include "util/pointer.h"
@@ -21,10 +24,33 @@ namespace receiver {
  * Its responsibility is updating the repository (sub-)catalogs with the changes
  * introduced during the lease. After all the catalogs have been updated, the
  * repository manifest is also updated and resigned.
+ *
+ * The gateway runs a receiver process per connection, so leases on disjoint
+ * sub paths of a repository commit concurrently.  The commits are grouped:
+ * every commit is registered in a spool directory of the repository and
+ * whichever receiver holds the commit lock applies all the pending commits
+ * with non-overlapping lease paths in a single catalog update and manifest
+ * signature.  The other receivers find their result in the spool directory
+ * once they get the lock.
  */
 class CommitProcessor {
+  FRIEND_TEST(T_CommitProcessor, SelectGroup);
+
  public:
-  enum Result { kSuccess, kMergeError, kIoError };
+  /**
+   * kRetry is used internally for the commits of a failed group, which are
+   * processed again by themselves
+   */
+  enum Result { kSuccess, kMergeError, kIoError, kRetry };
+
+  struct Request {
+    std::string id;
+    std::string lease_path;
+    shash::Any old_root_hash;
+    shash::Any new_root_hash;
+  };
+
+  static const unsigned kMaxGroupSize = 32;
 
   CommitProcessor();
   virtual ~CommitProcessor();
@@ -34,7 +60,32 @@ class CommitProcessor {
 
   int GetNumErrors() const { return num_errors_; }
 
+  static bool PathsOverlap(const std::string& lease_path1,
+                           const std::string& lease_path2);
+
+ protected:
+  virtual std::string GetSpoolDir(const std::string& repo_name);
+  /**
+   * Applies the commits of the group onto the repository, all of them for
+   * the same repository and on disjoint lease paths.  Sets a result for every
+   * commit.
+   */
+  virtual void ProcessGroup(const std::string& repo_name,
+                            const std::vector<Request>& group,
+                            std::vector<Result>* results);
+
  private:
+  static std::vector<Request> SelectGroup(const Request& own,
+                                          const std::vector<Request>& pending);
+  bool ReadPending(const std::string& spool_dir, std::vector<Request>* pending);
+  static bool WriteCommitRequest(const std::string& spool_dir,
+                                 const Request& request);
+  static bool ReadCommitRequest(const std::string& path, Request* request);
+  static bool WriteResult(const std::string& spool_dir, const std::string& id,
+                          Result result);
+  static bool ReadResult(const std::string& spool_dir, const std::string& id,
+                         Result* result);
+
   std::string temp_dir_;
   int num_errors_;
 };
@@ -8,6 +8,7 @@
 
 #include "options.h"
 #include "util/string.h"
+#include "util_concurrency.h"
 
 namespace receiver {
 
@@ -168,6 +169,40 @@ bool GetParamsFromFile(const std::string& repo_name, Params* params) {
     params->file_mbyte_limit = String2Uint64(file_mbyte_limit_str);
   }
 
+  params->num_merge_workers = GetNumberOfCpuCores();
+  std::string num_merge_workers_str;
+  if (parser.GetValue("CVMFS_NUM_MERGE_WORKERS", &num_merge_workers_str)) {
+    params->num_merge_workers = String2Uint64(num_merge_workers_str);
+  }
+
+  params->catalog_cache_dir = "";
+  params->catalog_cache_mbyte_limit = 4096;
+  std::string catalog_cache_str;
+  if (parser.GetValue("CVMFS_CATALOG_CACHE", &catalog_cache_str) &&
+      (catalog_cache_str == "true"))
+  {
+    std::string spool_dir;
+    if (!parser.GetValue("CVMFS_SPOOL_DIR", &spool_dir)) {
+      std::vector<std::string> tokens = SplitString(repo_name, '/');
+      spool_dir = "/var/spool/cvmfs/" + tokens.back();
+    }
+    params->catalog_cache_dir = spool_dir + "/catalog_cache";
+    std::string catalog_cache_limit_str;
+    if (parser.GetValue("CVMFS_CATALOG_CACHE_LIMIT_MB",
+                        &catalog_cache_limit_str)) {
+      params->catalog_cache_mbyte_limit =
+          String2Uint64(catalog_cache_limit_str);
+    }
+  }
+
+  params->lazy_vacuum = false;
+  std::string lazy_vacuum_str;
+  if (parser.GetValue("CVMFS_CATALOG_LAZY_VACUUM", &lazy_vacuum_str)) {
+    if (lazy_vacuum_str == "true") {
+      params->lazy_vacuum = true;
+    }
+  }
+
   return true;
 }
 
@@ -28,6 +28,11 @@ struct Params {
   bool use_autocatalogs;
   size_t max_weight;
   size_t min_weight;
+  unsigned num_merge_workers;
+  // Keeps uncompressed catalogs across commits, empty if disabled
+  std::string catalog_cache_dir;
+  size_t catalog_cache_mbyte_limit;
+  bool lazy_vacuum;
 };
 
 bool GetParamsFromFile(const std::string& repo_name, Params* params);
@@ -6,18 +6,29 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 
 #include "logging.h"
+#include "smalloc.h"
 #include "util/posix.h"
 #include "util/string.h"
 
 namespace receiver {
 
+const unsigned PayloadProcessor::kNumWriters;
+const unsigned PayloadProcessor::kMaxQueuedChunks;
+
 PayloadProcessor::PayloadProcessor()
-    : pending_files_(), current_repo_(), num_errors_(0) {}
+    : pending_files_(), current_repo_(), writers_(), next_writer_(0),
+      num_errors_(0) {}
 
-PayloadProcessor::~PayloadProcessor() {}
+PayloadProcessor::~PayloadProcessor() {
+  assert(writers_.empty());
+}
 
 PayloadProcessor::Result PayloadProcessor::Process(
     int fdin, const std::string& digest_base64, const std::string& path,
@@ -36,11 +47,11 @@ PayloadProcessor::Result PayloadProcessor::Process(
   ObjectPackConsumer deserializer(digest, header_size);
   deserializer.RegisterListener(&PayloadProcessor::ConsumerEventCallback, this);
 
+  StartWriters();
   int nb = 0;
   ObjectPackBuild::State consumer_state = ObjectPackBuild::kStateContinue;
+  std::vector<unsigned char> buffer(4096, 0);
   do {
-    std::vector<unsigned char> buffer(4096, 0);
-
     nb = read(fdin, &buffer[0], buffer.size());
     consumer_state = deserializer.ConsumeNext(nb, &buffer[0]);
     if (consumer_state != ObjectPackBuild::kStateContinue &&
@@ -51,6 +62,7 @@ PayloadProcessor::Result PayloadProcessor::Process(
       break;
     }
   } while (nb > 0 && consumer_state != ObjectPackBuild::kStateDone);
+  StopWriters();
 
   if (GetNumErrors() > 0) {
     return kOtherError;
@@ -61,6 +73,37 @@ PayloadProcessor::Result PayloadProcessor::Process(
   return kSuccess;
 }
 
+void PayloadProcessor::StartWriters() {
+  assert(writers_.empty());
+  next_writer_ = 0;
+  writers_.resize(kNumWriters);
+  for (unsigned i = 0; i < kNumWriters; ++i) {
+    writers_[i].processor = this;
+    writers_[i].queue = new FifoChannel<WriteJob*>(kMaxQueuedChunks, 1);
+    int retval = pthread_create(&writers_[i].thread, NULL, MainWriter,
+                                &writers_[i]);
+    assert(retval == 0);
+  }
+}
+
+/**
+ * Blocks until all the queued chunks are written
+ */
+void PayloadProcessor::StopWriters() {
+  for (unsigned i = 0; i < writers_.size(); ++i)
+    writers_[i].queue->Enqueue(NULL);
+  for (unsigned i = 0; i < writers_.size(); ++i) {
+    pthread_join(writers_[i].thread, NULL);
+    delete writers_[i].queue;
+  }
+  writers_.clear();
+}
+
+/**
+ * Runs in the reactor's thread, in the order of the payload stream.  The
+ * event buffer is only valid during the callback, so it is copied for the
+ * writer.
+ */
 void PayloadProcessor::ConsumerEventCallback(
     const ObjectPackBuild::Event& event) {
   std::string path("");
@@ -73,83 +116,148 @@ void PayloadProcessor::ConsumerEventCallback(
     // kEmpty - this is an error.
     LogCvmfs(kLogReceiver, kLogSyslogErr,
              "Event received with unknown object.");
-    num_errors_++;
+    atomic_inc32(&num_errors_);
     return;
   }
 
+  WriteJob* job = new WriteJob();
+  job->id = event.id;
+  job->object_size = event.size;
+  job->buf_size = event.buf_size;
+  job->buf = NULL;
+  if (event.buf_size > 0) {
+    job->buf = reinterpret_cast<unsigned char*>(smalloc(event.buf_size));
+    memcpy(job->buf, event.buf, event.buf_size);
+  }
+
   FileIterator it = pending_files_.find(event.id);
   if (it == pending_files_.end()) {
-    // New file to unpack
-    // Create a temporary path
-    std::string temp_dir = "/srv/cvmfs/" + current_repo_ + "/data/txn";
-    const std::string tmp_path = CreateTempPath(temp_dir, 0666);
-    if (tmp_path.empty()) {
-      LogCvmfs(kLogReceiver, kLogSyslogErr, "Unable to create temporary path.");
-      num_errors_++;
-      return;
-    }
-
+    // New file to unpack, assigned to the writers in turn
     FileInfo info;
-    info.temp_path = tmp_path;
     info.total_size = event.size;
     info.current_size = 0;
-
-    pending_files_[event.id] = info;
+    info.writer = next_writer_;
+    next_writer_ = (next_writer_ + 1) % writers_.size();
+    it = pending_files_.insert(std::make_pair(event.id, info)).first;
+    job->dest = "/srv/cvmfs/" + current_repo_ + "/data/" + path;
   }
 
-  FileInfo& info = pending_files_[event.id];
-
-  int fdout = open(info.temp_path.c_str(), O_CREAT | O_WRONLY | O_APPEND, 0600);
-  if (fdout == -1) {
-    LogCvmfs(kLogReceiver, kLogSyslogErr,
-             "Unable to open temporary output file: %s",
-             info.temp_path.c_str());
-    return;
-  }
-
-  if (!WriteFile(fdout, event.buf, event.buf_size)) {
-    LogCvmfs(kLogReceiver, kLogSyslogErr, "Unable to write %s",
-             info.temp_path.c_str());
-    num_errors_++;
-    unlink(info.temp_path.c_str());
-    close(fdout);
-    return;
-  }
-  close(fdout);
-
+  FileInfo& info = it->second;
   info.current_size += event.buf_size;
+  job->is_last = (info.current_size == info.total_size);
+  const unsigned writer = info.writer;
+  if (job->is_last)
+    pending_files_.erase(it);
 
-  if (info.current_size == info.total_size) {
-    const std::string dest = "/srv/cvmfs/" + current_repo_ + "/data/" + path;
+  // Blocks if the writer is behind
+  writers_[writer].queue->Enqueue(job);
+}
 
-    // Atomically move to final destination
-    // TODO(radu): It would be nice to hook this into the spooler/uploader
-    // components, allowing, for instance to upload from the gateway to S3
-    if (FileExists(dest)) {
-      unlink(dest.c_str());
+/**
+ * Writes the objects assigned to this writer one after another.  The chunks
+ * are hashed as they are written, the complete object is atomically moved to
+ * its final destination.
+ */
+void* PayloadProcessor::MainWriter(void* data) {
+  Writer* writer = reinterpret_cast<Writer*>(data);
+  PayloadProcessor* processor = writer->processor;
+
+  // State of the object in progress
+  std::string temp_path;
+  std::string dest;
+  int fdout = -1;
+  bool failed = false;
+  size_t written = 0;
+  shash::ContextPtr hash_context;
+
+  WriteJob* job;
+  while ((job = writer->queue->Dequeue()) != NULL) {
+    if (!job->dest.empty()) {
+      dest = job->dest;
+      written = 0;
+      failed = false;
+      free(hash_context.buffer);
+      hash_context = shash::ContextPtr(job->id.algorithm);
+      hash_context.buffer = smalloc(hash_context.size);
+      shash::Init(hash_context);
+
+      // Create a temporary path
+      const std::string temp_dir =
+        "/srv/cvmfs/" + processor->current_repo_ + "/data/txn";
+      temp_path = CreateTempPath(temp_dir, 0666);
+      if (temp_path.empty()) {
+        LogCvmfs(kLogReceiver, kLogSyslogErr,
+                 "Unable to create temporary path.");
+        failed = true;
+      } else {
+        fdout = open(temp_path.c_str(), O_WRONLY | O_APPEND, 0600);
+        if (fdout == -1) {
+          LogCvmfs(kLogReceiver, kLogSyslogErr,
+                   "Unable to open temporary output file: %s",
+                   temp_path.c_str());
+          unlink(temp_path.c_str());
+          failed = true;
+        }
+      }
+      if (failed)
+        atomic_inc32(&processor->num_errors_);
     }
-    if (RenameFile(info.temp_path.c_str(), dest.c_str())) {
-      LogCvmfs(kLogReceiver, kLogSyslogErr,
-               "Unable to move file to final destination: %s", dest.c_str());
-      num_errors_++;
-      return;
+
+    if (!failed && (job->buf_size > 0)) {
+      if (!processor->WriteFile(fdout, job->buf, job->buf_size)) {
+        LogCvmfs(kLogReceiver, kLogSyslogErr, "Unable to write %s",
+                 temp_path.c_str());
+        atomic_inc32(&processor->num_errors_);
+        close(fdout);
+        fdout = -1;
+        unlink(temp_path.c_str());
+        failed = true;
+      } else {
+        shash::Update(job->buf, job->buf_size, hash_context);
+        written += job->buf_size;
+      }
     }
 
-    pending_files_.erase(event.id);
+    if (!failed && job->is_last) {
+      close(fdout);
+      fdout = -1;
+      shash::Any file_hash(job->id.algorithm);
+      shash::Final(hash_context, &file_hash);
+      if (file_hash != job->id) {
+        LogCvmfs(kLogReceiver, kLogSyslogErr,
+                 "PayloadProcessor - Hash mismatch for unpacked file: event "
+                 "size: %ld, file size: %ld, event hash: %s, file hash: %s",
+                 job->object_size, written, job->id.ToString(true).c_str(),
+                 file_hash.ToString(true).c_str());
+        atomic_inc32(&processor->num_errors_);
+        unlink(temp_path.c_str());
+      } else {
+        // Atomically move to final destination
+        // TODO(radu): It would be nice to hook this into the spooler/uploader
+        // components, allowing, for instance to upload from the gateway to S3
+        if (FileExists(dest)) {
+          unlink(dest.c_str());
+        }
+        if (processor->RenameFile(temp_path, dest)) {
+          LogCvmfs(kLogReceiver, kLogSyslogErr,
+                   "Unable to move file to final destination: %s",
+                   dest.c_str());
+          atomic_inc32(&processor->num_errors_);
+        }
+      }
+    }
 
-    shash::Any file_hash(shash::kSha1);
-    shash::HashFile(dest, &file_hash);
+    free(job->buf);
+    delete job;
+  }
 
-    if (file_hash != event.id) {
-      LogCvmfs(kLogReceiver, kLogSyslogErr,
-               "PayloadProcessor - Hash mismatch for unpacked file: event "
-               "size: %ld, file size: %ld, event hash: %s, file hash: %s",
-               event.size, GetFileSize(dest), event.id.ToString(true).c_str(),
-               file_hash.ToString(true).c_str());
-      num_errors_++;
-      return;
-    }
+  // The payload ended in the middle of an object
+  if (fdout >= 0) {
+    close(fdout);
+    unlink(temp_path.c_str());
   }
+  free(hash_context.buffer);
+  return NULL;
 }
 
 bool PayloadProcessor::WriteFile(int fd, const void* const buf,
@@ -5,18 +5,26 @@
 #ifndef CVMFS_RECEIVER_PAYLOAD_PROCESSOR_H_
 #define CVMFS_RECEIVER_PAYLOAD_PROCESSOR_H_
 
+#include <pthread.h>
 #include <stdint.h>
+
 #include <map>
 #include <string>
+#include <vector>
 
+#include "atomic.h"
 #include "pack.h"
+#include "util_concurrency.h"
 
 namespace receiver {
 
 struct FileInfo {
-  std::string temp_path;
   size_t total_size;
   size_t current_size;
+  /**
+   * Index of the writer thread that unpacks the object
+   */
+  unsigned writer;
 };
 
 /**
@@ -27,11 +35,23 @@ struct FileInfo {
  *
  * Its responsibility is reading the payload - containing a serialized
  * ObjectPack - from a file descriptor, and unpacking it into the repository.
+ *
+ * Unpacking is pipelined: while the payload is still being read and
+ * deserialized, a pool of writer threads stores, hashes and moves the objects
+ * into place.  All chunks of an object go to the same writer, so they are
+ * written in order.  The writer queues are bounded; if the storage falls
+ * behind, reading from the input stalls.
  */
 class PayloadProcessor {
  public:
   enum Result { kSuccess, kPathViolation, kOtherError };
 
+  static const unsigned kNumWriters = 4;
+  /**
+   * Per writer thread, bounds the buffered payload to a few hundred kB
+   */
+  static const unsigned kMaxQueuedChunks = 64;
+
   PayloadProcessor();
   virtual ~PayloadProcessor();
 
@@ -40,20 +60,46 @@ class PayloadProcessor {
 
   virtual void ConsumerEventCallback(const ObjectPackBuild::Event& event);
 
-  int GetNumErrors() const { return num_errors_; }
+  int GetNumErrors() const { return atomic_read32(&num_errors_); }
 
  protected:
   // NOTE: These methods are made virtual such that they can be mocked for
-  //       the purpose of unit testing
+  //       the purpose of unit testing.  They are called from the writer
+  //       threads.
   virtual bool WriteFile(int fd, const void* const buf, size_t buf_size);
   virtual int RenameFile(const std::string& old_name,
                          const std::string& new_name);
 
  private:
+  /**
+   * A piece of an object as it comes out of the deserializer.  The first
+   * chunk of an object carries its destination path.
+   */
+  struct WriteJob {
+    shash::Any id;
+    std::string dest;
+    size_t object_size;
+    unsigned char* buf;
+    size_t buf_size;
+    bool is_last;
+  };
+
+  struct Writer {
+    PayloadProcessor* processor;
+    FifoChannel<WriteJob*>* queue;
+    pthread_t thread;
+  };
+
+  static void* MainWriter(void* data);
+  void StartWriters();
+  void StopWriters();
+
   typedef std::map<shash::Any, FileInfo>::iterator FileIterator;
   std::map<shash::Any, FileInfo> pending_files_;
   std::string current_repo_;
-  int num_errors_;
+  std::vector<Writer> writers_;
+  unsigned next_writer_;
+  mutable atomic_int32 num_errors_;
 };
 
 }  // namespace receiver
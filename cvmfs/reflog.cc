@@ -7,7 +7,9 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
+#include <ctime>
 
 #include "util/posix.h"
 #include "util/string.h"
@@ -193,10 +195,16 @@ bool Reflog::Remove(const shash::Any &hash) {
       return false;
   }
 
-  return
+  const bool retval =
     remove_reference_->BindReference(hash, type) &&
     remove_reference_->Execute()                 &&
     remove_reference_->Reset();
+  if (retval && has_index_) {
+    std::vector<IndexEntry>::iterator i = FindIndexEntry(hash);
+    if ((i != index_.end()) && (i->type == type))
+      i->removed = true;
+  }
+  return retval;
 }
 
 
@@ -238,15 +246,83 @@ bool Reflog::ContainsMetainfo(const shash::Any &metainfo) const {
 
 bool Reflog::AddReference(const shash::Any               &hash,
                           const SqlReflog::ReferenceType  type) {
-  return
+  const bool retval =
     insert_reference_->BindReference(hash, type) &&
     insert_reference_->Execute()                 &&
     insert_reference_->Reset();
+  if (retval && has_index_) {
+    // Same as the INSERT OR REPLACE statement
+    const IndexEntry entry(hash, type, time(NULL));
+    std::vector<IndexEntry>::iterator i = FindIndexEntry(hash);
+    if (i != index_.end())
+      *i = entry;
+    else
+      index_.insert(std::upper_bound(index_.begin(), index_.end(), entry),
+                    entry);
+  }
+  return retval;
+}
+
+
+bool Reflog::LoadIndex() {
+  assert(database_);
+  SqlListAllReferences list_all(database_.weak_ref());
+  index_.clear();
+  while (list_all.FetchRow()) {
+    index_.push_back(IndexEntry(list_all.RetrieveHash(),
+                                list_all.RetrieveType(),
+                                list_all.RetrieveTimestamp()));
+  }
+  if (!list_all.Reset()) {
+    index_.clear();
+    return false;
+  }
+  std::sort(index_.begin(), index_.end());
+  has_index_ = true;
+  LogCvmfs(kLogReflog, kLogDebug, "loaded %u references into the reflog index",
+           static_cast<unsigned>(index_.size()));
+  return true;
+}
+
+
+std::vector<Reflog::IndexEntry>::iterator Reflog::FindIndexEntry(
+  const shash::Any &hash)
+{
+  IndexEntry key;
+  key.hash = hash;
+  std::vector<IndexEntry>::iterator i =
+    std::lower_bound(index_.begin(), index_.end(), key);
+  if ((i == index_.end()) || (i->hash != hash))
+    return index_.end();
+  return i;
+}
+
+
+/**
+ * Returns NULL if the hash is not in the index with the given type.
+ */
+const Reflog::IndexEntry *Reflog::LookupIndex(
+  const shash::Any               &hash,
+  const SqlReflog::ReferenceType  type) const
+{
+  IndexEntry key;
+  key.hash = hash;
+  std::vector<IndexEntry>::const_iterator i =
+    std::lower_bound(index_.begin(), index_.end(), key);
+  if ((i == index_.end()) || (i->hash != hash) || i->removed ||
+      (i->type != type))
+  {
+    return NULL;
+  }
+  return &(*i);
 }
 
 
 bool Reflog::ContainsReference(const shash::Any               &hash,
                                const SqlReflog::ReferenceType  type) const {
+  if (has_index_)
+    return LookupIndex(hash, type) != NULL;
+
   const bool fetching =
     contains_reference_->BindReference(hash, type) &&
     contains_reference_->FetchRow();
@@ -265,6 +341,14 @@ bool Reflog::GetReferenceTimestamp(
   const SqlReflog::ReferenceType type,
   uint64_t *timestamp) const
 {
+  if (has_index_) {
+    const IndexEntry *entry = LookupIndex(hash, type);
+    if (entry == NULL)
+      return false;
+    *timestamp = entry->timestamp;
+    return true;
+  }
+
   bool retval =
     get_timestamp_->BindReference(hash, type) &&
     get_timestamp_->FetchRow();
@@ -68,6 +68,15 @@ class Reflog {
   bool GetCatalogTimestamp(const shash::Any &catalog,
                            uint64_t *timestamp) const;
 
+  /**
+   * Loads all references into a sorted in-memory index.  Afterwards, the
+   * Contains...() and GetCatalogTimestamp() lookups are binary searches in
+   * the index instead of one SQL query each, which matters for garbage
+   * collection runs.  Add...() and Remove() keep the index up to date.
+   */
+  bool LoadIndex();
+  bool HasIndex() const { return has_index_; }
+
   void BeginTransaction();
   void CommitTransaction();
 
@@ -91,6 +100,31 @@ class Reflog {
                              uint64_t *timestamp) const;
 
  private:
+  struct IndexEntry {
+    IndexEntry() : type(SqlReflog::kRefCatalog), timestamp(0), removed(false)
+    { }
+    IndexEntry(const shash::Any &h, const SqlReflog::ReferenceType t,
+               const uint64_t ts)
+      : hash(h), type(t), timestamp(ts), removed(false) { }
+    // Same as the primary key of the database: the hash without suffix
+    bool operator <(const IndexEntry &other) const {
+      return hash < other.hash;
+    }
+    shash::Any hash;
+    SqlReflog::ReferenceType type;
+    uint64_t timestamp;
+    /**
+     * Removed entries stay in place so that Remove() does not need to move
+     * the tail of the index.
+     */
+    bool removed;
+  };
+
+  Reflog() : has_index_(false) { }
+  std::vector<IndexEntry>::iterator FindIndexEntry(const shash::Any &hash);
+  const IndexEntry *LookupIndex(const shash::Any               &hash,
+                                const SqlReflog::ReferenceType  type) const;
+
   bool CreateDatabase(const std::string &database_path,
                       const std::string &repo_name);
   bool OpenDatabase(const std::string &database_path);
@@ -106,6 +140,9 @@ class Reflog {
   UniquePtr<SqlRemoveReference>   remove_reference_;
   UniquePtr<SqlContainsReference> contains_reference_;
   UniquePtr<SqlGetTimestamp>      get_timestamp_;
+
+  bool                            has_index_;
+  std::vector<IndexEntry>         index_;
 };
 
 }  // namespace manifest
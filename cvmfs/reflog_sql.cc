@@ -149,6 +149,28 @@ shash::Any SqlListReferences::RetrieveHash() const {
 //------------------------------------------------------------------------------
 
 
+SqlListAllReferences::SqlListAllReferences(const ReflogDatabase *database) {
+  DeferredInit(database->sqlite_db(), "SELECT hash, type, timestamp "
+                                      "FROM refs;");
+}
+
+shash::Any SqlListAllReferences::RetrieveHash() const {
+  return shash::MkFromHexPtr(shash::HexPtr(RetrieveString(0)),
+                             ToSuffix(RetrieveType()));
+}
+
+SqlReflog::ReferenceType SqlListAllReferences::RetrieveType() const {
+  return static_cast<ReferenceType>(RetrieveInt64(1));
+}
+
+uint64_t SqlListAllReferences::RetrieveTimestamp() const {
+  return static_cast<uint64_t>(RetrieveInt64(2));
+}
+
+
+//------------------------------------------------------------------------------
+
+
 SqlRemoveReference::SqlRemoveReference(const ReflogDatabase *database) {
   DeferredInit(database->sqlite_db(), "DELETE FROM refs WHERE hash = :hash "
                                       "AND type = :type;");
@@ -77,6 +77,19 @@ class SqlListReferences : public SqlReflog {
 };
 
 
+/**
+ * Lists all references with their type and timestamp, used to build the
+ * in-memory index of the Reflog.
+ */
+class SqlListAllReferences : public SqlReflog {
+ public:
+  explicit SqlListAllReferences(const ReflogDatabase *database);
+  shash::Any RetrieveHash() const;
+  ReferenceType RetrieveType() const;
+  uint64_t RetrieveTimestamp() const;
+};
+
+
 class SqlRemoveReference : public SqlReflog {
  public:
   explicit SqlRemoveReference(const ReflogDatabase *database);
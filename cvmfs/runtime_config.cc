@@ -0,0 +1,114 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "runtime_config.h"
+
+#include <cassert>
+
+#include "logging.h"
+#include "platform.h"
+#include "util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+namespace cvmfs {
+
+RuntimeConfigStore::RuntimeConfigStore(const RuntimeConfig &initial)
+  : max_kcache_timeout_sec_(initial.kcache_timeout_sec)
+  , max_kcache_negative_timeout_sec_(initial.kcache_negative_timeout_sec)
+  , current_(new RuntimeConfig(initial))
+{
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+}
+
+
+RuntimeConfigStore::~RuntimeConfigStore() {
+  for (unsigned i = 0; i < retired_.size(); ++i)
+    delete retired_[i].second;
+  delete current_;
+  pthread_mutex_destroy(&lock_);
+}
+
+
+/**
+ * Needs to be called with lock_ held.  Returns a private copy of the current
+ * snapshot.
+ */
+RuntimeConfig *RuntimeConfigStore::BeginChange() {
+  RuntimeConfig *config = new RuntimeConfig(*current_);
+  config->version++;
+  return config;
+}
+
+
+/**
+ * Needs to be called with lock_ held.
+ */
+void RuntimeConfigStore::Publish(RuntimeConfig *config) {
+  const uint64_t now = platform_monotonic_time();
+  FreeRetired(now);
+  retired_.push_back(make_pair(now, current_));
+  atomic_store_release(reinterpret_cast<void **>(&current_), config);
+}
+
+
+void RuntimeConfigStore::FreeRetired(const uint64_t now) {
+  unsigned num_expired = 0;
+  while ((num_expired < retired_.size()) &&
+         (retired_[num_expired].first + kGracePeriodSec < now))
+  {
+    delete retired_[num_expired].second;
+    num_expired++;
+  }
+  retired_.erase(retired_.begin(), retired_.begin() + num_expired);
+}
+
+
+/**
+ * Returns false if a timeout exceeds the one the file system was mounted with.
+ */
+bool RuntimeConfigStore::SetKcacheTimeouts(
+  const double timeout_sec,
+  const double negative_timeout_sec)
+{
+  if ((timeout_sec < 0.0) || (timeout_sec > max_kcache_timeout_sec_) ||
+      (negative_timeout_sec < 0.0) ||
+      (negative_timeout_sec > max_kcache_negative_timeout_sec_))
+  {
+    return false;
+  }
+
+  MutexLockGuard guard(&lock_);
+  RuntimeConfig *config = BeginChange();
+  config->kcache_timeout_sec = timeout_sec;
+  config->kcache_negative_timeout_sec = negative_timeout_sec;
+  Publish(config);
+  LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslog,
+           "kernel caches expire after %d seconds "
+           "(negative entries: %d seconds)",
+           static_cast<int>(timeout_sec),
+           static_cast<int>(negative_timeout_sec));
+  return true;
+}
+
+
+void RuntimeConfigStore::SetReloadModes(
+  const int drainout_mode,
+  const bool maintenance_mode)
+{
+  MutexLockGuard guard(&lock_);
+  if ((current_->drainout_mode == drainout_mode) &&
+      (current_->maintenance_mode == maintenance_mode))
+  {
+    return;
+  }
+  RuntimeConfig *config = BeginChange();
+  config->drainout_mode = drainout_mode;
+  config->maintenance_mode = maintenance_mode;
+  Publish(config);
+}
+
+}  // namespace cvmfs
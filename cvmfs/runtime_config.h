@@ -0,0 +1,119 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_RUNTIME_CONFIG_H_
+#define CVMFS_RUNTIME_CONFIG_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+#include "atomic.h"
+#include "gtest/gtest_prod.h"
+#include "util/single_copy.h"
+
+namespace cvmfs {
+
+/**
+ * The parameters of a mount point that the fuse callbacks need on every
+ * request and that change while the file system is mounted.  Instances are
+ * immutable once published by the RuntimeConfigStore.
+ */
+struct RuntimeConfig {
+  RuntimeConfig()
+    : version(0)
+    , kcache_timeout_sec(0.0)
+    , kcache_negative_timeout_sec(0.0)
+    , drainout_mode(0)
+    , maintenance_mode(false)
+  { }
+
+  /**
+   * Metadata replies are not cached by the kernel while the caches are
+   * drained out for a reload or in maintenance mode.
+   */
+  bool IsCaching() const { return (drainout_mode == 0) && !maintenance_mode; }
+  bool IsInDrainoutMode() const { return drainout_mode == 2; }
+  double GetKcacheTimeout() const {
+    return IsCaching() ? kcache_timeout_sec : 0.0;
+  }
+  double GetKcacheNegativeTimeout() const {
+    return IsCaching() ? kcache_negative_timeout_sec : 0.0;
+  }
+
+  /**
+   * Incremented with every published change
+   */
+  uint64_t version;
+  double kcache_timeout_sec;
+  double kcache_negative_timeout_sec;
+  /**
+   * Follows the drainout and maintenance mode of the FuseRemounter
+   */
+  int drainout_mode;
+  bool maintenance_mode;
+};
+
+
+/**
+ * Publishes RuntimeConfig snapshots by swapping a pointer.  Readers get the
+ * current snapshot with a single acquire load and no locks or atomic
+ * read-modify-write operations.  Writers are serialized; every change copies
+ * the current snapshot, modifies the copy, and publishes it.
+ *
+ * Readers must not keep the snapshot beyond a single request.  Replaced
+ * snapshots are freed only kGracePeriodSec after they were replaced, when the
+ * next change is published.
+ */
+class RuntimeConfigStore : SingleCopy {
+  FRIEND_TEST(T_RuntimeConfig, GracePeriod);
+
+ public:
+  static const unsigned kGracePeriodSec = 60;
+
+  /**
+   * The kernel cache timeouts of the initial configuration are the upper
+   * limits for SetKcacheTimeouts().  Longer timeouts would outlast the drain
+   * out of the kernel caches before a reload.
+   */
+  explicit RuntimeConfigStore(const RuntimeConfig &initial);
+  ~RuntimeConfigStore();
+
+  const RuntimeConfig *Get() const {
+    return static_cast<const RuntimeConfig *>(atomic_load_acquire(
+      reinterpret_cast<void * const *>(&current_)));
+  }
+
+  bool SetKcacheTimeouts(const double timeout_sec,
+                         const double negative_timeout_sec);
+  void SetReloadModes(const int drainout_mode, const bool maintenance_mode);
+
+  double max_kcache_timeout_sec() const { return max_kcache_timeout_sec_; }
+  double max_kcache_negative_timeout_sec() const {
+    return max_kcache_negative_timeout_sec_;
+  }
+
+ private:
+  RuntimeConfig *BeginChange();
+  void Publish(RuntimeConfig *config);
+  void FreeRetired(const uint64_t now);
+
+  double max_kcache_timeout_sec_;
+  double max_kcache_negative_timeout_sec_;
+  RuntimeConfig *current_;
+  /**
+   * Replaced snapshots and when (monotonic time in seconds) they were replaced
+   */
+  std::vector<std::pair<uint64_t, RuntimeConfig *> > retired_;
+  /**
+   * Serializes the writers
+   */
+  pthread_mutex_t lock_;
+};
+
+}  // namespace cvmfs
+
+#endif  // CVMFS_RUNTIME_CONFIG_H_
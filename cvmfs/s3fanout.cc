@@ -5,7 +5,9 @@
  */
 
 #include <pthread.h>
+#include <sys/time.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <utility>
 
@@ -20,6 +22,13 @@ using namespace std;  // NOLINT
 
 namespace s3fanout {
 
+static uint64_t GetTimestampMs() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return static_cast<uint64_t>(now.tv_sec) * 1000 + now.tv_usec / 1000;
+}
+
+
 /**
  * Called by curl for every HTTP header. Not called for file:// transfers.
  */
@@ -69,6 +78,12 @@ static size_t CallbackCurlHeader(void *ptr, size_t size, size_t nmemb,
     }
   }
 
+  // Multipart uploads refer to the parts by their ETag
+  if (HasPrefix(header_line, "ETag:", true)) {
+    info->etag = Trim(header_line.substr(
+      5, header_line.find_first_of("\r\n") - 5));
+  }
+
   return num_bytes;
 }
 
@@ -110,6 +125,42 @@ static size_t CallbackCurlData(void *ptr, size_t size, size_t nmemb,
 }
 
 
+/**
+ * POST requests and server-side copies report their result, including errors,
+ * in the response body.
+ */
+static bool HasResponseBody(const JobInfo *info) {
+  return (info->request == JobInfo::kReqDeleteMulti) ||
+         (info->request == JobInfo::kReqMultipartInit) ||
+         (info->request == JobInfo::kReqMultipartComplete) ||
+         (info->request == JobInfo::kReqCopy);
+}
+
+
+/**
+ * A request can fail with a "200 OK" reply and the error in the body
+ */
+static bool HasErrorResponse(const JobInfo *info) {
+  return HasResponseBody(info) &&
+         (info->response.find("<Error>") != string::npos);
+}
+
+
+/**
+ * Called by curl for every chunk of the response body.  Only the body of
+ * the requests that report their result in the body is collected, e.g. the
+ * keys that failed in a multi-object delete.
+ */
+static size_t CallbackCurlBody(char *ptr, size_t size, size_t nmemb,
+                               void *info_link) {
+  const size_t num_bytes = size*nmemb;
+  JobInfo *info = static_cast<JobInfo *>(info_link);
+  if (HasResponseBody(info))
+    info->response.append(ptr, num_bytes);
+  return num_bytes;
+}
+
+
 /**
  * Called when new curl sockets arrive or existing curl sockets depart.
  */
@@ -188,14 +239,37 @@ void *S3FanoutManager::MainUpload(void *data) {
 
   // Don't schedule more jobs into the multi handle than the maximum number of
   // parallel connections.  This should prevent starvation and thus a timeout
-  // of the authorization header (CVM-1339).
+  // of the authorization header (CVM-1339).  Below that, the limit adapts to
+  // throttling by S3.
   unsigned jobs_in_flight = 0;
 
   while (s3fanout_mgr->thread_upload_run_) {
+    // Backed off retries that are due go back into the multi handle
+    if (!s3fanout_mgr->jobs_backoff_.empty()) {
+      const uint64_t now = GetTimestampMs();
+      std::vector<JobInfo *>::iterator i = s3fanout_mgr->jobs_backoff_.begin();
+      while (i != s3fanout_mgr->jobs_backoff_.end()) {
+        if (((*i)->timestamp_retry_ms > now) ||
+            s3fanout_mgr->PostponeForHost(*i))
+        {
+          ++i;
+          continue;
+        }
+        (*i)->timestamp_retry_ms = 0;
+        curl_multi_add_handle(s3fanout_mgr->curl_multi_, (*i)->curl_handle);
+        int still_running = 0;
+        curl_multi_socket_action(s3fanout_mgr->curl_multi_,
+                                 CURL_SOCKET_TIMEOUT,
+                                 0,
+                                 &still_running);
+        i = s3fanout_mgr->jobs_backoff_.erase(i);
+      }
+    }
+
     JobInfo *info = NULL;
     pthread_mutex_lock(s3fanout_mgr->jobs_todo_lock_);
     if (!s3fanout_mgr->jobs_todo_.empty() &&
-        (jobs_in_flight < s3fanout_mgr->pool_max_handles_))
+        (jobs_in_flight < s3fanout_mgr->max_in_flight_))
     {
       info = s3fanout_mgr->jobs_todo_.back();
       s3fanout_mgr->jobs_todo_.pop_back();
@@ -219,8 +293,13 @@ void *S3FanoutManager::MainUpload(void *data) {
       }
       s3fanout_mgr->SetUrlOptions(info);
 
-      curl_multi_add_handle(s3fanout_mgr->curl_multi_, handle);
       jobs_in_flight++;
+      if (s3fanout_mgr->PostponeForHost(info)) {
+        s3fanout_mgr->statistics_->num_postponed++;
+        s3fanout_mgr->jobs_backoff_.push_back(info);
+        continue;
+      }
+      curl_multi_add_handle(s3fanout_mgr->curl_multi_, handle);
       int still_running = 0, retval = 0;
       retval = curl_multi_socket_action(s3fanout_mgr->curl_multi_,
                                         CURL_SOCKET_TIMEOUT,
@@ -290,6 +369,10 @@ void *S3FanoutManager::MainUpload(void *data) {
 
         curl_multi_remove_handle(s3fanout_mgr->curl_multi_, easy_handle);
         if (s3fanout_mgr->VerifyAndFinalize(curl_error, info)) {
+          if (info->timestamp_retry_ms > 0) {
+            s3fanout_mgr->jobs_backoff_.push_back(info);
+            continue;
+          }
           curl_multi_add_handle(s3fanout_mgr->curl_multi_, easy_handle);
           int still_running = 0;
           curl_multi_socket_action(s3fanout_mgr->curl_multi_,
@@ -345,11 +428,16 @@ CURL *S3FanoutManager::AcquireCurlHandle() const {
     // Other settings
     retval = curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1);
     assert(retval == CURLE_OK);
+    // Keep idle connections in the pool alive for reuse
+    retval = curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    assert(retval == CURLE_OK);
     retval = curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION,
                               CallbackCurlHeader);
     assert(retval == CURLE_OK);
     retval = curl_easy_setopt(handle, CURLOPT_READFUNCTION, CallbackCurlData);
     assert(retval == CURLE_OK);
+    retval = curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, CallbackCurlBody);
+    assert(retval == CURLE_OK);
   } else {
     handle = *(pool_handles_idle_->begin());
     pool_handles_idle_->erase(pool_handles_idle_->begin());
@@ -398,13 +486,16 @@ string S3FanoutManager::MkAuthoritzation(const string &access_key,
                                          const string &request,
                                          const string &content_md5_base64,
                                          const string &bucket,
-                                         const string &object_key) const {
+                                         const string &object_key,
+                                         const string &copy_source) const {
   string to_sign = request + "\n" +
                    content_md5_base64 + "\n" +
                    content_type + "\n" +
                    timestamp + "\n" +
-                   "x-amz-acl:public-read" + "\n" +  // default ACL
-                   "/" + bucket + "/" + object_key;
+                   "x-amz-acl:public-read" + "\n";  // default ACL
+  if (!copy_source.empty())
+    to_sign += "x-amz-copy-source:" + copy_source + "\n";
+  to_sign += "/" + bucket + "/" + object_key;
   LogCvmfs(kLogS3Fanout, kLogDebug,
            "%s string to sign for: %s", request.c_str(), object_key.c_str());
 
@@ -523,6 +614,8 @@ Failures S3FanoutManager::InitializeRequest(JobInfo *info, CURL *handle) const {
   info->num_retries = 0;
   info->backoff_ms = 0;
   info->http_headers = NULL;
+  info->response.clear();
+  info->etag.clear();
 
   InitializeDnsSettings(handle, info->hostname);
 
@@ -548,7 +641,7 @@ Failures S3FanoutManager::InitializeRequest(JobInfo *info, CURL *handle) const {
                                            req.c_str(),
                                            "",
                                            info->bucket,
-                                           info->object_key).c_str());
+                                           info->object_key, "").c_str());
     info->http_headers =
         curl_slist_append(info->http_headers, "Content-Length: 0");
 
@@ -559,6 +652,68 @@ Failures S3FanoutManager::InitializeRequest(JobInfo *info, CURL *handle) const {
       retval = curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, NULL);
       assert(retval == CURLE_OK);
     }
+  } else if ((info->request == JobInfo::kReqDeleteMulti) ||
+             (info->request == JobInfo::kReqMultipartInit) ||
+             (info->request == JobInfo::kReqMultipartComplete))
+  {
+    assert(info->origin == kOriginMem);
+    retval = curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, NULL);
+    assert(retval == CURLE_OK);
+    retval = curl_easy_setopt(handle, CURLOPT_UPLOAD, 0);
+    assert(retval == CURLE_OK);
+    retval = curl_easy_setopt(handle, CURLOPT_NOBODY, 0);
+    assert(retval == CURLE_OK);
+    // POST with the body provided by the read callback
+    retval = curl_easy_setopt(handle, CURLOPT_POST, 1);
+    assert(retval == CURLE_OK);
+    retval = curl_easy_setopt(handle, CURLOPT_POSTFIELDS, NULL);
+    assert(retval == CURLE_OK);
+    retval = curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE_LARGE,
+                              static_cast<curl_off_t>(info->origin_mem.size));
+    assert(retval == CURLE_OK);
+    // The multi-object delete requires the Content-MD5 header
+    shash::HashMem(info->origin_mem.data, info->origin_mem.size, &content_md5);
+    const string content_md5_base64 =
+        Base64(string(reinterpret_cast<char *>(content_md5.digest),
+                      content_md5.GetDigestSize()));
+    info->http_headers =
+        curl_slist_append(info->http_headers,
+                          ("Content-MD5: " + content_md5_base64).c_str());
+    timestamp = RfcTimestamp();
+    info->http_headers =
+        curl_slist_append(info->http_headers,
+                          MkAuthoritzation(info->access_key,
+                                           info->secret_key,
+                                           timestamp, "application/xml",
+                                           "POST", content_md5_base64,
+                                           info->bucket,
+                                           info->object_key, "").c_str());
+    info->http_headers =
+        curl_slist_append(info->http_headers, "Content-Type: application/xml");
+  } else if (info->request == JobInfo::kReqCopy) {
+    assert(!info->copy_source.empty());
+    retval = curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, NULL);
+    assert(retval == CURLE_OK);
+    retval = curl_easy_setopt(handle, CURLOPT_UPLOAD, 1);
+    assert(retval == CURLE_OK);
+    retval = curl_easy_setopt(handle, CURLOPT_NOBODY, 0);
+    assert(retval == CURLE_OK);
+    // PUT without a body, the data is taken from copy_source
+    retval = curl_easy_setopt(handle, CURLOPT_INFILESIZE_LARGE,
+                              static_cast<curl_off_t>(0));
+    assert(retval == CURLE_OK);
+    timestamp = RfcTimestamp();
+    info->http_headers =
+        curl_slist_append(info->http_headers,
+                          MkAuthoritzation(info->access_key,
+                                           info->secret_key,
+                                           timestamp, "", "PUT", "",
+                                           info->bucket,
+                                           info->object_key,
+                                           info->copy_source).c_str());
+    info->http_headers =
+        curl_slist_append(info->http_headers,
+                          ("x-amz-copy-source: " + info->copy_source).c_str());
   } else {
     retval = curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, NULL);
     assert(retval == CURLE_OK);
@@ -616,7 +771,7 @@ Failures S3FanoutManager::InitializeRequest(JobInfo *info, CURL *handle) const {
                                            timestamp, "binary/octet-stream",
                                            "PUT", content_md5_base64,
                                            info->bucket,
-                                           (info->object_key)).c_str());
+                                           info->object_key, "").c_str());
 
     info->http_headers =
         curl_slist_append(info->http_headers,
@@ -654,6 +809,9 @@ Failures S3FanoutManager::InitializeRequest(JobInfo *info, CURL *handle) const {
   retval = curl_easy_setopt(handle, CURLOPT_READDATA,
                             static_cast<void *>(info));
   assert(retval == CURLE_OK);
+  retval = curl_easy_setopt(handle, CURLOPT_WRITEDATA,
+                            static_cast<void *>(info));
+  assert(retval == CURLE_OK);
   retval = curl_easy_setopt(handle, CURLOPT_HTTPHEADER, info->http_headers);
   assert(retval == CURLE_OK);
   if (opt_ipv4_only_) {
@@ -691,9 +849,71 @@ void S3FanoutManager::SetUrlOptions(JobInfo *info) const {
  */
 void S3FanoutManager::UpdateStatistics(CURL *handle) {
   double val;
+  long num_connects;  // NOLINT(runtime/int)
 
   if (curl_easy_getinfo(handle, CURLINFO_SIZE_UPLOAD, &val) == CURLE_OK)
     statistics_->transferred_bytes += val;
+  if (curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &num_connects) ==
+      CURLE_OK)
+  {
+    statistics_->num_connections += num_connects;
+  }
+}
+
+
+/**
+ * Additive increase, multiplicative decrease of the number of requests in
+ * flight.  A "503 Slow Down" halves the limit.  The requests that were in
+ * flight at the same time likely see the same throttling, so the limit
+ * decreases at most once per (smoothed) request latency.
+ */
+void S3FanoutManager::AdaptConcurrency(const JobInfo *info) {
+  const uint64_t now = GetTimestampMs();
+  double total_time;
+  if (curl_easy_getinfo(info->curl_handle, CURLINFO_TOTAL_TIME, &total_time) ==
+      CURLE_OK)
+  {
+    const uint64_t sample_ms = static_cast<uint64_t>(total_time * 1000.0);
+    latency_ms_ = (latency_ms_ == 0) ? sample_ms
+                                     : (7 * latency_ms_ + sample_ms) / 8;
+  }
+
+  if (info->error_code == kFailServiceUnavailable) {
+    statistics_->num_throttled++;
+    if (now - timestamp_decrease_ms_ >= latency_ms_) {
+      max_in_flight_ = (max_in_flight_ > 1) ? max_in_flight_ / 2 : 1;
+      num_successes_ = 0;
+      timestamp_decrease_ms_ = now;
+      if (max_in_flight_ < statistics_->min_concurrency)
+        statistics_->min_concurrency = max_in_flight_;
+      LogCvmfs(kLogS3Fanout, kLogDebug,
+               "throttled, reducing parallel requests to %u", max_in_flight_);
+    }
+  } else if (info->error_code == kFailOk) {
+    if (++num_successes_ >= max_in_flight_) {
+      num_successes_ = 0;
+      if (max_in_flight_ < pool_max_handles_)
+        max_in_flight_++;
+    }
+  }
+}
+
+
+/**
+ * If the host of the request is known to be unavailable, sets the time of the
+ * next attempt to when the host is probed again.  Otherwise the request may go
+ * out, perhaps as the probe.  Only used by the I/O thread.
+ *
+ * @return true if the request has to wait
+ */
+bool S3FanoutManager::PostponeForHost(JobInfo *info) {
+  if (breakers_.Allow(info->hostname))
+    return false;
+  // A wait time of zero means the probe was just taken by another request
+  const uint64_t wait_ms = std::max(breakers_.GetWaitMs(info->hostname),
+                                    uint64_t(1));
+  info->timestamp_retry_ms = GetTimestampMs() + wait_ms;
+  return true;
 }
 
 
@@ -714,9 +934,9 @@ bool S3FanoutManager::CanRetry(const JobInfo *info) {
 
 
 /**
- * Backoff for retry to introduce a jitter into a upload sequence.
- *
- * \return true if backoff has been performed, false otherwise
+ * Backoff for retry to introduce a jitter into a upload sequence.  The I/O
+ * thread keeps the job aside until timestamp_retry_ms instead of sleeping, so
+ * that the other transfers continue.
  */
 void S3FanoutManager::Backoff(JobInfo *info) {
   pthread_mutex_lock(lock_options_);
@@ -735,7 +955,7 @@ void S3FanoutManager::Backoff(JobInfo *info) {
     info->backoff_ms = backoff_max_ms;
 
   LogCvmfs(kLogS3Fanout, kLogDebug, "backing off for %d ms", info->backoff_ms);
-  SafeSleepMs(info->backoff_ms);
+  info->timestamp_retry_ms = GetTimestampMs() + info->backoff_ms;
 }
 
 
@@ -782,6 +1002,27 @@ bool S3FanoutManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
       break;
   }
 
+  // E.g., a successful multi-object delete reports failed keys in the body
+  if ((info->error_code == kFailOk) && HasErrorResponse(info)) {
+    LogCvmfs(kLogS3Fanout, kLogStderr, "request for %s/%s failed: %s",
+             info->bucket.c_str(), info->object_key.c_str(),
+             info->response.c_str());
+    info->error_code = kFailOther;
+  }
+
+  AdaptConcurrency(info);
+
+  // Any reply shows that the host is alive
+  if ((info->error_code == kFailHostConnection) ||
+      (info->error_code == kFailHostResolve))
+  {
+    breakers_.ReportFailure(info->hostname);
+  } else if ((info->error_code != kFailLocalIO) &&
+             (info->error_code != kFailOther))
+  {
+    breakers_.ReportSuccess(info->hostname);
+  }
+
   // Transform HEAD to PUT request
   if ((info->error_code == kFailNotFound) &&
       (info->request == JobInfo::kReqHead)) {
@@ -815,9 +1056,12 @@ bool S3FanoutManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
   }
   if (try_again) {
     if (info->request == JobInfo::kReqPut ||
-        info->request == JobInfo::kReqPutNoCache) {
+        info->request == JobInfo::kReqPutNoCache ||
+        info->request == JobInfo::kReqPutPart ||
+        HasResponseBody(info)) {
       LogCvmfs(kLogS3Fanout, kLogDebug, "Trying again to upload %s",
                info->object_key.c_str());
+      info->response.clear();
       // Reset origin
       if (info->origin == kOriginMem)
         info->origin_mem.pos = 0;
@@ -845,6 +1089,11 @@ bool S3FanoutManager::VerifyAndFinalize(const int curl_error, JobInfo *info) {
       delete info->mmf;
       info->mmf = NULL;
     }
+    if (info->owns_origin_mem) {
+      free(const_cast<unsigned char *>(info->origin_mem.data));
+      info->origin_mem.data = NULL;
+      info->owns_origin_mem = false;
+    }
   }
 
   return false;  // stop transfer
@@ -894,6 +1143,11 @@ S3FanoutManager::S3FanoutManager() {
   resolver_ = NULL;
   available_jobs_ = NULL;
   statistics_ = NULL;
+
+  max_in_flight_ = 0;
+  num_successes_ = 0;
+  timestamp_decrease_ms_ = 0;
+  latency_ms_ = 0;
 }
 
 
@@ -924,8 +1178,14 @@ void S3FanoutManager::Init(const unsigned int max_pool_handles) {
   available_jobs_ = new Semaphore(max_available_jobs_);
   assert(NULL != available_jobs_);
 
+  max_in_flight_ = pool_max_handles_;
+  num_successes_ = 0;
+  timestamp_decrease_ms_ = 0;
+  latency_ms_ = 0;
+
   opt_timeout_ = 20;
   statistics_ = new Statistics();
+  statistics_->min_concurrency = pool_max_handles_;
   user_agent_ = new string();
   *user_agent_ = "User-Agent: cvmfs " + string(VERSION);
 
@@ -941,6 +1201,10 @@ void S3FanoutManager::Init(const unsigned int max_pool_handles) {
   mretval = curl_multi_setopt(curl_multi_, CURLMOPT_MAX_TOTAL_CONNECTIONS,
                               pool_max_handles_);
   assert(mretval == CURLM_OK);
+  // Keep the connections of a throttled, smaller window for later reuse
+  mretval = curl_multi_setopt(curl_multi_, CURLMOPT_MAXCONNECTS,
+                              pool_max_handles_);
+  assert(mretval == CURLM_OK);
 
   prng_.InitLocaltime();
 
@@ -1106,7 +1370,7 @@ bool S3FanoutManager::DoSingleJob(JobInfo *info) const {
 
   CURLcode resl = curl_easy_perform(handle);
   if (resl == CURLE_OK && info->error_code == kFailOk) {
-    retme = true;
+    retme = !HasErrorResponse(info);
   }
 
   ReleaseCurlHandle(info, handle);
@@ -1126,7 +1390,15 @@ string Statistics::Print() const {
       "Number of requests: " +
       StringifyInt(num_requests) + "\n" +
       "Number of retries:  " +
-      StringifyInt(num_retries) + "\n";
+      StringifyInt(num_retries) + "\n" +
+      "Throttled requests: " +
+      StringifyInt(num_throttled) + "\n" +
+      "New connections:    " +
+      StringifyInt(num_connections) + "\n" +
+      "Min. concurrency:   " +
+      StringifyInt(min_concurrency) + "\n" +
+      "Postponed requests: " +
+      StringifyInt(num_postponed) + "\n";
 }
 
 }  // namespace s3fanout
@@ -15,6 +15,7 @@
 #include <utility>
 #include <vector>
 
+#include "backoff.h"
 #include "dns.h"
 #include "duplex_curl.h"
 #include "prng.h"
@@ -71,12 +72,20 @@ struct Statistics {
   double transfer_time;
   uint64_t num_requests;
   uint64_t num_retries;
+  uint64_t num_throttled;  // 503 "Slow Down" replies
+  uint64_t num_connections;  // new connections, the others are reused
+  uint64_t min_concurrency;  // lowest adaptive concurrency limit
+  uint64_t num_postponed;  // requests held back for an unavailable host
 
   Statistics() {
     transferred_bytes = 0.0;
     transfer_time = 0.0;
     num_requests = 0;
     num_retries = 0;
+    num_throttled = 0;
+    num_connections = 0;
+    min_concurrency = 0;
+    num_postponed = 0;
   }
 
   std::string Print() const;
@@ -92,6 +101,16 @@ struct JobInfo {
     kReqPut,
     kReqPutNoCache,
     kReqDelete,
+    // S3 multi-object delete, the object keys are in the request body
+    kReqDeleteMulti,
+    // S3 multipart upload: the initiation (<key>?uploads), the parts
+    // (<key>?partNumber=<n>&uploadId=<id>), and the completion
+    // (<key>?uploadId=<id>) with the list of parts in the request body
+    kReqMultipartInit,
+    kReqPutPart,
+    kReqMultipartComplete,
+    // Server-side copy of copy_source to the object key
+    kReqCopy,
   };
 
   Origin origin;
@@ -107,7 +126,9 @@ struct JobInfo {
   const std::string bucket;
   const std::string object_key;
   const std::string origin_path;
+  std::string copy_source;  // /<bucket>/<object key>, only for kReqCopy
   bool test_and_set;
+  bool owns_origin_mem;  // origin_mem.data is free()d once the job is done
   void *callback;  // Callback to be called when job is finished
   MemoryMappedFile *mmf;
 
@@ -143,6 +164,7 @@ struct JobInfo {
     curl_handle = NULL;
     http_headers = NULL;
     test_and_set = false;
+    owns_origin_mem = false;
     origin_mem.pos = 0;
     origin_mem.size = 0;
     origin_mem.data = NULL;
@@ -153,18 +175,22 @@ struct JobInfo {
     error_code = kFailOk;
     num_retries = 0;
     backoff_ms = 0;
+    timestamp_retry_ms = 0;
     origin = kOriginPath;
   }
   ~JobInfo() {}
 
   // Internal state, don't touch
   CURL *curl_handle;
+  std::string response;  // Only collected for POST and copy requests
+  std::string etag;  // ETag header of the response
   struct curl_slist *http_headers;
   FILE *origin_file;
   RequestType request;
   Failures error_code;
   unsigned char num_retries;
   unsigned backoff_ms;
+  uint64_t timestamp_retry_ms;  // Due time of a backed off retry, 0 if none
 };  // JobInfo
 
 struct S3FanOutDnsEntry {
@@ -223,6 +249,8 @@ class S3FanoutManager : SingleCopy {
   void UpdateStatistics(CURL *handle);
   bool CanRetry(const JobInfo *info);
   void Backoff(JobInfo *info);
+  void AdaptConcurrency(const JobInfo *info);
+  bool PostponeForHost(JobInfo *info);
   bool VerifyAndFinalize(const int curl_error, JobInfo *info);
   std::string MkAuthoritzation(const std::string &access_key,
                                const std::string &secret_key,
@@ -231,7 +259,8 @@ class S3FanoutManager : SingleCopy {
                                const std::string &request,
                                const std::string &content_md5_base64,
                                const std::string &bucket,
-                               const std::string &object_key) const;
+                               const std::string &object_key,
+                               const std::string &copy_source) const;
   std::string MkUrl(const std::string &host,
                     const std::string &bucket,
                     const std::string &objkey2) const {
@@ -268,6 +297,23 @@ class S3FanoutManager : SingleCopy {
   unsigned int max_available_jobs_;
   Semaphore *available_jobs_;
 
+  /**
+   * AIMD limit of the requests in flight, between 1 and pool_max_handles_.
+   * Only used by the I/O thread.  It is halved when S3 throttles and grows by
+   * one after a window of successful requests.
+   */
+  uint32_t max_in_flight_;
+  uint32_t num_successes_;  // since the last growth of max_in_flight_
+  uint64_t timestamp_decrease_ms_;
+  uint64_t latency_ms_;  // smoothed request latency
+  // Retries that wait for their backoff without blocking the I/O thread
+  std::vector<JobInfo *> jobs_backoff_;
+  /**
+   * Hosts that failed to resolve or to connect repeatedly.  Requests to them
+   * wait in jobs_backoff_ until a single probing request succeeds.
+   */
+  CircuitBreakers breakers_;
+
   // Writes and reads should be atomic because reading happens in a different
   // thread than writing.
   Statistics *statistics_;
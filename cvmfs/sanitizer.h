@@ -129,6 +129,16 @@ class UriSanitizer : public InputSanitizer {
   UriSanitizer() : InputSanitizer("az AZ 09 . - _ /") { }
 };
 
+
+/**
+ * The Geo-API URIs contain comma-separated lists of host names and IPv6
+ * addresses as well as the "+PXYSEP+" separator.
+ */
+class GeoUriSanitizer : public InputSanitizer {
+ public:
+  GeoUriSanitizer() : InputSanitizer("az AZ 09 . - _ / , + :") { }
+};
+
 }  // namespace sanitizer
 
 #ifdef CVMFS_NAMESPACE_GUARD
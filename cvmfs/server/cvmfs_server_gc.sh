@@ -290,6 +290,14 @@ __run_gc() {
     additional_switches="$additional_switches -L $CVMFS_GC_DELETION_LOG"
   fi
 
+  # incremental garbage collection keeps catalog summaries in the spool area
+  if [ x"$CVMFS_GC_INCREMENTAL" = x"true" ] && [ $dry_run -eq 0 ]; then
+    additional_switches="$additional_switches -S ${CVMFS_SPOOL_DIR}/gc_state"
+    if [ ! -z "$CVMFS_GC_FULL_INTERVAL" ]; then
+      additional_switches="$additional_switches -I $CVMFS_GC_FULL_INTERVAL"
+    fi
+  fi
+
   # do it!
   local user_shell="$(get_user_shell $name)"
 
@@ -216,6 +216,12 @@ cvmfs_server_publish() {
        -a $CVMFS_AVG_CHUNK_SIZE \
        -h $CVMFS_MAX_CHUNK_SIZE"
     fi
+    if [ "x$CVMFS_CHUNKING_ALGORITHM" != "x" ]; then
+      sync_command="$sync_command -. $CVMFS_CHUNKING_ALGORITHM"
+    fi
+    if [ "x$CVMFS_PROCESSING_POLICY" != "x" ]; then
+      sync_command="$sync_command -/ $CVMFS_PROCESSING_POLICY"
+    fi
     if [ "x$CVMFS_AUTOCATALOGS" = "xtrue" ]; then
       sync_command="$sync_command -A"
     fi
@@ -225,6 +231,9 @@ cvmfs_server_publish() {
     if [ "x$CVMFS_AUTOCATALOGS_MIN_WEIGHT" != "x" ]; then
       sync_command="$sync_command -M $CVMFS_AUTOCATALOGS_MIN_WEIGHT"
     fi
+    if [ "x$CVMFS_AUTOCATALOGS_PROFILE" != "x" ]; then
+      sync_command="$sync_command -G $CVMFS_AUTOCATALOGS_PROFILE"
+    fi
     if [ "x$CVMFS_IGNORE_XDIR_HARDLINKS" = "xtrue" ]; then
       sync_command="$sync_command -i"
     fi
@@ -252,12 +261,66 @@ cvmfs_server_publish() {
     if [ "x$CVMFS_MAXIMAL_CONCURRENT_WRITES" != "x" ]; then
       sync_command="$sync_command -q $CVMFS_MAXIMAL_CONCURRENT_WRITES"
     fi
+    if [ "x$CVMFS_SCRATCH_SCAN_THREADS" != "x" ]; then
+      sync_command="$sync_command -J $CVMFS_SCRATCH_SCAN_THREADS"
+    fi
+    if [ "x$CVMFS_LOCAL_UPLOAD_THREADS" != "x" ]; then
+      sync_command="$sync_command -+ $CVMFS_LOCAL_UPLOAD_THREADS"
+    fi
+    if [ "x$CVMFS_LOCAL_UPLOAD_SYNC" != "x" ]; then
+      sync_command="$sync_command -, $CVMFS_LOCAL_UPLOAD_SYNC"
+    fi
+    if [ "x$CVMFS_MAX_STAGED_DIRENTS" != "x" ]; then
+      sync_command="$sync_command -W $CVMFS_MAX_STAGED_DIRENTS"
+    fi
+    if [ "x$CVMFS_INLINE_FILE_THRESHOLD" != "x" ]; then
+      sync_command="$sync_command -D $CVMFS_INLINE_FILE_THRESHOLD"
+    fi
+    if [ "x$CVMFS_BUNDLE_FILE_THRESHOLD" != "x" ]; then
+      sync_command="$sync_command -@ $CVMFS_BUNDLE_FILE_THRESHOLD"
+    fi
     if [ "x${CVMFS_VOMS_AUTHZ}" != x ]; then
       sync_command="$sync_command -V"
     fi
     if [ "x$CVMFS_IGNORE_SPECIAL_FILES" = "xtrue" ]; then
       sync_command="$sync_command -g"
     fi
+    if [ "x$CVMFS_SYNC_CONTENT_CACHE" = "xtrue" ]; then
+      sync_command="$sync_command -I ${spool_dir}/content_cache"
+    fi
+    if [ "x$CVMFS_CATALOG_CACHE" = "xtrue" ]; then
+      sync_command="$sync_command -0 ${spool_dir}/catalog_cache"
+      if [ "x$CVMFS_CATALOG_CACHE_LIMIT_MB" != "x" ]; then
+        sync_command="$sync_command -1 $CVMFS_CATALOG_CACHE_LIMIT_MB"
+      fi
+    fi
+    if [ "x$CVMFS_CATALOG_LAZY_VACUUM" = "xtrue" ]; then
+      sync_command="$sync_command -2"
+    fi
+    if [ "x$CVMFS_PREFETCH_GROUPS_PATTERNS" != "x" ]; then
+      sync_command="$sync_command -3 $CVMFS_PREFETCH_GROUPS_PATTERNS"
+    fi
+    if [ "x$CVMFS_PREFETCH_GROUPS_TRACE" != "x" ]; then
+      sync_command="$sync_command -4 $CVMFS_PREFETCH_GROUPS_TRACE"
+    fi
+    if [ "x$CVMFS_DIGEST_TREE_BLOCK_SIZE" != "x" ]; then
+      sync_command="$sync_command -5 $CVMFS_DIGEST_TREE_BLOCK_SIZE"
+    fi
+    if [ "x$CVMFS_CATALOG_DELTAS" = "xtrue" ]; then
+      sync_command="$sync_command -%"
+    fi
+    if [ "x$CVMFS_CATALOG_INDEXES" = "xtrue" ]; then
+      sync_command="$sync_command -^"
+    fi
+    if [ "x$CVMFS_NESTED_CATALOG_INDEX" = "xtrue" ]; then
+      sync_command="$sync_command -_"
+    fi
+    if [ "x$CVMFS_CATALOG_CLUSTERING" = "xtrue" ]; then
+      sync_command="$sync_command -~"
+    fi
+    if [ "x$CVMFS_UPLOAD_EXISTENCE_INDEX" = "xtrue" ]; then
+      sync_command="$sync_command -&"
+    fi
     local sync_command_virtual_dir=
     if [ "x${CVMFS_VIRTUAL_DIR}" = "xtrue" ]; then
       sync_command_virtual_dir="$sync_command -S snapshots"
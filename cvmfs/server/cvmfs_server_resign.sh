@@ -16,10 +16,11 @@ cvmfs_server_resign() {
   local force=0
   local whitelist_path
   local sign_published=0
+  local num_threads
 
   # parameter handling
   OPTIND=1
-  while getopts "d:fpw:" option; do
+  while getopts "d:fpw:j:" option; do
     case $option in
       d)
         expire_days=$OPTARG
@@ -33,6 +34,9 @@ cvmfs_server_resign() {
       w)
         whitelist_path=$OPTARG
       ;;
+      j)
+        num_threads=$OPTARG
+      ;;
       ?)
         shift $(($OPTIND-2))
         usage "Command resign: Unrecognized option: $1"
@@ -64,6 +68,29 @@ cvmfs_server_resign() {
     fi
   fi
 
+  # Whitelists of several repositories with a master key on disk are signed
+  # in one batch
+  if [ $sign_published -eq 0 ] && [ -z "$whitelist_path" ] && \
+     [ $(echo $names | wc -w) -gt 1 ]; then
+    local batch_names=""
+    local other_names=""
+    for name in $names; do
+      if is_stratum0 $name && \
+         cvmfs_sys_file_is_regular /etc/cvmfs/keys/${name}.masterkey; then
+        load_repo_config $name
+        check_repository_compatibility $name
+        batch_names="$batch_names $name"
+      else
+        other_names="$other_names $name"
+      fi
+    done
+    if [ $(echo $batch_names | wc -w) -gt 1 ]; then
+      create_whitelists_batch "$batch_names" "$expire_days" "$num_threads" || \
+        retcode=1
+      names="$other_names"
+    fi
+  fi
+
   for name in $names; do
 
     if [ -z "$whitelist_path" ]; then
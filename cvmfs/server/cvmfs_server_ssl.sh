@@ -54,34 +54,18 @@ create_cert() {
 }
 
 
-create_whitelist() {
+# Writes ${temp_dir}/whitelist.$name.unsigned and the hash to be signed to
+# ${temp_dir}/whitelist.$name.hash
+prepare_whitelist() {
   local name=$1
-  local user=$2
-  local spooler_definition=$3
-  local temp_dir=$4
-  local expire_days=$5
-  local rewrite_path=$6
-  local usemasterkeycard=0
+  local temp_dir=$2
+  local expire_days=$3
+  local rewrite_path=$4
   local hash_algorithm
 
   local whitelist
   whitelist=${temp_dir}/whitelist.$name
 
-  local masterkey=/etc/cvmfs/keys/${name}.masterkey
-  if cvmfs_sys_file_is_regular $masterkey; then
-    if [ -z "$expire_days" ]; then
-      expire_days=30
-    fi
-    echo -n "Signing $expire_days day whitelist with master key... "
-  elif masterkeycard_cert_available >/dev/null; then
-    usemasterkeycard=1
-    if [ -z "$expire_days" ]; then
-      expire_days=7
-    fi
-    echo -n "Signing $expire_days day whitelist with masterkeycard... "
-  else
-    die "Neither masterkey nor masterkeycard is available to sign whitelist!"
-  fi
   echo `date -u "+%Y%m%d%H%M%S"` > ${whitelist}.unsigned
   echo "E`date -u --date="+$expire_days days" "+%Y%m%d%H%M%S"`" >> ${whitelist}.unsigned
   echo "N$name" >> ${whitelist}.unsigned
@@ -102,11 +86,22 @@ create_whitelist() {
   echo "--" >> ${whitelist}.unsigned
   echo $hash >> ${whitelist}.unsigned
   echo -n $hash > ${whitelist}.hash
-  if [ $usemasterkeycard -eq 1 ]; then
-    masterkeycard_sign ${whitelist}.hash ${whitelist}.signature
-  else
-    openssl rsautl -inkey $masterkey -sign -in ${whitelist}.hash -out ${whitelist}.signature
-  fi
+}
+
+
+# Assembles the whitelist from the output of prepare_whitelist and
+# ${temp_dir}/whitelist.$name.signature and uploads it (or rewrites the local
+# whitelist file)
+finish_whitelist() {
+  local name=$1
+  local user=$2
+  local spooler_definition=$3
+  local temp_dir=$4
+  local rewrite_path=$5
+
+  local whitelist
+  whitelist=${temp_dir}/whitelist.$name
+
   cat ${whitelist}.unsigned ${whitelist}.signature > $whitelist
   chown $user $whitelist
 
@@ -120,10 +115,86 @@ create_whitelist() {
     __swissknife upload -i $whitelist -o .cvmfswhitelist -r $spooler_definition
   fi
   rm -f $whitelist
+}
+
+
+create_whitelist() {
+  local name=$1
+  local user=$2
+  local spooler_definition=$3
+  local temp_dir=$4
+  local expire_days=$5
+  local rewrite_path=$6
+  local usemasterkeycard=0
+
+  local whitelist
+  whitelist=${temp_dir}/whitelist.$name
+
+  local masterkey=/etc/cvmfs/keys/${name}.masterkey
+  if cvmfs_sys_file_is_regular $masterkey; then
+    if [ -z "$expire_days" ]; then
+      expire_days=30
+    fi
+    echo -n "Signing $expire_days day whitelist with master key... "
+  elif masterkeycard_cert_available >/dev/null; then
+    usemasterkeycard=1
+    if [ -z "$expire_days" ]; then
+      expire_days=7
+    fi
+    echo -n "Signing $expire_days day whitelist with masterkeycard... "
+  else
+    die "Neither masterkey nor masterkeycard is available to sign whitelist!"
+  fi
+  prepare_whitelist $name $temp_dir "$expire_days" "$rewrite_path"
+  if [ $usemasterkeycard -eq 1 ]; then
+    masterkeycard_sign ${whitelist}.hash ${whitelist}.signature
+  else
+    openssl rsautl -inkey $masterkey -sign -in ${whitelist}.hash -out ${whitelist}.signature
+  fi
+  finish_whitelist $name $user "$spooler_definition" $temp_dir "$rewrite_path"
   echo "done"
 }
 
 
+# Re-signs the whitelists of several stratum 0 repositories that have their
+# master key on disk.  The hashes are signed in one go by a pool of threads.
+create_whitelists_batch() {
+  local names="$1"
+  local expire_days="${2:-30}"
+  local num_threads="$3"
+
+  local tmpdir
+  tmpdir="`mktemp -d`"
+  local job_list=${tmpdir}/jobs
+  > $job_list
+
+  local name
+  echo -n "Preparing $expire_days day whitelists... "
+  for name in $names; do
+    load_repo_config $name
+    prepare_whitelist $name $tmpdir "$expire_days" "" || { rm -rf $tmpdir; return 1; }
+    echo "/etc/cvmfs/keys/${name}.masterkey ${tmpdir}/whitelist.${name}.hash ${tmpdir}/whitelist.${name}.signature" >> $job_list
+  done
+  echo "done"
+
+  echo "Signing whitelists with master keys... "
+  local thread_arg=""
+  [ -z "$num_threads" ] || thread_arg="-n $num_threads"
+  if ! __swissknife sign_batch -l $job_list $thread_arg; then
+    rm -rf $tmpdir
+    return 1
+  fi
+
+  for name in $names; do
+    load_repo_config $name
+    echo -n "Uploading whitelist of $name... "
+    finish_whitelist $name $CVMFS_USER ${CVMFS_UPSTREAM_STORAGE} $tmpdir ""
+    echo "done"
+  done
+  rm -rf $tmpdir
+}
+
+
 import_keychain() {
   local name=$1
   local keys_location="$2"
@@ -1006,8 +1006,11 @@ Supported Commands:
   resign          [ -w path to existing whitelist ]
                   [ -d days until expiration (default 30) ]
                   [ -f don't ask again ]
+                  [ -j number of signing threads ]
                   <fully qualified name>
                   Re-sign the whitelist.
+                  Whitelists of several repositories with master keys
+                  on disk are signed in parallel.
                   Default expiration days goes down to 7 with masterkeycard.
   resign -p       <fully qualified name>
                   Re-sign .cvmfspublished
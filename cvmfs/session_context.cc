@@ -4,6 +4,8 @@
 
 #include "session_context.h"
 
+#include <inttypes.h>
+
 #include <algorithm>
 
 #include "curl/curl.h"
@@ -11,10 +13,18 @@
 #include "gateway_util.h"
 #include "json_document.h"
 #include "swissknife_lease_curl.h"
+#include "util/algorithm.h"
+#include "util/posix.h"
 #include "util/string.h"
 
 namespace upload {
 
+const unsigned SessionContextBase::kTargetUploadTimeMs;
+const uint64_t SessionContextBase::kMinPackSize;
+const unsigned SessionContextBase::kDefaultMaxPacksInFlight;
+const unsigned SessionContext::kMaxUploadRetries;
+const unsigned SessionContext::kRetryBaseDelayMs;
+
 size_t SendCB(void* ptr, size_t size, size_t nmemb, void* userp) {
   CurlSendPayload* payload = static_cast<CurlSendPayload*>(userp);
 
@@ -57,9 +67,10 @@ size_t RecvCB(void* buffer, size_t size, size_t nmemb, void* userp) {
     return 0;
   }
 
-  *my_buffer = static_cast<char*>(buffer);
+  // The buffer is not null-terminated and may hold a part of the reply only
+  my_buffer->append(static_cast<char*>(buffer), size * nmemb);
 
-  return my_buffer->size();
+  return size * nmemb;
 }
 
 SessionContextBase::SessionContextBase()
@@ -68,14 +79,18 @@ SessionContextBase::SessionContextBase()
       session_token_(),
       key_id_(),
       secret_(),
-      queue_was_flushed_(1, 1),
+      max_packs_in_flight_(1),
       max_pack_size_(ObjectPack::kDefaultLimit),
+      min_pack_size_(kMinPackSize),
+      pack_size_(kMinPackSize),
       active_handles_(),
       current_pack_(NULL),
       current_pack_mtx_(),
       objects_dispatched_(0),
       bytes_committed_(0),
-      bytes_dispatched_(0) {}
+      bytes_dispatched_(0),
+      results_collected_(0),
+      results_ok_(true) {}
 
 SessionContextBase::~SessionContextBase() {}
 
@@ -83,7 +98,8 @@ bool SessionContextBase::Initialize(const std::string& api_url,
                                     const std::string& session_token,
                                     const std::string& key_id,
                                     const std::string& secret,
-                                    uint64_t max_pack_size) {
+                                    uint64_t max_pack_size,
+                                    unsigned max_packs_in_flight) {
   bool ret = true;
 
   // Initialize session context lock
@@ -103,17 +119,19 @@ bool SessionContextBase::Initialize(const std::string& api_url,
   key_id_ = key_id;
   secret_ = secret;
   max_pack_size_ = max_pack_size;
+  min_pack_size_ = std::min(max_pack_size_, kMinPackSize);
+  atomic_write64(&pack_size_, min_pack_size_);
+  max_packs_in_flight_ = std::max(1U, max_packs_in_flight);
 
   atomic_init64(&objects_dispatched_);
   bytes_committed_ = 0u;
   bytes_dispatched_ = 0u;
+  results_collected_ = 0;
+  results_ok_ = true;
 
   // Ensure that the upload job and result queues are empty
   upload_results_.Drop();
 
-  queue_was_flushed_.Drop();
-  queue_was_flushed_.Enqueue(true);
-
   // Ensure that there are not open object packs
   if (current_pack_) {
     LogCvmfs(
@@ -134,21 +152,22 @@ bool SessionContextBase::Finalize(bool commit, const std::string& old_root_hash,
     MutexLockGuard lock(current_pack_mtx_);
 
     if (current_pack_ && current_pack_->GetNoObjects() > 0) {
-      Dispatch();
-      current_pack_ = NULL;
+      Dispatch(current_pack_);
+    } else {
+      delete current_pack_;
     }
+    current_pack_ = NULL;
   }
 
-  bool results = true;
-  int64_t jobs_finished = 0;
-  while (!upload_results_.IsEmpty() || (jobs_finished < NumJobsSubmitted())) {
-    Future<bool>* future = upload_results_.Dequeue();
-    results = future->Get() && results;
-    delete future;
-    jobs_finished++;
+  while (!upload_results_.IsEmpty() ||
+         (results_collected_ < NumJobsSubmitted())) {
+    CollectResult();
   }
+  bool results = results_ok_;
 
-  if (commit) {
+  // The results are collected in the order of dispatch; the session is only
+  // committed once all the packs have arrived at the gateway
+  if (commit && results) {
     if (old_root_hash.empty() || new_root_hash.empty()) {
       return false;
     }
@@ -162,15 +181,16 @@ bool SessionContextBase::Finalize(bool commit, const std::string& old_root_hash,
 }
 
 void SessionContextBase::WaitForUpload() {
-  if (!upload_results_.IsEmpty()) {
-    queue_was_flushed_.Dequeue();
+  MutexLockGuard lock(current_pack_mtx_);
+  while (!upload_results_.IsEmpty()) {
+    CollectResult();
   }
 }
 
 ObjectPack::BucketHandle SessionContextBase::NewBucket() {
   MutexLockGuard lock(current_pack_mtx_);
   if (!current_pack_) {
-    current_pack_ = new ObjectPack(max_pack_size_);
+    current_pack_ = new ObjectPack(pack_size());
   }
   ObjectPack::BucketHandle hd = current_pack_->NewBucket();
   active_handles_.push_back(hd);
@@ -191,6 +211,25 @@ bool SessionContextBase::CommitBucket(const ObjectPack::BucketContentType type,
     return false;
   }
 
+  const uint64_t pack_size_limit = pack_size();
+  if (handle->size >= pack_size_limit / 2) {
+    // Send large objects right away, independent of the current pack
+    ObjectPack* standalone_pack = new ObjectPack(handle->size);
+    current_pack_->TransferBucket(handle, standalone_pack);
+    const bool retval = standalone_pack->CommitBucket(type, id, handle, name);
+    assert(retval);
+    active_handles_.erase(
+        std::remove(active_handles_.begin(), active_handles_.end(), handle),
+        active_handles_.end());
+    bytes_committed_ += handle->size;
+    Dispatch(standalone_pack);
+    if (force_dispatch && (current_pack_->GetNoObjects() > 0)) {
+      Dispatch(current_pack_);
+      current_pack_ = NULL;
+    }
+    return true;
+  }
+
   uint64_t size0 = current_pack_->size();
   bool committed = current_pack_->CommitBucket(type, id, handle, name);
 
@@ -201,15 +240,15 @@ bool SessionContextBase::CommitBucket(const ObjectPack::BucketContentType type,
     uint64_t size1 = current_pack_->size();
     bytes_committed_ += size1 - size0;
     if (force_dispatch) {
-      Dispatch();
+      Dispatch(current_pack_);
       current_pack_ = NULL;
     }
   } else {  // Current pack is full and can be dispatched
     uint64_t new_size = 0;
-    if (handle->capacity > max_pack_size_) {
+    if (handle->capacity > pack_size_limit) {
       new_size = handle->capacity + 1;
     } else {
-      new_size = max_pack_size_;
+      new_size = pack_size_limit;
     }
     ObjectPack* new_pack = new ObjectPack(new_size);
     for (size_t i = 0u; i < active_handles_.size(); ++i) {
@@ -217,7 +256,7 @@ bool SessionContextBase::CommitBucket(const ObjectPack::BucketContentType type,
     }
 
     if (current_pack_->GetNoObjects() > 0) {
-      Dispatch();
+      Dispatch(current_pack_);
     }
     current_pack_ = new_pack;
 
@@ -231,41 +270,86 @@ int64_t SessionContextBase::NumJobsSubmitted() const {
   return atomic_read64(&objects_dispatched_);
 }
 
-void SessionContextBase::Dispatch() {
+/**
+ * The new pack size is between the current one and the one that would have
+ * taken kTargetUploadTimeMs to upload, which smoothes out the throughput
+ * measurements.  Does not take the pack lock, which is held while waiting for
+ * upload results.
+ */
+void SessionContextBase::AdaptPackSize(uint64_t bytes,
+                                       double upload_time_s) {
+  if (upload_time_s <= 0.0) {
+    upload_time_s = 1e-6;
+  }
+  const double target =
+      static_cast<double>(bytes) / upload_time_s * kTargetUploadTimeMs /
+      1000.0;
+  uint64_t target_size = max_pack_size_;
+  if (target < static_cast<double>(max_pack_size_)) {
+    target_size = std::max(min_pack_size_, static_cast<uint64_t>(target));
+  }
+
+  const uint64_t new_size = pack_size() / 2 + target_size / 2;
+  atomic_write64(&pack_size_,
+                 std::min(max_pack_size_, std::max(min_pack_size_, new_size)));
+}
+
+void SessionContextBase::Dispatch(ObjectPack* pack) {
   MutexLockGuard lock(current_pack_mtx_);
 
-  if (!current_pack_) {
+  if (!pack) {
     return;
   }
 
+  // Collect finished uploads first if the result queue is full.  This also
+  // limits the amount of memory held by packs that wait to be uploaded.
+  while (upload_results_.GetItemCount() >=
+         upload_results_.GetMaximalItemCount()) {
+    CollectResult();
+  }
+
   atomic_inc64(&objects_dispatched_);
-  bytes_dispatched_ += current_pack_->size();
-  upload_results_.Enqueue(DispatchObjectPack(current_pack_));
+  bytes_dispatched_ += pack->size();
+  upload_results_.Enqueue(DispatchObjectPack(pack));
+}
+
+void SessionContextBase::CollectResult() {
+  Future<bool>* future = upload_results_.Dequeue();
+  results_ok_ = future->Get() && results_ok_;
+  delete future;
+  results_collected_++;
 }
 
 SessionContext::SessionContext()
     : SessionContextBase(),
       upload_jobs_(1000, 900),
-      worker_terminate_(),
-      worker_() {}
+      workers_() {}
 
 bool SessionContext::InitializeDerived() {
-  // Start worker thread
-  atomic_init32(&worker_terminate_);
-  atomic_write32(&worker_terminate_, 0);
-
   upload_jobs_.Drop();
 
-  int retval =
-      pthread_create(&worker_, NULL, UploadLoop, reinterpret_cast<void*>(this));
+  // Start upload threads, one per pack in flight
+  workers_.resize(max_packs_in_flight_);
+  for (unsigned i = 0; i < workers_.size(); ++i) {
+    int retval = pthread_create(&workers_[i], NULL, UploadLoop,
+                                reinterpret_cast<void*>(this));
+    if (retval) {
+      workers_.resize(i);
+      return false;
+    }
+  }
 
-  return !retval;
+  return true;
 }
 
 bool SessionContext::FinalizeDerived() {
-  atomic_write32(&worker_terminate_, 1);
-
-  pthread_join(worker_, NULL);
+  for (unsigned i = 0; i < workers_.size(); ++i) {
+    upload_jobs_.Enqueue(NULL);
+  }
+  for (unsigned i = 0; i < workers_.size(); ++i) {
+    pthread_join(workers_[i], NULL);
+  }
+  workers_.clear();
 
   return true;
 }
@@ -288,11 +372,14 @@ Future<bool>* SessionContext::DispatchObjectPack(ObjectPack* pack) {
   UploadJob* job = new UploadJob;
   job->pack = pack;
   job->result = new Future<bool>();
+  // The job is deleted by the upload thread once it is done
+  Future<bool>* result = job->result;
   upload_jobs_.Enqueue(job);
-  return job->result;
+  return result;
 }
 
-bool SessionContext::DoUpload(const SessionContext::UploadJob* job) {
+bool SessionContext::DoUpload(const SessionContext::UploadJob* job,
+                              CURL* h_curl) {
   // Set up the object pack serializer
   ObjectPackProducer serializer(job->pack);
 
@@ -316,13 +403,6 @@ bool SessionContext::DoUpload(const SessionContext::UploadJob* job) {
   const size_t payload_size =
       json_msg.size() + serializer.GetHeaderSize() + job->pack->size();
 
-  // Prepare the Curl POST request
-  CURL* h_curl = curl_easy_init();
-
-  if (!h_curl) {
-    return false;
-  }
-
   // Set HTTP headers (Authorization and Message-Size)
   std::string header_str = std::string("Authorization: ") + key_id_ + " " +
                            Base64(hmac.ToString(false));
@@ -338,6 +418,7 @@ bool SessionContext::DoUpload(const SessionContext::UploadJob* job) {
   curl_easy_setopt(h_curl, CURLOPT_MAXREDIRS, 50L);
   curl_easy_setopt(h_curl, CURLOPT_CUSTOMREQUEST, "POST");
   curl_easy_setopt(h_curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(h_curl, CURLOPT_FORBID_REUSE, 0L);
   curl_easy_setopt(h_curl, CURLOPT_URL, (api_url_ + "/payloads").c_str());
   curl_easy_setopt(h_curl, CURLOPT_POSTFIELDS, NULL);
   curl_easy_setopt(h_curl, CURLOPT_POSTFIELDSIZE_LARGE,
@@ -350,10 +431,15 @@ bool SessionContext::DoUpload(const SessionContext::UploadJob* job) {
   // Perform the Curl POST request
   CURLcode ret = curl_easy_perform(h_curl);
 
-  const bool ok = (reply == "{\"status\":\"ok\"}");
+  curl_easy_setopt(h_curl, CURLOPT_HTTPHEADER, NULL);
+  curl_slist_free_all(auth_header);
 
-  curl_easy_cleanup(h_curl);
-  h_curl = NULL;
+  const bool ok = (reply == "{\"status\":\"ok\"}");
+  if (!ok || ret) {
+    LogCvmfs(kLogUploadGateway, kLogDebug,
+             "SessionContext: payload upload failed (%d - %s), reply: %s",
+             ret, curl_easy_strerror(ret), reply.c_str());
+  }
 
   return ok && !ret;
 }
@@ -361,30 +447,46 @@ bool SessionContext::DoUpload(const SessionContext::UploadJob* job) {
 void* SessionContext::UploadLoop(void* data) {
   SessionContext* ctx = reinterpret_cast<SessionContext*>(data);
 
-  int64_t jobs_processed = 0;
-  while (!ctx->ShouldTerminate()) {
-    while (jobs_processed < ctx->NumJobsSubmitted()) {
-      UploadJob* job = ctx->upload_jobs_.Dequeue();
-      if (!ctx->DoUpload(job)) {
-        LogCvmfs(kLogUploadGateway, kLogStderr,
-                 "SessionContext: could not submit payload. Aborting.");
-        abort();
-      }
-      job->result->Set(true);
+  // Reused for all the packs of this thread
+  CURL* h_curl = curl_easy_init();
+  assert(h_curl != NULL);
+
+  UploadJob* job;
+  while ((job = ctx->upload_jobs_.Dequeue()) != NULL) {
+    StopWatch timer;
+    timer.Start();
+    bool success = ctx->DoUpload(job, h_curl);
+    for (unsigned i = 0; !success && (i < kMaxUploadRetries); ++i) {
+      const unsigned delay_ms = kRetryBaseDelayMs << i;
+      LogCvmfs(kLogUploadGateway, kLogStderr,
+               "SessionContext: could not submit payload, retrying in %u ms",
+               delay_ms);
+      SafeSleepMs(delay_ms);
+      success = ctx->DoUpload(job, h_curl);
+    }
+    timer.Stop();
+    if (!success) {
+      LogCvmfs(kLogUploadGateway, kLogStderr,
+               "SessionContext: could not submit payload after %u retries",
+               kMaxUploadRetries);
+      job->result->Set(false);
       delete job->pack;
       delete job;
-      jobs_processed++;
-    }
-    if (ctx->queue_was_flushed_.IsEmpty()) {
-      ctx->queue_was_flushed_.Enqueue(true);
+      continue;
     }
+    ctx->AdaptPackSize(job->pack->size(), timer.GetTime());
+    LogCvmfs(kLogUploadGateway, kLogDebug,
+             "SessionContext: uploaded %" PRIu64 " bytes in %.3fs, "
+             "next pack size %" PRIu64,
+             job->pack->size(), timer.GetTime(), ctx->pack_size());
+
+    job->result->Set(true);
+    delete job->pack;
+    delete job;
   }
 
+  curl_easy_cleanup(h_curl);
   return NULL;
 }
 
-bool SessionContext::ShouldTerminate() {
-  return atomic_read32(&worker_terminate_);
-}
-
 }  // namespace upload
@@ -5,9 +5,12 @@
 #ifndef CVMFS_SESSION_CONTEXT_H_
 #define CVMFS_SESSION_CONTEXT_H_
 
+#include <pthread.h>
+
 #include <string>
 #include <vector>
 
+#include "curl/curl.h"
 #include "pack.h"
 #include "util_concurrency.h"
 
@@ -36,13 +39,35 @@ size_t RecvCB(void* buffer, size_t size, size_t nmemb, void* userp);
  */
 class SessionContextBase {
  public:
+  /**
+   * The pack size adapts to the measured upload throughput such that sending
+   * a pack takes about this long.  The request round trip is then small
+   * compared to the transfer and the packs are sent early enough to keep the
+   * connections busy.
+   */
+  static const unsigned kTargetUploadTimeMs = 5000;
+  /**
+   * Lower bound for the adaptive pack size, unless the maximum pack size
+   * is smaller.  Also the pack size of the first uploads.
+   */
+  static const uint64_t kMinPackSize = 4 * 1024 * 1024;
+  static const unsigned kDefaultMaxPacksInFlight = 4;
+
   SessionContextBase();
 
   virtual ~SessionContextBase();
 
+  /**
+   * Objects of at least half the current pack size are sent in packs of their
+   * own.  Smaller objects keep being collected in the current pack.
+   *
+   * @param max_pack_size       upper bound of the adaptive pack size
+   * @param max_packs_in_flight number of packs uploaded concurrently
+   */
   bool Initialize(const std::string& api_url, const std::string& session_token,
                   const std::string& key_id, const std::string& secret,
-                  uint64_t max_pack_size = ObjectPack::kDefaultLimit);
+                  uint64_t max_pack_size = ObjectPack::kDefaultLimit,
+                  unsigned max_packs_in_flight = 1);
   bool Finalize(bool commit, const std::string& old_root_hash,
                 const std::string& new_root_hash);
 
@@ -67,6 +92,13 @@ class SessionContextBase {
 
   int64_t NumJobsSubmitted() const;
 
+  /**
+   * Called by the upload threads when a pack is sent
+   */
+  void AdaptPackSize(uint64_t bytes, double upload_time_s);
+
+  uint64_t pack_size() const { return atomic_read64(&pack_size_); }
+
   FifoChannel<Future<bool>*> upload_results_;
 
   std::string api_url_;
@@ -74,12 +106,19 @@ class SessionContextBase {
   std::string key_id_;
   std::string secret_;
 
-  FifoChannel<bool> queue_was_flushed_;
+  unsigned max_packs_in_flight_;
 
  private:
-  void Dispatch();
+  void Dispatch(ObjectPack* pack);
+  void CollectResult();
 
   uint64_t max_pack_size_;
+  uint64_t min_pack_size_;
+  /**
+   * Limit of new object packs, between min_pack_size_ and max_pack_size_.
+   * Updated by the upload threads.
+   */
+  mutable atomic_int64 pack_size_;
 
   std::vector<ObjectPack::BucketHandle> active_handles_;
 
@@ -89,10 +128,22 @@ class SessionContextBase {
   mutable atomic_int64 objects_dispatched_;
   uint64_t bytes_committed_;
   uint64_t bytes_dispatched_;
+  /**
+   * Upload results that were taken from upload_results_
+   */
+  int64_t results_collected_;
+  bool results_ok_;
 };
 
 class SessionContext : public SessionContextBase {
  public:
+  /**
+   * A failed pack upload is repeated after an exponentially growing delay,
+   * starting at kRetryBaseDelayMs.  The other packs in flight continue.
+   */
+  static const unsigned kMaxUploadRetries = 3;
+  static const unsigned kRetryBaseDelayMs = 100;
+
   SessionContext();
 
  protected:
@@ -110,17 +161,21 @@ class SessionContext : public SessionContextBase {
 
   virtual Future<bool>* DispatchObjectPack(ObjectPack* pack);
 
-  virtual bool DoUpload(const UploadJob* job);
+  /**
+   * The curl handle belongs to the calling upload thread and is reused for
+   * all its packs, which keeps the connection to the gateway alive.
+   */
+  virtual bool DoUpload(const UploadJob* job, CURL* h_curl);
 
  private:
   static void* UploadLoop(void* data);
 
-  bool ShouldTerminate();
-
+  /**
+   * A NULL job terminates an upload thread
+   */
   FifoChannel<UploadJob*> upload_jobs_;
 
-  atomic_int32 worker_terminate_;
-  pthread_t worker_;
+  std::vector<pthread_t> workers_;
 };
 
 }  // namespace upload
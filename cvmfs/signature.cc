@@ -645,6 +645,43 @@ bool SignatureManager::Verify(const unsigned char *buffer,
 }
 
 
+/**
+ * Signs the buffer with the raw RSA private key, without a message digest.
+ * This is the counterpart of VerifyRsa() and yields the same signature as
+ * "openssl rsautl -sign", e.g. for the whitelist.
+ */
+bool SignatureManager::SignRsa(const unsigned char *buffer,
+                               const unsigned buffer_size,
+                               unsigned char **signature,
+                               unsigned *signature_size)
+{
+  *signature_size = 0;
+  *signature = NULL;
+  if (!private_key_)
+    return false;
+
+  RSA *rsa = EVP_PKEY_get1_RSA(private_key_);
+  if (rsa == NULL)
+    return false;
+  if (buffer_size > unsigned(RSA_size(rsa))) {
+    RSA_free(rsa);
+    return false;
+  }
+
+  *signature = reinterpret_cast<unsigned char *>(smalloc(RSA_size(rsa)));
+  int size = RSA_private_encrypt(buffer_size, buffer, *signature, rsa,
+                                 RSA_PKCS1_PADDING);
+  RSA_free(rsa);
+  if (size < 0) {
+    free(*signature);
+    *signature = NULL;
+    return false;
+  }
+  *signature_size = size;
+  return true;
+}
+
+
 /**
  * Veryfies a signature against all loaded public keys.
  *
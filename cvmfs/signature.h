@@ -54,6 +54,8 @@ class SignatureManager {
 
   bool Sign(const unsigned char *buffer, const unsigned buffer_size,
             unsigned char **signature, unsigned *signature_size);
+  bool SignRsa(const unsigned char *buffer, const unsigned buffer_size,
+               unsigned char **signature, unsigned *signature_size);
   bool Verify(const unsigned char *buffer, const unsigned buffer_size,
               const unsigned char *signature, unsigned signature_size);
   bool VerifyRsa(const unsigned char *buffer, const unsigned buffer_size,
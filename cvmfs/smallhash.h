@@ -14,15 +14,23 @@
 #include <pthread.h>
 #include <stdint.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include <algorithm>
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
 #include <new>
 
 #include "atomic.h"
 #include "murmur.h"
 #include "prng.h"
 #include "smalloc.h"
+#include "util/single_copy.h"
 
 /**
  * Hash table with linear probing as collision resolution.  Works only for
@@ -96,13 +104,17 @@ class SmallHashBase {
     uint32_t collisions;
     const bool found = DoLookup(key, &bucket, &collisions);
     if (found) {
+      // Values are reset so that they release the resources they hold
       keys_[bucket] = empty_key_;
+      values_[bucket] = Value();
       size_--;
       bucket = (bucket+1) % capacity_;
       while (!(keys_[bucket] == empty_key_)) {
         Key rehash = keys_[bucket];
+        Value value = values_[bucket];
         keys_[bucket] = empty_key_;
-        DoInsert(rehash, values_[bucket], false);
+        values_[bucket] = Value();
+        DoInsert(rehash, value, false);
         bucket = (bucket+1) % capacity_;
       }
       static_cast<Derived *>(this)->Shrink();  // No-op if fixed-size
@@ -110,6 +122,8 @@ class SmallHashBase {
   }
 
   void Clear() {
+    for (uint32_t i = 0; i < capacity_; ++i)
+      values_[i] = Value();
     DoClear(true);
   }
 
@@ -278,6 +292,27 @@ class SmallHashDynamic :
   uint32_t size() const { return Base::size_; }
   uint32_t num_migrates() const { return num_migrates_; }
 
+  /**
+   * Exchanges the content with other in constant time.  The hash functions
+   * stay with their objects.  A hot reload hands over its maps this way, the
+   * hash function of a map saved by the unloaded library is a dangling
+   * pointer.  Both hash functions must map keys to the same value.
+   */
+  void Swap(SmallHashDynamic<Key, Value> *other) {
+    std::swap(Base::keys_, other->keys_);
+    std::swap(Base::values_, other->values_);
+    std::swap(Base::capacity_, other->capacity_);
+    std::swap(Base::initial_capacity_, other->initial_capacity_);
+    std::swap(Base::size_, other->size_);
+    std::swap(Base::bytes_allocated_, other->bytes_allocated_);
+    std::swap(Base::num_collisions_, other->num_collisions_);
+    std::swap(Base::max_collisions_, other->max_collisions_);
+    std::swap(Base::empty_key_, other->empty_key_);
+    std::swap(num_migrates_, other->num_migrates_);
+    std::swap(threshold_grow_, other->threshold_grow_);
+    std::swap(threshold_shrink_, other->threshold_shrink_);
+  }
+
  protected:
   void SetThresholds() {
     threshold_grow_ =
@@ -355,14 +390,31 @@ class SmallHashDynamic :
     num_migrates_++;
   }
 
+  /**
+   * Replaces the content by the elements of other.  The capacity of other is
+   * allocated upfront, so the copy does not migrate several times while it
+   * grows.  With equal capacity, inserting in bucket order does not cluster
+   * the elements and it keeps the memory access sequential.
+   */
   void CopyFrom(const SmallHashDynamic<Key, Value> &other) {
-    uint32_t *shuffled_indices = ShuffleIndices(other.capacity_);
+    if (Base::hasher_ == NULL) {
+      // Copy constructor
+      Base::hasher_ = other.hasher_;
+      Base::initial_capacity_ = other.initial_capacity_;
+    } else {
+      Base::DeallocMemory(Base::keys_, Base::values_, Base::capacity_);
+    }
+    Base::empty_key_ = other.empty_key_;
+    Base::capacity_ = other.capacity_;
+    SetThresholds();
+    Base::AllocMemory();
+    Base::DoClear(false);
     for (uint32_t i = 0; i < other.capacity_; ++i) {
-      if (other.keys_[shuffled_indices[i]] != other.empty_key_)
-        this->Insert(other.keys_[shuffled_indices[i]],
-                     other.values_[shuffled_indices[i]]);
+      if (other.keys_[i] != other.empty_key_) {
+        Base::DoInsert(other.keys_[i], other.values_[i], true);
+        Base::size_++;
+      }
     }
-    smunmap(shuffled_indices);
   }
 
   uint32_t num_migrates_;
@@ -372,6 +424,322 @@ class SmallHashDynamic :
 };
 
 
+/**
+ * Open addressing hash table in the style of Swiss tables.  Every slot has a
+ * control byte that marks it as empty, deleted, or full; full slots store 7
+ * bits of the key's hash in the control byte.  The slots are grouped by 16.
+ * A lookup compares the control bytes of an entire group at once (SSE2 or
+ * NEON if available) and only compares the keys of the slots whose hash bits
+ * match.  Thus misses usually only touch the control bytes of a single group,
+ * and hits usually touch those and the matching key.  The groups are probed
+ * quadratically and the capacity is a power of 2.
+ *
+ * The interface is the same as the one of SmallHashDynamic.  Like for the other
+ * tables, the slots that are not full contain the empty key so that the keys
+ * and values can be iterated over directly.  The hasher must distribute the
+ * keys over all 32 bits: the upper bits select the group, the lower 7 bits go
+ * into the control byte.
+ */
+template<class Key, class Value>
+class SmallHashGrouped : SingleCopy {
+  FRIEND_TEST(T_Smallhash, GroupedTombstones);
+
+ public:
+  static const unsigned kGroupSize = 16;
+  /**
+   * The table grows if more than 7/8 of the slots are full or deleted.  It
+   * shrinks if less than 1/8 of the slots are full.
+   */
+  static const unsigned kMaxLoadNumerator = 7;
+  static const unsigned kLoadDenominator = 8;
+
+  SmallHashGrouped()
+    : ctrl_(NULL)
+    , keys_(NULL)
+    , values_(NULL)
+    , capacity_(0)
+    , initial_capacity_(0)
+    , size_(0)
+    , num_deleted_(0)
+    , hasher_(NULL)
+    , bytes_allocated_(0)
+    , num_collisions_(0)
+    , max_collisions_(0)
+    , num_migrates_(0)
+  { }
+
+  ~SmallHashGrouped() {
+    DeallocMemory(ctrl_, keys_, values_, capacity_);
+  }
+
+  void Init(uint32_t expected_size, Key empty,
+            uint32_t (*hasher)(const Key &key))
+  {
+    hasher_ = hasher;
+    empty_key_ = empty;
+    capacity_ = kGroupSize;
+    while (capacity_ / kLoadDenominator * kMaxLoadNumerator < expected_size)
+      capacity_ *= 2;
+    initial_capacity_ = capacity_;
+    AllocMemory();
+  }
+
+  bool Lookup(const Key &key, Value *value) const {
+    uint32_t slot;
+    uint32_t collisions;
+    const bool found = DoLookup(key, &slot, &collisions);
+    if (found)
+      *value = values_[slot];
+    return found;
+  }
+
+  bool Contains(const Key &key) const {
+    uint32_t slot;
+    uint32_t collisions;
+    return DoLookup(key, &slot, &collisions);
+  }
+
+  void Insert(const Key &key, const Value &value) {
+    if ((size_ + num_deleted_ + 1) >
+        capacity_ / kLoadDenominator * kMaxLoadNumerator)
+    {
+      // Cleaning up the deleted slots might be sufficient
+      if ((size_ + 1) > capacity_ / kLoadDenominator * kMaxLoadNumerator / 2)
+        Migrate(capacity_ * 2);
+      else
+        Migrate(capacity_);
+    }
+    DoInsert(key, value);
+  }
+
+  void Erase(const Key &key) {
+    uint32_t slot;
+    uint32_t collisions;
+    if (!DoLookup(key, &slot, &collisions))
+      return;
+    // No probe sequence continues beyond a group with an empty slot, so the
+    // slot can be marked empty instead of deleted
+    const uint8_t *group = ctrl_ + (slot & ~(kGroupSize - 1));
+    if (MatchEmpty(group) != 0) {
+      ctrl_[slot] = kCtrlEmpty;
+    } else {
+      ctrl_[slot] = kCtrlDeleted;
+      num_deleted_++;
+    }
+    keys_[slot] = empty_key_;
+    values_[slot] = Value();
+    size_--;
+    if ((size_ < capacity_ / kLoadDenominator) &&
+        (capacity_ / 2 >= initial_capacity_))
+    {
+      Migrate(capacity_ / 2);
+    }
+  }
+
+  void Clear() {
+    DeallocMemory(ctrl_, keys_, values_, capacity_);
+    capacity_ = initial_capacity_;
+    AllocMemory();
+  }
+
+  uint64_t bytes_allocated() const { return bytes_allocated_; }
+
+  void GetCollisionStats(uint64_t *num_collisions,
+                         uint32_t *max_collisions) const
+  {
+    *num_collisions = num_collisions_;
+    *max_collisions = max_collisions_;
+  }
+
+  uint32_t capacity() const { return capacity_; }
+  uint32_t size() const { return size_; }
+  uint32_t num_migrates() const { return num_migrates_; }
+  Key empty_key() const { return empty_key_; }
+  Key *keys() const { return keys_; }
+  Value *values() const { return values_; }
+
+ private:
+  static const uint8_t kCtrlEmpty = 0x80;
+  static const uint8_t kCtrlDeleted = 0xfe;
+
+  // Bit masks of the matching slots of a group.  With NEON, there are 4 bits
+  // per slot of which only the highest one is set.
+#if defined(__SSE2__)
+  static const unsigned kMaskShift = 0;
+
+  static inline uint64_t MatchByte(const uint8_t *group, const uint8_t byte) {
+    // smmap'd memory is only 8 byte aligned on 32bit platforms
+    const __m128i ctrl =
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+    return _mm_movemask_epi8(
+      _mm_cmpeq_epi8(ctrl, _mm_set1_epi8(static_cast<char>(byte))));
+  }
+#elif defined(__ARM_NEON)
+  static const unsigned kMaskShift = 2;
+
+  static inline uint64_t MatchByte(const uint8_t *group, const uint8_t byte) {
+    const uint8x16_t eq = vceqq_u8(vld1q_u8(group), vdupq_n_u8(byte));
+    const uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0) &
+           0x8888888888888888ULL;
+  }
+#else
+  static const unsigned kMaskShift = 0;
+
+  static inline uint64_t MatchByte(const uint8_t *group, const uint8_t byte) {
+    uint64_t mask = 0;
+    for (unsigned i = 0; i < kGroupSize; ++i)
+      mask |= static_cast<uint64_t>(group[i] == byte) << i;
+    return mask;
+  }
+#endif
+
+  static inline uint64_t MatchEmpty(const uint8_t *group) {
+    return MatchByte(group, kCtrlEmpty);
+  }
+
+  static inline unsigned LowestSlot(const uint64_t mask) {
+    return __builtin_ctzll(mask) >> kMaskShift;
+  }
+
+  /**
+   * Triangular numbers visit every group if the number of groups is a power
+   * of 2.
+   */
+  inline uint32_t ProbeGroup(const uint32_t hash, const uint32_t probe) const {
+    const uint32_t num_groups = capacity_ / kGroupSize;
+    const uint32_t first =
+      (static_cast<uint64_t>(hash) * num_groups) >> 32;
+    return ((first + probe * (probe + 1) / 2) & (num_groups - 1)) * kGroupSize;
+  }
+
+  void AllocMemory() {
+    ctrl_ = static_cast<uint8_t *>(smmap(capacity_));
+    memset(ctrl_, kCtrlEmpty, capacity_);
+    keys_ = static_cast<Key *>(smmap(capacity_ * sizeof(Key)));
+    values_ = static_cast<Value *>(smmap(capacity_ * sizeof(Value)));
+    for (uint32_t i = 0; i < capacity_; ++i)
+      new (keys_ + i) Key(empty_key_);
+    for (uint32_t i = 0; i < capacity_; ++i)
+      new (values_ + i) Value();
+    size_ = 0;
+    num_deleted_ = 0;
+    bytes_allocated_ = (1 + sizeof(Key) + sizeof(Value)) * capacity_;
+  }
+
+  void DeallocMemory(uint8_t *c, Key *k, Value *v, uint32_t capacity) {
+    if (c == NULL)
+      return;
+    for (uint32_t i = 0; i < capacity; ++i)
+      k[i].~Key();
+    for (uint32_t i = 0; i < capacity; ++i)
+      v[i].~Value();
+    smunmap(c);
+    smunmap(k);
+    smunmap(v);
+  }
+
+  void Migrate(const uint32_t new_capacity) {
+    uint8_t *old_ctrl = ctrl_;
+    Key *old_keys = keys_;
+    Value *old_values = values_;
+    const uint32_t old_capacity = capacity_;
+
+    capacity_ = new_capacity;
+    AllocMemory();
+    for (uint32_t i = 0; i < old_capacity; ++i) {
+      // The keys are unique, no need to look them up
+      if (!(old_ctrl[i] & kCtrlEmpty))
+        DoInsertNew(old_keys[i], hasher_(old_keys[i]), old_values[i]);
+    }
+
+    DeallocMemory(old_ctrl, old_keys, old_values, old_capacity);
+    num_migrates_++;
+  }
+
+  /**
+   * The collisions are the number of groups probed in addition to the first
+   * one.
+   */
+  bool DoLookup(const Key &key, uint32_t *slot, uint32_t *collisions) const {
+    return DoLookup(key, hasher_(key), slot, collisions);
+  }
+
+  bool DoLookup(const Key &key, const uint32_t hash,
+                uint32_t *slot, uint32_t *collisions) const
+  {
+    const uint8_t hash_bits = hash & 0x7f;
+    for (uint32_t probe = 0; ; ++probe) {
+      const uint32_t group = ProbeGroup(hash, probe);
+      uint64_t mask = MatchByte(ctrl_ + group, hash_bits);
+      while (mask != 0) {
+        const uint32_t candidate = group + LowestSlot(mask);
+        if (keys_[candidate] == key) {
+          *slot = candidate;
+          *collisions = probe;
+          return true;
+        }
+        mask &= mask - 1;
+      }
+      if (MatchEmpty(ctrl_ + group) != 0) {
+        *collisions = probe;
+        return false;
+      }
+    }
+  }
+
+  /**
+   * The first empty or deleted slot on the probe sequence of the hash
+   */
+  uint32_t FindFreeSlot(const uint32_t hash) const {
+    for (uint32_t probe = 0; ; ++probe) {
+      const uint32_t group = ProbeGroup(hash, probe);
+      const uint64_t mask =
+        MatchEmpty(ctrl_ + group) | MatchByte(ctrl_ + group, kCtrlDeleted);
+      if (mask != 0)
+        return group + LowestSlot(mask);
+    }
+  }
+
+  void DoInsert(const Key &key, const Value &value) {
+    const uint32_t hash = hasher_(key);
+    uint32_t slot;
+    uint32_t collisions;
+    const bool overwritten = DoLookup(key, hash, &slot, &collisions);
+    num_collisions_ += collisions;
+    max_collisions_ = std::max(collisions, max_collisions_);
+    if (overwritten)
+      values_[slot] = value;
+    else
+      DoInsertNew(key, hash, value);
+  }
+
+  void DoInsertNew(const Key &key, const uint32_t hash, const Value &value) {
+    const uint32_t slot = FindFreeSlot(hash);
+    if (ctrl_[slot] == kCtrlDeleted)
+      num_deleted_--;
+    ctrl_[slot] = hash & 0x7f;
+    keys_[slot] = key;
+    values_[slot] = value;
+    size_++;
+  }
+
+  uint8_t *ctrl_;
+  Key *keys_;
+  Value *values_;
+  uint32_t capacity_;
+  uint32_t initial_capacity_;
+  uint32_t size_;
+  uint32_t num_deleted_;
+  uint32_t (*hasher_)(const Key &key);
+  uint64_t bytes_allocated_;
+  uint64_t num_collisions_;
+  uint32_t max_collisions_;
+  uint32_t num_migrates_;
+  Key empty_key_;
+};
+
+
 /**
  * Distributes the key-value pairs over $n$ dynamic hash maps with individual
  * mutexes.  Hence low mutex contention, and benefits from multiple processors.
@@ -18,6 +18,42 @@
 
 using namespace std;  // NOLINT
 
+const uint64_t SqliteMemoryManager::kDefaultPageCacheBudget;
+
+
+/**
+ * Header of a page.  It is followed by the page buffer and the extra bytes
+ * in the same memory block.
+ */
+struct SqliteMemoryManager::CachePage {
+  sqlite3_pcache_page base;
+  PageCache *cache;
+  unsigned key;
+  bool pinned;
+  CachePage *hash_next;
+  CachePage *lru_prev;
+  CachePage *lru_next;
+};
+
+
+/**
+ * The sqlite3_pcache handle of a database connection.  Pages are hashed by
+ * their page number.
+ */
+struct SqliteMemoryManager::PageCache {
+  PageCache(unsigned p, unsigned e, bool g)
+    : sz_page(p), sz_extra(e)
+    , sz_block(RoundUp8(sizeof(CachePage)) + RoundUp8(p) + RoundUp8(e))
+    , purgeable(g), num_pages(0), buckets(16, NULL)
+  { }
+  unsigned sz_page;
+  unsigned sz_extra;
+  unsigned sz_block;
+  bool purgeable;
+  unsigned num_pages;
+  std::vector<CachePage *> buckets;
+};
+
 
 void *SqliteMemoryManager::LookasideBufferArena::GetBuffer() {
   for (unsigned i = 0; i < kNoBitmaps; ++i) {
@@ -133,6 +169,338 @@ void SqliteMemoryManager::xShutdown(void *app_data __attribute__((unused))) {
 }
 
 
+//------------------------------------------------------------------------------
+
+
+int SqliteMemoryManager::xPcacheInit(void *app_data __attribute__((unused))) {
+  return SQLITE_OK;
+}
+
+
+void SqliteMemoryManager::xPcacheShutdown(
+  void *app_data __attribute__((unused)))
+{
+}
+
+
+sqlite3_pcache *SqliteMemoryManager::xPcacheCreate(
+  int sz_page,
+  int sz_extra,
+  int purgeable)
+{
+  PageCache *cache = new PageCache(sz_page, sz_extra, purgeable != 0);
+  MutexLockGuard lock_guard(instance_->pcache_lock_);
+  instance_->pcache_stats_.num_caches++;
+  return reinterpret_cast<sqlite3_pcache *>(cache);
+}
+
+
+/**
+ * The per-connection cache size is ignored in favor of the shared budget.
+ */
+void SqliteMemoryManager::xPcacheCachesize(
+  sqlite3_pcache *pcache __attribute__((unused)),
+  int nmax __attribute__((unused)))
+{
+}
+
+
+int SqliteMemoryManager::xPcachePagecount(sqlite3_pcache *pcache) {
+  MutexLockGuard lock_guard(instance_->pcache_lock_);
+  return reinterpret_cast<PageCache *>(pcache)->num_pages;
+}
+
+
+/**
+ * New pages are allocated regardless of create_flag 1 or 2.  If the budget is
+ * exhausted, the least recently used unpinned page of any database is
+ * recycled.  If all pages are pinned, the budget is exceeded temporarily.
+ */
+sqlite3_pcache_page *SqliteMemoryManager::xPcacheFetch(
+  sqlite3_pcache *pcache,
+  unsigned key,
+  int create_flag)
+{
+  PageCache *cache = reinterpret_cast<PageCache *>(pcache);
+  MutexLockGuard lock_guard(instance_->pcache_lock_);
+
+  CachePage *page = instance_->LookupPage(cache, key);
+  if (page != NULL) {
+    instance_->pcache_stats_.n_hit++;
+    if (!page->pinned) {
+      if (cache->purgeable)
+        instance_->UnlinkLru(page);
+      page->pinned = true;
+    }
+    return &page->base;
+  }
+  instance_->pcache_stats_.n_miss++;
+  if (create_flag == 0)
+    return NULL;
+
+  page = instance_->RecyclePage(cache->sz_block);
+  if (page == NULL) {
+    page = reinterpret_cast<CachePage *>(sqlite3_malloc(cache->sz_block));
+    if (page == NULL)
+      return NULL;
+    PageCacheStatistics *stats = &instance_->pcache_stats_;
+    stats->bytes_used += cache->sz_block;
+    if (stats->bytes_used > stats->bytes_max)
+      stats->bytes_max = stats->bytes_used;
+    stats->num_pages++;
+  }
+  page->base.pBuf = reinterpret_cast<char *>(page) +
+                    RoundUp8(sizeof(CachePage));
+  page->base.pExtra = reinterpret_cast<char *>(page->base.pBuf) +
+                      RoundUp8(cache->sz_page);
+  // Sqlite expects the extra bytes of a new page to be zeroed
+  memset(page->base.pExtra, 0, cache->sz_extra);
+  page->cache = cache;
+  page->key = key;
+  page->pinned = true;
+  page->lru_prev = page->lru_next = NULL;
+  instance_->InsertPage(cache, page);
+  return &page->base;
+}
+
+
+void SqliteMemoryManager::xPcacheUnpin(
+  sqlite3_pcache *pcache,
+  sqlite3_pcache_page *page,
+  int discard)
+{
+  PageCache *cache = reinterpret_cast<PageCache *>(pcache);
+  CachePage *cache_page = reinterpret_cast<CachePage *>(page);
+  MutexLockGuard lock_guard(instance_->pcache_lock_);
+  assert(cache_page->pinned);
+
+  if (discard) {
+    instance_->FreePage(cache_page);
+    return;
+  }
+  cache_page->pinned = false;
+  if (!cache->purgeable)
+    return;
+  instance_->LinkLru(cache_page);
+  // Enforces a reduced budget
+  while ((instance_->pcache_stats_.bytes_used >
+          instance_->pcache_stats_.budget) &&
+         (instance_->lru_tail_ != NULL))
+  {
+    instance_->FreePage(instance_->lru_tail_);
+    instance_->pcache_stats_.n_evict++;
+  }
+}
+
+
+/**
+ * A page that already exists under the new key is guaranteed to be unpinned.
+ */
+void SqliteMemoryManager::xPcacheRekey(
+  sqlite3_pcache *pcache,
+  sqlite3_pcache_page *page,
+  unsigned old_key,
+  unsigned new_key)
+{
+  PageCache *cache = reinterpret_cast<PageCache *>(pcache);
+  CachePage *cache_page = reinterpret_cast<CachePage *>(page);
+  MutexLockGuard lock_guard(instance_->pcache_lock_);
+  assert(cache_page->key == old_key);
+
+  CachePage *existing = instance_->LookupPage(cache, new_key);
+  if (existing != NULL)
+    instance_->FreePage(existing);
+  instance_->RemovePage(cache_page);
+  cache_page->key = new_key;
+  instance_->InsertPage(cache, cache_page);
+}
+
+
+/**
+ * Discards all pages with a key equal or larger than limit, pinned or not.
+ */
+void SqliteMemoryManager::xPcacheTruncate(
+  sqlite3_pcache *pcache,
+  unsigned limit)
+{
+  PageCache *cache = reinterpret_cast<PageCache *>(pcache);
+  MutexLockGuard lock_guard(instance_->pcache_lock_);
+  for (unsigned i = 0; i < cache->buckets.size(); ++i) {
+    CachePage *page = cache->buckets[i];
+    while (page != NULL) {
+      CachePage *next = page->hash_next;
+      if (page->key >= limit)
+        instance_->FreePage(page);
+      page = next;
+    }
+  }
+}
+
+
+void SqliteMemoryManager::xPcacheDestroy(sqlite3_pcache *pcache) {
+  PageCache *cache = reinterpret_cast<PageCache *>(pcache);
+  {
+    MutexLockGuard lock_guard(instance_->pcache_lock_);
+    for (unsigned i = 0; i < cache->buckets.size(); ++i) {
+      while (cache->buckets[i] != NULL)
+        instance_->FreePage(cache->buckets[i]);
+    }
+    instance_->pcache_stats_.num_caches--;
+  }
+  delete cache;
+}
+
+
+void SqliteMemoryManager::xPcacheShrink(sqlite3_pcache *pcache) {
+  PageCache *cache = reinterpret_cast<PageCache *>(pcache);
+  MutexLockGuard lock_guard(instance_->pcache_lock_);
+  for (unsigned i = 0; i < cache->buckets.size(); ++i) {
+    CachePage *page = cache->buckets[i];
+    while (page != NULL) {
+      CachePage *next = page->hash_next;
+      if (!page->pinned)
+        instance_->FreePage(page);
+      page = next;
+    }
+  }
+}
+
+
+SqliteMemoryManager::CachePage *SqliteMemoryManager::LookupPage(
+  PageCache *cache,
+  unsigned key)
+{
+  CachePage *page = cache->buckets[key & (cache->buckets.size() - 1)];
+  while ((page != NULL) && (page->key != key))
+    page = page->hash_next;
+  return page;
+}
+
+
+/**
+ * Keeps the load factor of the hash table below 1.
+ */
+void SqliteMemoryManager::InsertPage(PageCache *cache, CachePage *page) {
+  if (cache->num_pages >= cache->buckets.size()) {
+    std::vector<CachePage *> buckets(2 * cache->buckets.size(), NULL);
+    for (unsigned i = 0; i < cache->buckets.size(); ++i) {
+      CachePage *p = cache->buckets[i];
+      while (p != NULL) {
+        CachePage *next = p->hash_next;
+        const unsigned idx = p->key & (buckets.size() - 1);
+        p->hash_next = buckets[idx];
+        buckets[idx] = p;
+        p = next;
+      }
+    }
+    cache->buckets.swap(buckets);
+  }
+  const unsigned idx = page->key & (cache->buckets.size() - 1);
+  page->hash_next = cache->buckets[idx];
+  cache->buckets[idx] = page;
+  cache->num_pages++;
+}
+
+
+void SqliteMemoryManager::RemovePage(CachePage *page) {
+  PageCache *cache = page->cache;
+  CachePage **p = &cache->buckets[page->key & (cache->buckets.size() - 1)];
+  while (*p != page)
+    p = &((*p)->hash_next);
+  *p = page->hash_next;
+  page->hash_next = NULL;
+  cache->num_pages--;
+}
+
+
+void SqliteMemoryManager::FreePage(CachePage *page) {
+  if (!page->pinned && page->cache->purgeable)
+    UnlinkLru(page);
+  RemovePage(page);
+  pcache_stats_.bytes_used -= page->cache->sz_block;
+  pcache_stats_.num_pages--;
+  sqlite3_free(page);
+}
+
+
+void SqliteMemoryManager::LinkLru(CachePage *page) {
+  page->lru_prev = NULL;
+  page->lru_next = lru_head_;
+  if (lru_head_ != NULL)
+    lru_head_->lru_prev = page;
+  lru_head_ = page;
+  if (lru_tail_ == NULL)
+    lru_tail_ = page;
+}
+
+
+void SqliteMemoryManager::UnlinkLru(CachePage *page) {
+  if (page->lru_prev != NULL)
+    page->lru_prev->lru_next = page->lru_next;
+  else
+    lru_head_ = page->lru_next;
+  if (page->lru_next != NULL)
+    page->lru_next->lru_prev = page->lru_prev;
+  else
+    lru_tail_ = page->lru_prev;
+  page->lru_prev = page->lru_next = NULL;
+}
+
+
+/**
+ * Evicts unpinned pages until a new block fits in the budget.  An evicted
+ * page of the requested size is reused right away.  Returns NULL if a new
+ * block needs to be allocated.
+ */
+SqliteMemoryManager::CachePage *SqliteMemoryManager::RecyclePage(
+  const unsigned sz_block)
+{
+  while ((pcache_stats_.bytes_used + sz_block > pcache_stats_.budget) &&
+         (lru_tail_ != NULL))
+  {
+    CachePage *victim = lru_tail_;
+    pcache_stats_.n_evict++;
+    if (victim->cache->sz_block == sz_block) {
+      UnlinkLru(victim);
+      RemovePage(victim);
+      return victim;
+    }
+    FreePage(victim);
+  }
+  return NULL;
+}
+
+
+void SqliteMemoryManager::SetPageCacheBudget(const uint64_t budget) {
+  MutexLockGuard lock_guard(pcache_lock_);
+  pcache_stats_.budget = budget;
+}
+
+
+SqliteMemoryManager::PageCacheStatistics
+SqliteMemoryManager::GetPageCacheStatistics()
+{
+  MutexLockGuard lock_guard(pcache_lock_);
+  return pcache_stats_;
+}
+
+
+/**
+ * The memory mapped for the malloc arenas, the lookaside buffers, and the
+ * scratch space.  The sqlite page cache is allocated from the malloc arenas.
+ */
+uint64_t SqliteMemoryManager::GetMappedBytes() {
+  MutexLockGuard lock_guard(lock_);
+  return static_cast<uint64_t>(malloc_arenas_.size()) * kArenaSize +
+         static_cast<uint64_t>(lookaside_buffer_arenas_.size()) *
+           LookasideBufferArena::kArenaSize +
+         kScratchSize;
+}
+
+
+//------------------------------------------------------------------------------
+
+
 void SqliteMemoryManager::AssignGlobalArenas() {
   if (assigned_) return;
   int retval;
@@ -141,8 +509,9 @@ void SqliteMemoryManager::AssignGlobalArenas() {
                           kScratchSlotSize, kScratchNoSlots);
   assert(retval == SQLITE_OK);
 
-  retval = sqlite3_config(SQLITE_CONFIG_PAGECACHE, page_cache_memory_,
-                          kPageCacheSlotSize, kPageCacheNoSlots);
+  retval = sqlite3_config(SQLITE_CONFIG_GETPCACHE2, &sqlite3_pcache_vanilla_);
+  assert(retval == SQLITE_OK);
+  retval = sqlite3_config(SQLITE_CONFIG_PCACHE2, &pcache_methods_);
   assert(retval == SQLITE_OK);
 
   retval = sqlite3_config(SQLITE_CONFIG_GETMALLOC, &sqlite3_mem_vanilla_);
@@ -229,12 +598,17 @@ void *SqliteMemoryManager::GetMemory(int size) {
 SqliteMemoryManager::SqliteMemoryManager()
   : assigned_(false)
   , scratch_memory_(sxmmap(kScratchSize))
-  , page_cache_memory_(sxmmap(kPageCacheSize))
   , idx_last_arena_(0)
+  , lru_head_(NULL)
+  , lru_tail_(NULL)
 {
   memset(&sqlite3_mem_vanilla_, 0, sizeof(sqlite3_mem_vanilla_));
+  memset(&sqlite3_pcache_vanilla_, 0, sizeof(sqlite3_pcache_vanilla_));
   int retval = pthread_mutex_init(&lock_, NULL);
   assert(retval == 0);
+  retval = pthread_mutex_init(&pcache_lock_, NULL);
+  assert(retval == 0);
+  pcache_stats_.budget = kDefaultPageCacheBudget;
 
   lookaside_buffer_arenas_.push_back(new LookasideBufferArena());
   malloc_arenas_.push_back(new MallocArena(kArenaSize));
@@ -248,6 +622,21 @@ SqliteMemoryManager::SqliteMemoryManager()
   mem_methods_.xInit = xInit;
   mem_methods_.xShutdown = xShutdown;
   mem_methods_.pAppData = NULL;
+
+  memset(&pcache_methods_, 0, sizeof(pcache_methods_));
+  pcache_methods_.iVersion = 1;
+  pcache_methods_.pArg = NULL;
+  pcache_methods_.xInit = xPcacheInit;
+  pcache_methods_.xShutdown = xPcacheShutdown;
+  pcache_methods_.xCreate = xPcacheCreate;
+  pcache_methods_.xCachesize = xPcacheCachesize;
+  pcache_methods_.xPagecount = xPcachePagecount;
+  pcache_methods_.xFetch = xPcacheFetch;
+  pcache_methods_.xUnpin = xPcacheUnpin;
+  pcache_methods_.xRekey = xPcacheRekey;
+  pcache_methods_.xTruncate = xPcacheTruncate;
+  pcache_methods_.xDestroy = xPcacheDestroy;
+  pcache_methods_.xShrink = xPcacheShrink;
 }
 
 
@@ -260,19 +649,19 @@ SqliteMemoryManager::~SqliteMemoryManager() {
     int retval;
     retval = sqlite3_config(SQLITE_CONFIG_SCRATCH, NULL, 0, 0);
     assert(retval == SQLITE_OK);
-    retval = sqlite3_config(SQLITE_CONFIG_PAGECACHE, NULL, 0, 0);
+    retval = sqlite3_config(SQLITE_CONFIG_PCACHE2, &sqlite3_pcache_vanilla_);
     assert(retval == SQLITE_OK);
     retval = sqlite3_config(SQLITE_CONFIG_MALLOC, &sqlite3_mem_vanilla_);
     assert(retval == SQLITE_OK);
   }
 
   sxunmap(scratch_memory_, kScratchSize);
-  sxunmap(page_cache_memory_, kPageCacheSize);
   for (unsigned i = 0; i < lookaside_buffer_arenas_.size(); ++i)
     delete lookaside_buffer_arenas_[i];
   for (unsigned i = 0; i < malloc_arenas_.size(); ++i)
     delete malloc_arenas_[i];
   pthread_mutex_destroy(&lock_);
+  pthread_mutex_destroy(&pcache_lock_);
 }
 
 
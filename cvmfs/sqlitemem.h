@@ -21,10 +21,11 @@ class MallocArena;
 
 /**
  * The MemoryManager uses the sqlite hooks to optimize memory allocations.  It
- * is tuned for reading the cvmfs file catalogs.  It provides a page cache of
- * a few MB, a small scratch space and per-database lookaside buffers.  It also
- * contains a "general purpose" malloc/free implementation tailored to the
- * behavior of sqlite memory allocation.
+ * is tuned for reading the cvmfs file catalogs.  It provides a page cache
+ * that is shared by all database connections, a small scratch space and
+ * per-database lookaside buffers.  It also contains a "general purpose"
+ * malloc/free implementation tailored to the behavior of sqlite memory
+ * allocation.
  *
  * It is implemented as a singleton.  GetInstance() will reserve memory blocks,
  * AssignGlobalArenas will set the global sqlite configuration and
@@ -58,17 +59,11 @@ class SqliteMemoryManager {
   static const unsigned kScratchSize = kScratchSlotSize * kScratchNoSlots;
 
   /**
-   * Empricially, the largest page cache allocation is 1296B.
+   * Node-wide limit for the pages of all purgeable (i.e. file backed)
+   * databases.  Without the shared budget, every open catalog would keep up
+   * to 2MB of pages on its own.
    */
-  static const unsigned kPageCacheSlotSize = 1300;
-  /**
-   * Number of pages that can be cached.
-   */
-  static const unsigned kPageCacheNoSlots = 4000;
-  /**
-   * In total: ~5MB
-   */
-  static const unsigned kPageCacheSize = kPageCacheSlotSize * kPageCacheNoSlots;
+  static const uint64_t kDefaultPageCacheBudget = 16 * 1024 * 1024;
 
   /**
    * 32 bytes per slot is an empirically good value so that memory is not wasted
@@ -132,6 +127,25 @@ class SqliteMemoryManager {
   };
 
 
+  /**
+   * Unpinned pages of all databases are kept in a common LRU list.  Pages are
+   * recycled from the tail of the list once the page cache budget is reached.
+   */
+  struct PageCacheStatistics {
+    PageCacheStatistics()
+      : num_caches(0), num_pages(0), bytes_used(0), bytes_max(0)
+      , budget(0), n_hit(0), n_miss(0), n_evict(0)
+    { }
+    unsigned num_caches;
+    uint64_t num_pages;
+    uint64_t bytes_used;
+    uint64_t bytes_max;
+    uint64_t budget;
+    uint64_t n_hit;
+    uint64_t n_miss;
+    uint64_t n_evict;
+  };
+
   static SqliteMemoryManager *GetInstance() {
     if (instance_ == NULL)
       instance_ = new SqliteMemoryManager();
@@ -145,7 +159,15 @@ class SqliteMemoryManager {
   void *AssignLookasideBuffer(sqlite3 *db);
   void ReleaseLookasideBuffer(void *buffer);
 
+  void SetPageCacheBudget(const uint64_t budget);
+  PageCacheStatistics GetPageCacheStatistics();
+  uint64_t GetMappedBytes();
+
  private:
+  FRIEND_TEST(T_Sqlitemem, PageCache);
+  struct CachePage;
+  struct PageCache;
+
   /**
    * Should be larger than 10 times the largest allocation, which for reading
    * sqlite file catalogs is 64kB.  An arena size of 8MB limits the total
@@ -167,6 +189,25 @@ class SqliteMemoryManager {
   static int xInit(void *app_data);
   static void xShutdown(void *app_data);
 
+  /**
+   * Page cache callbacks, see https://www.sqlite.org/c3ref/pcache_methods2.html
+   */
+  static int xPcacheInit(void *app_data);
+  static void xPcacheShutdown(void *app_data);
+  static sqlite3_pcache *xPcacheCreate(int sz_page, int sz_extra,
+                                       int purgeable);
+  static void xPcacheCachesize(sqlite3_pcache *pcache, int nmax);
+  static int xPcachePagecount(sqlite3_pcache *pcache);
+  static sqlite3_pcache_page *xPcacheFetch(sqlite3_pcache *pcache,
+                                           unsigned key, int create_flag);
+  static void xPcacheUnpin(sqlite3_pcache *pcache, sqlite3_pcache_page *page,
+                           int discard);
+  static void xPcacheRekey(sqlite3_pcache *pcache, sqlite3_pcache_page *page,
+                           unsigned old_key, unsigned new_key);
+  static void xPcacheTruncate(sqlite3_pcache *pcache, unsigned limit);
+  static void xPcacheDestroy(sqlite3_pcache *pcache);
+  static void xPcacheShrink(sqlite3_pcache *pcache);
+
 
   SqliteMemoryManager();
 
@@ -177,6 +218,15 @@ class SqliteMemoryManager {
   void PutMemory(void *ptr);
   int GetMemorySize(void *ptr);
 
+  // The following methods require the pcache_lock_
+  CachePage *LookupPage(PageCache *cache, unsigned key);
+  void InsertPage(PageCache *cache, CachePage *page);
+  void RemovePage(CachePage *page);
+  void FreePage(CachePage *page);
+  void LinkLru(CachePage *page);
+  void UnlinkLru(CachePage *page);
+  CachePage *RecyclePage(const unsigned sz_block);
+
   pthread_mutex_t lock_;
 
   /**
@@ -192,14 +242,31 @@ class SqliteMemoryManager {
   struct sqlite3_mem_methods sqlite3_mem_vanilla_;
 
   struct sqlite3_mem_methods mem_methods_;
+  /**
+   * The default page cache implementation, restored on destruction.
+   */
+  struct sqlite3_pcache_methods2 sqlite3_pcache_vanilla_;
+  struct sqlite3_pcache_methods2 pcache_methods_;
   void *scratch_memory_;
-  void *page_cache_memory_;
   std::vector<LookasideBufferArena *> lookaside_buffer_arenas_;
   std::vector<MallocArena *> malloc_arenas_;
   /**
    * Where the last successful allocation took place.
    */
   unsigned idx_last_arena_;
+
+  /**
+   * Protects the page cache bookkeeping, which is shared among all database
+   * connections.
+   */
+  pthread_mutex_t pcache_lock_;
+  /**
+   * Most recently unpinned page.  Only unpinned pages of purgeable caches
+   * are in the LRU list.
+   */
+  CachePage *lru_head_;
+  CachePage *lru_tail_;
+  PageCacheStatistics pcache_stats_;
 };  // class SqliteMemoryManager
 
 #endif  // CVMFS_SQLITEMEM_H_
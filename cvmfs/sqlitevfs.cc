@@ -16,17 +16,23 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #include <sys/select.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
 #include <climits>
 #include <cstring>
 #include <ctime>
+#include <map>
+#include <utility>
 
 #include "cache.h"
 #include "duplex_sqlite3.h"
@@ -35,6 +41,7 @@
 #include "smalloc.h"
 #include "statistics.h"
 #include "util/string.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
@@ -44,14 +51,37 @@ namespace {
 
 const char *kVfsName = "cvmfs-readonly";
 
+/**
+ * Identifies a catalog file of the POSIX cache manager.  Catalogs with the
+ * same content hash are the same file in the cache directory.
+ */
+typedef std::pair<dev_t, ino_t> FileId;
+
+/**
+ * A memory mapped catalog that is used by all the open sqlite files on the
+ * same cache file.
+ */
+struct SharedMapping {
+  SharedMapping() : mapping(NULL), size(0), refcnt(0) { }
+  unsigned char *mapping;
+  uint64_t size;
+  unsigned refcnt;
+};
+
 /**
  * The private user data attached to the sqlite_vfs object.
  */
 struct VfsRdOnly {
   VfsRdOnly()
     : cache_mgr(NULL)
+    , use_mmap(false)
+    , mem_threshold(0)
     , n_access(NULL)
     , no_open(NULL)
+    , no_mmap(NULL)
+    , no_mem(NULL)
+    , sz_mem(NULL)
+    , n_mmap_shared(NULL)
     , n_rand(NULL)
     , sz_rand(NULL)
     , n_read(NULL)
@@ -59,10 +89,32 @@ struct VfsRdOnly {
     , n_sleep(NULL)
     , sz_sleep(NULL)
     , n_time(NULL)
-  { }
+  {
+    int retval = pthread_mutex_init(&lock_mappings, NULL);
+    assert(retval == 0);
+  }
+  ~VfsRdOnly() { pthread_mutex_destroy(&lock_mappings); }
   CacheManager *cache_mgr;
+  bool use_mmap;
+  /**
+   * Catalogs up to this size are read into memory on open and the cache
+   * manager's file descriptor is closed right away.  Zero disables it.
+   */
+  uint64_t mem_threshold;
+  /**
+   * Several catalog managers of the same process can open the same catalog,
+   * e.g. the active and the preloading one during a remount.  They share the
+   * mapping.  Across processes, the kernel shares the pages of the cache file
+   * anyway.
+   */
+  std::map<FileId, SharedMapping> mappings;
+  pthread_mutex_t lock_mappings;
   perf::Counter *n_access;
   perf::Counter *no_open;
+  perf::Counter *no_mmap;
+  perf::Counter *no_mem;
+  perf::Counter *sz_mem;
+  perf::Counter *n_mmap_shared;
   perf::Counter *n_rand;
   perf::Counter *sz_rand;
   perf::Counter *n_read;
@@ -80,13 +132,111 @@ struct VfsRdOnlyFile {
   VfsRdOnly *vfs_rdonly;
   int fd;
   uint64_t size;
+  /**
+   * Only set for files of the POSIX cache manager if memory mapping is
+   * enabled.  The catalogs are always fully present in the cache.
+   */
+  unsigned char *mapping;
+  /**
+   * Set instead of the file descriptor if the catalog is kept in memory.
+   */
+  unsigned char *buffer;
+  /**
+   * Key of the mapping in VfsRdOnly::mappings
+   */
+  FileId file_id;
 };
 
 }  // anonymous namespace
 
 
+/**
+ * Returns the mapping of the file behind fd, creating it if the file is not
+ * yet mapped by another open sqlite file.  Returns NULL if mapping fails.
+ */
+static unsigned char *AcquireMapping(VfsRdOnlyFile *p) {
+  VfsRdOnly *vfs_rdonly = p->vfs_rdonly;
+  platform_stat64 info;
+  if (platform_fstat(p->fd, &info) != 0)
+    return NULL;
+  p->file_id = FileId(info.st_dev, info.st_ino);
+
+  MutexLockGuard lock_guard(&vfs_rdonly->lock_mappings);
+  SharedMapping *shared = &vfs_rdonly->mappings[p->file_id];
+  if (shared->mapping != NULL) {
+    // Catalogs are immutable, the same file cannot change its size
+    assert(shared->size == p->size);
+    shared->refcnt++;
+    perf::Inc(vfs_rdonly->n_mmap_shared);
+    return shared->mapping;
+  }
+
+  void *mapping = mmap(NULL, p->size, PROT_READ, MAP_SHARED, p->fd, 0);
+  if (mapping == MAP_FAILED) {
+    LogCvmfs(kLogSql, kLogDebug, "failed to map fd %d (%d)", p->fd, errno);
+    vfs_rdonly->mappings.erase(p->file_id);
+    return NULL;
+  }
+  madvise(mapping, p->size, MADV_WILLNEED);
+  shared->mapping = static_cast<unsigned char *>(mapping);
+  shared->size = p->size;
+  shared->refcnt = 1;
+  return shared->mapping;
+}
+
+
+static void ReleaseMapping(VfsRdOnlyFile *p) {
+  VfsRdOnly *vfs_rdonly = p->vfs_rdonly;
+  MutexLockGuard lock_guard(&vfs_rdonly->lock_mappings);
+  std::map<FileId, SharedMapping>::iterator iter =
+    vfs_rdonly->mappings.find(p->file_id);
+  assert(iter != vfs_rdonly->mappings.end());
+  assert(iter->second.mapping == p->mapping);
+  if (--iter->second.refcnt == 0) {
+    munmap(iter->second.mapping, iter->second.size);
+    vfs_rdonly->mappings.erase(iter);
+  }
+}
+
+
+/**
+ * Copies the entire catalog behind fd into a malloc'd buffer.  Returns NULL if
+ * the file cannot be read completely.
+ */
+static unsigned char *ReadToMemory(
+  CacheManager *cache_mgr,
+  const int fd,
+  const uint64_t size)
+{
+  unsigned char *buffer = static_cast<unsigned char *>(smalloc(size));
+  uint64_t pos = 0;
+  while (pos < size) {
+    int64_t nbytes = cache_mgr->Pread(fd, buffer + pos, size - pos, pos);
+    if (nbytes <= 0) {
+      LogCvmfs(kLogSql, kLogDebug, "failed to read fd %d into memory (%" PRId64
+               ")", fd, nbytes);
+      free(buffer);
+      return NULL;
+    }
+    pos += nbytes;
+  }
+  return buffer;
+}
+
+
 static int VfsRdOnlyClose(sqlite3_file *pFile) {
   VfsRdOnlyFile *p = reinterpret_cast<VfsRdOnlyFile *>(pFile);
+  if (p->buffer != NULL) {
+    free(p->buffer);
+    perf::Dec(p->vfs_rdonly->no_mem);
+    perf::Xadd(p->vfs_rdonly->sz_mem, -static_cast<int64_t>(p->size));
+    perf::Dec(p->vfs_rdonly->no_open);
+    return SQLITE_OK;
+  }
+  if (p->mapping != NULL) {
+    ReleaseMapping(p);
+    perf::Dec(p->vfs_rdonly->no_mmap);
+  }
   int retval = p->vfs_rdonly->cache_mgr->Close(p->fd);
   if (retval == 0) {
     perf::Dec(p->vfs_rdonly->no_open);
@@ -107,7 +257,17 @@ static int VfsRdOnlyRead(
   sqlite_int64 iOfst
 ) {
   VfsRdOnlyFile *p = reinterpret_cast<VfsRdOnlyFile *>(pFile);
-  ssize_t got = p->vfs_rdonly->cache_mgr->Pread(p->fd, zBuf, iAmt, iOfst);
+  ssize_t got;
+  if (p->buffer != NULL) {
+    got = 0;
+    if (static_cast<uint64_t>(iOfst) < p->size) {
+      got = std::min(static_cast<uint64_t>(iAmt),
+                     p->size - static_cast<uint64_t>(iOfst));
+      memcpy(zBuf, p->buffer + iOfst, got);
+    }
+  } else {
+    got = p->vfs_rdonly->cache_mgr->Pread(p->fd, zBuf, iAmt, iOfst);
+  }
   perf::Inc(p->vfs_rdonly->n_read);
   if (got == iAmt) {
     perf::Xadd(p->vfs_rdonly->sz_read, iAmt);
@@ -210,6 +370,42 @@ static int VfsRdOnlyDeviceCharacteristics(
 }
 
 
+/**
+ * Hands out pages directly from the memory mapped file or from the in-memory
+ * copy so that sqlite does not need to copy them into its page cache.
+ * Otherwise, sqlite falls back to VfsRdOnlyRead.
+ */
+static int VfsRdOnlyFetch(
+  sqlite3_file *pFile,
+  sqlite3_int64 iOfst,
+  int iAmt,
+  void **pp)
+{
+  VfsRdOnlyFile *p = reinterpret_cast<VfsRdOnlyFile *>(pFile);
+  unsigned char *base = (p->buffer != NULL) ? p->buffer : p->mapping;
+  if ((base != NULL) && (iOfst >= 0) &&
+      (static_cast<uint64_t>(iOfst + iAmt) <= p->size))
+  {
+    *pp = base + iOfst;
+  } else {
+    *pp = NULL;
+  }
+  return SQLITE_OK;
+}
+
+
+/**
+ * The mapping stays in place until the file is closed.
+ */
+static int VfsRdOnlyUnfetch(
+  sqlite3_file *pFile __attribute__((unused)),
+  sqlite3_int64 iOfst __attribute__((unused)),
+  void *p __attribute__((unused)))
+{
+  return SQLITE_OK;
+}
+
+
 /**
  * Supports only read-only opens.  The "file name" has to be in the form of
  * '@<file descriptor>', where file descriptor is usable by the cache manager.
@@ -236,12 +432,35 @@ static int VfsRdOnlyOpen(
     VfsRdOnlySectorSize,
     VfsRdOnlyDeviceCharacteristics
   };
+  static const sqlite3_io_methods io_methods_mmap = {
+    3,  // iVersion
+    VfsRdOnlyClose,
+    VfsRdOnlyRead,
+    VfsRdOnlyWrite,
+    VfsRdOnlyTruncate,
+    VfsRdOnlySync,
+    VfsRdOnlyFileSize,
+    VfsRdOnlyLock,
+    VfsRdOnlyUnlock,
+    VfsRdOnlyCheckReservedLock,
+    VfsRdOnlyFileControl,
+    VfsRdOnlySectorSize,
+    VfsRdOnlyDeviceCharacteristics,
+    NULL,  // xShmMap
+    NULL,  // xShmLock
+    NULL,  // xShmBarrier
+    NULL,  // xShmUnmap
+    VfsRdOnlyFetch,
+    VfsRdOnlyUnfetch
+  };
 
   VfsRdOnlyFile *p = reinterpret_cast<VfsRdOnlyFile *>(pFile);
-  CacheManager *cache_mgr =
-    reinterpret_cast<VfsRdOnly *>(vfs->pAppData)->cache_mgr;
+  VfsRdOnly *vfs_rdonly = reinterpret_cast<VfsRdOnly *>(vfs->pAppData);
+  CacheManager *cache_mgr = vfs_rdonly->cache_mgr;
   // Prevent xClose from being called in case of errors
   p->base.pMethods = NULL;
+  p->mapping = NULL;
+  p->buffer = NULL;
 
   if (flags & SQLITE_OPEN_READWRITE)
     return SQLITE_IOERR;
@@ -260,19 +479,48 @@ static int VfsRdOnlyOpen(
     p->fd = -1;
     return SQLITE_IOERR_FSTAT;
   }
-  if (cache_mgr->Readahead(p->fd) != 0) {
+  p->size = static_cast<uint64_t>(size);
+  if ((size > 0) && (p->size <= vfs_rdonly->mem_threshold)) {
+    p->buffer = ReadToMemory(cache_mgr, p->fd, p->size);
+    if (p->buffer == NULL) {
+      cache_mgr->Close(p->fd);
+      p->fd = -1;
+      return SQLITE_IOERR_READ;
+    }
+    cache_mgr->Close(p->fd);
+    p->fd = -1;
+  } else if (vfs_rdonly->use_mmap && (size > 0) &&
+      (cache_mgr->id() == kPosixCacheManager))
+  {
+    // File descriptors of the POSIX cache manager are system file descriptors
+    p->vfs_rdonly = vfs_rdonly;
+    p->mapping = AcquireMapping(p);
+  }
+  if ((p->buffer == NULL) && (p->mapping == NULL) &&
+      (cache_mgr->Readahead(p->fd) != 0))
+  {
     cache_mgr->Close(p->fd);
     p->fd = -1;
     return SQLITE_IOERR;
   }
-  p->size = static_cast<uint64_t>(size);
   if (pOutFlags)
     *pOutFlags = flags;
-  p->vfs_rdonly = reinterpret_cast<VfsRdOnly *>(vfs->pAppData);
-  p->base.pMethods = &io_methods;
+  p->vfs_rdonly = vfs_rdonly;
+  if (p->buffer != NULL) {
+    p->base.pMethods = &io_methods_mmap;
+    perf::Inc(p->vfs_rdonly->no_mem);
+    perf::Xadd(p->vfs_rdonly->sz_mem, p->size);
+  } else if (p->mapping != NULL) {
+    p->base.pMethods = &io_methods_mmap;
+    perf::Inc(p->vfs_rdonly->no_mmap);
+  } else {
+    p->base.pMethods = &io_methods;
+  }
   perf::Inc(p->vfs_rdonly->no_open);
-  LogCvmfs(kLogSql, kLogDebug, "open sqlite3 catalog on fd %d, size %" PRIu64,
-           p->fd, p->size);
+  LogCvmfs(kLogSql, kLogDebug, "open sqlite3 catalog %s, size %" PRIu64
+           "%s", zName, p->size,
+           (p->buffer != NULL) ? " (in memory)" :
+             ((p->mapping != NULL) ? " (mapped)" : ""));
   return SQLITE_OK;
 }
 
@@ -435,12 +683,16 @@ static int VfsRdOnlyGetLastError(
 
 
 /**
- * Can only be registered once.
+ * Can only be registered once.  With kVfsOptMmap, sqlite must be configured
+ * for memory mapped I/O (SQLITE_CONFIG_MMAP_SIZE), otherwise the mappings
+ * are not used.  Catalogs up to mem_threshold bytes are kept in memory, which
+ * takes precedence over memory mapping.
  */
 bool RegisterVfsRdOnly(
   CacheManager *cache_mgr,
   perf::Statistics *statistics,
-  const VfsOptions options)
+  const int options,
+  const uint64_t mem_threshold)
 {
   sqlite3_vfs *vfs = reinterpret_cast<sqlite3_vfs *>(
     smalloc(sizeof(sqlite3_vfs)));
@@ -467,7 +719,7 @@ bool RegisterVfsRdOnly(
   vfs->xCurrentTimeInt64 = VfsRdOnlyCurrentTimeInt64;
   assert(vfs->zName);
 
-  int retval = sqlite3_vfs_register(vfs, options == kVfsOptDefault);
+  int retval = sqlite3_vfs_register(vfs, (options & kVfsOptDefault) != 0);
   if (retval != SQLITE_OK) {
     free(const_cast<char *>(vfs->zName));
     delete vfs_rdonly;
@@ -476,10 +728,21 @@ bool RegisterVfsRdOnly(
   }
 
   vfs_rdonly->cache_mgr = cache_mgr;
+  vfs_rdonly->use_mmap = (options & kVfsOptMmap) != 0;
+  vfs_rdonly->mem_threshold = mem_threshold;
   vfs_rdonly->n_access =
     statistics->Register("sqlite.n_access", "overall number of access() calls");
   vfs_rdonly->no_open =
     statistics->Register("sqlite.no_open", "currently open sqlite files");
+  vfs_rdonly->no_mmap =
+    statistics->Register("sqlite.no_mmap", "currently mapped sqlite files");
+  vfs_rdonly->no_mem =
+    statistics->Register("sqlite.no_mem", "currently in-memory sqlite files");
+  vfs_rdonly->sz_mem =
+    statistics->Register("sqlite.sz_mem", "bytes of in-memory sqlite files");
+  vfs_rdonly->n_mmap_shared =
+    statistics->Register("sqlite.n_mmap_shared",
+                         "overall number of opens using an existing mapping");
   vfs_rdonly->n_rand =
     statistics->Register("sqlite.n_rand", "overall number of random() calls");
   vfs_rdonly->sz_rand =
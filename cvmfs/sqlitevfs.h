@@ -5,6 +5,8 @@
 #ifndef CVMFS_SQLITEVFS_H_
 #define CVMFS_SQLITEVFS_H_
 
+#include <stdint.h>
+
 #include <string>
 
 class CacheManager;
@@ -14,14 +16,19 @@ class Statistics;
 
 namespace sqlite {
 
+/**
+ * Can be combined.
+ */
 enum VfsOptions {
   kVfsOptNone = 0,
-  kVfsOptDefault,  // the VFS becomes the default for new database connections.
+  kVfsOptDefault = 0x01,  // the VFS becomes the default for new connections.
+  kVfsOptMmap = 0x02,  // memory map files of the POSIX cache manager.
 };
 
 bool RegisterVfsRdOnly(CacheManager *cache_mgr,
                        perf::Statistics *statistics,
-                       const VfsOptions options);
+                       const int options,
+                       const uint64_t mem_threshold);
 bool UnregisterVfsRdOnly();
 
 }  // namespace sqlite
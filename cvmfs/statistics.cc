@@ -4,11 +4,21 @@
 
 #include "statistics.h"
 
+#include <poll.h>
+#include <unistd.h>
+
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
 
+#include "logging.h"
 #include "platform.h"
 #include "smalloc.h"
+#include "util/posix.h"
 #include "util/string.h"
 #include "util_concurrency.h"
 
@@ -20,6 +30,57 @@ namespace CVMFS_NAMESPACE_GUARD {
 
 namespace perf {
 
+Counter::Counter(const Counter &other) : shards_(NULL) {
+  atomic_init64(&counter_);
+  atomic_write64(&counter_, const_cast<Counter &>(other).Get());
+}
+
+
+Counter &Counter::operator=(const Counter &other) {
+  if (&other != this)
+    Set(const_cast<Counter &>(other).Get());
+  return *this;
+}
+
+
+Counter::~Counter() {
+  free(shards_);
+}
+
+
+int64_t Counter::GetSharded() {
+  int64_t result = atomic_read64(&counter_);
+  for (unsigned i = 0; i < kNumShards; ++i)
+    result += atomic_read64(&shards_[i].value);
+  return result;
+}
+
+
+void Counter::MakeSharded() {
+  assert(shards_ == NULL);
+  void *area;
+  int retval = posix_memalign(&area, kCacheLineSize,
+                              kNumShards * sizeof(Shard));
+  assert(retval == 0);
+  Shard *shards = reinterpret_cast<Shard *>(area);
+  for (unsigned i = 0; i < kNumShards; ++i)
+    atomic_init64(&shards[i].value);
+  shards_ = shards;
+}
+
+
+/**
+ * Not atomic for sharded counters with respect to concurrent changes.
+ */
+void Counter::Set(const int64_t val) {
+  if (shards_ != NULL) {
+    for (unsigned i = 0; i < kNumShards; ++i)
+      atomic_write64(&shards_[i].value, 0);
+  }
+  atomic_write64(&counter_, val);
+}
+
+
 std::string Counter::ToString() { return StringifyInt(Get()); }
 std::string Counter::Print() { return StringifyInt(Get()); }
 std::string Counter::PrintK() { return StringifyInt(Get() / 1000); }
@@ -36,9 +97,97 @@ std::string Counter::PrintRatio(Counter divider) {
 //-----------------------------------------------------------------------------
 
 
+Histogram::Histogram() {
+  for (unsigned i = 0; i < kNumBins; ++i)
+    atomic_init64(&bins_[i]);
+}
+
+
+unsigned Histogram::GetBin(const uint64_t value) {
+  if (value < kSubBuckets)
+    return value;
+  const unsigned exponent = 63 - __builtin_clzll(value);
+  const unsigned shift = exponent - kSubBucketBits;
+  const unsigned sub_bucket = (value >> shift) & (kSubBuckets - 1);
+  return (shift + 1) * kSubBuckets + sub_bucket;
+}
+
+
+uint64_t Histogram::GetBinUpperBound(const unsigned bin) {
+  if (bin < kSubBuckets)
+    return bin;
+  const unsigned shift = bin / kSubBuckets - 1;
+  const uint64_t sub_bucket = bin % kSubBuckets;
+  const uint64_t lower_bound = (kSubBuckets + sub_bucket) << shift;
+  return lower_bound + ((uint64_t(1) << shift) - 1);
+}
+
+
+uint64_t Histogram::GetCount() const {
+  uint64_t result = 0;
+  for (unsigned i = 0; i < kNumBins; ++i)
+    result += atomic_read64(&bins_[i]);
+  return result;
+}
+
+
+uint64_t Histogram::GetQuantile(const double q) const {
+  uint64_t counts[kNumBins];
+  uint64_t total = 0;
+  for (unsigned i = 0; i < kNumBins; ++i) {
+    counts[i] = atomic_read64(&bins_[i]);
+    total += counts[i];
+  }
+  if (total == 0)
+    return 0;
+
+  uint64_t rank = static_cast<uint64_t>(q * total + 0.5);
+  rank = std::max(rank, uint64_t(1));
+  rank = std::min(rank, total);
+  uint64_t seen = 0;
+  for (unsigned i = 0; i < kNumBins; ++i) {
+    seen += counts[i];
+    if (seen >= rank)
+      return GetBinUpperBound(i);
+  }
+  return GetBinUpperBound(kNumBins - 1);
+}
+
+
+/**
+ * Not atomic with respect to concurrent Add() calls.
+ */
+void Histogram::Reset() {
+  for (unsigned i = 0; i < kNumBins; ++i)
+    atomic_write64(&bins_[i], 0);
+}
+
+
+string Histogram::ToString() const {
+  return StringifyInt(GetCount()) + "|" +
+         StringifyInt(GetQuantile(0.5)) + "|" +
+         StringifyInt(GetQuantile(0.99)) + "|" +
+         StringifyInt(GetQuantile(0.999));
+}
+
+
+HistogramTimer::HistogramTimer(Histogram *histogram)
+  : histogram_(histogram)
+  , start_ns_(platform_monotonic_time_ns())
+{ }
+
+
+HistogramTimer::~HistogramTimer() {
+  histogram_->Add((platform_monotonic_time_ns() - start_ns_) / 1000);
+}
+
+
+//-----------------------------------------------------------------------------
+
+
 /**
- * Creates a new Statistics binder which maintains the same Counters as the
- * existing one.  Changes to those counters are visible in both Statistics
+ * Creates a new Statistics binder which maintains the same Counters and
+ * Histograms as the existing one.  Changes to those counters are visible in both Statistics
  * objects.  The child can then independently add more counters.  CounterInfo
  * objects are reference counted and deleted when all the statistics objects
  * dealing with it are destroyed.
@@ -53,6 +202,12 @@ Statistics *Statistics::Fork() {
     atomic_inc32(&i->second->refcnt);
   }
   child->counters_ = counters_;
+  for (map<string, HistogramInfo *>::iterator i = histograms_.begin(),
+       iEnd = histograms_.end(); i != iEnd; ++i)
+  {
+    atomic_inc32(&i->second->refcnt);
+  }
+  child->histograms_ = histograms_;
 
   return child;
 }
@@ -101,6 +256,138 @@ Counter *Statistics::Register(const string &name, const string &desc) {
 }
 
 
+Histogram *Statistics::RegisterHistogram(
+  const string &name,
+  const string &desc)
+{
+  MutexLockGuard lock_guard(lock_);
+  assert(histograms_.find(name) == histograms_.end());
+  HistogramInfo *histogram_info = new HistogramInfo(desc);
+  histograms_[name] = histogram_info;
+  return &histogram_info->histogram;
+}
+
+
+Histogram *Statistics::LookupHistogram(const string &name) {
+  MutexLockGuard lock_guard(lock_);
+  map<string, HistogramInfo *>::const_iterator i = histograms_.find(name);
+  if (i != histograms_.end())
+    return &i->second->histogram;
+  return NULL;
+}
+
+
+string Statistics::PrintHistograms(const PrintOptions print_options) {
+  string result;
+  if (print_options == kPrintHeader)
+    result += "Name|Count|P50|P99|P999|Description\n";
+
+  MutexLockGuard lock_guard(lock_);
+  for (map<string, HistogramInfo *>::const_iterator i = histograms_.begin(),
+       iEnd = histograms_.end(); i != iEnd; ++i)
+  {
+    result += i->first + "|" + i->second->histogram.ToString() +
+              "|" + i->second->desc + "\n";
+  }
+  return result;
+}
+
+
+/**
+ * OpenMetrics names may only contain [a-zA-Z0-9_:] and must not start with a
+ * digit.
+ */
+static string SanitizeMetricName(const string &name) {
+  string result = name;
+  for (unsigned i = 0; i < result.length(); ++i) {
+    const char c = result[i];
+    if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) ||
+        ((c >= '0') && (c <= '9') && (i > 0)) || (c == '_') || (c == ':'))
+    {
+      continue;
+    }
+    result[i] = '_';
+  }
+  return result;
+}
+
+
+static string EscapeMetricHelp(const string &help) {
+  string result;
+  for (unsigned i = 0; i < help.length(); ++i) {
+    if (help[i] == '\\')
+      result += "\\\\";
+    else if (help[i] == '\n')
+      result += "\\n";
+    else
+      result.push_back(help[i]);
+  }
+  return result;
+}
+
+
+/**
+ * Only the lists of counters and histograms are copied under the lock.  The
+ * values are read and formatted without holding it.  That is safe because
+ * counters and histograms are never unregistered, so the pointers remain valid
+ * for the lifetime of the Statistics object.
+ */
+string Statistics::PrintOpenMetrics(const string &prefix, const string &labels)
+{
+  vector<pair<string, CounterInfo *> > counters;
+  vector<pair<string, HistogramInfo *> > histograms;
+  {
+    MutexLockGuard lock_guard(lock_);
+    counters.assign(counters_.begin(), counters_.end());
+    histograms.assign(histograms_.begin(), histograms_.end());
+  }
+
+  const string label_set = labels.empty() ? "" : ("{" + labels + "}");
+  const string label_prefix = labels.empty() ? "{" : ("{" + labels + ",");
+  string result;
+  for (unsigned i = 0; i < counters.size(); ++i) {
+    const string name = SanitizeMetricName(prefix + counters[i].first);
+    result += "# TYPE " + name + " unknown\n";
+    if (!counters[i].second->desc.empty()) {
+      result += "# HELP " + name + " " +
+                EscapeMetricHelp(counters[i].second->desc) + "\n";
+    }
+    result += name + label_set + " " +
+              StringifyInt(counters[i].second->counter.Get()) + "\n";
+  }
+  for (unsigned i = 0; i < histograms.size(); ++i) {
+    const string name = SanitizeMetricName(prefix + histograms[i].first);
+    const Histogram &histogram = histograms[i].second->histogram;
+    result += "# TYPE " + name + " summary\n";
+    if (!histograms[i].second->desc.empty()) {
+      result += "# HELP " + name + " " +
+                EscapeMetricHelp(histograms[i].second->desc) + "\n";
+    }
+    result += name + label_prefix + "quantile=\"0.5\"} " +
+              StringifyInt(histogram.GetQuantile(0.5)) + "\n";
+    result += name + label_prefix + "quantile=\"0.99\"} " +
+              StringifyInt(histogram.GetQuantile(0.99)) + "\n";
+    result += name + label_prefix + "quantile=\"0.999\"} " +
+              StringifyInt(histogram.GetQuantile(0.999)) + "\n";
+    result += name + "_count" + label_set + " " +
+              StringifyInt(histogram.GetCount()) + "\n";
+  }
+  result += "# EOF\n";
+  return result;
+}
+
+
+/**
+ * For event counters on hot code paths, such as the number of file system
+ * calls.
+ */
+Counter *Statistics::RegisterSharded(const string &name, const string &desc) {
+  Counter *counter = Register(name, desc);
+  counter->MakeSharded();
+  return counter;
+}
+
+
 Statistics::Statistics() {
   lock_ =
     reinterpret_cast<pthread_mutex_t *>(smalloc(sizeof(pthread_mutex_t)));
@@ -117,6 +404,13 @@ Statistics::~Statistics() {
     if (old_value == 1)
       delete i->second;
   }
+  for (map<string, HistogramInfo *>::iterator i = histograms_.begin(),
+       iEnd = histograms_.end(); i != iEnd; ++i)
+  {
+    int32_t old_value = atomic_xadd32(&i->second->refcnt, -1);
+    if (old_value == 1)
+      delete i->second;
+  }
   pthread_mutex_destroy(lock_);
   free(lock_);
 }
@@ -229,6 +523,84 @@ void MultiRecorder::TickAt(uint64_t timestamp) {
     recorders_[i].TickAt(timestamp);
 }
 
+
+//------------------------------------------------------------------------------
+
+
+HistogramExporter::HistogramExporter(
+  Statistics *statistics,
+  const string &path,
+  const unsigned interval_s)
+  : statistics_(statistics)
+  , path_(path)
+  , interval_s_(interval_s)
+  , spawned_(false)
+{
+  assert(interval_s_ > 0);
+  MakePipe(pipe_terminate_);
+  memset(&thread_export_, 0, sizeof(thread_export_));
+}
+
+
+HistogramExporter::~HistogramExporter() {
+  if (spawned_) {
+    char c = 'T';
+    WritePipe(pipe_terminate_[1], &c, 1);
+    pthread_join(thread_export_, NULL);
+  }
+  ClosePipe(pipe_terminate_);
+}
+
+
+void HistogramExporter::Spawn() {
+  int retval = pthread_create(&thread_export_, NULL, MainExport, this);
+  assert(retval == 0);
+  spawned_ = true;
+}
+
+
+/**
+ * Writes to a temporary file first so that readers never see a partial file.
+ */
+bool HistogramExporter::Export() {
+  const string content =
+    statistics_->PrintHistograms(Statistics::kPrintHeader);
+  const string tmp_path = path_ + ".tmp";
+  unlink(tmp_path.c_str());
+  if (!SafeWriteToFile(content, tmp_path, 0644) ||
+      (rename(tmp_path.c_str(), path_.c_str()) != 0))
+  {
+    LogCvmfs(kLogCvmfs, kLogDebug | kLogSyslogWarn,
+             "failed to export latency histograms to %s (%d)",
+             path_.c_str(), errno);
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+void *HistogramExporter::MainExport(void *data) {
+  HistogramExporter *exporter = reinterpret_cast<HistogramExporter *>(data);
+  LogCvmfs(kLogCvmfs, kLogDebug, "histogram export thread started (%s)",
+           exporter->path_.c_str());
+
+  struct pollfd pfd_terminate;
+  pfd_terminate.fd = exporter->pipe_terminate_[0];
+  pfd_terminate.events = POLLIN | POLLPRI;
+  while (true) {
+    int retval = poll(&pfd_terminate, 1, exporter->interval_s_ * 1000);
+    if ((retval < 0) && (errno == EINTR))
+      continue;
+    exporter->Export();
+    if (retval != 0)
+      break;
+  }
+
+  LogCvmfs(kLogCvmfs, kLogDebug, "histogram export thread stopped");
+  return NULL;
+}
+
 }  // namespace perf
 
 
@@ -13,6 +13,8 @@
 #include <vector>
 
 #include "atomic.h"
+#include "util/single_copy.h"
+#include "util_concurrency.h"
 
 #ifdef CVMFS_NAMESPACE_GUARD
 namespace CVMFS_NAMESPACE_GUARD {
@@ -23,15 +25,37 @@ namespace perf {
 
 /**
  * A wrapper around an atomic 64bit signed integer.
+ *
+ * Counters that are changed very frequently by many threads can be sharded.
+ * A sharded counter spreads its value over several slots on separate cache
+ * lines; a thread always changes the same slot.  Reading a sharded counter
+ * sums up the slots.  The return value of Xadd() on a sharded counter only
+ * reflects the slot of the calling thread, so only event counters should be
+ * sharded.
  */
 class Counter {
  public:
-  Counter() { atomic_init64(&counter_); }
-  void Inc() { atomic_inc64(&counter_); }
-  void Dec() { atomic_dec64(&counter_); }
-  int64_t Get() { return atomic_read64(&counter_); }
-  void Set(const int64_t val) { atomic_write64(&counter_, val); }
-  int64_t Xadd(const int64_t delta) { return atomic_xadd64(&counter_, delta); }
+  Counter() : shards_(NULL) { atomic_init64(&counter_); }
+  /**
+   * Copies are not sharded.
+   */
+  Counter(const Counter &other);
+  Counter &operator=(const Counter &other);
+  ~Counter();
+  void Inc() { atomic_inc64(GetSlot()); }
+  void Dec() { atomic_dec64(GetSlot()); }
+  int64_t Get() {
+    if (shards_ == NULL)
+      return atomic_read64(&counter_);
+    return GetSharded();
+  }
+  void Set(const int64_t val);
+  int64_t Xadd(const int64_t delta) { return atomic_xadd64(GetSlot(), delta); }
+  /**
+   * Must be called before the counter is used concurrently.
+   */
+  void MakeSharded();
+  bool IsSharded() const { return shards_ != NULL; }
 
   std::string Print();
   std::string PrintK();
@@ -42,7 +66,24 @@ class Counter {
   std::string ToString();
 
  private:
+  static const unsigned kNumShards = 16;
+  struct Shard {
+    atomic_int64 value;
+    char padding[kCacheLineSize - sizeof(atomic_int64)];
+  };
+
+  atomic_int64 *GetSlot() {
+    if (shards_ == NULL)
+      return &counter_;
+    return &shards_[GetThreadSlot(kNumShards)].value;
+  }
+  int64_t GetSharded();
+
   atomic_int64 counter_;
+  /**
+   * NULL unless the counter is sharded.  Then, counter_ is only used by Set().
+   */
+  Shard *shards_;
 };
 
 // perf::Func(Counter) is more clear to read in the code
@@ -53,6 +94,56 @@ inline int64_t Xadd(class Counter *counter, const int64_t delta) {
 }
 
 
+/**
+ * A latency histogram in the spirit of HdrHistogram.  Values below kSubBuckets
+ * are counted exactly.  Above, every power of two is split into kSubBuckets
+ * linear bins, so a quantile is off by less than 1/kSubBuckets of its value.
+ * Add() is lock-free.  Quantiles are only exact if there are no concurrent
+ * writers.  Latencies are recorded in microseconds by convention.
+ */
+class Histogram : SingleCopy {
+ public:
+  Histogram();
+  void Add(const uint64_t value) { atomic_inc64(&bins_[GetBin(value)]); }
+  uint64_t GetCount() const;
+  /**
+   * Returns the largest value that falls into the same bin as the q-quantile,
+   * e.g. q = 0.99 for the 99th percentile.  Zero if the histogram is empty.
+   */
+  uint64_t GetQuantile(const double q) const;
+  void Reset();
+  /**
+   * Number of values, p50, p99, and p999 separated by '|'
+   */
+  std::string ToString() const;
+
+  static unsigned GetBin(const uint64_t value);
+  static uint64_t GetBinUpperBound(const unsigned bin);
+
+ private:
+  static const unsigned kSubBucketBits = 3;
+  static const unsigned kSubBuckets = 1 << kSubBucketBits;
+  static const unsigned kNumBins = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+  mutable atomic_int64 bins_[kNumBins];
+};
+
+
+/**
+ * Adds the lifetime of the object in microseconds to a histogram.  Put at the
+ * beginning of a function with several return paths.
+ */
+class HistogramTimer : SingleCopy {
+ public:
+  explicit HistogramTimer(Histogram *histogram);
+  ~HistogramTimer();
+
+ private:
+  Histogram *histogram_;
+  uint64_t start_ns_;
+};
+
+
 /**
  * A collection of Counter objects with a name and a description.  Counters in
  * a Statistics class have a name and a description.  Thread-safe.
@@ -68,9 +159,23 @@ class Statistics {
   ~Statistics();
   Statistics *Fork();
   Counter *Register(const std::string &name, const std::string &desc);
+  Counter *RegisterSharded(const std::string &name, const std::string &desc);
   Counter *Lookup(const std::string &name);
   std::string LookupDesc(const std::string &name);
   std::string PrintList(const PrintOptions print_options);
+  Histogram *RegisterHistogram(const std::string &name,
+                               const std::string &desc);
+  Histogram *LookupHistogram(const std::string &name);
+  std::string PrintHistograms(const PrintOptions print_options);
+  /**
+   * Text exposition in the OpenMetrics format.  Counters are exported with
+   * the type "unknown" because a Counter can be an event counter as well as a
+   * gauge.  Histograms are exported as summaries with the p50, p99, and p999
+   * quantiles.  The given labels, e.g. repo="a.b.c", are added to every
+   * sample.
+   */
+  std::string PrintOpenMetrics(const std::string &prefix,
+                               const std::string &labels);
 
  private:
   Statistics(const Statistics &other);
@@ -84,7 +189,17 @@ class Statistics {
     Counter counter;
     std::string desc;
   };
+  struct HistogramInfo {
+    explicit HistogramInfo(const std::string &desc) : desc(desc) {
+      atomic_init32(&refcnt);
+      atomic_inc32(&refcnt);
+    }
+    atomic_int32 refcnt;
+    Histogram histogram;
+    std::string desc;
+  };
   std::map<std::string, CounterInfo *> counters_;
+  std::map<std::string, HistogramInfo *> histograms_;
   pthread_mutex_t *lock_;
 };
 
@@ -110,6 +225,12 @@ class StatisticsTemplate {
   {
     return statistics_->Register(name_major_ + "." + name_minor, desc);
   }
+  Histogram *RegisterTemplatedHistogram(const std::string &name_minor,
+                                        const std::string &desc)
+  {
+    return statistics_->RegisterHistogram(name_major_ + "." + name_minor,
+                                          desc);
+  }
 
   Statistics *statistics() { return statistics_; }
 
@@ -182,6 +303,32 @@ class MultiRecorder {
   std::vector<Recorder> recorders_;
 };
 
+
+/**
+ * Periodically writes the histograms of a Statistics object to a file, so
+ * that a monitoring agent can pick up the percentiles.  The file is replaced
+ * atomically.
+ */
+class HistogramExporter : SingleCopy {
+ public:
+  HistogramExporter(Statistics *statistics,
+                    const std::string &path,
+                    const unsigned interval_s);
+  ~HistogramExporter();
+  void Spawn();
+  bool Export();
+
+ private:
+  static void *MainExport(void *data);
+
+  Statistics *statistics_;
+  std::string path_;
+  unsigned interval_s_;
+  int pipe_terminate_[2];
+  pthread_t thread_export_;
+  bool spawned_;
+};
+
 }  // namespace perf
 
 #ifdef CVMFS_NAMESPACE_GUARD
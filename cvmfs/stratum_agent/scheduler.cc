@@ -0,0 +1,133 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "stratum_agent/scheduler.h"
+
+#include <cassert>
+
+using namespace std;  // NOLINT
+
+const unsigned SnapshotScheduler::kDefaultMaxRunning;
+const unsigned SnapshotScheduler::kDefaultMaxPerUpstream;
+
+
+SnapshotScheduler::SnapshotScheduler(
+  const unsigned max_running,
+  const unsigned max_per_upstream)
+  : max_running_(max_running)
+  , max_per_upstream_(max_per_upstream)
+  , next_seq_(0)
+{
+  assert(max_running_ > 0);
+  assert(max_per_upstream_ > 0);
+}
+
+
+unsigned SnapshotScheduler::CountRunning(const string &upstream) const {
+  unsigned result = 0;
+  for (unsigned i = 0; i < running_.size(); ++i) {
+    if (running_[i].upstream == upstream)
+      result++;
+  }
+  return result;
+}
+
+
+string SnapshotScheduler::Enqueue(
+  const string &job_id,
+  const string &alias,
+  const string &upstream)
+{
+  for (unsigned i = 0; i < queue_.size(); ++i) {
+    if (queue_[i].alias == alias)
+      return queue_[i].job_id;
+  }
+  Entry entry;
+  entry.job_id = job_id;
+  entry.alias = alias;
+  entry.upstream = upstream;
+  entry.seq = next_seq_++;
+  queue_.push_back(entry);
+  return job_id;
+}
+
+
+void SnapshotScheduler::Finish(
+  const string &job_id,
+  const bool success,
+  const uint64_t timestamp)
+{
+  for (unsigned i = 0; i < running_.size(); ++i) {
+    if (running_[i].job_id == job_id) {
+      if (success)
+        last_success_[running_[i].alias] = timestamp;
+      running_.erase(running_.begin() + i);
+      return;
+    }
+  }
+}
+
+
+int SnapshotScheduler::GetPosition(const string &job_id) const {
+  for (unsigned i = 0; i < queue_.size(); ++i) {
+    if (queue_[i].job_id != job_id)
+      continue;
+    int position = 0;
+    for (unsigned j = 0; j < queue_.size(); ++j) {
+      if ((j != i) && IsPreferred(queue_[j], queue_[i]))
+        position++;
+    }
+    return position;
+  }
+  return -1;
+}
+
+
+bool SnapshotScheduler::IsEligible(const Entry &entry) const {
+  for (unsigned i = 0; i < running_.size(); ++i) {
+    if (running_[i].alias == entry.alias)
+      return false;
+  }
+  return CountRunning(entry.upstream) < max_per_upstream_;
+}
+
+
+/**
+ * True if entry should start before other
+ */
+bool SnapshotScheduler::IsPreferred(
+  const Entry &entry,
+  const Entry &other) const
+{
+  map<string, uint64_t>::const_iterator iter_entry =
+    last_success_.find(entry.alias);
+  map<string, uint64_t>::const_iterator iter_other =
+    last_success_.find(other.alias);
+  const bool known_entry = (iter_entry != last_success_.end());
+  const bool known_other = (iter_other != last_success_.end());
+  if (known_entry != known_other)
+    return !known_entry;
+  if (known_entry && (iter_entry->second != iter_other->second))
+    return iter_entry->second < iter_other->second;
+  return entry.seq < other.seq;
+}
+
+
+bool SnapshotScheduler::Next(string *job_id) {
+  if (running_.size() >= max_running_)
+    return false;
+  int best = -1;
+  for (unsigned i = 0; i < queue_.size(); ++i) {
+    if (!IsEligible(queue_[i]))
+      continue;
+    if ((best < 0) || IsPreferred(queue_[i], queue_[best]))
+      best = i;
+  }
+  if (best < 0)
+    return false;
+  *job_id = queue_[best].job_id;
+  running_.push_back(queue_[best]);
+  queue_.erase(queue_.begin() + best);
+  return true;
+}
@@ -0,0 +1,83 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_STRATUM_AGENT_SCHEDULER_H_
+#define CVMFS_STRATUM_AGENT_SCHEDULER_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Decides in which order the queued snapshot jobs of the stratum agent run.
+ * At most max_running jobs run at the same time, at most max_per_upstream of
+ * them replicate from the same stratum 0 host, and a repository is never
+ * snapshotted twice at the same time.  Among the jobs that may start, the one
+ * of the repository whose last successful snapshot is the oldest goes first;
+ * repositories that were not yet snapshotted by this agent count as the most
+ * stale ones.  Ties are broken by queue order.
+ *
+ * Not thread-safe, the stratum agent protects the scheduler by the lock of its
+ * job table.
+ */
+class SnapshotScheduler {
+ public:
+  static const unsigned kDefaultMaxRunning = 4;
+  static const unsigned kDefaultMaxPerUpstream = 2;
+
+  SnapshotScheduler(const unsigned max_running,
+                    const unsigned max_per_upstream);
+
+  /**
+   * Returns the job id of an already queued job of the same repository if
+   * there is one.  In this case, the new job is not queued because the queued
+   * one replicates the new revision anyway.  Otherwise returns job_id.
+   */
+  std::string Enqueue(const std::string &job_id, const std::string &alias,
+                      const std::string &upstream);
+  /**
+   * Picks the next job that may start and moves it from the queue to the
+   * running jobs.  Returns false if no job may start.
+   */
+  bool Next(std::string *job_id);
+  void Finish(const std::string &job_id, const bool success,
+              const uint64_t timestamp);
+
+  /**
+   * Position in the queue in the order of Next(), starting with 0.  Returns -1
+   * if the job is not queued.
+   */
+  int GetPosition(const std::string &job_id) const;
+  unsigned num_queued() const { return queue_.size(); }
+  unsigned num_running() const { return running_.size(); }
+  unsigned max_running() const { return max_running_; }
+  unsigned max_per_upstream() const { return max_per_upstream_; }
+
+ private:
+  struct Entry {
+    Entry() : seq(0) { }
+    std::string job_id;
+    std::string alias;
+    std::string upstream;
+    uint64_t seq;
+  };
+
+  bool IsEligible(const Entry &entry) const;
+  bool IsPreferred(const Entry &entry, const Entry &other) const;
+  unsigned CountRunning(const std::string &upstream) const;
+
+  unsigned max_running_;
+  unsigned max_per_upstream_;
+  uint64_t next_seq_;
+  std::vector<Entry> queue_;
+  std::vector<Entry> running_;
+  /**
+   * Maps the repository alias to the timestamp of the last successful snapshot
+   */
+  std::map<std::string, uint64_t> last_success_;
+};
+
+#endif  // CVMFS_STRATUM_AGENT_SCHEDULER_H_
@@ -10,8 +10,15 @@
  *     create new snapshot run.  Returns JSON with the job id
  *   - /cvmfs/<repo name>/api/v1/replicate/<job id>/
  *       {status,stdout,stderr,tail} (GET):
- *     Retrieve information about running and finished jobs.  The status is
- *     JSON encoded.  Finished jobs are cleaned up after a while.
+ *     Retrieve information about queued, running and finished jobs.  The
+ *     status is JSON encoded.  With '?offset=<bytes>', stdout and stderr only
+ *     return the output beyond offset, so that the progress of a running job
+ *     can be followed.  Finished jobs are cleaned up after a while.
+ *   - /cvmfs/<repo name>/api/v1/replicate/info (GET):
+ *     Version and scheduler state of the service
+ *
+ * New snapshot runs are queued and started by the SnapshotScheduler, which
+ * limits the number of concurrent runs overall and per stratum 0 host.
  *
  * TODO(jblomer): add support for synchronized application of a new revision.
  * In this case, the snapshot would run but the new manifest would only be
@@ -31,6 +38,7 @@
 #include <string>
 #include <vector>
 
+#include "dns.h"
 #include "download.h"
 #include "fence.h"
 #include "json.h"
@@ -40,6 +48,7 @@
 #include "options.h"
 #include "platform.h"
 #include "signature.h"
+#include "stratum_agent/scheduler.h"
 #include "stratum_agent/uri_map.h"
 #include "util/pointer.h"
 #include "util/posix.h"
@@ -110,6 +119,7 @@ struct Job : SingleCopy {
   }
   enum Status {
     kStatusLimbo,
+    kStatusQueued,
     kStatusRunning,
     kStatusDone
   };
@@ -127,7 +137,7 @@ struct Job : SingleCopy {
   Status status;
   int exit_code;
   pthread_t thread_job;
-  uint64_t birth;
+  uint64_t birth;  ///< Time of the start, or of the request while queued
   uint64_t death;
   time_t finish_timestamp;
   pid_t pid;
@@ -164,6 +174,10 @@ Fence g_fence_configurations;
  */
 map<string, Job *> g_jobs;
 pthread_mutex_t g_lock_jobs = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * Decides when queued jobs start, protected by g_lock_jobs
+ */
+SnapshotScheduler *g_scheduler;
 /**
  * Used to control the main thread from signals.
  */
@@ -280,33 +294,61 @@ class UriHandlerReplicate : public UriHandler {
     }
 
     UniquePtr<Job> job(new Job());
-    string exe = "/usr/bin/cvmfs_server";
-    vector<string> argv;
-    argv.push_back("snapshot");
-    argv.push_back(config->alias);
-    bool retval_b = ExecuteBinary(
-      &job->fd_stdin, &job->fd_stdout, &job->fd_stderr,
-      exe, argv, false, &job->pid);
-    if (!retval_b) {
-      WebReply::Send(WebReply::k500,
-                     MkJsonError("could not spawn snapshot process"), conn);
-      return;
-    }
-    job->status = Job::kStatusRunning;
     string uuid = cvmfs::Uuid::CreateOneTime();
     job->id = uuid;
     job->alias = config->alias;
     job->remote_ip = ntohl(req_info->remote_ip);
-
-    int retval_i = pthread_create(&job->thread_job, NULL, MainJobMgr, job);
-    assert(retval_i == 0);
-    retval_i = pthread_detach(job->thread_job);
-    assert(retval_i == 0);
+    job->status = Job::kStatusQueued;
+    string job_id;
     {
       MutexLockGuard guard_jobs(&g_lock_jobs);
-      g_jobs[uuid] = job.Release();
+      // An already queued job of the repository picks up the new revision, too
+      job_id = g_scheduler->Enqueue(
+        uuid, config->alias, dns::ExtractHost(config->stratum0_url));
+      if (job_id == uuid) {
+        g_jobs[uuid] = job.Release();
+        StartJobs();
+      }
+    }
+    WebReply::Send(WebReply::k200, "{\"job_id\":\"" + job_id + "\"}", conn);
+  }
+
+  /**
+   * Spawns the snapshot runs of the jobs that the scheduler lets go.  Called
+   * with g_lock_jobs held.
+   */
+  static void StartJobs() {
+    string job_id;
+    while (g_scheduler->Next(&job_id)) {
+      Job *job = g_jobs[job_id];
+      assert(job != NULL);
+      MutexLockGuard guard_job(&job->lock);
+      string exe = "/usr/bin/cvmfs_server";
+      vector<string> argv;
+      argv.push_back("snapshot");
+      argv.push_back(job->alias);
+      job->birth = platform_monotonic_time();
+      bool retval_b = ExecuteBinary(
+        &job->fd_stdin, &job->fd_stdout, &job->fd_stderr,
+        exe, argv, false, &job->pid);
+      if (!retval_b) {
+        LogCvmfs(kLogCvmfs, kLogStderr | kLogSyslogErr,
+                 "(%s) could not spawn snapshot process for job %s",
+                 job->alias.c_str(), job_id.c_str());
+        job->stderr = "could not spawn snapshot process\n";
+        job->death = platform_monotonic_time();
+        job->finish_timestamp = time(NULL);
+        job->status = Job::kStatusDone;
+        g_scheduler->Finish(job_id, false, job->finish_timestamp);
+        continue;
+      }
+      job->status = Job::kStatusRunning;
+
+      int retval_i = pthread_create(&job->thread_job, NULL, MainJobMgr, job);
+      assert(retval_i == 0);
+      retval_i = pthread_detach(job->thread_job);
+      assert(retval_i == 0);
     }
-    WebReply::Send(WebReply::k200, "{\"job_id\":\"" + uuid + "\"}", conn);
   }
 
  private:
@@ -360,6 +402,8 @@ class UriHandlerReplicate : public UriHandler {
       }
     }
 
+    int exit_code;
+    time_t finish_timestamp;
     {
       MutexLockGuard guard_job(&job->lock);
       close(job->fd_stdin);  job->fd_stdin = -1;
@@ -370,9 +414,16 @@ class UriHandlerReplicate : public UriHandler {
       job->finish_timestamp = time(NULL);
       job->status = Job::kStatusDone;
       job_id = job->id;
+      exit_code = job->exit_code;
+      finish_timestamp = job->finish_timestamp;
     }
     LogCvmfs(kLogCvmfs, kLogStdout | kLogSyslog,
              "(%s) finished replication job %s", alias.c_str(), job_id.c_str());
+    {
+      MutexLockGuard guard_jobs(&g_lock_jobs);
+      g_scheduler->Finish(job_id, exit_code == 0, finish_timestamp);
+      StartJobs();
+    }
     return NULL;
   }
 
@@ -405,19 +456,29 @@ class UriHandlerJob : public UriHandler {
     Job *job = iter->second;
     MutexLockGuard guard_this_job(&job->lock);
     if (what == "stdout") {
-      WebReply::Send(WebReply::k200, job->stdout, conn);
+      WebReply::Send(WebReply::k200, FromOffset(job->stdout, req_info), conn);
     } else if (what == "stderr") {
-      WebReply::Send(WebReply::k200, job->stderr, conn);
+      WebReply::Send(WebReply::k200, FromOffset(job->stderr, req_info), conn);
     } else if (what == "tail") {
       WebReply::Send(WebReply::k200, Tail(job->stdout, 4), conn);
     } else if (what == "status") {
       string reply = "{\"status\":";
       switch (job->status) {
         case Job::kStatusLimbo: reply += "\"limbo\""; break;
+        case Job::kStatusQueued: reply += "\"queued\""; break;
         case Job::kStatusRunning: reply += "\"running\""; break;
         case Job::kStatusDone: reply += "\"done\""; break;
         default: assert(false);
       }
+      if (job->status == Job::kStatusQueued) {
+        reply += ",\"position\":" +
+                 StringifyInt(g_scheduler->GetPosition(job->id));
+      }
+      if (job->status == Job::kStatusRunning) {
+        reply += ",\"duration\":" +
+                 StringifyInt(platform_monotonic_time() - job->birth);
+        reply += ",\"stdout_size\":" + StringifyInt(job->stdout.size());
+      }
       if (job->status == Job::kStatusDone) {
         reply += ",\"exit_code\":" + StringifyInt(job->exit_code);
         reply += ",\"duration\":" + StringifyInt(job->death - job->birth);
@@ -430,6 +491,27 @@ class UriHandlerJob : public UriHandler {
       WebReply::Send(WebReply::k404, "{\"error\":\"internal error\"}", conn);
     }
   }
+
+ private:
+  /**
+   * Strips the first 'offset' bytes of the job output if the request has an
+   * offset=<bytes> query parameter
+   */
+  static string FromOffset(const string &output,
+                           const struct mg_request_info *req_info)
+  {
+    if (req_info->query_string == NULL)
+      return output;
+    const string query = req_info->query_string;
+    if (!HasPrefix(query, "offset=", false))
+      return output;
+    uint64_t offset;
+    if (!String2Uint64Parse(query.substr(7), &offset))
+      return output;
+    if (offset >= output.size())
+      return "";
+    return output.substr(offset);
+  }
 };
 
 
@@ -446,7 +528,18 @@ class UriHandlerInfo : public UriHandler {
     string version = StringifyInt(kVersionMajor) + "." +
                      StringifyInt(kVersionMinor) + "." +
                      StringifyInt(kVersionPatch);
-    WebReply::Send(WebReply::k200, "{\"version\":\"" + version + "\"}", conn);
+    string reply = "{\"version\":\"" + version + "\"";
+    {
+      MutexLockGuard guard_jobs(&g_lock_jobs);
+      reply += ",\"running\":" + StringifyInt(g_scheduler->num_running());
+      reply += ",\"queued\":" + StringifyInt(g_scheduler->num_queued());
+      reply += ",\"max_running\":" +
+               StringifyInt(g_scheduler->max_running());
+      reply += ",\"max_per_upstream\":" +
+               StringifyInt(g_scheduler->max_per_upstream());
+    }
+    reply += "}";
+    WebReply::Send(WebReply::k200, reply, conn);
   }
 };
 
@@ -546,9 +639,13 @@ void Usage(const char *progname) {
            "trigger repository replication\n"
            "\n"
            "Usage: %s [-f(oreground)] [-p port (default: %s)]\n"
-           "          [-P pid file (default: %s)] [-u username]",
+           "          [-P pid file (default: %s)] [-u username]\n"
+           "          [-j concurrent snapshots (default: %u)]\n"
+           "          [-J concurrent snapshots per stratum 0 (default: %u)]",
            progname, kVersionMajor, kVersionMinor, kVersionPatch,
-           progname, kDefaultPort, kDefaultPidFile);
+           progname, kDefaultPort, kDefaultPidFile,
+           SnapshotScheduler::kDefaultMaxRunning,
+           SnapshotScheduler::kDefaultMaxPerUpstream);
 }
 
 
@@ -559,9 +656,11 @@ int main(int argc, char **argv) {
   string persona;
   uid_t original_uid = 0, drop_to_uid = 0;
   gid_t original_gid = 0, drop_to_gid = 0;
+  unsigned max_running = SnapshotScheduler::kDefaultMaxRunning;
+  unsigned max_per_upstream = SnapshotScheduler::kDefaultMaxPerUpstream;
 
   int c;
-  while ((c = getopt(argc, argv, "hvfp:P:u:")) != -1) {
+  while ((c = getopt(argc, argv, "hvfp:P:u:j:J:")) != -1) {
     switch (c) {
       case 'f':
         foreground = true;
@@ -582,6 +681,12 @@ int main(int argc, char **argv) {
         }
         break;
       }
+      case 'j':
+        max_running = String2Uint64(optarg);
+        break;
+      case 'J':
+        max_per_upstream = String2Uint64(optarg);
+        break;
       case 'v':
         break;
       case 'h':
@@ -593,6 +698,11 @@ int main(int argc, char **argv) {
     }
   }
 
+  if ((max_running == 0) || (max_per_upstream == 0)) {
+    Usage(argv[0]);
+    return 1;
+  }
+
   if (!foreground)
     Daemonize();
   int fd_pid_file = WritePidFile(pid_file);
@@ -620,6 +730,7 @@ int main(int argc, char **argv) {
   g_handler_job = new UriHandlerJob();
   g_handler_replicate = new UriHandlerReplicate();
   g_handler_info = new UriHandlerInfo();
+  g_scheduler = new SnapshotScheduler(max_running, max_per_upstream);
   ReadConfigurations();
   GenerateUriMap();
 
@@ -687,6 +798,7 @@ int main(int argc, char **argv) {
   delete g_handler_job;
   delete g_handler_replicate;
   delete g_handler_info;
+  delete g_scheduler;
 
   SwitchCredentials(original_uid, original_gid, true);
   UnlockFile(fd_pid_file);
@@ -10,9 +10,11 @@
 #include "swissknife_check.h"
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include <cassert>
+#include <cerrno>
 #include <map>
 #include <queue>
 #include <set>
@@ -29,13 +31,62 @@
 #include "reflog.h"
 #include "sanitizer.h"
 #include "shortstring.h"
+#include "sink.h"
 #include "util/pointer.h"
 #include "util/posix.h"
+#include "util/string.h"
 
 using namespace std;  // NOLINT
 
+namespace {
+
+/**
+ * Discards downloaded data chunks, only their size is counted.  The content
+ * hash is verified by the download manager.
+ */
+class NullSink : public cvmfs::Sink {
+ public:
+  NullSink() : nbytes(0) { }
+  virtual ~NullSink() { }
+  virtual int64_t Write(const void *buf, uint64_t sz) {
+    nbytes += sz;
+    return sz;
+  }
+  virtual int Reset() {
+    nbytes = 0;
+    return 0;
+  }
+  uint64_t nbytes;
+};
+
+}  // anonymous namespace
+
 namespace swissknife {
 
+CommandCheck::CommandCheck()
+  : check_chunks_(false)
+  , verify_hashes_(false)
+  , is_remote_(false)
+  , num_threads_(1)
+  , object_queue_(NULL)
+  , throttle_(NULL)
+  , checkpoint_file_(NULL)
+{
+  atomic_init32(&num_idle_catalog_threads_);
+  int retval = pthread_mutex_init(&lock_checkpoint_, NULL);
+  assert(retval == 0);
+}
+
+
+CommandCheck::~CommandCheck() {
+  StopVerifiers();
+  delete throttle_;
+  if (checkpoint_file_ != NULL)
+    fclose(checkpoint_file_);
+  pthread_mutex_destroy(&lock_checkpoint_);
+}
+
+
 bool CommandCheck::CompareEntries(const catalog::DirectoryEntry &a,
                                   const catalog::DirectoryEntry &b,
                                   const bool compare_names,
@@ -115,12 +166,17 @@ bool CommandCheck::CompareCounters(const catalog::Counters &a,
   const catalog::Counters::FieldsMap map_a = a.GetFieldsMap();
   const catalog::Counters::FieldsMap map_b = b.GetFieldsMap();
 
+  // Catalogs from before schema revision 7 are summarized on their next commit
+  const bool compare_summary = b.HasCompleteSummary();
+
   bool retval = true;
   catalog::Counters::FieldsMap::const_iterator i    = map_a.begin();
   catalog::Counters::FieldsMap::const_iterator iend = map_a.end();
   for (; i != iend; ++i) {
     catalog::Counters::FieldsMap::const_iterator comp = map_b.find(i->first);
     assert(comp != map_b.end());
+    if (!compare_summary && catalog::IsSummaryCounter(i->first))
+      continue;
 
     if (*(i->second) != *(comp->second)) {
       LogCvmfs(kLogCvmfs, kLogStderr,
@@ -150,6 +206,142 @@ bool CommandCheck::Exists(const string &file)
 }
 
 
+/**
+ * Checks for the existance of a data object or, with -V, verifies its content
+ * hash.  Uncompressed and compressed objects are hashed as they are stored.
+ */
+bool CommandCheck::VerifyObject(const ObjectCheck &check) {
+  if (!verify_hashes_)
+    return Exists(check.path);
+
+  uint64_t nbytes;
+  bool retval;
+  if (!is_remote_) {
+    const int64_t file_size = GetFileSize(check.path);
+    if (file_size < 0)
+      return false;
+    nbytes = file_size;
+    shash::Any computed_hash(check.hash.algorithm);
+    retval = shash::HashFile(check.path, &computed_hash) &&
+             (computed_hash == check.hash);
+  } else {
+    const string url = repo_base_path_ + "/" + check.path;
+    NullSink sink;
+    download::JobInfo download_job(&url, false, false, &sink, &check.hash);
+    retval = download_manager()->Fetch(&download_job) == download::kFailOk;
+    nbytes = sink.nbytes;
+  }
+  if (throttle_ != NULL)
+    throttle_->Consume(nbytes);
+  return retval;
+}
+
+
+void *CommandCheck::MainVerifier(void *data) {
+  CommandCheck *command = reinterpret_cast<CommandCheck *>(data);
+  while (true) {
+    ObjectCheck *check = command->object_queue_->Dequeue();
+    if (check == NULL)
+      break;
+    if (!command->VerifyObject(*check)) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "%s %s", check->description.c_str(),
+               command->verify_hashes_ ? "missing or corrupted" : "missing");
+      atomic_inc32(&check->batch->num_failed);
+    }
+    check->batch->pending.Decrement();
+  }
+  return NULL;
+}
+
+
+void CommandCheck::StartVerifiers() {
+  object_queue_ = new FifoChannel<ObjectCheck *>(num_threads_ * 1024, 1);
+  verifiers_.resize(num_threads_);
+  for (unsigned i = 0; i < num_threads_; ++i) {
+    int retval = pthread_create(&verifiers_[i], NULL, MainVerifier, this);
+    assert(retval == 0);
+  }
+}
+
+
+void CommandCheck::StopVerifiers() {
+  if (object_queue_ == NULL)
+    return;
+  for (unsigned i = 0; i < verifiers_.size(); ++i)
+    object_queue_->Enqueue(NULL);
+  for (unsigned i = 0; i < verifiers_.size(); ++i)
+    pthread_join(verifiers_[i], NULL);
+  verifiers_.clear();
+  delete object_queue_;
+  object_queue_ = NULL;
+}
+
+
+/**
+ * Hands the objects of a catalog to the verifier threads and waits for the
+ * result.  The verifiers are shared by all catalogs that are inspected
+ * concurrently.
+ */
+bool CommandCheck::CheckObjects(ObjectBatch *batch) {
+  if (batch->checks.empty())
+    return true;
+  batch->pending = static_cast<int32_t>(batch->checks.size());
+  for (unsigned i = 0; i < batch->checks.size(); ++i) {
+    batch->checks[i].batch = batch;
+    object_queue_->Enqueue(&batch->checks[i]);
+  }
+  batch->pending.WaitForZero();
+  return atomic_read32(&batch->num_failed) == 0;
+}
+
+
+/**
+ * Reads the catalogs verified by a previous run.  Newly verified catalogs are
+ * appended to the file.
+ */
+bool CommandCheck::LoadCheckpoint(const string &path) {
+  FILE *f = fopen(path.c_str(), "r");
+  if (f != NULL) {
+    string line;
+    while (GetLineFile(f, &line)) {
+      const shash::Any hash =
+        shash::MkFromSuffixedHexPtr(shash::HexPtr(Trim(line)));
+      if (!hash.IsNull())
+        checkpoint_.insert(hash);
+    }
+    fclose(f);
+    LogCvmfs(kLogCvmfs, kLogStdout, "resuming check: %u catalogs are already "
+             "verified", static_cast<unsigned>(checkpoint_.size()));
+  }
+
+  checkpoint_file_ = fopen(path.c_str(), "a");
+  if (checkpoint_file_ == NULL) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to open checkpoint file %s (%d)",
+             path.c_str(), errno);
+    return false;
+  }
+  checkpoint_path_ = path;
+  return true;
+}
+
+
+bool CommandCheck::IsCheckpointed(const shash::Any &catalog_hash) {
+  return checkpoint_.find(catalog_hash) != checkpoint_.end();
+}
+
+
+/**
+ * Records a catalog whose entire subtree was checked without errors.
+ */
+void CommandCheck::AddCheckpoint(const shash::Any &catalog_hash) {
+  if (checkpoint_file_ == NULL)
+    return;
+  MutexLockGuard guard(&lock_checkpoint_);
+  fprintf(checkpoint_file_, "%s\n", catalog_hash.ToStringWithSuffix().c_str());
+  fflush(checkpoint_file_);
+}
+
+
 /**
  * Copies a file from the repository into a temporary file.
  */
@@ -306,7 +498,8 @@ bool CommandCheck::InspectHistory(history::History *history) {
 bool CommandCheck::Find(const catalog::Catalog *catalog,
                         const PathString &path,
                         catalog::DeltaCounters *computed_counters,
-                        set<PathString> *bind_mountpoints)
+                        set<PathString> *bind_mountpoints,
+                        ObjectBatch *objects)
 {
   catalog::DirectoryEntryList entries;
   catalog::DirectoryEntry this_directory;
@@ -363,18 +556,16 @@ bool CommandCheck::Find(const catalog::Catalog *catalog,
       retval = false;
     }
 
-    // Check if the chunk is there
+    // Queue the chunk for the verifier threads
     if (check_chunks_ &&
         !entries[i].checksum().IsNull() && !entries[i].IsExternalFile())
     {
       string chunk_path = "data/" + entries[i].checksum().MakePath();
       if (entries[i].IsDirectory())
         chunk_path += shash::kSuffixMicroCatalog;
-      if (!Exists(chunk_path)) {
-        LogCvmfs(kLogCvmfs, kLogStderr, "data chunk %s (%s) missing",
-                 entries[i].checksum().ToString().c_str(), full_path.c_str());
-        retval = false;
-      }
+      objects->checks.push_back(ObjectCheck(entries[i].checksum(), chunk_path,
+        "data chunk " + entries[i].checksum().ToString() +
+        " (" + full_path.ToString() + ")"));
     }
 
     // Add hardlinks to counting map
@@ -452,8 +643,11 @@ bool CommandCheck::Find(const catalog::Catalog *catalog,
         }
       } else {
         // Recurse
-        if (!Find(catalog, full_path, computed_counters, bind_mountpoints))
+        if (!Find(catalog, full_path, computed_counters, bind_mountpoints,
+                  objects))
+        {
           retval = false;
+        }
       }
     } else if (entries[i].IsLink()) {
       computed_counters->self.symlinks++;
@@ -527,15 +721,11 @@ bool CommandCheck::Find(const catalog::Catalog *catalog,
         if (check_chunks_) {
           const shash::Any &chunk_hash = this_chunk.content_hash();
           const string chunk_path = "data/" + chunk_hash.MakePath();
-          if (!Exists(chunk_path)) {
-            LogCvmfs(kLogCvmfs, kLogStderr, "partial data chunk %s (%s -> "
-                                            "offset: %d | size: %d) missing",
-                     this_chunk.content_hash().ToStringWithSuffix().c_str(),
-                     full_path.c_str(),
-                     this_chunk.offset(),
-                     this_chunk.size());
-            retval = false;
-          }
+          objects->checks.push_back(ObjectCheck(chunk_hash, chunk_path,
+            "partial data chunk " + chunk_hash.ToStringWithSuffix() +
+            " (" + full_path.ToString() +
+            " -> offset: " + StringifyInt(this_chunk.offset()) +
+            " | size: " + StringifyInt(this_chunk.size()) + ")"));
         }
       }
 
@@ -687,6 +877,124 @@ bool CommandCheck::FindSubtreeRootCatalog(const string &subtree_path,
 }
 
 
+namespace {
+
+struct NestedInspection {
+  NestedInspection()
+    : command(NULL), size(0), retval(true), has_thread(false) { }
+  CommandCheck *command;
+  string path;
+  shash::Any hash;
+  uint64_t size;
+  catalog::DirectoryEntry transition_point;
+  catalog::DeltaCounters counters;
+  bool retval;
+  bool has_thread;
+  pthread_t thread;
+};
+
+}  // anonymous namespace
+
+
+void *CommandCheck::MainInspectNested(void *data) {
+  NestedInspection *nested = reinterpret_cast<NestedInspection *>(data);
+  CommandCheck *command = nested->command;
+  if (command->IsCheckpointed(nested->hash)) {
+    // The subtree was verified before, only its counters are needed
+    LogCvmfs(kLogCvmfs, kLogStdout, "[skipping verified catalog] %s at %s",
+             nested->hash.ToString().c_str(), nested->path.c_str());
+    const catalog::Catalog *catalog =
+      command->FetchCatalog(nested->path, nested->hash, nested->size);
+    if (catalog == NULL) {
+      nested->retval = false;
+    } else {
+      catalog->GetCounters().AddAsSubtree(&nested->counters);
+      delete catalog;
+    }
+  } else {
+    const bool is_nested = true;
+    nested->retval = command->InspectTree(nested->path, nested->hash,
+                                          nested->size, is_nested,
+                                          &nested->transition_point,
+                                          &nested->counters);
+  }
+  if (nested->has_thread)
+    atomic_inc32(&command->num_idle_catalog_threads_);
+  return NULL;
+}
+
+
+/**
+ * Inspects the nested catalogs of catalog.  While there are idle catalog
+ * threads, nested catalogs are inspected in their own thread; otherwise, the
+ * calling thread inspects them.  No ownership of computed_counters.
+ */
+bool CommandCheck::InspectNestedCatalogs(
+  const catalog::Catalog *catalog,
+  const set<PathString> &bind_mountpoints,
+  catalog::DeltaCounters *computed_counters)
+{
+  bool retval = true;
+  const catalog::Catalog::NestedCatalogList &nested_catalogs =
+    catalog->ListNestedCatalogs();
+  vector<NestedInspection *> inspections;
+  for (catalog::Catalog::NestedCatalogList::const_iterator i =
+       nested_catalogs.begin(), iEnd = nested_catalogs.end(); i != iEnd; ++i)
+  {
+    if (bind_mountpoints.find(i->mountpoint) != bind_mountpoints.end()) {
+      catalog::DirectoryEntry bind_mountpoint;
+      PathString mountpoint("/" + i->mountpoint.ToString().substr(1));
+      if (!catalog->LookupPath(mountpoint, &bind_mountpoint)) {
+        LogCvmfs(kLogCvmfs, kLogStderr, "failed to lookup bind mountpoint %s",
+                 mountpoint.c_str());
+        retval = false;
+      }
+      LogCvmfs(kLogCvmfs, kLogDebug, "skipping bind mountpoint %s",
+               i->mountpoint.c_str());
+      continue;
+    }
+    NestedInspection *nested = new NestedInspection();
+    if (!catalog->LookupPath(i->mountpoint, &nested->transition_point)) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to lookup transition point %s",
+               i->mountpoint.c_str());
+      retval = false;
+      delete nested;
+      continue;
+    }
+    nested->command = this;
+    nested->path = i->mountpoint.ToString();
+    nested->hash = i->hash;
+    nested->size = i->size;
+    inspections.push_back(nested);
+
+    int32_t num_idle;
+    while ((num_idle = atomic_read32(&num_idle_catalog_threads_)) > 0) {
+      if (atomic_cas32(&num_idle_catalog_threads_, num_idle, num_idle - 1)) {
+        nested->has_thread = true;
+        break;
+      }
+    }
+    if (nested->has_thread) {
+      int retval_thread = pthread_create(&nested->thread, NULL,
+                                         MainInspectNested, nested);
+      assert(retval_thread == 0);
+    } else {
+      MainInspectNested(nested);
+    }
+  }
+
+  for (unsigned i = 0; i < inspections.size(); ++i) {
+    if (inspections[i]->has_thread)
+      pthread_join(inspections[i]->thread, NULL);
+    if (!inspections[i]->retval)
+      retval = false;
+    inspections[i]->counters.PopulateToParent(computed_counters);
+    delete inspections[i];
+  }
+  return retval;
+}
+
+
 /**
  * Recursion on nested catalog level.  No ownership of computed_counters.
  */
@@ -752,11 +1060,14 @@ bool CommandCheck::InspectTree(const string                  &path,
 
   // Traverse the catalog
   set<PathString> bind_mountpoints;
+  ObjectBatch objects;
   if (!Find(catalog, PathString(path.data(), path.length()),
-            computed_counters, &bind_mountpoints))
+            computed_counters, &bind_mountpoints, &objects))
   {
     retval = false;
   }
+  if (!CheckObjects(&objects))
+    retval = false;
 
   // Check number of entries
   const uint64_t num_found_entries = 1 + computed_counters->self.regular_files +
@@ -793,35 +1104,8 @@ bool CommandCheck::InspectTree(const string                  &path,
     retval = false;
   }
 
-  for (catalog::Catalog::NestedCatalogList::const_iterator i =
-       nested_catalogs.begin(), iEnd = nested_catalogs.end(); i != iEnd; ++i)
-  {
-    if (bind_mountpoints.find(i->mountpoint) != bind_mountpoints.end()) {
-      catalog::DirectoryEntry bind_mountpoint;
-      PathString mountpoint("/" + i->mountpoint.ToString().substr(1));
-      if (!catalog->LookupPath(mountpoint, &bind_mountpoint)) {
-        LogCvmfs(kLogCvmfs, kLogStderr, "failed to lookup bind mountpoint %s",
-                 mountpoint.c_str());
-        retval = false;
-      }
-      LogCvmfs(kLogCvmfs, kLogDebug, "skipping bind mountpoint %s",
-               i->mountpoint.c_str());
-      continue;
-    }
-    catalog::DirectoryEntry nested_transition_point;
-    if (!catalog->LookupPath(i->mountpoint, &nested_transition_point)) {
-      LogCvmfs(kLogCvmfs, kLogStderr, "failed to lookup transition point %s",
-               i->mountpoint.c_str());
-      retval = false;
-    } else {
-      catalog::DeltaCounters nested_counters;
-      const bool is_nested = true;
-      if (!InspectTree(i->mountpoint.ToString(), i->hash, i->size, is_nested,
-                       &nested_transition_point, &nested_counters))
-        retval = false;
-      nested_counters.PopulateToParent(computed_counters);
-    }
-  }
+  if (!InspectNestedCatalogs(catalog, bind_mountpoints, computed_counters))
+    retval = false;
 
   // Check statistics counters
   // Additionally account for root directory
@@ -835,6 +1119,8 @@ bool CommandCheck::InspectTree(const string                  &path,
     retval = false;
   }
 
+  if (retval)
+    AddCheckpoint(catalog_hash);
   delete catalog;
   return retval;
 }
@@ -847,6 +1133,7 @@ int CommandCheck::Main(const swissknife::ArgumentList &args) {
   string trusted_certs = "";
   string repo_name = "";
   string reflog_chksum_path = "";
+  string checkpoint_path = "";
 
   temp_directory_ = (args.find('t') != args.end()) ? *args.find('t')->second
                                                    : "/tmp";
@@ -854,6 +1141,26 @@ int CommandCheck::Main(const swissknife::ArgumentList &args) {
     tag_name = *args.find('n')->second;
   if (args.find('c') != args.end())
     check_chunks_ = true;
+  if (args.find('V') != args.end()) {
+    check_chunks_ = true;
+    verify_hashes_ = true;
+  }
+  if (args.find('j') != args.end()) {
+    num_threads_ = String2Uint64(*args.find('j')->second);
+    if (num_threads_ == 0) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "invalid number of threads");
+      return 1;
+    }
+  }
+  if (args.find('b') != args.end()) {
+    const uint64_t max_bandwidth =
+      String2Uint64(*args.find('b')->second) * 1024 * 1024;
+    if (max_bandwidth == 0) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "invalid bandwidth limit");
+      return 1;
+    }
+    throttle_ = new BandwidthThrottle(max_bandwidth);
+  }
   if (args.find('l') != args.end()) {
     unsigned log_level =
       1 << (kLogLevel0 + String2Uint64(*args.find('l')->second));
@@ -877,6 +1184,9 @@ int CommandCheck::Main(const swissknife::ArgumentList &args) {
     subtree_path = MakeCanonicalPath(*args.find('s')->second);
   if (args.find('R') != args.end())
     reflog_chksum_path = *args.find('R')->second;
+  // Resolved before switching into a local repository
+  if (args.find('C') != args.end())
+    checkpoint_path = GetAbsolutePath(*args.find('C')->second);
 
   // Repository can be HTTP address or on local file system
   is_remote_ = (repo_base_path_.substr(0, 7) == "http://");
@@ -884,7 +1194,8 @@ int CommandCheck::Main(const swissknife::ArgumentList &args) {
   // initialize the (swissknife global) download and signature managers
   if (is_remote_) {
     const bool follow_redirects = (args.count('L') > 0);
-    if (!this->InitDownloadManager(follow_redirects)) {
+    // Catalog threads and verifier threads download concurrently
+    if (!this->InitDownloadManager(follow_redirects, 2 * num_threads_)) {
       return 1;
     }
 
@@ -1001,6 +1312,12 @@ int CommandCheck::Main(const swissknife::ArgumentList &args) {
     return 1;
   }
 
+  if (!checkpoint_path.empty() && !LoadCheckpoint(checkpoint_path))
+    return 1;
+  atomic_write32(&num_idle_catalog_threads_, num_threads_ - 1);
+  if (check_chunks_)
+    StartVerifiers();
+
   catalog::DeltaCounters computed_counters;
   successful = InspectTree(subtree_path,
                            root_hash,
@@ -1008,12 +1325,18 @@ int CommandCheck::Main(const swissknife::ArgumentList &args) {
                            is_nested_catalog,
                            NULL,
                            &computed_counters) && successful;
+  StopVerifiers();
 
   if (!successful) {
     LogCvmfs(kLogCvmfs, kLogStderr, "CATALOG PROBLEMS OR OTHER ERRORS FOUND");
     return 1;
   }
 
+  if (checkpoint_file_ != NULL) {
+    fclose(checkpoint_file_);
+    checkpoint_file_ = NULL;
+    unlink(checkpoint_path_.c_str());
+  }
   LogCvmfs(kLogCvmfs, kLogStdout, "no problems found");
   return 0;
 }
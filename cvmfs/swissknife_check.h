@@ -5,12 +5,21 @@
 #ifndef CVMFS_SWISSKNIFE_CHECK_H_
 #define CVMFS_SWISSKNIFE_CHECK_H_
 
+#include <pthread.h>
+#include <stdint.h>
+
+#include <cstdio>
 #include <set>
 #include <string>
+#include <vector>
 
+#include "atomic.h"
+#include "backoff.h"
 #include "catalog.h"
 #include "hash.h"
 #include "swissknife.h"
+#include "util/single_copy.h"
+#include "util_concurrency.h"
 
 namespace download {
 class DownloadManager;
@@ -26,10 +35,30 @@ namespace swissknife {
 
 class CommandCheck : public Command {
  public:
-  CommandCheck()
-    : check_chunks_(false)
-    , is_remote_(false) {}
-  ~CommandCheck() { }
+  /**
+   * A data object referenced by a catalog.  The checks of a catalog are
+   * queued for the verifier threads as one batch.
+   */
+  struct ObjectBatch;
+  struct ObjectCheck {
+    ObjectCheck() : batch(NULL) { }
+    ObjectCheck(const shash::Any &hash, const std::string &path,
+                const std::string &description)
+      : hash(hash), path(path), description(description), batch(NULL) { }
+    shash::Any hash;
+    std::string path;
+    std::string description;
+    ObjectBatch *batch;
+  };
+  struct ObjectBatch {
+    ObjectBatch() { atomic_init32(&num_failed); }
+    std::vector<ObjectCheck> checks;
+    SynchronizingCounter<int32_t> pending;
+    atomic_int32 num_failed;
+  };
+
+  CommandCheck();
+  ~CommandCheck();
   virtual std::string GetName() const { return "check"; }
   virtual std::string GetDescription() const {
     return "CernVM File System repository sanity checker\n"
@@ -47,7 +76,13 @@ class CommandCheck : public Command {
     r.push_back(Parameter::Optional('z', "trusted certificates"));
     r.push_back(Parameter::Optional('N', "name of the repository"));
     r.push_back(Parameter::Optional('R', "path to reflog.chksum file"));
+    r.push_back(Parameter::Optional('j', "number of threads (default: 1)"));
+    r.push_back(Parameter::Optional('b', "max. bandwidth for reading data "
+                                         "chunks (MB/s)"));
+    r.push_back(Parameter::Optional('C', "checkpoint file to resume a check"));
     r.push_back(Parameter::Switch('c', "check availability of data chunks"));
+    r.push_back(Parameter::Switch('V', "verify content hashes of data chunks "
+                                       "(implies -c)"));
     r.push_back(Parameter::Switch('L', "follow HTTP redirects"));
     return r;
   }
@@ -76,8 +111,21 @@ class CommandCheck : public Command {
   bool Find(const catalog::Catalog *catalog,
             const PathString &path,
             catalog::DeltaCounters *computed_counters,
-            std::set<PathString> *bind_mountpoints);
+            std::set<PathString> *bind_mountpoints,
+            ObjectBatch *objects);
   bool Exists(const std::string &file);
+  bool VerifyObject(const ObjectCheck &check);
+  bool CheckObjects(ObjectBatch *batch);
+  void StartVerifiers();
+  void StopVerifiers();
+  static void *MainVerifier(void *data);
+  bool InspectNestedCatalogs(const catalog::Catalog *catalog,
+                             const std::set<PathString> &bind_mountpoints,
+                             catalog::DeltaCounters *computed_counters);
+  static void *MainInspectNested(void *data);
+  bool LoadCheckpoint(const std::string &path);
+  bool IsCheckpointed(const shash::Any &catalog_hash);
+  void AddCheckpoint(const shash::Any &catalog_hash);
   bool CompareCounters(const catalog::Counters &a,
                        const catalog::Counters &b);
   bool CompareEntries(const catalog::DirectoryEntry &a,
@@ -89,7 +137,23 @@ class CommandCheck : public Command {
   std::string temp_directory_;
   std::string repo_base_path_;
   bool        check_chunks_;
+  bool        verify_hashes_;
   bool        is_remote_;
+  unsigned    num_threads_;
+  /**
+   * Catalog threads that may still be spawned for nested catalogs
+   */
+  atomic_int32 num_idle_catalog_threads_;
+  FifoChannel<ObjectCheck *> *object_queue_;
+  std::vector<pthread_t> verifiers_;
+  BandwidthThrottle *throttle_;
+  /**
+   * Catalogs whose subtree has been verified by a previous, interrupted run
+   */
+  std::set<shash::Any> checkpoint_;
+  std::string checkpoint_path_;
+  FILE *checkpoint_file_;
+  pthread_mutex_t lock_checkpoint_;
 };
 
 }  // namespace swissknife
@@ -79,6 +79,10 @@ std::string DiffTool::PrintDifferences(
     result_list.push_back(machine_readable_ ? "B" : "bind-mountpoint");
   if (diff & catalog::DirectoryEntryBase::Difference::kHiddenFlag)
     result_list.push_back(machine_readable_ ? "H" : "hidden");
+  if (diff & catalog::DirectoryEntryBase::Difference::kInlineFileFlag)
+    result_list.push_back(machine_readable_ ? "F" : "inline-file");
+  if (diff & catalog::DirectoryEntryBase::Difference::kBundledFileFlag)
+    result_list.push_back(machine_readable_ ? "U" : "bundled-file");
 
   return machine_readable_ ? ("[" + JoinStrings(result_list, "") + "]")
                            : (" [" + JoinStrings(result_list, ", ") + "]");
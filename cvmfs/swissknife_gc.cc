@@ -23,7 +23,7 @@ namespace swissknife {
 
 typedef HttpObjectFetcher<> ObjectFetcher;
 typedef CatalogTraversal<ObjectFetcher> ReadonlyCatalogTraversal;
-typedef SmallhashFilter HashFilter;
+typedef CompactHashFilter HashFilter;
 typedef GarbageCollector<ReadonlyCatalogTraversal, HashFilter> GC;
 typedef GarbageCollectorAux<ReadonlyCatalogTraversal, HashFilter> GCAux;
 typedef GC::Configuration GcConfig;
@@ -40,6 +40,16 @@ ParameterList CommandGc::GetParams() const {
   r.push_back(Parameter::Optional('k', "repository master key(s) / dir"));
   r.push_back(Parameter::Optional('t', "temporary directory"));
   r.push_back(Parameter::Optional('L', "path to deletion log file"));
+  r.push_back(Parameter::Optional('N', "number of concurrent catalog "
+                                       "downloads"));
+  r.push_back(Parameter::Optional('M', "memory limit of the preserved objects "
+                                       "filter in MB"));
+  r.push_back(Parameter::Optional('B', "number of objects removed per batch"));
+  r.push_back(Parameter::Optional('P', "number of concurrent removals"));
+  r.push_back(Parameter::Optional('S', "mark state directory for incremental "
+                                       "garbage collection"));
+  r.push_back(Parameter::Optional('I', "full garbage collection every <I> "
+                                       "runs (with -S)"));
   r.push_back(Parameter::Switch('d', "dry run"));
   r.push_back(Parameter::Switch('l', "list objects to be removed"));
   return r;
@@ -67,6 +77,20 @@ int CommandGc::Main(const ArgumentList &args) {
     *args.find('t')->second : "/tmp";
   const std::string deletion_log_path = (args.count('L') > 0) ?
     *args.find('L')->second : "";
+  const unsigned num_threads = (args.count('N') > 0) ?
+    String2Uint64(*args.find('N')->second) : 1;
+  const uint64_t hash_filter_memory = (args.count('M') > 0) ?
+    String2Uint64(*args.find('M')->second) * 1024 * 1024 : 0;
+  const unsigned deletion_batch_size = (args.count('B') > 0) ?
+    String2Uint64(*args.find('B')->second) :
+    GcConfig::kDefaultDeletionBatchSize;
+  const unsigned deletion_concurrency = (args.count('P') > 0) ?
+    String2Uint64(*args.find('P')->second) : 1;
+  const std::string mark_state_dir = (args.count('S') > 0) ?
+    *args.find('S')->second : "";
+  const unsigned full_gc_interval = (args.count('I') > 0) ?
+    String2Uint64(*args.find('I')->second) :
+    GcConfig::kDefaultFullGcInterval;
 
   if (revisions < 0) {
     LogCvmfs(kLogCvmfs, kLogStderr,
@@ -82,11 +106,15 @@ int CommandGc::Main(const ArgumentList &args) {
   }
 
   const bool follow_redirects = false;
-  if (!this->InitDownloadManager(follow_redirects) ||
+  const unsigned max_pool_handles = (num_threads > 1) ? num_threads : 1;
+  if (!this->InitDownloadManager(follow_redirects, max_pool_handles) ||
       !this->InitVerifyingSignatureManager(repo_keys)) {
     LogCvmfs(kLogCatalog, kLogStderr, "failed to init repo connection");
     return 1;
   }
+  // Concurrent catalog downloads require the download I/O thread
+  if (num_threads > 1)
+    download_manager()->Spawn();
 
   ObjectFetcher object_fetcher(repo_name,
                                repo_url,
@@ -135,6 +163,12 @@ int CommandGc::Main(const ArgumentList &args) {
   }
 
   reflog->BeginTransaction();
+  // The garbage collector looks up the timestamp of every traversed catalog
+  if (!reflog->LoadIndex()) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to load the reflog index");
+    uploader->TearDown();
+    return 1;
+  }
 
   GcConfig config;
   config.uploader                = uploader.weak_ref();
@@ -145,6 +179,13 @@ int CommandGc::Main(const ArgumentList &args) {
   config.object_fetcher          = &object_fetcher;
   config.reflog                  = reflog.weak_ref();
   config.deleted_objects_logfile = deletion_log_file;
+  config.num_threads             = num_threads;
+  config.hash_filter_memory      = hash_filter_memory;
+  config.tmp_dir                 = temp_directory;
+  config.deletion_batch_size     = deletion_batch_size;
+  config.deletion_concurrency    = deletion_concurrency;
+  config.mark_state_dir          = mark_state_dir;
+  config.full_gc_interval        = full_gc_interval;
 
 
   if (deletion_log_file != NULL) {
@@ -170,12 +211,19 @@ int CommandGc::Main(const ArgumentList &args) {
     uploader->TearDown();
     return 1;
   }
+  if (collector.is_incremental()) {
+    LogCvmfs(kLogCvmfs, kLogDebug, "incremental garbage collection: %u out of "
+             "%u preserved catalogs taken from the mark state",
+             collector.summarized_catalog_count(),
+             collector.preserved_catalog_count());
+  }
 
   // Tag databases, meta infos, certificates
   HashFilter preserved_objects;
   preserved_objects.Fill(manifest->certificate());
   preserved_objects.Fill(manifest->history());
   preserved_objects.Fill(manifest->meta_info());
+  preserved_objects.Freeze();
   GCAux collector_aux(config);
   success = collector_aux.CollectOlderThan(
     collector.oldest_trunk_catalog(), preserved_objects);
@@ -10,12 +10,16 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdio>
 #include <vector>
 
 #include "fs_traversal.h"
+#include "fs_traversal_parallel.h"
 #include "hash.h"
 #include "platform.h"
+#include "sync_graft_manifest.h"
+#include "util/pointer.h"
 #include "util/posix.h"
 
 bool swissknife::CommandGraft::ChecksumFdWithChunks(
@@ -150,7 +154,9 @@ void swissknife::CommandGraft::FileCallback(const std::string &relative_path,
                        (relative_path.size() ? relative_path : ".") + "/" +
                        file_name;
   }
-  Publish(full_input_path, full_output_path, false, false);
+  // Files are grafted after the traversal, possibly by several threads
+  jobs_.push_back(GraftJob(full_input_path, full_output_path,
+    relative_path.size() ? (relative_path + "/" + file_name) : file_name));
 }
 
 int swissknife::CommandGraft::Main(const swissknife::ArgumentList &args) {
@@ -179,6 +185,21 @@ int swissknife::CommandGraft::Main(const swissknife::ArgumentList &args) {
   }
   chunk_size_ *= 1024 * 1024;  // Convert to MB.
 
+  num_threads_ = 1;
+  if (args.find('j') != args.end()) {
+    uint64_t num_threads;
+    if (!String2Uint64Parse(*args.find('j')->second, &num_threads) ||
+        (num_threads == 0) || (num_threads > kMaxThreads))
+    {
+      LogCvmfs(kLogCvmfs, kLogStderr, "Invalid number of threads: %s",
+               args.find('j')->second->c_str());
+      return 1;
+    }
+    num_threads_ = num_threads;
+  }
+  manifest_path_ =
+      (args.find('m') == args.end()) ? "" : *(args.find('m')->second);
+
   platform_stat64 sbuf;
   bool output_file_is_dir = output_file.size() &&
                             (0 == platform_stat(output_file.c_str(), &sbuf)) &&
@@ -200,6 +221,11 @@ int swissknife::CommandGraft::Main(const swissknife::ArgumentList &args) {
                  input_file.c_str(), output_file.c_str());
         return 1;
       }
+      if (!manifest_path_.empty() && !output_file.size()) {
+        LogCvmfs(kLogCvmfs, kLogStderr,
+                 "A graft manifest requires an output directory\n");
+        return 1;
+      }
       if (verbose_) {
         LogCvmfs(kLogCvmfs, kLogStderr, "Recursing into directory %s\n",
                  input_file.c_str());
@@ -209,19 +235,21 @@ int swissknife::CommandGraft::Main(const swissknife::ArgumentList &args) {
       return Publish(input_file, output_file, output_file_is_dir, false);
     }
   }
+  if (!manifest_path_.empty()) {
+    LogCvmfs(kLogCvmfs, kLogStderr,
+             "A graft manifest requires a directory as input\n");
+    return 1;
+  }
   return Publish(input_file, output_file, output_file_is_dir, true);
 }
 
-int swissknife::CommandGraft::Publish(const std::string &input_file,
-                                      const std::string &output_file,
-                                      bool output_file_is_dir,
-                                      bool input_file_is_stdin) {
-  if (output_file.size() && verbose_) {
-    LogCvmfs(kLogCvmfs, kLogStdout, "Grafting %s to %s", input_file.c_str(),
-             output_file.c_str());
-  } else if (!output_file.size()) {
-    LogCvmfs(kLogCvmfs, kLogStdout, "Grafting %s", input_file.c_str());
-  }
+/**
+ * Computes the contents of the graft file, i.e. size and content hashes.
+ */
+bool swissknife::CommandGraft::MakeGraft(const std::string &input_file,
+                                         bool input_file_is_stdin,
+                                         std::string *graft_contents,
+                                         mode_t *input_file_mode) {
   int fd;
   if (input_file_is_stdin) {
     fd = 0;
@@ -230,7 +258,7 @@ int swissknife::CommandGraft::Publish(const std::string &input_file,
     if (fd < 0) {
       std::string errmsg = "Unable to open input file (" + input_file + ")";
       perror(errmsg.c_str());
-      return 1;
+      return false;
     }
   }
 
@@ -240,17 +268,18 @@ int swissknife::CommandGraft::Publish(const std::string &input_file,
     std::string errmsg = "Unable to stat input file (" + input_file + ")";
     perror(errmsg.c_str());
   }
-  mode_t input_file_mode = input_file_is_stdin ? 0644 : sbuf.st_mode;
+  *input_file_mode = input_file_is_stdin ? 0644 : sbuf.st_mode;
 
   shash::Any file_hash(hash_alg_);
   uint64_t processed_size;
   std::vector<uint64_t> chunk_offsets;
   std::vector<shash::Any> chunk_checksums;
-  zlib::Compressor *compressor = zlib::Compressor::Construct(compression_alg_);
+  UniquePtr<zlib::Compressor> compressor(
+      zlib::Compressor::Construct(compression_alg_));
 
   bool retval =
-      ChecksumFdWithChunks(fd, compressor, &processed_size, &file_hash,
-                           &chunk_offsets, &chunk_checksums);
+      ChecksumFdWithChunks(fd, compressor.weak_ref(), &processed_size,
+                           &file_hash, &chunk_offsets, &chunk_checksums);
 
   if (!input_file_is_stdin) {
     close(fd);
@@ -258,10 +287,65 @@ int swissknife::CommandGraft::Publish(const std::string &input_file,
   if (!retval) {
     std::string errmsg = "Unable to checksum input file (" + input_file + ")";
     perror(errmsg.c_str());
+    return false;
+  }
+
+  const bool with_suffix = true;
+  *graft_contents = "size=" + StringifyInt(processed_size) + "\n" +
+                    "checksum=" + file_hash.ToString(with_suffix) + "\n";
+  if (!chunk_offsets.empty()) {
+    std::vector<std::string> chunk_off_str;
+    chunk_off_str.reserve(chunk_offsets.size());
+    std::vector<std::string> chunk_ck_str;
+    chunk_ck_str.reserve(chunk_offsets.size());
+    for (unsigned idx = 0; idx < chunk_offsets.size(); idx++) {
+      chunk_off_str.push_back(StringifyInt(chunk_offsets[idx]));
+      chunk_ck_str.push_back(chunk_checksums[idx].ToStringWithSuffix());
+    }
+    *graft_contents +=
+        "chunk_offsets=" + JoinStrings(chunk_off_str, ",") + "\n";
+    *graft_contents +=
+        "chunk_checksums=" + JoinStrings(chunk_ck_str, ",") + "\n";
+  }
+  return true;
+}
+
+/**
+ * Creates and truncates the output file.
+ */
+bool swissknife::CommandGraft::CreateOutputFile(const std::string &output_fname,
+                                                mode_t mode) {
+  int fd = open(output_fname.c_str(), O_CREAT | O_TRUNC | O_WRONLY, mode);
+  if (fd < 0) {
+    std::string errmsg = "Unable to open output file (" + output_fname + ")";
+    perror(errmsg.c_str());
+    return false;
+  }
+  close(fd);
+  return true;
+}
+
+int swissknife::CommandGraft::Publish(const std::string &input_file,
+                                      const std::string &output_file,
+                                      bool output_file_is_dir,
+                                      bool input_file_is_stdin) {
+  if (output_file.size() && verbose_) {
+    LogCvmfs(kLogCvmfs, kLogStdout, "Grafting %s to %s", input_file.c_str(),
+             output_file.c_str());
+  } else if (!output_file.size()) {
+    LogCvmfs(kLogCvmfs, kLogStdout, "Grafting %s", input_file.c_str());
+  }
+
+  std::string graft_contents;
+  mode_t input_file_mode;
+  if (!MakeGraft(input_file, input_file_is_stdin, &graft_contents,
+                 &input_file_mode))
+  {
     return 1;
   }
 
   // Build the .cvmfsgraft-$filename
+  int fd;
   if (output_file.size()) {
     std::string dirname, fname;
     std::string graft_fname;
@@ -281,26 +365,9 @@ int swissknife::CommandGraft::Publish(const std::string &input_file,
   } else {
     fd = 1;
   }
-  const bool with_suffix = true;
-  std::string graft_contents = "size=" + StringifyInt(processed_size) + "\n" +
-                               "checksum=" + file_hash.ToString(with_suffix) +
-                               "\n";
-  if (!chunk_offsets.empty()) {
-    std::vector<std::string> chunk_off_str;
-    chunk_off_str.reserve(chunk_offsets.size());
-    std::vector<std::string> chunk_ck_str;
-    chunk_ck_str.reserve(chunk_offsets.size());
-    for (unsigned idx = 0; idx < chunk_offsets.size(); idx++) {
-      chunk_off_str.push_back(StringifyInt(chunk_offsets[idx]));
-      chunk_ck_str.push_back(chunk_checksums[idx].ToStringWithSuffix());
-    }
-    graft_contents += "chunk_offsets=" + JoinStrings(chunk_off_str, ",") + "\n";
-    graft_contents +=
-        "chunk_checksums=" + JoinStrings(chunk_ck_str, ",") + "\n";
-  }
   size_t nbytes = graft_contents.size();
   const char *buf = graft_contents.c_str();
-  retval = SafeWrite(fd, buf, nbytes);
+  bool retval = SafeWrite(fd, buf, nbytes);
   if (!retval) {
     perror("Failed writing to graft file");
     close(fd);
@@ -312,23 +379,76 @@ int swissknife::CommandGraft::Publish(const std::string &input_file,
     return 0;
   }
 
-  // Create and truncate the output file.
   std::string output_fname;
   if (output_file_is_dir) {
     output_fname = output_file + "/" + GetFileName(input_file);
   } else {
     output_fname = output_file;
   }
-  fd =
-      open(output_fname.c_str(), O_CREAT | O_TRUNC | O_WRONLY, input_file_mode);
-  if (fd < 0) {
-    std::string errmsg = "Unable to open output file (" + output_file + ")";
-    perror(errmsg.c_str());
-    return 1;
+  return CreateOutputFile(output_fname, input_file_mode) ? 0 : 1;
+}
+
+/**
+ * In manifest mode, the graft description is kept for WriteManifest() and
+ * only the (empty) output file is created.
+ */
+bool swissknife::CommandGraft::ProcessJob(unsigned idx) {
+  const GraftJob &job = jobs_[idx];
+  if (manifest_path_.empty())
+    return Publish(job.input_path, job.output_path, false, false) == 0;
+
+  if (verbose_) {
+    LogCvmfs(kLogCvmfs, kLogStdout, "Grafting %s to %s",
+             job.input_path.c_str(), job.output_path.c_str());
   }
-  close(fd);
+  std::string graft_contents;
+  mode_t input_file_mode;
+  if (!MakeGraft(job.input_path, false, &graft_contents, &input_file_mode))
+    return false;
+  if (!CreateOutputFile(job.output_path, input_file_mode))
+    return false;
+  manifest_records_[idx] = publish::GraftManifest::MakeRecord(
+    output_abs_path_ + "/" + job.relative_path, graft_contents);
+  return true;
+}
 
-  return 0;
+void *swissknife::CommandGraft::MainWorker(void *data) {
+  CommandGraft *command = reinterpret_cast<CommandGraft *>(data);
+  const int64_t num_jobs = command->jobs_.size();
+  int64_t idx;
+  while ((idx = atomic_xadd64(&command->next_job_, 1)) < num_jobs) {
+    if (!command->ProcessJob(idx))
+      atomic_inc32(&command->num_failures_);
+  }
+  return NULL;
+}
+
+/**
+ * The records are written in traversal order, so that the manifest does not
+ * depend on the number of threads.  Failed files are left out.
+ */
+bool swissknife::CommandGraft::WriteManifest() {
+  std::string manifest = publish::GraftManifest::MakeHeader();
+  unsigned num_records = 0;
+  for (unsigned i = 0; i < manifest_records_.size(); ++i) {
+    if (manifest_records_[i].empty())
+      continue;
+    manifest += manifest_records_[i];
+    num_records++;
+  }
+  const std::string tmp_path = manifest_path_ + ".tmp";
+  if (!SafeWriteToFile(manifest, tmp_path, 0644) ||
+      (rename(tmp_path.c_str(), manifest_path_.c_str()) != 0))
+  {
+    std::string errmsg = "Unable to write graft manifest (" +
+                         manifest_path_ + ")";
+    perror(errmsg.c_str());
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  LogCvmfs(kLogCvmfs, kLogStdout, "Wrote %u graft descriptions to %s",
+           num_records, manifest_path_.c_str());
+  return true;
 }
 
 int swissknife::CommandGraft::Recurse(const std::string &input_file,
@@ -339,6 +459,50 @@ int swissknife::CommandGraft::Recurse(const std::string &input_file,
   FileSystemTraversal<CommandGraft> traverser(this, input_file, true);
   traverser.fn_new_file = &CommandGraft::FileCallback;
   traverser.fn_new_dir_prefix = &CommandGraft::DirCallback;
+  UniquePtr<ParallelDirectoryScanner> scanner;
+  if (num_threads_ > 1) {
+    scanner = new ParallelDirectoryScanner(
+      num_threads_, ParallelDirectoryScanner::kDefaultMaxListings, NULL);
+    scanner->Start(input_file);
+    traverser.SetPrefetcher(scanner.weak_ref());
+  }
   traverser.Recurse(input_file);
+  scanner.Destroy();
+
+  if (!manifest_path_.empty()) {
+    // Manifest keys have to match the absolute paths seen by the sync
+    output_abs_path_ = GetAbsolutePath(output_file_);
+    while ((output_abs_path_.length() > 1) &&
+           (output_abs_path_[output_abs_path_.length() - 1] == '/'))
+    {
+      output_abs_path_.resize(output_abs_path_.length() - 1);
+    }
+    manifest_records_.resize(jobs_.size());
+  }
+  atomic_init64(&next_job_);
+  atomic_init32(&num_failures_);
+  const unsigned num_workers =
+    std::max(1U, std::min(num_threads_, static_cast<unsigned>(jobs_.size())));
+  if (num_workers == 1) {
+    MainWorker(this);
+  } else {
+    std::vector<pthread_t> threads(num_workers);
+    for (unsigned i = 0; i < num_workers; ++i) {
+      int retval = pthread_create(&threads[i], NULL, MainWorker, this);
+      assert(retval == 0);
+    }
+    for (unsigned i = 0; i < num_workers; ++i)
+      pthread_join(threads[i], NULL);
+  }
+
+  const int num_failures = atomic_read32(&num_failures_);
+  if (num_failures > 0) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "Failed to graft %d out of %zu files",
+             num_failures, jobs_.size());
+  }
+  if (!manifest_path_.empty()) {
+    if (!WriteManifest() || (num_failures > 0))
+      return 1;
+  }
   return 0;
 }
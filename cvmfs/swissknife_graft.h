@@ -7,9 +7,13 @@
 #ifndef CVMFS_SWISSKNIFE_GRAFT_H_
 #define CVMFS_SWISSKNIFE_GRAFT_H_
 
+#include <pthread.h>
+#include <sys/types.h>
+
 #include <string>
 #include <vector>
 
+#include "atomic.h"
 #include "compression.h"
 #include "hash.h"
 
@@ -21,6 +25,7 @@ namespace swissknife {
 class CommandGraft : public Command {
  public:
   static const unsigned kDefaultChunkSize = 24;
+  static const unsigned kMaxThreads = 256;
 
   ~CommandGraft() { }
   virtual std::string GetName() const { return "graft"; }
@@ -39,15 +44,36 @@ class CommandGraft : public Command {
                                     StringifyUint(kDefaultChunkSize) + ")"));
     r.push_back(Parameter::Optional('a', "hash algorithm (default: SHA-1)"));
     r.push_back(Parameter::Switch('b', "Generate bulk hash for chunked file"));
+    r.push_back(Parameter::Optional('j', "Number of threads for directory "
+                                    "input (default: 1)"));
+    r.push_back(Parameter::Optional('m', "Write a graft manifest for directory "
+                                    "input instead of graft files"));
     return r;
   }
 
   int Main(const ArgumentList &args);
 
  private:
+  /**
+   * A regular file found by Recurse(), processed by one of the workers
+   */
+  struct GraftJob {
+    GraftJob(const std::string &i, const std::string &o, const std::string &r)
+      : input_path(i), output_path(o), relative_path(r) { }
+    std::string input_path;
+    std::string output_path;
+    std::string relative_path;
+  };
+
   int Publish(const std::string &input_file, const std::string &output_file,
               bool output_file_is_dir, bool input_file_is_stdin);
+  bool MakeGraft(const std::string &input_file, bool input_file_is_stdin,
+                 std::string *graft_contents, mode_t *input_file_mode);
+  bool CreateOutputFile(const std::string &output_fname, mode_t mode);
   int Recurse(const std::string &input_file, const std::string &output_file);
+  static void *MainWorker(void *data);
+  bool ProcessJob(unsigned idx);
+  bool WriteManifest();
 
   void FileCallback(const std::string &relative_path,
                     const std::string &file_name);
@@ -68,6 +94,20 @@ class CommandGraft : public Command {
   shash::Algorithms hash_alg_;
   uint64_t chunk_size_;
   bool generate_bulk_hash_;
+  unsigned num_threads_;
+  /**
+   * If set, the graft descriptions of directory input are collected in a
+   * publish::GraftManifest instead of .cvmfsgraft-$filename files
+   */
+  std::string manifest_path_;
+  std::string output_abs_path_;
+  std::vector<GraftJob> jobs_;
+  /**
+   * Indexed like jobs_, filled by the workers in manifest mode
+   */
+  std::vector<std::string> manifest_records_;
+  atomic_int64 next_job_;
+  atomic_int32 num_failures_;
 };
 
 }  // namespace swissknife
@@ -12,6 +12,7 @@
 #include "catalog_rw.h"
 #include "download.h"
 #include "hash.h"
+#include "history_index.h"
 #include "manifest_fetch.h"
 #include "signature.h"
 #include "upload.h"
@@ -196,6 +197,18 @@ bool CommandTag::CloseAndPublishHistory(Environment *env) {
   // set the previous revision pointer of the history database
   env->history->SetPreviousRevision(env->manifest->history());
 
+  // write the tag index that allows clients to resolve tags without the
+  // history database
+  TagList tags;
+  UnlinkGuard tag_index_path(CreateTempPath(env->tmp_path + "/tag_index",
+                                            0600));
+  if (!env->history->List(&tags) ||
+      !history::TagIndex::Write(tags, tag_index_path.path()))
+  {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to create the tag index");
+    return false;
+  }
+
   // close the history database
   history::History *weak_history = env->history.Release();
   delete weak_history;
@@ -214,8 +227,21 @@ bool CommandTag::CloseAndPublishHistory(Environment *env) {
     return false;
   }
 
+  // compress and upload the tag index
+  Future<shash::Any> tag_index_hash;
+  callback = env->spooler->RegisterListener(
+      &CommandTag::UploadClosure, this, &tag_index_hash);
+  env->spooler->ProcessTagIndex(tag_index_path.path());
+  env->spooler->WaitForUpload();
+  const shash::Any new_tag_index_hash = tag_index_hash.Get();
+  env->spooler->UnregisterListener(callback);
+  if (new_tag_index_hash.IsNull()) {
+    return false;
+  }
+
   // update the (yet unsigned) manifest file
   env->manifest->set_history(new_history_hash);
+  env->manifest->set_tag_index(new_tag_index_hash);
   if (!env->manifest->Export(env->manifest_path.path())) {
     LogCvmfs(kLogCvmfs, kLogStderr, "failed to export the new manifest '%s'",
              env->manifest_path.path().c_str());
@@ -7,6 +7,8 @@
 
 #include <string>
 
+#include "catalog.h"
+#include "catalog_counters.h"
 #include "logging.h"
 #include "util/posix.h"
 #include "util/string.h"
@@ -15,7 +17,7 @@ namespace swissknife {
 
 CommandListCatalogs::CommandListCatalogs() :
   print_tree_(false), print_hash_(false), print_size_(false),
-  print_entries_(false) {}
+  print_entries_(false), print_summary_(false) {}
 
 
 ParameterList CommandListCatalogs::GetParams() const {
@@ -30,6 +32,7 @@ ParameterList CommandListCatalogs::GetParams() const {
   r.push_back(Parameter::Switch('d', "print digest for each catalog"));
   r.push_back(Parameter::Switch('s', "print catalog file sizes"));
   r.push_back(Parameter::Switch('e', "print number of catalog entries"));
+  r.push_back(Parameter::Switch('S', "print repository summary statistics"));
   return r;
 }
 
@@ -39,6 +42,7 @@ int CommandListCatalogs::Main(const ArgumentList &args) {
   print_hash_    = (args.count('d') > 0);
   print_size_    = (args.count('s') > 0);
   print_entries_ = (args.count('e') > 0);
+  print_summary_ = (args.count('S') > 0);
 
   shash::Any manual_root_hash;
   const std::string &repo_url  = *args.find('r')->second;
@@ -118,4 +122,38 @@ void CommandListCatalogs::CatalogCallback(
     clg_entries.c_str(), path.c_str());
 }
 
+
+
+void CommandListCatalogs::PrintCounters(const catalog::Counters &c) {
+  // Repository totals are stored as self + subtree of the root catalog
+  LogCvmfs(kLogCatalog, kLogStdout,
+           "regular files: %s\n"
+           "file size: %s B\n"
+           "chunked files: %s\n"
+           "external files: %s\n"
+           "inline files: %s\n"
+           "bundled files: %s\n"
+           "nested catalogs: %s",
+           StringifyInt(c.self.regular_files + c.subtree.regular_files).c_str(),
+           StringifyInt(c.self.file_size + c.subtree.file_size).c_str(),
+           StringifyInt(c.self.chunked_files + c.subtree.chunked_files).c_str(),
+           StringifyInt(c.self.externals + c.subtree.externals).c_str(),
+           StringifyInt(c.self.inline_files + c.subtree.inline_files).c_str(),
+           StringifyInt(c.self.bundled_files + c.subtree.bundled_files).c_str(),
+           StringifyInt(c.self.nested_catalogs +
+                        c.subtree.nested_catalogs).c_str());
+  for (unsigned i = 0; i < catalog::kNumSizeBins; ++i) {
+    LogCvmfs(kLogCatalog, kLogStdout, "%s: %s",
+             catalog::GetSizeBinName(i).c_str(),
+             StringifyInt(c.self.size_bins[i] +
+                          c.subtree.size_bins[i]).c_str());
+  }
+  if (!c.HasCompleteSummary()) {
+    LogCvmfs(kLogCatalog, kLogStdout,
+             "summary incomplete: %s catalog(s) not yet summarized",
+             StringifyInt(c.self.unsummarized +
+                          c.subtree.unsummarized).c_str());
+  }
+}
+
 }  // namespace swissknife
@@ -9,11 +9,15 @@
 
 #include "catalog_traversal.h"
 #include "hash.h"
+#include "logging.h"
+#include "manifest.h"
 #include "object_fetcher.h"
 #include "swissknife.h"
+#include "util/pointer.h"
 
 namespace catalog {
 class Catalog;
+class Counters;
 }
 
 namespace swissknife {
@@ -37,6 +41,9 @@ class CommandListCatalogs : public Command {
   bool Run(const shash::Any &manual_root_hash,
            ObjectFetcherT *object_fetcher)
   {
+    if (print_summary_)
+      return PrintSummary(manual_root_hash, object_fetcher);
+
     typename CatalogTraversal<ObjectFetcherT>::Parameters params;
     params.object_fetcher = object_fetcher;
     CatalogTraversal<ObjectFetcherT> traversal(params);
@@ -46,13 +53,50 @@ class CommandListCatalogs : public Command {
     return traversal.Traverse(manual_root_hash);
   }
 
+  /**
+   * The summary statistics of the repository are aggregated in the counters
+   * of the root catalog, so only the root catalog needs to be fetched.
+   */
+  template <class ObjectFetcherT>
+  bool PrintSummary(const shash::Any &manual_root_hash,
+                    ObjectFetcherT *object_fetcher)
+  {
+    shash::Any root_hash = manual_root_hash;
+    if (root_hash.IsNull()) {
+      manifest::Manifest *manifest = NULL;
+      const typename ObjectFetcherT::Failures retval =
+        object_fetcher->FetchManifest(&manifest);
+      if (retval != ObjectFetcherT::kFailOk) {
+        LogCvmfs(kLogCatalog, kLogStderr, "failed to fetch manifest (%s)",
+                 Code2Ascii(retval));
+        return false;
+      }
+      root_hash = manifest->catalog_hash();
+      delete manifest;
+    }
+
+    catalog::Catalog *root_catalog = NULL;
+    const typename ObjectFetcherT::Failures retval =
+      object_fetcher->FetchCatalog(root_hash, "", &root_catalog);
+    if (retval != ObjectFetcherT::kFailOk) {
+      LogCvmfs(kLogCatalog, kLogStderr, "failed to fetch root catalog %s (%s)",
+               root_hash.ToString().c_str(), Code2Ascii(retval));
+      return false;
+    }
+    UniquePtr<catalog::Catalog> catalog(root_catalog);
+    PrintCounters(catalog->GetCounters());
+    return true;
+  }
+
   void CatalogCallback(const CatalogTraversalData<catalog::Catalog> &data);
+  void PrintCounters(const catalog::Counters &c);
 
  private:
   bool print_tree_;
   bool print_hash_;
   bool print_size_;
   bool print_entries_;
+  bool print_summary_;
 };
 
 }  // namespace swissknife
@@ -25,6 +25,8 @@
 #include "swissknife_scrub.h"
 #include "swissknife_sign.h"
 #include "swissknife_sync.h"
+#include "swissknife_trace.h"
+#include "swissknife_warm.h"
 #include "swissknife_zpipe.h"
 
 
@@ -81,11 +83,13 @@ int main(int argc, char **argv) {
   command_list.push_back(new swissknife::CommandRollbackTag());
   command_list.push_back(new swissknife::CommandEmptyRecycleBin());
   command_list.push_back(new swissknife::CommandSign());
+  command_list.push_back(new swissknife::CommandSignBatch());
   command_list.push_back(new swissknife::CommandLetter());
   command_list.push_back(new swissknife::CommandCheck());
   command_list.push_back(new swissknife::CommandListCatalogs());
   command_list.push_back(new swissknife::CommandDiff());
   command_list.push_back(new swissknife::CommandPull());
+  command_list.push_back(new swissknife::CommandWarm());
   command_list.push_back(new swissknife::CommandZpipe());
   command_list.push_back(new swissknife::CommandGraft());
   command_list.push_back(new swissknife::CommandHash());
@@ -96,6 +100,9 @@ int main(int argc, char **argv) {
   command_list.push_back(new swissknife::CommandGc());
   command_list.push_back(new swissknife::CommandReconstructReflog());
   command_list.push_back(new swissknife::CommandLease());
+  command_list.push_back(new swissknife::CommandTrace2Csv());
+  command_list.push_back(new swissknife::CommandTraceReplay());
+  command_list.push_back(new swissknife::CommandCatalogHeatmap());
 
   if (argc < 2) {
     Usage();
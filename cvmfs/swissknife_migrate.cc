@@ -309,10 +309,16 @@ bool CommandMigrate::DoMigrationAndCommit(
                                          this);
 
   // Migrate catalogs recursively (starting with the deepest nested catalogs)
+  // Every catalog reports to finished_catalogs_ once it is uploaded or found
+  // unchanged.  Hence, the channel never holds more than catalog_count_ items
+  // and the callbacks never block on it.
   LogCvmfs(kLogCatalog, kLogStdout, "\nMigrating catalogs...");
+  finished_catalogs_ =
+    new FifoChannel<PendingCatalog *>(catalog_count_ + 1, catalog_count_ + 1);
   PendingCatalog *root_catalog = new PendingCatalog(root_catalog_);
   migration_stopwatch_.Start();
   ConvertCatalogsRecursively(root_catalog, &concurrent_migration);
+  ScheduleFinishedParents(root_catalog, &concurrent_migration);
   concurrent_migration.WaitForEmptyQueue();
   spooler_->WaitForUpload();
   migration_stopwatch_.Stop();
@@ -401,6 +407,7 @@ void CommandMigrate::MigrationCallback(PendingCatalog *const &data) {
   if (!data->HasChanges()) {
     PrintStatusMessage(data, data->GetOldContentHash(), "preserved");
     data->was_updated.Set(false);
+    finished_catalogs_->Enqueue(data);
     return;
   }
 
@@ -461,11 +468,13 @@ void CommandMigrate::UploadCallback(const upload::SpoolerResult &result) {
     PrintStatusMessage(catalog, result.content_hash, "migrated and uploaded");
 
     // The catalog is completely processed... fill the content_hash to allow the
-    // processing of parent catalogs (Notified by 'was_updated'-future)
+    // processing of parent catalogs (Notified by 'was_updated'-future and by
+    // the finished_catalogs_ channel)
     // NOTE: From now on, this PendingCatalog structure could be deleted and
     //       should not be used anymore!
     catalog->new_catalog_hash = result.content_hash;
     catalog->was_updated.Set(true);
+    finished_catalogs_->Enqueue(catalog);
   }
 }
 
@@ -484,6 +493,11 @@ void CommandMigrate::PrintStatusMessage(const PendingCatalog *catalog,
 }
 
 
+/**
+ * Builds the tree of pending catalogs and schedules the leaf catalogs.  Parent
+ * catalogs are scheduled by ScheduleFinishedParents() once all their nested
+ * catalogs are uploaded, so that no worker is blocked waiting for children.
+ */
 template <class MigratorT>
 void CommandMigrate::ConvertCatalogsRecursively(PendingCatalog *catalog,
                                                 MigratorT       *migrator) {
@@ -493,14 +507,33 @@ void CommandMigrate::ConvertCatalogsRecursively(PendingCatalog *catalog,
   catalog::CatalogList::const_iterator i    = nested_catalogs.begin();
   catalog::CatalogList::const_iterator iend = nested_catalogs.end();
   catalog->nested_catalogs.reserve(nested_catalogs.size());
+  catalog->num_pending_nested = nested_catalogs.size();
   for (; i != iend; ++i) {
-    PendingCatalog *new_nested = new PendingCatalog(*i);
+    PendingCatalog *new_nested = new PendingCatalog(*i, catalog);
     catalog->nested_catalogs.push_back(new_nested);
     ConvertCatalogsRecursively(new_nested, migrator);
   }
 
-  // Migrate this catalog referencing all its (already migrated) children
-  migrator->Schedule(catalog);
+  if (catalog->num_pending_nested == 0)
+    migrator->Schedule(catalog);
+}
+
+
+/**
+ * Waits for finished catalogs and schedules a parent catalog as soon as its
+ * last nested catalog is done.  Returns when the root catalog is finished.
+ * Failed migrations and uploads abort the process in the callbacks.
+ */
+template <class MigratorT>
+void CommandMigrate::ScheduleFinishedParents(PendingCatalog *root_catalog,
+                                             MigratorT      *migrator) {
+  PendingCatalog *finished;
+  do {
+    finished = finished_catalogs_->Dequeue();
+    PendingCatalog *parent = finished->parent;
+    if ((parent != NULL) && (--parent->num_pending_nested == 0))
+      migrator->Schedule(parent);
+  } while (finished != root_catalog);
 }
 
 
@@ -642,7 +675,8 @@ bool CommandMigrate::AbstractMigrationWorker<DerivedT>::
 
   // go through all nested catalogs and update their references (we are curently
   // in their parent catalog)
-  // Note: we might need to wait for the nested catalog to be fully processed.
+  // Note: the catalog is only scheduled after all its nested catalogs are fully
+  //       processed, so the futures are already set.
   PendingCatalogList::const_iterator i    = data->nested_catalogs.begin();
   PendingCatalogList::const_iterator iend = data->nested_catalogs.end();
   for (; i != iend; ++i) {
@@ -752,7 +786,7 @@ bool CommandMigrate::AbstractMigrationWorker<DerivedT>::CleanupNestedCatalogs(
  * both the catalog management and migration classes get updated.
  */
 const float    CommandMigrate::MigrationWorker_20x::kSchema         = 2.5;
-const unsigned CommandMigrate::MigrationWorker_20x::kSchemaRevision = 4;
+const unsigned CommandMigrate::MigrationWorker_20x::kSchemaRevision = 9;
 
 
 template<class DerivedT>
@@ -879,6 +913,14 @@ bool CommandMigrate::MigrationWorker_20x::AttachOldCatalogDatabase(
     Error("Failed to attach database of old catalog", sql_attach_new, data);
     return false;
   }
+
+  // Keep the scratch tables of the hardlink analysis in memory
+  catalog::SqlCatalog sql_temp_store(new_catalog,
+                                     "PRAGMA temp_store = MEMORY;");
+  if (!sql_temp_store.Execute()) {
+    Error("Failed to keep temporary tables in memory", sql_temp_store, data);
+    return false;
+  }
   return true;
 }
 
@@ -1081,13 +1123,34 @@ bool CommandMigrate::MigrationWorker_20x::AnalyzeFileLinkcounts(
   //       supported hardlink groups.
   //       Unsupported hardlink groups will be be treated as normal files with
   //       the same content
+  //
+  // Note: Only a small fraction of the entries share an inode.  Instead of a
+  //       self-join of the entire old catalog, the entries with a shared inode
+  //       are grouped in a single pass into the indexed 'hl_members' table
+  //       which is then joined with itself.
+  catalog::SqlCatalog sql_create_hardlinks_members_table(writable,
+    "CREATE TEMPORARY TABLE hl_members AS "
+    "  SELECT inode, md5path_1, md5path_2, parent_1, parent_2 "
+    "  FROM old.catalog "
+    "  WHERE inode IN (SELECT inode FROM old.catalog "
+    "                  GROUP BY inode HAVING count(*) > 1);");
+  catalog::SqlCatalog sql_index_hardlinks_members_table(writable,
+    "CREATE INDEX hl_members_inode ON hl_members (inode);");
+  retval = sql_create_hardlinks_members_table.Execute() &&
+           sql_index_hardlinks_members_table.Execute();
+  if (!retval) {
+    Error("Failed to collect hardlink candidates",
+          sql_create_hardlinks_members_table, data);
+    return false;
+  }
+
   catalog::SqlCatalog sql_create_hardlinks_scratch_table(writable,
     "CREATE TEMPORARY TABLE hl_scratch AS "
     "  SELECT c1.inode AS inode, c1.md5path_1, c1.md5path_2, "
     "         c1.parent_1 as c1p1, c1.parent_2 as c1p2, "
     "         c2.parent_1 as c2p1, c2.parent_2 as c2p2 "
-    "  FROM old.catalog AS c1 "
-    "  INNER JOIN old.catalog AS c2 "
+    "  FROM hl_members AS c1 "
+    "  INNER JOIN hl_members AS c2 "
     "  ON c1.inode == c2.inode AND "
     "     (c1.md5path_1 != c2.md5path_1 OR "
     "      c1.md5path_2 != c2.md5path_2);");
@@ -1147,7 +1210,10 @@ bool CommandMigrate::MigrationWorker_20x::AnalyzeFileLinkcounts(
   // can be deleted...
   catalog::SqlCatalog drop_hardlink_scratch_space(writable,
                                                   "DROP TABLE hl_scratch;");
-  retval = drop_hardlink_scratch_space.Execute();
+  catalog::SqlCatalog drop_hardlink_members(writable,
+                                            "DROP TABLE hl_members;");
+  retval = drop_hardlink_scratch_space.Execute() &&
+           drop_hardlink_members.Execute();
   if (!retval) {
     Error("Failed to remove file linkcount analysis scratch table",
           drop_hardlink_scratch_space, data);
@@ -1507,6 +1573,8 @@ bool CommandMigrate::MigrationWorker_20x::GenerateCatalogStatistics(
   stats_counters.self.directories      = count_directories.RetrieveInt64(0);
   stats_counters.self.nested_catalogs  = data->nested_catalogs.size();
   stats_counters.self.file_size        = aggregate_file_size.RetrieveInt64(0);
+  // The summary is computed when the catalog is committed the next time
+  stats_counters.self.unsummarized     = 1;
 
   // Write back the generated statistics counters into the catalog database
   stats_counters.WriteToDatabase(writable);
@@ -1677,6 +1745,8 @@ bool CommandMigrate::MigrationWorker_217::GenerateNewStatisticsCounters
   stats_counters.self.chunked_file_size = count_chunked_files.RetrieveInt64(1);
   stats_counters.self.file_chunks       = count_file_chunks.RetrieveInt64(0);
   stats_counters.self.file_size         = aggregate_file_size.RetrieveInt64(0);
+  // The summary is computed when the catalog is committed the next time
+  stats_counters.self.unsummarized      = 1;
 
   // Write back the generated statistics counters into the catalog database
   catalog::Counters counters;
@@ -1685,6 +1755,9 @@ bool CommandMigrate::MigrationWorker_217::GenerateNewStatisticsCounters
     Error("Failed to read old catalog statistics counters", data);
     return false;
   }
+  // Unsummarized catalogs are counted by stats_counters
+  counters.self.unsummarized = 0;
+  counters.subtree.unsummarized = 0;
   counters.ApplyDelta(stats_counters);
   retval = counters.InsertIntoDatabase(writable);
   if (!retval) {
@@ -61,10 +61,13 @@ class CommandMigrate : public Command {
   struct PendingCatalog;
   typedef std::vector<PendingCatalog *> PendingCatalogList;
   struct PendingCatalog {
-    explicit PendingCatalog(const catalog::Catalog *old_catalog = NULL)
+    explicit PendingCatalog(const catalog::Catalog *old_catalog = NULL,
+                            PendingCatalog         *parent      = NULL)
       : success(false)
       , old_catalog(old_catalog)
       , new_catalog(NULL)
+      , parent(parent)
+      , num_pending_nested(0)
       , new_catalog_size(0) { }
     virtual ~PendingCatalog();
 
@@ -89,6 +92,10 @@ class CommandMigrate : public Command {
     catalog::WritableCatalog         *new_catalog;
 
     PendingCatalogList                nested_catalogs;
+    // Only touched by the thread that drives the migration: a catalog is
+    // scheduled as soon as all of its nested catalogs are finished
+    PendingCatalog                   *parent;
+    unsigned int                      num_pending_nested;
     Future<catalog::DirectoryEntry>   root_entry;
     Future<catalog::DeltaCounters>    nested_statistics;
 
@@ -321,6 +328,9 @@ class CommandMigrate : public Command {
 
   template <class MigratorT>
   void ConvertCatalogsRecursively(PendingCatalog *catalog, MigratorT *migrator);
+  template <class MigratorT>
+  void ScheduleFinishedParents(PendingCatalog *root_catalog,
+                               MigratorT      *migrator);
   bool RaiseFileDescriptorLimit() const;
   bool ConfigureSQLite() const;
   void AnalyzeCatalogStatistics() const;
@@ -350,6 +360,7 @@ class CommandMigrate : public Command {
   catalog::Catalog const*     root_catalog_;
   UniquePtr<upload::Spooler>  spooler_;
   PendingCatalogMap           pending_catalogs_;
+  UniquePtr<FifoChannel<PendingCatalog *> >  finished_catalogs_;
 
   StopWatch  catalog_loading_stopwatch_;
   StopWatch  migration_stopwatch_;
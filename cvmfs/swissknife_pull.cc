@@ -16,13 +16,17 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
+#include <set>
 #include <string>
 #include <vector>
 
 #include "atomic.h"
 #include "catalog.h"
+#include "catalog_diff_tool.h"
+#include "catalog_mgr_ro.h"
 #include "compression.h"
 #include "download.h"
 #include "hash.h"
@@ -35,6 +39,7 @@
 #include "reflog.h"
 #include "signature.h"
 #include "smalloc.h"
+#include "swissknife_pull_journal.h"
 #include "upload.h"
 #include "util/posix.h"
 #include "util/string.h"
@@ -47,6 +52,40 @@ namespace {
 
 typedef HttpObjectFetcher<> ObjectFetcher;
 
+/**
+ * A catalog of the replication.  Catalogs are stored only after their chunks
+ * and the catalogs they reference (nested catalogs, previous revisions) are
+ * stored.  So an existing catalog implies that its entire tree is present,
+ * which allows for skipping it in the next replication run.
+ *
+ * The number of pending tasks includes the processing of the catalog itself,
+ * its queued chunks, and its referenced catalogs that are not yet stored.
+ */
+struct CatalogNode {
+  CatalogNode(const shash::Any &hash, const string &path,
+              const bool apply_threshold, const bool head,
+              CatalogNode *parent)
+    : hash(hash)
+    , path(path)
+    , apply_threshold(apply_threshold)
+    , head(head)
+    , parent(parent)
+    , complete(false)
+  {
+    atomic_init64(&pending);
+    atomic_inc64(&pending);
+  }
+
+  const shash::Any hash;
+  const string path;
+  const bool apply_threshold;
+  const bool head;  ///< part of the revision that is going to be served
+  CatalogNode *parent;
+  string file_catalog_vanilla;  ///< to be stored, empty if nothing to store
+  atomic_int64 pending;
+  bool complete;
+};
+
 /**
  * This just stores an shash::Any in a predictable way to send it through a
  * POSIX pipe.
@@ -56,12 +95,15 @@ class ChunkJob {
   ChunkJob()
     : suffix(shash::kSuffixNone)
     , hash_algorithm(shash::kAny)
-    , compression_alg(zlib::kZlibDefault) {}
+    , compression_alg(zlib::kZlibDefault)
+    , catalog(NULL) {}
 
-  ChunkJob(const shash::Any &hash, zlib::Algorithms compression_alg)
+  ChunkJob(const shash::Any &hash, zlib::Algorithms compression_alg,
+           CatalogNode *catalog)
     : suffix(hash.suffix)
     , hash_algorithm(hash.algorithm)
     , compression_alg(compression_alg)
+    , catalog(catalog)
   {
     memcpy(digest, hash.digest, hash.GetDigestSize());
   }
@@ -80,6 +122,7 @@ class ChunkJob {
   const shash::Suffix      suffix;
   const shash::Algorithms  hash_algorithm;
   const zlib::Algorithms   compression_alg;
+  CatalogNode * const      catalog;
   unsigned char            digest[shash::kMaxDigestSize];
 };
 
@@ -99,7 +142,6 @@ string              *stratum1_url = NULL;
 string              *temp_dir = NULL;
 unsigned             num_parallel = 1;
 bool                 pull_history = false;
-bool                 apply_timestamp_threshold = false;
 uint64_t             timestamp_threshold = 0;
 bool                 is_garbage_collectable = false;
 bool                 initial_snapshot = false;
@@ -115,7 +157,21 @@ atomic_int64         chunk_queue;
 bool                 preload_cache = false;
 string              *preload_cachedir = NULL;
 bool                 inspect_existing_catalogs = false;
+bool                 pull_delta = false;
+// set while pulling the HEAD catalogs whose chunks were fetched by the delta
+bool                 skip_head_chunks = false;
+// set while pulling the trunk catalog of the HEAD revision
+bool                 pull_head = false;
+// new catalogs of the HEAD revision in the order they were stored
+vector<shash::Any>   head_catalogs;
 manifest::Reflog    *reflog = NULL;
+// catalogs without pending tasks, stored by the main thread
+vector<CatalogNode *> finished_catalogs;
+pthread_mutex_t      lock_finished_catalogs = PTHREAD_MUTEX_INITIALIZER;
+PullJournal         *journal = NULL;
+// processed chunks that are not yet recorded in the journal
+vector<shash::Any>   unjournaled_chunks;
+pthread_mutex_t      lock_unjournaled_chunks = PTHREAD_MUTEX_INITIALIZER;
 
 }  // anonymous namespace
 
@@ -133,6 +189,8 @@ static bool Peek(const string &remote_path) {
 }
 
 static bool Peek(const shash::Any &remote_hash) {
+  if ((journal != NULL) && journal->Contains(remote_hash))
+    return true;
   return Peek(MakePath(remote_hash));
 }
 
@@ -247,6 +305,35 @@ static void WaitForStorage() {
 }
 
 
+/**
+ * Stores the list of new catalogs of the HEAD revision, one URL path relative
+ * to the repository per line and starting with the root catalog.  These are
+ * the objects that all the clients request when they switch to the new
+ * revision.  Catalogs that were stored by an interrupted previous run are not
+ * listed.
+ */
+static void StoreHotObjects() {
+  string hot_objects;
+  for (unsigned i = head_catalogs.size(); i > 0; --i)
+    hot_objects += MakePath(head_catalogs[i - 1]) + "\n";
+  StoreBuffer(reinterpret_cast<const unsigned char *>(hot_objects.data()),
+              hot_objects.size(), ".cvmfshotobjects", false);
+}
+
+
+/**
+ * Drops one pending task of the catalog.  Catalogs without pending tasks are
+ * handed to the main thread for storing.
+ */
+static void ReleaseCatalog(CatalogNode *catalog) {
+  if (atomic_xadd64(&catalog->pending, -1) == 1) {
+    pthread_mutex_lock(&lock_finished_catalogs);
+    finished_catalogs.push_back(catalog);
+    pthread_mutex_unlock(&lock_finished_catalogs);
+  }
+}
+
+
 struct MainWorkerContext {
   download::DownloadManager *download_manager;
 };
@@ -290,16 +377,27 @@ static void *MainWorker(void *data) {
     }
     if (atomic_xadd64(&overall_chunks, 1) % 1000 == 0)
       LogCvmfs(kLogCvmfs, kLogStdout | kLogNoLinebreak, ".");
+    if (journal != NULL) {
+      pthread_mutex_lock(&lock_unjournaled_chunks);
+      unjournaled_chunks.push_back(chunk_hash);
+      pthread_mutex_unlock(&lock_unjournaled_chunks);
+    }
+    if (next_chunk.catalog != NULL)
+      ReleaseCatalog(next_chunk.catalog);
     atomic_dec64(&chunk_queue);
   }
   return NULL;
 }
 
 
-bool CommandPull::PullRecursion(catalog::Catalog   *catalog,
-                                const std::string  &path) {
-  assert(catalog);
-
+/**
+ * Creates the nodes of the previous revision and of the nested catalogs.
+ */
+static void ListReferencedCatalogs(
+  const catalog::Catalog *catalog,
+  CatalogNode *node,
+  vector<CatalogNode *> *referenced)
+{
   // Previous catalogs
   if (pull_history) {
     shash::Any previous_catalog = catalog->GetPreviousRevision();
@@ -308,35 +406,42 @@ bool CommandPull::PullRecursion(catalog::Catalog   *catalog,
     } else {
       LogCvmfs(kLogCvmfs, kLogStdout, "Replicating from historic catalog %s",
                previous_catalog.ToString().c_str());
-      bool retval = Pull(previous_catalog, path);
-      if (!retval)
-        return false;
+      atomic_inc64(&node->pending);
+      referenced->push_back(
+        new CatalogNode(previous_catalog, node->path, true, false, node));
     }
   }
 
-  // Nested catalogs (in a nested code block because goto fail...)
+  // Nested catalogs
+  const catalog::Catalog::NestedCatalogList nested_catalogs =
+    catalog->ListOwnNestedCatalogs();
+  for (catalog::Catalog::NestedCatalogList::const_iterator i =
+       nested_catalogs.begin(), iEnd = nested_catalogs.end();
+       i != iEnd; ++i)
   {
-    const catalog::Catalog::NestedCatalogList nested_catalogs =
-      catalog->ListOwnNestedCatalogs();
-    for (catalog::Catalog::NestedCatalogList::const_iterator i =
-         nested_catalogs.begin(), iEnd = nested_catalogs.end();
-         i != iEnd; ++i)
-    {
-      LogCvmfs(kLogCvmfs, kLogStdout, "Replicating from catalog at %s",
-               i->mountpoint.c_str());
-      bool retval = Pull(i->hash, i->mountpoint.ToString());
-      if (!retval)
-        return false;
-    }
+    LogCvmfs(kLogCvmfs, kLogStdout, "Replicating from catalog at %s",
+             i->mountpoint.c_str());
+    atomic_inc64(&node->pending);
+    referenced->push_back(
+      new CatalogNode(i->hash, i->mountpoint.ToString(), true, node->head,
+                      node));
   }
-
-  return true;
 }
 
-bool CommandPull::Pull(const shash::Any   &catalog_hash,
-                       const std::string  &path) {
+
+/**
+ * Downloads a catalog, queues its chunks and lists its referenced catalogs.
+ * Runs concurrently for the catalogs of a level.
+ */
+static bool ProcessCatalog(
+  download::DownloadManager *download_manager,
+  CatalogNode *node,
+  vector<CatalogNode *> *referenced)
+{
   int retval;
   download::Failures dl_retval;
+  const shash::Any &catalog_hash = node->hash;
+  const string &path = node->path;
   assert(shash::kSuffixCatalog == catalog_hash.suffix);
 
   // Check if the catalog already exists
@@ -354,12 +459,13 @@ bool CommandPull::Pull(const shash::Any   &catalog_hash,
                  catalog_hash.ToString().c_str());
         return false;
       }
-      bool retval = PullRecursion(catalog, path);
+      ListReferencedCatalogs(catalog, node, referenced);
       delete catalog;
-      return retval;
+      return true;
     }
 
-    LogCvmfs(kLogCvmfs, kLogStdout, "  Catalog up to date");
+    LogCvmfs(kLogCvmfs, kLogStdout, "  Catalog %s up to date",
+             catalog_hash.ToString().c_str());
     return true;
   }
 
@@ -372,9 +478,6 @@ bool CommandPull::Pull(const shash::Any   &catalog_hash,
     return true;
   }
 
-  int64_t gauge_chunks = atomic_read64(&overall_chunks);
-  int64_t gauge_new = atomic_read64(&overall_new);
-
   // Download and uncompress catalog
   shash::Any chunk_hash;
   zlib::Algorithms compression_alg;
@@ -398,7 +501,7 @@ bool CommandPull::Pull(const shash::Any   &catalog_hash,
   const string url_catalog = *stratum0_url + "/data/" + catalog_hash.MakePath();
   download::JobInfo download_catalog(&url_catalog, false, false,
                                      fcatalog_vanilla, &catalog_hash);
-  dl_retval = download_manager()->Fetch(&download_catalog);
+  dl_retval = download_manager->Fetch(&download_catalog);
   fclose(fcatalog_vanilla);
   if (dl_retval != download::kFailOk) {
     if (path == "" && is_garbage_collectable) {
@@ -417,12 +520,6 @@ bool CommandPull::Pull(const shash::Any   &catalog_hash,
              file_catalog_vanilla.c_str(), catalog_hash.ToString().c_str());
     goto pull_cleanup;
   }
-  if (path.empty() && reflog != NULL) {
-    if (!reflog->AddCatalog(catalog_hash)) {
-      LogCvmfs(kLogCvmfs, kLogStderr, "failed to add catalog to Reflog.");
-      goto pull_cleanup;
-    }
-  }
 
   catalog = catalog::Catalog::AttachFreely(path, file_catalog, catalog_hash);
   if (catalog == NULL) {
@@ -432,7 +529,7 @@ bool CommandPull::Pull(const shash::Any   &catalog_hash,
   }
 
   // Always pull the HEAD root catalog and nested catalogs
-  if (apply_timestamp_threshold && (path == "") &&
+  if (node->apply_threshold && (path == "") &&
       (catalog->GetLastModified() < timestamp_threshold))
   {
     LogCvmfs(kLogCvmfs, kLogStdout,
@@ -442,37 +539,46 @@ bool CommandPull::Pull(const shash::Any   &catalog_hash,
     delete catalog;
     goto pull_skip;
   }
-  apply_timestamp_threshold = true;
 
-  // Traverse the chunks
-  LogCvmfs(kLogCvmfs, kLogStdout | kLogNoLinebreak,
-           "  Processing chunks [%" PRIu64 " registered chunks]: ",
-           catalog->GetNumChunks());
+  if (skip_head_chunks) {
+    LogCvmfs(kLogCvmfs, kLogStdout, "  Chunks of %s are part of the delta",
+             catalog_hash.ToString().c_str());
+    ListReferencedCatalogs(catalog, node, referenced);
+    delete catalog;
+    unlink(file_catalog.c_str());
+    node->file_catalog_vanilla = file_catalog_vanilla;
+    return true;
+  }
+
+  // Queue the chunks, the catalog is pending until they are stored
+  LogCvmfs(kLogCvmfs, kLogStdout,
+           "  Processing chunks of %s [%" PRIu64 " registered chunks]",
+           catalog_hash.ToString().c_str(), catalog->GetNumChunks());
   retval = catalog->AllChunksBegin();
   if (!retval) {
     LogCvmfs(kLogCvmfs, kLogStderr, "failed to gather chunks");
     goto pull_cleanup;
   }
   while (catalog->AllChunksNext(&chunk_hash, &compression_alg)) {
-    ChunkJob next_chunk(chunk_hash, compression_alg);
-    WritePipe(pipe_chunks[1], &next_chunk, sizeof(next_chunk));
+    ChunkJob next_chunk(chunk_hash, compression_alg, node);
+    atomic_inc64(&node->pending);
     atomic_inc64(&chunk_queue);
+    WritePipe(pipe_chunks[1], &next_chunk, sizeof(next_chunk));
   }
   catalog->AllChunksEnd();
-  while (atomic_read64(&chunk_queue) != 0) {
-    SafeSleepMs(100);
+  // The read-optimized index is stored like a regular data object
+  if (!catalog->GetIndexHash().IsNull()) {
+    ChunkJob index_job(catalog->GetIndexHash(), zlib::kZlibDefault, node);
+    atomic_inc64(&node->pending);
+    atomic_inc64(&chunk_queue);
+    WritePipe(pipe_chunks[1], &index_job, sizeof(index_job));
   }
-  LogCvmfs(kLogCvmfs, kLogStdout, " fetched %" PRId64 " new chunks out of "
-           "%" PRId64 " unique chunks",
-           atomic_read64(&overall_new)-gauge_new,
-           atomic_read64(&overall_chunks)-gauge_chunks);
 
-  retval = PullRecursion(catalog, path);
+  ListReferencedCatalogs(catalog, node, referenced);
 
   delete catalog;
   unlink(file_catalog.c_str());
-  WaitForStorage();
-  Store(file_catalog_vanilla, catalog_hash);
+  node->file_catalog_vanilla = file_catalog_vanilla;
   return true;
 
  pull_cleanup:
@@ -488,6 +594,302 @@ bool CommandPull::Pull(const shash::Any   &catalog_hash,
 }
 
 
+/**
+ * State of a level of catalogs shared by the catalog threads.
+ */
+struct CatalogWorkerContext {
+  CatalogWorkerContext(download::DownloadManager *dm,
+                       const vector<CatalogNode *> *l)
+    : download_manager(dm), level(l)
+  {
+    atomic_init32(&next_catalog);
+    atomic_init32(&num_failures);
+    int retval = pthread_mutex_init(&lock_next_level, NULL);
+    assert(retval == 0);
+  }
+  ~CatalogWorkerContext() {
+    pthread_mutex_destroy(&lock_next_level);
+  }
+
+  download::DownloadManager *download_manager;
+  const vector<CatalogNode *> *level;
+  vector<CatalogNode *> next_level;
+  atomic_int32 next_catalog;
+  atomic_int32 num_failures;
+  pthread_mutex_t lock_next_level;
+};
+
+static void *MainCatalogWorker(void *data) {
+  CatalogWorkerContext *ctx = static_cast<CatalogWorkerContext *>(data);
+  const int32_t num_catalogs = static_cast<int32_t>(ctx->level->size());
+  while (atomic_read32(&ctx->num_failures) == 0) {
+    const int32_t idx = atomic_xadd32(&ctx->next_catalog, 1);
+    if (idx >= num_catalogs)
+      break;
+    CatalogNode *node = (*ctx->level)[idx];
+    vector<CatalogNode *> referenced;
+    const bool retval =
+      ProcessCatalog(ctx->download_manager, node, &referenced);
+    pthread_mutex_lock(&ctx->lock_next_level);
+    ctx->next_level.insert(ctx->next_level.end(),
+                           referenced.begin(), referenced.end());
+    pthread_mutex_unlock(&ctx->lock_next_level);
+    if (!retval) {
+      atomic_inc32(&ctx->num_failures);
+      break;
+    }
+    ReleaseCatalog(node);
+  }
+  return NULL;
+}
+
+
+/**
+ * Stores the catalogs whose chunks and referenced catalogs are stored.  Only
+ * then the parent catalogs lose their pending task.  The chunks and catalogs
+ * are recorded in the journal once the storage confirmed them.
+ */
+static bool StoreFinishedCatalogs() {
+  vector<CatalogNode *> catalogs;
+  vector<shash::Any> chunks;
+  pthread_mutex_lock(&lock_finished_catalogs);
+  catalogs.swap(finished_catalogs);
+  pthread_mutex_unlock(&lock_finished_catalogs);
+  if (journal != NULL) {
+    pthread_mutex_lock(&lock_unjournaled_chunks);
+    chunks.swap(unjournaled_chunks);
+    pthread_mutex_unlock(&lock_unjournaled_chunks);
+  }
+  if (catalogs.empty() && chunks.empty())
+    return true;
+
+  WaitForStorage();
+  if ((journal != NULL) && !journal->AddObjects(chunks))
+    return false;
+  vector<shash::Any> stored_catalogs;
+  for (unsigned i = 0; i < catalogs.size(); ++i) {
+    CatalogNode *node = catalogs[i];
+    if (node->file_catalog_vanilla.empty())
+      continue;
+    if (node->path.empty() && reflog != NULL) {
+      if (!reflog->AddCatalog(node->hash)) {
+        LogCvmfs(kLogCvmfs, kLogStderr, "failed to add catalog to Reflog.");
+        return false;
+      }
+    }
+    Store(node->file_catalog_vanilla, node->hash);
+    node->file_catalog_vanilla.clear();
+    stored_catalogs.push_back(node->hash);
+    if (node->head)
+      head_catalogs.push_back(node->hash);
+  }
+  WaitForStorage();
+  for (unsigned i = 0; i < stored_catalogs.size(); ++i) {
+    if ((journal != NULL) && !journal->AddCatalog(stored_catalogs[i]))
+      return false;
+  }
+  for (unsigned i = 0; i < catalogs.size(); ++i) {
+    catalogs[i]->complete = true;
+    if (catalogs[i]->parent != NULL)
+      ReleaseCatalog(catalogs[i]->parent);
+  }
+  return true;
+}
+
+
+namespace {
+
+/**
+ * Queues the objects of the files that were added or modified between two
+ * revisions.  With several diff workers, the reports come from several
+ * threads.
+ */
+class DeltaCollector : public CatalogDiffTool<catalog::SimpleCatalogManager> {
+ public:
+  DeltaCollector(catalog::SimpleCatalogManager *old_catalog_mgr,
+                 catalog::SimpleCatalogManager *new_catalog_mgr)
+    : CatalogDiffTool<catalog::SimpleCatalogManager>(old_catalog_mgr,
+                                                     new_catalog_mgr)
+    , new_catalog_mgr_(new_catalog_mgr)
+    , num_failures_(0)
+  {
+    int retval = pthread_mutex_init(&lock_, NULL);
+    assert(retval == 0);
+  }
+  virtual ~DeltaCollector() {
+    pthread_mutex_destroy(&lock_);
+  }
+
+  unsigned num_objects() const { return queued_.size(); }
+  unsigned num_failures() const { return num_failures_; }
+
+ protected:
+  virtual void ReportAddition(const PathString &path,
+                              const catalog::DirectoryEntry &entry,
+                              const XattrList & /* xattrs */)
+  {
+    QueueEntry(path, entry);
+  }
+  virtual void ReportRemoval(const PathString & /* path */,
+                             const catalog::DirectoryEntry & /* entry */)
+  { }
+  virtual void ReportModification(const PathString &path,
+                                  const catalog::DirectoryEntry & /* old */,
+                                  const catalog::DirectoryEntry &new_entry,
+                                  const XattrList & /* xattrs */)
+  {
+    QueueEntry(path, new_entry);
+  }
+
+ private:
+  void QueueEntry(const PathString &path,
+                  const catalog::DirectoryEntry &entry)
+  {
+    if (!entry.IsRegular() || entry.IsExternalFile())
+      return;
+    if (!entry.checksum().IsNull())
+      QueueObject(entry.checksum(), entry.compression_algorithm());
+    if (!entry.IsChunkedFile())
+      return;
+
+    FileChunkList chunks;
+    if (!new_catalog_mgr_->ListFileChunks(path, entry.hash_algorithm(),
+                                          &chunks))
+    {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to list chunks of %s",
+               path.c_str());
+      MutexLockGuard guard(lock_);
+      num_failures_++;
+      return;
+    }
+    for (unsigned i = 0; i < chunks.size(); ++i) {
+      QueueObject(chunks.AtPtr(i)->content_hash(),
+                  entry.compression_algorithm());
+    }
+  }
+
+  void QueueObject(const shash::Any &hash,
+                   const zlib::Algorithms compression_alg)
+  {
+    {
+      MutexLockGuard guard(lock_);
+      if (!queued_.insert(hash).second)
+        return;
+    }
+    ChunkJob next_chunk(hash, compression_alg, NULL);
+    atomic_inc64(&chunk_queue);
+    WritePipe(pipe_chunks[1], &next_chunk, sizeof(next_chunk));
+  }
+
+  catalog::SimpleCatalogManager *new_catalog_mgr_;
+  pthread_mutex_t lock_;
+  std::set<shash::Any> queued_;
+  unsigned num_failures_;
+};
+
+}  // anonymous namespace
+
+
+/**
+ * Fetches the objects of the files that changed between the revision on the
+ * stratum 1 and the new revision.  Nested catalogs that are identical in both
+ * revisions are not even downloaded.  Returns false if the delta is
+ * incomplete, in which case the new revision is replicated in full.
+ */
+static bool PullDelta(download::DownloadManager *download_manager,
+                      const shash::Any &old_root_hash,
+                      const shash::Any &new_root_hash)
+{
+  perf::Statistics statistics_old;
+  perf::Statistics statistics_new;
+  catalog::SimpleCatalogManager *old_catalog_mgr =
+    new catalog::SimpleCatalogManager(old_root_hash, *stratum1_url, *temp_dir,
+                                      download_manager, &statistics_old, true);
+  catalog::SimpleCatalogManager *new_catalog_mgr =
+    new catalog::SimpleCatalogManager(new_root_hash, *stratum0_url, *temp_dir,
+                                      download_manager, &statistics_new, true);
+  // Takes ownership of the catalog managers
+  DeltaCollector delta(old_catalog_mgr, new_catalog_mgr);
+  if (!old_catalog_mgr->Init() || !new_catalog_mgr->Init()) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to load the root catalogs of the "
+             "delta, replicating the full revision");
+    return false;
+  }
+
+  delta.SetNumWorkers(num_parallel);
+  delta.Run(PathString(""));
+  while (atomic_read64(&chunk_queue) != 0)
+    SafeSleepMs(100);
+  if (delta.num_failures() > 0) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "incomplete delta, replicating the full "
+             "revision");
+    return false;
+  }
+  LogCvmfs(kLogCvmfs, kLogStdout, " %u objects changed",
+           delta.num_objects());
+  return StoreFinishedCatalogs();
+}
+
+
+/**
+ * Replicates the catalog tree level by level.  The catalogs of a level are
+ * downloaded concurrently by num_parallel threads, their chunks are queued for
+ * the workers as soon as a catalog is opened.
+ */
+bool CommandPull::Pull(const shash::Any &catalog_hash,
+                       const bool apply_threshold) {
+  int64_t gauge_chunks = atomic_read64(&overall_chunks);
+  int64_t gauge_new = atomic_read64(&overall_new);
+
+  CatalogNode *root =
+    new CatalogNode(catalog_hash, "", apply_threshold, pull_head, NULL);
+  vector<CatalogNode *> nodes(1, root);
+  vector<CatalogNode *> level(1, root);
+  bool retval = true;
+  while (retval && !level.empty()) {
+    CatalogWorkerContext ctx(download_manager(), &level);
+    const unsigned num_threads =
+      std::min(std::max(num_parallel, 1U), static_cast<unsigned>(level.size()));
+    vector<pthread_t> threads(num_threads);
+    for (unsigned i = 0; i < num_threads; ++i) {
+      int retval_thread = pthread_create(&threads[i], NULL, MainCatalogWorker,
+                                         static_cast<void *>(&ctx));
+      assert(retval_thread == 0);
+    }
+    for (unsigned i = 0; i < num_threads; ++i)
+      pthread_join(threads[i], NULL);
+
+    nodes.insert(nodes.end(), ctx.next_level.begin(), ctx.next_level.end());
+    level.swap(ctx.next_level);
+    retval = (atomic_read32(&ctx.num_failures) == 0) &&
+             StoreFinishedCatalogs();
+  }
+
+  while (retval && !root->complete) {
+    SafeSleepMs(100);
+    retval = StoreFinishedCatalogs();
+  }
+
+  // Chunks in flight refer to the catalog nodes
+  while (atomic_read64(&chunk_queue) != 0)
+    SafeSleepMs(100);
+  pthread_mutex_lock(&lock_finished_catalogs);
+  finished_catalogs.clear();
+  pthread_mutex_unlock(&lock_finished_catalogs);
+  for (unsigned i = 0; i < nodes.size(); ++i) {
+    if (!nodes[i]->file_catalog_vanilla.empty())
+      unlink(nodes[i]->file_catalog_vanilla.c_str());
+    delete nodes[i];
+  }
+
+  LogCvmfs(kLogCvmfs, kLogStdout, " fetched %" PRId64 " new chunks out of "
+           "%" PRId64 " unique chunks",
+           atomic_read64(&overall_new)-gauge_new,
+           atomic_read64(&overall_chunks)-gauge_chunks);
+  return retval;
+}
+
+
 int swissknife::CommandPull::Main(const swissknife::ArgumentList &args) {
   int retval;
   manifest::Failures m_retval;
@@ -553,6 +955,22 @@ int swissknife::CommandPull::Main(const swissknife::ArgumentList &args) {
   if (args.find('Z') != args.end()) {
     timestamp_threshold = String2Int64(*args.find('Z')->second);
   }
+  if (args.find('e') != args.end()) {
+    if (preload_cache || pull_history || initial_snapshot ||
+        (pathfilter != NULL))
+    {
+      LogCvmfs(kLogCvmfs, kLogStdout,
+               "Warning: -e is ignored together with -c, -p, -i, or -d");
+    } else {
+      pull_delta = true;
+    }
+  }
+  string journal_path;
+  if (args.find('j') != args.end())
+    journal_path = *args.find('j')->second;
+  string inventory_path;
+  if (args.find('I') != args.end())
+    inventory_path = *args.find('I')->second;
 
   if (!preload_cache && stratum1_url == NULL) {
     LogCvmfs(kLogCvmfs, kLogStderr, "need -w <stratum 1 URL>");
@@ -669,6 +1087,16 @@ int swissknife::CommandPull::Main(const swissknife::ArgumentList &args) {
 
   is_garbage_collectable = ensemble.manifest->garbage_collectable();
 
+  // Objects that are known to be stored are not looked up on the target
+  if (!journal_path.empty() || !inventory_path.empty()) {
+    journal =
+      PullJournal::Open(journal_path, ensemble.manifest->catalog_hash());
+    if (journal == NULL)
+      goto fini;
+    if (!inventory_path.empty() && !journal->LoadInventory(inventory_path))
+      goto fini;
+  }
+
   // Manifest available, now the spooler's hash algorithm can be determined
   // That doesn't actually matter because the replication does no re-hashing
   if (!preload_cache) {
@@ -768,6 +1196,25 @@ int swissknife::CommandPull::Main(const swissknife::ArgumentList &args) {
     }
   }
 
+  // The tag index is published along with the history database
+  if (!ensemble.manifest->tag_index().IsNull() && !preload_cache) {
+    shash::Any tag_index_hash = ensemble.manifest->tag_index();
+    const string tag_index_url = *stratum0_url + "/data/"
+                                               + tag_index_hash.MakePath();
+    const string tag_index_path = *temp_dir + "/" + tag_index_hash.ToString();
+    download::JobInfo download_tag_index(&tag_index_url, false, false,
+                                         &tag_index_path,
+                                         &tag_index_hash);
+    dl_retval = download_manager()->Fetch(&download_tag_index);
+    if (dl_retval != download::kFailOk) {
+      ReportDownloadError(tag_index_hash, dl_retval);
+      goto fini;
+    }
+    Store(tag_index_path, tag_index_hash);
+    WaitForStorage();
+    unlink(tag_index_path.c_str());
+  }
+
   // Starting threads
   MakePipe(pipe_chunks);
   LogCvmfs(kLogCvmfs, kLogStdout, "Starting %u workers", num_parallel);
@@ -779,9 +1226,33 @@ int swissknife::CommandPull::Main(const swissknife::ArgumentList &args) {
     assert(retval == 0);
   }
 
+  // Only fetch the objects that changed since the revision on the stratum 1
+  if (pull_delta) {
+    manifest::ManifestEnsemble ensemble_stratum1;
+    const manifest::Failures retval_stratum1 = FetchRemoteManifestEnsemble(
+      *stratum1_url, repository_name, &ensemble_stratum1);
+    if (retval_stratum1 != manifest::kFailOk) {
+      LogCvmfs(kLogCvmfs, kLogStdout, "no revision on the stratum 1 (%d - %s), "
+               "replicating the full revision",
+               retval_stratum1, manifest::Code2Ascii(retval_stratum1));
+    } else if (ensemble_stratum1.manifest->catalog_hash() !=
+               ensemble.manifest->catalog_hash())
+    {
+      LogCvmfs(kLogCvmfs, kLogStdout, "Replicating the changes since "
+               "revision %" PRIu64, ensemble_stratum1.manifest->revision());
+      skip_head_chunks =
+        PullDelta(download_manager(),
+                  ensemble_stratum1.manifest->catalog_hash(),
+                  ensemble.manifest->catalog_hash());
+    }
+  }
+
   LogCvmfs(kLogCvmfs, kLogStdout, "Replicating from trunk catalog at /");
-  retval = Pull(ensemble.manifest->catalog_hash(), "");
+  pull_head = true;
+  retval = Pull(ensemble.manifest->catalog_hash(), false);
+  pull_head = false;
   pull_history = false;
+  skip_head_chunks = false;
   if (!historic_tags.empty()) {
     LogCvmfs(kLogCvmfs, kLogStdout, "Checking tagged snapshots...");
   }
@@ -793,8 +1264,7 @@ int swissknife::CommandPull::Main(const swissknife::ArgumentList &args) {
       continue;
     LogCvmfs(kLogCvmfs, kLogStdout, "Replicating from %s repository tag",
              i->name.c_str());
-    apply_timestamp_threshold = false;
-    bool retval2 = Pull(i->root_hash, "");
+    bool retval2 = Pull(i->root_hash, false);
     retval = retval && retval2;
   }
 
@@ -862,6 +1332,9 @@ int swissknife::CommandPull::Main(const swissknife::ArgumentList &args) {
       bool retval = ensemble.manifest->ExportChecksum(*preload_cachedir, 0660);
       assert(retval);
     } else {
+      // Precedes the manifest, so that proxies can be warmed before clients
+      // switch to the new revision
+      StoreHotObjects();
       // pkcs#7 structure contains content + certificate + signature
       // So there is no race with whitelist and pkcs7 signature being out of
       // sync
@@ -882,6 +1355,8 @@ int swissknife::CommandPull::Main(const swissknife::ArgumentList &args) {
   LogCvmfs(kLogCvmfs, kLogStdout, "Fetched %" PRId64 " new chunks out of %"
            PRId64 " processed chunks",
            atomic_read64(&overall_new), atomic_read64(&overall_chunks));
+  if (journal != NULL)
+    journal->Remove();
   result = 0;
 
  fini:
@@ -890,6 +1365,8 @@ int swissknife::CommandPull::Main(const swissknife::ArgumentList &args) {
   free(workers);
   delete spooler;
   delete pathfilter;
+  delete journal;
+  journal = NULL;
   return result;
 }
 
@@ -9,10 +9,6 @@
 
 #include "swissknife.h"
 
-namespace catalog {
-class Catalog;
-}
-
 namespace shash {
 struct Any;
 }
@@ -42,9 +38,13 @@ class CommandPull : public Command {
     r.push_back(Parameter::Optional('a', "number of retries"));
     r.push_back(Parameter::Optional('d', "directory for path specification"));
     r.push_back(Parameter::Optional('Z', "pull revisions younger than <Z>"));
+    r.push_back(Parameter::Optional('j', "journal to resume a pull"));
+    r.push_back(Parameter::Optional('I', "inventory of present objects"));
     r.push_back(Parameter::Switch('p', "pull catalog history, too"));
     r.push_back(Parameter::Switch('i', "mark as an 'initial snapshot'"));
     r.push_back(Parameter::Switch('c', "preload cache instead of stratum 1"));
+    r.push_back(Parameter::Switch('e', "only fetch objects changed since the "
+                                       "revision on the stratum 1"));
     // Required for preloading client cache with a dirtab.  If the dirtab
     // changes, the existence of a catalog does not anymore indicate if
     // everything in the corresponding subtree is already fetched, too.
@@ -55,8 +55,7 @@ class CommandPull : public Command {
   int Main(const ArgumentList &args);
 
  protected:
-  bool PullRecursion(catalog::Catalog *catalog, const std::string &path);
-  bool Pull(const shash::Any &catalog_hash, const std::string &path);
+  bool Pull(const shash::Any &catalog_hash, const bool apply_threshold);
 };
 
 }  // namespace swissknife
@@ -0,0 +1,173 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "swissknife_pull_journal.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+
+#include "logging.h"
+#include "util/pointer.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace swissknife {
+
+PullJournal::PullJournal(const string &path)
+  : path_(path)
+  , file_(NULL)
+  , num_objects_(0)
+  , num_catalogs_(0)
+{ }
+
+
+PullJournal::~PullJournal() {
+  if (file_ != NULL)
+    fclose(file_);
+}
+
+
+PullJournal *PullJournal::Open(const string &path, const shash::Any &root_hash)
+{
+  UniquePtr<PullJournal> journal(new PullJournal(path));
+  if (path.empty())
+    return journal.Release();
+
+  if (journal->Load(root_hash)) {
+    journal->file_ = fopen(path.c_str(), "a");
+  } else {
+    journal->file_ = fopen(path.c_str(), "w");
+    if ((journal->file_ != NULL) &&
+        (!journal->Append('R', root_hash) || (fflush(journal->file_) != 0)))
+    {
+      return NULL;
+    }
+  }
+  if (journal->file_ == NULL) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to open pull journal %s (%d)",
+             path.c_str(), errno);
+    return NULL;
+  }
+  return journal.Release();
+}
+
+
+/**
+ * Reads the records of an existing journal.  Returns false if there is no
+ * journal for root_hash.  Lines that cannot be parsed, such as a last line
+ * that was cut short, are skipped.
+ */
+bool PullJournal::Load(const shash::Any &root_hash) {
+  FILE *f = fopen(path_.c_str(), "r");
+  if (f == NULL)
+    return false;
+
+  string line;
+  if (!GetLineFile(f, &line) || (line.empty()) || (line[0] != 'R') ||
+      (shash::MkFromSuffixedHexPtr(shash::HexPtr(line.substr(1))) !=
+       root_hash))
+  {
+    LogCvmfs(kLogCvmfs, kLogStdout, "starting new pull journal for %s",
+             root_hash.ToString().c_str());
+    fclose(f);
+    return false;
+  }
+
+  while (GetLineFile(f, &line)) {
+    if (line.length() < 2)
+      continue;
+    const shash::Any hash =
+      shash::MkFromSuffixedHexPtr(shash::HexPtr(line.substr(1)));
+    if (hash.IsNull())
+      continue;
+    if (line[0] == 'O') {
+      known_.Fill(hash);
+      num_objects_++;
+    } else if (line[0] == 'C') {
+      known_.Fill(hash);
+      num_catalogs_++;
+    }
+  }
+  fclose(f);
+  LogCvmfs(kLogCvmfs, kLogStdout, "resuming pull of %s: %u catalogs and "
+           "%u objects are already stored",
+           root_hash.ToString().c_str(), num_catalogs_, num_objects_);
+  return true;
+}
+
+
+shash::Any PullJournal::ParseInventoryLine(const string &line) {
+  string hash_str = Trim(line);
+  if (HasPrefix(hash_str, "data/", false))
+    hash_str = hash_str.substr(5);
+  if ((hash_str.length() > 2) && (hash_str[2] == '/'))
+    hash_str.erase(2, 1);
+  return shash::MkFromSuffixedHexPtr(shash::HexPtr(hash_str));
+}
+
+
+bool PullJournal::LoadInventory(const string &path) {
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to open inventory %s (%d)",
+             path.c_str(), errno);
+    return false;
+  }
+  string line;
+  unsigned num_inventory = 0;
+  while (GetLineFile(f, &line)) {
+    const shash::Any hash = ParseInventoryLine(line);
+    if (hash.IsNull())
+      continue;
+    known_.Fill(hash);
+    num_inventory++;
+  }
+  fclose(f);
+  LogCvmfs(kLogCvmfs, kLogStdout, "inventory %s lists %u objects",
+           path.c_str(), num_inventory);
+  return true;
+}
+
+
+bool PullJournal::Append(const char type, const shash::Any &hash) {
+  if (fprintf(file_, "%c%s\n", type, hash.ToStringWithSuffix().c_str()) < 0) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to write pull journal %s (%d)",
+             path_.c_str(), errno);
+    return false;
+  }
+  return true;
+}
+
+
+bool PullJournal::AddObjects(const vector<shash::Any> &hashes) {
+  if (file_ == NULL)
+    return true;
+  for (unsigned i = 0; i < hashes.size(); ++i) {
+    if (!Append('O', hashes[i]))
+      return false;
+  }
+  return fflush(file_) == 0;
+}
+
+
+bool PullJournal::AddCatalog(const shash::Any &hash) {
+  if (file_ == NULL)
+    return true;
+  return Append('C', hash) && (fflush(file_) == 0);
+}
+
+
+void PullJournal::Remove() {
+  if (file_ == NULL)
+    return;
+  fclose(file_);
+  file_ = NULL;
+  unlink(path_.c_str());
+}
+
+}  // namespace swissknife
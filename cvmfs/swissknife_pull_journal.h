@@ -0,0 +1,80 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * The pull journal records the progress of a replication towards a root
+ * catalog: the objects and the catalogs that are known to be stored on the
+ * target.  An interrupted pull that is restarted for the same root catalog
+ * skips them without looking them up on the target.  Additionally, an
+ * inventory of objects present on the target can be loaded, e.g. a listing of
+ * the data directory of a local stratum 1.
+ *
+ * The journal is a text file with one record per line:
+ *   R<root catalog hash>
+ *   O<object hash>
+ *   C<catalog hash>
+ * Records are appended only once the objects are stored, so a journal that is
+ * cut short by a crash just lacks some progress.
+ */
+
+#ifndef CVMFS_SWISSKNIFE_PULL_JOURNAL_H_
+#define CVMFS_SWISSKNIFE_PULL_JOURNAL_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "garbage_collection/hash_filter.h"
+#include "hash.h"
+#include "util/single_copy.h"
+
+namespace swissknife {
+
+class PullJournal : SingleCopy {
+ public:
+  /**
+   * Continues the journal at path if it belongs to root_hash, otherwise the
+   * journal is started over.  With an empty path, nothing is recorded.
+   */
+  static PullJournal *Open(const std::string &path,
+                           const shash::Any &root_hash);
+  ~PullJournal();
+
+  /**
+   * Adds the objects of an inventory, one object per line given either as
+   * hash or as path in the data directory (ab/cdef..., data/ab/cdef...).
+   */
+  bool LoadInventory(const std::string &path);
+
+  bool AddObjects(const std::vector<shash::Any> &hashes);
+  bool AddCatalog(const shash::Any &hash);
+  /**
+   * Removes the journal after the replication finished
+   */
+  void Remove();
+
+  /**
+   * Safe to call concurrently, records added in this run are not included.
+   */
+  bool Contains(const shash::Any &hash) const {
+    return known_.Contains(hash);
+  }
+  unsigned num_objects() const { return num_objects_; }
+  unsigned num_catalogs() const { return num_catalogs_; }
+
+  static shash::Any ParseInventoryLine(const std::string &line);
+
+ private:
+  explicit PullJournal(const std::string &path);
+  bool Load(const shash::Any &root_hash);
+  bool Append(const char type, const shash::Any &hash);
+
+  std::string path_;
+  FILE *file_;
+  SmallhashFilter known_;
+  unsigned num_objects_;
+  unsigned num_catalogs_;
+};
+
+}  // namespace swissknife
+
+#endif  // CVMFS_SWISSKNIFE_PULL_JOURNAL_H_
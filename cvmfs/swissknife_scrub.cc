@@ -7,10 +7,22 @@
 #include "swissknife_scrub.h"
 #include "cvmfs_config.h"
 
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+
+#include "backoff.h"
 #include "fs_traversal.h"
 #include "logging.h"
+#include "platform.h"
 #include "smalloc.h"
 #include "util/posix.h"
+#include "util/string.h"
 
 using namespace std;  // NOLINT
 
@@ -19,18 +31,25 @@ namespace swissknife {
 const size_t kHashSubtreeLength = 2;
 const std::string kTxnDirectoryName = "txn";
 
+const size_t CommandScrub::kBlockSize;
+const size_t CommandScrub::kBlockAlignment;
+
 CommandScrub::CommandScrub()
-    : machine_readable_output_(false), reader_(NULL), alerts_(0) {
+    : machine_readable_output_(false)
+    , use_direct_io_(false)
+    , progress_interval_s_(0)
+    , throttle_(NULL)
+    , alerts_(0) {
+  pipe_terminate_[0] = pipe_terminate_[1] = -1;
   // initialize alert printer mutex
   const bool mutex_init = (pthread_mutex_init(&alerts_mutex_, NULL) == 0);
   assert(mutex_init);
 }
 
 CommandScrub::~CommandScrub() {
-  if (reader_ != NULL) {
-    delete reader_;
-    reader_ = NULL;
-  }
+  for (unsigned i = 0; i < shards_.size(); ++i)
+    delete shards_[i];
+  delete throttle_;
 
   pthread_mutex_destroy(&alerts_mutex_);
 }
@@ -59,22 +78,57 @@ void CommandScrub::StoredFile::Finalize() {
   hash_done_ = true;
 }
 
-tbb::task *CommandScrub::StoredFileScrubbingTask::execute() {
-  StoredFile *file = StoredFileScrubbingTask::file();
-  upload::CharBuffer *buffer = StoredFileScrubbingTask::buffer();
+void CommandScrub::Shard::Run() {
+  void *buffer;
+  const int retval = posix_memalign(&buffer, kBlockAlignment, kBlockSize);
+  assert(retval == 0);
+  buffer_ = static_cast<unsigned char *>(buffer);
+
+  FileSystemTraversal<Shard> traverser(this, command_->repo_path_, true);
+  traverser.fn_new_file = &Shard::FileCallback;
+  traverser.fn_enter_dir = &Shard::DirCallback;
+  traverser.fn_new_symlink = &Shard::SymlinkCallback;
+  for (unsigned i = 0; i < directories_.size(); ++i)
+    traverser.Recurse(command_->repo_path_ + "/" + directories_[i]);
+
+  free(buffer_);
+  buffer_ = NULL;
+}
 
-  file->Update(buffer->ptr(), buffer->used_bytes());
-  if (IsLast()) {
-    file->Finalize();
-  }
+void CommandScrub::Shard::FileCallback(const std::string &relative_path,
+                                       const std::string &file_name) {
+  StoredFile *file = command_->NewStoredFile(relative_path, file_name);
+  if (file == NULL)
+    return;
+  if (command_->ReadStoredFile(file, this))
+    command_->FileProcessedCallback(file);
+  else
+    command_->PrintAlert(Alerts::kReadFailure, file->path());
+  atomic_inc64(&num_files_);
+  delete file;
+}
+
+void CommandScrub::Shard::DirCallback(const std::string &relative_path,
+                                      const std::string &dir_name) {
+  // The CAS subdirectory itself has been checked by the main thread
+  if (dir_name.empty())
+    return;
+  command_->DirCallback(relative_path, dir_name);
+}
 
-  return Finalize();
+void CommandScrub::Shard::SymlinkCallback(const std::string &relative_path,
+                                          const std::string &symlink_name) {
+  command_->SymlinkCallback(relative_path, symlink_name);
 }
 
 swissknife::ParameterList CommandScrub::GetParams() const {
   swissknife::ParameterList r;
   r.push_back(Parameter::Mandatory('r', "repository directory"));
+  r.push_back(Parameter::Optional('n', "number of threads (default: 1)"));
+  r.push_back(Parameter::Optional('b', "max. read bandwidth (MB/s)"));
+  r.push_back(Parameter::Optional('p', "progress report interval (s)"));
   r.push_back(Parameter::Switch('m', "machine readable output"));
+  r.push_back(Parameter::Switch('d', "bypass the page cache (O_DIRECT)"));
   return r;
 }
 
@@ -94,38 +148,156 @@ const char *CommandScrub::Alerts::ToString(const CommandScrub::Alerts::Type t) {
       return "malformed CAS subdir length";
     case Alerts::kContentHashMismatch:
       return "mismatch of file name and content hash";
+    case Alerts::kReadFailure:
+      return "failed to read file";
     default:
       return "unknown alert";
   }
 }
 
+/**
+ * Files in the top level directory
+ */
 void CommandScrub::FileCallback(const std::string &relative_path,
                                 const std::string &file_name) {
+  PrintAlert(Alerts::kUnexpectedFile, repo_path_ + "/" + file_name);
+}
+
+/**
+ * Directories in the top level directory are scrubbed by the shards
+ */
+bool CommandScrub::CollectDirCallback(const std::string &relative_path,
+                                      const std::string &dir_name) {
+  DirCallback(relative_path, dir_name);
+  cas_directories_.push_back(dir_name);
+  return false;
+}
+
+CommandScrub::StoredFile *CommandScrub::NewStoredFile(
+    const std::string &relative_path, const std::string &file_name) {
   assert(!file_name.empty());
 
-  if (relative_path.empty()) {
-    PrintAlert(Alerts::kUnexpectedFile, repo_path_ + "/" + file_name);
-    return;
-  }
   if (relative_path == kTxnDirectoryName) {
     // transaction directory should be ignored
-    return;
+    return NULL;
   }
 
   const string full_path = MakeFullPath(relative_path, file_name);
   const std::string hash_string =
       CheckPathAndExtractHash(relative_path, file_name, full_path);
   if (hash_string.empty()) {
-    return;
+    return NULL;
   }
 
   if (!shash::HexPtr(hash_string).IsValid()) {
     PrintAlert(Alerts::kMalformedHash, full_path, hash_string);
-    return;
+    return NULL;
+  }
+
+  return new StoredFile(full_path, hash_string);
+}
+
+/**
+ * Hashes a stored file block by block.  Without direct I/O, blocks are evicted
+ * from the page cache after reading unless they were cached before, so that
+ * the pages of other users of the storage stay in the cache.
+ */
+bool CommandScrub::ReadStoredFile(StoredFile *file, Shard *shard) {
+  int fd = -1;
+  bool is_direct_io = false;
+#ifdef O_DIRECT
+  if (use_direct_io_) {
+    // Not all file systems support direct I/O
+    fd = open(file->path().c_str(), O_RDONLY | O_DIRECT);
+    is_direct_io = (fd >= 0);
+  }
+#endif
+  if (fd < 0)
+    fd = open(file->path().c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  off_t offset = 0;
+  while (true) {
+    const size_t expected_bytes = std::min(kBlockSize,
+      (file->size() > static_cast<size_t>(offset)) ?
+        file->size() - static_cast<size_t>(offset) : 0);
+    const bool was_cached = !is_direct_io &&
+      platform_in_kcache(fd, offset, expected_bytes);
+    const ssize_t nbytes = read(fd, shard->buffer(), kBlockSize);
+    if (nbytes < 0) {
+      if (errno == EINTR)
+        continue;
+      close(fd);
+      file->Finalize();
+      return false;
+    }
+    if (nbytes == 0)
+      break;
+    if (!is_direct_io && !was_cached)
+      (void) platform_invalidate_kcache(fd, offset, nbytes);
+
+    file->Update(shard->buffer(), nbytes);
+    offset += nbytes;
+    shard->AddBytes(nbytes);
+    if (throttle_ != NULL)
+      throttle_->Consume(nbytes);
   }
+  close(fd);
+  file->Finalize();
+  return true;
+}
 
-  assert(reader_ != NULL);
-  reader_->ScheduleRead(new StoredFile(full_path, hash_string));
+void *CommandScrub::MainShard(void *data) {
+  Shard *shard = reinterpret_cast<Shard *>(data);
+  shard->Run();
+  return NULL;
+}
+
+void *CommandScrub::MainProgress(void *data) {
+  CommandScrub *command = reinterpret_cast<CommandScrub *>(data);
+  std::vector<uint64_t> last_bytes(command->shards_.size(), 0);
+  struct pollfd watch_terminate;
+  watch_terminate.fd = command->pipe_terminate_[0];
+  watch_terminate.events = POLLIN | POLLPRI;
+  const int timeout_ms = command->progress_interval_s_ * 1000;
+  while (true) {
+    const int retval = poll(&watch_terminate, 1, timeout_ms);
+    if ((retval < 0) && (errno == EINTR))
+      continue;
+    if (retval != 0)
+      break;
+    command->ReportProgress(timeout_ms, &last_bytes);
+  }
+  return NULL;
+}
+
+/**
+ * Prints the number of scrubbed files and bytes and the throughput of every
+ * shard during the last interval_ms.
+ */
+void CommandScrub::ReportProgress(const uint64_t interval_ms,
+                                  std::vector<uint64_t> *last_bytes) {
+  uint64_t total_files = 0;
+  uint64_t total_bytes = 0;
+  uint64_t total_interval_bytes = 0;
+  for (unsigned i = 0; i < shards_.size(); ++i) {
+    const uint64_t num_files = shards_[i]->num_files();
+    const uint64_t num_bytes = shards_[i]->num_bytes();
+    const uint64_t interval_bytes = num_bytes - (*last_bytes)[i];
+    (*last_bytes)[i] = num_bytes;
+    total_files += num_files;
+    total_bytes += num_bytes;
+    total_interval_bytes += interval_bytes;
+    LogCvmfs(kLogUtility, kLogStdout, "shard %u: %" PRIu64 " files, "
+             "%" PRIu64 " MB, %.1f MB/s", shards_[i]->id(), num_files,
+             num_bytes / (1024 * 1024),
+             (interval_bytes * 1000.0) / (interval_ms * 1024.0 * 1024.0));
+  }
+  LogCvmfs(kLogUtility, kLogStdout, "total: %" PRIu64 " files, "
+           "%" PRIu64 " MB, %.1f MB/s", total_files,
+           total_bytes / (1024 * 1024),
+           (total_interval_bytes * 1000.0) / (interval_ms * 1024.0 * 1024.0));
 }
 
 void CommandScrub::DirCallback(const std::string &relative_path,
@@ -171,7 +343,8 @@ std::string CommandScrub::CheckPathAndExtractHash(
       last_character != shash::kSuffixPartial &&
       last_character != shash::kSuffixCertificate &&
       last_character != shash::kSuffixMicroCatalog &&
-      last_character != shash::kSuffixMetainfo) {
+      last_character != shash::kSuffixMetainfo &&
+      last_character != shash::kSuffixTagIndex) {
     PrintAlert(Alerts::kUnexpectedModifier, full_path);
     return "";
   }
@@ -186,24 +359,67 @@ std::string CommandScrub::CheckPathAndExtractHash(
 int CommandScrub::Main(const swissknife::ArgumentList &args) {
   repo_path_ = MakeCanonicalPath(*args.find('r')->second);
   machine_readable_output_ = (args.find('m') != args.end());
+  use_direct_io_ = (args.find('d') != args.end());
+  unsigned num_threads = 1;
+  if (args.find('n') != args.end()) {
+    num_threads = String2Uint64(*args.find('n')->second);
+    if (num_threads == 0) {
+      LogCvmfs(kLogUtility, kLogStderr, "invalid number of threads");
+      return 1;
+    }
+  }
+  if (args.find('b') != args.end()) {
+    const uint64_t max_bandwidth =
+      String2Uint64(*args.find('b')->second) * 1024 * 1024;
+    if (max_bandwidth == 0) {
+      LogCvmfs(kLogUtility, kLogStderr, "invalid bandwidth limit");
+      return 1;
+    }
+    throttle_ = new BandwidthThrottle(max_bandwidth);
+  }
+  if (args.find('p') != args.end())
+    progress_interval_s_ = String2Uint64(*args.find('p')->second);
 
-  // initialize asynchronous reader
-  const size_t max_buffer_size = 512 * 1024;
-  const unsigned int max_files_in_flight = 100;
-  reader_ = new ScrubbingReader(max_buffer_size, max_files_in_flight);
-  reader_->RegisterListener(&CommandScrub::FileProcessedCallback, this);
-  reader_->Initialize();
-
-  // initialize file system recursion engine
-  FileSystemTraversal<CommandScrub> traverser(this, repo_path_, true);
+  // the top level directory should only contain the CAS subdirectories
+  FileSystemTraversal<CommandScrub> traverser(this, repo_path_, false);
   traverser.fn_new_file = &CommandScrub::FileCallback;
-  traverser.fn_enter_dir = &CommandScrub::DirCallback;
+  traverser.fn_new_dir_prefix = &CommandScrub::CollectDirCallback;
   traverser.fn_new_symlink = &CommandScrub::SymlinkCallback;
   traverser.Recurse(repo_path_);
 
-  // wait for reader to finish all jobs
-  reader_->Wait();
-  reader_->TearDown();
+  // distribute the CAS subdirectories among the shards
+  std::sort(cas_directories_.begin(), cas_directories_.end());
+  for (unsigned i = 0; i < num_threads; ++i)
+    shards_.push_back(new Shard(this, i));
+  for (unsigned i = 0; i < cas_directories_.size(); ++i)
+    shards_[i % num_threads]->AddDirectory(cas_directories_[i]);
+
+  const uint64_t start_ms = platform_monotonic_time_ns() / (1000 * 1000);
+  pthread_t thread_progress;
+  if (progress_interval_s_ > 0) {
+    MakePipe(pipe_terminate_);
+    int retval = pthread_create(&thread_progress, NULL, MainProgress, this);
+    assert(retval == 0);
+  }
+  for (unsigned i = 0; i < shards_.size(); ++i) {
+    int retval = pthread_create(shards_[i]->thread(), NULL, MainShard,
+                                shards_[i]);
+    assert(retval == 0);
+  }
+  for (unsigned i = 0; i < shards_.size(); ++i)
+    pthread_join(*shards_[i]->thread(), NULL);
+  if (progress_interval_s_ > 0) {
+    const char terminate = 'T';
+    WritePipe(pipe_terminate_[1], &terminate, 1);
+    pthread_join(thread_progress, NULL);
+    ClosePipe(pipe_terminate_);
+
+    std::vector<uint64_t> last_bytes(shards_.size(), 0);
+    const uint64_t elapsed_ms =
+      platform_monotonic_time_ns() / (1000 * 1000) - start_ms;
+    LogCvmfs(kLogUtility, kLogStdout, "scrubbing finished, averages:");
+    ReportProgress((elapsed_ms > 0) ? elapsed_ms : 1, &last_bytes);
+  }
 
   return (alerts_ == 0) ? 0 : 1;
 }
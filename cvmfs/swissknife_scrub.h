@@ -7,13 +7,18 @@
 
 #include "swissknife.h"
 
+#include <pthread.h>
+
 #include <cassert>
 #include <string>
+#include <vector>
 
-#include "file_processing/async_reader.h"
+#include "atomic.h"
 #include "file_processing/file.h"
 #include "hash.h"
 
+class BandwidthThrottle;
+
 namespace swissknife {
 
 class CommandScrub : public Command {
@@ -27,6 +32,7 @@ class CommandScrub : public Command {
       kMalformedHash,
       kMalformedCasSubdir,
       kContentHashMismatch,
+      kReadFailure,
       kNumberOfErrorTypes  // This should _always_ stay the last entry!
     };
 
@@ -53,23 +59,51 @@ class CommandScrub : public Command {
     shash::Any        expected_hash_;
   };
 
-  class StoredFileScrubbingTask :
-                          public upload::AbstractFileScrubbingTask<StoredFile> {
+  /**
+   * A worker thread and the CAS subdirectories it scrubs.  Every shard reads
+   * its directories and files on its own.
+   */
+  class Shard {
    public:
-    StoredFileScrubbingTask(StoredFile              *file,
-                            upload::CharBuffer      *buffer,
-                            const bool               is_last_piece,
-                            upload::AbstractReader  *reader) :
-      upload::AbstractFileScrubbingTask<StoredFile>(file,
-                                                    buffer,
-                                                    is_last_piece,
-                                                    reader) {}
-
-   protected:
-    tbb::task* execute();
+    Shard(CommandScrub *command, const unsigned id)
+      : command_(command), id_(id), buffer_(NULL)
+    {
+      atomic_init64(&num_files_);
+      atomic_init64(&num_bytes_);
+    }
+    void AddDirectory(const std::string &dir) { directories_.push_back(dir); }
+    void Run();
+
+    void FileCallback(const std::string &relative_path,
+                      const std::string &file_name);
+    void DirCallback(const std::string &relative_path,
+                     const std::string &dir_name);
+    void SymlinkCallback(const std::string &relative_path,
+                         const std::string &symlink_name);
+
+    unsigned id() const { return id_; }
+    uint64_t num_files() { return atomic_read64(&num_files_); }
+    uint64_t num_bytes() { return atomic_read64(&num_bytes_); }
+    void AddBytes(const uint64_t nbytes) { atomic_xadd64(&num_bytes_, nbytes); }
+    unsigned char *buffer() { return buffer_; }
+    pthread_t *thread() { return &thread_; }
+
+   private:
+    CommandScrub *command_;
+    unsigned id_;
+    std::vector<std::string> directories_;
+    unsigned char *buffer_;
+    atomic_int64 num_files_;
+    atomic_int64 num_bytes_;
+    pthread_t thread_;
   };
 
-  typedef upload::Reader<StoredFileScrubbingTask, StoredFile> ScrubbingReader;
+  /**
+   * Reads are done in blocks of this size, a multiple of the alignment
+   * required for O_DIRECT
+   */
+  static const size_t kBlockSize = 512 * 1024;
+  static const size_t kBlockAlignment = 4096;
 
  public:
   CommandScrub();
@@ -93,6 +127,16 @@ class CommandScrub : public Command {
                        const std::string &symlink_name);
 
   void FileProcessedCallback(StoredFile* const& file);
+  bool CollectDirCallback(const std::string &relative_path,
+                          const std::string &dir_name);
+
+  StoredFile *NewStoredFile(const std::string &relative_path,
+                            const std::string &file_name);
+  bool ReadStoredFile(StoredFile *file, Shard *shard);
+  static void *MainShard(void *data);
+  static void *MainProgress(void *data);
+  void ReportProgress(const uint64_t interval_ms,
+                      std::vector<uint64_t> *last_bytes);
 
   void PrintAlert(const Alerts::Type   type,
                   const std::string   &path,
@@ -112,7 +156,15 @@ class CommandScrub : public Command {
  private:
   std::string                   repo_path_;
   bool                          machine_readable_output_;
-  ScrubbingReader              *reader_;
+  bool                          use_direct_io_;
+  unsigned                      progress_interval_s_;
+  BandwidthThrottle            *throttle_;
+  std::vector<std::string>      cas_directories_;
+  std::vector<Shard *>          shards_;
+  /**
+   * Written by the main thread to stop the progress reporter
+   */
+  int                           pipe_terminate_[2];
 
   mutable unsigned int          alerts_;
   mutable pthread_mutex_t       alerts_mutex_;
@@ -1,18 +1,23 @@
 /**
  * This file is part of the CernVM File System
  *
- * This tool signs a CernVM-FS manifest with an X.509 certificate.
+ * This tool signs a CernVM-FS manifest with an X.509 certificate.  It also
+ * signs batches of whitelists in parallel.
  */
 
 #include "swissknife_sign.h"
 #include "cvmfs_config.h"
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <termios.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cassert>
 #include <cstdio>
 #include <cstdlib>
 #include <set>
@@ -30,6 +35,8 @@
 #include "smalloc.h"
 #include "upload.h"
 #include "util/posix.h"
+#include "util/string.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
@@ -67,3 +74,157 @@ int swissknife::CommandSign::Main(const swissknife::ArgumentList &args) {
                           reflog_chksum_path, garbage_collectable,
                           bootstrap_shortcuts, return_early);
 }
+
+
+bool swissknife::CommandSignBatch::ParseJobList(const string &path,
+                                                vector<Job> *jobs)
+{
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to open job list %s", path.c_str());
+    return false;
+  }
+  bool result = true;
+  string line;
+  while (GetLineFile(f, &line)) {
+    line = Trim(line);
+    if (line.empty() || (line[0] == '#'))
+      continue;
+    vector<string> tokens = SplitString(line, ' ');
+    if (tokens.size() != 3) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "invalid job: %s", line.c_str());
+      result = false;
+      break;
+    }
+    Job job;
+    job.private_key = tokens[0];
+    job.input_path = tokens[1];
+    job.output_path = tokens[2];
+    jobs->push_back(job);
+  }
+  fclose(f);
+  return result;
+}
+
+
+/**
+ * Every worker has its own signature manager that only holds a private key.
+ * OpenSSL is initialized and cleaned up once by SignAll().  The jobs of a
+ * list are usually sorted by key, so the private key is only reloaded when it
+ * changes.
+ */
+void *swissknife::CommandSignBatch::MainWorker(void *data) {
+  CommandSignBatch *command = reinterpret_cast<CommandSignBatch *>(data);
+  signature::SignatureManager signature_manager;
+  string loaded_key;
+
+  while (true) {
+    const int32_t idx = atomic_xadd32(&command->next_job_, 1);
+    if (idx >= static_cast<int32_t>(command->jobs_->size()))
+      break;
+    Job *job = &(*command->jobs_)[idx];
+
+    if (job->private_key != loaded_key) {
+      signature_manager.UnloadPrivateKey();
+      loaded_key.clear();
+      if (!signature_manager.LoadPrivateKeyPath(job->private_key,
+                                                command->password_))
+      {
+        LogCvmfs(kLogCvmfs, kLogStderr, "failed to load private key %s (%s)",
+                 job->private_key.c_str(),
+                 signature_manager.GetCryptoError().c_str());
+        continue;
+      }
+      loaded_key = job->private_key;
+    }
+
+    string input;
+    int fd = open(job->input_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to open %s",
+               job->input_path.c_str());
+      continue;
+    }
+    const bool retval_rd = SafeReadToString(fd, &input);
+    close(fd);
+    if (!retval_rd) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to read %s",
+               job->input_path.c_str());
+      continue;
+    }
+
+    unsigned char *signature;
+    unsigned signature_size;
+    const unsigned char *buffer =
+      reinterpret_cast<const unsigned char *>(input.data());
+    const bool retval_sig = command->digest_ ?
+      signature_manager.Sign(buffer, input.length(),
+                             &signature, &signature_size) :
+      signature_manager.SignRsa(buffer, input.length(),
+                                &signature, &signature_size);
+    if (!retval_sig) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to sign %s (%s)",
+               job->input_path.c_str(),
+               signature_manager.GetCryptoError().c_str());
+      continue;
+    }
+    job->ok = SafeWriteToFile(
+      string(reinterpret_cast<char *>(signature), signature_size),
+      job->output_path, 0644);
+    free(signature);
+    if (!job->ok) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to write %s",
+               job->output_path.c_str());
+    }
+  }
+
+  signature_manager.UnloadPrivateKey();
+  return NULL;
+}
+
+
+unsigned swissknife::CommandSignBatch::SignAll(vector<Job> *jobs,
+                                               const unsigned num_threads)
+{
+  signature::SignatureManager signature_manager;
+  signature_manager.Init();
+  jobs_ = jobs;
+  atomic_init32(&next_job_);
+  const unsigned num_workers =
+    std::max(1U, std::min(num_threads, static_cast<unsigned>(jobs->size())));
+  vector<pthread_t> workers(num_workers);
+  for (unsigned i = 0; i < num_workers; ++i) {
+    int retval = pthread_create(&workers[i], NULL, MainWorker, this);
+    assert(retval == 0);
+  }
+  for (unsigned i = 0; i < num_workers; ++i)
+    pthread_join(workers[i], NULL);
+  jobs_ = NULL;
+  signature_manager.Fini();
+
+  unsigned num_failed = 0;
+  for (unsigned i = 0; i < jobs->size(); ++i) {
+    if (!(*jobs)[i].ok)
+      num_failed++;
+  }
+  return num_failed;
+}
+
+
+int swissknife::CommandSignBatch::Main(const swissknife::ArgumentList &args) {
+  const string job_list = *args.find('l')->second;
+  if (args.find('s') != args.end()) password_ = *args.find('s')->second;
+  unsigned num_threads = GetNumberOfCpuCores();
+  if (args.find('n') != args.end())
+    num_threads = String2Uint64(*args.find('n')->second);
+  digest_ = (args.count('d') > 0);
+
+  vector<Job> jobs;
+  if (!ParseJobList(job_list, &jobs))
+    return 1;
+  const unsigned num_failed = SignAll(&jobs, num_threads);
+  const unsigned num_jobs = jobs.size();
+  LogCvmfs(kLogCvmfs, kLogStdout, "signed %u of %u files",
+           num_jobs - num_failed, num_jobs);
+  return (num_failed == 0) ? 0 : 1;
+}
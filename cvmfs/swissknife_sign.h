@@ -6,7 +6,9 @@
 #define CVMFS_SWISSKNIFE_SIGN_H_
 
 #include <string>
+#include <vector>
 
+#include "atomic.h"
 #include "swissknife.h"
 
 namespace upload {
@@ -47,6 +49,59 @@ class CommandSign : public Command {
   int Main(const ArgumentList &args);
 };
 
+
+/**
+ * Signs a batch of whitelist hashes (or other small buffers) on a pool of
+ * threads.  Used by "cvmfs_server resign" for many repositories at once
+ * instead of one openssl process per repository.
+ */
+class CommandSignBatch : public Command {
+ public:
+  /**
+   * One line of the job list: <private key> <input file> <output file>
+   */
+  struct Job {
+    Job() : ok(false) { }
+    std::string private_key;
+    std::string input_path;
+    std::string output_path;
+    bool ok;
+  };
+
+  CommandSignBatch() : jobs_(NULL), digest_(false) {
+    atomic_init32(&next_job_);
+  }
+  ~CommandSignBatch() {}
+  virtual std::string GetName() const { return "sign_batch"; }
+  virtual std::string GetDescription() const {
+    return "Signs a list of files in parallel.";
+  }
+  virtual ParameterList GetParams() const {
+    ParameterList r;
+    r.push_back(Parameter::Mandatory('l', "job list (key, input, output)"));
+    r.push_back(Parameter::Optional('s', "password for the private keys"));
+    r.push_back(Parameter::Optional('n', "number of threads"));
+    r.push_back(Parameter::Switch('d', "sign the SHA-1 digest of the input "
+                                       "instead of the raw input"));
+    return r;
+  }
+  int Main(const ArgumentList &args);
+
+  static bool ParseJobList(const std::string &path, std::vector<Job> *jobs);
+  /**
+   * Returns the number of failed jobs.
+   */
+  unsigned SignAll(std::vector<Job> *jobs, const unsigned num_threads);
+
+ private:
+  static void *MainWorker(void *data);
+
+  std::vector<Job> *jobs_;
+  std::string password_;
+  bool digest_;
+  atomic_int32 next_job_;
+};
+
 }  // namespace swissknife
 
 #endif  // CVMFS_SWISSKNIFE_SIGN_H_
@@ -32,27 +32,91 @@
 #include <string>
 #include <vector>
 
+#include "bloom_filter.h"
+#include "catalog_access_profile.h"
+#include "catalog_cache.h"
 #include "catalog_mgr_ro.h"
 #include "catalog_mgr_rw.h"
+#include "catalog_prefetch_groups.h"
+#include "catalog_traversal.h"
 #include "catalog_virtual.h"
 #include "download.h"
+#include "file_processing/processing_policy.h"
 #include "logging.h"
 #include "manifest.h"
+#include "object_fetcher.h"
 #include "path_filters/dirtab.h"
 #include "platform.h"
 #include "reflog.h"
+#include "sync_graft_manifest.h"
 #include "sync_mediator.h"
 #include "sync_union.h"
+#include "sync_union_tarball.h"
+#include "util/pointer.h"
 #include "util/string.h"
 
 using namespace std;  // NOLINT
 
+namespace {
+
+typedef HttpObjectFetcher<> ObjectFetcher;
+typedef swissknife::CatalogTraversal<ObjectFetcher> ReadonlyCatalogTraversal;
+
+/**
+ * Collects the catalogs and the objects referenced by a repository revision in
+ * a bloom filter, which lets the uploader skip objects that exist already.
+ */
+class ExistenceIndexBuilder {
+ public:
+  ExistenceIndexBuilder() : num_catalogs_(0) { }
+
+  void CatalogCallback(const ReadonlyCatalogTraversal::CallbackDataTN &data) {
+    if (!index_.IsValid()) {
+      // The root catalog comes first, its counters describe the entire tree
+      const catalog::Counters &counters = data.catalog->GetCounters();
+      const uint64_t expected_keys = counters.GetAllEntries() +
+        counters.self.file_chunks + counters.subtree.file_chunks;
+      index_ = new BloomFilter(expected_keys);
+    }
+    num_catalogs_++;
+    Add(data.catalog->hash());
+    const catalog::Catalog::HashVector &referenced =
+      data.catalog->GetReferencedObjects();
+    for (unsigned i = 0; i < referenced.size(); ++i)
+      Add(referenced[i]);
+  }
+
+  BloomFilter *Release() { return index_.Release(); }
+  unsigned num_catalogs() const { return num_catalogs_; }
+  uint64_t num_keys() const {
+    return index_.IsValid() ? index_->num_keys() : 0;
+  }
+
+ private:
+  void Add(const shash::Any &hash) {
+    uint64_t h1, h2;
+    upload::AbstractUploader::ExistenceIndexKey(hash, &h1, &h2);
+    index_->Add(h1, h2);
+  }
+
+  UniquePtr<BloomFilter> index_;
+  unsigned num_catalogs_;
+};
+
+}  // anonymous namespace
+
+
 bool swissknife::CommandSync::CheckParams(const SyncParameters &p) {
-  if (!DirectoryExists(p.dir_scratch)) {
+  if (p.union_fs_type == "tarball") {
+    // The union volume and the scratch directory are not used
+    if (p.tarball_path.empty()) {
+      PrintError("tarball missing");
+      return false;
+    }
+  } else if (!DirectoryExists(p.dir_scratch)) {
     PrintError("overlay (copy on write) directory does not exist");
     return false;
-  }
-  if (!DirectoryExists(p.dir_union)) {
+  } else if (!DirectoryExists(p.dir_union)) {
     PrintError("union volume does not exist");
     return false;
   }
@@ -483,6 +547,35 @@ bool swissknife::CommandSync::ReadFileChunkingArgs(
   return true;
 }
 
+/**
+ * Traverses the catalogs of the previous revision and hands the objects that
+ * they reference to the data spooler.  Failures only cost the optimization.
+ */
+void swissknife::CommandSync::BuildExistenceIndex(
+  const SyncParameters &params,
+  const shash::Any &root_catalog_hash)
+{
+  LogCvmfs(kLogCvmfs, kLogStdout, "Indexing existing objects...");
+  ObjectFetcher object_fetcher(params.repo_name, params.stratum0,
+                               params.dir_temp, download_manager(),
+                               signature_manager());
+  ReadonlyCatalogTraversal::Parameters traversal_params;
+  traversal_params.object_fetcher = &object_fetcher;
+  ReadonlyCatalogTraversal traversal(traversal_params);
+  ExistenceIndexBuilder builder;
+  traversal.RegisterListener(&ExistenceIndexBuilder::CatalogCallback,
+                             &builder);
+  if (!traversal.TraverseRevision(root_catalog_hash)) {
+    LogCvmfs(kLogCvmfs, kLogStderr,
+             "Warning: failed to index existing objects, uploading all");
+    return;
+  }
+  LogCvmfs(kLogCvmfs, kLogStdout, "Indexed %" PRIu64 " objects in %u catalogs",
+           builder.num_keys(), builder.num_catalogs());
+  params.spooler->SetExistenceIndex(builder.Release());
+}
+
+
 int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
   SyncParameters params;
 
@@ -537,6 +630,8 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
     params.max_weight = String2Uint64(*args.find('X')->second);
   if (args.find('M') != args.end())
     params.min_weight = String2Uint64(*args.find('M')->second);
+  if (args.find('G') != args.end())
+    params.access_profile_path = *args.find('G')->second;
 
   if (args.find('p') != args.end()) {
     params.use_file_chunking = true;
@@ -566,6 +661,15 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
   }
 
   if (args.find('E') != args.end()) params.enforce_limits = true;
+  if (args.find('%') != args.end()) params.catalog_deltas = true;
+  if (args.find('^') != args.end()) params.catalog_indexes = true;
+  if (args.find('_') != args.end()) params.nested_catalog_index = true;
+  if (args.find('~') != args.end()) params.catalog_clustering = true;
+  if (args.find('2') != args.end()) params.lazy_vacuum = true;
+  if (args.find('&') != args.end()) params.existence_index = true;
+  if (args.find('!') != args.end()) {
+    params.graft_manifest_path = *args.find('!')->second;
+  }
   if (args.find('Q') != args.end()) {
     params.nested_kcatalog_limit = String2Uint64(*args.find('Q')->second);
   } else {
@@ -592,6 +696,72 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
     params.max_concurrent_write_jobs = String2Uint64(*args.find('q')->second);
   }
 
+  if (args.find('j') != args.end()) {
+    params.num_processing_threads = String2Uint64(*args.find('j')->second);
+  }
+
+  if (args.find('J') != args.end()) {
+    params.num_scan_threads = String2Uint64(*args.find('J')->second);
+  }
+
+  if (args.find('+') != args.end()) {
+    params.num_local_writers = String2Uint64(*args.find('+')->second);
+  }
+
+  if (args.find(',') != args.end()) {
+    const std::string sync_mode = *args.find(',')->second;
+    if (sync_mode == "none") {
+      params.local_sync_mode = upload::SpoolerDefinition::kLocalSyncNone;
+    } else if (sync_mode == "file") {
+      params.local_sync_mode = upload::SpoolerDefinition::kLocalSyncFile;
+    } else if (sync_mode == "session") {
+      params.local_sync_mode = upload::SpoolerDefinition::kLocalSyncSession;
+    } else {
+      PrintError("unknown local storage sync mode: " + sync_mode);
+      return 2;
+    }
+  }
+
+  if (args.find('.') != args.end()) {
+    const std::string chunking_algorithm = *args.find('.')->second;
+    if (chunking_algorithm == "xor32") {
+      params.chunking_algorithm = upload::SpoolerDefinition::kChunkingXor32;
+    } else if (chunking_algorithm == "fastcdc") {
+      params.chunking_algorithm = upload::SpoolerDefinition::kChunkingFastCdc;
+    } else {
+      PrintError("unknown chunking algorithm: " + chunking_algorithm);
+      return 2;
+    }
+  }
+
+  if (args.find('W') != args.end()) {
+    params.max_staged_dirents = String2Uint64(*args.find('W')->second);
+  }
+
+  if (args.find('D') != args.end()) {
+    params.inline_file_threshold = String2Uint64(*args.find('D')->second);
+  }
+
+  if (args.find('@') != args.end()) {
+    params.bundle_file_threshold = String2Uint64(*args.find('@')->second);
+  }
+
+  if (args.find('#') != args.end()) {
+    params.tarball_path = *args.find('#')->second;
+    if (params.tarball_path != "-")
+      params.tarball_path = MakeCanonicalPath(params.tarball_path);
+  }
+  if (args.find('=') != args.end())
+    params.base_directory = *args.find('=')->second;
+  if ((params.union_fs_type == "tarball") &&
+      (params.bundle_file_threshold > 0))
+  {
+    // Bundles are assembled at commit time, when the contents of the tarball
+    // entries are no longer available
+    LogCvmfs(kLogCvmfs, kLogStdout, "File bundling is disabled for tarballs");
+    params.bundle_file_threshold = 0;
+  }
+
   if (args.find('T') != args.end()) {
     params.ttl_seconds = String2Uint64(*args.find('T')->second);
   }
@@ -608,6 +778,32 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
     params.key_file = *args.find('H')->second;
   }
 
+  if (args.find('I') != args.end()) {
+    params.content_cache_path = *args.find('I')->second;
+  }
+
+  if (args.find('/') != args.end()) {
+    params.processing_policy_path = *args.find('/')->second;
+  }
+
+  if (args.find('0') != args.end()) {
+    params.catalog_cache_path = *args.find('0')->second;
+  }
+  if (args.find('1') != args.end()) {
+    params.catalog_cache_mbyte_limit = String2Uint64(*args.find('1')->second);
+  }
+
+  if (args.find('3') != args.end()) {
+    params.prefetch_patterns_path = *args.find('3')->second;
+  }
+  if (args.find('4') != args.end()) {
+    params.prefetch_trace_path = *args.find('4')->second;
+  }
+
+  if (args.find('5') != args.end()) {
+    params.digest_tree_block_size = String2Uint64(*args.find('5')->second);
+  }
+
   if (!CheckParams(params)) return 2;
 
   // Start spooler
@@ -626,6 +822,25 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
     spooler_definition.number_of_concurrent_uploads =
         params.max_concurrent_write_jobs;
   }
+  if (params.num_processing_threads > 0) {
+    spooler_definition.number_of_threads = params.num_processing_threads;
+  }
+  if (params.num_local_writers > 0) {
+    spooler_definition.number_of_local_writers = params.num_local_writers;
+  }
+  spooler_definition.local_sync_mode = params.local_sync_mode;
+  spooler_definition.chunking_algorithm = params.chunking_algorithm;
+  spooler_definition.digest_tree_block_size = params.digest_tree_block_size;
+  UniquePtr<upload::ProcessingPolicy> processing_policy;
+  if (!params.processing_policy_path.empty()) {
+    processing_policy =
+      upload::ProcessingPolicy::Create(params.processing_policy_path);
+    if (!processing_policy.IsValid()) {
+      PrintError("invalid processing policy " + params.processing_policy_path);
+      return 2;
+    }
+    spooler_definition.processing_policy = processing_policy.weak_ref();
+  }
 
   upload::SpoolerDefinition spooler_definition_catalogs(
       spooler_definition.Dup2DefaultCompression());
@@ -664,13 +879,63 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
 
   const std::string old_root_hash = manifest->catalog_hash().ToString(true);
 
+  UniquePtr<catalog::CatalogCache> catalog_cache;
+  if (!params.catalog_cache_path.empty()) {
+    catalog_cache = catalog::CatalogCache::Create(
+      params.catalog_cache_path,
+      uint64_t(params.catalog_cache_mbyte_limit) * 1024 * 1024);
+    if (!catalog_cache.IsValid())
+      return 3;
+  }
+
   catalog::WritableCatalogManager catalog_manager(
       params.base_hash, params.stratum0, params.dir_temp, spooler_catalogs,
       download_manager(), params.enforce_limits, params.nested_kcatalog_limit,
       params.root_kcatalog_limit, params.file_mbyte_limit, statistics(),
       params.is_balanced, params.max_weight, params.min_weight);
+  catalog_manager.SetMaxStagedDirents(params.max_staged_dirents);
+  if (params.catalog_deltas)
+    catalog_manager.EnableCatalogDeltas();
+  if (params.catalog_indexes)
+    catalog_manager.EnableCatalogIndexes();
+  if (params.nested_catalog_index)
+    catalog_manager.EnableNestedCatalogIndex();
+  if (params.catalog_clustering)
+    catalog_manager.EnableCatalogClustering();
+  if (params.lazy_vacuum)
+    catalog_manager.EnableLazyVacuum();
+  if (catalog_cache.IsValid())
+    catalog_manager.SetCatalogCache(catalog_cache.weak_ref());
+  catalog::AccessProfile access_profile;
+  if (!params.access_profile_path.empty()) {
+    if (!access_profile.LoadTracerLog(params.access_profile_path))
+      return 3;
+    catalog_manager.SetAccessProfile(&access_profile);
+  }
+  catalog::PrefetchGroups prefetch_groups;
+  if (!params.prefetch_patterns_path.empty() &&
+      !prefetch_groups.LoadPatterns(params.prefetch_patterns_path))
+  {
+    return 3;
+  }
+  if (!params.prefetch_trace_path.empty() &&
+      !prefetch_groups.LoadTracerLog(params.prefetch_trace_path))
+  {
+    return 3;
+  }
+  if (!params.prefetch_patterns_path.empty() ||
+      !params.prefetch_trace_path.empty())
+  {
+    params.prefetch_groups = &prefetch_groups;
+  }
   catalog_manager.Init();
 
+  if (params.existence_index && !params.branched_catalog &&
+      !manifest->catalog_hash().IsNull())
+  {
+    BuildExistenceIndex(params, manifest->catalog_hash());
+  }
+
   publish::SyncMediator mediator(&catalog_manager, &params);
 
   // Should be before the syncronization starts to avoid race of GetTTL with
@@ -692,12 +957,30 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
     } else if (params.union_fs_type == "aufs") {
       sync = new publish::SyncUnionAufs(&mediator, params.dir_rdonly,
                                         params.dir_union, params.dir_scratch);
+    } else if (params.union_fs_type == "tarball") {
+      sync = new publish::SyncUnionTarball(&mediator, params.dir_rdonly,
+                                           params.tarball_path,
+                                           params.base_directory,
+                                           params.dir_temp);
     } else {
       LogCvmfs(kLogCvmfs, kLogStderr, "unknown union file system: %s",
                params.union_fs_type.c_str());
       return 3;
     }
 
+    UniquePtr<publish::GraftManifest> graft_manifest;
+    if (!params.graft_manifest_path.empty()) {
+      graft_manifest = new publish::GraftManifest(params.graft_manifest_path);
+      if (!graft_manifest->Load()) {
+        LogCvmfs(kLogCvmfs, kLogStderr, "failed to load graft manifest %s",
+                 params.graft_manifest_path.c_str());
+        return 4;
+      }
+      LogCvmfs(kLogCvmfs, kLogStdout, "Loaded %u graft descriptions",
+               graft_manifest->size());
+      sync->set_graft_manifest(graft_manifest.weak_ref());
+    }
+
     if (!sync->Initialize()) {
       LogCvmfs(kLogCvmfs, kLogStderr,
                "Initialization of the synchronisation "
@@ -749,6 +1032,37 @@ int swissknife::CommandSync::Main(const swissknife::ArgumentList &args) {
   LogCvmfs(kLogCvmfs, kLogStdout, "Exporting repository manifest");
   params.spooler->WaitForUpload();
   spooler_catalogs->WaitForUpload();
+  if (params.existence_index) {
+    LogCvmfs(kLogCvmfs, kLogStdout,
+             "Skipped the upload of %" PRId64 " existing objects (%" PRId64
+             " kB)", params.spooler->GetNumberOfSkippedUploads(),
+             params.spooler->GetNumberOfSkippedBytes() / 1024);
+  }
+  if (params.spooler->GetNumberOfChunkedFiles() > 0) {
+    const perf::Histogram &chunk_sizes = params.spooler->GetChunkSizes();
+    LogCvmfs(kLogCvmfs, kLogStdout,
+             "Chunked %" PRId64 " files into %" PRIu64 " chunks (%s, chunk "
+             "size p50/p99/p999: %" PRIu64 "/%" PRIu64 "/%" PRIu64 " kB)",
+             params.spooler->GetNumberOfChunkedFiles(),
+             chunk_sizes.GetCount(),
+             params.chunking_algorithm ==
+               upload::SpoolerDefinition::kChunkingFastCdc ?
+               "fastcdc" : "xor32",
+             chunk_sizes.GetQuantile(0.5) / 1024,
+             chunk_sizes.GetQuantile(0.99) / 1024,
+             chunk_sizes.GetQuantile(0.999) / 1024);
+  }
+  if (catalog_cache.IsValid()) {
+    LogCvmfs(kLogCvmfs, kLogStdout,
+             "Took %d catalogs from the catalog cache, downloaded %d",
+             catalog_cache->num_hits(), catalog_cache->num_misses());
+  }
+  if (params.spooler->GetNumberOfIncompressibleFiles() > 0) {
+    LogCvmfs(kLogCvmfs, kLogStdout,
+             "Stored %" PRId64 " files uncompressed (poor compression ratio "
+             "of the first block)",
+             params.spooler->GetNumberOfIncompressibleFiles());
+  }
   params.spooler->FinalizeSession(false);
 
   // We call FinalizeSession(true) this time, to also trigger the commit
@@ -12,8 +12,13 @@
 #include "swissknife.h"
 #include "upload.h"
 
+namespace catalog {
+class PrefetchGroups;
+}
+
 struct SyncParameters {
   static const unsigned kDefaultMaxWeight = 100000;
+  static const unsigned kDefaultMaxStagedDirents = 4096;
   static const unsigned kDefaultMinWeight = 1000;
   static const size_t kDefaultMinFileChunkSize = 4 * 1024 * 1024;
   static const size_t kDefaultAvgFileChunkSize = 8 * 1024 * 1024;
@@ -21,6 +26,7 @@ struct SyncParameters {
   static const unsigned kDefaultNestedKcatalogLimit = 500;
   static const unsigned kDefaultRootKcatalogLimit = 200;
   static const unsigned kDefaultFileMbyteLimit = 1024;
+  static const unsigned kDefaultCatalogCacheMbyteLimit = 4096;
 
   SyncParameters()
       : spooler(NULL),
@@ -40,20 +46,45 @@ struct SyncParameters {
         branched_catalog(false),
         compression_alg(zlib::kZlibDefault),
         enforce_limits(false),
+        catalog_deltas(false),
+        catalog_indexes(false),
+        nested_catalog_index(false),
+        catalog_clustering(false),
+        lazy_vacuum(false),
+        existence_index(false),
         nested_kcatalog_limit(0),
         root_kcatalog_limit(0),
         file_mbyte_limit(0),
         min_file_chunk_size(kDefaultMinFileChunkSize),
         avg_file_chunk_size(kDefaultAvgFileChunkSize),
         max_file_chunk_size(kDefaultMaxFileChunkSize),
+        chunking_algorithm(upload::SpoolerDefinition::kChunkingXor32),
         manual_revision(0),
         ttl_seconds(0),
         max_concurrent_write_jobs(0),
+        num_processing_threads(0),
+        num_scan_threads(0),
+        num_local_writers(0),
+        local_sync_mode(upload::SpoolerDefinition::kLocalSyncNone),
+        max_staged_dirents(kDefaultMaxStagedDirents),
+        inline_file_threshold(0),
+        bundle_file_threshold(0),
+        digest_tree_block_size(0),
         is_balanced(false),
         max_weight(kDefaultMaxWeight),
         min_weight(kDefaultMinWeight),
         session_token_file(),
-        key_file() {}
+        key_file(),
+        content_cache_path(),
+        catalog_cache_path(),
+        catalog_cache_mbyte_limit(kDefaultCatalogCacheMbyteLimit),
+        processing_policy_path(),
+        access_profile_path(),
+        prefetch_patterns_path(),
+        prefetch_trace_path(),
+        prefetch_groups(NULL),
+        tarball_path(),
+        base_directory() {}
 
   upload::Spooler *spooler;
   std::string repo_name;
@@ -84,15 +115,42 @@ struct SyncParameters {
   bool branched_catalog;
   zlib::Algorithms compression_alg;
   bool enforce_limits;
+  // Upload page-level deltas from the previous catalog revisions
+  bool catalog_deltas;
+  // Upload the read-optimized encoding of the changed catalogs
+  bool catalog_indexes;
+  // Upload the index of all the nested catalogs with the root catalog
+  bool nested_catalog_index;
+  // Rebuild the changed catalogs with rows ordered by parent directory
+  bool catalog_clustering;
+  // Defragment the changed catalogs only once they are very fragmented
+  bool lazy_vacuum;
+  // Skip the upload of objects referenced by the previous revision
+  bool existence_index;
+  // Graft descriptions of external files, replaces the .cvmfsgraft- files
+  std::string graft_manifest_path;
   unsigned nested_kcatalog_limit;
   unsigned root_kcatalog_limit;
   unsigned file_mbyte_limit;
   size_t min_file_chunk_size;
   size_t avg_file_chunk_size;
   size_t max_file_chunk_size;
+  upload::SpoolerDefinition::ChunkingAlgorithm chunking_algorithm;
   uint64_t manual_revision;
   uint64_t ttl_seconds;
   uint64_t max_concurrent_write_jobs;
+  unsigned num_processing_threads;
+  unsigned num_scan_threads;
+  // Only used by the local uploader
+  unsigned num_local_writers;
+  upload::SpoolerDefinition::LocalSyncMode local_sync_mode;
+  unsigned max_staged_dirents;
+  // Files up to this size are stored in the catalogs, zero disables inlining
+  unsigned inline_file_threshold;
+  // Files up to this size are packed into bundles, zero disables bundling
+  unsigned bundle_file_threshold;
+  // Block size of the digest trees of large files, zero disables digest trees
+  unsigned digest_tree_block_size;
   bool is_balanced;
   unsigned max_weight;
   unsigned min_weight;
@@ -100,6 +158,30 @@ struct SyncParameters {
   // Parameters for when upstream type is HTTP
   std::string session_token_file;
   std::string key_file;
+
+  // Remembers content hashes of processed files, empty if disabled
+  std::string content_cache_path;
+
+  // Keeps uncompressed catalogs across transactions, empty if disabled
+  std::string catalog_cache_path;
+  unsigned catalog_cache_mbyte_limit;
+
+  // Per-file compression and chunking rules, empty if disabled
+  std::string processing_policy_path;
+
+  // Client trace log that steers the catalog balancer, empty if disabled
+  std::string access_profile_path;
+
+  // Pathspecs and client trace log that define prefetch groups, empty if
+  // disabled.  Loaded into prefetch_groups.
+  std::string prefetch_patterns_path;
+  std::string prefetch_trace_path;
+  catalog::PrefetchGroups *prefetch_groups;
+
+  // Archive to publish with the "tarball" engine (-f tarball), "-" for stdin,
+  // and the repository directory it is extracted to
+  std::string tarball_path;
+  std::string base_directory;
 };
 
 namespace catalog {
@@ -252,12 +334,18 @@ class CommandSync : public Command {
     r.push_back(Parameter::Optional('e', "hash algorithm (default: SHA-1)"));
     r.push_back(Parameter::Optional('f', "union filesystem type"));
     r.push_back(Parameter::Optional('h', "maximal file chunk size in bytes"));
+    r.push_back(Parameter::Optional('j', "number of compression threads"));
+    r.push_back(Parameter::Optional('J', "number of scratch scan threads"));
     r.push_back(Parameter::Optional('l', "minimal file chunk size in bytes"));
     r.push_back(Parameter::Optional('q', "number of concurrent write jobs"));
     r.push_back(Parameter::Optional('v', "manual revision number"));
+    r.push_back(Parameter::Optional('W', "staged catalog entries (0: off)"));
+    r.push_back(Parameter::Optional('D', "inline files up to size (0: off)"));
+    r.push_back(Parameter::Optional('@', "bundle files up to size (0: off)"));
     r.push_back(Parameter::Optional('z', "log level (0-4, default: 2)"));
     r.push_back(Parameter::Optional('C', "trusted certificates"));
     r.push_back(Parameter::Optional('F', "Authz file listing (default: none)"));
+    r.push_back(Parameter::Optional('G', "access profile for autocatalogs"));
     r.push_back(Parameter::Optional('M', "minimum weight of the autocatalogs"));
     r.push_back(Parameter::Optional('Q',
                                     "nested catalog limit in kilo-entries"));
@@ -266,8 +354,8 @@ class CommandSync : public Command {
     r.push_back(Parameter::Optional('U', "file size limit in megabytes"));
     r.push_back(Parameter::Optional('X', "maximum weight of the autocatalogs"));
     r.push_back(Parameter::Optional('Z',
-                                    "compression algorithm "
-                                    "(default: zlib)"));
+                                    "compression algorithm, zlib, zstd, lz4 "
+                                    "or none (default: zlib)"));
     r.push_back(Parameter::Optional('S',
                                     "virtual directory options "
                                     "[snapshots, remove]"));
@@ -292,9 +380,30 @@ class CommandSync : public Command {
                                   "authenticated repos"));
     r.push_back(Parameter::Switch('Y', "enable external data"));
     r.push_back(Parameter::Switch('B', "branched catalog (no manifest)"));
+    r.push_back(Parameter::Switch('%', "upload catalog deltas"));
+    r.push_back(Parameter::Switch('^', "upload catalog indexes"));
+    r.push_back(Parameter::Switch('_', "upload nested catalog index"));
+    r.push_back(Parameter::Switch('~', "cluster catalog rows by directory"));
+    r.push_back(Parameter::Switch('&', "skip uploads of existing objects"));
+    r.push_back(Parameter::Optional('!', "graft manifest for external data"));
+    r.push_back(Parameter::Optional('+', "number of local storage writers"));
+    r.push_back(Parameter::Optional(',', "local storage sync mode "
+                                         "(none, file, session)"));
+    r.push_back(Parameter::Optional('.', "chunking algorithm "
+                                         "(xor32, fastcdc)"));
+    r.push_back(Parameter::Optional('/', "per-file processing policy"));
+    r.push_back(Parameter::Optional('0', "catalog cache directory"));
+    r.push_back(Parameter::Optional('1', "catalog cache limit in MB"));
+    r.push_back(Parameter::Switch('2', "defragment catalogs lazily"));
+    r.push_back(Parameter::Optional('3', "prefetch group patterns"));
+    r.push_back(Parameter::Optional('4', "prefetch group trace log"));
+    r.push_back(Parameter::Optional('5', "digest tree block size (0: off)"));
 
     r.push_back(Parameter::Optional('P', "session_token_file"));
     r.push_back(Parameter::Optional('H', "key file for HTTP API"));
+    r.push_back(Parameter::Optional('I', "content cache of unchanged files"));
+    r.push_back(Parameter::Optional('#', "tarball to publish (-f tarball)"));
+    r.push_back(Parameter::Optional('=', "base directory for the tarball"));
 
     return r;
   }
@@ -304,6 +413,8 @@ class CommandSync : public Command {
   bool ReadFileChunkingArgs(const swissknife::ArgumentList &args,
                             SyncParameters *params);
   bool CheckParams(const SyncParameters &p);
+  void BuildExistenceIndex(const SyncParameters &params,
+                           const shash::Any &root_catalog_hash);
 };
 
 }  // namespace swissknife
@@ -0,0 +1,411 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "swissknife_trace.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <map>
+#include <vector>
+
+#include "catalog_access_profile.h"
+#include "catalog_heatmap.h"
+#include "logging.h"
+#include "platform.h"
+#include "tracer.h"
+#include "util/posix.h"
+#include "util/string.h"
+#include "util_concurrency.h"
+
+int swissknife::CommandTrace2Csv::Main(const swissknife::ArgumentList &args) {
+  const std::string input_path = *args.find('i')->second;
+
+  FILE *output = stdout;
+  if (args.find('o') != args.end()) {
+    const std::string output_path = *args.find('o')->second;
+    output = fopen(output_path.c_str(), "w");
+    if (output == NULL) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to open %s (%d)",
+               output_path.c_str(), errno);
+      return 1;
+    }
+  }
+
+  const bool retval = Tracer::ConvertBinaryToCsv(input_path, output);
+  if (output != stdout)
+    fclose(output);
+  if (!retval) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to convert trace file %s",
+             input_path.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+
+namespace {
+
+struct ReplayWorker {
+  ReplayWorker() : thread(0), jobs(NULL), num_bytes(0) { }
+  pthread_t thread;
+  FifoChannel<const Tracer::Event *> *jobs;
+  std::string mount_point;
+  /**
+   * Per event code, latencies in microseconds
+   */
+  std::map<int, std::vector<uint64_t> > latencies;
+  std::map<int, uint64_t> failures;
+  uint64_t num_bytes;
+};
+
+
+bool ReplayEvent(const std::string &path, const int code, uint64_t *num_bytes) {
+  switch (code) {
+    case Tracer::kEventLookup:
+    case Tracer::kEventStat: {
+      platform_stat64 info;
+      return platform_lstat(path.c_str(), &info) == 0;
+    }
+    case Tracer::kEventOpen: {
+      const int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+        return false;
+      char buffer[64 * 1024];
+      ssize_t nbytes;
+      while ((nbytes = read(fd, buffer, sizeof(buffer))) > 0)
+        *num_bytes += nbytes;
+      close(fd);
+      return nbytes == 0;
+    }
+    case Tracer::kEventLs: {
+      DIR *dirp = opendir(path.c_str());
+      if (dirp == NULL)
+        return false;
+      while (readdir(dirp) != NULL) { }
+      closedir(dirp);
+      return true;
+    }
+    case Tracer::kEventReadlink: {
+      char buffer[PATH_MAX];
+      return readlink(path.c_str(), buffer, sizeof(buffer)) >= 0;
+    }
+    default:
+      return true;
+  }
+}
+
+
+void *MainReplayWorker(void *data) {
+  ReplayWorker *worker = reinterpret_cast<ReplayWorker *>(data);
+  while (true) {
+    const Tracer::Event *event = worker->jobs->Dequeue();
+    if (event == NULL)
+      break;
+    const std::string path = worker->mount_point + event->path;
+    const uint64_t start = platform_monotonic_time_ns();
+    const bool retval = ReplayEvent(path, event->code, &worker->num_bytes);
+    const uint64_t latency_us = (platform_monotonic_time_ns() - start) / 1000;
+    worker->latencies[event->code].push_back(latency_us);
+    if (!retval)
+      worker->failures[event->code]++;
+  }
+  return NULL;
+}
+
+
+bool IsReplayed(const int code) {
+  return (code == Tracer::kEventOpen) || (code == Tracer::kEventLs) ||
+         (code == Tracer::kEventReadlink) || (code == Tracer::kEventLookup) ||
+         (code == Tracer::kEventStat);
+}
+
+
+std::string EventName(const int code) {
+  switch (code) {
+    case Tracer::kEventOpen: return "open";
+    case Tracer::kEventLs: return "opendir";
+    case Tracer::kEventReadlink: return "readlink";
+    case Tracer::kEventLookup: return "lookup";
+    case Tracer::kEventStat: return "getattr";
+    default: return StringifyInt(code);
+  }
+}
+
+
+uint64_t Percentile(const std::vector<uint64_t> &sorted, const unsigned p) {
+  return sorted[((sorted.size() - 1) * p) / 100];
+}
+
+
+/**
+ * Reads a numeric extended attribute of the mount point root, -1 on failure
+ */
+int64_t GetCounter(const std::string &mount_point, const std::string &name) {
+  std::string value;
+  if (!platform_getxattr(mount_point, name, &value))
+    return -1;
+  return String2Int64(value);
+}
+
+}  // anonymous namespace
+
+
+/**
+ * Csv traces store timestamps as milliseconds with microsecond fraction, see
+ * StringifyTimeval().
+ */
+bool swissknife::CommandTraceReplay::ReadCsvTrace(
+  const std::string &path,
+  std::vector<Tracer::Event> *events)
+{
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to open trace file %s (%d)",
+             path.c_str(), errno);
+    return false;
+  }
+  std::string line;
+  std::vector<std::string> fields;
+  unsigned num_lines = 0;
+  while (GetLineFile(f, &line)) {
+    ++num_lines;
+    if (!catalog::AccessProfile::ParseCsvLine(line, &fields) ||
+        (fields.size() < 4))
+    {
+      LogCvmfs(kLogCvmfs, kLogStderr, "invalid line %u in trace file %s",
+               num_lines, path.c_str());
+      fclose(f);
+      return false;
+    }
+    std::vector<std::string> time_parts = SplitString(fields[0], '.');
+    uint64_t time_ns = String2Uint64(time_parts[0]) * 1000000;
+    if (time_parts.size() > 1)
+      time_ns += String2Uint64(time_parts[1]) * 1000;
+    events->push_back(Tracer::Event(time_ns,
+                                    static_cast<int>(String2Int64(fields[1])),
+                                    fields[2], fields[3]));
+  }
+  fclose(f);
+  return true;
+}
+
+
+int swissknife::CommandTraceReplay::Main(const swissknife::ArgumentList &args) {
+  const std::string trace_path = *args.find('i')->second;
+  const std::string mount_point = MakeCanonicalPath(*args.find('r')->second);
+  unsigned num_threads = 8;
+  if (args.find('t') != args.end())
+    num_threads = String2Uint64(*args.find('t')->second);
+  double speed = 1.0;
+  if (args.find('s') != args.end())
+    speed = atof(args.find('s')->second->c_str());
+  if ((num_threads == 0) || (speed < 0.0)) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "invalid number of threads or speed");
+    return 1;
+  }
+
+  std::vector<Tracer::Event> events;
+  if (!Tracer::ReadBinaryTrace(trace_path, &events)) {
+    events.clear();
+    if (!ReadCsvTrace(trace_path, &events))
+      return 1;
+  }
+  std::vector<const Tracer::Event *> replay;
+  for (unsigned i = 0; i < events.size(); ++i) {
+    if (IsReplayed(events[i].code))
+      replay.push_back(&events[i]);
+  }
+  if (replay.empty()) {
+    LogCvmfs(kLogCvmfs, kLogStdout, "no replayable events in %s",
+             trace_path.c_str());
+    return 0;
+  }
+
+  const int64_t ndownload_start = GetCounter(mount_point, "user.ndownload");
+  const int64_t rx_start = GetCounter(mount_point, "user.rx");
+
+  FifoChannel<const Tracer::Event *> jobs(num_threads * 64, num_threads * 32);
+  std::vector<ReplayWorker> workers(num_threads);
+  for (unsigned i = 0; i < num_threads; ++i) {
+    workers[i].jobs = &jobs;
+    workers[i].mount_point = mount_point;
+    int retval = pthread_create(&workers[i].thread, NULL, MainReplayWorker,
+                                &workers[i]);
+    assert(retval == 0);
+  }
+
+  // Events are dispatched relative to the first replayed event
+  const uint64_t trace_start = replay[0]->time_ns;
+  const uint64_t replay_start = platform_monotonic_time_ns();
+  for (unsigned i = 0; i < replay.size(); ++i) {
+    if ((speed > 0.0) && (replay[i]->time_ns > trace_start)) {
+      const uint64_t due_ns = static_cast<uint64_t>(
+        static_cast<double>(replay[i]->time_ns - trace_start) / speed);
+      const uint64_t elapsed_ns = platform_monotonic_time_ns() - replay_start;
+      if (due_ns > elapsed_ns) {
+        const uint64_t wait_ns = due_ns - elapsed_ns;
+        struct timespec wait;
+        wait.tv_sec = wait_ns / 1000000000;
+        wait.tv_nsec = wait_ns % 1000000000;
+        nanosleep(&wait, NULL);
+      }
+    }
+    jobs.Enqueue(replay[i]);
+  }
+  for (unsigned i = 0; i < num_threads; ++i)
+    jobs.Enqueue(NULL);
+  for (unsigned i = 0; i < num_threads; ++i)
+    pthread_join(workers[i].thread, NULL);
+  const double duration =
+    static_cast<double>(platform_monotonic_time_ns() - replay_start) / 1e9;
+
+  std::map<int, std::vector<uint64_t> > latencies;
+  std::map<int, uint64_t> failures;
+  uint64_t num_bytes = 0;
+  for (unsigned i = 0; i < num_threads; ++i) {
+    for (std::map<int, std::vector<uint64_t> >::const_iterator j =
+         workers[i].latencies.begin(), jEnd = workers[i].latencies.end();
+         j != jEnd; ++j)
+    {
+      latencies[j->first].insert(latencies[j->first].end(),
+                                 j->second.begin(), j->second.end());
+    }
+    for (std::map<int, uint64_t>::const_iterator j =
+         workers[i].failures.begin(), jEnd = workers[i].failures.end();
+         j != jEnd; ++j)
+    {
+      failures[j->first] += j->second;
+    }
+    num_bytes += workers[i].num_bytes;
+  }
+
+  LogCvmfs(kLogCvmfs, kLogStdout,
+           "replayed %" PRIu64 " events in %.3f seconds (%.0f events/s), "
+           "read %" PRIu64 " kB",
+           static_cast<uint64_t>(replay.size()), duration,
+           (duration > 0.0) ? replay.size() / duration : 0.0,
+           num_bytes / 1024);
+  const int64_t ndownload_stop = GetCounter(mount_point, "user.ndownload");
+  const int64_t rx_stop = GetCounter(mount_point, "user.rx");
+  if ((ndownload_start >= 0) && (ndownload_stop >= 0) &&
+      (rx_start >= 0) && (rx_stop >= 0))
+  {
+    LogCvmfs(kLogCvmfs, kLogStdout,
+             "cache misses: %" PRId64 " downloads, %" PRId64 " kB received",
+             ndownload_stop - ndownload_start, rx_stop - rx_start);
+  }
+  LogCvmfs(kLogCvmfs, kLogStdout,
+           "operation | count | failed | p50 (us) | p90 (us) | p99 (us) | "
+           "max (us)");
+  for (std::map<int, std::vector<uint64_t> >::iterator i = latencies.begin(),
+       iEnd = latencies.end(); i != iEnd; ++i)
+  {
+    std::sort(i->second.begin(), i->second.end());
+    LogCvmfs(kLogCvmfs, kLogStdout,
+             "%s | %" PRIu64 " | %" PRIu64 " | %" PRIu64 " | %" PRIu64
+             " | %" PRIu64 " | %" PRIu64,
+             EventName(i->first).c_str(),
+             static_cast<uint64_t>(i->second.size()), failures[i->first],
+             Percentile(i->second, 50), Percentile(i->second, 90),
+             Percentile(i->second, 99), i->second.back());
+  }
+  return 0;
+}
+
+
+int swissknife::CommandCatalogHeatmap::Main(
+  const swissknife::ArgumentList &args)
+{
+  catalog::CatalogHeatmap::RankBy rank_by =
+    catalog::CatalogHeatmap::kRankLookups;
+  if (args.find('s') != args.end()) {
+    const std::string rank = *args.find('s')->second;
+    if (rank == "attaches") {
+      rank_by = catalog::CatalogHeatmap::kRankAttaches;
+    } else if (rank == "latency") {
+      rank_by = catalog::CatalogHeatmap::kRankAttachTime;
+    } else if (rank == "bytes") {
+      rank_by = catalog::CatalogHeatmap::kRankBytes;
+    } else if (rank != "lookups") {
+      LogCvmfs(kLogCvmfs, kLogStderr, "unknown ranking %s", rank.c_str());
+      return 1;
+    }
+  }
+  const unsigned max_rows = (args.find('n') != args.end()) ?
+    String2Uint64(*args.find('n')->second) : 50;
+
+  std::vector<std::string> inputs =
+    SplitString(*args.find('i')->second, ',');
+  std::vector<std::string> dump_paths;
+  for (unsigned i = 0; i < inputs.size(); ++i) {
+    if (DirectoryExists(inputs[i])) {
+      std::vector<std::string> files = FindFiles(inputs[i], "");
+      for (unsigned j = 0; j < files.size(); ++j) {
+        if (FileExists(files[j]))
+          dump_paths.push_back(files[j]);
+      }
+    } else {
+      dump_paths.push_back(inputs[i]);
+    }
+  }
+
+  // Merged per repository
+  std::map<std::string, catalog::CatalogHeatmap *> heatmaps;
+  for (unsigned i = 0; i < dump_paths.size(); ++i) {
+    std::vector<catalog::CatalogHeatmap *> loaded;
+    if (!catalog::CatalogHeatmap::Load(dump_paths[i], &loaded)) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to read heat map %s, skipping",
+               dump_paths[i].c_str());
+    }
+    for (unsigned j = 0; j < loaded.size(); ++j) {
+      const std::string repo_name = loaded[j]->repo_name();
+      if (heatmaps.find(repo_name) == heatmaps.end()) {
+        heatmaps[repo_name] = loaded[j];
+      } else {
+        heatmaps[repo_name]->Merge(*loaded[j]);
+        delete loaded[j];
+      }
+    }
+  }
+
+  std::string report;
+  std::string merged;
+  for (std::map<std::string, catalog::CatalogHeatmap *>::const_iterator
+       i = heatmaps.begin(), iEnd = heatmaps.end(); i != iEnd; ++i)
+  {
+    report += i->second->PrintReport(rank_by, max_rows) + "\n";
+    merged += i->second->Serialize();
+    delete i->second;
+  }
+
+  if ((args.find('m') != args.end()) &&
+      !SafeWriteToFile(merged, *args.find('m')->second, 0644))
+  {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to write %s",
+             args.find('m')->second->c_str());
+    return 1;
+  }
+  if (args.find('o') != args.end()) {
+    if (!SafeWriteToFile(report, *args.find('o')->second, 0644)) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to write %s",
+               args.find('o')->second->c_str());
+      return 1;
+    }
+  } else {
+    LogCvmfs(kLogCvmfs, kLogStdout | kLogNoLinebreak, "%s", report.c_str());
+  }
+  return heatmaps.empty() ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_SWISSKNIFE_TRACE_H_
+#define CVMFS_SWISSKNIFE_TRACE_H_
+
+#include <string>
+#include <vector>
+
+#include "swissknife.h"
+#include "tracer.h"
+
+namespace swissknife {
+
+class CommandTrace2Csv : public Command {
+ public:
+  ~CommandTrace2Csv() { }
+  virtual std::string GetName() const { return "trace2csv"; }
+  virtual std::string GetDescription() const {
+    return "Converts a binary client trace file "
+           "(CVMFS_TRACEFILE_FORMAT=binary) to the csv format.";
+  }
+  virtual ParameterList GetParams() const {
+    ParameterList r;
+    r.push_back(Parameter::Mandatory('i', "binary trace file"));
+    r.push_back(Parameter::Optional('o', "csv output file (default: stdout)"));
+    return r;
+  }
+  int Main(const ArgumentList &args);
+};
+
+
+/**
+ * Replays the file system operations of a client trace against a mounted
+ * repository.  Traces do not record threads, so concurrency is reproduced by
+ * dispatching the events at their original (possibly scaled) points in time
+ * to a pool of worker threads.  Traces do not record read offsets either, so
+ * every traced open() results in a full read of the file.
+ */
+class CommandTraceReplay : public Command {
+ public:
+  ~CommandTraceReplay() { }
+  virtual std::string GetName() const { return "trace_replay"; }
+  virtual std::string GetDescription() const {
+    return "Replays a client trace (binary or csv) against a mounted "
+           "repository and reports the latencies per operation.";
+  }
+  virtual ParameterList GetParams() const {
+    ParameterList r;
+    r.push_back(Parameter::Mandatory('i', "trace file"));
+    r.push_back(Parameter::Mandatory('r', "repository mount point"));
+    r.push_back(Parameter::Optional('t', "number of threads (default: 8)"));
+    r.push_back(Parameter::Optional('s', "speed factor, 0 replays as fast as "
+                                         "possible (default: 1)"));
+    return r;
+  }
+  int Main(const ArgumentList &args);
+
+ private:
+  static bool ReadCsvTrace(const std::string &path,
+                           std::vector<Tracer::Event> *events);
+};
+
+
+/**
+ * Merges the catalog heat map dumps of many clients (CVMFS_CATALOG_HEATMAP)
+ * into a ranked report per repository.
+ */
+class CommandCatalogHeatmap : public Command {
+ public:
+  ~CommandCatalogHeatmap() { }
+  virtual std::string GetName() const { return "catalog_heatmap"; }
+  virtual std::string GetDescription() const {
+    return "Merges client catalog heat map dumps into a ranked report per "
+           "repository.";
+  }
+  virtual ParameterList GetParams() const {
+    ParameterList r;
+    r.push_back(Parameter::Mandatory('i', "comma-separated list of heat map "
+                                          "dumps or directories of dumps"));
+    r.push_back(Parameter::Optional('o', "report file (default: stdout)"));
+    r.push_back(Parameter::Optional('m', "merged heat map output file"));
+    r.push_back(Parameter::Optional('s', "rank by lookups, attaches, latency, "
+                                         "or bytes (default: lookups)"));
+    r.push_back(Parameter::Optional('n', "catalogs per repository "
+                                         "(default: 50)"));
+    return r;
+  }
+  int Main(const ArgumentList &args);
+};
+
+}  // namespace swissknife
+
+#endif  // CVMFS_SWISSKNIFE_TRACE_H_
@@ -0,0 +1,423 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#define __STDC_FORMAT_MACROS
+
+#include "cvmfs_config.h"
+#include "swissknife_warm.h"
+
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <set>
+
+#include "catalog_access_profile.h"
+#include "catalog_mgr_ro.h"
+#include "directory_entry.h"
+#include "download.h"
+#include "file_chunk.h"
+#include "logging.h"
+#include "manifest.h"
+#include "shortstring.h"
+#include "tracer.h"
+#include "util/async.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace swissknife {
+
+namespace {
+
+/**
+ * Loads the catalogs directly into the cache directory, where the client finds
+ * them later on.  With an empty cache directory (dry run), catalogs are loaded
+ * into the temporary directory and removed when they are detached.
+ */
+class WarmCatalogManager : public catalog::SimpleCatalogManager {
+ public:
+  WarmCatalogManager(const shash::Any &base_hash,
+                     const string &stratum0,
+                     const string &dir_temp,
+                     download::DownloadManager *download_manager,
+                     perf::Statistics *statistics,
+                     const string &cache_dir)
+    : catalog::SimpleCatalogManager(base_hash, stratum0, dir_temp,
+                                    download_manager, statistics,
+                                    cache_dir.empty())
+    , stratum0_(stratum0)
+    , download_manager_(download_manager)
+    , cache_dir_(cache_dir)
+  { }
+
+ protected:
+  virtual catalog::LoadError LoadCatalog(const PathString &mountpoint,
+                                         const shash::Any &hash,
+                                         string *catalog_path,
+                                         shash::Any *catalog_hash)
+  {
+    if (cache_dir_.empty()) {
+      return catalog::SimpleCatalogManager::LoadCatalog(
+        mountpoint, hash, catalog_path, catalog_hash);
+    }
+
+    const shash::Any effective_hash = hash.IsNull() ? base_hash() : hash;
+    *catalog_hash = effective_hash;
+    *catalog_path = cache_dir_ + "/" + effective_hash.MakePathWithoutSuffix();
+    if (FileExists(*catalog_path))
+      return catalog::kLoadUp2Date;
+
+    const string url = stratum0_ + "/data/" + effective_hash.MakePath();
+    const string tmp_path =
+      cache_dir_ + "/txn/catalog." + effective_hash.ToString();
+    download::JobInfo download_catalog(&url, true, false, &tmp_path,
+                                       &effective_hash);
+    download::Failures retval = download_manager_->Fetch(&download_catalog);
+    if (retval != download::kFailOk) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to load %s (%d - %s)",
+               url.c_str(), retval, download::Code2Ascii(retval));
+      return catalog::kLoadFail;
+    }
+    if (rename(tmp_path.c_str(), catalog_path->c_str()) != 0) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to move catalog to %s (%d)",
+               catalog_path->c_str(), errno);
+      unlink(tmp_path.c_str());
+      return catalog::kLoadFail;
+    }
+    return catalog::kLoadNew;
+  }
+
+ private:
+  string stratum0_;
+  download::DownloadManager *download_manager_;
+  string cache_dir_;
+};
+
+}  // anonymous namespace
+
+
+/**
+ * Strips the mount point prefix /cvmfs/<repository name> and trailing slashes.
+ * The root directory becomes the empty string.
+ */
+string CommandWarm::NormalizePath(
+  const string &path,
+  const string &repository_name)
+{
+  string result = path;
+  const string mount_prefix = "/cvmfs/" + repository_name;
+  if (HasPrefix(result, mount_prefix, false) &&
+      ((result.length() == mount_prefix.length()) ||
+       (result[mount_prefix.length()] == '/')))
+  {
+    result = result.substr(mount_prefix.length());
+  }
+  while (!result.empty() && (*result.rbegin() == '/'))
+    result.erase(result.length() - 1);
+  if (!result.empty() && (result[0] != '/'))
+    result = "/" + result;
+  return result;
+}
+
+
+/**
+ * One path per line.  Empty lines and lines starting with '#' are skipped.
+ */
+bool CommandWarm::ReadPathList(
+  const string &path,
+  const string &repository_name,
+  vector<string> *paths)
+{
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to open path list %s (%d)",
+             path.c_str(), errno);
+    return false;
+  }
+  string line;
+  while (GetLineFile(f, &line)) {
+    line = Trim(line);
+    if (line.empty() || (line[0] == '#'))
+      continue;
+    const string normalized = NormalizePath(line, repository_name);
+    if (!normalized.empty())
+      paths->push_back(normalized);
+  }
+  fclose(f);
+  return true;
+}
+
+
+/**
+ * Takes the files opened in the traced run, in the order of their first
+ * access.  Other events only need the catalogs, which are loaded anyway on the
+ * way to the files.
+ */
+bool CommandWarm::ReadTracerLog(const string &path, vector<string> *paths) {
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to open tracer log %s (%d)",
+             path.c_str(), errno);
+    return false;
+  }
+  string line;
+  vector<string> fields;
+  unsigned num_lines = 0;
+  while (GetLineFile(f, &line)) {
+    ++num_lines;
+    if (!catalog::AccessProfile::ParseCsvLine(line, &fields) ||
+        (fields.size() < 3))
+    {
+      LogCvmfs(kLogCvmfs, kLogStderr, "invalid line %u in tracer log %s",
+               num_lines, path.c_str());
+      fclose(f);
+      return false;
+    }
+    if (String2Int64(fields[1]) != Tracer::kEventOpen)
+      continue;
+    const string normalized = NormalizePath(fields[2], "");
+    if (!normalized.empty())
+      paths->push_back(normalized);
+  }
+  fclose(f);
+  return true;
+}
+
+
+string CommandWarm::GetCachePath(const shash::Any &id) const {
+  return cache_dir_ + "/" + id.MakePathWithoutSuffix();
+}
+
+
+/**
+ * Resolves the paths to the objects of the regular files and their chunks.
+ * Objects shared by several files are only listed once.
+ */
+void CommandWarm::CollectObjects(
+  catalog::SimpleCatalogManager *catalog_mgr,
+  const vector<string> &paths,
+  vector<Object> *objects)
+{
+  set<shash::Any> seen;
+  unsigned num_unresolved = 0;
+  for (unsigned i = 0; i < paths.size(); ++i) {
+    catalog::DirectoryEntry dirent;
+    if (!catalog_mgr->LookupPath(paths[i], catalog::kLookupSole, &dirent)) {
+      LogCvmfs(kLogCvmfs, kLogVerboseMsg, "%s not found", paths[i].c_str());
+      num_unresolved++;
+      continue;
+    }
+    // External files are not stored in the repository
+    if (!dirent.IsRegular() || dirent.IsExternalFile())
+      continue;
+
+    if (dirent.IsChunkedFile()) {
+      PathString path(paths[i].data(), paths[i].length());
+      FileChunkList chunks;
+      if (!catalog_mgr->ListFileChunks(path, dirent.hash_algorithm(),
+                                       &chunks) || chunks.IsEmpty())
+      {
+        LogCvmfs(kLogCvmfs, kLogVerboseMsg, "no chunks for %s",
+                 paths[i].c_str());
+        num_unresolved++;
+        continue;
+      }
+      for (unsigned j = 0; j < chunks.size(); ++j) {
+        const FileChunk *chunk = chunks.AtPtr(j);
+        if (seen.insert(chunk->content_hash()).second) {
+          objects->push_back(Object(chunk->content_hash(), chunk->size(),
+                                    dirent.compression_algorithm()));
+        }
+      }
+      continue;
+    }
+
+    if (!dirent.checksum().IsNull() && seen.insert(dirent.checksum()).second) {
+      objects->push_back(Object(dirent.checksum(), dirent.size(),
+                                dirent.compression_algorithm()));
+    }
+  }
+  if (num_unresolved > 0) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "Warning: %u paths could not be resolved",
+             num_unresolved);
+  }
+}
+
+
+void CommandWarm::OnJobDone(
+  download::JobInfo * const &job,
+  Downloads *downloads)
+{
+  Download *download = (*downloads)[job];
+  if (job->error_code != download::kFailOk) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to fetch %s (%d - %s)",
+             download->url.c_str(), job->error_code,
+             download::Code2Ascii(job->error_code));
+    num_failed_++;
+    return;
+  }
+  if (rename(download->tmp_path.c_str(), download->cache_path.c_str()) != 0) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to move %s to %s (%d)",
+             download->tmp_path.c_str(), download->cache_path.c_str(), errno);
+    unlink(download->tmp_path.c_str());
+    num_failed_++;
+    return;
+  }
+  num_fetched_++;
+}
+
+
+/**
+ * Objects are downloaded in batches through the download manager's
+ * FetchMany(), which keeps as many transfers in flight as there are pooled
+ * connections.  Downloads land in the txn directory of the cache and are moved
+ * into place once they are verified.
+ */
+void CommandWarm::FetchObjects(const vector<Object> &objects) {
+  for (unsigned begin = 0; begin < objects.size(); begin += kBatchSize) {
+    const unsigned end =
+      std::min(begin + kBatchSize, static_cast<unsigned>(objects.size()));
+    Downloads downloads;
+    vector<download::JobInfo *> jobs;
+    for (unsigned i = begin; i < end; ++i) {
+      Download *download = new Download();
+      download->id = objects[i].id;
+      download->url = stratum0_url_ + "/data/" + download->id.MakePath();
+      download->tmp_path = cache_dir_ + "/txn/warm." + download->id.ToString();
+      download->cache_path = GetCachePath(download->id);
+      const bool compressed =
+        (objects[i].compression_algorithm != zlib::kNoCompression);
+      download->job = new download::JobInfo(
+        &download->url, compressed, false, &download->tmp_path, &download->id);
+      download->job->compression_alg = objects[i].compression_algorithm;
+      downloads[download->job] = download;
+      jobs.push_back(download->job);
+    }
+
+    BoundClosure<download::JobInfo *, CommandWarm, Downloads *>
+      on_done(&CommandWarm::OnJobDone, this, &downloads);
+    download_manager()->FetchMany(jobs, &on_done);
+    for (Downloads::iterator i = downloads.begin(), iEnd = downloads.end();
+         i != iEnd; ++i)
+    {
+      delete i->first;
+      delete i->second;
+    }
+    LogCvmfs(kLogCvmfs, kLogStdout, "CernVM-FS: processed %u of %u objects",
+             end, static_cast<unsigned>(objects.size()));
+  }
+}
+
+
+int CommandWarm::Main(const ArgumentList &args) {
+  stratum0_url_ = *args.find('u')->second;
+  cache_dir_ = *args.find('r')->second;
+  const string repository_name = *args.find('m')->second;
+  const string temp_dir = *args.find('x')->second;
+  string master_keys = *args.find('k')->second;
+  if (DirectoryExists(master_keys))
+    master_keys = JoinStrings(FindFiles(master_keys, ".pub"), ":");
+  string trusted_certs;
+  if (args.find('y') != args.end())
+    trusted_certs = *args.find('y')->second;
+  unsigned num_parallel = 4;
+  if (args.find('n') != args.end())
+    num_parallel = String2Uint64(*args.find('n')->second);
+  unsigned timeout = 60;
+  if (args.find('t') != args.end())
+    timeout = String2Uint64(*args.find('t')->second);
+  unsigned retries = 3;
+  if (args.find('a') != args.end())
+    retries = String2Uint64(*args.find('a')->second);
+  const bool dry_run = (args.find('D') != args.end());
+
+  if ((args.find('l') == args.end()) && (args.find('T') == args.end())) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "need a path list (-l) or a tracer log "
+             "(-T)");
+    return 1;
+  }
+  vector<string> all_paths;
+  if ((args.find('l') != args.end()) &&
+      !ReadPathList(*args.find('l')->second, repository_name, &all_paths))
+  {
+    return 1;
+  }
+  if ((args.find('T') != args.end()) &&
+      !ReadTracerLog(*args.find('T')->second, &all_paths))
+  {
+    return 1;
+  }
+  vector<string> paths;
+  set<string> seen_paths;
+  for (unsigned i = 0; i < all_paths.size(); ++i) {
+    if (seen_paths.insert(all_paths[i]).second)
+      paths.push_back(all_paths[i]);
+  }
+
+  if (!InitDownloadManager(false, std::max(num_parallel, 1U) + 1))
+    return 1;
+  if (!InitVerifyingSignatureManager(master_keys, trusted_certs)) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to initalize CVMFS signatures");
+    return 1;
+  }
+  download_manager()->SetTimeout(timeout, timeout);
+  download_manager()->SetRetryParameters(retries, 500, 2000);
+  download_manager()->Spawn();
+
+  manifest::ManifestEnsemble ensemble;
+  manifest::Failures m_retval =
+    FetchRemoteManifestEnsemble(stratum0_url_, repository_name, &ensemble);
+  if (m_retval != manifest::kFailOk) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to fetch manifest (%d - %s)",
+             m_retval, manifest::Code2Ascii(m_retval));
+    return 1;
+  }
+
+  vector<Object> objects;
+  {
+    WarmCatalogManager catalog_mgr(ensemble.manifest->catalog_hash(),
+                                   stratum0_url_, temp_dir,
+                                   download_manager(), statistics(),
+                                   dry_run ? "" : cache_dir_);
+    if (!catalog_mgr.Init()) {
+      LogCvmfs(kLogCvmfs, kLogStderr, "failed to load the root catalog");
+      return 1;
+    }
+    CollectObjects(&catalog_mgr, paths, &objects);
+  }
+
+  vector<Object> missing;
+  uint64_t size_total = 0;
+  uint64_t size_missing = 0;
+  for (unsigned i = 0; i < objects.size(); ++i) {
+    size_total += objects[i].size;
+    if (!FileExists(GetCachePath(objects[i].id))) {
+      missing.push_back(objects[i]);
+      size_missing += objects[i].size;
+    }
+  }
+  LogCvmfs(kLogCvmfs, kLogStdout, "CernVM-FS: %u paths resolve to %u objects "
+           "(%" PRIu64 " MB), %u objects (%" PRIu64 " MB) are not yet cached",
+           static_cast<unsigned>(paths.size()),
+           static_cast<unsigned>(objects.size()), size_total / (1024 * 1024),
+           static_cast<unsigned>(missing.size()), size_missing / (1024 * 1024));
+  if (dry_run)
+    return 0;
+
+  FetchObjects(missing);
+  if (!ensemble.manifest->ExportChecksum(cache_dir_, 0660)) {
+    LogCvmfs(kLogCvmfs, kLogStderr, "failed to write the checksum of %s",
+             repository_name.c_str());
+    return 1;
+  }
+  LogCvmfs(kLogCvmfs, kLogStdout, "CernVM-FS: fetched %" PRIu64 " objects, "
+           "%" PRIu64 " failed", num_fetched_, num_failed_);
+  return (num_failed_ == 0) ? 0 : 1;
+}
+
+}  // namespace swissknife
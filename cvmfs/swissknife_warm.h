@@ -0,0 +1,111 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Warms a client cache directory for a job.  Instead of mirroring the
+ * repository like "pull -c", only the objects of the given paths are fetched.
+ * The paths come from a list or from the tracer log of a previous run.
+ */
+
+#ifndef CVMFS_SWISSKNIFE_WARM_H_
+#define CVMFS_SWISSKNIFE_WARM_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "compression.h"
+#include "hash.h"
+#include "swissknife.h"
+
+namespace catalog {
+class SimpleCatalogManager;
+}
+namespace download {
+struct JobInfo;
+}
+
+namespace swissknife {
+
+class CommandWarm : public Command {
+ public:
+  /**
+   * Number of objects handed to the download manager at once
+   */
+  static const unsigned kBatchSize = 1024;
+
+  /**
+   * A data object of a file or of a file chunk
+   */
+  struct Object {
+    Object() : size(0), compression_algorithm(zlib::kZlibDefault) { }
+    Object(const shash::Any &id, const uint64_t size,
+           const zlib::Algorithms compression_algorithm)
+      : id(id), size(size), compression_algorithm(compression_algorithm) { }
+
+    shash::Any id;
+    uint64_t size;
+    zlib::Algorithms compression_algorithm;
+  };
+
+  CommandWarm() : num_fetched_(0), num_failed_(0) { }
+  ~CommandWarm() { }
+  virtual std::string GetName() const { return "warm"; }
+  virtual std::string GetDescription() const {
+    return "Fetches the files of a list of paths into a client cache "
+           "directory.";
+  }
+  virtual ParameterList GetParams() const {
+    ParameterList r;
+    r.push_back(Parameter::Mandatory('u', "repository url"));
+    r.push_back(Parameter::Mandatory('m', "repository name"));
+    r.push_back(Parameter::Mandatory('r', "cache directory"));
+    r.push_back(Parameter::Mandatory('k', "repository master key(s) / dir"));
+    r.push_back(Parameter::Optional('y', "trusted certificate directories"));
+    r.push_back(Parameter::Mandatory('x', "directory for temporary files"));
+    r.push_back(Parameter::Optional('l', "file with a list of paths"));
+    r.push_back(Parameter::Optional('T', "tracer log (csv) of a previous run"));
+    r.push_back(Parameter::Optional('n', "number of parallel downloads"));
+    r.push_back(Parameter::Optional('t', "timeout (s)"));
+    r.push_back(Parameter::Optional('a', "number of retries"));
+    r.push_back(Parameter::Switch('D', "dry run, only estimate the size"));
+    return r;
+  }
+  int Main(const ArgumentList &args);
+
+  static std::string NormalizePath(const std::string &path,
+                                   const std::string &repository_name);
+  static bool ReadPathList(const std::string &path,
+                           const std::string &repository_name,
+                           std::vector<std::string> *paths);
+  static bool ReadTracerLog(const std::string &path,
+                            std::vector<std::string> *paths);
+
+ private:
+  struct Download {
+    Download() : job(NULL) { }
+    download::JobInfo *job;
+    std::string url;
+    std::string tmp_path;
+    std::string cache_path;
+    shash::Any id;
+  };
+  typedef std::map<download::JobInfo *, Download *> Downloads;
+
+  void CollectObjects(catalog::SimpleCatalogManager *catalog_mgr,
+                      const std::vector<std::string> &paths,
+                      std::vector<Object> *objects);
+  void FetchObjects(const std::vector<Object> &objects);
+  void OnJobDone(download::JobInfo * const &job, Downloads *downloads);
+  std::string GetCachePath(const shash::Any &id) const;
+
+  std::string stratum0_url_;
+  std::string cache_dir_;
+  uint64_t num_fetched_;
+  uint64_t num_failed_;
+};
+
+}  // namespace swissknife
+
+#endif  // CVMFS_SWISSKNIFE_WARM_H_
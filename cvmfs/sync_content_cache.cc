@@ -0,0 +1,194 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#define __STDC_FORMAT_MACROS
+
+#include "cvmfs_config.h"
+#include "sync_content_cache.h"
+
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+
+#include "logging.h"
+#include "util/posix.h"
+#include "util/string.h"
+#include "util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+namespace publish {
+
+const char *SyncContentCache::kMagic = "CVMFS_SYNC_CONTENT_CACHE_V1";
+
+
+SyncContentCache::SyncContentCache(
+  const string &path,
+  const string &fingerprint)
+  : path_(path)
+  , fingerprint_(fingerprint)
+{
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+}
+
+
+SyncContentCache::~SyncContentCache() {
+  pthread_mutex_destroy(&lock_);
+}
+
+
+/**
+ * Reads the entries of the previous publish.  A missing, damaged, or
+ * incompatible cache file results in an empty cache.
+ */
+bool SyncContentCache::Load() {
+  previous_.clear();
+  FILE *f = fopen(path_.c_str(), "r");
+  if (f == NULL) {
+    LogCvmfs(kLogPublish, kLogDebug, "no content cache in %s", path_.c_str());
+    return false;
+  }
+
+  string line;
+  if (!GetLineFile(f, &line) || (line != string(kMagic) + " " + fingerprint_))
+  {
+    LogCvmfs(kLogPublish, kLogDebug, "ignoring incompatible content cache %s",
+             path_.c_str());
+    fclose(f);
+    return false;
+  }
+
+  char hash_str[128];
+  while (GetLineFile(f, &line)) {
+    Entry entry;
+    int compression_alg;
+    uint64_t num_chunks;
+    int path_pos = 0;
+    int retval = sscanf(line.c_str(),
+      "F %" SCNu64 " %" SCNu64 " %" SCNd64 " %" SCNd64 " %127s %d %" SCNu64
+      "%n",
+      &entry.inode, &entry.size, &entry.mtime, &entry.ctime, hash_str,
+      &compression_alg, &num_chunks, &path_pos);
+    if ((retval != 7) || (path_pos == 0) || (line[path_pos] != ' '))
+      goto load_fail;
+    const string relative_path = line.substr(path_pos + 1);
+    entry.content_hash = shash::MkFromSuffixedHexPtr(shash::HexPtr(hash_str));
+    if (entry.content_hash.IsNull())
+      goto load_fail;
+    entry.compression_alg = static_cast<zlib::Algorithms>(compression_alg);
+
+    for (uint64_t i = 0; i < num_chunks; ++i) {
+      uint64_t offset;
+      uint64_t size;
+      if (!GetLineFile(f, &line))
+        goto load_fail;
+      retval = sscanf(line.c_str(), "%" SCNu64 " %" SCNu64 " %127s",
+                      &offset, &size, hash_str);
+      if (retval != 3)
+        goto load_fail;
+      entry.file_chunks.PushBack(FileChunk(
+        shash::MkFromSuffixedHexPtr(shash::HexPtr(hash_str)),
+        offset, size));
+    }
+    previous_[relative_path] = entry;
+  }
+  fclose(f);
+  LogCvmfs(kLogPublish, kLogDebug, "loaded %u entries from content cache %s",
+           num_loaded(), path_.c_str());
+  return true;
+
+ load_fail:
+  LogCvmfs(kLogPublish, kLogStderr, "Warning: ignoring damaged content "
+           "cache %s", path_.c_str());
+  fclose(f);
+  previous_.clear();
+  return false;
+}
+
+
+/**
+ * Atomically replaces the cache file by the entries of the current publish.
+ */
+bool SyncContentCache::Save() {
+  MutexLockGuard guard(lock_);
+  const string tmp_path = path_ + ".tmp";
+  FILE *f = fopen(tmp_path.c_str(), "w");
+  if (f == NULL) {
+    LogCvmfs(kLogPublish, kLogStderr, "Warning: failed to write content "
+             "cache %s (%d)", tmp_path.c_str(), errno);
+    return false;
+  }
+
+  bool retval = fprintf(f, "%s %s\n", kMagic, fingerprint_.c_str()) > 0;
+  for (EntryMap::const_iterator i = current_.begin(), iEnd = current_.end();
+       retval && (i != iEnd); ++i)
+  {
+    const Entry &entry = i->second;
+    retval = fprintf(f,
+      "F %" PRIu64 " %" PRIu64 " %" PRId64 " %" PRId64 " %s %d %" PRIu64
+      " %s\n",
+      entry.inode, entry.size, entry.mtime, entry.ctime,
+      entry.content_hash.ToStringWithSuffix().c_str(),
+      static_cast<int>(entry.compression_alg),
+      static_cast<uint64_t>(entry.file_chunks.size()),
+      i->first.c_str()) > 0;
+    for (unsigned j = 0; retval && (j < entry.file_chunks.size()); ++j) {
+      const FileChunk chunk = entry.file_chunks.At(j);
+      retval = fprintf(f, "%" PRIu64 " %" PRIu64 " %s\n",
+                       static_cast<uint64_t>(chunk.offset()),
+                       static_cast<uint64_t>(chunk.size()),
+                       chunk.content_hash().ToStringWithSuffix().c_str()) > 0;
+    }
+  }
+  retval = (fclose(f) == 0) && retval;
+  if (retval)
+    retval = rename(tmp_path.c_str(), path_.c_str()) == 0;
+  if (!retval) {
+    LogCvmfs(kLogPublish, kLogStderr, "Warning: failed to write content "
+             "cache %s", path_.c_str());
+    unlink(tmp_path.c_str());
+    return false;
+  }
+  LogCvmfs(kLogPublish, kLogDebug, "stored %u entries in content cache %s",
+           static_cast<unsigned>(current_.size()), path_.c_str());
+  return true;
+}
+
+
+/**
+ * Returns true and fills entry if relative_path was processed during the
+ * previous publish and its key did not change since.
+ */
+bool SyncContentCache::Lookup(
+  const string &relative_path,
+  const Entry &key,
+  Entry *entry) const
+{
+  EntryMap::const_iterator i = previous_.find(relative_path);
+  if ((i == previous_.end()) || !i->second.HasSameKey(key))
+    return false;
+  *entry = i->second;
+  return true;
+}
+
+
+void SyncContentCache::Insert(const string &relative_path, const Entry &entry) {
+  // The cache file is line based
+  if (relative_path.find('\n') != string::npos)
+    return;
+  MutexLockGuard guard(lock_);
+  current_[relative_path] = entry;
+}
+
+
+unsigned SyncContentCache::num_inserted() const {
+  MutexLockGuard guard(lock_);
+  return current_.size();
+}
+
+}  // namespace publish
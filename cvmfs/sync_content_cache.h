@@ -0,0 +1,94 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * The SyncContentCache remembers the outcome of processing regular files
+ * during a publish.  An entry is keyed by the path of the file and by the
+ * (inode, size, mtime, ctime) tuple of the file in the union volume.  If a
+ * later publish finds the file in the change set with an unmodified key, the
+ * content hash and the chunk list are taken from the cache instead of reading
+ * and compressing the file once more.  This helps with build systems that
+ * touch files without changing them and with publish runs that are retried
+ * after an abort.
+ */
+
+#ifndef CVMFS_SYNC_CONTENT_CACHE_H_
+#define CVMFS_SYNC_CONTENT_CACHE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include "compression.h"
+#include "file_chunk.h"
+#include "hash.h"
+
+namespace publish {
+
+class SyncContentCache {
+ public:
+  struct Entry {
+    Entry()
+      : inode(0)
+      , size(0)
+      , mtime(0)
+      , ctime(0)
+      , compression_alg(zlib::kZlibDefault)
+    { }
+
+    bool HasSameKey(const Entry &other) const {
+      return (inode == other.inode) && (size == other.size) &&
+             (mtime == other.mtime) && (ctime == other.ctime);
+    }
+
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime;
+    int64_t ctime;
+    shash::Any content_hash;
+    zlib::Algorithms compression_alg;
+    FileChunkList file_chunks;
+  };
+
+  /**
+   * The fingerprint describes the processing parameters (hash algorithm,
+   * compression, chunking, ...).  A cache file written with a different
+   * fingerprint is ignored.
+   */
+  SyncContentCache(const std::string &path, const std::string &fingerprint);
+  ~SyncContentCache();
+
+  bool Load();
+  bool Save();
+
+  bool Lookup(const std::string &relative_path,
+              const Entry &key,
+              Entry *entry) const;
+  void Insert(const std::string &relative_path, const Entry &entry);
+
+  unsigned num_loaded() const { return previous_.size(); }
+  unsigned num_inserted() const;
+
+ private:
+  typedef std::map<std::string, Entry> EntryMap;
+
+  static const char *kMagic;
+
+  std::string path_;
+  std::string fingerprint_;
+  /**
+   * Entries of the previous publish, read-only after Load()
+   */
+  EntryMap previous_;
+  /**
+   * Entries of the current publish, written on Save().  Only these are kept,
+   * so that the cache does not grow beyond the size of a change set.
+   */
+  EntryMap current_;
+  mutable pthread_mutex_t lock_;
+};
+
+}  // namespace publish
+
+#endif  // CVMFS_SYNC_CONTENT_CACHE_H_
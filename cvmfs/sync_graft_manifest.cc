@@ -0,0 +1,84 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "sync_graft_manifest.h"
+
+#include <cerrno>
+#include <cstdio>
+
+#include "logging.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace publish {
+
+const char *GraftManifest::kMagic = "CVMFS_GRAFT_MANIFEST_V1";
+
+
+/**
+ * A record starts with a line "P <path>", followed by the lines of the graft
+ * description.
+ */
+string GraftManifest::MakeRecord(const string &path, const string &description)
+{
+  return "P " + path + "\n" + description;
+}
+
+
+string GraftManifest::MakeHeader() {
+  return string(kMagic) + "\n";
+}
+
+
+bool GraftManifest::Load() {
+  descriptions_.clear();
+  FILE *f = fopen(path_.c_str(), "r");
+  if (f == NULL) {
+    LogCvmfs(kLogPublish, kLogStderr, "failed to open graft manifest %s (%d)",
+             path_.c_str(), errno);
+    return false;
+  }
+
+  string line;
+  if (!GetLineFile(f, &line) || (line != kMagic)) {
+    LogCvmfs(kLogPublish, kLogStderr, "%s is not a graft manifest",
+             path_.c_str());
+    fclose(f);
+    return false;
+  }
+
+  string *description = NULL;
+  while (GetLineFile(f, &line)) {
+    if (HasPrefix(line, "P ", false)) {
+      description = &descriptions_[line.substr(2)];
+      description->clear();
+      continue;
+    }
+    if (description == NULL) {
+      LogCvmfs(kLogPublish, kLogStderr, "invalid line in graft manifest %s: %s",
+               path_.c_str(), line.c_str());
+      fclose(f);
+      descriptions_.clear();
+      return false;
+    }
+    *description += line + "\n";
+  }
+  fclose(f);
+  LogCvmfs(kLogPublish, kLogDebug, "loaded %u graft descriptions from %s",
+           size(), path_.c_str());
+  return true;
+}
+
+
+bool GraftManifest::Lookup(const string &path, string *description) const {
+  map<string, string>::const_iterator i = descriptions_.find(path);
+  if (i == descriptions_.end())
+    return false;
+  *description = i->second;
+  return true;
+}
+
+}  // namespace publish
@@ -0,0 +1,46 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * A graft manifest collects the graft descriptions of many files in a single
+ * file.  It is written by `cvmfs_swissknife graft -m` for bulk imports of
+ * external data and read by `cvmfs_swissknife sync`, which then does not need
+ * to open a .cvmfsgraft-$filename side file for every grafted file.
+ *
+ * The descriptions have the key=value format of the side files.  They are
+ * keyed by the absolute path of the grafted file in the union volume.
+ */
+
+#ifndef CVMFS_SYNC_GRAFT_MANIFEST_H_
+#define CVMFS_SYNC_GRAFT_MANIFEST_H_
+
+#include <map>
+#include <string>
+
+namespace publish {
+
+class GraftManifest {
+ public:
+  static const char *kMagic;
+
+  explicit GraftManifest(const std::string &path) : path_(path) { }
+
+  bool Load();
+  /**
+   * Read-only, can be called concurrently after Load()
+   */
+  bool Lookup(const std::string &path, std::string *description) const;
+
+  static std::string MakeHeader();
+  static std::string MakeRecord(const std::string &path,
+                                const std::string &description);
+
+  unsigned size() const { return descriptions_.size(); }
+
+ private:
+  std::string path_;
+  std::map<std::string, std::string> descriptions_;
+};
+
+}  // namespace publish
+
+#endif  // CVMFS_SYNC_GRAFT_MANIFEST_H_
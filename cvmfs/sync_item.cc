@@ -7,6 +7,7 @@
 #include <cerrno>
 #include <vector>
 
+#include "sync_graft_manifest.h"
 #include "sync_mediator.h"
 #include "sync_union.h"
 
@@ -24,6 +25,7 @@ SyncItem::SyncItem() :
   valid_graft_(false),
   graft_marker_present_(false),
   external_data_(false),
+  streamed_(false),
   graft_chunklist_(NULL),
   graft_size_(-1),
   scratch_type_(static_cast<SyncItemType>(0)),
@@ -42,6 +44,7 @@ SyncItem::SyncItem(const string       &relative_parent_path,
   valid_graft_(false),
   graft_marker_present_(false),
   external_data_(false),
+  streamed_(false),
   relative_parent_path_(relative_parent_path),
   filename_(filename),
   graft_chunklist_(NULL),
@@ -54,6 +57,38 @@ SyncItem::SyncItem(const string       &relative_parent_path,
   CheckMarkerFiles();
 }
 
+SyncItem::SyncItem(const string          &relative_parent_path,
+                   const string          &filename,
+                   const SyncUnion       *union_engine,
+                   const platform_stat64 &info,
+                   const string          &symlink,
+                   const string          &data_path) :
+  union_engine_(union_engine),
+  whiteout_(false),
+  opaque_(false),
+  masked_hardlink_(true),
+  has_catalog_marker_(false),
+  valid_graft_(false),
+  graft_marker_present_(false),
+  external_data_(false),
+  streamed_(true),
+  relative_parent_path_(relative_parent_path),
+  filename_(filename),
+  graft_chunklist_(NULL),
+  graft_size_(-1),
+  scratch_type_(kItemUnknown),
+  rdonly_type_(kItemUnknown),
+  compression_algorithm_(zlib::kZlibDefault),
+  symlink_(symlink),
+  data_path_(data_path)
+{
+  content_hash_.algorithm = shash::kAny;
+  union_stat_.obtained = true;
+  union_stat_.stat = info;
+  scratch_stat_ = union_stat_;
+  scratch_type_ = GetGenericFiletype(scratch_stat_);
+}
+
 
 SyncItem::~SyncItem() {
   delete graft_chunklist_;
@@ -188,7 +223,9 @@ catalog::DirectoryEntryBase SyncItem::CreateBasicCatalogDirent() const {
 
   dirent.name_.Assign(filename_.data(), filename_.length());
 
-  if (this->IsSymlink()) {
+  if (this->IsSymlink() && streamed_) {
+    dirent.symlink_.Assign(symlink_.data(), symlink_.length());
+  } else if (this->IsSymlink()) {
     char slnk[PATH_MAX+1];
     const ssize_t length =
       readlink((this->GetUnionPath()).c_str(), slnk, PATH_MAX);
@@ -206,12 +243,16 @@ std::string SyncItem::GetRdOnlyPath() const {
 }
 
 std::string SyncItem::GetUnionPath() const {
+  if (streamed_ && !data_path_.empty())
+    return data_path_;
   const string relative_path = GetRelativePath().empty() ?
                                "" : "/" + GetRelativePath();
   return union_engine_->union_path() + relative_path;
 }
 
 std::string SyncItem::GetScratchPath() const {
+  if (streamed_ && !data_path_.empty())
+    return data_path_;
   const string relative_path = GetRelativePath().empty() ?
                                "" : "/" + GetRelativePath();
   return union_engine_->scratch_path() + relative_path;
@@ -238,14 +279,12 @@ std::string SyncItem::GetGraftMarkerPath() const {
           ("/.cvmfsgraft-" + filename_)));
 }
 
-void SyncItem::CheckGraft() {
-  valid_graft_ = false;
-  bool found_checksum = false;
-  std::string checksum_type;
-  std::string checksum_value;
-  std::string graftfile = GetGraftMarkerPath();
-  LogCvmfs(kLogFsTraversal, kLogDebug, "Checking potential graft path %s.",
-           graftfile.c_str());
+/**
+ * Reads the .cvmfsgraft-$filename side file.  Returns false if there is none.
+ */
+bool SyncItem::ReadGraftMarker(const std::string &graftfile,
+                               std::string *description) const
+{
   FILE *fp = fopen(graftfile.c_str(), "r");
   if (fp == NULL) {
     // This sync item can be a file from a removed directory tree on overlayfs.
@@ -256,18 +295,46 @@ void SyncItem::CheckGraft() {
                "(%s): %s (errno=%d)",
                graftfile.c_str(), strerror(errno), errno);
     }
-    return;
+    return false;
+  }
+  std::string line;
+  while (GetLineFile(fp, &line))
+    *description += line + "\n";
+  if (!feof(fp)) {
+    LogCvmfs(kLogFsTraversal, kLogWarning, "Unable to read from catalog "
+             "marker (%s): %s (errno=%d)",
+             graftfile.c_str(), strerror(errno), errno);
+  }
+  fclose(fp);
+  return true;
+}
+
+void SyncItem::CheckGraft() {
+  valid_graft_ = false;
+  bool found_checksum = false;
+  std::string checksum_type;
+  std::string checksum_value;
+  std::string graftfile = GetGraftMarkerPath();
+  std::string description;
+  const GraftManifest *manifest = union_engine_->graft_manifest();
+  if ((manifest != NULL) && manifest->Lookup(GetUnionPath(), &description)) {
+    graftfile = GetUnionPath() + " (graft manifest)";
+  } else {
+    LogCvmfs(kLogFsTraversal, kLogDebug, "Checking potential graft path %s.",
+             graftfile.c_str());
+    if (!ReadGraftMarker(graftfile, &description))
+      return;
   }
   graft_marker_present_ = true;
   valid_graft_ = true;
-  std::string line;
   std::vector<std::string> contents;
 
   std::vector<off_t> chunk_offsets;
   std::vector<shash::Any> chunk_checksums;
 
-  while (GetLineFile(fp, &line)) {
-    std::string trimmed_line = Trim(line);
+  std::vector<std::string> lines = SplitString(description, '\n');
+  for (unsigned i = 0; i < lines.size(); ++i) {
+    std::string trimmed_line = Trim(lines[i]);
 
     if (!trimmed_line.size()) {continue;}
     if (trimmed_line[0] == '#') {continue;}
@@ -331,12 +398,6 @@ void SyncItem::CheckGraft() {
       }
     }
   }
-  if (!feof(fp)) {
-    LogCvmfs(kLogFsTraversal, kLogWarning, "Unable to read from catalog "
-             "marker (%s): %s (errno=%d)",
-             graftfile.c_str(), strerror(errno), errno);
-  }
-  fclose(fp);
   valid_graft_ = valid_graft_ && (graft_size_ > -1) && found_checksum
                  && (chunk_checksums.size() == chunk_offsets.size());
 
@@ -63,6 +63,7 @@ class SyncItem {
   inline bool IsBlockDevice()     const { return IsType(kItemBlockDevice);     }
   inline bool IsGraftMarker()     const { return IsType(kItemMarker);          }
   inline bool IsExternalData()    const { return external_data_;               }
+  inline bool IsStreamed()        const { return streamed_;                    }
 
   inline bool IsWhiteout()        const { return whiteout_;                    }
   inline bool IsCatalogMarker()   const { return filename_ == ".cvmfscatalog"; }
@@ -132,6 +133,11 @@ class SyncItem {
     return !masked_hardlink_ && GetUnionLinkcount() > 1;
   }
 
+  inline platform_stat64 GetUnionStat() const {
+    StatUnion();
+    return union_stat_.stat;
+  }
+
   unsigned int GetRdOnlyLinkcount() const;
   uint64_t GetRdOnlyInode() const;
   unsigned int GetUnionLinkcount() const;
@@ -148,11 +154,6 @@ class SyncItem {
   }
 
  protected:
-  inline platform_stat64 GetUnionStat() const {
-    StatUnion();
-    return union_stat_.stat;
-  }
-
   SyncItemType GetRdOnlyFiletype() const;
   SyncItemType GetScratchFiletype() const;
 
@@ -202,6 +203,18 @@ class SyncItem {
            const SyncUnion    *union_engine,
            const SyncItemType  entry_type);
 
+  /**
+   * Creates a SyncItem for an entry that does not exist in the union file
+   * system, such as an entry of a tarball.  The stat information is given
+   * and the file contents, if any, are read from data_path.
+   */
+  SyncItem(const std::string     &relative_parent_path,
+           const std::string     &filename,
+           const SyncUnion       *union_engine,
+           const platform_stat64 &info,
+           const std::string     &symlink,
+           const std::string     &data_path);
+
   /**
    * Structure to cache stat calls to the different file locations.
    */
@@ -232,6 +245,8 @@ class SyncItem {
   void CheckCatalogMarker();
 
   std::string GetGraftMarkerPath() const;
+  bool ReadGraftMarker(const std::string &graftfile,
+                       std::string *description) const;
   void CheckGraft();
 
   const SyncUnion *union_engine_;     /**< this SyncUnion created this object */
@@ -248,6 +263,7 @@ class SyncItem {
   bool graft_marker_present_;         /**< .cvmfsgraft-$filename exists */
 
   bool external_data_;
+  bool streamed_;                     /**< not backed by the union file system*/
   std::string relative_parent_path_;
   std::string filename_;
 
@@ -266,14 +282,20 @@ class SyncItem {
   // The compression algorithm for the file
   zlib::Algorithms compression_algorithm_;
 
+  // Symlink target and location of the contents of streamed items
+  std::string symlink_;
+  std::string data_path_;
+
   // Lazy evaluation and caching of results of file stats
   inline void StatRdOnly(const bool refresh = false) const {
     StatGeneric(GetRdOnlyPath(), &rdonly_stat_, refresh);
   }
   inline void StatUnion(const bool refresh = false) const {
+    if (streamed_) return;
     StatGeneric(GetUnionPath(), &union_stat_, refresh);
   }
   inline void StatScratch(const bool refresh = false) const {
+    if (streamed_) return;
     StatGeneric(GetScratchPath(), &scratch_stat_, refresh);
   }
   static void StatGeneric(const std::string  &path,
@@ -13,11 +13,15 @@
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <ctime>
 
+#include "catalog_prefetch_groups.h"
 #include "catalog_virtual.h"
 #include "compression.h"
+#include "file_processing/processing_policy.h"
 #include "fs_traversal.h"
 #include "hash.h"
+#include "pack.h"
 #include "smalloc.h"
 #include "sync_union.h"
 #include "upload.h"
@@ -35,10 +39,38 @@ SyncMediator::SyncMediator(catalog::WritableCatalogManager *catalog_manager,
   union_engine_(NULL),
   handle_hardlinks_(false),
   params_(params),
-  changed_items_(0)
+  changed_items_(0),
+  content_cache_(NULL),
+  timestamp_start_(time(NULL)),
+  num_content_cache_hits_(0)
 {
   int retval = pthread_mutex_init(&lock_file_queue_, NULL);
   assert(retval == 0);
+  retval = pthread_mutex_init(&lock_bundle_queue_, NULL);
+  assert(retval == 0);
+  retval = pthread_mutex_init(&lock_hardlink_queue_, NULL);
+  assert(retval == 0);
+
+  if (!params->content_cache_path.empty()) {
+    // Cached results are only valid if the files would be processed the same
+    const string fingerprint =
+      StringifyInt(params->spooler->GetHashAlgorithm()) + ":" +
+      zlib::AlgorithmName(params->compression_alg) + ":" +
+      (params->use_file_chunking ?
+        StringifyInt(params->min_file_chunk_size) + "-" +
+        StringifyInt(params->avg_file_chunk_size) + "-" +
+        StringifyInt(params->max_file_chunk_size) +
+        (params->chunking_algorithm ==
+           upload::SpoolerDefinition::kChunkingFastCdc ? "-fastcdc" : "") :
+        "nochunks") + ":" +
+      StringifyInt(params->generate_legacy_bulk_chunks) + ":" +
+      StringifyInt(params->external_data) +
+      (params->spooler->GetProcessingPolicy() != NULL ?
+        ":" + params->spooler->GetProcessingPolicy()->GetFingerprint() : "");
+    content_cache_ =
+      new SyncContentCache(params->content_cache_path, fingerprint);
+    content_cache_->Load();
+  }
 
   params->spooler->RegisterListener(&SyncMediator::PublishFilesCallback, this);
 
@@ -47,7 +79,10 @@ SyncMediator::SyncMediator(catalog::WritableCatalogManager *catalog_manager,
 
 
 SyncMediator::~SyncMediator() {
+  delete content_cache_;
+  pthread_mutex_destroy(&lock_bundle_queue_);
   pthread_mutex_destroy(&lock_file_queue_);
+  pthread_mutex_destroy(&lock_hardlink_queue_);
 }
 
 
@@ -196,6 +231,16 @@ void SyncMediator::LeaveDirectory(const SyncItem &entry)
 }
 
 
+/**
+ * Blocks until the spooler has processed all the files handed over so far,
+ * which has the files' catalog entries written.  Sync engines that provide
+ * the file contents themselves use it to release the data.
+ */
+void SyncMediator::WaitForUpload() {
+  params_->spooler->WaitForUpload();
+}
+
+
 /**
  * Do any pending processing and commit all changes to the catalogs.
  * To be called after change set traversal is finished.
@@ -213,44 +258,32 @@ bool SyncMediator::Commit(manifest::Manifest *manifest) {
   if (!hardlink_queue_.empty()) {
     assert(handle_hardlinks_);
 
+    // The hardlink groups have been spooled along with the regular files
     LogCvmfs(kLogPublish, kLogStdout, "Processing hardlinks...");
-    params_->spooler->UnregisterListeners();
-    params_->spooler->RegisterListener(&SyncMediator::PublishHardlinksCallback,
-                                       this);
-
-    // TODO(rmeusel): Revise that for Thread Safety!
-    //       This loop will spool hardlinks into the spooler, which will then
-    //       process them.
-    //       On completion of every hardlink the spooler will asynchronously
-    //       emit callbacks (SyncMediator::PublishHardlinksCallback) which
-    //       might happen while this for-loop goes through the hardlink_queue_
-    //
-    //       For the moment this seems not to be a problem, but it's an accident
-    //       just waiting to happen.
-    //
-    //       Note: Just wrapping this loop in a mutex might produce a dead lock
-    //             since the spooler does not fill it's processing queue to an
-    //             unlimited size. Meaning that it might be flooded with hard-
-    //             links and waiting for the queue to be processed while proces-
-    //             sing is stalled because the callback is waiting for this
-    //             mutex.
-    for (HardlinkGroupList::const_iterator i = hardlink_queue_.begin(),
+    for (HardlinkGroupQueue::const_iterator i = hardlink_queue_.begin(),
          iEnd = hardlink_queue_.end(); i != iEnd; ++i)
     {
-      LogCvmfs(kLogPublish, kLogVerboseMsg, "Spooling hardlink group %s",
-               i->master.GetUnionPath().c_str());
-      params_->spooler->Process(i->master.GetUnionPath());
+      LogCvmfs(kLogPublish, kLogVerboseMsg, "Processing hardlink group %s",
+               i->first.c_str());
+      AddHardlinkGroup(i->second);
     }
+  }
 
+  if (!bundle_queue_.empty()) {
+    LogCvmfs(kLogPublish, kLogStdout, "Bundling small files...");
+    params_->spooler->UnregisterListeners();
+    params_->spooler->RegisterListener(&SyncMediator::PublishBundlesCallback,
+                                       this);
+    CreateBundles();
     params_->spooler->WaitForUpload();
+    AddBundles();
+  }
 
-    for (HardlinkGroupList::const_iterator i = hardlink_queue_.begin(),
-         iEnd = hardlink_queue_.end(); i != iEnd; ++i)
-    {
-      LogCvmfs(kLogPublish, kLogVerboseMsg, "Processing hardlink group %s",
-               i->master.GetUnionPath().c_str());
-      AddHardlinkGroup(*i);
-    }
+  if ((params_->prefetch_groups != NULL) &&
+      !params_->prefetch_groups->traced_groups().empty())
+  {
+    LogCvmfs(kLogPublish, kLogStdout, "Recording prefetch groups...");
+    AddTracedPrefetchGroups();
   }
 
   params_->spooler->UnregisterListeners();
@@ -261,6 +294,13 @@ bool SyncMediator::Commit(manifest::Manifest *manifest) {
     return false;
   }
 
+  if (content_cache_ != NULL) {
+    LogCvmfs(kLogPublish, kLogVerboseMsg,
+             "%u unchanged files taken from the content cache",
+             num_content_cache_hits_);
+    content_cache_->Save();
+  }
+
   if (catalog_manager_->IsBalanceable() ||
       (params_->virtual_dir_actions != catalog::VirtualCatalog::kActionNone))
   {
@@ -321,17 +361,9 @@ void SyncMediator::InsertLegacyHardlink(const SyncItem &entry) {
   hl_group = GetHardlinkMap().find(inode);
 
   if (hl_group != GetHardlinkMap().end()) {  // touched hardlinks in this group?
-    bool found = false;
-
-    // search for the entry in this group
-    for (SyncItemList::const_iterator i = hl_group->second.hardlinks.begin(),
-         iEnd = hl_group->second.hardlinks.end(); i != iEnd; ++i)
-    {
-      if (i->second == entry) {
-        found = true;
-        break;
-      }
-    }
+    // The group is indexed by relative path
+    const bool found = hl_group->second.hardlinks.find(
+      entry.GetRelativePath()) != hl_group->second.hardlinks.end();
 
     if (!found) {
       // Hardlink already in the group?
@@ -356,8 +388,10 @@ void SyncMediator::InsertLegacyHardlink(const SyncItem &entry) {
 void SyncMediator::CompleteHardlinks(const SyncItem &entry) {
   assert(handle_hardlinks_);
 
-  // If no hardlink in this directory was changed, we can skip this
-  if (GetHardlinkMap().empty())
+  // If no hardlink in this directory was changed, we can skip this.  If all
+  // the members of the touched groups are known already, there are no legacy
+  // hardlinks to pick up either and the directory need not be scanned again.
+  if (!HasIncompleteHardlinkGroups())
     return;
 
   LogCvmfs(kLogPublish, kLogVerboseMsg, "Post-processing hard links in %s",
@@ -373,6 +407,18 @@ void SyncMediator::CompleteHardlinks(const SyncItem &entry) {
 }
 
 
+bool SyncMediator::HasIncompleteHardlinkGroups() {
+  const HardlinkGroupMap &hardlinks = GetHardlinkMap();
+  for (HardlinkGroupMap::const_iterator i = hardlinks.begin(),
+       iEnd = hardlinks.end(); i != iEnd; ++i)
+  {
+    if (i->second.hardlinks.size() < i->second.master.GetUnionLinkcount())
+      return true;
+  }
+  return false;
+}
+
+
 void SyncMediator::LegacyRegularHardlinkCallback(const string &parent_dir,
                                                  const string &file_name)
 {
@@ -391,6 +437,10 @@ void SyncMediator::LegacySymlinkHardlinkCallback(const string &parent_dir,
 
 void SyncMediator::AddDirectoryRecursively(const SyncItem &entry) {
   AddDirectory(entry);
+  // Streamed directories have no subtree on disk, their contents follow as
+  // separate items
+  if (entry.IsStreamed())
+    return;
 
   // Create a recursion engine, which recursively adds all entries in a newly
   // created directory
@@ -544,29 +594,62 @@ void SyncMediator::PublishFilesCallback(const upload::SpoolerResult &result) {
     itr = file_queue_.find(result.local_path);
   }
 
-  assert(itr != file_queue_.end());
+  if (itr == file_queue_.end()) {
+    const bool is_hardlink = PublishHardlinkMaster(result);
+    assert(is_hardlink);
+    return;
+  }
 
   SyncItem &item = itr->second;
   item.SetContentHash(result.content_hash);
   item.SetCompressionAlgorithm(result.compression_alg);
+  AddProcessedFile(item, result.file_chunks, result.digest_tree);
 
+  if (content_cache_ != NULL) {
+    InsertContentCache(item, result.content_hash, result.compression_alg,
+                       result.file_chunks);
+  }
+}
+
+
+/**
+ * Adds a regular file to the catalogs once its content hash is known.  The
+ * digest tree of non-chunked files is stored along with the entry, if there is
+ * one.
+ */
+void SyncMediator::AddProcessedFile(
+  const SyncItem &item,
+  const FileChunkList &file_chunks,
+  const string &digest_tree)
+{
   XattrList *xattrs = &default_xattrs;
   if (params_->include_xattrs) {
-    xattrs = XattrList::CreateFromFile(result.local_path);
+    xattrs = XattrList::CreateFromFile(item.GetUnionPath());
     assert(xattrs != NULL);
   }
 
-  if (result.IsChunked()) {
+  string inline_data;
+  if (!file_chunks.IsEmpty()) {
     catalog_manager_->AddChunkedFile(
       item.CreateBasicCatalogDirent(),
       *xattrs,
       item.relative_parent_path(),
-      result.file_chunks);
+      file_chunks);
+  } else if (ReadInlineData(item, &inline_data)) {
+    catalog_manager_->AddInlineFile(
+      item.CreateBasicCatalogDirent(),
+      *xattrs,
+      item.relative_parent_path(),
+      inline_data);
   } else {
     catalog_manager_->AddFile(
       item.CreateBasicCatalogDirent(),
       *xattrs,
       item.relative_parent_path());
+    if (!digest_tree.empty())
+      catalog_manager_->AddDigestTree(item.GetRelativePath(), digest_tree);
+    QueueBundleMember(item);
+    AddPrefetchGroup(item);
   }
 
   if (xattrs != &default_xattrs)
@@ -574,11 +657,272 @@ void SyncMediator::PublishFilesCallback(const upload::SpoolerResult &result) {
 }
 
 
-void SyncMediator::PublishHardlinksCallback(
+/**
+ * Puts the file into the prefetch group of the first matching pattern.  Only
+ * ordinary, unchunked files are prefetched as group members by the clients.
+ */
+void SyncMediator::AddPrefetchGroup(const SyncItem &item) {
+  if ((params_->prefetch_groups == NULL) || item.IsExternalData())
+    return;
+  const uint64_t group_id =
+    params_->prefetch_groups->GetGroupId("/" + item.GetRelativePath());
+  if (group_id != 0)
+    catalog_manager_->SetPrefetchGroup(item.GetRelativePath(), group_id);
+}
+
+
+/**
+ * Files up to params_->inline_file_threshold bytes are stored in the catalog
+ * in addition to being uploaded.  Returns false if the file should not or
+ * cannot be inlined, in which case it is added as an ordinary file.
+ */
+bool SyncMediator::ReadInlineData(const SyncItem &item, string *data) const {
+  if ((params_->inline_file_threshold == 0) || item.IsExternalData())
+    return false;
+  const catalog::DirectoryEntryBase dirent = item.CreateBasicCatalogDirent();
+  if (!dirent.IsRegular() || (dirent.size() > params_->inline_file_threshold))
+    return false;
+
+  int fd = open(item.GetUnionPath().c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  const bool retval = SafeReadToString(fd, data);
+  close(fd);
+  if (!retval || (data->length() != dirent.size())) {
+    LogCvmfs(kLogPublish, kLogStderr, "Warning: failed to inline %s",
+             item.GetUnionPath().c_str());
+    return false;
+  }
+  return true;
+}
+
+
+/**
+ * Non-empty files up to params_->bundle_file_threshold bytes are remembered
+ * per directory so that they can be packed into bundle objects.  Called from
+ * the spooler callbacks.
+ */
+void SyncMediator::QueueBundleMember(const SyncItem &item) {
+  if ((params_->bundle_file_threshold == 0) || item.IsExternalData())
+    return;
+  const catalog::DirectoryEntryBase dirent = item.CreateBasicCatalogDirent();
+  if (!dirent.IsRegular() || (dirent.size() == 0) ||
+      (dirent.size() > params_->bundle_file_threshold))
+  {
+    return;
+  }
+
+  BundleMember member;
+  member.path = item.GetRelativePath();
+  member.union_path = item.GetUnionPath();
+  member.content_hash = item.GetContentHash();
+  member.size = dirent.size();
+  MutexLockGuard guard(lock_bundle_queue_);
+  bundle_queue_[item.relative_parent_path()].push_back(member);
+}
+
+
+/**
+ * Applies the groups learned from the client trace log to the files of the
+ * repository.  Paths that do not exist anymore are skipped.
+ */
+void SyncMediator::AddTracedPrefetchGroups() {
+  const map<string, uint64_t> &groups =
+    params_->prefetch_groups->traced_groups();
+  unsigned num_files = 0;
+  for (map<string, uint64_t>::const_iterator i = groups.begin(),
+       iEnd = groups.end(); i != iEnd; ++i)
+  {
+    if (catalog_manager_->SetPrefetchGroup(i->first.substr(1), i->second))
+      num_files++;
+  }
+  LogCvmfs(kLogPublish, kLogVerboseMsg,
+           "%u out of %u traced files put into prefetch groups",
+           num_files, static_cast<unsigned>(groups.size()));
+}
+
+
+/**
+ * Every directory with at least two small new files gets one or more bundles
+ * of up to kMaxBundleSize bytes.  The bundles are spooled like ordinary but
+ * unchunked files.
+ */
+void SyncMediator::CreateBundles() {
+  for (map<string, vector<BundleMember> >::const_iterator i =
+       bundle_queue_.begin(), iEnd = bundle_queue_.end(); i != iEnd; ++i)
+  {
+    vector<BundleMember> candidates;
+    uint64_t size = 0;
+    for (unsigned j = 0; j < i->second.size(); ++j) {
+      if (size + i->second[j].size > kMaxBundleSize) {
+        CreateBundle(candidates);
+        candidates.clear();
+        size = 0;
+      }
+      candidates.push_back(i->second[j]);
+      size += i->second[j].size;
+    }
+    CreateBundle(candidates);
+  }
+  bundle_queue_.clear();
+
+  // The spooler callbacks look up the bundles, so they are complete by now
+  for (map<string, Bundle>::const_iterator i = bundles_.begin(),
+       iEnd = bundles_.end(); i != iEnd; ++i)
+  {
+    params_->spooler->Process(i->first, false);
+  }
+}
+
+
+void SyncMediator::CreateBundle(const vector<BundleMember> &candidates) {
+  if (candidates.size() < 2)
+    return;
+
+  // Members with the same content are stored once
+  ObjectPack pack(kMaxBundleSize);
+  Bundle bundle;
+  map<shash::Any, uint64_t> payload_offsets;
+  vector<uint64_t> payload_offset_of;
+  uint64_t payload_size = 0;
+  for (unsigned i = 0; i < candidates.size(); ++i) {
+    const BundleMember &member = candidates[i];
+    map<shash::Any, uint64_t>::const_iterator iter_offset =
+      payload_offsets.find(member.content_hash);
+    if (iter_offset != payload_offsets.end()) {
+      bundle.members.push_back(member);
+      payload_offset_of.push_back(iter_offset->second);
+      continue;
+    }
+
+    string data;
+    int fd = open(member.union_path.c_str(), O_RDONLY);
+    if (fd < 0)
+      continue;
+    const bool retval = SafeReadToString(fd, &data);
+    close(fd);
+    if (!retval || (data.length() != member.size)) {
+      LogCvmfs(kLogPublish, kLogStderr, "Warning: failed to bundle %s",
+               member.union_path.c_str());
+      continue;
+    }
+    ObjectPack::BucketHandle bucket = pack.NewBucket();
+    ObjectPack::AddToBucket(data.data(), data.length(), bucket);
+    if (!pack.CommitBucket(ObjectPack::kCas, member.content_hash, bucket)) {
+      pack.DiscardBucket(bucket);
+      continue;
+    }
+    bundle.members.push_back(member);
+    payload_offset_of.push_back(payload_size);
+    payload_offsets[member.content_hash] = payload_size;
+    payload_size += member.size;
+  }
+  if (pack.GetNoObjects() < 2)
+    return;
+
+  ObjectPackProducer producer(&pack);
+  const uint64_t header_size = producer.GetHeaderSize();
+  for (unsigned i = 0; i < payload_offset_of.size(); ++i)
+    bundle.offsets.push_back(header_size + payload_offset_of[i]);
+
+  FILE *f = CreateTempFile(params_->dir_temp + "/bundle", 0600, "w",
+                           &bundle.tmp_path);
+  assert(f != NULL);
+  unsigned char buf[4096];
+  unsigned nbytes;
+  while ((nbytes = producer.ProduceNext(sizeof(buf), buf)) > 0) {
+    size_t written = fwrite(buf, 1, nbytes, f);
+    assert(written == nbytes);
+  }
+  fclose(f);
+
+  LogCvmfs(kLogPublish, kLogVerboseMsg, "bundling %u files into %s",
+           static_cast<unsigned>(bundle.members.size()),
+           bundle.tmp_path.c_str());
+  bundles_[bundle.tmp_path] = bundle;
+}
+
+
+/**
+ * Records the uploaded bundles in the catalogs.
+ */
+void SyncMediator::AddBundles() {
+  for (map<string, Bundle>::const_iterator i = bundles_.begin(),
+       iEnd = bundles_.end(); i != iEnd; ++i)
+  {
+    const Bundle &bundle = i->second;
+    assert(!bundle.hash.IsNull());
+    for (unsigned j = 0; j < bundle.members.size(); ++j) {
+      catalog_manager_->AddBundledFile(bundle.members[j].path, bundle.hash,
+                                       bundle.offsets[j]);
+    }
+    unlink(bundle.tmp_path.c_str());
+  }
+  LogCvmfs(kLogPublish, kLogVerboseMsg, "added %u bundles",
+           static_cast<unsigned>(bundles_.size()));
+  bundles_.clear();
+}
+
+
+/**
+ * Bypasses the spooler if the file is unchanged since the previous publish.
+ * The cached content hash refers to an object that has been uploaded already.
+ */
+bool SyncMediator::AddFileFromContentCache(const SyncItem &entry) {
+  const platform_stat64 info = entry.GetUnionStat();
+  SyncContentCache::Entry key;
+  key.inode = info.st_ino;
+  key.size = info.st_size;
+  key.mtime = info.st_mtime;
+  key.ctime = info.st_ctime;
+  SyncContentCache::Entry cached;
+  if (!content_cache_->Lookup(entry.GetRelativePath(), key, &cached))
+    return false;
+
+  LogCvmfs(kLogPublish, kLogVerboseMsg, "content cache hit for %s (%s)",
+           entry.GetUnionPath().c_str(),
+           cached.content_hash.ToString().c_str());
+  num_content_cache_hits_++;
+  SyncItem item(entry);
+  item.SetContentHash(cached.content_hash);
+  item.SetCompressionAlgorithm(cached.compression_alg);
+  // The content cache does not keep digest trees
+  AddProcessedFile(item, cached.file_chunks, "");
+  content_cache_->Insert(entry.GetRelativePath(), cached);
+  return true;
+}
+
+
+void SyncMediator::InsertContentCache(
+  const SyncItem &item,
+  const shash::Any &content_hash,
+  const zlib::Algorithms compression_alg,
+  const FileChunkList &file_chunks)
+{
+  const platform_stat64 info = item.GetUnionStat();
+  if ((info.st_mtime >= timestamp_start_) ||
+      (info.st_ctime >= timestamp_start_))
+  {
+    return;
+  }
+
+  SyncContentCache::Entry entry;
+  entry.inode = info.st_ino;
+  entry.size = info.st_size;
+  entry.mtime = info.st_mtime;
+  entry.ctime = info.st_ctime;
+  entry.content_hash = content_hash;
+  entry.compression_alg = compression_alg;
+  entry.file_chunks = file_chunks;
+  content_cache_->Insert(item.GetRelativePath(), entry);
+}
+
+
+void SyncMediator::PublishBundlesCallback(
   const upload::SpoolerResult &result)
 {
   LogCvmfs(kLogPublish, kLogVerboseMsg,
-           "Spooler callback for hardlink %s, digest %s, retval %d",
+           "Spooler callback for bundle %s, digest %s, retval %d",
            result.local_path.c_str(),
            result.content_hash.ToString().c_str(),
            result.return_code);
@@ -588,27 +932,39 @@ void SyncMediator::PublishHardlinksCallback(
     abort();
   }
 
-  bool found = false;
-  for (unsigned i = 0; i < hardlink_queue_.size(); ++i) {
-    if (hardlink_queue_[i].master.GetUnionPath() == result.local_path) {
-      found = true;
-      hardlink_queue_[i].master.SetContentHash(result.content_hash);
-      SyncItemList::iterator j, jend;
-      for (j = hardlink_queue_[i].hardlinks.begin(),
-           jend = hardlink_queue_[i].hardlinks.end();
-           j != jend; ++j)
-      {
-        j->second.SetContentHash(result.content_hash);
-        j->second.SetCompressionAlgorithm(result.compression_alg);
-      }
-      if (result.IsChunked())
-        hardlink_queue_[i].file_chunks = result.file_chunks;
+  // All the bundles are created before the first one is spooled
+  map<string, Bundle>::iterator iter = bundles_.find(result.local_path);
+  assert(iter != bundles_.end());
+  iter->second.hash = result.content_hash;
+}
 
-      break;
-    }
-  }
 
-  assert(found);
+/**
+ * Called from PublishFilesCallback() for results that belong to the master of
+ * a hardlink group.  Returns false if the result is not a hardlink master.
+ */
+bool SyncMediator::PublishHardlinkMaster(
+  const upload::SpoolerResult &result)
+{
+  MutexLockGuard guard(lock_hardlink_queue_);
+  HardlinkGroupQueue::iterator itr = hardlink_queue_.find(result.local_path);
+  if (itr == hardlink_queue_.end())
+    return false;
+
+  LogCvmfs(kLogPublish, kLogVerboseMsg,
+           "Spooler callback for hardlink %s, digest %s",
+           result.local_path.c_str(), result.content_hash.ToString().c_str());
+  HardlinkGroup *group = &itr->second;
+  group->master.SetContentHash(result.content_hash);
+  for (SyncItemList::iterator j = group->hardlinks.begin(),
+       jend = group->hardlinks.end(); j != jend; ++j)
+  {
+    j->second.SetContentHash(result.content_hash);
+    j->second.SetCompressionAlgorithm(result.compression_alg);
+  }
+  if (result.IsChunked())
+    group->file_chunks = result.file_chunks;
+  return true;
 }
 
 
@@ -704,13 +1060,16 @@ void SyncMediator::AddFile(const SyncItem &entry) {
     LogCvmfs(kLogPublish, kLogStderr,
              "Error: nested catalog marker in root directory");
     abort();
+  } else if ((content_cache_ != NULL) && AddFileFromContentCache(entry)) {
+    return;
   } else {
     // Push the file to the spooler, remember the entry for the path
     pthread_mutex_lock(&lock_file_queue_);
     file_queue_[entry.GetUnionPath()] = entry;
     pthread_mutex_unlock(&lock_file_queue_);
     // Spool the file
-    params_->spooler->Process(entry.GetUnionPath());
+    params_->spooler->Process(entry.GetUnionPath(), true,
+                              "/" + entry.GetRelativePath());
   }
 }
 
@@ -816,10 +1175,23 @@ void SyncMediator::AddLocalHardlinkGroups(const HardlinkGroupMap &hardlinks) {
     if (params_->dry_run)
       continue;
 
-    if (i->second.master.IsSymlink())
+    if (i->second.master.IsSymlink()) {
       AddHardlinkGroup(i->second);
-    else
-      hardlink_queue_.push_back(i->second);
+      continue;
+    }
+
+    // The spooler callback must find the group, so it is queued first.  The
+    // lock must not be held while spooling (cf. PublishFilesCallback).
+    const string master_path = i->second.master.GetUnionPath();
+    {
+      MutexLockGuard guard(lock_hardlink_queue_);
+      hardlink_queue_.insert(
+        HardlinkGroupQueue::value_type(master_path, i->second));
+    }
+    LogCvmfs(kLogPublish, kLogVerboseMsg, "Spooling hardlink group %s",
+             master_path.c_str());
+    params_->spooler->Process(master_path, true,
+                              "/" + i->second.master.GetRelativePath());
   }
 }
 
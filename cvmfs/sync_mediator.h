@@ -35,8 +35,10 @@
 #include "catalog_mgr_rw.h"
 #include "compression.h"
 #include "file_chunk.h"
+#include "hash.h"
 #include "platform.h"
 #include "swissknife_sync.h"
+#include "sync_content_cache.h"
 #include "sync_item.h"
 #include "xattr.h"
 
@@ -72,6 +74,30 @@ struct HardlinkGroup {
 typedef std::map<uint64_t, HardlinkGroup> HardlinkGroupMap;
 
 
+/**
+ * A small file that is processed and added to the catalogs and that is going
+ * to be part of a bundle object of its directory.
+ */
+struct BundleMember {
+  BundleMember() : size(0) { }
+  std::string path;
+  std::string union_path;
+  shash::Any content_hash;
+  uint64_t size;
+};
+
+/**
+ * A serialized ObjectPack of small files in a temporary file.  Offsets are the
+ * positions of the members in the serialized bundle.
+ */
+struct Bundle {
+  std::string tmp_path;
+  shash::Any hash;
+  std::vector<BundleMember> members;
+  std::vector<uint64_t> offsets;
+};
+
+
 /**
  * The SyncMediator refines the input received from a concrete UnionSync object.
  * For example, it resolves the insertion and deletion of complete directories
@@ -84,6 +110,10 @@ typedef std::map<uint64_t, HardlinkGroup> HardlinkGroupMap;
 class SyncMediator {
  public:
   static const unsigned int processing_dot_interval = 100;
+  /**
+   * Bundles are loaded in one piece by the clients.
+   */
+  static const uint64_t kMaxBundleSize = 4 * 1024 * 1024;
 
   SyncMediator(catalog::WritableCatalogManager *catalog_manager,
                const SyncParameters *params);
@@ -98,6 +128,7 @@ class SyncMediator {
   void EnterDirectory(const SyncItem &entry);
   void LeaveDirectory(const SyncItem &entry);
 
+  void WaitForUpload();
   bool Commit(manifest::Manifest *manifest);
 
   // The sync union engine uses this information to create properly initialized
@@ -106,6 +137,7 @@ class SyncMediator {
   zlib::Algorithms GetCompressionAlgorithm() const {
     return params_->compression_alg;
   }
+  unsigned GetNumScanThreads() const { return params_->num_scan_threads; }
 
  private:
   enum ChangesetAction {
@@ -118,7 +150,10 @@ class SyncMediator {
   };
 
   typedef std::stack<HardlinkGroupMap> HardlinkGroupMapStack;
-  typedef std::vector<HardlinkGroup> HardlinkGroupList;
+  /**
+   * Complete hardlink groups, keyed by the union path of the group master
+   */
+  typedef std::map<std::string, HardlinkGroup> HardlinkGroupQueue;
 
   void PrintChangesetNotice(const ChangesetAction action,
                             const std::string &extra_info) const;
@@ -169,12 +204,31 @@ class SyncMediator {
                           const std::string  &filename,
                           const SyncItemType  entry_type) const;
 
+  // Files that are unchanged since the previous publish bypass the spooler
+  bool AddFileFromContentCache(const SyncItem &entry);
+  void InsertContentCache(const SyncItem &item,
+                          const shash::Any &content_hash,
+                          const zlib::Algorithms compression_alg,
+                          const FileChunkList &file_chunks);
+  void AddProcessedFile(const SyncItem &item,
+                        const FileChunkList &file_chunks,
+                        const std::string &digest_tree);
+  bool ReadInlineData(const SyncItem &item, std::string *data) const;
+  void QueueBundleMember(const SyncItem &item);
+  void AddPrefetchGroup(const SyncItem &item);
+  void AddTracedPrefetchGroups();
+  void CreateBundles();
+  void CreateBundle(const std::vector<BundleMember> &candidates);
+  void AddBundles();
+
   // Called by Upload Spooler
   void PublishFilesCallback(const upload::SpoolerResult &result);
-  void PublishHardlinksCallback(const upload::SpoolerResult &result);
+  bool PublishHardlinkMaster(const upload::SpoolerResult &result);
+  void PublishBundlesCallback(const upload::SpoolerResult &result);
 
   // Hardlink handling
   void CompleteHardlinks(const SyncItem &entry);
+  bool HasIncompleteHardlinkGroups();
   HardlinkGroupMap &GetHardlinkMap() { return hardlink_stack_.top(); }
   void LegacyRegularHardlinkCallback(const std::string &parent_dir,
                                      const std::string &file_name);
@@ -208,11 +262,42 @@ class SyncMediator {
   pthread_mutex_t lock_file_queue_;
   SyncItemList file_queue_;
 
-  HardlinkGroupList hardlink_queue_;
+  /**
+   * Hardlink groups are spooled through the regular file pipeline as soon as
+   * their directory is complete.  Once they are processed, they are added to
+   * the catalogs in Commit().
+   */
+  pthread_mutex_t lock_hardlink_queue_;
+  HardlinkGroupQueue hardlink_queue_;
+
+  /**
+   * Small files up to params_->bundle_file_threshold, grouped by directory.
+   * They are packed into bundles once all the files are processed.
+   */
+  pthread_mutex_t lock_bundle_queue_;
+  std::map<std::string, std::vector<BundleMember> > bundle_queue_;
+  /**
+   * Maps the temporary path of the serialized bundles to the bundles.
+   */
+  std::map<std::string, Bundle> bundles_;
 
   const SyncParameters *params_;
   mutable unsigned int changed_items_;
 
+  /**
+   * Optional, NULL unless params_->content_cache_path is set.  Files whose
+   * (inode, size, mtime, ctime) did not change since they were processed
+   * during the previous publish reuse the previous content hash and chunks.
+   */
+  SyncContentCache *content_cache_;
+  /**
+   * Files modified in the same second as the publish started are not recorded
+   * in the content cache because their timestamps cannot tell further
+   * modifications apart.
+   */
+  time_t timestamp_start_;
+  unsigned num_content_cache_hits_;
+
   /**
    * By default, files have no extended attributes.
    */
@@ -14,6 +14,7 @@
 #include <vector>
 
 #include "fs_traversal.h"
+#include "fs_traversal_parallel.h"
 #include "logging.h"
 #include "platform.h"
 #include "sync_mediator.h"
@@ -22,6 +23,30 @@ using namespace std;  // NOLINT
 
 namespace publish {
 
+namespace {
+
+/**
+ * New directories are added as a whole by the SyncMediator from the union
+ * volume, so only directories that already exist in the repository need to be
+ * read ahead in the scratch area.
+ */
+class ScratchScanFilter : public ParallelDirectoryScanner::Filter {
+ public:
+  ScratchScanFilter(const string &scratch_path, const string &rdonly_path)
+    : scratch_path_(scratch_path), rdonly_path_(rdonly_path) { }
+
+  virtual bool Descend(const string &path) {
+    return DirectoryExists(rdonly_path_ + path.substr(scratch_path_.length()));
+  }
+
+ private:
+  const string scratch_path_;
+  const string rdonly_path_;
+};
+
+}  // anonymous namespace
+
+
 SyncUnion::SyncUnion(SyncMediator *mediator,
                      const std::string &rdonly_path,
                      const std::string &union_path,
@@ -30,7 +55,8 @@ SyncUnion::SyncUnion(SyncMediator *mediator,
   scratch_path_(scratch_path),
   union_path_(union_path),
   mediator_(mediator),
-  initialized_(false) {}
+  initialized_(false),
+  graft_manifest_(NULL) {}
 
 
 bool SyncUnion::Initialize() {
@@ -53,6 +79,43 @@ SyncItem SyncUnion::CreateSyncItem(const std::string  &relative_parent_path,
 }
 
 
+SyncItem SyncUnion::CreateStreamItem(
+  const std::string     &relative_parent_path,
+  const std::string     &filename,
+  const platform_stat64 &info,
+  const std::string     &symlink,
+  const std::string     &data_path) const
+{
+  SyncItem entry(relative_parent_path, filename, this, info, symlink,
+                 data_path);
+  PreprocessSyncItem(&entry);
+  if (entry.IsRegularFile()) {
+    entry.SetExternalData(mediator_->IsExternalData());
+    entry.SetCompressionAlgorithm(mediator_->GetCompressionAlgorithm());
+  }
+  return entry;
+}
+
+
+/**
+ * Returns NULL unless scratch area scan threads are requested.
+ */
+ParallelDirectoryScanner *SyncUnion::StartScratchScan(
+  ParallelDirectoryScanner::Filter *filter) const
+{
+  const unsigned num_threads = mediator_->GetNumScanThreads();
+  if (num_threads == 0)
+    return NULL;
+
+  ParallelDirectoryScanner *scanner = new ParallelDirectoryScanner(
+    num_threads, ParallelDirectoryScanner::kDefaultMaxListings, filter);
+  scanner->Start(scratch_path());
+  LogCvmfs(kLogUnionFs, kLogVerboseMsg, "scanning scratch area with %u threads",
+           num_threads);
+  return scanner;
+}
+
+
 void SyncUnion::PreprocessSyncItem(SyncItem *entry) const {
   if (IsWhiteoutEntry(*entry)) {
     entry->MarkAsWhiteout(UnwindWhiteoutFilename(*entry));
@@ -206,6 +269,9 @@ void SyncUnionAufs::Traverse() {
            scratch_path().c_str(),
            mediator_->IsExternalData());
 
+  ScratchScanFilter filter(scratch_path(), rdonly_path());
+  UniquePtr<ParallelDirectoryScanner> scanner(StartScratchScan(&filter));
+  traversal.SetPrefetcher(scanner.weak_ref());
   traversal.Recurse(scratch_path());
 }
 
@@ -389,6 +455,9 @@ void SyncUnionOverlayfs::Traverse() {
   LogCvmfs(kLogUnionFs, kLogVerboseMsg, "OverlayFS starting traversal "
            "recursion for scratch_path=[%s]",
            scratch_path().c_str());
+  ScratchScanFilter filter(scratch_path(), rdonly_path());
+  UniquePtr<ParallelDirectoryScanner> scanner(StartScratchScan(&filter));
+  traversal.SetPrefetcher(scanner.weak_ref());
   traversal.Recurse(scratch_path());
 }
 
@@ -35,7 +35,9 @@
 #include <set>
 #include <string>
 
+#include "fs_traversal_parallel.h"
 #include "path_filters/dirtab.h"
+#include "sync_graft_manifest.h"
 #include "sync_item.h"
 
 namespace publish {
@@ -132,6 +134,15 @@ class SyncUnion {
   bool IsInitialized() const { return initialized_; }
   virtual bool SupportsHardlinks() const { return false; }
 
+  /**
+   * Graft descriptions are taken from the manifest before looking for
+   * .cvmfsgraft-$filename side files.  Not owned, NULL for none.
+   */
+  void set_graft_manifest(const GraftManifest *manifest) {
+    graft_manifest_ = manifest;
+  }
+  const GraftManifest *graft_manifest() const { return graft_manifest_; }
+
  protected:
   std::string rdonly_path_;
   std::string scratch_path_;
@@ -213,8 +224,30 @@ class SyncUnion {
    */
   void ProcessFile(const SyncItem &entry);
 
+  /**
+   * Starts reading the scratch area ahead of the traversal on several threads.
+   * @param filter  decides which directories are read ahead
+   * @return  an owned scanner or NULL if scan threads are not requested
+   */
+  ParallelDirectoryScanner *StartScratchScan(
+    ParallelDirectoryScanner::Filter *filter) const;
+
+  /**
+   * Produces a SyncItem for an entry that is not taken from the union file
+   * system (see SyncItem's streamed constructor).
+   * @param info       the stat information of the entry
+   * @param symlink    the symlink target for symlinks
+   * @param data_path  where to read the contents of regular files from
+   */
+  SyncItem CreateStreamItem(const std::string     &relative_parent_path,
+                            const std::string     &filename,
+                            const platform_stat64 &info,
+                            const std::string     &symlink,
+                            const std::string     &data_path) const;
+
  private:
   bool initialized_;
+  const GraftManifest *graft_manifest_;
 };  // class SyncUnion
 
 
@@ -0,0 +1,424 @@
+/**
+ * This file is part of the CernVM File System
+ */
+
+#include "sync_union_tarball.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "logging.h"
+#include "sync_mediator.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace publish {
+
+namespace {
+
+const char *kWhiteoutPrefix = ".wh.";
+const char *kOpaqueMarker = ".wh..wh..opq";
+
+}  // anonymous namespace
+
+
+SyncUnionTarball::SyncUnionTarball(
+  SyncMediator *mediator,
+  const string &rdonly_path,
+  const string &tarball_path,
+  const string &base_directory,
+  const string &temp_dir)
+  // The union and the scratch path are only used to print the change set
+  : SyncUnion(mediator, rdonly_path, tarball_path, tarball_path)
+  , tarball_path_(tarball_path)
+  , base_directory_(TarReader::NormalizePath(base_directory))
+  , temp_dir_(temp_dir)
+  , tarball_fd_(-1)
+  , buffered_bytes_(0)
+  , max_buffered_files_(0)
+{ }
+
+
+SyncUnionTarball::~SyncUnionTarball() {
+  for (map<string, int>::const_iterator i = buffered_files_.begin(),
+       iEnd = buffered_files_.end(); i != iEnd; ++i)
+  {
+    close(i->second);
+  }
+  if ((tarball_fd_ >= 0) && (tarball_path_ != "-"))
+    close(tarball_fd_);
+}
+
+
+bool SyncUnionTarball::Initialize() {
+  if (tarball_path_ == "-") {
+    tarball_fd_ = 0;
+  } else {
+    tarball_fd_ = open(tarball_path_.c_str(), O_RDONLY);
+    if (tarball_fd_ < 0) {
+      LogCvmfs(kLogUnionFs, kLogStderr, "failed to open %s (%d)",
+               tarball_path_.c_str(), errno);
+      return false;
+    }
+  }
+  reader_ = new TarReader(tarball_fd_);
+
+  // Every buffered file is open here and, while it is processed, once more in
+  // the spooler
+  struct rlimit rpl;
+  memset(&rpl, 0, sizeof(rpl));
+  getrlimit(RLIMIT_NOFILE, &rpl);
+  max_buffered_files_ =
+    std::max(static_cast<uint64_t>(rpl.rlim_cur / 4), uint64_t(64));
+  return SyncUnion::Initialize();
+}
+
+
+void SyncUnionTarball::Traverse() {
+  assert(this->IsInitialized());
+  LogCvmfs(kLogUnionFs, kLogVerboseMsg, "Tarball ingestion of %s into /%s",
+           tarball_path_.c_str(), base_directory_.c_str());
+
+  if (!base_directory_.empty()) {
+    EnsureParentDirectory(base_directory_ + "/");
+  }
+
+  TarReader::Entry entry;
+  while (reader_->Next(&entry)) {
+    ProcessEntry(entry);
+  }
+  if (reader_->failed()) {
+    LogCvmfs(kLogUnionFs, kLogStderr, "failed to read %s",
+             tarball_path_.c_str());
+    abort();
+  }
+  Flush();
+}
+
+
+void SyncUnionTarball::ProcessEntry(const TarReader::Entry &entry) {
+  const vector<string> components = SplitString(entry.path, '/');
+  if (std::find(components.begin(), components.end(), "..") !=
+      components.end())
+  {
+    LogCvmfs(kLogUnionFs, kLogStderr, "tarball entry %s leaves the base "
+             "directory", entry.path.c_str());
+    abort();
+  }
+
+  string path = base_directory_;
+  if (!entry.path.empty())
+    path += (path.empty() ? "" : "/") + entry.path;
+  if (path.empty()) {
+    // The root directory is not part of the archive
+    return;
+  }
+  EnsureParentDirectory(path);
+
+  string parent;
+  string name;
+  SplitPath(path, &parent, &name);
+  const platform_stat64 info = MakeStat(entry);
+
+  if (entry.type == TarReader::kEntryDirectory) {
+    ProcessStreamDirectory(path, info, true);
+    return;
+  }
+
+  if (name == kOpaqueMarker) {
+    PrintWarning("'" + path + "' is an opaque directory marker, which is not "
+                 "supported for tarballs, ignoring.");
+    return;
+  }
+  if (ingested_paths_.count(path) > 0) {
+    PrintWarning("'" + path + "' appears more than once in the tarball, "
+                 "ignoring all but the first entry.");
+    return;
+  }
+  ingested_paths_.insert(path);
+
+  if (HasPrefix(name, kWhiteoutPrefix, false)) {
+    // Taken care of by PreprocessSyncItem()
+    ProcessFile(CreateStreamItem(parent, name, info, "", ""));
+    return;
+  }
+
+  int fd;
+  map<string, int>::const_iterator iter;
+  switch (entry.type) {
+    case TarReader::kEntryFile:
+      fd = CopyData(entry.size);
+      ProcessDataFile(path, info, fd);
+      break;
+    case TarReader::kEntryHardlink:
+      // Hardlinks become copies of the linked file
+      iter = buffered_files_.find((base_directory_.empty() ? "" :
+                                   base_directory_ + "/") + entry.link_target);
+      if (iter == buffered_files_.end()) {
+        PrintWarning("'" + path + "' is a hardlink to '" + entry.link_target +
+                     "', which is not available anymore, ignoring.");
+        return;
+      }
+      {
+        platform_stat64 link_info;
+        int retval = platform_fstat(iter->second, &link_info);
+        assert(retval == 0);
+        fd = CreateDataFile(link_info.st_size);
+        unsigned char buf[64 * 1024];
+        uint64_t offset = 0;
+        ssize_t nbytes;
+        while ((nbytes = pread(iter->second, buf, sizeof(buf), offset)) > 0) {
+          if (!SafeWrite(fd, buf, nbytes)) {
+            LogCvmfs(kLogUnionFs, kLogStderr, "failed to copy data of %s "
+                     "(%d)", path.c_str(), errno);
+            abort();
+          }
+          offset += nbytes;
+        }
+        assert(offset == static_cast<uint64_t>(link_info.st_size));
+        platform_stat64 copy_info = info;
+        copy_info.st_size = link_info.st_size;
+        ProcessDataFile(path, copy_info, fd);
+      }
+      break;
+    case TarReader::kEntrySymlink:
+    case TarReader::kEntryCharacterDevice:
+    case TarReader::kEntryBlockDevice:
+      ProcessFile(CreateStreamItem(parent, name, info, entry.link_target, ""));
+      break;
+    case TarReader::kEntryFifo:
+      PrintWarning("'" + path + "' is a fifo, ignoring.");
+      break;
+    default:
+      abort();
+  }
+}
+
+
+/**
+ * Hands over a regular file, whose contents are in fd, to the mediator.  The
+ * file descriptor is closed once the spooler is done with it.
+ */
+void SyncUnionTarball::ProcessDataFile(
+  const string &path,
+  const platform_stat64 &info,
+  int fd)
+{
+  if ((buffered_files_.size() >= max_buffered_files_) ||
+      (buffered_bytes_ + info.st_size > kMaxBufferedBytes))
+  {
+    Flush();
+  }
+  buffered_files_[path] = fd;
+  buffered_bytes_ += info.st_size;
+
+  string parent;
+  string name;
+  SplitPath(path, &parent, &name);
+  // The spooler opens the file again through the path and reads from the
+  // beginning
+  const string data_path = "/proc/self/fd/" + StringifyInt(fd);
+  ProcessFile(CreateStreamItem(parent, name, info, "", data_path));
+}
+
+
+/**
+ * Directories that exist in the repository with the same type are touched,
+ * which updates their attributes.  Directory entries that appear only as
+ * parents of other entries (is_explicit == false) leave existing directories
+ * as they are.
+ */
+void SyncUnionTarball::ProcessStreamDirectory(
+  const string &path,
+  const platform_stat64 &info,
+  const bool is_explicit)
+{
+  const bool is_known = known_directories_.count(path) > 0;
+  if (is_known && !is_explicit)
+    return;
+
+  string parent;
+  string name;
+  SplitPath(path, &parent, &name);
+  SyncItem entry = CreateStreamItem(parent, name, info, "", "");
+  known_directories_.insert(path);
+  if (is_known) {
+    mediator_->Touch(entry);
+  } else if (entry.IsNew()) {
+    mediator_->Add(entry);
+  } else if (entry.WasDirectory()) {
+    if (is_explicit)
+      mediator_->Touch(entry);
+  } else {
+    mediator_->Replace(entry);
+  }
+}
+
+
+/**
+ * Archives do not necessarily contain the parent directories of all entries.
+ * Missing parents are created with default attributes.
+ */
+void SyncUnionTarball::EnsureParentDirectory(const string &path) {
+  const string parent = GetParentPath(path);
+  if (parent.empty() || (known_directories_.count(parent) > 0))
+    return;
+  EnsureParentDirectory(parent);
+
+  platform_stat64 info;
+  memset(&info, 0, sizeof(info));
+  info.st_mode = S_IFDIR | 0755;
+  info.st_nlink = 1;
+  info.st_uid = geteuid();
+  info.st_gid = getegid();
+  info.st_mtime = time(NULL);
+  ProcessStreamDirectory(parent, info, false);
+}
+
+
+/**
+ * Creates an anonymous file for the given amount of data.  Small enough files
+ * are kept in memory, if the kernel supports it.
+ */
+int SyncUnionTarball::CreateDataFile(const uint64_t size) const {
+#ifdef __NR_memfd_create
+  if (size <= kMaxBufferedBytes) {
+    const int fd = syscall(__NR_memfd_create, "cvmfs-tarball", 0);
+    if (fd >= 0)
+      return fd;
+  }
+#endif
+
+  string temp_path;
+  FILE *f = CreateTempFile(temp_dir_ + "/tarball", 0600, "w+", &temp_path);
+  if (f == NULL) {
+    LogCvmfs(kLogUnionFs, kLogStderr, "failed to create temporary file in %s",
+             temp_dir_.c_str());
+    abort();
+  }
+  const int fd = dup(fileno(f));
+  assert(fd >= 0);
+  fclose(f);
+  unlink(temp_path.c_str());
+  return fd;
+}
+
+
+/**
+ * Copies the data of the current archive entry into a new data file.
+ */
+int SyncUnionTarball::CopyData(const uint64_t size) {
+  const int fd = CreateDataFile(size);
+  unsigned char buf[64 * 1024];
+  int64_t nbytes;
+  while ((nbytes = reader_->ReadData(buf, sizeof(buf))) > 0) {
+    if (!SafeWrite(fd, buf, nbytes)) {
+      LogCvmfs(kLogUnionFs, kLogStderr, "failed to buffer tarball data (%d)",
+               errno);
+      abort();
+    }
+  }
+  if (nbytes < 0) {
+    LogCvmfs(kLogUnionFs, kLogStderr, "failed to read %s",
+             tarball_path_.c_str());
+    abort();
+  }
+  return fd;
+}
+
+
+/**
+ * Waits for the spooler to process all the buffered files and releases them.
+ */
+void SyncUnionTarball::Flush() {
+  if (buffered_files_.empty())
+    return;
+  LogCvmfs(kLogUnionFs, kLogVerboseMsg, "releasing %lu buffered files",
+           buffered_files_.size());
+  mediator_->WaitForUpload();
+  for (map<string, int>::const_iterator i = buffered_files_.begin(),
+       iEnd = buffered_files_.end(); i != iEnd; ++i)
+  {
+    close(i->second);
+  }
+  buffered_files_.clear();
+  buffered_bytes_ = 0;
+}
+
+
+platform_stat64 SyncUnionTarball::MakeStat(
+  const TarReader::Entry &entry) const
+{
+  platform_stat64 info;
+  memset(&info, 0, sizeof(info));
+  info.st_mode = entry.mode;
+  switch (entry.type) {
+    case TarReader::kEntryDirectory:
+      info.st_mode |= S_IFDIR;
+      break;
+    case TarReader::kEntrySymlink:
+      info.st_mode |= S_IFLNK;
+      break;
+    case TarReader::kEntryCharacterDevice:
+      info.st_mode |= S_IFCHR;
+      break;
+    case TarReader::kEntryBlockDevice:
+      info.st_mode |= S_IFBLK;
+      break;
+    case TarReader::kEntryFifo:
+      info.st_mode |= S_IFIFO;
+      break;
+    default:
+      info.st_mode |= S_IFREG;
+  }
+  info.st_nlink = 1;
+  info.st_uid = entry.uid;
+  info.st_gid = entry.gid;
+  info.st_size = (entry.type == TarReader::kEntrySymlink) ?
+                 entry.link_target.length() : entry.size;
+  info.st_mtime = entry.mtime;
+  info.st_rdev = makedev(entry.dev_major, entry.dev_minor);
+  return info;
+}
+
+
+void SyncUnionTarball::SplitPath(
+  const string &path,
+  string *parent,
+  string *name)
+{
+  *parent = GetParentPath(path);
+  *name = GetFileName(path);
+}
+
+
+bool SyncUnionTarball::IsWhiteoutEntry(const SyncItem &entry) const {
+  const string &filename = entry.filename();
+  return HasPrefix(filename, kWhiteoutPrefix, false) &&
+         (filename != kOpaqueMarker);
+}
+
+
+bool SyncUnionTarball::IsOpaqueDirectory(const SyncItem &directory) const {
+  return false;
+}
+
+
+string SyncUnionTarball::UnwindWhiteoutFilename(const SyncItem &entry) const {
+  return entry.filename().substr(strlen(kWhiteoutPrefix));
+}
+
+}  // namespace publish
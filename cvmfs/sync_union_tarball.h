@@ -0,0 +1,101 @@
+/**
+ * This file is part of the CernVM File System
+ */
+
+#ifndef CVMFS_SYNC_UNION_TARBALL_H_
+#define CVMFS_SYNC_UNION_TARBALL_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "sync_union.h"
+#include "tar_reader.h"
+#include "util/pointer.h"
+
+namespace publish {
+
+/**
+ * Publishes the contents of a tar archive without a union file system.  The
+ * archive is read once, in order, from a file or from standard input.  The
+ * data of regular files is buffered in anonymous memory files (or in unlinked
+ * temporary files for very large files) until the spooler has processed them.
+ *
+ * The archive can contain OCI style whiteout files (".wh.<name>") that remove
+ * entries from the repository.  All the other entries are added or replace
+ * existing entries.
+ */
+class SyncUnionTarball : public SyncUnion {
+ public:
+  /**
+   * Upper limit of the file contents kept in memory at the same time
+   */
+  static const uint64_t kMaxBufferedBytes = 512 * 1024 * 1024;
+
+  /**
+   * @param tarball_path    path of the (uncompressed) archive, "-" for stdin
+   * @param base_directory  the archive is extracted under this repository
+   *                        directory, empty for the repository root
+   * @param temp_dir        temporary files are created here if necessary
+   */
+  SyncUnionTarball(SyncMediator *mediator,
+                   const std::string &rdonly_path,
+                   const std::string &tarball_path,
+                   const std::string &base_directory,
+                   const std::string &temp_dir);
+  ~SyncUnionTarball();
+
+  bool Initialize();
+  void Traverse();
+
+ protected:
+  std::string UnwindWhiteoutFilename(const SyncItem &entry) const;
+  bool IsOpaqueDirectory(const SyncItem &directory) const;
+  bool IsWhiteoutEntry(const SyncItem &entry) const;
+
+ private:
+  void ProcessEntry(const TarReader::Entry &entry);
+  void ProcessDataFile(const std::string &path,
+                       const platform_stat64 &info,
+                       int fd);
+  void ProcessStreamDirectory(const std::string &path,
+                              const platform_stat64 &info,
+                              const bool is_explicit);
+  void EnsureParentDirectory(const std::string &path);
+  int CreateDataFile(const uint64_t size) const;
+  int CopyData(const uint64_t size);
+  void Flush();
+  platform_stat64 MakeStat(const TarReader::Entry &entry) const;
+
+  static void SplitPath(const std::string &path,
+                        std::string *parent, std::string *name);
+
+  std::string tarball_path_;
+  std::string base_directory_;
+  std::string temp_dir_;
+  int tarball_fd_;
+  UniquePtr<TarReader> reader_;
+
+  /**
+   * Directories that were added or touched from the archive or that are known
+   * to exist in the repository
+   */
+  std::set<std::string> known_directories_;
+  /**
+   * Non-directory entries that were processed, later duplicates are ignored
+   */
+  std::set<std::string> ingested_paths_;
+  /**
+   * File descriptors of the files whose contents might still be read by the
+   * spooler, by repository path
+   */
+  std::map<std::string, int> buffered_files_;
+  uint64_t buffered_bytes_;
+  unsigned max_buffered_files_;
+};  // class SyncUnionTarball
+
+}  // namespace publish
+
+#endif  // CVMFS_SYNC_UNION_TARBALL_H_
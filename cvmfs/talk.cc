@@ -19,6 +19,7 @@
 #include <pthread.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/un.h>
@@ -30,12 +31,16 @@
 #include <string>
 #include <vector>
 
+#include "atomic.h"
 #include "cache.h"
 #include "cache_posix.h"
+#include "cache_ram.h"
+#include "catalog_heatmap.h"
 #include "catalog_mgr_client.h"
 #include "cvmfs.h"
 #include "download.h"
 #include "duplex_sqlite3.h"
+#include "fetch_timing.h"
 #include "fuse_remount.h"
 #include "glue_buffer.h"
 #include "loader.h"
@@ -46,9 +51,12 @@
 #include "options.h"
 #include "platform.h"
 #include "quota.h"
+#include "runtime_config.h"
 #include "shortstring.h"
+#include "sqlitemem.h"
 #include "statistics.h"
 #include "tracer.h"
+#include "uid_accounting.h"
 #include "util/pointer.h"
 #include "wpad.h"
 
@@ -86,10 +94,44 @@ TalkManager *TalkManager::Create(
   LogCvmfs(kLogTalk, kLogDebug, "socket created at %s (fd %d)",
            socket_path.c_str(), talk_manager->socket_fd_);
 
+  talk_manager->CreateMetricsEndpoint();
   return talk_manager.Release();
 }
 
 
+/**
+ * A metrics endpoint that cannot be created does not prevent the mount, it
+ * only leaves the monitoring without data.
+ */
+void TalkManager::CreateMetricsEndpoint() {
+  OptionsManager *options_mgr = mount_point_->file_system()->options_mgr();
+  string optarg;
+  if (options_mgr->GetValue("CVMFS_METRICS_SOCKET", &optarg)) {
+    metrics_fd_ = MakeSocket(optarg, 0660);
+    if (metrics_fd_ >= 0)
+      metrics_socket_path_ = optarg;
+  } else if (options_mgr->GetValue("CVMFS_METRICS_PORT", &optarg)) {
+    metrics_fd_ = MakeTcpEndpoint("127.0.0.1", String2Uint64(optarg));
+    optarg = "127.0.0.1:" + optarg;
+  } else {
+    return;
+  }
+
+  if ((metrics_fd_ < 0) || (listen(metrics_fd_, 1) == -1)) {
+    LogCvmfs(kLogTalk, kLogDebug | kLogSyslogWarn,
+             "failed to create metrics endpoint %s (%d)",
+             optarg.c_str(), errno);
+    if (metrics_fd_ >= 0) {
+      close(metrics_fd_);
+      metrics_fd_ = -1;
+    }
+    return;
+  }
+  LogCvmfs(kLogTalk, kLogDebug, "metrics endpoint created at %s (fd %d)",
+           optarg.c_str(), metrics_fd_);
+}
+
+
 string TalkManager::FormatHostInfo(download::DownloadManager *download_mgr) {
   vector<string> host_chain;
   vector<int> rtt;
@@ -107,7 +149,12 @@ string TalkManager::FormatHostInfo(download::DownloadManager *download_mgr) {
       host_str += "geographically ordered";
     else
       host_str += StringifyInt(rtt[i]) + " ms";
-    host_str += ")\n";
+    host_str += ")";
+    download::DownloadManager::EndpointScore score =
+      download_mgr->GetHostScore(host_chain[i]);
+    if (score.num_samples > 0)
+      host_str += " [" + score.Print() + "]";
+    host_str += "\n";
   }
   host_str += "Active host " + StringifyInt(active_host) + ": " +
               host_chain[active_host] + "\n";
@@ -143,6 +190,68 @@ string TalkManager::FormatProxyInfo(download::DownloadManager *download_mgr) {
 }
 
 
+/**
+ * Some counters are not maintained by their owners but need to be set by hand
+ * before they are shown.
+ */
+void TalkManager::UpdateStatistics() {
+  // Manually setting the values of the ShortString counters
+  mount_point_->statistics()->Lookup("pathstring.n_instances")->
+      Set(PathString::num_instances());
+  mount_point_->statistics()->Lookup("pathstring.n_overflows")->
+      Set(PathString::num_overflows());
+  mount_point_->statistics()->Lookup("namestring.n_instances")->
+      Set(NameString::num_instances());
+  mount_point_->statistics()->Lookup("namestring.n_overflows")->
+      Set(NameString::num_overflows());
+  mount_point_->statistics()->Lookup("linkstring.n_instances")->
+      Set(LinkString::num_instances());
+  mount_point_->statistics()->Lookup("linkstring.n_overflows")->
+      Set(LinkString::num_overflows());
+
+  // Manually setting the inode tracker numbers
+  glue::InodeTracker::Statistics inode_stats =
+    mount_point_->inode_tracker()->GetStatistics();
+  mount_point_->statistics()->Lookup("inode_tracker.n_insert")->Set(
+    atomic_read64(&inode_stats.num_inserts));
+  mount_point_->statistics()->Lookup("inode_tracker.n_remove")->Set(
+    atomic_read64(&inode_stats.num_removes));
+  mount_point_->statistics()->Lookup("inode_tracker.no_reference")->Set(
+    atomic_read64(&inode_stats.num_references));
+  mount_point_->statistics()->Lookup("inode_tracker.n_hit_inode")->Set(
+    atomic_read64(&inode_stats.num_hits_inode));
+  mount_point_->statistics()->Lookup("inode_tracker.n_hit_path")->Set(
+    atomic_read64(&inode_stats.num_hits_path));
+  mount_point_->statistics()->Lookup("inode_tracker.n_miss_path")->Set(
+    atomic_read64(&inode_stats.num_misses_path));
+
+  // Estimated memory usage of the main client data structures
+  perf::Statistics *statistics = mount_point_->statistics();
+  statistics->Lookup("memory.sz_inode_tracker")->Set(
+    mount_point_->inode_tracker()->bytes_allocated());
+  statistics->Lookup("memory.sz_metadata_caches")->Set(
+    statistics->Lookup("inode_cache.sz_allocated")->Get() +
+    statistics->Lookup("path_cache.sz_allocated")->Get() +
+    statistics->Lookup("md5_path_cache.sz_allocated")->Get());
+  statistics->Lookup("memory.sz_catalogs")->Set(
+    mount_point_->catalog_mgr()->GetMemoryUsage());
+  statistics->Lookup("memory.sz_sqlite")->Set(
+    SqliteMemoryManager::HasInstance() ?
+      SqliteMemoryManager::GetInstance()->GetMappedBytes() :
+      sqlite3_memory_used());
+  statistics->Lookup("memory.sz_chunk_tables")->Set(
+    mount_point_->chunk_tables()->GetMemoryUsage());
+  uint64_t sz_download = mount_point_->download_mgr()->GetMemoryUsage();
+  if (mount_point_->external_download_mgr() != NULL)
+    sz_download += mount_point_->external_download_mgr()->GetMemoryUsage();
+  statistics->Lookup("memory.sz_download")->Set(sz_download);
+  CacheManager *cache_mgr = mount_point_->file_system()->cache_mgr();
+  statistics->Lookup("memory.sz_ram_cache")->Set(
+    (cache_mgr->id() == kRamCacheManager) ?
+      reinterpret_cast<RamCacheManager *>(cache_mgr)->GetMemoryUsage() : 0);
+}
+
+
 /**
  * Listener thread on the socket.
  * TODO(jblomer): create Format... helpers to shorten this method
@@ -449,8 +558,51 @@ void *TalkManager::MainResponder(void *data) {
         mount_point->download_mgr()->SetTimeout(timeout, timeout_direct);
         talk_mgr->Answer(con_fd, "OK\n");
       }
+    } else if (line == "kcache timeout info") {
+      cvmfs::RuntimeConfigStore *runtime_config = mount_point->runtime_config();
+      const cvmfs::RuntimeConfig *config = runtime_config->Get();
+      string timeout_str =
+        "Kernel cache timeout: " +
+        StringifyInt(static_cast<int>(config->kcache_timeout_sec)) +
+        "s (at most " + StringifyInt(static_cast<int>(
+          runtime_config->max_kcache_timeout_sec())) + "s)\n" +
+        "Negative kernel cache timeout: " +
+        StringifyInt(static_cast<int>(config->kcache_negative_timeout_sec)) +
+        "s (at most " + StringifyInt(static_cast<int>(
+          runtime_config->max_kcache_negative_timeout_sec())) + "s)\n";
+      if (!config->IsCaching())
+        timeout_str += "Kernel caching currently suspended (reload)\n";
+      talk_mgr->Answer(con_fd, timeout_str);
+    } else if (line.substr(0, 18) == "kcache timeout set") {
+      if (line.length() < 20) {
+        talk_mgr->Answer(con_fd,
+                         "Usage: kcache timeout set <positive> <negative>\n");
+      } else {
+        uint64_t timeout;
+        uint64_t timeout_negative;
+        String2Uint64Pair(line.substr(19), &timeout, &timeout_negative);
+        if (mount_point->runtime_config()->SetKcacheTimeouts(
+              static_cast<double>(timeout),
+              static_cast<double>(timeout_negative)))
+        {
+          talk_mgr->Answer(con_fd, "OK\n");
+        } else {
+          talk_mgr->Answer(con_fd, "Failed to set kernel cache timeouts: "
+                           "cannot exceed the timeouts at mount time\n");
+        }
+      }
     } else if (line == "open catalogs") {
       talk_mgr->Answer(con_fd, mount_point->catalog_mgr()->PrintHierarchy());
+    } else if (line == "catalog heatmap") {
+      catalog::CatalogHeatmap *heatmap =
+        mount_point->catalog_mgr()->SnapshotHeatmap();
+      if (heatmap == NULL) {
+        talk_mgr->Answer(con_fd, "catalog heatmap is disabled\n");
+      } else {
+        talk_mgr->Answer(con_fd, heatmap->PrintReport(
+          catalog::CatalogHeatmap::kRankLookups, kHeatmapMaxRows));
+        delete heatmap;
+      }
     } else if (line == "internal affairs") {
       int current;
       int highwater;
@@ -458,35 +610,7 @@ void *TalkManager::MainResponder(void *data) {
 
       result += "Inode Generation:\n  " + cvmfs::PrintInodeGeneration();
 
-      // Manually setting the values of the ShortString counters
-      mount_point->statistics()->Lookup("pathstring.n_instances")->
-          Set(PathString::num_instances());
-      mount_point->statistics()->Lookup("pathstring.n_overflows")->
-          Set(PathString::num_overflows());
-      mount_point->statistics()->Lookup("namestring.n_instances")->
-          Set(NameString::num_instances());
-      mount_point->statistics()->Lookup("namestring.n_overflows")->
-          Set(NameString::num_overflows());
-      mount_point->statistics()->Lookup("linkstring.n_instances")->
-          Set(LinkString::num_instances());
-      mount_point->statistics()->Lookup("linkstring.n_overflows")->
-          Set(LinkString::num_overflows());
-
-      // Manually setting the inode tracker numbers
-      glue::InodeTracker::Statistics inode_stats =
-        mount_point->inode_tracker()->GetStatistics();
-      mount_point->statistics()->Lookup("inode_tracker.n_insert")->Set(
-        atomic_read64(&inode_stats.num_inserts));
-      mount_point->statistics()->Lookup("inode_tracker.n_remove")->Set(
-        atomic_read64(&inode_stats.num_removes));
-      mount_point->statistics()->Lookup("inode_tracker.no_reference")->Set(
-        atomic_read64(&inode_stats.num_references));
-      mount_point->statistics()->Lookup("inode_tracker.n_hit_inode")->Set(
-        atomic_read64(&inode_stats.num_hits_inode));
-      mount_point->statistics()->Lookup("inode_tracker.n_hit_path")->Set(
-        atomic_read64(&inode_stats.num_hits_path));
-      mount_point->statistics()->Lookup("inode_tracker.n_miss_path")->Set(
-        atomic_read64(&inode_stats.num_misses_path));
+      talk_mgr->UpdateStatistics();
 
       if (file_system->cache_mgr()->id() == kPosixCacheManager) {
         PosixCacheManager *cache_mgr =
@@ -510,6 +634,25 @@ void *TalkManager::MainResponder(void *data) {
       result += "\nDrainout Mode: " + StringifyBool(drainout_mode) + "\n";
       result += "Maintenance Mode: " + StringifyBool(maintenance_mode) + "\n";
 
+      perf::Statistics *statistics = mount_point->statistics();
+      result += "\nMemory Usage (estimated):\n";
+      result += "  Inode tracker " + StringifyInt(
+        statistics->Lookup("memory.sz_inode_tracker")->Get() / 1024) + " KB\n";
+      result += "  Metadata caches " + StringifyInt(
+        statistics->Lookup("memory.sz_metadata_caches")->Get() / 1024) +
+        " KB\n";
+      result += "  Catalogs " + StringifyInt(
+        statistics->Lookup("memory.sz_catalogs")->Get() / 1024) + " KB\n";
+      result += "  SQlite arenas (incl. catalogs) " + StringifyInt(
+        statistics->Lookup("memory.sz_sqlite")->Get() / 1024) + " KB\n";
+      result += "  Chunk tables " + StringifyInt(
+        statistics->Lookup("memory.sz_chunk_tables")->Get() / 1024) +
+        " KB\n";
+      result += "  Download buffers " + StringifyInt(
+        statistics->Lookup("memory.sz_download")->Get() / 1024) + " KB\n";
+      result += "  RAM cache " + StringifyInt(
+        statistics->Lookup("memory.sz_ram_cache")->Get() / 1024) + " KB\n";
+
       if (file_system->IsNfsSource()) {
         result += "\nNFS Map Statistics:\n";
         result += nfs_maps::GetStatistics();
@@ -526,18 +669,20 @@ void *TalkManager::MainResponder(void *data) {
       sqlite3_status(SQLITE_STATUS_MALLOC_SIZE, &current, &highwater, 0);
       result += "  Largest malloc " + StringifyInt(highwater) + " Bytes\n";
 
-      sqlite3_status(SQLITE_STATUS_PAGECACHE_USED, &current, &highwater, 0);
-      result += "  Page cache allocations " + StringifyInt(current) + " / " +
-                StringifyInt(highwater) + "\n";
-
-      sqlite3_status(SQLITE_STATUS_PAGECACHE_OVERFLOW,
-                     &current, &highwater, 0);
-      result += "  Page cache overflows " + StringifyInt(current/1024) +
-                " KB / " + StringifyInt(highwater/1024) + " KB\n";
-
-      sqlite3_status(SQLITE_STATUS_PAGECACHE_SIZE, &current, &highwater, 0);
-      result += "  Largest page cache allocation " + StringifyInt(highwater) +
-                " Bytes\n";
+      if (SqliteMemoryManager::HasInstance()) {
+        SqliteMemoryManager::PageCacheStatistics pcache_stats =
+          SqliteMemoryManager::GetInstance()->GetPageCacheStatistics();
+        result += "  Shared page cache " +
+                  StringifyInt(pcache_stats.bytes_used / 1024) + " KB / " +
+                  StringifyInt(pcache_stats.bytes_max / 1024) + " KB (budget " +
+                  StringifyInt(pcache_stats.budget / 1024) + " KB)\n";
+        result += "  Page cache pages " +
+                  StringifyInt(pcache_stats.num_pages) + " in " +
+                  StringifyInt(pcache_stats.num_caches) + " connections\n";
+        result += "  Page cache hits " + StringifyInt(pcache_stats.n_hit) +
+                  ", misses " + StringifyInt(pcache_stats.n_miss) +
+                  ", evictions " + StringifyInt(pcache_stats.n_evict) + "\n";
+      }
 
       sqlite3_status(SQLITE_STATUS_SCRATCH_USED, &current, &highwater, 0);
       result += "  Scratch allocations " + StringifyInt(current) + " / " +
@@ -558,6 +703,36 @@ void *TalkManager::MainResponder(void *data) {
         mount_point->statistics()->PrintList(perf::Statistics::kPrintHeader);
 
       talk_mgr->Answer(con_fd, result);
+    } else if (line == "latency") {
+      talk_mgr->Answer(con_fd, "Latencies in microseconds\n" +
+        mount_point->statistics()->PrintHistograms(
+          perf::Statistics::kPrintHeader));
+    } else if (line == "slow ops") {
+      if (mount_point->fetch_timing_log() == NULL) {
+        talk_mgr->Answer(con_fd, "fetch timing is disabled\n");
+      } else {
+        talk_mgr->Answer(con_fd, mount_point->fetch_timing_log()->Print());
+      }
+    } else if (line == "uid accounting") {
+      if (mount_point->uid_accounting() == NULL) {
+        talk_mgr->Answer(con_fd, "uid accounting is disabled\n");
+      } else {
+        talk_mgr->Answer(con_fd, mount_point->uid_accounting()->Print());
+      }
+    } else if (line == "fuse workers") {
+      const loader::LoaderExports *loader_exports = cvmfs::loader_exports_;
+      if ((loader_exports->version < 5) ||
+          (loader_exports->num_fuse_workers == 0))
+      {
+        talk_mgr->Answer(con_fd, "libfuse multi-threaded loop\n");
+      } else {
+        string workers_str = "Requests per fuse worker:\n";
+        for (unsigned i = 0; i < loader_exports->num_fuse_workers; ++i) {
+          workers_str += "  [" + StringifyInt(i) + "] " + StringifyInt(
+            atomic_read64(&loader_exports->fuse_worker_requests[i])) + "\n";
+        }
+        talk_mgr->Answer(con_fd, workers_str);
+      }
     } else if (line == "reset error counters") {
       file_system->ResetErrorCounters();
       talk_mgr->Answer(con_fd, "OK\n");
@@ -573,6 +748,10 @@ void *TalkManager::MainResponder(void *data) {
       talk_mgr->Answer(con_fd, pid_str);
     } else if (line == "parameters") {
       talk_mgr->Answer(con_fd, file_system->options_mgr()->Dump());
+    } else if (line == "boot timing") {
+      string timings = "File system:\n" + file_system->PrintBootTimings() +
+                       "Mount point:\n" + mount_point->PrintBootTimings();
+      talk_mgr->Answer(con_fd, timings);
     } else if (line == "hotpatch history") {
       string history_str =
         StringifyTime(cvmfs::loader_exports_->boot_time, true) +
@@ -611,6 +790,66 @@ void *TalkManager::MainResponder(void *data) {
 }
 
 
+string TalkManager::FormatMetricsResponse() {
+  UpdateStatistics();
+  const string body = mount_point_->statistics()->PrintOpenMetrics(
+    "cvmfs_", "repo=\"" + mount_point_->fqrn() + "\"");
+  return "HTTP/1.1 200 OK\r\n"
+         "Content-Type: application/openmetrics-text; version=1.0.0; "
+         "charset=utf-8\r\n"
+         "Content-Length: " + StringifyInt(body.length()) + "\r\n"
+         "Connection: close\r\n\r\n" + body;
+}
+
+
+/**
+ * Serves the statistics to every HTTP GET request on the metrics socket,
+ * independent of the requested path.  Connections are handled one at a time,
+ * a receive timeout prevents a stuck client from blocking the endpoint.
+ */
+void *TalkManager::MainMetrics(void *data) {
+  TalkManager *talk_mgr = reinterpret_cast<TalkManager *>(data);
+  LogCvmfs(kLogTalk, kLogDebug, "metrics thread started");
+
+  int con_fd = -1;
+  while (true) {
+    if (con_fd >= 0) {
+      shutdown(con_fd, SHUT_RDWR);
+      close(con_fd);
+    }
+    if ((con_fd = accept(talk_mgr->metrics_fd_, NULL, NULL)) < 0) {
+      LogCvmfs(kLogTalk, kLogDebug,
+               "terminating metrics thread (fd %d, errno %d)", con_fd, errno);
+      break;
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec = kMetricsTimeoutSec;
+    timeout.tv_usec = 0;
+    (void)setsockopt(con_fd, SOL_SOCKET, SO_RCVTIMEO,
+                     &timeout, sizeof(timeout));
+    (void)setsockopt(con_fd, SOL_SOCKET, SO_SNDTIMEO,
+                     &timeout, sizeof(timeout));
+
+    // Only the request line matters, the rest of the request is ignored
+    char buf[kMaxCommandSize];
+    int bytes_read;
+    if ((bytes_read = recv(con_fd, buf, sizeof(buf), 0)) <= 0)
+      continue;
+    const string request(buf, bytes_read);
+    if (!HasPrefix(request, "GET ", false)) {
+      talk_mgr->Answer(con_fd, "HTTP/1.1 405 Method Not Allowed\r\n"
+                               "Content-Length: 0\r\n"
+                               "Connection: close\r\n\r\n");
+      continue;
+    }
+    talk_mgr->Answer(con_fd, talk_mgr->FormatMetricsResponse());
+  }
+
+  return NULL;
+}
+
+
 TalkManager::TalkManager(
   const string &socket_path,
   MountPoint *mount_point,
@@ -620,8 +859,11 @@ TalkManager::TalkManager(
   , mount_point_(mount_point)
   , remounter_(remounter)
   , spawned_(false)
+  , metrics_fd_(-1)
+  , spawned_metrics_(false)
 {
   memset(&thread_talk_, 0, sizeof(thread_talk_));
+  memset(&thread_metrics_, 0, sizeof(thread_metrics_));
 }
 
 
@@ -644,6 +886,17 @@ TalkManager::~TalkManager() {
     pthread_join(thread_talk_, NULL);
     LogCvmfs(kLogTalk, kLogDebug, "talk thread stopped");
   }
+
+  if (metrics_fd_ >= 0) {
+    shutdown(metrics_fd_, SHUT_RDWR);
+    close(metrics_fd_);
+  }
+  if (spawned_metrics_) {
+    pthread_join(thread_metrics_, NULL);
+    LogCvmfs(kLogTalk, kLogDebug, "metrics thread stopped");
+  }
+  if (!metrics_socket_path_.empty())
+    unlink(metrics_socket_path_.c_str());
 }
 
 
@@ -651,4 +904,10 @@ void TalkManager::Spawn() {
   int retval = pthread_create(&thread_talk_, NULL, MainResponder, this);
   assert(retval == 0);
   spawned_ = true;
+
+  if (metrics_fd_ >= 0) {
+    retval = pthread_create(&thread_metrics_, NULL, MainMetrics, this);
+    assert(retval == 0);
+    spawned_metrics_ = true;
+  }
 }
@@ -23,6 +23,11 @@ class OptionsManager;
 /**
  * Provides a command & control interface to the MountPoint class.  Data is
  * exchanged through a UNIX domain socket.  Used by the cvmfs_talk utility.
+ *
+ * Optionally, the statistics are served in the OpenMetrics format over HTTP
+ * on a second UNIX domain socket (CVMFS_METRICS_SOCKET) or on a localhost TCP
+ * port (CVMFS_METRICS_PORT), so that monitoring agents can scrape them
+ * without running cvmfs_talk.
  */
 class TalkManager : SingleCopy {
  public:
@@ -38,11 +43,23 @@ class TalkManager : SingleCopy {
    * Maximum number of characters that can be read as a command from the socket.
    */
   static const unsigned kMaxCommandSize = 512;
+  /**
+   * Send and receive timeout for scrapes of the metrics endpoint
+   */
+  static const unsigned kMetricsTimeoutSec = 5;
+  /**
+   * Number of catalogs shown by the "catalog heatmap" command
+   */
+  static const unsigned kHeatmapMaxRows = 100;
 
   TalkManager(const std::string &socket_path,
               MountPoint *mount_point,
               FuseRemounter *remounter);
+  void CreateMetricsEndpoint();
   static void *MainResponder(void *data);
+  static void *MainMetrics(void *data);
+  void UpdateStatistics();
+  std::string FormatMetricsResponse();
   void Answer(int con_fd, const std::string &msg);
   void AnswerStringList(int con_fd, const std::vector<std::string> &list);
   std::string FormatHostInfo(download::DownloadManager *download_mgr);
@@ -54,6 +71,14 @@ class TalkManager : SingleCopy {
   FuseRemounter *remounter_;
   pthread_t thread_talk_;
   bool spawned_;
+  /**
+   * Either a UNIX domain socket or a TCP socket on 127.0.0.1, -1 if the
+   * metrics endpoint is not enabled
+   */
+  std::string metrics_socket_path_;
+  int metrics_fd_;
+  pthread_t thread_metrics_;
+  bool spawned_metrics_;
 };
 
 #endif  // CVMFS_TALK_H_
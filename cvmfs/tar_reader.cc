@@ -0,0 +1,365 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "tar_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "logging.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace publish {
+
+namespace {
+
+// Offsets and lengths of the ustar header fields
+const unsigned kOffsetName = 0;
+const unsigned kLengthName = 100;
+const unsigned kOffsetMode = 100;
+const unsigned kOffsetUid = 108;
+const unsigned kOffsetGid = 116;
+const unsigned kLengthId = 8;
+const unsigned kOffsetSize = 124;
+const unsigned kOffsetMtime = 136;
+const unsigned kLengthNumber = 12;
+const unsigned kOffsetChecksum = 148;
+const unsigned kLengthChecksum = 8;
+const unsigned kOffsetType = 156;
+const unsigned kOffsetLinkname = 157;
+const unsigned kOffsetMagic = 257;
+const unsigned kOffsetDevMajor = 329;
+const unsigned kOffsetDevMinor = 337;
+const unsigned kOffsetPrefix = 345;
+const unsigned kLengthPrefix = 155;
+
+/**
+ * Pax headers and GNU long names are read into memory
+ */
+const uint64_t kMaxExtensionSize = 1024 * 1024;
+
+}  // anonymous namespace
+
+
+TarReader::TarReader(int fd)
+  : fd_(fd)
+  , data_remaining_(0)
+  , padding_(0)
+  , failed_(false)
+{ }
+
+
+string TarReader::GetField(const unsigned char *field, const unsigned length) {
+  const char *begin = reinterpret_cast<const char *>(field);
+  return string(begin, std::find(begin, begin + length, '\0'));
+}
+
+
+bool TarReader::ParseNumber(
+  const unsigned char *field,
+  const unsigned length,
+  uint64_t *value)
+{
+  *value = 0;
+  if (field[0] & 0x80) {
+    // Base-256, negative numbers are not used for sizes and ids
+    if (field[0] == 0xff)
+      return false;
+    *value = field[0] & 0x7f;
+    for (unsigned i = 1; i < length; ++i) {
+      if (*value > (UINT64_MAX >> 8))
+        return false;
+      *value = (*value << 8) | field[i];
+    }
+    return true;
+  }
+
+  unsigned i = 0;
+  while ((i < length) && (field[i] == ' '))
+    i++;
+  for (; (i < length) && (field[i] != '\0') && (field[i] != ' '); ++i) {
+    if ((field[i] < '0') || (field[i] > '7'))
+      return false;
+    if (*value > (UINT64_MAX >> 3))
+      return false;
+    *value = (*value << 3) | (field[i] - '0');
+  }
+  return true;
+}
+
+
+/**
+ * The checksum is the sum of the header bytes with the checksum field taken as
+ * spaces.  Some historic implementations summed signed chars.
+ */
+bool TarReader::VerifyChecksum(const unsigned char *block) {
+  uint64_t expected;
+  if (!ParseNumber(block + kOffsetChecksum, kLengthChecksum, &expected))
+    return false;
+  uint64_t sum_unsigned = 0;
+  int64_t sum_signed = 0;
+  for (unsigned i = 0; i < kBlockSize; ++i) {
+    const bool is_checksum =
+      (i >= kOffsetChecksum) && (i < kOffsetChecksum + kLengthChecksum);
+    const unsigned char c = is_checksum ? ' ' : block[i];
+    sum_unsigned += c;
+    sum_signed += static_cast<signed char>(c);
+  }
+  return (expected == sum_unsigned) ||
+         (static_cast<int64_t>(expected) == sum_signed);
+}
+
+
+/**
+ * Removes empty and "." path components.  ".." components are kept, it is up
+ * to the caller to reject them.
+ */
+string TarReader::NormalizePath(const string &path) {
+  const vector<string> components = SplitString(path, '/');
+  string result;
+  for (unsigned i = 0; i < components.size(); ++i) {
+    if (components[i].empty() || (components[i] == "."))
+      continue;
+    if (!result.empty())
+      result.push_back('/');
+    result += components[i];
+  }
+  return result;
+}
+
+
+bool TarReader::ReadFully(void *buf, const uint64_t size) {
+  const ssize_t nbytes = SafeRead(fd_, buf, size);
+  if ((nbytes < 0) || (static_cast<uint64_t>(nbytes) != size)) {
+    LogCvmfs(kLogPublish, kLogStderr, "tarball ends prematurely");
+    failed_ = true;
+    return false;
+  }
+  return true;
+}
+
+
+/**
+ * The archive might be a pipe, so the data is read and thrown away.
+ */
+bool TarReader::Skip(uint64_t size) {
+  unsigned char buf[16 * kBlockSize];
+  while (size > 0) {
+    const uint64_t nbytes = std::min(size, static_cast<uint64_t>(sizeof(buf)));
+    if (!ReadFully(buf, nbytes))
+      return false;
+    size -= nbytes;
+  }
+  return true;
+}
+
+
+/**
+ * Reads the data of a pax header or of a GNU long name entry, including the
+ * padding to the next block.
+ */
+bool TarReader::ReadExtension(const uint64_t size, string *data) {
+  if (size > kMaxExtensionSize) {
+    LogCvmfs(kLogPublish, kLogStderr, "tar extension header too large");
+    failed_ = true;
+    return false;
+  }
+  const uint64_t padded_size =
+    (size + kBlockSize - 1) / kBlockSize * kBlockSize;
+  vector<char> buf(padded_size + 1);
+  if (!ReadFully(&buf[0], padded_size))
+    return false;
+  data->assign(&buf[0], size);
+  return true;
+}
+
+
+/**
+ * Records have the form "<length> <key>=<value>\n", where length includes
+ * the entire record.
+ */
+bool TarReader::ParsePaxRecords(const string &data) {
+  size_t pos = 0;
+  while (pos < data.length()) {
+    const size_t pos_space = data.find(' ', pos);
+    uint64_t length;
+    if ((pos_space == string::npos) ||
+        !String2Uint64Parse(data.substr(pos, pos_space - pos), &length) ||
+        (length <= pos_space - pos) || (pos + length > data.length()) ||
+        (data[pos + length - 1] != '\n'))
+    {
+      LogCvmfs(kLogPublish, kLogStderr, "invalid pax header");
+      failed_ = true;
+      return false;
+    }
+    const string record = data.substr(pos_space + 1,
+                                      pos + length - pos_space - 2);
+    const size_t pos_equal = record.find('=');
+    if (pos_equal != string::npos)
+      pax_values_[record.substr(0, pos_equal)] = record.substr(pos_equal + 1);
+    pos += length;
+  }
+  return true;
+}
+
+
+bool TarReader::Next(Entry *entry) {
+  if (failed_)
+    return false;
+  if (!Skip(data_remaining_ + padding_))
+    return false;
+  data_remaining_ = padding_ = 0;
+
+  unsigned char block[kBlockSize];
+  while (true) {
+    // Archives that end without the two zero blocks are accepted
+    const ssize_t nbytes = SafeRead(fd_, block, kBlockSize);
+    if (nbytes == 0)
+      return false;
+    if (nbytes != static_cast<ssize_t>(kBlockSize)) {
+      LogCvmfs(kLogPublish, kLogStderr, "tarball ends prematurely");
+      failed_ = true;
+      return false;
+    }
+    bool is_zero = true;
+    for (unsigned i = 0; (i < kBlockSize) && is_zero; ++i)
+      is_zero = (block[i] == 0);
+    if (is_zero)
+      return false;
+
+    uint64_t size;
+    if (!VerifyChecksum(block) ||
+        !ParseNumber(block + kOffsetSize, kLengthNumber, &size))
+    {
+      LogCvmfs(kLogPublish, kLogStderr, "invalid tar header");
+      failed_ = true;
+      return false;
+    }
+
+    const char type_flag = block[kOffsetType];
+    string extension;
+    switch (type_flag) {
+      case 'x':
+        if (!ReadExtension(size, &extension) || !ParsePaxRecords(extension))
+          return false;
+        continue;
+      case 'g':
+        // Global pax headers carry no file system attributes we care about
+        if (!Skip((size + kBlockSize - 1) / kBlockSize * kBlockSize))
+          return false;
+        continue;
+      case 'L':
+        if (!ReadExtension(size, &extension))
+          return false;
+        gnu_long_path_ = extension.substr(0, extension.find('\0'));
+        continue;
+      case 'K':
+        if (!ReadExtension(size, &extension))
+          return false;
+        gnu_long_link_ = extension.substr(0, extension.find('\0'));
+        continue;
+      default:
+        break;
+    }
+
+    *entry = Entry();
+    switch (type_flag) {
+      case '1': entry->type = kEntryHardlink; break;
+      case '2': entry->type = kEntrySymlink; break;
+      case '3': entry->type = kEntryCharacterDevice; break;
+      case '4': entry->type = kEntryBlockDevice; break;
+      case '5': entry->type = kEntryDirectory; break;
+      case '6': entry->type = kEntryFifo; break;
+      // Unknown types are regular files according to POSIX
+      default: entry->type = kEntryFile;
+    }
+
+    string path = GetField(block + kOffsetName, kLengthName);
+    const bool is_ustar =
+      memcmp(block + kOffsetMagic, "ustar", 5) == 0;
+    if (is_ustar) {
+      const string prefix = GetField(block + kOffsetPrefix, kLengthPrefix);
+      if (!prefix.empty())
+        path = prefix + "/" + path;
+    }
+    if (!gnu_long_path_.empty())
+      path = gnu_long_path_;
+    string link_target = GetField(block + kOffsetLinkname, kLengthName);
+    if (!gnu_long_link_.empty())
+      link_target = gnu_long_link_;
+
+    uint64_t mode, uid, gid, mtime, dev_major = 0, dev_minor = 0;
+    bool retval =
+      ParseNumber(block + kOffsetMode, kLengthId, &mode) &&
+      ParseNumber(block + kOffsetUid, kLengthId, &uid) &&
+      ParseNumber(block + kOffsetGid, kLengthId, &gid) &&
+      ParseNumber(block + kOffsetMtime, kLengthNumber, &mtime);
+    if (is_ustar) {
+      retval = retval &&
+        ParseNumber(block + kOffsetDevMajor, kLengthId, &dev_major) &&
+        ParseNumber(block + kOffsetDevMinor, kLengthId, &dev_minor);
+    }
+
+    map<string, string>::const_iterator iter;
+    if ((iter = pax_values_.find("path")) != pax_values_.end())
+      path = iter->second;
+    if ((iter = pax_values_.find("linkpath")) != pax_values_.end())
+      link_target = iter->second;
+    if ((iter = pax_values_.find("size")) != pax_values_.end())
+      retval = retval && String2Uint64Parse(iter->second, &size);
+    if ((iter = pax_values_.find("uid")) != pax_values_.end())
+      retval = retval && String2Uint64Parse(iter->second, &uid);
+    if ((iter = pax_values_.find("gid")) != pax_values_.end())
+      retval = retval && String2Uint64Parse(iter->second, &gid);
+    if ((iter = pax_values_.find("mtime")) != pax_values_.end()) {
+      // Might have a fractional part
+      retval = retval && String2Uint64Parse(
+        iter->second.substr(0, iter->second.find('.')), &mtime);
+    }
+    pax_values_.clear();
+    gnu_long_path_.clear();
+    gnu_long_link_.clear();
+    if (!retval) {
+      LogCvmfs(kLogPublish, kLogStderr, "invalid tar header for %s",
+               path.c_str());
+      failed_ = true;
+      return false;
+    }
+
+    entry->path = NormalizePath(path);
+    entry->link_target = (entry->type == kEntryHardlink) ?
+                         NormalizePath(link_target) : link_target;
+    entry->mode = mode & 07777;
+    entry->uid = uid;
+    entry->gid = gid;
+    entry->mtime = mtime;
+    entry->dev_major = dev_major;
+    entry->dev_minor = dev_minor;
+    entry->size = (entry->type == kEntryFile) ? size : 0;
+    // Other entry types normally have no data but it is skipped if they do
+    data_remaining_ = size;
+    padding_ = (kBlockSize - (size % kBlockSize)) % kBlockSize;
+    return true;
+  }
+}
+
+
+int64_t TarReader::ReadData(void *buf, const uint64_t size) {
+  if (failed_)
+    return -1;
+  const uint64_t nbytes = std::min(size, data_remaining_);
+  if (nbytes == 0)
+    return 0;
+  if (!ReadFully(buf, nbytes))
+    return -1;
+  data_remaining_ -= nbytes;
+  return nbytes;
+}
+
+}  // namespace publish
@@ -0,0 +1,112 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_TAR_READER_H_
+#define CVMFS_TAR_READER_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+
+#include "util/single_copy.h"
+
+namespace publish {
+
+/**
+ * Reads the entries of a tar archive one after another from a file
+ * descriptor, which can as well be a pipe.  Understands POSIX ustar and pax
+ * archives as well as the GNU extensions for long names and for large
+ * numbers.  Compressed archives need to be decompressed by the caller.
+ */
+class TarReader : SingleCopy {
+ public:
+  enum EntryType {
+    kEntryFile = 0,
+    kEntryDirectory,
+    kEntrySymlink,
+    kEntryHardlink,
+    kEntryCharacterDevice,
+    kEntryBlockDevice,
+    kEntryFifo
+  };
+
+  struct Entry {
+    Entry()
+      : type(kEntryFile), mode(0), uid(0), gid(0), size(0), mtime(0)
+      , dev_major(0), dev_minor(0)
+    { }
+
+    EntryType type;
+    /**
+     * Relative path without leading "./" or "/" and without trailing "/".
+     * Empty for the top-level directory of the archive.
+     */
+    std::string path;
+    /**
+     * Target of a symlink, or the path of the hardlinked entry
+     */
+    std::string link_target;
+    unsigned mode;  ///< Permission bits, without the file type
+    uid_t uid;
+    gid_t gid;
+    uint64_t size;  ///< Size of the data of regular files
+    int64_t mtime;
+    unsigned dev_major;
+    unsigned dev_minor;
+  };
+
+  explicit TarReader(int fd);
+
+  /**
+   * Moves to the next entry.  Unread data of the previous entry is skipped.
+   * Returns false at the end of the archive or on failure, see failed().
+   */
+  bool Next(Entry *entry);
+  /**
+   * Reads up to size bytes of the data of the current entry.  Returns the
+   * number of bytes read, 0 once all the data is read, or -1 on failure.
+   */
+  int64_t ReadData(void *buf, const uint64_t size);
+
+  bool failed() const { return failed_; }
+
+  static std::string NormalizePath(const std::string &path);
+  /**
+   * Parses an octal or a GNU base-256 number field of the header
+   */
+  static bool ParseNumber(const unsigned char *field, const unsigned length,
+                          uint64_t *value);
+
+ private:
+  static const unsigned kBlockSize = 512;
+
+  bool ReadFully(void *buf, const uint64_t size);
+  bool Skip(uint64_t size);
+  bool ReadExtension(const uint64_t size, std::string *data);
+  bool ParsePaxRecords(const std::string &data);
+  static bool VerifyChecksum(const unsigned char *block);
+  static std::string GetField(const unsigned char *field,
+                              const unsigned length);
+
+  int fd_;
+  /**
+   * Unread data of the current entry, followed by padding_ bytes to fill up
+   * the last block
+   */
+  uint64_t data_remaining_;
+  uint64_t padding_;
+  bool failed_;
+  /**
+   * Values of a pax extended header, they apply to the following entry only
+   */
+  std::map<std::string, std::string> pax_values_;
+  std::string gnu_long_path_;
+  std::string gnu_long_link_;
+};
+
+}  // namespace publish
+
+#endif  // CVMFS_TAR_READER_H_
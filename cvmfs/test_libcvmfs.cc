@@ -54,28 +54,22 @@ int cvmfs_test_list(cvmfs_context *ctx, const char *path)
     return -1;
   }
 
-  char filepath[TEST_LINE_MAX];
-  struct stat info;
-
-  char **buffer = 0;
+  struct cvmfs_listing_entry *buffer = NULL;
   size_t length = 0;
-  int i;
+  size_t i;
 
-  int result = cvmfs_listdir(ctx, path, &buffer, &length);
+  int result = cvmfs_listdir_stat(ctx, path, &buffer, &length);
   if (result < 0) {
     fprintf(stderr, "%s: %s\n", path, strerror(errno));
     return -1;
   }
 
-
-  for (i = 0; buffer[i]; i++) {
-    snprintf(filepath, TEST_LINE_MAX, "%s/%s", path, buffer[i]);
-    cvmfs_stat(ctx, filepath, &info);
+  for (i = 0; i < length; i++) {
     printf("%10" PRIu64 " %s\n",
-           static_cast<uint64_t>(info.st_size), buffer[i]);
+           static_cast<uint64_t>(buffer[i].info.st_size), buffer[i].name);
   }
 
-  free(buffer);
+  cvmfs_listdir_stat_free(buffer, length);
 
   return 0;
 }
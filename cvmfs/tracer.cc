@@ -13,20 +13,29 @@
 #include <cstdlib>
 #include <cstring>
 #include <string>
+#include <vector>
 
 #include "atomic.h"
+#include "platform.h"
 #include "util/posix.h"
 #include "util/string.h"
 
 using namespace std;  // NOLINT
 
+const uint64_t Tracer::kBinaryMagic;
+const uint32_t Tracer::kBinaryVersion;
+const int32_t Tracer::kRecordHeader;
+const int32_t Tracer::kRecordString;
+
 
 void Tracer::Activate(
   const int buffer_size,
   const int flush_threshold,
-  const string &trace_file)
+  const string &trace_file,
+  const Format format)
 {
   trace_file_ = trace_file;
+  format_ = format;
   buffer_size_ = buffer_size;
   flush_threshold_ = flush_threshold;
   assert(buffer_size_ > 1);
@@ -50,7 +59,7 @@ void Tracer::Activate(
 
 /**
  * Trace a message.  This is usually a lock-free procedure that just
- * requires two fetch_and_add operations and a gettimeofday syscall.
+ * requires two fetch_and_add operations and a clock_gettime call.
  * There are two exceptions:
  *   -# If the ring buffer is full, the function blocks until the flush
  *      thread made some space.  Avoid that by carefully choosing size
@@ -71,8 +80,7 @@ int32_t Tracer::DoTrace(
   const string &msg)
 {
   int32_t my_seq_no = atomic_xadd32(&seq_no_, 1);
-  timeval now;
-  gettimeofday(&now, NULL);
+  const uint64_t now = platform_realtime_ns();
   int pos = my_seq_no % buffer_size_;
 
   while (my_seq_no - atomic_read32(&flushed_) >= buffer_size_) {
@@ -86,7 +94,7 @@ int32_t Tracer::DoTrace(
     assert(retval == ETIMEDOUT || retval == 0);
   }
 
-  ring_buffer_[pos].time_stamp = now;
+  ring_buffer_[pos].time_ns = now;
   ring_buffer_[pos].code = event;
   ring_buffer_[pos].path = path;
   ring_buffer_[pos].msg = msg;
@@ -149,6 +157,10 @@ void *Tracer::MainFlush(void *data) {
   LockMutex(&tracer->sig_flush_mutex_);
   FILE *f = fopen(tracer->trace_file_.c_str(), "a");
   assert(f != NULL && "Could not open trace file");
+  if (tracer->format_ == kFormatBinary) {
+    retval = tracer->WriteBinaryHeader(f);
+    assert(retval == 0);
+  }
   struct timespec timeout;
 
   do {
@@ -171,18 +183,13 @@ void *Tracer::MainFlush(void *data) {
            (atomic_read32(&tracer->commit_buffer_[
              pos = ((base + i) % tracer->buffer_size_)]) == 1))
     {
-      string tmp;
-      tmp = StringifyTimeval(tracer->ring_buffer_[pos].time_stamp);
-      retval = tracer->WriteCsvFile(f, tmp);
-      retval |= fputc(',', f) - ',';
-      tmp = StringifyInt(tracer->ring_buffer_[pos].code);
-      retval = tracer->WriteCsvFile(f, tmp);
-      retval |= fputc(',', f) - ',';
-      retval |= tracer->WriteCsvFile(
-        f, tracer->ring_buffer_[pos].path.ToString());
-      retval |= fputc(',', f) - ',';
-      retval |= tracer->WriteCsvFile(f, tracer->ring_buffer_[pos].msg);
-      retval |= (fputc(13, f) - 13) | (fputc(10, f) - 10);
+      const BufferEntry &entry = tracer->ring_buffer_[pos];
+      if (tracer->format_ == kFormatBinary) {
+        retval = tracer->WriteBinaryLine(f, entry);
+      } else {
+        retval = WriteCsvLine(f, entry.time_ns, entry.code,
+                              entry.path.ToString(), entry.msg);
+      }
       assert(retval == 0);
 
       atomic_dec32(&tracer->commit_buffer_[pos]);
@@ -222,6 +229,7 @@ void Tracer::Spawn() {
 Tracer::Tracer()
   : active_(false)
   , spawned_(false)
+  , format_(kFormatCsv)
   , buffer_size_(0)
   , flush_threshold_(0)
   , ring_buffer_(NULL)
@@ -287,3 +295,175 @@ int Tracer::WriteCsvFile(FILE *fp, const string &field) {
 
   return 0;
 }
+
+
+int Tracer::WriteCsvLine(
+  FILE *fp,
+  const uint64_t time_ns,
+  const int code,
+  const string &path,
+  const string &msg)
+{
+  timeval time_stamp;
+  time_stamp.tv_sec = time_ns / 1000000000;
+  time_stamp.tv_usec = (time_ns % 1000000000) / 1000;
+
+  int retval = WriteCsvFile(fp, StringifyTimeval(time_stamp));
+  retval |= fputc(',', fp) - ',';
+  retval |= WriteCsvFile(fp, StringifyInt(code));
+  retval |= fputc(',', fp) - ',';
+  retval |= WriteCsvFile(fp, path);
+  retval |= fputc(',', fp) - ',';
+  retval |= WriteCsvFile(fp, msg);
+  retval |= (fputc(13, fp) - 13) | (fputc(10, fp) - 10);
+  return retval;
+}
+
+
+/**
+ * Starts a new run in the binary file, string ids are not carried over from
+ * earlier runs.
+ */
+int Tracer::WriteBinaryHeader(FILE *fp) {
+  string_ids_.clear();
+  BinaryRecord record;
+  memset(&record, 0, sizeof(record));
+  record.time_ns = kBinaryMagic;
+  record.code = kRecordHeader;
+  record.length = kBinaryVersion;
+  return (fwrite(&record, sizeof(record), 1, fp) == 1) ? 0 : -1;
+}
+
+
+/**
+ * Returns the id of str.  New strings are defined in the trace file first.
+ */
+uint32_t Tracer::InternString(FILE *fp, const string &str, int *retval) {
+  map<string, uint32_t>::const_iterator i = string_ids_.find(str);
+  if (i != string_ids_.end())
+    return i->second;
+
+  const uint32_t id = string_ids_.size();
+  string_ids_[str] = id;
+
+  BinaryRecord record;
+  memset(&record, 0, sizeof(record));
+  record.code = kRecordString;
+  record.path_id = id;
+  record.length = str.length();
+  const unsigned padding =
+    (sizeof(record) - (str.length() % sizeof(record))) % sizeof(record);
+  const char zeros[sizeof(record)] = { 0 };
+  if ((fwrite(&record, sizeof(record), 1, fp) != 1) ||
+      (fwrite(str.data(), 1, str.length(), fp) != str.length()) ||
+      (fwrite(zeros, 1, padding, fp) != padding))
+  {
+    *retval = -1;
+  }
+  return id;
+}
+
+
+int Tracer::WriteBinaryLine(FILE *fp, const BufferEntry &entry) {
+  int retval = 0;
+  // Both strings of the record need to be defined in the same run
+  if (string_ids_.size() + 2 > kMaxInternedStrings)
+    retval = WriteBinaryHeader(fp);
+
+  BinaryRecord record;
+  memset(&record, 0, sizeof(record));
+  record.time_ns = entry.time_ns;
+  record.code = entry.code;
+  record.path_id = InternString(fp, entry.path.ToString(), &retval);
+  record.msg_id = InternString(fp, entry.msg, &retval);
+  if (fwrite(&record, sizeof(record), 1, fp) != 1)
+    retval = -1;
+  return retval;
+}
+
+
+bool Tracer::ConvertBinaryToCsv(const string &binary_path, FILE *fp) {
+  return ReadBinary(binary_path, fp, NULL);
+}
+
+
+/**
+ * Appends the events of a binary trace file to events, including the internal
+ * events with negative codes.
+ */
+bool Tracer::ReadBinaryTrace(const string &binary_path, vector<Event> *events) {
+  return ReadBinary(binary_path, NULL, events);
+}
+
+
+/**
+ * Either writes the events as csv to fp or collects them in events.
+ */
+bool Tracer::ReadBinary(
+  const string &binary_path,
+  FILE *fp,
+  vector<Event> *events)
+{
+  FILE *f = fopen(binary_path.c_str(), "r");
+  if (f == NULL)
+    return false;
+
+  vector<string> strings;
+  bool header_seen = false;
+  bool result = true;
+  BinaryRecord record;
+  while (fread(&record, sizeof(record), 1, f) == 1) {
+    if (record.code == kRecordHeader) {
+      if ((record.time_ns != kBinaryMagic) ||
+          (record.length != kBinaryVersion))
+      {
+        result = false;
+        break;
+      }
+      header_seen = true;
+      strings.clear();
+      continue;
+    }
+    if (!header_seen) {
+      result = false;
+      break;
+    }
+
+    if (record.code == kRecordString) {
+      const unsigned padded_length =
+        ((record.length + sizeof(record) - 1) / sizeof(record)) *
+        sizeof(record);
+      vector<char> buffer(padded_length + 1);
+      if ((padded_length > 0) &&
+          (fread(&buffer[0], 1, padded_length, f) != padded_length))
+      {
+        result = false;
+        break;
+      }
+      if (record.path_id >= strings.size())
+        strings.resize(record.path_id + 1);
+      strings[record.path_id] = string(&buffer[0], record.length);
+      continue;
+    }
+
+    if ((record.path_id >= strings.size()) ||
+        (record.msg_id >= strings.size()))
+    {
+      result = false;
+      break;
+    }
+    if (fp == NULL) {
+      events->push_back(Event(record.time_ns, record.code,
+                              strings[record.path_id],
+                              strings[record.msg_id]));
+    } else if (WriteCsvLine(fp, record.time_ns, record.code,
+                            strings[record.path_id],
+                            strings[record.msg_id]) != 0)
+    {
+      result = false;
+      break;
+    }
+  }
+  fclose(f);
+  return result;
+}
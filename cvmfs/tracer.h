@@ -10,7 +10,9 @@
 #include <sys/time.h>
 
 #include <cstdio>
+#include <map>
 #include <string>
+#include <vector>
 
 #include "atomic.h"
 #include "shortstring.h"
@@ -29,6 +31,14 @@
  *
  * Csv output is adapted from libcsv.
  *
+ * Alternatively, the trace file is written in a compact binary format that is
+ * much cheaper to produce and can be converted to csv offline
+ * (cvmfs_swissknife trace2csv).  It consists of fixed-size BinaryRecords in
+ * host byte order.  Paths and messages are interned: when a string is used for
+ * the first time, a kRecordString record defines its id, followed by the string
+ * padded to a multiple of the record size.  Every run of the tracer starts
+ * with a kRecordHeader record and a fresh set of ids.
+ *
  * \todo If anything goes wrong, the whole thing breaks down on assertion.  This
  * might be not desired behavior.
  */
@@ -45,11 +55,60 @@ class Tracer : SingleCopy {
     kEventCrowd,
   };
 
+  enum Format {
+    kFormatCsv = 0,
+    kFormatBinary,
+  };
+
+  struct BinaryRecord {
+    /**
+     * Nanoseconds since the epoch.  For kRecordHeader the magic number.
+     */
+    uint64_t time_ns;
+    int32_t code;
+    /**
+     * For kRecordString the id of the defined string
+     */
+    uint32_t path_id;
+    uint32_t msg_id;
+    /**
+     * For kRecordString the length of the string that follows, for
+     * kRecordHeader the format version
+     */
+    uint32_t length;
+  };
+
+  /**
+   * "CVMFSTRC" on little-endian hosts
+   */
+  static const uint64_t kBinaryMagic = 0x435254534D465643ULL;
+  static const uint32_t kBinaryVersion = 1;
+  /**
+   * Codes of the binary format's internal records, no trace events
+   */
+  static const int32_t kRecordHeader = -100;
+  static const int32_t kRecordString = -101;
+
+  /**
+   * A trace event as read back from a binary trace file
+   */
+  struct Event {
+    Event() : time_ns(0), code(0) { }
+    Event(const uint64_t t, const int c, const std::string &p,
+          const std::string &m)
+      : time_ns(t), code(c), path(p), msg(m) { }
+    uint64_t time_ns;
+    int code;
+    std::string path;
+    std::string msg;
+  };
+
   Tracer();
   ~Tracer();
 
   void Activate(const int buffer_size, const int flush_threshold,
-                const std::string &trace_file);
+                const std::string &trace_file,
+                const Format format = kFormatCsv);
   void Spawn();
   void Flush();
   void inline __attribute__((used)) Trace(const int event,
@@ -59,6 +118,13 @@ class Tracer : SingleCopy {
     if (active_) DoTrace(event, path, msg);
   }
 
+  /**
+   * Writes the events of a binary trace file to fp in the csv format
+   */
+  static bool ConvertBinaryToCsv(const std::string &binary_path, FILE *fp);
+  static bool ReadBinaryTrace(const std::string &binary_path,
+                              std::vector<Event> *events);
+
  private:
   /**
    * Code of the first log line in the trace file.
@@ -72,15 +138,20 @@ class Tracer : SingleCopy {
    * Manual flush
    */
   static const int kEventFlush = -3;
+  /**
+   * Bounds the memory used by the interned strings of the binary format.  When
+   * reached, the ids are recycled.
+   */
+  static const unsigned kMaxInternedStrings = 1024 * 1024;
 
   /**
    * Contents of a single log line.
    */
   struct BufferEntry {
     /**
-     * This is currently with milliseconds precision (using gettimeofday).
+     * Nanoseconds since the epoch.  The csv format has microsecond precision.
      */
-    timeval time_stamp;
+    uint64_t time_ns;
     /**
      * arbitrary code, negative codes are reserved for internal use.
      */
@@ -91,7 +162,14 @@ class Tracer : SingleCopy {
 
   static void *MainFlush(void *data);
   void GetTimespecRel(const int64_t ms, timespec *ts);
-  int WriteCsvFile(FILE *fp, const std::string &field);
+  static int WriteCsvFile(FILE *fp, const std::string &field);
+  static int WriteCsvLine(FILE *fp, const uint64_t time_ns, const int code,
+                          const std::string &path, const std::string &msg);
+  static bool ReadBinary(const std::string &binary_path, FILE *fp,
+                         std::vector<Event> *events);
+  int WriteBinaryHeader(FILE *fp);
+  int WriteBinaryLine(FILE *fp, const BufferEntry &entry);
+  uint32_t InternString(FILE *fp, const std::string &str, int *retval);
   int32_t DoTrace(const int event,
                   const PathString &path,
                   const std::string &msg);
@@ -99,6 +177,11 @@ class Tracer : SingleCopy {
   bool active_;
   bool spawned_;
   std::string trace_file_;
+  Format format_;
+  /**
+   * Ids of the strings in the binary trace file, used by the flush thread
+   */
+  std::map<std::string, uint32_t> string_ids_;
   int buffer_size_;
   int flush_threshold_;
   BufferEntry *ring_buffer_;
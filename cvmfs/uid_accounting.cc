@@ -0,0 +1,144 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "uid_accounting.h"
+
+#include <cassert>
+
+#include "clientctx.h"
+#include "util/string.h"
+#include "util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+namespace cvmfs {
+
+const uid_t UidAccounting::kInternalUid = static_cast<uid_t>(-1);
+const uid_t UidAccounting::kOverflowUid = static_cast<uid_t>(-2);
+
+
+UidAccounting::UidAccounting() : num_uids_(0) {
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    int retval = pthread_mutex_init(&shards_[i].lock, NULL);
+    assert(retval == 0);
+  }
+  int retval = pthread_mutex_init(&lock_num_uids_, NULL);
+  assert(retval == 0);
+}
+
+
+UidAccounting::~UidAccounting() {
+  for (unsigned i = 0; i < kNumShards; ++i)
+    pthread_mutex_destroy(&shards_[i].lock);
+  pthread_mutex_destroy(&lock_num_uids_);
+}
+
+
+uid_t UidAccounting::GetCurrentUid() {
+  ClientCtx *ctx = ClientCtx::GetInstance();
+  if (!ctx->IsSet())
+    return kInternalUid;
+  uid_t uid;
+  gid_t gid;
+  pid_t pid;
+  ctx->Get(&uid, &gid, &pid);
+  return uid;
+}
+
+
+/**
+ * Needs to be called with the shard lock held.  Every shard has its own entry
+ * for the overflow uid, they are summed up in GetUsage().
+ */
+UidAccounting::Usage *UidAccounting::GetEntry(const uid_t uid, Shard *shard) {
+  map<uid_t, Usage>::iterator iter = shard->usage.find(uid);
+  if (iter != shard->usage.end())
+    return &iter->second;
+  if (uid != kInternalUid) {
+    MutexLockGuard guard(&lock_num_uids_);
+    if (num_uids_ >= kMaxUids)
+      return &shard->usage[kOverflowUid];
+    num_uids_++;
+  }
+  return &shard->usage[uid];
+}
+
+
+void UidAccounting::RecordHit() {
+  const uid_t uid = GetCurrentUid();
+  Shard *shard = &shards_[uid % kNumShards];
+  MutexLockGuard guard(&shard->lock);
+  GetEntry(uid, shard)->n_hits++;
+}
+
+
+void UidAccounting::RecordDownload(
+  const uint64_t size,
+  const uint64_t duration_us,
+  const bool success)
+{
+  const uid_t uid = GetCurrentUid();
+  Shard *shard = &shards_[uid % kNumShards];
+  MutexLockGuard guard(&shard->lock);
+  Usage *entry = GetEntry(uid, shard);
+  if (success) {
+    entry->n_downloads++;
+    entry->sz_downloaded += size;
+  } else {
+    entry->n_failures++;
+  }
+  entry->download_time_us += duration_us;
+}
+
+
+void UidAccounting::GetUsage(map<uid_t, Usage> *usage) const {
+  usage->clear();
+  for (unsigned i = 0; i < kNumShards; ++i) {
+    Shard *shard = const_cast<Shard *>(&shards_[i]);
+    MutexLockGuard guard(&shard->lock);
+    for (map<uid_t, Usage>::const_iterator j = shard->usage.begin(),
+         jEnd = shard->usage.end(); j != jEnd; ++j)
+    {
+      Usage *sum = &(*usage)[j->first];
+      sum->n_hits += j->second.n_hits;
+      sum->n_downloads += j->second.n_downloads;
+      sum->n_failures += j->second.n_failures;
+      sum->sz_downloaded += j->second.sz_downloaded;
+      sum->download_time_us += j->second.download_time_us;
+    }
+  }
+}
+
+
+/**
+ * One line per uid, used by cvmfs_talk.
+ */
+string UidAccounting::Print() const {
+  map<uid_t, Usage> usage;
+  GetUsage(&usage);
+  string result =
+    "uid | cache hits | downloads | failed downloads | downloaded bytes | "
+    "download time (ms)\n";
+  for (map<uid_t, Usage>::const_iterator i = usage.begin(),
+       iEnd = usage.end(); i != iEnd; ++i)
+  {
+    string uid;
+    if (i->first == kInternalUid)
+      uid = "internal";
+    else if (i->first == kOverflowUid)
+      uid = "other";
+    else
+      uid = StringifyInt(i->first);
+    result += uid + " | " +
+              StringifyInt(i->second.n_hits) + " | " +
+              StringifyInt(i->second.n_downloads) + " | " +
+              StringifyInt(i->second.n_failures) + " | " +
+              StringifyInt(i->second.sz_downloaded) + " | " +
+              StringifyInt(i->second.download_time_us / 1000) + "\n";
+  }
+  return result;
+}
+
+}  // namespace cvmfs
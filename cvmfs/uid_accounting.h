@@ -0,0 +1,78 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_UID_ACCOUNTING_H_
+#define CVMFS_UID_ACCOUNTING_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+
+#include "gtest/gtest_prod.h"
+#include "util/single_copy.h"
+
+namespace cvmfs {
+
+/**
+ * Accounts the objects served by the Fetcher to the uid of the requesting
+ * process, as recorded in the ClientCtx.  Requests without a client context,
+ * e.g. catalog updates in the background, are accounted to kInternalUid.
+ *
+ * Recording a cache hit is on the hot path, so the table is sharded by uid.
+ * The number of distinct uids is bounded; beyond kMaxUids, new uids are
+ * accounted to kOverflowUid.
+ */
+class UidAccounting : SingleCopy {
+  FRIEND_TEST(T_UidAccounting, Overflow);
+
+ public:
+  static const uid_t kInternalUid;
+  static const uid_t kOverflowUid;
+  static const unsigned kMaxUids = 1024;
+
+  struct Usage {
+    Usage() : n_hits(0), n_downloads(0), n_failures(0), sz_downloaded(0),
+              download_time_us(0) { }
+    uint64_t n_hits;
+    uint64_t n_downloads;  ///< cache misses that were downloaded
+    uint64_t n_failures;  ///< cache misses that failed to download
+    uint64_t sz_downloaded;  ///< bytes of the downloaded objects
+    uint64_t download_time_us;
+  };
+
+  UidAccounting();
+  ~UidAccounting();
+
+  void RecordHit();
+  void RecordDownload(const uint64_t size, const uint64_t duration_us,
+                      const bool success);
+
+  void GetUsage(std::map<uid_t, Usage> *usage) const;
+  std::string Print() const;
+
+ private:
+  static const unsigned kNumShards = 16;
+
+  struct Shard {
+    pthread_mutex_t lock;
+    std::map<uid_t, Usage> usage;
+  };
+
+  static uid_t GetCurrentUid();
+  Usage *GetEntry(const uid_t uid, Shard *shard);
+
+  Shard shards_[kNumShards];
+  /**
+   * Number of distinct uids over all the shards, protected by lock_num_uids_
+   */
+  unsigned num_uids_;
+  pthread_mutex_t lock_num_uids_;
+};
+
+}  // namespace cvmfs
+
+#endif  // CVMFS_UID_ACCOUNTING_H_
@@ -51,8 +51,10 @@ bool Spooler::Initialize() {
 }
 
 void Spooler::Process(const std::string &local_path,
-                      const bool allow_chunking) {
-  file_processor_->Process(local_path, allow_chunking);
+                      const bool allow_chunking,
+                      const std::string &repository_path) {
+  file_processor_->Process(local_path, allow_chunking, shash::kSuffixNone,
+                           repository_path);
 }
 
 void Spooler::ProcessCatalog(const std::string &local_path) {
@@ -71,6 +73,10 @@ void Spooler::ProcessMetainfo(const std::string &local_path) {
   file_processor_->Process(local_path, false, shash::kSuffixMetainfo);
 }
 
+void Spooler::ProcessTagIndex(const std::string &local_path) {
+  file_processor_->Process(local_path, false, shash::kSuffixTagIndex);
+}
+
 void Spooler::Upload(const std::string &local_path,
                      const std::string &remote_path) {
   uploader_->Upload(
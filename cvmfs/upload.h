@@ -193,8 +193,11 @@ class Spooler : public Observable<SpoolerResult> {
    *                        loaded into the backend storage
    * @param allow_chunking  (optional) controls if this file should be cut in
    *                        chunks or uploaded at once
+   * @param repository_path (optional) the path of the file in the repository
+   *                        that selects the rules of the processing policy
    */
-  void Process(const std::string &local_path, const bool allow_chunking = true);
+  void Process(const std::string &local_path, const bool allow_chunking = true,
+               const std::string &repository_path = "");
 
   /**
    * Convenience wrapper to process a catalog file. Please always use this
@@ -227,6 +230,14 @@ class Spooler : public Observable<SpoolerResult> {
    */
   void ProcessMetainfo(const std::string &local_path);
 
+  /**
+   * Convenience wrapper to process the tag index of a history database (see
+   * history::TagIndex).
+   *
+   * @param local_path  the location of the tag index file
+   */
+  void ProcessTagIndex(const std::string &local_path);
+
   /**
    * Deletes the given file from the repository backend storage. This is done
    * synchronous, in any case.
@@ -273,6 +284,31 @@ class Spooler : public Observable<SpoolerResult> {
    */
   unsigned int GetNumberOfErrors() const;
 
+  /**
+   * See AbstractUploader::SetExistenceIndex().  Takes ownership of the filter.
+   */
+  void SetExistenceIndex(BloomFilter *existence_index) {
+    uploader_->SetExistenceIndex(existence_index);
+  }
+  int64_t GetNumberOfSkippedUploads() const {
+    return uploader_->num_skipped_uploads();
+  }
+  int64_t GetNumberOfSkippedBytes() const {
+    return uploader_->num_skipped_bytes();
+  }
+  int64_t GetNumberOfChunkedFiles() const {
+    return file_processor_->num_chunked_files();
+  }
+  const perf::Histogram &GetChunkSizes() const {
+    return file_processor_->chunk_sizes();
+  }
+  int64_t GetNumberOfIncompressibleFiles() const {
+    return file_processor_->num_incompressible_files();
+  }
+  const ProcessingPolicy *GetProcessingPolicy() const {
+    return spooler_definition_.processing_policy;
+  }
+
   shash::Algorithms GetHashAlgorithm() const {
     return spooler_definition_.hash_algorithm;
   }
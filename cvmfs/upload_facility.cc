@@ -5,7 +5,9 @@
 #include "upload_facility.h"
 
 #include <cassert>
+#include <cstring>
 
+#include "file_processing/char_buffer.h"
 #include "upload_gateway.h"
 #include "upload_local.h"
 #include "upload_s3.h"
@@ -20,8 +22,11 @@ void AbstractUploader::RegisterPlugins() {
 
 AbstractUploader::AbstractUploader(const SpoolerDefinition &spooler_definition)
     : spooler_definition_(spooler_definition),
+      upload_queue_(spooler_definition.number_of_concurrent_uploads + 1),
       torn_down_(false),
-      jobs_in_flight_(spooler_definition.number_of_concurrent_uploads) {}
+      jobs_in_flight_(spooler_definition.number_of_concurrent_uploads),
+      num_skipped_uploads_(0),
+      num_skipped_bytes_(0) {}
 
 bool AbstractUploader::Initialize() {
   // late initialization of the writer_thread_ field. This is necessary, since
@@ -83,10 +88,21 @@ AbstractUploader::JobStatus::State AbstractUploader::DispatchJob(
     const UploadJob &job) {
   switch (job.type) {
     case UploadJob::Upload:
+      job.stream_handle->bytes_streamed += job.buffer->used_bytes();
       StreamedUpload(job.stream_handle, job.buffer, job.callback);
       return JobStatus::kOk;
 
     case UploadJob::Commit:
+      if (IsKnownObject(job.content_hash)) {
+        const CallbackTN *callback = job.stream_handle->commit_callback;
+        const uint64_t size = job.stream_handle->bytes_streamed;
+        if (DiscardStreamedUpload(job.stream_handle)) {
+          atomic_inc64(&num_skipped_uploads_);
+          atomic_xadd64(&num_skipped_bytes_, size);
+          Respond(callback, UploaderResults(0));
+          return JobStatus::kOk;
+        }
+      }
       FinalizeStreamedUpload(job.stream_handle, job.content_hash);
       return JobStatus::kOk;
 
@@ -102,11 +118,53 @@ AbstractUploader::JobStatus::State AbstractUploader::DispatchJob(
 
 void AbstractUploader::TearDown() {
   assert(!torn_down_);
-  upload_queue_.push(UploadJob());  // Termination signal
+  upload_queue_.Push(UploadJob());  // Termination signal
   writer_thread_.join();
   torn_down_ = true;
 }
 
 void AbstractUploader::WaitForUpload() const { jobs_in_flight_.WaitForZero(); }
 
+void AbstractUploader::SetExistenceIndex(BloomFilter *existence_index) {
+  existence_index_ = existence_index;
+}
+
+/**
+ * Content hashes are uniformly distributed, so the filter probes are taken
+ * from the digest.  The suffix is mixed in to tell apart, e.g., a catalog and
+ * a data object with the same content.
+ */
+void AbstractUploader::ExistenceIndexKey(
+  const shash::Any &hash,
+  uint64_t *h1,
+  uint64_t *h2)
+{
+  memcpy(h1, hash.digest, sizeof(*h1));
+  memcpy(h2, hash.digest + sizeof(*h1), sizeof(*h2));
+  *h2 ^= static_cast<unsigned char>(hash.suffix);
+}
+
+/**
+ * Objects in the existence index are confirmed by the backend storage.
+ */
+bool AbstractUploader::IsKnownObject(const shash::Any &content_hash) const {
+  if (!existence_index_.IsValid())
+    return false;
+  uint64_t h1, h2;
+  ExistenceIndexKey(content_hash, &h1, &h2);
+  if (!existence_index_->MayContain(h1, h2))
+    return false;
+  return Peek("data/" + content_hash.MakePath());
+}
+
+bool AbstractUploader::RemoveBatch(
+  const std::vector<shash::Any> &hashes_to_delete,
+  const unsigned /* concurrency */)
+{
+  bool result = true;
+  for (unsigned i = 0; i < hashes_to_delete.size(); ++i)
+    result = Remove(hashes_to_delete[i]) && result;
+  return result;
+}
+
 }  // namespace upload
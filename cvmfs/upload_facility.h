@@ -5,15 +5,19 @@
 #ifndef CVMFS_UPLOAD_FACILITY_H_
 #define CVMFS_UPLOAD_FACILITY_H_
 
-#include <tbb/concurrent_queue.h>
 #include <tbb/tbb_thread.h>
 
 #include <fcntl.h>
 
 #include <string>
+#include <vector>
 
+#include "atomic.h"
+#include "bloom_filter.h"
 #include "upload_spooler_definition.h"
+#include "util/pointer.h"
 #include "util/posix.h"
+#include "util/ring_queue.h"
 #include "util_concurrency.h"
 
 namespace upload {
@@ -189,7 +193,7 @@ class AbstractUploader
   void ScheduleUpload(UploadStreamHandle *handle, CharBuffer *buffer,
                       const CallbackTN *callback = NULL) {
     ++jobs_in_flight_;
-    upload_queue_.push(UploadJob(handle, buffer, callback));
+    upload_queue_.Push(UploadJob(handle, buffer, callback));
   }
 
   /**
@@ -206,7 +210,7 @@ class AbstractUploader
   void ScheduleCommit(UploadStreamHandle *handle,
                       const shash::Any &content_hash) {
     ++jobs_in_flight_;
-    upload_queue_.push(UploadJob(handle, content_hash));
+    upload_queue_.Push(UploadJob(handle, content_hash));
   }
 
   /**
@@ -235,6 +239,19 @@ class AbstractUploader
     return Remove("data/" + hash_to_delete.MakePath());
   }
 
+  /**
+   * Removes many objects at once, e.g. during garbage collection.  Backends
+   * can use bulk requests or parallel removals.  The default implementation
+   * removes the objects one by one.
+   *
+   * @param hashes_to_delete  the content hashes of the objects to be deleted
+   * @param concurrency       the maximum number of removals in flight
+   * @return                  true if all the objects are removed (as in
+   *                          Remove(), non-existing objects count as removed)
+   */
+  virtual bool RemoveBatch(const std::vector<shash::Any> &hashes_to_delete,
+                           const unsigned concurrency);
+
   /**
    * Checks if a file is already present in the backend storage. This might be a
    * synchronous operation.
@@ -266,6 +283,25 @@ class AbstractUploader
   virtual unsigned int GetNumberOfErrors() const = 0;
   static void RegisterPlugins();
 
+  /**
+   * Lets streamed uploads of objects that already exist in the backend storage
+   * be skipped.  The filter contains the content hashes that are likely to
+   * exist, e.g. those of the previous revision (see ExistenceIndexKey()).
+   * Before skipping an upload, the object is confirmed with Peek(), so false
+   * positives cost a lookup but never lose an object.  Takes ownership of the
+   * filter.  Must be set before the first upload.
+   */
+  void SetExistenceIndex(BloomFilter *existence_index);
+  static void ExistenceIndexKey(const shash::Any &hash,
+                                uint64_t *h1, uint64_t *h2);
+
+  int64_t num_skipped_uploads() const {
+    return atomic_read64(&num_skipped_uploads_);
+  }
+  int64_t num_skipped_bytes() const {
+    return atomic_read64(&num_skipped_bytes_);
+  }
+
  protected:
   explicit AbstractUploader(const SpoolerDefinition &spooler_definition);
 
@@ -302,6 +338,16 @@ class AbstractUploader
   virtual void FinalizeStreamedUpload(UploadStreamHandle *handle,
                                       const shash::Any &content_hash) = 0;
 
+  /**
+   * Drops a streamed upload instead of committing it, because the object
+   * already exists.  Frees the handle but does not respond to its commit
+   * callback.  Returns false, without any side effects, if the upload cannot
+   * be dropped anymore; the default implementation never drops uploads.
+   */
+  virtual bool DiscardStreamedUpload(UploadStreamHandle *handle) {
+    return false;
+  }
+
   /**
    * This notifies the callback that is associated to a finishing job. Please
    * do not call the handed callback yourself in concrete Uploaders!
@@ -321,6 +367,12 @@ class AbstractUploader
     --jobs_in_flight_;
   }
 
+  /**
+   * Accounts for a job that a concrete uploader starts by itself, i.e. not
+   * through the job queue, and finishes with Respond()
+   */
+  void IncJobsInFlight() { ++jobs_in_flight_; }
+
   /**
    * Performs a job from the job queue.
    *
@@ -333,7 +385,7 @@ class AbstractUploader
    */
   JobStatus::State PerformJob() {
     UploadJob job;
-    upload_queue_.pop(job);
+    upload_queue_.Pop(&job);
     return DispatchJob(job);
   }
 
@@ -348,7 +400,7 @@ class AbstractUploader
    */
   JobStatus::State TryToPerformJob() {
     UploadJob job;
-    const bool got_job = upload_queue_.try_pop(job);
+    const bool got_job = upload_queue_.TryPop(&job);
     return (got_job) ? DispatchJob(job) : JobStatus::kNoJobs;
   }
 
@@ -385,15 +437,24 @@ class AbstractUploader
 
  private:
   JobStatus::State DispatchJob(const UploadJob &job);
+  bool IsKnownObject(const shash::Any &content_hash) const;
 
  private:
   const SpoolerDefinition spooler_definition_;
-  tbb::concurrent_bounded_queue<UploadJob> upload_queue_;
+  /**
+   * Holds at most one job per job in flight plus the termination signal, so
+   * pushing never blocks; the backpressure comes from jobs_in_flight_.
+   */
+  RingQueue<UploadJob> upload_queue_;
   tbb::tbb_thread writer_thread_;
   bool torn_down_;
 
   mutable SynchronizingCounter<int32_t> jobs_in_flight_;
   Future<bool> thread_started_executing_;
+
+  UniquePtr<BloomFilter> existence_index_;
+  mutable atomic_int64 num_skipped_uploads_;
+  mutable atomic_int64 num_skipped_bytes_;
 };
 
 /**
@@ -407,10 +468,14 @@ struct UploadStreamHandle {
   typedef AbstractUploader::CallbackTN CallbackTN;
 
   explicit UploadStreamHandle(const CallbackTN *commit_callback)
-      : commit_callback(commit_callback) {}
+      : commit_callback(commit_callback), bytes_streamed(0) {}
   virtual ~UploadStreamHandle() {}
 
   const CallbackTN *commit_callback;
+  /**
+   * Maintained by the AbstractUploader, counts the scheduled data
+   */
+  uint64_t bytes_streamed;
 };
 
 }  // namespace upload
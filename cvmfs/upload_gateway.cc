@@ -93,8 +93,9 @@ bool GatewayUploader::Initialize() {
     return false;
   }
 
-  return session_context_->Initialize(config_.api_url, session_token, key_id,
-                                      secret);
+  return session_context_->Initialize(
+      config_.api_url, session_token, key_id, secret,
+      ObjectPack::kDefaultLimit, SessionContext::kDefaultMaxPacksInFlight);
 }
 
 bool GatewayUploader::FinalizeSession(bool commit,
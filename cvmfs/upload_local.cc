@@ -6,13 +6,18 @@
 #include "cvmfs_config.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <string>
+#include <vector>
 
 #include "compression.h"
 #include "file_processing/char_buffer.h"
 #include "logging.h"
 #include "platform.h"
+#include "util/executor.h"
 #include "util/posix.h"
 
 namespace upload {
@@ -21,11 +26,22 @@ LocalUploader::LocalUploader(const SpoolerDefinition &spooler_definition)
     : AbstractUploader(spooler_definition),
       backend_file_mode_(default_backend_file_mode_ ^ GetUmask()),
       upstream_path_(spooler_definition.spooler_configuration),
-      temporary_path_(spooler_definition.temporary_path) {
+      temporary_path_(spooler_definition.temporary_path),
+      sync_mode_(spooler_definition.local_sync_mode) {
   assert(spooler_definition.IsValid() &&
          spooler_definition.driver_type == SpoolerDefinition::Local);
 
   atomic_init32(&copy_errors_);
+  int retval = pthread_mutex_init(&lock_writer_responses_, NULL);
+  assert(retval == 0);
+  if (spooler_definition.number_of_local_writers > 1)
+    writers_ = new Executor(spooler_definition.number_of_local_writers);
+}
+
+LocalUploader::~LocalUploader() {
+  // Pending writer tasks still use the uploader
+  writers_.Destroy();
+  pthread_mutex_destroy(&lock_writer_responses_);
 }
 
 bool LocalUploader::WillHandle(const SpoolerDefinition &spooler_definition) {
@@ -36,9 +52,83 @@ unsigned int LocalUploader::GetNumberOfErrors() const {
   return atomic_read32(&copy_errors_);
 }
 
+/**
+ * Copies an uploaded file into the storage on one of the writer threads
+ */
+class LocalUploader::FileUploadTask : public Executor::Task {
+ public:
+  FileUploadTask(LocalUploader *uploader,
+                 const std::string &local_path,
+                 const std::string &remote_path,
+                 const CallbackTN *callback)
+    : uploader_(uploader)
+    , local_path_(local_path)
+    , remote_path_(remote_path)
+    , callback_(callback)
+  { }
+
+  virtual void Run() {
+    uploader_->DoFileUpload(local_path_, remote_path_, callback_);
+  }
+
+ private:
+  LocalUploader *uploader_;
+  std::string local_path_;
+  std::string remote_path_;
+  const CallbackTN *callback_;
+};
+
+/**
+ * Moves a committed stream into the storage on one of the writer threads
+ */
+class LocalUploader::CommitTask : public Executor::Task {
+ public:
+  CommitTask(LocalUploader *uploader,
+             LocalStreamHandle *handle,
+             const shash::Any &content_hash)
+    : uploader_(uploader)
+    , handle_(handle)
+    , content_hash_(content_hash)
+  { }
+
+  virtual void Run() {
+    uploader_->DoFinalizeStreamedUpload(handle_, content_hash_);
+  }
+
+ private:
+  LocalUploader *uploader_;
+  LocalStreamHandle *handle_;
+  shash::Any content_hash_;
+};
+
+/**
+ * The listeners, e.g. the sync mediator, expect the results of committed
+ * objects from a single thread at a time.
+ */
+void LocalUploader::RespondFromWriter(const CallbackTN *callback,
+                                      const UploaderResults &result) {
+  if (!writers_.IsValid()) {
+    Respond(callback, result);
+    return;
+  }
+  MutexLockGuard guard(lock_writer_responses_);
+  Respond(callback, result);
+}
+
 void LocalUploader::FileUpload(const std::string &local_path,
                                const std::string &remote_path,
                                const CallbackTN *callback) {
+  if (writers_.IsValid()) {
+    writers_->Submit(
+      new FileUploadTask(this, local_path, remote_path, callback));
+    return;
+  }
+  DoFileUpload(local_path, remote_path, callback);
+}
+
+void LocalUploader::DoFileUpload(const std::string &local_path,
+                                 const std::string &remote_path,
+                                 const CallbackTN *callback) {
   LogCvmfs(kLogSpooler, kLogVerboseMsg, "FileUpload call started.");
 
   // create destination in backend storage temporary directory
@@ -49,7 +139,7 @@ void LocalUploader::FileUpload(const std::string &local_path,
              "upload of file '%s' (errno: %d)",
              local_path.c_str(), errno);
     atomic_inc32(&copy_errors_);
-    Respond(callback, UploaderResults(1, local_path));
+    RespondFromWriter(callback, UploaderResults(1, local_path));
     return;
   }
 
@@ -62,7 +152,16 @@ void LocalUploader::FileUpload(const std::string &local_path,
              "area: '%s'",
              local_path.c_str(), tmp_path.c_str());
     atomic_inc32(&copy_errors_);
-    Respond(callback, UploaderResults(retcode, local_path));
+    RespondFromWriter(callback, UploaderResults(retcode, local_path));
+    return;
+  }
+  if ((sync_mode_ == SpoolerDefinition::kLocalSyncFile) &&
+      !SyncFile(tmp_path))
+  {
+    const int sync_errno = errno;
+    atomic_inc32(&copy_errors_);
+    unlink(tmp_path.c_str());
+    RespondFromWriter(callback, UploaderResults(sync_errno, local_path));
     return;
   }
 
@@ -75,10 +174,10 @@ void LocalUploader::FileUpload(const std::string &local_path,
              "'%s'",
              tmp_path.c_str(), remote_path.c_str());
     atomic_inc32(&copy_errors_);
-    Respond(callback, UploaderResults(retcode, local_path));
+    RespondFromWriter(callback, UploaderResults(retcode, local_path));
     return;
   }
-  Respond(callback, UploaderResults(retcode, local_path));
+  RespondFromWriter(callback, UploaderResults(retcode, local_path));
 }
 
 UploadStreamHandle *LocalUploader::InitStreamedUpload(
@@ -134,8 +233,30 @@ void LocalUploader::StreamedUpload(UploadStreamHandle *handle,
 
 void LocalUploader::FinalizeStreamedUpload(UploadStreamHandle *handle,
                                            const shash::Any &content_hash) {
-  int retval = 0;
   LocalStreamHandle *local_handle = static_cast<LocalStreamHandle *>(handle);
+  if (writers_.IsValid()) {
+    writers_->Submit(new CommitTask(this, local_handle, content_hash));
+    return;
+  }
+  DoFinalizeStreamedUpload(local_handle, content_hash);
+}
+
+void LocalUploader::DoFinalizeStreamedUpload(LocalStreamHandle *local_handle,
+                                             const shash::Any &content_hash) {
+  int retval = 0;
+  if (sync_mode_ == SpoolerDefinition::kLocalSyncFile) {
+    retval = fsync(local_handle->file_descriptor);
+    if (retval != 0) {
+      const int cpy_errno = errno;
+      LogCvmfs(kLogSpooler, kLogVerboseMsg,
+               "failed to sync temp file '%s' (errno: %d)",
+               local_handle->temporary_path.c_str(), cpy_errno);
+      atomic_inc32(&copy_errors_);
+      RespondFromWriter(local_handle->commit_callback,
+                        UploaderResults(cpy_errno));
+      return;
+    }
+  }
 
   retval = close(local_handle->file_descriptor);
   if (retval != 0) {
@@ -145,7 +266,8 @@ void LocalUploader::FinalizeStreamedUpload(UploadStreamHandle *handle,
              "(errno: %d)",
              local_handle->temporary_path.c_str(), cpy_errno);
     atomic_inc32(&copy_errors_);
-    Respond(handle->commit_callback, UploaderResults(cpy_errno));
+    RespondFromWriter(local_handle->commit_callback,
+                      UploaderResults(cpy_errno));
     return;
   }
 
@@ -160,7 +282,8 @@ void LocalUploader::FinalizeStreamedUpload(UploadStreamHandle *handle,
                local_handle->temporary_path.c_str(), final_path.c_str(),
                cpy_errno);
       atomic_inc32(&copy_errors_);
-      Respond(handle->commit_callback, UploaderResults(cpy_errno));
+      RespondFromWriter(local_handle->commit_callback,
+                        UploaderResults(cpy_errno));
       return;
     }
   } else {
@@ -173,10 +296,43 @@ void LocalUploader::FinalizeStreamedUpload(UploadStreamHandle *handle,
     }
   }
 
-  const CallbackTN *callback = handle->commit_callback;
+  const CallbackTN *callback = local_handle->commit_callback;
   delete local_handle;
 
-  Respond(callback, UploaderResults(0));
+  RespondFromWriter(callback, UploaderResults(0));
+}
+
+bool LocalUploader::DiscardStreamedUpload(UploadStreamHandle *handle) {
+  LocalStreamHandle *local_handle = static_cast<LocalStreamHandle *>(handle);
+  close(local_handle->file_descriptor);
+  unlink(local_handle->temporary_path.c_str());
+  delete local_handle;
+  return true;
+}
+
+bool LocalUploader::FinalizeSession(bool /*commit*/,
+                                    const std::string & /*old_root_hash*/,
+                                    const std::string & /*new_root_hash*/) {
+  if (sync_mode_ != SpoolerDefinition::kLocalSyncSession)
+    return true;
+
+  const int fd = open(upstream_path_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LogCvmfs(kLogSpooler, kLogStderr, "failed to open %s (errno: %d)",
+             upstream_path_.c_str(), errno);
+    atomic_inc32(&copy_errors_);
+    return false;
+  }
+  const int retval = platform_syncfs(fd);
+  const int sync_errno = errno;
+  close(fd);
+  if (retval != 0) {
+    LogCvmfs(kLogSpooler, kLogStderr, "failed to sync %s (errno: %d)",
+             upstream_path_.c_str(), sync_errno);
+    atomic_inc32(&copy_errors_);
+    return false;
+  }
+  return true;
 }
 
 bool LocalUploader::Remove(const std::string &file_to_delete) {
@@ -184,6 +340,73 @@ bool LocalUploader::Remove(const std::string &file_to_delete) {
   return retval == 0 || errno == ENOENT;
 }
 
+/**
+ * Removes the objects [begin, end) of a batch
+ */
+class LocalUploader::RemoveSliceTask : public Executor::Task {
+ public:
+  RemoveSliceTask(LocalUploader *uploader,
+                  const std::vector<shash::Any> *hashes,
+                  const size_t begin,
+                  const size_t end,
+                  atomic_int32 *num_errors)
+    : uploader_(uploader)
+    , hashes_(hashes)
+    , begin_(begin)
+    , end_(end)
+    , num_errors_(num_errors)
+  { }
+
+  virtual void Run() {
+    for (size_t i = begin_; i < end_; ++i) {
+      if (!uploader_->Remove("data/" + (*hashes_)[i].MakePath()))
+        atomic_inc32(num_errors_);
+    }
+  }
+
+ private:
+  LocalUploader *uploader_;
+  const std::vector<shash::Any> *hashes_;
+  size_t begin_;
+  size_t end_;
+  atomic_int32 *num_errors_;
+};
+
+bool LocalUploader::RemoveBatch(
+  const std::vector<shash::Any> &hashes_to_delete,
+  const unsigned concurrency)
+{
+  atomic_int32 num_errors;
+  atomic_init32(&num_errors);
+  const size_t num_slices =
+    (hashes_to_delete.size() + kRemoveSliceSize - 1) / kRemoveSliceSize;
+  const size_t num_threads =
+    std::min(static_cast<size_t>(std::max(concurrency, 1U)), num_slices);
+  if (num_threads == 0)
+    return true;
+
+  // Small slices balance the load if some unlinks are slow
+  std::vector<Executor::Task *> tasks;
+  for (size_t i = 0; i < num_slices; ++i) {
+    tasks.push_back(new RemoveSliceTask(
+      this, &hashes_to_delete, i * kRemoveSliceSize,
+      std::min((i + 1) * kRemoveSliceSize, hashes_to_delete.size()),
+      &num_errors));
+  }
+  if (num_threads == 1) {
+    for (size_t i = 0; i < num_slices; ++i) {
+      tasks[i]->Run();
+      delete tasks[i];
+    }
+  } else {
+    Executor executor(num_threads, num_slices);
+    executor.SubmitBatch(tasks);
+    executor.Wait();
+  }
+
+  return atomic_read32(&num_errors) == 0;
+}
+
 bool LocalUploader::Peek(const std::string &path) const {
   return FileExists(upstream_path_ + "/" + path);
 }
@@ -194,6 +417,25 @@ bool LocalUploader::PlaceBootstrappingShortcut(const shash::Any &object) const {
   return SymlinkForced(src, dest);
 }
 
+bool LocalUploader::SyncFile(const std::string &path) const {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LogCvmfs(kLogSpooler, kLogVerboseMsg, "failed to open '%s' (errno: %d)",
+             path.c_str(), errno);
+    return false;
+  }
+  const int retval = fsync(fd);
+  const int sync_errno = errno;
+  close(fd);
+  if (retval != 0) {
+    LogCvmfs(kLogSpooler, kLogVerboseMsg, "failed to sync '%s' (errno: %d)",
+             path.c_str(), sync_errno);
+    errno = sync_errno;
+    return false;
+  }
+  return true;
+}
+
 int LocalUploader::Move(const std::string &local_path,
                         const std::string &remote_path) const {
   const std::string destination_path = upstream_path_ + "/" + remote_path;
@@ -5,12 +5,16 @@
 #ifndef CVMFS_UPLOAD_LOCAL_H_
 #define CVMFS_UPLOAD_LOCAL_H_
 
+#include <pthread.h>
 #include <sys/stat.h>
 
 #include <string>
+#include <vector>
 
 #include "atomic.h"
 #include "upload_facility.h"
+#include "util/executor.h"
+#include "util/pointer.h"
 #include "util_concurrency.h"
 
 namespace upload {
@@ -31,6 +35,10 @@ struct LocalStreamHandle : public UploadStreamHandle {
  * into a local CVMFS repository backend.
  * For a detailed description of the classes interface please have a look into
  * the AbstractSpooler base class.
+ *
+ * With more than one local writer, uploaded files and committed streams are
+ * moved into the storage concurrently by a pool of writer threads.  Stream
+ * buffers are still written in order by the uploader thread.
  */
 class LocalUploader : public AbstractUploader {
  private:
@@ -39,6 +47,7 @@ class LocalUploader : public AbstractUploader {
 
  public:
   explicit LocalUploader(const SpoolerDefinition &spooler_definition);
+  virtual ~LocalUploader();
   static bool WillHandle(const SpoolerDefinition &spooler_definition);
 
   virtual std::string name() const { return "Local"; }
@@ -58,8 +67,21 @@ class LocalUploader : public AbstractUploader {
                       const CallbackTN *callback = NULL);
   void FinalizeStreamedUpload(UploadStreamHandle *handle,
                               const shash::Any &content_hash);
+  bool DiscardStreamedUpload(UploadStreamHandle *handle);
+
+  /**
+   * Flushes the storage if the session sync mode is used
+   */
+  bool FinalizeSession(bool commit, const std::string &old_root_hash,
+                       const std::string &new_root_hash);
 
   bool Remove(const std::string &file_to_delete);
+  /**
+   * Unlinks the batch in slices of kRemoveSliceSize objects on up to
+   * concurrency threads
+   */
+  bool RemoveBatch(const std::vector<shash::Any> &hashes_to_delete,
+                   const unsigned concurrency);
 
   bool Peek(const std::string &path) const;
 
@@ -75,11 +97,32 @@ class LocalUploader : public AbstractUploader {
   int Move(const std::string &local_path, const std::string &remote_path) const;
 
  private:
+  static const size_t kRemoveSliceSize = 64;
+
+  class RemoveSliceTask;
+  class FileUploadTask;
+  class CommitTask;
+
+  void DoFileUpload(const std::string &local_path,
+                    const std::string &remote_path,
+                    const CallbackTN *callback);
+  void DoFinalizeStreamedUpload(LocalStreamHandle *local_handle,
+                                const shash::Any &content_hash);
+  bool SyncFile(const std::string &path) const;
+  void RespondFromWriter(const CallbackTN *callback,
+                         const UploaderResults &result);
+
   // state information
   const std::string upstream_path_;
   const std::string temporary_path_;
   mutable atomic_int32 copy_errors_;  //!< counts the number of occured
                                       //!< errors in Upload()
+  const SpoolerDefinition::LocalSyncMode sync_mode_;
+  /**
+   * NULL if objects are moved into the storage by the uploader thread
+   */
+  UniquePtr<Executor> writers_;
+  pthread_mutex_t lock_writer_responses_;
 };
 
 }  // namespace upload
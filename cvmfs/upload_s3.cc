@@ -12,6 +12,9 @@
 #endif
 #include <unistd.h>
 
+#include <algorithm>
+#include <ctime>
+#include <map>
 #include <sstream>  // TODO(jblomer): remove me
 #include <string>
 #include <vector>
@@ -21,13 +24,22 @@
 #include "logging.h"
 #include "options.h"
 #include "s3fanout.h"
+#include "smalloc.h"
 #include "util/posix.h"
 #include "util/string.h"
 
 namespace upload {
 
+const unsigned S3Uploader::kDefaultPartSizeMb;
+const unsigned S3Uploader::kDefaultParallelParts;
+const unsigned S3Uploader::kMaxParts;
+const unsigned S3Uploader::kMaxKeysPerDelete;
+
 S3Uploader::S3Uploader(const SpoolerDefinition &spooler_definition)
     : AbstractUploader(spooler_definition),
+      part_size_(0),
+      parallel_parts_(kDefaultParallelParts),
+      num_multipart_uploads_(0),
       temporary_path_(spooler_definition.temporary_path) {
   if (!ParseSpoolerDefinition(spooler_definition)) {
     abort();
@@ -126,6 +138,18 @@ bool S3Uploader::ParseSpoolerDefinition(
     return false;
   }
   max_num_parallel_uploads_ = String2Uint64(parameter);
+  part_size_ = static_cast<size_t>(kDefaultPartSizeMb) * 1024 * 1024;
+  if (options_manager->GetValue("CVMFS_S3_PART_SIZE", &parameter))
+    part_size_ = String2Uint64(parameter) * 1024 * 1024;
+  if (options_manager->GetValue("CVMFS_S3_PARALLEL_PARTS", &parameter)) {
+    parallel_parts_ = String2Uint64(parameter);
+    if (parallel_parts_ < 1) {
+      LogCvmfs(kLogUploadS3, kLogStderr,
+               "Fail, invalid CVMFS_S3_PARALLEL_PARTS given: '%s'.",
+               parameter.c_str());
+      return false;
+    }
+  }
   delete options_manager;
   options_manager = NULL;
 
@@ -176,33 +200,7 @@ void S3Uploader::WorkerThread() {
     // Try to perform a new job
     running = TryToPerformJob() != JobStatus::kTerminate;
 
-    // Get and report completed jobs
-    std::vector<s3fanout::JobInfo *> jobs;
-    jobs.clear();
-    s3fanout_mgr_.PopCompletedJobs(&jobs);
-    std::vector<s3fanout::JobInfo*>::iterator             it    = jobs.begin();
-    const std::vector<s3fanout::JobInfo*>::const_iterator itend = jobs.end();
-    for (; it != itend; ++it) {
-      // Report completed job
-      s3fanout::JobInfo *info = *it;
-      int reply_code = 0;
-      if (info->error_code != s3fanout::kFailOk) {
-        LogCvmfs(kLogUploadS3, kLogStderr, "Upload job for '%s' failed. "
-                                           "(error code: %d - %s)",
-                 info->object_key.c_str(), info->error_code,
-                 s3fanout::Code2Ascii(info->error_code));
-        reply_code = 99;
-      }
-      if (info->origin == s3fanout::kOriginMem) {
-        Respond(static_cast<CallbackTN*>(info->callback),
-                UploaderResults(reply_code));
-      } else {
-        Respond(static_cast<CallbackTN*>(info->callback),
-                UploaderResults(reply_code, info->origin_path));
-      }
-      assert(info->mmf == NULL);
-      assert(info->origin_file == NULL);
-    }
+    ReportCompletedJobs();
 #ifdef _POSIX_PRIORITY_SCHEDULING
     sched_yield();
 #endif
@@ -212,6 +210,44 @@ void S3Uploader::WorkerThread() {
 }
 
 
+/**
+ * Gets and reports completed jobs.  Only called from the worker thread.
+ */
+void S3Uploader::ReportCompletedJobs() {
+  std::vector<s3fanout::JobInfo *> jobs;
+  s3fanout_mgr_.PopCompletedJobs(&jobs);
+  std::vector<s3fanout::JobInfo*>::iterator             it    = jobs.begin();
+  const std::vector<s3fanout::JobInfo*>::const_iterator itend = jobs.end();
+  for (; it != itend; ++it) {
+    // Report completed job
+    s3fanout::JobInfo *info = *it;
+    int reply_code = 0;
+    if (info->error_code != s3fanout::kFailOk) {
+      LogCvmfs(kLogUploadS3, kLogStderr, "Upload job for '%s' failed. "
+                                         "(error code: %d - %s)",
+               info->object_key.c_str(), info->error_code,
+               s3fanout::Code2Ascii(info->error_code));
+      reply_code = 99;
+    }
+    assert(info->mmf == NULL);
+    assert(info->origin_file == NULL);
+    if (info->request == s3fanout::JobInfo::kReqPutPart) {
+      // Parts belong to the commit of their stream, they are not reported
+      S3StreamHandle *handle = static_cast<S3StreamHandle *>(info->callback);
+      if (reply_code != 0)
+        handle->num_failed_parts++;
+      handle->num_parts_in_flight--;
+    } else if (info->origin == s3fanout::kOriginMem) {
+      Respond(static_cast<CallbackTN*>(info->callback),
+              UploaderResults(reply_code));
+    } else {
+      Respond(static_cast<CallbackTN*>(info->callback),
+              UploaderResults(reply_code, info->origin_path));
+    }
+  }
+}
+
+
 /**
  * Returns the access/secret key index of requested bucket
  *
@@ -385,7 +421,14 @@ bool S3Uploader::UploadJobInfo(s3fanout::JobInfo *info) {
 }
 
 
+/**
+ * With multipart uploads enabled, the stream is collected in memory and
+ * uploaded in parts of part_size_ as it is produced.
+ */
 UploadStreamHandle *S3Uploader::InitStreamedUpload(const CallbackTN *callback) {
+  if (part_size_ > 0)
+    return new S3StreamHandle(callback);
+
   std::string tmp_path;
   const int tmp_fd = CreateAndOpenTemporaryChunkFile(&tmp_path);
 
@@ -411,6 +454,12 @@ void S3Uploader::StreamedUpload(UploadStreamHandle  *handle,
   assert(buffer->IsInitialized());
   S3StreamHandle *local_handle = static_cast<S3StreamHandle*>(handle);
 
+  if (local_handle->IsInMemory()) {
+    AppendToStream(local_handle, buffer->ptr(), buffer->used_bytes());
+    Respond(callback, UploaderResults(0, buffer));
+    return;
+  }
+
   LogCvmfs(kLogUploadS3, kLogDebug, "Upload target = %s",
            local_handle->temporary_path.c_str());
 
@@ -438,6 +487,29 @@ void S3Uploader::FinalizeStreamedUpload(UploadStreamHandle  *handle,
   int retval = 0;
   S3StreamHandle *local_handle = static_cast<S3StreamHandle*>(handle);
 
+  if (local_handle->IsInMemory()) {
+    const std::string final_key =
+      repository_alias_ + "/data/" + content_hash.MakePath();
+    if (local_handle->IsMultipart() || (local_handle->num_failed_parts > 0)) {
+      FinalizeMultipartUpload(local_handle, final_key);
+      return;
+    }
+
+    // The object fits into a single part, the job takes over the buffer
+    s3fanout::JobInfo *info = CreateJobInfo(final_key, "",
+                                            local_handle->buffer,
+                                            local_handle->buffer_size);
+    info->callback = const_cast<void*>(
+      static_cast<void const*>(handle->commit_callback));
+    info->owns_origin_mem = true;
+    local_handle->buffer = NULL;
+    delete local_handle;
+
+    const bool retval2 = UploadJobInfo(info);
+    assert(retval2);
+    return;
+  }
+
   retval = close(local_handle->file_descriptor);
   if (retval != 0) {
     const int cpy_errno = errno;
@@ -497,7 +569,232 @@ void S3Uploader::FinalizeStreamedUpload(UploadStreamHandle  *handle,
 }
 
 
+void S3Uploader::AppendToStream(
+  S3StreamHandle *handle,
+  const unsigned char *data,
+  size_t size)
+{
+  while (size > 0) {
+    // Only hand over a part if there is more data, so that an object of
+    // exactly part_size_ is still uploaded in a single request
+    if (handle->buffer_size == part_size_)
+      UploadPart(handle);
+
+    const size_t nbytes = std::min(size, part_size_ - handle->buffer_size);
+    if (handle->buffer_size + nbytes > handle->buffer_capacity) {
+      handle->buffer_capacity = std::min(part_size_,
+        std::max(handle->buffer_size + nbytes, 2 * handle->buffer_capacity));
+      handle->buffer = static_cast<unsigned char *>(
+        srealloc(handle->buffer, handle->buffer_capacity));
+    }
+    memcpy(handle->buffer + handle->buffer_size, data, nbytes);
+    handle->buffer_size += nbytes;
+    data += nbytes;
+    size -= nbytes;
+  }
+}
+
+
+/**
+ * Hands over the stream buffer as the next part of the multipart upload.
+ * Blocks while parallel_parts_ parts of the stream are in flight, which
+ * bounds the memory of a stream.  After a failure, the data is dropped; the
+ * commit fails anyway.
+ */
+void S3Uploader::UploadPart(S3StreamHandle *handle) {
+  if (handle->parts.empty() && (handle->num_failed_parts == 0)) {
+    if (!InitMultipartUpload(handle))
+      handle->num_failed_parts++;
+  }
+  if (handle->parts.size() >= kMaxParts) {
+    LogCvmfs(kLogUploadS3, kLogStderr,
+             "too many parts for %s, increase CVMFS_S3_PART_SIZE",
+             handle->staging_key.c_str());
+    handle->num_failed_parts++;
+  }
+  if (handle->num_failed_parts > 0) {
+    handle->buffer_size = 0;
+    return;
+  }
+
+  WaitForParts(handle, parallel_parts_ - 1);
+
+  const std::string subresource =
+    "?partNumber=" + StringifyInt(handle->parts.size() + 1) +
+    "&uploadId=" + handle->upload_id;
+  s3fanout::JobInfo *info = CreateJobInfo(handle->staging_key, subresource,
+                                          handle->buffer, handle->buffer_size);
+  info->request = s3fanout::JobInfo::kReqPutPart;
+  info->callback = handle;
+  info->owns_origin_mem = true;
+  handle->buffer = NULL;
+  handle->buffer_size = 0;
+  handle->buffer_capacity = 0;
+
+  handle->parts.push_back(info);
+  handle->num_parts_in_flight++;
+  const bool retval = UploadJobInfo(info);
+  assert(retval);
+}
+
+
+/**
+ * Processes completed jobs until no more than max_in_flight parts of the
+ * stream are in flight.  Only called from the worker thread.
+ */
+void S3Uploader::WaitForParts(
+  S3StreamHandle *handle,
+  const unsigned max_in_flight)
+{
+  while (handle->num_parts_in_flight > max_in_flight) {
+    ReportCompletedJobs();
+#ifdef _POSIX_PRIORITY_SCHEDULING
+    sched_yield();
+#endif
+  }
+}
+
+
+/**
+ * The final key, i.e. the content hash, is only known on commit.  Therefore
+ * the parts are uploaded to a unique staging key.
+ */
+bool S3Uploader::InitMultipartUpload(S3StreamHandle *handle) {
+  handle->staging_key = repository_alias_ + "/data/txn/multipart." +
+    StringifyInt(getpid()) + "." + StringifyInt(time(NULL)) + "." +
+    StringifyInt(num_multipart_uploads_++);
+  s3fanout::JobInfo *info =
+    CreateJobInfo(handle->staging_key, "?uploads", NULL, 0);
+  info->request = s3fanout::JobInfo::kReqMultipartInit;
+  bool retval = s3fanout_mgr_.DoSingleJob(info);
+  if (retval) {
+    const std::string kTagOpen = "<UploadId>";
+    const size_t begin = info->response.find(kTagOpen);
+    const size_t end = info->response.find("</UploadId>");
+    if ((begin == std::string::npos) || (end == std::string::npos) ||
+        (end <= begin + kTagOpen.length()))
+    {
+      retval = false;
+    } else {
+      handle->upload_id = info->response.substr(
+        begin + kTagOpen.length(), end - begin - kTagOpen.length());
+    }
+  }
+  if (!retval) {
+    LogCvmfs(kLogUploadS3, kLogStderr,
+             "failed to initiate multipart upload of %s",
+             handle->staging_key.c_str());
+  }
+  delete info;
+  return retval;
+}
+
+
+/**
+ * Assembles the object at the staging key from the uploaded parts and copies
+ * it to its final key.
+ */
+bool S3Uploader::CompleteMultipartUpload(
+  S3StreamHandle *handle,
+  const std::string &final_key)
+{
+  std::string request = "<CompleteMultipartUpload>";
+  for (unsigned i = 0; i < handle->parts.size(); ++i) {
+    if (handle->parts[i]->etag.empty()) {
+      AbortMultipartUpload(handle);
+      return false;
+    }
+    request += "<Part><PartNumber>" + StringifyInt(i + 1) + "</PartNumber>"
+               "<ETag>" + handle->parts[i]->etag + "</ETag></Part>";
+  }
+  request += "</CompleteMultipartUpload>";
+
+  s3fanout::JobInfo *info = CreateJobInfo(
+    handle->staging_key, "?uploadId=" + handle->upload_id,
+    reinterpret_cast<const unsigned char *>(request.data()), request.length());
+  info->request = s3fanout::JobInfo::kReqMultipartComplete;
+  const std::string staging_bucket = info->bucket;
+  bool retval = s3fanout_mgr_.DoSingleJob(info);
+  delete info;
+  if (!retval) {
+    AbortMultipartUpload(handle);
+    return false;
+  }
+
+  info = CreateJobInfo(final_key, "", NULL, 0);
+  info->request = s3fanout::JobInfo::kReqCopy;
+  info->copy_source = "/" + staging_bucket + "/" + handle->staging_key;
+  retval = s3fanout_mgr_.DoSingleJob(info);
+  delete info;
+
+  info = CreateJobInfo(handle->staging_key, "", NULL, 0);
+  info->request = s3fanout::JobInfo::kReqDelete;
+  if (!s3fanout_mgr_.DoSingleJob(info)) {
+    LogCvmfs(kLogUploadS3, kLogStderr, "failed to remove staging object %s",
+             handle->staging_key.c_str());
+  }
+  delete info;
+  return retval;
+}
+
+
+/**
+ * Frees the storage of the parts that have been uploaded so far
+ */
+void S3Uploader::AbortMultipartUpload(S3StreamHandle *handle) {
+  s3fanout::JobInfo *info = CreateJobInfo(
+    handle->staging_key, "?uploadId=" + handle->upload_id, NULL, 0);
+  info->request = s3fanout::JobInfo::kReqDelete;
+  if (!s3fanout_mgr_.DoSingleJob(info)) {
+    LogCvmfs(kLogUploadS3, kLogStderr, "failed to abort multipart upload %s",
+             handle->staging_key.c_str());
+  }
+  delete info;
+}
+
+
+void S3Uploader::FinalizeMultipartUpload(
+  S3StreamHandle *handle,
+  const std::string &final_key)
+{
+  if (handle->buffer_size > 0)
+    UploadPart(handle);
+  WaitForParts(handle, 0);
+
+  bool retval = false;
+  if (handle->num_failed_parts == 0) {
+    retval = CompleteMultipartUpload(handle, final_key);
+  } else if (handle->IsMultipart()) {
+    AbortMultipartUpload(handle);
+  }
+
+  if (!retval) {
+    LogCvmfs(kLogUploadS3, kLogStderr, "Failed to upload %s",
+             final_key.c_str());
+    atomic_inc32(&copy_errors_);
+  }
+  LogCvmfs(kLogUploadS3, kLogDebug, "Uploaded %s in %u parts",
+           final_key.c_str(), static_cast<unsigned>(handle->parts.size()));
+  Respond(handle->commit_callback, UploaderResults(retval ? 0 : 99));
+  delete handle;
+}
+
+
 s3fanout::JobInfo *S3Uploader::CreateJobInfo(const std::string& path) const {
+  return CreateJobInfo(path, "", NULL, 0);
+}
+
+
+/**
+ * The bucket is selected by path.  The subresource, e.g. "?uploads", is
+ * appended to the object key.
+ */
+s3fanout::JobInfo *S3Uploader::CreateJobInfo(
+  const std::string &path,
+  const std::string &subresource,
+  const unsigned char *buffer,
+  const size_t size) const
+{
   std::string access_key, secret_key, bucket_name;
   GetKeysAndBucket(path, &access_key, &secret_key, &bucket_name);
 
@@ -505,11 +802,28 @@ s3fanout::JobInfo *S3Uploader::CreateJobInfo(const std::string& path) const {
                                secret_key,
                                full_host_name_,
                                bucket_name,
-                               path,
+                               path + subresource,
                                NULL,
                                NULL,
-                               NULL,
-                               0);
+                               buffer,
+                               size);
+}
+
+
+/**
+ * Multipart uploads have their parts stored already and are completed
+ * regardless.
+ */
+bool S3Uploader::DiscardStreamedUpload(UploadStreamHandle *handle) {
+  S3StreamHandle *local_handle = static_cast<S3StreamHandle*>(handle);
+  if (local_handle->IsMultipart() || (local_handle->num_failed_parts > 0))
+    return false;
+  if (!local_handle->IsInMemory()) {
+    close(local_handle->file_descriptor);
+    unlink(local_handle->temporary_path.c_str());
+  }
+  delete local_handle;
+  return true;
 }
 
 
@@ -525,6 +839,100 @@ bool S3Uploader::Remove(const std::string& file_to_delete) {
 }
 
 
+/**
+ * The body of a multi-object delete of keys[begin, end).  The quiet mode only
+ * reports the keys that could not be deleted.
+ */
+std::string S3Uploader::MkDeleteRequest(
+  const std::vector<std::string> &keys,
+  const size_t begin,
+  const size_t end)
+{
+  std::string request =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<Delete><Quiet>true</Quiet>";
+  for (size_t i = begin; i < end; ++i)
+    request += "<Object><Key>" + keys[i] + "</Key></Object>";
+  request += "</Delete>";
+  return request;
+}
+
+
+void S3Uploader::OnRemoveBatchPart(
+  const UploaderResults &results,
+  RemoveBatchState *state)
+{
+  if (results.return_code != 0)
+    atomic_inc32(&state->num_errors);
+  state->in_flight.Decrement();
+}
+
+
+bool S3Uploader::RemoveBatch(
+  const std::vector<shash::Any> &hashes_to_delete,
+  const unsigned concurrency)
+{
+  if (hashes_to_delete.empty())
+    return true;
+
+  // A multi-object delete works on a single bucket
+  std::map<std::string, std::vector<std::string> > keys_per_bucket;
+  std::map<std::string, std::pair<std::string, std::string> > bucket_keys;
+  for (unsigned i = 0; i < hashes_to_delete.size(); ++i) {
+    const std::string mangled_path =
+      repository_alias_ + "/data/" + hashes_to_delete[i].MakePath();
+    std::string access_key, secret_key, bucket_name;
+    GetKeysAndBucket(mangled_path, &access_key, &secret_key, &bucket_name);
+    keys_per_bucket[bucket_name].push_back(mangled_path);
+    bucket_keys[bucket_name] = std::make_pair(access_key, secret_key);
+  }
+
+  // Spread the batch over the concurrent requests
+  const unsigned num_requests = std::max(concurrency, 1U);
+  const size_t part_size = std::min(static_cast<size_t>(kMaxKeysPerDelete),
+    (hashes_to_delete.size() + num_requests - 1) / num_requests);
+
+  RemoveBatchState state(num_requests);
+  std::vector<std::string *> requests;
+  std::vector<s3fanout::JobInfo *> jobs;
+  std::map<std::string, std::vector<std::string> >::const_iterator i =
+    keys_per_bucket.begin();
+  for (; i != keys_per_bucket.end(); ++i) {
+    const std::vector<std::string> &keys = i->second;
+    for (size_t begin = 0; begin < keys.size(); begin += part_size) {
+      const size_t end = std::min(begin + part_size, keys.size());
+      requests.push_back(new std::string(MkDeleteRequest(keys, begin, end)));
+      const std::string *request = requests.back();
+      const CallbackTN *callback =
+        MakeClosure(&S3Uploader::OnRemoveBatchPart, this, &state);
+      s3fanout::JobInfo *info = new s3fanout::JobInfo(
+        bucket_keys[i->first].first,
+        bucket_keys[i->first].second,
+        full_host_name_,
+        i->first,
+        "?delete",
+        const_cast<void*>(static_cast<void const*>(callback)),
+        NULL,
+        reinterpret_cast<const unsigned char *>(request->data()),
+        request->length());
+      info->request = s3fanout::JobInfo::kReqDeleteMulti;
+      jobs.push_back(info);
+
+      // Blocks while concurrency requests are in flight
+      state.in_flight.Increment();
+      IncJobsInFlight();
+      s3fanout_mgr_.PushNewJob(info);
+    }
+  }
+  state.in_flight.WaitForZero();
+
+  for (unsigned j = 0; j < jobs.size(); ++j) {
+    delete jobs[j];
+    delete requests[j];
+  }
+  return atomic_read32(&state.num_errors) == 0;
+}
+
+
 bool S3Uploader::Peek(const std::string& path) const {
   const std::string mangled_path = repository_alias_ + "/" + path;
   s3fanout::JobInfo *info = CreateJobInfo(mangled_path);
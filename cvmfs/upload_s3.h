@@ -5,12 +5,15 @@
 #ifndef CVMFS_UPLOAD_S3_H_
 #define CVMFS_UPLOAD_S3_H_
 
+#include <cstdlib>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "atomic.h"
 #include "s3fanout.h"
 #include "upload_facility.h"
+#include "util_concurrency.h"
 
 namespace upload {
 
@@ -19,10 +22,43 @@ struct S3StreamHandle : public UploadStreamHandle {
                  const std::string &tmp_path)
       : UploadStreamHandle(commit_callback),
         file_descriptor(tmp_fd),
-        temporary_path(tmp_path) {}
+        temporary_path(tmp_path),
+        buffer(NULL), buffer_size(0), buffer_capacity(0),
+        num_parts_in_flight(0), num_failed_parts(0) {}
+
+  /**
+   * Streams without a temporary file collect the data in memory
+   */
+  explicit S3StreamHandle(const CallbackTN *commit_callback)
+      : UploadStreamHandle(commit_callback),
+        file_descriptor(-1),
+        buffer(NULL), buffer_size(0), buffer_capacity(0),
+        num_parts_in_flight(0), num_failed_parts(0) {}
+
+  ~S3StreamHandle() {
+    free(buffer);
+    for (unsigned i = 0; i < parts.size(); ++i)
+      delete parts[i];
+  }
+
+  bool IsInMemory() const { return file_descriptor < 0; }
+  bool IsMultipart() const { return !upload_id.empty(); }
 
   const int file_descriptor;
   const std::string temporary_path;
+
+  // Data that is not yet handed over to an upload job
+  unsigned char *buffer;
+  size_t buffer_size;
+  size_t buffer_capacity;
+
+  // Multipart uploads go to a staging key.  Once the content hash is known,
+  // the object is copied to its final key on the server side.
+  std::string staging_key;
+  std::string upload_id;
+  std::vector<s3fanout::JobInfo *> parts;
+  unsigned num_parts_in_flight;
+  unsigned num_failed_parts;
 };
 
 /**
@@ -54,8 +90,15 @@ class S3Uploader : public AbstractUploader {
                       const CallbackTN *callback = NULL);
   void FinalizeStreamedUpload(UploadStreamHandle *handle,
                               const shash::Any &content_hash);
+  bool DiscardStreamedUpload(UploadStreamHandle *handle);
 
   bool Remove(const std::string &file_to_delete);
+  /**
+   * Uses S3 multi-object deletes of up to kMaxKeysPerDelete objects.  Up to
+   * concurrency requests are in flight.
+   */
+  bool RemoveBatch(const std::vector<shash::Any> &hashes_to_delete,
+                   const unsigned concurrency);
   bool Peek(const std::string &path) const;
   bool PlaceBootstrappingShortcut(const shash::Any &object) const;
 
@@ -69,8 +112,52 @@ class S3Uploader : public AbstractUploader {
   void WorkerThread();
 
  private:
+  /**
+   * Part size of multipart uploads in megabytes, zero disables them.  Apart
+   * from the last one, S3 requires parts of at least 5MB.
+   */
+  static const unsigned kDefaultPartSizeMb = 0;
+  static const unsigned kDefaultParallelParts = 4;
+  /**
+   * S3 limit of the number of parts of a multipart upload
+   */
+  static const unsigned kMaxParts = 10000;
+
+  /**
+   * S3 limit of the number of keys in a multi-object delete
+   */
+  static const unsigned kMaxKeysPerDelete = 1000;
+
+  struct RemoveBatchState {
+    explicit RemoveBatchState(const unsigned concurrency)
+      : in_flight(concurrency) { atomic_init32(&num_errors); }
+    SynchronizingCounter<int32_t> in_flight;
+    atomic_int32 num_errors;
+  };
+
+  void OnRemoveBatchPart(const UploaderResults &results,
+                         RemoveBatchState *state);
+  static std::string MkDeleteRequest(const std::vector<std::string> &keys,
+                                     const size_t begin, const size_t end);
+
   bool ParseSpoolerDefinition(const SpoolerDefinition &spooler_definition);
   bool UploadJobInfo(s3fanout::JobInfo *info);
+  void ReportCompletedJobs();
+
+  void AppendToStream(S3StreamHandle *handle,
+                      const unsigned char *data, size_t size);
+  void UploadPart(S3StreamHandle *handle);
+  void WaitForParts(S3StreamHandle *handle, const unsigned max_in_flight);
+  bool InitMultipartUpload(S3StreamHandle *handle);
+  bool CompleteMultipartUpload(S3StreamHandle *handle,
+                               const std::string &final_key);
+  void AbortMultipartUpload(S3StreamHandle *handle);
+  void FinalizeMultipartUpload(S3StreamHandle *handle,
+                               const std::string &final_key);
+  s3fanout::JobInfo *CreateJobInfo(const std::string &path,
+                                   const std::string &subresource,
+                                   const unsigned char *buffer,
+                                   const size_t size) const;
 
   int GetKeysAndBucket(const std::string &filename, std::string *access_key,
                        std::string *secret_key, std::string *bucket_name) const;
@@ -87,6 +174,9 @@ class S3Uploader : public AbstractUploader {
   std::string bucket_body_name_;
   int number_of_buckets_;
   int max_num_parallel_uploads_;
+  size_t part_size_;
+  unsigned parallel_parts_;
+  unsigned num_multipart_uploads_;
   std::vector<std::pair<std::string, std::string> > keys_;
 
   const std::string temporary_path_;
@@ -31,8 +31,14 @@ SpoolerDefinition::SpoolerDefinition(
       min_file_chunk_size(min_file_chunk_size),
       avg_file_chunk_size(avg_file_chunk_size),
       max_file_chunk_size(max_file_chunk_size),
+      chunking_algorithm(kChunkingXor32),
+      digest_tree_block_size(0),
+      encryption_key(NULL),
+      processing_policy(NULL),
       number_of_threads(tbb::task_scheduler_init::default_num_threads()),
       number_of_concurrent_uploads(number_of_threads * 100),
+      number_of_local_writers(1),
+      local_sync_mode(kLocalSyncNone),
       session_token_file(session_token_file),
       key_file(key_file),
       valid_(false) {
@@ -75,6 +81,9 @@ SpoolerDefinition::SpoolerDefinition(
 SpoolerDefinition SpoolerDefinition::Dup2DefaultCompression() const {
   SpoolerDefinition result(*this);
   result.compression_alg = zlib::kZlibDefault;
+  result.encryption_key = NULL;
+  result.processing_policy = NULL;
+  result.digest_tree_block_size = 0;
   return result;
 }
 
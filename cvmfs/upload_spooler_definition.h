@@ -10,8 +10,14 @@
 #include "compression.h"
 #include "hash.h"
 
+namespace cipher {
+class Key;
+}
+
 namespace upload {
 
+class ProcessingPolicy;
+
 /**
  * SpoolerDefinition is given by a string of the form:
  * <spooler type>:<spooler description>
@@ -21,6 +27,17 @@ namespace upload {
  */
 struct SpoolerDefinition {
   enum DriverType { S3, Local, Gateway, Mock, Unknown };
+  /**
+   * How the local uploader makes objects durable: not at all (left to the
+   * file system), by fsync() of every object before it is renamed into
+   * place, or by flushing the entire storage once at the end of the session
+   */
+  enum LocalSyncMode { kLocalSyncNone, kLocalSyncFile, kLocalSyncSession };
+  /**
+   * The content-defined chunking algorithm.  Changing the algorithm of a
+   * repository changes the cut marks of republished files once.
+   */
+  enum ChunkingAlgorithm { kChunkingXor32, kChunkingFastCdc };
 
   /**
    * Reads a given definition_string as described above and interprets
@@ -48,7 +65,7 @@ struct SpoolerDefinition {
   /**
    * Creates a new SpoolerDefinition based on an existing one.  The new spooler
    * has compression set to zlib, which is required for catalogs and other meta-
-   * objects.
+   * objects.  Meta-objects are not encrypted.
    */
   SpoolerDefinition Dup2DefaultCompression() const;
 
@@ -72,9 +89,37 @@ struct SpoolerDefinition {
   size_t min_file_chunk_size;
   size_t avg_file_chunk_size;
   size_t max_file_chunk_size;
+  ChunkingAlgorithm chunking_algorithm;
+  /**
+   * If non-zero, the FileProcessor computes a DigestTree with blocks of that
+   * size for files larger than one block.
+   */
+  size_t digest_tree_block_size;
+  /**
+   * If set, the FileProcessor encrypts the compressed chunks with
+   * AES-256-CTR.  Not owned, needs to outlive the spooler.  Cannot be combined
+   * with legacy bulk chunks.
+   */
+  const cipher::Key *encryption_key;
+  /**
+   * If set, overrides the compression and chunking parameters for files with
+   * a repository path.  Not owned, needs to outlive the spooler.
+   */
+  const ProcessingPolicy *processing_policy;
 
-  const unsigned int number_of_threads;
+  /**
+   * Number of TBB threads that compress and hash file data.  Defaults to the
+   * number of cores; chunks of a single file are processed concurrently.
+   */
+  unsigned int number_of_threads;
   unsigned int number_of_concurrent_uploads;
+  /**
+   * Number of threads of the local uploader that move finished objects into
+   * the storage.  More than one thread helps on high-latency storage, e.g.
+   * NFS or CephFS.
+   */
+  unsigned int number_of_local_writers;
+  LocalSyncMode local_sync_mode;
 
   // The session_token_file parameter is only used for the HTTP driver
   std::string session_token_file;
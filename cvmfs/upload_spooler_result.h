@@ -42,6 +42,10 @@ struct SpoolerResult {
   shash::Any    content_hash;
   FileChunkList file_chunks;   //!< the file chunks generated during processing
   zlib::Algorithms  compression_alg;
+  /**
+   * The serialized DigestTree of the bulk file or empty if none was computed
+   */
+  std::string   digest_tree;
 };
 
 }  // namespace upload
@@ -0,0 +1,175 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_UTIL_EXECUTOR_H_
+#define CVMFS_UTIL_EXECUTOR_H_
+
+#include <pthread.h>
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+#include "atomic.h"
+#include "util/single_copy.h"
+#include "util/work_stealing.h"
+#include "util_concurrency.h"
+
+#ifdef CVMFS_NAMESPACE_GUARD
+namespace CVMFS_NAMESPACE_GUARD {
+#endif
+
+/**
+ * A pool of worker threads that run submitted tasks.  The tasks are queued in
+ * a WorkStealingQueue with one lane per worker, so that submitting and
+ * picking up short tasks scales with the number of workers.  Tasks do not
+ * run in submission order.
+ *
+ * Results are passed back either by the task itself or, for Async(), by a
+ * Future.  The destructor waits for all the queued tasks.
+ */
+class Executor : SingleCopy {
+ public:
+  class Task {
+   public:
+    virtual ~Task() { }
+    virtual void Run() = 0;
+  };
+
+  /**
+   * Maximum number of queued tasks per worker thread if not specified
+   */
+  static const unsigned kQueuedTasksPerThread = 64;
+
+  explicit Executor(const unsigned num_threads,
+                    const size_t maximal_queue_length = 0)
+    : num_threads_(num_threads)
+    , queue_(num_threads, (maximal_queue_length > 0) ? maximal_queue_length
+                          : num_threads * kQueuedTasksPerThread)
+    , threads_(num_threads)
+    , bindings_(num_threads)
+  {
+    assert(num_threads > 0);
+    atomic_init32(&num_pending_);
+    int retval = pthread_mutex_init(&lock_done_, NULL);
+    assert(retval == 0);
+    retval = pthread_cond_init(&cond_done_, NULL);
+    assert(retval == 0);
+    for (unsigned i = 0; i < num_threads_; ++i) {
+      bindings_[i].executor = this;
+      bindings_[i].lane_id = i;
+      retval = pthread_create(&threads_[i], NULL, MainWorker, &bindings_[i]);
+      assert(retval == 0);
+    }
+  }
+
+  ~Executor() {
+    Wait();
+    // A NULL task stops its worker
+    for (unsigned i = 0; i < num_threads_; ++i)
+      queue_.Push(NULL);
+    for (unsigned i = 0; i < num_threads_; ++i)
+      pthread_join(threads_[i], NULL);
+    pthread_cond_destroy(&cond_done_);
+    pthread_mutex_destroy(&lock_done_);
+  }
+
+  /**
+   * Takes ownership of the task and deletes it after it ran.  Blocks if the
+   * queue is full.
+   */
+  void Submit(Task *task) {
+    assert(task != NULL);
+    atomic_inc32(&num_pending_);
+    queue_.Push(task);
+  }
+
+  /**
+   * Like Submit() for several tasks at once, the queue is locked once per
+   * worker instead of once per task.
+   */
+  void SubmitBatch(const std::vector<Task *> &tasks) {
+    atomic_xadd32(&num_pending_, static_cast<int32_t>(tasks.size()));
+    queue_.PushBatch(tasks);
+  }
+
+  /**
+   * Runs function(data) in a worker thread.  The result is set in the returned
+   * Future, which is owned by the caller.
+   */
+  template <typename T>
+  Future<T> *Async(T (*function)(void *data), void *data) {
+    Future<T> *result = new Future<T>();
+    Submit(new AsyncTask<T>(function, data, result));
+    return result;
+  }
+
+  /**
+   * Blocks until all the tasks submitted so far have finished.  Must not be
+   * called from a task.
+   */
+  void Wait() {
+    pthread_mutex_lock(&lock_done_);
+    while (atomic_read32(&num_pending_) > 0)
+      pthread_cond_wait(&cond_done_, &lock_done_);
+    pthread_mutex_unlock(&lock_done_);
+  }
+
+  unsigned num_threads() const { return num_threads_; }
+
+ private:
+  template <typename T>
+  class AsyncTask : public Task {
+   public:
+    AsyncTask(T (*function)(void *data), void *data, Future<T> *result)
+      : function_(function), data_(data), result_(result) { }
+    virtual void Run() { result_->Set(function_(data_)); }
+
+   private:
+    T (*function_)(void *data);
+    void *data_;
+    Future<T> *result_;
+  };
+
+  struct WorkerBinding {
+    WorkerBinding() : executor(NULL), lane_id(0) { }
+    Executor *executor;
+    unsigned lane_id;
+  };
+
+  static void *MainWorker(void *data) {
+    WorkerBinding *binding = reinterpret_cast<WorkerBinding *>(data);
+    Executor *executor = binding->executor;
+    while (true) {
+      Task *task = executor->queue_.Pop(binding->lane_id);
+      if (task == NULL)
+        break;
+      task->Run();
+      delete task;
+      if (atomic_xadd32(&executor->num_pending_, -1) == 1) {
+        pthread_mutex_lock(&executor->lock_done_);
+        pthread_cond_broadcast(&executor->cond_done_);
+        pthread_mutex_unlock(&executor->lock_done_);
+      }
+    }
+    return NULL;
+  }
+
+  const unsigned num_threads_;
+  WorkStealingQueue<Task *> queue_;
+  std::vector<pthread_t> threads_;
+  std::vector<WorkerBinding> bindings_;
+  /**
+   * Submitted tasks that have not yet finished
+   */
+  atomic_int32 num_pending_;
+  pthread_mutex_t lock_done_;
+  pthread_cond_t cond_done_;
+};
+
+#ifdef CVMFS_NAMESPACE_GUARD
+}  // namespace CVMFS_NAMESPACE_GUARD
+#endif
+
+#endif  // CVMFS_UTIL_EXECUTOR_H_
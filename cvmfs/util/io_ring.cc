@@ -0,0 +1,238 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include "cvmfs_config.h"
+#include "util/io_ring.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifdef HAS_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include "logging.h"
+#include "util/pointer.h"
+
+#if defined(HAS_IO_URING) && defined(__NR_io_uring_setup) && \
+    defined(__NR_io_uring_enter)
+#define CVMFS_IO_RING_AVAILABLE
+#endif
+
+using namespace std;  // NOLINT
+
+#ifdef CVMFS_NAMESPACE_GUARD
+namespace CVMFS_NAMESPACE_GUARD {
+#endif
+
+IoRing::IoRing()
+  : ring_fd_(-1)
+  , depth_(0)
+  , sq_ring_(MAP_FAILED)
+  , sq_ring_size_(0)
+  , cq_ring_(MAP_FAILED)
+  , cq_ring_size_(0)
+  , sqes_(MAP_FAILED)
+  , sqes_size_(0)
+  , sq_tail_(NULL)
+  , sq_mask_(0)
+  , sq_array_(NULL)
+  , cq_head_(NULL)
+  , cq_tail_(NULL)
+  , cq_mask_(0)
+  , cqes_(NULL)
+{ }
+
+
+IoRing::~IoRing() {
+  if (sqes_ != MAP_FAILED)
+    munmap(sqes_, sqes_size_);
+  if ((cq_ring_ != MAP_FAILED) && (cq_ring_ != sq_ring_))
+    munmap(cq_ring_, cq_ring_size_);
+  if (sq_ring_ != MAP_FAILED)
+    munmap(sq_ring_, sq_ring_size_);
+  if (ring_fd_ >= 0)
+    close(ring_fd_);
+}
+
+
+IoRing *IoRing::Create(const unsigned depth) {
+  assert(depth > 0);
+  UniquePtr<IoRing> ring(new IoRing());
+  if (!ring->Setup(depth))
+    return NULL;
+  return ring.Release();
+}
+
+
+#ifdef CVMFS_IO_RING_AVAILABLE
+
+bool IoRing::Setup(const unsigned depth) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = syscall(__NR_io_uring_setup, depth, &params);
+  if (ring_fd_ < 0) {
+    LogCvmfs(kLogUtility, kLogDebug, "io_uring not available (%d)", errno);
+    return false;
+  }
+  depth_ = std::min(depth, params.sq_entries);
+  iovecs_.resize(depth_);
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+    params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED)
+    return false;
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED)
+      return false;
+  }
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes_ == MAP_FAILED)
+    return false;
+
+  char *sq = reinterpret_cast<char *>(sq_ring_);
+  sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  char *cq = reinterpret_cast<char *>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes_ = cq + params.cq_off.cqes;
+  return true;
+}
+
+
+/**
+ * Collects the available completions, returns their number
+ */
+unsigned IoRing::Reap(vector<Request> *requests) {
+  struct io_uring_cqe *cqes = reinterpret_cast<struct io_uring_cqe *>(cqes_);
+  unsigned head = *cq_head_;
+  unsigned num_reaped = 0;
+  while (true) {
+    __sync_synchronize();
+    if (head == *cq_tail_)
+      break;
+    const struct io_uring_cqe *cqe = &cqes[head & cq_mask_];
+    (*requests)[cqe->user_data].result = cqe->res;
+    ++head;
+    ++num_reaped;
+  }
+  __sync_synchronize();
+  *cq_head_ = head;
+  return num_reaped;
+}
+
+
+void IoRing::Read(vector<Request> *requests) {
+  struct io_uring_sqe *sqes = reinterpret_cast<struct io_uring_sqe *>(sqes_);
+  for (size_t first = 0; first < requests->size(); first += depth_) {
+    const unsigned batch =
+      std::min(static_cast<size_t>(depth_), requests->size() - first);
+
+    // All the previous requests are completed, so the submission queue is
+    // empty and its slots can be filled from the tail
+    unsigned tail = *sq_tail_;
+    for (unsigned i = 0; i < batch; ++i) {
+      Request *request = &(*requests)[first + i];
+      iovecs_[i].iov_base = request->buffer;
+      iovecs_[i].iov_len = request->size;
+      const unsigned idx = tail & sq_mask_;
+      struct io_uring_sqe *sqe = &sqes[idx];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_READV;
+      sqe->fd = request->fd;
+      sqe->off = request->offset;
+      sqe->addr = reinterpret_cast<uintptr_t>(&iovecs_[i]);
+      sqe->len = 1;
+      sqe->user_data = first + i;
+      sq_array_[idx] = idx;
+      ++tail;
+    }
+    __sync_synchronize();
+    *sq_tail_ = tail;
+    __sync_synchronize();
+
+    // The kernel only waits for completions if all entries were submitted
+    unsigned num_submitted = 0;
+    unsigned num_completed = 0;
+    while (num_completed < batch) {
+      const int retval = syscall(__NR_io_uring_enter, ring_fd_,
+                                 batch - num_submitted, batch - num_completed,
+                                 IORING_ENTER_GETEVENTS, NULL, 0);
+      if (retval < 0) {
+        if ((errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY)) {
+          LogCvmfs(kLogUtility, kLogStderr, "io_uring_enter failed (%d)",
+                   errno);
+          abort();
+        }
+      } else {
+        num_submitted += retval;
+      }
+      num_completed += Reap(requests);
+    }
+
+    // Short reads in the middle of a file are legal, complete them
+    for (unsigned i = 0; i < batch; ++i) {
+      Request *request = &(*requests)[first + i];
+      while ((request->result >= 0) &&
+             (static_cast<size_t>(request->result) < request->size))
+      {
+        const ssize_t nbytes = pread(request->fd,
+          reinterpret_cast<char *>(request->buffer) + request->result,
+          request->size - request->result, request->offset + request->result);
+        if (nbytes == 0)
+          break;
+        if (nbytes < 0) {
+          if (errno == EINTR)
+            continue;
+          request->result = -errno;
+          break;
+        }
+        request->result += nbytes;
+      }
+    }
+  }
+}
+
+#else  // CVMFS_IO_RING_AVAILABLE
+
+bool IoRing::Setup(const unsigned depth) {
+  return false;
+}
+
+unsigned IoRing::Reap(vector<Request> *requests) {
+  return 0;
+}
+
+void IoRing::Read(vector<Request> *requests) {
+  abort();
+}
+
+#endif  // CVMFS_IO_RING_AVAILABLE
+
+#ifdef CVMFS_NAMESPACE_GUARD
+}  // namespace CVMFS_NAMESPACE_GUARD
+#endif
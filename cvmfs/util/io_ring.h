@@ -0,0 +1,87 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_UTIL_IO_RING_H_
+#define CVMFS_UTIL_IO_RING_H_
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "util/single_copy.h"
+
+#ifdef CVMFS_NAMESPACE_GUARD
+namespace CVMFS_NAMESPACE_GUARD {
+#endif
+
+/**
+ * Reads batches of file blocks through the Linux io_uring interface.  All the
+ * reads of a batch are in flight at the same time and submitted (and reaped)
+ * by a single system call, which keeps the queue of fast devices filled from a
+ * single thread.  The ring is driven by the raw system calls, there is no
+ * dependency on liburing.
+ *
+ * Create() returns NULL if cvmfs was built without io_uring support or if the
+ * kernel refuses to set up a ring (kernel < 5.1, seccomp filters, ...).  Users
+ * are expected to fall back to synchronous reads in that case.
+ */
+class IoRing : SingleCopy {
+ public:
+  struct Request {
+    Request() : fd(-1), buffer(NULL), size(0), offset(0), result(0) { }
+    Request(int f, void *b, size_t s, off_t o)
+      : fd(f), buffer(b), size(s), offset(o), result(0) { }
+    int fd;
+    void *buffer;
+    size_t size;
+    off_t offset;
+    /**
+     * Number of bytes read or -errno.  Less than size only at the end of file.
+     */
+    ssize_t result;
+  };
+
+  static IoRing *Create(const unsigned depth);
+  ~IoRing();
+
+  /**
+   * Blocks until all requests are served.  Batches larger than the depth of
+   * the ring are processed in several rounds.
+   */
+  void Read(std::vector<Request> *requests);
+
+  unsigned depth() const { return depth_; }
+
+ private:
+  IoRing();
+  bool Setup(const unsigned depth);
+  unsigned Reap(std::vector<Request> *requests);
+
+  int ring_fd_;
+  unsigned depth_;
+  std::vector<struct iovec> iovecs_;
+
+  void *sq_ring_;
+  size_t sq_ring_size_;
+  void *cq_ring_;
+  size_t cq_ring_size_;
+  void *sqes_;
+  size_t sqes_size_;
+
+  volatile unsigned *sq_tail_;
+  unsigned sq_mask_;
+  unsigned *sq_array_;
+  volatile unsigned *cq_head_;
+  volatile unsigned *cq_tail_;
+  unsigned cq_mask_;
+  void *cqes_;
+};
+
+#ifdef CVMFS_NAMESPACE_GUARD
+}  // namespace CVMFS_NAMESPACE_GUARD
+#endif
+
+#endif  // CVMFS_UTIL_IO_RING_H_
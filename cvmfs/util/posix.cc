@@ -1425,7 +1425,7 @@ bool SafeReadToString(int fd, std::string *final_result) {
 }
 
 bool SafeWriteToFile(const string &content, const string &path, int mode) {
-  int fd = open(path.c_str(), O_WRONLY | O_CREAT, mode);
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode);
   if (fd < 0) return false;
   bool retval = SafeWrite(fd, content.data(), content.size());
   close(fd);
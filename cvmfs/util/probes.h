@@ -0,0 +1,39 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Static user-space tracepoints (USDT) for SystemTap, bpftrace, or perf.  All
+ * probes belong to the "cvmfs" provider, for instance
+ *
+ *   bpftrace -e 'usdt:/usr/lib64/libcvmfs_fuse.so:cvmfs:fetch_miss
+ *                { printf("%s\n", str(arg0)); }'
+ *
+ * lists the cache misses of a running client.  An unused probe is a single nop
+ * instruction; its arguments are still evaluated, so they should be values
+ * that are at hand anyway.  Without sys/sdt.h, the probes compile to nothing.
+ */
+
+#ifndef CVMFS_UTIL_PROBES_H_
+#define CVMFS_UTIL_PROBES_H_
+
+#ifdef HAS_SDT
+
+#include <sys/sdt.h>
+
+#define CVMFS_PROBE(name) DTRACE_PROBE(cvmfs, name)
+#define CVMFS_PROBE1(name, a1) DTRACE_PROBE1(cvmfs, name, a1)
+#define CVMFS_PROBE2(name, a1, a2) DTRACE_PROBE2(cvmfs, name, a1, a2)
+#define CVMFS_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(cvmfs, name, a1, a2, a3)
+#define CVMFS_PROBE4(name, a1, a2, a3, a4) \
+  DTRACE_PROBE4(cvmfs, name, a1, a2, a3, a4)
+
+#else  // HAS_SDT
+
+#define CVMFS_PROBE(name) do { } while (0)
+#define CVMFS_PROBE1(name, a1) do { } while (0)
+#define CVMFS_PROBE2(name, a1, a2) do { } while (0)
+#define CVMFS_PROBE3(name, a1, a2, a3) do { } while (0)
+#define CVMFS_PROBE4(name, a1, a2, a3, a4) do { } while (0)
+
+#endif  // HAS_SDT
+
+#endif  // CVMFS_UTIL_PROBES_H_
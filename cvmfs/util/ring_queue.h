@@ -0,0 +1,228 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_UTIL_RING_QUEUE_H_
+#define CVMFS_UTIL_RING_QUEUE_H_
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+
+#include <cassert>
+#include <cstddef>
+
+#include "atomic.h"
+#include "util/single_copy.h"
+
+#ifdef CVMFS_NAMESPACE_GUARD
+namespace CVMFS_NAMESPACE_GUARD {
+#endif
+
+/**
+ * A bounded multi-producer/multi-consumer FIFO queue on a ring buffer
+ * (D. Vyukov's algorithm).  Every slot carries a sequence number that tells
+ * whether the slot is free for the producer of a given position or filled for
+ * the consumer of that position.  Producers and consumers claim positions by
+ * compare-and-swap on the tail and head counters; TryPush() and TryPop() take
+ * no locks.
+ *
+ * Push() and Pop() block if the queue is full respectively empty.  They first
+ * retry for a short while and then sleep on a condition variable.  The other
+ * side only touches the lock if there are sleeping threads, so that the
+ * blocking fallback is free as long as the queue neither runs full nor empty.
+ *
+ * The capacity is rounded up to a power of two.  T needs to be default
+ * constructible and assignable.
+ */
+template <class T>
+class RingQueue : SingleCopy {
+ public:
+  explicit RingQueue(const size_t capacity) {
+    capacity_ = 1;
+    while (capacity_ < capacity)
+      capacity_ <<= 1;
+    mask_ = capacity_ - 1;
+    cells_ = new Cell[capacity_];
+    for (size_t i = 0; i < capacity_; ++i)
+      cells_[i].sequence = i;
+    atomic_init64(&head_);
+    atomic_init64(&tail_);
+    atomic_init32(&num_waiting_consumers_);
+    atomic_init32(&num_waiting_producers_);
+    int retval = pthread_mutex_init(&lock_sleep_, NULL);
+    assert(retval == 0);
+    retval = pthread_cond_init(&cond_items_, NULL);
+    assert(retval == 0);
+    retval = pthread_cond_init(&cond_space_, NULL);
+    assert(retval == 0);
+  }
+
+  ~RingQueue() {
+    delete[] cells_;
+    pthread_cond_destroy(&cond_space_);
+    pthread_cond_destroy(&cond_items_);
+    pthread_mutex_destroy(&lock_sleep_);
+  }
+
+  /**
+   * Returns false if the queue is full
+   */
+  bool TryPush(const T &item) {
+    if (!DoPush(item))
+      return false;
+    WakeUp(&num_waiting_consumers_, &cond_items_);
+    return true;
+  }
+
+  /**
+   * Returns false if the queue is empty
+   */
+  bool TryPop(T *item) {
+    if (!DoPop(item))
+      return false;
+    WakeUp(&num_waiting_producers_, &cond_space_);
+    return true;
+  }
+
+  void Push(const T &item) {
+    for (unsigned i = 0; i < kMaxSpins; ++i) {
+      if (TryPush(item))
+        return;
+      sched_yield();
+    }
+    pthread_mutex_lock(&lock_sleep_);
+    atomic_inc32(&num_waiting_producers_);
+    while (!DoPush(item))
+      pthread_cond_wait(&cond_space_, &lock_sleep_);
+    atomic_dec32(&num_waiting_producers_);
+    pthread_mutex_unlock(&lock_sleep_);
+    WakeUp(&num_waiting_consumers_, &cond_items_);
+  }
+
+  void Pop(T *item) {
+    for (unsigned i = 0; i < kMaxSpins; ++i) {
+      if (TryPop(item))
+        return;
+      sched_yield();
+    }
+    pthread_mutex_lock(&lock_sleep_);
+    atomic_inc32(&num_waiting_consumers_);
+    while (!DoPop(item))
+      pthread_cond_wait(&cond_items_, &lock_sleep_);
+    atomic_dec32(&num_waiting_consumers_);
+    pthread_mutex_unlock(&lock_sleep_);
+    WakeUp(&num_waiting_producers_, &cond_space_);
+  }
+
+  /**
+   * Only a snapshot if there are concurrent producers or consumers
+   */
+  size_t GetSize() {
+    const int64_t size = atomic_read64(&tail_) - atomic_read64(&head_);
+    return (size > 0) ? size : 0;
+  }
+  size_t GetCapacity() const { return capacity_; }
+
+ private:
+  /**
+   * Tries before a blocking call goes to sleep
+   */
+  static const unsigned kMaxSpins = 16;
+
+  struct Cell {
+    Cell() : sequence(0), data() { }
+    volatile int64_t sequence;
+    T data;
+  };
+
+  static int64_t LoadAcquire(volatile int64_t *value) {
+    const int64_t result = *value;
+    __sync_synchronize();
+    return result;
+  }
+
+  static void StoreRelease(volatile int64_t *value, const int64_t new_value) {
+    __sync_synchronize();
+    *value = new_value;
+  }
+
+  bool DoPush(const T &item) {
+    Cell *cell;
+    int64_t pos = atomic_read64(&tail_);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const int64_t diff = LoadAcquire(&cell->sequence) - pos;
+      if (diff == 0) {
+        if (atomic_cas64(&tail_, pos, pos + 1))
+          break;
+      } else if (diff < 0) {
+        // The slot still holds the item from one round before
+        return false;
+      }
+      pos = atomic_read64(&tail_);
+    }
+    cell->data = item;
+    StoreRelease(&cell->sequence, pos + 1);
+    return true;
+  }
+
+  bool DoPop(T *item) {
+    Cell *cell;
+    int64_t pos = atomic_read64(&head_);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const int64_t diff = LoadAcquire(&cell->sequence) - (pos + 1);
+      if (diff == 0) {
+        if (atomic_cas64(&head_, pos, pos + 1))
+          break;
+      } else if (diff < 0) {
+        // The producer of this position has not yet finished
+        return false;
+      }
+      pos = atomic_read64(&head_);
+    }
+    *item = cell->data;
+    cell->data = T();
+    StoreRelease(&cell->sequence, pos + capacity_);
+    return true;
+  }
+
+  /**
+   * Waiting threads register under lock_sleep_ before they re-check the
+   * queue.  The atomic counter operations are full barriers, so either the
+   * waiting thread sees the change or the other side sees the registration
+   * and signals under lock_sleep_.
+   */
+  void WakeUp(atomic_int32 *num_waiting, pthread_cond_t *cond) {
+    if (atomic_read32(num_waiting) == 0)
+      return;
+    pthread_mutex_lock(&lock_sleep_);
+    pthread_cond_signal(cond);
+    pthread_mutex_unlock(&lock_sleep_);
+  }
+
+  size_t capacity_;
+  size_t mask_;
+  Cell *cells_;
+  /**
+   * Head and tail are written by different threads, keep them apart
+   */
+  char padding_head_[64];
+  atomic_int64 head_;
+  char padding_tail_[64];
+  atomic_int64 tail_;
+  char padding_end_[64];
+
+  atomic_int32 num_waiting_consumers_;
+  atomic_int32 num_waiting_producers_;
+  pthread_mutex_t lock_sleep_;
+  pthread_cond_t cond_items_;
+  pthread_cond_t cond_space_;
+};
+
+#ifdef CVMFS_NAMESPACE_GUARD
+}  // namespace CVMFS_NAMESPACE_GUARD
+#endif
+
+#endif  // CVMFS_UTIL_RING_QUEUE_H_
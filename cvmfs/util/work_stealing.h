@@ -0,0 +1,236 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef CVMFS_UTIL_WORK_STEALING_H_
+#define CVMFS_UTIL_WORK_STEALING_H_
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cassert>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include "atomic.h"
+#include "util/single_copy.h"
+
+#ifdef CVMFS_NAMESPACE_GUARD
+namespace CVMFS_NAMESPACE_GUARD {
+#endif
+
+/**
+ * A job queue for a fixed set of consumer threads.  Every consumer has its own
+ * lane (a deque with its own lock).  Producers distribute the items round
+ * robin over the lanes; a consumer takes items from its own lane and steals
+ * from the other lanes when its own lane runs empty.  Unlike the FifoChannel,
+ * producers and consumers do not contend for a single lock, which matters for
+ * many consumers and short jobs.  Per lane, items are processed in FIFO order;
+ * there is no global order.
+ *
+ * The total number of queued items is bounded by maximal_length.  The bound is
+ * soft: concurrent producers can exceed it by one item each.
+ *
+ * Consumers only touch the shared lock and condition variables when they run
+ * out of work; producers only when consumers are asleep.
+ */
+template <class T>
+class WorkStealingQueue : SingleCopy {
+ public:
+  WorkStealingQueue(const unsigned num_lanes, const size_t maximal_length)
+    : num_lanes_(num_lanes)
+    , maximal_length_(maximal_length)
+    , lanes_(new Lane[num_lanes])
+  {
+    assert(num_lanes > 0);
+    assert(maximal_length > 0);
+    atomic_init32(&num_items_);
+    atomic_init32(&num_idle_consumers_);
+    atomic_init32(&num_blocked_producers_);
+    atomic_init32(&next_lane_);
+    int retval = pthread_mutex_init(&lock_sleep_, NULL);
+    assert(retval == 0);
+    retval = pthread_cond_init(&cond_items_, NULL);
+    assert(retval == 0);
+    retval = pthread_cond_init(&cond_space_, NULL);
+    assert(retval == 0);
+  }
+
+  ~WorkStealingQueue() {
+    delete[] lanes_;
+    pthread_cond_destroy(&cond_space_);
+    pthread_cond_destroy(&cond_items_);
+    pthread_mutex_destroy(&lock_sleep_);
+  }
+
+  /**
+   * Blocks while the queue is full
+   */
+  void Push(const T &item) {
+    WaitForSpace();
+    Lane *lane = &lanes_[NextLane()];
+    pthread_mutex_lock(&lane->lock);
+    lane->items.push_back(item);
+    pthread_mutex_unlock(&lane->lock);
+    atomic_inc32(&num_items_);
+    WakeConsumers(false);
+  }
+
+  /**
+   * Spreads the items over the lanes with one lock acquisition per lane.  The
+   * batch is taken as a whole, i.e. it can exceed the maximal length.
+   */
+  void PushBatch(const std::vector<T> &items) {
+    if (items.empty())
+      return;
+    WaitForSpace();
+    const unsigned first_lane = NextLane();
+    const unsigned num_used_lanes =
+      (items.size() < num_lanes_) ? items.size() : num_lanes_;
+    for (unsigned i = 0; i < num_used_lanes; ++i) {
+      Lane *lane = &lanes_[(first_lane + i) % num_lanes_];
+      pthread_mutex_lock(&lane->lock);
+      for (size_t j = i; j < items.size(); j += num_used_lanes)
+        lane->items.push_back(items[j]);
+      pthread_mutex_unlock(&lane->lock);
+    }
+    atomic_xadd32(&num_items_, static_cast<int32_t>(items.size()));
+    WakeConsumers(true);
+  }
+
+  /**
+   * Takes an item from the given lane or, if empty, from another lane.  Blocks
+   * until an item is available.
+   */
+  T Pop(const unsigned lane_id) {
+    assert(lane_id < num_lanes_);
+    unsigned num_spins = 0;
+    while (true) {
+      if (atomic_read32(&num_items_) == 0) {
+        // Short jobs are often followed by more jobs; waiting a little is
+        // cheaper than going to sleep and being woken up
+        if (num_spins++ < kMaxSpins) {
+          sched_yield();
+          continue;
+        }
+        pthread_mutex_lock(&lock_sleep_);
+        atomic_inc32(&num_idle_consumers_);
+        while (atomic_read32(&num_items_) == 0)
+          pthread_cond_wait(&cond_items_, &lock_sleep_);
+        atomic_dec32(&num_idle_consumers_);
+        pthread_mutex_unlock(&lock_sleep_);
+      }
+
+      for (unsigned i = 0; i < num_lanes_; ++i) {
+        Lane *lane = &lanes_[(lane_id + i) % num_lanes_];
+        pthread_mutex_lock(&lane->lock);
+        if (!lane->items.empty()) {
+          T item = lane->items.front();
+          lane->items.pop_front();
+          pthread_mutex_unlock(&lane->lock);
+          atomic_dec32(&num_items_);
+          WakeProducers();
+          return item;
+        }
+        pthread_mutex_unlock(&lane->lock);
+      }
+    }
+  }
+
+  /**
+   * Removes all queued items
+   *
+   * @return  number of dropped items
+   */
+  unsigned Drop() {
+    unsigned num_dropped = 0;
+    for (unsigned i = 0; i < num_lanes_; ++i) {
+      pthread_mutex_lock(&lanes_[i].lock);
+      num_dropped += lanes_[i].items.size();
+      lanes_[i].items.clear();
+      pthread_mutex_unlock(&lanes_[i].lock);
+    }
+    atomic_xadd32(&num_items_, -static_cast<int32_t>(num_dropped));
+    WakeProducers();
+    return num_dropped;
+  }
+
+  size_t GetItemCount() { return atomic_read32(&num_items_); }
+  size_t GetMaximalItemCount() const { return maximal_length_; }
+  unsigned num_lanes() const { return num_lanes_; }
+
+ private:
+  /**
+   * Number of times an idle consumer yields before it goes to sleep
+   */
+  static const unsigned kMaxSpins = 16;
+
+  struct Lane {
+    Lane() {
+      int retval = pthread_mutex_init(&lock, NULL);
+      assert(retval == 0);
+    }
+    ~Lane() { pthread_mutex_destroy(&lock); }
+    pthread_mutex_t lock;
+    std::deque<T> items;
+  };
+
+  unsigned NextLane() {
+    return static_cast<uint32_t>(atomic_xadd32(&next_lane_, 1)) % num_lanes_;
+  }
+
+  /**
+   * The idle counters are changed under lock_sleep_ before the sleeping
+   * thread re-checks num_items_.  Since the atomic operations are full
+   * barriers, either the sleeping thread sees the new item count or the
+   * waking thread sees the idle counter and signals under lock_sleep_.
+   */
+  void WakeConsumers(const bool all) {
+    if (atomic_read32(&num_idle_consumers_) == 0)
+      return;
+    pthread_mutex_lock(&lock_sleep_);
+    if (all)
+      pthread_cond_broadcast(&cond_items_);
+    else
+      pthread_cond_signal(&cond_items_);
+    pthread_mutex_unlock(&lock_sleep_);
+  }
+
+  void WakeProducers() {
+    if (atomic_read32(&num_blocked_producers_) == 0)
+      return;
+    pthread_mutex_lock(&lock_sleep_);
+    pthread_cond_broadcast(&cond_space_);
+    pthread_mutex_unlock(&lock_sleep_);
+  }
+
+  void WaitForSpace() {
+    if (static_cast<size_t>(atomic_read32(&num_items_)) < maximal_length_)
+      return;
+    pthread_mutex_lock(&lock_sleep_);
+    atomic_inc32(&num_blocked_producers_);
+    while (static_cast<size_t>(atomic_read32(&num_items_)) >= maximal_length_)
+      pthread_cond_wait(&cond_space_, &lock_sleep_);
+    atomic_dec32(&num_blocked_producers_);
+    pthread_mutex_unlock(&lock_sleep_);
+  }
+
+  const unsigned num_lanes_;
+  const size_t maximal_length_;
+  Lane *lanes_;
+  atomic_int32 num_items_;
+  atomic_int32 num_idle_consumers_;
+  atomic_int32 num_blocked_producers_;
+  atomic_int32 next_lane_;
+
+  pthread_mutex_t lock_sleep_;
+  pthread_cond_t cond_items_;
+  pthread_cond_t cond_space_;
+};
+
+#ifdef CVMFS_NAMESPACE_GUARD
+}  // namespace CVMFS_NAMESPACE_GUARD
+#endif
+
+#endif  // CVMFS_UTIL_WORK_STEALING_H_
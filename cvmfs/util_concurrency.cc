@@ -6,8 +6,13 @@
 #include "util_concurrency.h"
 
 #include <unistd.h>
+#ifndef __APPLE__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 
 #include <cassert>
+#include <cstdlib>
 
 #ifdef CVMFS_NAMESPACE_GUARD
 namespace CVMFS_NAMESPACE_GUARD {
@@ -57,6 +62,134 @@ void Signal::Wakeup() {
   assert(retval == 0);
 }
 
+
+//------------------------------------------------------------------------------
+
+
+#ifdef __APPLE__
+
+Completion::Completion() : fired_(false) {
+  int retval = pthread_mutex_init(&lock_, NULL);
+  assert(retval == 0);
+  retval = pthread_cond_init(&cond_, NULL);
+  assert(retval == 0);
+}
+
+
+Completion::~Completion() {
+  pthread_cond_destroy(&cond_);
+  pthread_mutex_destroy(&lock_);
+}
+
+
+void Completion::Fire() {
+  MutexLockGuard guard(lock_);
+  fired_ = true;
+  int retval = pthread_cond_signal(&cond_);
+  assert(retval == 0);
+}
+
+
+void Completion::Wait() {
+  MutexLockGuard guard(lock_);
+  while (!fired_) {
+    int retval = pthread_cond_wait(&cond_, &lock_);
+    assert(retval == 0);
+  }
+  fired_ = false;
+}
+
+#else  // Linux
+
+Completion::Completion() {
+  atomic_init32(&state_);
+}
+
+
+Completion::~Completion() { }
+
+
+/**
+ * The futex is only woken if the waiter announced that it sleeps.  The waiter
+ * might return (and destroy the object) before FUTEX_WAKE is issued, which is
+ * harmless because the kernel does not access the futex word on wake.
+ */
+void Completion::Fire() {
+  int32_t state;
+  do {
+    state = atomic_read32(&state_);
+  } while (!atomic_cas32(&state_, state, kStateFired));
+  if (state == kStateSleeping) {
+    syscall(SYS_futex, &state_, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+}
+
+
+void Completion::Wait() {
+  while (!atomic_cas32(&state_, kStateFired, kStateIdle)) {
+    if (atomic_cas32(&state_, kStateIdle, kStateSleeping) ||
+        (atomic_read32(&state_) == kStateSleeping))
+    {
+      // Returns immediately if the state changed in the meantime
+      syscall(SYS_futex, &state_, FUTEX_WAIT_PRIVATE, kStateSleeping,
+              NULL, NULL, 0);
+    }
+  }
+}
+
+#endif
+
+
+//------------------------------------------------------------------------------
+
+
+StripedRwLock::StripedRwLock() : write_locked_(false) {
+  void *area;
+  int retval = posix_memalign(&area, kCacheLineSize,
+                              kNumStripes * sizeof(Stripe));
+  assert(retval == 0);
+  stripes_ = reinterpret_cast<Stripe *>(area);
+  for (unsigned i = 0; i < kNumStripes; ++i) {
+    retval = pthread_rwlock_init(&stripes_[i].lock, NULL);
+    assert(retval == 0);
+  }
+}
+
+
+StripedRwLock::~StripedRwLock() {
+  for (unsigned i = 0; i < kNumStripes; ++i)
+    pthread_rwlock_destroy(&stripes_[i].lock);
+  free(stripes_);
+}
+
+
+/**
+ * Stripes are always taken in the same order, so that concurrent writers do
+ * not deadlock.
+ */
+void StripedRwLock::WriteLock() {
+  for (unsigned i = 0; i < kNumStripes; ++i) {
+    int retval = pthread_rwlock_wrlock(&stripes_[i].lock);
+    assert(retval == 0);
+  }
+  write_locked_ = true;
+}
+
+
+void StripedRwLock::Unlock() {
+  int retval;
+  if (write_locked_) {
+    write_locked_ = false;
+    for (unsigned i = kNumStripes; i > 0; --i) {
+      retval = pthread_rwlock_unlock(&stripes_[i - 1].lock);
+      assert(retval == 0);
+    }
+    return;
+  }
+  retval = pthread_rwlock_unlock(&stripes_[GetStripeIdx()].lock);
+  assert(retval == 0);
+}
+
 #ifdef CVMFS_NAMESPACE_GUARD
 }  // namespace CVMFS_NAMESPACE_GUARD
 #endif
@@ -6,6 +6,7 @@
 #define CVMFS_UTIL_CONCURRENCY_H_
 
 #include <pthread.h>
+#include <stdint.h>
 
 #include <cassert>
 #include <queue>
@@ -15,6 +16,7 @@
 #include "atomic.h"
 #include "util/async.h"
 #include "util/single_copy.h"
+#include "util/work_stealing.h"
 
 #ifdef CVMFS_NAMESPACE_GUARD
 namespace CVMFS_NAMESPACE_GUARD {
@@ -431,6 +433,110 @@ class Signal : SingleCopy {
 };
 
 
+/**
+ * Wakes up a single thread that waits for a request to be processed by another
+ * thread, e.g. a download handed to the download I/O thread.  Fire() can happen
+ * before or after Wait().  Wait() consumes the event, so that the object can be
+ * reused for the next request.
+ *
+ * On Linux, the completion is a futex on a single word: it needs no file
+ * descriptor and neither side enters the kernel unless the waiter actually
+ * sleeps.  Other platforms fall back to a mutex and a condition variable.
+ */
+class Completion : SingleCopy {
+ public:
+  Completion();
+  ~Completion();
+  void Fire();
+  void Wait();
+
+ private:
+#ifdef __APPLE__
+  bool fired_;
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_;
+#else
+  enum State {
+    kStateIdle = 0,
+    kStateFired,
+    kStateSleeping
+  };
+  atomic_int32 state_;
+#endif
+};
+
+
+//
+// -----------------------------------------------------------------------------
+//
+
+
+/**
+ * Data that different threads change concurrently should sit on separate cache
+ * lines.
+ */
+const unsigned kCacheLineSize = 64;
+
+/**
+ * Maps the calling thread to one of num_slots slots, e.g. the stripes of a
+ * lock or the shards of a counter.  The same thread always maps to the same
+ * slot.
+ */
+inline unsigned GetThreadSlot(const unsigned num_slots) {
+  uint64_t tid = (uint64_t)(pthread_self());  // NOLINT
+  // Thread ids are often aligned addresses, shuffle the bits
+  tid ^= tid >> 33;
+  tid *= 0xff51afd7ed558ccdULL;
+  tid ^= tid >> 33;
+  return tid % num_slots;
+}
+
+
+/**
+ * A reader-writer lock for read-mostly data structures that are accessed by
+ * many threads, such as the catalog tree.  The lock consists of several
+ * stripes, each of them a pthread rwlock on its own cache line.  Readers only
+ * take the stripe that belongs to the calling thread, so that concurrent
+ * readers on different cores do not write to the same cache line.  Writers
+ * take all the stripes in order, which makes write locking more expensive.
+ *
+ * Unlock() works for both readers and writers.  Like for pthread rwlocks, a
+ * thread must not take the lock recursively.
+ */
+class StripedRwLock : SingleCopy {
+ public:
+  static const unsigned kNumStripes = 32;
+
+  StripedRwLock();
+  ~StripedRwLock();
+
+  void ReadLock() {
+    int retval = pthread_rwlock_rdlock(&stripes_[GetStripeIdx()].lock);
+    assert(retval == 0);
+  }
+  void WriteLock();
+  void Unlock();
+
+ private:
+  struct Stripe {
+    pthread_rwlock_t lock;
+    char padding[kCacheLineSize - (sizeof(pthread_rwlock_t) % kCacheLineSize)];
+  };
+
+  /**
+   * The same thread always maps to the same stripe.
+   */
+  static unsigned GetStripeIdx() { return GetThreadSlot(kNumStripes); }
+
+  Stripe *stripes_;
+  /**
+   * Only changed with all the stripes write-locked, so that a thread holding
+   * any of the stripes sees a consistent value.
+   */
+  bool write_locked_;
+};
+
+
 //
 // -----------------------------------------------------------------------------
 //
@@ -537,8 +643,8 @@ class ConcurrentWorkers : public Observable<typename WorkerT::returned_data> {
 
   /**
    * This is a simple wrapper structure to piggy-back control information on
-   * scheduled jobs. Job structures are scheduled into a central FIFO queue and
-   * are then processed concurrently by the workers.
+   * scheduled jobs. Job structures are scheduled into a WorkStealingQueue with
+   * one lane per worker and are then processed concurrently by the workers.
    */
   template <class DataT>
   struct Job {
@@ -548,8 +654,8 @@ class ConcurrentWorkers : public Observable<typename WorkerT::returned_data> {
     Job() :
       data(),
       is_death_sentence(true) {}
-    const DataT  data;               //!< job payload
-    const bool   is_death_sentence;  //!< death sentence flag
+    DataT  data;               //!< job payload
+    bool   is_death_sentence;  //!< death sentence flag
   };
   typedef Job<expected_data_t> WorkerJob;
   typedef Job<returned_data_t> CallbackJob;
@@ -703,9 +809,11 @@ class ConcurrentWorkers : public Observable<typename WorkerT::returned_data> {
    * until there is a new job available for processing.
    * THIS METHOD MUST ONLY BE CALLED INSIDE THE WORKER OBJECTS
    *
+   * @param worker_id  the worker's lane in the job queue, jobs are stolen from
+   *                   the other lanes if it is empty
    * @return  a job to be processed by a worker
    */
-  inline WorkerJob Acquire();
+  inline WorkerJob Acquire(const unsigned int worker_id);
 
   /**
    * Controls the asynchronous finishing of a job.
@@ -752,8 +860,9 @@ class ConcurrentWorkers : public Observable<typename WorkerT::returned_data> {
   pthread_t                callback_thread_;      //!< handles callback invokes
 
   // job queue
-  typedef FifoChannel<WorkerJob > JobQueue;
+  typedef WorkStealingQueue<WorkerJob > JobQueue;
   JobQueue                 jobs_queue_;
+  mutable atomic_int32     next_worker_id_;  //!< hands out the queue lanes
   mutable atomic_int32     jobs_pending_;
   mutable atomic_int32     jobs_failed_;
   mutable atomic_int64     jobs_processed_;
@@ -349,7 +349,7 @@ ConcurrentWorkers<WorkerT>::ConcurrentWorkers(
   initialized_(false),
   running_(false),
   workers_started_(0),
-  jobs_queue_(maximal_queue_length, maximal_queue_length / 4 + 1),
+  jobs_queue_(number_of_workers, maximal_queue_length),
   results_queue_(maximal_queue_length, 1)
 {
   assert(maximal_queue_length >= number_of_workers);
@@ -358,6 +358,7 @@ ConcurrentWorkers<WorkerT>::ConcurrentWorkers(
   atomic_init32(&jobs_pending_);
   atomic_init32(&jobs_failed_);
   atomic_init64(&jobs_processed_);
+  atomic_init32(&next_worker_id_);
 }
 
 
@@ -470,6 +471,9 @@ void* ConcurrentWorkers<WorkerT>::RunWorker(void *run_binding) {
     *(static_cast<WorkerRunBinding*>(run_binding));
   ConcurrentWorkers<WorkerT> *master         = binding.delegate;
   const worker_context_t     *worker_context = binding.worker_context;
+  // every worker takes its jobs primarily from its own lane of the job queue
+  const unsigned int          worker_id      =
+    atomic_xadd32(&master->next_worker_id_, 1);
 
   // boot up the worker object and make sure it works
   WorkerT worker(worker_context);
@@ -493,7 +497,7 @@ void* ConcurrentWorkers<WorkerT>::RunWorker(void *run_binding) {
   LogCvmfs(kLogConcurrency, kLogVerboseMsg, "Starting Worker...");
   while (master->IsRunning()) {
     // acquire a new job
-    WorkerJob job = master->Acquire();
+    WorkerJob job = master->Acquire(worker_id);
 
     // check if we need to terminate
     if (job.is_death_sentence)
@@ -577,10 +581,10 @@ void ConcurrentWorkers<WorkerT>::Schedule(WorkerJob job) {
     return;
   }
 
-  jobs_queue_.Enqueue(job);
   if (!job.is_death_sentence) {
     atomic_inc32(&jobs_pending_);
   }
+  jobs_queue_.Push(job);
 }
 
 
@@ -604,11 +608,11 @@ void ConcurrentWorkers<WorkerT>::ScheduleDeathSentences() {
 
 template <class WorkerT>
 typename ConcurrentWorkers<WorkerT>::WorkerJob
-  ConcurrentWorkers<WorkerT>::Acquire()
+  ConcurrentWorkers<WorkerT>::Acquire(const unsigned int worker_id)
 {
   // Note: This method is exclusively called inside the worker threads!
   //       Any other usage might produce undefined behavior.
-  return jobs_queue_.Dequeue();
+  return jobs_queue_.Pop(worker_id);
 }
 
 
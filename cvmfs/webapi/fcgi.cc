@@ -8,6 +8,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -19,11 +20,13 @@
 #include "logging.h"
 #include "platform.h"
 #include "util/posix.h"
+#include "util/string.h"
 
 using namespace std;  // NOLINT
 
 
 const unsigned FastCgi::kMaxContentLength = 64 * 1024 - 1;
+const unsigned FastCgi::kMaxRequests;
 const char *FastCgi::kValueMaxConns = "FCGI_MAX_CONNS";
 const char *FastCgi::kValueMaxReqs = "FCGI_MAX_REQS";
 const char *FastCgi::kValueMpxConns = "FCGI_MPXS_CONNS";
@@ -33,17 +36,33 @@ const char *FastCgi::kValueMpxConns = "FCGI_MPXS_CONNS";
  * The HTTP client has closed the connection prematurely.
  */
 void FastCgi::AbortRequest() {
-  if (request_id_ == -1)
-    return;
-  ReplyEndRequest(fd_transport_, request_id_, 1, kStatusReqComplete);
-  if (!keep_connection_) {
-    CloseConnection();
-  } else {
-    global_request_id_++;
-    request_id_ = -1;
-    keep_connection_ = false;
-    params_.clear();
+  FinishRequest(1, kStatusReqComplete);
+}
+
+
+/**
+ * Returns false if the listening socket fails.
+ */
+bool FastCgi::AcceptConnection() {
+  sockaddr_in addr_in;
+  socklen_t addr_len = sizeof(addr_in);
+  int fd_transport =
+    accept(fd_sock_, reinterpret_cast<struct sockaddr *>(&addr_in),
+           &addr_len);
+  if (fd_transport < 0)
+    return (errno == EINTR) || (errno == ECONNABORTED);
+
+  // For UNIX sockets, addr_in is garbage (but FCGI_WEB_SERVER_ADDRS is not
+  // defined)
+  if (is_tcp_socket_ && !CheckValidSource(addr_in)) {
+    LogCvmfs(kLogCvmfs, kLogSyslogErr,
+             "FastCGI connection from invalid source %s",
+             inet_ntoa(addr_in.sin_addr));
+    close(fd_transport);
+    return true;
   }
+  connections_.push_back(fd_transport);
+  return true;
 }
 
 
@@ -88,25 +107,36 @@ bool FastCgi::CheckValidSource(const struct sockaddr_in &addr_in) {
 }
 
 
-void FastCgi::CloseConnection() {
-  if (fd_transport_ != -1) {
-    close(fd_transport_);
-    fd_transport_ = -1;
-    request_id_ = -1;
-    keep_connection_ = false;
+/**
+ * Closes the connection and drops all its requests.
+ */
+void FastCgi::CloseConnection(int fd_transport) {
+  close(fd_transport);
+  connections_.erase(
+    std::remove(connections_.begin(), connections_.end(), fd_transport),
+    connections_.end());
+  for (map<uint64_t, Request>::iterator i = requests_.begin();
+       i != requests_.end(); )
+  {
+    if (i->second.fd_transport == fd_transport) {
+      if (i->first == current_request_id_)
+        current_request_id_ = 0;
+      requests_.erase(i++);
+    } else {
+      ++i;
+    }
   }
-  global_request_id_++;
-  params_.clear();
 }
 
 
 string FastCgi::DumpParams() {
-  if (request_id_ == -1)
+  Request *request = GetCurrentRequest();
+  if (request == NULL)
     return "";
 
   string result;
-  for (map<string, string>::const_iterator i = params_.begin(),
-       i_end = params_.end(); i != i_end; ++i)
+  for (map<string, string>::const_iterator i = request->params.begin(),
+       i_end = request->params.end(); i != i_end; ++i)
   {
     result += i->first + "=" + i->second + "\n";
   }
@@ -119,41 +149,82 @@ string FastCgi::DumpParams() {
  * handled through HTTP error return codes.
  */
 void FastCgi::EndRequest(uint32_t exit_code) {
-  if (request_id_ == -1)
-    return;
-
-  ReplyEndRequest(fd_transport_, request_id_, exit_code, kStatusReqComplete);
-  if (!keep_connection_) {
-    CloseConnection();
-  } else {
-    global_request_id_++;
-    request_id_ = -1;
-    keep_connection_ = false;
-    params_.clear();
-  }
+  FinishRequest(exit_code, kStatusReqComplete);
 }
 
 
 FastCgi::FastCgi()
     : fd_sock_(kCgiListnsockFileno)
     , is_tcp_socket_(false)
-    , fd_transport_(-1)
-    , global_request_id_(1)
-    , request_id_(-1)
-    , keep_connection_(false)
+    , next_connection_(0)
+    , next_request_id_(1)
+    , current_request_id_(0)
 { }
 
 
 FastCgi::~FastCgi() {
+  for (unsigned i = 0; i < connections_.size(); ++i)
+    close(connections_[i]);
   if (is_tcp_socket_)
     close(fd_sock_);
 }
 
 
+FastCgi::Request *FastCgi::FindRequest(
+  int fd_transport,
+  uint16_t request_id,
+  uint64_t *id)
+{
+  for (map<uint64_t, Request>::iterator i = requests_.begin(),
+       i_end = requests_.end(); i != i_end; ++i)
+  {
+    if ((i->second.fd_transport == fd_transport) &&
+        (i->second.request_id == request_id))
+    {
+      *id = i->first;
+      return &i->second;
+    }
+  }
+  return NULL;
+}
+
+
+/**
+ * Ends the current request.  Unless the web server asked to keep the
+ * connection, the connection is closed, too.
+ */
+void FastCgi::FinishRequest(uint32_t exit_code, unsigned char status) {
+  Request *request = GetCurrentRequest();
+  if (request == NULL)
+    return;
+
+  ReplyEndRequest(request->fd_transport, request->request_id, exit_code,
+                  status);
+  if (!request->keep_connection) {
+    CloseConnection(request->fd_transport);
+  } else {
+    requests_.erase(current_request_id_);
+  }
+  current_request_id_ = 0;
+}
+
+
+FastCgi::Request *FastCgi::GetCurrentRequest() {
+  map<uint64_t, Request>::iterator i = requests_.find(current_request_id_);
+  if (i == requests_.end())
+    return NULL;
+  return &i->second;
+}
+
+
 bool FastCgi::GetParam(const string &key, string *value) {
-  map<string, string>::const_iterator it = params_.find(key);
-  if (it != params_.end()) {
+  Request *request = GetCurrentRequest();
+  if (request == NULL)
+    return false;
+  map<string, string>::const_iterator it = request->params.find(key);
+  if (it != request->params.end()) {
     *value = it->second;
+    return true;
   }
   return false;
 }
@@ -201,7 +272,7 @@ bool FastCgi::MkTcpSocket(const string &ip4_address, uint16_t port) {
     return false;
   }
 
-  retval = listen(fd_sock_, 4);
+  retval = listen(fd_sock_, SOMAXCONN);
   if (retval != 0) {
     close(fd_sock_);
     fd_sock_ = -1;
@@ -215,8 +286,9 @@ bool FastCgi::MkTcpSocket(const string &ip4_address, uint16_t port) {
 
 /**
  * Protocol processing as far as the application is not involved.  What is
- * received for stdin is pointed to in buf and length.  A different id is set
- * for every request.
+ * received for stdin is pointed to in buf and length; buf is valid until the
+ * next call.  A different id is set for every request, the request of the
+ * event becomes the current request.
  */
 FastCgi::Event FastCgi::NextEvent(
   unsigned char **buf,
@@ -225,122 +297,72 @@ FastCgi::Event FastCgi::NextEvent(
 {
   *buf = NULL;
   *length = 0;
-  *id = global_request_id_;
+  *id = 0;
 
+  vector<struct pollfd> watch_fds;
   while (true) {
-    if (fd_transport_ == -1) {
-      sockaddr_in addr_in;
-      socklen_t addr_len = sizeof(addr_in);
-      fd_transport_ =
-        accept(fd_sock_, reinterpret_cast<struct sockaddr *>(&addr_in),
-               &addr_len);
-      if (fd_transport_ < 0)
-        return kEventExit;
-
-      // For UNIX sockets, addr_in is garbage (but FCGI_WEB_SERVER_ADDRS is not
-      // defined)
-      if (is_tcp_socket_ && !CheckValidSource(addr_in)) {
-        LogCvmfs(kLogCvmfs, kLogSyslogErr,
-                 "FastCGI connection from invalid source %s",
-                 inet_ntoa(addr_in.sin_addr));
-        close(fd_transport_);
-        fd_transport_ = -1;
+    watch_fds.resize(connections_.size() + 1);
+    watch_fds[0].fd = fd_sock_;
+    for (unsigned i = 0; i < connections_.size(); ++i)
+      watch_fds[i + 1].fd = connections_[i];
+    for (unsigned i = 0; i < watch_fds.size(); ++i) {
+      watch_fds[i].events = POLLIN | POLLPRI;
+      watch_fds[i].revents = 0;
+    }
+    int retval = poll(&watch_fds[0], watch_fds.size(), -1);
+    if (retval < 0) {
+      if (errno == EINTR)
         continue;
-      }
+      return kEventExit;
     }
 
-    Header header;
-    if (!ReadHeader(fd_transport_, &header)) {
-      CloseConnection();
-      return kEventTransportError;
+    if (watch_fds[0].revents != 0) {
+      if ((watch_fds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) ||
+          !AcceptConnection())
+      {
+        return kEventExit;
+      }
     }
 
-    uint16_t role;
-    bool keep_connection;
-    switch (header.type) {
-      case kTypeValues:
-        if (!ProcessValues(header)) {
-          CloseConnection();
-          return kEventTransportError;
-        }
-        break;
-
-      case kTypeBegin:
-        if (!ReadBeginBody(fd_transport_, &role, &keep_connection)) {
-          CloseConnection();
-          return kEventTransportError;
-        }
-        if (request_id_ != -1) {
-          ReplyEndRequest(fd_transport_, header.request_id, 0,
-                          kStatusCantMpxConn);
-          continue;
-        }
-        if (role != kRoleResponder) {
-          ReplyEndRequest(fd_transport_, header.request_id, 0,
-                          kStatusUnknownRole);
-          if (!keep_connection) CloseConnection();
-          continue;
-        }
-        keep_connection_ = keep_connection;
-        request_id_ = header.request_id;
-        break;
-
-      case kTypeAbort:
-        if (request_id_ != header.request_id) {
-          CloseConnection();
-          return kEventTransportError;
-        }
-        return kEventAbortReq;
-        break;
-
-      case kTypeParams:
-        if (request_id_ != header.request_id) {
-          CloseConnection();
-          return kEventTransportError;
-        }
-        if (!ReadParams(header)) {
-          CloseConnection();
-          return kEventTransportError;
-        }
-        break;
-
-      case kTypeStdin:
-        if (request_id_ != header.request_id) {
-          CloseConnection();
-          return kEventTransportError;
-        }
-        if (!ReadContent(header.content_length, header.padding_length)) {
-          CloseConnection();
-          return kEventTransportError;
-        }
-        *buf = content_buf_;
-        *length = header.content_length;
-        return kEventStdin;
-        break;
-
-      case kTypeData:
-        // Only used in Filter role
-        CloseConnection();
-        return kEventTransportError;
-
-      default:
-        // Unexpected type
-        if (header.request_id == 0) {
-          ReplyUnknownType(fd_transport_, header.type);
-        } else {
-          // we did not sign up for other application records
-          CloseConnection();
-          return kEventTransportError;
-        }
+    // One record per round, the connections take turns.  Processing a record
+    // can close connections, so the remaining ones are polled again.
+    const unsigned num_connections = watch_fds.size() - 1;
+    for (unsigned i = 0; i < num_connections; ++i) {
+      const unsigned idx = 1 + (next_connection_ + i) % num_connections;
+      if (watch_fds[idx].revents == 0)
         continue;
-    }  // switch (header.type)
-  }  // accept loop
+      next_connection_ = idx;
+      Event event;
+      if (ProcessRecord(watch_fds[idx].fd, buf, length, id, &event))
+        return event;
+      break;
+    }
+  }
 
   // Never here
   return kEventExit;
 }
 
 
+bool FastCgi::ParseParams(Request *request) {
+  const string &data = request->raw_params;
+  const unsigned len = data.length();
+  unsigned pos = 0;
+  while (pos < len) {
+    unsigned nparsed;
+    string key;
+    string value;
+    if (!ParseKvPair(data.data() + pos, len - pos, &nparsed, &key, &value))
+      return false;
+    pos += nparsed;
+    if (key.length() > 0)
+      request->params[key] = value;
+  }
+  request->raw_params.clear();
+  return true;
+}
+
+
 bool FastCgi::ParseKvPair(
   const char *data,
   unsigned len,
@@ -393,13 +415,13 @@ bool FastCgi::ParseKvPair(
 /**
  * Reads the kTypeValues body and replies with a kTypeValuesResult record.
  */
-bool FastCgi::ProcessValues(const Header &request_header) {
+bool FastCgi::ProcessValues(int fd_transport, const Header &request_header) {
   unsigned nbytes = request_header.content_length +
                     request_header.padding_length;
   // Can't use content_buf_ because kTypeValues requests can come anytime
   char *data = reinterpret_cast<char *>(alloca(nbytes));
   if (nbytes > 0) {
-    int received = read(fd_transport_, data, nbytes);
+    ssize_t received = SafeRead(fd_transport, data, nbytes);
     if ((received < 0) || (static_cast<unsigned>(received) != nbytes))
       return false;
   }
@@ -424,18 +446,18 @@ bool FastCgi::ProcessValues(const Header &request_header) {
     pos += nparsed;
 
     if (!max_conns && (key == kValueMaxConns)) {
-      ret_pos +=
-        AddShortKv(key, "1", ret_buf_len - ret_pos, ret_buf + ret_pos);
+      ret_pos += AddShortKv(key, StringifyInt(kMaxRequests),
+                            ret_buf_len - ret_pos, ret_buf + ret_pos);
       max_conns = true;
     }
     if (!max_reqs && (key == kValueMaxReqs)) {
-      ret_pos +=
-        AddShortKv(key, "1", ret_buf_len - ret_pos, ret_buf + ret_pos);
+      ret_pos += AddShortKv(key, StringifyInt(kMaxRequests),
+                            ret_buf_len - ret_pos, ret_buf + ret_pos);
       max_reqs = true;
     }
     if (!mpx_conns && (key == kValueMpxConns)) {
       ret_pos +=
-        AddShortKv(key, "0", ret_buf_len - ret_pos, ret_buf + ret_pos);
+        AddShortKv(key, "1", ret_buf_len - ret_pos, ret_buf + ret_pos);
       mpx_conns = true;
     }
   }
@@ -445,19 +467,142 @@ bool FastCgi::ProcessValues(const Header &request_header) {
   FlattenUint16(ret_pos,
                 &ret_header.content_length_b1,
                 &ret_header.content_length_b0);
-  SafeWrite(fd_transport_, &ret_header, sizeof(ret_header));
-  SafeWrite(fd_transport_, ret_buf, ret_pos);
+  SafeWrite(fd_transport, &ret_header, sizeof(ret_header));
+  SafeWrite(fd_transport, ret_buf, ret_pos);
   return true;
 }
 
 
+/**
+ * Reads one record from the connection.  Returns true if the record results
+ * in an event for the application.
+ */
+bool FastCgi::ProcessRecord(
+  int fd_transport,
+  unsigned char **buf,
+  unsigned *length,
+  uint64_t *id,
+  Event *event)
+{
+  *event = kEventTransportError;
+  Header header;
+  if (!ReadHeader(fd_transport, &header)) {
+    CloseConnection(fd_transport);
+    return true;
+  }
+
+  uint64_t request_id;
+  Request *request = NULL;
+  if (header.request_id != kNullRequestId)
+    request = FindRequest(fd_transport, header.request_id, &request_id);
+
+  uint16_t role;
+  bool keep_connection;
+  switch (header.type) {
+    case kTypeValues:
+      if (!ProcessValues(fd_transport, header)) {
+        CloseConnection(fd_transport);
+        return true;
+      }
+      return false;
+
+    case kTypeBegin:
+      if (!ReadBeginBody(fd_transport, &role, &keep_connection) ||
+          (request != NULL))
+      {
+        CloseConnection(fd_transport);
+        return true;
+      }
+      if (role != kRoleResponder) {
+        ReplyEndRequest(fd_transport, header.request_id, 0,
+                        kStatusUnknownRole);
+        if (!keep_connection) CloseConnection(fd_transport);
+        return false;
+      }
+      if (requests_.size() >= kMaxRequests) {
+        ReplyEndRequest(fd_transport, header.request_id, 0,
+                        kStatusOverloaded);
+        if (!keep_connection) CloseConnection(fd_transport);
+        return false;
+      }
+      request = &requests_[next_request_id_++];
+      request->fd_transport = fd_transport;
+      request->request_id = header.request_id;
+      request->keep_connection = keep_connection;
+      return false;
+
+    case kTypeAbort:
+      if (request == NULL) {
+        CloseConnection(fd_transport);
+        return true;
+      }
+      current_request_id_ = *id = request_id;
+      *event = kEventAbortReq;
+      return true;
+
+    case kTypeParams:
+      if ((request == NULL) ||
+          !ReadContent(fd_transport, header.content_length,
+                       header.padding_length))
+      {
+        CloseConnection(fd_transport);
+        return true;
+      }
+      // The params stream ends with an empty record
+      if (header.content_length > 0) {
+        request->raw_params += string(reinterpret_cast<char *>(content_buf_),
+                                      header.content_length);
+      } else if (!ParseParams(request)) {
+        CloseConnection(fd_transport);
+        return true;
+      }
+      return false;
+
+    case kTypeStdin:
+      if ((request == NULL) ||
+          !ReadContent(fd_transport, header.content_length,
+                       header.padding_length))
+      {
+        CloseConnection(fd_transport);
+        return true;
+      }
+      *buf = content_buf_;
+      *length = header.content_length;
+      current_request_id_ = *id = request_id;
+      *event = kEventStdin;
+      return true;
+
+    case kTypeData:
+      // Only used in Filter role
+      CloseConnection(fd_transport);
+      return true;
+
+    default:
+      // Unexpected type
+      if (header.request_id == kNullRequestId) {
+        if (!ReadContent(fd_transport, header.content_length,
+                         header.padding_length))
+        {
+          CloseConnection(fd_transport);
+          return true;
+        }
+        ReplyUnknownType(fd_transport, header.type);
+        return false;
+      }
+      // we did not sign up for other application records
+      CloseConnection(fd_transport);
+      return true;
+  }  // switch (header.type)
+}
+
+
 bool FastCgi::ReadBeginBody(
   int fd_transport,
   uint16_t *role,
   bool *keep_connection)
 {
   BeginRequestBody body;
-  int nbytes = read(fd_transport, &body, sizeof(body));
+  ssize_t nbytes = SafeRead(fd_transport, &body, sizeof(body));
   if (nbytes != sizeof(body))
     return false;
 
@@ -467,12 +612,15 @@ bool FastCgi::ReadBeginBody(
 }
 
 
-bool FastCgi::ReadContent(uint16_t content_length, unsigned char padding_length)
+bool FastCgi::ReadContent(
+  int fd_transport,
+  uint16_t content_length,
+  unsigned char padding_length)
 {
   uint32_t nbytes = static_cast<uint32_t>(content_length) +
                     static_cast<uint32_t>(padding_length);
   if (nbytes > 0) {
-    int received = read(fd_transport_, content_buf_, nbytes);
+    ssize_t received = SafeRead(fd_transport, content_buf_, nbytes);
     return ((received >= 0) && (static_cast<unsigned>(received) == nbytes));
   }
   return true;
@@ -481,7 +629,7 @@ bool FastCgi::ReadContent(uint16_t content_length, unsigned char padding_length)
 
 bool FastCgi::ReadHeader(int fd_transport, Header *header) {
   RawHeader raw_header;
-  int nbytes = read(fd_transport, &raw_header, sizeof(raw_header));
+  ssize_t nbytes = SafeRead(fd_transport, &raw_header, sizeof(raw_header));
   if (nbytes != sizeof(raw_header))
     return false;
   if (raw_header.version != kVersion1)
@@ -497,42 +645,6 @@ bool FastCgi::ReadHeader(int fd_transport, Header *header) {
 }
 
 
-bool FastCgi::ReadParams(const Header &first_header) {
-  uint16_t content_length = first_header.content_length;
-  if (!ReadContent(content_length, first_header.padding_length))
-  {
-    return false;
-  }
-  string data;
-  while (content_length > 0) {
-    data += string(reinterpret_cast<char *>(content_buf_), content_length);
-
-    Header header;
-    if (!ReadHeader(fd_transport_, &header))
-      return false;
-    if ((header.type != kTypeParams) || (header.request_id != request_id_))
-      return false;
-    content_length = header.content_length;
-    if (!ReadContent(content_length, header.padding_length))
-      return false;
-  }
-
-  const unsigned len = data.length();
-  unsigned pos = 0;
-  while (pos < len) {
-    unsigned nparsed;
-    string key;
-    string value;
-    if (!ParseKvPair(data.data() + pos, len - pos, &nparsed, &key, &value))
-      return false;
-    pos += nparsed;
-    if (key.length() > 0)
-      params_[key] = value;
-  }
-  return true;
-}
-
-
 void FastCgi::ReplyEndRequest(
   int fd_transport,
   uint16_t req_id,
@@ -547,6 +659,9 @@ void FastCgi::ReplyEndRequest(
   FlattenUint16(req_id,
                 &reply.raw_header.request_id_b1,
                 &reply.raw_header.request_id_b0);
+  FlattenUint16(sizeof(reply.body),
+                &reply.raw_header.content_length_b1,
+                &reply.raw_header.content_length_b0);
   reply.body.protocol_status = status;
   reply.body.app_status_b3 =
     static_cast<unsigned char>((exit_code >> 24) & 0xff);
@@ -565,15 +680,16 @@ bool FastCgi::ReplyStream(
   unsigned length)
 {
   assert((type == kTypeStdout) || (type == kTypeStderr));
+  Request *request = GetCurrentRequest();
+  assert(request != NULL);
+  const int fd_transport = request->fd_transport;
 
   RawHeader raw_header;
   raw_header.type = type;
-  FlattenUint16(request_id_,
+  FlattenUint16(request->request_id,
                 &raw_header.request_id_b1, &raw_header.request_id_b0);
-  if (length == 0) {
-    return (write(fd_transport_, &raw_header, sizeof(raw_header)) ==
-            sizeof(raw_header));
-  }
+  if (length == 0)
+    return SafeWrite(fd_transport, &raw_header, sizeof(raw_header));
 
   unsigned written = 0;
   while (written < length) {
@@ -581,11 +697,9 @@ bool FastCgi::ReplyStream(
     FlattenUint16(nbytes,
                   &raw_header.content_length_b1,
                   &raw_header.content_length_b0);
-    int retval = write(fd_transport_, &raw_header, sizeof(raw_header));
-    if (retval != sizeof(raw_header))
+    if (!SafeWrite(fd_transport, &raw_header, sizeof(raw_header)))
       return false;
-    retval = write(fd_transport_, data + written, nbytes);
-    if ((retval < 0) || (static_cast<unsigned>(retval) != nbytes))
+    if (!SafeWrite(fd_transport, data + written, nbytes))
       return false;
     written += nbytes;
   }
@@ -599,6 +713,9 @@ void FastCgi::ReplyUnknownType(int fd_transport, unsigned char received_type) {
     UnknownTypeBody body;
   } reply;
   reply.raw_header.type = kTypeUnknown;
+  FlattenUint16(sizeof(reply.body),
+                &reply.raw_header.content_length_b1,
+                &reply.raw_header.content_length_b0);
   reply.body.type = received_type;
   SafeWrite(fd_transport, &reply, sizeof(reply));
 }
@@ -620,11 +737,24 @@ void FastCgi::ReturnNotFound() {
 }
 
 
+/**
+ * Makes the request with the given id the current one, e.g. to answer it after
+ * events of other requests.  Returns false if the request is gone because it
+ * was finished or its connection was closed.
+ */
+bool FastCgi::SelectRequest(uint64_t id) {
+  if (requests_.find(id) == requests_.end())
+    return false;
+  current_request_id_ = id;
+  return true;
+}
+
+
 /**
  * The HTTP body.  Indicate the end of the stream with finish.
  */
 bool FastCgi::SendData(const string &data, bool finish) {
-  if (request_id_ == -1)
+  if (GetCurrentRequest() == NULL)
     return false;
 
   if (!ReplyStream(kTypeStdout, reinterpret_cast<const unsigned char *>(
@@ -643,7 +773,7 @@ bool FastCgi::SendData(const string &data, bool finish) {
  * finish.
  */
 bool FastCgi::SendError(const string &data, bool finish) {
-  if (request_id_ == -1)
+  if (GetCurrentRequest() == NULL)
     return false;
 
   if (!ReplyStream(kTypeStderr, reinterpret_cast<const unsigned char *>(
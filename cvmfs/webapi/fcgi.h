@@ -11,12 +11,21 @@
 #include <cstring>
 #include <map>
 #include <string>
+#include <vector>
 
 // TODO(jblomer): deal with termination signals
 
 /**
- * Implements a simple FastCGI responder role.  This responder cannot multi-
- * plex connections.  See http://www.fastcgi.com/devkit/doc/fcgi-spec.html
+ * Implements a simple FastCGI responder role.
+ * See http://www.fastcgi.com/devkit/doc/fcgi-spec.html
+ *
+ * The responder is event-driven: it serves several web server connections at
+ * the same time and multiplexes requests on a connection (FCGI_MPXS_CONNS).
+ * Every request has its own context.  The functions that answer a request
+ * (GetParam, SendData, EndRequest, ...) refer to the request of the last
+ * event.  A request that is answered later is selected again by its id with
+ * SelectRequest().
+ *
  * It is supposed to be used in the following way.  Don't forget to sanitize
  * everything you get out from fcgi.
  *
@@ -30,8 +39,8 @@
  *       fcgi.AbortRequest();
  *       break;
  *     case FastCgi::kEventStdin:
- *       // Use id to detect if this new input is part of the same request than
- *       // the previous one.
+ *       // Use id to detect to which request this new input belongs.  The
+ *       // input of several requests can be interleaved.
  *       // Process buf; if length == 0, the input stream is finished
  *       // For POST: compare CONTENT-LENGTH with actual stream length
  *       fcgi.GetParam("PARAMETER", ...) ...
@@ -64,9 +73,12 @@ class FastCgi {
   void ReturnBadRequest(const std::string &reason);
   void ReturnNotFound();
   Event NextEvent(unsigned char **buf, unsigned *length, uint64_t *id);
+  bool SelectRequest(uint64_t id);
 
   bool GetParam(const std::string &key, std::string *value);
   std::string DumpParams();
+  unsigned num_requests() const { return requests_.size(); }
+  unsigned num_connections() const { return connections_.size(); }
 
   bool MkTcpSocket(const std::string &ip4_address, uint16_t port);
 
@@ -74,6 +86,11 @@ class FastCgi {
   static const int kCgiListnsockFileno = 0;
 
   static const unsigned kMaxContentLength;
+  /**
+   * Concurrent requests over all connections, further requests are answered
+   * with kStatusOverloaded.  Reported for FCGI_MAX_CONNS and FCGI_MAX_REQS.
+   */
+  static const unsigned kMaxRequests = 256;
 
   /**
    * Value for version component of Header.
@@ -129,7 +146,7 @@ class FastCgi {
   enum ProtocolStatus {
     kStatusReqComplete = 0,
     kStatusCantMpxConn = 1,
-    kStatusOverloaded = 2,  // unused in this implementation
+    kStatusOverloaded = 2,
     kStatusUnknownRole = 3,
   };
 
@@ -178,6 +195,21 @@ class FastCgi {
     unsigned char reserved[3];
   };
 
+  /**
+   * The context of a request between its begin record and EndRequest()
+   */
+  struct Request {
+    Request() : fd_transport(-1), request_id(0), keep_connection(false) { }
+    int fd_transport;
+    uint16_t request_id;
+    bool keep_connection;
+    /**
+     * Collects the params stream until its terminating empty record
+     */
+    std::string raw_params;
+    std::map<std::string, std::string> params;
+  };
+
   struct UnknownTypeBody {
     UnknownTypeBody() : type(0) {
       memset(reserved, 0, 7);
@@ -187,12 +219,19 @@ class FastCgi {
   };
 
   bool CheckValidSource(const struct sockaddr_in &addr_in);
-  void CloseConnection();
+  bool AcceptConnection();
+  void CloseConnection(int fd_transport);
+  void FinishRequest(uint32_t exit_code, unsigned char status);
+  Request *FindRequest(int fd_transport, uint16_t request_id, uint64_t *id);
+  Request *GetCurrentRequest();
+  bool ProcessRecord(int fd_transport, unsigned char **buf, unsigned *length,
+                     uint64_t *id, Event *event);
 
   bool ReadHeader(int fd_transport, Header *header);
-  bool ReadContent(uint16_t content_length, unsigned char padding_length);
+  bool ReadContent(int fd_transport, uint16_t content_length,
+                   unsigned char padding_length);
   bool ReadBeginBody(int fd_transport, uint16_t *role, bool *keep_connection);
-  bool ReadParams(const Header &first_header);
+  bool ParseParams(Request *request);
 
   bool ParseKvPair(const char *data, unsigned len,
                    unsigned *nparsed, std::string *key, std::string *value);
@@ -203,7 +242,7 @@ class FastCgi {
   bool ReplyStream(unsigned char type,
                    const unsigned char *data, unsigned length);
 
-  bool ProcessValues(const Header &request_header);
+  bool ProcessValues(int fd_transport, const Header &request_header);
 
   inline uint16_t MkUint16(const unsigned char b1, const unsigned char b0) {
     return (static_cast<uint16_t>(b1) << 8) + static_cast<uint16_t>(b0);
@@ -226,18 +265,30 @@ class FastCgi {
   bool is_tcp_socket_;
 
   unsigned char content_buf_[64 * 1024 + 255];
-  int fd_transport_;
+  /**
+   * The open web server connections
+   */
+  std::vector<int> connections_;
+  /**
+   * Round-robin start for reading records from the connections
+   */
+  unsigned next_connection_;
 
   /**
    * Returned by NextEvent().  Has a different value for every request.  Never
    * zero, so the application can initialize its id state to zero and detect
    * if a stdin event is for the same request or a new one.
    */
-  uint64_t global_request_id_;
+  uint64_t next_request_id_;
 
-  int request_id_;
-  bool keep_connection_;
-  std::map<std::string, std::string> params_;
+  /**
+   * Maps the ids handed out by NextEvent() to the active requests
+   */
+  std::map<uint64_t, Request> requests_;
+  /**
+   * The request that the reply functions refer to, zero if there is none
+   */
+  uint64_t current_request_id_;
 };
 
 #endif  // CVMFS_WEBAPI_FCGI_H_
@@ -0,0 +1,515 @@
+/**
+ * This file is part of the CernVM File System
+ */
+
+#include "webapi/geo.h"
+
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "logging.h"
+#include "util/string.h"
+#include "webapi/fcgi.h"
+
+using namespace std;  // NOLINT
+
+const unsigned GeoSorter::kCacheTtl;
+const unsigned GeoSorter::kNegativeCacheTtl;
+const unsigned GeoSorter::kMaxCacheEntries;
+
+
+namespace {
+
+uint64_t LoadUint64(const unsigned char *bytes) {
+  uint64_t result = 0;
+  for (unsigned i = 0; i < 8; ++i)
+    result = (result << 8) | bytes[i];
+  return result;
+}
+
+/**
+ * Mask that keeps the first prefix bits of a 64 bit word
+ */
+uint64_t PrefixMask(const unsigned prefix) {
+  if (prefix == 0)
+    return 0;
+  if (prefix >= 64)
+    return ~uint64_t(0);
+  return ~(~uint64_t(0) >> prefix);
+}
+
+GeoDb::Address MaskAddress(const GeoDb::Address &address,
+                           const unsigned prefix)
+{
+  GeoDb::Address result;
+  result.hi = address.hi & PrefixMask(prefix);
+  result.lo = address.lo & PrefixMask((prefix > 64) ? prefix - 64 : 0);
+  return result;
+}
+
+}  // anonymous namespace
+
+
+bool GeoDb::ParseAddress(const string &str, Address *address) {
+  unsigned char bytes[16];
+  memset(bytes, 0, sizeof(bytes));
+  if (str.find(':') != string::npos) {
+    if (inet_pton(AF_INET6, str.c_str(), bytes) != 1)
+      return false;
+  } else {
+    // IPv4-mapped IPv6 address ::ffff:a.b.c.d
+    if (inet_pton(AF_INET, str.c_str(), bytes + 12) != 1)
+      return false;
+    bytes[10] = bytes[11] = 0xff;
+  }
+  address->hi = LoadUint64(bytes);
+  address->lo = LoadUint64(bytes + 8);
+  return true;
+}
+
+
+string GeoDb::GetSubnet(const string &str) {
+  Address address;
+  if (!ParseAddress(str, &address))
+    return "";
+  const bool is_ipv4 = (str.find(':') == string::npos);
+  const Address subnet = MaskAddress(address, is_ipv4 ? 96 + 24 : 48);
+  char buf[34];
+  snprintf(buf, sizeof(buf), "%016" PRIx64 "%016" PRIx64,
+           subnet.hi, subnet.lo);
+  return string(buf);
+}
+
+
+bool GeoDb::AddNetwork(const string &cidr, const Location &location) {
+  const size_t slash = cidr.find('/');
+  if (slash == string::npos)
+    return false;
+  const string ip = cidr.substr(0, slash);
+  uint64_t prefix;
+  if (!String2Uint64Parse(cidr.substr(slash + 1), &prefix))
+    return false;
+  const bool is_ipv4 = (ip.find(':') == string::npos);
+  if (is_ipv4)
+    prefix += 96;
+  if (prefix > 128)
+    return false;
+
+  Address address;
+  if (!ParseAddress(ip, &address))
+    return false;
+  Network network;
+  network.first = MaskAddress(address, prefix);
+  network.last.hi = network.first.hi | ~PrefixMask(prefix);
+  network.last.lo = network.first.lo |
+                    ~PrefixMask((prefix > 64) ? prefix - 64 : 0);
+  network.latitude = location.latitude;
+  network.longitude = location.longitude;
+  if (!networks_.empty() && (network < networks_[networks_.size() - 1]))
+    sorted_ = false;
+  networks_.push_back(network);
+  return true;
+}
+
+
+bool GeoDb::Lookup(const string &address, Location *location) {
+  Network needle;
+  if (!ParseAddress(address, &needle.first))
+    return false;
+  if (!sorted_) {
+    sort(networks_.begin(), networks_.end());
+    sorted_ = true;
+  }
+
+  // The networks do not overlap, the candidate is the last network that
+  // starts at or before the address
+  vector<Network>::const_iterator iter =
+    upper_bound(networks_.begin(), networks_.end(), needle);
+  if (iter == networks_.begin())
+    return false;
+  --iter;
+  if (iter->last < needle.first)
+    return false;
+  location->latitude = iter->latitude;
+  location->longitude = iter->longitude;
+  return true;
+}
+
+
+bool GeoDb::LoadCsv(const string &path) {
+  FILE *f = fopen(path.c_str(), "r");
+  if (f == NULL) {
+    LogCvmfs(kLogCvmfs, kLogSyslogWarn, "failed to open geo database %s",
+             path.c_str());
+    return false;
+  }
+
+  string line;
+  int col_network = -1;
+  int col_latitude = -1;
+  int col_longitude = -1;
+  if (GetLineFile(f, &line)) {
+    const vector<string> header = SplitString(Trim(line), ',');
+    for (unsigned i = 0; i < header.size(); ++i) {
+      if (header[i] == "network") col_network = i;
+      else if (header[i] == "latitude") col_latitude = i;
+      else if (header[i] == "longitude") col_longitude = i;
+    }
+  }
+  if ((col_network < 0) || (col_latitude < 0) || (col_longitude < 0)) {
+    LogCvmfs(kLogCvmfs, kLogSyslogWarn, "invalid geo database header in %s",
+             path.c_str());
+    fclose(f);
+    return false;
+  }
+  const unsigned min_columns =
+    max(col_network, max(col_latitude, col_longitude)) + 1;
+
+  unsigned num_skipped = 0;
+  while (GetLineFile(f, &line)) {
+    const vector<string> columns = SplitString(Trim(line), ',');
+    // Networks without coordinates are useless for sorting
+    if ((columns.size() < min_columns) ||
+        columns[col_latitude].empty() || columns[col_longitude].empty())
+    {
+      num_skipped++;
+      continue;
+    }
+    const Location location(strtod(columns[col_latitude].c_str(), NULL),
+                            strtod(columns[col_longitude].c_str(), NULL));
+    if (!AddNetwork(columns[col_network], location))
+      num_skipped++;
+  }
+  fclose(f);
+  LogCvmfs(kLogCvmfs, kLogDebug, "loaded geo database %s (%u networks, "
+           "%u skipped lines)", path.c_str(), size(), num_skipped);
+  return true;
+}
+
+
+GeoDb *GeoDb::Load(const vector<string> &csv_paths) {
+  GeoDb *db = new GeoDb();
+  bool loaded = false;
+  for (unsigned i = 0; i < csv_paths.size(); ++i)
+    loaded = db->LoadCsv(csv_paths[i]) || loaded;
+  if (!loaded) {
+    delete db;
+    return NULL;
+  }
+  return db;
+}
+
+
+//------------------------------------------------------------------------------
+
+
+GeoSorter::GeoSorter(GeoDb *db)
+  : db_(db)
+  , num_cache_hits_(0)
+{ }
+
+
+GeoSorter::~GeoSorter() {
+  delete db_;
+}
+
+
+/**
+ * Great-circle arc between two locations on the unit sphere
+ */
+double GeoSorter::Distance(const GeoDb::Location &a, const GeoDb::Location &b)
+{
+  if ((a.latitude == b.latitude) && (a.longitude == b.longitude))
+    return 0.0;
+  const double degrees_to_radians = M_PI / 180.0;
+  const double phi1 = (90.0 - a.latitude) * degrees_to_radians;
+  const double phi2 = (90.0 - b.latitude) * degrees_to_radians;
+  const double theta1 = a.longitude * degrees_to_radians;
+  const double theta2 = b.longitude * degrees_to_radians;
+  double cosine = sin(phi1) * sin(phi2) * cos(theta1 - theta2) +
+                  cos(phi1) * cos(phi2);
+  // Guard against rounding errors
+  cosine = max(-1.0, min(1.0, cosine));
+  return acos(cosine);
+}
+
+
+/**
+ * Allowed characters of host names and addresses, see cvmfs_geo.py
+ */
+bool GeoSorter::IsValidName(const string &name) {
+  if (name.length() >= 256)
+    return false;
+  for (unsigned i = 0; i < name.length(); ++i) {
+    const char c = name[i];
+    if (!(((c >= '0') && (c <= '9')) || ((c >= 'a') && (c <= 'z')) ||
+          ((c >= 'A') && (c <= 'Z')) || (c == '.') || (c == ':') ||
+          (c == '-')))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool GeoSorter::ResolveName(const string &name, string *address) {
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_protocol = IPPROTO_TCP;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo *result = NULL;
+  if (getaddrinfo(name.c_str(), NULL, &hints, &result) != 0)
+    return false;
+
+  // Prefer IPv4 because the database is more accurate
+  struct addrinfo *selected = result;
+  for (struct addrinfo *info = result; info != NULL; info = info->ai_next) {
+    if (info->ai_family == AF_INET) {
+      selected = info;
+      break;
+    }
+  }
+  char buf[INET6_ADDRSTRLEN];
+  const char *ntop = NULL;
+  if (selected->ai_family == AF_INET) {
+    struct sockaddr_in *addr =
+      reinterpret_cast<struct sockaddr_in *>(selected->ai_addr);
+    ntop = inet_ntop(AF_INET, &addr->sin_addr, buf, sizeof(buf));
+  } else if (selected->ai_family == AF_INET6) {
+    struct sockaddr_in6 *addr =
+      reinterpret_cast<struct sockaddr_in6 *>(selected->ai_addr);
+    ntop = inet_ntop(AF_INET6, &addr->sin6_addr, buf, sizeof(buf));
+  }
+  freeaddrinfo(result);
+  if (ntop == NULL)
+    return false;
+  *address = buf;
+  return true;
+}
+
+
+/**
+ * Resolves and locates a server name or address.  The result, including
+ * failures, is cached for kCacheTtl seconds.
+ */
+const GeoSorter::NameEntry &GeoSorter::LookupName(const string &name) {
+  const time_t now = time(NULL);
+  map<string, NameEntry>::iterator iter = names_.find(name);
+  if ((iter != names_.end()) && (iter->second.expires > now))
+    return iter->second;
+
+  if (names_.size() >= kMaxCacheEntries)
+    names_.clear();
+  NameEntry entry;
+  entry.expires = now + kCacheTtl;
+  if (IsValidName(name) && ResolveName(name, &entry.address))
+    entry.found = db_->Lookup(entry.address, &entry.location);
+  return names_[name] = entry;
+}
+
+
+/**
+ * Orders servers by their distance to the origin.  Servers that cannot be
+ * located go to the end, servers with the same distance keep their order.
+ * Returns false if none of the servers can be located.
+ */
+bool GeoSorter::SortServers(
+  const GeoDb::Location &origin,
+  const vector<string> &servers,
+  vector<unsigned> *indexes)
+{
+  bool one_good = false;
+  vector<pair<double, unsigned> > arcs;
+  for (unsigned i = 0; i < servers.size(); ++i) {
+    const NameEntry &entry = LookupName(servers[i]);
+    double arc = HUGE_VAL;
+    if (entry.found) {
+      one_good = true;
+      arc = Distance(origin, entry.location);
+    }
+    arcs.push_back(make_pair(arc, i));
+  }
+  stable_sort(arcs.begin(), arcs.end());
+
+  indexes->clear();
+  for (unsigned i = 0; i < arcs.size(); ++i)
+    indexes->push_back(arcs[i].second);
+  return one_good;
+}
+
+
+bool GeoSorter::DoSort(
+  const GeoDb::Location &origin,
+  const vector<string> &servers,
+  string *reply)
+{
+  vector<unsigned> indexes;
+  bool one_good;
+
+  const vector<string>::const_iterator iter_sep =
+    find(servers.begin(), servers.end(), "+PXYSEP+");
+  if (iter_sep != servers.end()) {
+    // First sort the proxies after the separator and, if at least one is
+    // known, sort the hosts before the separator relative to the closest proxy
+    // rather than to the client
+    const unsigned pxysep = iter_sep - servers.begin();
+    const vector<string> proxies(iter_sep + 1, servers.end());
+    const vector<string> hosts(servers.begin(), iter_sep);
+    vector<unsigned> proxy_indexes;
+    GeoDb::Location reference = origin;
+    if (SortServers(origin, proxies, &proxy_indexes)) {
+      const NameEntry &closest = LookupName(proxies[proxy_indexes[0]]);
+      if (closest.found)
+        reference = closest.location;
+    }
+    one_good = SortServers(reference, hosts, &indexes);
+    for (unsigned i = 0; i < proxy_indexes.size(); ++i)
+      indexes.push_back(pxysep + 1 + proxy_indexes[i]);
+    // The index of the separator is appended for backward compatibility, so
+    // that clients always receive as many indexes as they sent names
+    indexes.push_back(pxysep);
+  } else {
+    one_good = SortServers(origin, servers, &indexes);
+  }
+
+  if (!one_good) {
+    *reply = "no server addr found in database";
+    return false;
+  }
+  vector<string> numbers;
+  for (unsigned i = 0; i < indexes.size(); ++i)
+    numbers.push_back(StringifyInt(indexes[i] + 1));
+  *reply = JoinStrings(numbers, ",") + "\n";
+  return true;
+}
+
+
+bool GeoSorter::Sort(
+  const string &path_info,
+  const string &remote_addr,
+  const string &forwarded_for,
+  string *reply)
+{
+  const size_t slash = path_info.find('/');
+  if (slash == string::npos) {
+    *reply = "no slash in geo path";
+    return false;
+  }
+  const string caching_string = path_info.substr(0, slash);
+  const string server_list = path_info.substr(slash + 1);
+
+  // If the caching string resolves to a known address, it is used as the
+  // client address.  This prevents poisoning the proxy caches of others by
+  // using the name of their proxy.
+  string client_addr;
+  GeoDb::Location origin;
+  bool found_origin = false;
+  if (caching_string.find('.') != string::npos) {
+    const NameEntry &entry = LookupName(caching_string);
+    if (entry.found) {
+      client_addr = entry.address;
+      origin = entry.location;
+      found_origin = true;
+    }
+  }
+  if (!found_origin) {
+    client_addr = remote_addr;
+    if (!forwarded_for.empty()) {
+      size_t start = forwarded_for.rfind(' ');
+      if (start == string::npos)
+        start = forwarded_for.rfind(',');
+      client_addr = (start == string::npos) ?
+                    forwarded_for : forwarded_for.substr(start + 1);
+    }
+  }
+
+  // Clients of the same subnet share the reply
+  const string subnet = GeoDb::GetSubnet(client_addr);
+  const string key = subnet + "/" + server_list;
+  const time_t now = time(NULL);
+  if (!subnet.empty()) {
+    map<string, ReplyEntry>::const_iterator iter = replies_.find(key);
+    if ((iter != replies_.end()) && (iter->second.expires > now)) {
+      num_cache_hits_++;
+      *reply = iter->second.reply;
+      return iter->second.success;
+    }
+  }
+
+  ReplyEntry entry;
+  if (!found_origin && IsValidName(client_addr))
+    found_origin = db_->Lookup(client_addr, &origin);
+  if (found_origin) {
+    entry.success = DoSort(origin, SplitString(server_list, ','),
+                           &entry.reply);
+  } else {
+    entry.reply = "remote addr not found in database";
+  }
+  entry.expires = now + (entry.success ? kCacheTtl : kNegativeCacheTtl);
+  if (!subnet.empty()) {
+    if (replies_.size() >= kMaxCacheEntries)
+      replies_.clear();
+    replies_[key] = entry;
+  }
+  *reply = entry.reply;
+  return entry.success;
+}
+
+
+//------------------------------------------------------------------------------
+
+
+void GeoUriHandler::OnData(
+  const uint64_t id,
+  unsigned char * /*buf*/,
+  unsigned length)
+{
+  // GET requests have no content, the end of stdin concludes the request
+  if (length > 0)
+    return;
+  if (!fcgi_->SelectRequest(id))
+    return;
+
+  string request_uri;
+  string remote_addr;
+  string forwarded_for;
+  fcgi_->GetParam("REQUEST_URI", &request_uri);
+  fcgi_->GetParam("REMOTE_ADDR", &remote_addr);
+  fcgi_->GetParam("HTTP_X_FORWARDED_FOR", &forwarded_for);
+  request_uri = request_uri.substr(0, request_uri.find('?'));
+  const string geo_tag = "/geo/";
+  const size_t pos_geo = request_uri.find(geo_tag);
+  if (pos_geo == string::npos) {
+    fcgi_->ReturnNotFound();
+    return;
+  }
+  const string path_info = request_uri.substr(pos_geo + geo_tag.length());
+
+  string reply;
+  if (sorter_->Sort(path_info, remote_addr, forwarded_for, &reply)) {
+    fcgi_->SendData("Status: 200 OK\r\n"
+                    "Content-Type: text/plain\r\n"
+                    "Cache-Control: max-age=" +
+                    StringifyInt(GeoSorter::kCacheTtl) + "\r\n\r\n" + reply,
+                    true);
+  } else {
+    fcgi_->SendData("Status: 400 Bad Request\r\n"
+                    "Content-Type: text/plain\r\n"
+                    "Cache-Control: max-age=" +
+                    StringifyInt(GeoSorter::kNegativeCacheTtl) + "\r\n\r\n"
+                    "Bad Request: " + reply + "\n", true);
+  }
+  fcgi_->EndRequest(0);
+}
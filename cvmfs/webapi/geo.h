@@ -0,0 +1,163 @@
+/**
+ * This file is part of the CernVM File System
+ */
+
+#ifndef CVMFS_WEBAPI_GEO_H_
+#define CVMFS_WEBAPI_GEO_H_
+
+#include <stdint.h>
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "webapi/uri_map.h"
+
+/**
+ * In-memory database that maps IPv4 and IPv6 networks to geographic
+ * coordinates.  It is loaded from the CSV network blocks files of the MaxMind
+ * GeoLite2 City database, which have the columns "network", "latitude", and
+ * "longitude" among others.  IPv4 addresses are stored as IPv4-mapped IPv6
+ * addresses.
+ */
+class GeoDb {
+ public:
+  struct Location {
+    Location() : latitude(0.0), longitude(0.0) { }
+    Location(double lat, double lon) : latitude(lat), longitude(lon) { }
+    double latitude;
+    double longitude;
+  };
+
+  struct Address {
+    Address() : hi(0), lo(0) { }
+    bool operator <(const Address &other) const {
+      return (hi < other.hi) || ((hi == other.hi) && (lo < other.lo));
+    }
+    bool operator ==(const Address &other) const {
+      return (hi == other.hi) && (lo == other.lo);
+    }
+    uint64_t hi;
+    uint64_t lo;
+  };
+
+  /**
+   * Returns NULL if none of the files can be read.
+   */
+  static GeoDb *Load(const std::vector<std::string> &csv_paths);
+  static bool ParseAddress(const std::string &str, Address *address);
+  /**
+   * The /24 network of IPv4 addresses and the /48 network of IPv6 addresses,
+   * which are assumed to be at the same location.  Empty if str is not an
+   * address.
+   */
+  static std::string GetSubnet(const std::string &str);
+
+  GeoDb() : sorted_(true) { }
+  bool AddNetwork(const std::string &cidr, const Location &location);
+  bool Lookup(const std::string &address, Location *location);
+  unsigned size() const { return networks_.size(); }
+
+ private:
+  struct Network {
+    bool operator <(const Network &other) const { return first < other.first; }
+    Address first;
+    Address last;
+    float latitude;
+    float longitude;
+  };
+
+  bool LoadCsv(const std::string &path);
+
+  std::vector<Network> networks_;
+  bool sorted_;
+};
+
+
+/**
+ * Implements the Geo-API of the stratum 1s: orders a list of servers by their
+ * distance to the client.  The query is of the form
+ * <caching string>/<server list>; see cvmfs_geo.py for the detailed semantics.
+ * The locations of the server names and the replies for every client subnet
+ * are cached.
+ *
+ * Not thread-safe, it is supposed to be used by the single-threaded FastCGI
+ * responder.
+ */
+class GeoSorter {
+ public:
+  static const unsigned kCacheTtl = 3600;
+  static const unsigned kNegativeCacheTtl = 300;
+  static const unsigned kMaxCacheEntries = 100000;
+
+  explicit GeoSorter(GeoDb *db);
+  virtual ~GeoSorter();
+
+  /**
+   * Returns false and the reason in reply if the request is invalid.  On
+   * success, reply is the ordered list of 1-based server indexes.
+   */
+  bool Sort(const std::string &path_info, const std::string &remote_addr,
+            const std::string &forwarded_for, std::string *reply);
+
+  uint64_t num_cache_hits() const { return num_cache_hits_; }
+
+ protected:
+  /**
+   * Resolves a host name to an address, preferring IPv4
+   */
+  virtual bool ResolveName(const std::string &name, std::string *address);
+
+ private:
+  struct NameEntry {
+    NameEntry() : found(false), expires(0) { }
+    bool found;
+    std::string address;
+    GeoDb::Location location;
+    time_t expires;
+  };
+
+  struct ReplyEntry {
+    ReplyEntry() : success(false), expires(0) { }
+    bool success;
+    std::string reply;
+    time_t expires;
+  };
+
+  static bool IsValidName(const std::string &name);
+  static double Distance(const GeoDb::Location &a, const GeoDb::Location &b);
+
+  const NameEntry &LookupName(const std::string &name);
+  bool SortServers(const GeoDb::Location &origin,
+                   const std::vector<std::string> &servers,
+                   std::vector<unsigned> *indexes);
+  bool DoSort(const GeoDb::Location &origin,
+              const std::vector<std::string> &servers,
+              std::string *reply);
+
+  GeoDb *db_;
+  std::map<std::string, NameEntry> names_;
+  /**
+   * Maps the client subnet and the server list to the reply
+   */
+  std::map<std::string, ReplyEntry> replies_;
+  uint64_t num_cache_hits_;
+};
+
+
+/**
+ * Serves /cvmfs/<repo>/api/v1.0/geo/<caching string>/<server list>
+ */
+class GeoUriHandler : public UriHandler {
+ public:
+  GeoUriHandler(FastCgi *fcgi, GeoSorter *sorter)
+    : UriHandler(fcgi), sorter_(sorter) { }
+  virtual ~GeoUriHandler() { }
+  virtual void OnData(const uint64_t id, unsigned char *buf, unsigned length);
+
+ private:
+  GeoSorter *sorter_;
+};
+
+#endif  // CVMFS_WEBAPI_GEO_H_
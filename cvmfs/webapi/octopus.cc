@@ -5,13 +5,18 @@
 #include <cstdio>
 #include <cstdlib>
 #include <string>
+#include <vector>
 
 #include "sanitizer.h"
+#include "util/pointer.h"
 #include "webapi/fcgi.h"
+#include "webapi/geo.h"
 #include "webapi/uri_map.h"
 
 using namespace std;  // NOLINT
 
+const char *kGeoDbDir = "/var/lib/cvmfs-server/geo";
+
 int main(int argc, char **argv) {
   // FILE *f = fopen("/tmp/mycgi.log", "w");
   FastCgi fcgi;
@@ -25,6 +30,22 @@ int main(int argc, char **argv) {
 
   UriMap uri_map;
   uri_map.Register("/cvmfs/*/api/v1/lease", NULL);
+
+  // The geo database is kept in memory, sorted replies are cached per client
+  // subnet
+  vector<string> geo_db_paths;
+  geo_db_paths.push_back(string(kGeoDbDir) + "/GeoLite2-City-Blocks-IPv4.csv");
+  geo_db_paths.push_back(string(kGeoDbDir) + "/GeoLite2-City-Blocks-IPv6.csv");
+  UniquePtr<GeoSorter> geo_sorter;
+  UniquePtr<GeoUriHandler> geo_handler;
+  GeoDb *geo_db = GeoDb::Load(geo_db_paths);
+  if (geo_db != NULL) {
+    geo_sorter = new GeoSorter(geo_db);
+    geo_handler = new GeoUriHandler(&fcgi, geo_sorter.weak_ref());
+    uri_map.Register("/cvmfs/*/api/v1.0/geo/*/*", geo_handler.weak_ref());
+  } else {
+    fprintf(stderr, "geo database not available, geo API disabled\n");
+  }
   UriHandler *handler;
 
   unsigned char *buf;
@@ -34,6 +55,8 @@ int main(int argc, char **argv) {
   string request_uri;
   string content;
   sanitizer::UriSanitizer uri_sanitizer;
+  sanitizer::GeoUriSanitizer geo_uri_sanitizer;
+  sanitizer::InputSanitizer *sanitizer;
   while ((event = fcgi.NextEvent(&buf, &length, &id)) != FastCgi::kEventExit) {
     switch (event) {
       case FastCgi::kEventAbortReq:
@@ -49,11 +72,16 @@ int main(int argc, char **argv) {
         fprintf(f, "%s", string((char *)buf, length).c_str());
         fflush(f);*/
         fcgi.GetParam("REQUEST_URI", &request_uri);
-        if (!uri_sanitizer.IsValid(request_uri)) {
+        handler = uri_map.Route(request_uri);
+        // Geo-API requests contain server lists, the handler validates the
+        // individual names
+        sanitizer = &uri_sanitizer;
+        if ((handler != NULL) && (handler == geo_handler.weak_ref()))
+          sanitizer = &geo_uri_sanitizer;
+        if (!sanitizer->IsValid(request_uri)) {
           fcgi.ReturnBadRequest("Invalid URI");
           break;
         }
-        handler = uri_map.Route(request_uri);
         if (handler != NULL) {
           handler->OnData(id, buf, length);
         } else {
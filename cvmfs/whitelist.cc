@@ -5,6 +5,8 @@
 #include "cvmfs_config.h"
 #include "whitelist.h"
 
+#include <alloca.h>
+
 #include <algorithm>
 #include <cassert>
 #include <cstring>
@@ -15,6 +17,7 @@
 #include "signature.h"
 #include "smalloc.h"
 #include "util/string.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
@@ -23,6 +26,11 @@ namespace whitelist {
 const int Whitelist::kFlagVerifyRsa     = 0x01;
 const int Whitelist::kFlagVerifyPkcs7   = 0x02;
 const int Whitelist::kFlagVerifyCaChain = 0x04;
+const unsigned Whitelist::kVerifiedCacheTtl = 3600;
+const unsigned Whitelist::kVerifiedCacheMaxEntries = 64;
+
+Whitelist::VerifiedCache Whitelist::verified_cache_;
+pthread_mutex_t Whitelist::lock_verified_cache_ = PTHREAD_MUTEX_INITIALIZER;
 
 
 void Whitelist::CopyBuffers(unsigned *plain_size, unsigned char **plain_buf,
@@ -74,11 +82,22 @@ Failures Whitelist::VerifyLoadedCertificate() const {
   for (unsigned i = 0; i < fingerprints_.size(); ++i) {
     shash::Algorithms algorithm = fingerprints_[i].algorithm;
     if (signature_manager_->HashCertificate(algorithm) == fingerprints_[i]) {
+      if (verified_from_cache_)
+        return kFailOk;
       if (verification_flags_ & kFlagVerifyCaChain) {
         bool retval = signature_manager_->VerifyCaChain();
         if (!retval)
           return kFailBadCaChain;
       }
+      if (!verified_key_.IsNull()) {
+        VerifiedEntry entry;
+        entry.fingerprints = fingerprints_;
+        entry.expires = expires_;
+        entry.valid_until = std::min(expires_,
+          static_cast<time_t>(time(NULL) + kVerifiedCacheTtl));
+        entry.verification_flags = verification_flags_;
+        StoreVerified(verified_key_, entry);
+      }
       return kFailOk;
     }
   }
@@ -97,6 +116,7 @@ Failures Whitelist::Load(const std::string &base_url) {
   const string whitelist_url = base_url + string("/.cvmfswhitelist");
   download::JobInfo download_whitelist(&whitelist_url,
                                        false, probe_hosts, NULL);
+  download_whitelist.priority = download::kPriorityMetadata;
   retval_dl = download_manager_->Fetch(&download_whitelist);
   if (retval_dl != download::kFailOk)
     return kFailLoad;
@@ -110,20 +130,13 @@ Failures Whitelist::Load(const std::string &base_url) {
   if (retval_wl != kFailOk)
     return retval_wl;
 
-  if (verification_flags_ & kFlagVerifyRsa) {
-    retval_b = signature_manager_->VerifyLetter(plain_buf_, plain_size_, true);
-    if (!retval_b) {
-      LogCvmfs(kLogCvmfs, kLogDebug, "failed to verify repository whitelist");
-      return kFailBadSignature;
-    }
-  }
-
   if (verification_flags_ & kFlagVerifyPkcs7) {
     // Load the separate whitelist pkcs7 structure
     const string whitelist_pkcs7_url =
       base_url + string("cvmfswhitelist.pkcs7");
     download::JobInfo download_whitelist_pkcs7(&whitelist_pkcs7_url, false,
                                                probe_hosts, NULL);
+    download_whitelist_pkcs7.priority = download::kPriorityMetadata;
     retval_dl = download_manager_->Fetch(&download_whitelist_pkcs7);
     if (retval_dl != download::kFailOk)
       return kFailLoadPkcs7;
@@ -132,7 +145,32 @@ Failures Whitelist::Load(const std::string &base_url) {
       return kFailEmptyPkcs7;
     pkcs7_buf_ = reinterpret_cast<unsigned char *>
       (download_whitelist_pkcs7.destination_mem.data);
+  }
+
+  // The certificate is loaded by the caller before the whitelist
+  const shash::Any verified_key = MakeVerifiedKey();
+  VerifiedEntry entry;
+  if (LookupVerified(verified_key, &entry)) {
+    LogCvmfs(kLogSignature, kLogDebug,
+             "certificate and whitelist of %s have been verified before",
+             fqrn_.c_str());
+    fingerprints_ = entry.fingerprints;
+    expires_ = entry.expires;
+    verification_flags_ = entry.verification_flags;
+    verified_from_cache_ = true;
+    status_ = kStAvailable;
+    return kFailOk;
+  }
+
+  if (verification_flags_ & kFlagVerifyRsa) {
+    retval_b = signature_manager_->VerifyLetter(plain_buf_, plain_size_, true);
+    if (!retval_b) {
+      LogCvmfs(kLogCvmfs, kLogDebug, "failed to verify repository whitelist");
+      return kFailBadSignature;
+    }
+  }
 
+  if (verification_flags_ & kFlagVerifyPkcs7) {
     unsigned char *extracted_whitelist;
     unsigned extracted_whitelist_size;
     vector<string> alt_uris;
@@ -180,11 +218,84 @@ Failures Whitelist::Load(const std::string &base_url) {
     }
   }
 
+  // Stored by VerifyLoadedCertificate() once the certificate is accepted
+  verified_key_ = verified_key;
   status_ = kStAvailable;
   return kFailOk;
 }
 
 
+/**
+ * The cache key covers everything the verification depends on: the
+ * repository name, the certificate, the trusted public keys, and the
+ * whitelist including its pkcs#7 envelope.
+ */
+shash::Any Whitelist::MakeVerifiedKey() {
+  const string certificate =
+    signature_manager_->HashCertificate(shash::kSha1).ToString();
+  const string pubkeys = signature_manager_->GetActivePubkeys();
+  const string sizes = fqrn_ + "|" + StringifyInt(certificate.length()) + "|" +
+    StringifyInt(pubkeys.length()) + "|" + StringifyInt(plain_size_) + "|" +
+    StringifyInt(pkcs7_size_) + "|";
+
+  shash::Any key(shash::kSha1);
+  shash::ContextPtr ctx(shash::kSha1);
+  ctx.buffer = alloca(ctx.size);
+  shash::Init(ctx);
+  shash::Update(reinterpret_cast<const unsigned char *>(sizes.data()),
+                sizes.length(), ctx);
+  shash::Update(reinterpret_cast<const unsigned char *>(certificate.data()),
+                certificate.length(), ctx);
+  shash::Update(reinterpret_cast<const unsigned char *>(pubkeys.data()),
+                pubkeys.length(), ctx);
+  shash::Update(plain_buf_, plain_size_, ctx);
+  if (pkcs7_size_ > 0)
+    shash::Update(pkcs7_buf_, pkcs7_size_, ctx);
+  shash::Final(ctx, &key);
+  return key;
+}
+
+
+bool Whitelist::LookupVerified(const shash::Any &key, VerifiedEntry *entry) {
+  MutexLockGuard guard(&lock_verified_cache_);
+  VerifiedCache::iterator i = verified_cache_.find(key);
+  if (i == verified_cache_.end())
+    return false;
+  if (time(NULL) > i->second.valid_until) {
+    verified_cache_.erase(i);
+    return false;
+  }
+  *entry = i->second;
+  return true;
+}
+
+
+void Whitelist::StoreVerified(const shash::Any &key,
+                              const VerifiedEntry &entry)
+{
+  MutexLockGuard guard(&lock_verified_cache_);
+  if (verified_cache_.size() >= kVerifiedCacheMaxEntries) {
+    const time_t now = time(NULL);
+    VerifiedCache::iterator i = verified_cache_.begin();
+    while (i != verified_cache_.end()) {
+      if (now > i->second.valid_until)
+        verified_cache_.erase(i++);
+      else
+        ++i;
+    }
+    if (verified_cache_.size() >= kVerifiedCacheMaxEntries)
+      verified_cache_.clear();
+  }
+  verified_cache_[key] = entry;
+}
+
+
+void Whitelist::ClearVerifiedCache() {
+  MutexLockGuard guard(&lock_verified_cache_);
+  verified_cache_.clear();
+}
+
+
 /**
  * Helps for the time being with whitelists valid until after Y2038 on 32 bit
  * systems.
@@ -315,6 +426,8 @@ Failures Whitelist::ParseWhitelist(const unsigned char *whitelist,
 
 void Whitelist::Reset() {
   status_ = kStNone;
+  verified_key_ = shash::Any();
+  verified_from_cache_ = false;
   fingerprints_.clear();
   expires_ = 0;
   verification_flags_ = 0;
@@ -351,7 +464,9 @@ Whitelist::Whitelist(const Whitelist &other) :
   status_(other.status_),
   fingerprints_(other.fingerprints_),
   expires_(other.expires_),
-  verification_flags_(other.verification_flags_)
+  verification_flags_(other.verification_flags_),
+  verified_key_(other.verified_key_),
+  verified_from_cache_(other.verified_from_cache_)
 {
   other.CopyBuffers(&plain_size_, &plain_buf_, &pkcs7_size_, &pkcs7_buf_);
 }
@@ -368,6 +483,7 @@ Whitelist::Whitelist()
   , plain_size_(0)
   , pkcs7_buf_(NULL)
   , pkcs7_size_(0)
+  , verified_from_cache_(false)
 {
 }
 
@@ -383,6 +499,8 @@ Whitelist &Whitelist::operator= (const Whitelist &other) {
   fingerprints_ = other.fingerprints_;
   expires_ = other.expires_;
   verification_flags_ = other.verification_flags_;
+  verified_key_ = other.verified_key_;
+  verified_from_cache_ = other.verified_from_cache_;
   other.CopyBuffers(&plain_size_, &plain_buf_, &pkcs7_size_, &pkcs7_buf_);
 
   return *this;
@@ -7,8 +7,10 @@
 
 #include <gtest/gtest_prod.h>
 #include <inttypes.h>
+#include <pthread.h>
 
 #include <ctime>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -70,6 +72,7 @@ inline const char *Code2Ascii(const Failures error) {
 
 class Whitelist {
   FRIEND_TEST(T_Whitelist, ParseWhitelist);
+  FRIEND_TEST(T_Whitelist, VerifiedCache);
 
  public:
   enum Status {
@@ -90,14 +93,50 @@ class Whitelist {
   time_t expires();
   bool IsExpired() const;
   Failures VerifyLoadedCertificate() const;
+  bool verified_from_cache() const { return verified_from_cache_; }
+
+  static void ClearVerifiedCache();
 
  private:
+  /**
+   * Outcome of a successful verification of a whitelist and a certificate.
+   * Remounts and catalog updates usually find the same certificate and the
+   * same whitelist again, in which case the signature of the whitelist and
+   * the CA chain are not verified another time.
+   */
+  struct VerifiedEntry {
+    VerifiedEntry() : expires(0), valid_until(0), verification_flags(0) { }
+    std::vector<shash::Any> fingerprints;
+    time_t expires;
+    time_t valid_until;
+    int verification_flags;
+  };
+  typedef std::map<shash::Any, VerifiedEntry> VerifiedCache;
+
+  /**
+   * Cached verifications are repeated at the latest after this many seconds,
+   * so that changes of the trusted CAs and CRLs are picked up.
+   */
+  static const unsigned kVerifiedCacheTtl;
+  static const unsigned kVerifiedCacheMaxEntries;
+
   Whitelist();
 
   static const int kFlagVerifyRsa;
   static const int kFlagVerifyPkcs7;
   static const int kFlagVerifyCaChain;
 
+  static bool LookupVerified(const shash::Any &key, VerifiedEntry *entry);
+  static void StoreVerified(const shash::Any &key, const VerifiedEntry &entry);
+  shash::Any MakeVerifiedKey();
+
+  /**
+   * Shared by all the whitelist objects of the process, i.e. it survives
+   * remounts.  Protected by lock_verified_cache_.
+   */
+  static VerifiedCache verified_cache_;
+  static pthread_mutex_t lock_verified_cache_;
+
   bool IsBefore(time_t now, const struct tm &t_whitelist);
   Failures ParseWhitelist(const unsigned char *whitelist,
                           const unsigned whitelist_size);
@@ -115,6 +154,11 @@ class Whitelist {
   unsigned plain_size_;
   unsigned char *pkcs7_buf_;
   unsigned pkcs7_size_;
+  /**
+   * Identifies this certificate and whitelist in the verified cache
+   */
+  shash::Any verified_key_;
+  bool verified_from_cache_;
 };
 
 }  // namespace whitelist
@@ -10,6 +10,7 @@
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
+#include <ctime>
 
 #include <string>
 #include <vector>
@@ -17,6 +18,7 @@
 #include "download.h"
 #include "logging.h"
 #include "pacparser.h"
+#include "platform.h"
 #include "statistics.h"
 #include "util/posix.h"
 #include "util/string.h"
@@ -203,14 +205,50 @@ string AutoProxy(DownloadManager *download_manager) {
 }
 
 
+static bool ReadFile(const string &path, string *content) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  bool retval = SafeReadToString(fd, content);
+  close(fd);
+  return retval;
+}
+
+
+/**
+ * The discovered proxies are stored in path_fallback_cache, the proxy
+ * description they were discovered for next to it in a ".description" file.
+ */
 string ResolveProxyDescription(
   const string &cvmfs_proxies,
   const std::string &path_fallback_cache,
-  DownloadManager *download_manager)
+  DownloadManager *download_manager,
+  const unsigned cache_ttl_s)
 {
   if ((cvmfs_proxies == "") || (cvmfs_proxies.find("auto") == string::npos))
     return cvmfs_proxies;
 
+  const string path_description = path_fallback_cache + ".description";
+  if (!path_fallback_cache.empty() && (cache_ttl_s > 0)) {
+    platform_stat64 info;
+    const time_t now = time(NULL);
+    string cached_proxies;
+    string cached_description;
+    if ((platform_stat(path_fallback_cache.c_str(), &info) == 0) &&
+        (info.st_mtime <= now) &&
+        (now - info.st_mtime < static_cast<time_t>(cache_ttl_s)) &&
+        ReadFile(path_description, &cached_description) &&
+        (cached_description == cvmfs_proxies) &&
+        ReadFile(path_fallback_cache, &cached_proxies) &&
+        !cached_proxies.empty())
+    {
+      LogCvmfs(kLogDownload, kLogDebug,
+               "using recently discovered proxy settings from %s",
+               path_fallback_cache.c_str());
+      return cached_proxies;
+    }
+  }
+
   bool use_cache = false;
   vector<string> lb_groups = SplitString(cvmfs_proxies, ';');
   for (unsigned i = 0; i < lb_groups.size(); ++i) {
@@ -227,20 +265,16 @@ string ResolveProxyDescription(
   if (!path_fallback_cache.empty()) {
     if (use_cache) {
       string cached_proxies;
-      int fd = open(path_fallback_cache.c_str(), O_RDONLY);
-      if (fd >= 0) {
-        bool retval = SafeReadToString(fd, &cached_proxies);
-        close(fd);
-        if (retval) {
-          LogCvmfs(kLogDownload, kLogSyslog | kLogDebug,
-                   "using cached proxy settings from %s",
-                   path_fallback_cache.c_str());
-          return cached_proxies;
-        }
+      if (ReadFile(path_fallback_cache, &cached_proxies)) {
+        LogCvmfs(kLogDownload, kLogSyslog | kLogDebug,
+                 "using cached proxy settings from %s",
+                 path_fallback_cache.c_str());
+        return cached_proxies;
       }
     } else {
       bool retval =
-        SafeWriteToFile(discovered_proxies, path_fallback_cache, 0660);
+        SafeWriteToFile(discovered_proxies, path_fallback_cache, 0660) &&
+        SafeWriteToFile(cvmfs_proxies, path_description, 0660);
       if (!retval) {
         LogCvmfs(kLogDownload, kLogSyslogWarn | kLogDebug,
                  "failed to write proxy settings into %s",
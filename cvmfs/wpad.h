@@ -18,11 +18,15 @@ class DownloadManager;
 std::string AutoProxy(DownloadManager *download_manager);
 
 /**
- * Uses AutoProxy to replace any "auto" proxy by the proxies from the PAC file
+ * Uses AutoProxy to replace any "auto" proxy by the proxies from the PAC file.
+ * If cache_ttl_s is set, a discovery result of the same proxy description
+ * that is younger than cache_ttl_s is taken from path_fallback_cache without
+ * running the discovery again.
  */
 std::string ResolveProxyDescription(const std::string &cvmfs_proxies,
                                     const std::string &path_fallback_cache,
-                                    DownloadManager *download_manager);
+                                    DownloadManager *download_manager,
+                                    const unsigned cache_ttl_s = 0);
 
 int MainResolveProxyDescription(int argc, char **argv);
 
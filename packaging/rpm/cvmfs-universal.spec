@@ -474,6 +474,7 @@ fi
 %defattr(-,root,root)
 %{_bindir}/cvmfs_unittests
 %{_bindir}/cvmfs_test_cache
+%{_bindir}/cvmfs_test_alloc
 %doc COPYING AUTHORS README.md ChangeLog
 
 %changelog
@@ -0,0 +1,298 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include <benchmark/benchmark.h>
+
+#include <alloca.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "cache.h"
+#include "cache_extern.h"
+#include "cache_posix.h"
+#include "cache_ram.h"
+#include "cache_tiered.h"
+#include "hash.h"
+#include "kvstore.h"
+#include "prng.h"
+#include "statistics.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+/**
+ * Drives the cache managers through the common CacheManager interface with a
+ * mix of reads and commits.  A read opens a random object of the working set,
+ * preads it entirely in blocks of kBlockSize, and closes it again.  A commit
+ * writes an object through a transaction.  Commits cycle through a bounded set
+ * of object ids so that the cache size stays bounded and the working set is
+ * not evicted from the memory caches.
+ *
+ * The first argument is the percentage of commits, the second one the object
+ * size.  Object size zero is a mix of 80% 4kB, 15% 64kB, and 5% 1MB objects.
+ * The latency of the operations is reported in microseconds in the label as
+ * p50/p99/p999.
+ *
+ * The external cache manager runs if CVMFS_UBENCH_CACHE_PLUGIN points to a
+ * cache plugin binary, such as cvmfs_cache_ram or cvmfs_cache_null.  Note that
+ * the null plugin does not store data, so that only its commits make sense.
+ */
+class BM_CacheBackends : public benchmark::Fixture {
+ protected:
+  static const unsigned kNumObjects = 128;
+  static const unsigned kNumCommitIds = 128;
+  static const unsigned kMaxEntries = 4096;
+  static const unsigned kBlockSize = 64 * 1024;
+  static const unsigned kMaxObjectSize = 1024 * 1024;
+  static const uint64_t kRamSize = 512 * 1024 * 1024;
+
+  virtual void SetUp(const benchmark::State &st) {
+    int retval = pthread_once(&once_, Init);
+    assert(retval == 0);
+  }
+
+  static unsigned GetObjectSize(const unsigned size, const unsigned i) {
+    if (size > 0)
+      return size;
+    const unsigned bucket = i % 20;
+    if (bucket == 0)
+      return 1024 * 1024;
+    if (bucket < 4)
+      return 64 * 1024;
+    return 4096;
+  }
+
+  static shash::Any MkId(const unsigned size, const unsigned i) {
+    shash::Any id(shash::kSha1);
+    memset(id.digest, 0, sizeof(id.digest));
+    // The first byte spreads the objects over the cache directories
+    id.digest[0] = i & 0xff;
+    memcpy(id.digest + 1, &i, sizeof(i));
+    memcpy(id.digest + 1 + sizeof(i), &size, sizeof(size));
+    return id;
+  }
+
+  static void Populate(CacheManager *cache_mgr, const unsigned size) {
+    unsigned char *buffer = reinterpret_cast<unsigned char *>(
+      smalloc(kMaxObjectSize));
+    memset(buffer, 'x', kMaxObjectSize);
+    for (unsigned i = 0; i < kNumObjects; ++i) {
+      bool retval = cache_mgr->CommitFromMem(
+        MkId(size, i), buffer, GetObjectSize(size, i), "bm");
+      assert(retval);
+    }
+    free(buffer);
+  }
+
+  static void Read(CacheManager *cache_mgr, const unsigned size,
+                   const unsigned i, unsigned char *buffer)
+  {
+    int fd = cache_mgr->Open(CacheManager::Bless(MkId(size, i)));
+    assert(fd >= 0);
+    const uint64_t object_size = GetObjectSize(size, i);
+    for (uint64_t offset = 0; offset < object_size; offset += kBlockSize) {
+      int64_t nbytes = cache_mgr->Pread(fd, buffer, kBlockSize, offset);
+      assert(nbytes > 0);
+    }
+    cache_mgr->Close(fd);
+  }
+
+  static void Commit(CacheManager *cache_mgr, const unsigned size,
+                     const unsigned i, const unsigned char *buffer)
+  {
+    const shash::Any id = MkId(size, kNumObjects + i);
+    const uint64_t object_size = GetObjectSize(size, i);
+    void *txn = alloca(cache_mgr->SizeOfTxn());
+    int retval = cache_mgr->StartTxn(id, object_size, txn);
+    assert(retval >= 0);
+    cache_mgr->CtrlTxn(CacheManager::ObjectInfo(CacheManager::kTypeRegular,
+                                                "bm"), 0, txn);
+    for (uint64_t offset = 0; offset < object_size; offset += kBlockSize) {
+      const uint64_t nbytes =
+        std::min(static_cast<uint64_t>(kBlockSize), object_size - offset);
+      int64_t written = cache_mgr->Write(buffer, nbytes, txn);
+      assert(written == static_cast<int64_t>(nbytes));
+    }
+    retval = cache_mgr->CommitTxn(txn);
+    assert(retval == 0);
+  }
+
+  static void Run(CacheManager *cache_mgr, benchmark::State *st) {
+    if (cache_mgr == NULL) {
+      st->SetLabel("cache manager not available");
+      while (st->KeepRunning()) { }
+      return;
+    }
+    const unsigned commit_pct = st->range_x();
+    const unsigned size = st->range_y();
+    if (st->thread_index == 0) {
+      Prepare(cache_mgr, size);
+      histogram_.Reset();
+    }
+
+    unsigned char *buffer = reinterpret_cast<unsigned char *>(
+      smalloc(kMaxObjectSize));
+    memset(buffer, 'x', kMaxObjectSize);
+    Prng prng;
+    prng.InitSeed(st->thread_index + 1);
+    uint64_t nbytes = 0;
+    while (st->KeepRunning()) {
+      const bool is_commit = prng.Next(100) < commit_pct;
+      const unsigned i =
+        prng.Next(is_commit ? kNumCommitIds : kNumObjects);
+      perf::HistogramTimer timer(&histogram_);
+      if (is_commit)
+        Commit(cache_mgr, size, i, buffer);
+      else
+        Read(cache_mgr, size, i, buffer);
+      nbytes += GetObjectSize(size, i);
+    }
+    free(buffer);
+
+    st->SetItemsProcessed(st->iterations());
+    st->SetBytesProcessed(nbytes);
+    if (st->thread_index == 0) {
+      st->SetLabel("p50/p99/p999 " +
+                   StringifyInt(histogram_.GetQuantile(0.5)) + "/" +
+                   StringifyInt(histogram_.GetQuantile(0.99)) + "/" +
+                   StringifyInt(histogram_.GetQuantile(0.999)) + " us");
+    }
+  }
+
+  static CacheManager *posix_mgr_;
+  static CacheManager *ram_mgr_;
+  static CacheManager *tiered_mgr_;
+  static CacheManager *extern_mgr_;
+
+ private:
+  /**
+   * Populates the working set for the given object size once per cache
+   * manager
+   */
+  static void Prepare(CacheManager *cache_mgr, const unsigned size) {
+    const string key = StringifyInt(reinterpret_cast<uintptr_t>(cache_mgr)) +
+                       "/" + StringifyInt(size);
+    if (find(populated_->begin(), populated_->end(), key) !=
+        populated_->end())
+    {
+      return;
+    }
+    Populate(cache_mgr, size);
+    populated_->push_back(key);
+  }
+
+  static CacheManager *CreateExternal(const string &sandbox) {
+    const char *plugin = getenv("CVMFS_UBENCH_CACHE_PLUGIN");
+    if (plugin == NULL)
+      return NULL;
+    const string locator = "unix=" + sandbox + "/plugin.socket";
+    const string config = sandbox + "/plugin.conf";
+    FILE *f = fopen(config.c_str(), "w");
+    assert(f != NULL);
+    fprintf(f, "CVMFS_CACHE_PLUGIN_LOCATOR=%s\n", locator.c_str());
+    fprintf(f, "CVMFS_CACHE_PLUGIN_SIZE=%s\n",
+            StringifyInt(kRamSize / (1024 * 1024)).c_str());
+    fclose(f);
+
+    vector<string> cmd_line;
+    cmd_line.push_back(plugin);
+    cmd_line.push_back(config);
+    ExternalCacheManager::PluginHandle *plugin_handle =
+      ExternalCacheManager::CreatePlugin(locator, cmd_line);
+    if (!plugin_handle->IsValid()) {
+      fprintf(stderr, "failed to start cache plugin %s: %s\n",
+              plugin, plugin_handle->error_msg().c_str());
+      delete plugin_handle;
+      return NULL;
+    }
+    ExternalCacheManager *cache_mgr = ExternalCacheManager::Create(
+      plugin_handle->fd_connection(), 64, "bm");
+    delete plugin_handle;
+    assert(cache_mgr != NULL);
+    cache_mgr->AcquireQuotaManager(ExternalQuotaManager::Create(cache_mgr));
+    return cache_mgr;
+  }
+
+  static void Init() {
+    const string sandbox = CreateTempDir("/tmp/cvmfs_ubench_cache_backends");
+    assert(!sandbox.empty());
+    populated_ = new vector<string>();
+    statistics_ = new perf::Statistics();
+
+    posix_mgr_ = PosixCacheManager::Create(sandbox + "/posix", false);
+    assert(posix_mgr_ != NULL);
+    ram_mgr_ = new RamCacheManager(
+      kRamSize, kMaxEntries, MemoryKvStore::kMallocHeap,
+      perf::StatisticsTemplate("ram", statistics_));
+
+    CacheManager *upper = new RamCacheManager(
+      kRamSize, kMaxEntries, MemoryKvStore::kMallocHeap,
+      perf::StatisticsTemplate("tiered_upper", statistics_));
+    CacheManager *lower = PosixCacheManager::Create(sandbox + "/lower", false);
+    assert(lower != NULL);
+    tiered_mgr_ = TieredCacheManager::Create(upper, lower,
+      perf::StatisticsTemplate("tiered", statistics_));
+
+    extern_mgr_ = CreateExternal(sandbox);
+  }
+
+  static pthread_once_t once_;
+  static perf::Histogram histogram_;
+  static perf::Statistics *statistics_;
+  static vector<string> *populated_;
+};
+
+pthread_once_t BM_CacheBackends::once_ = PTHREAD_ONCE_INIT;
+perf::Histogram BM_CacheBackends::histogram_;
+perf::Statistics *BM_CacheBackends::statistics_ = NULL;
+vector<string> *BM_CacheBackends::populated_ = NULL;
+CacheManager *BM_CacheBackends::posix_mgr_ = NULL;
+CacheManager *BM_CacheBackends::ram_mgr_ = NULL;
+CacheManager *BM_CacheBackends::tiered_mgr_ = NULL;
+CacheManager *BM_CacheBackends::extern_mgr_ = NULL;
+
+
+static void CacheMixes(benchmark::internal::Benchmark *b) {
+  const int commit_pcts[] = {0, 10, 50};
+  const int sizes[] = {4096, 1024 * 1024, 0};
+  for (unsigned i = 0; i < sizeof(commit_pcts) / sizeof(int); ++i) {
+    for (unsigned j = 0; j < sizeof(sizes) / sizeof(int); ++j)
+      b->ArgPair(commit_pcts[i], sizes[j]);
+  }
+}
+
+
+BENCHMARK_DEFINE_F(BM_CacheBackends, Posix)(benchmark::State &st) {
+  Run(posix_mgr_, &st);
+}
+BENCHMARK_REGISTER_F(BM_CacheBackends, Posix)->Apply(CacheMixes)->
+  ThreadRange(1, 16)->UseRealTime();
+
+
+BENCHMARK_DEFINE_F(BM_CacheBackends, Ram)(benchmark::State &st) {
+  Run(ram_mgr_, &st);
+}
+BENCHMARK_REGISTER_F(BM_CacheBackends, Ram)->Apply(CacheMixes)->
+  ThreadRange(1, 16)->UseRealTime();
+
+
+BENCHMARK_DEFINE_F(BM_CacheBackends, Tiered)(benchmark::State &st) {
+  Run(tiered_mgr_, &st);
+}
+BENCHMARK_REGISTER_F(BM_CacheBackends, Tiered)->Apply(CacheMixes)->
+  ThreadRange(1, 16)->UseRealTime();
+
+
+BENCHMARK_DEFINE_F(BM_CacheBackends, External)(benchmark::State &st) {
+  Run(extern_mgr_, &st);
+}
+BENCHMARK_REGISTER_F(BM_CacheBackends, External)->Apply(CacheMixes)->
+  ThreadRange(1, 16)->UseRealTime();
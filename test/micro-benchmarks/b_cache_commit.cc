@@ -0,0 +1,89 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include <benchmark/benchmark.h>
+
+#include <pthread.h>
+
+#include <cassert>
+#include <cstring>
+#include <string>
+
+#include "atomic.h"
+#include "cache_posix.h"
+#include "hash.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+/**
+ * Compares the commit rate of cache misses into the posix cache manager with
+ * named temporary files in the txn directory that are renamed on commit and
+ * with unnamed O_TMPFILE files that are linked on commit.  Every iteration
+ * commits a new small object.  If the file system of the sandbox does not
+ * support O_TMPFILE, the Tmpfile runs are labeled accordingly.
+ */
+class BM_CacheCommit : public benchmark::Fixture {
+ protected:
+  static const unsigned kObjectSize = 4096;
+
+  virtual void SetUp(const benchmark::State &st) {
+    int retval = pthread_once(&once_, Init);
+    assert(retval == 0);
+  }
+
+  static void Run(PosixCacheManager *cache_mgr, benchmark::State *st) {
+    unsigned char buffer[kObjectSize];
+    memset(buffer, 'x', kObjectSize);
+    shash::Any id(shash::kSha1);
+    memset(id.digest, 0, sizeof(id.digest));
+    while (st->KeepRunning()) {
+      // Unique over all runs, so that no object replaces an existing one.  The
+      // first byte spreads the objects over the cache directories.
+      const int64_t i = atomic_xadd64(&next_id_, 1);
+      id.digest[0] = i & 0xff;
+      memcpy(id.digest + 1, &i, sizeof(i));
+      bool retval = cache_mgr->CommitFromMem(id, buffer, kObjectSize, "bm");
+      assert(retval);
+    }
+    st->SetItemsProcessed(st->iterations());
+  }
+
+  static PosixCacheManager *rename_mgr_;
+  static PosixCacheManager *tmpfile_mgr_;
+  static atomic_int64 next_id_;
+
+ private:
+  static void Init() {
+    const string sandbox = CreateTempDir("/tmp/cvmfs_ubench_cache_commit");
+    assert(!sandbox.empty());
+    rename_mgr_ = PosixCacheManager::Create(sandbox + "/rename", false);
+    assert(rename_mgr_ != NULL);
+    rename_mgr_->DisableTmpfile();
+    tmpfile_mgr_ = PosixCacheManager::Create(sandbox + "/tmpfile", false);
+    assert(tmpfile_mgr_ != NULL);
+  }
+
+  static pthread_once_t once_;
+};
+
+pthread_once_t BM_CacheCommit::once_ = PTHREAD_ONCE_INIT;
+PosixCacheManager *BM_CacheCommit::rename_mgr_ = NULL;
+PosixCacheManager *BM_CacheCommit::tmpfile_mgr_ = NULL;
+atomic_int64 BM_CacheCommit::next_id_ = 0;
+
+
+BENCHMARK_DEFINE_F(BM_CacheCommit, Rename)(benchmark::State &st) {
+  Run(rename_mgr_, &st);
+}
+BENCHMARK_REGISTER_F(BM_CacheCommit, Rename)->ThreadRange(1, 16)->
+  UseRealTime();
+
+
+BENCHMARK_DEFINE_F(BM_CacheCommit, Tmpfile)(benchmark::State &st) {
+  if (!tmpfile_mgr_->use_tmpfile())
+    st.SetLabel("O_TMPFILE not supported");
+  Run(tmpfile_mgr_, &st);
+}
+BENCHMARK_REGISTER_F(BM_CacheCommit, Tmpfile)->ThreadRange(1, 16)->
+  UseRealTime();
@@ -0,0 +1,71 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include <benchmark/benchmark.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include <cassert>
+
+#include "bm_util.h"
+#include "murmur.h"
+#include "util_concurrency.h"
+
+/**
+ * Compares the single rwlock that used to guard the catalog manager with the
+ * striped rwlock.  The critical section mimics a short lookup in an attached
+ * catalog.  Run with increasing thread counts to see how lookups scale.
+ */
+class BM_CatalogLock : public benchmark::Fixture {
+ protected:
+  static const unsigned kLookupCycles = 64;
+
+  static inline uint32_t Lookup(uint32_t key) {
+    for (unsigned i = 0; i < kLookupCycles; ++i)
+      key = MurmurHash2(&key, sizeof(key), 0x07387a4f);
+    return key;
+  }
+};
+
+static pthread_rwlock_t g_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static StripedRwLock *g_striped_lock = NULL;
+
+
+BENCHMARK_DEFINE_F(BM_CatalogLock, Baseline)(benchmark::State &st) {
+  uint32_t key = st.thread_index;
+  while (st.KeepRunning()) {
+    key = Lookup(key);
+    Escape(&key);
+  }
+  st.SetItemsProcessed(st.iterations());
+}
+BENCHMARK_REGISTER_F(BM_CatalogLock, Baseline)->ThreadRange(1, 64);
+
+
+BENCHMARK_DEFINE_F(BM_CatalogLock, RwLock)(benchmark::State &st) {
+  uint32_t key = st.thread_index;
+  while (st.KeepRunning()) {
+    pthread_rwlock_rdlock(&g_rwlock);
+    key = Lookup(key);
+    pthread_rwlock_unlock(&g_rwlock);
+    Escape(&key);
+  }
+  st.SetItemsProcessed(st.iterations());
+}
+BENCHMARK_REGISTER_F(BM_CatalogLock, RwLock)->ThreadRange(1, 64);
+
+
+BENCHMARK_DEFINE_F(BM_CatalogLock, StripedRwLock)(benchmark::State &st) {
+  // Never freed, shared by the benchmark threads of all the runs
+  if ((st.thread_index == 0) && (g_striped_lock == NULL))
+    g_striped_lock = new StripedRwLock();
+  uint32_t key = st.thread_index;
+  while (st.KeepRunning()) {
+    g_striped_lock->ReadLock();
+    key = Lookup(key);
+    g_striped_lock->Unlock();
+    Escape(&key);
+  }
+  st.SetItemsProcessed(st.iterations());
+}
+BENCHMARK_REGISTER_F(BM_CatalogLock, StripedRwLock)->ThreadRange(1, 64);
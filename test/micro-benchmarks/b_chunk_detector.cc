@@ -0,0 +1,88 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include <benchmark/benchmark.h>
+
+#include <inttypes.h>
+
+#include <cstdlib>
+
+#include "file_processing/char_buffer.h"
+#include "file_processing/chunk_detector.h"
+#include "util/pointer.h"
+
+class BM_ChunkDetector : public benchmark::Fixture {
+ protected:
+  static const size_t kBufferSize = 4 * 1024 * 1024;
+  static const size_t kMinChunkSize = 4 * 1024 * 1024;
+
+  virtual void SetUp(const benchmark::State &st) {
+    buffer_ = new upload::CharBuffer(kBufferSize);
+    for (unsigned i = 0; i < kBufferSize; ++i)
+      buffer_->ptr()[i] = random() % 256;
+    buffer_->SetUsedBytes(kBufferSize);
+  }
+
+  virtual void TearDown(const benchmark::State &st) {
+    delete buffer_;
+  }
+
+  /**
+   * Scans a stream of identical buffers with the given implementation.
+   */
+  void RunXor32(
+    benchmark::State &st,  // NOLINT
+    upload::Xor32Detector::Implementation implementation)
+  {
+    if (!upload::Xor32Detector::IsImplementationAvailable(implementation)) {
+      st.SetLabel("not supported by this CPU");
+      while (st.KeepRunning()) { }
+      return;
+    }
+    upload::Xor32Detector detector(
+      kMinChunkSize, 2 * kMinChunkSize, 4 * kMinChunkSize);
+    detector.SetImplementation(implementation);
+    off_t offset = 0;
+    while (st.KeepRunning()) {
+      buffer_->SetBaseOffset(offset);
+      while (detector.FindNextCutMark(buffer_) != 0) { }
+      offset += kBufferSize;
+    }
+    st.SetBytesProcessed(int64_t(st.iterations()) * kBufferSize);
+  }
+
+  void RunFastCdc(benchmark::State &st) {  // NOLINT
+    upload::FastCdcDetector detector(
+      kMinChunkSize, 2 * kMinChunkSize, 4 * kMinChunkSize);
+    off_t offset = 0;
+    while (st.KeepRunning()) {
+      buffer_->SetBaseOffset(offset);
+      while (detector.FindNextCutMark(buffer_) != 0) { }
+      offset += kBufferSize;
+    }
+    st.SetBytesProcessed(int64_t(st.iterations()) * kBufferSize);
+  }
+
+  upload::CharBuffer *buffer_;
+};
+
+
+BENCHMARK_DEFINE_F(BM_ChunkDetector, Xor32Scalar)(benchmark::State &st) {
+  RunXor32(st, upload::Xor32Detector::kImplScalar);
+}
+BENCHMARK_REGISTER_F(BM_ChunkDetector, Xor32Scalar)->Repetitions(3);
+
+BENCHMARK_DEFINE_F(BM_ChunkDetector, Xor32Sse41)(benchmark::State &st) {
+  RunXor32(st, upload::Xor32Detector::kImplSse41);
+}
+BENCHMARK_REGISTER_F(BM_ChunkDetector, Xor32Sse41)->Repetitions(3);
+
+BENCHMARK_DEFINE_F(BM_ChunkDetector, Xor32Avx2)(benchmark::State &st) {
+  RunXor32(st, upload::Xor32Detector::kImplAvx2);
+}
+BENCHMARK_REGISTER_F(BM_ChunkDetector, Xor32Avx2)->Repetitions(3);
+
+BENCHMARK_DEFINE_F(BM_ChunkDetector, FastCdc)(benchmark::State &st) {
+  RunFastCdc(st);
+}
+BENCHMARK_REGISTER_F(BM_ChunkDetector, FastCdc)->Repetitions(3);
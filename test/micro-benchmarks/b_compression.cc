@@ -5,19 +5,71 @@
 
 #include <inttypes.h>
 
+#include <cassert>
 #include <cstdlib>
 #include <cstring>
 
 #include "bm_util.h"
 #include "compression.h"
+#include "util/pointer.h"
 
 class BM_Compression : public benchmark::Fixture {
  protected:
   virtual void SetUp(const benchmark::State &st) {
+    // Somewhat compressible, like binaries
+    size_ = st.range_x();
+    buffer_ = static_cast<unsigned char *>(malloc(size_));
+    for (unsigned i = 0; i < size_; ++i)
+      buffer_[i] = (i % 7 == 0) ? (random() % 256) : (i % 13);
   }
 
   virtual void TearDown(const benchmark::State &st) {
+    free(buffer_);
   }
+
+  /**
+   * Compresses the buffer in a single Deflate call into output of the
+   * size of the deflate bound.
+   */
+  void Compress(zlib::Algorithms alg, unsigned char *out, size_t *out_size) {
+    UniquePtr<zlib::Compressor> compressor(zlib::Compressor::Construct(alg));
+    unsigned char *in = buffer_;
+    size_t in_size = size_;
+    bool retval = compressor->Deflate(true, &in, &in_size, &out, out_size);
+    assert(retval);
+  }
+
+  void RunCompress(benchmark::State &st, zlib::Algorithms alg) {  // NOLINT
+    UniquePtr<zlib::Compressor> compressor(zlib::Compressor::Construct(alg));
+    const size_t bound = compressor->DeflateBound(size_);
+    unsigned char *out = static_cast<unsigned char *>(malloc(bound));
+    while (st.KeepRunning()) {
+      size_t out_size = bound;
+      Compress(alg, out, &out_size);
+      Escape(out);
+    }
+    free(out);
+    st.SetBytesProcessed(int64_t(st.iterations()) * size_);
+  }
+
+  void RunDecompress(benchmark::State &st, zlib::Algorithms alg) {  // NOLINT
+    UniquePtr<zlib::Compressor> compressor(zlib::Compressor::Construct(alg));
+    size_t out_size = compressor->DeflateBound(size_);
+    unsigned char *out = static_cast<unsigned char *>(malloc(out_size));
+    Compress(alg, out, &out_size);
+    while (st.KeepRunning()) {
+      void *decompressed;
+      uint64_t decompressed_size;
+      zlib::DecompressMem2Mem(alg, out, out_size,
+                              &decompressed, &decompressed_size);
+      free(decompressed);
+    }
+    free(out);
+    st.SetBytesProcessed(int64_t(st.iterations()) * size_);
+  }
+
+  unsigned char *buffer_;
+  unsigned size_;
 };
 
 
@@ -34,3 +86,46 @@ BENCHMARK_DEFINE_F(BM_Compression, Zlib)(benchmark::State &st) {
 }
 BENCHMARK_REGISTER_F(BM_Compression, Zlib)->Repetitions(3)->
   Arg(100)->Arg(4096)->Arg(100*1024);
+
+
+BENCHMARK_DEFINE_F(BM_Compression, DeflateZlib)(benchmark::State &st) {
+  RunCompress(st, zlib::kZlibDefault);
+}
+BENCHMARK_REGISTER_F(BM_Compression, DeflateZlib)->Repetitions(3)->
+  Arg(4096)->Arg(1024*1024);
+
+BENCHMARK_DEFINE_F(BM_Compression, InflateZlib)(benchmark::State &st) {
+  RunDecompress(st, zlib::kZlibDefault);
+}
+BENCHMARK_REGISTER_F(BM_Compression, InflateZlib)->Repetitions(3)->
+  Arg(4096)->Arg(1024*1024);
+
+
+#ifdef HAS_ZSTD
+BENCHMARK_DEFINE_F(BM_Compression, DeflateZstd)(benchmark::State &st) {
+  RunCompress(st, zlib::kZstd);
+}
+BENCHMARK_REGISTER_F(BM_Compression, DeflateZstd)->Repetitions(3)->
+  Arg(4096)->Arg(1024*1024);
+
+BENCHMARK_DEFINE_F(BM_Compression, InflateZstd)(benchmark::State &st) {
+  RunDecompress(st, zlib::kZstd);
+}
+BENCHMARK_REGISTER_F(BM_Compression, InflateZstd)->Repetitions(3)->
+  Arg(4096)->Arg(1024*1024);
+#endif
+
+
+#ifdef HAS_LZ4
+BENCHMARK_DEFINE_F(BM_Compression, DeflateLz4)(benchmark::State &st) {
+  RunCompress(st, zlib::kLz4);
+}
+BENCHMARK_REGISTER_F(BM_Compression, DeflateLz4)->Repetitions(3)->
+  Arg(4096)->Arg(1024*1024);
+
+BENCHMARK_DEFINE_F(BM_Compression, InflateLz4)(benchmark::State &st) {
+  RunDecompress(st, zlib::kLz4);
+}
+BENCHMARK_REGISTER_F(BM_Compression, InflateLz4)->Repetitions(3)->
+  Arg(4096)->Arg(1024*1024);
+#endif
@@ -0,0 +1,390 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include <benchmark/benchmark.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "atomic.h"
+#include "compression.h"
+#include "download.h"
+#include "platform.h"
+#include "sink.h"
+#include "statistics.h"
+#include "util/posix.h"
+#include "util/string.h"
+#include "util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+namespace {
+
+/**
+ * A minimal HTTP/1.1 server on the loopback interface with keep-alive
+ * connections and a thread per connection.  The request path encodes the
+ * reply, so that the server needs no configuration:
+ *   /<latency in us>/<bandwidth in KiB/s, 0 = unlimited>/<zlib 0|1>/<size>
+ * The object consists of size bytes of moderately compressible text, zlib
+ * compressed if requested.  Requests in proxy form (GET http://host/path) are
+ * served like direct requests, so the server can be its own proxy.
+ */
+class LoopbackServer {
+ public:
+  LoopbackServer() : fd_listen_(-1), port_(0) {
+    int retval = pthread_mutex_init(&lock_objects_, NULL);
+    assert(retval == 0);
+  }
+
+  bool Start() {
+    fd_listen_ = MakeTcpEndpoint("127.0.0.1", 0);
+    if ((fd_listen_ < 0) || (listen(fd_listen_, 128) != 0))
+      return false;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getsockname(fd_listen_, reinterpret_cast<struct sockaddr *>(&addr),
+                    &addr_len) != 0)
+    {
+      return false;
+    }
+    port_ = ntohs(addr.sin_port);
+    pthread_t thread_accept;
+    if (pthread_create(&thread_accept, NULL, MainAccept, this) != 0)
+      return false;
+    pthread_detach(thread_accept);
+    return true;
+  }
+
+  std::string url() const { return "http://127.0.0.1:" + StringifyInt(port_); }
+
+  static std::string MakePath(const unsigned latency_us,
+                              const unsigned kib_per_s,
+                              const bool compressed,
+                              const uint64_t size)
+  {
+    return "/" + StringifyInt(latency_us) + "/" + StringifyInt(kib_per_s) +
+           "/" + (compressed ? "1" : "0") + "/" + StringifyInt(size);
+  }
+
+ private:
+  struct Connection {
+    LoopbackServer *server;
+    int fd;
+  };
+
+  static void *MainAccept(void *data) {
+    LoopbackServer *server = reinterpret_cast<LoopbackServer *>(data);
+    while (true) {
+      const int fd = accept(server->fd_listen_, NULL, NULL);
+      if (fd < 0)
+        continue;
+      // Replies are written in pieces, which would otherwise wait for the
+      // delayed acknowledgment of the client
+      const int on = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+      Connection *connection = new Connection();
+      connection->server = server;
+      connection->fd = fd;
+      pthread_t thread_connection;
+      if (pthread_create(&thread_connection, NULL, MainConnection,
+                         connection) != 0)
+      {
+        close(fd);
+        delete connection;
+        continue;
+      }
+      pthread_detach(thread_connection);
+    }
+    return NULL;
+  }
+
+  static void *MainConnection(void *data) {
+    Connection *connection = reinterpret_cast<Connection *>(data);
+    string buffer;
+    char chunk[4096];
+    while (true) {
+      size_t pos_end;
+      while ((pos_end = buffer.find("\r\n\r\n")) == string::npos) {
+        const ssize_t nbytes = read(connection->fd, chunk, sizeof(chunk));
+        if (nbytes <= 0)
+          break;
+        buffer.append(chunk, nbytes);
+      }
+      if (pos_end == string::npos)
+        break;
+      const string request = buffer.substr(0, pos_end);
+      buffer.erase(0, pos_end + 4);
+      if (!connection->server->Serve(connection->fd, request))
+        break;
+    }
+    close(connection->fd);
+    delete connection;
+    return NULL;
+  }
+
+  bool Serve(const int fd, const string &request) {
+    const vector<string> request_line =
+      SplitString(request.substr(0, request.find("\r\n")), ' ');
+    if (request_line.size() < 2)
+      return false;
+    const bool is_head = (request_line[0] == "HEAD");
+    string path = request_line[1];
+    if (HasPrefix(path, "http://", true))
+      path = path.substr(path.find('/', 7));
+
+    const vector<string> params = SplitString(path, '/');
+    if (params.size() < 5)
+      return SendAll(fd, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+    const unsigned latency_us = String2Uint64(params[1]);
+    const unsigned kib_per_s = String2Uint64(params[2]);
+    const string &object = GetObject(params[3] == "1",
+                                     String2Uint64(params[4]));
+
+    if (latency_us > 0)
+      usleep(latency_us);
+    const string header = "HTTP/1.1 200 OK\r\nContent-Length: " +
+                          StringifyInt(object.size()) + "\r\n\r\n";
+    if (is_head)
+      return SendAll(fd, header);
+    if (kib_per_s == 0)
+      return SendAll(fd, header + object);
+    if (!SendAll(fd, header))
+      return false;
+
+    // Paces the reply in blocks of 16 kB
+    const uint64_t start_ns = platform_monotonic_time_ns();
+    const unsigned kBlockSize = 16 * 1024;
+    for (uint64_t pos = 0; pos < object.size(); pos += kBlockSize) {
+      if (!SendAll(fd, object.substr(pos, kBlockSize)))
+        return false;
+      const uint64_t sent = std::min(pos + kBlockSize, uint64_t(object.size()));
+      const uint64_t due_us = sent * 1000 * 1000 / (uint64_t(kib_per_s) * 1024);
+      const uint64_t elapsed_us =
+        (platform_monotonic_time_ns() - start_ns) / 1000;
+      if (due_us > elapsed_us)
+        usleep(due_us - elapsed_us);
+    }
+    return true;
+  }
+
+  const string &GetObject(const bool compressed, const uint64_t size) {
+    MutexLockGuard guard(&lock_objects_);
+    const pair<bool, uint64_t> key(compressed, size);
+    map<pair<bool, uint64_t>, string>::iterator iter = objects_.find(key);
+    if (iter != objects_.end())
+      return iter->second;
+
+    string content(size, ' ');
+    for (uint64_t i = 0; i < size; ++i)
+      content[i] = 'a' + ((i * 7 + i / 61) % 26);
+    if (compressed) {
+      void *buf;
+      uint64_t buf_size;
+      bool retval = zlib::CompressMem2Mem(content.data(), content.size(),
+                                          &buf, &buf_size);
+      assert(retval);
+      content.assign(reinterpret_cast<char *>(buf), buf_size);
+      free(buf);
+    }
+    return objects_[key] = content;
+  }
+
+  static bool SendAll(const int fd, const string &data) {
+    const char *buf = data.data();
+    size_t remaining = data.size();
+    while (remaining > 0) {
+      const ssize_t nbytes = send(fd, buf, remaining, MSG_NOSIGNAL);
+      if (nbytes <= 0)
+        return false;
+      buf += nbytes;
+      remaining -= nbytes;
+    }
+    return true;
+  }
+
+  int fd_listen_;
+  int port_;
+  std::map<std::pair<bool, uint64_t>, std::string> objects_;
+  pthread_mutex_t lock_objects_;
+};
+
+
+/**
+ * Discards the downloaded data
+ */
+class NullSink : public cvmfs::Sink {
+ public:
+  NullSink() : size_(0) { }
+  virtual int64_t Write(const void *buf, uint64_t sz) {
+    size_ += sz;
+    return sz;
+  }
+  virtual int Reset() { size_ = 0; return 0; }
+  uint64_t size() const { return size_; }
+ private:
+  uint64_t size_;
+};
+
+}  // anonymous namespace
+
+
+/**
+ * Measures requests per second and bytes per second of
+ * DownloadManager::Fetch() from the threads of the benchmark against the
+ * loopback server.  range_x is max_pool_handles, range_y the object size.  An
+ * object size of 0 selects a mix of mostly small files: 90% of 4 kB, 9% of
+ * 64 kB and 1% of 1 MB.  The bytes are counted after decompression.  There is
+ * one download manager per pool size and proxy setting, so the connection
+ * reuse across iterations is part of the measurement.
+ */
+class BM_Download : public benchmark::Fixture {
+ protected:
+  virtual void SetUp(const benchmark::State &st) {
+    int retval = pthread_once(&once_, Init);
+    assert(retval == 0);
+  }
+
+  static download::DownloadManager *GetManager(const unsigned max_pool_handles,
+                                               const bool via_proxy)
+  {
+    MutexLockGuard guard(&lock_managers_);
+    const pair<unsigned, bool> key(max_pool_handles, via_proxy);
+    map<pair<unsigned, bool>, download::DownloadManager *>::iterator iter =
+      managers_.find(key);
+    if (iter != managers_.end())
+      return iter->second;
+
+    download::DownloadManager *download_mgr = new download::DownloadManager();
+    download_mgr->Init(max_pool_handles, false,
+      perf::StatisticsTemplate(
+        "download-" + StringifyInt(max_pool_handles) +
+        (via_proxy ? "-proxy" : ""), statistics_));
+    download_mgr->SetHostChain(server_->url());
+    download_mgr->SetProxyChain(via_proxy ? server_->url() : "DIRECT", "",
+                                download::DownloadManager::kSetProxyRegular);
+    download_mgr->Spawn();
+    managers_[key] = download_mgr;
+    return download_mgr;
+  }
+
+  static uint64_t GetObjectSize(const uint64_t size, const uint64_t i) {
+    if (size > 0)
+      return size;
+    const unsigned p = (i * 37) % 100;
+    if (p < 90)
+      return 4 * 1024;
+    return (p < 99) ? 64 * 1024 : 1024 * 1024;
+  }
+
+  static void Run(benchmark::State *st,
+                  const bool compressed,
+                  const bool via_proxy,
+                  const unsigned latency_us,
+                  const unsigned kib_per_s)
+  {
+    download::DownloadManager *download_mgr =
+      GetManager(st->range_x(), via_proxy);
+    vector<string> paths;
+    for (unsigned i = 0; i < 100; ++i) {
+      paths.push_back(LoopbackServer::MakePath(
+        latency_us, kib_per_s, compressed, GetObjectSize(st->range_y(), i)));
+    }
+
+    NullSink sink;
+    uint64_t nbytes = 0;
+    uint64_t i = st->thread_index;
+    while (st->KeepRunning()) {
+      const string &path = paths[i++ % paths.size()];
+      download::JobInfo info(&path, compressed, true, &sink, NULL);
+      download::Failures retval = download_mgr->Fetch(&info);
+      assert(retval == download::kFailOk);
+      nbytes += sink.size();
+      sink.Reset();
+    }
+    st->SetItemsProcessed(st->iterations());
+    st->SetBytesProcessed(nbytes);
+  }
+
+ private:
+  static void Init() {
+    server_ = new LoopbackServer();
+    bool retval = server_->Start();
+    assert(retval);
+    statistics_ = new perf::Statistics();
+    int retval_lock = pthread_mutex_init(&lock_managers_, NULL);
+    assert(retval_lock == 0);
+  }
+
+  static pthread_once_t once_;
+  static LoopbackServer *server_;
+  static perf::Statistics *statistics_;
+  static std::map<std::pair<unsigned, bool>, download::DownloadManager *>
+    managers_;
+  static pthread_mutex_t lock_managers_;
+};
+
+pthread_once_t BM_Download::once_ = PTHREAD_ONCE_INIT;
+LoopbackServer *BM_Download::server_ = NULL;
+perf::Statistics *BM_Download::statistics_ = NULL;
+std::map<std::pair<unsigned, bool>, download::DownloadManager *>
+  BM_Download::managers_;
+pthread_mutex_t BM_Download::lock_managers_;
+
+
+BENCHMARK_DEFINE_F(BM_Download, Plain)(benchmark::State &st) {
+  Run(&st, false, false, 0, 0);
+}
+BENCHMARK_REGISTER_F(BM_Download, Plain)->
+  ArgPair(1, 4 * 1024)->ArgPair(8, 4 * 1024)->ArgPair(32, 4 * 1024)->
+  ArgPair(8, 1024 * 1024)->ArgPair(32, 1024 * 1024)->ArgPair(8, 0)->
+  ArgPair(32, 0)->ThreadRange(1, 32)->UseRealTime();
+
+
+BENCHMARK_DEFINE_F(BM_Download, Compressed)(benchmark::State &st) {
+  Run(&st, true, false, 0, 0);
+}
+BENCHMARK_REGISTER_F(BM_Download, Compressed)->
+  ArgPair(8, 4 * 1024)->ArgPair(8, 1024 * 1024)->ArgPair(32, 0)->
+  ThreadRange(1, 32)->UseRealTime();
+
+
+BENCHMARK_DEFINE_F(BM_Download, Proxy)(benchmark::State &st) {
+  Run(&st, false, true, 0, 0);
+}
+BENCHMARK_REGISTER_F(BM_Download, Proxy)->
+  ArgPair(8, 4 * 1024)->ArgPair(8, 1024 * 1024)->ArgPair(32, 0)->
+  ThreadRange(1, 32)->UseRealTime();
+
+
+/**
+ * A WAN-like round trip of 5 ms per request, which rewards more transfers in
+ * flight
+ */
+BENCHMARK_DEFINE_F(BM_Download, Latency)(benchmark::State &st) {
+  Run(&st, true, false, 5000, 0);
+}
+BENCHMARK_REGISTER_F(BM_Download, Latency)->
+  ArgPair(1, 0)->ArgPair(8, 0)->ArgPair(32, 0)->ThreadRange(1, 64)->
+  UseRealTime();
+
+
+/**
+ * Every connection is limited to 10 MiB/s
+ */
+BENCHMARK_DEFINE_F(BM_Download, Bandwidth)(benchmark::State &st) {
+  Run(&st, false, false, 0, 10 * 1024);
+}
+BENCHMARK_REGISTER_F(BM_Download, Bandwidth)->
+  ArgPair(1, 1024 * 1024)->ArgPair(8, 1024 * 1024)->ArgPair(32, 0)->
+  ThreadRange(1, 32)->UseRealTime();
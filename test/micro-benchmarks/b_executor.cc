@@ -0,0 +1,135 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include <benchmark/benchmark.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cassert>
+#include <vector>
+
+#include "atomic.h"
+#include "bm_util.h"
+#include "util/executor.h"
+#include "util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+/**
+ * Compares the Executor with a thread pool on a single shared FifoChannel,
+ * which is how the ConcurrentWorkers used to queue their jobs.  Every
+ * iteration runs kNumTasks short tasks on a pool of range_x worker threads.
+ */
+class BM_Executor : public benchmark::Fixture {
+ protected:
+  static const unsigned kNumTasks = 10000;
+
+  class SpinTask : public Executor::Task {
+   public:
+    explicit SpinTask(atomic_int32 *counter) : counter_(counter) { }
+    virtual void Run() {
+      unsigned x = 0;
+      for (unsigned i = 0; i < 64; ++i)
+        x += i * i;
+      Escape(&x);
+      atomic_inc32(counter_);
+    }
+   private:
+    atomic_int32 *counter_;
+  };
+
+  /**
+   * The reference implementation: one queue and one lock for all workers
+   */
+  class FifoPool {
+   public:
+    explicit FifoPool(unsigned num_threads)
+      : queue_(num_threads * Executor::kQueuedTasksPerThread, 1)
+      , threads_(num_threads)
+    {
+      atomic_init32(&num_pending_);
+      for (unsigned i = 0; i < threads_.size(); ++i) {
+        int retval = pthread_create(&threads_[i], NULL, MainWorker, this);
+        assert(retval == 0);
+      }
+    }
+    ~FifoPool() {
+      for (unsigned i = 0; i < threads_.size(); ++i)
+        queue_.Enqueue(NULL);
+      for (unsigned i = 0; i < threads_.size(); ++i)
+        pthread_join(threads_[i], NULL);
+    }
+    void Submit(Executor::Task *task) {
+      atomic_inc32(&num_pending_);
+      queue_.Enqueue(task);
+    }
+    void Wait() {
+      while (atomic_read32(&num_pending_) > 0)
+        sched_yield();
+    }
+
+   private:
+    static void *MainWorker(void *data) {
+      FifoPool *pool = reinterpret_cast<FifoPool *>(data);
+      Executor::Task *task;
+      while ((task = pool->queue_.Dequeue()) != NULL) {
+        task->Run();
+        delete task;
+        atomic_dec32(&pool->num_pending_);
+      }
+      return NULL;
+    }
+
+    FifoChannel<Executor::Task *> queue_;
+    vector<pthread_t> threads_;
+    atomic_int32 num_pending_;
+  };
+};
+
+
+BENCHMARK_DEFINE_F(BM_Executor, FifoChannel)(benchmark::State &st) {
+  FifoPool pool(st.range_x());
+  atomic_int32 counter;
+  atomic_init32(&counter);
+  while (st.KeepRunning()) {
+    for (unsigned i = 0; i < kNumTasks; ++i)
+      pool.Submit(new SpinTask(&counter));
+    pool.Wait();
+  }
+  st.SetItemsProcessed(st.iterations() * kNumTasks);
+}
+BENCHMARK_REGISTER_F(BM_Executor, FifoChannel)->Arg(1)->Arg(2)->Arg(4)->
+  Arg(8)->Arg(16)->UseRealTime();
+
+
+BENCHMARK_DEFINE_F(BM_Executor, WorkStealing)(benchmark::State &st) {
+  Executor executor(st.range_x());
+  atomic_int32 counter;
+  atomic_init32(&counter);
+  while (st.KeepRunning()) {
+    for (unsigned i = 0; i < kNumTasks; ++i)
+      executor.Submit(new SpinTask(&counter));
+    executor.Wait();
+  }
+  st.SetItemsProcessed(st.iterations() * kNumTasks);
+}
+BENCHMARK_REGISTER_F(BM_Executor, WorkStealing)->Arg(1)->Arg(2)->Arg(4)->
+  Arg(8)->Arg(16)->UseRealTime();
+
+
+BENCHMARK_DEFINE_F(BM_Executor, WorkStealingBatch)(benchmark::State &st) {
+  Executor executor(st.range_x());
+  atomic_int32 counter;
+  atomic_init32(&counter);
+  vector<Executor::Task *> tasks(kNumTasks);
+  while (st.KeepRunning()) {
+    for (unsigned i = 0; i < kNumTasks; ++i)
+      tasks[i] = new SpinTask(&counter);
+    executor.SubmitBatch(tasks);
+    executor.Wait();
+  }
+  st.SetItemsProcessed(st.iterations() * kNumTasks);
+}
+BENCHMARK_REGISTER_F(BM_Executor, WorkStealingBatch)->Arg(1)->Arg(2)->Arg(4)->
+  Arg(8)->Arg(16)->UseRealTime();
@@ -113,6 +113,8 @@ BENCHMARK_DEFINE_F(BM_InodeTracker, FindPath)(benchmark::State &st) {
     ++i;
   }
   st.SetItemsProcessed(st.iterations());
+  st.SetLabel("bytes/inode: " +
+              StringifyInt(inode_tracker_->bytes_allocated() / size));
 }
 BENCHMARK_REGISTER_F(BM_InodeTracker, FindPath)->Repetitions(3)->Arg(10000);
 
@@ -3,8 +3,11 @@
  */
 #include <benchmark/benchmark.h>
 
+#include <inttypes.h>
+
 #include <cstdlib>
 #include <cstring>
+#include <string>
 
 #include "bm_util.h"
 #include "hash.h"
@@ -23,6 +26,23 @@ class BM_Hash : public benchmark::Fixture {
     free(long_path_);
   }
 
+  /**
+   * Hashes a buffer of range_x() bytes, reports the throughput.
+   */
+  void RunHashMem(benchmark::State &st, shash::Algorithms alg) {  // NOLINT
+    unsigned size = st.range_x();
+    unsigned char *buffer = static_cast<unsigned char *>(malloc(size));
+    memset(buffer, 0, size);
+    shash::Any content_hash(alg);
+    while (st.KeepRunning()) {
+      HashMem(buffer, size, &content_hash);
+      Escape(&content_hash);
+    }
+    free(buffer);
+    st.SetItemsProcessed(st.iterations());
+    st.SetBytesProcessed(int64_t(st.iterations()) * size);
+  }
+
   char *short_path_;
   char *long_path_;
 };
@@ -52,14 +72,61 @@ BENCHMARK_DEFINE_F(BM_Hash, LongPath)(benchmark::State &st) {
 BENCHMARK_REGISTER_F(BM_Hash, LongPath)->Repetitions(3);
 
 
+BENCHMARK_DEFINE_F(BM_Hash, Md5)(benchmark::State &st) {
+  RunHashMem(st, shash::kMd5);
+}
+BENCHMARK_REGISTER_F(BM_Hash, Md5)->Repetitions(3)->Arg(100)->Arg(4096)->
+  Arg(100*1024);
+
+
 BENCHMARK_DEFINE_F(BM_Hash, Sha1)(benchmark::State &st) {
-  unsigned size = st.range_x();
-  unsigned char buffer[size];
-  shash::Any content_hash(shash::kSha1);
+  RunHashMem(st, shash::kSha1);
+}
+BENCHMARK_REGISTER_F(BM_Hash, Sha1)->Repetitions(3)->Arg(100)->Arg(4096)->
+  Arg(100*1024);
+
+
+BENCHMARK_DEFINE_F(BM_Hash, Rmd160)(benchmark::State &st) {
+  RunHashMem(st, shash::kRmd160);
+}
+BENCHMARK_REGISTER_F(BM_Hash, Rmd160)->Repetitions(3)->Arg(100)->Arg(4096)->
+  Arg(100*1024);
+
+
+BENCHMARK_DEFINE_F(BM_Hash, Shake128)(benchmark::State &st) {
+  RunHashMem(st, shash::kShake128);
+}
+BENCHMARK_REGISTER_F(BM_Hash, Shake128)->Repetitions(3)->Arg(100)->Arg(4096)->
+  Arg(100*1024);
+
+
+BENCHMARK_DEFINE_F(BM_Hash, Sha256)(benchmark::State &st) {
+  RunHashMem(st, shash::kSha256);
+}
+BENCHMARK_REGISTER_F(BM_Hash, Sha256)->Repetitions(3)->Arg(100)->Arg(4096)->
+  Arg(100*1024);
+
+
+BENCHMARK_DEFINE_F(BM_Hash, MakePath)(benchmark::State &st) {
+  shash::Any hash(shash::kSha1);
+  hash.Randomize();
   while (st.KeepRunning()) {
-    HashMem(buffer, size, &content_hash);
+    std::string path = hash.MakePathWithoutSuffix();
+    Escape(&path);
   }
   st.SetItemsProcessed(st.iterations());
 }
-BENCHMARK_REGISTER_F(BM_Hash, Sha1)->Repetitions(3)->Arg(100)->Arg(4096)->
-  Arg(100*1024);
+BENCHMARK_REGISTER_F(BM_Hash, MakePath)->Repetitions(3);
+
+
+BENCHMARK_DEFINE_F(BM_Hash, WritePath)(benchmark::State &st) {
+  shash::Any hash(shash::kSha1);
+  hash.Randomize();
+  char path[64];
+  while (st.KeepRunning()) {
+    hash.WritePathWithoutSuffix(path, sizeof(path));
+    Escape(path);
+  }
+  st.SetItemsProcessed(st.iterations());
+}
+BENCHMARK_REGISTER_F(BM_Hash, WritePath)->Repetitions(3);
@@ -0,0 +1,275 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include <benchmark/benchmark.h>
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "bm_util.h"
+#include "cache_posix.h"
+#include "catalog.h"
+#include "catalog_sql.h"
+#include "directory_entry.h"
+#include "hash.h"
+#include "shortstring.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+/**
+ * Exercises the layers below the fuse callbacks: catalog lookups for
+ * lookup()/getattr(), catalog listings for readdir(), and the posix cache
+ * manager for open()/read().  A synthetic catalog with kNumDirs directories of
+ * kNumFiles files each is created in a temporary directory, along with
+ * kNumFiles small objects and one large object in the cache.  The fixture is
+ * shared by all the runs and all the threads.
+ *
+ * For regression tracking, run with --benchmark_format=json.
+ */
+class BM_Metadata : public benchmark::Fixture {
+ protected:
+  static const unsigned kNumDirs = 64;
+  static const unsigned kNumFiles = 64;
+  static const unsigned kSmallFileSize = 4096;
+  static const unsigned kLargeFileSize = 64 * 1024 * 1024;
+  static const unsigned kBlockSize = 128 * 1024;
+
+  virtual void SetUp(const benchmark::State &st) {
+    int retval = pthread_once(&once_, Init);
+    assert(retval == 0);
+  }
+
+  static string DirPath(unsigned dir) {
+    return "/dir" + StringifyInt(dir);
+  }
+
+  static string FilePath(unsigned dir, unsigned file) {
+    return DirPath(dir) + "/file" + StringifyInt(file);
+  }
+
+  static catalog::Catalog *catalog_;
+  static PosixCacheManager *cache_mgr_;
+  static vector<PathString> *paths_;
+  static vector<shash::Any> *small_objects_;
+  static shash::Any *large_object_;
+
+ private:
+  static void Init();
+  static void InsertEntry(catalog::SqlCatalog *stmt,
+                          const string &path,
+                          const string &name,
+                          const string &parent_path,
+                          const unsigned mode,
+                          const int flags,
+                          const shash::Any &hash);
+
+  static pthread_once_t once_;
+};
+
+pthread_once_t BM_Metadata::once_ = PTHREAD_ONCE_INIT;
+catalog::Catalog *BM_Metadata::catalog_ = NULL;
+PosixCacheManager *BM_Metadata::cache_mgr_ = NULL;
+vector<PathString> *BM_Metadata::paths_ = NULL;
+vector<shash::Any> *BM_Metadata::small_objects_ = NULL;
+shash::Any *BM_Metadata::large_object_ = NULL;
+
+
+void BM_Metadata::InsertEntry(
+  catalog::SqlCatalog *stmt,
+  const string &path,
+  const string &name,
+  const string &parent_path,
+  const unsigned mode,
+  const int flags,
+  const shash::Any &hash)
+{
+  bool retval =
+    stmt->BindMd5(1, 2, shash::Md5(shash::AsciiPtr(path))) &&
+    stmt->BindMd5(3, 4, shash::Md5(shash::AsciiPtr(parent_path))) &&
+    stmt->BindInt64(5, 1) &&
+    stmt->BindInt64(7, S_ISDIR(mode) ? 4096 : kSmallFileSize) &&
+    stmt->BindInt(8, mode) &&
+    stmt->BindInt64(9, 0) &&
+    stmt->BindInt(10, flags) &&
+    stmt->BindTextTransient(11, name) &&
+    stmt->BindInt64(12, getuid()) &&
+    stmt->BindInt64(13, getgid());
+  if (S_ISDIR(mode)) {
+    retval = retval && stmt->BindNull(6);
+  } else {
+    retval = retval &&
+             stmt->BindBlobTransient(6, hash.digest, hash.GetDigestSize());
+  }
+  retval = retval && stmt->Execute() && stmt->Reset();
+  assert(retval);
+}
+
+
+void BM_Metadata::Init() {
+  // Never removed, shared by all the runs
+  const string sandbox = CreateTempDir("/tmp/cvmfs_ubench_metadata");
+  assert(!sandbox.empty());
+  const string db_path = sandbox + "/catalog.db";
+
+  paths_ = new vector<PathString>();
+  small_objects_ = new vector<shash::Any>();
+  catalog::CatalogDatabase *db = catalog::CatalogDatabase::Create(db_path);
+  assert(db != NULL);
+  bool retval = db->InsertInitialValues("", false, "");
+  assert(retval);
+  retval = db->BeginTransaction();
+  assert(retval);
+  {
+    catalog::SqlCatalog stmt(*db,
+      "INSERT INTO catalog "
+      "(md5path_1, md5path_2, parent_1, parent_2, hardlinks, hash, size, mode,"
+      " mtime, flags, name, symlink, uid, gid, xattr) "
+      "VALUES (:md5_1, :md5_2, :p_1, :p_2, :links, :hash, :size, :mode,"
+      " :mtime, :flags, :name, '', :uid, :gid, NULL);");
+    for (unsigned d = 0; d < kNumDirs; ++d) {
+      InsertEntry(&stmt, DirPath(d), DirPath(d).substr(1), "",
+                  S_IFDIR | 0755, catalog::SqlDirent::kFlagDir, shash::Any());
+      for (unsigned f = 0; f < kNumFiles; ++f) {
+        const string path = FilePath(d, f);
+        shash::Any hash(shash::kSha1);
+        shash::HashString(path, &hash);
+        InsertEntry(&stmt, path, GetFileName(path), DirPath(d),
+                    S_IFREG | 0644, catalog::SqlDirent::kFlagFile, hash);
+        paths_->push_back(PathString(path));
+      }
+    }
+  }
+  retval = db->CommitTransaction();
+  assert(retval);
+  delete db;
+
+  catalog_ = catalog::Catalog::AttachFreely("", db_path,
+                                            shash::Any(shash::kSha1));
+  assert(catalog_ != NULL);
+
+  cache_mgr_ = PosixCacheManager::Create(sandbox + "/cache", false);
+  assert(cache_mgr_ != NULL);
+  unsigned char *buffer =
+    static_cast<unsigned char *>(malloc(kLargeFileSize));
+  for (unsigned i = 0; i < kLargeFileSize; ++i)
+    buffer[i] = static_cast<unsigned char>(random());
+  for (unsigned i = 0; i < kNumFiles; ++i) {
+    shash::Any id(shash::kSha1);
+    shash::HashMem(buffer + i * kSmallFileSize, kSmallFileSize, &id);
+    retval = cache_mgr_->CommitFromMem(id, buffer + i * kSmallFileSize,
+                                       kSmallFileSize, "small");
+    assert(retval);
+    small_objects_->push_back(id);
+  }
+  large_object_ = new shash::Any(shash::kSha1);
+  shash::HashMem(buffer, kLargeFileSize, large_object_);
+  retval = cache_mgr_->CommitFromMem(*large_object_, buffer, kLargeFileSize,
+                                     "large");
+  assert(retval);
+  free(buffer);
+}
+
+
+/**
+ * lookup() and getattr() of different files
+ */
+BENCHMARK_DEFINE_F(BM_Metadata, Lookup)(benchmark::State &st) {
+  catalog::DirectoryEntry dirent;
+  unsigned i = st.thread_index * 7919;
+  while (st.KeepRunning()) {
+    bool retval = catalog_->LookupPath((*paths_)[i % paths_->size()], &dirent);
+    assert(retval);
+    Escape(&dirent);
+    i++;
+  }
+  st.SetItemsProcessed(st.iterations());
+}
+BENCHMARK_REGISTER_F(BM_Metadata, Lookup)->ThreadRange(1, 16)->UseRealTime();
+
+
+/**
+ * getattr() storm: all the threads stat the same file
+ */
+BENCHMARK_DEFINE_F(BM_Metadata, StatStorm)(benchmark::State &st) {
+  catalog::DirectoryEntry dirent;
+  const PathString path((*paths_)[0]);
+  while (st.KeepRunning()) {
+    bool retval = catalog_->LookupPath(path, &dirent);
+    assert(retval);
+    Escape(&dirent);
+  }
+  st.SetItemsProcessed(st.iterations());
+}
+BENCHMARK_REGISTER_F(BM_Metadata, StatStorm)->ThreadRange(1, 16)->
+  UseRealTime();
+
+
+/**
+ * readdir() of a directory with kNumFiles entries
+ */
+BENCHMARK_DEFINE_F(BM_Metadata, Readdir)(benchmark::State &st) {
+  unsigned i = st.thread_index;
+  while (st.KeepRunning()) {
+    catalog::StatEntryList listing;
+    const string path = DirPath(i % kNumDirs);
+    bool retval = catalog_->ListingPathStat(PathString(path), &listing);
+    assert(retval);
+    assert(listing.size() == kNumFiles);
+    i++;
+  }
+  st.SetItemsProcessed(st.iterations() * kNumFiles);
+}
+BENCHMARK_REGISTER_F(BM_Metadata, Readdir)->ThreadRange(1, 16)->UseRealTime();
+
+
+/**
+ * open(), read() and close() of small cached files
+ */
+BENCHMARK_DEFINE_F(BM_Metadata, SmallFileRead)(benchmark::State &st) {
+  unsigned char buf[kSmallFileSize];
+  unsigned i = st.thread_index;
+  while (st.KeepRunning()) {
+    const int fd = cache_mgr_->Open(CacheManager::Bless(
+      (*small_objects_)[i % small_objects_->size()]));
+    assert(fd >= 0);
+    const int64_t nbytes = cache_mgr_->Pread(fd, buf, kSmallFileSize, 0);
+    assert(nbytes == kSmallFileSize);
+    cache_mgr_->Close(fd);
+    Escape(buf);
+    i++;
+  }
+  st.SetItemsProcessed(st.iterations());
+  st.SetBytesProcessed(st.iterations() * kSmallFileSize);
+}
+BENCHMARK_REGISTER_F(BM_Metadata, SmallFileRead)->ThreadRange(1, 16)->
+  UseRealTime();
+
+
+/**
+ * Sequential read of the large cached file in kBlockSize blocks
+ */
+BENCHMARK_DEFINE_F(BM_Metadata, LargeFileRead)(benchmark::State &st) {
+  unsigned char *buf = static_cast<unsigned char *>(malloc(kBlockSize));
+  const int fd = cache_mgr_->Open(CacheManager::Bless(*large_object_));
+  assert(fd >= 0);
+  uint64_t offset = 0;
+  while (st.KeepRunning()) {
+    const int64_t nbytes = cache_mgr_->Pread(fd, buf, kBlockSize, offset);
+    assert(nbytes == kBlockSize);
+    Escape(buf);
+    offset = (offset + kBlockSize) % kLargeFileSize;
+  }
+  cache_mgr_->Close(fd);
+  free(buf);
+  st.SetBytesProcessed(st.iterations() * kBlockSize);
+}
+BENCHMARK_REGISTER_F(BM_Metadata, LargeFileRead)->ThreadRange(1, 16)->
+  UseRealTime();
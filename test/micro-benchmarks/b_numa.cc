@@ -0,0 +1,84 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include <benchmark/benchmark.h>
+
+#include <sched.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "bm_util.h"
+#include "murmur.h"
+#include "platform.h"
+#include "prng.h"
+#include "smallhash.h"
+
+using namespace std;  // NOLINT
+
+/**
+ * Lookups in a large hash table, similar to the md5path cache, from the last
+ * CPU while the table is created on the first CPU.  On a multi-socket node,
+ * the table is remote for the lookups unless it is interleaved.  Arg(0) uses
+ * the default first-touch placement, Arg(1) interleaves the table.
+ */
+class BM_Numa : public benchmark::Fixture {
+ protected:
+  static const unsigned kNumEntries = 4 * 1024 * 1024;
+
+  virtual void SetUp(const benchmark::State &st) {
+    sched_getaffinity(0, sizeof(saved_cpus_), &saved_cpus_);
+    num_cpus_ = sysconf(_SC_NPROCESSORS_ONLN);
+  }
+
+  virtual void TearDown(const benchmark::State &st) {
+    sched_setaffinity(0, sizeof(saved_cpus_), &saved_cpus_);
+  }
+
+  static inline uint32_t hasher_uint64t(const uint64_t &value) {
+    return MurmurHash2(&value, sizeof(value), 0x07387a4f);
+  }
+
+  void PinCpu(unsigned cpu) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+  }
+
+  cpu_set_t saved_cpus_;
+  unsigned num_cpus_;
+};
+
+
+BENCHMARK_DEFINE_F(BM_Numa, RemoteLookup)(benchmark::State &st) {
+  PinCpu(0);
+  const bool interleaved =
+    (st.range_x() == 1) && platform_numa_interleave(true);
+  SmallHashFixed<uint64_t, uint64_t> *table =
+    new SmallHashFixed<uint64_t, uint64_t>();
+  table->Init(kNumEntries, 0, hasher_uint64t);
+  for (uint64_t i = 1; i <= kNumEntries; ++i)
+    table->Insert(i, i);
+  if (interleaved)
+    platform_numa_interleave(false);
+
+  PinCpu(num_cpus_ - 1);
+  Prng prng;
+  prng.InitLocaltime();
+  uint64_t sum = 0;
+  uint64_t value;
+  while (st.KeepRunning()) {
+    table->Lookup(prng.Next(kNumEntries) + 1, &value);
+    sum += value;
+  }
+  Escape(&sum);
+  st.SetItemsProcessed(st.iterations());
+  if (st.range_x() == 1)
+    st.SetLabel(interleaved ? "interleaved" : "single NUMA node");
+  else
+    st.SetLabel("first touch");
+  delete table;
+}
+BENCHMARK_REGISTER_F(BM_Numa, RemoteLookup)->Repetitions(3)->Arg(0)->Arg(1);
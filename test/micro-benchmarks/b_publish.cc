@@ -0,0 +1,185 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+#include <benchmark/benchmark.h>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "bm_util.h"
+#include "compression.h"
+#include "fs_traversal.h"
+#include "hash.h"
+#include "upload.h"
+#include "upload_spooler_definition.h"
+#include "util/algorithm.h"
+#include "util/pointer.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+/**
+ * Runs synthetic trees through the stages of a publish run: the traversal of
+ * the scratch area and the spooler pipeline (chunking, compression, hashing
+ * and the local uploader).  The stages in isolation are covered by the
+ * BM_ChunkDetector, BM_Compression and BM_Hash benchmarks.
+ *
+ * The tree has kNumFiles files but not more than kMaxBytes in total.  File
+ * sizes are uniformly distributed between half and one and a half times the
+ * average file size.  A given percentage of the files are duplicates, which
+ * are hashed but not stored twice.  The pipeline label shows the CPU
+ * utilization, i.e. CPU time over wall clock time.
+ *
+ * For regression tracking, run with --benchmark_format=json.
+ */
+class BM_Publish : public benchmark::Fixture {
+ public:
+  void OnFile(const string &parent_path, const string &name) {
+    num_scanned_++;
+  }
+
+ protected:
+  static const unsigned kNumFiles = 256;
+  static const unsigned kMaxBytes = 256 * 1024 * 1024;
+  static const unsigned kFanOut = 4;
+
+  virtual void SetUp(const benchmark::State &st) {
+    sandbox_ = CreateTempDir("/tmp/cvmfs_ubench_publish");
+    assert(!sandbox_.empty());
+    num_bytes_ = 0;
+    files_.clear();
+  }
+
+  virtual void TearDown(const benchmark::State &st) {
+    RemoveTree(sandbox_);
+  }
+
+  /**
+   * Directory of the i-th file in a tree of the given depth and kFanOut
+   * subdirectories per level.
+   */
+  string DirPath(unsigned i, const unsigned depth) {
+    string path = sandbox_ + "/tree";
+    for (unsigned level = 0; level < depth; ++level) {
+      path += "/d" + StringifyInt(i % kFanOut);
+      i /= kFanOut;
+    }
+    return path;
+  }
+
+  void CreateTree(const unsigned avg_size,
+                  const unsigned depth,
+                  const unsigned dup_percent)
+  {
+    srandom(42);
+    string unique_content;
+    const unsigned num_files =
+      std::min(static_cast<unsigned>(kNumFiles), kMaxBytes / avg_size);
+    for (unsigned i = 0; i < num_files; ++i) {
+      const unsigned size = avg_size / 2 + random() % (avg_size + 1);
+      string content(size, '\0');
+      for (unsigned j = 0; j < size; ++j)
+        content[j] = static_cast<char>(random());
+      if ((i > 0) && (random() % 100 < dup_percent))
+        content = unique_content;
+      else
+        unique_content = content;
+
+      const string dir = DirPath(i, depth);
+      bool retval = MkdirDeep(dir, 0755, true);
+      assert(retval);
+      const string path = dir + "/file" + StringifyInt(i);
+      retval = CopyMem2Path(
+        reinterpret_cast<const unsigned char *>(content.data()),
+        content.length(), path);
+      assert(retval);
+      files_.push_back(path);
+      num_bytes_ += content.length();
+    }
+  }
+
+  string sandbox_;
+  vector<string> files_;
+  uint64_t num_bytes_;
+  unsigned num_scanned_;
+};
+
+
+/**
+ * Scan stage: traversal of trees of increasing depth
+ */
+BENCHMARK_DEFINE_F(BM_Publish, Scan)(benchmark::State &st) {
+  const unsigned depth = st.range_x();
+  CreateTree(64, depth, 0);
+  while (st.KeepRunning()) {
+    num_scanned_ = 0;
+    FileSystemTraversal<BM_Publish> traversal(this, sandbox_, true);
+    traversal.fn_new_file = &BM_Publish::OnFile;
+    traversal.Recurse(sandbox_ + "/tree");
+    assert(num_scanned_ == kNumFiles);
+  }
+  st.SetItemsProcessed(st.iterations() * kNumFiles);
+  st.SetLabel("depth " + StringifyInt(depth));
+}
+BENCHMARK_REGISTER_F(BM_Publish, Scan)->Arg(1)->Arg(4)->Arg(8);
+
+
+/**
+ * Spooler pipeline for different average file sizes and duplication ratios
+ */
+BENCHMARK_DEFINE_F(BM_Publish, Pipeline)(benchmark::State &st) {
+  const unsigned avg_size = st.range_x();
+  const unsigned dup_percent = st.range_y();
+  CreateTree(avg_size, 4, dup_percent);
+
+  const string repo_path = sandbox_ + "/repo";
+  bool retval = MakeCacheDirectories(repo_path + "/data", 0700);
+  assert(retval);
+  const bool generate_legacy_bulk_chunks = false;
+  const bool use_file_chunking = true;
+  upload::SpoolerDefinition definition(
+    "local," + repo_path + "/data/txn," + repo_path,
+    shash::kSha1, zlib::kZlibDefault,
+    generate_legacy_bulk_chunks, use_file_chunking,
+    4 * 1024 * 1024, 8 * 1024 * 1024, 16 * 1024 * 1024);
+  assert(definition.IsValid());
+  UniquePtr<upload::Spooler> spooler(upload::Spooler::Construct(definition));
+  assert(spooler.IsValid());
+
+  struct rusage ru_start, ru_stop;
+  struct timeval wall_start, wall_stop;
+  getrusage(RUSAGE_SELF, &ru_start);
+  gettimeofday(&wall_start, NULL);
+  while (st.KeepRunning()) {
+    for (unsigned i = 0; i < files_.size(); ++i)
+      spooler->Process(files_[i]);
+    spooler->WaitForUpload();
+  }
+  gettimeofday(&wall_stop, NULL);
+  getrusage(RUSAGE_SELF, &ru_stop);
+  assert(spooler->GetNumberOfErrors() == 0);
+
+  const double cpu_time =
+    DiffTimeSeconds(ru_start.ru_utime, ru_stop.ru_utime) +
+    DiffTimeSeconds(ru_start.ru_stime, ru_stop.ru_stime);
+  const double wall_time = DiffTimeSeconds(wall_start, wall_stop);
+  char label[64];
+  snprintf(label, sizeof(label), "dup %u%%, cpu %.0f%%",
+           dup_percent, (wall_time > 0) ? 100.0 * cpu_time / wall_time : 0.0);
+  st.SetLabel(label);
+  st.SetItemsProcessed(st.iterations() * files_.size());
+  st.SetBytesProcessed(st.iterations() * num_bytes_);
+}
+BENCHMARK_REGISTER_F(BM_Publish, Pipeline)->
+  ArgPair(4 * 1024, 0)->ArgPair(4 * 1024, 50)->
+  ArgPair(1024 * 1024, 0)->ArgPair(1024 * 1024, 50)->
+  ArgPair(32 * 1024 * 1024, 0)->UseRealTime();
@@ -28,6 +28,9 @@ class BM_SmallHash : public benchmark::Fixture {
       shash::Md5 md5hash(reinterpret_cast<const char *>(&values_int_[i]),
                          sizeof(values_int_[i]));
       values_md5_[i] = md5hash;
+      values_any_[i] = shash::Any(shash::kSha1);
+      shash::HashMem(reinterpret_cast<const unsigned char *>(&values_int_[i]),
+                     sizeof(values_int_[i]), &values_any_[i]);
     }
   }
 
@@ -43,6 +46,63 @@ class BM_SmallHash : public benchmark::Fixture {
     return (uint32_t) *(reinterpret_cast<const uint32_t *>(key.digest) + 1);
   }
 
+  static inline uint32_t hasher_any(const shash::Any &key) {
+    return (uint32_t) *(reinterpret_cast<const uint32_t *>(key.digest) + 1);
+  }
+
+  /**
+   * Fills the table with the first st->range_x() keys and looks up hits and
+   * misses in turn.  Reports the table size next to the collisions.
+   */
+  template <class HashTableT, class Key>
+  void RunLookup(HashTableT *htable, const Key *keys, benchmark::State *st) {
+    const unsigned num_keys = st->range_x();
+    for (unsigned i = 0; i < num_keys; ++i)
+      htable->Insert(keys[i], i);
+
+    unsigned i = 0;
+    unsigned num_found = 0;
+    unsigned value;
+    while (st->KeepRunning()) {
+      // Every other lookup goes to a key that is not (likely) in the table
+      const unsigned idx = (i % 2) ? (i % num_keys) :
+                           (num_keys + (i % (kNumRandomNumbers - num_keys)));
+      num_found += htable->Lookup(keys[idx], &value);
+      ++i;
+    }
+    Escape(&num_found);
+
+    st->SetItemsProcessed(i);
+    uint64_t num_collisions;
+    uint32_t max_collisions;
+    htable->GetCollisionStats(&num_collisions, &max_collisions);
+    char label[96];
+    snprintf(label, sizeof(label), "collisions (avg/max) %f / %" PRIu32
+             ", %" PRIu64 " kB",
+             static_cast<float>(num_collisions) / static_cast<float>(i),
+             max_collisions, htable->bytes_allocated() / 1024);
+    st->SetLabel(label);
+  }
+
+  template <class HashTableT, class Key>
+  void RunInsertErase(HashTableT *htable, const Key *keys,
+                      benchmark::State *st)
+  {
+    const unsigned num_keys = st->range_x();
+    unsigned i = 0;
+    while (st->KeepRunning()) {
+      htable->Insert(keys[i % kNumRandomNumbers], i);
+      if (i >= num_keys)
+        htable->Erase(keys[(i - num_keys) % kNumRandomNumbers]);
+      ++i;
+    }
+    st->SetItemsProcessed(i);
+    char label[32];
+    snprintf(label, sizeof(label), "%" PRIu64 " kB",
+             htable->bytes_allocated() / 1024);
+    st->SetLabel(label);
+  }
+
   void SetCollisionLabel(uint64_t num_collisions,
                          uint32_t max_collisions,
                          size_t iterations,
@@ -59,6 +119,7 @@ class BM_SmallHash : public benchmark::Fixture {
   Prng prng_;
   uint64_t values_int_[kNumRandomNumbers];
   shash::Md5 values_md5_[kNumRandomNumbers];
+  shash::Any values_any_[kNumRandomNumbers];
 };
 
 
@@ -136,3 +197,78 @@ BENCHMARK_DEFINE_F(BM_SmallHash, InsertMd5Dirent)(benchmark::State &st) {
   SetCollisionLabel(num_collisions, max_collisions, i, &st);
 }
 BENCHMARK_REGISTER_F(BM_SmallHash, InsertMd5Dirent)->Repetitions(3)->Arg(40000);
+
+
+// Linear probing (SmallHashDynamic) versus group probing (SmallHashGrouped)
+// on the keys used by the caches
+
+BENCHMARK_DEFINE_F(BM_SmallHash, LookupIntDynamic)(benchmark::State &st) {
+  SmallHashDynamic<uint64_t, unsigned> htable;
+  htable.Init(16, 0, hasher_uint64t);
+  RunLookup(&htable, values_int_, &st);
+}
+BENCHMARK_REGISTER_F(BM_SmallHash, LookupIntDynamic)->Repetitions(3)
+  ->Arg(5000)->Arg(200000);
+
+
+BENCHMARK_DEFINE_F(BM_SmallHash, LookupIntGrouped)(benchmark::State &st) {
+  SmallHashGrouped<uint64_t, unsigned> htable;
+  htable.Init(16, 0, hasher_uint64t);
+  RunLookup(&htable, values_int_, &st);
+}
+BENCHMARK_REGISTER_F(BM_SmallHash, LookupIntGrouped)->Repetitions(3)
+  ->Arg(5000)->Arg(200000);
+
+
+BENCHMARK_DEFINE_F(BM_SmallHash, LookupMd5Dynamic)(benchmark::State &st) {
+  SmallHashDynamic<shash::Md5, unsigned> htable;
+  htable.Init(16, shash::Md5(shash::AsciiPtr("!")), hasher_md5);
+  RunLookup(&htable, values_md5_, &st);
+}
+BENCHMARK_REGISTER_F(BM_SmallHash, LookupMd5Dynamic)->Repetitions(3)
+  ->Arg(5000)->Arg(200000);
+
+
+BENCHMARK_DEFINE_F(BM_SmallHash, LookupMd5Grouped)(benchmark::State &st) {
+  SmallHashGrouped<shash::Md5, unsigned> htable;
+  htable.Init(16, shash::Md5(shash::AsciiPtr("!")), hasher_md5);
+  RunLookup(&htable, values_md5_, &st);
+}
+BENCHMARK_REGISTER_F(BM_SmallHash, LookupMd5Grouped)->Repetitions(3)
+  ->Arg(5000)->Arg(200000);
+
+
+BENCHMARK_DEFINE_F(BM_SmallHash, LookupAnyDynamic)(benchmark::State &st) {
+  SmallHashDynamic<shash::Any, unsigned> htable;
+  htable.Init(16, shash::Any(), hasher_any);
+  RunLookup(&htable, values_any_, &st);
+}
+BENCHMARK_REGISTER_F(BM_SmallHash, LookupAnyDynamic)->Repetitions(3)
+  ->Arg(5000)->Arg(200000);
+
+
+BENCHMARK_DEFINE_F(BM_SmallHash, LookupAnyGrouped)(benchmark::State &st) {
+  SmallHashGrouped<shash::Any, unsigned> htable;
+  htable.Init(16, shash::Any(), hasher_any);
+  RunLookup(&htable, values_any_, &st);
+}
+BENCHMARK_REGISTER_F(BM_SmallHash, LookupAnyGrouped)->Repetitions(3)
+  ->Arg(5000)->Arg(200000);
+
+
+BENCHMARK_DEFINE_F(BM_SmallHash, InsertEraseMd5Dynamic)(benchmark::State &st) {
+  SmallHashDynamic<shash::Md5, unsigned> htable;
+  htable.Init(16, shash::Md5(shash::AsciiPtr("!")), hasher_md5);
+  RunInsertErase(&htable, values_md5_, &st);
+}
+BENCHMARK_REGISTER_F(BM_SmallHash, InsertEraseMd5Dynamic)->Repetitions(3)
+  ->Arg(40000);
+
+
+BENCHMARK_DEFINE_F(BM_SmallHash, InsertEraseMd5Grouped)(benchmark::State &st) {
+  SmallHashGrouped<shash::Md5, unsigned> htable;
+  htable.Init(16, shash::Md5(shash::AsciiPtr("!")), hasher_md5);
+  RunInsertErase(&htable, values_md5_, &st);
+}
+BENCHMARK_REGISTER_F(BM_SmallHash, InsertEraseMd5Grouped)->Repetitions(3)
+  ->Arg(40000);
@@ -0,0 +1,206 @@
+#!/usr/bin/python
+"""
+A forward HTTP proxy for the node stress test (node_stress.sh) that adds
+latency and faults to the requests of cvmfs clients.
+
+Every request is delayed by the configured latency plus a random jitter.  A
+share of the requests fails with an HTTP 502 and another share has its
+connection dropped without an answer.  SIGUSR1 takes the proxy down, i.e. all
+connections are dropped, SIGUSR2 brings it back up.  This way, the stress
+test can trigger a proxy failover while the clients are busy.
+
+The proxy prints a line of statistics to stdout every 10 seconds.
+"""
+
+from __future__ import print_function
+
+import random
+import signal
+import socket
+import sys
+import threading
+import time
+from optparse import OptionParser
+
+try:
+  import BaseHTTPServer
+  import SocketServer
+  import urllib2
+  HTTPServer = BaseHTTPServer.HTTPServer
+  BaseHTTPRequestHandler = BaseHTTPServer.BaseHTTPRequestHandler
+  ThreadingMixIn = SocketServer.ThreadingMixIn
+  urlopen = urllib2.build_opener(urllib2.ProxyHandler({})).open
+  Request = urllib2.Request
+  HTTPError = urllib2.HTTPError
+except ImportError:
+  import http.server
+  import socketserver
+  import urllib.request
+  import urllib.error
+  HTTPServer = http.server.HTTPServer
+  BaseHTTPRequestHandler = http.server.BaseHTTPRequestHandler
+  ThreadingMixIn = socketserver.ThreadingMixIn
+  urlopen = urllib.request.build_opener(
+    urllib.request.ProxyHandler({})).open
+  Request = urllib.request.Request
+  HTTPError = urllib.error.HTTPError
+
+
+class State:
+  down = False
+  latency_ms = 0
+  jitter_ms = 0
+  error_rate = 0.0
+  drop_rate = 0.0
+  timeout = 30
+  lock = threading.Lock()
+  counters = {'requests': 0, 'errors': 0, 'drops': 0, 'upstream_errors': 0,
+              'bytes': 0}
+
+  @classmethod
+  def count(cls, name, value=1):
+    with cls.lock:
+      cls.counters[name] += value
+
+
+class FaultProxyHandler(BaseHTTPRequestHandler):
+  protocol_version = 'HTTP/1.0'
+
+  def log_message(self, format, *args):
+    pass
+
+  def drop(self):
+    State.count('drops')
+    try:
+      self.connection.shutdown(socket.SHUT_RDWR)
+    except socket.error:
+      pass
+    self.close_connection = True
+
+  def do_GET(self):
+    self.handle_request(send_body=True)
+
+  def do_HEAD(self):
+    self.handle_request(send_body=False)
+
+  def handle_request(self, send_body):
+    State.count('requests')
+    if State.down:
+      return self.drop()
+    delay_ms = State.latency_ms + random.uniform(0, State.jitter_ms)
+    if delay_ms > 0:
+      time.sleep(delay_ms / 1000.0)
+    dice = random.random()
+    if dice < State.drop_rate:
+      return self.drop()
+    if dice < State.drop_rate + State.error_rate:
+      State.count('errors')
+      self.send_error(502, 'Injected fault')
+      return
+
+    headers = {}
+    for name in ('Range', 'Cache-Control', 'Pragma', 'X-CVMFS-Info'):
+      if self.headers.get(name) is not None:
+        headers[name] = self.headers.get(name)
+    request = Request(self.path, headers=headers)
+    if not send_body:
+      request.get_method = lambda: 'HEAD'
+    try:
+      upstream = urlopen(request, timeout=State.timeout)
+      status = upstream.getcode()
+    except HTTPError as e:
+      upstream = e
+      status = e.code
+    except Exception:
+      State.count('upstream_errors')
+      self.send_error(502, 'Upstream unreachable')
+      return
+
+    try:
+      body = upstream.read() if send_body else b''
+    except Exception:
+      State.count('upstream_errors')
+      return self.drop()
+    self.send_response(status)
+    for name in ('Content-Type', 'Content-Range', 'Last-Modified',
+                 'Cache-Control', 'Location'):
+      value = upstream.headers.get(name)
+      if value is not None:
+        self.send_header(name, value)
+    self.send_header('Content-Length', str(len(body)))
+    self.end_headers()
+    if send_body:
+      try:
+        self.wfile.write(body)
+        State.count('bytes', len(body))
+      except socket.error:
+        pass
+
+
+class ThreadedHTTPServer(ThreadingMixIn, HTTPServer):
+  daemon_threads = True
+  request_queue_size = 512
+
+
+def on_down(signum, frame):
+  State.down = True
+  print('[%d] proxy down' % time.time())
+  sys.stdout.flush()
+
+
+def on_up(signum, frame):
+  State.down = False
+  print('[%d] proxy up' % time.time())
+  sys.stdout.flush()
+
+
+def print_statistics():
+  while True:
+    time.sleep(10)
+    with State.lock:
+      counters = dict(State.counters)
+    print('[%d] requests %d, errors %d, drops %d, upstream errors %d, '
+          'bytes %d' % (time.time(), counters['requests'], counters['errors'],
+                        counters['drops'], counters['upstream_errors'],
+                        counters['bytes']))
+    sys.stdout.flush()
+
+
+def main():
+  parser = OptionParser()
+  parser.add_option("-p", "--port", dest="port", type="int",
+                    help="port number to be bound to", metavar="PORT")
+  parser.add_option("-l", "--latency", dest="latency_ms", type="int",
+                    default=0, help="added latency in milliseconds")
+  parser.add_option("-j", "--jitter", dest="jitter_ms", type="int",
+                    default=0, help="random additional latency (ms)")
+  parser.add_option("-e", "--error-rate", dest="error_rate", type="float",
+                    default=0.0, help="share of requests answered by 502")
+  parser.add_option("-d", "--drop-rate", dest="drop_rate", type="float",
+                    default=0.0, help="share of dropped connections")
+  (options, args) = parser.parse_args()
+  if not options.port:
+    parser.print_help()
+    sys.exit(1)
+
+  State.latency_ms = options.latency_ms
+  State.jitter_ms = options.jitter_ms
+  State.error_rate = options.error_rate
+  State.drop_rate = options.drop_rate
+  signal.signal(signal.SIGUSR1, on_down)
+  signal.signal(signal.SIGUSR2, on_up)
+
+  stats = threading.Thread(target=print_statistics)
+  stats.daemon = True
+  stats.start()
+
+  httpd = ThreadedHTTPServer(("127.0.0.1", options.port), FaultProxyHandler)
+  print('[%d] serving on port %d (latency %d+%d ms, errors %.3f, drops %.3f)'
+        % (time.time(), options.port, State.latency_ms, State.jitter_ms,
+           State.error_rate, State.drop_rate))
+  sys.stdout.flush()
+  httpd.serve_forever()
+
+
+if __name__ == '__main__':
+  main()
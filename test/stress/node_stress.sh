@@ -0,0 +1,185 @@
+#!/bin/bash
+#
+# Node stress test: many private mounts of the same or different repositories,
+# many concurrent jobs, a shared cache that runs at its quota limit, and a
+# proxy failover in the middle of the run.
+#
+# The mounts go through two local fault proxies (fault_proxy.py).  The primary
+# proxy adds latency and injects errors; at the failover time it is taken down
+# so that all clients have to switch to the clean secondary proxy.  The jobs
+# are driven by stress_jobs.py.  Results end up in the output directory:
+#   results.json       throughput, latency percentiles, resource timeline
+#   talk-<n>.txt       internal affairs, proxy info and cache size per mount
+#   proxy-*.log        proxy statistics
+#
+# Needs sudo for mounting and the repository public keys in the keys
+# directory (-k).  Example:
+#   ./node_stress.sh -r atlas.cern.ch,cms.cern.ch \
+#     -s "http://cvmfs-stratum-one.cern.ch/cvmfs/@fqrn@" -d 600
+
+SCRIPT_DIR=$(cd "$(dirname "$0")" && pwd)
+
+REPOSITORIES=""
+NUM_MOUNTS=30
+NUM_JOBS=200
+DURATION=300
+QUOTA_MB=1000
+FAILOVER_AT=""
+SERVER_URL="http://cvmfs-stratum-one.cern.ch/cvmfs/@fqrn@"
+LATENCY_MS=20
+JITTER_MS=20
+ERROR_RATE=0.01
+DROP_RATE=0.005
+OUTPUT_DIR="$(pwd)/node_stress.$(date +%Y%m%d-%H%M%S)"
+KEYS_DIR=/etc/cvmfs/keys
+PROXY_PORT_BASE=18128
+
+usage() {
+  echo "usage: $0 -r <repositories> [options]"
+  echo "  -r  comma-separated list of repositories (mounts cycle through them)"
+  echo "  -m  number of mounts (default $NUM_MOUNTS)"
+  echo "  -j  number of concurrent jobs (default $NUM_JOBS)"
+  echo "  -d  duration in seconds (default $DURATION)"
+  echo "  -q  shared cache quota in MB (default $QUOTA_MB)"
+  echo "  -f  seconds until the primary proxy goes down (default: half time)"
+  echo "  -s  stratum 1 URL, @fqrn@ is replaced (default $SERVER_URL)"
+  echo "  -l  latency of the primary proxy in ms (default $LATENCY_MS)"
+  echo "  -e  error rate of the primary proxy (default $ERROR_RATE)"
+  echo "  -o  output directory"
+  echo "  -k  keys directory (default $KEYS_DIR)"
+  exit 1
+}
+
+while getopts "r:m:j:d:q:f:s:l:e:o:k:h" option; do
+  case $option in
+    r) REPOSITORIES=$OPTARG ;;
+    m) NUM_MOUNTS=$OPTARG ;;
+    j) NUM_JOBS=$OPTARG ;;
+    d) DURATION=$OPTARG ;;
+    q) QUOTA_MB=$OPTARG ;;
+    f) FAILOVER_AT=$OPTARG ;;
+    s) SERVER_URL=$OPTARG ;;
+    l) LATENCY_MS=$OPTARG ;;
+    e) ERROR_RATE=$OPTARG ;;
+    o) OUTPUT_DIR=$OPTARG ;;
+    k) KEYS_DIR=$OPTARG ;;
+    *) usage ;;
+  esac
+done
+[ -z "$REPOSITORIES" ] && usage
+[ -z "$FAILOVER_AT" ] && FAILOVER_AT=$(( $DURATION / 2 ))
+
+PRIMARY_PORT=$PROXY_PORT_BASE
+SECONDARY_PORT=$(( $PROXY_PORT_BASE + 1 ))
+WORK_DIR=$OUTPUT_DIR/work
+CACHE_DIR=$WORK_DIR/cache
+PRIMARY_PID=""
+SECONDARY_PID=""
+MOUNTPOINTS=""
+
+cleanup() {
+  echo "cleaning up..."
+  for mnt in $MOUNTPOINTS; do
+    sudo umount $mnt > /dev/null 2>&1 || sudo umount -l $mnt > /dev/null 2>&1
+  done
+  [ -z "$PRIMARY_PID" ]   || kill $PRIMARY_PID   > /dev/null 2>&1
+  [ -z "$SECONDARY_PID" ] || kill $SECONDARY_PID > /dev/null 2>&1
+  [ -z "$JOBS_PID" ]      || kill $JOBS_PID      > /dev/null 2>&1
+}
+trap cleanup EXIT HUP INT TERM
+
+repository_of() {
+  local n=$1
+  local repos=$(echo $REPOSITORIES | tr , ' ')
+  local num_repos=$(echo $repos | wc -w)
+  echo $repos | cut -d' ' -f$(( $n % $num_repos + 1 ))
+}
+
+write_config() {
+  local n=$1
+  local config=$WORK_DIR/config-$n
+  cat > $config << EOF
+CVMFS_SERVER_URL="$SERVER_URL"
+CVMFS_HTTP_PROXY="http://127.0.0.1:${PRIMARY_PORT};http://127.0.0.1:${SECONDARY_PORT}"
+CVMFS_PROXY_RESET_AFTER=$(( $DURATION * 2 ))
+CVMFS_KEYS_DIR=$KEYS_DIR
+CVMFS_CACHE_BASE=$CACHE_DIR
+CVMFS_SHARED_CACHE=yes
+CVMFS_QUOTA_LIMIT=$QUOTA_MB
+CVMFS_WORKSPACE=$WORK_DIR/workspace-$n
+CVMFS_RELOAD_SOCKETS=$WORK_DIR/workspace-$n
+CVMFS_USYSLOG=$OUTPUT_DIR/usyslog-$n.log
+CVMFS_CLAIM_OWNERSHIP=yes
+EOF
+  echo $config
+}
+
+talk() {
+  local n=$1
+  shift
+  sudo cvmfs_talk -p $WORK_DIR/workspace-$n/cvmfs_io.$(repository_of $n) "$@"
+}
+
+mkdir -p $WORK_DIR $CACHE_DIR || exit 1
+echo "output in $OUTPUT_DIR"
+
+echo "starting fault proxies on ports $PRIMARY_PORT and $SECONDARY_PORT"
+$SCRIPT_DIR/fault_proxy.py -p $PRIMARY_PORT -l $LATENCY_MS -j $JITTER_MS \
+  -e $ERROR_RATE -d $DROP_RATE > $OUTPUT_DIR/proxy-primary.log 2>&1 &
+PRIMARY_PID=$!
+$SCRIPT_DIR/fault_proxy.py -p $SECONDARY_PORT \
+  > $OUTPUT_DIR/proxy-secondary.log 2>&1 &
+SECONDARY_PID=$!
+sleep 1
+
+echo "mounting $NUM_MOUNTS repositories"
+mount_list=""
+for n in $(seq 0 $(( $NUM_MOUNTS - 1 ))); do
+  repo=$(repository_of $n)
+  mnt=$WORK_DIR/mnt-$n
+  mkdir -p $mnt $WORK_DIR/workspace-$n
+  config=$(write_config $n)
+  if ! sudo cvmfs2 -o config=$config,allow_other $repo $mnt \
+       > $OUTPUT_DIR/mount-$n.log 2>&1; then
+    echo "failed to mount $repo on $mnt (see $OUTPUT_DIR/mount-$n.log)"
+    exit 2
+  fi
+  MOUNTPOINTS="$MOUNTPOINTS $mnt"
+  mount_list="${mount_list:+$mount_list,}$mnt"
+done
+
+echo "running $NUM_JOBS jobs for $DURATION seconds"
+$SCRIPT_DIR/stress_jobs.py -m $mount_list -j $NUM_JOBS -d $DURATION \
+  -o $OUTPUT_DIR/results.json > $OUTPUT_DIR/jobs.log 2>&1 &
+JOBS_PID=$!
+
+sleep $FAILOVER_AT
+echo "taking down the primary proxy after $FAILOVER_AT seconds"
+kill -USR1 $PRIMARY_PID
+
+wait $JOBS_PID
+jobs_retval=$?
+JOBS_PID=""
+
+echo "collecting client statistics"
+failed_over=0
+for n in $(seq 0 $(( $NUM_MOUNTS - 1 ))); do
+  {
+    talk $n proxy info
+    talk $n cache size
+    talk $n internal affairs
+  } > $OUTPUT_DIR/talk-$n.txt 2>&1
+  if grep "Active proxy:" $OUTPUT_DIR/talk-$n.txt | \
+     grep -q "127.0.0.1:${SECONDARY_PORT}"; then
+    failed_over=$(( $failed_over + 1 ))
+  fi
+done
+du -sh $CACHE_DIR > $OUTPUT_DIR/cache-usage.txt 2>&1
+
+cat $OUTPUT_DIR/jobs.log
+echo "$failed_over of $NUM_MOUNTS mounts failed over to the secondary proxy"
+echo "shared cache: $(cat $OUTPUT_DIR/cache-usage.txt), quota $QUOTA_MB MB"
+
+[ $jobs_retval -eq 0 ] || exit 3
+[ $failed_over -eq $NUM_MOUNTS ] || exit 4
+exit 0
@@ -0,0 +1,247 @@
+#!/usr/bin/python
+"""
+Runs many concurrent jobs against a set of cvmfs mount points and reports
+throughput, latency percentiles and the resource usage of the cvmfs2
+processes.  Used by node_stress.sh but it works on any mounted repositories.
+
+Every job is a thread that picks a random mount point and a random file and
+stats it, lists its directory, or reads it completely.  The files are
+discovered by a walk through each mount point before the jobs start.  The
+results are written as JSON, a summary is printed on stdout.
+"""
+
+from __future__ import print_function
+
+import json
+import os
+import random
+import sys
+import threading
+import time
+from optparse import OptionParser
+
+OPERATIONS = ('stat', 'listdir', 'read')
+READ_BLOCK = 128 * 1024
+
+
+def discover(mountpoint, max_files):
+  files = []
+  for root, dirs, names in os.walk(mountpoint):
+    for name in names:
+      files.append(os.path.join(root, name))
+      if len(files) >= max_files:
+        return files
+  return files
+
+
+def percentile(sorted_values, p):
+  if not sorted_values:
+    return 0.0
+  idx = int(round(p / 100.0 * (len(sorted_values) - 1)))
+  return sorted_values[idx]
+
+
+class Recorder:
+  def __init__(self):
+    self.lock = threading.Lock()
+    self.latencies = dict((op, []) for op in OPERATIONS)
+    self.errors = dict((op, 0) for op in OPERATIONS)
+    self.bytes_read = 0
+    self.timeline = []
+
+  def record(self, op, latency_s, nbytes, failed):
+    with self.lock:
+      if failed:
+        self.errors[op] += 1
+      else:
+        self.latencies[op].append(latency_s)
+      self.bytes_read += nbytes
+
+
+def run_job(files, recorder, deadline, weights):
+  rnd = random.Random()
+  mounts = list(files.keys())
+  while time.time() < deadline:
+    mnt = rnd.choice(mounts)
+    if not files[mnt]:
+      continue
+    path = rnd.choice(files[mnt])
+    op = rnd.choice(weights)
+    nbytes = 0
+    failed = False
+    start = time.time()
+    try:
+      if op == 'stat':
+        os.stat(path)
+      elif op == 'listdir':
+        os.listdir(os.path.dirname(path))
+      else:
+        f = open(path, 'rb')
+        try:
+          while True:
+            block = f.read(READ_BLOCK)
+            if not block:
+              break
+            nbytes += len(block)
+        finally:
+          f.close()
+    except (IOError, OSError):
+      failed = True
+    recorder.record(op, time.time() - start, nbytes, failed)
+
+
+def cvmfs_pids():
+  pids = []
+  for entry in os.listdir('/proc'):
+    if not entry.isdigit():
+      continue
+    try:
+      comm = open('/proc/%s/comm' % entry).read().strip()
+    except (IOError, OSError):
+      continue
+    if comm == 'cvmfs2':
+      pids.append(entry)
+  return pids
+
+
+def sample_resources():
+  """Sum of RSS (kB), CPU time (s) and threads over all cvmfs2 processes"""
+  clock_ticks = os.sysconf('SC_CLK_TCK')
+  rss_kb = cpu_s = threads = 0
+  pids = cvmfs_pids()
+  for pid in pids:
+    try:
+      for line in open('/proc/%s/status' % pid):
+        if line.startswith('VmRSS:'):
+          rss_kb += int(line.split()[1])
+        elif line.startswith('Threads:'):
+          threads += int(line.split()[1])
+      stat = open('/proc/%s/stat' % pid).read()
+      fields = stat[stat.rfind(')') + 2:].split()
+      cpu_s += float(int(fields[11]) + int(fields[12])) / clock_ticks
+    except (IOError, OSError, IndexError, ValueError):
+      continue
+  return {'processes': len(pids), 'rss_kb': rss_kb, 'cpu_s': cpu_s,
+          'threads': threads}
+
+
+def run_sampler(recorder, start, deadline, interval):
+  while True:
+    sample = sample_resources()
+    sample['time'] = time.time() - start
+    with recorder.lock:
+      sample['ops'] = sum(len(l) for l in recorder.latencies.values())
+      sample['bytes'] = recorder.bytes_read
+      recorder.timeline.append(sample)
+    if time.time() >= deadline:
+      return
+    time.sleep(interval)
+
+
+def summarize(recorder, duration):
+  result = {'duration': duration, 'operations': {},
+            'bytes_read': recorder.bytes_read,
+            'mb_per_s': recorder.bytes_read / duration / (1024.0 * 1024.0),
+            'timeline': recorder.timeline}
+  total = 0
+  for op in OPERATIONS:
+    values = sorted(recorder.latencies[op])
+    total += len(values)
+    result['operations'][op] = {
+      'count': len(values),
+      'errors': recorder.errors[op],
+      'ops_per_s': len(values) / duration,
+      'p50_ms': percentile(values, 50) * 1000,
+      'p90_ms': percentile(values, 90) * 1000,
+      'p99_ms': percentile(values, 99) * 1000,
+      'max_ms': (values[-1] if values else 0.0) * 1000,
+    }
+  result['ops_per_s'] = total / duration
+  if recorder.timeline:
+    result['max_rss_kb'] = max(s['rss_kb'] for s in recorder.timeline)
+    result['max_threads'] = max(s['threads'] for s in recorder.timeline)
+    result['cpu_s'] = (recorder.timeline[-1]['cpu_s'] -
+                       recorder.timeline[0]['cpu_s'])
+  return result
+
+
+def print_summary(result):
+  print('%-8s %10s %8s %10s %10s %10s %10s %10s' %
+        ('op', 'count', 'errors', 'ops/s', 'p50 ms', 'p90 ms', 'p99 ms',
+         'max ms'))
+  for op in OPERATIONS:
+    r = result['operations'][op]
+    print('%-8s %10d %8d %10.1f %10.2f %10.2f %10.2f %10.2f' %
+          (op, r['count'], r['errors'], r['ops_per_s'], r['p50_ms'],
+           r['p90_ms'], r['p99_ms'], r['max_ms']))
+  print('total %.1f ops/s, %.2f MB/s read' %
+        (result['ops_per_s'], result['mb_per_s']))
+  if 'max_rss_kb' in result:
+    print('cvmfs2: max RSS %d MB, max threads %d, CPU %.1f s' %
+          (result['max_rss_kb'] / 1024, result['max_threads'],
+           result['cpu_s']))
+
+
+def main():
+  parser = OptionParser()
+  parser.add_option("-m", "--mounts", dest="mounts",
+                    help="comma-separated list of mount points")
+  parser.add_option("-j", "--jobs", dest="jobs", type="int", default=200,
+                    help="number of concurrent jobs")
+  parser.add_option("-d", "--duration", dest="duration", type="int",
+                    default=300, help="run time in seconds")
+  parser.add_option("-o", "--output", dest="output",
+                    help="JSON result file")
+  parser.add_option("-i", "--sample-interval", dest="interval", type="int",
+                    default=5, help="resource sampling interval in seconds")
+  parser.add_option("-n", "--max-files", dest="max_files", type="int",
+                    default=20000, help="files discovered per mount point")
+  parser.add_option("-w", "--weights", dest="weights", default="4,1,2",
+                    help="relative weights of stat,listdir,read")
+  (options, args) = parser.parse_args()
+  if not options.mounts:
+    parser.print_help()
+    sys.exit(1)
+
+  weights = []
+  for op, w in zip(OPERATIONS, options.weights.split(',')):
+    weights += [op] * int(w)
+  files = {}
+  for mnt in options.mounts.split(','):
+    files[mnt] = discover(mnt, options.max_files)
+    if not files[mnt]:
+      print('no files found in %s' % mnt, file=sys.stderr)
+      sys.exit(1)
+  print('discovered %d files in %d mount points' %
+        (sum(len(f) for f in files.values()), len(files)))
+  sys.stdout.flush()
+
+  recorder = Recorder()
+  start = time.time()
+  deadline = start + options.duration
+  sampler = threading.Thread(target=run_sampler,
+                             args=(recorder, start, deadline,
+                                   options.interval))
+  sampler.daemon = True
+  sampler.start()
+  jobs = []
+  for i in range(options.jobs):
+    t = threading.Thread(target=run_job,
+                         args=(files, recorder, deadline, weights))
+    t.daemon = True
+    t.start()
+    jobs.append(t)
+  for t in jobs:
+    t.join()
+  sampler.join()
+
+  result = summarize(recorder, time.time() - start)
+  print_summary(result)
+  if options.output:
+    f = open(options.output, 'w')
+    json.dump(result, f, indent=2, sort_keys=True)
+    f.close()
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,20 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#ifndef TEST_UNITTESTS_ALLOC_ALLOCATION_COUNTER_H_
+#define TEST_UNITTESTS_ALLOC_ALLOCATION_COUNTER_H_
+
+/**
+ * Counts the calls to operator new of the calling thread during the lifetime
+ * of the object.  Backed by the replacement of the global operator new in
+ * main.cc, which is why these tests live in their own binary.
+ */
+class AllocationCounter {
+ public:
+  AllocationCounter();
+  ~AllocationCounter();
+  unsigned count() const;
+};
+
+#endif  // TEST_UNITTESTS_ALLOC_ALLOCATION_COUNTER_H_
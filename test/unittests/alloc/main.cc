@@ -0,0 +1,53 @@
+/**
+ * This file is part of the CernVM File System.
+ *
+ * Tests that hot code paths do not allocate memory.  The global operator new
+ * is replaced for this binary only, the regular unit tests keep the default
+ * allocator.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+#include "allocation_counter.h"
+
+namespace {
+__thread bool g_count_allocations = false;
+__thread unsigned g_num_allocations = 0;
+}  // anonymous namespace
+
+void *operator new(size_t size) {
+  if (g_count_allocations)
+    g_num_allocations++;
+  void *p = malloc(size ? size : 1);
+  if (p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) throw() {
+  free(p);
+}
+
+AllocationCounter::AllocationCounter() {
+  assert(!g_count_allocations);
+  g_num_allocations = 0;
+  g_count_allocations = true;
+}
+
+AllocationCounter::~AllocationCounter() {
+  g_count_allocations = false;
+}
+
+unsigned AllocationCounter::count() const {
+  return g_num_allocations;
+}
+
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,59 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "allocation_counter.h"
+#include "cache_posix.h"
+#include "hash.h"
+#include "prng.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+
+TEST(T_Allocation, WritePathWithoutSuffix) {
+  Prng prng;
+  prng.InitSeed(42);
+  char buffer[128];
+
+  shash::Any hash_rmd160(shash::kRmd160);
+  hash_rmd160.Randomize(&prng);
+  hash_rmd160.suffix = shash::kSuffixCatalog;
+  const string expected = hash_rmd160.MakePathWithoutSuffix();
+  {
+    AllocationCounter allocations;
+    EXPECT_EQ(expected.length(),
+              hash_rmd160.WritePathWithoutSuffix(buffer, sizeof(buffer)));
+    EXPECT_EQ(0U, allocations.count());
+  }
+  EXPECT_EQ(expected, string(buffer));
+}
+
+
+TEST(T_Allocation, PosixCacheOpen) {
+  const string tmp_path = CreateTempDir("./cvmfs_ut_alloc_cache");
+  ASSERT_FALSE(tmp_path.empty());
+  PosixCacheManager *cache_mgr = PosixCacheManager::Create(tmp_path, false);
+  ASSERT_TRUE(cache_mgr != NULL);
+
+  shash::Any hash(shash::kSha1);
+  hash.digest[0] = 1;
+  unsigned char buf = 'A';
+  ASSERT_TRUE(cache_mgr->CommitFromMem(hash, &buf, 1, "one"));
+
+  int fd;
+  {
+    AllocationCounter allocations;
+    fd = cache_mgr->Open(CacheManager::Bless(hash));
+    EXPECT_EQ(0U, allocations.count());
+  }
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(0, cache_mgr->Close(fd));
+
+  delete cache_mgr;
+  RemoveTree(tmp_path);
+}
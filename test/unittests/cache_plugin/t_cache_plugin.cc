@@ -7,6 +7,8 @@
 
 #include <gtest/gtest.h>
 
+#include <pthread.h>
+
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -19,6 +21,7 @@
 #include "globals.h"
 #include "hash.h"
 #include "prng.h"
+#include "util/pointer.h"
 #include "util/posix.h"
 #include "util/string.h"
 
@@ -58,6 +61,8 @@ class T_CachePlugin : public ::testing::Test {
     }
   }
 
+  static void *MainLoad(void *data);
+
   static const int nfiles;
   ExternalCacheManager *cache_mgr_;
   ExternalQuotaManager *quota_mgr_;
@@ -406,3 +411,81 @@ TEST_F(T_CachePlugin, List) {
     EXPECT_EQ(0, cache_mgr_->Close(*i));
   }
 }
+
+
+namespace {
+
+struct LoadData {
+  T_CachePlugin *fixture;
+  unsigned seed;
+  unsigned num_objects;
+  unsigned num_misses;
+};
+
+}  // anonymous namespace
+
+/**
+ * Every thread has its own connection and stores and reads back objects with
+ * random content.  Objects are unpinned after the read and may be evicted
+ * concurrently by other threads, so only the content of found objects is
+ * checked.
+ */
+void *T_CachePlugin::MainLoad(void *data) {
+  LoadData *ld = reinterpret_cast<LoadData *>(data);
+  int fd_client = ld->fixture->Connect();
+  EXPECT_GE(fd_client, 0);
+  UniquePtr<ExternalCacheManager> cache_mgr(
+    ExternalCacheManager::Create(fd_client, nfiles, "load"));
+  EXPECT_TRUE(cache_mgr.IsValid());
+  if (!cache_mgr.IsValid())
+    return NULL;
+
+  Prng prng;
+  prng.InitSeed(ld->seed);
+  vector<shash::Any> ids;
+  vector<string> contents;
+  for (unsigned i = 0; i < ld->num_objects; ++i) {
+    string content(prng.Next(64 * 1024) + 1, 'a' + prng.Next(26));
+    content += StringifyInt(ld->seed) + "-" + StringifyInt(i);
+    shash::Any id(shash::kSha1);
+    HashString(content, &id);
+    unsigned char *data = const_cast<unsigned char *>(
+      reinterpret_cast<const unsigned char *>(content.data()));
+    EXPECT_TRUE(cache_mgr->CommitFromMem(id, data, content.length(), "load"));
+    ids.push_back(id);
+    contents.push_back(content);
+
+    unsigned idx = prng.Next(ids.size());
+    unsigned char *buffer;
+    uint64_t size;
+    if (!cache_mgr->Open2Mem(ids[idx], "load", &buffer, &size)) {
+      ld->num_misses++;
+      continue;
+    }
+    EXPECT_EQ(contents[idx], string(reinterpret_cast<char *>(buffer), size));
+    free(buffer);
+  }
+  return NULL;
+}
+
+
+TEST_F(T_CachePlugin, ConcurrentLoad) {
+  const unsigned num_threads = 8;
+  pthread_t threads[num_threads];
+  LoadData ld[num_threads];
+  for (unsigned i = 0; i < num_threads; ++i) {
+    ld[i].fixture = this;
+    ld[i].seed = 42 + i;
+    ld[i].num_objects = 250;
+    ld[i].num_misses = 0;
+    int retval = pthread_create(&threads[i], NULL, MainLoad, &ld[i]);
+    ASSERT_EQ(0, retval);
+  }
+  unsigned num_misses = 0;
+  for (unsigned i = 0; i < num_threads; ++i) {
+    pthread_join(threads[i], NULL);
+    num_misses += ld[i].num_misses;
+  }
+  printf("%u cache misses out of %u reads\n",
+         num_misses, num_threads * ld[0].num_objects);
+}
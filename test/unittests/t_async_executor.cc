@@ -0,0 +1,158 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include "async_executor.h"
+#include "atomic.h"
+#include "clientctx.h"
+#include "statistics.h"
+#include "util/pointer.h"
+#include "util/posix.h"
+#include "util_concurrency.h"
+
+using namespace std;  // NOLINT
+
+namespace cvmfs {
+
+class T_AsyncExecutor : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    n_submitted_ = statistics_.Register("test.n_submitted", "");
+    n_rejected_ = statistics_.Register("test.n_rejected", "");
+    atomic_init32(&num_processed_);
+    atomic_init32(&num_with_ctx_);
+    atomic_init32(&num_drained_);
+  }
+
+  static void CountJob(void *data) {
+    T_AsyncExecutor *test = reinterpret_cast<T_AsyncExecutor *>(data);
+    atomic_inc32(&test->num_processed_);
+    uid_t uid;
+    gid_t gid;
+    pid_t pid;
+    ClientCtx *ctx = ClientCtx::GetInstance();
+    if (ctx->IsSet()) {
+      ctx->Get(&uid, &gid, &pid);
+      if ((uid == 1) && (gid == 2) && (pid == 3))
+        atomic_inc32(&test->num_with_ctx_);
+    }
+  }
+
+  /**
+   * Blocks until a byte is written to pipe_block_
+   */
+  static void BlockingJob(void *data) {
+    T_AsyncExecutor *test = reinterpret_cast<T_AsyncExecutor *>(data);
+    char c;
+    ReadPipe(test->pipe_block_[0], &c, 1);
+    atomic_inc32(&test->num_processed_);
+  }
+
+  static void *MainDrain(void *data) {
+    T_AsyncExecutor *test = reinterpret_cast<T_AsyncExecutor *>(data);
+    test->executor_->Drain();
+    atomic_inc32(&test->num_drained_);
+    return NULL;
+  }
+
+  perf::Statistics statistics_;
+  perf::Counter *n_submitted_;
+  perf::Counter *n_rejected_;
+  atomic_int32 num_processed_;
+  atomic_int32 num_with_ctx_;
+  atomic_int32 num_drained_;
+  int pipe_block_[2];
+  AsyncExecutor *executor_;
+};
+
+
+TEST_F(T_AsyncExecutor, Submit) {
+  UniquePtr<AsyncExecutor> executor(
+    new AsyncExecutor(4, n_submitted_, n_rejected_));
+  EXPECT_EQ(4U, executor->num_threads());
+  // Not yet running
+  EXPECT_FALSE(executor->Submit(CountJob, this));
+  EXPECT_EQ(0, n_submitted_->Get());
+  executor->Spawn();
+
+  const unsigned kNumJobs = 100;
+  unsigned num_submitted = 0;
+  {
+    ClientCtxGuard ctx_guard(1, 2, 3);
+    for (unsigned i = 0; i < kNumJobs / 2; ++i)
+      num_submitted += executor->Submit(CountJob, this) ? 1 : 0;
+  }
+  for (unsigned i = 0; i < kNumJobs / 2; ++i)
+    num_submitted += executor->Submit(CountJob, this) ? 1 : 0;
+  EXPECT_EQ(kNumJobs, num_submitted);
+
+  // The queued jobs are processed before the workers stop
+  executor.Destroy();
+  EXPECT_EQ(static_cast<int32_t>(kNumJobs), atomic_read32(&num_processed_));
+  EXPECT_EQ(static_cast<int32_t>(kNumJobs / 2), atomic_read32(&num_with_ctx_));
+  EXPECT_EQ(static_cast<int64_t>(kNumJobs), n_submitted_->Get());
+  EXPECT_EQ(0, n_rejected_->Get());
+
+  AsyncExecutor disabled(0, n_submitted_, n_rejected_);
+  disabled.Spawn();
+  EXPECT_FALSE(disabled.Submit(CountJob, this));
+}
+
+
+TEST_F(T_AsyncExecutor, QueueFull) {
+  AsyncExecutor executor(1, n_submitted_, n_rejected_);
+  // Pretend the worker is running but never takes a job
+  executor.spawned_ = true;
+  for (unsigned i = 0; i < AsyncExecutor::kMaxQueueLength; ++i)
+    EXPECT_TRUE(executor.Submit(CountJob, this));
+  EXPECT_FALSE(executor.Submit(CountJob, this));
+  EXPECT_EQ(static_cast<int64_t>(AsyncExecutor::kMaxQueueLength),
+            n_submitted_->Get());
+  EXPECT_EQ(1, n_rejected_->Get());
+
+  for (unsigned i = 0; i < executor.jobs_.size(); ++i)
+    AsyncExecutor::ProcessJob(executor.jobs_[i]);
+  executor.jobs_.clear();
+  EXPECT_EQ(static_cast<int32_t>(AsyncExecutor::kMaxQueueLength),
+            atomic_read32(&num_processed_));
+}
+
+
+
+TEST_F(T_AsyncExecutor, Drain) {
+  AsyncExecutor executor(2, n_submitted_, n_rejected_);
+  executor_ = &executor;
+  // Nothing to wait for
+  executor.Drain();
+  EXPECT_FALSE(executor.Submit(CountJob, this));
+  executor.draining_ = false;
+
+  executor.Spawn();
+  MakePipe(pipe_block_);
+  EXPECT_TRUE(executor.Submit(BlockingJob, this));
+  EXPECT_TRUE(executor.Submit(CountJob, this));
+
+  pthread_t thread_drain;
+  int retval = pthread_create(&thread_drain, NULL, MainDrain, this);
+  ASSERT_EQ(0, retval);
+  while (true) {
+    MutexLockGuard lock_guard(&executor.lock_);
+    if (executor.draining_)
+      break;
+  }
+  EXPECT_FALSE(executor.Submit(CountJob, this));
+  SafeSleepMs(100);
+  EXPECT_EQ(0, atomic_read32(&num_drained_));
+
+  char c = 'x';
+  WritePipe(pipe_block_[1], &c, 1);
+  pthread_join(thread_drain, NULL);
+  EXPECT_EQ(1, atomic_read32(&num_drained_));
+  EXPECT_EQ(2, atomic_read32(&num_processed_));
+  EXPECT_EQ(2, n_submitted_->Get());
+  ClosePipe(pipe_block_);
+}
+
+}  // namespace cvmfs
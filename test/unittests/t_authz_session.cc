@@ -10,9 +10,11 @@
 #include "authz/authz.h"
 #include "authz/authz_fetch.h"
 #include "authz/authz_session.h"
+#include "authz/authz_shared.h"
 #include "platform.h"
 #include "statistics.h"
 #include "util/pointer.h"
+#include "util/posix.h"
 
 
 class TestAuthzFetcher : public AuthzFetcher {
@@ -47,6 +49,7 @@ class T_AuthzSession : public ::testing::Test {
   AuthzSessionManager *authz_session_mgr_;
   TestAuthzFetcher authz_fetcher_;
   perf::Statistics statistics;
+  perf::Statistics statistics_other_;
 };
 
 
@@ -173,3 +176,59 @@ TEST_F(T_AuthzSession, GetTokenCopy) {
 
   EXPECT_EQ(NULL, authz_session_mgr_->GetTokenCopy(-1, "A"));
 }
+
+
+TEST_F(T_AuthzSession, SharedCache) {
+  const std::string path = CreateTempPath("./cvmfs_ut_authz_shared", 0600);
+  ASSERT_FALSE(path.empty());
+  AuthzSessionManager *other_mgr =
+    AuthzSessionManager::Create(&authz_fetcher_, &statistics_other_);
+  authz_session_mgr_->SetSharedCache(AuthzSharedCache::Open(path));
+  other_mgr->SetSharedCache(AuthzSharedCache::Open(path));
+
+  AuthzSessionManager::SessionKey session_key;
+  AuthzSessionManager::PidKey pid_key;
+  AuthzData authz_data;
+  session_key.sid = pid_key.sid = 1;
+  session_key.sid_bday = 10;
+  pid_key.pid = 1;
+  pid_key.uid = 1000;
+  pid_key.gid = 1000;
+  authz_fetcher_.next_status = kAuthzOk;
+  authz_fetcher_.next_ttl = 1000;
+  EXPECT_TRUE(authz_session_mgr_->LookupAuthzData(
+    pid_key, session_key, "A", &authz_data));
+
+  // The other mount point takes the decision unless it needs the token
+  authz_fetcher_.next_status = kAuthzNotMember;
+  EXPECT_TRUE(other_mgr->LookupAuthzData(
+    pid_key, session_key, "A", &authz_data, false));
+  EXPECT_EQ(1, statistics_other_.Lookup("authz.n_shared")->Get());
+  EXPECT_EQ(0, statistics_other_.Lookup("authz.n_fetch")->Get());
+  EXPECT_FALSE(other_mgr->LookupAuthzData(
+    pid_key, session_key, "A", &authz_data, true));
+  EXPECT_EQ(1, statistics_other_.Lookup("authz.n_fetch")->Get());
+
+  // Negative decisions are shared, too
+  session_key.sid = pid_key.sid = 2;
+  EXPECT_FALSE(authz_session_mgr_->LookupAuthzData(
+    pid_key, session_key, "A", &authz_data));
+  authz_fetcher_.next_status = kAuthzOk;
+  EXPECT_FALSE(other_mgr->LookupAuthzData(
+    pid_key, session_key, "A", &authz_data, true));
+  EXPECT_EQ(2, statistics_other_.Lookup("authz.n_shared")->Get());
+  EXPECT_EQ(1, statistics_other_.Lookup("authz.n_fetch")->Get());
+
+  // Another user is not covered
+  session_key.sid = pid_key.sid = 3;
+  EXPECT_TRUE(authz_session_mgr_->LookupAuthzData(
+    pid_key, session_key, "A", &authz_data));
+  pid_key.uid = 1001;
+  EXPECT_TRUE(other_mgr->LookupAuthzData(
+    pid_key, session_key, "A", &authz_data, false));
+  EXPECT_EQ(2, statistics_other_.Lookup("authz.n_shared")->Get());
+  EXPECT_EQ(2, statistics_other_.Lookup("authz.n_fetch")->Get());
+
+  delete other_mgr;
+  unlink(path.c_str());
+}
@@ -0,0 +1,121 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <string>
+
+#include "authz/authz_shared.h"
+#include "util/pointer.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+class T_AuthzShared : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    path_ = CreateTempPath("./cvmfs_ut_authz_shared", 0600);
+    ASSERT_FALSE(path_.empty());
+  }
+
+  virtual void TearDown() {
+    unlink(path_.c_str());
+  }
+
+  string path_;
+};
+
+
+TEST_F(T_AuthzShared, LookupStore) {
+  UniquePtr<AuthzSharedCache> cache(AuthzSharedCache::Open(path_));
+  ASSERT_TRUE(cache.IsValid());
+  UniquePtr<AuthzSharedCache> other(AuthzSharedCache::Open(path_));
+  ASSERT_TRUE(other.IsValid());
+
+  AuthzSharedCache::Key key(100, 1234, 1000, 1000, "cms");
+  AuthzStatus status;
+  unsigned ttl;
+  EXPECT_FALSE(cache->Lookup(key, &status, &ttl));
+  cache->Store(key, kAuthzOk, 60);
+  EXPECT_TRUE(other->Lookup(key, &status, &ttl));
+  EXPECT_EQ(kAuthzOk, status);
+  EXPECT_LE(ttl, 60U);
+  EXPECT_GE(ttl, 59U);
+
+  cache->Store(key, kAuthzNotMember, 30);
+  EXPECT_TRUE(other->Lookup(key, &status, &ttl));
+  EXPECT_EQ(kAuthzNotMember, status);
+
+  // Every part of the key matters
+  AuthzSharedCache::Key other_key = key;
+  other_key.membership = "atlas";
+  EXPECT_FALSE(other->Lookup(other_key, &status, &ttl));
+  other_key = key;
+  other_key.sid_bday++;
+  EXPECT_FALSE(other->Lookup(other_key, &status, &ttl));
+  other_key = key;
+  other_key.uid++;
+  EXPECT_FALSE(other->Lookup(other_key, &status, &ttl));
+  other_key = key;
+  other_key.gid++;
+  EXPECT_FALSE(other->Lookup(other_key, &status, &ttl));
+  other_key = key;
+  other_key.sid++;
+  EXPECT_FALSE(other->Lookup(other_key, &status, &ttl));
+
+  // Reopening keeps the entries
+  cache.Destroy();
+  cache = AuthzSharedCache::Open(path_);
+  ASSERT_TRUE(cache.IsValid());
+  EXPECT_TRUE(cache->Lookup(key, &status, &ttl));
+}
+
+
+TEST_F(T_AuthzShared, Expiry) {
+  UniquePtr<AuthzSharedCache> cache(AuthzSharedCache::Open(path_));
+  ASSERT_TRUE(cache.IsValid());
+  AuthzSharedCache::Key key(100, 1234, 1000, 1000, "cms");
+  AuthzStatus status;
+  unsigned ttl;
+  cache->Store(key, kAuthzOk, 0);
+  EXPECT_TRUE(cache->Lookup(key, &status, &ttl));
+  EXPECT_EQ(0U, ttl);
+  sleep(1);
+  EXPECT_FALSE(cache->Lookup(key, &status, &ttl));
+}
+
+
+TEST_F(T_AuthzShared, Collisions) {
+  UniquePtr<AuthzSharedCache> cache(AuthzSharedCache::Open(path_));
+  ASSERT_TRUE(cache.IsValid());
+  AuthzStatus status;
+  unsigned ttl;
+  // Far more sessions than slots: the table never overflows, recent entries
+  // with long lifetimes survive
+  for (unsigned i = 0; i < 4 * AuthzSharedCache::kNumEntries; ++i) {
+    AuthzSharedCache::Key key(i, i, 1000, 1000, "cms");
+    cache->Store(key, kAuthzOk, 10);
+  }
+  AuthzSharedCache::Key key(0, 0, 1000, 1000, "long");
+  cache->Store(key, kAuthzOk, 1000);
+  unsigned num_found = 0;
+  for (unsigned i = 0; i < 4 * AuthzSharedCache::kNumEntries; ++i) {
+    AuthzSharedCache::Key k(i, i, 1000, 1000, "cms");
+    if (cache->Lookup(k, &status, &ttl))
+      num_found++;
+  }
+  EXPECT_LE(num_found, AuthzSharedCache::kNumEntries);
+  EXPECT_GT(num_found, AuthzSharedCache::kNumEntries / 2);
+  EXPECT_TRUE(cache->Lookup(key, &status, &ttl));
+
+  // A file of the wrong size is reset
+  cache.Destroy();
+  EXPECT_EQ(0, truncate(path_.c_str(), 100));
+  cache = AuthzSharedCache::Open(path_);
+  ASSERT_TRUE(cache.IsValid());
+  EXPECT_FALSE(cache->Lookup(key, &status, &ttl));
+  EXPECT_EQ(AuthzSharedCache::kMagic, cache->header_->magic);
+}
@@ -5,6 +5,8 @@
 #include <gtest/gtest.h>
 
 #include "backoff.h"
+#include "platform.h"
+#include "util/posix.h"
 
 using namespace std;  // NOLINT
 
@@ -22,3 +24,72 @@ class T_Backoff : public ::testing::Test {
 
 TEST_F(T_Backoff, Create) {
 }
+
+
+TEST(T_BandwidthThrottle, GetDelayMs) {
+  const uint64_t mb = 1024 * 1024;
+  EXPECT_EQ(0U, BandwidthThrottle::GetDelayMs(0, 0, mb));
+  EXPECT_EQ(1000U, BandwidthThrottle::GetDelayMs(mb, 0, mb));
+  EXPECT_EQ(500U, BandwidthThrottle::GetDelayMs(mb, 500, mb));
+  EXPECT_EQ(0U, BandwidthThrottle::GetDelayMs(mb, 1000, mb));
+  EXPECT_EQ(0U, BandwidthThrottle::GetDelayMs(mb, 2000, mb));
+  EXPECT_EQ(2000U, BandwidthThrottle::GetDelayMs(4 * mb, 0, 2 * mb));
+}
+
+
+TEST(T_BandwidthThrottle, Consume) {
+  BandwidthThrottle throttle(1000);
+  const uint64_t start_ms = platform_monotonic_time_ns() / (1000 * 1000);
+  throttle.Consume(100);
+  uint64_t elapsed_ms = platform_monotonic_time_ns() / (1000 * 1000) - start_ms;
+  EXPECT_GE(elapsed_ms, 99U);
+  throttle.Consume(100);
+  elapsed_ms = platform_monotonic_time_ns() / (1000 * 1000) - start_ms;
+  EXPECT_GE(elapsed_ms, 199U);
+}
+
+
+TEST(T_CircuitBreakers, States) {
+  CircuitBreakers breakers(2, 50, 100);
+  EXPECT_TRUE(breakers.Allow("a"));
+  breakers.ReportFailure("a");
+  EXPECT_EQ(CircuitBreakers::kStateClosed, breakers.GetState("a"));
+  EXPECT_TRUE(breakers.Allow("a"));
+  breakers.ReportFailure("a");
+  EXPECT_EQ(CircuitBreakers::kStateOpen, breakers.GetState("a"));
+  EXPECT_FALSE(breakers.Allow("a"));
+  EXPECT_TRUE(breakers.IsOpen("a"));
+  EXPECT_GT(breakers.GetWaitMs("a"), 0U);
+  EXPECT_TRUE(breakers.Allow("b"));
+
+  // A single probe after the wait time
+  SafeSleepMs(60);
+  EXPECT_FALSE(breakers.IsOpen("a"));
+  EXPECT_TRUE(breakers.Allow("a"));
+  EXPECT_EQ(CircuitBreakers::kStateHalfOpen, breakers.GetState("a"));
+  EXPECT_FALSE(breakers.Allow("a"));
+
+  // Failed probe, wait time doubles
+  breakers.ReportFailure("a");
+  EXPECT_EQ(CircuitBreakers::kStateOpen, breakers.GetState("a"));
+  EXPECT_GT(breakers.GetWaitMs("a"), 50U);
+  SafeSleepMs(110);
+  EXPECT_TRUE(breakers.Allow("a"));
+  breakers.ReportSuccess("a");
+  EXPECT_EQ(CircuitBreakers::kStateClosed, breakers.GetState("a"));
+  EXPECT_TRUE(breakers.Allow("a"));
+  EXPECT_EQ(0U, breakers.GetWaitMs("a"));
+}
+
+
+TEST(T_CircuitBreakers, SuccessResetsFailures) {
+  CircuitBreakers breakers(2, 1000, 1000);
+  breakers.ReportFailure("a");
+  breakers.ReportSuccess("a");
+  breakers.ReportFailure("a");
+  EXPECT_EQ(CircuitBreakers::kStateClosed, breakers.GetState("a"));
+  breakers.ReportFailure("a");
+  EXPECT_TRUE(breakers.IsOpen("a"));
+  breakers.Reset();
+  EXPECT_TRUE(breakers.Allow("a"));
+}
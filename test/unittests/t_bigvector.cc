@@ -97,3 +97,23 @@ TEST_F(T_Bigvector, Copy) {
     EXPECT_EQ(value, i);
   }
 }
+
+TEST_F(T_Bigvector, PushBackDefault) {
+  unsigned N = kNumSmall;
+  vec_->Reserve(N);
+  size_t capacity = vec_->capacity();
+  EXPECT_GE(capacity, N);
+  for (unsigned i = 0; i < N; ++i) {
+    unsigned *item = vec_->PushBackDefault();
+    EXPECT_EQ(0U, *item);
+    *item = i;
+  }
+  EXPECT_EQ(capacity, vec_->capacity());
+  EXPECT_EQ(N, vec_->size());
+
+  unsigned M = kNumBig;
+  vec_->Reserve(M);
+  EXPECT_GE(vec_->capacity(), M);
+  for (unsigned i = 0; i < N; ++i)
+    EXPECT_EQ(i, vec_->At(i));
+}
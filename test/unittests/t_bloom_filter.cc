@@ -0,0 +1,47 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include "bloom_filter.h"
+#include "hash.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+static shash::Md5 MkPath(const unsigned i) {
+  const string path = "/software/x86_64/" + StringifyInt(i);
+  return shash::Md5(path.data(), path.length());
+}
+
+
+TEST(T_BloomFilter, Basic) {
+  BloomFilter filter(0);
+  EXPECT_EQ(64U, filter.num_bits());
+  EXPECT_FALSE(filter.MayContain(MkPath(0)));
+  filter.Add(MkPath(0));
+  EXPECT_TRUE(filter.MayContain(MkPath(0)));
+  EXPECT_EQ(1U, filter.num_keys());
+}
+
+
+TEST(T_BloomFilter, FalsePositives) {
+  const unsigned kNumKeys = 10000;
+  BloomFilter filter(kNumKeys);
+  EXPECT_GE(filter.num_bits(), kNumKeys * BloomFilter::kBitsPerKey);
+  for (unsigned i = 0; i < kNumKeys; ++i)
+    filter.Add(MkPath(i));
+
+  // No false negatives
+  for (unsigned i = 0; i < kNumKeys; ++i)
+    EXPECT_TRUE(filter.MayContain(MkPath(i)));
+
+  // About 1% false positives
+  unsigned num_false_positives = 0;
+  for (unsigned i = kNumKeys; i < 2 * kNumKeys; ++i) {
+    if (filter.MayContain(MkPath(i)))
+      num_false_positives++;
+  }
+  EXPECT_LT(num_false_positives, kNumKeys / 50);
+}
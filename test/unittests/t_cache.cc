@@ -9,10 +9,14 @@
 #include <pthread.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <utime.h>
 
 #include <cassert>
+#include <cstdio>
 #include <cstring>
+#include <ctime>
 #include <string>
+#include <vector>
 
 #include "cache_posix.h"
 #include "compression.h"
@@ -21,6 +25,9 @@
 #include "quota.h"
 #include "smalloc.h"
 #include "testutil.h"
+#include "util/pointer.h"
+#include "util/posix.h"
+#include "util/string.h"
 
 using namespace std;  // NOLINT
 
@@ -374,6 +381,8 @@ TEST_F(T_CacheManager, OpenPinned) {
 
 
 TEST_F(T_CacheManager, AbortTxn) {
+  // Unnamed files cannot be removed from under the transaction
+  cache_mgr_->DisableTmpfile();
   void *txn = alloca(cache_mgr_->SizeOfTxn());
   ASSERT_TRUE(txn != NULL);
 
@@ -435,6 +444,132 @@ TEST_F(T_CacheManager, CommitTxn) {
 }
 
 
+TEST_F(T_CacheManager, CommitTxnCompressed) {
+  EXPECT_FALSE(alien_cache_mgr_->EnableCompression());
+  EXPECT_FALSE(cache_mgr_->compressed());
+  EXPECT_TRUE(cache_mgr_->EnableCompression());
+  EXPECT_TRUE(cache_mgr_->compressed());
+
+  const unsigned size = 3 * zlib::kFramedBlockSize + 100;
+  string content;
+  for (unsigned i = 0; content.length() < size; ++i)
+    content += "line " + StringifyInt(i % 1000) + "\n";
+  content.resize(size);
+
+  shash::Any rnd_hash;
+  rnd_hash.Randomize();
+  void *txn = alloca(cache_mgr_->SizeOfTxn());
+  EXPECT_GE(cache_mgr_->StartTxn(rnd_hash, size, txn), 0);
+  EXPECT_EQ(static_cast<int64_t>(size),
+            cache_mgr_->Write(content.data(), size, txn));
+  EXPECT_EQ(0, cache_mgr_->CommitTxn(txn));
+
+  platform_stat64 info;
+  EXPECT_EQ(0, platform_stat((tmp_path_ + "/" + rnd_hash.MakePath()).c_str(),
+                             &info));
+  EXPECT_LT(info.st_size, static_cast<int64_t>(size) / 2);
+
+  int fd = cache_mgr_->Open(CacheManager::Bless(rnd_hash));
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(static_cast<int64_t>(size), cache_mgr_->GetSize(fd));
+  EXPECT_EQ(-1, cache_mgr_->GetNativeFd(fd));
+  string buf(size, '\0');
+  EXPECT_EQ(static_cast<int64_t>(size),
+            cache_mgr_->Pread(fd, &buf[0], size + 10, 0));
+  EXPECT_EQ(content, buf);
+  const uint64_t offset = zlib::kFramedBlockSize - 5;
+  EXPECT_EQ(10, cache_mgr_->Pread(fd, &buf[0], 10, offset));
+  EXPECT_EQ(content.substr(offset, 10), buf.substr(0, 10));
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+
+  // Incompressible objects are kept as they are
+  fd = cache_mgr_->Open(CacheManager::Bless(hash_one_));
+  EXPECT_EQ(fd, cache_mgr_->GetNativeFd(fd));
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+  EXPECT_GE(cache_mgr_->StartTxn(rnd_hash, 1, txn), 0);
+  EXPECT_EQ(1, cache_mgr_->Write("A", 1, txn));
+  EXPECT_EQ(0, cache_mgr_->CommitTxn(txn));
+  EXPECT_EQ(0, platform_stat((tmp_path_ + "/" + rnd_hash.MakePath()).c_str(),
+                             &info));
+  EXPECT_EQ(1, info.st_size);
+
+  UniquePtr<PosixCacheManager> cache_mgr(
+    PosixCacheManager::Create(tmp_path_, false));
+  ASSERT_TRUE(cache_mgr.IsValid());
+  EXPECT_TRUE(cache_mgr->compressed());
+}
+
+
+TEST_F(T_CacheManager, CommitTxnFetchLocking) {
+  alien_cache_mgr_->EnableFetchLocking();
+  ASSERT_TRUE(alien_cache_mgr_->fetch_locking());
+
+  shash::Any rnd_hash;
+  rnd_hash.Randomize();
+  const string lock_path = tmp_path_ + "/txn/fetch." + rnd_hash.ToString();
+  void *txn = alloca(alien_cache_mgr_->SizeOfTxn());
+  EXPECT_GE(alien_cache_mgr_->StartTxn(rnd_hash, 1, txn), 0);
+  EXPECT_TRUE(FileExists(lock_path));
+  EXPECT_EQ(1, alien_cache_mgr_->Write("A", 1, txn));
+  EXPECT_EQ(0, alien_cache_mgr_->AbortTxn(txn));
+  EXPECT_FALSE(FileExists(lock_path));
+
+  // Another node holds the marker and has stored the object
+  EXPECT_GE(alien_cache_mgr_->StartTxn(rnd_hash, 1, txn), 0);
+  EXPECT_EQ(1, alien_cache_mgr_->Write("A", 1, txn));
+  EXPECT_EQ(0, alien_cache_mgr_->CommitTxn(txn));
+  EXPECT_FALSE(FileExists(lock_path));
+  int fd = open(lock_path.c_str(), O_CREAT | O_WRONLY, 0600);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  EXPECT_EQ(-EEXIST, alien_cache_mgr_->StartTxn(rnd_hash, 1, txn));
+
+  // Stale markers of crashed nodes are taken over
+  rnd_hash.Randomize();
+  const string stale_path = tmp_path_ + "/txn/fetch." + rnd_hash.ToString();
+  fd = open(stale_path.c_str(), O_CREAT | O_WRONLY, 0600);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  struct utimbuf times;
+  times.actime = times.modtime =
+    time(NULL) - PosixCacheManager::kFetchLockTimeout - 10;
+  ASSERT_EQ(0, utime(stale_path.c_str(), &times));
+  EXPECT_GE(alien_cache_mgr_->StartTxn(rnd_hash, 1, txn), 0);
+  EXPECT_EQ(1, alien_cache_mgr_->Write("B", 1, txn));
+  EXPECT_EQ(0, alien_cache_mgr_->CommitTxn(txn));
+  EXPECT_FALSE(FileExists(stale_path));
+  EXPECT_TRUE(FileExists(tmp_path_ + "/" + rnd_hash.MakePath()));
+  unlink(lock_path.c_str());
+}
+
+
+TEST_F(T_CacheManager, CommitTxnFetchLockingShared) {
+  EXPECT_FALSE(cache_mgr_->fetch_locking());
+  cache_mgr_->EnableFetchLocking();
+  ASSERT_TRUE(cache_mgr_->fetch_locking());
+
+  shash::Any rnd_hash;
+  rnd_hash.Randomize();
+  const string lock_path = tmp_path_ + "/txn/fetch." + rnd_hash.ToString();
+  void *txn = alloca(cache_mgr_->SizeOfTxn());
+  EXPECT_GE(cache_mgr_->StartTxn(rnd_hash, 1, txn), 0);
+  EXPECT_TRUE(FileExists(lock_path));
+  EXPECT_EQ(1, cache_mgr_->Write("A", 1, txn));
+  EXPECT_EQ(0, cache_mgr_->CommitTxn(txn));
+  EXPECT_FALSE(FileExists(lock_path));
+
+  // Another mount holds the marker and has stored the object
+  int fd = open(lock_path.c_str(), O_CREAT | O_WRONLY, 0600);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  EXPECT_EQ(-EEXIST, cache_mgr_->StartTxn(rnd_hash, 1, txn));
+  fd = cache_mgr_->Open(CacheManager::Bless(rnd_hash));
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+  unlink(lock_path.c_str());
+}
+
+
 TEST_F(T_CacheManager, CommitTxnSizeMismatch) {
   shash::Any rnd_hash;
   rnd_hash.Randomize();
@@ -602,6 +737,109 @@ TEST_F(T_CacheManager, Dup) {
 }
 
 
+TEST_F(T_CacheManager, FdCache) {
+  cache_mgr_->SetFdCacheSize(2);
+  TestQuotaManager *quota_mgr = new TestQuotaManager();
+  EXPECT_TRUE(cache_mgr_->AcquireQuotaManager(quota_mgr));
+
+  int fd = cache_mgr_->Open(CacheManager::Bless(hash_one_));
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(TestQuotaManager::kCmdTouch, quota_mgr->last_cmd.cmd);
+  quota_mgr->last_cmd = TestQuotaManager::LastCommand();
+  // Shared descriptor, not touched again
+  EXPECT_EQ(fd, cache_mgr_->Open(CacheManager::Bless(hash_one_)));
+  EXPECT_EQ(TestQuotaManager::kCmdUnknown, quota_mgr->last_cmd.cmd);
+  EXPECT_EQ(fd, cache_mgr_->Dup(fd));
+  EXPECT_EQ(1U, cache_mgr_->fd_cache_.size());
+  EXPECT_EQ(3U, cache_mgr_->fd_cache_[fd].refcnt);
+  for (unsigned i = 0; i < 3; ++i)
+    EXPECT_EQ(0, cache_mgr_->Close(fd));
+  EXPECT_EQ(-EBADF, cache_mgr_->Close(fd));
+  // Idle descriptor stays open and is reused
+  EXPECT_EQ(1U, cache_mgr_->fd_cache_idle_.size());
+  EXPECT_EQ(fd, cache_mgr_->Open(CacheManager::Bless(hash_one_)));
+  EXPECT_EQ(0U, cache_mgr_->fd_cache_idle_.size());
+  unsigned char buf;
+  EXPECT_EQ(1, cache_mgr_->Pread(fd, &buf, 1, 0));
+  EXPECT_EQ('A', buf);
+
+  // Full cache with referenced descriptors: plain descriptors
+  int fd_null = cache_mgr_->Open(CacheManager::Bless(hash_null_));
+  EXPECT_GE(fd_null, 0);
+  int fd_page = cache_mgr_->Open(CacheManager::Bless(hash_page_));
+  EXPECT_GE(fd_page, 0);
+  int fd_page2 = cache_mgr_->Open(CacheManager::Bless(hash_page_));
+  EXPECT_NE(fd_page, fd_page2);
+  EXPECT_EQ(2U, cache_mgr_->fd_cache_.size());
+  EXPECT_EQ(0, cache_mgr_->Close(fd_page));
+  EXPECT_EQ(0, cache_mgr_->Close(fd_page2));
+  // The least recently used idle descriptor is evicted
+  EXPECT_EQ(0, cache_mgr_->Close(fd_null));
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+  fd_page = cache_mgr_->Open(CacheManager::Bless(hash_page_));
+  EXPECT_EQ(0U, cache_mgr_->fd_cache_ids_.count(hash_null_));
+  EXPECT_EQ(1U, cache_mgr_->fd_cache_ids_.count(hash_one_));
+  EXPECT_EQ(1U, cache_mgr_->fd_cache_ids_.count(hash_page_));
+  EXPECT_EQ(0, cache_mgr_->Close(fd_page));
+
+  // Replacing the object detaches the descriptor
+  fd = cache_mgr_->Open(CacheManager::Bless(hash_one_));
+  buf = 'B';
+  EXPECT_TRUE(cache_mgr_->CommitFromMem(hash_one_, &buf, 1, "one"));
+  int fd_new = cache_mgr_->Open(CacheManager::Bless(hash_one_));
+  EXPECT_NE(fd, fd_new);
+  EXPECT_EQ(1, cache_mgr_->Pread(fd, &buf, 1, 0));
+  EXPECT_EQ('A', buf);
+  EXPECT_EQ(1, cache_mgr_->Pread(fd_new, &buf, 1, 0));
+  EXPECT_EQ('B', buf);
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+  EXPECT_EQ(-EBADF, cache_mgr_->Close(fd));
+  EXPECT_EQ(0, cache_mgr_->Close(fd_new));
+}
+
+
+TEST_F(T_CacheManager, FdCacheSaveState) {
+  cache_mgr_->SetFdCacheSize(16);
+  int fd_idle = cache_mgr_->Open(CacheManager::Bless(hash_null_));
+  EXPECT_EQ(0, cache_mgr_->Close(fd_idle));
+  int fd = cache_mgr_->Open(CacheManager::Bless(hash_one_));
+  EXPECT_EQ(fd, cache_mgr_->Dup(fd));
+
+  void *data = cache_mgr_->DoSaveState();
+  EXPECT_NE('\0', *reinterpret_cast<char *>(data));
+  EXPECT_EQ(-1, close(fd_idle));
+  EXPECT_EQ(EBADF, errno);
+  UniquePtr<PosixCacheManager> new_cache_mgr(
+    PosixCacheManager::Create(tmp_path_, false));
+  EXPECT_TRUE(new_cache_mgr->DoRestoreState(data));
+  EXPECT_TRUE(new_cache_mgr->DoFreeState(data));
+  // The inherited descriptor is not shared with new readers
+  int fd_new = new_cache_mgr->Open(CacheManager::Bless(hash_one_));
+  EXPECT_NE(fd, fd_new);
+  EXPECT_EQ(0, new_cache_mgr->Close(fd_new));
+  EXPECT_EQ(0, new_cache_mgr->Close(fd));
+  EXPECT_EQ(0, new_cache_mgr->Close(fd));
+  EXPECT_EQ(-EBADF, new_cache_mgr->Close(fd));
+
+  // Old format if no descriptor is in use
+  data = new_cache_mgr->DoSaveState();
+  EXPECT_EQ('\0', *reinterpret_cast<char *>(data));
+  EXPECT_TRUE(cache_mgr_->DoFreeState(data));
+}
+
+
+TEST_F(T_CacheManager, GetNativeFd) {
+  int fd = cache_mgr_->Open(CacheManager::Bless(hash_one_));
+  EXPECT_GE(fd, 0);
+  int native_fd = cache_mgr_->GetNativeFd(fd);
+  EXPECT_EQ(fd, native_fd);
+  char buf;
+  EXPECT_EQ(1, pread(native_fd, &buf, 1, 0));
+  EXPECT_EQ('A', buf);
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+}
+
+
 TEST_F(T_CacheManager, GetSize) {
   int fd = cache_mgr_->Open(CacheManager::Bless(hash_null_));
   EXPECT_GE(fd, 0);
@@ -637,6 +875,7 @@ TEST_F(T_CacheManager, Open) {
 
 
 TEST_F(T_CacheManager, OpenFromTxn) {
+  cache_mgr_->DisableTmpfile();
   shash::Any rnd_hash;
   rnd_hash.Randomize();
   void *txn = alloca(cache_mgr_->SizeOfTxn());
@@ -775,6 +1014,46 @@ TEST_F(T_CacheManager, StartTxn) {
 }
 
 
+TEST_F(T_CacheManager, Tmpfile) {
+  EXPECT_FALSE(alien_cache_mgr_->use_tmpfile());
+  if (!cache_mgr_->use_tmpfile()) {
+    printf("Skipping, O_TMPFILE not supported\n");
+    return;
+  }
+
+  shash::Any rnd_hash;
+  rnd_hash.Randomize();
+  void *txn = alloca(cache_mgr_->SizeOfTxn());
+  ASSERT_TRUE(txn != NULL);
+  EXPECT_GE(cache_mgr_->StartTxn(rnd_hash, 1, txn), 0);
+  unsigned char buf = 'A';
+  EXPECT_EQ(1U, cache_mgr_->Write(&buf, 1, txn));
+  // Only . and ..
+  EXPECT_EQ(2U, FindFiles(tmp_path_ + "/txn", "").size());
+  int fd = cache_mgr_->OpenFromTxn(txn);
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(1U, cache_mgr_->GetSize(fd));
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+  EXPECT_EQ(0, cache_mgr_->CommitTxn(txn));
+
+  // Replaces the existing object
+  EXPECT_GE(cache_mgr_->StartTxn(rnd_hash, 1, txn), 0);
+  buf = 'B';
+  EXPECT_EQ(1U, cache_mgr_->Write(&buf, 1, txn));
+  EXPECT_EQ(0, cache_mgr_->CommitTxn(txn));
+  fd = cache_mgr_->Open(CacheManager::Bless(rnd_hash));
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(1, cache_mgr_->Pread(fd, &buf, 1, 0));
+  EXPECT_EQ('B', buf);
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+
+  EXPECT_GE(cache_mgr_->StartTxn(rnd_hash, 1, txn), 0);
+  EXPECT_EQ(0, cache_mgr_->AbortTxn(txn));
+  // Only . and ..
+  EXPECT_EQ(2U, FindFiles(tmp_path_ + "/txn", "").size());
+}
+
+
 TEST_F(T_CacheManager, TearDown2ReadOnly) {
   EXPECT_FALSE(TearDownTimedOut(cache_mgr_, 10000));
   void *txn = alloca(cache_mgr_->SizeOfTxn());
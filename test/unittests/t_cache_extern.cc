@@ -7,6 +7,7 @@
 #include <alloca.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <signal.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -23,6 +24,7 @@
 #include "cache_plugin/channel.h"
 #include "cache_transport.h"
 #include "hash.h"
+#include "platform.h"
 #include "smalloc.h"
 #include "util/posix.h"
 
@@ -141,6 +143,8 @@ class MockCachePlugin : public CachePlugin {
     unsigned char *buffer,
     uint32_t size)
   {
+    if (next_status >= 0)
+      return static_cast<cvmfs::EnumStatus>(next_status);
     string data(reinterpret_cast<char *>(buffer), size);
     new_object_content += data;
     return cvmfs::STATUS_OK;
@@ -599,6 +603,30 @@ TEST_F(T_ExternalCacheManager, MultiThreaded) {
 }
 
 
+TEST_F(T_ExternalCacheManager, NonFatalIoErrors) {
+  cache_mgr_->MakeIoErrorsNonFatal();
+  int fd = cache_mgr_->Open(CacheManager::Bless(mock_plugin_->known_object));
+  EXPECT_GE(fd, 0);
+
+  const shash::Any known_object = mock_plugin_->known_object;
+  delete mock_plugin_;
+  mock_plugin_ = NULL;
+  // After the plugin's I/O thread restored the signal handler
+  platform_sighandler_t save_sigpipe = signal(SIGPIPE, SIG_IGN);
+  char buf[16];
+  EXPECT_EQ(-EIO, cache_mgr_->Pread(fd, buf, sizeof(buf), 0));
+  EXPECT_EQ(-EIO,
+            cache_mgr_->Open(CacheManager::Bless(known_object)));
+  shash::Any id(shash::kSha1);
+  id.Randomize();
+  unsigned char data = 0;
+  EXPECT_FALSE(cache_mgr_->CommitFromMem(id, &data, 1, "test"));
+  delete cache_mgr_;
+  cache_mgr_ = NULL;
+  signal(SIGPIPE, save_sigpipe);
+}
+
+
 TEST_F(T_ExternalCacheManager, SaveState) {
   // Should not crash
   void *data = cache_mgr_->SaveState(-1);
@@ -625,3 +653,120 @@ TEST_F(T_ExternalCacheManager, SaveState) {
   EXPECT_EQ(mock_plugin_->known_object_content, string(buffer, len));
   EXPECT_EQ(0, cache_mgr_->Close(fd));
 }
+
+
+TEST_F(T_ExternalCacheManager, SharedMemory) {
+  EXPECT_FALSE(cache_mgr_->has_shm());
+  delete cache_mgr_;
+  fd_client = ConnectSocket(socket_path_);
+  ASSERT_GE(fd_client, 0);
+  cache_mgr_ = ExternalCacheManager::Create(fd_client, nfiles, "test", true);
+  ASSERT_TRUE(cache_mgr_ != NULL);
+  quota_mgr_ = ExternalQuotaManager::Create(cache_mgr_);
+  cache_mgr_->AcquireQuotaManager(quota_mgr_);
+  EXPECT_TRUE(cache_mgr_->has_shm());
+
+  int fd = cache_mgr_->Open(CacheManager::Bless(mock_plugin_->known_object));
+  EXPECT_GE(fd, 0);
+  char buffer[64];
+  int64_t len = cache_mgr_->Pread(fd, buffer, 64, 0);
+  EXPECT_EQ(static_cast<int>(mock_plugin_->known_object_content.length()), len);
+  EXPECT_EQ(mock_plugin_->known_object_content, string(buffer, len));
+  EXPECT_EQ(-EINVAL, cache_mgr_->Pread(fd, buffer, 1, 64));
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+
+  // Multi-part upload and read through the shared memory region
+  cache_mgr_->Spawn();
+  unsigned large_size = 10 * cache_mgr_->max_object_size() + 1;
+  unsigned char *large_buffer = reinterpret_cast<unsigned char *>(
+    smalloc(large_size));
+  for (unsigned i = 0; i < large_size; ++i)
+    large_buffer[i] = i % 251;
+  shash::Any id(shash::kSha1);
+  shash::HashMem(large_buffer, large_size, &id);
+  EXPECT_TRUE(
+    cache_mgr_->CommitFromMem(id, large_buffer, large_size, "test"));
+  unsigned char *large_buffer_verify;
+  uint64_t size;
+  EXPECT_TRUE(cache_mgr_->Open2Mem(id, "test", &large_buffer_verify, &size));
+  EXPECT_EQ(large_size, size);
+  EXPECT_EQ(0, memcmp(large_buffer, large_buffer_verify, large_size));
+  free(large_buffer_verify);
+  free(large_buffer);
+}
+
+
+TEST_F(T_ExternalCacheManager, PreadMany) {
+  EXPECT_TRUE(cache_mgr_->capabilities() & cvmfs::CAP_READV);
+  const string &content = mock_plugin_->known_object_content;
+  int fd = cache_mgr_->Open(CacheManager::Bless(mock_plugin_->known_object));
+  EXPECT_GE(fd, 0);
+
+  for (unsigned round = 0; round < 2; ++round) {
+    if (round == 1)
+      cache_mgr_->Spawn();
+    char buffers[4][64];
+    vector<ExternalCacheManager::ReadRange> ranges;
+    ranges.push_back(ExternalCacheManager::ReadRange(fd, buffers[0], 5, 0));
+    ranges.push_back(ExternalCacheManager::ReadRange(fd, buffers[1], 64, 7));
+    ranges.push_back(ExternalCacheManager::ReadRange(fd + 1, buffers[2], 1, 0));
+    ranges.push_back(ExternalCacheManager::ReadRange(fd, buffers[3], 1, 64));
+    cache_mgr_->PreadMany(&ranges);
+    EXPECT_EQ(5, ranges[0].result);
+    EXPECT_EQ(content.substr(0, 5), string(buffers[0], 5));
+    EXPECT_EQ(static_cast<int>(content.length() - 7), ranges[1].result);
+    EXPECT_EQ(content.substr(7), string(buffers[1], content.length() - 7));
+    EXPECT_EQ(-EBADF, ranges[2].result);
+    EXPECT_EQ(-EINVAL, ranges[3].result);
+  }
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+
+  // Pipelined pieces of a range larger than the maximum object size
+  unsigned large_size = 20 * cache_mgr_->max_object_size() + 5;
+  unsigned char *large_buffer = reinterpret_cast<unsigned char *>(
+    smalloc(large_size));
+  for (unsigned i = 0; i < large_size; ++i)
+    large_buffer[i] = i % 253;
+  shash::Any id(shash::kSha1);
+  shash::HashMem(large_buffer, large_size, &id);
+  EXPECT_TRUE(
+    cache_mgr_->CommitFromMem(id, large_buffer, large_size, "test"));
+  fd = cache_mgr_->Open(CacheManager::Bless(id));
+  EXPECT_GE(fd, 0);
+  unsigned char *verify = reinterpret_cast<unsigned char *>(
+    smalloc(large_size + 100));
+  EXPECT_EQ(static_cast<int64_t>(large_size),
+            cache_mgr_->Pread(fd, verify, large_size + 100, 0));
+  EXPECT_EQ(0, memcmp(large_buffer, verify, large_size));
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+  free(verify);
+  free(large_buffer);
+}
+
+
+TEST_F(T_ExternalCacheManager, TransactionPipelined) {
+  cache_mgr_->Spawn();
+  shash::Any id(shash::kSha1);
+  id.Randomize();
+  const unsigned write_size = 4 * cache_mgr_->max_object_size();
+  unsigned char *buffer = reinterpret_cast<unsigned char *>(
+    scalloc(write_size, 1));
+  void *txn = alloca(cache_mgr_->SizeOfTxn());
+
+  EXPECT_EQ(0, cache_mgr_->StartTxn(id, CacheManager::kSizeUnknown, txn));
+  mock_plugin_->next_status = cvmfs::STATUS_NOSPACE;
+  // Parts are sent without waiting for the acknowledgement
+  EXPECT_EQ(static_cast<int64_t>(write_size),
+            cache_mgr_->Write(buffer, write_size, txn));
+  EXPECT_EQ(-ENOSPC, cache_mgr_->CommitTxn(txn));
+  mock_plugin_->next_status = -1;
+  EXPECT_EQ(0, cache_mgr_->AbortTxn(txn));
+
+  EXPECT_EQ(0, cache_mgr_->StartTxn(id, CacheManager::kSizeUnknown, txn));
+  EXPECT_EQ(static_cast<int64_t>(write_size),
+            cache_mgr_->Write(buffer, write_size, txn));
+  EXPECT_EQ(0, cache_mgr_->CommitTxn(txn));
+  EXPECT_EQ(mock_plugin_->new_object, id);
+  EXPECT_EQ(write_size, mock_plugin_->new_object_content.length());
+  free(buffer);
+}
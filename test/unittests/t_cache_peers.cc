@@ -0,0 +1,100 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "cache_plugin/cache_peers.h"
+#include "prng.h"
+#include "util/pointer.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+
+class T_CachePeers : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    for (unsigned i = 0; i < 8; ++i)
+      peers_.push_back("tcp=node" + StringifyInt(i) + ":4224");
+    Prng prng;
+    prng.InitSeed(42);
+    for (unsigned i = 0; i < kNumObjects; ++i) {
+      struct cvmcache_hash id;
+      for (unsigned j = 0; j < sizeof(id.digest); ++j)
+        id.digest[j] = prng.Next(256);
+      id.algorithm = 0;
+      ids_.push_back(id);
+    }
+  }
+
+  static const unsigned kNumObjects = 10000;
+  vector<string> peers_;
+  vector<struct cvmcache_hash> ids_;
+};
+
+
+TEST_F(T_CachePeers, RingBalance) {
+  PeerRing ring(peers_);
+  vector<unsigned> num_owned(peers_.size(), 0);
+  for (unsigned i = 0; i < ids_.size(); ++i) {
+    unsigned owner = ring.GetOwner(ids_[i]);
+    ASSERT_LT(owner, peers_.size());
+    EXPECT_EQ(owner, ring.GetOwner(ids_[i]));
+    num_owned[owner]++;
+  }
+  const unsigned fair_share = kNumObjects / peers_.size();
+  for (unsigned i = 0; i < num_owned.size(); ++i) {
+    EXPECT_GT(num_owned[i], fair_share / 2) << peers_[i];
+    EXPECT_LT(num_owned[i], fair_share * 2) << peers_[i];
+  }
+
+  vector<string> single_peer;
+  single_peer.push_back(peers_[0]);
+  PeerRing single_ring(single_peer);
+  for (unsigned i = 0; i < ids_.size(); ++i)
+    EXPECT_EQ(0U, single_ring.GetOwner(ids_[i]));
+}
+
+
+TEST_F(T_CachePeers, RingRemovePeer) {
+  PeerRing ring(peers_);
+  vector<string> fewer_peers(peers_);
+  fewer_peers.erase(fewer_peers.begin() + 3);
+  PeerRing smaller_ring(fewer_peers);
+
+  for (unsigned i = 0; i < ids_.size(); ++i) {
+    const string owner = peers_[ring.GetOwner(ids_[i])];
+    const string new_owner = fewer_peers[smaller_ring.GetOwner(ids_[i])];
+    // Only the objects of the removed peer move
+    if (owner != peers_[3])
+      EXPECT_EQ(owner, new_owner);
+  }
+}
+
+
+TEST_F(T_CachePeers, Create) {
+  const string peer_list = JoinStrings(peers_, ", ");
+  EXPECT_EQ(NULL, PeerCache::Create("tcp=elsewhere:4224", peer_list));
+
+  UniquePtr<PeerCache> peer_cache(PeerCache::Create(peers_[2], peer_list));
+  ASSERT_TRUE(peer_cache.IsValid());
+  PeerRing ring(peers_);
+  for (unsigned i = 0; i < 100; ++i) {
+    EXPECT_EQ(ring.GetOwner(ids_[i]) == 2, peer_cache->IsOwner(ids_[i]));
+    if (peer_cache->IsOwner(ids_[i])) {
+      unsigned char *buffer;
+      uint64_t size;
+      EXPECT_FALSE(peer_cache->Fetch(ids_[i], &buffer, &size));
+    }
+  }
+
+  // Only this node in the list
+  peer_cache = PeerCache::Create(peers_[2], peers_[2]);
+  ASSERT_TRUE(peer_cache.IsValid());
+  EXPECT_TRUE(peer_cache->IsOwner(ids_[0]));
+}
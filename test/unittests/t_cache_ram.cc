@@ -124,6 +124,19 @@ TEST_F(T_RamCacheManager, Dup) {
   EXPECT_EQ(0, ramcache_.Close(dupfd));
 }
 
+TEST_F(T_RamCacheManager, GetNativeFd) {
+  int fd;
+  char buf[alloc_size];
+  memset(buf, 42, alloc_size);
+  void *txn = alloca(ramcache_.SizeOfTxn());
+  EXPECT_EQ(0, ramcache_.StartTxn(a_, alloc_size, txn));
+  EXPECT_EQ(alloc_size, ramcache_.Write(buf, alloc_size, txn));
+  EXPECT_GE((fd = ramcache_.OpenFromTxn(txn)), 0);
+  // Virtual file descriptors cannot be used for splicing
+  EXPECT_EQ(-1, ramcache_.GetNativeFd(fd));
+  EXPECT_EQ(0, ramcache_.Close(fd));
+}
+
 TEST_F(T_RamCacheManager, Eviction) {
   char buf[alloc_size];
   memset(buf, 42, alloc_size);
@@ -342,3 +355,54 @@ TEST_F(T_RamCacheManager, OpenClose) {
     EXPECT_EQ(0, ramcache_.Close(fds[i]));
   }
 }
+
+
+TEST_F(T_RamCacheManager, SizeLimit) {
+  char buf[alloc_size];
+  memset(buf, 42, alloc_size);
+  shash::Any ids[4];
+  for (unsigned i = 0; i < 4; ++i) {
+    ids[i].digest[2] = i + 1;
+    void *txn = alloca(ramcache_.SizeOfTxn());
+    EXPECT_EQ(0, ramcache_.StartTxn(ids[i], alloc_size, txn));
+    EXPECT_EQ(alloc_size, ramcache_.Write(buf, alloc_size, txn));
+    EXPECT_EQ(0, ramcache_.CommitTxn(txn));
+  }
+
+  // The oldest entries are evicted
+  ramcache_.SetSizeLimit(2 * alloc_size);
+  EXPECT_EQ(2 * alloc_size, ramcache_.size_limit());
+  EXPECT_EQ(-ENOENT, ramcache_.Open(CacheManager::Bless(ids[0])));
+  EXPECT_EQ(-ENOENT, ramcache_.Open(CacheManager::Bless(ids[1])));
+  int fd = ramcache_.Open(CacheManager::Bless(ids[3]));
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(0, ramcache_.Close(fd));
+
+  void *txn = alloca(ramcache_.SizeOfTxn());
+  EXPECT_EQ(0, ramcache_.StartTxn(ids[0], alloc_size, txn));
+  EXPECT_EQ(alloc_size, ramcache_.Write(buf, alloc_size, txn));
+  EXPECT_EQ(0, ramcache_.CommitTxn(txn));
+  EXPECT_EQ(-ENOENT, ramcache_.Open(CacheManager::Bless(ids[2])));
+
+  // Capped by the initial size
+  ramcache_.SetSizeLimit(100 * alloc_size);
+  EXPECT_EQ(4 * alloc_size, ramcache_.size_limit());
+}
+
+
+TEST_F(T_RamCacheManager, PressureAdaptation) {
+  double avg10;
+  EXPECT_TRUE(RamCacheManager::ParsePsi(
+    "some avg10=12.50 avg60=1.00 avg300=0.00 total=100\n"
+    "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n", &avg10));
+  EXPECT_DOUBLE_EQ(12.5, avg10);
+  EXPECT_FALSE(RamCacheManager::ParsePsi("", &avg10));
+  EXPECT_FALSE(RamCacheManager::ParsePsi("full avg10=1.00", &avg10));
+  EXPECT_FALSE(RamCacheManager::ParsePsi("some avg10=x", &avg10));
+
+  EXPECT_EQ(750U, RamCacheManager::NextSizeLimit(1000, 200, 1000, 20.0));
+  EXPECT_EQ(200U, RamCacheManager::NextSizeLimit(250, 200, 1000, 20.0));
+  EXPECT_EQ(500U, RamCacheManager::NextSizeLimit(500, 200, 1000, 5.0));
+  EXPECT_EQ(600U, RamCacheManager::NextSizeLimit(500, 200, 1000, 0.0));
+  EXPECT_EQ(1000U, RamCacheManager::NextSizeLimit(950, 200, 1000, 0.0));
+}
@@ -4,11 +4,15 @@
 
 #include <gtest/gtest.h>
 
+#include <string>
+
 #include "cache.h"
 #include "cache_ram.h"
 #include "cache_tiered.h"
 #include "hash.h"
 #include "statistics.h"
+#include "util/posix.h"
+#include "util/string.h"
 
 using namespace std;  // NOLINT
 
@@ -21,7 +25,8 @@ class T_TieredCacheManager : public ::testing::Test {
     lower_cache_ =
       new RamCacheManager(1024, 128, MemoryKvStore::kMallocLibc,
                           perf::StatisticsTemplate("test", &stats_lower_));
-    tiered_cache_ = TieredCacheManager::Create(upper_cache_, lower_cache_);
+    tiered_cache_ = TieredCacheManager::Create(upper_cache_, lower_cache_,
+      perf::StatisticsTemplate("tiered", &stats_tiered_));
     buf_ = 'x';
     hash_one_.digest[1] = 1;
   }
@@ -30,8 +35,46 @@ class T_TieredCacheManager : public ::testing::Test {
     delete tiered_cache_;
   }
 
+  TieredCacheManager *tiered() {
+    return reinterpret_cast<TieredCacheManager *>(tiered_cache_);
+  }
+
+  int64_t GetCounter(const string &name) {
+    return stats_tiered_.Lookup("tiered." + name)->Get();
+  }
+
+  /**
+   * Waits for the background copy thread to reach the given counter value
+   */
+  bool WaitForCounter(const string &name, int64_t value) {
+    for (unsigned i = 0; i < 10000; ++i) {
+      if (GetCounter(name) >= value)
+        return true;
+      SafeSleepMs(1);
+    }
+    return false;
+  }
+
+  bool IsInUpper(const shash::Any &id) {
+    int fd = upper_cache_->Open(CacheManager::Bless(id));
+    if (fd < 0)
+      return false;
+    EXPECT_EQ(0, upper_cache_->Close(fd));
+    return true;
+  }
+
+  bool IsInLower(const shash::Any &id) {
+    int fd = lower_cache_->Open(CacheManager::Bless(id));
+    if (fd < 0)
+      return false;
+    EXPECT_EQ(0, lower_cache_->Close(fd));
+    return true;
+  }
+
   perf::Statistics stats_upper_;
   perf::Statistics stats_lower_;
+  perf::Statistics stats_tiered_;
+  perf::Statistics stats_nested_;
   CacheManager *tiered_cache_;
   RamCacheManager *upper_cache_;
   RamCacheManager *lower_cache_;
@@ -106,3 +149,154 @@ TEST_F(T_TieredCacheManager, ReadOnly) {
   EXPECT_EQ(0, tiered_cache_->Reset(txn));
   EXPECT_EQ(0, tiered_cache_->AbortTxn(txn));
 }
+
+
+TEST_F(T_TieredCacheManager, PromoteOnAccess) {
+  tiered()->SetPromotionPolicy(TieredCacheManager::kPromoteOnAccess, 3);
+  EXPECT_TRUE(lower_cache_->CommitFromMem(hash_one_, &buf_, 1, "one"));
+
+  for (unsigned i = 0; i < 2; ++i) {
+    int fd = tiered_cache_->Open(CacheManager::Bless(hash_one_));
+    EXPECT_GE(fd, 0);
+    EXPECT_EQ(1, tiered_cache_->GetSize(fd));
+    unsigned char buf;
+    EXPECT_EQ(1, tiered_cache_->Pread(fd, &buf, 1, 0));
+    EXPECT_EQ(buf_, buf);
+    int fd_dup = tiered_cache_->Dup(fd);
+    EXPECT_GE(fd_dup, 0);
+    EXPECT_EQ(0, tiered_cache_->Close(fd_dup));
+    EXPECT_EQ(0, tiered_cache_->Close(fd));
+    EXPECT_FALSE(IsInUpper(hash_one_));
+  }
+  EXPECT_EQ(2, GetCounter("n_lower_reads"));
+
+  int fd = tiered_cache_->Open(CacheManager::Bless(hash_one_));
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(0, tiered_cache_->Close(fd));
+  EXPECT_TRUE(IsInUpper(hash_one_));
+  EXPECT_EQ(1, GetCounter("n_promotions"));
+}
+
+
+TEST_F(T_TieredCacheManager, AsyncPromotion) {
+  tiered()->SetPromotionPolicy(TieredCacheManager::kPromoteAsync, 0);
+  EXPECT_TRUE(lower_cache_->CommitFromMem(hash_one_, &buf_, 1, "one"));
+
+  int fd = tiered_cache_->Open(CacheManager::Bless(hash_one_));
+  EXPECT_GE(fd, 0);
+  unsigned char buf;
+  EXPECT_EQ(1, tiered_cache_->Pread(fd, &buf, 1, 0));
+  EXPECT_EQ(buf_, buf);
+  EXPECT_EQ(0, tiered_cache_->Close(fd));
+  // Not yet spawned
+  EXPECT_FALSE(IsInUpper(hash_one_));
+  EXPECT_EQ(1, GetCounter("sz_copy_queue"));
+
+  tiered_cache_->Spawn();
+  EXPECT_TRUE(WaitForCounter("n_promotions", 1));
+  EXPECT_TRUE(IsInUpper(hash_one_));
+  EXPECT_EQ(0, GetCounter("sz_copy_queue"));
+
+  // Catalogs are promoted right away
+  shash::Any hash_two(shash::kSha1, shash::kSuffixCatalog);
+  hash_two.digest[1] = 2;
+  EXPECT_TRUE(lower_cache_->CommitFromMem(hash_two, &buf_, 1, "two"));
+  fd = tiered_cache_->Open(CacheManager::Bless(hash_two,
+                                               CacheManager::kTypeCatalog));
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(0, tiered_cache_->Close(fd));
+  EXPECT_TRUE(IsInUpper(hash_two));
+}
+
+
+TEST_F(T_TieredCacheManager, AsyncWriteBack) {
+  tiered()->SetAsyncWriteBack(1);
+  EXPECT_TRUE(tiered_cache_->CommitFromMem(hash_one_, &buf_, 1, "one"));
+  EXPECT_TRUE(IsInUpper(hash_one_));
+  EXPECT_FALSE(IsInLower(hash_one_));
+  EXPECT_EQ(1, GetCounter("sz_copy_queue"));
+
+  // Queue is full
+  shash::Any hash_two(shash::kSha1);
+  hash_two.digest[1] = 2;
+  EXPECT_TRUE(tiered_cache_->CommitFromMem(hash_two, &buf_, 1, "two"));
+  EXPECT_EQ(1, GetCounter("n_copies_dropped"));
+
+  tiered_cache_->Spawn();
+  EXPECT_TRUE(WaitForCounter("n_writebacks", 1));
+  EXPECT_TRUE(IsInLower(hash_one_));
+  EXPECT_FALSE(IsInLower(hash_two));
+
+  // Aborted transactions are not written back
+  void *txn = alloca(tiered_cache_->SizeOfTxn());
+  shash::Any hash_three(shash::kSha1);
+  hash_three.digest[1] = 3;
+  EXPECT_EQ(0, tiered_cache_->StartTxn(hash_three, 1, txn));
+  tiered_cache_->CtrlTxn(CacheManager::ObjectInfo(), 0, txn);
+  EXPECT_EQ(1, tiered_cache_->Write(&buf_, 1, txn));
+  EXPECT_EQ(0, tiered_cache_->AbortTxn(txn));
+  EXPECT_EQ(0, GetCounter("sz_copy_queue"));
+  EXPECT_EQ(1, GetCounter("n_writebacks"));
+}
+
+
+TEST_F(T_TieredCacheManager, Nested) {
+  // The inner instance keeps serving the object from its lower tier
+  tiered()->SetPromotionPolicy(TieredCacheManager::kPromoteOnAccess, 100);
+  EXPECT_TRUE(lower_cache_->CommitFromMem(hash_one_, &buf_, 1, "one"));
+  TieredCacheManager *inner = tiered();
+  RamCacheManager *outer_lower =
+    new RamCacheManager(1024, 128, MemoryKvStore::kMallocLibc,
+                        perf::StatisticsTemplate("ram", &stats_nested_));
+  tiered_cache_ = TieredCacheManager::Create(tiered_cache_, outer_lower,
+    perf::StatisticsTemplate("outer", &stats_nested_));
+  TieredCacheManager *outer = tiered();
+  outer->SetPromotionPolicy(TieredCacheManager::kPromoteOnAccess, 100);
+  EXPECT_EQ(2U, outer->GetNesting());
+  EXPECT_NE(outer->lower_fd_flag_, inner->lower_fd_flag_);
+
+  int fd = tiered_cache_->Open(CacheManager::Bless(hash_one_));
+  EXPECT_GE(fd, 0);
+  EXPECT_TRUE(inner->IsLowerFd(fd));
+  EXPECT_FALSE(outer->IsLowerFd(fd));
+  unsigned char buf;
+  EXPECT_EQ(1, tiered_cache_->Pread(fd, &buf, 1, 0));
+  EXPECT_EQ(buf_, buf);
+  int fd_dup = tiered_cache_->Dup(fd);
+  EXPECT_GE(fd_dup, 0);
+  EXPECT_EQ(0, tiered_cache_->Close(fd_dup));
+  EXPECT_EQ(0, tiered_cache_->Close(fd));
+  EXPECT_EQ(1, GetCounter("n_lower_reads"));
+
+  // Object in the lower tier of the outer instance
+  shash::Any hash_two(shash::kSha1);
+  hash_two.digest[1] = 2;
+  EXPECT_TRUE(outer_lower->CommitFromMem(hash_two, &buf_, 1, "two"));
+  fd = tiered_cache_->Open(CacheManager::Bless(hash_two));
+  EXPECT_GE(fd, 0);
+  EXPECT_TRUE(outer->IsLowerFd(fd));
+  EXPECT_EQ(1, tiered_cache_->GetSize(fd));
+  EXPECT_EQ(1, tiered_cache_->Pread(fd, &buf, 1, 0));
+  EXPECT_EQ(buf_, buf);
+  EXPECT_EQ(0, tiered_cache_->Close(fd));
+  EXPECT_EQ(1, stats_nested_.Lookup("outer.n_lower_reads")->Get());
+}
+
+
+TEST_F(T_TieredCacheManager, MaxNesting) {
+  for (unsigned i = 1; i < TieredCacheManager::kMaxNesting; ++i) {
+    RamCacheManager *lower =
+      new RamCacheManager(1024, 128, MemoryKvStore::kMallocLibc,
+        perf::StatisticsTemplate("ram" + StringifyInt(i), &stats_nested_));
+    tiered_cache_ = TieredCacheManager::Create(tiered_cache_, lower,
+      perf::StatisticsTemplate("tiered" + StringifyInt(i), &stats_nested_));
+    ASSERT_TRUE(tiered_cache_ != NULL);
+  }
+  RamCacheManager *lower =
+    new RamCacheManager(1024, 128, MemoryKvStore::kMallocLibc,
+                        perf::StatisticsTemplate("ram", &stats_nested_));
+  // Takes ownership of both tiers also on failure
+  tiered_cache_ = TieredCacheManager::Create(tiered_cache_, lower,
+    perf::StatisticsTemplate("too_deep", &stats_nested_));
+  EXPECT_EQ(NULL, tiered_cache_);
+}
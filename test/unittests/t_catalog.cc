@@ -7,10 +7,18 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <vector>
+
 #include "catalog.h"
+#include "catalog_index.h"
 #include "catalog_rw.h"
 #include "hash.h"
 #include "shortstring.h"
+#include "smalloc.h"
+#include "statistics.h"
 #include "testutil.h"
 
 using namespace std;  // NOLINT
@@ -102,7 +110,8 @@ class T_Catalog : public ::testing::Test {
                 string checksum,
                 string symlink = "",
                 bool   is_chunked_file = false,
-                bool   is_hidden       = false) {
+                bool   is_hidden       = false,
+                bool   is_inline_file  = false) {
     catalog::DirectoryEntryTestFactory::Metadata metadata;
     metadata.name       = name;
     metadata.mode       = mode | S_IRWXU;  // file permissions/mode
@@ -119,6 +128,7 @@ class T_Catalog : public ::testing::Test {
     DirectoryEntry de(DirectoryEntryTestFactory::Make(metadata));
     XattrList xattrlist;
     de.set_is_chunked_file(is_chunked_file);
+    de.set_is_inline_file(is_inline_file);
     writable_catalog->AddEntry(de, xattrlist, complete_name, parent_path);
     writable_catalog->UpdateLastModified();
   }
@@ -365,6 +375,221 @@ TEST_F(T_Catalog, Listing) {
     EXPECT_NE(NameString("hidden"), root_stat_entry_list.At(i).name);
 }
 
+TEST_F(T_Catalog, ListingPage) {
+  PathString path("/dir/dir");
+  PathString root_path("");
+  catalog = catalog::Catalog::AttachFreely("",
+                                           catalog_db_root,
+                                           shash::Any(),
+                                           NULL,
+                                           false);
+
+  DirectoryEntryList page;
+  vector<uint64_t> rowids;
+  uint64_t cursor = 0;
+  EXPECT_TRUE(catalog->ListingPathPage(path, 2, &cursor, &page, &rowids));
+  ASSERT_EQ(2u, page.size());
+  ASSERT_EQ(2u, rowids.size());
+  EXPECT_EQ(NameString("bar"), page.at(0).name());
+  EXPECT_EQ(NameString("bar2"), page.at(1).name());
+  EXPECT_LT(rowids[0], rowids[1]);
+  EXPECT_EQ(rowids[1], cursor);
+
+  EXPECT_TRUE(catalog->ListingPathPage(path, 2, &cursor, &page, &rowids));
+  ASSERT_EQ(3u, page.size());
+  EXPECT_EQ(NameString("link"), page.at(2).name());
+  EXPECT_EQ(rowids[2], cursor);
+
+  // End of the listing leaves the cursor untouched
+  EXPECT_TRUE(catalog->ListingPathPage(path, 2, &cursor, &page, &rowids));
+  EXPECT_EQ(3u, page.size());
+  EXPECT_EQ(rowids[2], cursor);
+
+  // Hidden entries advance the cursor but are not listed
+  DirectoryEntryList root_page;
+  rowids.clear();
+  cursor = 0;
+  uint64_t last_cursor;
+  do {
+    last_cursor = cursor;
+    EXPECT_TRUE(catalog->ListingPathPage(root_path, 1, &cursor,
+                                         &root_page, &rowids));
+  } while (cursor != last_cursor);
+  EXPECT_EQ(2u, root_page.size());
+  for (unsigned i = 0; i < root_page.size(); ++i)
+    EXPECT_NE(NameString("hidden"), root_page.at(i).name());
+}
+
+TEST_F(T_Catalog, ListingStream) {
+  catalog = catalog::Catalog::AttachFreely("",
+                                           catalog_db_root,
+                                           shash::Any(),
+                                           NULL,
+                                           false);
+
+  UniquePtr<ListingStream> stream(
+    catalog->OpenListingStream(PathString("/dir/dir")));
+  ASSERT_TRUE(stream.IsValid());
+  DirectoryEntry dirent;
+  shash::Md5 md5path;
+  vector<string> names;
+  vector<shash::Md5> md5paths;
+  while (stream->Next(&dirent, &md5path)) {
+    names.push_back(dirent.name().ToString());
+    EXPECT_EQ(shash::Md5(shash::AsciiPtr("/dir/dir/" + names.back())),
+              md5path);
+    if (!md5paths.empty())
+      EXPECT_LT(ListingStream::CompareMd5Paths(md5paths.back(), md5path), 0);
+    md5paths.push_back(md5path);
+  }
+  sort(names.begin(), names.end());
+  ASSERT_EQ(3u, names.size());
+  EXPECT_EQ("bar", names[0]);
+  EXPECT_EQ("bar2", names[1]);
+  EXPECT_EQ("link", names[2]);
+  EXPECT_FALSE(stream->Next(&dirent, &md5path));
+
+  stream = catalog->OpenListingStream(PathString("/no/such/dir"));
+  ASSERT_TRUE(stream.IsValid());
+  EXPECT_FALSE(stream->Next(&dirent, &md5path));
+}
+
+TEST_F(T_Catalog, ListingStreamLargeDirectory) {
+  const string db_path = CreateCatalogDB("");
+  catalog::WritableCatalog *writable_catalog =
+    catalog::WritableCatalog::AttachFreely("", db_path,
+                                           shash::Any(shash::kSha1), NULL,
+                                           false);
+  AddEntry(writable_catalog, "big", "", S_IFDIR, "");
+  AddEntry(writable_catalog, "small", "", S_IFDIR, "");
+  const unsigned num_entries = ListingStream::kMaxSortedRows + 1;
+  for (unsigned i = 0; i < num_entries; ++i) {
+    AddEntry(writable_catalog, "f" + StringifyInt(i), "/big", S_IFREG,
+             "448fa8e3d2b1a80d4f38727cd9a85eb2c0faf433");
+  }
+  writable_catalog->Commit();
+  delete writable_catalog;
+
+  catalog = catalog::Catalog::AttachFreely("", db_path, shash::Any(), NULL,
+                                           false);
+  UniquePtr<ListingStream> stream(
+    catalog->OpenListingStream(PathString("/big")));
+  DirectoryEntry dirent;
+  shash::Md5 md5path;
+  shash::Md5 last_md5path;
+  unsigned num_listed = 0;
+  while (stream->Next(&dirent, &md5path)) {
+    if (num_listed > 0)
+      EXPECT_LT(ListingStream::CompareMd5Paths(last_md5path, md5path), 0);
+    last_md5path = md5path;
+    num_listed++;
+  }
+  EXPECT_EQ(num_entries, num_listed);
+
+  // The entries of the other directories are skipped
+  stream = catalog->OpenListingStream(PathString("/small"));
+  EXPECT_FALSE(stream->Next(&dirent, &md5path));
+}
+
+TEST_F(T_Catalog, PathFilter) {
+  catalog = catalog::Catalog::AttachFreely("",
+                                           catalog_db_root,
+                                           shash::Any(),
+                                           NULL,
+                                           false);
+  EXPECT_FALSE(catalog->HasPathFilter());
+  EXPECT_TRUE(catalog->BuildPathFilter());
+  EXPECT_TRUE(catalog->HasPathFilter());
+
+  DirectoryEntry dirent;
+  EXPECT_TRUE(catalog->LookupPath(PathString("/foo"), &dirent));
+  EXPECT_TRUE(catalog->LookupPath(PathString("/dir/dir/bar2"), &dirent));
+  EXPECT_TRUE(catalog->LookupPath(PathString("/dir/folder"), &dirent));
+  EXPECT_FALSE(catalog->LookupPath(PathString("/dir/dir/bar3"), &dirent));
+  EXPECT_FALSE(catalog->LookupPath(PathString("/dir/folder/file1"), &dirent));
+}
+
+TEST_F(T_Catalog, Index) {
+  catalog = catalog::Catalog::AttachFreely("",
+                                           catalog_db_root,
+                                           shash::Any(),
+                                           NULL,
+                                           false);
+  const char *paths[] = {"", "/foo", "/hidden", "/dir", "/dir/dir",
+                         "/dir/folder", "/dir/dir/bar", "/dir/dir/link",
+                         "/dir/dir/bar3", "/dir/folder/file1", NULL};
+  vector<bool> found;
+  vector<DirectoryEntry> dirents;
+  vector<DirectoryEntryList> listings;
+  vector<StatEntryList *> stat_listings;
+  for (unsigned i = 0; paths[i] != NULL; ++i) {
+    DirectoryEntry dirent;
+    found.push_back(catalog->LookupPath(PathString(paths[i]), &dirent));
+    dirents.push_back(dirent);
+    DirectoryEntryList listing;
+    EXPECT_TRUE(catalog->ListingPath(PathString(paths[i]), &listing));
+    listings.push_back(listing);
+    stat_listings.push_back(new StatEntryList());
+    EXPECT_TRUE(catalog->ListingPathStat(PathString(paths[i]),
+                                         stat_listings.back()));
+  }
+
+  string data;
+  {
+    UniquePtr<CatalogDatabase> database(
+      CatalogDatabase::Open(catalog_db_root, CatalogDatabase::kOpenReadOnly));
+    ASSERT_TRUE(database.IsValid());
+    ASSERT_TRUE(CatalogIndex::Build(*database, &data));
+  }
+  unsigned char *buffer =
+    reinterpret_cast<unsigned char *>(smalloc(data.size()));
+  memcpy(buffer, data.data(), data.size());
+  CatalogIndex *index = CatalogIndex::Create(buffer, data.size());
+  ASSERT_TRUE(index != NULL);
+  EXPECT_EQ(catalog->max_row_id(), index->num_rows());
+  EXPECT_FALSE(catalog->HasIndex());
+  catalog->AttachIndex(index);
+  EXPECT_TRUE(catalog->HasIndex());
+
+  for (unsigned i = 0; paths[i] != NULL; ++i) {
+    DirectoryEntry dirent;
+    EXPECT_EQ(found[i], catalog->LookupPath(PathString(paths[i]), &dirent))
+      << paths[i];
+    EXPECT_EQ(dirents[i], dirent) << paths[i];
+    EXPECT_EQ(dirents[i].inode(), dirent.inode()) << paths[i];
+    EXPECT_EQ(dirents[i].checksum(), dirent.checksum()) << paths[i];
+    EXPECT_EQ(dirents[i].IsChunkedFile(), dirent.IsChunkedFile()) << paths[i];
+
+    DirectoryEntryList listing;
+    EXPECT_TRUE(catalog->ListingPath(PathString(paths[i]), &listing));
+    ASSERT_EQ(listings[i].size(), listing.size()) << paths[i];
+    StatEntryList stat_listing;
+    EXPECT_TRUE(catalog->ListingPathStat(PathString(paths[i]), &stat_listing));
+    ASSERT_EQ(stat_listings[i]->size(), stat_listing.size()) << paths[i];
+    for (unsigned j = 0; j < listing.size(); ++j) {
+      bool listed = false;
+      for (unsigned k = 0; k < listings[i].size(); ++k) {
+        if (listings[i][k] == listing[j]) {
+          EXPECT_EQ(listings[i][k].inode(), listing[j].inode());
+          listed = true;
+        }
+      }
+      EXPECT_TRUE(listed) << listing[j].name().ToString();
+    }
+    delete stat_listings[i];
+  }
+
+  // Corrupted indexes are rejected
+  buffer = reinterpret_cast<unsigned char *>(smalloc(data.size()));
+  memcpy(buffer, data.data(), data.size());
+  EXPECT_TRUE(CatalogIndex::Create(buffer, data.size() - 1) == NULL);
+  buffer = reinterpret_cast<unsigned char *>(smalloc(data.size()));
+  memcpy(buffer, data.data(), data.size());
+  buffer[0] = 'X';
+  EXPECT_TRUE(CatalogIndex::Create(buffer, data.size()) == NULL);
+  EXPECT_TRUE(CatalogIndex::Create(NULL, 0) == NULL);
+}
+
 TEST_F(T_Catalog, Chunks) {
   catalog = catalog::Catalog::AttachFreely("",
                                            catalog_db_root,
@@ -392,4 +617,269 @@ TEST_F(T_Catalog, Statistics) {
   EXPECT_NE("", catalog->PrintMemStatistics());
 }
 
+TEST_F(T_Catalog, StagedEntries) {
+  perf::Statistics statistics;
+  DirentStagingStatistics staging_statistics(&statistics);
+  string db_path = CreateCatalogDB("");
+  WritableCatalog *writable =
+    WritableCatalog::AttachFreely("", db_path, shash::Any(shash::kSha1));
+  ASSERT_TRUE(writable != NULL);
+  writable->SetStaging(4, &staging_statistics);
+
+  AddEntry(writable, "dir", "", S_IFDIR, "");
+  AddEntry(writable, "chunked", "/dir", S_IFREG,
+           "988881adc9fc3655077dc2d4d757d480b5ea0e11", "", true);
+  for (unsigned i = 0; i < 2; ++i) {
+    shash::Any chunk_hash(shash::kSha1, shash::kSuffixPartial);
+    chunk_hash.Randomize();
+    writable->AddFileChunk("/dir/chunked", FileChunk(chunk_hash, i * 10, 10));
+  }
+  AddEntry(writable, "file", "/dir", S_IFREG,
+           "448fa8e3d2b1a80d4f38727cd9a85eb2c0faf433");
+  EXPECT_EQ(0, staging_statistics.n_flushes->Get());
+
+  // Staged entries are visible to readers
+  DirectoryEntry dirent;
+  EXPECT_TRUE(writable->LookupPath(PathString("/dir/file"), &dirent));
+  EXPECT_EQ(1, staging_statistics.n_flushes->Get());
+  EXPECT_EQ(3, staging_statistics.n_staged->Get());
+  for (unsigned i = 0; i < 5; ++i)
+    AddEntry(writable, "f" + StringifyInt(i), "/dir", S_IFREG, "");
+  EXPECT_EQ(2, staging_statistics.n_flushes->Get());
+  DirectoryEntryList listing;
+  EXPECT_TRUE(writable->ListingPath(PathString("/dir"), &listing));
+  EXPECT_EQ(7U, listing.size());
+  EXPECT_EQ(0, staging_statistics.n_unstaged->Get());
+
+  writable->SetStaging(0, &staging_statistics);
+  AddEntry(writable, "unstaged", "/dir", S_IFREG, "");
+  EXPECT_EQ(1, staging_statistics.n_unstaged->Get());
+  writable->Commit();
+  delete writable;
+
+  catalog = Catalog::AttachFreely("", db_path, shash::Any(), NULL, false);
+  ASSERT_TRUE(catalog != NULL);
+  EXPECT_EQ(9U, catalog->GetNumEntries());
+  FileChunkList chunks;
+  EXPECT_TRUE(catalog->ListPathChunks(PathString("/dir/chunked"),
+                                      shash::kSha1, &chunks));
+  ASSERT_EQ(2U, chunks.size());
+  EXPECT_EQ(10, chunks.At(1).offset());
+}
+
+TEST_F(T_Catalog, InlineData) {
+  string db_path = CreateCatalogDB("");
+  WritableCatalog *writable =
+    WritableCatalog::AttachFreely("", db_path, shash::Any(shash::kSha1));
+  ASSERT_TRUE(writable != NULL);
+  writable->SetStaging(4, NULL);
+
+  const string data(100, 'x');
+  AddEntry(writable, "dir", "", S_IFDIR, "");
+  AddEntry(writable, "staged", "/dir", S_IFREG,
+           "988881adc9fc3655077dc2d4d757d480b5ea0e11", "", false, false, true);
+  writable->AddInlineData("/dir/staged", data);
+  AddEntry(writable, "empty", "/dir", S_IFREG,
+           "e69de29bb2d1d6434b8b29ae775ad8c2e48c5391", "", false, false, true);
+  writable->AddInlineData("/dir/empty", "");
+  AddEntry(writable, "regular", "/dir", S_IFREG,
+           "448fa8e3d2b1a80d4f38727cd9a85eb2c0faf433");
+
+  string result;
+  EXPECT_TRUE(writable->LookupInlineDataPath(PathString("/dir/staged"),
+                                             &result));
+  EXPECT_EQ(data, result);
+  EXPECT_FALSE(writable->LookupInlineDataPath(PathString("/dir/regular"),
+                                              &result));
+
+  writable->SetStaging(0, NULL);
+  AddEntry(writable, "unstaged", "/dir", S_IFREG,
+           "1e12aecf3c6b0e9208cf5a22e3d5dec7edbd577e", "", false, false, true);
+  writable->AddInlineData("/dir/unstaged", "abc");
+  AddEntry(writable, "removed", "/dir", S_IFREG,
+           "38be7d1b981f2fb6a4a0a052453f887373dc1fe8", "", false, false, true);
+  writable->AddInlineData("/dir/removed", "abc");
+  writable->RemoveEntry("/dir/removed");
+  writable->Commit();
+  delete writable;
+
+  catalog = Catalog::AttachFreely("", db_path, shash::Any(), NULL, false);
+  ASSERT_TRUE(catalog != NULL);
+  DirectoryEntry dirent;
+  EXPECT_TRUE(catalog->LookupPath(PathString("/dir/staged"), &dirent));
+  EXPECT_TRUE(dirent.IsInlineFile());
+  EXPECT_FALSE(dirent.IsChunkedFile());
+  EXPECT_TRUE(catalog->LookupPath(PathString("/dir/regular"), &dirent));
+  EXPECT_FALSE(dirent.IsInlineFile());
+
+  EXPECT_TRUE(catalog->LookupInlineDataPath(PathString("/dir/staged"),
+                                            &result));
+  EXPECT_EQ(data, result);
+  EXPECT_TRUE(catalog->LookupInlineDataPath(PathString("/dir/empty"),
+                                            &result));
+  EXPECT_EQ("", result);
+  EXPECT_TRUE(catalog->LookupInlineDataPath(PathString("/dir/unstaged"),
+                                            &result));
+  EXPECT_EQ("abc", result);
+  EXPECT_FALSE(catalog->LookupInlineDataPath(PathString("/dir/removed"),
+                                             &result));
+}
+
+TEST_F(T_Catalog, Bundles) {
+  string db_path = CreateCatalogDB("");
+  WritableCatalog *writable =
+    WritableCatalog::AttachFreely("", db_path, shash::Any(shash::kSha1));
+  ASSERT_TRUE(writable != NULL);
+  writable->SetStaging(4, NULL);
+
+  const shash::Any bundle_hash(shash::MkFromHexPtr(
+    shash::HexPtr("b3d8ee35e3a4ed3f0aa1fa0d3a7d1d5a2b1ff0a1")));
+  AddEntry(writable, "dir", "", S_IFDIR, "");
+  AddEntry(writable, "first", "/dir", S_IFREG,
+           "988881adc9fc3655077dc2d4d757d480b5ea0e11");
+  AddEntry(writable, "second", "/dir", S_IFREG,
+           "1e12aecf3c6b0e9208cf5a22e3d5dec7edbd577e");
+  AddEntry(writable, "removed", "/dir", S_IFREG,
+           "38be7d1b981f2fb6a4a0a052453f887373dc1fe8");
+  AddEntry(writable, "regular", "/dir", S_IFREG,
+           "448fa8e3d2b1a80d4f38727cd9a85eb2c0faf433");
+  writable->AddBundle("/dir/first", bundle_hash, 100);
+  writable->AddBundle("/dir/second", bundle_hash, 4196);
+  writable->AddBundle("/dir/removed", bundle_hash, 8292);
+  writable->RemoveEntry("/dir/removed");
+  writable->Commit();
+  delete writable;
+
+  catalog = Catalog::AttachFreely("", db_path, shash::Any(), NULL, false);
+  ASSERT_TRUE(catalog != NULL);
+  DirectoryEntry dirent;
+  EXPECT_TRUE(catalog->LookupPath(PathString("/dir/first"), &dirent));
+  EXPECT_TRUE(dirent.IsBundledFile());
+  EXPECT_TRUE(catalog->LookupPath(PathString("/dir/regular"), &dirent));
+  EXPECT_FALSE(dirent.IsBundledFile());
+
+  shash::Any hash;
+  uint64_t offset;
+  EXPECT_TRUE(catalog->LookupBundlePath(PathString("/dir/second"),
+                                        shash::kSha1, &hash, &offset));
+  EXPECT_EQ(bundle_hash, hash);
+  EXPECT_EQ(4196U, offset);
+  EXPECT_FALSE(catalog->LookupBundlePath(PathString("/dir/removed"),
+                                         shash::kSha1, &hash, &offset));
+  EXPECT_FALSE(catalog->LookupBundlePath(PathString("/dir/regular"),
+                                         shash::kSha1, &hash, &offset));
+
+  // Replication and garbage collection need to keep the bundle
+  unsigned num_bundle_hashes = 0;
+  zlib::Algorithms compression_alg;
+  EXPECT_TRUE(catalog->AllChunksBegin());
+  while (catalog->AllChunksNext(&hash, &compression_alg)) {
+    if (hash == bundle_hash)
+      num_bundle_hashes++;
+  }
+  EXPECT_TRUE(catalog->AllChunksEnd());
+  EXPECT_EQ(1U, num_bundle_hashes);
+  const Catalog::HashVector &referenced = catalog->GetReferencedObjects();
+  EXPECT_NE(referenced.end(),
+            std::find(referenced.begin(), referenced.end(), bundle_hash));
+}
+
+TEST_F(T_Catalog, PrefetchGroups) {
+  string db_path = CreateCatalogDB("");
+  WritableCatalog *writable =
+    WritableCatalog::AttachFreely("", db_path, shash::Any(shash::kSha1));
+  ASSERT_TRUE(writable != NULL);
+
+  AddEntry(writable, "dir", "", S_IFDIR, "");
+  AddEntry(writable, "first", "/dir", S_IFREG,
+           "988881adc9fc3655077dc2d4d757d480b5ea0e11");
+  AddEntry(writable, "second", "/dir", S_IFREG,
+           "1e12aecf3c6b0e9208cf5a22e3d5dec7edbd577e");
+  AddEntry(writable, "removed", "/dir", S_IFREG,
+           "38be7d1b981f2fb6a4a0a052453f887373dc1fe8");
+  AddEntry(writable, "other", "/dir", S_IFREG,
+           "448fa8e3d2b1a80d4f38727cd9a85eb2c0faf433");
+  writable->AddPrefetchGroup("/dir/first", 42);
+  writable->AddPrefetchGroup("/dir/second", 42);
+  writable->AddPrefetchGroup("/dir/removed", 42);
+  writable->AddPrefetchGroup("/dir/other", 7);
+  writable->RemoveEntry("/dir/removed");
+  writable->Commit();
+  delete writable;
+
+  // Unchanged groups do not modify the catalog
+  writable =
+    WritableCatalog::AttachFreely("", db_path, shash::Any(shash::kSha1));
+  ASSERT_TRUE(writable != NULL);
+  writable->AddPrefetchGroup("/dir/first", 42);
+  EXPECT_FALSE(writable->IsDirty());
+  writable->AddPrefetchGroup("/dir/other", 42);
+  EXPECT_TRUE(writable->IsDirty());
+  writable->AddPrefetchGroup("/dir/other", 7);
+  writable->Commit();
+  delete writable;
+
+  catalog = Catalog::AttachFreely("", db_path, shash::Any(), NULL, false);
+  ASSERT_TRUE(catalog != NULL);
+  uint64_t group_id;
+  EXPECT_TRUE(catalog->LookupPrefetchGroupPath(PathString("/dir/second"),
+                                               &group_id));
+  EXPECT_EQ(42U, group_id);
+  EXPECT_FALSE(catalog->LookupPrefetchGroupPath(PathString("/dir/removed"),
+                                                &group_id));
+  EXPECT_FALSE(catalog->LookupPrefetchGroupPath(PathString("/dir"),
+                                                &group_id));
+
+  PrefetchGroup group;
+  EXPECT_TRUE(catalog->ListPrefetchGroup(42, 32, &group));
+  ASSERT_EQ(2U, group.size());
+  std::set<string> paths;
+  for (unsigned i = 0; i < group.size(); ++i) {
+    paths.insert(group[i].path.ToString());
+    EXPECT_TRUE(group[i].dirent.IsRegular());
+  }
+  EXPECT_EQ(1U, paths.count("/dir/first"));
+  EXPECT_EQ(1U, paths.count("/dir/second"));
+  group.clear();
+  EXPECT_TRUE(catalog->ListPrefetchGroup(42, 1, &group));
+  EXPECT_EQ(1U, group.size());
+  group.clear();
+  EXPECT_TRUE(catalog->ListPrefetchGroup(7, 32, &group));
+  ASSERT_EQ(1U, group.size());
+  EXPECT_EQ("/dir/other", group[0].path.ToString());
+}
+
+TEST_F(T_Catalog, DigestTrees) {
+  string db_path = CreateCatalogDB("");
+  WritableCatalog *writable =
+    WritableCatalog::AttachFreely("", db_path, shash::Any(shash::kSha1));
+  ASSERT_TRUE(writable != NULL);
+
+  AddEntry(writable, "dir", "", S_IFDIR, "");
+  AddEntry(writable, "large", "/dir", S_IFREG,
+           "988881adc9fc3655077dc2d4d757d480b5ea0e11");
+  AddEntry(writable, "removed", "/dir", S_IFREG,
+           "38be7d1b981f2fb6a4a0a052453f887373dc1fe8");
+  AddEntry(writable, "small", "/dir", S_IFREG,
+           "448fa8e3d2b1a80d4f38727cd9a85eb2c0faf433");
+  // The serialized tree is binary
+  const string tree("digest\0tree", 11);
+  writable->AddDigestTree("/dir/large", tree);
+  writable->AddDigestTree("/dir/removed", tree);
+  writable->RemoveEntry("/dir/removed");
+  writable->Commit();
+  delete writable;
+
+  catalog = Catalog::AttachFreely("", db_path, shash::Any(), NULL, false);
+  ASSERT_TRUE(catalog != NULL);
+  string stored;
+  EXPECT_TRUE(catalog->LookupDigestTreePath(PathString("/dir/large"),
+                                            &stored));
+  EXPECT_EQ(tree, stored);
+  EXPECT_FALSE(catalog->LookupDigestTreePath(PathString("/dir/removed"),
+                                             &stored));
+  EXPECT_FALSE(catalog->LookupDigestTreePath(PathString("/dir/small"),
+                                             &stored));
+}
+
 }  // namespace catalog
@@ -0,0 +1,96 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "catalog_access_profile.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+class T_AccessProfile : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    tmp_path_ = CreateTempDir("./cvmfs_ut_access_profile");
+    ASSERT_FALSE(tmp_path_.empty());
+    log_path_ = tmp_path_ + "/trace.log";
+  }
+
+  virtual void TearDown() {
+    RemoveTree(tmp_path_);
+  }
+
+  void WriteLog(const string &content) {
+    FILE *f = fopen(log_path_.c_str(), "w");
+    ASSERT_TRUE(f != NULL);
+    fprintf(f, "%s", content.c_str());
+    fclose(f);
+  }
+
+  string tmp_path_;
+  string log_path_;
+};
+
+
+TEST_F(T_AccessProfile, ParseCsvLine) {
+  vector<string> fields;
+  EXPECT_TRUE(AccessProfile::ParseCsvLine(
+    "\"1.5\",\"1\",\"/a,b\",\"say \"\"hi\"\"\"\r", &fields));
+  ASSERT_EQ(4U, fields.size());
+  EXPECT_EQ("1.5", fields[0]);
+  EXPECT_EQ("1", fields[1]);
+  EXPECT_EQ("/a,b", fields[2]);
+  EXPECT_EQ("say \"hi\"", fields[3]);
+
+  EXPECT_TRUE(AccessProfile::ParseCsvLine("x,,y", &fields));
+  ASSERT_EQ(3U, fields.size());
+  EXPECT_EQ("", fields[1]);
+
+  EXPECT_FALSE(AccessProfile::ParseCsvLine("\"open", &fields));
+}
+
+
+TEST_F(T_AccessProfile, Runs) {
+  WriteLog(
+    "\"1.0\",\"-1\",\"Tracer\",\"Trace buffer created\"\r\n"
+    "\"1.1\",\"1\",\"/sw/app/bin\",\"open()\"\r\n"
+    "\"1.2\",\"6\",\"/sw/app/lib/\",\"lookup()\"\r\n"
+    "\"1.3\",\"-2\",\"Tracer\",\"Destroying trace buffer...\"\r\n"
+    "\"2.0\",\"-1\",\"Tracer\",\"Trace buffer created\"\r\n"
+    "\"2.1\",\"1\",\"/sw/app/bin\",\"open()\"\r\n"
+    "\"2.2\",\"2\",\"/data\",\"opendir()\"\r\n"
+    "\"3.0\",\"-1\",\"Tracer\",\"Trace buffer created\"\r\n");
+
+  AccessProfile profile;
+  EXPECT_TRUE(profile.LoadTracerLog(log_path_));
+  EXPECT_EQ(2U, profile.num_runs());
+  EXPECT_EQ(2U, profile.GetNumRuns(""));
+  EXPECT_EQ(2U, profile.GetNumRuns("/sw"));
+  EXPECT_EQ(2U, profile.GetNumRuns("/sw/app/bin"));
+  EXPECT_EQ(1U, profile.GetNumRuns("/sw/app/lib"));
+  EXPECT_EQ(1U, profile.GetNumRuns("/data"));
+  EXPECT_EQ(0U, profile.GetNumRuns("/other"));
+  EXPECT_EQ(0U, profile.GetNumRuns("Tracer"));
+
+  // A second log adds to the runs
+  EXPECT_TRUE(profile.LoadTracerLog(log_path_));
+  EXPECT_EQ(4U, profile.num_runs());
+  EXPECT_EQ(2U, profile.GetNumRuns("/data"));
+}
+
+
+TEST_F(T_AccessProfile, Invalid) {
+  AccessProfile profile;
+  EXPECT_FALSE(profile.LoadTracerLog(tmp_path_ + "/no_such_file"));
+  WriteLog("\"1.1\",\"1\",\"/unterminated\r\n");
+  EXPECT_FALSE(profile.LoadTracerLog(log_path_));
+}
+
+}  // namespace catalog
@@ -0,0 +1,124 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <string>
+
+#include "catalog_cache.h"
+#include "hash.h"
+#include "util/pointer.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+class T_CatalogCache : public ::testing::Test {
+ protected:
+  static const unsigned kCatalogSize = 4096;
+
+  virtual void SetUp() {
+    tmp_path_ = CreateTempDir("./cvmfs_ut_catalog_cache");
+    ASSERT_FALSE(tmp_path_.empty());
+    cache_dir_ = tmp_path_ + "/cache";
+  }
+
+  virtual void TearDown() {
+    RemoveTree(tmp_path_);
+  }
+
+  string WriteCatalog(const string &name, const char fill) {
+    const string path = tmp_path_ + "/" + name;
+    EXPECT_TRUE(SafeWriteToFile(string(kCatalogSize, fill), path, 0600));
+    return path;
+  }
+
+  shash::Any HashOf(const string &content) {
+    shash::Any hash(shash::kSha1);
+    shash::HashString(content, &hash);
+    return hash;
+  }
+
+  string ReadFile(const string &path) {
+    string content;
+    int fd = open(path.c_str(), O_RDONLY);
+    EXPECT_GE(fd, 0);
+    EXPECT_TRUE(SafeReadToString(fd, &content));
+    close(fd);
+    return content;
+  }
+
+  string tmp_path_;
+  string cache_dir_;
+};
+
+
+TEST_F(T_CatalogCache, InsertFetch) {
+  UniquePtr<CatalogCache> cache(CatalogCache::Create(cache_dir_, 0));
+  ASSERT_TRUE(cache.IsValid());
+  const shash::Any hash = HashOf("a");
+
+  string path;
+  EXPECT_FALSE(cache->Fetch(hash, tmp_path_ + "/fetched", &path));
+  EXPECT_EQ(1, cache->num_misses());
+
+  cache->Insert(hash, WriteCatalog("a.db", 'a'));
+  ASSERT_TRUE(cache->Fetch(hash, tmp_path_ + "/fetched", &path));
+  EXPECT_EQ(string(kCatalogSize, 'a'), ReadFile(path));
+  EXPECT_EQ(1, cache->num_hits());
+
+  // The copy is private, the cache entry remains untouched
+  EXPECT_TRUE(SafeWriteToFile("modified", path, 0600));
+  string path2;
+  ASSERT_TRUE(cache->Fetch(hash, tmp_path_ + "/fetched", &path2));
+  EXPECT_NE(path, path2);
+  EXPECT_EQ(string(kCatalogSize, 'a'), ReadFile(path2));
+}
+
+
+TEST_F(T_CatalogCache, Corruption) {
+  UniquePtr<CatalogCache> cache(CatalogCache::Create(cache_dir_, 0));
+  ASSERT_TRUE(cache.IsValid());
+  const shash::Any hash = HashOf("a");
+  cache->Insert(hash, WriteCatalog("a.db", 'a'));
+
+  const string entry = cache_dir_ + "/" + hash.ToString(true) + ".catalog";
+  ASSERT_TRUE(FileExists(entry));
+  EXPECT_TRUE(SafeWriteToFile(string(kCatalogSize, 'b'), entry, 0600));
+
+  string path;
+  EXPECT_FALSE(cache->Fetch(hash, tmp_path_ + "/fetched", &path));
+  EXPECT_FALSE(FileExists(entry));
+
+  cache->Insert(hash, WriteCatalog("a.db", 'a'));
+  EXPECT_TRUE(cache->Fetch(hash, tmp_path_ + "/fetched", &path));
+}
+
+
+TEST_F(T_CatalogCache, Trim) {
+  UniquePtr<CatalogCache> cache(
+    CatalogCache::Create(cache_dir_, kCatalogSize + kCatalogSize / 2));
+  ASSERT_TRUE(cache.IsValid());
+  const shash::Any hash_a = HashOf("a");
+  const shash::Any hash_b = HashOf("b");
+  cache->Insert(hash_a, WriteCatalog("a.db", 'a'));
+  cache->Insert(hash_b, WriteCatalog("b.db", 'b'));
+
+  // b is the least recently used catalog
+  struct utimbuf old_times;
+  old_times.actime = old_times.modtime = 1000;
+  const string entry_b = cache_dir_ + "/" + hash_b.ToString(true) + ".catalog";
+  ASSERT_EQ(0, utime(entry_b.c_str(), &old_times));
+
+  cache->Trim();
+  string path;
+  EXPECT_TRUE(cache->Fetch(hash_a, tmp_path_ + "/fetched", &path));
+  EXPECT_FALSE(cache->Fetch(hash_b, tmp_path_ + "/fetched", &path));
+}
+
+}  // namespace catalog
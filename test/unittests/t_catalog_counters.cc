@@ -440,4 +440,84 @@ TEST_F(T_CatalogCounters, FieldsMap) {
   EXPECT_EQ(DeltaCounters_t(1), *map["subtree_external"]);
 }
 
+
+
+TEST_F(T_CatalogCounters, SizeBins) {
+  EXPECT_EQ(0U, GetSizeBin(0));
+  EXPECT_EQ(0U, GetSizeBin(4 * 1024 - 1));
+  EXPECT_EQ(1U, GetSizeBin(4 * 1024));
+  EXPECT_EQ(1U, GetSizeBin(64 * 1024 - 1));
+  EXPECT_EQ(2U, GetSizeBin(64 * 1024));
+  EXPECT_EQ(3U, GetSizeBin(16 * 1024 * 1024 - 1));
+  EXPECT_EQ(5U, GetSizeBin(uint64_t(4) * 1024 * 1024 * 1024 - 1));
+  EXPECT_EQ(kNumSizeBins - 1, GetSizeBin(uint64_t(4) * 1024 * 1024 * 1024));
+  EXPECT_EQ(kNumSizeBins - 1, GetSizeBin(uint64_t(-1)));
+
+  EXPECT_EQ("size_4k", GetSizeBinName(0));
+  EXPECT_EQ("size_huge", GetSizeBinName(kNumSizeBins - 1));
+}
+
+
+TEST_F(T_CatalogCounters, SummaryCounters) {
+  DeltaCounters d_counters;
+  DeltaCounters d_parent;
+
+  DirectoryEntry small_file = DirectoryEntryTestFactory::RegularFile("s", 10);
+  DirectoryEntry large_file =
+    DirectoryEntryTestFactory::RegularFile("l", 2 * 1024 * 1024);
+  DirectoryEntry inline_file = DirectoryEntryTestFactory::RegularFile("i", 20);
+  inline_file.set_is_inline_file(true);
+  DirectoryEntry bundled_file =
+    DirectoryEntryTestFactory::RegularFile("b", 5000);
+  bundled_file.set_is_bundled_file(true);
+  DirectoryEntry directory = DirectoryEntryTestFactory::Directory();
+
+  d_counters.Increment(small_file);
+  d_counters.Increment(large_file);
+  d_counters.Increment(inline_file);
+  d_counters.Increment(bundled_file);
+  d_counters.Increment(directory);
+
+  DeltaCounters::FieldsMap map = d_counters.GetFieldsMap();
+  EXPECT_EQ(DeltaCounters_t(1), *map["self_inline"]);
+  EXPECT_EQ(DeltaCounters_t(1), *map["self_bundled"]);
+  EXPECT_EQ(DeltaCounters_t(2), *map["self_size_4k"]);
+  EXPECT_EQ(DeltaCounters_t(1), *map["self_size_64k"]);
+  EXPECT_EQ(DeltaCounters_t(0), *map["self_size_1m"]);
+  EXPECT_EQ(DeltaCounters_t(1), *map["self_size_16m"]);
+  EXPECT_EQ(DeltaCounters_t(0), *map["self_unsummarized"]);
+
+  d_counters.PopulateToParent(&d_parent);
+  map = d_parent.GetFieldsMap();
+  EXPECT_EQ(DeltaCounters_t(0), *map["self_inline"]);
+  EXPECT_EQ(DeltaCounters_t(1), *map["subtree_inline"]);
+  EXPECT_EQ(DeltaCounters_t(1), *map["subtree_bundled"]);
+  EXPECT_EQ(DeltaCounters_t(2), *map["subtree_size_4k"]);
+
+  d_counters.Decrement(inline_file);
+  d_counters.Decrement(small_file);
+  map = d_counters.GetFieldsMap();
+  EXPECT_EQ(DeltaCounters_t(0), *map["self_inline"]);
+  EXPECT_EQ(DeltaCounters_t(0), *map["self_size_4k"]);
+
+  EXPECT_TRUE(IsSummaryCounter("self_inline"));
+  EXPECT_TRUE(IsSummaryCounter("subtree_size_huge"));
+  EXPECT_TRUE(IsSummaryCounter("self_unsummarized"));
+  EXPECT_FALSE(IsSummaryCounter("self_regular"));
+  EXPECT_FALSE(IsSummaryCounter("subtree_file_size"));
+}
+
+
+TEST_F(T_CatalogCounters, CompleteSummary) {
+  Counters counters;
+  EXPECT_TRUE(counters.HasCompleteSummary());
+  counters.subtree.unsummarized = 2;
+  EXPECT_FALSE(counters.HasCompleteSummary());
+
+  DeltaCounters delta;
+  delta.subtree.unsummarized = -2;
+  counters.ApplyDelta(delta);
+  EXPECT_TRUE(counters.HasCompleteSummary());
+}
+
 }  // namespace catalog
@@ -0,0 +1,122 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "catalog_delta.h"
+#include "hash.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+class T_CatalogDelta : public ::testing::Test {
+ protected:
+  static const unsigned kPageSize = 1024;
+
+  /**
+   * A fake database of num_pages pages with an SQLite header
+   */
+  static string MakeDatabase(unsigned num_pages, char fill) {
+    string result(num_pages * kPageSize, fill);
+    result.replace(0, 16, "SQLite format 3\0", 16);
+    result[16] = static_cast<char>(kPageSize >> 8);
+    result[17] = static_cast<char>(kPageSize & 0xff);
+    return result;
+  }
+};
+
+const unsigned T_CatalogDelta::kPageSize;
+
+
+TEST_F(T_CatalogDelta, PageSize) {
+  EXPECT_EQ(kPageSize, CatalogDelta::GetPageSize(MakeDatabase(1, 'x')));
+  string database = MakeDatabase(1, 'x');
+  database[16] = 0;
+  database[17] = 1;
+  EXPECT_EQ(65536U, CatalogDelta::GetPageSize(database));
+  database[17] = 100;
+  EXPECT_EQ(0U, CatalogDelta::GetPageSize(database));
+  EXPECT_EQ(0U, CatalogDelta::GetPageSize(string(kPageSize, 'x')));
+  EXPECT_EQ(0U, CatalogDelta::GetPageSize(""));
+}
+
+
+TEST_F(T_CatalogDelta, RoundTrip) {
+  const string base = MakeDatabase(16, 'a');
+  string target = base;
+  target[2 * kPageSize + 10] = 'b';
+  target[7 * kPageSize] = 'c';
+  // Grows by one and a half pages
+  target.append(kPageSize + kPageSize / 2, 'd');
+
+  string delta;
+  ASSERT_TRUE(CatalogDelta::Create(base, target, &delta));
+  EXPECT_LT(delta.size(), 5 * kPageSize);
+  string result;
+  ASSERT_TRUE(CatalogDelta::Apply(base, delta, &result));
+  EXPECT_EQ(target, result);
+
+  // Shrinking
+  ASSERT_TRUE(CatalogDelta::Create(target, base, &delta));
+  ASSERT_TRUE(CatalogDelta::Apply(target, delta, &result));
+  EXPECT_EQ(base, result);
+
+  // No changes
+  ASSERT_TRUE(CatalogDelta::Create(base, base, &delta));
+  ASSERT_TRUE(CatalogDelta::Apply(base, delta, &result));
+  EXPECT_EQ(base, result);
+}
+
+
+TEST_F(T_CatalogDelta, TooManyChanges) {
+  const string base = MakeDatabase(8, 'a');
+  string target = base;
+  target[2 * kPageSize] = 'b';
+  target[3 * kPageSize] = 'b';
+  string delta;
+  EXPECT_TRUE(CatalogDelta::Create(base, target, &delta));
+  target[4 * kPageSize] = 'b';
+  EXPECT_FALSE(CatalogDelta::Create(base, target, &delta));
+}
+
+
+TEST_F(T_CatalogDelta, Mismatch) {
+  const string base = MakeDatabase(8, 'a');
+  string target = base;
+  target[5 * kPageSize] = 'b';
+  string delta;
+
+  string other_page_size = target;
+  other_page_size[16] = static_cast<char>((2 * kPageSize) >> 8);
+  EXPECT_FALSE(CatalogDelta::Create(base, other_page_size, &delta));
+  EXPECT_FALSE(CatalogDelta::Create(base, string(kPageSize, 'x'), &delta));
+
+  ASSERT_TRUE(CatalogDelta::Create(base, target, &delta));
+  string result;
+  EXPECT_FALSE(CatalogDelta::Apply(MakeDatabase(9, 'a'), delta, &result));
+  EXPECT_FALSE(CatalogDelta::Apply(base, delta.substr(0, delta.size() - 1),
+                                   &result));
+  EXPECT_FALSE(CatalogDelta::Apply(base, "CVMFSDL0" + delta.substr(8),
+                                   &result));
+  EXPECT_FALSE(CatalogDelta::Apply(base, "", &result));
+  EXPECT_TRUE(CatalogDelta::Apply(base, delta, &result));
+}
+
+
+TEST_F(T_CatalogDelta, Path) {
+  const shash::Any base(shash::MkFromHexPtr(
+    shash::HexPtr("0123456789abcdef0123456789abcdef01234567"),
+    shash::kSuffixCatalog));
+  const shash::Any target(shash::MkFromHexPtr(
+    shash::HexPtr("fedcba9876543210fedcba9876543210fedcba98"),
+    shash::kSuffixCatalog));
+  EXPECT_EQ("data/fe/dcba9876543210fedcba9876543210fedcba98C-"
+            "0123456789abcdef0123456789abcdef01234567",
+            CatalogDelta::MakeDeltaPath(base, target));
+}
+
+}  // namespace catalog
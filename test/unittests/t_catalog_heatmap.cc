@@ -0,0 +1,123 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "catalog_heatmap.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+class T_CatalogHeatmap : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    tmp_path_ = CreateTempDir("./cvmfs_ut_catalog_heatmap");
+    ASSERT_FALSE(tmp_path_.empty());
+  }
+
+  virtual void TearDown() {
+    RemoveTree(tmp_path_);
+  }
+
+  static void DeleteAll(vector<CatalogHeatmap *> *heatmaps) {
+    for (unsigned i = 0; i < heatmaps->size(); ++i)
+      delete (*heatmaps)[i];
+    heatmaps->clear();
+  }
+
+  string tmp_path_;
+};
+
+
+TEST_F(T_CatalogHeatmap, Record) {
+  CatalogHeatmap heatmap("test.cern.ch");
+  heatmap.RecordAttach("/", 1000, 4096);
+  heatmap.RecordAttach("/sw", 5000, 0);
+  heatmap.RecordAttach("/sw", 3000, 8192);
+  heatmap.RecordLookups("/sw", 10);
+  heatmap.RecordLookups("/sw", 0);
+  EXPECT_EQ(2U, heatmap.size());
+
+  CatalogHeatmap::Entry entry;
+  EXPECT_FALSE(heatmap.Lookup("/none", &entry));
+  ASSERT_TRUE(heatmap.Lookup("/sw", &entry));
+  EXPECT_EQ(1U, entry.num_clients);
+  EXPECT_EQ(2U, entry.num_attaches);
+  EXPECT_EQ(8000U, entry.attach_us);
+  EXPECT_EQ(5000U, entry.max_attach_us);
+  EXPECT_EQ(10U, entry.num_lookups);
+  EXPECT_EQ(8192U, entry.num_bytes);
+}
+
+
+TEST_F(T_CatalogHeatmap, SaveLoadMerge) {
+  const string path = tmp_path_ + "/catalogheatmap";
+  CatalogHeatmap heatmap("test.cern.ch");
+  heatmap.RecordAttach("/", 1000, 4096);
+  heatmap.RecordAttach("/path with blanks", 2000, 100);
+  heatmap.RecordLookups("/", 7);
+  EXPECT_TRUE(heatmap.Save(path));
+
+  vector<CatalogHeatmap *> loaded;
+  ASSERT_TRUE(CatalogHeatmap::Load(path, &loaded));
+  ASSERT_EQ(1U, loaded.size());
+  EXPECT_EQ("test.cern.ch", loaded[0]->repo_name());
+  EXPECT_EQ(heatmap.Serialize(), loaded[0]->Serialize());
+  CatalogHeatmap::Entry entry;
+  ASSERT_TRUE(loaded[0]->Lookup("/path with blanks", &entry));
+  EXPECT_EQ(2000U, entry.attach_us);
+
+  // A second client
+  loaded[0]->Merge(heatmap);
+  ASSERT_TRUE(loaded[0]->Lookup("/", &entry));
+  EXPECT_EQ(2U, entry.num_clients);
+  EXPECT_EQ(2U, entry.num_attaches);
+  EXPECT_EQ(1000U, entry.max_attach_us);
+  EXPECT_EQ(14U, entry.num_lookups);
+  DeleteAll(&loaded);
+
+  // Concatenated dumps of two repositories
+  CatalogHeatmap other("other.cern.ch");
+  other.RecordAttach("/", 10, 10);
+  ASSERT_TRUE(SafeWriteToFile(heatmap.Serialize() + other.Serialize(), path,
+                              0644));
+  ASSERT_TRUE(CatalogHeatmap::Load(path, &loaded));
+  ASSERT_EQ(2U, loaded.size());
+  EXPECT_EQ("other.cern.ch", loaded[1]->repo_name());
+  EXPECT_EQ(1U, loaded[1]->size());
+  DeleteAll(&loaded);
+
+  ASSERT_TRUE(SafeWriteToFile("1 2 3 4 5 6 /no-header\n", path, 0644));
+  EXPECT_FALSE(CatalogHeatmap::Load(path, &loaded));
+  DeleteAll(&loaded);
+  EXPECT_FALSE(CatalogHeatmap::Load(tmp_path_ + "/none", &loaded));
+}
+
+
+TEST_F(T_CatalogHeatmap, Report) {
+  CatalogHeatmap heatmap("test.cern.ch");
+  heatmap.RecordAttach("/a", 1000, 1024);
+  heatmap.RecordAttach("/b", 9000, 0);
+  heatmap.RecordAttach("/c", 1000, 0);
+  heatmap.RecordLookups("/a", 1);
+  heatmap.RecordLookups("/c", 100);
+
+  string report = heatmap.PrintReport(CatalogHeatmap::kRankLookups, 10);
+  EXPECT_LT(report.find("/c\n"), report.find("/a\n"));
+  EXPECT_LT(report.find("/a\n"), report.find("/b\n"));
+
+  report = heatmap.PrintReport(CatalogHeatmap::kRankAttachTime, 10);
+  EXPECT_LT(report.find("/b\n"), report.find("/a\n"));
+
+  report = heatmap.PrintReport(CatalogHeatmap::kRankLookups, 1);
+  EXPECT_NE(string::npos, report.find("/c\n"));
+  EXPECT_EQ(string::npos, report.find("/a\n"));
+}
+
+}  // namespace catalog
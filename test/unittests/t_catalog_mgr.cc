@@ -193,6 +193,30 @@ TEST_F(T_CatalogManager, Lookup) {
   EXPECT_EQ(3, catalog_mgr_.GetNumCatalogs());
 }
 
+TEST_F(T_CatalogManager, DetachIdle) {
+  catalog::DirectoryEntry dirent;
+  ASSERT_TRUE(catalog_mgr_.Init());
+  AddTree();
+  EXPECT_TRUE(catalog_mgr_.LookupPath("/dir/dir/dir/dir/dir/file5",
+                                      kLookupSole, &dirent));
+  EXPECT_EQ(3, catalog_mgr_.GetNumCatalogs());
+
+  // Within the memory budget
+  EXPECT_EQ(0U, catalog_mgr_.DetachIdle(0, 3 * 4096));
+  // Recently used
+  EXPECT_EQ(0U, catalog_mgr_.DetachIdle(3600, 0));
+  EXPECT_EQ(3, catalog_mgr_.GetNumCatalogs());
+
+  // Only leaf catalogs are detached, the root catalog stays
+  EXPECT_EQ(1U, catalog_mgr_.DetachIdle(0, 2 * 4096));
+  EXPECT_EQ(2, catalog_mgr_.GetNumCatalogs());
+  EXPECT_EQ(1U, catalog_mgr_.DetachIdle(0, 0));
+  EXPECT_EQ(1, catalog_mgr_.GetNumCatalogs());
+  EXPECT_EQ(0U, catalog_mgr_.DetachIdle(0, 0));
+  EXPECT_EQ(1, catalog_mgr_.GetNumCatalogs());
+  EXPECT_EQ(2, catalog_mgr_.statistics().n_detach_idle->Get());
+}
+
 TEST_F(T_CatalogManager, LongLookup) {
   catalog::DirectoryEntry dirent;
   ASSERT_TRUE(catalog_mgr_.Init());
@@ -0,0 +1,159 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "catalog_nested_index.h"
+#include "hash.h"
+#include "smalloc.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+class T_NestedCatalogIndex : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    // Deliberately unsorted
+    Add("/software/v2");
+    Add("/software");
+    Add("/software/v1/lib");
+    Add("/software/v1");
+    Add("/data");
+    Add("/software-old");
+    NestedCatalogIndex::Build(catalogs_, &encoded_);
+  }
+
+  void Add(const string &mountpoint) {
+    Catalog::NestedCatalog nested;
+    nested.mountpoint.Assign(mountpoint.data(), mountpoint.length());
+    nested.hash = shash::Any(shash::kSha1, shash::kSuffixCatalog);
+    shash::HashString(mountpoint, &nested.hash);
+    nested.size = mountpoint.length();
+    catalogs_.push_back(nested);
+  }
+
+  NestedCatalogIndex *Open(const string &encoded) {
+    unsigned char *buffer =
+      reinterpret_cast<unsigned char *>(smalloc(encoded.size()));
+    memcpy(buffer, encoded.data(), encoded.size());
+    return NestedCatalogIndex::Create(buffer, encoded.size());
+  }
+
+  static string MountpointOf(const Catalog::NestedCatalog &nested) {
+    return nested.mountpoint.ToString();
+  }
+
+  Catalog::NestedCatalogList catalogs_;
+  string encoded_;
+};
+
+
+TEST_F(T_NestedCatalogIndex, Find) {
+  NestedCatalogIndex *index = Open(encoded_);
+  ASSERT_TRUE(index != NULL);
+  EXPECT_EQ(catalogs_.size(), index->num_catalogs());
+
+  for (unsigned i = 0; i < catalogs_.size(); ++i) {
+    Catalog::NestedCatalog nested;
+    ASSERT_TRUE(index->Find(catalogs_[i].mountpoint, &nested));
+    EXPECT_EQ(catalogs_[i].mountpoint, nested.mountpoint);
+    EXPECT_EQ(catalogs_[i].hash, nested.hash);
+    EXPECT_EQ(shash::kSuffixCatalog, nested.hash.suffix);
+    EXPECT_EQ(catalogs_[i].size, nested.size);
+  }
+  Catalog::NestedCatalog nested;
+  EXPECT_FALSE(index->Find(PathString("/soft"), &nested));
+  EXPECT_FALSE(index->Find(PathString("/software/v3"), &nested));
+  EXPECT_FALSE(index->Find(PathString(""), &nested));
+  delete index;
+}
+
+
+TEST_F(T_NestedCatalogIndex, FindChain) {
+  NestedCatalogIndex *index = Open(encoded_);
+  ASSERT_TRUE(index != NULL);
+
+  Catalog::NestedCatalogList chain;
+  index->FindChain(PathString(""), PathString("/software/v1/lib/libz.so"),
+                   &chain);
+  ASSERT_EQ(3U, chain.size());
+  EXPECT_EQ("/software", MountpointOf(chain[0]));
+  EXPECT_EQ("/software/v1", MountpointOf(chain[1]));
+  EXPECT_EQ("/software/v1/lib", MountpointOf(chain[2]));
+
+  chain.clear();
+  index->FindChain(PathString("/software"), PathString("/software/v1/lib"),
+                   &chain);
+  ASSERT_EQ(2U, chain.size());
+  EXPECT_EQ("/software/v1", MountpointOf(chain[0]));
+  EXPECT_EQ("/software/v1/lib", MountpointOf(chain[1]));
+
+  chain.clear();
+  index->FindChain(PathString(""), PathString("/software-old/bin"), &chain);
+  ASSERT_EQ(1U, chain.size());
+  EXPECT_EQ("/software-old", MountpointOf(chain[0]));
+
+  chain.clear();
+  index->FindChain(PathString(""), PathString("/etc/passwd"), &chain);
+  EXPECT_TRUE(chain.empty());
+  delete index;
+}
+
+
+TEST_F(T_NestedCatalogIndex, ListSubtree) {
+  NestedCatalogIndex *index = Open(encoded_);
+  ASSERT_TRUE(index != NULL);
+
+  Catalog::NestedCatalogList subtree;
+  index->ListSubtree(PathString("/software"), &subtree);
+  ASSERT_EQ(3U, subtree.size());
+  EXPECT_EQ("/software/v1", MountpointOf(subtree[0]));
+  EXPECT_EQ("/software/v1/lib", MountpointOf(subtree[1]));
+  EXPECT_EQ("/software/v2", MountpointOf(subtree[2]));
+
+  subtree.clear();
+  index->ListSubtree(PathString("/data"), &subtree);
+  EXPECT_TRUE(subtree.empty());
+
+  subtree.clear();
+  index->ListSubtree(PathString(""), &subtree);
+  EXPECT_EQ(catalogs_.size(), subtree.size());
+  delete index;
+}
+
+
+TEST_F(T_NestedCatalogIndex, Empty) {
+  string encoded;
+  NestedCatalogIndex::Build(Catalog::NestedCatalogList(), &encoded);
+  NestedCatalogIndex *index = Open(encoded);
+  ASSERT_TRUE(index != NULL);
+  EXPECT_EQ(0U, index->num_catalogs());
+  Catalog::NestedCatalogList chain;
+  index->FindChain(PathString(""), PathString("/software"), &chain);
+  EXPECT_TRUE(chain.empty());
+  delete index;
+}
+
+
+TEST_F(T_NestedCatalogIndex, Corrupted) {
+  EXPECT_TRUE(Open(encoded_.substr(0, encoded_.size() - 1)) == NULL);
+  string bad_magic = encoded_;
+  bad_magic[0] = 'X';
+  EXPECT_TRUE(Open(bad_magic) == NULL);
+  // Swapped order of the first two records breaks the binary search
+  string unsorted = encoded_;
+  const unsigned record_size = 20 + shash::kMaxDigestSize;
+  const string first = unsorted.substr(16, record_size);
+  unsorted.replace(16, record_size, unsorted.substr(16 + record_size,
+                                                    record_size));
+  unsorted.replace(16 + record_size, record_size, first);
+  EXPECT_TRUE(Open(unsorted) == NULL);
+}
+
+}  // namespace catalog
@@ -0,0 +1,99 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include "catalog_prefetch_groups.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+class T_PrefetchGroups : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    tmp_path_ = CreateTempDir("./cvmfs_ut_prefetch_groups");
+    ASSERT_FALSE(tmp_path_.empty());
+    log_path_ = tmp_path_ + "/trace.log";
+  }
+
+  virtual void TearDown() {
+    RemoveTree(tmp_path_);
+  }
+
+  void WriteLog(const string &content) {
+    FILE *f = fopen(log_path_.c_str(), "w");
+    ASSERT_TRUE(f != NULL);
+    fprintf(f, "%s", content.c_str());
+    fclose(f);
+  }
+
+  string tmp_path_;
+  string log_path_;
+};
+
+
+TEST_F(T_PrefetchGroups, Patterns) {
+  PrefetchGroups groups;
+  EXPECT_TRUE(groups.LoadPatternsFromString(
+    "# Libraries are loaded together\n"
+    "*.so*\n"
+    "\n"
+    "  /sw/python/*.py  # modules\n"));
+  EXPECT_EQ(2U, groups.GetNumberOfPatterns());
+
+  const uint64_t lib_a = groups.GetGroupId("/sw/lib/liba.so");
+  EXPECT_NE(0U, lib_a);
+  EXPECT_EQ(lib_a, groups.GetGroupId("/sw/lib/libb.so.1"));
+  // Same pattern in another directory
+  EXPECT_NE(0U, groups.GetGroupId("/sw/lib64/liba.so"));
+  EXPECT_NE(lib_a, groups.GetGroupId("/sw/lib64/liba.so"));
+
+  const uint64_t python = groups.GetGroupId("/sw/python/a.py");
+  EXPECT_NE(0U, python);
+  EXPECT_EQ(python, groups.GetGroupId("/sw/python/b.py"));
+  EXPECT_EQ(0U, groups.GetGroupId("/sw/python/README"));
+  EXPECT_EQ(0U, groups.GetGroupId("/sw/lib/README"));
+
+  PrefetchGroups invalid;
+  EXPECT_FALSE(invalid.LoadPatternsFromString("/sw/\\"));
+  EXPECT_FALSE(invalid.LoadPatterns(tmp_path_ + "/no_such_file"));
+}
+
+
+TEST_F(T_PrefetchGroups, TracerLog) {
+  WriteLog(
+    "\"1.0\",\"-1\",\"Tracer\",\"Trace buffer created\"\r\n"
+    "\"1.1\",\"1\",\"/sw/bin/app\",\"open()\"\r\n"
+    "\"1.2\",\"1\",\"/sw/lib/liba.so\",\"open()\"\r\n"
+    "\"1.3\",\"1\",\"/sw/lib/libb.so\",\"open()\"\r\n"
+    "\"1.4\",\"6\",\"/sw/lib/libc.so\",\"lookup()\"\r\n"
+    "\"9.0\",\"1\",\"/sw/lib/late.so\",\"open()\"\r\n"
+    "\"10.0\",\"-1\",\"Tracer\",\"Trace buffer created\"\r\n"
+    "\"10.1\",\"1\",\"/sw/lib/liba.so\",\"open()\"\r\n"
+    "\"10.2\",\"1\",\"/sw/lib/libb.so\",\"open()\"\r\n"
+    "\"10.3\",\"1\",\"/sw/lib/libb.so\",\"open()\"\r\n");
+
+  PrefetchGroups groups;
+  EXPECT_TRUE(groups.LoadTracerLog(log_path_));
+  const map<string, uint64_t> &traced = groups.traced_groups();
+  ASSERT_EQ(2U, traced.size());
+  ASSERT_EQ(1U, traced.count("/sw/lib/liba.so"));
+  ASSERT_EQ(1U, traced.count("/sw/lib/libb.so"));
+  EXPECT_EQ(traced.find("/sw/lib/liba.so")->second,
+            traced.find("/sw/lib/libb.so")->second);
+  EXPECT_NE(0U, traced.find("/sw/lib/liba.so")->second);
+
+  WriteLog("\"1.1\",\"1\",\"/unterminated\r\n");
+  PrefetchGroups invalid;
+  EXPECT_FALSE(invalid.LoadTracerLog(log_path_));
+  EXPECT_FALSE(invalid.LoadTracerLog(tmp_path_ + "/no_such_file"));
+}
+
+}  // namespace catalog
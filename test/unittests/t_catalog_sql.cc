@@ -17,7 +17,52 @@ class T_CatalogSql : public ::testing::Test {
   }
 };
 
+static void RevertToRevision8(catalog::CatalogDatabase *db) {
+  ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
+    "DROP TABLE digest_trees;").Execute());
+  ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
+    "UPDATE properties SET value=8 WHERE key='schema_revision';").Execute());
+}
+
+static void RevertToRevision7(catalog::CatalogDatabase *db) {
+  RevertToRevision8(db);
+  ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
+    "DROP TABLE prefetch_groups;").Execute());
+  ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
+    "UPDATE properties SET value=7 WHERE key='schema_revision';").Execute());
+}
+
+static void RevertToRevision6(catalog::CatalogDatabase *db) {
+  RevertToRevision7(db);
+  ASSERT_TRUE(sqlite::Sql(db->sqlite_db(), "DELETE FROM statistics WHERE "
+    "counter GLOB '*_size_[0-9]*' OR counter GLOB '*_size_huge' OR "
+    "counter GLOB '*_inline' OR counter GLOB '*_bundled' OR "
+    "counter GLOB '*_unsummarized';").Execute());
+  ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
+    "UPDATE properties SET value=6 WHERE key='schema_revision';").Execute());
+}
+
+static void RevertToRevision5(catalog::CatalogDatabase *db) {
+  RevertToRevision6(db);
+
+  ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
+    "DROP TABLE bundles;").Execute());
+  ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
+    "UPDATE properties SET value=5 WHERE key='schema_revision';").Execute());
+}
+
+static void RevertToRevision4(catalog::CatalogDatabase *db) {
+  RevertToRevision5(db);
+
+  ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
+    "DROP TABLE inline_data;").Execute());
+  ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
+    "UPDATE properties SET value=4 WHERE key='schema_revision';").Execute());
+}
+
 static void RevertToRevision3(catalog::CatalogDatabase *db) {
+  RevertToRevision4(db);
+
   ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
     "DROP TABLE bind_mountpoints;").Execute());
   ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
@@ -114,7 +159,7 @@ TEST_F(T_CatalogSql, SchemaMigration) {
   fclose(ftmp);
   UnlinkGuard unlink_guard(path);
 
-  // Revision 1 --> 4
+  // Revision 1 --> 9
   {
     UniquePtr<catalog::CatalogDatabase>
       db(catalog::CatalogDatabase::Create(path));
@@ -132,7 +177,7 @@ TEST_F(T_CatalogSql, SchemaMigration) {
     sqlite::Sql sql2(db->sqlite_db(),
       "SELECT value FROM properties WHERE key='schema_revision'");
     ASSERT_TRUE(sql2.FetchRow());
-    EXPECT_EQ(4, sql2.RetrieveInt(0));
+    EXPECT_EQ(9, sql2.RetrieveInt(0));
     sqlite::Sql sql3(db->sqlite_db(),
       "SELECT value FROM statistics WHERE counter='self_xattr'");
     ASSERT_TRUE(sql3.FetchRow());
@@ -145,9 +190,25 @@ TEST_F(T_CatalogSql, SchemaMigration) {
       "SELECT COUNT(*) FROM bind_mountpoints");
     ASSERT_TRUE(sql5.FetchRow());
     EXPECT_EQ(0, sql5.RetrieveInt(0));
+    sqlite::Sql sql6(db->sqlite_db(),
+      "SELECT COUNT(*) FROM inline_data");
+    ASSERT_TRUE(sql6.FetchRow());
+    EXPECT_EQ(0, sql6.RetrieveInt(0));
+    sqlite::Sql sql7(db->sqlite_db(),
+      "SELECT COUNT(*) FROM bundles");
+    ASSERT_TRUE(sql7.FetchRow());
+    EXPECT_EQ(0, sql7.RetrieveInt(0));
+    sqlite::Sql sql8(db->sqlite_db(),
+      "SELECT COUNT(*) FROM prefetch_groups");
+    ASSERT_TRUE(sql8.FetchRow());
+    EXPECT_EQ(0, sql8.RetrieveInt(0));
+    sqlite::Sql sql9(db->sqlite_db(),
+      "SELECT COUNT(*) FROM digest_trees");
+    ASSERT_TRUE(sql9.FetchRow());
+    EXPECT_EQ(0, sql9.RetrieveInt(0));
   }
 
-  // Revision 0 --> 4
+  // Revision 0 --> 9
   {
     UniquePtr<catalog::CatalogDatabase> db(catalog::CatalogDatabase::Open(
       path, catalog::CatalogDatabase::kOpenReadWrite));
@@ -168,7 +229,7 @@ TEST_F(T_CatalogSql, SchemaMigration) {
     sqlite::Sql sql3(db->sqlite_db(),
       "SELECT value FROM properties WHERE key='schema_revision'");
     ASSERT_TRUE(sql3.FetchRow());
-    EXPECT_EQ(4, sql3.RetrieveInt(0));
+    EXPECT_EQ(9, sql3.RetrieveInt(0));
     sqlite::Sql sql4(db->sqlite_db(),
       "SELECT value FROM statistics WHERE counter='self_xattr'");
     ASSERT_TRUE(sql4.FetchRow());
@@ -195,3 +256,104 @@ TEST_F(T_CatalogSql, SchemaMigration) {
     EXPECT_EQ(0, sql9.RetrieveInt(0));
   }
 }
+
+
+TEST_F(T_CatalogSql, InlineData) {
+  string path;
+  FILE *ftmp = CreateTempFile("./cvmfs_ut_catalog_sql", 0600, "w+", &path);
+  ASSERT_TRUE(ftmp != NULL);
+  fclose(ftmp);
+  UnlinkGuard unlink_guard(path);
+
+  UniquePtr<catalog::CatalogDatabase>
+    db(catalog::CatalogDatabase::Create(path));
+  ASSERT_TRUE(db.IsValid());
+  const shash::Md5 path_hash(shash::AsciiPtr("/small"));
+  const string data("\0binary\n\0", 10);
+
+  catalog::SqlInlineDataInsert sql_insert(*db);
+  EXPECT_TRUE(sql_insert.BindPathHash(path_hash));
+  EXPECT_TRUE(sql_insert.BindData(data));
+  EXPECT_TRUE(sql_insert.Execute());
+
+  catalog::SqlInlineDataLookup sql_lookup(*db);
+  EXPECT_TRUE(sql_lookup.BindPathHash(path_hash));
+  ASSERT_TRUE(sql_lookup.FetchRow());
+  EXPECT_EQ(data, sql_lookup.GetData());
+  EXPECT_TRUE(sql_lookup.Reset());
+
+  catalog::SqlInlineDataRemove sql_remove(*db);
+  EXPECT_TRUE(sql_remove.BindPathHash(path_hash));
+  EXPECT_TRUE(sql_remove.Execute());
+  EXPECT_TRUE(sql_lookup.BindPathHash(path_hash));
+  EXPECT_FALSE(sql_lookup.FetchRow());
+}
+
+
+TEST_F(T_CatalogSql, Bundles) {
+  string path;
+  FILE *ftmp = CreateTempFile("./cvmfs_ut_catalog_sql", 0600, "w+", &path);
+  ASSERT_TRUE(ftmp != NULL);
+  fclose(ftmp);
+  UnlinkGuard unlink_guard(path);
+
+  UniquePtr<catalog::CatalogDatabase>
+    db(catalog::CatalogDatabase::Create(path));
+  ASSERT_TRUE(db.IsValid());
+  const shash::Md5 path_hash(shash::AsciiPtr("/small"));
+  shash::Any bundle_hash(shash::kShake128);
+  bundle_hash.Randomize();
+
+  catalog::SqlBundleInsert sql_insert(*db);
+  EXPECT_TRUE(sql_insert.BindPathHash(path_hash));
+  EXPECT_TRUE(sql_insert.BindBundle(bundle_hash, 42));
+  EXPECT_TRUE(sql_insert.Execute());
+
+  catalog::SqlBundleLookup sql_lookup(*db);
+  EXPECT_TRUE(sql_lookup.BindPathHash(path_hash));
+  ASSERT_TRUE(sql_lookup.FetchRow());
+  EXPECT_EQ(bundle_hash, sql_lookup.GetBundleHash(shash::kShake128));
+  EXPECT_EQ(42U, sql_lookup.GetOffset());
+  EXPECT_TRUE(sql_lookup.Reset());
+
+  catalog::SqlBundleRemove sql_remove(*db);
+  EXPECT_TRUE(sql_remove.BindPathHash(path_hash));
+  EXPECT_TRUE(sql_remove.Execute());
+  EXPECT_TRUE(sql_lookup.BindPathHash(path_hash));
+  EXPECT_FALSE(sql_lookup.FetchRow());
+}
+
+
+TEST_F(T_CatalogSql, ClusterByParent) {
+  string path;
+  FILE *ftmp = CreateTempFile("./cvmfs_ut_catalog_sql", 0600, "w+", &path);
+  ASSERT_TRUE(ftmp != NULL);
+  fclose(ftmp);
+  UnlinkGuard unlink_guard(path);
+
+  UniquePtr<catalog::CatalogDatabase>
+    db(catalog::CatalogDatabase::Create(path));
+  ASSERT_TRUE(db.IsValid());
+  // Entries of two directories, inserted interleaved
+  for (unsigned i = 0; i < 6; ++i) {
+    ASSERT_TRUE(sqlite::Sql(db->sqlite_db(),
+      "INSERT INTO catalog (md5path_1, md5path_2, parent_1, parent_2, name) "
+      "VALUES (" + StringifyInt(i) + ", 0, " + StringifyInt(i % 2) + ", 0, "
+      "'" + StringifyInt(i) + "');").Execute());
+  }
+
+  EXPECT_TRUE(db->ClusterByParent());
+  sqlite::Sql sql(db->sqlite_db(),
+                  "SELECT md5path_1 FROM catalog ORDER BY rowid;");
+  const int64_t expected[] = {0, 2, 4, 1, 3, 5};
+  for (unsigned i = 0; i < 6; ++i) {
+    ASSERT_TRUE(sql.FetchRow());
+    EXPECT_EQ(expected[i], sql.RetrieveInt64(0));
+  }
+  EXPECT_FALSE(sql.FetchRow());
+  EXPECT_TRUE(sql.Reset());
+
+  sqlite::Sql sql_count(db->sqlite_db(), "SELECT count(*) FROM catalog;");
+  ASSERT_TRUE(sql_count.FetchRow());
+  EXPECT_EQ(6, sql_count.RetrieveInt64(0));
+}
@@ -0,0 +1,127 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "catalog_trace.h"
+#include "hash.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+class T_CatalogTrace : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    tmp_path_ = CreateTempDir("./cvmfs_ut_catalog_trace");
+    ASSERT_FALSE(tmp_path_.empty());
+    trace_path_ = tmp_path_ + "/catalogtrace";
+    root_ = MkHash("0");
+    a_ = MkHash("a");
+    b_ = MkHash("b");
+    c_ = MkHash("c");
+  }
+
+  virtual void TearDown() {
+    RemoveTree(tmp_path_);
+  }
+
+  static shash::Any MkHash(const string &content) {
+    shash::Any hash(shash::kSha1);
+    shash::HashString(content, &hash);
+    hash.suffix = shash::kSuffixCatalog;
+    return hash;
+  }
+
+  string tmp_path_;
+  string trace_path_;
+  shash::Any root_;
+  shash::Any a_;
+  shash::Any b_;
+  shash::Any c_;
+};
+
+
+TEST_F(T_CatalogTrace, Record) {
+  CatalogTrace trace(root_);
+  EXPECT_TRUE(trace.Record(root_, 100).empty());
+  EXPECT_TRUE(trace.Record(a_, 101).empty());
+  EXPECT_TRUE(trace.Record(a_, 102).empty());
+  EXPECT_TRUE(trace.Record(b_, 110).empty());
+  // Outside of the window, starts a new group
+  EXPECT_TRUE(trace.Record(c_, 111).empty());
+  EXPECT_TRUE(trace.Save(trace_path_));
+
+  CatalogTrace *learned = CatalogTrace::Load(trace_path_, root_);
+  ASSERT_TRUE(learned != NULL);
+  EXPECT_EQ(root_, learned->root_hash());
+  EXPECT_EQ(1U, learned->num_learned());
+  vector<shash::Any> group = learned->Record(root_, 200);
+  ASSERT_EQ(2U, group.size());
+  EXPECT_EQ(a_, group[0]);
+  EXPECT_EQ(b_, group[1]);
+  // Handed out only once
+  EXPECT_TRUE(learned->Record(root_, 300).empty());
+  EXPECT_TRUE(learned->Record(c_, 301).empty());
+  delete learned;
+}
+
+
+TEST_F(T_CatalogTrace, Merge) {
+  CatalogTrace trace(root_);
+  trace.Record(root_, 100);
+  trace.Record(a_, 100);
+  trace.Record(b_, 200);
+  trace.Record(c_, 200);
+  EXPECT_TRUE(trace.Save(trace_path_));
+
+  // Recorded groups replace learned groups with the same leader
+  CatalogTrace *learned = CatalogTrace::Load(trace_path_, root_);
+  ASSERT_TRUE(learned != NULL);
+  EXPECT_EQ(2U, learned->num_learned());
+  learned->Record(root_, 300);
+  learned->Record(c_, 300);
+  EXPECT_TRUE(learned->Save(trace_path_));
+  delete learned;
+
+  learned = CatalogTrace::Load(trace_path_, root_);
+  ASSERT_TRUE(learned != NULL);
+  EXPECT_EQ(2U, learned->num_learned());
+  vector<shash::Any> group = learned->Record(root_, 400);
+  ASSERT_EQ(1U, group.size());
+  EXPECT_EQ(c_, group[0]);
+  group = learned->Record(b_, 500);
+  ASSERT_EQ(1U, group.size());
+  EXPECT_EQ(c_, group[0]);
+  delete learned;
+}
+
+
+TEST_F(T_CatalogTrace, Load) {
+  EXPECT_EQ(NULL, CatalogTrace::Load(trace_path_, root_));
+
+  CatalogTrace trace(root_);
+  trace.Record(root_, 100);
+  trace.Record(a_, 100);
+  EXPECT_TRUE(trace.Save(trace_path_));
+  EXPECT_EQ(NULL, CatalogTrace::Load(trace_path_, a_));
+
+  EXPECT_TRUE(SafeWriteToFile(root_.ToStringWithSuffix() + "\n" +
+                              "garbage " + a_.ToStringWithSuffix() + "\n" +
+                              a_.ToStringWithSuffix() + "\n" +
+                              b_.ToStringWithSuffix() + " " +
+                              c_.ToStringWithSuffix() + "\n",
+                              trace_path_, 0644));
+  CatalogTrace *learned = CatalogTrace::Load(trace_path_, root_);
+  ASSERT_TRUE(learned != NULL);
+  EXPECT_EQ(1U, learned->num_learned());
+  EXPECT_EQ(1U, learned->Record(b_, 100).size());
+  delete learned;
+}
+
+}  // namespace catalog
@@ -4,6 +4,7 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <cassert>
 #include <map>
 #include <string>
@@ -960,6 +961,48 @@ TEST_F(T_CatalogTraversal, SecondLevelHistoryTraversalNoRepeat) {
 //------------------------------------------------------------------------------
 
 
+CatalogIdentifiers UnorderedTraversal_visited_catalogs;
+void UnorderedTraversalCallback(
+  const MockedCatalogTraversal::CallbackDataTN &data)
+{
+  UnorderedTraversal_visited_catalogs.push_back(
+    std::make_pair(data.catalog->GetRevision(),
+                   data.catalog->mountpoint().ToString()));
+}
+
+TEST_F(T_CatalogTraversal, UnorderedTraversal) {
+  for (unsigned no_repeat = 0; no_repeat < 2; ++no_repeat) {
+    TraversalParams params = GetBasicTraversalParams();
+    params.history = TraversalParams::kFullHistory;
+    params.no_repeat_history = (no_repeat == 1);
+    params.num_threads = 4;
+
+    UnorderedTraversal_visited_catalogs.clear();
+    MockedCatalogTraversal traverse_ordered(params);
+    traverse_ordered.RegisterListener(&UnorderedTraversalCallback);
+    EXPECT_TRUE(traverse_ordered.Traverse());
+    CatalogIdentifiers expected = UnorderedTraversal_visited_catalogs;
+
+    UnorderedTraversal_visited_catalogs.clear();
+    MockedCatalogTraversal traverse_unordered(params);
+    traverse_unordered.RegisterListener(&UnorderedTraversalCallback);
+    EXPECT_TRUE(traverse_unordered.Traverse(
+      MockedCatalogTraversal::kUnorderedTraversal));
+    CatalogIdentifiers observed = UnorderedTraversal_visited_catalogs;
+
+    // The HEAD root catalog comes first
+    ASSERT_FALSE(observed.empty());
+    EXPECT_EQ(std::make_pair(max_revision, std::string("")), observed.front());
+    std::sort(expected.begin(), expected.end());
+    std::sort(observed.begin(), observed.end());
+    CheckCatalogSequence(expected, observed);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+
+
 CatalogIdentifiers FullHistoryTraversalNoRepeat_visited_catalogs;
 void FullHistoryTraversalNoRepeatCallback(
   const MockedCatalogTraversal::CallbackDataTN &data)
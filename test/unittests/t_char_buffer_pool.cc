@@ -0,0 +1,93 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+#include "file_processing/char_buffer.h"
+#include "file_processing/char_buffer_pool.h"
+
+using namespace std;  // NOLINT
+
+namespace upload {
+
+TEST(T_CharBufferPool, SizeClasses) {
+  CharBufferPool pool;
+  CharBuffer *small = pool.Acquire(1);
+  EXPECT_EQ(CharBufferPool::kMinClassSize, small->size());
+  CharBuffer *medium = pool.Acquire(512 * 1024 + 1);
+  EXPECT_EQ(1024U * 1024U, medium->size());
+  CharBuffer *large = pool.Acquire(CharBufferPool::kMaxClassSize + 1);
+  EXPECT_EQ(CharBufferPool::kMaxClassSize + 1, large->size());
+
+  pool.Release(small);
+  pool.Release(medium);
+  pool.Release(large);
+  CharBufferPool::Statistics stats = pool.GetStatistics();
+  EXPECT_EQ(3U, stats.num_acquired);
+  EXPECT_EQ(3U, stats.num_allocated);
+  EXPECT_EQ(3U, stats.num_released);
+  // The oversized buffer is not pooled
+  EXPECT_EQ(1U, stats.num_freed);
+  EXPECT_EQ(CharBufferPool::kMinClassSize + 1024U * 1024U, stats.sz_pooled);
+}
+
+
+TEST(T_CharBufferPool, Recycle) {
+  CharBufferPool pool;
+  CharBuffer *buffer = pool.Acquire(1000);
+  buffer->SetUsedBytes(100);
+  buffer->SetBaseOffset(42);
+  pool.Release(buffer);
+
+  CharBuffer *recycled = pool.Acquire(CharBufferPool::kMinClassSize);
+  EXPECT_EQ(buffer, recycled);
+  EXPECT_EQ(0U, recycled->used_bytes());
+  EXPECT_EQ(0, recycled->base_offset());
+  CharBufferPool::Statistics stats = pool.GetStatistics();
+  EXPECT_EQ(1U, stats.num_allocated);
+  EXPECT_EQ(1U, stats.num_recycled);
+  EXPECT_EQ(0U, stats.sz_pooled);
+
+  // Foreign buffers are only kept if they have exactly the size of a class
+  CharBuffer *foreign = new CharBuffer(1000);
+  pool.Release(foreign);
+  EXPECT_EQ(1U, pool.GetStatistics().num_freed);
+  pool.Release(recycled);
+  EXPECT_EQ(1U, pool.GetStatistics().num_freed);
+}
+
+
+TEST(T_CharBufferPool, Limit) {
+  CharBufferPool pool(2 * CharBufferPool::kMinClassSize);
+  CharBuffer *buffers[3];
+  for (unsigned i = 0; i < 3; ++i)
+    buffers[i] = pool.Acquire(CharBufferPool::kMinClassSize);
+  for (unsigned i = 0; i < 3; ++i)
+    pool.Release(buffers[i]);
+  CharBufferPool::Statistics stats = pool.GetStatistics();
+  EXPECT_EQ(1U, stats.num_freed);
+  EXPECT_EQ(2 * CharBufferPool::kMinClassSize, stats.sz_pooled);
+}
+
+
+TEST(T_CharBufferPool, Clone) {
+  CharBufferPool pool;
+  CharBuffer *buffer = pool.Acquire(10);
+  memcpy(buffer->ptr(), "0123456789", 10);
+  buffer->SetUsedBytes(10);
+  buffer->SetBaseOffset(1000);
+
+  CharBuffer *clone = pool.Clone(*buffer);
+  EXPECT_NE(buffer, clone);
+  EXPECT_EQ(buffer->size(), clone->size());
+  EXPECT_EQ(10U, clone->used_bytes());
+  EXPECT_EQ(1000, clone->base_offset());
+  EXPECT_EQ(0, memcmp(buffer->ptr(), clone->ptr(), 10));
+  pool.Release(buffer);
+  pool.Release(clone);
+}
+
+}  // namespace upload
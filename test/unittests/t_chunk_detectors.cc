@@ -274,6 +274,54 @@ TEST_F(T_ChunkDetectors, Xor32ChunkDetectorSlow) {
 }
 
 
+TEST_F(T_ChunkDetectors, Xor32ImplementationsSlow) {
+  const size_t base = 512000;
+  EXPECT_TRUE(Xor32Detector::IsImplementationAvailable(
+    Xor32Detector::kImplScalar));
+
+  std::vector<Xor32Detector::Implementation> implementations;
+  implementations.push_back(Xor32Detector::kImplSse41);
+  implementations.push_back(Xor32Detector::kImplAvx2);
+
+  std::vector<size_t> buffer_sizes;
+  buffer_sizes.push_back(4096);
+  buffer_sizes.push_back(102400);    // 100kB
+  buffer_sizes.push_back(base * 2);  // same as average chunk size
+
+  for (unsigned i = 0; i < buffer_sizes.size(); ++i) {
+    CreateBuffers(buffer_sizes[i]);
+
+    std::vector<off_t> expected;
+    Xor32Detector scalar(base, base * 2, base * 4);
+    scalar.SetImplementation(Xor32Detector::kImplScalar);
+    EXPECT_EQ(Xor32Detector::kImplScalar, scalar.implementation());
+    for (unsigned j = 0; j < buffers_.size(); ++j) {
+      off_t next_cut;
+      while ((next_cut = scalar.FindNextCutMark(buffers_[j])) != 0)
+        expected.push_back(next_cut);
+    }
+    ASSERT_FALSE(expected.empty());
+
+    for (unsigned k = 0; k < implementations.size(); ++k) {
+      if (!Xor32Detector::IsImplementationAvailable(implementations[k]))
+        continue;
+      Xor32Detector detector(base, base * 2, base * 4);
+      detector.SetImplementation(implementations[k]);
+      EXPECT_EQ(implementations[k], detector.implementation());
+
+      std::vector<off_t> cuts;
+      for (unsigned j = 0; j < buffers_.size(); ++j) {
+        off_t next_cut;
+        while ((next_cut = detector.FindNextCutMark(buffers_[j])) != 0)
+          cuts.push_back(next_cut);
+      }
+      EXPECT_EQ(expected, cuts) << "implementation " << implementations[k]
+                                << ", buffer size " << buffer_sizes[i];
+    }
+  }
+}
+
+
 TEST_F(T_ChunkDetectors, Xor32ChunkDetectorZerosBufferPowerOfTwo) {
   // This is a regression test for CVM-957, describing a bug in the XOR 32 chunk
   // detector that crashes with certain input. Namely, if the provided data does
@@ -309,4 +357,101 @@ TEST_F(T_ChunkDetectors, Xor32ChunkDetectorZerosBufferPowerOfTwo) {
   }
 }
 
+
+TEST_F(T_ChunkDetectors, FastCdcMasks) {
+  FastCdcDetector detector(4 * 1024 * 1024, 8 * 1024 * 1024,
+                           16 * 1024 * 1024);
+  EXPECT_EQ(25, __builtin_popcountll(detector.mask_small_));
+  EXPECT_EQ(21, __builtin_popcountll(detector.mask_large_));
+  EXPECT_EQ(0xffffff8000000000ULL, detector.mask_small_);
+  EXPECT_EQ(0xfffff80000000000ULL, detector.mask_large_);
+
+  FastCdcDetector tiny(1, 2, 4);
+  EXPECT_EQ(3, __builtin_popcountll(tiny.mask_small_));
+  EXPECT_EQ(1, __builtin_popcountll(tiny.mask_large_));
+}
+
+
+TEST_F(T_ChunkDetectors, FastCdcChunkDetectorSlow) {
+  const size_t base = 512000;
+  const size_t min_chk_size = base;
+  const size_t avg_chk_size = base * 2;
+  const size_t max_chk_size = base * 4;
+
+  FastCdcDetector fastcdc_detector(min_chk_size, avg_chk_size, max_chk_size);
+  EXPECT_FALSE(fastcdc_detector.MightFindChunks(0));
+  EXPECT_FALSE(fastcdc_detector.MightFindChunks(base));
+  EXPECT_TRUE(fastcdc_detector.MightFindChunks(base + 1));
+
+  std::vector<size_t> buffer_sizes;
+  buffer_sizes.push_back(4096);
+  buffer_sizes.push_back(102400);    // 100kB
+  buffer_sizes.push_back(base);      // same as minimal chunk size
+  buffer_sizes.push_back(base * 2);  // same as average chunk size
+  buffer_sizes.push_back(10485760);  // 10MB
+
+  std::vector<off_t> expected;
+  for (unsigned i = 0; i < buffer_sizes.size(); ++i) {
+    CreateBuffers(buffer_sizes[i]);
+
+    FastCdcDetector detector(min_chk_size, avg_chk_size, max_chk_size);
+    std::vector<off_t> cuts;
+    off_t last_cut = 0;
+    for (unsigned j = 0; j < buffers_.size(); ++j) {
+      off_t next_cut;
+      while ((next_cut = detector.FindNextCutMark(buffers_[j])) != 0) {
+        const size_t chunk_size = next_cut - last_cut;
+        ASSERT_LE(min_chk_size, chunk_size)
+          << "too small chunk with buffer size " << buffer_sizes[i];
+        ASSERT_GE(max_chk_size, chunk_size)
+          << "too large chunk with buffer size " << buffer_sizes[i];
+        cuts.push_back(next_cut);
+        last_cut = next_cut;
+      }
+    }
+
+    if (i == 0) {
+      expected = cuts;
+      continue;
+    }
+    EXPECT_EQ(expected, cuts) << "buffer size " << buffer_sizes[i];
+  }
+
+  // Normalized chunking centers the chunk sizes around the average chunk size
+  ASSERT_GT(expected.size(), 1u);
+  const double average = static_cast<double>(expected.back()) /
+                         static_cast<double>(expected.size());
+  EXPECT_LT(0.9 * avg_chk_size, average);
+  EXPECT_GT(1.2 * avg_chk_size, average);
+  unsigned num_hard_cuts = 0;
+  off_t last_cut = 0;
+  for (unsigned i = 0; i < expected.size(); ++i) {
+    if (expected[i] - last_cut == static_cast<off_t>(max_chk_size))
+      num_hard_cuts++;
+    last_cut = expected[i];
+  }
+  EXPECT_GT(expected.size() / 100 + 1, num_hard_cuts);
+}
+
+
+TEST_F(T_ChunkDetectors, FastCdcChunkDetectorZeros) {
+  const size_t min_chk_size = data_size() / 64;
+  const size_t avg_chk_size = data_size() / 32;
+  const size_t max_chk_size = data_size() / 16;
+  FastCdcDetector detector(min_chk_size, avg_chk_size, max_chk_size);
+
+  CreateZeroBuffers(512000);
+
+  off_t next_cut = 0;
+  unsigned num_cuts = 0;
+  for (unsigned j = 0; j < buffers_.size(); ++j) {
+    while ((next_cut = detector.FindNextCutMark(buffers_[j])) != 0) {
+      EXPECT_EQ(0u, next_cut % max_chk_size);
+      EXPECT_GE(data_size(), static_cast<size_t>(next_cut));
+      num_cuts++;
+    }
+  }
+  EXPECT_EQ(16u, num_cuts);
+}
+
 }  // namespace upload
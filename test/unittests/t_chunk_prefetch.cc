@@ -0,0 +1,200 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "backoff.h"
+#include "cache_posix.h"
+#include "chunk_prefetch.h"
+#include "compression.h"
+#include "download.h"
+#include "fetch.h"
+#include "file_chunk.h"
+#include "hash.h"
+#include "statistics.h"
+#include "testutil.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+namespace cvmfs {
+
+class T_ChunkPrefetcher : public ::testing::Test {
+ protected:
+  static const unsigned kNumChunks = 4;
+
+  virtual void SetUp() {
+    used_fds_ = GetNoUsedFds();
+    tmp_path_ = CreateTempDir(GetCurrentWorkingDirectory() +
+                              "/cvmfs_ut_chunk_prefetch");
+    const string src_path = tmp_path_ + "/data";
+
+    chunk_list_ = new FileChunkList();
+    for (unsigned i = 0; i < kNumChunks; ++i) {
+      unsigned char c = 'a' + i;
+      void *buf;
+      uint64_t buf_size;
+      EXPECT_TRUE(zlib::CompressMem2Mem(&c, 1, &buf, &buf_size));
+      shash::Any hash(shash::kSha1);
+      shash::HashMem(static_cast<unsigned char *>(buf), buf_size, &hash);
+      MkdirDeep(GetParentPath(src_path + "/" + hash.MakePath()), 0700);
+      EXPECT_TRUE(CopyMem2Path(static_cast<unsigned char *>(buf), buf_size,
+                               src_path + "/" + hash.MakePath()));
+      free(buf);
+      chunk_list_->PushBack(FileChunk(hash, i, 1));
+    }
+    chunks_ = FileChunkReflist(chunk_list_, PathString("/chunked"),
+                               zlib::kZlibDefault, false);
+
+    cache_mgr_ = PosixCacheManager::Create(tmp_path_, false);
+    ASSERT_TRUE(cache_mgr_ != NULL);
+    download_mgr_ = new download::DownloadManager();
+    download_mgr_->Init(8, false,
+      perf::StatisticsTemplate("test", &statistics_));
+    download_mgr_->SetHostChain("file://" + tmp_path_);
+    fetcher_ = new Fetcher(cache_mgr_, download_mgr_, &backoff_throttle_,
+                           perf::StatisticsTemplate("fetch", &statistics_));
+    n_scheduled_ = statistics_.Register("test.n_readahead", "");
+    n_dropped_ = statistics_.Register("test.n_readahead_dropped", "");
+  }
+
+  virtual void TearDown() {
+    delete fetcher_;
+    download_mgr_->Fini();
+    delete download_mgr_;
+    delete cache_mgr_;
+    delete chunk_list_;
+    if (tmp_path_ != "")
+      RemoveTree(tmp_path_);
+    EXPECT_EQ(used_fds_, GetNoUsedFds());
+  }
+
+  bool IsCached(unsigned chunk_idx) {
+    int fd = cache_mgr_->Open(
+      CacheManager::Bless(chunk_list_->AtPtr(chunk_idx)->content_hash()));
+    if (fd < 0)
+      return false;
+    cache_mgr_->Close(fd);
+    return true;
+  }
+
+  FileChunkList *chunk_list_;
+  FileChunkReflist chunks_;
+  PosixCacheManager *cache_mgr_;
+  download::DownloadManager *download_mgr_;
+  Fetcher *fetcher_;
+  perf::Statistics statistics_;
+  perf::Counter *n_scheduled_;
+  perf::Counter *n_dropped_;
+  BackoffThrottle backoff_throttle_;
+  unsigned used_fds_;
+  string tmp_path_;
+};
+
+
+TEST_F(T_ChunkPrefetcher, Disabled) {
+  ChunkPrefetcher prefetcher(0, 2, n_scheduled_, n_dropped_);
+  prefetcher.Spawn();
+  prefetcher.Schedule(chunks_, 0, fetcher_, CacheManager::kTypeRegular);
+  EXPECT_EQ(0, n_scheduled_->Get());
+}
+
+
+TEST_F(T_ChunkPrefetcher, Schedule) {
+  ChunkPrefetcher prefetcher(2, 2, n_scheduled_, n_dropped_);
+  EXPECT_EQ(2U, prefetcher.window());
+
+  // Not yet spawned, jobs stay queued and are not scheduled twice
+  prefetcher.Schedule(chunks_, 0, fetcher_, CacheManager::kTypeRegular);
+  EXPECT_EQ(2, n_scheduled_->Get());
+  EXPECT_EQ(2U, prefetcher.jobs_.size());
+  prefetcher.Schedule(chunks_, 0, fetcher_, CacheManager::kTypeRegular);
+  EXPECT_EQ(2, n_scheduled_->Get());
+  // Window is cut at the end of the file
+  prefetcher.Schedule(chunks_, 2, fetcher_, CacheManager::kTypeRegular);
+  EXPECT_EQ(3, n_scheduled_->Get());
+  prefetcher.Schedule(chunks_, kNumChunks - 1, fetcher_,
+                      CacheManager::kTypeRegular);
+  EXPECT_EQ(3, n_scheduled_->Get());
+
+  prefetcher.Spawn();
+  unsigned retries = 0;
+  while ((!IsCached(1) || !IsCached(2) || !IsCached(3)) && (retries < 500)) {
+    SafeSleepMs(10);
+    retries++;
+  }
+  EXPECT_FALSE(IsCached(0));
+  EXPECT_TRUE(IsCached(1));
+  EXPECT_TRUE(IsCached(2));
+  EXPECT_TRUE(IsCached(3));
+  EXPECT_EQ(0, n_dropped_->Get());
+}
+
+
+TEST_F(T_ChunkPrefetcher, ScheduleChunk) {
+  ChunkPrefetcher disabled(0, 2, n_scheduled_, n_dropped_);
+  EXPECT_FALSE(disabled.ScheduleChunk(chunks_, 0, fetcher_,
+                                      CacheManager::kTypeRegular));
+
+  ChunkPrefetcher prefetcher(2, 2, n_scheduled_, n_dropped_);
+  EXPECT_TRUE(prefetcher.ScheduleChunk(chunks_, 0, fetcher_,
+                                       CacheManager::kTypeRegular));
+  EXPECT_EQ(1, n_scheduled_->Get());
+  // Already in flight
+  EXPECT_TRUE(prefetcher.ScheduleChunk(chunks_, 0, fetcher_,
+                                       CacheManager::kTypeRegular));
+  EXPECT_EQ(1, n_scheduled_->Get());
+  EXPECT_EQ(1U, prefetcher.jobs_.size());
+
+  prefetcher.Spawn();
+  unsigned retries = 0;
+  while (!IsCached(0) && (retries < 500)) {
+    SafeSleepMs(10);
+    retries++;
+  }
+  EXPECT_TRUE(IsCached(0));
+  EXPECT_FALSE(IsCached(1));
+}
+
+
+TEST_F(T_ChunkPrefetcher, QueueFull) {
+  ChunkPrefetcher prefetcher(1, 1, n_scheduled_, n_dropped_);
+  FileChunkList long_list;
+  for (unsigned i = 0; i < ChunkPrefetcher::kMaxQueueLength + 2; ++i) {
+    shash::Any hash(shash::kSha1);
+    hash.Randomize(i);
+    long_list.PushBack(FileChunk(hash, i, 1));
+  }
+  FileChunkReflist chunks(&long_list, PathString("/long"),
+                          zlib::kZlibDefault, false);
+  for (unsigned i = 0; i < long_list.size(); ++i)
+    prefetcher.Schedule(chunks, i, fetcher_, CacheManager::kTypeRegular);
+  EXPECT_EQ(static_cast<int>(ChunkPrefetcher::kMaxQueueLength),
+            n_scheduled_->Get());
+  EXPECT_EQ(1, n_dropped_->Get());
+  EXPECT_EQ(ChunkPrefetcher::kMaxQueueLength, prefetcher.jobs_.size());
+}
+
+
+TEST_F(T_ChunkPrefetcher, ClaimGroup) {
+  ChunkPrefetcher disabled(0, 2, n_scheduled_, n_dropped_);
+  EXPECT_FALSE(disabled.ClaimGroup(1));
+
+  ChunkPrefetcher prefetcher(2, 2, n_scheduled_, n_dropped_);
+  EXPECT_TRUE(prefetcher.ClaimGroup(1));
+  EXPECT_FALSE(prefetcher.ClaimGroup(1));
+  EXPECT_TRUE(prefetcher.ClaimGroup(2));
+
+  for (unsigned i = 3; i <= ChunkPrefetcher::kMaxClaimedGroups; ++i)
+    EXPECT_TRUE(prefetcher.ClaimGroup(i));
+  EXPECT_EQ(ChunkPrefetcher::kMaxClaimedGroups,
+            prefetcher.claimed_groups_.size());
+  // Forgotten once the set is full
+  EXPECT_TRUE(prefetcher.ClaimGroup(1));
+  EXPECT_EQ(1U, prefetcher.claimed_groups_.size());
+}
+
+}  // namespace cvmfs
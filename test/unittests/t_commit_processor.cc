@@ -0,0 +1,233 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+#include "atomic.h"
+#include "receiver/commit_processor.h"
+#include "testutil.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+namespace receiver {
+
+/**
+ * Records the groups instead of merging catalogs.  Commits on lease paths
+ * containing "fail" let their group fail with a merge error.
+ */
+class MockedCommitProcessor : public CommitProcessor {
+ public:
+  explicit MockedCommitProcessor(const std::string& spool_dir)
+      : spool_dir_(spool_dir) { }
+
+  std::vector<std::vector<std::string> > groups;
+
+ protected:
+  virtual std::string GetSpoolDir(const std::string& /*repo_name*/) {
+    return spool_dir_;
+  }
+
+  virtual void ProcessGroup(const std::string& /*repo_name*/,
+                            const std::vector<Request>& group,
+                            std::vector<Result>* results) {
+    std::vector<std::string> lease_paths;
+    for (unsigned i = 0; i < group.size(); ++i) {
+      lease_paths.push_back(group[i].lease_path);
+      if (group[i].lease_path.find("fail") != std::string::npos) {
+        results->assign(group.size(), kRetry);
+        (*results)[i] = kMergeError;
+        groups.push_back(lease_paths);
+        return;
+      }
+    }
+    groups.push_back(lease_paths);
+    results->assign(group.size(), kSuccess);
+  }
+
+ private:
+  std::string spool_dir_;
+};
+
+
+class T_CommitProcessor : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    spool_dir_ = CreateTempDir(GetCurrentWorkingDirectory() + "/commits");
+    ASSERT_FALSE(spool_dir_.empty());
+    hash_ = shash::Any(shash::kSha1);
+    hash_.suffix = shash::kSuffixCatalog;
+  }
+
+  virtual void TearDown() {
+    RemoveTree(spool_dir_);
+  }
+
+  CommitProcessor::Request MakeRequest(const std::string& id,
+                                       const std::string& lease_path) {
+    CommitProcessor::Request request;
+    request.id = id;
+    request.lease_path = lease_path;
+    request.old_root_hash = hash_;
+    request.new_root_hash = hash_;
+    return request;
+  }
+
+  /**
+   * Registers a commit of another, running receiver
+   */
+  void AddPending(const std::string& lease_path, unsigned seq) {
+    const std::string id =
+        "0000000000000000000" + StringifyInt(seq) + "-" +
+        StringifyInt(getpid());
+    const std::string content =
+        lease_path + "\n" + hash_.ToString(true) + "\n" +
+        hash_.ToString(true) + "\n";
+    ASSERT_TRUE(
+        SafeWriteToFile(content, spool_dir_ + "/" + id + ".req", 0600));
+  }
+
+  std::string spool_dir_;
+  shash::Any hash_;
+};
+
+
+TEST_F(T_CommitProcessor, PathsOverlap) {
+  EXPECT_TRUE(CommitProcessor::PathsOverlap("repo/a", "repo/a"));
+  EXPECT_TRUE(CommitProcessor::PathsOverlap("repo/a", "repo/a/"));
+  EXPECT_TRUE(CommitProcessor::PathsOverlap("repo/a", "repo/a/b"));
+  EXPECT_TRUE(CommitProcessor::PathsOverlap("repo/a/b/c", "repo/a"));
+  EXPECT_TRUE(CommitProcessor::PathsOverlap("repo", "repo/a"));
+  EXPECT_TRUE(CommitProcessor::PathsOverlap("repo/", "repo/a"));
+  EXPECT_FALSE(CommitProcessor::PathsOverlap("repo/a", "repo/b"));
+  EXPECT_FALSE(CommitProcessor::PathsOverlap("repo/a", "repo/ab"));
+  EXPECT_FALSE(CommitProcessor::PathsOverlap("repo/a/b", "repo/a/c"));
+}
+
+
+TEST_F(T_CommitProcessor, SelectGroup) {
+  std::vector<CommitProcessor::Request> pending;
+  pending.push_back(MakeRequest("1", "repo/a/x"));
+  pending.push_back(MakeRequest("2", "repo/b"));
+  pending.push_back(MakeRequest("3", "repo/c"));
+  pending.push_back(MakeRequest("4", "repo/b/y"));
+  pending.push_back(MakeRequest("5", "repo/a"));
+
+  std::vector<CommitProcessor::Request> group =
+      CommitProcessor::SelectGroup(pending[4], pending);
+  ASSERT_EQ(3U, group.size());
+  EXPECT_EQ("5", group[0].id);
+  EXPECT_EQ("2", group[1].id);
+  EXPECT_EQ("3", group[2].id);
+
+  group = CommitProcessor::SelectGroup(pending[0], pending);
+  ASSERT_EQ(3U, group.size());
+  EXPECT_EQ("1", group[0].id);
+  EXPECT_EQ("2", group[1].id);
+  EXPECT_EQ("3", group[2].id);
+}
+
+
+TEST_F(T_CommitProcessor, GroupCommit) {
+  AddPending("repo/b", 1);
+  AddPending("repo/a/x", 2);
+  AddPending("repo/c", 3);
+
+  MockedCommitProcessor processor(spool_dir_);
+  EXPECT_EQ(CommitProcessor::kSuccess,
+            processor.Process("repo/a", hash_, hash_));
+  ASSERT_EQ(1U, processor.groups.size());
+  ASSERT_EQ(3U, processor.groups[0].size());
+  EXPECT_EQ("repo/a", processor.groups[0][0]);
+  EXPECT_EQ("repo/b", processor.groups[0][1]);
+  EXPECT_EQ("repo/c", processor.groups[0][2]);
+
+  // The overlapping commit is still pending, the others have a result
+  const std::vector<std::string> requests = FindFiles(spool_dir_, ".req");
+  ASSERT_EQ(1U, requests.size());
+  EXPECT_TRUE(HasSuffix(requests[0], "2-" + StringifyInt(getpid()) + ".req",
+                        false));
+  EXPECT_EQ(2U, FindFiles(spool_dir_, ".res").size());
+}
+
+
+TEST_F(T_CommitProcessor, FailedGroup) {
+  AddPending("repo/fail", 1);
+  AddPending("repo/c", 2);
+
+  MockedCommitProcessor processor(spool_dir_);
+  EXPECT_EQ(CommitProcessor::kSuccess,
+            processor.Process("repo/a", hash_, hash_));
+  // The first group fails because of the other commit, the own commit is
+  // retried together with the remaining commit
+  ASSERT_EQ(2U, processor.groups.size());
+  EXPECT_EQ(2U, processor.groups[0].size());
+  ASSERT_EQ(2U, processor.groups[1].size());
+  EXPECT_EQ("repo/a", processor.groups[1][0]);
+  EXPECT_EQ("repo/c", processor.groups[1][1]);
+
+  EXPECT_TRUE(FindFiles(spool_dir_, ".req").empty());
+  EXPECT_EQ(2U, FindFiles(spool_dir_, ".res").size());
+
+  MockedCommitProcessor failing(spool_dir_);
+  EXPECT_EQ(CommitProcessor::kMergeError,
+            failing.Process("repo/fail/x", hash_, hash_));
+  EXPECT_EQ(1, failing.GetNumErrors());
+}
+
+
+namespace {
+
+struct ConcurrentCommit {
+  std::string spool_dir;
+  std::string lease_path;
+  shash::Any hash;
+  CommitProcessor::Result result;
+  atomic_int32 *num_groups;
+};
+
+void *MainCommit(void *data) {
+  ConcurrentCommit *commit = reinterpret_cast<ConcurrentCommit *>(data);
+  MockedCommitProcessor processor(commit->spool_dir);
+  commit->result = processor.Process(commit->lease_path, commit->hash,
+                                     commit->hash);
+  atomic_xadd32(commit->num_groups, processor.groups.size());
+  return NULL;
+}
+
+}  // anonymous namespace
+
+
+TEST_F(T_CommitProcessor, ConcurrentCommits) {
+  const unsigned kNumCommits = 16;
+  atomic_int32 num_groups;
+  atomic_init32(&num_groups);
+  std::vector<ConcurrentCommit> commits(kNumCommits);
+  std::vector<pthread_t> threads(kNumCommits);
+  for (unsigned i = 0; i < kNumCommits; ++i) {
+    commits[i].spool_dir = spool_dir_;
+    // Pairs of overlapping lease paths
+    commits[i].lease_path = "repo/dir" + StringifyInt(i / 2) +
+                            ((i % 2) ? "/sub" : "");
+    commits[i].hash = hash_;
+    commits[i].result = CommitProcessor::kRetry;
+    commits[i].num_groups = &num_groups;
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, MainCommit, &commits[i]));
+  }
+  for (unsigned i = 0; i < kNumCommits; ++i) {
+    pthread_join(threads[i], NULL);
+    EXPECT_EQ(CommitProcessor::kSuccess, commits[i].result);
+  }
+  EXPECT_GE(atomic_read32(&num_groups), 2);
+  EXPECT_LE(atomic_read32(&num_groups), static_cast<int32_t>(kNumCommits));
+
+  EXPECT_TRUE(FindFiles(spool_dir_, ".req").empty());
+  EXPECT_TRUE(FindFiles(spool_dir_, ".res").empty());
+}
+
+}  // namespace receiver
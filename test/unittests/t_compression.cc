@@ -5,9 +5,21 @@
 #include <gtest/gtest.h>
 
 #include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 
 #include "compression.h"
 #include "hash.h"
+#include "prng.h"
+#include "util/file_guard.h"
+#include "util/pointer.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
 
 TEST(T_Compression, CompressFd2Null) {
   shash::Any hash(shash::kSha1);
@@ -21,3 +33,115 @@ TEST(T_Compression, CompressFd2Null) {
 
   EXPECT_FALSE(zlib::CompressFd2Null(-1, &hash));
 }
+
+
+TEST(T_Compression, FusedHash) {
+  shash::Any empty_hash(shash::kSha1);
+  EXPECT_TRUE(zlib::CompressMem2Null(NULL, 0, &empty_hash));
+  EXPECT_EQ("e8ec3d88b62ebf526e4e5a4ff6162a3aa48a6b78", empty_hash.ToString());
+
+  // Spans several compression chunks
+  Prng prng;
+  prng.InitSeed(42);
+  string data(5 * zlib::kZChunk + 17, '\0');
+  for (unsigned i = 0; i < data.size(); ++i)
+    data[i] = static_cast<char>(prng.Next(8) + 'a');
+
+  void *compressed;
+  uint64_t compressed_size;
+  ASSERT_TRUE(zlib::CompressMem2Mem(data.data(), data.size(),
+                                    &compressed, &compressed_size));
+  shash::Any expected_hash(shash::kSha1);
+  shash::HashMem(static_cast<unsigned char *>(compressed), compressed_size,
+                 &expected_hash);
+
+  shash::Any hash(shash::kSha1);
+  EXPECT_TRUE(zlib::CompressMem2Null(data.data(), data.size(), &hash));
+  EXPECT_EQ(expected_hash, hash);
+
+  void *fused;
+  uint64_t fused_size;
+  hash = shash::Any(shash::kSha1);
+  ASSERT_TRUE(zlib::CompressMem2Mem(data.data(), data.size(),
+                                    &fused, &fused_size, &hash));
+  EXPECT_EQ(expected_hash, hash);
+  ASSERT_EQ(compressed_size, fused_size);
+  EXPECT_EQ(0, memcmp(compressed, fused, fused_size));
+  free(fused);
+
+  void *decompressed;
+  uint64_t decompressed_size;
+  hash = shash::Any(shash::kSha1);
+  ASSERT_TRUE(zlib::DecompressMem2Mem(compressed, compressed_size,
+                                      &decompressed, &decompressed_size,
+                                      &hash));
+  EXPECT_EQ(expected_hash, hash);
+  EXPECT_EQ(data, string(static_cast<char *>(decompressed),
+                         decompressed_size));
+  free(decompressed);
+
+  // Truncated input
+  EXPECT_FALSE(zlib::DecompressMem2Mem(compressed, compressed_size / 2,
+                                       &decompressed, &decompressed_size,
+                                       &hash));
+  EXPECT_EQ(NULL, decompressed);
+  free(compressed);
+}
+
+
+TEST(T_Compression, Framed) {
+  Prng prng;
+  prng.InitSeed(42);
+  // Compressible first block, incompressible second block, partial last block
+  string data(2 * zlib::kFramedBlockSize + 1000, '\0');
+  for (unsigned i = 0; i < data.size(); ++i) {
+    data[i] = (i / zlib::kFramedBlockSize == 1) ?
+              static_cast<char>(prng.Next(256)) :
+              static_cast<char>(prng.Next(8) + 'a');
+  }
+  string path_plain;
+  string path_framed;
+  FILE *f_plain = CreateTempFile("./cvmfs_ut_framed", 0600, "w+", &path_plain);
+  FILE *f_framed =
+    CreateTempFile("./cvmfs_ut_framed", 0600, "w+", &path_framed);
+  ASSERT_TRUE((f_plain != NULL) && (f_framed != NULL));
+  UnlinkGuard unlink_plain(path_plain);
+  UnlinkGuard unlink_framed(path_framed);
+  const int fd_plain = fileno(f_plain);
+  const int fd_framed = fileno(f_framed);
+  ASSERT_TRUE(SafeWrite(fd_plain, data.data(), data.size()));
+  ASSERT_EQ(0, lseek(fd_plain, 0, SEEK_SET));
+
+  uint64_t framed_size;
+  ASSERT_TRUE(zlib::CompressFd2Framed(fd_plain, fd_framed, &framed_size));
+  EXPECT_LT(framed_size, data.size());
+  EXPECT_EQ(framed_size, static_cast<uint64_t>(GetFileSize(path_framed)));
+  EXPECT_EQ(NULL, zlib::FramedReader::Create(fd_plain));
+
+  UniquePtr<zlib::FramedReader> reader(zlib::FramedReader::Create(fd_framed));
+  ASSERT_TRUE(reader.IsValid());
+  EXPECT_EQ(data.size(), reader->size());
+  string buf(data.size() + 100, '\0');
+  EXPECT_EQ(static_cast<int64_t>(data.size()),
+            reader->Pread(fd_framed, &buf[0], buf.size(), 0));
+  EXPECT_EQ(data, buf.substr(0, data.size()));
+
+  // Small reads and reads across block boundaries
+  UniquePtr<zlib::FramedReader> clone(reader->Clone());
+  const uint64_t offsets[] = {0, 5, zlib::kFramedBlockSize - 10,
+                              2 * zlib::kFramedBlockSize + 990, 7};
+  for (unsigned i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i) {
+    char small[20];
+    const int64_t nbytes =
+      clone->Pread(fd_framed, small, sizeof(small), offsets[i]);
+    const string expected = data.substr(offsets[i], sizeof(small));
+    EXPECT_EQ(static_cast<int64_t>(expected.length()), nbytes);
+    EXPECT_EQ(expected, string(small, nbytes));
+  }
+  EXPECT_EQ(0, reader->Pread(fd_framed, &buf[0], 1, data.size()));
+
+  EXPECT_EQ(0, ftruncate(fd_framed, framed_size - 1));
+  EXPECT_EQ(NULL, zlib::FramedReader::Create(fd_framed));
+  fclose(f_plain);
+  fclose(f_framed);
+}
@@ -4,6 +4,9 @@
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <string>
 
 #include "compression.h"
 #include "util/pointer.h"
@@ -154,4 +157,123 @@ TEST_F(T_Compressor, EchoCompressionLong) {
   EXPECT_EQ(0, memcmp(compress_buf.weak_ref(), long_string, long_size));
 }
 
+
+TEST_F(T_Compressor, AlgorithmNames) {
+  EXPECT_EQ(kZlibDefault, ParseCompressionAlgorithm("default"));
+  EXPECT_EQ(kNoCompression, ParseCompressionAlgorithm("none"));
+  EXPECT_EQ("zstd", AlgorithmName(kZstd));
+  EXPECT_EQ("lz4", AlgorithmName(kLz4));
+  EXPECT_TRUE(IsAlgorithmAvailable(kZlibDefault));
+  EXPECT_TRUE(IsAlgorithmAvailable(kNoCompression));
+  if (IsAlgorithmAvailable(kZstd))
+    EXPECT_EQ(kZstd, ParseCompressionAlgorithm("zstd"));
+  if (IsAlgorithmAvailable(kLz4))
+    EXPECT_EQ(kLz4, ParseCompressionAlgorithm("lz4"));
+}
+
+
+TEST_F(T_Compressor, Decompressor) {
+  UniquePtr<Decompressor> decompressor(Decompressor::Construct(kZlibDefault));
+  ASSERT_TRUE(decompressor.IsValid());
+  EXPECT_EQ(NULL, Decompressor::Construct(kNoCompression));
+}
+
+
+/**
+ * Compresses the input in pieces of piece_size bytes into an output buffer of
+ * out_size bytes.  The compressor is cloned after half of the input and the
+ * clone finishes the stream.
+ */
+static void FrameRoundtrip(
+  const Algorithms alg,
+  const unsigned char *data,
+  const size_t size,
+  const size_t piece_size,
+  const size_t out_size)
+{
+  UniquePtr<Compressor> compressor(Compressor::Construct(alg));
+  ASSERT_TRUE(compressor.IsValid());
+  std::string compressed;
+  unsigned char *out = new unsigned char[out_size];
+  size_t pos = 0;
+  bool cloned = false;
+  bool done = false;
+  while (!done) {
+    if (!cloned && (pos >= size / 2)) {
+      compressor = compressor->Clone();
+      cloned = true;
+    }
+    size_t nbytes = std::min(piece_size, size - pos);
+    unsigned char *in = const_cast<unsigned char *>(data) + pos;
+    const bool flush = (pos + nbytes == size);
+    do {
+      size_t have = out_size;
+      unsigned char *out_ptr = out;
+      EXPECT_LE(1U, compressor->DeflateBound(nbytes));
+      done = compressor->Deflate(flush, &in, &nbytes, &out_ptr, &have);
+      compressed.append(reinterpret_cast<char *>(out), have);
+    } while (!done);
+    pos = in - data;
+    done = flush;
+  }
+  delete[] out;
+
+  void *decompressed;
+  uint64_t decompressed_size;
+  ASSERT_TRUE(DecompressMem2Mem(alg, compressed.data(), compressed.length(),
+                                &decompressed, &decompressed_size));
+  EXPECT_EQ(size, decompressed_size);
+  EXPECT_EQ(0, memcmp(decompressed, data, size));
+  free(decompressed);
+
+  // Streaming decompression in small pieces
+  UniquePtr<Decompressor> decompressor(Decompressor::Construct(alg));
+  ASSERT_TRUE(decompressor.IsValid());
+  FILE *f = tmpfile();
+  ASSERT_TRUE(f != NULL);
+  StreamStates state = kStreamContinue;
+  for (unsigned i = 0; i < compressed.length(); i += 1000) {
+    EXPECT_EQ(kStreamContinue, state);
+    state = decompressor->Inflate2File(compressed.data() + i,
+      std::min(static_cast<size_t>(1000), compressed.length() - i), f);
+  }
+  EXPECT_EQ(kStreamEnd, state);
+  EXPECT_EQ(static_cast<long>(size), ftell(f));  // NOLINT
+  fclose(f);
+
+  // Truncated stream
+  EXPECT_FALSE(DecompressMem2Mem(alg, compressed.data(),
+                                 compressed.length() - 1,
+                                 &decompressed, &decompressed_size));
+}
+
+
+static void FrameRoundtrips(
+  const Algorithms alg,
+  unsigned char *data,
+  const size_t size)
+{
+  for (size_t i = 0; i < size; ++i)
+    data[i] = (i % 7 == 0) ? (i % 251) : 'x';
+  FrameRoundtrip(alg, data, 0, 100, 100);
+  FrameRoundtrip(alg, data, 1, 100, 1);
+  FrameRoundtrip(alg, data, size, size, 1024 * 1024);
+  FrameRoundtrip(alg, data, size, kZChunk, kZChunk);
+  FrameRoundtrip(alg, data, 3 * FrameCompressor::kFrameSize, 4096, 100);
+}
+
+
+#ifdef HAS_ZSTD
+TEST_F(T_Compressor, Zstd) {
+  FrameRoundtrips(kZstd, long_string, long_size / 4);
+}
+#endif
+
+
+#ifdef HAS_LZ4
+TEST_F(T_Compressor, Lz4) {
+  FrameRoundtrips(kLz4, long_string, long_size / 4);
+}
+#endif
+
 }  // end namespace zlib
@@ -0,0 +1,150 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "digest_tree.h"
+#include "hash.h"
+
+using namespace std;  // NOLINT
+
+static const uint32_t kBlockSize = 16;
+
+class T_DigestTree : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    // 3 full blocks and a partial one
+    for (unsigned i = 0; i < 3 * kBlockSize + 5; ++i)
+      content_.push_back(static_cast<char>('a' + (i % 26)));
+  }
+
+  const unsigned char *data(uint64_t offset = 0) const {
+    return reinterpret_cast<const unsigned char *>(content_.data()) + offset;
+  }
+
+  string content_;
+};
+
+
+TEST_F(T_DigestTree, Build) {
+  DigestTree tree(shash::kSha1, kBlockSize);
+  EXPECT_FALSE(tree.finalized());
+  // Pieces that do not match the block boundaries
+  tree.Update(data(), 7);
+  tree.Update(data(7), 20);
+  tree.Update(data(27), content_.length() - 27);
+  tree.Finalize();
+  EXPECT_TRUE(tree.finalized());
+  EXPECT_EQ(4U, tree.num_blocks());
+  EXPECT_EQ(content_.length(), tree.file_size());
+
+  DigestTree tree_oneshot(shash::kSha1, kBlockSize);
+  tree_oneshot.Update(data(), content_.length());
+  tree_oneshot.Finalize();
+  EXPECT_EQ(tree.Serialize(), tree_oneshot.Serialize());
+  EXPECT_EQ(tree.GetRoot(), tree_oneshot.GetRoot());
+
+  DigestTree empty(shash::kSha1, kBlockSize);
+  empty.Finalize();
+  EXPECT_EQ(0U, empty.num_blocks());
+  EXPECT_NE(empty.GetRoot(), tree.GetRoot());
+}
+
+
+TEST_F(T_DigestTree, Copy) {
+  DigestTree tree(shash::kSha1, kBlockSize);
+  tree.Update(data(), 20);
+  // The copy continues from the state of the partial block
+  DigestTree copy(tree);
+  copy.Update(data(20), content_.length() - 20);
+  copy.Finalize();
+  tree.Update(data(20), content_.length() - 20);
+  tree.Finalize();
+  EXPECT_EQ(tree.GetRoot(), copy.GetRoot());
+
+  DigestTree assigned(shash::kMd5, 1);
+  assigned = tree;
+  EXPECT_EQ(tree.GetRoot(), assigned.GetRoot());
+}
+
+
+TEST_F(T_DigestTree, Parse) {
+  DigestTree tree(shash::kRmd160, kBlockSize);
+  tree.Update(data(), content_.length());
+  tree.Finalize();
+  const string serialized = tree.Serialize();
+
+  DigestTree restored(shash::kRmd160, 1);
+  EXPECT_TRUE(restored.Parse(serialized));
+  EXPECT_EQ(tree.GetRoot(), restored.GetRoot());
+  EXPECT_EQ(kBlockSize, restored.block_size());
+  EXPECT_EQ(content_.length(), restored.file_size());
+  EXPECT_TRUE(restored.VerifyRange(0, data(), content_.length()));
+
+  DigestTree other_algorithm(shash::kSha1, kBlockSize);
+  EXPECT_FALSE(other_algorithm.Parse(serialized));
+
+  DigestTree broken(shash::kRmd160, kBlockSize);
+  EXPECT_FALSE(broken.Parse(""));
+  EXPECT_FALSE(broken.Parse("B16\nS10\n"));
+  EXPECT_FALSE(broken.Parse("B0\nS0\n--\n"));
+  // Wrong number of blocks
+  EXPECT_FALSE(broken.Parse("B16\nS17\n--\n"));
+  EXPECT_FALSE(broken.Parse(serialized.substr(0, serialized.length() - 1)));
+  EXPECT_TRUE(broken.Parse("B16\nS0\n--\n"));
+  EXPECT_EQ(0U, broken.num_blocks());
+}
+
+
+TEST_F(T_DigestTree, AlignRange) {
+  DigestTree tree(shash::kSha1, kBlockSize);
+  tree.Update(data(), content_.length());
+  tree.Finalize();
+
+  uint64_t offset;
+  uint64_t size;
+  tree.AlignRange(0, 1, &offset, &size);
+  EXPECT_EQ(0U, offset);
+  EXPECT_EQ(kBlockSize, size);
+  tree.AlignRange(kBlockSize, kBlockSize, &offset, &size);
+  EXPECT_EQ(kBlockSize, offset);
+  EXPECT_EQ(kBlockSize, size);
+  tree.AlignRange(kBlockSize - 1, 2, &offset, &size);
+  EXPECT_EQ(0U, offset);
+  EXPECT_EQ(2 * kBlockSize, size);
+  // Cut at the end of the file
+  tree.AlignRange(3 * kBlockSize + 1, 100, &offset, &size);
+  EXPECT_EQ(3 * kBlockSize, offset);
+  EXPECT_EQ(5U, size);
+  tree.AlignRange(content_.length(), 1, &offset, &size);
+  EXPECT_EQ(content_.length(), offset);
+  EXPECT_EQ(0U, size);
+}
+
+
+TEST_F(T_DigestTree, VerifyRange) {
+  DigestTree tree(shash::kSha1, kBlockSize);
+  tree.Update(data(), content_.length());
+  tree.Finalize();
+
+  EXPECT_TRUE(tree.VerifyRange(0, data(), content_.length()));
+  EXPECT_TRUE(tree.VerifyRange(kBlockSize, data(kBlockSize), kBlockSize));
+  EXPECT_TRUE(tree.VerifyRange(3 * kBlockSize, data(3 * kBlockSize), 5));
+  EXPECT_TRUE(tree.VerifyRange(content_.length(), data(), 0));
+  // Not aligned
+  EXPECT_FALSE(tree.VerifyRange(1, data(1), kBlockSize));
+  EXPECT_FALSE(tree.VerifyRange(0, data(), kBlockSize - 1));
+  EXPECT_FALSE(tree.VerifyRange(3 * kBlockSize, data(3 * kBlockSize), 6));
+  // Wrong data
+  string modified = content_;
+  modified[kBlockSize + 3] = '!';
+  const unsigned char *modified_data =
+    reinterpret_cast<const unsigned char *>(modified.data());
+  EXPECT_TRUE(tree.VerifyRange(0, modified_data, kBlockSize));
+  EXPECT_FALSE(tree.VerifyRange(0, modified_data, 2 * kBlockSize));
+  EXPECT_FALSE(
+    tree.VerifyRange(kBlockSize, modified_data + kBlockSize, kBlockSize));
+}
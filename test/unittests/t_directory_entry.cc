@@ -0,0 +1,134 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "directory_entry.h"
+#include "hash.h"
+#include "lru_md.h"
+#include "statistics.h"
+#include "testutil.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace catalog {
+
+class T_DirectoryEntry : public ::testing::Test {
+ protected:
+  static void ExpectSame(const DirectoryEntry &expected,
+                         const DirectoryEntry &actual)
+  {
+    EXPECT_TRUE(expected == actual);
+    EXPECT_EQ(expected.inode(), actual.inode());
+    EXPECT_EQ(expected.uid(), actual.uid());
+    EXPECT_EQ(expected.gid(), actual.gid());
+    EXPECT_EQ(expected.checksum().algorithm, actual.checksum().algorithm);
+    EXPECT_EQ(expected.checksum().suffix, actual.checksum().suffix);
+    EXPECT_EQ(expected.compression_algorithm(),
+              actual.compression_algorithm());
+    EXPECT_EQ(expected.IsNegative(), actual.IsNegative());
+  }
+
+  static DirectoryEntryCompact Encode(const DirectoryEntry &dirent) {
+    return DirectoryEntryCompact(dirent);
+  }
+};
+
+
+TEST_F(T_DirectoryEntry, CompactRoundTrip) {
+  const string hex = "9ee4cae03ae388070b5b58b9ea901ab0458720c7";
+  const shash::Any hash(shash::kSha1, shash::HexPtr(hex),
+                        shash::kSuffixPartial);
+
+  DirectoryEntry expanded;
+  DirectoryEntry file =
+    DirectoryEntryTestFactory::RegularFile("file", 42, hash);
+  file.set_inode(1000);
+  file.set_hardlink_group(7);
+  file.set_linkcount(3);
+  file.set_has_xattrs(true);
+  Encode(file).Expand(&expanded);
+  ExpectSame(file, expanded);
+  EXPECT_EQ(7U, expanded.hardlink_group());
+  EXPECT_TRUE(expanded.HasXattrs());
+
+  DirectoryEntry dir = DirectoryEntryTestFactory::Directory("dir", 4096,
+                                                            shash::Any(), true);
+  Encode(dir).Expand(&expanded);
+  ExpectSame(dir, expanded);
+  EXPECT_TRUE(expanded.IsNestedCatalogMountpoint());
+  EXPECT_TRUE(expanded.checksum().IsNull());
+
+  const string long_name(300, 'x');
+  const string long_target(2000, 'y');
+  DirectoryEntry link =
+    DirectoryEntryTestFactory::Symlink(long_name, 0, long_target);
+  Encode(link).Expand(&expanded);
+  ExpectSame(link, expanded);
+  EXPECT_EQ(long_target, expanded.symlink().ToString());
+
+  DirectoryEntry empty_name = DirectoryEntryTestFactory::ChunkedFile(hash);
+  Encode(empty_name).Expand(&expanded);
+  ExpectSame(empty_name, expanded);
+  EXPECT_TRUE(expanded.IsChunkedFile());
+
+  DirectoryEntry external = DirectoryEntryTestFactory::ExternalFile();
+  Encode(external).Expand(&expanded);
+  ExpectSame(external, expanded);
+  EXPECT_TRUE(expanded.IsExternalFile());
+
+  DirectoryEntry negative(kDirentNegative);
+  Encode(negative).Expand(&expanded);
+  EXPECT_TRUE(expanded.IsNegative());
+  EXPECT_EQ(kDirentNegative, expanded.GetSpecial());
+}
+
+
+TEST_F(T_DirectoryEntry, CompactCopy) {
+  DirectoryEntryCompact empty;
+  EXPECT_TRUE(empty.IsEmpty());
+
+  DirectoryEntry file = DirectoryEntryTestFactory::RegularFile("file");
+  DirectoryEntryCompact compact(file);
+  EXPECT_FALSE(compact.IsEmpty());
+  DirectoryEntryCompact copy(compact);
+  empty = compact;
+  compact = DirectoryEntryCompact();
+  EXPECT_TRUE(compact.IsEmpty());
+
+  DirectoryEntry expanded;
+  copy.Expand(&expanded);
+  ExpectSame(file, expanded);
+  empty.Expand(&expanded);
+  ExpectSame(file, expanded);
+}
+
+
+TEST_F(T_DirectoryEntry, CompactInCache) {
+  perf::Statistics statistics;
+  lru::InodeCache inode_cache(1024, &statistics);
+  for (unsigned i = 1; i <= 2048; ++i) {
+    DirectoryEntry dirent =
+      DirectoryEntryTestFactory::RegularFile("f" + StringifyInt(i), i);
+    dirent.set_inode(i);
+    inode_cache.Insert(i, dirent);
+  }
+  DirectoryEntry dirent;
+  EXPECT_FALSE(inode_cache.Lookup(1, &dirent));
+  ASSERT_TRUE(inode_cache.Lookup(2048, &dirent));
+  EXPECT_EQ("f2048", dirent.name().ToString());
+  EXPECT_EQ(2048U, dirent.size());
+  inode_cache.Drop();
+  EXPECT_FALSE(inode_cache.Lookup(2048, &dirent));
+
+  lru::Md5PathCache md5path_cache(1024, &statistics);
+  EXPECT_TRUE(md5path_cache.InsertNegative(shash::Md5(shash::AsciiPtr("/n"))));
+  ASSERT_TRUE(md5path_cache.Lookup(shash::Md5(shash::AsciiPtr("/n")), &dirent));
+  EXPECT_TRUE(dirent.IsNegative());
+}
+
+}  // namespace catalog
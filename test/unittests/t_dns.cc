@@ -432,11 +432,13 @@ TEST_F(T_Dns, HostBestAddresses) {
   EXPECT_EQ("10.0.0.1", *host.ViewBestAddresses(kIpPreferSystem).begin());
   EXPECT_EQ("10.0.0.1", *host.ViewBestAddresses(kIpPreferV4).begin());
   EXPECT_EQ("10.0.0.1", *host.ViewBestAddresses(kIpPreferV6).begin());
+  EXPECT_EQ("10.0.0.1", *host.ViewBestAddresses(kIpPreferRace).begin());
 
   host.ipv6_addresses_.insert("[::1]");
   EXPECT_EQ("10.0.0.1", *host.ViewBestAddresses(kIpPreferSystem).begin());
   EXPECT_EQ("10.0.0.1", *host.ViewBestAddresses(kIpPreferV4).begin());
   EXPECT_EQ("[::1]", *host.ViewBestAddresses(kIpPreferV6).begin());
+  EXPECT_EQ("[::1]", *host.ViewBestAddresses(kIpPreferRace).begin());
 
   host.ipv4_addresses_.clear();
   EXPECT_EQ("[::1]", *host.ViewBestAddresses(kIpPreferSystem).begin());
@@ -1001,4 +1003,57 @@ TEST_F(T_Dns, NormalResolverCombinedSlow) {
               (hosts[5].status() == kFailTimeout));
 }
 
+
+
+TEST_F(T_Dns, NormalResolverSharedCache) {
+  UniquePtr<NormalResolver> resolver(NormalResolver::Create(false, 0, 100));
+  ASSERT_TRUE(resolver.IsValid());
+  vector<string> no_resolvers;
+  no_resolvers.push_back("127.0.0.2");
+  resolver->SetResolvers(no_resolvers);
+  const string cache_dir = CreateTempDir("./cvmfs_ut_dns_cache");
+  ASSERT_FALSE(cache_dir.empty());
+  EXPECT_TRUE(resolver->SetSharedCacheDir(cache_dir + "/dnscache"));
+  EXPECT_EQ(cache_dir + "/dnscache", resolver->shared_cache_dir());
+
+  const time_t now = time(NULL);
+  EXPECT_TRUE(SafeWriteToFile(StringifyInt(now + 600) + "\n0\n" +
+                              "cached.example.org\n4 10.0.0.1\n6 ::1\n",
+                              cache_dir + "/dnscache/cached.example.org",
+                              0600));
+  EXPECT_TRUE(SafeWriteToFile(StringifyInt(now - 1) + "\n0\n" +
+                              "expired.example.org\n4 10.0.0.2\n",
+                              cache_dir + "/dnscache/expired.example.org",
+                              0600));
+  Host host = resolver->Resolve("cached.example.org");
+  ExpectResolvedName(host, "cached.example.org", "10.0.0.1", "[::1]");
+  EXPECT_LE(host.deadline(), now + 601);
+  host = resolver->Resolve("expired.example.org");
+  EXPECT_NE(kFailOk, host.status());
+
+  vector<string> ipv4_addresses;
+  ipv4_addresses.push_back("10.0.0.3");
+  resolver->StoreSharedCache("stored.example.org", ipv4_addresses,
+                             vector<string>(), 3600, "stored.example.org");
+  host = resolver->Resolve("stored.example.org");
+  ExpectResolvedName(host, "stored.example.org", "10.0.0.3", "");
+
+  // Entries of IPv4-only resolvers do not serve resolvers that ask for IPv6
+  UniquePtr<NormalResolver> ipv4_only(NormalResolver::Create(true, 0, 100));
+  ASSERT_TRUE(ipv4_only.IsValid());
+  ipv4_only->SetResolvers(no_resolvers);
+  EXPECT_TRUE(ipv4_only->SetSharedCacheDir(cache_dir + "/dnscache"));
+  ipv4_addresses[0] = "10.0.0.4";
+  ipv4_only->StoreSharedCache("ipv4.example.org", ipv4_addresses,
+                              vector<string>(), 3600, "ipv4.example.org");
+  host = ipv4_only->Resolve("ipv4.example.org");
+  ExpectResolvedName(host, "ipv4.example.org", "10.0.0.4", "");
+  host = ipv4_only->Resolve("cached.example.org");
+  ExpectResolvedName(host, "cached.example.org", "10.0.0.1", "");
+  host = resolver->Resolve("ipv4.example.org");
+  EXPECT_NE(kFailOk, host.status());
+
+  RemoveTree(cache_dir);
+}
+
 }  // namespace dns
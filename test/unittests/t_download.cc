@@ -4,18 +4,26 @@
 
 #include "gtest/gtest.h"
 
+#include <fcntl.h>
 #include <unistd.h>
 
 #include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <vector>
 
 #include "compression.h"
 #include "download.h"
 #include "hash.h"
+#include "platform.h"
 #include "prng.h"
 #include "sink.h"
 #include "statistics.h"
+#include "util/async.h"
 #include "util/file_guard.h"
 #include "util/posix.h"
+#include "util/string.h"
 
 using namespace std;  // NOLINT
 
@@ -149,6 +157,247 @@ TEST_F(T_Download, Multiple) {
 }
 
 
+TEST_F(T_Download, Http2) {
+  download_mgr.EnableHttp2(DownloadManager::kHttp2DefaultMaxHostConnections);
+  DownloadManager *download_mgr_cloned = download_mgr.Clone(
+    perf::StatisticsTemplate("x", &statistics));
+  download_mgr_cloned->Spawn();
+
+  string dest_path;
+  FILE *fdest = CreateTemporaryFile(&dest_path);
+  ASSERT_TRUE(fdest != NULL);
+  UnlinkGuard unlink_guard(dest_path);
+  JobInfo info(&foo_url, false /* compressed */, false /* probe hosts */,
+               fdest,  NULL);
+  download_mgr.Fetch(&info);
+  EXPECT_EQ(kFailOk, info.error_code);
+  JobInfo info2(&foo_url, false /* compressed */, false /* probe hosts */,
+                fdest,  NULL);
+  download_mgr_cloned->Fetch(&info2);
+  EXPECT_EQ(kFailOk, info2.error_code);
+  fclose(fdest);
+
+  // Local files are not counted as HTTP transfers
+  EXPECT_EQ(2, statistics.Lookup("test.n_requests")->Get() +
+               statistics.Lookup("x.n_requests")->Get());
+  EXPECT_EQ(0, statistics.Lookup("test.n_requests_http1")->Get());
+  EXPECT_EQ(0, statistics.Lookup("test.n_requests_http2")->Get());
+  EXPECT_EQ(0, statistics.Lookup("x.n_requests_http2")->Get());
+
+  download_mgr_cloned->Fini();
+  delete download_mgr_cloned;
+}
+
+
+class JobCounter {
+ public:
+  JobCounter() : num_done(0), num_failed(0) { }
+  void OnJobDone(JobInfo * const &info) {
+    num_done++;
+    if (info->error_code != kFailOk)
+      num_failed++;
+  }
+  unsigned num_done;
+  unsigned num_failed;
+};
+
+
+TEST_F(T_Download, FetchMany) {
+  // More jobs than pooled handles, so that the I/O thread needs to queue
+  const unsigned kNumFiles = 50;
+  vector<string> paths;
+  vector<string> urls;
+  vector<shash::Any> hashes;
+  for (unsigned i = 0; i < kNumFiles; ++i) {
+    string path;
+    FILE *f = CreateTemporaryFile(&path);
+    ASSERT_TRUE(f != NULL);
+    const string content = StringifyInt(i);
+    EXPECT_EQ(content.length(), fwrite(content.data(), 1, content.length(), f));
+    fclose(f);
+    paths.push_back(path);
+    urls.push_back("file://" + path);
+    shash::Any hash(shash::kSha1);
+    shash::HashString(content, &hash);
+    hashes.push_back(hash);
+  }
+  // The last one cannot be found
+  urls[kNumFiles - 1] += ".missing";
+
+  DownloadManager *download_mgr_cloned = download_mgr.Clone(
+    perf::StatisticsTemplate("x", &statistics));
+  download_mgr_cloned->Spawn();
+  DownloadManager *managers[] = {&download_mgr, download_mgr_cloned};
+  for (unsigned m = 0; m < 2; ++m) {
+    vector<JobInfo *> infos;
+    for (unsigned i = 0; i < kNumFiles; ++i) {
+      infos.push_back(new JobInfo(&urls[i], false /* compressed */,
+                                  false /* probe hosts */, &hashes[i]));
+    }
+    JobCounter counter;
+    BoundCallback<JobInfo *, JobCounter> on_done(&JobCounter::OnJobDone,
+                                                 &counter);
+    EXPECT_FALSE(managers[m]->FetchMany(infos, &on_done));
+    EXPECT_EQ(kNumFiles, counter.num_done);
+    EXPECT_EQ(1U, counter.num_failed);
+    for (unsigned i = 0; i < kNumFiles - 1; ++i) {
+      EXPECT_EQ(kFailOk, infos[i]->error_code);
+      EXPECT_EQ(StringifyInt(i), string(infos[i]->destination_mem.data,
+                                        infos[i]->destination_mem.pos));
+      EXPECT_EQ(NULL, infos[i]->batch);
+      free(infos[i]->destination_mem.data);
+    }
+    EXPECT_NE(kFailOk, infos[kNumFiles - 1]->error_code);
+    EXPECT_EQ(NULL, infos[kNumFiles - 1]->destination_mem.data);
+    for (unsigned i = 0; i < kNumFiles; ++i)
+      delete infos[i];
+
+    // Empty batch
+    EXPECT_TRUE(managers[m]->FetchMany(vector<JobInfo *>(), NULL));
+  }
+  download_mgr_cloned->Fini();
+  delete download_mgr_cloned;
+
+  for (unsigned i = 0; i < kNumFiles; ++i)
+    unlink(paths[i].c_str());
+}
+
+
+TEST_F(T_Download, DataWorkers) {
+  const unsigned kNumFiles = 20;
+  // Larger than a single curl data chunk
+  const unsigned kFileSize = 256 * 1024;
+  Prng prng;
+  prng.InitSeed(42);
+  vector<string> paths;
+  vector<string> urls;
+  vector<string> contents;
+  vector<shash::Any> hashes;
+  for (unsigned i = 0; i < kNumFiles; ++i) {
+    string content(kFileSize, '\0');
+    for (unsigned j = 0; j < kFileSize; ++j)
+      content[j] = static_cast<char>(prng.Next(16) + 'a');
+    string path;
+    FILE *f = CreateTemporaryFile(&path);
+    ASSERT_TRUE(f != NULL);
+    shash::Any hash(shash::kSha1);
+    EXPECT_TRUE(zlib::CompressMem2File(
+      reinterpret_cast<const unsigned char *>(content.data()), content.size(),
+      f, &hash));
+    fclose(f);
+    paths.push_back(path);
+    urls.push_back("file://" + path);
+    contents.push_back(content);
+    hashes.push_back(hash);
+  }
+  // The last one has a wrong hash
+  hashes[kNumFiles - 1].Randomize(1);
+
+  download_mgr.EnableDataWorkers(3);
+  DownloadManager *download_mgr_cloned = download_mgr.Clone(
+    perf::StatisticsTemplate("x", &statistics));
+  download_mgr_cloned->Spawn();
+
+  vector<string> dest_paths;
+  for (unsigned i = 0; i < kNumFiles; ++i)
+    dest_paths.push_back(paths[i] + ".dest");
+  vector<JobInfo *> infos;
+  for (unsigned i = 0; i < kNumFiles; ++i) {
+    infos.push_back(new JobInfo(&urls[i], true /* compressed */,
+                                false /* probe hosts */, &dest_paths[i],
+                                &hashes[i]));
+  }
+  JobCounter counter;
+  BoundCallback<JobInfo *, JobCounter> on_done(&JobCounter::OnJobDone,
+                                               &counter);
+  EXPECT_FALSE(download_mgr_cloned->FetchMany(infos, &on_done));
+  EXPECT_EQ(kNumFiles, counter.num_done);
+  EXPECT_EQ(1U, counter.num_failed);
+  for (unsigned i = 0; i < kNumFiles - 1; ++i) {
+    EXPECT_EQ(kFailOk, infos[i]->error_code);
+    string data;
+    int fd = open(dest_paths[i].c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    EXPECT_TRUE(SafeReadToString(fd, &data));
+    close(fd);
+    EXPECT_EQ(contents[i], data);
+  }
+  EXPECT_NE(kFailOk, infos[kNumFiles - 1]->error_code);
+
+  // Sink destination through Fetch()
+  TestSink test_sink;
+  JobInfo info(&urls[0], true /* compressed */, false /* probe hosts */,
+               &test_sink, &hashes[0]);
+  EXPECT_EQ(kFailOk, download_mgr_cloned->Fetch(&info));
+  EXPECT_EQ(static_cast<int64_t>(kFileSize), GetFileSize(test_sink.path));
+
+  download_mgr_cloned->Fini();
+  delete download_mgr_cloned;
+  for (unsigned i = 0; i < kNumFiles; ++i) {
+    delete infos[i];
+    unlink(paths[i].c_str());
+    unlink(dest_paths[i].c_str());
+  }
+}
+
+
+TEST_F(T_Download, Striped) {
+  const unsigned kFileSize = 2 * DownloadManager::kStripeSize + 1000;
+  Prng prng;
+  prng.InitSeed(42);
+  string content(kFileSize, '\0');
+  for (unsigned i = 0; i < kFileSize; ++i)
+    content[i] = static_cast<char>(prng.Next(256));
+  string path;
+  FILE *f = CreateTemporaryFile(&path);
+  ASSERT_TRUE(f != NULL);
+  UnlinkGuard unlink_guard(path);
+  ASSERT_EQ(kFileSize, fwrite(content.data(), 1, kFileSize, f));
+  fclose(f);
+  const string url = "file://" + path;
+  shash::Any hash(shash::kSha1);
+  shash::HashString(content, &hash);
+
+  download_mgr.EnableStriping(2, 0);
+  DownloadManager *download_mgr_cloned = download_mgr.Clone(
+    perf::StatisticsTemplate("x", &statistics));
+  download_mgr_cloned->Spawn();
+
+  TestSink test_sink;
+  JobInfo info(&url, false /* compressed */, false /* probe hosts */,
+               &test_sink, &hash);
+  info.range_size = kFileSize;
+  EXPECT_EQ(kFailOk, download_mgr_cloned->Fetch(&info));
+  string data;
+  EXPECT_EQ(0, lseek(test_sink.fd, 0, SEEK_SET));
+  EXPECT_TRUE(SafeReadToString(test_sink.fd, &data));
+  EXPECT_EQ(content, data);
+  EXPECT_EQ(1, statistics.Lookup("x.n_striped")->Get());
+  EXPECT_EQ(0, statistics.Lookup("x.n_striped_fallback")->Get());
+
+  // Falls back to a single transfer if the ranges do not match the hash.  The
+  // single transfer retries without cache and then reports a host failure.
+  shash::Any wrong_hash(hash);
+  wrong_hash.Randomize(1);
+  TestSink test_sink_fallback;
+  JobInfo info_fallback(&url, false, false, &test_sink_fallback, &wrong_hash);
+  info_fallback.range_size = kFileSize;
+  EXPECT_EQ(kFailHostHttp, download_mgr_cloned->Fetch(&info_fallback));
+  EXPECT_EQ(2, statistics.Lookup("x.n_striped")->Get());
+  EXPECT_EQ(1, statistics.Lookup("x.n_striped_fallback")->Get());
+
+  // Too small for striping
+  TestSink test_sink_small;
+  JobInfo info_small(&url, false, false, &test_sink_small, &hash);
+  info_small.range_size = DownloadManager::kStripeSize;
+  EXPECT_EQ(kFailOk, download_mgr_cloned->Fetch(&info_small));
+  EXPECT_EQ(2, statistics.Lookup("x.n_striped")->Get());
+
+  download_mgr_cloned->Fini();
+  delete download_mgr_cloned;
+}
+
+
 TEST_F(T_Download, LocalFile2Mem) {
   string dest_path;
   FILE *fdest = CreateTemporaryFile(&dest_path);
@@ -167,6 +416,29 @@ TEST_F(T_Download, LocalFile2Mem) {
 }
 
 
+TEST_F(T_Download, IfModifiedSince) {
+  platform_stat64 info_foo;
+  ASSERT_EQ(0, platform_stat(foo_path.c_str(), &info_foo));
+
+  JobInfo info(&foo_url, false /* compressed */, false /* probe hosts */, NULL);
+  download_mgr.Fetch(&info);
+  ASSERT_EQ(kFailOk, info.error_code);
+  EXPECT_EQ(info_foo.st_mtime, info.last_modified);
+
+  JobInfo info_unmodified(&foo_url, false, false, NULL);
+  info_unmodified.if_modified_since = info_foo.st_mtime + 60;
+  download_mgr.Fetch(&info_unmodified);
+  EXPECT_EQ(kFailNotModified, info_unmodified.error_code);
+  EXPECT_EQ(NULL, info_unmodified.destination_mem.data);
+
+  JobInfo info_modified(&foo_url, false, false, NULL);
+  info_modified.if_modified_since = info_foo.st_mtime - 60;
+  download_mgr.Fetch(&info_modified);
+  EXPECT_EQ(kFailOk, info_modified.error_code);
+  free(info_modified.destination_mem.data);
+}
+
+
 TEST_F(T_Download, LocalFile2Sink) {
   string dest_path;
   FILE *fdest = CreateTemporaryFile(&dest_path);
@@ -291,6 +563,37 @@ TEST_F(T_Download, ValidateGeoReply) {
 }
 
 
+TEST_F(T_Download, GeoCache) {
+  const string cache_dir = GetCurrentWorkingDirectory() + "/cvmfs_ut_geocache";
+  const string path = cache_dir + "/geo.test";
+  vector<uint64_t> geo_order;
+  EXPECT_FALSE(download_mgr.LoadGeoOrder(path, 60, 2, &geo_order));
+  download_mgr.StoreGeoOrder(path, "2,1\n");
+  EXPECT_TRUE(download_mgr.LoadGeoOrder(path, 60, 2, &geo_order));
+  ASSERT_EQ(2U, geo_order.size());
+  EXPECT_EQ(1U, geo_order[0]);
+  EXPECT_EQ(0U, geo_order[1]);
+  // Different number of servers or expired
+  EXPECT_FALSE(download_mgr.LoadGeoOrder(path, 60, 3, &geo_order));
+  EXPECT_FALSE(download_mgr.LoadGeoOrder(path, 0, 2, &geo_order));
+
+  // Without any reachable stratum 1, the cached order is used
+  download_mgr.EnableGeoCache(cache_dir, 60);
+  vector<string> servers;
+  servers.push_back("http://s1.cern.ch/cvmfs/@fqrn@");
+  servers.push_back("http://s2.cern.ch/cvmfs/@fqrn@");
+  EXPECT_FALSE(download_mgr.GeoSortServers(&servers));
+  const string key = "s1.cern.ch,s2.cern.ch|" + download_mgr.GetProxyList();
+  download_mgr.StoreGeoOrder(
+    cache_dir + "/geo." + shash::Md5(key.data(), key.length()).ToString(),
+    "2,1");
+  EXPECT_TRUE(download_mgr.GeoSortServers(&servers));
+  EXPECT_EQ("http://s2.cern.ch/cvmfs/@fqrn@", servers[0]);
+  EXPECT_EQ("http://s1.cern.ch/cvmfs/@fqrn@", servers[1]);
+  RemoveTree(cache_dir);
+}
+
+
 TEST_F(T_Download, ParseHttpCode) {
   char digits[3];
   digits[0] = '0';  digits[1] = '0';  digits[2] = 'a';
@@ -305,4 +608,195 @@ TEST_F(T_Download, ParseHttpCode) {
   EXPECT_EQ(999, DownloadManager::ParseHttpCode(digits));
 }
 
+
+
+static DownloadManager::ProxyInfo *FindProxy(
+  vector<DownloadManager::ProxyInfo> *group,
+  const string &url)
+{
+  for (unsigned i = 0; i < group->size(); ++i) {
+    if ((*group)[i].url == url)
+      return &((*group)[i]);
+  }
+  return NULL;
+}
+
+
+TEST_F(T_Download, EndpointScore) {
+  DownloadManager::EndpointScore score;
+  EXPECT_EQ("unscored", score.Print());
+  score.Add(100.0, 0.0);
+  EXPECT_EQ(1U, score.num_samples);
+  EXPECT_DOUBLE_EQ(100.0, score.latency_ms);
+  EXPECT_DOUBLE_EQ(100.0, score.Cost());
+  score.Add(20.0, 1024.0 * 1024.0);
+  EXPECT_DOUBLE_EQ(90.0, score.latency_ms);
+  EXPECT_DOUBLE_EQ(1024.0 * 1024.0, score.throughput);
+  EXPECT_DOUBLE_EQ(90.0 + 125.0, score.Cost());
+  EXPECT_EQ("90 ms, 1024 kB/s", score.Print());
+}
+
+
+TEST_F(T_Download, IpFamilyRace) {
+  download_mgr.SetIpPreference(dns::kIpPreferRace);
+  // Single-stack proxies are still used by their addresses
+  download_mgr.SetProxyChain("http://127.0.0.1:3128", "",
+                             DownloadManager::kSetProxyRegular);
+  ASSERT_EQ(1U, (*download_mgr.opt_proxy_groups_)[0].size());
+  EXPECT_EQ("http://127.0.0.1:3128",
+            (*download_mgr.opt_proxy_groups_)[0][0].url);
+
+  const string endpoint = "http://proxy.example.com:3128";
+  EXPECT_FALSE(download_mgr.IsIpv4PinnedUnlocked(endpoint));
+  download_mgr.ipv4_pinned_[endpoint] = time(NULL) + 60;
+  EXPECT_TRUE(download_mgr.IsIpv4PinnedUnlocked(endpoint));
+  // Expired entries are raced again
+  download_mgr.ipv4_pinned_[endpoint] = time(NULL) - 1;
+  EXPECT_FALSE(download_mgr.IsIpv4PinnedUnlocked(endpoint));
+  EXPECT_TRUE(download_mgr.ipv4_pinned_.empty());
+}
+
+
+TEST_F(T_Download, SteerProxy) {
+  download_mgr.SetProxyChain(
+    "http://127.0.0.1:3128|http://127.0.0.2:3128|http://127.0.0.3:3128", "",
+    DownloadManager::kSetProxyRegular);
+  vector<DownloadManager::ProxyInfo> *group =
+    &((*download_mgr.opt_proxy_groups_)[0]);
+  ASSERT_EQ(3U, group->size());
+  const string slow = (*group)[0].url;
+  const string fast = (*group)[1].url;
+  for (unsigned i = 0; i < DownloadManager::kMinScoreSamples; ++i) {
+    download_mgr.opt_proxy_scores_[slow].Add(100.0, 0.0);
+    download_mgr.opt_proxy_scores_[fast].Add(10.0, 0.0);
+  }
+
+  download_mgr.EnableAdaptiveProxies();
+  download_mgr.SteerProxyUnlocked();
+  EXPECT_EQ(fast, (*group)[0].url);
+
+  vector< vector<DownloadManager::ProxyInfo> > proxy_chain;
+  download_mgr.GetProxyInfo(&proxy_chain, NULL, NULL);
+  EXPECT_EQ(DownloadManager::kMinScoreSamples,
+            proxy_chain[0][0].score.num_samples);
+  EXPECT_NE(string::npos, proxy_chain[0][0].Print().find("[10 ms]"));
+
+  // Within the threshold, the active proxy stays
+  for (unsigned i = 0; i < 100; ++i)
+    download_mgr.opt_proxy_scores_[slow].Add(12.0, 0.0);
+  swap((*group)[0], *FindProxy(group, slow));
+  download_mgr.SteerProxyUnlocked();
+  EXPECT_EQ(slow, (*group)[0].url);
+
+  // Failed proxies are not considered
+  for (unsigned i = 0; i < 100; ++i)
+    download_mgr.opt_proxy_scores_[slow].Add(100.0, 0.0);
+  download_mgr.opt_proxy_groups_current_burned_ = 3;
+  swap(*FindProxy(group, fast), (*group)[2]);
+  download_mgr.SteerProxyUnlocked();
+  EXPECT_EQ(slow, (*group)[0].url);
+}
+
+
+TEST_F(T_Download, HedgeDelay) {
+  download_mgr.EnableHedgedRequests(10);
+  string url = "/data/xy";
+  JobInfo info(&url, false);
+  info.head_request = false;
+
+  // Too few samples
+  for (unsigned i = 0; i < DownloadManager::kHedgeSamples - 1; ++i)
+    download_mgr.UpdateHedgeDelayUnlocked(static_cast<double>(i));
+  download_mgr.ScheduleHedge(&info);
+  EXPECT_EQ(0U, info.hedge_deadline_ms);
+
+  download_mgr.UpdateHedgeDelayUnlocked(
+    static_cast<double>(DownloadManager::kHedgeSamples - 1));
+  EXPECT_EQ(static_cast<int32_t>(DownloadManager::kHedgeSamples *
+                                 DownloadManager::kHedgePercentile / 100 + 1),
+            atomic_read32(&download_mgr.hedge_delay_ms_));
+  download_mgr.ScheduleHedge(&info);
+  EXPECT_GT(info.hedge_deadline_ms, 0U);
+
+  JobInfo head_info(&url, false);
+  download_mgr.ScheduleHedge(&head_info);
+  EXPECT_EQ(0U, head_info.hedge_deadline_ms);
+
+  // The hedge goes through another proxy of the group
+  download_mgr.SetProxyChain("http://127.0.0.1:3128|http://127.0.0.2:3128", "",
+                             DownloadManager::kSetProxyRegular);
+  info.proxy = (*download_mgr.opt_proxy_groups_)[0][0].url;
+  JobInfo hedge(&url, false);
+  hedge.head_request = false;
+  download_mgr.InitializeRequest(&hedge, download_mgr.AcquireCurlHandle());
+  EXPECT_TRUE(download_mgr.SetHedgeUrlOptions(&hedge, &info));
+  EXPECT_EQ((*download_mgr.opt_proxy_groups_)[0][1].url, hedge.proxy);
+  download_mgr.ReleaseCurlHandle(hedge.curl_handle);
+  download_mgr.header_lists_->PutList(hedge.headers);
+
+  // Nothing to hedge to without proxies and with a single host
+  download_mgr.SetProxyChain("DIRECT", "", DownloadManager::kSetProxyRegular);
+  info.proxy = "DIRECT";
+  download_mgr.InitializeRequest(&hedge, download_mgr.AcquireCurlHandle());
+  EXPECT_FALSE(download_mgr.SetHedgeUrlOptions(&hedge, &info));
+  download_mgr.ReleaseCurlHandle(hedge.curl_handle);
+  download_mgr.header_lists_->PutList(hedge.headers);
+}
+
+
+TEST_F(T_Download, Priorities) {
+  // Every class can use at least one handle
+  EXPECT_EQ(0U, download_mgr.GetReservedHandles(kPriorityPrefetch, 1));
+  EXPECT_EQ(1U, download_mgr.GetReservedHandles(kPriorityPrefetch, 2));
+  EXPECT_EQ(1U, download_mgr.GetReservedHandles(kPriorityInteractive, 2));
+  EXPECT_EQ(0U, download_mgr.GetReservedHandles(kPriorityMetadata, 2));
+
+  EXPECT_EQ(0U, download_mgr.GetReservedHandles(kPriorityMetadata, 16));
+  EXPECT_EQ(2U, download_mgr.GetReservedHandles(kPriorityInteractive, 16));
+  EXPECT_EQ(4U, download_mgr.GetReservedHandles(kPriorityBulk, 16));
+  EXPECT_EQ(8U, download_mgr.GetReservedHandles(kPriorityPrefetch, 16));
+
+  string url = "/data/xy";
+  JobInfo bulk(&url, false);
+  bulk.priority = kPriorityBulk;
+  bulk.uid = 1;
+  download_mgr.QueueJob(&bulk);
+  EXPECT_EQ(1U, download_mgr.queued_jobs_[0][0].size());
+  download_mgr.queued_jobs_[0].clear();
+
+  download_mgr.EnablePriorities();
+  download_mgr.QueueJob(&bulk);
+  EXPECT_TRUE(download_mgr.queued_jobs_[0].empty());
+  EXPECT_EQ(1U, download_mgr.queued_jobs_[kPriorityBulk][0].size());
+  download_mgr.queued_jobs_[kPriorityBulk].clear();
+  download_mgr.num_queued_jobs_ = 0;
+}
+
+TEST_F(T_Download, Degraded) {
+  download_mgr.SetHostChain("http://a.example.org;http://b.example.org");
+  download_mgr.SetProxyChain("DIRECT", "", DownloadManager::kSetProxyRegular);
+  EXPECT_FALSE(download_mgr.IsDegraded());
+  for (unsigned i = 0; i < CircuitBreakers::kDefaultFailureThreshold; ++i)
+    download_mgr.breakers_.ReportFailure("a.example.org");
+  EXPECT_FALSE(download_mgr.IsDegraded());
+  for (unsigned i = 0; i < CircuitBreakers::kDefaultFailureThreshold; ++i)
+    download_mgr.breakers_.ReportFailure("b.example.org");
+  EXPECT_TRUE(download_mgr.IsDegraded());
+
+  // All the proxies are unreachable
+  download_mgr.breakers_.Reset();
+  download_mgr.SetProxyChain("http://127.0.0.1:3128|http://127.0.0.2:3128", "",
+                             DownloadManager::kSetProxyRegular);
+  EXPECT_FALSE(download_mgr.IsDegraded());
+  const vector<DownloadManager::ProxyInfo> &group =
+    (*download_mgr.opt_proxy_groups_)[0];
+  for (unsigned i = 0; i < CircuitBreakers::kDefaultFailureThreshold; ++i) {
+    for (unsigned j = 0; j < group.size(); ++j)
+      download_mgr.breakers_.ReportFailure(group[j].url);
+  }
+  EXPECT_TRUE(download_mgr.IsDegraded());
+  download_mgr.breakers_.Reset();
+  EXPECT_FALSE(download_mgr.IsDegraded());
+}
+
 }  // namespace download
@@ -197,4 +197,101 @@ TEST(T_Encrypt, Aes_256_Cbc_Iv) {
   }
 }
 
+
+TEST(T_Encrypt, Aes_256_Ctr) {
+  CipherAes256Ctr cipher;
+  UniquePtr<Key> k(Key::CreateRandomly(cipher.key_size()));
+  ASSERT_TRUE(k.IsValid());
+
+  string empty;
+  string dummy = "Hello, World!";
+  string ciphertext;
+  string ciphertext_two;
+  string plaintext;
+  bool retval;
+
+  retval = cipher.Encrypt(empty, *k, &ciphertext);
+  EXPECT_TRUE(retval);
+  EXPECT_EQ(CipherAes256Ctr::kHeaderSize, ciphertext.size());
+  retval = Cipher::Decrypt(ciphertext, *k, &plaintext);
+  EXPECT_TRUE(retval);
+  EXPECT_EQ(empty, plaintext);
+
+  retval = cipher.Encrypt(dummy, *k, &ciphertext);
+  EXPECT_TRUE(retval);
+  EXPECT_EQ(CipherAes256Ctr::kHeaderSize + dummy.size(), ciphertext.size());
+  retval = cipher.Encrypt(dummy, *k, &ciphertext_two);
+  EXPECT_TRUE(retval);
+  EXPECT_NE(ciphertext, ciphertext_two);
+  retval = Cipher::Decrypt(ciphertext, *k, &plaintext);
+  EXPECT_TRUE(retval);
+  EXPECT_EQ(dummy, plaintext);
+
+  retval = Cipher::Decrypt(ciphertext.substr(0, 1 + cipher.iv_size() - 1),
+                           *k, &plaintext);
+  EXPECT_EQ("", plaintext);
+}
+
+
+TEST(T_Encrypt, Stream) {
+  UniquePtr<Key> k(Key::CreateRandomly(CipherAes256Ctr::kKeySize));
+  ASSERT_TRUE(k.IsValid());
+  UniquePtr<Key> k_bad(Key::CreateRandomly(1));
+  ASSERT_TRUE(k_bad.IsValid());
+  EXPECT_EQ(NULL, StreamEncryptor::Create(*k_bad));
+
+  string plaintext(100000, '\0');
+  for (unsigned i = 0; i < plaintext.size(); ++i)
+    plaintext[i] = i % 251;
+
+  // Encrypt in place in odd-sized pieces
+  UniquePtr<StreamEncryptor> encryptor(StreamEncryptor::Create(*k));
+  ASSERT_TRUE(encryptor.IsValid());
+  string ciphertext = plaintext;
+  for (unsigned pos = 0; pos < ciphertext.size(); pos += 777) {
+    const unsigned size =
+      std::min(777U, static_cast<unsigned>(ciphertext.size()) - pos);
+    unsigned char *piece = reinterpret_cast<unsigned char *>(&ciphertext[pos]);
+    encryptor->Update(piece, size, piece);
+  }
+  EXPECT_NE(plaintext, ciphertext);
+  ciphertext = encryptor->header() + ciphertext;
+
+  string result;
+  EXPECT_TRUE(Cipher::Decrypt(ciphertext, *k, &result));
+  EXPECT_EQ(plaintext, result);
+
+  // Decrypt in small pieces that split the header, too
+  StreamDecryptor decryptor(k.weak_ref());
+  for (unsigned round = 0; round < 2; ++round) {
+    result.clear();
+    unsigned pos = 0;
+    while (pos < ciphertext.size()) {
+      const unsigned size = std::min(5 + pos % 13,
+        static_cast<unsigned>(ciphertext.size()) - pos);
+      const unsigned char *piece;
+      size_t piece_size;
+      ASSERT_TRUE(decryptor.Update(ciphertext.data() + pos, size,
+                                   &piece, &piece_size));
+      result.append(reinterpret_cast<const char *>(piece), piece_size);
+      pos += size;
+    }
+    EXPECT_EQ(plaintext, result);
+    decryptor.Reset();
+  }
+
+  const unsigned char *piece;
+  size_t piece_size;
+  StreamDecryptor decryptor_bad(k_bad.weak_ref());
+  EXPECT_FALSE(decryptor_bad.Update(ciphertext.data(), ciphertext.size(),
+                                    &piece, &piece_size));
+  string cbc_ciphertext;
+  CipherAes256Cbc cbc;
+  EXPECT_TRUE(cbc.Encrypt("Hello, World!", *k, &cbc_ciphertext));
+  StreamDecryptor decryptor_cbc(k.weak_ref());
+  EXPECT_FALSE(decryptor_cbc.Update(cbc_ciphertext.data(),
+                                    cbc_ciphertext.size(),
+                                    &piece, &piece_size));
+}
+
 }  // namespace cipher
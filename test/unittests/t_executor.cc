@@ -0,0 +1,142 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <set>
+#include <vector>
+
+#include "atomic.h"
+#include "util/executor.h"
+#include "util/work_stealing.h"
+
+using namespace std;  // NOLINT
+
+TEST(T_Executor, QueueStealing) {
+  WorkStealingQueue<int> queue(4, 100);
+  for (int i = 0; i < 10; ++i)
+    queue.Push(i);
+  EXPECT_EQ(10U, queue.GetItemCount());
+
+  // A single consumer gets all the items, also the ones from the other lanes
+  set<int> items;
+  for (int i = 0; i < 10; ++i)
+    items.insert(queue.Pop(2));
+  EXPECT_EQ(10U, items.size());
+  EXPECT_EQ(0, *items.begin());
+  EXPECT_EQ(9, *items.rbegin());
+  EXPECT_EQ(0U, queue.GetItemCount());
+}
+
+
+TEST(T_Executor, QueueBatchAndDrop) {
+  WorkStealingQueue<int> queue(3, 4);
+  vector<int> batch;
+  for (int i = 0; i < 7; ++i)
+    batch.push_back(i);
+  // A batch can exceed the maximal length
+  queue.PushBatch(batch);
+  queue.PushBatch(vector<int>());
+  EXPECT_EQ(7U, queue.GetItemCount());
+  EXPECT_EQ(7U, queue.Drop());
+  EXPECT_EQ(0U, queue.GetItemCount());
+  EXPECT_EQ(0U, queue.Drop());
+}
+
+
+namespace {
+
+struct QueueProducer {
+  WorkStealingQueue<int> *queue;
+  int num_items;
+};
+
+void *MainProducer(void *data) {
+  QueueProducer *producer = reinterpret_cast<QueueProducer *>(data);
+  for (int i = 0; i < producer->num_items; ++i)
+    producer->queue->Push(i);
+  return NULL;
+}
+
+}  // anonymous namespace
+
+TEST(T_Executor, QueueBounded) {
+  WorkStealingQueue<int> queue(2, 2);
+  QueueProducer producer;
+  producer.queue = &queue;
+  producer.num_items = 1000;
+  pthread_t thread;
+  int retval = pthread_create(&thread, NULL, MainProducer, &producer);
+  ASSERT_EQ(0, retval);
+
+  int sum = 0;
+  for (int i = 0; i < producer.num_items; ++i) {
+    EXPECT_LE(queue.GetItemCount(), 2U);
+    sum += queue.Pop(i % 2);
+  }
+  pthread_join(thread, NULL);
+  EXPECT_EQ(999 * 1000 / 2, sum);
+  EXPECT_EQ(0U, queue.GetItemCount());
+}
+
+
+namespace {
+
+class CountingTask : public Executor::Task {
+ public:
+  explicit CountingTask(atomic_int32 *counter) : counter_(counter) { }
+  virtual void Run() { atomic_inc32(counter_); }
+ private:
+  atomic_int32 *counter_;
+};
+
+int Square(void *data) {
+  const int value = *reinterpret_cast<int *>(data);
+  return value * value;
+}
+
+}  // anonymous namespace
+
+TEST(T_Executor, Submit) {
+  atomic_int32 counter;
+  atomic_init32(&counter);
+  {
+    Executor executor(4, 8);
+    EXPECT_EQ(4U, executor.num_threads());
+    for (unsigned i = 0; i < 1000; ++i)
+      executor.Submit(new CountingTask(&counter));
+    executor.Wait();
+    EXPECT_EQ(1000, atomic_read32(&counter));
+
+    vector<Executor::Task *> batch;
+    for (unsigned i = 0; i < 100; ++i)
+      batch.push_back(new CountingTask(&counter));
+    executor.SubmitBatch(batch);
+    executor.Wait();
+    EXPECT_EQ(1100, atomic_read32(&counter));
+
+    // Waits for the queued tasks on destruction
+    for (unsigned i = 0; i < 100; ++i)
+      executor.Submit(new CountingTask(&counter));
+  }
+  EXPECT_EQ(1200, atomic_read32(&counter));
+}
+
+
+TEST(T_Executor, Async) {
+  Executor executor(2);
+  vector<int> values;
+  for (int i = 0; i < 16; ++i)
+    values.push_back(i);
+  vector<Future<int> *> results;
+  for (unsigned i = 0; i < values.size(); ++i)
+    results.push_back(executor.Async(Square, &values[i]));
+  for (unsigned i = 0; i < results.size(); ++i) {
+    EXPECT_EQ(values[i] * values[i], results[i]->Get());
+    delete results[i];
+  }
+}
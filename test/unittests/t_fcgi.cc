@@ -0,0 +1,225 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "util/posix.h"
+#include "webapi/fcgi.h"
+
+using namespace std;  // NOLINT
+
+class T_FastCgi : public ::testing::Test {
+ protected:
+  static const unsigned char kTypeBegin = 1;
+  static const unsigned char kTypeEnd = 3;
+  static const unsigned char kTypeParams = 4;
+  static const unsigned char kTypeStdin = 5;
+  static const unsigned char kTypeStdout = 6;
+  static const unsigned char kTypeValues = 9;
+  static const unsigned char kTypeValuesResult = 10;
+
+  struct Record {
+    unsigned char type;
+    uint16_t request_id;
+    string content;
+  };
+
+  virtual void SetUp() {
+    port_ = 0;
+    for (uint16_t port = 9700; port < 9800; ++port) {
+      if (fcgi_.MkTcpSocket("127.0.0.1", port)) {
+        port_ = port;
+        break;
+      }
+    }
+    ASSERT_NE(0, port_);
+  }
+
+  int Connect() {
+    int fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    EXPECT_GE(fd, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = htons(port_);
+    EXPECT_EQ(0, connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                         sizeof(addr)));
+    return fd;
+  }
+
+  static string MkRecord(unsigned char type, uint16_t request_id,
+                         const string &content)
+  {
+    string result(8, '\0');
+    result[0] = 1;
+    result[1] = type;
+    result[2] = (request_id >> 8) & 0xff;
+    result[3] = request_id & 0xff;
+    result[4] = (content.length() >> 8) & 0xff;
+    result[5] = content.length() & 0xff;
+    return result + content;
+  }
+
+  static string MkBegin(uint16_t request_id, bool keep_connection) {
+    string body(8, '\0');
+    body[1] = 1;  // responder
+    body[2] = keep_connection ? 1 : 0;
+    return MkRecord(kTypeBegin, request_id, body);
+  }
+
+  static string MkKv(const string &key, const string &value) {
+    return string(1, key.length()) + string(1, value.length()) + key + value;
+  }
+
+  static void Send(int fd, const string &data) {
+    EXPECT_TRUE(SafeWrite(fd, data.data(), data.length()));
+  }
+
+  static Record Receive(int fd) {
+    Record record;
+    unsigned char header[8];
+    EXPECT_EQ(8, SafeRead(fd, header, 8));
+    record.type = header[1];
+    record.request_id = (header[2] << 8) + header[3];
+    const unsigned length = (header[4] << 8) + header[5] + header[6];
+    string content(length, '\0');
+    if (length > 0)
+      EXPECT_EQ(static_cast<ssize_t>(length), SafeRead(fd, &content[0],
+                                                       length));
+    record.content = content.substr(0, (header[4] << 8) + header[5]);
+    return record;
+  }
+
+  /**
+   * Returns the id of the next stdin event with content
+   */
+  uint64_t NextInput(string *input) {
+    unsigned char *buf;
+    unsigned length;
+    uint64_t id;
+    FastCgi::Event event;
+    while ((event = fcgi_.NextEvent(&buf, &length, &id)) ==
+           FastCgi::kEventStdin)
+    {
+      if (length > 0) {
+        *input = string(reinterpret_cast<char *>(buf), length);
+        return id;
+      }
+    }
+    ADD_FAILURE() << "unexpected event " << event;
+    return 0;
+  }
+
+  FastCgi fcgi_;
+  uint16_t port_;
+};
+
+const unsigned char T_FastCgi::kTypeBegin;
+const unsigned char T_FastCgi::kTypeEnd;
+const unsigned char T_FastCgi::kTypeParams;
+const unsigned char T_FastCgi::kTypeStdin;
+const unsigned char T_FastCgi::kTypeStdout;
+const unsigned char T_FastCgi::kTypeValues;
+const unsigned char T_FastCgi::kTypeValuesResult;
+
+
+TEST_F(T_FastCgi, MultiplexedRequests) {
+  int fd = Connect();
+  Send(fd, MkRecord(kTypeValues, 0, MkKv("FCGI_MPXS_CONNS", "")));
+  Send(fd, MkBegin(1, true));
+  Send(fd, MkBegin(2, true));
+  Send(fd, MkRecord(kTypeParams, 1, MkKv("REQUEST_URI", "/a")));
+  Send(fd, MkRecord(kTypeParams, 2, MkKv("REQUEST_URI", "/b")));
+  Send(fd, MkRecord(kTypeParams, 2, ""));
+  Send(fd, MkRecord(kTypeParams, 1, ""));
+  Send(fd, MkRecord(kTypeStdin, 2, "two"));
+  Send(fd, MkRecord(kTypeStdin, 1, "one"));
+
+  string input;
+  string uri;
+  const uint64_t id2 = NextInput(&input);
+  EXPECT_EQ("two", input);
+  EXPECT_TRUE(fcgi_.GetParam("REQUEST_URI", &uri));
+  EXPECT_EQ("/b", uri);
+  const uint64_t id1 = NextInput(&input);
+  EXPECT_EQ("one", input);
+  EXPECT_TRUE(fcgi_.GetParam("REQUEST_URI", &uri));
+  EXPECT_EQ("/a", uri);
+  EXPECT_NE(id1, id2);
+  EXPECT_EQ(2U, fcgi_.num_requests());
+
+  // Answer in the opposite order
+  EXPECT_TRUE(fcgi_.SelectRequest(id1));
+  EXPECT_TRUE(fcgi_.SendData("A", true));
+  fcgi_.EndRequest(0);
+  EXPECT_FALSE(fcgi_.SelectRequest(id1));
+  EXPECT_TRUE(fcgi_.SelectRequest(id2));
+  EXPECT_TRUE(fcgi_.SendData("B", true));
+  fcgi_.EndRequest(0);
+  EXPECT_EQ(0U, fcgi_.num_requests());
+  EXPECT_EQ(1U, fcgi_.num_connections());
+
+  Record record = Receive(fd);
+  EXPECT_EQ(kTypeValuesResult, record.type);
+  EXPECT_EQ(MkKv("FCGI_MPXS_CONNS", "1"), record.content);
+  record = Receive(fd);
+  EXPECT_EQ(kTypeStdout, record.type);
+  EXPECT_EQ(1U, record.request_id);
+  EXPECT_EQ("A", record.content);
+  record = Receive(fd);
+  EXPECT_EQ(kTypeStdout, record.type);
+  EXPECT_EQ("", record.content);
+  record = Receive(fd);
+  EXPECT_EQ(kTypeEnd, record.type);
+  EXPECT_EQ(1U, record.request_id);
+  record = Receive(fd);
+  EXPECT_EQ(kTypeStdout, record.type);
+  EXPECT_EQ(2U, record.request_id);
+  EXPECT_EQ("B", record.content);
+  close(fd);
+}
+
+
+TEST_F(T_FastCgi, ConcurrentConnections) {
+  int fd1 = Connect();
+  int fd2 = Connect();
+  Send(fd1, MkBegin(1, false));
+  Send(fd1, MkRecord(kTypeParams, 1, ""));
+  Send(fd2, MkBegin(1, false));
+  Send(fd2, MkRecord(kTypeParams, 1, ""));
+  Send(fd2, MkRecord(kTypeStdin, 1, "from2"));
+  // The first connection does not block the second one
+  string input;
+  const uint64_t id2 = NextInput(&input);
+  EXPECT_EQ("from2", input);
+  EXPECT_EQ(2U, fcgi_.num_connections());
+  EXPECT_EQ(2U, fcgi_.num_requests());
+
+  Send(fd1, MkRecord(kTypeStdin, 1, "from1"));
+  const uint64_t id1 = NextInput(&input);
+  EXPECT_EQ("from1", input);
+  EXPECT_NE(id1, id2);
+  fcgi_.EndRequest(0);
+  // The web server did not ask to keep the connection
+  EXPECT_EQ(1U, fcgi_.num_connections());
+  EXPECT_TRUE(fcgi_.SelectRequest(id2));
+  fcgi_.EndRequest(0);
+  EXPECT_EQ(0U, fcgi_.num_connections());
+  EXPECT_EQ(0U, fcgi_.num_requests());
+
+  Record record = Receive(fd1);
+  EXPECT_EQ(kTypeEnd, record.type);
+  record = Receive(fd2);
+  EXPECT_EQ(kTypeEnd, record.type);
+  close(fd1);
+  close(fd2);
+}
@@ -7,12 +7,15 @@
 #include <fcntl.h>
 #include <pthread.h>
 
+#include <vector>
+
 #include "atomic.h"
 #include "backoff.h"
 #include "cache_posix.h"
 #include "download.h"
 #include "fetch.h"
 #include "hash.h"
+#include "pack.h"
 #include "statistics.h"
 #include "testutil.h"
 
@@ -426,6 +429,131 @@ TEST_F(T_Fetcher, FetchCollapse) {
 }
 
 
+TEST_F(T_Fetcher, FetchMany) {
+  unsigned char x = 'x';
+  shash::Any hash_avail(shash::kSha1);
+  EXPECT_TRUE(cache_mgr_->CommitFromMem(hash_avail, &x, 1, ""));
+  shash::Any rnd_hash(shash::kSha1);
+  rnd_hash.Randomize();
+
+  download_mgr_->Spawn();
+  for (unsigned round = 0; round < 2; ++round) {
+    vector<Fetcher::FetchRequest> requests;
+    // Cache hit
+    requests.push_back(Fetcher::FetchRequest(hash_avail, 1, "",
+      zlib::kZlibDefault, CacheManager::kTypeRegular));
+    requests.push_back(Fetcher::FetchRequest(hash_regular_,
+      CacheManager::kSizeUnknown, "reg", zlib::kZlibDefault,
+      CacheManager::kTypeRegular));
+    // Download fails
+    requests.push_back(Fetcher::FetchRequest(rnd_hash,
+      CacheManager::kSizeUnknown, "rnd", zlib::kZlibDefault,
+      CacheManager::kTypeRegular));
+    requests.push_back(Fetcher::FetchRequest(hash_catalog_,
+      CacheManager::kSizeUnknown, "cat", zlib::kZlibDefault,
+      CacheManager::kTypeCatalog));
+    requests.push_back(Fetcher::FetchRequest(hash_uncompressed_, 1, "unc",
+      zlib::kNoCompression, CacheManager::kTypeRegular));
+    // Duplicates are downloaded once
+    requests.push_back(Fetcher::FetchRequest(hash_regular_,
+      CacheManager::kSizeUnknown, "reg", zlib::kZlibDefault,
+      CacheManager::kTypeRegular));
+    requests.push_back(Fetcher::FetchRequest(rnd_hash,
+      CacheManager::kSizeUnknown, "rnd", zlib::kZlibDefault,
+      CacheManager::kTypeRegular));
+
+    const int64_t n_downloads =
+      statistics_.Lookup("fetch.n_downloads")->Get();
+    fetcher_->FetchMany(&requests);
+    // The second round only retries the failed download
+    EXPECT_EQ((round == 0) ? 4 : 1,
+              statistics_.Lookup("fetch.n_downloads")->Get() - n_downloads);
+    EXPECT_EQ(-EIO, requests[2].fd);
+    EXPECT_EQ(-EIO, requests[6].fd);
+    for (unsigned i = 0; i < requests.size(); ++i) {
+      if ((i == 2) || (i == 6))
+        continue;
+      EXPECT_GE(requests[i].fd, 0);
+      EXPECT_EQ(0, cache_mgr_->Close(requests[i].fd));
+    }
+    EXPECT_TRUE(fetcher_->queues_download_.empty());
+  }
+
+  int fd = cache_mgr_->Open(CacheManager::Bless(hash_regular_));
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+  fd = cache_mgr_->Open(CacheManager::Bless(hash_catalog_));
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+  fd = cache_mgr_->Open(CacheManager::Bless(hash_uncompressed_));
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+}
+
+
+TEST_F(T_Fetcher, CommitBundle) {
+  const string content_a = "abc";
+  const string content_b(5000, 'b');
+  shash::Any hash_a(shash::kSha1);
+  shash::Any hash_b(shash::kSha1);
+  hash_a.Randomize(1);
+  hash_b.Randomize(2);
+  ObjectPack pack;
+  ObjectPack::BucketHandle bucket = pack.NewBucket();
+  ObjectPack::AddToBucket(content_a.data(), content_a.length(), bucket);
+  EXPECT_TRUE(pack.CommitBucket(ObjectPack::kCas, hash_a, bucket));
+  bucket = pack.NewBucket();
+  ObjectPack::AddToBucket(content_b.data(), content_b.length(), bucket);
+  EXPECT_TRUE(pack.CommitBucket(ObjectPack::kCas, hash_b, bucket));
+
+  string bundle;
+  ObjectPackProducer producer(&pack);
+  unsigned char buf[1024];
+  unsigned nbytes;
+  while ((nbytes = producer.ProduceNext(sizeof(buf), buf)) > 0)
+    bundle += string(reinterpret_cast<char *>(buf), nbytes);
+
+  // Malformed bundles are rejected
+  shash::Any bundle_hash(shash::kSha1);
+  const unsigned char *bundle_buf =
+    reinterpret_cast<const unsigned char *>(bundle.data());
+  EXPECT_EQ(-EIO, fetcher_->CommitBundle(bundle_hash, bundle_buf, 10));
+  EXPECT_EQ(-EIO,
+            fetcher_->CommitBundle(bundle_hash, bundle_buf, bundle.size() - 1));
+
+  // Download of the bundle
+  void *zbuf;
+  uint64_t zbuf_size;
+  EXPECT_TRUE(zlib::CompressMem2Mem(bundle_buf, bundle.size(),
+                                    &zbuf, &zbuf_size));
+  shash::HashMem(static_cast<unsigned char *>(zbuf), zbuf_size, &bundle_hash);
+  MkdirDeep(GetParentPath(src_path_ + "/" + bundle_hash.MakePath()), 0700);
+  EXPECT_TRUE(CopyMem2Path(static_cast<unsigned char *>(zbuf), zbuf_size,
+                           src_path_ + "/" + bundle_hash.MakePath()));
+  free(zbuf);
+  EXPECT_EQ(2, fetcher_->FetchBundle(bundle_hash, "bundle",
+                                     zlib::kZlibDefault));
+  EXPECT_TRUE(fetcher_->queues_download_.empty());
+  EXPECT_EQ(2, statistics_.Lookup("fetch.n_bundle_objects")->Get());
+
+  int fd = cache_mgr_->Open(CacheManager::Bless(hash_b));
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(static_cast<int64_t>(content_b.length()),
+            cache_mgr_->GetSize(fd));
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+  fd = cache_mgr_->Open(CacheManager::Bless(hash_a));
+  EXPECT_GE(fd, 0);
+  char result[3];
+  EXPECT_EQ(3, cache_mgr_->Pread(fd, result, 3, 0));
+  EXPECT_EQ(content_a, string(result, 3));
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+
+  shash::Any rnd_hash(shash::kSha1);
+  rnd_hash.Randomize();
+  EXPECT_EQ(-EIO, fetcher_->FetchBundle(rnd_hash, "rnd", zlib::kZlibDefault));
+}
+
+
 TEST_F(T_Fetcher, SignalWaitingThreads) {
   unsigned char x = 'x';
   EXPECT_TRUE(cache_mgr_->CommitFromMem(hash_regular_, &x, 1, ""));
@@ -465,4 +593,52 @@ TEST_F(T_Fetcher, SignalWaitingThreads) {
   EXPECT_EQ(0, cache_mgr_->Close(fd));
 }
 
+
+TEST_F(T_Fetcher, FastFail) {
+  fetcher_->EnableFastFail(60);
+  shash::Any rnd_hash(shash::kSha1);
+  rnd_hash.Randomize();
+  EXPECT_EQ(-EIO,
+    fetcher_->Fetch(rnd_hash, CacheManager::kSizeUnknown, "rnd",
+                    zlib::kZlibDefault, CacheManager::kTypeRegular));
+  EXPECT_EQ(1, fetcher_->n_downloads->Get());
+  EXPECT_EQ(0, fetcher_->n_fast_fail->Get());
+
+  // The failure is remembered
+  EXPECT_EQ(-EIO,
+    fetcher_->Fetch(rnd_hash, CacheManager::kSizeUnknown, "rnd",
+                    zlib::kZlibDefault, CacheManager::kTypeRegular));
+  EXPECT_EQ(1, fetcher_->n_downloads->Get());
+  EXPECT_EQ(1, fetcher_->n_fast_fail->Get());
+
+  // Other objects are still downloaded
+  int fd = fetcher_->Fetch(hash_regular_, CacheManager::kSizeUnknown, "reg",
+                           zlib::kZlibDefault, CacheManager::kTypeRegular);
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(0, cache_mgr_->Close(fd));
+  EXPECT_EQ(2, fetcher_->n_downloads->Get());
+
+  // Expired failures are downloaded again
+  fetcher_->failed_objects_[rnd_hash] = 0;
+  EXPECT_EQ(-EIO,
+    fetcher_->Fetch(rnd_hash, CacheManager::kSizeUnknown, "rnd",
+                    zlib::kZlibDefault, CacheManager::kTypeRegular));
+  EXPECT_EQ(3, fetcher_->n_downloads->Get());
+}
+
+
+TEST_F(T_Fetcher, GetPriority) {
+  EXPECT_EQ(download::kPriorityMetadata,
+            Fetcher::GetPriority(CacheManager::kTypeCatalog,
+                                 1024 * 1024 * 1024));
+  EXPECT_EQ(download::kPriorityInteractive,
+            Fetcher::GetPriority(CacheManager::kTypeRegular, 1024));
+  EXPECT_EQ(download::kPriorityInteractive,
+            Fetcher::GetPriority(CacheManager::kTypeRegular,
+                                 CacheManager::kSizeUnknown));
+  EXPECT_EQ(download::kPriorityBulk,
+            Fetcher::GetPriority(CacheManager::kTypeVolatile,
+                                 1024 * 1024 * 1024));
+}
+
 }  // namespace cvmfs
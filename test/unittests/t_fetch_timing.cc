@@ -0,0 +1,102 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "download.h"
+#include "fetch_timing.h"
+#include "hash.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace cvmfs {
+
+static FetchTiming MakeTiming(const unsigned i) {
+  FetchTiming timing;
+  timing.id = shash::Any(shash::kSha1);
+  shash::HashString(StringifyInt(i), &timing.id);
+  timing.name = "object " + StringifyInt(i);
+  timing.size = i;
+  timing.total_us = 1000 * i;
+  return timing;
+}
+
+
+TEST(T_FetchTiming, ToString) {
+  download::JobInfo download_job;
+  download_job.num_retries = 2;
+  download_job.proxy = "http://proxy:3128";
+  download_job.timing.queue = 1000000;
+  download_job.timing.dns = 2000000;
+  download_job.timing.connect = 3000000;
+  download_job.timing.tls = 4000000;
+  download_job.timing.wait = 5500000;
+  download_job.timing.transfer = 6000000;
+  download_job.timing.data = 7000000;
+
+  FetchTiming timing;
+  timing.total_us = 40000;
+  timing.txn_us = 500;
+  timing.commit_us = 8000;
+  timing.SetDownload(download_job);
+  timing.result = 3;
+  EXPECT_EQ("total 40.000 txn 0.500 queue 1.000 dns 2.000 connect 3.000 "
+            "tls 4.000 wait 5.500 transfer 6.000 data 7.000 commit 8.000 "
+            "retries 2 proxy http://proxy:3128 [ok]", timing.ToString());
+
+  FetchTiming collapsed;
+  collapsed.collapsed = true;
+  collapsed.total_us = 1500;
+  collapsed.result = -5;
+  EXPECT_EQ("total 1.500 waited for another download [error 5]",
+            collapsed.ToString());
+}
+
+
+TEST(T_FetchTiming, Ring) {
+  FetchTimingLog log(0);
+  const FetchTiming first = MakeTiming(0);
+  vector<shash::Any> ids;
+  ids.push_back(first.id);
+  FetchTiming timing;
+  EXPECT_FALSE(log.Lookup(ids, &timing));
+
+  log.Record(first);
+  ASSERT_TRUE(log.Lookup(ids, &timing));
+  EXPECT_EQ("object 0", timing.name);
+
+  // The newer record of the same object wins
+  FetchTiming again = MakeTiming(0);
+  again.name = "object 0 again";
+  log.Record(again);
+  ASSERT_TRUE(log.Lookup(ids, &timing));
+  EXPECT_EQ("object 0 again", timing.name);
+
+  for (unsigned i = 1; i < FetchTimingLog::kCapacity; ++i)
+    log.Record(MakeTiming(i));
+  // The first record has been overwritten but the second one is still there
+  ASSERT_TRUE(log.Lookup(ids, &timing));
+  EXPECT_EQ("object 0 again", timing.name);
+  log.Record(MakeTiming(FetchTimingLog::kCapacity));
+  EXPECT_FALSE(log.Lookup(ids, &timing));
+
+  ids.push_back(MakeTiming(5).id);
+  ids.push_back(MakeTiming(7).id);
+  ASSERT_TRUE(log.Lookup(ids, &timing));
+  EXPECT_EQ("object 7", timing.name);
+
+  const string printed = log.Print();
+  EXPECT_EQ(FetchTimingLog::kCapacity + 1,
+            SplitString(printed, '\n').size() - 1);
+  EXPECT_LT(printed.find("object " + StringifyInt(FetchTimingLog::kCapacity) +
+                         " ("),
+            printed.find("object 7 ("));
+  EXPECT_EQ(string::npos, printed.find("object 0 again"));
+}
+
+}  // namespace cvmfs
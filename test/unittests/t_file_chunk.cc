@@ -4,6 +4,8 @@
 
 #include <gtest/gtest.h>
 
+#include <pthread.h>
+
 #include <vector>
 
 #include "file_chunk.h"
@@ -55,6 +57,18 @@ TEST_F(T_FileChunk, FindChunkIdx) {
 }
 
 
+TEST_F(T_FileChunk, GetFileSize) {
+  FileChunkList chunks;
+  FileChunkReflist reflist(&chunks, PathString(""), zlib::kZlibDefault, false);
+  EXPECT_EQ(0U, reflist.GetFileSize());
+  chunks.PushBack(FileChunk(shash::Any(), 0, 10));
+  EXPECT_EQ(10U, reflist.GetFileSize());
+  chunks.PushBack(FileChunk(shash::Any(), 10, 5));
+  EXPECT_EQ(15U, reflist.GetFileSize());
+  EXPECT_EQ(0U, FileChunkReflist().GetFileSize());
+}
+
+
 TEST_F(T_FileChunk, Simple) {
   EXPECT_DEATH(simple_.Add(FileChunkReflist()), ".*");
 
@@ -88,3 +102,116 @@ TEST_F(T_FileChunk, Simple) {
   simple_.Release(3);
   EXPECT_EQ(0, simple_.Add(NewChunks()));
 }
+
+
+TEST_F(T_FileChunk, SimpleChunkLock) {
+  const int handle = simple_.Add(NewChunks());
+  SimpleChunkTables::OpenChunks open_chunks = simple_.Get(handle);
+  ASSERT_TRUE(open_chunks.chunk_lock != NULL);
+  EXPECT_EQ(0, pthread_mutex_trylock(open_chunks.chunk_lock));
+  // Copies of the entry share the lock
+  SimpleChunkTables::OpenChunks other = simple_.Get(handle);
+  EXPECT_EQ(open_chunks.chunk_lock, other.chunk_lock);
+  EXPECT_NE(0, pthread_mutex_trylock(other.chunk_lock));
+  EXPECT_EQ(0, pthread_mutex_unlock(open_chunks.chunk_lock));
+
+  EXPECT_NE(simple_.Get(simple_.Add(NewChunks())).chunk_lock,
+            open_chunks.chunk_lock);
+  simple_.Release(handle);
+  EXPECT_EQ(NULL, simple_.Get(handle).chunk_lock);
+}
+
+
+TEST_F(T_FileChunk, ChunkTablesShards) {
+  ChunkTables tables;
+  EXPECT_EQ(2U, tables.NextHandle());
+  EXPECT_EQ(3U, tables.NextHandle());
+
+  vector<uint64_t> handles;
+  for (unsigned i = 0; i < 100; ++i) {
+    const uint64_t handle = tables.NextHandle();
+    ChunkFd chunk_fd;
+    chunk_fd.fd = i;
+    ChunkTables::HandleShard *shard = tables.Handle2Shard(handle);
+    EXPECT_EQ(shard, tables.Handle2Shard(handle));
+    shard->handle2fd.Insert(handle, chunk_fd);
+    shard->handle2uniqino.Insert(handle, 1000 + (i % 10));
+    handles.push_back(handle);
+  }
+  for (unsigned i = 0; i < 10; ++i) {
+    ChunkTables::InodeShard *shard = tables.Inode2Shard(1000 + i);
+    shard->inode2chunks.Insert(1000 + i, NewChunks());
+    shard->inode2references.Insert(1000 + i, 10);
+  }
+  EXPECT_EQ(100U, tables.GetNumHandles());
+  // The handles are spread over the shards
+  EXPECT_LT(tables.handle_shards[0].handle2fd.size(), 50U);
+  // The chunk lists of the ten open inodes are accounted for
+  ChunkTables fresh;
+  EXPECT_GE(tables.GetMemoryUsage(),
+            fresh.GetMemoryUsage() + 10 * sizeof(FileChunk));
+
+  ChunkTables copy(tables);
+  EXPECT_EQ(100U, copy.GetNumHandles());
+  EXPECT_EQ(tables.NextHandle(), copy.NextHandle());
+  for (unsigned i = 0; i < handles.size(); ++i) {
+    ChunkFd chunk_fd;
+    uint64_t unique_inode;
+    ChunkTables::HandleShard *shard = copy.Handle2Shard(handles[i]);
+    EXPECT_NE(shard->lock, tables.Handle2Shard(handles[i])->lock);
+    EXPECT_TRUE(shard->handle2fd.Lookup(handles[i], &chunk_fd));
+    EXPECT_EQ(static_cast<int>(i), chunk_fd.fd);
+    EXPECT_TRUE(shard->handle2uniqino.Lookup(handles[i], &unique_inode));
+    EXPECT_EQ(1000 + (i % 10), unique_inode);
+  }
+  for (unsigned i = 0; i < 10; ++i) {
+    FileChunkReflist chunks;
+    EXPECT_TRUE(copy.Inode2Shard(1000 + i)->inode2chunks.Lookup(1000 + i,
+                                                                 &chunks));
+    delete chunks.list;
+  }
+
+  ChunkTables empty;
+  copy = empty;
+  EXPECT_EQ(0U, copy.GetNumHandles());
+  EXPECT_EQ(2U, copy.NextHandle());
+}
+
+
+TEST_F(T_FileChunk, CompactChunkList) {
+  FileChunkList chunks;
+  CompactChunkList compact;
+  EXPECT_FALSE(CompactChunkList::Encode(chunks, &compact));
+
+  const uint64_t sizes[] = {1, 127, 128, 16384, uint64_t(1) << 40, 7};
+  const unsigned num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+  off_t offset = 0;
+  for (unsigned i = 0; i < num_sizes; ++i) {
+    shash::Any hash(shash::kSha1, shash::kSuffixPartial);
+    hash.Randomize();
+    chunks.PushBack(FileChunk(hash, offset, sizes[i]));
+    offset += sizes[i];
+  }
+  ASSERT_TRUE(CompactChunkList::Encode(chunks, &compact));
+  EXPECT_EQ(num_sizes, compact.num_chunks());
+  EXPECT_LT(compact.GetMemorySize(), num_sizes * sizeof(FileChunk));
+
+  FileChunkList expanded;
+  compact.Expand(&expanded);
+  ASSERT_EQ(chunks.size(), expanded.size());
+  for (unsigned i = 0; i < chunks.size(); ++i) {
+    EXPECT_EQ(chunks.At(i).content_hash(), expanded.At(i).content_hash());
+    EXPECT_EQ(chunks.At(i).offset(), expanded.At(i).offset());
+    EXPECT_EQ(chunks.At(i).size(), expanded.At(i).size());
+  }
+
+  // Gaps and mixed hash algorithms cannot be encoded
+  FileChunkList gap;
+  gap.PushBack(chunks.At(0));
+  gap.PushBack(chunks.At(2));
+  EXPECT_FALSE(CompactChunkList::Encode(gap, &compact));
+  FileChunkList mixed;
+  mixed.PushBack(chunks.At(0));
+  mixed.PushBack(FileChunk(shash::Any(shash::kRmd160), 1, 1));
+  EXPECT_FALSE(CompactChunkList::Encode(mixed, &compact));
+}
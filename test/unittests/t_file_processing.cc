@@ -12,6 +12,8 @@
 #include <vector>
 
 #include "c_file_sandbox.h"
+#include "compression.h"
+#include "digest_tree.h"
 #include "file_processing/char_buffer.h"
 #include "file_processing/file_processor.h"
 #include "testutil.h"
@@ -629,15 +631,18 @@ struct CallbackTest {
     result_content_hash = result.content_hash;
     result_local_path = result.local_path;
     result_chunk_list = result.file_chunks;
+    result_digest_tree = result.digest_tree;
   }
 
   static shash::Any result_content_hash;
   static std::string result_local_path;
   static FileChunkList result_chunk_list;
+  static std::string result_digest_tree;
 };
 shash::Any CallbackTest::result_content_hash;
 std::string CallbackTest::result_local_path;
 FileChunkList CallbackTest::result_chunk_list;
+std::string CallbackTest::result_digest_tree;
 
 TEST_F(T_FileProcessing, ProcessingCallbackForSmallFile) {
   upload::FileProcessor processor(uploader_, MockSpoolerDefinition());
@@ -667,3 +672,30 @@ TEST_F(T_FileProcessing, ProcessingCallbackForBigFile) {
   EXPECT_EQ(GetBigFile(), CallbackTest::result_local_path);
   EXPECT_EQ(number_of_chunks, CallbackTest::result_chunk_list.size());
 }
+
+TEST_F(T_FileProcessing, ProcessingCallbackDigestTree) {
+  upload::SpoolerDefinition spooler_definition = MockSpoolerDefinition();
+  spooler_definition.digest_tree_block_size = 64 * 1024;
+  upload::FileProcessor processor(uploader_, spooler_definition);
+  processor.RegisterListener(&CallbackTest::CallbackFn);
+
+  // Small files fit in a single block and get no tree
+  processor.Process(GetSmallFile(), true);
+  processor.WaitForProcessing();
+  EXPECT_TRUE(CallbackTest::result_digest_tree.empty());
+
+  // The bulk chunk of a chunked file inherits the tree of the first chunk
+  processor.Process(GetBigFile(), true);
+  processor.WaitForProcessing();
+  ASSERT_FALSE(CallbackTest::result_digest_tree.empty());
+  DigestTree tree(shash::kSha1, 1);
+  EXPECT_TRUE(tree.Parse(CallbackTest::result_digest_tree));
+  EXPECT_EQ(64U * 1024U, tree.block_size());
+
+  unsigned char *content;
+  unsigned content_size;
+  ASSERT_TRUE(CopyPath2Mem(GetBigFile(), &content, &content_size));
+  EXPECT_EQ(content_size, tree.file_size());
+  EXPECT_TRUE(tree.VerifyRange(0, content, content_size));
+  free(content);
+}
@@ -14,8 +14,10 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "fs_traversal.h"
+#include "fs_traversal_parallel.h"
 #include "platform.h"
 #include "util/file_guard.h"
 #include "util/posix.h"
@@ -659,6 +661,146 @@ TEST_F(T_FsTraversal, SteeredTraversal) {
   delegate.Check();
 }
 
+
+//
+// # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # # #
+//
+
+
+TEST_F(T_FsTraversal, PrefetchedTraversal) {
+  BaseTraversalDelegate delegate(reference_);
+  FileSystemTraversal<BaseTraversalDelegate> traverse(&delegate,
+                                                       testbed_path_,
+                                                       true);
+  RegisterDelegate(&traverse);
+  ParallelDirectoryScanner scanner(4, 2, NULL);
+  scanner.Start(testbed_path_);
+  traverse.SetPrefetcher(&scanner);
+
+  traverse.Recurse(testbed_path_);
+  delegate.Check();
+}
+
+
+TEST_F(T_FsTraversal, PrefetchedIgnoringTraversal) {
+  std::set<std::string> ignored_filenames;
+  ignored_filenames.insert("baz");
+  ignored_filenames.insert("d");
+
+  IgnoringTraversalDelegate delegate(reference_);
+  delegate.SetIgnoreNames(ignored_filenames);
+  FileSystemTraversal<IgnoringTraversalDelegate> traverse(&delegate,
+                                                           testbed_path_,
+                                                           true);
+  RegisterDelegate(&traverse);
+  traverse.fn_ignore_file = &IgnoringTraversalDelegate::IgnoreFilePredicate;
+  ParallelDirectoryScanner scanner(4, 1, NULL);
+  scanner.Start(testbed_path_);
+  traverse.SetPrefetcher(&scanner);
+
+  traverse.Recurse(testbed_path_);
+  delegate.Check();
+}
+
+
+TEST_F(T_FsTraversal, PrefetchedSteeredTraversal) {
+  SteeringTraversalDelegate delegate(reference_);
+  FileSystemTraversal<SteeringTraversalDelegate> traverse(&delegate,
+                                                           testbed_path_,
+                                                           true);
+  RegisterDelegate(&traverse);
+  ParallelDirectoryScanner scanner(2, 1, NULL);
+  scanner.Start(testbed_path_);
+  traverse.SetPrefetcher(&scanner);
+
+  traverse.Recurse(testbed_path_);
+  delegate.Check();
+}
+
+
+class OrderTraversalDelegate : public BaseTraversalDelegate {
+ public:
+  explicit OrderTraversalDelegate(const ChecklistMap &reference) :
+    BaseTraversalDelegate(reference) {}
+
+  virtual void EnterDir(const std::string &relative_path,
+                        const std::string &dir_name) {
+    BaseTraversalDelegate::EnterDir(relative_path, dir_name);
+    entered_dirs.push_back(CombinePath(relative_path, dir_name));
+  }
+
+  std::vector<std::string> entered_dirs;
+};
+
+
+class SkippingScanFilter : public ParallelDirectoryScanner::Filter {
+ public:
+  explicit SkippingScanFilter(const std::string &skipped) : skipped_(skipped) {}
+  virtual bool Descend(const std::string &path) {
+    return path != skipped_;
+  }
+
+ private:
+  std::string skipped_;
+};
+
+
+TEST_F(T_FsTraversal, PrefetchedOrder) {
+  OrderTraversalDelegate delegate(reference_);
+  FileSystemTraversal<OrderTraversalDelegate> traverse(&delegate,
+                                                        testbed_path_,
+                                                        true);
+  RegisterDelegate(&traverse);
+  ParallelDirectoryScanner scanner(8, 3, NULL);
+  scanner.Start(testbed_path_);
+  traverse.SetPrefetcher(&scanner);
+
+  traverse.Recurse(testbed_path_);
+  delegate.Check();
+
+  // Directories are visited in sorted depth-first order
+  ParallelDirectoryScanner::PathOrder order;
+  ASSERT_LT(1U, delegate.entered_dirs.size());
+  EXPECT_EQ("", delegate.entered_dirs[0]);
+  for (unsigned i = 1; i < delegate.entered_dirs.size(); ++i) {
+    EXPECT_TRUE(order(delegate.entered_dirs[i - 1], delegate.entered_dirs[i]))
+      << delegate.entered_dirs[i - 1] << " before " << delegate.entered_dirs[i];
+  }
+}
+
+
+TEST_F(T_FsTraversal, PartiallyPrefetchedTraversal) {
+  BaseTraversalDelegate delegate(reference_);
+  FileSystemTraversal<BaseTraversalDelegate> traverse(&delegate,
+                                                       testbed_path_,
+                                                       true);
+  RegisterDelegate(&traverse);
+  // The filter only affects the read-ahead, "b/b" is read by the traversal
+  SkippingScanFilter filter(testbed_path_ + "/b/b");
+  ParallelDirectoryScanner scanner(2, 4, &filter);
+  scanner.Start(testbed_path_);
+  traverse.SetPrefetcher(&scanner);
+
+  traverse.Recurse(testbed_path_);
+  delegate.Check();
+}
+
+
+TEST(T_ParallelDirectoryScanner, PathOrder) {
+  ParallelDirectoryScanner::PathOrder order;
+  EXPECT_TRUE(order("a", "a/b"));
+  EXPECT_TRUE(order("a/b", "a!"));
+  EXPECT_FALSE(order("a!", "a/b"));
+  EXPECT_TRUE(order("a/z/z", "ab"));
+  EXPECT_FALSE(order("a", "a"));
+  EXPECT_TRUE(order("/tmp/a/\xff", "/tmp/b"));
+
+  EXPECT_TRUE(ParallelDirectoryScanner::IsDescendant("a/b", "a"));
+  EXPECT_FALSE(ParallelDirectoryScanner::IsDescendant("ab", "a"));
+  EXPECT_FALSE(ParallelDirectoryScanner::IsDescendant("a", "a"));
+}
+
+
 class CustomDelegate {
  public:
   explicit CustomDelegate(const std::string &path) :
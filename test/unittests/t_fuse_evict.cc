@@ -4,12 +4,15 @@
 
 #include <gtest/gtest.h>
 
+#include <vector>
+
 #include "fuse_evict.h"
 #include "glue_buffer.h"
 #include "util/string.h"
 
 extern "C" {
 unsigned fuse_lowlevel_notify_inval_entry_cnt = 0;
+unsigned fuse_lowlevel_notify_inval_inode_cnt = 0;
 }
 
 class T_FuseInvalidator : public ::testing::Test {
@@ -93,3 +96,41 @@ TEST_F(T_FuseInvalidator, InvalidateOps) {
   EXPECT_EQ((2 * FuseInvalidator::kCheckTimeoutFreqOps) + 1024,
             fuse_lowlevel_notify_inval_entry_cnt);
 }
+
+
+TEST_F(T_FuseInvalidator, InvalidatePaths) {
+  invalidator_->fuse_channel_ = reinterpret_cast<struct fuse_chan **>(this);
+  inode_tracker_.VfsGet(1, PathString(""));
+  inode_tracker_.VfsGet(2, PathString("/dir"));
+  inode_tracker_.VfsGet(3, PathString("/dir/known"));
+  unsigned entry_cnt = fuse_lowlevel_notify_inval_entry_cnt;
+  unsigned inode_cnt = fuse_lowlevel_notify_inval_inode_cnt;
+
+  std::vector<PathString> *paths = new std::vector<PathString>();
+  paths->push_back(PathString(""));
+  paths->push_back(PathString("/dir"));
+  paths->push_back(PathString("/dir/known"));
+  // Parent known to the kernel, entry possibly cached as negative entry
+  paths->push_back(PathString("/dir/unknown"));
+  // Neither the entry nor its parent is known to the kernel
+  paths->push_back(PathString("/unknown/unknown"));
+
+  FuseInvalidator::Handle handle(0);
+  EXPECT_FALSE(handle.IsDone());
+  invalidator_->InvalidatePaths(&handle, paths);
+  handle.WaitFor();
+  EXPECT_TRUE(handle.IsDone());
+  EXPECT_EQ(entry_cnt + 3, fuse_lowlevel_notify_inval_entry_cnt);
+  EXPECT_EQ(inode_cnt + 3, fuse_lowlevel_notify_inval_inode_cnt);
+
+  // Without a fuse channel, eviction falls back to the timeout
+  invalidator_->fuse_channel_ = NULL;
+  paths = new std::vector<PathString>();
+  paths->push_back(PathString("/dir"));
+  handle.Reset();
+  invalidator_->InvalidatePaths(&handle, paths);
+  handle.WaitFor();
+  EXPECT_TRUE(handle.IsDone());
+  EXPECT_EQ(entry_cnt + 3, fuse_lowlevel_notify_inval_entry_cnt);
+  EXPECT_EQ(inode_cnt + 3, fuse_lowlevel_notify_inval_inode_cnt);
+}
@@ -7,6 +7,7 @@
 #include <cassert>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "catalog_traversal.h"
 #include "garbage_collection/garbage_collector.h"
@@ -15,6 +16,7 @@
 #include "manifest.h"
 #include "prng.h"
 #include "testutil.h"
+#include "util/posix.h"
 
 using swissknife::CatalogTraversal;
 using upload::SpoolerDefinition;
@@ -49,12 +51,19 @@ class GC_MockUploader : public AbstractMockUploader<GC_MockUploader> {
     return true;
   }
 
+  bool RemoveBatch(const std::vector<shash::Any> &hashes_to_delete,
+                   const unsigned concurrency) {
+    batch_sizes.push_back(hashes_to_delete.size());
+    return AbstractUploader::RemoveBatch(hashes_to_delete, concurrency);
+  }
+
   bool HasDeleted(const shash::Any &hash) const {
     return deleted_hashes.find(hash) != deleted_hashes.end();
   }
 
  public:
   std::set<shash::Any> deleted_hashes;
+  std::vector<size_t> batch_sizes;
 };
 
 class T_GarbageCollector : public ::testing::Test {
@@ -555,6 +564,91 @@ TEST_F(T_GarbageCollector, KeepLastRevision) {
   // snapshot and check if it is gone after another collection run...
 }
 
+TEST_F(T_GarbageCollector, BatchedDeletion) {
+  GcConfiguration config = GetStandardGarbageCollectorConfiguration();
+  config.keep_history_depth = 0;
+  config.deletion_batch_size = 2;
+  config.deletion_concurrency = 4;
+
+  MyGarbageCollector gc(config);
+  EXPECT_TRUE(gc.Collect());
+  EXPECT_EQ(5u, gc.condemned_catalog_count());
+
+  GC_MockUploader *upl = static_cast<GC_MockUploader *>(config.uploader);
+  RevisionMap &c = catalogs_;
+  EXPECT_TRUE(upl->HasDeleted(h("2e87adef242bc67cb66fcd61238ad808a7b44aab")));
+  EXPECT_TRUE(upl->HasDeleted(h("219d1ca4c958bd615822f8c125701e73ce379428")));
+  EXPECT_TRUE(upl->HasDeleted(c[mp(1, "00")]->hash()));
+  EXPECT_TRUE(upl->HasDeleted(c[mp(3, "11")]->hash()));
+  EXPECT_FALSE(upl->HasDeleted(c[mp(5, "00")]->hash()));
+  EXPECT_EQ(11u, upl->deleted_hashes.size());
+
+  size_t num_removed = 0;
+  for (unsigned i = 0; i < upl->batch_sizes.size(); ++i) {
+    EXPECT_GE(2u, upl->batch_sizes[i]);
+    num_removed += upl->batch_sizes[i];
+  }
+  EXPECT_EQ(gc.condemned_objects_count(), num_removed);
+  EXPECT_LT(1u, upl->batch_sizes.size());
+}
+
+TEST_F(T_GarbageCollector, IncrementalMarkState) {
+  const std::string state_dir =
+    CreateTempDir(GetCurrentWorkingDirectory() + "/cvmfs_ut_gc_state");
+  ASSERT_FALSE(state_dir.empty());
+  GcConfiguration config = GetStandardGarbageCollectorConfiguration();
+  config.keep_history_depth = TraversalParams::kFullHistory;
+  config.mark_state_dir = state_dir;
+
+  // The first run is a full one and records all catalogs
+  MyGarbageCollector gc1(config);
+  EXPECT_FALSE(gc1.is_incremental());
+  EXPECT_TRUE(gc1.Collect());
+  EXPECT_EQ(16u, gc1.preserved_catalog_count());
+  EXPECT_EQ(0u, gc1.summarized_catalog_count());
+  EXPECT_EQ(0u, gc1.condemned_objects_count());
+
+  // Same result as KeepLastRevision without downloading preserved catalogs
+  config.keep_history_depth = 0;
+  MyGarbageCollector gc2(config);
+  EXPECT_TRUE(gc2.is_incremental());
+  EXPECT_TRUE(gc2.Collect());
+  EXPECT_EQ(11u, gc2.preserved_catalog_count());
+  EXPECT_EQ(11u, gc2.summarized_catalog_count());
+  EXPECT_EQ(5u, gc2.condemned_catalog_count());
+  EXPECT_EQ(static_cast<unsigned>(t(26, 12, 2004)),
+            gc2.oldest_trunk_catalog());
+
+  GC_MockUploader *upl = static_cast<GC_MockUploader *>(config.uploader);
+  RevisionMap &c = catalogs_;
+  EXPECT_EQ(11u, upl->deleted_hashes.size());
+  EXPECT_TRUE(upl->HasDeleted(h("2e87adef242bc67cb66fcd61238ad808a7b44aab")));
+  EXPECT_TRUE(upl->HasDeleted(h("219d1ca4c958bd615822f8c125701e73ce379428")));
+  EXPECT_TRUE(upl->HasDeleted(c[mp(1, "00")]->hash()));
+  EXPECT_TRUE(upl->HasDeleted(c[mp(3, "11")]->hash()));
+  EXPECT_FALSE(upl->HasDeleted(c[mp(2, "11")]->hash()));
+  EXPECT_FALSE(upl->HasDeleted(c[mp(5, "20")]->hash()));
+  EXPECT_FALSE(upl->HasDeleted(h("8031b9ad81b52cd772db9b1b12d38994fdd9dbe4")));
+  EXPECT_FALSE(
+      upl->HasDeleted(h("defae1853b929bbbdbc7c6d4e75531273f1ae4cb", 'P')));
+
+  // Periodic full run
+  config.full_gc_interval = 1;
+  MyGarbageCollector gc3(config);
+  EXPECT_FALSE(gc3.is_incremental());
+  EXPECT_TRUE(gc3.Collect());
+  EXPECT_EQ(11u, gc3.preserved_catalog_count());
+  EXPECT_EQ(0u, gc3.summarized_catalog_count());
+
+  config.full_gc_interval = 2;
+  MyGarbageCollector gc4(config);
+  EXPECT_TRUE(gc4.is_incremental());
+  EXPECT_TRUE(gc4.Collect());
+  EXPECT_EQ(11u, gc4.summarized_catalog_count());
+
+  RemoveTree(state_dir);
+}
+
 TEST_F(T_GarbageCollector, KeepLastThreeRevisions) {
   GcConfiguration config = GetStandardGarbageCollectorConfiguration();
   config.keep_history_depth = 2;  // preserve two historic revisions
@@ -0,0 +1,195 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "util/posix.h"
+#include "webapi/geo.h"
+
+using namespace std;  // NOLINT
+
+namespace {
+
+/**
+ * Resolves names from a static table instead of DNS
+ */
+class MockedGeoSorter : public GeoSorter {
+ public:
+  explicit MockedGeoSorter(GeoDb *db) : GeoSorter(db), num_resolved(0) { }
+
+  map<string, string> addresses;
+  unsigned num_resolved;
+
+ protected:
+  virtual bool ResolveName(const string &name, string *address) {
+    num_resolved++;
+    map<string, string>::const_iterator iter = addresses.find(name);
+    if (iter == addresses.end())
+      return false;
+    *address = iter->second;
+    return true;
+  }
+};
+
+}  // anonymous namespace
+
+
+class T_Geo : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    GeoDb *db = new GeoDb();
+    // Geneva, Chicago, Tokyo, and an IPv6 network in Sydney
+    ASSERT_TRUE(db->AddNetwork("10.0.1.0/24", GeoDb::Location(46.2, 6.1)));
+    ASSERT_TRUE(db->AddNetwork("10.0.2.0/24", GeoDb::Location(41.9, -87.6)));
+    ASSERT_TRUE(db->AddNetwork("10.0.0.0/24", GeoDb::Location(35.7, 139.7)));
+    ASSERT_TRUE(db->AddNetwork("2001:db8::/32",
+                               GeoDb::Location(-33.9, 151.2)));
+    sorter_ = new MockedGeoSorter(db);
+    sorter_->addresses["cern.ch"] = "10.0.1.10";
+    sorter_->addresses["fnal.gov"] = "10.0.2.10";
+    sorter_->addresses["kek.jp"] = "10.0.0.10";
+    sorter_->addresses["aarnet.au"] = "2001:db8::10";
+    sorter_->addresses["10.0.1.20"] = "10.0.1.20";
+  }
+
+  virtual void TearDown() {
+    delete sorter_;
+  }
+
+  MockedGeoSorter *sorter_;
+};
+
+
+TEST_F(T_Geo, Database) {
+  GeoDb db;
+  EXPECT_TRUE(db.AddNetwork("192.168.0.0/16", GeoDb::Location(1.0, 2.0)));
+  EXPECT_TRUE(db.AddNetwork("10.1.2.3/8", GeoDb::Location(3.0, 4.0)));
+  EXPECT_TRUE(db.AddNetwork("2001:db8:1::/48", GeoDb::Location(5.0, 6.0)));
+  EXPECT_FALSE(db.AddNetwork("10.0.0.0", GeoDb::Location()));
+  EXPECT_FALSE(db.AddNetwork("10.0.0.0/33", GeoDb::Location()));
+  EXPECT_FALSE(db.AddNetwork("abc/8", GeoDb::Location()));
+  EXPECT_EQ(3U, db.size());
+
+  GeoDb::Location location;
+  EXPECT_TRUE(db.Lookup("192.168.255.1", &location));
+  EXPECT_DOUBLE_EQ(1.0, location.latitude);
+  EXPECT_DOUBLE_EQ(2.0, location.longitude);
+  EXPECT_TRUE(db.Lookup("10.0.0.0", &location));
+  EXPECT_DOUBLE_EQ(3.0, location.latitude);
+  EXPECT_TRUE(db.Lookup("10.255.255.255", &location));
+  EXPECT_TRUE(db.Lookup("2001:db8:1:ffff::1", &location));
+  EXPECT_DOUBLE_EQ(5.0, location.latitude);
+  EXPECT_FALSE(db.Lookup("11.0.0.0", &location));
+  EXPECT_FALSE(db.Lookup("9.255.255.255", &location));
+  EXPECT_FALSE(db.Lookup("2001:db8:2::1", &location));
+  EXPECT_FALSE(db.Lookup("::1", &location));
+  EXPECT_FALSE(db.Lookup("no-address", &location));
+
+  EXPECT_EQ(GeoDb::GetSubnet("10.1.2.3"), GeoDb::GetSubnet("10.1.2.200"));
+  EXPECT_NE(GeoDb::GetSubnet("10.1.2.3"), GeoDb::GetSubnet("10.1.3.3"));
+  EXPECT_EQ(GeoDb::GetSubnet("2001:db8:1::1"),
+            GeoDb::GetSubnet("2001:db8:1:2::1"));
+  EXPECT_EQ("", GeoDb::GetSubnet("cern.ch"));
+}
+
+
+TEST_F(T_Geo, LoadCsv) {
+  const string path = GetCurrentWorkingDirectory() + "/cvmfs_ut_geo.csv";
+  const string content =
+    "network,geoname_id,registered_country_geoname_id,latitude,longitude,"
+    "accuracy_radius\n"
+    "1.0.0.0/24,2077456,2077456,-33.4940,143.2104,1000\n"
+    "1.0.1.0/24,1814991,1814991,,,\n"
+    "1.0.4.0/22,2077456,2077456,-37.7000,145.1833,1000\n";
+  ASSERT_TRUE(SafeWriteToFile(content, path, 0600));
+  vector<string> paths;
+  paths.push_back(path);
+  paths.push_back(path + ".missing");
+  GeoDb *db = GeoDb::Load(paths);
+  unlink(path.c_str());
+  ASSERT_TRUE(db != NULL);
+  EXPECT_EQ(2U, db->size());
+  GeoDb::Location location;
+  EXPECT_TRUE(db->Lookup("1.0.6.1", &location));
+  EXPECT_NEAR(-37.7, location.latitude, 0.0001);
+  EXPECT_NEAR(145.1833, location.longitude, 0.0001);
+  EXPECT_FALSE(db->Lookup("1.0.1.1", &location));
+  delete db;
+
+  paths.erase(paths.begin());
+  EXPECT_TRUE(GeoDb::Load(paths) == NULL);
+}
+
+
+TEST_F(T_Geo, Sort) {
+  string reply;
+  // The caching string is not resolvable, the client is in Geneva
+  EXPECT_TRUE(sorter_->Sort("proxy/kek.jp,fnal.gov,cern.ch", "10.0.1.99", "",
+                            &reply));
+  EXPECT_EQ("3,2,1\n", reply);
+  // The last forwarded-for address is in Tokyo
+  EXPECT_TRUE(sorter_->Sort("proxy/cern.ch,fnal.gov,kek.jp", "10.0.1.99",
+                            "10.0.1.1, 10.0.0.1", &reply));
+  EXPECT_EQ("3,1,2\n", reply);
+  // The caching string resolves to Chicago
+  EXPECT_TRUE(sorter_->Sort("fnal.gov/kek.jp,cern.ch,fnal.gov", "10.0.0.1",
+                            "", &reply));
+  EXPECT_EQ("3,2,1\n", reply);
+  // Unknown servers go last, in the original order
+  EXPECT_TRUE(sorter_->Sort("x/unknown,kek.jp,bad_name,cern.ch", "2001:db8::1",
+                            "", &reply));
+  EXPECT_EQ("2,4,1,3\n", reply);
+
+  EXPECT_FALSE(sorter_->Sort("noslash", "10.0.1.99", "", &reply));
+  EXPECT_EQ("no slash in geo path", reply);
+  EXPECT_FALSE(sorter_->Sort("x/cern.ch", "192.168.1.1", "", &reply));
+  EXPECT_EQ("remote addr not found in database", reply);
+  EXPECT_FALSE(sorter_->Sort("x/unknown,other", "10.0.1.99", "", &reply));
+  EXPECT_EQ("no server addr found in database", reply);
+}
+
+
+TEST_F(T_Geo, ProxySeparator) {
+  string reply;
+  // The client is in Tokyo, its closest proxy in Geneva, so the hosts are
+  // sorted relative to Geneva
+  EXPECT_TRUE(sorter_->Sort(
+    "x/kek.jp,fnal.gov,cern.ch,+PXYSEP+,fnal.gov,10.0.1.20", "10.0.0.1", "",
+    &reply));
+  EXPECT_EQ("3,2,1,6,5,4\n", reply);
+  // Without a known proxy, the hosts are sorted relative to the client
+  EXPECT_TRUE(sorter_->Sort("x/cern.ch,kek.jp,+PXYSEP+,unknown", "10.0.0.1", "",
+                            &reply));
+  EXPECT_EQ("2,1,4,3\n", reply);
+}
+
+
+TEST_F(T_Geo, Cache) {
+  string reply;
+  EXPECT_TRUE(sorter_->Sort("proxy/kek.jp,cern.ch", "10.0.1.1", "", &reply));
+  const unsigned num_resolved = sorter_->num_resolved;
+  EXPECT_EQ(0U, sorter_->num_cache_hits());
+
+  // Same subnet and server list
+  EXPECT_TRUE(sorter_->Sort("proxy/kek.jp,cern.ch", "10.0.1.2", "", &reply));
+  EXPECT_EQ("2,1\n", reply);
+  EXPECT_EQ(1U, sorter_->num_cache_hits());
+  EXPECT_EQ(num_resolved, sorter_->num_resolved);
+
+  // Failures are cached, too
+  EXPECT_FALSE(sorter_->Sort("proxy/kek.jp", "192.168.0.1", "", &reply));
+  EXPECT_FALSE(sorter_->Sort("proxy/kek.jp", "192.168.0.2", "", &reply));
+  EXPECT_EQ("remote addr not found in database", reply);
+  EXPECT_EQ(2U, sorter_->num_cache_hits());
+
+  // Another subnet is sorted again but the server names are not resolved again
+  EXPECT_TRUE(sorter_->Sort("proxy/kek.jp,cern.ch", "10.0.0.1", "", &reply));
+  EXPECT_EQ("1,2\n", reply);
+  EXPECT_EQ(2U, sorter_->num_cache_hits());
+  EXPECT_EQ(num_resolved, sorter_->num_resolved);
+}
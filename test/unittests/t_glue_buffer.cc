@@ -6,6 +6,7 @@
 
 #include "glue_buffer.h"
 #include "shortstring.h"
+#include "util/string.h"
 
 namespace glue {
 
@@ -56,4 +57,161 @@ TEST_F(T_GlueBuffer, InodeTracker) {
   inode_tracker_.EndEnumerate(&cursor);
 }
 
+
+TEST_F(T_GlueBuffer, PathTracking) {
+  PathString path;
+  inode_tracker_.VfsGet(1, PathString(""));
+  inode_tracker_.VfsGet(2, PathString("/foo"));
+  inode_tracker_.VfsGetBy(4, 2, PathString("/foo/bar"));
+  EXPECT_EQ(1U, inode_tracker_.FindInode(PathString("")));
+  EXPECT_EQ(2U, inode_tracker_.FindInode(PathString("/foo")));
+  EXPECT_EQ(4U, inode_tracker_.FindInode(PathString("/foo/bar")));
+  EXPECT_EQ(0U, inode_tracker_.FindInode(PathString("/bar")));
+  EXPECT_TRUE(inode_tracker_.FindPath(4, &path));
+  EXPECT_EQ("/foo/bar", path.ToString());
+  EXPECT_FALSE(inode_tracker_.FindPath(3, &path));
+
+  // The parent path is kept as long as it is needed by its children
+  inode_tracker_.VfsPut(2, 1);
+  EXPECT_FALSE(inode_tracker_.FindPath(2, &path));
+  EXPECT_EQ(0U, inode_tracker_.FindInode(PathString("/foo")));
+  path.Clear();
+  EXPECT_TRUE(inode_tracker_.FindPath(4, &path));
+  EXPECT_EQ("/foo/bar", path.ToString());
+
+  inode_tracker_.VfsPut(4, 1);
+  EXPECT_EQ(4U, inode_tracker_.FindInode(PathString("/foo/bar")));
+  inode_tracker_.VfsPut(4, 1);
+  EXPECT_EQ(0U, inode_tracker_.FindInode(PathString("/foo/bar")));
+  EXPECT_FALSE(inode_tracker_.FindPath(4, &path));
+
+  // A path that is looked up again gets its inode back
+  inode_tracker_.VfsGet(2, PathString("/foo"));
+  EXPECT_EQ(2U, inode_tracker_.FindInode(PathString("/foo")));
+  InodeTracker::Statistics statistics = inode_tracker_.GetStatistics();
+  EXPECT_EQ(4, atomic_read64(&statistics.num_inserts));
+  EXPECT_EQ(2, atomic_read64(&statistics.num_removes));
+  EXPECT_EQ(2, atomic_read64(&statistics.num_references));
+}
+
+
+TEST_F(T_GlueBuffer, Compact) {
+  const unsigned kNumInodes = 50000;
+  const std::string prefix = "/a/long/directory/name/for/many/entries/";
+  inode_tracker_.VfsGet(1, PathString(""));
+  EXPECT_FALSE(inode_tracker_.Compact());
+  for (unsigned i = 2; i < kNumInodes; ++i) {
+    std::string path = prefix + StringifyInt(i);
+    inode_tracker_.VfsGet(i, PathString(path.data(), path.length()));
+  }
+  uint64_t bytes_full = inode_tracker_.bytes_allocated();
+  EXPECT_FALSE(inode_tracker_.Compact());
+
+  for (unsigned i = 2; i < kNumInodes - 10; ++i)
+    inode_tracker_.VfsPut(i, 1);
+  inode_tracker_.Compact();
+  EXPECT_LT(inode_tracker_.bytes_allocated(), bytes_full / 4);
+  EXPECT_FALSE(inode_tracker_.Compact());
+
+  PathString path;
+  for (unsigned i = kNumInodes - 10; i < kNumInodes; ++i) {
+    path.Clear();
+    EXPECT_TRUE(inode_tracker_.FindPath(i, &path));
+    EXPECT_EQ(prefix + StringifyInt(i), path.ToString());
+  }
+  const std::string last_path = prefix + StringifyInt(kNumInodes - 1);
+  EXPECT_EQ(kNumInodes - 1, inode_tracker_.FindInode(PathString(last_path)));
+}
+
+
+TEST_F(T_GlueBuffer, Swap) {
+  inode_tracker_.VfsGet(1, PathString(""));
+  inode_tracker_.VfsGet(2, PathString("/foo"));
+  inode_tracker_.VfsGetBy(4, 2, PathString("/foo/bar"));
+
+  InodeTracker saved_tracker;
+  saved_tracker.Swap(&inode_tracker_);
+  EXPECT_EQ(0U, inode_tracker_.FindInode(PathString("/foo")));
+  EXPECT_EQ(2U, saved_tracker.FindInode(PathString("/foo")));
+  InodeTracker::Statistics statistics = saved_tracker.GetStatistics();
+  EXPECT_EQ(3, atomic_read64(&statistics.num_inserts));
+  statistics = inode_tracker_.GetStatistics();
+  EXPECT_EQ(0, atomic_read64(&statistics.num_inserts));
+
+  InodeTracker restored_tracker;
+  restored_tracker.Swap(&saved_tracker);
+  PathString path;
+  EXPECT_TRUE(restored_tracker.FindPath(4, &path));
+  EXPECT_EQ("/foo/bar", path.ToString());
+  restored_tracker.VfsPut(4, 2);
+  EXPECT_EQ(0U, restored_tracker.FindInode(PathString("/foo/bar")));
+  restored_tracker.VfsGet(8, PathString("/foo/baz"));
+  EXPECT_EQ(8U, restored_tracker.FindInode(PathString("/foo/baz")));
+}
+
+
+TEST_F(T_GlueBuffer, StableInode) {
+  const shash::Md5 md5_foo(shash::AsciiPtr("/foo"));
+  const shash::Md5 md5_bar(shash::AsciiPtr("/bar"));
+  const uint64_t inode = inode_tracker_.FindStableInode(md5_foo, 1);
+  EXPECT_GE(inode, InodeTracker::kStableInodeBase);
+  EXPECT_EQ(inode, inode_tracker_.FindStableInode(md5_foo, 1));
+  EXPECT_NE(inode, inode_tracker_.FindStableInode(md5_foo, 2));
+  EXPECT_NE(inode, inode_tracker_.FindStableInode(md5_bar, 1));
+
+  // Inodes of the same path are reused, inodes of other paths are skipped
+  inode_tracker_.VfsGet(inode, PathString("/foo"));
+  EXPECT_EQ(inode, inode_tracker_.FindStableInode(md5_foo, 1));
+  inode_tracker_.VfsPut(inode, 1);
+  inode_tracker_.VfsGet(inode, PathString("/bar"));
+  const uint64_t collision = inode_tracker_.FindStableInode(md5_foo, 1);
+  EXPECT_NE(inode, collision);
+  EXPECT_GE(collision, InodeTracker::kStableInodeBase);
+  inode_tracker_.VfsPut(inode, 1);
+  EXPECT_EQ(inode, inode_tracker_.FindStableInode(md5_foo, 1));
+}
+
+
+TEST_F(T_GlueBuffer, PageCacheTracker) {
+  const shash::Any hash_a(shash::kSha1, shash::HexPtr(
+    "0123456789abcdef0123456789abcdef01234567"));
+  const shash::Any hash_b(shash::kSha1, shash::HexPtr(
+    "fedcba9876543210fedcba9876543210fedcba98"));
+  PageCacheTracker tracker;
+
+  // Unknown page cache content
+  EXPECT_FALSE(tracker.Open(1, hash_a));
+  EXPECT_TRUE(tracker.Open(1, hash_a));
+  tracker.Close(1);
+  tracker.Close(1);
+  EXPECT_TRUE(tracker.Open(1, hash_a));
+  tracker.Close(1);
+  EXPECT_FALSE(tracker.Open(1, hash_b));
+  tracker.Close(1);
+  EXPECT_TRUE(tracker.Open(1, hash_b));
+
+  // The old handle can still read the old content into the page cache
+  EXPECT_FALSE(tracker.Open(1, hash_a));
+  EXPECT_FALSE(tracker.Open(1, hash_a));
+  tracker.Close(1);
+  tracker.Close(1);
+  tracker.Close(1);
+  EXPECT_FALSE(tracker.Open(1, hash_a));
+  tracker.Close(1);
+  EXPECT_TRUE(tracker.Open(1, hash_a));
+  tracker.Close(1);
+
+  tracker.Evict(1);
+  EXPECT_FALSE(tracker.Open(1, hash_a));
+  tracker.Close(1);
+  // Handles from before a reload
+  tracker.Close(2);
+  EXPECT_FALSE(tracker.Open(2, hash_a));
+
+  PageCacheTracker::Statistics statistics = tracker.GetStatistics();
+  EXPECT_EQ(4U, statistics.n_keep);
+  EXPECT_EQ(7U, statistics.n_drop);
+  EXPECT_EQ(1U, statistics.n_stale);
+}
+
 }  // namespace glue
@@ -7,6 +7,7 @@
 #include <algorithm>
 
 #include "garbage_collection/hash_filter.h"
+#include "util/posix.h"
 
 static shash::Any sha(const std::string &hash,
                       const char suffix = shash::kSuffixNone) {
@@ -67,7 +68,9 @@ class T_HashFilter : public ::testing::Test {
   };
 };
 
-typedef ::testing::Types<SimpleHashFilter, SmallhashFilter> HashFilterTypes;
+typedef ::testing::Types<SimpleHashFilter,
+                         SmallhashFilter,
+                         CompactHashFilter> HashFilterTypes;
 TYPED_TEST_CASE(T_HashFilter, HashFilterTypes);
 
 
@@ -424,3 +427,56 @@ TYPED_TEST(T_HashFilter, FillManyRandomHashesSlow) {
 
   std::for_each(random_hashes.begin(), random_hashes.end(), check_contains);
 }
+
+
+static unsigned CountSpillFiles(const std::string &dir) {
+  const std::vector<std::string> files = FindFiles(dir, "");
+  unsigned result = 0;
+  for (unsigned i = 0; i < files.size(); ++i) {
+    if (files[i].find("/hashfilter") != std::string::npos)
+      result++;
+  }
+  return result;
+}
+
+
+TEST(T_CompactHashFilter, Spill) {
+  const std::string tmp_dir = CreateTempDir("./cvmfs_ut_hash_filter");
+  ASSERT_FALSE(tmp_dir.empty());
+
+  Prng rng;
+  rng.InitSeed(1337);
+  RandomHashGenerator random_hash_generator(rng);
+  const unsigned int hash_count = 100000;
+  std::vector<shash::Any> random_hashes(hash_count, shash::Any());
+  std::generate(random_hashes.begin(), random_hashes.end(),
+                random_hash_generator);
+
+  {
+    CompactHashFilter filter;
+    filter.SetMemoryLimit(64 * 1024, tmp_dir);
+    for (unsigned i = 0; i < hash_count; ++i) {
+      filter.Fill(random_hashes[i]);
+      // Duplicates in different runs
+      if (i % 2 == 0)
+        filter.Fill(random_hashes[i / 2]);
+    }
+    EXPECT_LT(0u, filter.num_runs());
+    EXPECT_LE(hash_count, filter.Count());
+    filter.Freeze();
+    EXPECT_EQ(0u, filter.num_runs());
+    EXPECT_EQ(hash_count, filter.Count());
+    EXPECT_EQ(1u, CountSpillFiles(tmp_dir));
+
+    for (unsigned i = 0; i < hash_count; ++i) {
+      EXPECT_TRUE(filter.Contains(random_hashes[i]));
+      EXPECT_TRUE(filter.Contains(shash::Any(random_hashes[i].algorithm,
+        shash::HexPtr(random_hashes[i].ToString()), shash::kSuffixCatalog)));
+    }
+    for (unsigned i = 0; i < hash_count; ++i) {
+      EXPECT_FALSE(filter.Contains(random_hash_generator()));
+    }
+  }
+  EXPECT_EQ(0u, CountSpillFiles(tmp_dir));
+  RemoveTree(tmp_dir);
+}
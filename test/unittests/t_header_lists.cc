@@ -46,6 +46,8 @@ TEST_F(T_HeaderLists, Intrinsics) {
 
   header_lists->GetList("Some: Header");
   EXPECT_EQ(header_lists->blocks_.size(), 2U);
+  EXPECT_EQ(2U * header_lists->kBlockSize * sizeof(curl_slist),
+            header_lists->bytes_allocated());
 
   delete header_lists;
 }
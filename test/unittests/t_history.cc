@@ -1662,5 +1662,58 @@ TYPED_TEST(T_History, UpgradeAndWriteLegacyVersion1Revision2) {
   EXPECT_EQ(1U, branches.size());
   EXPECT_EQ(History::Branch("", "", 0), branches[0]);
 
+  // Changes are recorded from the schema upgrade on
+  std::vector<std::string> changes;
+  uint64_t last_serial;
+  EXPECT_TRUE(history->ListTagChanges(0, &changes, &last_serial));
+  EXPECT_EQ(2U, changes.size());
+  EXPECT_EQ(2U, last_serial);
+
+  TestFixture::CloseHistory(history);
+}
+
+
+TYPED_TEST(T_History, ListTagChanges) {
+  const std::string hp = TestFixture::GetHistoryFilename();
+  History *history = TestFixture::CreateHistory(hp);
+  ASSERT_NE(static_cast<History*>(NULL), history);
+
+  std::vector<std::string> changes;
+  uint64_t last_serial = 1;
+  if (TestFixture::IsMocked()) {
+    // the mocked history does not record changes
+    EXPECT_FALSE(history->ListTagChanges(0, &changes, &last_serial));
+    TestFixture::CloseHistory(history);
+    return;
+  }
+
+  ASSERT_TRUE(history->ListTagChanges(0, &changes, &last_serial));
+  EXPECT_TRUE(changes.empty());
+  EXPECT_EQ(0U, last_serial);
+
+  ASSERT_TRUE(history->Insert(TestFixture::GetDummyTag("foo", 1)));
+  ASSERT_TRUE(history->Insert(TestFixture::GetDummyTag("bar", 2)));
+  ASSERT_TRUE(history->ListTagChanges(0, &changes, &last_serial));
+  ASSERT_EQ(2U, changes.size());
+  EXPECT_EQ("foo", changes[0]);
+  EXPECT_EQ("bar", changes[1]);
+  const uint64_t serial = last_serial;
+
+  ASSERT_TRUE(history->Remove("foo"));
+  changes.clear();
+  ASSERT_TRUE(history->ListTagChanges(serial, &changes, &last_serial));
+  ASSERT_EQ(1U, changes.size());
+  EXPECT_EQ("foo", changes[0]);
+  EXPECT_GT(last_serial, serial);
+
+  // Up to date
+  changes.clear();
+  ASSERT_TRUE(history->ListTagChanges(last_serial, &changes, &last_serial));
+  EXPECT_TRUE(changes.empty());
+
+  // The serial is from a different history
+  EXPECT_FALSE(history->ListTagChanges(last_serial + 1, &changes,
+                                       &last_serial));
+
   TestFixture::CloseHistory(history);
 }
@@ -0,0 +1,228 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "history_index.h"
+#include "prng.h"
+#include "util/pointer.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace history {
+
+class T_HistoryIndex : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    tmp_path_ = CreateTempPath("./cvmfs_ut_history_index", 0600);
+    ASSERT_FALSE(tmp_path_.empty());
+    delta_path_ = tmp_path_ + ".delta";
+    merged_path_ = tmp_path_ + ".merged";
+  }
+
+  virtual void TearDown() {
+    unlink(tmp_path_.c_str());
+    unlink(delta_path_.c_str());
+    unlink(merged_path_.c_str());
+  }
+
+  History::Tag MakeTag(const string &name, const unsigned revision,
+                       const time_t timestamp, const string &branch = "")
+  {
+    shash::Any hash(shash::kSha1, shash::kSuffixCatalog);
+    hash.Randomize(revision);
+    return History::Tag(name, hash, 1000 + revision, revision, timestamp,
+                        History::kChannelTrunk, "description", branch);
+  }
+
+  // Reference implementation of the GetByDate SQL query
+  bool FindByDate(const vector<History::Tag> &tags, const time_t timestamp,
+                  History::Tag *tag)
+  {
+    bool found = false;
+    for (unsigned i = 0; i < tags.size(); ++i) {
+      if (!tags[i].branch.empty() || (tags[i].timestamp > timestamp))
+        continue;
+      if (!found || (tags[i].revision > tag->revision)) {
+        *tag = tags[i];
+        found = true;
+      }
+    }
+    return found;
+  }
+
+  void ExpectSameTag(const History::Tag &expected, const History::Tag &tag) {
+    EXPECT_EQ(expected.name, tag.name);
+    EXPECT_EQ(expected.root_hash, tag.root_hash);
+    EXPECT_EQ(expected.size, tag.size);
+    EXPECT_EQ(expected.revision, tag.revision);
+    EXPECT_EQ(expected.timestamp, tag.timestamp);
+    EXPECT_EQ(expected.channel, tag.channel);
+    EXPECT_EQ(expected.branch, tag.branch);
+  }
+
+  string tmp_path_;
+  string delta_path_;
+  string merged_path_;
+};
+
+
+TEST_F(T_HistoryIndex, Empty) {
+  vector<History::Tag> tags;
+  ASSERT_TRUE(TagIndex::Write(tags, tmp_path_));
+  UniquePtr<TagIndex> index(TagIndex::Open(tmp_path_));
+  ASSERT_TRUE(index.IsValid());
+  EXPECT_EQ(0U, index->GetNumberOfTags());
+  History::Tag tag;
+  EXPECT_FALSE(index->GetByName("trunk", &tag));
+  EXPECT_FALSE(index->GetByDate(time(NULL), &tag));
+}
+
+
+TEST_F(T_HistoryIndex, GetByName) {
+  vector<History::Tag> tags;
+  tags.push_back(MakeTag("trunk", 10, 1000));
+  tags.push_back(MakeTag("trunk-previous", 9, 900));
+  tags.push_back(MakeTag("release-1.0", 5, 500));
+  tags.push_back(MakeTag("feature", 7, 700, "branch"));
+  ASSERT_TRUE(TagIndex::Write(tags, tmp_path_));
+
+  UniquePtr<TagIndex> index(TagIndex::Open(tmp_path_));
+  ASSERT_TRUE(index.IsValid());
+  EXPECT_EQ(TagIndex::kTypeFull, index->type());
+  EXPECT_EQ(4U, index->GetNumberOfTags());
+  History::Tag tag;
+  for (unsigned i = 0; i < tags.size(); ++i) {
+    EXPECT_TRUE(index->GetByName(tags[i].name, &tag));
+    ExpectSameTag(tags[i], tag);
+    EXPECT_TRUE(tag.description.empty());
+  }
+  EXPECT_FALSE(index->GetByName("trunk-", &tag));
+  EXPECT_FALSE(index->GetByName("", &tag));
+  EXPECT_FALSE(index->GetByName("zzz", &tag));
+}
+
+
+TEST_F(T_HistoryIndex, GetByDate) {
+  Prng prng;
+  prng.InitSeed(42);
+  vector<History::Tag> tags;
+  for (unsigned i = 0; i < 500; ++i) {
+    // Timestamps are not monotonic in the revision, e.g. after a rollback
+    tags.push_back(MakeTag("tag" + StringifyInt(i), i + 1,
+                           1000 + prng.Next(5000),
+                           (prng.Next(5) == 0) ? "branch" : ""));
+  }
+  ASSERT_TRUE(TagIndex::Write(tags, tmp_path_));
+  UniquePtr<TagIndex> index(TagIndex::Open(tmp_path_));
+  ASSERT_TRUE(index.IsValid());
+
+  History::Tag expected;
+  History::Tag tag;
+  for (time_t t = 900; t < 6100; t += 7) {
+    const bool found = FindByDate(tags, t, &expected);
+    ASSERT_EQ(found, index->GetByDate(t, &tag)) << t;
+    if (found) {
+      ExpectSameTag(expected, tag);
+    }
+  }
+}
+
+
+TEST_F(T_HistoryIndex, Delta) {
+  vector<History::Tag> base_tags;
+  base_tags.push_back(MakeTag("trunk", 10, 1000));
+  base_tags.push_back(MakeTag("trunk-previous", 9, 900));
+  base_tags.push_back(MakeTag("old", 3, 300));
+  base_tags.push_back(MakeTag("stable", 5, 500));
+
+  vector<History::Tag> tags;
+  tags.push_back(MakeTag("trunk", 11, 1100));
+  tags.push_back(MakeTag("trunk-previous", 10, 1000));
+  tags.push_back(MakeTag("stable", 5, 500));
+  tags.push_back(MakeTag("new", 11, 1100));
+
+  ASSERT_TRUE(TagIndex::Write(base_tags, tmp_path_));
+  ASSERT_TRUE(TagIndex::WriteDelta(base_tags, tags, delta_path_));
+  UniquePtr<TagIndex> delta(TagIndex::Open(delta_path_));
+  ASSERT_TRUE(delta.IsValid());
+  EXPECT_EQ(TagIndex::kTypeDelta, delta->type());
+  vector<History::Tag> changed;
+  EXPECT_TRUE(delta->List(&changed));
+  EXPECT_EQ(3U, changed.size());
+  vector<string> removed;
+  EXPECT_TRUE(delta->ListRemoved(&removed));
+  ASSERT_EQ(1U, removed.size());
+  EXPECT_EQ("old", removed[0]);
+  History::Tag tag;
+  EXPECT_FALSE(delta->GetByName("old", &tag));
+  EXPECT_FALSE(delta->GetByDate(2000, &tag));
+
+  UniquePtr<TagIndex> base(TagIndex::Open(tmp_path_));
+  ASSERT_TRUE(base.IsValid());
+  ASSERT_TRUE(TagIndex::ApplyDelta(*base, delta_path_, merged_path_));
+  UniquePtr<TagIndex> merged(TagIndex::Open(merged_path_));
+  ASSERT_TRUE(merged.IsValid());
+  EXPECT_EQ(4U, merged->GetNumberOfTags());
+  for (unsigned i = 0; i < tags.size(); ++i) {
+    EXPECT_TRUE(merged->GetByName(tags[i].name, &tag));
+    ExpectSameTag(tags[i], tag);
+  }
+  EXPECT_FALSE(merged->GetByName("old", &tag));
+  EXPECT_TRUE(merged->GetByDate(1050, &tag));
+  EXPECT_EQ("trunk-previous", tag.name);
+
+  // A full index is not a delta
+  EXPECT_FALSE(TagIndex::ApplyDelta(*base, tmp_path_, merged_path_));
+}
+
+
+TEST_F(T_HistoryIndex, Parse) {
+  vector<History::Tag> tags;
+  tags.push_back(MakeTag("trunk", 10, 1000));
+  ASSERT_TRUE(TagIndex::Write(tags, tmp_path_));
+  string content;
+  int fd = open(tmp_path_.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_TRUE(SafeReadToString(fd, &content));
+  close(fd);
+
+  unsigned char *buffer =
+    static_cast<unsigned char *>(malloc(content.length()));
+  memcpy(buffer, content.data(), content.length());
+  UniquePtr<TagIndex> index(TagIndex::Parse(buffer, content.length()));
+  ASSERT_TRUE(index.IsValid());
+  History::Tag tag;
+  EXPECT_TRUE(index->GetByName("trunk", &tag));
+  ExpectSameTag(tags[0], tag);
+
+  // Truncated
+  buffer = static_cast<unsigned char *>(malloc(content.length()));
+  memcpy(buffer, content.data(), content.length());
+  EXPECT_EQ(NULL, TagIndex::Parse(buffer, content.length() - 1));
+
+  // Name offset out of bounds
+  buffer = static_cast<unsigned char *>(malloc(content.length()));
+  memcpy(buffer, content.data(), content.length());
+  TagIndex::TagRecord *record = reinterpret_cast<TagIndex::TagRecord *>(
+    buffer + sizeof(TagIndex::IndexHeader));
+  record->name_offset = 1000;
+  EXPECT_EQ(NULL, TagIndex::Parse(buffer, content.length()));
+
+  // Not an index
+  EXPECT_TRUE(SafeWriteToFile("not an index", tmp_path_, 0600));
+  EXPECT_EQ(NULL, TagIndex::Open(tmp_path_));
+}
+
+}  // namespace history
@@ -0,0 +1,89 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "util/io_ring.h"
+#include "util/pointer.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+class T_IoRing : public ::testing::Test {
+ protected:
+  static const unsigned kNumFiles = 5;
+  static const unsigned kFileSize = 10000;
+
+  virtual void SetUp() {
+    for (unsigned i = 0; i < kNumFiles; ++i) {
+      const string path = CreateTempPath("./cvmfs_ut_io_ring", 0600);
+      ASSERT_FALSE(path.empty());
+      paths_.push_back(path);
+      string content;
+      for (unsigned j = 0; j < kFileSize; ++j)
+        content.push_back('a' + (i + j) % 26);
+      ASSERT_TRUE(SafeWriteToFile(content, path, 0600));
+      fds_.push_back(open(path.c_str(), O_RDONLY));
+      ASSERT_GE(fds_.back(), 0);
+    }
+  }
+
+  virtual void TearDown() {
+    for (unsigned i = 0; i < fds_.size(); ++i)
+      close(fds_[i]);
+    for (unsigned i = 0; i < paths_.size(); ++i)
+      unlink(paths_[i].c_str());
+  }
+
+  vector<string> paths_;
+  vector<int> fds_;
+};
+
+
+TEST_F(T_IoRing, Read) {
+  UniquePtr<IoRing> ring(IoRing::Create(4));
+  if (!ring.IsValid()) {
+    printf("Skipping, io_uring not available\n");
+    return;
+  }
+  EXPECT_EQ(4U, ring->depth());
+
+  // More requests than the ring depth, across files and up to the end of file
+  const unsigned kBlockSize = 4096;
+  vector<vector<char> > buffers;
+  vector<IoRing::Request> requests;
+  for (unsigned i = 0; i < kNumFiles; ++i) {
+    for (unsigned offset = 0; offset < kFileSize; offset += kBlockSize) {
+      buffers.push_back(vector<char>(kBlockSize));
+      requests.push_back(IoRing::Request(fds_[i], NULL, kBlockSize, offset));
+    }
+  }
+  for (unsigned i = 0; i < requests.size(); ++i)
+    requests[i].buffer = &buffers[i][0];
+  ring->Read(&requests);
+
+  for (unsigned i = 0; i < requests.size(); ++i) {
+    const unsigned file = i / 3;
+    const off_t offset = requests[i].offset;
+    const ssize_t expected =
+      std::min(static_cast<off_t>(kBlockSize), kFileSize - offset);
+    ASSERT_EQ(expected, requests[i].result);
+    for (unsigned j = 0; j < expected; ++j)
+      ASSERT_EQ('a' + (file + offset + j) % 26, buffers[i][j]);
+  }
+
+  vector<IoRing::Request> invalid;
+  char c;
+  invalid.push_back(IoRing::Request(-1, &c, 1, 0));
+  ring->Read(&invalid);
+  EXPECT_EQ(-EBADF, invalid[0].result);
+}
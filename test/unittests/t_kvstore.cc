@@ -7,6 +7,8 @@
 #include <string.h>
 #include <gtest/gtest.h>
 
+#include <vector>
+
 #include "cache.h"
 #include "hash.h"
 #include "kvstore.h"
@@ -161,4 +163,56 @@ TEST_F(T_MemoryKvStore, ShrinkTo) {
   EXPECT_EQ(malloc_size, store_.GetUsed());
 }
 
+TEST_F(T_MemoryKvStore, Slabs) {
+  const unsigned kHeapSize = 4 * 1024 * 1024;
+  MemoryKvStore store(cache_size, MemoryKvStore::kMallocHeap, kHeapSize,
+                      perf::StatisticsTemplate("slab", &statistics_));
+  perf::Counter *n_chunks_128 = statistics_.Lookup("slab.n_slab_chunks_128");
+  perf::Counter *n_compact = statistics_.Lookup("slab.n_compact");
+  ASSERT_TRUE(n_chunks_128 != NULL);
+  ASSERT_TRUE(n_compact != NULL);
+
+  const unsigned kSmallSize = 100;
+  const unsigned kLargeSize = 64 * 1024;
+  char data[kLargeSize];
+  char out[kLargeSize];
+  MemoryBuffer buf;
+  buf.address = data;
+  buf.id = a1_;
+  buf.size = kSmallSize;
+  memset(data, 1, kSmallSize);
+  EXPECT_EQ(0, store.Commit(buf));
+  EXPECT_EQ(1, n_chunks_128->Get());
+
+  // Large objects go to the heap and get compacted
+  vector<shash::Any> large_ids;
+  for (unsigned i = 0; i < 32; ++i) {
+    buf.id = a2_;
+    *(reinterpret_cast<uint32_t *>(buf.id.digest + 1)) += i;
+    buf.size = kLargeSize;
+    memset(data, i, kLargeSize);
+    EXPECT_EQ(0, store.Commit(buf));
+    large_ids.push_back(buf.id);
+  }
+  EXPECT_EQ(1, n_chunks_128->Get());
+  for (unsigned i = 0; i < large_ids.size(); i += 2)
+    EXPECT_TRUE(store.Delete(large_ids[i]));
+  buf.id = a2_;
+  buf.size = kLargeSize;
+  EXPECT_EQ(0, store.Commit(buf));
+  EXPECT_EQ(1, n_compact->Get());
+
+  EXPECT_EQ(kSmallSize, store.Read(a1_, out, kLargeSize, 0));
+  memset(data, 1, kSmallSize);
+  EXPECT_EQ(0, memcmp(data, out, kSmallSize));
+  for (unsigned i = 1; i < large_ids.size(); i += 2) {
+    EXPECT_EQ(kLargeSize, store.Read(large_ids[i], out, kLargeSize, 0));
+    memset(data, i, kLargeSize);
+    EXPECT_EQ(0, memcmp(data, out, kLargeSize));
+  }
+
+  EXPECT_TRUE(store.Delete(a1_));
+  EXPECT_EQ(0, n_chunks_128->Get());
+}
+
 }  // namespace kvstore
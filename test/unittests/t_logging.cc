@@ -4,6 +4,8 @@
 
 #include <gtest/gtest.h>
 
+#include <unistd.h>
+
 #include <cassert>
 #include <cstdio>
 #include <string>
@@ -92,6 +94,30 @@ TEST_F(T_Logging, MicroSyslogRotateSlow) {
 }
 
 
+TEST_F(T_Logging, SyslogRateLimit) {
+  SetLogMicroSyslog(tmp_path_ + "/usyslog");
+  SetLogSyslogRateLimit(3, 2);
+  for (unsigned i = 0; i < 5; ++i)
+    LogCvmfs(kLogCvmfs, kLogSyslog, "Line%u", i);
+  LogCvmfs(kLogCvmfs, kLogSyslogErr, "Error");
+  EXPECT_TRUE(SearchInFile(tmp_path_ + "/usyslog", "Line2"));
+  EXPECT_FALSE(SearchInFile(tmp_path_ + "/usyslog", "Line3"));
+  EXPECT_FALSE(SearchInFile(tmp_path_ + "/usyslog", "Line4"));
+  EXPECT_TRUE(SearchInFile(tmp_path_ + "/usyslog", "Error"));
+
+  sleep(3);
+  LogCvmfs(kLogCvmfs, kLogSyslog, "Next");
+  EXPECT_TRUE(SearchInFile(tmp_path_ + "/usyslog", "Next"));
+  EXPECT_TRUE(SearchInFile(tmp_path_ + "/usyslog",
+                           "2 messages suppressed by the rate limit"));
+
+  SetLogSyslogRateLimit(0, 60);
+  for (unsigned i = 0; i < 5; ++i)
+    LogCvmfs(kLogCvmfs, kLogSyslog, "Unlimited%u", i);
+  EXPECT_TRUE(SearchInFile(tmp_path_ + "/usyslog", "Unlimited4"));
+}
+
+
 TEST_F(T_Logging, Custom) {
   EXPECT_DEATH(LogCvmfs(kLogCvmfs, kLogCustom0, "Line"), ".*");
   EXPECT_DEATH(LogCvmfs(kLogCvmfs, kLogCustom1, "Line"), ".*");
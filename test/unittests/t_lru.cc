@@ -3,7 +3,9 @@
  */
 
 #include <gtest/gtest.h>
+#include <pthread.h>
 
+#include <set>
 #include <string>
 
 #include "lru.h"
@@ -11,11 +13,16 @@
 #include "util/string.h"
 
 using lru::LruCache;
+using lru::ShardedLruCache;
 
 static inline uint32_t hasher_int(const int &value) {
   return value;
 }
 
+static inline uint32_t hasher_int_spread(const int &value) {
+  return value * 2654435761U;
+}
+
 static const unsigned cache_size = 1024;
 const std::string name = "lru_cache";
 
@@ -569,3 +576,108 @@ TEST(T_LruCache, PauseAndResume) {
   EXPECT_TRUE(cache.IsEmpty());
   EXPECT_FALSE(cache.IsFull());
 }
+
+
+TEST(T_LruCache, Sharded) {
+  perf::Statistics statistics;
+  ShardedLruCache<int, std::string> small_cache(cache_size, -1, hasher_int,
+      perf::StatisticsTemplate("small", &statistics));
+  EXPECT_EQ(1U, small_cache.num_shards());
+
+  ShardedLruCache<int, std::string> cache(16 * cache_size, -1,
+      hasher_int_spread, perf::StatisticsTemplate(name, &statistics));
+  EXPECT_EQ(16U, cache.num_shards());
+  EXPECT_EQ(16 * cache_size, statistics.Lookup(name + ".sz_size")->Get());
+  EXPECT_TRUE(cache.IsEmpty());
+
+  for (int i = 0; i < 1000; ++i)
+    EXPECT_TRUE(cache.Insert(i, StringifyInt(i)));
+  EXPECT_FALSE(cache.Insert(0, "null"));
+  EXPECT_FALSE(cache.IsEmpty());
+
+  std::string v;
+  EXPECT_TRUE(cache.Lookup(0, &v));
+  EXPECT_EQ("null", v);
+  EXPECT_TRUE(cache.Lookup(999, &v));
+  EXPECT_EQ("999", v);
+  EXPECT_FALSE(cache.Lookup(1000, &v));
+  EXPECT_TRUE(cache.UpdateValue(999, "neunhundertneunundneunzig"));
+  EXPECT_TRUE(cache.Lookup(999, &v, false));
+  EXPECT_EQ("neunhundertneunundneunzig", v);
+  EXPECT_TRUE(cache.Forget(999));
+  EXPECT_FALSE(cache.Forget(999));
+  EXPECT_EQ(3, statistics.Lookup(name + ".n_hit")->Get());
+  EXPECT_EQ(1, statistics.Lookup(name + ".n_miss")->Get());
+  EXPECT_EQ(1000, statistics.Lookup(name + ".n_insert")->Get());
+  EXPECT_EQ(1, statistics.Lookup(name + ".n_forget")->Get());
+
+  cache.Pause();
+  EXPECT_FALSE(cache.Lookup(0, &v));
+  EXPECT_FALSE(cache.Insert(1000, "tausend"));
+  cache.Resume();
+  EXPECT_TRUE(cache.Lookup(0, &v));
+
+  cache.Drop();
+  EXPECT_TRUE(cache.IsEmpty());
+  EXPECT_EQ(1, statistics.Lookup(name + ".n_drop")->Get());
+  EXPECT_FALSE(cache.Lookup(0, &v));
+}
+
+
+TEST(T_LruCache, ShardedFilter) {
+  perf::Statistics statistics;
+  ShardedLruCache<int, std::string> cache(16 * cache_size, -1,
+      hasher_int_spread, perf::StatisticsTemplate(name, &statistics));
+  for (int i = 0; i < 1000; ++i)
+    cache.Insert(i, StringifyInt(i));
+
+  std::set<int> seen;
+  int key;
+  std::string value;
+  cache.FilterBegin();
+  while (cache.FilterNext()) {
+    cache.FilterGet(&key, &value);
+    EXPECT_EQ(StringifyInt(key), value);
+    seen.insert(key);
+    if (key % 2 == 0)
+      cache.FilterDelete();
+  }
+  cache.FilterEnd();
+  EXPECT_EQ(1000U, seen.size());
+
+  for (int i = 0; i < 1000; ++i)
+    EXPECT_EQ(i % 2 == 1, cache.Lookup(i, &value));
+}
+
+
+static void *MainShardedLookups(void *data) {
+  ShardedLruCache<int, int> *cache =
+    reinterpret_cast<ShardedLruCache<int, int> *>(data);
+  for (int i = 0; i < 100000; ++i) {
+    int key = i % 4096;
+    int value;
+    if (cache->Lookup(key, &value)) {
+      EXPECT_EQ(key, value);
+    } else {
+      cache->Insert(key, key);
+    }
+  }
+  return NULL;
+}
+
+TEST(T_LruCache, ShardedConcurrent) {
+  perf::Statistics statistics;
+  ShardedLruCache<int, int> cache(16 * cache_size, -1,
+      hasher_int_spread, perf::StatisticsTemplate(name, &statistics));
+  const unsigned kNumThreads = 8;
+  pthread_t threads[kNumThreads];
+  for (unsigned i = 0; i < kNumThreads; ++i) {
+    int retval = pthread_create(&threads[i], NULL, MainShardedLookups, &cache);
+    ASSERT_EQ(0, retval);
+  }
+  for (unsigned i = 0; i < kNumThreads; ++i)
+    pthread_join(threads[i], NULL);
+  EXPECT_EQ(kNumThreads * 100000,
+            statistics.Lookup(name + ".n_hit")->Get() +
+            statistics.Lookup(name + ".n_miss")->Get());
+}
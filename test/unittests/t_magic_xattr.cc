@@ -0,0 +1,57 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "magic_xattr.h"
+
+using namespace std;  // NOLINT
+
+
+TEST(T_MagicXattr, Lookup) {
+  for (unsigned i = kMagicXattrNone + 1; i < kMagicXattrNumEntries; ++i) {
+    const MagicXattr id = static_cast<MagicXattr>(i);
+    const string name = GetMagicXattrName(id);
+    EXPECT_EQ(id, LookupMagicXattr(name)) << name;
+  }
+
+  EXPECT_EQ(kMagicXattrPid, LookupMagicXattr("user.pid"));
+  EXPECT_EQ(kMagicXattrXfsrootRawlink, LookupMagicXattr("xfsroot.rawlink"));
+  EXPECT_EQ(kMagicXattrNone, LookupMagicXattr(""));
+  EXPECT_EQ(kMagicXattrNone, LookupMagicXattr("user.pi"));
+  EXPECT_EQ(kMagicXattrNone, LookupMagicXattr("user.pidx"));
+  EXPECT_EQ(kMagicXattrNone, LookupMagicXattr("pid"));
+  EXPECT_EQ(kMagicXattrNone, LookupMagicXattr("security.capability"));
+  EXPECT_EQ(kMagicXattrNone, LookupMagicXattr(string("user.pid\0", 9)));
+}
+
+
+TEST(T_MagicXattr, ParseStat) {
+  vector<MagicXattr> ids;
+  EXPECT_FALSE(ParseMagicXattrStat("user.pid", &ids));
+  EXPECT_FALSE(ParseMagicXattrStat("user.stat.", &ids));
+  EXPECT_FALSE(ParseMagicXattrStat("user.stat.pid,,nopen", &ids));
+  EXPECT_FALSE(ParseMagicXattrStat("user.stat.pid,unknown", &ids));
+  EXPECT_TRUE(ids.empty());
+  EXPECT_FALSE(ParseMagicXattrStat("user.stat.stat", &ids));
+  EXPECT_FALSE(ParseMagicXattrStat("user.stat.pubkeys", &ids));
+
+  EXPECT_TRUE(ParseMagicXattrStat("user.stat.pid,user.hash,xfsroot.rawlink",
+                                  &ids));
+  ASSERT_EQ(3U, ids.size());
+  EXPECT_EQ(kMagicXattrPid, ids[0]);
+  EXPECT_EQ(kMagicXattrHash, ids[1]);
+  EXPECT_EQ(kMagicXattrXfsrootRawlink, ids[2]);
+
+  EXPECT_TRUE(ParseMagicXattrStat("user.stat", &ids));
+  EXPECT_EQ(kMagicXattrNumEntries - 5U, ids.size());
+  for (unsigned i = 0; i < ids.size(); ++i) {
+    EXPECT_NE(kMagicXattrStat, ids[i]);
+    EXPECT_NE(kMagicXattrLhash, ids[i]);
+    EXPECT_NE(kMagicXattrPubkeys, ids[i]);
+  }
+}
@@ -257,3 +257,44 @@ TEST_F(T_MallocHeap, Expand) {
 
   EXPECT_DEATH(M.Expand(ptr, 4), ".*");
 }
+
+
+TEST_F(T_MallocHeap, HugePages) {
+  IntMap int_map;
+  // Not a multiple of the huge page size
+  MallocHeap M(kSmallArena + 4096,
+               int_map.MakeCallback(&IntMap::OnBlockMove, &int_map), true);
+  EXPECT_EQ(kSmallArena + 4096, M.capacity());
+
+  Prng prng;
+  prng.InitSeed(42);
+  const unsigned N = 100;
+  for (unsigned i = 0; i < N; ++i) {
+    unsigned size = sizeof(i) + 1024 + i * 8;
+    void *p = M.Allocate(size, &i, sizeof(i));
+    ASSERT_TRUE(p != NULL);
+    FillRandomly(reinterpret_cast<unsigned char *>(p) + sizeof(i),
+                 size - sizeof(i), &prng);
+    int_map.mem_digest[i] = IntMap::Info(p, MemChecksum(p, size));
+  }
+  for (unsigned i = 0; i < N; i += 2) {
+    M.MarkFree(int_map.mem_digest[i].ptr);
+    int_map.mem_digest.erase(i);
+  }
+  M.Compact();
+  EXPECT_GT(int_map.num_moves, 0U);
+  for (map<unsigned, IntMap::Info>::const_iterator i =
+       int_map.mem_digest.begin(), iEnd = int_map.mem_digest.end();
+       i != iEnd; ++i)
+  {
+    unsigned size = sizeof(unsigned) + 1024 + i->first * 8;
+    EXPECT_EQ(i->second.checksum, MemChecksum(i->second.ptr, size));
+  }
+
+  // Fill up to the requested capacity, not to the rounded up mapping
+  unsigned id = N;
+  void *p = M.Allocate(M.capacity() - M.compacted_bytes() - 16,
+                       &id, sizeof(id));
+  EXPECT_TRUE(p != NULL);
+  memset(p, 0xAA, M.GetSize(p));
+}
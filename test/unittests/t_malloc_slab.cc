@@ -0,0 +1,105 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include "malloc_slab.h"
+
+using namespace std;  // NOLINT
+
+static const unsigned kNumSlabs = 4;
+
+class T_MallocSlab : public ::testing::Test {
+ protected:
+  T_MallocSlab() : slab_(kNumSlabs * MallocSlab::kSlabSize) { }
+
+  MallocSlab slab_;
+};
+
+
+TEST_F(T_MallocSlab, Classes) {
+  EXPECT_EQ(0U, MallocSlab::GetClass(1));
+  EXPECT_EQ(0U, MallocSlab::GetClass(64));
+  EXPECT_EQ(1U, MallocSlab::GetClass(65));
+  EXPECT_EQ(MallocSlab::kNumClasses - 1,
+            MallocSlab::GetClass(MallocSlab::kMaxChunkSize));
+  EXPECT_EQ(MallocSlab::kNumClasses,
+            MallocSlab::GetClass(MallocSlab::kMaxChunkSize + 1));
+  EXPECT_EQ(MallocSlab::kMaxChunkSize,
+            MallocSlab::GetChunkSize(MallocSlab::kNumClasses - 1));
+}
+
+
+TEST_F(T_MallocSlab, Basic) {
+  EXPECT_EQ(kNumSlabs * MallocSlab::kSlabSize, slab_.capacity());
+  EXPECT_EQ(kNumSlabs, slab_.num_free_slabs());
+  EXPECT_EQ(NULL, slab_.Allocate(MallocSlab::kMaxChunkSize + 1));
+
+  void *p1 = slab_.Allocate(10);
+  void *p2 = slab_.Allocate(100);
+  void *p3 = slab_.Allocate(100);
+  ASSERT_TRUE(p1 != NULL);
+  ASSERT_TRUE(p2 != NULL);
+  ASSERT_TRUE(p3 != NULL);
+  EXPECT_TRUE(slab_.Contains(p1));
+  EXPECT_FALSE(slab_.Contains(&p1));
+  EXPECT_EQ(0U, slab_.GetClassOf(p1));
+  EXPECT_EQ(1U, slab_.GetClassOf(p2));
+  EXPECT_EQ(1U, slab_.num_chunks(0));
+  EXPECT_EQ(2U, slab_.num_chunks(1));
+  EXPECT_EQ(kNumSlabs - 2, slab_.num_free_slabs());
+  memset(p2, 1, 100);
+  memset(p3, 2, 100);
+  EXPECT_EQ(128, reinterpret_cast<char *>(p3) - reinterpret_cast<char *>(p2));
+
+  // Freed chunks are reused first
+  slab_.MarkFree(p2);
+  EXPECT_EQ(p2, slab_.Allocate(128));
+  slab_.MarkFree(p2);
+  slab_.MarkFree(p3);
+  EXPECT_EQ(0U, slab_.num_chunks(1));
+  EXPECT_EQ(kNumSlabs - 1, slab_.num_free_slabs());
+  slab_.MarkFree(p1);
+  EXPECT_EQ(kNumSlabs, slab_.num_free_slabs());
+}
+
+
+TEST_F(T_MallocSlab, Exhaust) {
+  const unsigned chunks_per_slab =
+    MallocSlab::kSlabSize / MallocSlab::kMaxChunkSize;
+  vector<void *> chunks;
+  set<void *> unique_chunks;
+  void *p;
+  while ((p = slab_.Allocate(MallocSlab::kMaxChunkSize)) != NULL) {
+    memset(p, chunks.size() % 256, MallocSlab::kMaxChunkSize);
+    chunks.push_back(p);
+    unique_chunks.insert(p);
+  }
+  EXPECT_EQ(kNumSlabs * chunks_per_slab, chunks.size());
+  EXPECT_EQ(chunks.size(), unique_chunks.size());
+  EXPECT_EQ(0U, slab_.num_free_slabs());
+  EXPECT_EQ(NULL, slab_.Allocate(1));
+
+  // Emptying a slab makes it available to other size classes
+  for (unsigned i = 0; i < chunks_per_slab; ++i)
+    slab_.MarkFree(chunks[i]);
+  EXPECT_EQ(1U, slab_.num_free_slabs());
+  p = slab_.Allocate(1);
+  EXPECT_TRUE(p != NULL);
+  EXPECT_EQ(0U, slab_.GetClassOf(p));
+  EXPECT_EQ(0U, slab_.num_free_slabs());
+
+  // A full slab with a freed chunk takes allocations again
+  slab_.MarkFree(chunks[chunks_per_slab]);
+  EXPECT_EQ(chunks[chunks_per_slab],
+            slab_.Allocate(MallocSlab::kMaxChunkSize));
+  for (unsigned i = chunks_per_slab + 1; i < chunks.size(); ++i) {
+    EXPECT_EQ(static_cast<char>(i % 256),
+              *reinterpret_cast<char *>(chunks[i]));
+  }
+}
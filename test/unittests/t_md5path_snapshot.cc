@@ -0,0 +1,101 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "directory_entry.h"
+#include "hash.h"
+#include "lru_md.h"
+#include "md5path_snapshot.h"
+#include "statistics.h"
+#include "util/pointer.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+class T_Md5PathSnapshot : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    tmp_path_ = CreateTempDir(GetCurrentWorkingDirectory() +
+                              "/cvmfs_ut_md5path_snapshot");
+    snapshot_path_ = tmp_path_ + "/snapshot";
+    root_hash_ = shash::Any(shash::kSha1);
+    root_hash_.Randomize(1);
+    md5path_cache_ = new lru::Md5PathCache(1024, &statistics_);
+  }
+
+  virtual void TearDown() {
+    delete md5path_cache_;
+    if (tmp_path_ != "")
+      RemoveTree(tmp_path_);
+  }
+
+  static shash::Md5 Md5(const string &path) {
+    return shash::Md5(path.data(), path.length());
+  }
+
+  string tmp_path_;
+  string snapshot_path_;
+  shash::Any root_hash_;
+  perf::Statistics statistics_;
+  lru::Md5PathCache *md5path_cache_;
+};
+
+
+TEST_F(T_Md5PathSnapshot, Missing) {
+  EXPECT_EQ(NULL, Md5PathSnapshot::Open(snapshot_path_, root_hash_));
+  EXPECT_TRUE(SafeWriteToFile("garbage", snapshot_path_, 0600));
+  EXPECT_EQ(NULL, Md5PathSnapshot::Open(snapshot_path_, root_hash_));
+}
+
+
+TEST_F(T_Md5PathSnapshot, WriteOpen) {
+  EXPECT_TRUE(md5path_cache_->InsertNegative(Md5("/neg1")));
+  EXPECT_TRUE(md5path_cache_->InsertNegative(Md5("/neg2")));
+  catalog::DirectoryEntry dirent;
+  EXPECT_TRUE(md5path_cache_->Insert(Md5("/pos"), dirent));
+  EXPECT_TRUE(Md5PathSnapshot::Write(snapshot_path_, root_hash_,
+                                     md5path_cache_, NULL));
+
+  UniquePtr<Md5PathSnapshot> snapshot(
+    Md5PathSnapshot::Open(snapshot_path_, root_hash_));
+  ASSERT_TRUE(snapshot.IsValid());
+  EXPECT_EQ(2U, snapshot->size());
+  EXPECT_TRUE(snapshot->IsNegative(Md5("/neg1")));
+  EXPECT_TRUE(snapshot->IsNegative(Md5("/neg2")));
+  EXPECT_FALSE(snapshot->IsNegative(Md5("/pos")));
+  EXPECT_FALSE(snapshot->IsNegative(Md5("/unknown")));
+
+  // Different root catalog
+  shash::Any other_root_hash(shash::kSha1);
+  other_root_hash.Randomize(2);
+  EXPECT_EQ(NULL, Md5PathSnapshot::Open(snapshot_path_, other_root_hash));
+}
+
+
+TEST_F(T_Md5PathSnapshot, Merge) {
+  EXPECT_TRUE(md5path_cache_->InsertNegative(Md5("/neg1")));
+  EXPECT_TRUE(Md5PathSnapshot::Write(snapshot_path_, root_hash_,
+                                     md5path_cache_, NULL));
+  UniquePtr<Md5PathSnapshot> previous(
+    Md5PathSnapshot::Open(snapshot_path_, root_hash_));
+  ASSERT_TRUE(previous.IsValid());
+
+  md5path_cache_->Drop();
+  EXPECT_TRUE(md5path_cache_->InsertNegative(Md5("/neg1")));
+  EXPECT_TRUE(md5path_cache_->InsertNegative(Md5("/neg2")));
+  // Replaces the file that is still mapped by previous
+  EXPECT_TRUE(Md5PathSnapshot::Write(snapshot_path_, root_hash_,
+                                     md5path_cache_, previous.weak_ref()));
+  EXPECT_TRUE(previous->IsNegative(Md5("/neg1")));
+
+  UniquePtr<Md5PathSnapshot> snapshot(
+    Md5PathSnapshot::Open(snapshot_path_, root_hash_));
+  ASSERT_TRUE(snapshot.IsValid());
+  EXPECT_EQ(2U, snapshot->size());
+  EXPECT_TRUE(snapshot->IsNegative(Md5("/neg1")));
+  EXPECT_TRUE(snapshot->IsNegative(Md5("/neg2")));
+}
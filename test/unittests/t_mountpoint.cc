@@ -481,6 +481,11 @@ TEST_F(T_MountPoint, TieredComplex) {
     EXPECT_EQ(kRamCacheManager, upper->lower_->id());
     EXPECT_EQ(kPosixCacheManager, lower->upper_->id());
     EXPECT_EQ(kPosixCacheManager, lower->lower_->id());
+    EXPECT_EQ(TieredCacheManager::kLowerFdFlag,
+              reinterpret_cast<TieredCacheManager *>(
+                fs->cache_mgr())->lower_fd_flag_);
+    EXPECT_EQ(TieredCacheManager::kLowerFdFlag >> 1, upper->lower_fd_flag_);
+    EXPECT_EQ(TieredCacheManager::kLowerFdFlag >> 1, lower->lower_fd_flag_);
   }
 }
 
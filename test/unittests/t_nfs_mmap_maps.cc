@@ -0,0 +1,110 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <string>
+
+#include "nfs_mmap_maps.h"
+#include "shortstring.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+class T_NfsMmapMaps : public ::testing::Test {
+ protected:
+  static const uint64_t kRootInode = 256;
+  static const unsigned kNumPaths = 20000;
+
+  virtual void SetUp() {
+    tmp_path_ = CreateTempDir("./cvmfs_ut_nfs_mmap_maps");
+    ASSERT_FALSE(tmp_path_.empty());
+  }
+
+  virtual void TearDown() {
+    RemoveTree(tmp_path_);
+  }
+
+  static PathString MkPath(const unsigned i) {
+    const string path = "/software/x86_64/" + StringifyInt(i);
+    return PathString(path.data(), path.length());
+  }
+
+  /**
+   * Issues kNumPaths inodes, enough to grow all the files
+   */
+  void Populate() {
+    for (unsigned i = 0; i < kNumPaths; ++i)
+      EXPECT_EQ(kRootInode + 1 + i, nfs_mmap_maps::GetInode(MkPath(i)));
+  }
+
+  void Verify() {
+    EXPECT_EQ(kRootInode, nfs_mmap_maps::GetInode(PathString("", 0)));
+    PathString path;
+    for (unsigned i = 0; i < kNumPaths; ++i) {
+      EXPECT_EQ(kRootInode + 1 + i, nfs_mmap_maps::GetInode(MkPath(i)));
+      EXPECT_TRUE(nfs_mmap_maps::GetPath(kRootInode + 1 + i, &path));
+      EXPECT_EQ(MkPath(i), path);
+    }
+    EXPECT_FALSE(nfs_mmap_maps::GetPath(kRootInode + 1 + kNumPaths, &path));
+    EXPECT_FALSE(nfs_mmap_maps::GetPath(kRootInode - 1, &path));
+  }
+
+  string tmp_path_;
+};
+
+const uint64_t T_NfsMmapMaps::kRootInode;
+const unsigned T_NfsMmapMaps::kNumPaths;
+
+
+TEST_F(T_NfsMmapMaps, Basic) {
+  ASSERT_TRUE(nfs_mmap_maps::Init(tmp_path_, kRootInode, false));
+  PathString path;
+  EXPECT_TRUE(nfs_mmap_maps::GetPath(kRootInode, &path));
+  EXPECT_TRUE(path.IsEmpty());
+  Populate();
+  Verify();
+  nfs_mmap_maps::Fini();
+}
+
+
+TEST_F(T_NfsMmapMaps, Persistence) {
+  ASSERT_TRUE(nfs_mmap_maps::Init(tmp_path_, kRootInode, false));
+  nfs_mmap_maps::Spawn();
+  Populate();
+  nfs_mmap_maps::Fini();
+
+  ASSERT_TRUE(nfs_mmap_maps::Init(tmp_path_, kRootInode, false));
+  Verify();
+  EXPECT_EQ(kRootInode + 1 + kNumPaths,
+            nfs_mmap_maps::GetInode(MkPath(kNumPaths)));
+  nfs_mmap_maps::Fini();
+}
+
+
+TEST_F(T_NfsMmapMaps, Rebuild) {
+  ASSERT_TRUE(nfs_mmap_maps::Init(tmp_path_, kRootInode, false));
+  Populate();
+  nfs_mmap_maps::Fini();
+
+  // Requested rebuild, e.g. after a crash
+  ASSERT_TRUE(nfs_mmap_maps::Init(tmp_path_, kRootInode, true));
+  Verify();
+  nfs_mmap_maps::Fini();
+
+  // Lost path table
+  EXPECT_EQ(0, unlink((tmp_path_ + "/paths.idx").c_str()));
+  ASSERT_TRUE(nfs_mmap_maps::Init(tmp_path_, kRootInode, false));
+  Verify();
+  nfs_mmap_maps::Fini();
+
+  // Index of a different root inode
+  ASSERT_TRUE(nfs_mmap_maps::Init(tmp_path_, kRootInode + 1, false));
+  EXPECT_EQ(kRootInode + 1, nfs_mmap_maps::GetInode(PathString("", 0)));
+  EXPECT_EQ(kRootInode + 2, nfs_mmap_maps::GetInode(MkPath(0)));
+  nfs_mmap_maps::Fini();
+}
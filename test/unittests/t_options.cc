@@ -220,3 +220,51 @@ TYPED_TEST(T_Options, TaintEnvironment) {
   EXPECT_TRUE(options_manager.GetValue("NO_SUCH_OPTION_NOTAINT", &arg));
   EXPECT_EQ(NULL, getenv("NO_SUCH_OPTION_NOTAINT"));
 }
+
+
+TEST(T_BashOptions, LiteralValues) {
+  const string literal =
+    "# comment\n"
+    "A=1\n"
+    "export B=\"two words\"\n"
+    "C='$HOME'  # single quotes\n"
+    "D=x#y\n"
+    "E=\n"
+    "F=\"http://a;http://b|DIRECT\"\n";
+  string literal_file;
+  FILE *f = CreateTempFile("./cvmfs_ut_options", 0600, "w", &literal_file);
+  ASSERT_TRUE(f != NULL);
+  UnlinkGuard literal_guard(literal_file);
+  ASSERT_EQ(literal.length(), fwrite(literal.data(), 1, literal.length(), f));
+  fclose(f);
+
+  // A command forces the evaluation with a shell
+  string shell_file;
+  f = CreateTempFile("./cvmfs_ut_options", 0600, "w", &shell_file);
+  ASSERT_TRUE(f != NULL);
+  UnlinkGuard shell_guard(shell_file);
+  const string shell = literal + "true\n";
+  ASSERT_EQ(shell.length(), fwrite(shell.data(), 1, shell.length(), f));
+  fclose(f);
+
+  BashOptionsManager options_literal;
+  options_literal.set_taint_environment(false);
+  options_literal.ParsePath(literal_file, false);
+  BashOptionsManager options_shell;
+  options_shell.set_taint_environment(false);
+  options_shell.ParsePath(shell_file, false);
+
+  const char *keys[] = {"A", "B", "C", "D", "E", "F"};
+  for (unsigned i = 0; i < sizeof(keys) / sizeof(keys[0]); ++i) {
+    string value_literal;
+    string value_shell;
+    EXPECT_TRUE(options_literal.GetValue(keys[i], &value_literal)) << keys[i];
+    EXPECT_TRUE(options_shell.GetValue(keys[i], &value_shell)) << keys[i];
+    EXPECT_EQ(value_shell, value_literal) << keys[i];
+  }
+  string value;
+  EXPECT_TRUE(options_literal.GetValue("C", &value));
+  EXPECT_EQ("$HOME", value);
+  EXPECT_TRUE(options_literal.GetValue("F", &value));
+  EXPECT_EQ("http://a;http://b|DIRECT", value);
+}
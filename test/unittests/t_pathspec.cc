@@ -338,6 +338,39 @@ TEST(T_Pathspec, MatchWithWildcard) {
 }
 
 
+TEST(T_Pathspec, MatchWithBacktracking) {
+  const Pathspec p1("/a*b*c");
+  const Pathspec p2("/*ab?");
+  const Pathspec p3("/src/**.cc");
+  const Pathspec p4("/lit*");
+
+  EXPECT_TRUE(p1.IsMatching("/abc"));
+  EXPECT_TRUE(p1.IsMatching("/aXbYbZc"));
+  EXPECT_TRUE(p1.IsMatching("/abcbc/"));
+  EXPECT_FALSE(p1.IsMatching("/aXbYbZcd"));
+  EXPECT_FALSE(p1.IsMatching("/acb"));
+  EXPECT_TRUE(p1.IsMatchingRelaxed("/a/b/c"));
+  EXPECT_FALSE(p1.IsMatchingRelaxed("/a/b/c/d"));
+
+  EXPECT_TRUE(p2.IsMatching("/aaabx"));
+  EXPECT_TRUE(p2.IsMatching("/abababx"));
+  EXPECT_FALSE(p2.IsMatching("/aaab"));
+  EXPECT_FALSE(p2.IsMatching("/ab/"));
+  EXPECT_FALSE(p2.IsMatchingRelaxed("/x/ab/"));
+  EXPECT_TRUE(p2.IsMatchingRelaxed("/x/abc/"));
+
+  EXPECT_TRUE(p3.IsMatching("/src/main.cc"));
+  EXPECT_TRUE(p3.IsMatching("/src/.cc"));
+  EXPECT_FALSE(p3.IsMatching("/src/util/main.cc"));
+  EXPECT_TRUE(p3.IsMatchingRelaxed("/src/util/main.cc"));
+
+  EXPECT_TRUE(p4.IsMatching("/lit"));
+  EXPECT_TRUE(p4.IsMatching("/literal"));
+  EXPECT_FALSE(p4.IsMatching("/li"));
+  EXPECT_FALSE(p4.IsMatching("/lIteral"));
+}
+
+
 TEST(T_Pathspec, MatchWithPlaceholders) {
   const Pathspec p1("/hallo/welt.???");
   const Pathspec p2("f?o/b?r");
@@ -0,0 +1,121 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "file_processing/processing_policy.h"
+#include "util/pointer.h"
+
+using namespace std;  // NOLINT
+
+namespace upload {
+
+class T_ProcessingPolicy : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    defaults.compression_alg = zlib::kZlibDefault;
+    defaults.use_chunking = true;
+    defaults.chunking_algorithm = SpoolerDefinition::kChunkingXor32;
+    defaults.min_chunk_size = 4 * 1024 * 1024;
+    defaults.avg_chunk_size = 8 * 1024 * 1024;
+    defaults.max_chunk_size = 16 * 1024 * 1024;
+  }
+
+  ProcessingPolicy::Settings Apply(const ProcessingPolicy &policy,
+                                   const string &path)
+  {
+    ProcessingPolicy::Settings settings(defaults);
+    policy.Apply(path, &settings);
+    return settings;
+  }
+
+  ProcessingPolicy::Settings defaults;
+};
+
+
+TEST_F(T_ProcessingPolicy, Parse) {
+  UniquePtr<ProcessingPolicy> policy(ProcessingPolicy::CreateFromString(""));
+  ASSERT_TRUE(policy.IsValid());
+  EXPECT_EQ(0u, policy->GetNumberOfRules());
+
+  policy = ProcessingPolicy::CreateFromString(
+    "# comment\n"
+    "\n"
+    "  *.gz \t compression=none  # already compressed\n"
+    "/data/*.root chunking=fastcdc chunk_size=1048576 sample=90\n"
+    "/logs compression=zlib chunking=off\n");
+  ASSERT_TRUE(policy.IsValid());
+  EXPECT_EQ(3u, policy->GetNumberOfRules());
+  EXPECT_FALSE(policy->GetFingerprint().empty());
+}
+
+
+TEST_F(T_ProcessingPolicy, ParseErrors) {
+  EXPECT_EQ(NULL, ProcessingPolicy::CreateFromString("*.gz\n"));
+  EXPECT_EQ(NULL, ProcessingPolicy::CreateFromString("*.gz none\n"));
+  EXPECT_EQ(NULL, ProcessingPolicy::CreateFromString("*.gz =none\n"));
+  EXPECT_EQ(NULL, ProcessingPolicy::CreateFromString("*.gz compression=\n"));
+  EXPECT_EQ(NULL, ProcessingPolicy::CreateFromString("*.gz compression=xz\n"));
+  EXPECT_EQ(NULL, ProcessingPolicy::CreateFromString("*.gz chunking=on\n"));
+  EXPECT_EQ(NULL, ProcessingPolicy::CreateFromString("*.gz chunk_size=16\n"));
+  EXPECT_EQ(NULL, ProcessingPolicy::CreateFromString("*.gz chunk_size=x\n"));
+  EXPECT_EQ(NULL, ProcessingPolicy::CreateFromString("*.gz sample=101\n"));
+  EXPECT_EQ(NULL, ProcessingPolicy::CreateFromString("*.gz colour=red\n"));
+  EXPECT_EQ(NULL, ProcessingPolicy::CreateFromString(
+    "*.gz compression=none\n"
+    "*.xz compression=unknown\n"));
+}
+
+
+TEST_F(T_ProcessingPolicy, Fingerprint) {
+  UniquePtr<ProcessingPolicy> policy1(
+    ProcessingPolicy::CreateFromString("*.gz compression=none\n"));
+  UniquePtr<ProcessingPolicy> policy2(
+    ProcessingPolicy::CreateFromString("*.gz compression=none\n"));
+  UniquePtr<ProcessingPolicy> policy3(
+    ProcessingPolicy::CreateFromString("*.gz compression=zlib\n"));
+  ASSERT_TRUE(policy1.IsValid());
+  ASSERT_TRUE(policy2.IsValid());
+  ASSERT_TRUE(policy3.IsValid());
+  EXPECT_EQ(policy1->GetFingerprint(), policy2->GetFingerprint());
+  EXPECT_NE(policy1->GetFingerprint(), policy3->GetFingerprint());
+}
+
+
+TEST_F(T_ProcessingPolicy, Apply) {
+  UniquePtr<ProcessingPolicy> policy(ProcessingPolicy::CreateFromString(
+    "*         sample=90\n"
+    "*.gz      compression=none sample=0\n"
+    "/data/*   chunking=fastcdc chunk_size=1048576\n"
+    "/data/small/*  chunking=off\n"));
+  ASSERT_TRUE(policy.IsValid());
+
+  ProcessingPolicy::Settings settings = Apply(*policy, "/README");
+  EXPECT_EQ(zlib::kZlibDefault, settings.compression_alg);
+  EXPECT_EQ(90u, settings.sample_threshold);
+  EXPECT_TRUE(settings.use_chunking);
+  EXPECT_EQ(SpoolerDefinition::kChunkingXor32, settings.chunking_algorithm);
+  EXPECT_EQ(defaults.avg_chunk_size, settings.avg_chunk_size);
+
+  settings = Apply(*policy, "/sw/archive.tar.gz");
+  EXPECT_EQ(zlib::kNoCompression, settings.compression_alg);
+  EXPECT_EQ(0u, settings.sample_threshold);
+
+  settings = Apply(*policy, "/data/run1/events");
+  EXPECT_EQ(zlib::kZlibDefault, settings.compression_alg);
+  EXPECT_TRUE(settings.use_chunking);
+  EXPECT_EQ(SpoolerDefinition::kChunkingFastCdc, settings.chunking_algorithm);
+  EXPECT_EQ(512u * 1024u, settings.min_chunk_size);
+  EXPECT_EQ(1024u * 1024u, settings.avg_chunk_size);
+  EXPECT_EQ(2048u * 1024u, settings.max_chunk_size);
+
+  settings = Apply(*policy, "/data/small/events.gz");
+  EXPECT_EQ(zlib::kNoCompression, settings.compression_alg);
+  EXPECT_FALSE(settings.use_chunking);
+  EXPECT_EQ(1024u * 1024u, settings.avg_chunk_size);
+}
+
+}  // namespace upload
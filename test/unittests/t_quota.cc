@@ -18,6 +18,8 @@
 #include "quota_posix.h"
 #include "testutil.h"
 #include "util/algorithm.h"
+#include "util/posix.h"
+#include "util_concurrency.h"
 
 using namespace std;  // NOLINT
 
@@ -142,6 +144,41 @@ TEST_F(T_QuotaManager, BroadcastBackchannels) {
 }
 
 
+TEST_F(T_QuotaManager, BackgroundCleanup) {
+  // Ten files of 950k exceed the watermark (9M) but not the limit (10M)
+  const uint64_t size = 950*1024;
+  const unsigned N = 10;
+  vector<shash::Any> hashes;
+  for (unsigned i = 0; i < N; ++i) {
+    hashes.push_back(shash::Any(shash::kSha1));
+    hashes[i].Randomize(&prng_);
+    CreateFile(tmp_path_ + "/" + hashes[i].MakePath(), 0600);
+    quota_mgr_->Insert(hashes[i], size, StringifyInt(i));
+  }
+
+  // The cache manager thread cleans up once it is idle
+  unsigned num_retries = 0;
+  while ((quota_mgr_->GetSize() > threshold_) && (num_retries < 500)) {
+    SafeSleepMs(10);
+    num_retries++;
+  }
+  EXPECT_EQ(5 * size, quota_mgr_->GetSize());
+  EXPECT_EQ(0U, quota_mgr_->GetCleanupRate(60));
+  EXPECT_FALSE(quota_mgr_->background_cleanup_);
+
+  vector<string> remaining = quota_mgr_->List();
+  sort(remaining.begin(), remaining.end());
+  ASSERT_EQ(5U, remaining.size());
+  for (unsigned i = 0; i < N; ++i) {
+    const bool is_remaining = (i >= N - 5);
+    if (is_remaining)
+      EXPECT_EQ(StringifyInt(i), remaining[i - (N - 5)]);
+    EXPECT_EQ(is_remaining,
+              FileExists(tmp_path_ + "/" + hashes[i].MakePath()));
+  }
+}
+
+
 TEST_F(T_QuotaManager, BindReturnPipe) {
   EXPECT_EQ(42, quota_mgr_->BindReturnPipe(42));
 
@@ -199,6 +236,56 @@ TEST_F(T_QuotaManager, Cleanup) {
 }
 
 
+TEST_F(T_QuotaManager, CleanupSlru) {
+  EXPECT_EQ(PosixQuotaManager::kEvictLru, quota_mgr_->eviction_policy());
+  PosixQuotaManager::EvictionPolicy eviction_policy;
+  EXPECT_FALSE(PosixQuotaManager::ParseEvictionPolicy("arc", &eviction_policy));
+  EXPECT_TRUE(PosixQuotaManager::ParseEvictionPolicy("slru", &eviction_policy));
+  EXPECT_EQ(PosixQuotaManager::kEvictSlru, eviction_policy);
+
+  delete quota_mgr_;
+  quota_mgr_ = PosixQuotaManager::Create(tmp_path_, limit_, threshold_, false);
+  quota_mgr_->SetEvictionPolicy(PosixQuotaManager::kEvictSlru);
+  quota_mgr_->async_delete_ = false;
+  quota_mgr_->Spawn();
+
+  // The first four files are used again after insertion, the others are
+  // read once
+  const uint64_t size = 1000;
+  for (unsigned i = 0; i < 4; ++i)
+    quota_mgr_->Insert(hashes_[i], size, StringifyInt(i));
+  for (unsigned i = 0; i < 4; ++i)
+    quota_mgr_->Touch(hashes_[i]);
+  for (unsigned i = 4; i < 8; ++i)
+    quota_mgr_->Insert(hashes_[i], size, StringifyInt(i));
+
+  // Plain LRU would remove the used files because they are older
+  EXPECT_TRUE(quota_mgr_->Cleanup(4 * size));
+  vector<string> remaining = quota_mgr_->List();
+  sort(remaining.begin(), remaining.end());
+  EXPECT_EQ("0\n1\n2\n3\n", PrintStringVector(remaining));
+
+  // Protected files beyond 80% of the cache are evicted in LRU order
+  quota_mgr_->Insert(hashes_[4], size, "4");
+  quota_mgr_->Touch(hashes_[4]);
+  quota_mgr_->Insert(hashes_[5], size, "new");
+  EXPECT_TRUE(quota_mgr_->Cleanup(5 * size));
+  remaining = quota_mgr_->List();
+  sort(remaining.begin(), remaining.end());
+  EXPECT_EQ("1\n2\n3\n4\nnew\n", PrintStringVector(remaining));
+
+  // Switching back to LRU drops the protection
+  delete quota_mgr_;
+  quota_mgr_ = PosixQuotaManager::Create(tmp_path_, limit_, threshold_, false);
+  quota_mgr_->SetEvictionPolicy(PosixQuotaManager::kEvictLru);
+  quota_mgr_->async_delete_ = false;
+  quota_mgr_->Spawn();
+  EXPECT_TRUE(quota_mgr_->Cleanup(size));
+  remaining = quota_mgr_->List();
+  EXPECT_EQ("new\n", PrintStringVector(remaining));
+}
+
+
 TEST_F(T_QuotaManager, CleanupLru) {
   unsigned N = hashes_.size();
   vector<shash::Any> shuffled_hashes = Shuffle(hashes_, &prng_);
@@ -338,10 +425,12 @@ TEST_F(T_QuotaManager, Create) {
 TEST_F(T_QuotaManager, CreateShared) {
   delete quota_mgr_;
   EXPECT_EQ(NULL,
-    PosixQuotaManager::CreateShared("", tmp_path_ + "/noent", 5, 5, false));
+    PosixQuotaManager::CreateShared("", tmp_path_ + "/noent", 5, 5, false,
+                                    PosixQuotaManager::kEvictLru));
 
   // Forking fails
-  EXPECT_EQ(NULL, PosixQuotaManager::CreateShared("", tmp_path_, 5, 5, false));
+  EXPECT_EQ(NULL, PosixQuotaManager::CreateShared(
+    "", tmp_path_, 5, 5, false, PosixQuotaManager::kEvictLru));
   EXPECT_EQ(0, unlink((tmp_path_ + "/cachemgr").c_str()));
 
   // TODO(jblomer): test fork logic (requires changes to __cachemgr__ execve)
@@ -397,6 +486,39 @@ TEST_F(T_QuotaManager, Getters) {
 }
 
 
+TEST_F(T_QuotaManager, GetMaxSeq) {
+  delete quota_mgr_;
+  quota_mgr_ = PosixQuotaManager::Create(tmp_path_, limit_, threshold_, false);
+  ASSERT_TRUE(quota_mgr_ != NULL);
+  quota_mgr_->SetEvictionPolicy(PosixQuotaManager::kEvictSlru);
+  quota_mgr_->Spawn();
+
+  // Mix of protected, regular, and volatile sequence numbers
+  quota_mgr_->Insert(hashes_[0], 1, "0");
+  quota_mgr_->Insert(hashes_[1], 1, "1");
+  quota_mgr_->Touch(hashes_[0]);
+  quota_mgr_->InsertVolatile(hashes_[2], 1, "2");
+  quota_mgr_->Insert(hashes_[3], 1, "3");
+  quota_mgr_->InsertVolatile(hashes_[4], 1, "4");
+  delete quota_mgr_;
+
+  quota_mgr_ = PosixQuotaManager::Create(tmp_path_, limit_, threshold_, false);
+  ASSERT_TRUE(quota_mgr_ != NULL);
+  sqlite3_stmt *stmt;
+  ASSERT_EQ(SQLITE_OK, sqlite3_prepare_v2(quota_mgr_->database_,
+    "SELECT max(acseq & (~(3<<62))) FROM cache_catalog;", -1, &stmt, NULL));
+  ASSERT_EQ(SQLITE_ROW, sqlite3_step(stmt));
+  const uint64_t expected_max_seq = sqlite3_column_int64(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  uint64_t max_seq;
+  EXPECT_TRUE(quota_mgr_->GetMaxSeq(&max_seq));
+  EXPECT_EQ(expected_max_seq, max_seq);
+  EXPECT_EQ(max_seq + 1, quota_mgr_->seq_);
+  EXPECT_GE(max_seq, 5U);
+}
+
+
 TEST_F(T_QuotaManager, InitDatabase) {
   PosixQuotaManager *mgr = new PosixQuotaManager(2, 1, tmp_path_ + "/noent");
   EXPECT_FALSE(mgr->InitDatabase(false));
@@ -550,3 +672,69 @@ TEST_F(T_QuotaManager, Touch) {
   quota_mgr_->Cleanup(1);
   EXPECT_EQ("a\n", PrintStringVector(quota_mgr_->List()));
 }
+
+
+TEST_F(T_QuotaManager, TouchBatch) {
+  EXPECT_GE(quota_mgr_->protocol_revision_, 3U);
+  unsigned N = hashes_.size();
+  for (unsigned i = 0; i < N; ++i)
+    quota_mgr_->Insert(hashes_[i], 1, StringifyInt(i));
+
+  // Repeated touches are coalesced
+  quota_mgr_->Touch(hashes_[1]);
+  quota_mgr_->Touch(hashes_[0]);
+  quota_mgr_->Touch(hashes_[1]);
+  EXPECT_EQ(2U, quota_mgr_->pending_touches_.size());
+  // Other commands send the pending touches first
+  EXPECT_TRUE(quota_mgr_->Cleanup(2));
+  EXPECT_TRUE(quota_mgr_->pending_touches_.empty());
+  vector<string> remaining = quota_mgr_->List();
+  sort(remaining.begin(), remaining.end());
+  EXPECT_EQ("0\n1\n", PrintStringVector(remaining));
+
+  // Full batches are sent right away
+  for (unsigned i = 0; i < PosixQuotaManager::kMaxTouchBatch; ++i) {
+    shash::Any hash(shash::kSha1);
+    hash.Randomize(&prng_);
+    quota_mgr_->Touch(hash);
+  }
+  EXPECT_TRUE(quota_mgr_->pending_touches_.empty());
+  EXPECT_EQ(2U, quota_mgr_->GetSize());
+}
+
+
+TEST_F(T_QuotaManager, TouchWindow) {
+  quota_mgr_->Insert(hashes_[0], 1, "0");
+  quota_mgr_->Touch(hashes_[0]);
+
+  // Without further commands, the batch is sent once the window has passed
+  bool flushed = false;
+  for (unsigned i = 0; (i < 50) && !flushed; ++i) {
+    SafeSleepMs(100);
+    MutexLockGuard lock_guard(&quota_mgr_->lock_touches_);
+    flushed = quota_mgr_->pending_touches_.empty();
+  }
+  EXPECT_TRUE(flushed);
+}
+
+
+TEST_F(T_QuotaManager, TouchCheckpoint) {
+  quota_mgr_->Insert(hashes_[0], 1, "0");
+  quota_mgr_->Insert(hashes_[1], 1, "1");
+  quota_mgr_->Touch(hashes_[0]);
+  quota_mgr_->List();  // trigger database commit
+
+  // Touches that are kept in memory are written out on shutdown
+  delete quota_mgr_;
+  quota_mgr_ = PosixQuotaManager::Create(tmp_path_, limit_, threshold_, false);
+  ASSERT_TRUE(quota_mgr_ != NULL);
+  quota_mgr_->Spawn();
+  EXPECT_TRUE(quota_mgr_->Cleanup(1));
+  EXPECT_EQ("0\n", PrintStringVector(quota_mgr_->List()));
+
+  // Cleanup sees the pending touches, too
+  quota_mgr_->Insert(hashes_[1], 1, "1");
+  quota_mgr_->Touch(hashes_[0]);
+  EXPECT_TRUE(quota_mgr_->Cleanup(1));
+  EXPECT_EQ("0\n", PrintStringVector(quota_mgr_->List()));
+}
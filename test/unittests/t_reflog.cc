@@ -4,8 +4,13 @@
 
 #include <gtest/gtest.h>
 
+#include <string>
+#include <vector>
+
 #include "reflog.h"
 #include "testutil.h"
+#include "util/file_guard.h"
+#include "util/pointer.h"
 
 template <class ReflogT>
 class T_Reflog : public ::testing::Test {
@@ -418,3 +423,67 @@ TYPED_TEST(T_Reflog, GetTimestamp) {
   EXPECT_LE(t1, timestamp);
   EXPECT_LE(timestamp, t2);
 }
+
+
+TEST(T_Reflog, Index) {
+  const std::string rp = CreateTempPath("./cvmfs_ut_reflog_index", 0600);
+  ASSERT_FALSE(rp.empty());
+  UnlinkGuard reflog_file(rp);
+  UniquePtr<manifest::Reflog> rl(manifest::Reflog::Create(rp, "test.cern.ch"));
+  ASSERT_TRUE(rl.IsValid());
+
+  std::vector<shash::Any> catalogs;
+  for (unsigned i = 0; i < 100; ++i) {
+    shash::Any catalog(shash::kSha1, shash::kSuffixCatalog);
+    catalog.Randomize(i);
+    catalogs.push_back(catalog);
+    ASSERT_TRUE(rl->AddCatalog(catalog));
+  }
+  const shash::Any certificate = h("b778b910390254b37ec66366aeef04f034c51941",
+                                   shash::kSuffixCertificate);
+  ASSERT_TRUE(rl->AddCertificate(certificate));
+
+  std::vector<uint64_t> timestamps;
+  for (unsigned i = 0; i < catalogs.size(); ++i) {
+    uint64_t timestamp;
+    ASSERT_TRUE(rl->GetCatalogTimestamp(catalogs[i], &timestamp));
+    timestamps.push_back(timestamp);
+  }
+
+  EXPECT_FALSE(rl->HasIndex());
+  ASSERT_TRUE(rl->LoadIndex());
+  EXPECT_TRUE(rl->HasIndex());
+  for (unsigned i = 0; i < catalogs.size(); ++i) {
+    uint64_t timestamp;
+    EXPECT_TRUE(rl->ContainsCatalog(catalogs[i]));
+    EXPECT_TRUE(rl->GetCatalogTimestamp(catalogs[i], &timestamp));
+    EXPECT_EQ(timestamps[i], timestamp);
+  }
+  EXPECT_TRUE(rl->ContainsCertificate(certificate));
+  // Same hash, different type
+  EXPECT_FALSE(rl->ContainsCatalog(h("b778b910390254b37ec66366aeef04f034c51941",
+                                     shash::kSuffixCatalog)));
+
+  // Updates are reflected in both the index and the database
+  EXPECT_TRUE(rl->Remove(catalogs[0]));
+  EXPECT_FALSE(rl->ContainsCatalog(catalogs[0]));
+  uint64_t timestamp;
+  EXPECT_FALSE(rl->GetCatalogTimestamp(catalogs[0], &timestamp));
+  shash::Any new_catalog(shash::kSha1, shash::kSuffixCatalog);
+  new_catalog.Randomize(1000);
+  EXPECT_TRUE(rl->AddCatalog(new_catalog));
+  EXPECT_TRUE(rl->ContainsCatalog(new_catalog));
+  EXPECT_TRUE(rl->AddCatalog(catalogs[0]));
+  EXPECT_TRUE(rl->ContainsCatalog(catalogs[0]));
+  EXPECT_TRUE(rl->Remove(catalogs[1]));
+  for (unsigned i = 2; i < catalogs.size(); ++i)
+    EXPECT_TRUE(rl->ContainsCatalog(catalogs[i]));
+
+  rl.Destroy();
+  rl = manifest::Reflog::Open(rp);
+  ASSERT_TRUE(rl.IsValid());
+  EXPECT_EQ(101U, rl->CountEntries());
+  EXPECT_TRUE(rl->ContainsCatalog(catalogs[0]));
+  EXPECT_FALSE(rl->ContainsCatalog(catalogs[1]));
+  EXPECT_TRUE(rl->ContainsCatalog(new_catalog));
+}
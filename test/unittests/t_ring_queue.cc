@@ -0,0 +1,111 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+
+#include <vector>
+
+#include "atomic.h"
+#include "util/ring_queue.h"
+
+using namespace std;  // NOLINT
+
+TEST(T_RingQueue, Capacity) {
+  RingQueue<int> queue(5);
+  EXPECT_EQ(8U, queue.GetCapacity());
+  EXPECT_EQ(1U, RingQueue<int>(1).GetCapacity());
+  EXPECT_EQ(16U, RingQueue<int>(16).GetCapacity());
+}
+
+
+TEST(T_RingQueue, Fifo) {
+  RingQueue<int> queue(4);
+  int item = -1;
+  EXPECT_FALSE(queue.TryPop(&item));
+  EXPECT_EQ(-1, item);
+
+  // Several rounds over the ring buffer
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 4; ++i)
+      EXPECT_TRUE(queue.TryPush(round * 10 + i));
+    EXPECT_FALSE(queue.TryPush(100));
+    EXPECT_EQ(4U, queue.GetSize());
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_TRUE(queue.TryPop(&item));
+      EXPECT_EQ(round * 10 + i, item);
+    }
+    EXPECT_FALSE(queue.TryPop(&item));
+    EXPECT_EQ(0U, queue.GetSize());
+  }
+
+  queue.Push(1);
+  queue.Pop(&item);
+  EXPECT_EQ(1, item);
+}
+
+
+namespace {
+
+const int kNumItems = 20000;
+const unsigned kNumThreads = 4;
+
+struct RingQueueContext {
+  RingQueue<int> *queue;
+  atomic_int64 sum;
+  atomic_int32 num_popped;
+};
+
+void *MainRingProducer(void *data) {
+  RingQueueContext *ctx = reinterpret_cast<RingQueueContext *>(data);
+  for (int i = 1; i <= kNumItems; ++i)
+    ctx->queue->Push(i);
+  return NULL;
+}
+
+void *MainRingConsumer(void *data) {
+  RingQueueContext *ctx = reinterpret_cast<RingQueueContext *>(data);
+  while (true) {
+    int item;
+    ctx->queue->Pop(&item);
+    // Every consumer gets exactly one termination item
+    if (item == 0)
+      break;
+    atomic_xadd64(&ctx->sum, item);
+    atomic_inc32(&ctx->num_popped);
+  }
+  return NULL;
+}
+
+}  // anonymous namespace
+
+TEST(T_RingQueue, MultiProducerMultiConsumer) {
+  // Small enough that producers and consumers block
+  RingQueue<int> queue(8);
+  RingQueueContext ctx;
+  ctx.queue = &queue;
+  atomic_init64(&ctx.sum);
+  atomic_init32(&ctx.num_popped);
+
+  vector<pthread_t> producers(kNumThreads);
+  vector<pthread_t> consumers(kNumThreads);
+  for (unsigned i = 0; i < kNumThreads; ++i) {
+    ASSERT_EQ(0, pthread_create(&producers[i], NULL, MainRingProducer, &ctx));
+    ASSERT_EQ(0, pthread_create(&consumers[i], NULL, MainRingConsumer, &ctx));
+  }
+  for (unsigned i = 0; i < kNumThreads; ++i)
+    pthread_join(producers[i], NULL);
+  for (unsigned i = 0; i < kNumThreads; ++i)
+    queue.Push(0);
+  for (unsigned i = 0; i < kNumThreads; ++i)
+    pthread_join(consumers[i], NULL);
+
+  EXPECT_EQ(static_cast<int32_t>(kNumThreads * kNumItems),
+            atomic_read32(&ctx.num_popped));
+  const int64_t expected_sum =
+    static_cast<int64_t>(kNumThreads) * kNumItems * (kNumItems + 1) / 2;
+  EXPECT_EQ(expected_sum, atomic_read64(&ctx.sum));
+  EXPECT_EQ(0U, queue.GetSize());
+}
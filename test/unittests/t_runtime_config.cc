@@ -0,0 +1,92 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include "platform.h"
+#include "runtime_config.h"
+
+namespace cvmfs {
+
+static RuntimeConfig MakeConfig() {
+  RuntimeConfig config;
+  config.kcache_timeout_sec = 60.0;
+  config.kcache_negative_timeout_sec = 30.0;
+  return config;
+}
+
+
+TEST(T_RuntimeConfig, Get) {
+  RuntimeConfigStore store(MakeConfig());
+  const RuntimeConfig *config = store.Get();
+  EXPECT_EQ(0U, config->version);
+  EXPECT_TRUE(config->IsCaching());
+  EXPECT_EQ(60.0, config->GetKcacheTimeout());
+  EXPECT_EQ(30.0, config->GetKcacheNegativeTimeout());
+  EXPECT_EQ(60.0, store.max_kcache_timeout_sec());
+  EXPECT_EQ(30.0, store.max_kcache_negative_timeout_sec());
+}
+
+
+TEST(T_RuntimeConfig, SetKcacheTimeouts) {
+  RuntimeConfigStore store(MakeConfig());
+  EXPECT_FALSE(store.SetKcacheTimeouts(61.0, 10.0));
+  EXPECT_FALSE(store.SetKcacheTimeouts(10.0, 31.0));
+  EXPECT_FALSE(store.SetKcacheTimeouts(-1.0, 10.0));
+  EXPECT_EQ(0U, store.Get()->version);
+
+  const RuntimeConfig *previous = store.Get();
+  EXPECT_TRUE(store.SetKcacheTimeouts(10.0, 0.0));
+  EXPECT_EQ(1U, store.Get()->version);
+  EXPECT_EQ(10.0, store.Get()->GetKcacheTimeout());
+  EXPECT_EQ(0.0, store.Get()->GetKcacheNegativeTimeout());
+  // Readers of the previous snapshot are unaffected
+  EXPECT_EQ(60.0, previous->GetKcacheTimeout());
+
+  EXPECT_TRUE(store.SetKcacheTimeouts(60.0, 30.0));
+  EXPECT_EQ(2U, store.Get()->version);
+  EXPECT_EQ(60.0, store.Get()->GetKcacheTimeout());
+}
+
+
+TEST(T_RuntimeConfig, SetReloadModes) {
+  RuntimeConfigStore store(MakeConfig());
+  store.SetReloadModes(1, false);
+  EXPECT_EQ(1U, store.Get()->version);
+  EXPECT_FALSE(store.Get()->IsCaching());
+  EXPECT_FALSE(store.Get()->IsInDrainoutMode());
+  EXPECT_EQ(0.0, store.Get()->GetKcacheTimeout());
+  EXPECT_EQ(0.0, store.Get()->GetKcacheNegativeTimeout());
+
+  store.SetReloadModes(2, false);
+  EXPECT_TRUE(store.Get()->IsInDrainoutMode());
+  // Unchanged modes do not publish a new snapshot
+  store.SetReloadModes(2, false);
+  EXPECT_EQ(2U, store.Get()->version);
+
+  store.SetReloadModes(0, false);
+  EXPECT_TRUE(store.Get()->IsCaching());
+  EXPECT_EQ(60.0, store.Get()->GetKcacheTimeout());
+
+  store.SetReloadModes(0, true);
+  EXPECT_FALSE(store.Get()->IsCaching());
+  EXPECT_TRUE(store.Get()->maintenance_mode);
+}
+
+
+TEST(T_RuntimeConfig, GracePeriod) {
+  RuntimeConfigStore store(MakeConfig());
+  EXPECT_TRUE(store.SetKcacheTimeouts(10.0, 10.0));
+  EXPECT_TRUE(store.SetKcacheTimeouts(20.0, 20.0));
+  EXPECT_EQ(2U, store.retired_.size());
+
+  const uint64_t now = platform_monotonic_time();
+  store.FreeRetired(now);
+  EXPECT_EQ(2U, store.retired_.size());
+  store.FreeRetired(now + RuntimeConfigStore::kGracePeriodSec + 1);
+  EXPECT_EQ(0U, store.retired_.size());
+  EXPECT_EQ(20.0, store.Get()->GetKcacheTimeout());
+}
+
+}  // namespace cvmfs
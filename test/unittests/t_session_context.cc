@@ -9,10 +9,24 @@
 
 class SessionContextMocked : public upload::SessionContext {
  public:
-  SessionContextMocked() : num_jobs_dispatched_(0), num_jobs_finished_(0) {}
+  SessionContextMocked()
+      : num_jobs_dispatched_(0),
+        num_jobs_finished_(0),
+        num_failures_(0),
+        num_commits_(0) {}
 
   int num_jobs_dispatched_;
   int num_jobs_finished_;
+  /**
+   * Number of upload attempts that fail before the first one succeeds
+   */
+  int num_failures_;
+  int num_commits_;
+
+  void AdaptPackSizeWrapper(uint64_t bytes, double upload_time_s) {
+    AdaptPackSize(bytes, upload_time_s);
+  }
+  uint64_t GetPackSize() const { return pack_size(); }
 
  protected:
   virtual Future<bool>* DispatchObjectPack(ObjectPack* pack) {
@@ -23,10 +37,16 @@ class SessionContextMocked : public upload::SessionContext {
 
   virtual bool Commit(const std::string& /*old_catalog*/,
                       const std::string& /*new_catalog*/) {
+    num_commits_++;
     return true;
   }
 
-  virtual bool DoUpload(const UploadJob* /*job*/) {
+  virtual bool DoUpload(const UploadJob* /*job*/, CURL* h_curl) {
+    EXPECT_TRUE(h_curl != NULL);
+    if (num_failures_ > 0) {
+      num_failures_--;
+      return false;
+    }
     num_jobs_finished_++;
     return true;
   }
@@ -179,6 +199,97 @@ TEST_F(T_SessionContext, EncounterFileWhichIsLargerThanExpected) {
   EXPECT_EQ(1, ctx.num_jobs_finished_);
 }
 
+TEST_F(T_SessionContext, LargeObjectInOwnPack) {
+  SessionContextMocked ctx;
+  EXPECT_TRUE(ctx.Initialize("http://my.repo.address:8080/api/v1",
+                             "/path/to/the/session_file", "some_key_id",
+                             "some_secret", 20000));
+
+  unsigned char buffer[12000];
+  memset(buffer, 0, 12000);
+  shash::Any hash(shash::kSha1);
+
+  ObjectPack::BucketHandle hd_small = ctx.NewBucket();
+  ObjectPack::AddToBucket(buffer, 4096, hd_small);
+  ObjectPack::BucketHandle hd_large = ctx.NewBucket();
+  ObjectPack::AddToBucket(buffer, 12000, hd_large);
+
+  // The large object is sent right away, the small one keeps waiting
+  EXPECT_TRUE(ctx.CommitBucket(ObjectPack::kCas, hash, hd_large, ""));
+  EXPECT_EQ(1, ctx.num_jobs_dispatched_);
+  EXPECT_TRUE(ctx.CommitBucket(ObjectPack::kCas, hash, hd_small, ""));
+  EXPECT_EQ(1, ctx.num_jobs_dispatched_);
+
+  EXPECT_TRUE(ctx.Finalize(true, "fake/old_root_hash", "fake/new_root_hash"));
+  EXPECT_EQ(2, ctx.num_jobs_dispatched_);
+  EXPECT_EQ(2, ctx.num_jobs_finished_);
+}
+
+TEST_F(T_SessionContext, RetryFailedUpload) {
+  SessionContextMocked ctx;
+  ctx.num_failures_ = upload::SessionContext::kMaxUploadRetries;
+  EXPECT_TRUE(ctx.Initialize("http://my.repo.address:8080/api/v1",
+                             "/path/to/the/session_file", "some_key_id",
+                             "some_secret"));
+
+  ObjectPack::BucketHandle hd = ctx.NewBucket();
+  unsigned char buffer[4096];
+  memset(buffer, 0, 4096);
+  ObjectPack::AddToBucket(buffer, 4096, hd);
+  shash::Any hash(shash::kSha1);
+  EXPECT_TRUE(ctx.CommitBucket(ObjectPack::kCas, hash, hd, "", true));
+
+  EXPECT_TRUE(ctx.Finalize(true, "fake/old_root_hash", "fake/new_root_hash"));
+  EXPECT_EQ(1, ctx.num_jobs_finished_);
+  EXPECT_EQ(1, ctx.num_commits_);
+}
+
+TEST_F(T_SessionContext, FailedUploadPreventsCommit) {
+  SessionContextMocked ctx;
+  ctx.num_failures_ = upload::SessionContext::kMaxUploadRetries + 1;
+  EXPECT_TRUE(ctx.Initialize("http://my.repo.address:8080/api/v1",
+                             "/path/to/the/session_file", "some_key_id",
+                             "some_secret", 20000));
+
+  unsigned char buffer[4096];
+  memset(buffer, 0, 4096);
+  shash::Any hash(shash::kSha1);
+  for (int i = 0; i < 4; ++i) {
+    ObjectPack::BucketHandle hd = ctx.NewBucket();
+    ObjectPack::AddToBucket(buffer, 4096, hd);
+    EXPECT_TRUE(ctx.CommitBucket(ObjectPack::kCas, hash, hd, "", true));
+  }
+
+  // The other packs are still uploaded but the session is not committed
+  EXPECT_FALSE(ctx.Finalize(true, "fake/old_root_hash", "fake/new_root_hash"));
+  EXPECT_EQ(3, ctx.num_jobs_finished_);
+  EXPECT_EQ(0, ctx.num_commits_);
+}
+
+TEST_F(T_SessionContext, AdaptivePackSize) {
+  SessionContextMocked ctx;
+  const uint64_t min_size = upload::SessionContextBase::kMinPackSize;
+  EXPECT_TRUE(ctx.Initialize("http://my.repo.address:8080/api/v1",
+                             "/path/to/the/session_file", "some_key_id",
+                             "some_secret", 16 * min_size, 2));
+  EXPECT_EQ(min_size, ctx.GetPackSize());
+
+  // Fast uploads grow the packs up to the maximum size
+  ctx.AdaptPackSizeWrapper(min_size, 0.001);
+  EXPECT_GT(ctx.GetPackSize(), min_size);
+  for (unsigned i = 0; i < 64; ++i)
+    ctx.AdaptPackSizeWrapper(ctx.GetPackSize(), 0.001);
+  EXPECT_GE(ctx.GetPackSize(), 15 * min_size);
+  EXPECT_LE(ctx.GetPackSize(), 16 * min_size);
+
+  // Slow uploads shrink them again
+  for (unsigned i = 0; i < 64; ++i)
+    ctx.AdaptPackSizeWrapper(ctx.GetPackSize(), 1000.0);
+  EXPECT_EQ(min_size, ctx.GetPackSize());
+
+  EXPECT_TRUE(ctx.Finalize(false, "", ""));
+}
+
 TEST_F(T_SessionContext, CurlUploadCallback) {
   ObjectPack pack(10000);
 
@@ -104,6 +104,34 @@ TEST(T_Shash, TestVectors) {
 }
 
 
+TEST(T_Shash, TestVectorsSha256) {
+  shash::Any sha256(shash::kSha256);
+
+  HashString("", &sha256);
+  EXPECT_EQ(
+    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4-sha256", sha256.ToString());
+  HashString("abc", &sha256);
+  EXPECT_EQ(
+    "ba7816bf8f01cfea414140de5dae2223b00361a3-sha256", sha256.ToString());
+  HashString(
+    "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", &sha256);
+  EXPECT_EQ(
+    "248d6a61d20638b8e5c026930c3e6039a33ce459-sha256", sha256.ToString());
+  HashString("The quick brown fox jumps over the lazy dog", &sha256);
+  EXPECT_EQ(
+    "d7a8fbb307d7809469ca9abcb0082e4f8d5651e4-sha256", sha256.ToString());
+
+  void *a_1m = smalloc(1000000);
+  memset(a_1m, 'a', 1000000);
+  HashMem(reinterpret_cast<const unsigned char *>(a_1m), 1000000, &sha256);
+  EXPECT_EQ(
+    "cdc76e5c9914fb9281a1c7e284d73e67f1809a48-sha256", sha256.ToString());
+  free(a_1m);
+
+  EXPECT_EQ(shash::kSha256, shash::ParseHashAlgorithm("sha256"));
+}
+
+
 TEST(T_Shash, LongTestVectorsSlow) {
   string s = "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmno";
   unsigned rep_s = 16777216;
@@ -254,6 +282,16 @@ TEST(T_Shash, VerifyHex) {
   EXPECT_EQ(shash::HexPtr(
     "adc83b19e793491b1c6ea0fd8b46cd9f32e592fcc-shake128").IsValid(),
     false);
+
+  EXPECT_EQ(shash::HexPtr(
+    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4-sha256").IsValid(),
+    true);
+  EXPECT_EQ(shash::HexPtr(
+    "e3b0c44298fc1c149afbf4c8996fb92427ae41e-sha256").IsValid(),
+    false);
+  EXPECT_EQ(shash::HexPtr(
+    "e3b0c44298fc1c149afbf4c8996fb92427ae41e4-sha257").IsValid(),
+    false);
 }
 
 
@@ -273,6 +311,15 @@ TEST(T_Shash, MkFromHexPtr) {
   EXPECT_EQ(sha1, shash::MkFromHexPtr(shash::HexPtr(sha1.ToString())));
   EXPECT_EQ(rmd160, shash::MkFromHexPtr(shash::HexPtr(rmd160.ToString())));
   EXPECT_EQ(shake128, shash::MkFromHexPtr(shash::HexPtr(shake128.ToString())));
+  shash::Any sha256(shash::kSha256);
+  sha256.Randomize();
+  EXPECT_EQ(sha256, shash::MkFromHexPtr(shash::HexPtr(sha256.ToString())));
+
+  // The algorithm identifier has to match, not only its length
+  EXPECT_EQ(shash::Any(), shash::MkFromHexPtr(shash::HexPtr(
+    "adc83b19e793491b1c6ea0fd8b46cd9f32e592fc-rmd161")));
+  EXPECT_EQ(shash::Any(), shash::MkFromHexPtr(shash::HexPtr(
+    "adc83b19e793491b1c6ea0fd8b46cd9f32e592fc-sha257")));
 
   shash::Any constructed = shash::MkFromHexPtr(shash::HexPtr(sha1.ToString()));
   EXPECT_EQ(shash::kSuffixNone, constructed.suffix);
@@ -328,6 +375,19 @@ TEST(T_Shash, MkFromSuffixedHexPtr) {
     shash::MkFromSuffixedHexPtr(shash::HexPtr(shake128S.ToString(true)));
   EXPECT_EQ(shake128S, constructed);
   EXPECT_EQ(shake128S.suffix, constructed.suffix);
+
+  shash::Any sha256(shash::kSha256);
+  shash::Any sha256S(shash::kSha256);
+  sha256.Randomize();  sha256S.Randomize();
+  sha256S.suffix = shash::kSuffixCatalog;
+  constructed =
+    shash::MkFromSuffixedHexPtr(shash::HexPtr(sha256.ToString(true)));
+  EXPECT_EQ(sha256, constructed);
+  EXPECT_EQ(sha256.suffix, constructed.suffix);
+  constructed =
+    shash::MkFromSuffixedHexPtr(shash::HexPtr(sha256S.ToString(true)));
+  EXPECT_EQ(sha256S, constructed);
+  EXPECT_EQ(sha256S.suffix, constructed.suffix);
 }
 
 
@@ -553,6 +613,27 @@ TEST(T_Shash, MakePathExplicit) {
 }
 
 
+TEST(T_Shash, WritePathWithoutSuffix) {
+  Prng prng;
+  prng.InitSeed(42);
+  char buffer[128];
+
+  shash::Any hash_rmd160(shash::kRmd160);
+  hash_rmd160.Randomize(&prng);
+  hash_rmd160.suffix = shash::kSuffixCatalog;
+  const string expected = hash_rmd160.MakePathWithoutSuffix();
+  EXPECT_EQ(expected.length(),
+            hash_rmd160.WritePathWithoutSuffix(buffer, sizeof(buffer)));
+  EXPECT_EQ(expected, string(buffer));
+
+  // No space for the terminating null byte
+  EXPECT_EQ(0U,
+            hash_rmd160.WritePathWithoutSuffix(buffer, expected.length()));
+  EXPECT_EQ(expected.length(),
+            hash_rmd160.WritePathWithoutSuffix(buffer, expected.length() + 1));
+}
+
+
 TEST(T_Shash, MakePathDefault) {
   Prng prng;
   prng.InitSeed(27111987);
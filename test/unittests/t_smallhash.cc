@@ -8,6 +8,7 @@
 #include <pthread.h>
 
 #include <limits>
+#include <map>
 
 #include "hash.h"
 #include "murmur.h"
@@ -22,6 +23,10 @@ static uint32_t hasher_md5(const shash::Md5 &key) {
   return (uint32_t) *(reinterpret_cast<const uint32_t *>(key.digest) + 1);
 }
 
+static uint32_t hasher_constant(const int &key) {
+  return 42;
+}
+
 class T_Smallhash : public ::testing::Test {
  protected:
   virtual void SetUp() {
@@ -119,6 +124,39 @@ TEST_F(T_Smallhash, InsertAndCopyMd5Slow) {
 }
 
 
+TEST_F(T_Smallhash, CopyAndSwap) {
+  unsigned N = kNumElements;
+  for (unsigned i = 0; i < N; ++i) {
+    smallhash_.Insert(i, i);
+  }
+
+  SmallHashDynamic<int, int> copy;
+  copy.Init(16, -1, hasher_int);
+  copy.Insert(N, N);
+  copy = smallhash_;
+  EXPECT_EQ(N, copy.size());
+  EXPECT_EQ(smallhash_.capacity(), copy.capacity());
+  EXPECT_EQ(0U, copy.num_migrates());
+  EXPECT_FALSE(copy.Contains(N));
+  SmallHashDynamic<int, int> copy_constructed(smallhash_);
+  EXPECT_EQ(N, copy_constructed.size());
+
+  SmallHashDynamic<int, int> swapped;
+  swapped.Init(16, -1, hasher_int);
+  swapped.Swap(&copy);
+  EXPECT_EQ(0U, copy.size());
+  EXPECT_EQ(N, swapped.size());
+  for (unsigned i = 0; i < N; ++i) {
+    int value = -1;
+    EXPECT_TRUE(swapped.Lookup(i, &value));
+    EXPECT_EQ(unsigned(value), i);
+    EXPECT_TRUE(copy_constructed.Contains(i));
+  }
+  copy.Insert(1, 1);
+  EXPECT_EQ(1U, copy.size());
+}
+
+
 TEST_F(T_Smallhash, InsertAndErase) {
   unsigned N = kNumElements;
   unsigned initial_capacity = smallhash_.capacity();
@@ -228,3 +266,119 @@ TEST_F(T_Smallhash, MultihashMultithread) {
   EXPECT_EQ(unsigned(0), GetMultiSize());
 }
 
+
+
+TEST_F(T_Smallhash, Grouped) {
+  SmallHashGrouped<int, int> grouped;
+  grouped.Init(16, -1, hasher_int);
+  EXPECT_EQ(32U, grouped.capacity());
+  unsigned N = kNumElements;
+  for (unsigned i = 0; i < N; ++i)
+    grouped.Insert(i, i);
+  EXPECT_EQ(N, grouped.size());
+  EXPECT_EQ(0U, grouped.capacity() & (grouped.capacity() - 1));
+  for (unsigned i = 0; i < N; ++i) {
+    int value = -1;
+    EXPECT_TRUE(grouped.Lookup(i, &value));
+    EXPECT_EQ(unsigned(value), i);
+  }
+  EXPECT_FALSE(grouped.Contains(N));
+  grouped.Insert(0, 42);
+  int value = -1;
+  EXPECT_TRUE(grouped.Lookup(0, &value));
+  EXPECT_EQ(42, value);
+  EXPECT_EQ(N, grouped.size());
+
+  // Direct iteration over the keys
+  unsigned num_keys = 0;
+  for (unsigned i = 0; i < grouped.capacity(); ++i) {
+    if (grouped.keys()[i] != grouped.empty_key())
+      num_keys++;
+  }
+  EXPECT_EQ(N, num_keys);
+
+  for (unsigned i = 0; i < N; i += 2)
+    grouped.Erase(i);
+  grouped.Erase(N + 1);
+  EXPECT_EQ(N / 2, grouped.size());
+  for (unsigned i = 0; i < N; ++i)
+    EXPECT_EQ((i % 2) == 1, grouped.Contains(i));
+  for (unsigned i = 1; i < N; i += 2)
+    grouped.Erase(i);
+  EXPECT_EQ(0U, grouped.size());
+  EXPECT_EQ(32U, grouped.capacity());
+
+  grouped.Insert(1, 1);
+  grouped.Clear();
+  EXPECT_EQ(0U, grouped.size());
+  EXPECT_FALSE(grouped.Contains(1));
+}
+
+
+TEST_F(T_Smallhash, GroupedMd5) {
+  SmallHashGrouped<shash::Md5, int> grouped;
+  grouped.Init(16, shash::Md5(shash::AsciiPtr("!")), hasher_md5);
+  unsigned N = kNumElements;
+  for (unsigned i = 0; i < N; ++i) {
+    shash::Md5 random_hash;
+    random_hash.Randomize(i);
+    grouped.Insert(random_hash, i);
+  }
+  EXPECT_EQ(N, grouped.size());
+  for (unsigned i = 0; i < N; ++i) {
+    shash::Md5 random_hash;
+    random_hash.Randomize(i);
+    int value = -1;
+    EXPECT_TRUE(grouped.Lookup(random_hash, &value));
+    EXPECT_EQ(unsigned(value), i);
+  }
+  uint64_t num_collisions;
+  uint32_t max_collisions;
+  grouped.GetCollisionStats(&num_collisions, &max_collisions);
+  EXPECT_LT(num_collisions, N / 10);
+}
+
+
+TEST_F(T_Smallhash, GroupedTombstones) {
+  // All keys end up in the same probe sequence
+  SmallHashGrouped<int, int> grouped;
+  grouped.Init(200, -1, hasher_constant);
+  const uint32_t capacity = grouped.capacity();
+  std::map<int, int> reference;
+  uint32_t max_deleted = 0;
+  for (unsigned round = 0; round < 20; ++round) {
+    for (int i = 0; i < 50; ++i) {
+      const int key = round * 50 + i;
+      grouped.Insert(key, -key);
+      reference[key] = -key;
+    }
+    for (int i = 0; i < 50; i += 3) {
+      const int key = round * 50 + i;
+      grouped.Erase(key);
+      reference.erase(key);
+    }
+    // Keep the size stable
+    while (reference.size() > 50) {
+      grouped.Erase(reference.begin()->first);
+      reference.erase(reference.begin());
+    }
+    EXPECT_LE(grouped.size() + grouped.num_deleted_,
+              capacity / 8 * 7) << round;
+    max_deleted = std::max(max_deleted, grouped.num_deleted_);
+  }
+  EXPECT_EQ(reference.size(), grouped.size());
+  EXPECT_EQ(capacity, grouped.capacity());
+  // Erasing from full groups leaves deleted slots that are reused later on
+  EXPECT_GT(max_deleted, 0U);
+  for (std::map<int, int>::const_iterator i = reference.begin();
+       i != reference.end(); ++i)
+  {
+    int value = 0;
+    EXPECT_TRUE(grouped.Lookup(i->first, &value));
+    EXPECT_EQ(i->second, value);
+  }
+  for (int i = 0; i < 20 * 50; ++i) {
+    if (reference.find(i) == reference.end())
+      EXPECT_FALSE(grouped.Contains(i)) << i;
+  }
+}
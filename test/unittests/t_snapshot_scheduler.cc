@@ -0,0 +1,102 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "stratum_agent/scheduler.h"
+
+using namespace std;  // NOLINT
+
+TEST(T_SnapshotScheduler, Concurrency) {
+  SnapshotScheduler scheduler(3, 2);
+  EXPECT_EQ("1", scheduler.Enqueue("1", "a.cern.ch", "s0.cern.ch"));
+  EXPECT_EQ("2", scheduler.Enqueue("2", "b.cern.ch", "s0.cern.ch"));
+  EXPECT_EQ("3", scheduler.Enqueue("3", "c.cern.ch", "s0.cern.ch"));
+  EXPECT_EQ("4", scheduler.Enqueue("4", "d.fnal.gov", "s0.fnal.gov"));
+  EXPECT_EQ("5", scheduler.Enqueue("5", "e.desy.de", "s0.desy.de"));
+  EXPECT_EQ(5U, scheduler.num_queued());
+
+  string job_id;
+  EXPECT_TRUE(scheduler.Next(&job_id));
+  EXPECT_EQ("1", job_id);
+  EXPECT_TRUE(scheduler.Next(&job_id));
+  EXPECT_EQ("2", job_id);
+  // At most two jobs from the same stratum 0
+  EXPECT_TRUE(scheduler.Next(&job_id));
+  EXPECT_EQ("4", job_id);
+  // At most three jobs overall
+  EXPECT_FALSE(scheduler.Next(&job_id));
+  EXPECT_EQ(3U, scheduler.num_running());
+  EXPECT_EQ(2U, scheduler.num_queued());
+
+  scheduler.Finish("4", true, 100);
+  EXPECT_TRUE(scheduler.Next(&job_id));
+  EXPECT_EQ("5", job_id);
+  EXPECT_FALSE(scheduler.Next(&job_id));
+  scheduler.Finish("1", true, 101);
+  EXPECT_TRUE(scheduler.Next(&job_id));
+  EXPECT_EQ("3", job_id);
+  EXPECT_EQ(0U, scheduler.num_queued());
+  EXPECT_FALSE(scheduler.Next(&job_id));
+}
+
+
+TEST(T_SnapshotScheduler, Coalesce) {
+  SnapshotScheduler scheduler(1, 1);
+  EXPECT_EQ("1", scheduler.Enqueue("1", "a.cern.ch", "s0.cern.ch"));
+  EXPECT_EQ("1", scheduler.Enqueue("2", "a.cern.ch", "s0.cern.ch"));
+  EXPECT_EQ(1U, scheduler.num_queued());
+
+  string job_id;
+  EXPECT_TRUE(scheduler.Next(&job_id));
+  EXPECT_EQ("1", job_id);
+  // The running job may have missed the new revision
+  EXPECT_EQ("3", scheduler.Enqueue("3", "a.cern.ch", "s0.cern.ch"));
+  EXPECT_EQ("3", scheduler.Enqueue("4", "a.cern.ch", "s0.cern.ch"));
+
+  // The same repository is not snapshotted twice at the same time
+  SnapshotScheduler parallel(2, 2);
+  parallel.Enqueue("1", "a.cern.ch", "s0.cern.ch");
+  EXPECT_TRUE(parallel.Next(&job_id));
+  parallel.Enqueue("2", "a.cern.ch", "s0.cern.ch");
+  EXPECT_FALSE(parallel.Next(&job_id));
+  parallel.Finish("1", false, 100);
+  EXPECT_TRUE(parallel.Next(&job_id));
+  EXPECT_EQ("2", job_id);
+}
+
+
+TEST(T_SnapshotScheduler, Staleness) {
+  SnapshotScheduler scheduler(1, 1);
+  string job_id;
+  scheduler.Enqueue("1", "a.cern.ch", "s0.cern.ch");
+  EXPECT_TRUE(scheduler.Next(&job_id));
+  scheduler.Finish("1", true, 200);
+  scheduler.Enqueue("2", "b.cern.ch", "s0.cern.ch");
+  EXPECT_TRUE(scheduler.Next(&job_id));
+  scheduler.Finish("2", true, 100);
+  scheduler.Enqueue("3", "c.cern.ch", "s0.cern.ch");
+  EXPECT_TRUE(scheduler.Next(&job_id));
+  scheduler.Finish("3", false, 300);
+
+  // a was snapshotted last, b before, c never successfully
+  EXPECT_EQ("4", scheduler.Enqueue("4", "a.cern.ch", "s0.cern.ch"));
+  EXPECT_EQ("5", scheduler.Enqueue("5", "b.cern.ch", "s0.cern.ch"));
+  EXPECT_EQ("6", scheduler.Enqueue("6", "c.cern.ch", "s0.cern.ch"));
+  EXPECT_EQ(2, scheduler.GetPosition("4"));
+  EXPECT_EQ(1, scheduler.GetPosition("5"));
+  EXPECT_EQ(0, scheduler.GetPosition("6"));
+  EXPECT_EQ(-1, scheduler.GetPosition("1"));
+
+  EXPECT_TRUE(scheduler.Next(&job_id));
+  EXPECT_EQ("6", job_id);
+  scheduler.Finish("6", true, 400);
+  EXPECT_TRUE(scheduler.Next(&job_id));
+  EXPECT_EQ("5", job_id);
+  scheduler.Finish("5", true, 500);
+  EXPECT_TRUE(scheduler.Next(&job_id));
+  EXPECT_EQ("4", job_id);
+}
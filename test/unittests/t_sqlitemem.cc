@@ -4,9 +4,12 @@
 
 #include <gtest/gtest.h>
 
+#include <unistd.h>
+
 #include <cstdlib>
 #include <cstring>
 #include <map>
+#include <string>
 #include <vector>
 
 #include "malloc_arena.h"
@@ -15,6 +18,7 @@
 #include "sqlitemem.h"
 #include "util/algorithm.h"
 #include "util/pointer.h"
+#include "util/string.h"
 
 using namespace std;  // NOLINT
 
@@ -180,3 +184,119 @@ TEST_F(T_Sqlitemem, ReallocStress) {
     ASSERT_TRUE(p != NULL);
   }
 }
+
+
+TEST_F(T_Sqlitemem, PageCache) {
+  sqlite3_pcache *cache1 = SqliteMemoryManager::xPcacheCreate(1024, 64, 1);
+  sqlite3_pcache *cache2 = SqliteMemoryManager::xPcacheCreate(1024, 64, 1);
+  EXPECT_EQ(NULL, SqliteMemoryManager::xPcacheFetch(cache1, 1, 0));
+  sqlite3_pcache_page *page = SqliteMemoryManager::xPcacheFetch(cache1, 1, 1);
+  ASSERT_TRUE(page != NULL);
+  EXPECT_EQ(0, *reinterpret_cast<char *>(page->pExtra));
+  memset(page->pBuf, 1, 1024);
+  SqliteMemoryManager::PageCacheStatistics stats =
+    mem_mgr_->GetPageCacheStatistics();
+  const uint64_t sz_block = stats.bytes_used;
+  EXPECT_GT(sz_block, 1024U + 64U);
+  EXPECT_EQ(2U, stats.num_caches);
+  EXPECT_EQ(2U, stats.n_miss);
+  // Room for four pages
+  mem_mgr_->SetPageCacheBudget(4 * sz_block);
+
+  EXPECT_EQ(page, SqliteMemoryManager::xPcacheFetch(cache1, 1, 0));
+  SqliteMemoryManager::xPcacheUnpin(cache1, page, 0);
+  EXPECT_EQ(page, SqliteMemoryManager::xPcacheFetch(cache1, 1, 0));
+  EXPECT_EQ(2U, mem_mgr_->GetPageCacheStatistics().n_hit);
+  SqliteMemoryManager::xPcacheUnpin(cache1, page, 0);
+  for (unsigned i = 2; i <= 4; ++i) {
+    page = SqliteMemoryManager::xPcacheFetch(cache1, i, 1);
+    ASSERT_TRUE(page != NULL);
+    SqliteMemoryManager::xPcacheUnpin(cache1, page, 0);
+  }
+  EXPECT_EQ(4, SqliteMemoryManager::xPcachePagecount(cache1));
+
+  // The least recently used page of the other cache is recycled
+  sqlite3_pcache_page *pinned[4];
+  pinned[0] = SqliteMemoryManager::xPcacheFetch(cache2, 1, 1);
+  ASSERT_TRUE(pinned[0] != NULL);
+  EXPECT_EQ(0, *reinterpret_cast<char *>(pinned[0]->pExtra));
+  EXPECT_EQ(3, SqliteMemoryManager::xPcachePagecount(cache1));
+  EXPECT_EQ(NULL, SqliteMemoryManager::xPcacheFetch(cache1, 1, 0));
+  stats = mem_mgr_->GetPageCacheStatistics();
+  EXPECT_EQ(1U, stats.n_evict);
+  EXPECT_EQ(4 * sz_block, stats.bytes_used);
+
+  // Pinned pages are never evicted, the budget is exceeded instead
+  for (unsigned i = 1; i < 4; ++i) {
+    pinned[i] = SqliteMemoryManager::xPcacheFetch(cache2, i + 1, 2);
+    ASSERT_TRUE(pinned[i] != NULL);
+  }
+  EXPECT_EQ(0, SqliteMemoryManager::xPcachePagecount(cache1));
+  page = SqliteMemoryManager::xPcacheFetch(cache1, 1, 1);
+  ASSERT_TRUE(page != NULL);
+  stats = mem_mgr_->GetPageCacheStatistics();
+  EXPECT_EQ(5 * sz_block, stats.bytes_used);
+  EXPECT_EQ(5 * sz_block, stats.bytes_max);
+  EXPECT_EQ(5U, stats.num_pages);
+  // Unpinned pages beyond the budget are released right away
+  SqliteMemoryManager::xPcacheUnpin(cache1, page, 0);
+  EXPECT_EQ(0, SqliteMemoryManager::xPcachePagecount(cache1));
+
+  SqliteMemoryManager::xPcacheRekey(cache2, pinned[3], 4, 10);
+  EXPECT_EQ(NULL, SqliteMemoryManager::xPcacheFetch(cache2, 4, 0));
+  EXPECT_EQ(pinned[3], SqliteMemoryManager::xPcacheFetch(cache2, 10, 0));
+  SqliteMemoryManager::xPcacheTruncate(cache2, 3);
+  EXPECT_EQ(2, SqliteMemoryManager::xPcachePagecount(cache2));
+  SqliteMemoryManager::xPcacheUnpin(cache2, pinned[0], 0);
+  SqliteMemoryManager::xPcacheShrink(cache2);
+  EXPECT_EQ(1, SqliteMemoryManager::xPcachePagecount(cache2));
+  EXPECT_EQ(pinned[1], SqliteMemoryManager::xPcacheFetch(cache2, 2, 0));
+
+  SqliteMemoryManager::xPcacheDestroy(cache1);
+  SqliteMemoryManager::xPcacheDestroy(cache2);
+  stats = mem_mgr_->GetPageCacheStatistics();
+  EXPECT_EQ(0U, stats.num_caches);
+  EXPECT_EQ(0U, stats.num_pages);
+  EXPECT_EQ(0U, stats.bytes_used);
+}
+
+
+TEST_F(T_Sqlitemem, PageCacheSqlite) {
+  sqlite3_shutdown();
+  mem_mgr_->SetPageCacheBudget(64 * 1024);
+  mem_mgr_->AssignGlobalArenas();
+
+  const string db_path = "sqlitemem_pcache.db";
+  unlink(db_path.c_str());
+  sqlite3 *db;
+  ASSERT_EQ(SQLITE_OK, sqlite3_open(db_path.c_str(), &db));
+  ASSERT_EQ(SQLITE_OK, sqlite3_exec(db,
+    "CREATE TABLE t (k INTEGER PRIMARY KEY, v TEXT); BEGIN;", NULL, NULL,
+    NULL));
+  for (unsigned i = 0; i < 10000; ++i) {
+    const string sql = "INSERT INTO t VALUES (" + StringifyInt(i) +
+      ", '" + string(100, 'a' + (i % 26)) + "');";
+    ASSERT_EQ(SQLITE_OK, sqlite3_exec(db, sql.c_str(), NULL, NULL, NULL));
+  }
+  ASSERT_EQ(SQLITE_OK, sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL));
+  sqlite3_close(db);
+
+  ASSERT_EQ(SQLITE_OK, sqlite3_open_v2(db_path.c_str(), &db,
+                                       SQLITE_OPEN_READONLY, NULL));
+  sqlite3_stmt *stmt;
+  ASSERT_EQ(SQLITE_OK, sqlite3_prepare_v2(db,
+    "SELECT COUNT(*), SUM(LENGTH(v)) FROM t;", -1, &stmt, NULL));
+  ASSERT_EQ(SQLITE_ROW, sqlite3_step(stmt));
+  EXPECT_EQ(10000, sqlite3_column_int(stmt, 0));
+  EXPECT_EQ(1000000, sqlite3_column_int(stmt, 1));
+  sqlite3_finalize(stmt);
+
+  SqliteMemoryManager::PageCacheStatistics stats =
+    mem_mgr_->GetPageCacheStatistics();
+  EXPECT_EQ(1U, stats.num_caches);
+  EXPECT_LE(stats.bytes_used, stats.budget);
+  EXPECT_GT(stats.n_evict, 0U);
+  sqlite3_close(db);
+  sqlite3_shutdown();
+  unlink(db_path.c_str());
+}
@@ -4,8 +4,15 @@
 
 #include "gtest/gtest.h"
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <string>
+
 #include "platform.h"
 #include "statistics.h"
+#include "util/posix.h"
 
 using namespace std;  // NOLINT
 
@@ -80,6 +87,49 @@ TEST(T_Statistics, Fork) {
 }
 
 
+static void *MainIncCounter(void *data) {
+  Counter *counter = reinterpret_cast<Counter *>(data);
+  for (unsigned i = 0; i < 10000; ++i)
+    perf::Inc(counter);
+  perf::Xadd(counter, 2);
+  return NULL;
+}
+
+TEST(T_Statistics, ShardedCounter) {
+  Statistics statistics;
+  Counter *counter = statistics.RegisterSharded("test.sharded", "");
+  EXPECT_TRUE(counter->IsSharded());
+  EXPECT_FALSE(statistics.Register("test.regular", "")->IsSharded());
+  EXPECT_EQ(0, counter->Get());
+  counter->Inc();
+  counter->Inc();
+  counter->Dec();
+  EXPECT_EQ(1, counter->Get());
+  counter->Set(10);
+  EXPECT_EQ(10, counter->Get());
+  counter->Xadd(-10);
+  EXPECT_EQ(0, counter->Get());
+
+  const unsigned kNumThreads = 8;
+  pthread_t threads[kNumThreads];
+  for (unsigned i = 0; i < kNumThreads; ++i) {
+    int retval = pthread_create(&threads[i], NULL, MainIncCounter, counter);
+    ASSERT_EQ(0, retval);
+  }
+  for (unsigned i = 0; i < kNumThreads; ++i)
+    pthread_join(threads[i], NULL);
+  EXPECT_EQ(static_cast<int64_t>(kNumThreads * 10002), counter->Get());
+  EXPECT_EQ("test.regular|0|\ntest.sharded|80016|\n",
+            statistics.PrintList(Statistics::kPrintSimple));
+
+  // Copies are not sharded but carry the value
+  Counter copy(*counter);
+  EXPECT_FALSE(copy.IsSharded());
+  EXPECT_EQ(80016, copy.Get());
+  EXPECT_EQ("1.000", counter->PrintRatio(*counter));
+}
+
+
 TEST(T_Statistics, StatisticsTemplate) {
   Statistics statistics;
   StatisticsTemplate stat_template1("template1", &statistics);
@@ -95,6 +145,139 @@ TEST(T_Statistics, StatisticsTemplate) {
 }
 
 
+TEST(T_Statistics, HistogramBins) {
+  for (uint64_t v = 0; v < 8; ++v) {
+    EXPECT_EQ(v, Histogram::GetBin(v));
+    EXPECT_EQ(v, Histogram::GetBinUpperBound(v));
+  }
+  EXPECT_EQ(8U, Histogram::GetBin(8));
+  EXPECT_EQ(16U, Histogram::GetBin(16));
+  EXPECT_EQ(16U, Histogram::GetBin(17));
+  EXPECT_EQ(17U, Histogram::GetBin(18));
+  EXPECT_EQ(17U, Histogram::GetBinUpperBound(16));
+  EXPECT_EQ(uint64_t(-1),
+            Histogram::GetBinUpperBound(Histogram::GetBin(uint64_t(-1))));
+
+  // Every value lies within its bin and the bin is less than 1/8 wide
+  for (uint64_t v = 1; v < (uint64_t(1) << 62); v = v * 3 + 1) {
+    const unsigned bin = Histogram::GetBin(v);
+    EXPECT_LE(v, Histogram::GetBinUpperBound(bin));
+    EXPECT_GT(v, bin > 0 ? Histogram::GetBinUpperBound(bin - 1) : 0);
+    EXPECT_LE(Histogram::GetBinUpperBound(bin) - v, v / 8);
+  }
+}
+
+
+TEST(T_Statistics, Histogram) {
+  Histogram histogram;
+  EXPECT_EQ(0U, histogram.GetCount());
+  EXPECT_EQ(0U, histogram.GetQuantile(0.5));
+  EXPECT_EQ("0|0|0|0", histogram.ToString());
+
+  for (unsigned i = 1; i <= 1000; ++i)
+    histogram.Add(i);
+  EXPECT_EQ(1000U, histogram.GetCount());
+  EXPECT_EQ(1U, histogram.GetQuantile(0.0));
+  EXPECT_LE(500U, histogram.GetQuantile(0.5));
+  EXPECT_GE(500U + 500 / 8, histogram.GetQuantile(0.5));
+  EXPECT_LE(990U, histogram.GetQuantile(0.99));
+  EXPECT_GE(990U + 990 / 8, histogram.GetQuantile(0.99));
+  EXPECT_LE(1000U, histogram.GetQuantile(1.0));
+
+  histogram.Reset();
+  histogram.Add(5);
+  EXPECT_EQ("1|5|5|5", histogram.ToString());
+}
+
+
+TEST(T_Statistics, StatisticsHistogram) {
+  Statistics statistics;
+  Histogram *histogram = statistics.RegisterHistogram("test.lat", "latency");
+  ASSERT_TRUE(histogram != NULL);
+  ASSERT_DEATH(statistics.RegisterHistogram("test.lat", "Name Clash"), ".*");
+  EXPECT_EQ(histogram, statistics.LookupHistogram("test.lat"));
+  EXPECT_EQ(NULL, statistics.LookupHistogram("test.unknown"));
+  EXPECT_EQ(NULL, statistics.Lookup("test.lat"));
+
+  {
+    HistogramTimer timer(histogram);
+  }
+  EXPECT_EQ(1U, histogram->GetCount());
+
+  Statistics *child = statistics.Fork();
+  child->LookupHistogram("test.lat")->Add(2);
+  StatisticsTemplate stat_template("template", child);
+  stat_template.RegisterTemplatedHistogram("lat", "child latency")->Add(3);
+  delete child;
+  EXPECT_EQ(2U, histogram->GetCount());
+  EXPECT_EQ(NULL, statistics.LookupHistogram("template.lat"));
+
+  histogram->Reset();
+  histogram->Add(7);
+  EXPECT_EQ("Name|Count|P50|P99|P999|Description\n"
+            "test.lat|1|7|7|7|latency\n",
+            statistics.PrintHistograms(Statistics::kPrintHeader));
+}
+
+
+TEST(T_Statistics, OpenMetrics) {
+  Statistics statistics;
+  EXPECT_EQ("# EOF\n", statistics.PrintOpenMetrics("cvmfs_", ""));
+
+  statistics.Register("test.n-value", "a test\ncounter")->Set(3);
+  statistics.Register("test.no_desc", "");
+  statistics.RegisterHistogram("test.lat", "latency")->Add(7);
+  EXPECT_EQ(
+    "# TYPE cvmfs_test_n_value unknown\n"
+    "# HELP cvmfs_test_n_value a test\\ncounter\n"
+    "cvmfs_test_n_value{repo=\"a.b\"} 3\n"
+    "# TYPE cvmfs_test_no_desc unknown\n"
+    "cvmfs_test_no_desc{repo=\"a.b\"} 0\n"
+    "# TYPE cvmfs_test_lat summary\n"
+    "# HELP cvmfs_test_lat latency\n"
+    "cvmfs_test_lat{repo=\"a.b\",quantile=\"0.5\"} 7\n"
+    "cvmfs_test_lat{repo=\"a.b\",quantile=\"0.99\"} 7\n"
+    "cvmfs_test_lat{repo=\"a.b\",quantile=\"0.999\"} 7\n"
+    "cvmfs_test_lat_count{repo=\"a.b\"} 1\n"
+    "# EOF\n",
+    statistics.PrintOpenMetrics("cvmfs_", "repo=\"a.b\""));
+
+  const string no_labels = statistics.PrintOpenMetrics("", "");
+  EXPECT_NE(string::npos, no_labels.find("\ntest_no_desc 0\n"));
+  EXPECT_NE(string::npos, no_labels.find("\ntest_lat{quantile=\"0.5\"} 7\n"));
+  EXPECT_NE(string::npos, no_labels.find("\ntest_lat_count 1\n"));
+}
+
+
+TEST(T_Statistics, HistogramExporter) {
+  const string tmp_path = CreateTempDir("./cvmfs_ut_histogram_exporter");
+  ASSERT_FALSE(tmp_path.empty());
+  const string export_path = tmp_path + "/latency";
+
+  Statistics statistics;
+  statistics.RegisterHistogram("test.lat", "latency")->Add(1);
+  {
+    HistogramExporter exporter(&statistics, export_path, 1000);
+    EXPECT_TRUE(exporter.Export());
+    EXPECT_TRUE(FileExists(export_path));
+    EXPECT_FALSE(FileExists(export_path + ".tmp"));
+    unlink(export_path.c_str());
+    // Exports once more on termination
+    exporter.Spawn();
+  }
+  int fd = open(export_path.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  string content;
+  EXPECT_TRUE(SafeReadToString(fd, &content));
+  close(fd);
+  EXPECT_EQ(statistics.PrintHistograms(Statistics::kPrintHeader), content);
+
+  HistogramExporter exporter(&statistics, tmp_path + "/none/latency", 1);
+  EXPECT_FALSE(exporter.Export());
+  RemoveTree(tmp_path);
+}
+
+
 TEST(T_Statistics, RecorderConstruct) {
   Recorder recorder(5, 10);
   EXPECT_EQ(10U, recorder.capacity_s());
@@ -0,0 +1,115 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "hash.h"
+#include "swissknife_pull_journal.h"
+#include "util/pointer.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+namespace swissknife {
+
+class T_PullJournal : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    tmp_path_ = CreateTempDir("./cvmfs_ut_pull_journal");
+    ASSERT_FALSE(tmp_path_.empty());
+    journal_path_ = tmp_path_ + "/journal";
+    root_ = shash::MkFromSuffixedHexPtr(
+      shash::HexPtr(string("1111111111111111111111111111111111111111C")));
+    object_ = shash::MkFromHexPtr(
+      shash::HexPtr(string("2222222222222222222222222222222222222222")));
+    catalog_ = shash::MkFromSuffixedHexPtr(
+      shash::HexPtr(string("3333333333333333333333333333333333333333C")));
+  }
+
+  virtual void TearDown() {
+    RemoveTree(tmp_path_);
+  }
+
+  string tmp_path_;
+  string journal_path_;
+  shash::Any root_;
+  shash::Any object_;
+  shash::Any catalog_;
+};
+
+
+TEST_F(T_PullJournal, Resume) {
+  UniquePtr<PullJournal> journal(PullJournal::Open(journal_path_, root_));
+  ASSERT_TRUE(journal.IsValid());
+  EXPECT_FALSE(journal->Contains(object_));
+  EXPECT_TRUE(journal->AddObjects(vector<shash::Any>(1, object_)));
+  EXPECT_TRUE(journal->AddCatalog(catalog_));
+  // Records of the current run are only used by the next one
+  EXPECT_FALSE(journal->Contains(object_));
+
+  // Interrupted, same root catalog: resume
+  journal = PullJournal::Open(journal_path_, root_);
+  ASSERT_TRUE(journal.IsValid());
+  EXPECT_EQ(1U, journal->num_objects());
+  EXPECT_EQ(1U, journal->num_catalogs());
+  EXPECT_TRUE(journal->Contains(object_));
+  EXPECT_TRUE(journal->Contains(catalog_));
+  EXPECT_FALSE(journal->Contains(root_));
+
+  // A cut short record is skipped
+  FILE *f = fopen(journal_path_.c_str(), "a");
+  ASSERT_TRUE(f != NULL);
+  fprintf(f, "O44444");
+  fclose(f);
+  journal = PullJournal::Open(journal_path_, root_);
+  ASSERT_TRUE(journal.IsValid());
+  EXPECT_EQ(1U, journal->num_objects());
+
+  journal->Remove();
+  EXPECT_FALSE(FileExists(journal_path_));
+}
+
+
+TEST_F(T_PullJournal, NewRoot) {
+  UniquePtr<PullJournal> journal(PullJournal::Open(journal_path_, root_));
+  ASSERT_TRUE(journal.IsValid());
+  EXPECT_TRUE(journal->AddObjects(vector<shash::Any>(1, object_)));
+
+  journal = PullJournal::Open(journal_path_, catalog_);
+  ASSERT_TRUE(journal.IsValid());
+  EXPECT_EQ(0U, journal->num_objects());
+  EXPECT_FALSE(journal->Contains(object_));
+}
+
+
+TEST_F(T_PullJournal, Inventory) {
+  EXPECT_EQ(object_, PullJournal::ParseInventoryLine(
+    "data/22/22222222222222222222222222222222222222"));
+  EXPECT_EQ(catalog_, PullJournal::ParseInventoryLine(
+    " 33/33333333333333333333333333333333333333C "));
+  EXPECT_TRUE(PullJournal::ParseInventoryLine("txn").IsNull());
+
+  const string inventory_path = tmp_path_ + "/inventory";
+  FILE *f = fopen(inventory_path.c_str(), "w");
+  ASSERT_TRUE(f != NULL);
+  fprintf(f, "data/22/22222222222222222222222222222222222222\n"
+             "data/.cvmfsdirtab\n");
+  fclose(f);
+
+  // Without a journal file
+  UniquePtr<PullJournal> journal(PullJournal::Open("", root_));
+  ASSERT_TRUE(journal.IsValid());
+  EXPECT_FALSE(journal->LoadInventory(tmp_path_ + "/no_such_file"));
+  EXPECT_TRUE(journal->LoadInventory(inventory_path));
+  EXPECT_TRUE(journal->Contains(object_));
+  EXPECT_FALSE(journal->Contains(catalog_));
+  EXPECT_TRUE(journal->AddCatalog(catalog_));
+  EXPECT_FALSE(FileExists(journal_path_));
+}
+
+}  // namespace swissknife
@@ -0,0 +1,144 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "signature.h"
+#include "swissknife_sign.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace swissknife {
+
+class T_SwissknifeSignBatch : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    tmp_path_ = CreateTempDir("./cvmfs_ut_sign_batch");
+    ASSERT_FALSE(tmp_path_.empty());
+    WriteKey(tmp_path_ + "/a");
+    WriteKey(tmp_path_ + "/b");
+  }
+
+  virtual void TearDown() {
+    RemoveTree(tmp_path_);
+  }
+
+  void WriteKey(const string &prefix) {
+    RSA *rsa = RSA_new();
+    BIGNUM *e = BN_new();
+    ASSERT_EQ(1, BN_set_word(e, RSA_F4));
+    ASSERT_EQ(1, RSA_generate_key_ex(rsa, 1024, e, NULL));
+    BN_free(e);
+
+    FILE *f = fopen((prefix + ".masterkey").c_str(), "w");
+    ASSERT_TRUE(f != NULL);
+    EXPECT_EQ(1, PEM_write_RSAPrivateKey(f, rsa, NULL, NULL, 0, NULL, NULL));
+    fclose(f);
+    f = fopen((prefix + ".pub").c_str(), "w");
+    ASSERT_TRUE(f != NULL);
+    EXPECT_EQ(1, PEM_write_RSA_PUBKEY(f, rsa));
+    fclose(f);
+    RSA_free(rsa);
+  }
+
+  bool VerifyRsa(const string &pubkey, const string &input_path,
+                 const string &signature_path)
+  {
+    string input;
+    string signature;
+    if (!ReadFile(input_path, &input) || !ReadFile(signature_path, &signature))
+      return false;
+    signature::SignatureManager signature_manager;
+    signature_manager.Init();
+    bool result = signature_manager.LoadPublicRsaKeys(pubkey) &&
+      signature_manager.VerifyRsa(
+        reinterpret_cast<const unsigned char *>(input.data()), input.length(),
+        reinterpret_cast<const unsigned char *>(signature.data()),
+        signature.length());
+    signature_manager.Fini();
+    return result;
+  }
+
+  bool ReadFile(const string &path, string *content) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    bool result = SafeReadToString(fd, content);
+    close(fd);
+    return result;
+  }
+
+  string tmp_path_;
+};
+
+
+TEST_F(T_SwissknifeSignBatch, ParseJobList) {
+  const string list = tmp_path_ + "/jobs";
+  vector<CommandSignBatch::Job> jobs;
+  EXPECT_FALSE(CommandSignBatch::ParseJobList(list, &jobs));
+
+  ASSERT_TRUE(SafeWriteToFile("# comment\n\nk1 in1 out1\n  k2 in2 out2  \n",
+                              list, 0600));
+  EXPECT_TRUE(CommandSignBatch::ParseJobList(list, &jobs));
+  ASSERT_EQ(2U, jobs.size());
+  EXPECT_EQ("k1", jobs[0].private_key);
+  EXPECT_EQ("in1", jobs[0].input_path);
+  EXPECT_EQ("out1", jobs[0].output_path);
+  EXPECT_EQ("k2", jobs[1].private_key);
+  EXPECT_EQ("out2", jobs[1].output_path);
+  EXPECT_FALSE(jobs[0].ok);
+
+  jobs.clear();
+  ASSERT_TRUE(SafeWriteToFile("k1 in1\n", list, 0600));
+  EXPECT_FALSE(CommandSignBatch::ParseJobList(list, &jobs));
+}
+
+
+TEST_F(T_SwissknifeSignBatch, SignAll) {
+  vector<CommandSignBatch::Job> jobs;
+  for (unsigned i = 0; i < 16; ++i) {
+    CommandSignBatch::Job job;
+    job.private_key = tmp_path_ + ((i < 8) ? "/a" : "/b") + ".masterkey";
+    job.input_path = tmp_path_ + "/hash" + StringifyInt(i);
+    job.output_path = tmp_path_ + "/signature" + StringifyInt(i);
+    ASSERT_TRUE(SafeWriteToFile("hash" + StringifyInt(i), job.input_path,
+                                0600));
+    jobs.push_back(job);
+  }
+  // Missing key and missing input
+  CommandSignBatch::Job job = jobs[0];
+  job.private_key = tmp_path_ + "/none.masterkey";
+  job.output_path = tmp_path_ + "/signature_none";
+  jobs.push_back(job);
+  job = jobs[0];
+  job.input_path = tmp_path_ + "/none";
+  job.output_path = tmp_path_ + "/signature_none";
+  jobs.push_back(job);
+
+  CommandSignBatch command;
+  EXPECT_EQ(2U, command.SignAll(&jobs, 4));
+  for (unsigned i = 0; i < 16; ++i) {
+    EXPECT_TRUE(jobs[i].ok);
+    const string right = tmp_path_ + ((i < 8) ? "/a" : "/b") + ".pub";
+    const string wrong = tmp_path_ + ((i < 8) ? "/b" : "/a") + ".pub";
+    EXPECT_TRUE(VerifyRsa(right, jobs[i].input_path, jobs[i].output_path));
+    EXPECT_FALSE(VerifyRsa(wrong, jobs[i].input_path, jobs[i].output_path));
+  }
+  EXPECT_FALSE(jobs[16].ok);
+  EXPECT_FALSE(jobs[17].ok);
+  EXPECT_FALSE(FileExists(tmp_path_ + "/signature_none"));
+}
+
+}  // namespace swissknife
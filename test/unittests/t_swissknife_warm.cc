@@ -0,0 +1,90 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "swissknife_warm.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+namespace swissknife {
+
+class T_SwissknifeWarm : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    tmp_path_ = CreateTempDir("./cvmfs_ut_swissknife_warm");
+    ASSERT_FALSE(tmp_path_.empty());
+    input_path_ = tmp_path_ + "/input";
+  }
+
+  virtual void TearDown() {
+    RemoveTree(tmp_path_);
+  }
+
+  void WriteInput(const string &content) {
+    FILE *f = fopen(input_path_.c_str(), "w");
+    ASSERT_TRUE(f != NULL);
+    fprintf(f, "%s", content.c_str());
+    fclose(f);
+  }
+
+  string tmp_path_;
+  string input_path_;
+};
+
+
+TEST_F(T_SwissknifeWarm, NormalizePath) {
+  EXPECT_EQ("/sw/bin", CommandWarm::NormalizePath("/sw/bin", "a.cern.ch"));
+  EXPECT_EQ("/sw/bin", CommandWarm::NormalizePath("sw/bin/", "a.cern.ch"));
+  EXPECT_EQ("/sw/bin",
+            CommandWarm::NormalizePath("/cvmfs/a.cern.ch/sw/bin", "a.cern.ch"));
+  EXPECT_EQ("", CommandWarm::NormalizePath("/cvmfs/a.cern.ch/", "a.cern.ch"));
+  EXPECT_EQ("/cvmfs/a.cern.chx/bin",
+            CommandWarm::NormalizePath("/cvmfs/a.cern.chx/bin", "a.cern.ch"));
+  EXPECT_EQ("/cvmfs/b.cern.ch/bin",
+            CommandWarm::NormalizePath("/cvmfs/b.cern.ch/bin", "a.cern.ch"));
+}
+
+
+TEST_F(T_SwissknifeWarm, ReadPathList) {
+  WriteInput(
+    "# job inputs\n"
+    "/cvmfs/a.cern.ch/sw/bin/app\n"
+    "\n"
+    "  /sw/lib/libapp.so  \n"
+    "/cvmfs/a.cern.ch\n");
+  vector<string> paths;
+  EXPECT_TRUE(CommandWarm::ReadPathList(input_path_, "a.cern.ch", &paths));
+  ASSERT_EQ(2U, paths.size());
+  EXPECT_EQ("/sw/bin/app", paths[0]);
+  EXPECT_EQ("/sw/lib/libapp.so", paths[1]);
+
+  EXPECT_FALSE(CommandWarm::ReadPathList(tmp_path_ + "/no_such_file",
+                                         "a.cern.ch", &paths));
+}
+
+
+TEST_F(T_SwissknifeWarm, ReadTracerLog) {
+  WriteInput(
+    "\"1.0\",\"-1\",\"Tracer\",\"Trace buffer created\"\r\n"
+    "\"1.1\",\"1\",\"/sw/bin/app\",\"open()\"\r\n"
+    "\"1.2\",\"6\",\"/sw/lib\",\"lookup()\"\r\n"
+    "\"1.3\",\"1\",\"/sw/lib/libapp.so\",\"open()\"\r\n"
+    "\"1.4\",\"-2\",\"Tracer\",\"Destroying trace buffer...\"\r\n");
+  vector<string> paths;
+  EXPECT_TRUE(CommandWarm::ReadTracerLog(input_path_, &paths));
+  ASSERT_EQ(2U, paths.size());
+  EXPECT_EQ("/sw/bin/app", paths[0]);
+  EXPECT_EQ("/sw/lib/libapp.so", paths[1]);
+
+  WriteInput("\"1.1\",\"1\",\"/unterminated\r\n");
+  EXPECT_FALSE(CommandWarm::ReadTracerLog(input_path_, &paths));
+}
+
+}  // namespace swissknife
@@ -0,0 +1,139 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+
+#include "hash.h"
+#include "sync_content_cache.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+namespace publish {
+
+class T_SyncContentCache : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    tmp_path_ = CreateTempDir("./cvmfs_ut_sync_content_cache");
+    ASSERT_FALSE(tmp_path_.empty());
+    cache_path_ = tmp_path_ + "/content_cache";
+  }
+
+  virtual void TearDown() {
+    RemoveTree(tmp_path_);
+  }
+
+  static SyncContentCache::Entry MkEntry(const unsigned i) {
+    SyncContentCache::Entry entry;
+    entry.inode = 1000 + i;
+    entry.size = 4096 * i;
+    entry.mtime = 1500000000 + i;
+    entry.ctime = 1500000001 + i;
+    entry.content_hash = shash::Any(shash::kSha1);
+    entry.content_hash.Randomize();
+    entry.compression_alg = zlib::kZlibDefault;
+    return entry;
+  }
+
+  string tmp_path_;
+  string cache_path_;
+};
+
+
+TEST_F(T_SyncContentCache, Roundtrip) {
+  SyncContentCache::Entry plain = MkEntry(1);
+  SyncContentCache::Entry chunked = MkEntry(2);
+  chunked.compression_alg = zlib::kNoCompression;
+  for (unsigned i = 0; i < 3; ++i) {
+    shash::Any chunk_hash(shash::kSha1, shash::kSuffixPartial);
+    chunk_hash.Randomize();
+    chunked.file_chunks.PushBack(FileChunk(chunk_hash, i * 2048, 2048));
+  }
+
+  SyncContentCache writer(cache_path_, "fp");
+  EXPECT_FALSE(writer.Load());
+  writer.Insert("dir/plain", plain);
+  writer.Insert("dir/with space", chunked);
+  writer.Insert("dir/new\nline", plain);
+  EXPECT_EQ(2U, writer.num_inserted());
+  EXPECT_TRUE(writer.Save());
+
+  SyncContentCache reader(cache_path_, "fp");
+  EXPECT_TRUE(reader.Load());
+  EXPECT_EQ(2U, reader.num_loaded());
+  EXPECT_EQ(0U, reader.num_inserted());
+
+  SyncContentCache::Entry result;
+  EXPECT_TRUE(reader.Lookup("dir/plain", plain, &result));
+  EXPECT_EQ(plain.content_hash, result.content_hash);
+  EXPECT_EQ(plain.compression_alg, result.compression_alg);
+  EXPECT_TRUE(result.file_chunks.IsEmpty());
+
+  EXPECT_TRUE(reader.Lookup("dir/with space", chunked, &result));
+  EXPECT_EQ(chunked.content_hash, result.content_hash);
+  EXPECT_EQ(zlib::kNoCompression, result.compression_alg);
+  ASSERT_EQ(3U, result.file_chunks.size());
+  for (unsigned i = 0; i < 3; ++i) {
+    EXPECT_EQ(chunked.file_chunks.At(i).content_hash(),
+              result.file_chunks.At(i).content_hash());
+    EXPECT_EQ(static_cast<off_t>(i * 2048), result.file_chunks.At(i).offset());
+    EXPECT_EQ(2048U, result.file_chunks.At(i).size());
+  }
+
+  EXPECT_FALSE(reader.Lookup("dir/other", plain, &result));
+}
+
+
+TEST_F(T_SyncContentCache, ChangedKey) {
+  SyncContentCache writer(cache_path_, "fp");
+  writer.Insert("file", MkEntry(1));
+  EXPECT_TRUE(writer.Save());
+
+  SyncContentCache reader(cache_path_, "fp");
+  EXPECT_TRUE(reader.Load());
+  SyncContentCache::Entry result;
+  SyncContentCache::Entry key = MkEntry(1);
+  EXPECT_TRUE(reader.Lookup("file", key, &result));
+  key.size++;
+  EXPECT_FALSE(reader.Lookup("file", key, &result));
+  key = MkEntry(1);
+  key.inode++;
+  EXPECT_FALSE(reader.Lookup("file", key, &result));
+  key = MkEntry(1);
+  key.mtime++;
+  EXPECT_FALSE(reader.Lookup("file", key, &result));
+  key = MkEntry(1);
+  key.ctime++;
+  EXPECT_FALSE(reader.Lookup("file", key, &result));
+
+  // Only the entries of the last publish are kept
+  EXPECT_TRUE(reader.Save());
+  SyncContentCache empty(cache_path_, "fp");
+  EXPECT_TRUE(empty.Load());
+  EXPECT_EQ(0U, empty.num_loaded());
+}
+
+
+TEST_F(T_SyncContentCache, Invalid) {
+  SyncContentCache writer(cache_path_, "fp");
+  writer.Insert("file", MkEntry(1));
+  EXPECT_TRUE(writer.Save());
+
+  SyncContentCache other_params(cache_path_, "other fp");
+  EXPECT_FALSE(other_params.Load());
+  EXPECT_EQ(0U, other_params.num_loaded());
+
+  FILE *f = fopen(cache_path_.c_str(), "a");
+  ASSERT_TRUE(f != NULL);
+  fprintf(f, "F garbage\n");
+  fclose(f);
+  SyncContentCache damaged(cache_path_, "fp");
+  EXPECT_FALSE(damaged.Load());
+  EXPECT_EQ(0U, damaged.num_loaded());
+}
+
+}  // namespace publish
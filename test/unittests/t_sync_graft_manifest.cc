@@ -0,0 +1,78 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "sync_graft_manifest.h"
+#include "util/posix.h"
+
+using namespace std;  // NOLINT
+
+namespace publish {
+
+class T_SyncGraftManifest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    tmp_path_ = CreateTempDir("./cvmfs_ut_sync_graft_manifest");
+    ASSERT_FALSE(tmp_path_.empty());
+    manifest_path_ = tmp_path_ + "/manifest";
+  }
+
+  virtual void TearDown() {
+    RemoveTree(tmp_path_);
+  }
+
+  string tmp_path_;
+  string manifest_path_;
+};
+
+
+TEST_F(T_SyncGraftManifest, Roundtrip) {
+  const string plain =
+    "size=4\nchecksum=da39a3ee5e6b4b0d3255bfef95601890afd80709\n";
+  const string chunked =
+    "size=8\nchecksum=da39a3ee5e6b4b0d3255bfef95601890afd80709\n"
+    "chunk_offsets=0,4\n"
+    "chunk_checksums=da39a3ee5e6b4b0d3255bfef95601890afd80709,"
+    "da39a3ee5e6b4b0d3255bfef95601890afd80709\n";
+  ASSERT_TRUE(SafeWriteToFile(
+    GraftManifest::MakeHeader() +
+    GraftManifest::MakeRecord("/cvmfs/test.cern.ch/a", plain) +
+    GraftManifest::MakeRecord("/cvmfs/test.cern.ch/dir/b", chunked),
+    manifest_path_, 0644));
+
+  GraftManifest manifest(manifest_path_);
+  EXPECT_TRUE(manifest.Load());
+  EXPECT_EQ(2U, manifest.size());
+
+  string description;
+  EXPECT_TRUE(manifest.Lookup("/cvmfs/test.cern.ch/a", &description));
+  EXPECT_EQ(plain, description);
+  EXPECT_TRUE(manifest.Lookup("/cvmfs/test.cern.ch/dir/b", &description));
+  EXPECT_EQ(chunked, description);
+  EXPECT_FALSE(manifest.Lookup("/cvmfs/test.cern.ch/dir", &description));
+}
+
+
+TEST_F(T_SyncGraftManifest, Invalid) {
+  GraftManifest manifest(manifest_path_);
+  EXPECT_FALSE(manifest.Load());
+
+  ASSERT_TRUE(SafeWriteToFile("size=4\n", manifest_path_, 0644));
+  EXPECT_FALSE(manifest.Load());
+
+  ASSERT_TRUE(SafeWriteToFile(GraftManifest::MakeHeader() + "size=4\n",
+                              manifest_path_, 0644));
+  EXPECT_FALSE(manifest.Load());
+  EXPECT_EQ(0U, manifest.size());
+
+  ASSERT_TRUE(SafeWriteToFile(GraftManifest::MakeHeader(), manifest_path_,
+                              0644));
+  EXPECT_TRUE(manifest.Load());
+  EXPECT_EQ(0U, manifest.size());
+}
+
+}  // namespace publish
@@ -0,0 +1,256 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+
+#include "tar_reader.h"
+#include "util/posix.h"
+#include "util/string.h"
+
+using namespace std;  // NOLINT
+
+namespace publish {
+
+class T_TarReader : public ::testing::Test {
+ protected:
+  static const unsigned kBlockSize = 512;
+
+  virtual void SetUp() {
+    fd_ = -1;
+    archive_path_ = CreateTempPath("./cvmfs_ut_tar_reader", 0600);
+    ASSERT_FALSE(archive_path_.empty());
+  }
+
+  virtual void TearDown() {
+    if (fd_ >= 0)
+      close(fd_);
+    unlink(archive_path_.c_str());
+  }
+
+  static void SetField(string *block, unsigned offset, const string &value) {
+    block->replace(offset, value.length(), value);
+  }
+
+  static string Octal(uint64_t value, unsigned length) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%0*llo", length - 1,
+             static_cast<unsigned long long>(value));  // NOLINT
+    return string(buf);
+  }
+
+  static string Header(const string &name, char type, uint64_t size,
+                       const string &link = "")
+  {
+    string block(kBlockSize, '\0');
+    SetField(&block, 0, name);
+    SetField(&block, 100, Octal(0644, 8));
+    SetField(&block, 108, Octal(1000, 8));
+    SetField(&block, 116, Octal(100, 8));
+    SetField(&block, 124, Octal(size, 12));
+    SetField(&block, 136, Octal(1234567890, 12));
+    block[156] = type;
+    SetField(&block, 157, link);
+    SetField(&block, 257, string("ustar\0" "00", 8));
+    return block;
+  }
+
+  static string Finalize(string block) {
+    SetField(&block, 148, string(8, ' '));
+    unsigned sum = 0;
+    for (unsigned i = 0; i < kBlockSize; ++i)
+      sum += static_cast<unsigned char>(block[i]);
+    SetField(&block, 148, Octal(sum, 7) + '\0');
+    return block;
+  }
+
+  static string Data(const string &data) {
+    return data + string((kBlockSize - data.length() % kBlockSize) %
+                         kBlockSize, '\0');
+  }
+
+  static string PaxRecord(const string &key, const string &value) {
+    const string payload = " " + key + "=" + value + "\n";
+    unsigned length = payload.length() + 1;
+    while (StringifyInt(length).length() + payload.length() != length)
+      length++;
+    return StringifyInt(length) + payload;
+  }
+
+  void Open(const string &archive) {
+    ASSERT_TRUE(SafeWriteToFile(archive, archive_path_, 0600));
+    fd_ = open(archive_path_.c_str(), O_RDONLY);
+    ASSERT_GE(fd_, 0);
+  }
+
+  string ReadAll(TarReader *reader) {
+    string result;
+    char buf[7];
+    int64_t nbytes;
+    while ((nbytes = reader->ReadData(buf, sizeof(buf))) > 0)
+      result.append(buf, nbytes);
+    EXPECT_EQ(0, nbytes);
+    return result;
+  }
+
+  int fd_;
+  string archive_path_;
+};
+
+const unsigned T_TarReader::kBlockSize;
+
+
+TEST_F(T_TarReader, ParseNumber) {
+  uint64_t value;
+  const unsigned char octal[] = "0000644\0";
+  EXPECT_TRUE(TarReader::ParseNumber(octal, 8, &value));
+  EXPECT_EQ(0644U, value);
+  const unsigned char spaces[] = "  755 \0\0";
+  EXPECT_TRUE(TarReader::ParseNumber(spaces, 8, &value));
+  EXPECT_EQ(0755U, value);
+  const unsigned char empty[] = "\0\0\0\0\0\0\0\0";
+  EXPECT_TRUE(TarReader::ParseNumber(empty, 8, &value));
+  EXPECT_EQ(0U, value);
+  const unsigned char base256[] =
+    {0x80, 0, 0, 0, 0, 0, 0, 0x02, 0, 0, 0, 0x01};
+  EXPECT_TRUE(TarReader::ParseNumber(base256, 12, &value));
+  EXPECT_EQ((uint64_t(2) << 32) + 1, value);
+  const unsigned char negative[] = {0xff, 0xff, 0xff, 0xff};
+  EXPECT_FALSE(TarReader::ParseNumber(negative, 4, &value));
+  const unsigned char invalid[] = "0000899\0";
+  EXPECT_FALSE(TarReader::ParseNumber(invalid, 8, &value));
+}
+
+
+TEST_F(T_TarReader, NormalizePath) {
+  EXPECT_EQ("", TarReader::NormalizePath(""));
+  EXPECT_EQ("", TarReader::NormalizePath("./"));
+  EXPECT_EQ("", TarReader::NormalizePath("/"));
+  EXPECT_EQ("a/b", TarReader::NormalizePath("./a/b/"));
+  EXPECT_EQ("a/b", TarReader::NormalizePath("/a//./b"));
+  EXPECT_EQ("a/../b", TarReader::NormalizePath("a/../b"));
+}
+
+
+TEST_F(T_TarReader, Ustar) {
+  const string archive =
+    Finalize(Header("./dir/", '5', 0)) +
+    Finalize(Header("./dir/file", '0', 11)) + Data("hello world") +
+    Finalize(Header("dir/skipped", '0', 600)) + Data(string(600, 'x')) +
+    Finalize(Header("dir/link", '2', 0, "file")) +
+    Finalize(Header("dir/hardlink", '1', 0, "./dir/file")) +
+    string(2 * kBlockSize, '\0');
+  Open(archive);
+
+  TarReader reader(fd_);
+  TarReader::Entry entry;
+  ASSERT_TRUE(reader.Next(&entry));
+  EXPECT_EQ(TarReader::kEntryDirectory, entry.type);
+  EXPECT_EQ("dir", entry.path);
+  EXPECT_EQ(0644U, entry.mode);
+  EXPECT_EQ(1000U, entry.uid);
+  EXPECT_EQ(100U, entry.gid);
+  EXPECT_EQ(1234567890, entry.mtime);
+
+  ASSERT_TRUE(reader.Next(&entry));
+  EXPECT_EQ(TarReader::kEntryFile, entry.type);
+  EXPECT_EQ("dir/file", entry.path);
+  EXPECT_EQ(11U, entry.size);
+  EXPECT_EQ("hello world", ReadAll(&reader));
+
+  // Data that is not read is skipped
+  ASSERT_TRUE(reader.Next(&entry));
+  EXPECT_EQ("dir/skipped", entry.path);
+  EXPECT_EQ(600U, entry.size);
+
+  ASSERT_TRUE(reader.Next(&entry));
+  EXPECT_EQ(TarReader::kEntrySymlink, entry.type);
+  EXPECT_EQ("file", entry.link_target);
+  EXPECT_EQ(0U, entry.size);
+
+  ASSERT_TRUE(reader.Next(&entry));
+  EXPECT_EQ(TarReader::kEntryHardlink, entry.type);
+  EXPECT_EQ("dir/file", entry.link_target);
+
+  EXPECT_FALSE(reader.Next(&entry));
+  EXPECT_FALSE(reader.failed());
+}
+
+
+TEST_F(T_TarReader, Extensions) {
+  const string long_name = "dir/" + string(150, 'a');
+  const string long_target = string(120, 'b');
+  const string pax = PaxRecord("path", long_name) +
+                     PaxRecord("size", "3") +
+                     PaxRecord("mtime", "1500000000.25") +
+                     PaxRecord("uid", "4000000");
+
+  string ustar_prefix = Header(string(60, 'c'), '0', 0);
+  SetField(&ustar_prefix, 345, "prefix/dir");
+
+  const string archive =
+    Finalize(Header("pax_global_header", 'g', 20)) + Data(string(20, 'g')) +
+    Finalize(Header("PaxHeaders/x", 'x', pax.length())) + Data(pax) +
+    Finalize(Header("ignored", '0', 0)) + Data("abc") +
+    Finalize(Header("././@LongLink", 'L', long_name.length() + 1)) +
+      Data(long_name + '\0') +
+    Finalize(Header("././@LongLink", 'K', long_target.length() + 1)) +
+      Data(long_target + '\0') +
+    Finalize(Header("truncated", '2', 0, "truncated")) +
+    Finalize(ustar_prefix);
+  Open(archive);
+
+  TarReader reader(fd_);
+  TarReader::Entry entry;
+  ASSERT_TRUE(reader.Next(&entry));
+  EXPECT_EQ(long_name, entry.path);
+  EXPECT_EQ(3U, entry.size);
+  EXPECT_EQ(1500000000, entry.mtime);
+  EXPECT_EQ(4000000U, entry.uid);
+  EXPECT_EQ("abc", ReadAll(&reader));
+
+  ASSERT_TRUE(reader.Next(&entry));
+  EXPECT_EQ(TarReader::kEntrySymlink, entry.type);
+  EXPECT_EQ(long_name, entry.path);
+  EXPECT_EQ(long_target, entry.link_target);
+  // Pax values apply to a single entry
+  EXPECT_EQ(1000U, entry.uid);
+
+  ASSERT_TRUE(reader.Next(&entry));
+  EXPECT_EQ("prefix/dir/" + string(60, 'c'), entry.path);
+
+  // No end of archive marker
+  EXPECT_FALSE(reader.Next(&entry));
+  EXPECT_FALSE(reader.failed());
+}
+
+
+TEST_F(T_TarReader, Corrupted) {
+  string header = Finalize(Header("file", '0', 5));
+  header[0] = 'g';
+  Open(header + Data("hello"));
+  TarReader reader(fd_);
+  TarReader::Entry entry;
+  EXPECT_FALSE(reader.Next(&entry));
+  EXPECT_TRUE(reader.failed());
+}
+
+
+TEST_F(T_TarReader, Truncated) {
+  Open(Finalize(Header("file", '0', 1000)) + "hello");
+  TarReader reader(fd_);
+  TarReader::Entry entry;
+  ASSERT_TRUE(reader.Next(&entry));
+  char buf[1000];
+  EXPECT_EQ(-1, reader.ReadData(buf, sizeof(buf)));
+  EXPECT_TRUE(reader.failed());
+  EXPECT_FALSE(reader.Next(&entry));
+}
+
+}  // namespace publish
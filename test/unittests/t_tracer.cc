@@ -8,6 +8,8 @@
 
 #include <cassert>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "tracer.h"
 #include "util/posix.h"
@@ -313,4 +315,67 @@ TEST_F(T_Tracer, FlushTen) {
   EXPECT_EQ(11002U, GetNol());
 }
 
+TEST_F(T_Tracer, Binary) {
+  tracer_ = new Tracer();
+  tracer_->Activate(64, 32, trace_file_, Tracer::kFormatBinary);
+  tracer_->Spawn();
+  for (int i = 0; i < 100; ++i) {
+    tracer_->Trace(Tracer::kEventOpen, PathString(StringifyInt(i % 3)),
+                   "open \"quoted\"");
+  }
+  delete tracer_;
+
+  // Strings are only stored once
+  EXPECT_LT(GetFileSize(trace_file_),
+            static_cast<int64_t>(120 * sizeof(Tracer::BinaryRecord)));
+
+  const string csv_file = CreateTempPath("./cvmfs_ut_tracer_csv", 0600);
+  FILE *f = fopen(csv_file.c_str(), "w");
+  ASSERT_TRUE(f != NULL);
+  EXPECT_TRUE(Tracer::ConvertBinaryToCsv(trace_file_, f));
+  fclose(f);
+
+  f = fopen(csv_file.c_str(), "r");
+  ASSERT_TRUE(f != NULL);
+  vector<string> lines;
+  string line;
+  while (GetLineFile(f, &line))
+    lines.push_back(line);
+  fclose(f);
+  unlink(csv_file.c_str());
+
+  ASSERT_EQ(102U, lines.size());
+  EXPECT_NE(string::npos, lines[0].find(",\"-1\",\"Tracer\","));
+  EXPECT_NE(string::npos,
+            lines[3].find(",\"1\",\"2\",\"open \"\"quoted\"\"\""));
+  EXPECT_NE(string::npos, lines[101].find(",\"-2\",\"Tracer\","));
+
+  // Not a binary trace file
+  EXPECT_FALSE(Tracer::ConvertBinaryToCsv(csv_file, stdout));
+  EXPECT_FALSE(Tracer::ConvertBinaryToCsv("/no/such/file", stdout));
+}
+
+TEST_F(T_Tracer, ReadBinaryTrace) {
+  tracer_ = new Tracer();
+  tracer_->Activate(64, 32, trace_file_, Tracer::kFormatBinary);
+  tracer_->Spawn();
+  tracer_->Trace(Tracer::kEventLookup, PathString("/a"), "lookup()");
+  tracer_->Trace(Tracer::kEventOpen, PathString("/a/b"), "open()");
+  delete tracer_;
+
+  vector<Tracer::Event> events;
+  EXPECT_TRUE(Tracer::ReadBinaryTrace(trace_file_, &events));
+  ASSERT_EQ(4U, events.size());
+  EXPECT_EQ(-1, events[0].code);
+  EXPECT_EQ(Tracer::kEventLookup, events[1].code);
+  EXPECT_EQ("/a", events[1].path);
+  EXPECT_EQ("lookup()", events[1].msg);
+  EXPECT_EQ(Tracer::kEventOpen, events[2].code);
+  EXPECT_EQ("/a/b", events[2].path);
+  EXPECT_LE(events[1].time_ns, events[2].time_ns);
+  EXPECT_EQ(-2, events[3].code);
+
+  EXPECT_FALSE(Tracer::ReadBinaryTrace("/no/such/file", &events));
+}
+
 }  // namespace tracer
@@ -0,0 +1,80 @@
+/**
+ * This file is part of the CernVM File System.
+ */
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <string>
+
+#include "clientctx.h"
+#include "uid_accounting.h"
+
+using namespace std;  // NOLINT
+
+namespace cvmfs {
+
+TEST(T_UidAccounting, Record) {
+  UidAccounting accounting;
+  accounting.RecordHit();
+  {
+    ClientCtxGuard guard(1000, 100, 1);
+    accounting.RecordHit();
+    accounting.RecordHit();
+    accounting.RecordDownload(1024, 5000, true);
+    accounting.RecordDownload(0, 1000, false);
+  }
+  {
+    ClientCtxGuard guard(1001, 100, 2);
+    accounting.RecordDownload(10, 10, true);
+  }
+
+  map<uid_t, UidAccounting::Usage> usage;
+  accounting.GetUsage(&usage);
+  EXPECT_EQ(3U, usage.size());
+  EXPECT_EQ(1U, usage[UidAccounting::kInternalUid].n_hits);
+  EXPECT_EQ(2U, usage[1000].n_hits);
+  EXPECT_EQ(1U, usage[1000].n_downloads);
+  EXPECT_EQ(1U, usage[1000].n_failures);
+  EXPECT_EQ(1024U, usage[1000].sz_downloaded);
+  EXPECT_EQ(6000U, usage[1000].download_time_us);
+  EXPECT_EQ(0U, usage[1001].n_hits);
+  EXPECT_EQ(10U, usage[1001].sz_downloaded);
+
+  const string printed = accounting.Print();
+  EXPECT_NE(string::npos, printed.find("internal | 1 | 0 | 0 | 0 | 0\n"));
+  EXPECT_NE(string::npos, printed.find("1000 | 2 | 1 | 1 | 1024 | 6\n"));
+}
+
+
+TEST(T_UidAccounting, Overflow) {
+  UidAccounting accounting;
+  {
+    ClientCtxGuard guard(1000, 100, 1);
+    accounting.RecordHit();
+  }
+  accounting.num_uids_ = UidAccounting::kMaxUids;
+  // Uids in different shards end up in the same overflow entry
+  for (uid_t uid = 2000; uid < 2000 + 2 * UidAccounting::kNumShards; ++uid) {
+    ClientCtxGuard guard(uid, 100, 1);
+    accounting.RecordHit();
+  }
+  {
+    // Known uids are still accounted on their own
+    ClientCtxGuard guard(1000, 100, 1);
+    accounting.RecordHit();
+  }
+  // The internal uid does not count towards the limit
+  accounting.RecordHit();
+
+  map<uid_t, UidAccounting::Usage> usage;
+  accounting.GetUsage(&usage);
+  EXPECT_EQ(3U, usage.size());
+  EXPECT_EQ(2U, usage[1000].n_hits);
+  EXPECT_EQ(2 * UidAccounting::kNumShards,
+            usage[UidAccounting::kOverflowUid].n_hits);
+  EXPECT_EQ(1U, usage[UidAccounting::kInternalUid].n_hits);
+  EXPECT_NE(string::npos, accounting.Print().find("other | "));
+}
+
+}  // namespace cvmfs
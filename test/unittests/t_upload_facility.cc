@@ -6,6 +6,10 @@
 
 #include <unistd.h>
 
+#include <set>
+#include <string>
+
+#include "bloom_filter.h"
 #include "file_processing/char_buffer.h"
 #include "hash.h"
 #include "testutil.h"
@@ -36,7 +40,7 @@ class UF_MockUploader : public AbstractMockUploader<UF_MockUploader> {
  public:
   explicit UF_MockUploader(const SpoolerDefinition &spooler_definition)
       : AbstractMockUploader<UF_MockUploader>(spooler_definition),
-        initialize_called(false) {}
+        initialize_called(false), discards(0) {}
 
   virtual std::string name() const { return "UFMock"; }
 
@@ -70,8 +74,21 @@ class UF_MockUploader : public AbstractMockUploader<UF_MockUploader> {
     Respond(callback, UploaderResults(0));
   }
 
+  bool Peek(const std::string &path) const {
+    return stored_paths.count(path) > 0;
+  }
+
+ protected:
+  bool DiscardStreamedUpload(upload::UploadStreamHandle *abstract_handle) {
+    discards++;
+    delete static_cast<UF_MockStreamHandle *>(abstract_handle);
+    return true;
+  }
+
  public:
   bool initialize_called;
+  int discards;
+  std::set<std::string> stored_paths;
 };
 
 //------------------------------------------------------------------------------
@@ -257,4 +274,56 @@ TEST(T_UploadFacility, InitDtorRace) {
   delete uploader;
 }
 
+//------------------------------------------------------------------------------
+
+int existence_commit_callback_calls = 0;
+void CommitCallback_T_ExistenceIndex(const UploaderResults &results) {
+  EXPECT_EQ(UploaderResults::kChunkCommit, results.type);
+  EXPECT_EQ(0, results.return_code);
+  existence_commit_callback_calls++;
+}
+
+TEST(T_UploadFacility, ExistenceIndex) {
+  UF_MockUploader *uploader = UF_MockUploader::MockConstruct();
+  ASSERT_NE(static_cast<UF_MockUploader *>(NULL), uploader);
+
+  shash::Any stored(shash::kSha1);
+  stored.Randomize(1);
+  shash::Any false_positive(shash::kSha1);
+  false_positive.Randomize(2);
+  shash::Any unknown(shash::kSha1);
+  unknown.Randomize(3);
+
+  uint64_t h1, h2;
+  BloomFilter *index = new BloomFilter(16);
+  AbstractUploader::ExistenceIndexKey(stored, &h1, &h2);
+  index->Add(h1, h2);
+  // In the index but not in the storage, must not be dropped
+  AbstractUploader::ExistenceIndexKey(false_positive, &h1, &h2);
+  index->Add(h1, h2);
+  uploader->SetExistenceIndex(index);
+  uploader->stored_paths.insert("data/" + stored.MakePath());
+
+  const shash::Any hashes[] = { stored, false_positive, unknown };
+  for (unsigned i = 0; i < 3; ++i) {
+    UploadStreamHandle *handle = uploader->InitStreamedUpload(
+      AbstractUploader::MakeCallback(&CommitCallback_T_ExistenceIndex));
+    CharBuffer *buffer = new CharBuffer(1024);
+    buffer->SetUsedBytes(100);
+    buffer->SetBaseOffset(0);
+    uploader->ScheduleUpload(handle, buffer);
+    uploader->ScheduleCommit(handle, hashes[i]);
+    uploader->WaitForUpload();
+    delete buffer;
+  }
+  uploader->TearDown();
+
+  EXPECT_EQ(3, existence_commit_callback_calls);
+  EXPECT_EQ(1, uploader->discards);
+  EXPECT_EQ(1, uploader->num_skipped_uploads());
+  EXPECT_EQ(100, uploader->num_skipped_bytes());
+  EXPECT_EQ(0, UF_MockStreamHandle::instances);
+  delete uploader;
+}
+
 }  // namespace upload
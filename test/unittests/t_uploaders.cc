@@ -8,12 +8,16 @@
 #include <tbb/atomic.h>
 #include <unistd.h>
 
+#include <set>
 #include <string>
+#include <vector>
 
 #include "atomic.h"
 #include "c_file_sandbox.h"
+#include "compression.h"
 #include "file_processing/char_buffer.h"
 #include "hash.h"
+#include "prng.h"
 #include "testutil.h"
 #include "upload_facility.h"
 #include "upload_local.h"
@@ -28,6 +32,11 @@
  */
 #define CVMFS_S3_TEST_MOCKUP_SERVER_PORT 8082
 
+/**
+ * Upload id that the S3 mockup server hands out for multipart uploads
+ */
+static const char kMockUploadId[] = "42";
+
 namespace upload {
 
 class UploadCallbacks {
@@ -324,6 +333,26 @@ class T_Uploaders : public FileSandbox {
   }
 
 
+  /**
+   * Restarts the uploader such that streamed S3 uploads use multipart
+   * uploads.  No-op for other uploaders.
+   */
+  void EnableMultipartUploads(const unsigned part_size_mb,
+                              const unsigned parallel_parts) {
+    if (!IsS3())
+      return;
+    uploader_->TearDown();
+    delete uploader_;
+    FILE *s3_conf = fopen(s3_conf_path.c_str(), "a");
+    ASSERT_TRUE(s3_conf != NULL);
+    fprintf(s3_conf, "CVMFS_S3_PART_SIZE=%u\nCVMFS_S3_PARALLEL_PARTS=%u\n",
+            part_size_mb, parallel_parts);
+    fclose(s3_conf);
+    uploader_ = AbstractUploader::Construct(GetSpoolerDefinition());
+    ASSERT_NE(static_cast<AbstractUploader*>(NULL), uploader_);
+  }
+
+
   bool IsS3() const;
 
  private:
@@ -379,6 +408,20 @@ class T_Uploaders : public FileSandbox {
   }
 
 
+  /**
+   * Get the value of the HTTP header name from the request header, empty if
+   * the header is missing.
+   */
+  std::string GetHeader(const std::string &header, const std::string &name) {
+    const size_t pos = header.find("\n" + name + ":");
+    if (pos == std::string::npos)
+      return "";
+    const size_t begin = pos + name.length() + 2;
+    return Trim(header.substr(begin,
+                              header.find_first_of("\r\n", begin) - begin));
+  }
+
+
   void S3MockupServerThread() {
     const int kReadBufferSize = 1000;
     int listen_sockfd, accept_sockfd;
@@ -410,6 +453,7 @@ class T_Uploaders : public FileSandbox {
     tv.tv_sec = 5;
     tv.tv_usec = 0;
     fd_set rfds;
+    std::set<std::string> throttled;
     while (true) {
       // Wait for traffic
       FD_ZERO(&rfds);
@@ -449,14 +493,21 @@ class T_Uploaders : public FileSandbox {
       req_type = GetField(req_header, ' ', 0);
       req_file = GetField(req_header, ' ', 1);
       req_file = req_file.substr(req_file.find("/", 1) + 1);  // no bucket
-      if (req_type.compare("PUT") == 0) {
+      if ((req_type.compare("PUT") == 0) || (req_type.compare("POST") == 0)) {
         content_length = GetValue(req_header, "Content-Length");
         ASSERT_GE(content_length, 0);
       }
 
       // Get content
       FILE *file = NULL;
-      if (req_type.compare("PUT") == 0) {
+      std::string copy_source = GetHeader(req_header, "x-amz-copy-source");
+      if (!copy_source.empty()) {
+        // Server-side copy, the source starts with the bucket
+        copy_source = copy_source.substr(copy_source.find("/", 1) + 1);
+        EXPECT_EQ(0, content_length);
+        EXPECT_TRUE(CopyPath2Path(T_Uploaders::dest_dir + "/" + copy_source,
+                                  T_Uploaders::dest_dir + "/" + req_file));
+      } else if (req_type.compare("PUT") == 0) {
         std::string path = T_Uploaders::dest_dir + "/" + req_file;
         file = fopen(path.c_str(), "w");
         ASSERT_TRUE(file != NULL);
@@ -473,8 +524,78 @@ class T_Uploaders : public FileSandbox {
         EXPECT_EQ(retval, 0);
       }
 
+      std::string body;
+      if (req_type.compare("POST") == 0) {
+        while (static_cast<int>(body.length()) < content_length) {
+          int n = read(accept_sockfd, buffer, kReadBufferSize-1);
+          ASSERT_GT(n, 0);
+          body += std::string(buffer, n);
+        }
+      }
+
+      // Multipart upload, "?uploads" initiates and "?uploadId=" completes
+      std::string post_result = "<DeleteResult></DeleteResult>";
+      const size_t upload_id_pos = req_file.find("?uploadId=");
+      if ((req_type.compare("POST") == 0) && HasSuffix(req_file, "?uploads",
+                                                       false))
+      {
+        post_result = "<InitiateMultipartUploadResult><UploadId>" +
+                      std::string(kMockUploadId) +
+                      "</UploadId></InitiateMultipartUploadResult>";
+      } else if ((req_type.compare("POST") == 0) &&
+                 (upload_id_pos != std::string::npos))
+      {
+        const std::string key = req_file.substr(0, upload_id_pos);
+        const std::string path = T_Uploaders::dest_dir + "/" + key;
+        FILE *fobject = fopen(path.c_str(), "w");
+        ASSERT_TRUE(fobject != NULL);
+        FileGuard file_guard(fobject);
+        unsigned part_number = 0;
+        size_t pos = 0;
+        while ((pos = body.find("<PartNumber>", pos)) != std::string::npos) {
+          pos += 12;
+          EXPECT_EQ(++part_number, String2Uint64(body.substr(pos)));
+          const std::string path_part = path + "?partNumber=" +
+            StringifyInt(part_number) + "&uploadId=" + kMockUploadId;
+          EXPECT_NE(std::string::npos,
+                    body.find("<ETag>\"" + StringifyInt(part_number) +
+                              "\"</ETag>", pos));
+          unsigned char *part = NULL;
+          unsigned part_size = 0;
+          EXPECT_TRUE(CopyPath2Mem(path_part, &part, &part_size));
+          EXPECT_TRUE(CopyMem2File(part, part_size, fobject));
+          free(part);
+          retval = remove(path_part.c_str());
+          ASSERT_EQ(retval, 0);
+        }
+        EXPECT_GT(part_number, 0U);
+        post_result = "<CompleteMultipartUploadResult>"
+                      "</CompleteMultipartUploadResult>";
+      } else if (req_type.compare("POST") == 0) {
+        // Multi-object delete, the body lists the keys
+        EXPECT_EQ("?delete", req_file);
+        size_t pos = 0;
+        while ((pos = body.find("<Key>", pos)) != std::string::npos) {
+          pos += 5;
+          const std::string key =
+            body.substr(pos, body.find("</Key>", pos) - pos);
+          std::string path = T_Uploaders::dest_dir + "/" + key;
+          if (FileExists(path)) {
+            retval = remove(path.c_str());
+            ASSERT_EQ(retval, 0);
+          }
+        }
+      }
+
       // Reply to client
       std::string reply = "HTTP/1.1 200 OK\r\n";
+      // S3 throttling, the first upload of a "throttled" object fails
+      if ((req_type.compare("PUT") == 0) &&
+          (req_file.find("throttled") != std::string::npos) &&
+          throttled.insert(req_file).second)
+      {
+        reply = "HTTP/1.1 503 Slow Down\r\n";
+      }
       if (req_type.compare("HEAD") == 0) {
         if (req_file.size() >= 4 &&
             req_file.compare(req_file.size() - 4, 4, "EXIT") == 0) {
@@ -490,6 +611,21 @@ class T_Uploaders : public FileSandbox {
         }
         // "No Content"-reply even if file did not exist
         reply = "HTTP/1.1 204 No Content\r\n";
+      } else if (req_type.compare("POST") == 0) {
+        reply += "Content-Length: " + StringifyInt(post_result.length()) +
+                 "\r\n";
+        reply += "Connection: close\r\n\r\n" + post_result;
+        int n = write(accept_sockfd, reply.c_str(), reply.length());
+        ASSERT_GE(n, 0);
+        continue;
+      }
+      const size_t part_number_pos = req_file.find("?partNumber=");
+      if ((req_type.compare("PUT") == 0) &&
+          (part_number_pos != std::string::npos))
+      {
+        reply += "ETag: \"" +
+          StringifyInt(String2Uint64(req_file.substr(part_number_pos + 12))) +
+          "\"\r\n";
       }
       reply += "Connection: close\r\n\r\n";
 
@@ -694,11 +830,69 @@ TYPED_TEST(T_Uploaders, RemoveFromStorage) {
 }
 
 
+TYPED_TEST(T_Uploaders, RemoveBatchFromStorage) {
+  const std::string small_file_path = TestFixture::GetSmallFile();
+  const unsigned kNumObjects = 50;
+
+  Prng prng;
+  prng.InitLocaltime();
+  std::vector<shash::Any> hashes;
+  for (unsigned i = 0; i < kNumObjects; ++i) {
+    shash::Any hash(shash::kSha1);
+    hash.Randomize(&prng);
+    hashes.push_back(hash);
+    this->uploader_->Upload(small_file_path, "data/" + hash.MakePath(),
+                            AbstractUploader::MakeClosure(
+                                &UploadCallbacks::SimpleUploadClosure,
+                                &this->delegate_,
+                                UploaderResults(0, small_file_path)));
+  }
+  this->uploader_->WaitForUpload();
+  EXPECT_EQ(kNumObjects, this->delegate_.simple_upload_invocations);
+  for (unsigned i = 0; i < kNumObjects; ++i)
+    EXPECT_TRUE(TestFixture::CheckFile("data/" + hashes[i].MakePath()));
+
+  // Not existing objects count as removed
+  shash::Any missing(shash::kSha1);
+  missing.Randomize(&prng);
+  hashes.push_back(missing);
+
+  EXPECT_TRUE(this->uploader_->RemoveBatch(hashes, 4));
+  for (unsigned i = 0; i < kNumObjects; ++i)
+    EXPECT_FALSE(TestFixture::CheckFile("data/" + hashes[i].MakePath()));
+  EXPECT_TRUE(this->uploader_->RemoveBatch(std::vector<shash::Any>(), 4));
+}
+
+
 //
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 //
 
 
+TYPED_TEST(T_Uploaders, UploadThrottled) {
+  const std::string small_file_path = TestFixture::GetSmallFile();
+  const unsigned kNumObjects = 20;
+
+  for (unsigned i = 0; i < kNumObjects; ++i) {
+    this->uploader_->Upload(small_file_path, "throttled-" + StringifyInt(i),
+                            AbstractUploader::MakeClosure(
+                                &UploadCallbacks::SimpleUploadClosure,
+                                &this->delegate_,
+                                UploaderResults(0, small_file_path)));
+  }
+  this->uploader_->WaitForUpload();
+
+  EXPECT_EQ(kNumObjects, this->delegate_.simple_upload_invocations);
+  for (unsigned i = 0; i < kNumObjects; ++i) {
+    const std::string dest_name = "throttled-" + StringifyInt(i);
+    EXPECT_TRUE(TestFixture::CheckFile(dest_name));
+    TestFixture::CompareFileContents(small_file_path,
+                                     TestFixture::AbsoluteDestinationPath(
+                                         dest_name));
+  }
+}
+
+
 TYPED_TEST(T_Uploaders, UploadEmptyFile) {
   const std::string empty_file_path = TestFixture::GetEmptyFile();
   const std::string dest_name       = "empty_file";
@@ -849,6 +1043,77 @@ TYPED_TEST(T_Uploaders, SingleStreamedUpload) {
 //------------------------------------------------------------------------------
 
 
+TYPED_TEST(T_Uploaders, MultipartStreamedUpload) {
+  this->EnableMultipartUploads(1, 2);
+
+  const unsigned int number_of_buffers = 20;
+  typename TestFixture::Buffers large_buffers =
+      TestFixture::MakeRandomizedBuffers(number_of_buffers, 4711);
+  typename TestFixture::Buffers small_buffers =
+      TestFixture::MakeRandomizedBuffers(1, 42);
+  size_t large_size = 0;
+  for (unsigned i = 0; i < number_of_buffers; ++i)
+    large_size += large_buffers[i]->used_bytes();
+  // Several parts of 1MB
+  ASSERT_GT(large_size, 3u * 1024 * 1024);
+  ASSERT_LT(small_buffers[0]->used_bytes(), 1024u * 1024);
+
+  typename TestFixture::StreamHandle large;
+  typename TestFixture::StreamHandle small;
+  large.handle = this->uploader_->InitStreamedUpload(
+      AbstractUploader::MakeClosure(&UploadCallbacks::StreamedUploadComplete,
+                                    &this->delegate_,
+                                    0));
+  small.handle = this->uploader_->InitStreamedUpload(
+      AbstractUploader::MakeClosure(&UploadCallbacks::StreamedUploadComplete,
+                                    &this->delegate_,
+                                    0));
+  ASSERT_NE(static_cast<UploadStreamHandle*>(NULL), large.handle);
+  ASSERT_NE(static_cast<UploadStreamHandle*>(NULL), small.handle);
+
+  for (unsigned i = 0; i < number_of_buffers; ++i) {
+    this->uploader_->ScheduleUpload(large.handle, large_buffers[i],
+                                    AbstractUploader::MakeClosure(
+                                        &UploadCallbacks::BufferUploadComplete,
+                                        &this->delegate_,
+                                        UploaderResults(0, large_buffers[i])));
+  }
+  this->uploader_->ScheduleUpload(small.handle, small_buffers[0],
+                                  AbstractUploader::MakeClosure(
+                                      &UploadCallbacks::BufferUploadComplete,
+                                      &this->delegate_,
+                                      UploaderResults(0, small_buffers[0])));
+  this->uploader_->ScheduleCommit(large.handle, large.content_hash);
+  this->uploader_->ScheduleCommit(small.handle, small.content_hash);
+  this->uploader_->WaitForUpload();
+
+  EXPECT_EQ(number_of_buffers + 1,
+            this->delegate_.buffer_upload_complete_invocations);
+  EXPECT_EQ(2u, this->delegate_.streamed_upload_complete_invocations);
+
+  const std::string large_dest = "data/" + large.content_hash.MakePath();
+  const std::string small_dest = "data/" + small.content_hash.MakePath();
+  EXPECT_TRUE(TestFixture::CheckFile(large_dest));
+  EXPECT_TRUE(TestFixture::CheckFile(small_dest));
+  TestFixture::CompareBuffersAndFileContents(
+      large_buffers, TestFixture::AbsoluteDestinationPath(large_dest));
+  TestFixture::CompareBuffersAndFileContents(
+      small_buffers, TestFixture::AbsoluteDestinationPath(small_dest));
+
+  // No leftover staging objects or parts
+  const std::vector<std::string> txn =
+      FindFiles(TestFixture::AbsoluteDestinationPath("data/txn"), "");
+  for (unsigned i = 0; i < txn.size(); ++i)
+    EXPECT_EQ(std::string::npos, txn[i].find("multipart")) << txn[i];
+
+  TestFixture::FreeBuffers(&large_buffers);
+  TestFixture::FreeBuffers(&small_buffers);
+}
+
+
+//------------------------------------------------------------------------------
+
+
 TYPED_TEST(T_Uploaders, MultipleStreamedUploadSlow) {
   const unsigned int  number_of_files        = 100;
   const unsigned int  max_buffers_per_stream = 15;
@@ -925,6 +1190,73 @@ TYPED_TEST(T_Uploaders, MultipleStreamedUploadSlow) {
 //------------------------------------------------------------------------------
 
 
+TYPED_TEST(T_Uploaders, MultipleWriters) {
+  // Only the local uploader uses the writer threads, the others ignore them
+  SpoolerDefinition definition = TestFixture::GetSpoolerDefinition();
+  definition.number_of_local_writers = 4;
+  definition.local_sync_mode = SpoolerDefinition::kLocalSyncSession;
+  this->uploader_->TearDown();
+  delete this->uploader_;
+  this->uploader_ = AbstractUploader::Construct(definition);
+  ASSERT_NE(static_cast<AbstractUploader*>(NULL), this->uploader_);
+
+  const std::string small_file_path = TestFixture::GetSmallFile();
+  const unsigned kNumFiles = 50;
+  for (unsigned i = 0; i < kNumFiles; ++i) {
+    this->uploader_->Upload(small_file_path, "file" + StringifyInt(i),
+                            AbstractUploader::MakeClosure(
+                                &UploadCallbacks::SimpleUploadClosure,
+                                &this->delegate_,
+                                UploaderResults(0, small_file_path)));
+  }
+
+  const unsigned kNumStreams = 20;
+  std::vector<shash::Any> hashes;
+  std::vector<CharBuffer *> buffers;
+  for (unsigned i = 0; i < kNumStreams; ++i) {
+    typename TestFixture::Buffers stream_buffers =
+        TestFixture::MakeRandomizedBuffers(1, i);
+    buffers.push_back(stream_buffers[0]);
+    shash::Any content_hash(shash::kSha1);
+    content_hash.Randomize(1000 + i);
+    hashes.push_back(content_hash);
+
+    UploadStreamHandle *handle = this->uploader_->InitStreamedUpload(
+        AbstractUploader::MakeClosure(&UploadCallbacks::StreamedUploadComplete,
+                                      &this->delegate_,
+                                      0));
+    ASSERT_NE(static_cast<UploadStreamHandle*>(NULL), handle);
+    this->uploader_->ScheduleUpload(handle, buffers[i],
+                                    AbstractUploader::MakeClosure(
+                                        &UploadCallbacks::BufferUploadComplete,
+                                        &this->delegate_,
+                                        UploaderResults(0, buffers[i])));
+    this->uploader_->ScheduleCommit(handle, content_hash);
+  }
+  this->uploader_->WaitForUpload();
+  EXPECT_TRUE(this->uploader_->FinalizeSession(false, "", ""));
+
+  EXPECT_EQ(kNumFiles, this->delegate_.simple_upload_invocations);
+  EXPECT_EQ(kNumStreams, this->delegate_.buffer_upload_complete_invocations);
+  EXPECT_EQ(kNumStreams,
+            this->delegate_.streamed_upload_complete_invocations);
+  EXPECT_EQ(0u, this->uploader_->GetNumberOfErrors());
+  for (unsigned i = 0; i < kNumFiles; ++i)
+    EXPECT_TRUE(TestFixture::CheckFile("file" + StringifyInt(i)));
+  for (unsigned i = 0; i < kNumStreams; ++i) {
+    const std::string dest = "data/" + hashes[i].MakePath();
+    EXPECT_TRUE(TestFixture::CheckFile(dest));
+    TestFixture::CompareBuffersAndFileContents(
+        typename TestFixture::Buffers(1, buffers[i]),
+        TestFixture::AbsoluteDestinationPath(dest));
+  }
+  TestFixture::FreeBuffers(&buffers);
+}
+
+
+//------------------------------------------------------------------------------
+
+
 TYPED_TEST(T_Uploaders, PlaceBootstrappingShortcut) {
   if (TestFixture::IsS3()) {
     SUCCEED();  // TODO(rmeusel): enable this as soon as the feature is
@@ -416,3 +416,115 @@ TEST(T_UtilConcurrency, Signal) {
     pthread_join(thread_signal, NULL);
   }
 }
+
+
+static void *MainCompletion(void *data) {
+  Completion *completion = reinterpret_cast<Completion *>(data);
+  completion->Fire();
+  return 0;
+}
+
+TEST(T_UtilConcurrency, Completion) {
+  pthread_t thread_completion;
+  for (unsigned i = 0; i < 1000; ++i) {
+    Completion completion;
+    int retval =
+      pthread_create(&thread_completion, NULL, MainCompletion, &completion);
+    assert(retval == 0);
+    completion.Wait();
+    pthread_join(thread_completion, NULL);
+  }
+
+  // Fired before waiting
+  Completion completion;
+  completion.Fire();
+  completion.Wait();
+}
+
+
+struct CompletionPingPong {
+  CompletionPingPong() : value(0) { }
+  Completion ping;
+  Completion pong;
+  int value;
+};
+
+static void *MainCompletionPingPong(void *data) {
+  CompletionPingPong *p = reinterpret_cast<CompletionPingPong *>(data);
+  for (unsigned i = 0; i < 10000; ++i) {
+    p->ping.Wait();
+    p->value++;
+    p->pong.Fire();
+  }
+  return 0;
+}
+
+TEST(T_UtilConcurrency, CompletionReuse) {
+  CompletionPingPong ping_pong;
+  pthread_t thread_pong;
+  int retval = pthread_create(&thread_pong, NULL, MainCompletionPingPong,
+                              &ping_pong);
+  assert(retval == 0);
+  for (int i = 0; i < 10000; ++i) {
+    EXPECT_EQ(i, ping_pong.value);
+    ping_pong.ping.Fire();
+    ping_pong.pong.Wait();
+  }
+  pthread_join(thread_pong, NULL);
+  EXPECT_EQ(10000, ping_pong.value);
+}
+
+
+struct StripedRwLockData {
+  StripedRwLockData() : lock(NULL), in_write(NULL), violations(0) { }
+  StripedRwLock *lock;
+  atomic_int32 *in_write;
+  atomic_int32 violations;
+};
+
+static void *MainStripedRwLock(void *data) {
+  StripedRwLockData *d = reinterpret_cast<StripedRwLockData *>(data);
+  for (unsigned i = 0; i < 1000; ++i) {
+    if ((i % 10) == 0) {
+      d->lock->WriteLock();
+      if (atomic_xadd32(d->in_write, 1) != 0)
+        atomic_inc32(&d->violations);
+      atomic_dec32(d->in_write);
+      d->lock->Unlock();
+    } else {
+      d->lock->ReadLock();
+      if (atomic_read32(d->in_write) != 0)
+        atomic_inc32(&d->violations);
+      d->lock->Unlock();
+    }
+  }
+  return NULL;
+}
+
+TEST(T_UtilConcurrency, StripedRwLock) {
+  StripedRwLock lock;
+  // Readers share the lock
+  lock.ReadLock();
+  lock.ReadLock();
+  lock.Unlock();
+  lock.Unlock();
+  lock.WriteLock();
+  lock.Unlock();
+
+  const unsigned kNumThreads = 8;
+  atomic_int32 in_write;
+  atomic_init32(&in_write);
+  StripedRwLockData data[kNumThreads];
+  pthread_t threads[kNumThreads];
+  for (unsigned i = 0; i < kNumThreads; ++i) {
+    data[i].lock = &lock;
+    data[i].in_write = &in_write;
+    atomic_init32(&data[i].violations);
+    int retval = pthread_create(&threads[i], NULL, MainStripedRwLock, &data[i]);
+    ASSERT_EQ(0, retval);
+  }
+  for (unsigned i = 0; i < kNumThreads; ++i) {
+    pthread_join(threads[i], NULL);
+    EXPECT_EQ(0, atomic_read32(&data[i].violations));
+  }
+}
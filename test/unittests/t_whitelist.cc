@@ -62,4 +62,50 @@ TEST_F(T_Whitelist, ParseWhitelist) {
     reinterpret_cast<const unsigned char *>(text.data()), text.size()));
 }
 
+
+TEST_F(T_Whitelist, VerifiedCache) {
+  Whitelist::ClearVerifiedCache();
+  shash::Any key(shash::kSha1);
+  key.Randomize(1);
+  Whitelist::VerifiedEntry entry;
+  EXPECT_FALSE(Whitelist::LookupVerified(key, &entry));
+
+  Whitelist::VerifiedEntry verified;
+  shash::Any fingerprint(shash::kSha1);
+  fingerprint.Randomize(2);
+  verified.fingerprints.push_back(fingerprint);
+  verified.expires = time(NULL) + 7200;
+  verified.valid_until = time(NULL) + 60;
+  verified.verification_flags = Whitelist::kFlagVerifyRsa;
+  Whitelist::StoreVerified(key, verified);
+  EXPECT_TRUE(Whitelist::LookupVerified(key, &entry));
+  ASSERT_EQ(1U, entry.fingerprints.size());
+  EXPECT_EQ(fingerprint, entry.fingerprints[0]);
+  EXPECT_EQ(verified.expires, entry.expires);
+  EXPECT_EQ(Whitelist::kFlagVerifyRsa, entry.verification_flags);
+
+  shash::Any other_key(shash::kSha1);
+  other_key.Randomize(3);
+  EXPECT_FALSE(Whitelist::LookupVerified(other_key, &entry));
+
+  // Outdated entries are dropped
+  verified.valid_until = time(NULL) - 1;
+  Whitelist::StoreVerified(other_key, verified);
+  EXPECT_FALSE(Whitelist::LookupVerified(other_key, &entry));
+  EXPECT_TRUE(Whitelist::LookupVerified(key, &entry));
+
+  // The cache is bounded
+  for (unsigned i = 0; i < 2 * Whitelist::kVerifiedCacheMaxEntries; ++i) {
+    shash::Any k(shash::kSha1);
+    k.Randomize(100 + i);
+    verified.valid_until = time(NULL) + 60;
+    Whitelist::StoreVerified(k, verified);
+  }
+  EXPECT_LE(Whitelist::verified_cache_.size(),
+            Whitelist::kVerifiedCacheMaxEntries);
+
+  Whitelist::ClearVerifiedCache();
+  EXPECT_FALSE(Whitelist::LookupVerified(key, &entry));
+}
+
 }  // namespace whitelist
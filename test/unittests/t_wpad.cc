@@ -4,6 +4,13 @@
 
 #include <gtest/gtest.h>
 
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "util/posix.h"
 #include "wpad.h"
 
 using namespace std;  // NOLINT
@@ -11,12 +18,51 @@ using namespace std;  // NOLINT
 class T_Wpad : public ::testing::Test {
  protected:
   virtual void SetUp() {
+    const char *http_env = getenv("http_proxy");
+    saved_http_env_ = (http_env == NULL) ? "" : http_env;
+    setenv("http_proxy", "http://discovered:3128", 1);
+    cache_path_ = CreateTempPath("./cvmfs_ut_wpad", 0600);
+    ASSERT_FALSE(cache_path_.empty());
   }
 
   virtual void TearDown() {
+    if (saved_http_env_.empty())
+      unsetenv("http_proxy");
+    else
+      setenv("http_proxy", saved_http_env_.c_str(), 1);
+    unlink(cache_path_.c_str());
+    unlink((cache_path_ + ".description").c_str());
   }
+
+  string saved_http_env_;
+  string cache_path_;
 };
 
 
 TEST_F(T_Wpad, Init) {
 }
+
+
+TEST_F(T_Wpad, CachedDiscovery) {
+  EXPECT_EQ("http://discovered:3128;DIRECT", download::ResolveProxyDescription(
+    "auto;DIRECT", cache_path_, NULL, 3600));
+  int fd = open(cache_path_.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  string content;
+  EXPECT_TRUE(SafeReadToString(fd, &content));
+  close(fd);
+  EXPECT_EQ("http://discovered:3128;DIRECT", content);
+
+  ASSERT_TRUE(SafeWriteToFile("http://cached:3128;DIRECT", cache_path_, 0600));
+  EXPECT_EQ("http://cached:3128;DIRECT", download::ResolveProxyDescription(
+    "auto;DIRECT", cache_path_, NULL, 3600));
+  // Cached result of another proxy description
+  EXPECT_EQ("http://discovered:3128", download::ResolveProxyDescription(
+    "auto", cache_path_, NULL, 3600));
+
+  ASSERT_TRUE(SafeWriteToFile("http://cached:3128", cache_path_, 0600));
+  EXPECT_EQ("http://discovered:3128", download::ResolveProxyDescription(
+    "auto", cache_path_, NULL, 0));
+  EXPECT_EQ("http://discovered:3128", download::ResolveProxyDescription(
+    "auto", "", NULL, 3600));
+}
@@ -396,7 +396,7 @@ class MockCatalog : public MockObjectStorage<MockCatalog> {
     root_path_(root_path), catalog_hash_(catalog_hash),
     catalog_size_(catalog_size), revision_(revision),
     last_modified_(last_modified), is_root_(is_root),
-    owns_database_file_(false)
+    owns_database_file_(false), last_access_(0)
   {
     if (this->catalog_hash_.IsNull()) {
       this->catalog_hash_.Randomize();
@@ -409,7 +409,7 @@ class MockCatalog : public MockObjectStorage<MockCatalog> {
     string name = root_path.substr(pos + 1, string::npos);
     File mountpoint_file(shash::Any(), 4096, parent_path, name);
     files_.push_back(mountpoint_file);
-    ++MockCatalog::instances;
+    __sync_fetch_and_add(&MockCatalog::instances, 1);
   }
 
   MockCatalog(const MockCatalog &other) :
@@ -417,15 +417,16 @@ class MockCatalog : public MockObjectStorage<MockCatalog> {
     root_path_(other.root_path_), catalog_hash_(other.catalog_hash_),
     catalog_size_(other.catalog_size_), revision_(other.revision_),
     last_modified_(other.last_modified_), is_root_(other.is_root_),
-    owns_database_file_(false), active_children_(other.active_children_),
+    owns_database_file_(false), last_access_(0),
+    active_children_(other.active_children_),
     children_(other.children_), files_(other.files_),
     chunks_(other.chunks_)
   {
-    ++MockCatalog::instances;
+    __sync_fetch_and_add(&MockCatalog::instances, 1);
   }
 
   ~MockCatalog() {
-    --MockCatalog::instances;
+    __sync_fetch_and_sub(&MockCatalog::instances, 1);
   }
 
   /**
@@ -463,6 +464,7 @@ class MockCatalog : public MockObjectStorage<MockCatalog> {
   bool FindNested(const PathString &mountpoint,
                    shash::Any *hash, uint64_t *size) const;
   uint64_t GetTTL() const { return 0; }
+  void CountLookup() const { }
   bool LookupRawSymlink(const PathString &path,
                                 LinkString *raw_symlink) const { return false; }
   bool LookupPath(const PathString &path,
@@ -472,6 +474,11 @@ class MockCatalog : public MockObjectStorage<MockCatalog> {
 
   bool GetVOMSAuthz(std::string *authz) { return false; }
 
+  void Touch(const uint64_t now) const { last_access_ = now; }
+  uint64_t last_access() const { return last_access_; }
+  bool HasOpenStreams() const { return false; }
+  uint64_t GetMemoryUsage() const { return catalog_size_; }
+
  protected:
   // silence coverity
   MockCatalog& operator= (const MockCatalog &other);
@@ -550,6 +557,7 @@ class MockCatalog : public MockObjectStorage<MockCatalog> {
   const time_t        last_modified_;
   const bool          is_root_;
   bool                owns_database_file_;
+  mutable uint64_t    last_access_;
   NestedCatalogList   active_children_;
   NestedCatalogList   children_;
   FileList            files_;
@@ -562,6 +570,7 @@ class MockCatalog : public MockObjectStorage<MockCatalog> {
 
 namespace catalog {
 
+class AccessProfile;
 template <class CatalogMgrT>
 class CatalogBalancer;
 
@@ -571,7 +580,7 @@ class MockCatalogManager : public AbstractCatalogManager<MockCatalog> {
   explicit MockCatalogManager(perf::Statistics *statistics) :
     AbstractCatalogManager<MockCatalog>(statistics), spooler_(new Spooler()),
     max_weight_(5), min_weight_(1), balance_weight_(3),
-    autogenerated_catalogs_(0), num_added_files_(0) { }
+    autogenerated_catalogs_(0), num_added_files_(0), access_profile_(NULL) { }
 
   virtual ~MockCatalogManager() { delete spooler_; }
 
@@ -641,6 +650,7 @@ class MockCatalogManager : public AbstractCatalogManager<MockCatalog> {
   unsigned balance_weight_;
   unsigned autogenerated_catalogs_;
   unsigned num_added_files_;
+  const AccessProfile *access_profile_;
 };
 
 }  // namespace catalog
@@ -712,6 +722,9 @@ class MockHistory : public history::History,
                                   std::vector<Tag>   *tags) const;
 
   bool GetHashes(std::vector<shash::Any> *hashes) const;
+  bool ListTagChanges(const uint64_t since_serial,
+                      std::vector<std::string> *names,
+                      uint64_t *last_serial) const { return false; }
 
   bool Vacuum() { return true; }
   void TakeDatabaseFileOwnership() { owns_database_file_ = true;  }